@@ -0,0 +1,437 @@
+#include "AllocationTracker.h"
+
+#include <Windows.h>
+#include <DbgHelp.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+#if ALLOCATION_TRACKER_CALL_SITES
+#pragma comment(lib, "dbghelp.lib")
+#endif
+
+// Every thread's, since the process started
+static std::atomic<unsigned long long> totalAllocations(0);
+static std::atomic<unsigned long long> totalFrees(0);
+static std::atomic<unsigned long long> totalBytes(0);
+static std::atomic<unsigned long long> liveBytes(0);
+
+// Only this thread's, so there's nothing to synchronize
+static thread_local AllocationCounts threadCounts = {};
+
+// Only touched by EndFrame() and the UI (both on the main thread)
+static AllocationCounts frameStart = {};
+static AllocationCounts lastFrame = {};
+static unsigned long long history[ALLOCATION_TRACKER_FRAMES] = {};
+static unsigned long long historyCount = 0;
+
+// One stack that's allocated, and how much (the table's zeroed before
+// anything runs, so an unclaimed slot's hash is 0)
+struct CallSiteSlot
+{
+	std::atomic<unsigned long long> Hash;
+	std::atomic<bool> Ready;	// Once its frames are written
+	void* Frames[ALLOCATION_TRACKER_STACK_DEPTH];
+	unsigned int FrameCount;
+	std::atomic<unsigned long long> Allocations;
+	std::atomic<unsigned long long> Bytes;
+
+	// Kept by EndFrame()
+	unsigned long long FrameStartAllocations;
+	unsigned long long FrameStartBytes;
+	unsigned long long LastFrameAllocations;
+	unsigned long long LastFrameBytes;
+};
+
+#if ALLOCATION_TRACKER_CALL_SITES
+static CallSiteSlot callSites[ALLOCATION_TRACKER_MAX_CALL_SITES];
+#endif
+static std::atomic<bool> captureCallSites(false);
+static std::atomic<unsigned long long> untrackedCallSites(0);
+
+void* AllocationTracker::Allocate(size_t size)
+{
+	// The same size Free() gets back from _msize()
+	size = size > 0 ? size : 1;
+	void* memory = malloc(size);
+	if (!memory)
+		return 0;
+
+	Track(size);
+	return memory;
+}
+
+void AllocationTracker::Free(void* memory)
+{
+	if (!memory)
+		return;
+
+	Untrack(_msize(memory));
+	free(memory);
+}
+
+// The same, for over-aligned types, which the CRT keeps in a heap of their own
+void* AllocationTracker::AllocateAligned(size_t size, size_t alignment)
+{
+	size = size > 0 ? size : 1;
+	void* memory = _aligned_malloc(size, alignment);
+	if (!memory)
+		return 0;
+
+	Track(size);
+	return memory;
+}
+
+void AllocationTracker::FreeAligned(void* memory, size_t alignment)
+{
+	if (!memory)
+		return;
+
+	Untrack(_aligned_msize(memory, alignment, 0));
+	_aligned_free(memory);
+}
+
+void AllocationTracker::Track(size_t size)
+{
+	threadCounts.Allocations++;
+	threadCounts.Bytes += size;
+	totalAllocations.fetch_add(1, std::memory_order_relaxed);
+	totalBytes.fetch_add(size, std::memory_order_relaxed);
+	liveBytes.fetch_add(size, std::memory_order_relaxed);
+
+#if ALLOCATION_TRACKER_CALL_SITES
+	if (captureCallSites.load(std::memory_order_relaxed))
+		RecordCallSite(size);
+#endif
+}
+
+void AllocationTracker::Untrack(size_t size)
+{
+	threadCounts.Frees++;
+	totalFrees.fetch_add(1, std::memory_order_relaxed);
+	liveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+AllocationCounts AllocationTracker::GetThreadCounts()
+{
+	return threadCounts;
+}
+
+AllocationCounts AllocationTracker::GetTotals()
+{
+	AllocationCounts totals;
+	totals.Allocations = totalAllocations.load(std::memory_order_relaxed);
+	totals.Frees = totalFrees.load(std::memory_order_relaxed);
+	totals.Bytes = totalBytes.load(std::memory_order_relaxed);
+	return totals;
+}
+
+void AllocationTracker::EndFrame()
+{
+	AllocationCounts now = GetTotals();
+	lastFrame.Allocations = now.Allocations - frameStart.Allocations;
+	lastFrame.Frees = now.Frees - frameStart.Frees;
+	lastFrame.Bytes = now.Bytes - frameStart.Bytes;
+	frameStart = now;
+	history[historyCount++ % ALLOCATION_TRACKER_FRAMES] = lastFrame.Allocations;
+
+#if ALLOCATION_TRACKER_CALL_SITES
+	if (!captureCallSites.load(std::memory_order_relaxed))
+		return;
+
+	for (CallSiteSlot& slot : callSites)
+	{
+		if (slot.Hash.load(std::memory_order_relaxed) == 0)
+			continue;
+
+		unsigned long long allocations = slot.Allocations.load(std::memory_order_relaxed);
+		unsigned long long bytes = slot.Bytes.load(std::memory_order_relaxed);
+		slot.LastFrameAllocations = allocations - slot.FrameStartAllocations;
+		slot.LastFrameBytes = bytes - slot.FrameStartBytes;
+		slot.FrameStartAllocations = allocations;
+		slot.FrameStartBytes = bytes;
+	}
+#endif
+}
+
+AllocationCounts AllocationTracker::GetLastFrame()
+{
+	return lastFrame;
+}
+
+unsigned long long AllocationTracker::GetLiveBytes()
+{
+	return liveBytes.load(std::memory_order_relaxed);
+}
+
+unsigned long long AllocationTracker::GetLiveAllocations()
+{
+	return totalAllocations.load(std::memory_order_relaxed) - totalFrees.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::GetHistory(std::vector<float>& allocations)
+{
+	allocations.clear();
+	unsigned long long first = historyCount > ALLOCATION_TRACKER_FRAMES ? historyCount - ALLOCATION_TRACKER_FRAMES : 0;
+	for (unsigned long long i = first; i < historyCount; i++)
+		allocations.push_back((float)history[i % ALLOCATION_TRACKER_FRAMES]);
+}
+
+bool AllocationTracker::GetCaptureCallSites()
+{
+	return captureCallSites.load();
+}
+
+void AllocationTracker::SetCaptureCallSites(bool capture)
+{
+	captureCallSites = capture && CallSitesCompiled();
+}
+
+unsigned long long AllocationTracker::GetUntrackedCallSiteAllocations()
+{
+	return untrackedCallSites.load(std::memory_order_relaxed);
+}
+
+// --------------------------------------------------------
+// Hashes the stack, and counts it in the first slot that's
+// either its own or free (claiming it), looking a little
+// way past where it lands before giving up
+// --------------------------------------------------------
+void AllocationTracker::RecordCallSite(size_t size)
+{
+#if ALLOCATION_TRACKER_CALL_SITES
+	void* frames[ALLOCATION_TRACKER_STACK_DEPTH];
+	unsigned int frameCount = CaptureStackBackTrace(1, ALLOCATION_TRACKER_STACK_DEPTH, frames, 0);
+
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned int i = 0; i < frameCount; i++)
+		hash = (hash ^ (unsigned long long)frames[i]) * 1099511628211ull;
+	hash = hash != 0 ? hash : 1;
+
+	for (unsigned int probe = 0; probe < 32; probe++)
+	{
+		CallSiteSlot& slot = callSites[(hash + probe) % ALLOCATION_TRACKER_MAX_CALL_SITES];
+		unsigned long long slotHash = slot.Hash.load(std::memory_order_acquire);
+		if (slotHash == 0 && slot.Hash.compare_exchange_strong(slotHash, hash))
+		{
+			memcpy(slot.Frames, frames, sizeof(void*) * frameCount);
+			slot.FrameCount = frameCount;
+			slot.Ready.store(true, std::memory_order_release);
+			slotHash = hash;
+		}
+
+		if (slotHash == hash)
+		{
+			slot.Allocations.fetch_add(1, std::memory_order_relaxed);
+			slot.Bytes.fetch_add(size, std::memory_order_relaxed);
+			return;
+		}
+	}
+	untrackedCallSites.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+// --------------------------------------------------------
+// Names the biggest call sites' frames (each address only
+// once ever, since it never moves), and picks the first
+// that's actually the program's as where it's from
+// --------------------------------------------------------
+void AllocationTracker::GetCallSites(std::vector<AllocationCallSite>& sites, bool lastFrameOnly, unsigned int maxCount)
+{
+	sites.clear();
+#if ALLOCATION_TRACKER_CALL_SITES
+	// Counted once, since they can change while they're sorted
+	std::vector<std::pair<unsigned long long, CallSiteSlot*>> found;
+	for (CallSiteSlot& slot : callSites)
+	{
+		if (!slot.Ready.load(std::memory_order_acquire))
+			continue;
+		unsigned long long count = lastFrameOnly ? slot.LastFrameAllocations : slot.Allocations.load(std::memory_order_relaxed);
+		if (count > 0)
+			found.push_back({ count, &slot });
+	}
+
+	std::sort(found.begin(), found.end(), [](const std::pair<unsigned long long, CallSiteSlot*>& a, const std::pair<unsigned long long, CallSiteSlot*>& b) { return a.first > b.first; });
+	if (found.size() > maxCount)
+		found.resize(maxCount);
+
+	// DbgHelp isn't thread safe, and the names are kept
+	static std::mutex symbolMutex;
+	static std::unordered_map<void*, std::pair<std::string, bool>> names;
+	static bool symbolsLoaded = false;
+	std::lock_guard<std::mutex> lock(symbolMutex);
+	if (!symbolsLoaded)
+	{
+		SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS | SYMOPT_LOAD_LINES);
+		SymInitialize(GetCurrentProcess(), 0, TRUE);
+		symbolsLoaded = true;
+	}
+
+	for (auto& entry : found)
+	{
+		CallSiteSlot* slot = entry.second;
+		AllocationCallSite site;
+		site.Allocations = entry.first;
+		site.Bytes = lastFrameOnly ? slot->LastFrameBytes : slot->Bytes.load(std::memory_order_relaxed);
+		site.TotalAllocations = slot->Allocations.load(std::memory_order_relaxed);
+
+		for (unsigned int i = 0; i < slot->FrameCount; i++)
+		{
+			auto name = names.find(slot->Frames[i]);
+			if (name == names.end())
+			{
+				bool internal = false;
+				std::string description = DescribeFrame(slot->Frames[i], internal);
+				name = names.insert({ slot->Frames[i], { description, internal } }).first;
+			}
+
+			site.Stack.push_back(name->second.first);
+			if (site.Location.empty() && !name->second.second)
+				site.Location = name->second.first;
+		}
+		if (site.Location.empty() && !site.Stack.empty())
+			site.Location = site.Stack.back();
+		sites.push_back(site);
+	}
+#endif
+}
+
+// The function (and line, when there are symbols for it), and whether
+// it's only the allocator or the standard library
+std::string AllocationTracker::DescribeFrame(void* address, bool& internal)
+{
+	internal = false;
+#if ALLOCATION_TRACKER_CALL_SITES
+	HANDLE process = GetCurrentProcess();
+	char symbolBuffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME] = {};
+	SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(symbolBuffer);
+	symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+	symbol->MaxNameLen = MAX_SYM_NAME;
+
+	char description[MAX_SYM_NAME + MAX_PATH];
+	DWORD64 displacement = 0;
+	if (!SymFromAddr(process, (DWORD64)address, &displacement, symbol))
+	{
+		sprintf_s(description, "0x%p", address);
+		return description;
+	}
+
+	const char* internalPrefixes[] = { "operator new", "AllocationTracker::", "std::", "malloc", "_malloc" };
+	for (const char* prefix : internalPrefixes)
+		internal = internal || strncmp(symbol->Name, prefix, strlen(prefix)) == 0;
+
+	IMAGEHLP_LINE64 line = {};
+	line.SizeOfStruct = sizeof(line);
+	DWORD lineDisplacement = 0;
+	if (SymGetLineFromAddr64(process, (DWORD64)address, &lineDisplacement, &line))
+	{
+		const char* file = line.FileName;
+		for (const char* c = line.FileName; *c; c++)
+			if (*c == '\\' || *c == '/') file = c + 1;
+		sprintf_s(description, "%s (%s:%lu)", symbol->Name, file, line.LineNumber);
+	}
+	else
+	{
+		sprintf_s(description, "%s", symbol->Name);
+	}
+	return description;
+#else
+	return std::string();
+#endif
+}
+
+// --------------------------------------------------------
+// Every form of new and delete, through the tracker (a
+// replacement of the global one only needs defining once,
+// anywhere in the program)
+//  - The aligned forms only exist with aligned new (C++17,
+//    or /Zc:alignedNew), and without it over-aligned types
+//    just get new's usual alignment, through the tracker
+// --------------------------------------------------------
+#if ALLOCATION_TRACKER_ENABLED
+void* operator new(size_t size)
+{
+	for (;;)
+	{
+		void* memory = AllocationTracker::Allocate(size);
+		if (memory)
+			return memory;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	try { return operator new(size); }
+	catch (...) { return 0; }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	try { return operator new(size); }
+	catch (...) { return 0; }
+}
+
+void operator delete(void* memory) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, size_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, size_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { AllocationTracker::Free(memory); }
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	for (;;)
+	{
+		void* memory = AllocationTracker::AllocateAligned(size, (size_t)alignment);
+		if (memory)
+			return memory;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	try { return operator new(size, alignment); }
+	catch (...) { return 0; }
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	try { return operator new(size, alignment); }
+	catch (...) { return 0; }
+}
+
+void operator delete(void* memory, std::align_val_t alignment) noexcept { AllocationTracker::FreeAligned(memory, (size_t)alignment); }
+void operator delete[](void* memory, std::align_val_t alignment) noexcept { AllocationTracker::FreeAligned(memory, (size_t)alignment); }
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept { AllocationTracker::FreeAligned(memory, (size_t)alignment); }
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept { AllocationTracker::FreeAligned(memory, (size_t)alignment); }
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept { AllocationTracker::FreeAligned(memory, (size_t)alignment); }
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept { AllocationTracker::FreeAligned(memory, (size_t)alignment); }
+#endif
+#endif
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Set to 0 (in the project, or before this is included) to leave the
+// global operator new and delete alone entirely
+#ifndef ALLOCATION_TRACKER_ENABLED
+#define ALLOCATION_TRACKER_ENABLED 1
+#endif
+
+// Where allocations come from (a stack walk for each one, when it's
+// turned on), which is only compiled into debug builds by default
+#ifndef ALLOCATION_TRACKER_CALL_SITES
+#ifdef _DEBUG
+#define ALLOCATION_TRACKER_CALL_SITES 1
+#else
+#define ALLOCATION_TRACKER_CALL_SITES 0
+#endif
+#endif
+
+// How many frames of counts are kept for the graph
+#define ALLOCATION_TRACKER_FRAMES			120
+
+// How many different call sites are kept apart (any more are only
+// counted), how much of each stack is kept, and how many the UI lists
+#define ALLOCATION_TRACKER_MAX_CALL_SITES	2048
+#define ALLOCATION_TRACKER_STACK_DEPTH		16
+#define ALLOCATION_TRACKER_TOP_COUNT		50
+
+// Counts since whenever they're from
+struct AllocationCounts
+{
+	unsigned long long Allocations;
+	unsigned long long Frees;
+	unsigned long long Bytes;	// Allocated, not freed
+};
+
+// One place that allocates, and how much
+struct AllocationCallSite
+{
+	std::string Location;				// The first frame that isn't the allocator or the standard library
+	std::vector<std::string> Stack;		// Innermost first
+	unsigned long long Allocations;		// In the last frame
+	unsigned long long Bytes;
+	unsigned long long TotalAllocations;	// Ever
+};
+
+// --------------------------------------------------------
+// Counts every heap allocation made through new and delete
+//  - Everything's static (and constant initialized), since
+//    operator new can be called before anything else is
+//    constructed, and a singleton's made with new
+//  - Each thread keeps its own counts, which profiler
+//    scopes read at each end to get what was allocated
+//    inside them, and the process wide counts are relaxed
+//    atomic adds
+//  - EndFrame() keeps the frame that just finished, for
+//    the UI and for benchmark reports
+//  - With call sites compiled in (and turned on), each
+//    allocation's stack is hashed into a fixed table,
+//    which is only turned into names when it's looked at
+// --------------------------------------------------------
+class AllocationTracker
+{
+public:
+	// Called by the replaced operator new and delete (and their aligned
+	// forms, which have to be freed with the alignment they were made with)
+	static void* Allocate(size_t size);
+	static void Free(void* memory);
+	static void* AllocateAligned(size_t size, size_t alignment);
+	static void FreeAligned(void* memory, size_t alignment);
+
+	// This thread's, and every thread's, since the process started
+	static AllocationCounts GetThreadCounts();
+	static AllocationCounts GetTotals();
+
+	// Marks the end of a frame (on the main thread, once a frame)
+	static void EndFrame();
+	static AllocationCounts GetLastFrame();
+
+	// What's allocated right now, and how many objects that is
+	static unsigned long long GetLiveBytes();
+	static unsigned long long GetLiveAllocations();
+
+	// How many allocations each of the last frames made, oldest first
+	static void GetHistory(std::vector<float>& allocations);
+
+	// Walking the stack makes every allocation slower, so it's off until asked for
+	static bool CallSitesCompiled() { return ALLOCATION_TRACKER_CALL_SITES != 0; }
+	static bool GetCaptureCallSites();
+	static void SetCaptureCallSites(bool capture);
+
+	// The call sites that allocated the most (in the last frame, or ever),
+	// biggest first, and how many allocations had no room in the table
+	static void GetCallSites(std::vector<AllocationCallSite>& sites, bool lastFrameOnly, unsigned int maxCount = ALLOCATION_TRACKER_TOP_COUNT);
+	static unsigned long long GetUntrackedCallSiteAllocations();
+
+private:
+	static void Track(size_t size);
+	static void Untrack(size_t size);
+	static void RecordCallSite(size_t size);
+	static std::string DescribeFrame(void* address, bool& internal);
+};
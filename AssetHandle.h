@@ -0,0 +1,60 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+
+// --------------------------------------------------------
+// FNV-1a of an asset's name, exactly as it's written (which
+// is how Assets tells names apart), usable at compile time
+// --------------------------------------------------------
+constexpr unsigned long long HashAssetName(const char* name, size_t length)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)name[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// An asset's name with its hash worked out ahead of time, made
+// with the _asset literal, e.g. Assets::GetInstance().GetPixelShader("SsaoPS.cso"_asset)
+//  - Looking one up doesn't build (or hash) a string, the name
+//    is only read the first time that asset's handle is made
+struct AssetKey
+{
+	unsigned long long Hash;
+	const char* Name;
+	size_t Length;
+};
+
+constexpr AssetKey operator"" _asset(const char* name, size_t length)
+{
+	return { HashAssetName(name, length), name, length };
+}
+
+// --------------------------------------------------------
+// An index into one of Assets' handle tables, which stays
+// valid for as long as Assets is around, even if the asset
+// itself is unloaded (getting it then just gives back null)
+//  - Typed, so a texture's handle can't be used for a mesh
+// --------------------------------------------------------
+template<typename T>
+struct AssetHandle
+{
+	unsigned int Index = UINT_MAX;
+	bool IsValid() const { return Index != UINT_MAX; }
+};
+
+class Mesh;
+class SimplePixelShader;
+class SimpleVertexShader;
+class SimpleComputeShader;
+struct ID3D11ShaderResourceView;
+
+typedef AssetHandle<Mesh> MeshHandle;
+typedef AssetHandle<SimplePixelShader> PixelShaderHandle;
+typedef AssetHandle<SimpleVertexShader> VertexShaderHandle;
+typedef AssetHandle<SimpleComputeShader> ComputeShaderHandle;
+typedef AssetHandle<ID3D11ShaderResourceView> TextureHandle;
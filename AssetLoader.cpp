@@ -1,4 +1,8 @@
 #include "AssetLoader.h"
+#include "GeometryPool.h"
+#include "CpuProfiler.h"
+#include "GpuMemory.h"
+#include "ThreadManager.h"
 
 #define _SILENCE_EXPERIMENTAL_FILESYSTEM_DEPRECATION_WARNING
 #include <experimental/filesystem>
@@ -6,214 +10,1822 @@
 
 #include <DDSTextureLoader.h>
 #include <WICTextureLoader.h>
+#include <objbase.h>
+#include <wincodec.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <fstream>
+
+#include "JobSystem.h"
+#include "LoadProfiler.h"
+
+// Usually from the Windows headers, but not with everything left out
+#ifndef MAKEFOURCC
+#define MAKEFOURCC(a, b, c, d) ((unsigned int)(unsigned char)(a) | ((unsigned int)(unsigned char)(b) << 8) | ((unsigned int)(unsigned char)(c) << 16) | ((unsigned int)(unsigned char)(d) << 24))
+#endif
 
 
 // Singleton requirement
 Assets* Assets::instance;
 
-Assets::~Assets()
+Assets::~Assets()
+{
+	// Nothing can still be loading in the background
+	watcher.Stop();
+	StopStreaming();
+	WriteAccessLog();
+	for (auto& r : reloadedAssets) DeletePending(r);
+	DeleteRetired(true);
+	for (auto& r : textureRequests) delete r.second;
+	for (auto& t : mipTextures) delete t.second;
+
+	// Delete all regular pointers
+	for (auto& m : meshes) delete m.second;
+	for (auto& p : pixelShaders) delete p.second;
+	for (auto& v : vertexShaders) delete v.second;
+	for (auto& c : computeShaders) delete c.second;
+}
+
+
+void Assets::Initialize(std::string rootAssetPath, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->device = device;
+	this->context = context;
+	this->rootAssetPath = rootAssetPath;
+	compactVertices = true;
+	streamTextures = false;
+	uploadBudget = ASSETS_STREAMING_UPLOAD_BUDGET;
+	streamingSequence = 0;
+	streamingRunning = false;
+	streamMips = false;
+	mipBudget = ASSETS_MIP_STREAMING_BUDGET;
+	mipResidentBytes = 0;
+	textureBytes = 0;
+	textureBudget = ASSETS_TEXTURE_BUDGET;
+	streamingFrame = 0;
+	loadOnDemand = false;
+	hotReload = false;
+	reloadCount = 0;
+	reloadFrame = 0;
+
+	// Not having one is fine, that just means the loose files
+	if (pack.Open(GetFullPathTo(ASSET_PACK_FILE)))
+		printf("Using asset pack %s (%u entries)\n", ASSET_PACK_FILE, pack.GetEntryCount());
+}
+
+
+// --------------------------------------------------------
+// Finds every asset and shader, loads them across the job
+// system, then adds each one in the order it was found
+//  - Anything that needs the immediate context (uploading
+//    meshes, generating mips) waits for the main thread, so
+//    the workers only ever use the (free threaded) device
+// --------------------------------------------------------
+void Assets::LoadAllAssets()
+{
+	PROFILE_SCOPE("Assets::LoadAllAssets");
+	if (rootAssetPath.empty())
+		return;
+
+	// Everything's listed in the pack's table of contents, if there is one,
+	// with shaders kept until the end like they are from the exe directory
+	std::vector<PendingAsset> pending;
+	std::vector<PendingAsset> shaders;
+	if (pack.IsOpen())
+	{
+		for (auto& name : pack.GetNames())
+		{
+			PendingAsset asset = {};
+			asset.Path = name;
+			asset.Name = name;
+			asset.Packed = true;
+			if (EndsWith(name, ".cso"))
+			{
+				asset.Type = PendingAssetType::Shader;
+				shaders.push_back(asset);
+			}
+			else if (FindAssetType(asset))
+			{
+				if (streamTextures && asset.Type != PendingAssetType::Mesh)
+					texturePaths.insert({ asset.Name, asset.Path });
+				else
+					pending.push_back(asset);
+			}
+		}
+	}
+	else
+	{
+		// Recursively go through all directories starting at the root
+		for (auto& item : std::experimental::filesystem::recursive_directory_iterator(GetFullPathTo(rootAssetPath)))
+		{
+			// Is this a regular file?
+			if (item.status().type() != std::experimental::filesystem::file_type::regular)
+				continue;
+
+			// Strip out everything before and including the asset root path
+			PendingAsset asset = {};
+			asset.Path = item.path().string();
+			asset.Name = asset.Path.substr(asset.Path.rfind(rootAssetPath) + rootAssetPath.size());
+			if (!FindAssetType(asset))
+				continue;
+
+			// Streamed textures only need to be found for now
+			if (streamTextures && asset.Type != PendingAssetType::Mesh)
+				texturePaths.insert({ asset.Name, asset.Path });
+			else
+				pending.push_back(asset);
+		}
+
+		// Search and load all shaders in the exe directory
+		for (auto& item : std::experimental::filesystem::directory_iterator(GetFullPathTo(".")))
+		{
+			// Assume we're just using the filename for shaders due to being in the .exe path
+			std::string itemPath = item.path().filename().string();
+
+			// Is this a Compiled Shader Object?
+			if (EndsWith(itemPath, ".cso"))
+			{
+				PendingAsset asset = {};
+				asset.Type = PendingAssetType::Shader;
+				asset.Path = itemPath;
+				asset.Name = itemPath;
+				shaders.push_back(asset);
+			}
+		}
+	}
+
+	// Only what the last run asked for loads now, everything else waits to be asked for
+	if (loadOnDemand)
+	{
+		std::unordered_set<std::string> preload;
+		std::ifstream log(GetFullPathTo(ASSETS_ACCESS_LOG));
+		for (std::string line; std::getline(log, line);)
+			preload.insert(line);
+
+		for (auto* list : { &pending, &shaders })
+		{
+			auto indexed = std::stable_partition(list->begin(), list->end(), [&](const PendingAsset& a) { return preload.count(a.Name) > 0; });
+			for (auto it = indexed; it != list->end(); it++)
+				assetIndex.insert({ it->Name, *it });
+			list->erase(indexed, list->end());
+		}
+		printf("Loading %u assets from %s, leaving %u until they're used\n",
+			(unsigned int)(pending.size() + shaders.size()), ASSETS_ACCESS_LOG, (unsigned int)assetIndex.size());
+	}
+
+	size_t firstShader = pending.size();
+	pending.insert(pending.end(), shaders.begin(), shaders.end());
+	bool reflectionCacheLoaded = ISimpleShader::LoadReflectionCache(GetFullPathTo_Wide(ToWideString(ASSETS_SHADER_REFLECTION_CACHE)));
+
+	// Every asset is its own job, since even small ones take a while
+	LoadProfileScope scope("Assets", "LoadAllAssets");
+	auto start = std::chrono::high_resolution_clock::now();
+	JobSystem::GetInstance().ParallelFor((unsigned int)pending.size(), 1, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = first; i < last; i++)
+			LoadPending(pending[i]);
+	});
+	double loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	for (size_t i = 0; i < firstShader; i++)
+		FinishPending(pending[i]);
+
+	// How much the mesh caches saved, compared to importing everything
+	double meshMilliseconds = 0, importMilliseconds = 0;
+	unsigned int cachedMeshes = 0;
+	for (auto& m : meshes)
+	{
+		meshMilliseconds += m.second->GetLoadMilliseconds();
+		importMilliseconds += m.second->GetImportMilliseconds();
+		cachedMeshes += m.second->IsFromCache() ? 1 : 0;
+	}
+	printf("Loaded %u meshes (%u cached) in %.2f ms, saving %.2f ms\n",
+		(unsigned int)meshes.size(), cachedMeshes, meshMilliseconds, importMilliseconds - meshMilliseconds);
+
+	GeometryPool& pool = GeometryPool::GetInstance();
+	if (pool.IsInitialized())
+	{
+		printf("Geometry pool: %u buffer pairs, %.2f of %.2f MB used\n",
+			pool.GetBufferCount(), pool.GetUsedBytes() / (1024.0 * 1024.0), pool.GetCapacityBytes() / (1024.0 * 1024.0));
+	}
+
+	double shaderMilliseconds = 0;
+	for (size_t i = firstShader; i < pending.size(); i++)
+	{
+		FinishPending(pending[i]);
+		shaderMilliseconds += pending[i].ShaderMilliseconds;
+	}
+
+	// How much the reflection cache saved, compared to reflecting everything
+	SimpleShaderReflectionCacheStats reflectionStats = ISimpleShader::GetReflectionCacheStats();
+	printf("Loaded %u shaders in %.2f ms, with %u reflections from the cache%s (saving %.2f ms) and %u reflected (%.2f ms)\n",
+		(unsigned int)(pending.size() - firstShader), shaderMilliseconds, reflectionStats.Hits, reflectionCacheLoaded ? "" : " (none found)",
+		reflectionStats.SavedMilliseconds, reflectionStats.Reflected, reflectionStats.ReflectMilliseconds);
+	ISimpleShader::SaveReflectionCache(GetFullPathTo_Wide(ToWideString(ASSETS_SHADER_REFLECTION_CACHE)));
+
+	printf("Loaded %u assets and shaders across %u workers in %.2f ms\n",
+		(unsigned int)pending.size(), JobSystem::GetInstance().GetWorkerCount(), loadMilliseconds);
+
+	// Pair up each vertex shader with its compact vertex permutation
+	for (auto& v : vertexShaders)
+	{
+		std::string name = v.first.substr(0, v.first.size() - 4);
+		auto compact = vertexShaders.find(name + "_Compact.cso");
+		if (compact != vertexShaders.end())
+			compactVertexShaders.insert({ v.second, compact->second });
+	}
+
+	// Anything requested from here on loads in the background
+	if (streamTextures && !streamingThread.joinable())
+	{
+		streamingRunning = true;
+		streamingThread = std::thread(&Assets::StreamingLoop, this);
+	}
+}
+
+
+
+TextureRequest* Assets::RequestTexture(std::string name, float priority, std::string placeholder, std::function<void(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>)> onLoaded)
+{
+	TextureRequest* request;
+	auto existing = textureRequests.find(name);
+	if (existing != textureRequests.end())
+	{
+		request = existing->second;
+	}
+	else
+	{
+		// Every request shares the same default placeholder
+		if (placeholder.empty())
+		{
+			placeholder = ASSETS_STREAMING_PLACEHOLDER;
+			if (!GetTexture(placeholder))
+				CreateSolidColorTexture(placeholder, 2, 2, DirectX::XMFLOAT4(0.5f, 0.5f, 0.5f, 1));
+		}
+
+		request = new TextureRequest();
+		request->Name = name;
+		request->Priority = priority;
+		request->State = TextureRequestState::Cancelled;
+		request->SRV = GetTexture(placeholder);
+		request->Placeholder = request->SRV;
+		textureRequests.insert({ name, request });
+
+		// Already loaded, or nowhere to load it from
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> loaded = GetTexture(name);
+		if (loaded)
+		{
+			request->SRV = loaded;
+			request->State = TextureRequestState::Loaded;
+		}
+		else if (texturePaths.find(name) == texturePaths.end() || !streamingThread.joinable())
+		{
+			printf("Can't stream texture %s: not found\n", name.c_str());
+			request->State = TextureRequestState::Failed;
+		}
+	}
+
+	// Kept even once it's loaded, since mip streaming and eviction both change the view
+	if (onLoaded)
+	{
+		if (request->State == TextureRequestState::Loaded)
+			onLoaded(request->SRV);
+		request->OnLoaded.push_back(onLoaded);
+	}
+
+	// Queue it up (again, if the priority changed), unless the
+	// background thread already has it
+	if (request->State == TextureRequestState::Loaded || request->State == TextureRequestState::Failed)
+		return request;
+
+	{
+		std::lock_guard<std::mutex> lock(streamingMutex);
+		TextureRequestState state = request->State;
+		if (state == TextureRequestState::Loading || (state == TextureRequestState::Queued && request->Priority == priority))
+			return request;
+
+		request->Priority = priority;
+		request->State = TextureRequestState::Queued;
+		streamingQueue.push_back({ priority, streamingSequence++, request });
+		std::push_heap(streamingQueue.begin(), streamingQueue.end());
+	}
+	streamingCondition.notify_one();
+	return request;
+}
+
+void Assets::CancelRequest(TextureRequest* request)
+{
+	std::lock_guard<std::mutex> lock(streamingMutex);
+	if (request->State == TextureRequestState::Loaded || request->State == TextureRequestState::Failed)
+		return;
+
+	// Anything still in the queue is skipped once it comes up, and
+	// anything loading now is dropped once it's done
+	request->State = TextureRequestState::Cancelled;
+	for (size_t i = 0; i < streamedTextures.size(); i++)
+	{
+		if (streamedTextures[i].Request == request)
+		{
+			streamedTextures.erase(streamedTextures.begin() + i);
+			break;
+		}
+	}
+}
+
+void Assets::WaitForTexture(TextureRequest* request)
+{
+	if (request->State == TextureRequestState::Loaded || request->State == TextureRequestState::Failed)
+		return;
+
+	std::unique_lock<std::mutex> lock(streamingMutex);
+
+	// Not started yet, so take it from the background thread
+	if (request->State != TextureRequestState::Loading)
+	{
+		request->State = TextureRequestState::Loading;
+		lock.unlock();
+		PendingAsset asset = LoadStreamed(request);
+		FinishStreamed(request, asset);
+		return;
+	}
+
+	// Otherwise wait for the background thread to finish it
+	auto finished = streamedTextures.end();
+	streamedCondition.wait(lock, [&]()
+	{
+		finished = std::find_if(streamedTextures.begin(), streamedTextures.end(), [&](const StreamedTexture& s) { return s.Request == request; });
+		return finished != streamedTextures.end();
+	});
+	PendingAsset asset = std::move(finished->Asset);
+	streamedTextures.erase(finished);
+	lock.unlock();
+	FinishStreamed(request, asset);
+}
+
+// --------------------------------------------------------
+// Swaps in finished textures in the order they finished,
+// until the next one would go over the upload budget
+// --------------------------------------------------------
+void Assets::UpdateStreaming()
+{
+	PROFILE_SCOPE("Assets::UpdateStreaming");
+	unsigned long long uploaded = 0;
+	while (true)
+	{
+		StreamedTexture streamed;
+		{
+			std::lock_guard<std::mutex> lock(streamingMutex);
+			if (streamedTextures.empty())
+				break;
+
+			// Texels at 4 bytes each (and a third more for mips) for decoded
+			// images, or the size of the file for ones that are used as they are
+			PendingAsset& next = streamedTextures.front().Asset;
+			unsigned long long bytes = next.FileData.size() + next.PackedSize;
+			Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+			if (next.Type == PendingAssetType::Texture && next.TextureResource && SUCCEEDED(next.TextureResource.As(&texture)))
+			{
+				D3D11_TEXTURE2D_DESC desc;
+				texture->GetDesc(&desc);
+				bytes = (unsigned long long)desc.Width * desc.Height * 4 * 4 / 3;
+			}
+
+			if (uploaded > 0 && uploaded + bytes > uploadBudget)
+				break;
+
+			uploaded += bytes;
+			streamed = std::move(streamedTextures.front());
+			streamedTextures.erase(streamedTextures.begin());
+		}
+
+		FinishStreamed(streamed.Request, streamed.Asset);
+	}
+
+	if (textureBudget > 0)
+		EvictTextures();
+	UpdateMipStreaming(uploaded);
+	streamingFrame++;
+}
+
+unsigned int Assets::GetStreamingCount()
+{
+	std::lock_guard<std::mutex> lock(streamingMutex);
+	unsigned int count = 0;
+	for (auto& r : textureRequests)
+	{
+		TextureRequestState state = r.second->State;
+		count += (state == TextureRequestState::Queued || state == TextureRequestState::Loading) ? 1 : 0;
+	}
+	return count;
+}
+
+// --------------------------------------------------------
+// The background thread, which loads the highest priority
+// request until there aren't any left, then any finer mips
+// that were asked for, then sleeps
+// --------------------------------------------------------
+void Assets::StreamingLoop()
+{
+	CpuProfiler::GetInstance().NameThread("Asset Streaming");
+	ThreadManager::GetInstance().Configure(ThreadRole::Background, "Asset Streaming");
+	while (true)
+	{
+		TextureRequest* request = 0;
+		MipStreamedTexture* mipTexture = 0;
+		unsigned int mip = 0;
+		{
+			std::unique_lock<std::mutex> lock(streamingMutex);
+			streamingCondition.wait(lock, [&]() { return !streamingRunning || !streamingQueue.empty() || !mipQueue.empty(); });
+			if (!streamingRunning)
+			{
+				ThreadManager::GetInstance().Unregister();
+				return;
+			}
+
+			// Textures that aren't here at all are more important than detail
+			if (streamingQueue.empty())
+			{
+				mipTexture = mipQueue.front();
+				mip = mipTexture->LoadingMip;
+				mipQueue.erase(mipQueue.begin());
+			}
+			else
+			{
+				std::pop_heap(streamingQueue.begin(), streamingQueue.end());
+				QueuedTextureRequest next = streamingQueue.back();
+				streamingQueue.pop_back();
+
+				// Skip ones that were cancelled, taken by WaitForTexture()
+				// or queued again at another priority since
+				if (next.Request->State != TextureRequestState::Queued || next.Request->Priority != next.Priority)
+					continue;
+
+				request = next.Request;
+				request->State = TextureRequestState::Loading;
+			}
+		}
+
+		// The path and layout never change once it's streaming, so
+		// they're safe to read here (and a failed read is left empty)
+		if (mipTexture)
+		{
+			StreamedMipLevel level = { mipTexture, mip };
+			if (!ReadDDSMips(texturePaths.find(mipTexture->Request->Name)->second, mipTexture->Layout, mip, mip, level.Data))
+				level.Data.clear();
+
+			std::lock_guard<std::mutex> lock(streamingMutex);
+			streamedMipLevels.push_back(std::move(level));
+			continue;
+		}
+
+		PendingAsset asset = LoadStreamed(request);
+
+		{
+			std::lock_guard<std::mutex> lock(streamingMutex);
+			if (request->State == TextureRequestState::Loading)
+				streamedTextures.push_back({ request, std::move(asset) });
+		}
+		streamedCondition.notify_all();
+	}
+}
+
+void Assets::StopStreaming()
+{
+	if (!streamingThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(streamingMutex);
+		streamingRunning = false;
+	}
+	streamingCondition.notify_all();
+	streamingThread.join();
+}
+
+// Only reads the name and the (unchanging) paths, so it's safe on any thread
+//  - Its texture's created here too, with just the device (which is free
+//    threaded), so the main thread only has to swap it in
+Assets::PendingAsset Assets::LoadStreamed(TextureRequest* request)
+{
+	PendingAsset asset = {};
+	asset.Name = request->Name;
+	asset.Path = texturePaths.find(request->Name)->second;
+	asset.Packed = pack.Contains(asset.Path);
+	asset.Type = EndsWith(asset.Path, ".dds") ? PendingAssetType::DDSTexture : PendingAssetType::Texture;
+
+	// Just the smallest mips for now, if the rest can be streamed
+	if (streamMips && asset.Type == PendingAssetType::DDSTexture)
+	{
+		if (ReadDDSLayout(asset.Path, asset.Layout))
+		{
+			asset.Type = PendingAssetType::StreamedMips;
+			asset.Result = ReadDDSMips(asset.Path, asset.Layout, asset.Layout.BaseMip, asset.Layout.MipCount - 1, asset.FileData) ? S_OK : E_FAIL;
+			if (SUCCEEDED(asset.Result))
+			{
+				LoadProfileScope scope("GPU Create", asset.Name);
+				Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+				asset.Result = CreateMipTexture(asset.Layout, asset.Layout.BaseMip, asset.FileData.data(), asset.Name, texture, asset.SRV);
+				asset.TextureResource = texture;
+			}
+			return asset;
+		}
+	}
+
+	LoadPending(asset);
+	return asset;
+}
+
+void Assets::FinishStreamed(TextureRequest* request, PendingAsset& asset)
+{
+	FinishPending(asset);
+	if (FAILED(asset.Result))
+	{
+		request->State = TextureRequestState::Failed;
+		return;
+	}
+
+	// Back from being evicted (if it was), however it was asked for
+	for (auto it = evictedTextures.begin(); it != evictedTextures.end();)
+		it = it->second == request ? evictedTextures.erase(it) : std::next(it);
+
+	request->SRV = asset.SRV;
+	request->State = TextureRequestState::Loaded;
+	for (auto& onLoaded : request->OnLoaded)
+		onLoaded(asset.SRV);
+
+	if (asset.Type != PendingAssetType::StreamedMips)
+		return;
+
+	// Starts out with just its base mips, until the renderer asks for more
+	MipStreamedTexture* texture = new MipStreamedTexture();
+	texture->Request = request;
+	texture->Layout = asset.Layout;
+	asset.TextureResource.As(&texture->Texture);
+	texture->AllocatedMip = asset.Layout.BaseMip;
+	texture->ResidentMip = asset.Layout.BaseMip;
+	texture->WantedMip = asset.Layout.BaseMip;
+	texture->LastUsedFrame = 0;
+	texture->LoadingMip = UINT_MAX;
+	mipTextures.insert({ request->Name, texture });
+	mipTexturesBySRV.insert({ asset.SRV.Get(), texture });
+	mipResidentBytes += GetMipAllocationSize(texture->Layout, texture->AllocatedMip);
+	TrackTexture(request->Name, asset.SRV.Get(), GetMipAllocationSize(texture->Layout, texture->AllocatedMip), texture->Layout.Format);
+}
+
+
+// --------------------------------------------------------
+// Finds the finest mip a mip streamed texture needs to have
+// about one texel per pixel wherever it's drawn
+// --------------------------------------------------------
+void Assets::RequestTextureDetail(ID3D11ShaderResourceView* srv, float uvPerPixel)
+{
+	MarkTextureUsed(srv);
+	auto it = mipTexturesBySRV.find(srv);
+	if (it == mipTexturesBySRV.end())
+		return;
+
+	// Texels across a pixel at full size, each mip down halving it
+	MipStreamedTexture* texture = it->second;
+	float texelsPerPixel = max(texture->Layout.Width, texture->Layout.Height) * uvPerPixel;
+	unsigned int mip = texelsPerPixel > 1.0f ? (unsigned int)log2f(texelsPerPixel) : 0;
+	mip = min(mip, texture->Layout.BaseMip);
+
+	if (texture->LastUsedFrame != streamingFrame)
+	{
+		texture->LastUsedFrame = streamingFrame;
+		texture->WantedMip = mip;
+	}
+	else
+		texture->WantedMip = min(texture->WantedMip, mip);
+}
+
+void Assets::MarkTextureUsed(ID3D11ShaderResourceView* srv)
+{
+	// Drawn with the view it was evicted to, so it's wanted back
+	auto evicted = evictedTextures.find(srv);
+	if (evicted != evictedTextures.end())
+	{
+		TextureRequest* request = evicted->second;
+		evictedTextures.erase(evicted);
+		RequestTexture(request->Name, request->Priority);
+		return;
+	}
+
+	auto it = textureNamesBySRV.find(srv);
+	if (it != textureNamesBySRV.end())
+		textureMemory[it->second].LastUsedFrame = streamingFrame;
+}
+
+// Adds a finished texture to the dictionary, along with its memory
+void Assets::AddTexture(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	DXGI_FORMAT format;
+	unsigned long long bytes = GetTextureSize(srv.Get(), format);
+	textures.insert({ name, srv });
+	TrackTexture(name, srv.Get(), bytes, format);
+}
+
+// Starts out as just used, so nothing's evicted before it's had a chance to be drawn
+void Assets::TrackTexture(std::string name, ID3D11ShaderResourceView* srv, unsigned long long bytes, DXGI_FORMAT format)
+{
+	auto existing = textureMemory.find(name);
+	if (existing != textureMemory.end())
+		textureBytes -= existing->second.Bytes;
+
+	textureMemory[name] = { bytes, format, streamingFrame };
+	textureNamesBySRV[srv] = name;
+	textureBytes += bytes;
+}
+
+void Assets::UntrackTexture(std::string name, ID3D11ShaderResourceView* srv)
+{
+	textureNamesBySRV.erase(srv);
+	auto it = textureMemory.find(name);
+	if (it == textureMemory.end())
+		return;
+
+	textureBytes -= it->second.Bytes;
+	textureMemory.erase(it);
+}
+
+// --------------------------------------------------------
+// Evicts the least recently drawn streamed textures until
+// everything fits in the budget again, leaving any drawn
+// in the last few frames (so a scene that doesn't fit the
+// budget doesn't thrash)
+//  - Mip streamed textures stay, as they already shrink
+//    to fit their own budget
+// --------------------------------------------------------
+void Assets::EvictTextures()
+{
+	if (textureBytes <= textureBudget)
+		return;
+
+	std::vector<std::pair<unsigned long long, TextureRequest*>> candidates;
+	for (auto& r : textureRequests)
+	{
+		TextureRequest* request = r.second;
+		if (request->State != TextureRequestState::Loaded || request->OnLoaded.empty() || mipTextures.find(request->Name) != mipTextures.end())
+			continue;
+
+		auto memory = textureMemory.find(request->Name);
+		if (memory != textureMemory.end() && memory->second.LastUsedFrame + ASSETS_TEXTURE_EVICT_FRAMES <= streamingFrame)
+			candidates.push_back({ memory->second.LastUsedFrame, request });
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const std::pair<unsigned long long, TextureRequest*>& a, const std::pair<unsigned long long, TextureRequest*>& b) { return a.first < b.first; });
+
+	for (auto& c : candidates)
+	{
+		if (textureBytes <= textureBudget)
+			break;
+
+		// Its own view, so drawing it can be told apart from the placeholder
+		TextureRequest* request = c.second;
+		Microsoft::WRL::ComPtr<ID3D11Resource> placeholder;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> standIn;
+		request->Placeholder->GetResource(placeholder.GetAddressOf());
+		if (FAILED(device->CreateShaderResourceView(placeholder.Get(), 0, standIn.GetAddressOf())))
+			continue;
+
+		ForgetHandle(textureHandles, request->Name);
+		textures.erase(request->Name);
+		UntrackTexture(request->Name, request->SRV.Get());
+		evictedTextures.insert({ standIn.Get(), request });
+
+		request->SRV = standIn;
+		request->State = TextureRequestState::Cancelled;
+		for (auto& onLoaded : request->OnLoaded)
+			onLoaded(standIn);
+	}
+}
+
+// Every mip of every slice, as the bytes the format needs for each
+unsigned long long Assets::GetTextureSize(ID3D11ShaderResourceView* srv, DXGI_FORMAT& format)
+{
+	format = DXGI_FORMAT_UNKNOWN;
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	srv->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&texture)))
+		return 0;
+
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+	format = desc.Format;
+	return GpuMemory::GetTextureBytes(desc);
+}
+
+// --------------------------------------------------------
+// Uploads the mips the background thread finished, then
+// grows each texture that was drawn with more detail than
+// it has by a mip, most detail missing first, evicting the
+// finer mips of others to stay under the budget
+//  - Reallocating copies everything the texture keeps, so
+//    that counts against the upload budget too
+// --------------------------------------------------------
+void Assets::UpdateMipStreaming(unsigned long long uploaded)
+{
+	std::vector<StreamedMipLevel> finished;
+	{
+		std::lock_guard<std::mutex> lock(streamingMutex);
+		finished.swap(streamedMipLevels);
+		for (auto& level : finished)
+			level.Texture->LoadingMip = UINT_MAX;
+	}
+
+	for (auto& level : finished)
+	{
+		MipStreamedTexture* texture = level.Texture;
+
+		// Couldn't be read, so give up on the space it was going into
+		if (level.Data.empty())
+		{
+			ReallocateMips(texture, texture->ResidentMip);
+			continue;
+		}
+
+		// Fills in the next mip, unless it was evicted while loading
+		if (level.Mip + 1 == texture->ResidentMip && level.Mip >= texture->AllocatedMip)
+		{
+			unsigned int mipLevels = texture->Layout.MipCount - texture->AllocatedMip;
+			context->UpdateSubresource(texture->Texture.Get(), D3D11CalcSubresource(level.Mip - texture->AllocatedMip, 0, mipLevels), 0,
+				level.Data.data(), texture->Layout.MipRowPitches[level.Mip], 0);
+			texture->ResidentMip = level.Mip;
+			context->SetResourceMinLOD(texture->Texture.Get(), (float)(texture->ResidentMip - texture->AllocatedMip));
+			uploaded += level.Data.size();
+		}
+
+		QueueNextMip(texture);
+	}
+
+	// Lowering the budget shrinks whatever it can straight away
+	while (mipResidentBytes > mipBudget && EvictMip(0));
+
+	std::vector<MipStreamedTexture*> growing;
+	for (auto& t : mipTextures)
+	{
+		if (t.second->LastUsedFrame == streamingFrame && t.second->WantedMip < t.second->AllocatedMip)
+			growing.push_back(t.second);
+	}
+	std::sort(growing.begin(), growing.end(), [](MipStreamedTexture* a, MipStreamedTexture* b)
+	{
+		return a->AllocatedMip - a->WantedMip > b->AllocatedMip - b->WantedMip;
+	});
+
+	for (MipStreamedTexture* texture : growing)
+	{
+		unsigned long long size = GetMipAllocationSize(texture->Layout, texture->AllocatedMip - 1);
+		if (uploaded > 0 && uploaded + size > uploadBudget)
+			break;
+
+		bool fits = true;
+		unsigned long long growth = size - GetMipAllocationSize(texture->Layout, texture->AllocatedMip);
+		while (fits && mipResidentBytes + growth > mipBudget)
+			fits = EvictMip(texture);
+		if (!fits)
+			continue;
+
+		ReallocateMips(texture, texture->AllocatedMip - 1);
+		QueueNextMip(texture);
+		uploaded += size;
+	}
+}
+
+// --------------------------------------------------------
+// Takes the finest mip of the least recently drawn texture
+// that has more than it was last asked for, without going
+// under its base mips
+// --------------------------------------------------------
+bool Assets::EvictMip(MipStreamedTexture* except)
+{
+	MipStreamedTexture* victim = 0;
+	for (auto& t : mipTextures)
+	{
+		MipStreamedTexture* texture = t.second;
+		bool drawn = texture->LastUsedFrame == streamingFrame;
+		if (texture == except || texture->AllocatedMip >= texture->Layout.BaseMip || (drawn && texture->AllocatedMip >= texture->WantedMip))
+			continue;
+
+		if (!victim || texture->LastUsedFrame < victim->LastUsedFrame ||
+			(texture->LastUsedFrame == victim->LastUsedFrame && texture->AllocatedMip < victim->AllocatedMip))
+			victim = texture;
+	}
+
+	if (!victim)
+		return false;
+
+	ReallocateMips(victim, victim->AllocatedMip + 1);
+	return true;
+}
+
+// --------------------------------------------------------
+// Moves a texture to a new one with a different finest mip,
+// copying over every loaded mip they both have, and hands
+// the new view to everything using the request
+// --------------------------------------------------------
+void Assets::ReallocateMips(MipStreamedTexture* texture, unsigned int allocatedMip)
+{
+	if (allocatedMip == texture->AllocatedMip)
+		return;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> resized;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (FAILED(CreateMipTexture(texture->Layout, allocatedMip, 0, texture->Request->Name, resized, srv)))
+		return;
+
+	unsigned int mipCount = texture->Layout.MipCount;
+	unsigned int residentMip = max(texture->ResidentMip, allocatedMip);
+	for (unsigned int mip = residentMip; mip < mipCount; mip++)
+	{
+		context->CopySubresourceRegion(
+			resized.Get(), D3D11CalcSubresource(mip - allocatedMip, 0, mipCount - allocatedMip), 0, 0, 0,
+			texture->Texture.Get(), D3D11CalcSubresource(mip - texture->AllocatedMip, 0, mipCount - texture->AllocatedMip), 0);
+	}
+	context->SetResourceMinLOD(resized.Get(), (float)(residentMip - allocatedMip));
+
+	mipResidentBytes += GetMipAllocationSize(texture->Layout, allocatedMip);
+	mipResidentBytes -= GetMipAllocationSize(texture->Layout, texture->AllocatedMip);
+	mipTexturesBySRV.erase(texture->Request->SRV.Get());
+	mipTexturesBySRV.insert({ srv.Get(), texture });
+	UntrackTexture(texture->Request->Name, texture->Request->SRV.Get());
+	TrackTexture(texture->Request->Name, srv.Get(), GetMipAllocationSize(texture->Layout, allocatedMip), texture->Layout.Format);
+
+	texture->Texture = resized;
+	texture->AllocatedMip = allocatedMip;
+	texture->ResidentMip = residentMip;
+	texture->Request->SRV = srv;
+	for (auto& onLoaded : texture->Request->OnLoaded)
+		onLoaded(srv);
+}
+
+// One mip at a time, finest missing one first
+void Assets::QueueNextMip(MipStreamedTexture* texture)
+{
+	if (texture->ResidentMip <= texture->AllocatedMip)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(streamingMutex);
+		if (texture->LoadingMip != UINT_MAX)
+			return;
+
+		texture->LoadingMip = texture->ResidentMip - 1;
+		mipQueue.push_back(texture);
+	}
+	streamingCondition.notify_one();
+}
+
+unsigned long long Assets::GetMipAllocationSize(const DDSLayout& layout, unsigned int allocatedMip)
+{
+	unsigned long long size = 0;
+	for (unsigned int mip = allocatedMip; mip < layout.MipCount; mip++)
+		size += layout.MipSizes[mip];
+	return size;
+}
+
+// Created with every mip from the given one down, either from
+// those mips packed one after another or left for copies
+HRESULT Assets::CreateMipTexture(const DDSLayout& layout, unsigned int allocatedMip, const unsigned char* initialData, const std::string& name, Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = max(1u, layout.Width >> allocatedMip);
+	desc.Height = max(1u, layout.Height >> allocatedMip);
+	desc.MipLevels = layout.MipCount - allocatedMip;
+	desc.ArraySize = 1;
+	desc.Format = layout.Format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	std::vector<D3D11_SUBRESOURCE_DATA> subresources;
+	for (unsigned int mip = allocatedMip; initialData && mip < layout.MipCount; mip++)
+	{
+		D3D11_SUBRESOURCE_DATA data = {};
+		data.pSysMem = initialData + (layout.MipOffsets[mip] - layout.MipOffsets[allocatedMip]);
+		data.SysMemPitch = layout.MipRowPitches[mip];
+		subresources.push_back(data);
+	}
+
+	HRESULT hr = GpuMemory::CreateTexture2D(device.Get(), &desc, initialData ? subresources.data() : 0, texture.ReleaseAndGetAddressOf(), GpuMemoryCategory::Textures, name);
+	if (SUCCEEDED(hr))
+		hr = device->CreateShaderResourceView(texture.Get(), 0, srv.ReleaseAndGetAddressOf());
+	return hr;
+}
+
+// --------------------------------------------------------
+// Reads just the headers of a DDS file, to find where each
+// mip is, as long as it's a single 2D texture in a format
+// whose size is known here (and has mips to stream)
+//  - The header's read as raw words, as DDSTextureLoader
+//    keeps its own structs to itself
+// --------------------------------------------------------
+bool Assets::ReadDDSLayout(const std::string& path, DDSLayout& layout)
+{
+	// Magic, DDS_HEADER (124 bytes), then maybe DDS_HEADER_DXT10 (20)
+	unsigned int header[37] = {};
+	if (!ReadAssetBytes(path, 0, 128, (unsigned char*)header) || header[0] != 0x20534444 || header[1] != 124)
+		return false;
+
+	unsigned int flags = header[2];
+	unsigned int pixelFlags = header[20];
+	unsigned int fourCC = header[21];
+	unsigned int caps2 = header[28];
+	unsigned long long dataOffset = 128;
+	if (caps2 & (0x200 | 0x200000))
+		return false;	// Cube map or volume
+
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+	if ((pixelFlags & 0x4) && fourCC == MAKEFOURCC('D', 'X', '1', '0'))
+	{
+		if (!ReadAssetBytes(path, 128, 20, (unsigned char*)&header[32]) || header[33] != 3 || header[35] != 1 || (header[34] & 0x4))
+			return false;	// Not a single 2D texture
+
+		format = (DXGI_FORMAT)header[32];
+		dataOffset = 148;
+	}
+	else if (pixelFlags & 0x4)
+	{
+		switch (fourCC)
+		{
+		case MAKEFOURCC('D', 'X', 'T', '1'): format = DXGI_FORMAT_BC1_UNORM; break;
+		case MAKEFOURCC('D', 'X', 'T', '3'): format = DXGI_FORMAT_BC2_UNORM; break;
+		case MAKEFOURCC('D', 'X', 'T', '5'): format = DXGI_FORMAT_BC3_UNORM; break;
+		case MAKEFOURCC('A', 'T', 'I', '1'): case MAKEFOURCC('B', 'C', '4', 'U'): format = DXGI_FORMAT_BC4_UNORM; break;
+		case MAKEFOURCC('A', 'T', 'I', '2'): case MAKEFOURCC('B', 'C', '5', 'U'): format = DXGI_FORMAT_BC5_UNORM; break;
+		}
+	}
+	else if ((pixelFlags & 0x40) && header[22] == 32 && header[26] == 0xFF000000)
+	{
+		format = header[23] == 0xFF ? DXGI_FORMAT_R8G8B8A8_UNORM : (header[23] == 0xFF0000 ? DXGI_FORMAT_B8G8R8A8_UNORM : DXGI_FORMAT_UNKNOWN);
+	}
+
+	bool compressed;
+	unsigned int blockBytes = GpuMemory::GetFormatBlockBytes(format, compressed);
+	if (blockBytes == 0)
+		return false;
+
+	layout.Format = format;
+	layout.Width = header[4];
+	layout.Height = header[3];
+	layout.MipCount = (flags & 0x20000) && header[7] > 0 ? header[7] : 1;
+	layout.BaseMip = layout.MipCount - 1;
+	layout.MipOffsets.clear();
+	layout.MipSizes.clear();
+	layout.MipRowPitches.clear();
+
+	unsigned long long offset = dataOffset;
+	for (unsigned int mip = 0; mip < layout.MipCount; mip++)
+	{
+		unsigned int width = max(1u, layout.Width >> mip);
+		unsigned int height = max(1u, layout.Height >> mip);
+		unsigned int rowPitch = compressed ? max(1u, (width + 3) / 4) * blockBytes : width * blockBytes;
+		unsigned int rows = compressed ? max(1u, (height + 3) / 4) : height;
+		layout.MipOffsets.push_back(offset);
+		layout.MipSizes.push_back(rowPitch * rows);
+		layout.MipRowPitches.push_back(rowPitch);
+		offset += rowPitch * rows;
+
+		if (mip < layout.BaseMip && max(width, height) <= ASSETS_MIP_STREAMING_BASE_SIZE)
+			layout.BaseMip = mip;
+	}
+
+	// Every texture it can be allocated as needs whole blocks
+	for (unsigned int mip = 0; compressed && mip <= layout.BaseMip; mip++)
+	{
+		if ((layout.Width >> mip) % 4 != 0 || (layout.Height >> mip) % 4 != 0)
+			return false;
+	}
+
+	return layout.BaseMip > 0;
+}
+
+// Mips in a file are one after another, finest first, so any run of them is one read
+bool Assets::ReadDDSMips(const std::string& path, const DDSLayout& layout, unsigned int firstMip, unsigned int lastMip, std::vector<unsigned char>& data)
+{
+	unsigned long long start = layout.MipOffsets[firstMip];
+	data.resize((size_t)(layout.MipOffsets[lastMip] + layout.MipSizes[lastMip] - start));
+	return ReadAssetBytes(path, start, data.size(), data.data());
+}
+
+
+
+Mesh* Assets::GetMesh(std::string name)
+{
+	// Search and return mesh if found, loading it the first time
+	auto it = meshes.find(name);
+	if (it == meshes.end() && LoadOnDemand(name))
+		it = meshes.find(name);
+	if (it != meshes.end())
+	{
+		RecordAccess(name);
+		return it->second;
+	}
+
+	// Unsuccessful
+	return 0;
+}
+
+void Assets::UnloadMesh(std::string name)
+{
+	auto it = meshes.find(name);
+	if (it == meshes.end())
+		return;
+
+	delete it->second;
+	ForgetHandle(meshHandles, name);
+	meshes.erase(it);
+	GeometryPool::GetInstance().Defragment();
+}
+
+SimplePixelShader* Assets::GetPixelShader(std::string name)
+{
+	// Search and return shader if found, loading it the first time
+	auto it = pixelShaders.find(name);
+	if (it == pixelShaders.end() && LoadOnDemand(name))
+		it = pixelShaders.find(name);
+	if (it != pixelShaders.end())
+	{
+		RecordAccess(name);
+		return it->second;
+	}
+
+	// Unsuccessful
+	return 0;
+}
+
+std::string Assets::GetPixelShaderName(SimplePixelShader* shader)
+{
+	for (auto& p : pixelShaders)
+		if (p.second == shader)
+			return p.first;
+
+	return "";
+}
+
+std::string Assets::GetMeshName(Mesh* mesh)
+{
+	for (auto& m : meshes)
+		if (m.second == mesh)
+			return m.first;
+
+	return "";
+}
+
+SimpleVertexShader* Assets::GetVertexShader(std::string name)
+{
+	// Search and return shader if found, loading it the first time
+	auto it = vertexShaders.find(name);
+	if (it == vertexShaders.end() && LoadOnDemand(name))
+		it = vertexShaders.find(name);
+	if (it != vertexShaders.end())
+	{
+		RecordAccess(name);
+		return it->second;
+	}
+
+	// Unsuccessful
+	return 0;
+}
+
+SimpleVertexShader* Assets::GetVertexShaderFor(SimpleVertexShader* shader, Mesh* mesh)
+{
+	if (!mesh->HasCompactVertices())
+		return shader;
+
+	auto it = compactVertexShaders.find(shader);
+	if (it != compactVertexShaders.end())
+		return it->second;
+
+	// No permutation, so this shader can't read the mesh
+	return shader;
+}
+
+SimpleComputeShader* Assets::GetComputeShader(std::string name)
+{
+	// Search and return shader if found, loading it the first time
+	auto it = computeShaders.find(name);
+	if (it == computeShaders.end() && LoadOnDemand(name))
+		it = computeShaders.find(name);
+	if (it != computeShaders.end())
+	{
+		RecordAccess(name);
+		return it->second;
+	}
+
+	// Unsuccessful
+	return 0;
+}
+
+
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Assets::GetTexture(std::string name)
+{
+	// Search and return texture if found, loading it the first time
+	auto it = textures.find(name);
+	if (it == textures.end() && LoadOnDemand(name))
+		it = textures.find(name);
+	if (it != textures.end())
+	{
+		RecordAccess(name);
+		return it->second;
+	}
+
+	// Unsuccessful
+	return 0;
+}
+
+
+
+Mesh* Assets::GetMesh(MeshHandle handle)
 {
-	// Delete all regular pointers
-	for (auto& m : meshes) delete m.second;
-	for (auto& p : pixelShaders) delete p.second;
-	for (auto& v : vertexShaders) delete v.second;
+	Mesh** mesh = ResolveHandle(meshHandles, meshes, handle.Index);
+	return mesh ? *mesh : 0;
 }
 
+SimplePixelShader* Assets::GetPixelShader(PixelShaderHandle handle)
+{
+	SimplePixelShader** shader = ResolveHandle(pixelShaderHandles, pixelShaders, handle.Index);
+	return shader ? *shader : 0;
+}
 
-void Assets::Initialize(std::string rootAssetPath, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+SimpleVertexShader* Assets::GetVertexShader(VertexShaderHandle handle)
 {
-	this->device = device;
-	this->context = context;
-	this->rootAssetPath = rootAssetPath;
+	SimpleVertexShader** shader = ResolveHandle(vertexShaderHandles, vertexShaders, handle.Index);
+	return shader ? *shader : 0;
 }
 
+SimpleComputeShader* Assets::GetComputeShader(ComputeShaderHandle handle)
+{
+	SimpleComputeShader** shader = ResolveHandle(computeShaderHandles, computeShaders, handle.Index);
+	return shader ? *shader : 0;
+}
 
-void Assets::LoadAllAssets()
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Assets::GetTexture(TextureHandle handle)
 {
-	if (rootAssetPath.empty())
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* texture = ResolveHandle(textureHandles, textures, handle.Index);
+	return texture ? *texture : 0;
+}
+
+
+// --------------------------------------------------------
+// Loads an asset that was found but left until it was
+// asked for, right here on the main thread
+//  - A vertex shader brings its compact vertex permutation
+//    along, since meshes are drawn with either one
+// --------------------------------------------------------
+bool Assets::LoadOnDemand(std::string name)
+{
+	auto it = assetIndex.find(name);
+	if (it == assetIndex.end())
+		return false;
+
+	PendingAsset asset = it->second;
+	assetIndex.erase(it);
+	LoadPending(asset);
+	FinishPending(asset);
+
+	auto vs = vertexShaders.find(name);
+	if (vs != vertexShaders.end() && !EndsWith(name, "_Compact.cso"))
+	{
+		SimpleVertexShader* compact = GetVertexShader(name.substr(0, name.size() - 4) + "_Compact.cso");
+		if (compact)
+			compactVertexShaders.insert({ vs->second, compact });
+	}
+	return true;
+}
+
+void Assets::RecordAccess(const std::string& name)
+{
+	if (loadOnDemand && accessedAssets.insert(name).second)
+		accessLog.push_back(name);
+}
+
+// Everything this run asked for, so the next one can load it all up front
+void Assets::WriteAccessLog()
+{
+	if (!loadOnDemand || accessLog.empty())
+		return;
+
+	std::ofstream log(GetFullPathTo(ASSETS_ACCESS_LOG));
+	for (auto& name : accessLog)
+		log << name << "\n";
+}
+
+
+
+// --------------------------------------------------------
+// Watches the asset root (and everything under it) and the
+// exe's directory, where the compiled shaders are
+// --------------------------------------------------------
+void Assets::SetHotReload(bool enabled)
+{
+	if (enabled == hotReload)
 		return;
 
-	// Recursively go through all directories starting at the root
-	for (auto& item : std::experimental::filesystem::recursive_directory_iterator(GetFullPathTo(rootAssetPath)))
+	if (!enabled)
 	{
-		// Is this a regular file?
-		if (item.status().type() == std::experimental::filesystem::file_type::regular)
-		{
-			std::string itemPath = item.path().string();
+		watcher.Stop();
+		hotReload = false;
+		return;
+	}
 
-			// Determine the file type
-			if (EndsWith(itemPath, ".obj") || EndsWith(itemPath, ".fbx"))
-			{
-				LoadMesh(itemPath);
-			}
-			else if (EndsWith(itemPath, ".jpg") || EndsWith(itemPath, ".png"))
-			{
-				LoadTexture(itemPath);
-			}
-			else if (EndsWith(itemPath, ".dds"))
+	// The pack's a snapshot, so there's nothing to watch
+	if (pack.IsOpen() || rootAssetPath.empty())
+	{
+		printf("Hot reload needs the loose files, so it's staying off\n");
+		return;
+	}
+
+	watchedAssetPath = GetFullPathTo(rootAssetPath);
+	std::vector<AssetWatchDirectory> directories = { { watchedAssetPath, true }, { GetFullPathTo("."), false } };
+	hotReload = watcher.Start(directories, [this](unsigned int directory, const std::string& file) { LoadChanged(directory, file); });
+	if (hotReload)
+		printf("Watching %s and the compiled shaders for changes\n", rootAssetPath.c_str());
+}
+
+// --------------------------------------------------------
+// Loads a file that changed, on the watcher's thread, the
+// same way LoadAllAssets() would have, without knowing (or
+// needing to) whether it's something that's loaded yet
+//  - A block compressed texture is reloaded under the name
+//    of the image it was made from, like it was loaded
+// --------------------------------------------------------
+void Assets::LoadChanged(unsigned int directory, const std::string& file)
+{
+	PendingAsset asset = {};
+	if (directory == 1)
+	{
+		if (!EndsWith(file, ".cso"))
+			return;
+
+		asset.Type = PendingAssetType::Shader;
+		asset.Path = file;
+		asset.Name = file;
+	}
+	else
+	{
+		asset.Path = watchedAssetPath + file;
+		asset.Name = file;
+		if (EndsWith(file, ".dds"))
+		{
+			std::string source = file.substr(0, file.size() - 4);
+			for (const char* extension : { ".png", ".jpg" })
 			{
-				LoadDDSTexture(itemPath);
+				if (AssetExists(watchedAssetPath + source + extension, false))
+				{
+					asset.Path = watchedAssetPath + source + extension;
+					asset.Name = source + extension;
+				}
 			}
 		}
+
+		if (!FindAssetType(asset))
+			return;
 	}
 
-	// Search and load all shaders in the exe directory
-	for (auto& item : std::experimental::filesystem::directory_iterator(GetFullPathTo(".")))
+	LoadPending(asset);
+	std::lock_guard<std::mutex> lock(reloadMutex);
+	reloadedAssets.push_back(std::move(asset));
+}
+
+// --------------------------------------------------------
+// Swaps everything that's finished reloading into place, then
+// tells the listeners, so by the time anything's drawn this
+// frame every handle and listener has the new versions
+// --------------------------------------------------------
+void Assets::UpdateHotReload()
+{
+	// Whatever was replaced long enough ago that no frame in flight has it
+	reloadFrame++;
+	if (!retiredAssets.empty())
+		DeleteRetired(false);
+
+	std::vector<PendingAsset> reloaded;
 	{
-		// Assume we're just using the filename for shaders due to being in the .exe path
-		std::string itemPath = item.path().filename().string();
+		std::lock_guard<std::mutex> lock(reloadMutex);
+		if (reloadedAssets.empty())
+			return;
+		reloaded.swap(reloadedAssets);
+	}
 
-		// Is this a Compiled Shader Object?
-		if (EndsWith(itemPath, ".cso"))
+	PROFILE_SCOPE("Assets::UpdateHotReload");
+	for (auto& asset : reloaded)
+	{
+		AssetReload reload = {};
+		reload.Name = asset.Name;
+		if (!SwapReloaded(asset, reload))
 		{
-			LoadUnknownShader(itemPath);
+			DeletePending(asset);
+			continue;
 		}
+
+		reloadCount++;
+		printf("Reloaded %s\n", asset.Name.c_str());
+		for (auto& listener : reloadListeners)
+			listener(reload);
 	}
 }
 
+// --------------------------------------------------------
+// Puts a reloaded asset in place of the one in its dictionary,
+// or returns false if it failed or there wasn't one to replace
+//  - Map nodes stay where they are, so the handles pointing
+//    at them see the new value without being told
+// --------------------------------------------------------
+bool Assets::SwapReloaded(PendingAsset& asset, AssetReload& reload)
+{
+	if (FAILED(asset.Result))
+	{
+		printf("Couldn't reload %s, so it's staying as it was\n", asset.Name.c_str());
+		return false;
+	}
 
+	switch (asset.Type)
+	{
+	case PendingAssetType::Mesh:
+	{
+		auto it = meshes.find(asset.Name);
+		if (it == meshes.end())
+			return false;
+
+		asset.LoadedMesh->CreatePendingBuffers(device);
+		reload.OldMesh = it->second;
+		reload.NewMesh = asset.LoadedMesh;
+		it->second = asset.LoadedMesh;
+		retiredAssets.push_back({ reload.OldMesh, 0, reloadFrame });
+		return true;
+	}
 
-Mesh* Assets::GetMesh(std::string name)
-{
-	// Search and return mesh if found
-	auto it = meshes.find(name);
-	if (it != meshes.end())
-		return it->second;
+	case PendingAssetType::Texture:
+	case PendingAssetType::DDSTexture:
+	{
+		// Mip streamed textures are made a mip at a time from their files,
+		// so they'd have to start streaming over, rather than be swapped
+		if (mipTextures.count(asset.Name))
+		{
+			printf("Not reloading %s, since it's mip streamed\n", asset.Name.c_str());
+			return false;
+		}
 
-	// Unsuccessful
-	return 0;
-}
+		auto it = textures.find(asset.Name);
+		auto request = textureRequests.find(asset.Name);
+		bool requested = request != textureRequests.end() && request->second->State == TextureRequestState::Loaded && !evictedTextures.count(request->second->SRV.Get());
+		if (it == textures.end() && !requested)
+			return false;
+
+		asset.SRV = GenerateMips(asset.TextureResource, asset.SRV);
+		GpuMemory::Track(asset.SRV.Get(), GpuMemoryCategory::Textures, asset.Name);
+		reload.OldTexture = it != textures.end() ? it->second : request->second->SRV;
+		reload.NewTexture = asset.SRV;
+
+		DXGI_FORMAT format;
+		unsigned long long bytes = GetTextureSize(asset.SRV.Get(), format);
+		UntrackTexture(asset.Name, reload.OldTexture.Get());
+		TrackTexture(asset.Name, asset.SRV.Get(), bytes, format);
+		if (it != textures.end())
+			it->second = asset.SRV;
+
+		// Streamed ones tell whoever asked for them, like when they stream in
+		if (requested)
+		{
+			request->second->SRV = asset.SRV;
+			for (auto& onLoaded : request->second->OnLoaded)
+				onLoaded(asset.SRV);
+		}
+		return true;
+	}
 
-SimplePixelShader* Assets::GetPixelShader(std::string name)
-{
-	// Search and return shader if found
-	auto it = pixelShaders.find(name);
-	if (it != pixelShaders.end())
-		return it->second;
+	case PendingAssetType::Shader:
+	{
+		if (asset.VertexShader)
+		{
+			auto it = vertexShaders.find(asset.Name);
+			if (it == vertexShaders.end())
+				return false;
+
+			// Its compact permutation is looked up by the shader itself
+			SimpleVertexShader* old = it->second;
+			reload.OldShader = old;
+			it->second = asset.VertexShader;
+			auto compact = compactVertexShaders.find(old);
+			if (compact != compactVertexShaders.end())
+			{
+				compactVertexShaders.insert({ asset.VertexShader, compact->second });
+				compactVertexShaders.erase(compact);
+			}
+			for (auto& c : compactVertexShaders)
+				if (c.second == old)
+					c.second = asset.VertexShader;
+		}
+		else if (asset.PixelShader)
+		{
+			auto it = pixelShaders.find(asset.Name);
+			if (it == pixelShaders.end())
+				return false;
 
-	// Unsuccessful
-	return 0;
+			reload.OldShader = it->second;
+			it->second = asset.PixelShader;
+		}
+		else if (asset.ComputeShader)
+		{
+			auto it = computeShaders.find(asset.Name);
+			if (it == computeShaders.end())
+				return false;
+
+			reload.OldShader = it->second;
+			it->second = asset.ComputeShader;
+		}
+		else
+			return false;
+
+		reload.NewShader = asset.VertexShader ? (ISimpleShader*)asset.VertexShader : (asset.PixelShader ? (ISimpleShader*)asset.PixelShader : asset.ComputeShader);
+		retiredAssets.push_back({ 0, reload.OldShader, reloadFrame });
+		return true;
+	}
+	}
+
+	return false;
 }
 
-SimpleVertexShader* Assets::GetVertexShader(std::string name)
+// --------------------------------------------------------
+// Deletes what reloads replaced once it's been retired for
+// ASSETS_RETIRED_FRAMES (or all of it, as it's shutting down)
+// --------------------------------------------------------
+void Assets::DeleteRetired(bool all)
 {
-	// Search and return shader if found
-	auto it = vertexShaders.find(name);
-	if (it != vertexShaders.end())
-		return it->second;
+	size_t kept = 0;
+	for (auto& retired : retiredAssets)
+	{
+		if (all || retired.Frame + ASSETS_RETIRED_FRAMES <= reloadFrame)
+		{
+			delete retired.OldMesh;
+			delete retired.OldShader;
+		}
+		else
+			retiredAssets[kept++] = retired;
+	}
+	retiredAssets.resize(kept);
+}
 
-	// Unsuccessful
-	return 0;
+// Whatever a pending asset made that never went anywhere
+void Assets::DeletePending(PendingAsset& asset)
+{
+	delete asset.LoadedMesh;
+	delete asset.VertexShader;
+	delete asset.PixelShader;
+	delete asset.ComputeShader;
+	asset.LoadedMesh = 0;
+	asset.VertexShader = 0;
+	asset.PixelShader = 0;
+	asset.ComputeShader = 0;
 }
 
 
 
-Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Assets::GetTexture(std::string name)
+// --------------------------------------------------------
+// Works out what kind of asset a file is from its name,
+// returning false for anything that isn't loaded here
+//  - Packed meshes are their caches, named after the model
+// --------------------------------------------------------
+bool Assets::FindAssetType(PendingAsset& asset)
 {
-	// Search and return texture if found
-	auto it = textures.find(name);
-	if (it != textures.end())
-		return it->second;
-
-	// Unsuccessful
-	return 0;
-}
+	std::string path = asset.Path;
+	if (asset.Packed && EndsWith(path, MESH_CACHE_EXTENSION))
+	{
+		asset.Type = PendingAssetType::Mesh;
+		asset.Name = asset.Name.substr(0, asset.Name.size() - std::string(MESH_CACHE_EXTENSION).size());
+	}
+	else if (!asset.Packed && (EndsWith(path, ".obj") || EndsWith(path, ".fbx")))
+		asset.Type = PendingAssetType::Mesh;
+	else if (EndsWith(path, ".jpg") || EndsWith(path, ".png"))
+	{
+		// Block compressed versions (from Tools\TextureCompressor) load
+		// in place of the textures they were made from, under their names
+		std::string compressedPath = path.substr(0, path.size() - 4) + ".dds";
+		if (AssetExists(compressedPath, asset.Packed))
+		{
+			asset.Type = PendingAssetType::DDSTexture;
+			asset.Path = compressedPath;
+		}
+		else
+			asset.Type = PendingAssetType::Texture;
+	}
+	else if (EndsWith(path, ".dds"))
+	{
+		// Already found (or about to be) as the texture it was made from
+		std::string sourcePath = path.substr(0, path.size() - 4);
+		if (AssetExists(sourcePath + ".png", asset.Packed) || AssetExists(sourcePath + ".jpg", asset.Packed))
+			return false;
 
+		asset.Type = PendingAssetType::DDSTexture;
+	}
+	else
+		return false;
 
+	return true;
+}
 
-void Assets::LoadMesh(std::string path)
+bool Assets::AssetExists(const std::string& path, bool packed)
 {
-	// Strip out everything before and including the asset root path
-	size_t assetPathLength = rootAssetPath.size();
-	size_t assetPathPosition = path.rfind(rootAssetPath);
-	std::string filename = path.substr(assetPathPosition + assetPathLength);
-
-	printf("Loading mesh: ");
-	printf(filename.c_str());
-	printf("\n");
+	return packed ? pack.Contains(path) : std::experimental::filesystem::exists(path);
+}
 
+// Reads part of an asset, from the pack if it's in there
+bool Assets::ReadAssetBytes(const std::string& path, unsigned long long offset, unsigned long long size, unsigned char* data)
+{
+	const unsigned char* packedData;
+	unsigned long long packedSize;
+	if (pack.Find(path, packedData, packedSize))
+	{
+		if (offset + size > packedSize)
+			return false;
 
-	// Load the mesh
-	Mesh* m = new Mesh(path.c_str(), device, true);
+		memcpy(data, packedData + offset, (size_t)size);
+		return true;
+	}
 
-	// Add to the dictionary
-	meshes.insert({ filename, m });
+	std::ifstream file(path, std::ios::binary);
+	file.seekg(offset);
+	return file.is_open() && file.read((char*)data, size);
 }
 
-void Assets::LoadTexture(std::string path)
+// --------------------------------------------------------
+// The part of loading an asset that can happen on any thread:
+// reading and decoding it, and anything that only needs the
+// device (which is free threaded)
+// --------------------------------------------------------
+void Assets::LoadPending(PendingAsset& asset)
 {
-	// Strip out everything before and including the asset root path
-	size_t assetPathLength = rootAssetPath.size();
-	size_t assetPathPosition = path.rfind(rootAssetPath);
-	std::string filename = path.substr(assetPathPosition + assetPathLength);
+	PROFILE_SCOPE("Assets::LoadPending");
+	// Packed assets are read straight out of the mapped pack
+	const unsigned char* packedData = 0;
+	unsigned long long packedSize = 0;
+	if (asset.Packed && !pack.Find(asset.Path, packedData, packedSize))
+	{
+		asset.Result = E_FAIL;
+		return;
+	}
 
-	printf("Loading texture: ");
-	printf(filename.c_str());
-	printf("\n");
+	switch (asset.Type)
+	{
+	case PendingAssetType::Mesh:
+		if (asset.Packed)
+		{
+			LoadProfileScope scope("Mesh Cache", asset.Name);
+			asset.LoadedMesh = new Mesh(packedData, packedSize, device, true, compactVertices, true);
+		}
+		else
+			asset.LoadedMesh = new Mesh(asset.Path.c_str(), device, true, compactVertices, true);
+		asset.Result = asset.LoadedMesh->HasPendingBuffers() ? S_OK : E_FAIL;
+		break;
 
-	// Load the texture
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
-	DirectX::CreateWICTextureFromFile(device.Get(), context.Get(), ToWideString(path).c_str(), 0, srv.GetAddressOf());
+	case PendingAssetType::Texture:
+	{
+		// WIC needs COM on whichever thread this ends up on, and without
+		// the context the loader only uses the device (see GenerateMips())
+		LoadProfileScope scope("Decode", asset.Name);
+		HRESULT com = CoInitializeEx(0, COINIT_MULTITHREADED);
+		if (asset.Packed)
+			asset.Result = DirectX::CreateWICTextureFromMemory(device.Get(), packedData, (size_t)packedSize, asset.TextureResource.GetAddressOf(), asset.SRV.GetAddressOf());
+		else
+			asset.Result = DirectX::CreateWICTextureFromFile(device.Get(), ToWideString(asset.Path).c_str(), asset.TextureResource.GetAddressOf(), asset.SRV.GetAddressOf());
+		if (SUCCEEDED(com))
+			CoUninitialize();
+		break;
+	}
 
-	// Add to the dictionary
-	textures.insert({ filename, srv });
-}
+	case PendingAssetType::DDSTexture:
+	{
+		// Packed ones are already in memory
+		const unsigned char* data = packedData;
+		size_t size = (size_t)packedSize;
+		if (asset.Packed)
+		{
+			asset.PackedData = packedData;
+			asset.PackedSize = packedSize;
+		}
+		else
+		{
+			LoadProfileScope scope("Read", asset.Name);
+			std::ifstream file(asset.Path, std::ios::binary | std::ios::ate);
+			if (file.is_open())
+			{
+				asset.FileData.resize((size_t)file.tellg());
+				file.seekg(0);
+				if (!asset.FileData.empty() && file.read((char*)asset.FileData.data(), asset.FileData.size()))
+				{
+					data = asset.FileData.data();
+					size = asset.FileData.size();
+				}
+			}
+		}
 
+		// Created here with just the device, which is free threaded, so
+		// it's off the main thread wherever this runs, and any mips it's
+		// missing are generated on the context once it's finished
+		asset.Result = E_FAIL;
+		if (data && size > 0)
+		{
+			LoadProfileScope scope("GPU Create", asset.Name);
+			asset.Result = DirectX::CreateDDSTextureFromMemory(device.Get(), data, size, asset.TextureResource.GetAddressOf(), asset.SRV.GetAddressOf());
+		}
+		break;
+	}
 
+	case PendingAssetType::Shader:
+	{
+		// Simple shaders only use the device while they're created
+		auto start = std::chrono::high_resolution_clock::now();
+		std::wstring fullPath = GetFullPathTo_Wide(ToWideString(asset.Path));
+		asset.ShaderType = asset.Packed ? GetShaderType(packedData, (size_t)packedSize) : GetShaderType(fullPath);
+		ISimpleShader* shader = 0;
+		if (asset.Packed)
+		{
+			std::wstring name = ToWideString(asset.Name);
+			switch (asset.ShaderType)
+			{
+			case D3D11_SHVER_VERTEX_SHADER: shader = asset.VertexShader = new SimpleVertexShader(device, context, packedData, (size_t)packedSize, name.c_str()); break;
+			case D3D11_SHVER_PIXEL_SHADER: shader = asset.PixelShader = new SimplePixelShader(device, context, packedData, (size_t)packedSize, name.c_str()); break;
+			case D3D11_SHVER_COMPUTE_SHADER: shader = asset.ComputeShader = new SimpleComputeShader(device, context, packedData, (size_t)packedSize, name.c_str()); break;
+			}
+		}
+		else
+		{
+			switch (asset.ShaderType)
+			{
+			case D3D11_SHVER_VERTEX_SHADER: shader = asset.VertexShader = new SimpleVertexShader(device, context, fullPath.c_str()); break;
+			case D3D11_SHVER_PIXEL_SHADER: shader = asset.PixelShader = new SimplePixelShader(device, context, fullPath.c_str()); break;
+			case D3D11_SHVER_COMPUTE_SHADER: shader = asset.ComputeShader = new SimpleComputeShader(device, context, fullPath.c_str()); break;
+			}
+		}
+		asset.Result = shader && shader->IsShaderValid() ? S_OK : E_FAIL;
+		asset.ShaderMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		break;
+	}
+	}
+}
 
-void Assets::LoadDDSTexture(std::string path)
+// --------------------------------------------------------
+// Finishes an asset on the main thread and adds it, or
+// reports why it couldn't be loaded
+// --------------------------------------------------------
+void Assets::FinishPending(PendingAsset& asset)
 {
-	// Strip out everything before and including the asset root path
-	size_t assetPathLength = rootAssetPath.size();
-	size_t assetPathPosition = path.rfind(rootAssetPath);
-	std::string filename = path.substr(assetPathPosition + assetPathLength);
+	PROFILE_SCOPE("Assets::FinishPending");
+	switch (asset.Type)
+	{
+	case PendingAssetType::Mesh:
+	{
+		printf("Loading mesh: %s\n", asset.Name.c_str());
+		Mesh* m = asset.LoadedMesh;
+		if (FAILED(asset.Result))
+		{
+			printf(" - Failed to load\n");
+			delete m;
+			return;
+		}
 
-	printf("Loading texture: ");
-	printf(filename.c_str());
-	printf("\n");
+		{
+			LoadProfileScope scope("GPU Create", asset.Name);
+			m->CreatePendingBuffers(device);
+		}
+		if (m->IsFromCache())
+			printf(" - From cache in %.2f ms (importing took %.2f ms)", m->GetLoadMilliseconds(), m->GetImportMilliseconds());
+		else
+			printf(" - Imported in %.2f ms", m->GetLoadMilliseconds());
+		printf(", ACMR %.3f -> %.3f, %u byte vertices\n", m->GetAcmrBefore(), m->GetAcmrAfter(), m->GetVertexStride());
+
+		// Triangles in each level of detail
+		printf(" - %u LODs:", m->GetLodCount());
+		for (unsigned int i = 0; i < m->GetLodCount(); i++)
+			printf(" %u", m->GetLodTriangleCount(i));
+		printf(" triangles\n");
+
+		// Add to the dictionary
+		meshes.insert({ asset.Name, m });
+		break;
+	}
 
-	// Load the texture
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
-	DirectX::CreateDDSTextureFromFile(device.Get(), context.Get(), ToWideString(path).c_str(), 0, srv.GetAddressOf());
+	case PendingAssetType::Texture:
+	case PendingAssetType::DDSTexture:
+	{
+		printf("Loading texture: %s\n", asset.Name.c_str());
+		if (SUCCEEDED(asset.Result))
+		{
+			// Both kinds were created where they were loaded, so all that's
+			// left is generating any mips they don't have (on the context)
+			LoadProfileScope scope("Generate Mips", asset.Name);
+			asset.SRV = GenerateMips(asset.TextureResource, asset.SRV);
+			GpuMemory::Track(asset.SRV.Get(), GpuMemoryCategory::Textures, asset.Name);
+		}
 
-	// Add to the dictionary
-	textures.insert({ filename, srv });
-}
+		if (FAILED(asset.Result))
+		{
+			printf(" - Failed to load (HRESULT 0x%08X)\n", (unsigned int)asset.Result);
+			return;
+		}
 
+		// Add to the dictionary
+		AddTexture(asset.Name, asset.SRV);
+		break;
+	}
 
-void Assets::LoadUnknownShader(std::string path)
-{
-	// Load the file into a blob
-	ID3DBlob* shaderBlob;
-	HRESULT hr = D3DReadFileToBlob(GetFullPathTo_Wide(ToWideString(path)).c_str(), &shaderBlob);
-	if (hr != S_OK)
+	case PendingAssetType::StreamedMips:
 	{
-		return;
+		// Only reachable through its request, since the view changes as it
+		// streams, and already created with its base mips by LoadStreamed()
+		printf("Loading texture: %s (%u of %u mips, streaming the rest)\n", asset.Name.c_str(), asset.Layout.MipCount - asset.Layout.BaseMip, asset.Layout.MipCount);
+		if (FAILED(asset.Result))
+		{
+			printf(" - Failed to load (HRESULT 0x%08X)\n", (unsigned int)asset.Result);
+			return;
+		}
+		break;
+	}
+
+	case PendingAssetType::Shader:
+	{
+		// Not a shader type that's kept
+		if (!asset.VertexShader && !asset.PixelShader && !asset.ComputeShader)
+			return;
+
+		const char* type = asset.VertexShader ? "vertex" : (asset.PixelShader ? "pixel" : "compute");
+		printf("Loading %s shader: %s\n", type, asset.Name.c_str());
+		if (FAILED(asset.Result))
+			printf(" - Failed to create the shader\n");
+
+		// Create the simple shader and add to dictionary
+		if (asset.VertexShader) vertexShaders.insert({ asset.Name, asset.VertexShader });
+		if (asset.PixelShader) pixelShaders.insert({ asset.Name, asset.PixelShader });
+		if (asset.ComputeShader) computeShaders.insert({ asset.Name, asset.ComputeShader });
+		break;
+	}
 	}
+}
 
-	// Set up shader reflection to get information about
-	// this shader and its variables,  buffers, etc.
-	ID3D11ShaderReflection* refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)&refl);
+// --------------------------------------------------------
+// Textures loaded without the context only have their top mip,
+// so this copies them into one with a full chain and has the
+// GPU fill in the rest, like the WIC loader does itself when
+// given the context (including leaving formats without mip
+// generation support alone)
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Assets::GenerateMips(Microsoft::WRL::ComPtr<ID3D11Resource> resource, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> source;
+	if (FAILED(resource.As(&source)))
+		return srv;
+
+	D3D11_TEXTURE2D_DESC desc;
+	source->GetDesc(&desc);
+	UINT support = 0;
+	device->CheckFormatSupport(desc.Format, &support);
+	if (desc.MipLevels != 1 || (desc.Width == 1 && desc.Height == 1) || !(support & D3D11_FORMAT_SUPPORT_MIP_AUTOGEN))
+		return srv;
+
+	desc.MipLevels = 0;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags |= D3D11_RESOURCE_MISC_GENERATE_MIPS;
 
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> mippedSRV;
+	if (FAILED(GpuMemory::CreateTexture2D(device.Get(), &desc, 0, texture.GetAddressOf(), GpuMemoryCategory::Textures, "Mipped Texture")) ||
+		FAILED(device->CreateShaderResourceView(texture.Get(), 0, mippedSRV.GetAddressOf())))
+		return srv;
+
+	context->CopySubresourceRegion(texture.Get(), 0, 0, 0, 0, source.Get(), 0, 0);
+	context->GenerateMips(mippedSRV.Get());
+	return mippedSRV;
+}
 
-	// What kind of shader?
-	switch (D3D11_SHVER_GET_TYPE(shaderDesc.Version))
+// --------------------------------------------------------
+// Reflects a compiled shader to find out what kind it is,
+// returning one of the D3D11_SHVER types (or -1)
+//  - SimpleShader keeps the reflection (or finds it in its
+//    cache), so creating the shader doesn't reflect again
+// --------------------------------------------------------
+unsigned int Assets::GetShaderType(std::wstring path)
+{
+	// Load the file into a blob
+	ID3DBlob* shaderBlob;
+	HRESULT hr = D3DReadFileToBlob(path.c_str(), &shaderBlob);
+	if (hr != S_OK)
 	{
-	case D3D11_SHVER_VERTEX_SHADER: LoadVertexShader(path); break;
-	case D3D11_SHVER_PIXEL_SHADER: LoadPixelShader(path); break;
+		return (unsigned int)-1;
 	}
 
-	// Clean up
-	refl->Release();
+	unsigned int type = GetShaderType(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize());
 	shaderBlob->Release();
+	return type;
+}
+
+unsigned int Assets::GetShaderType(const void* bytecode, size_t size)
+{
+	return ISimpleShader::GetShaderType(bytecode, size);
 }
 
 
@@ -231,9 +1843,7 @@ void Assets::LoadPixelShader(std::string path, bool useAssetPath)
 		filename = path.substr(assetPathPosition + assetPathLength);
 	}
 
-	printf("Loading pixel shader: ");
-	printf(filename.c_str());
-	printf("\n");
+	printf("Loading pixel shader: %s\n", filename.c_str());
 
 	// Create the simple shader and add to dictionary
 	SimplePixelShader* ps = new SimplePixelShader(device, context, GetFullPathTo_Wide(ToWideString(path)).c_str());
@@ -256,15 +1866,35 @@ void Assets::LoadVertexShader(std::string path, bool useAssetPath)
 		filename = path.substr(assetPathPosition + assetPathLength);
 	}
 
-	printf("Loading vertex shader: ");
-	printf(filename.c_str());
-	printf("\n");
+	printf("Loading vertex shader: %s\n", filename.c_str());
 
 	// Create the simple shader and add to dictionary
 	SimpleVertexShader* vs = new SimpleVertexShader(device, context, GetFullPathTo_Wide(ToWideString(path)).c_str());
 	vertexShaders.insert({ filename, vs });
 }
 
+
+void Assets::LoadComputeShader(std::string path, bool useAssetPath)
+{
+	// Assuming filename and path are the same
+	std::string filename = path;
+
+	// Unless we need to check asset folder
+	if (useAssetPath)
+	{
+		// Strip out everything before and including the asset root path
+		size_t assetPathLength = rootAssetPath.size();
+		size_t assetPathPosition = path.rfind(rootAssetPath);
+		filename = path.substr(assetPathPosition + assetPathLength);
+	}
+
+	printf("Loading compute shader: %s\n", filename.c_str());
+
+	// Create the simple shader and add to dictionary
+	SimpleComputeShader* cs = new SimpleComputeShader(device, context, GetFullPathTo_Wide(ToWideString(path)).c_str());
+	computeShaders.insert({ filename, cs });
+}
+
 // --------------------------------------------------------------------------
 // Creates a solid color texture of the specified size and adds it to
 // the asset manager using the specified name
@@ -307,7 +1937,7 @@ void Assets::CreateSolidColorTexture(std::string textureName, int width, int hei
 
 	// Actually create it
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
-	device->CreateTexture2D(&td, &data, texture.GetAddressOf());
+	GpuMemory::CreateTexture2D(device.Get(), &td, &data, texture.GetAddressOf(), GpuMemoryCategory::Textures, textureName);
 
 	// All done with pixel array
 	delete[] pixels;
@@ -323,7 +1953,7 @@ void Assets::CreateSolidColorTexture(std::string textureName, int width, int hei
 	device->CreateShaderResourceView(texture.Get(), &srvDesc, srv.GetAddressOf());
 
 	// Add to the asset manager
-	textures.insert({ textureName, srv });
+	AddTexture(textureName, srv);
 }
 
 void Assets::CreateFloatTexture(std::string textureName, int width, int height, DirectX::XMFLOAT4* pixels)
@@ -349,7 +1979,7 @@ void Assets::CreateFloatTexture(std::string textureName, int width, int height,
 
 	// Actually create it
 	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
-	device->CreateTexture2D(&td, &data, texture.GetAddressOf());
+	GpuMemory::CreateTexture2D(device.Get(), &td, &data, texture.GetAddressOf(), GpuMemoryCategory::Textures, textureName);
 
 	// Create the shader resource view for this texture
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
@@ -362,9 +1992,127 @@ void Assets::CreateFloatTexture(std::string textureName, int width, int height,
 	device->CreateShaderResourceView(texture.Get(), &srvDesc, srv.GetAddressOf());
 
 	// Add to the asset manager
-	textures.insert({ textureName, srv });
+	AddTexture(textureName, srv);
+}
+
+
+// --------------------------------------------------------
+// Decodes six faces on the job system's workers and uploads
+// them into a single cube map, which the GPU then makes the
+// mips of, so the faces never become textures of their own
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Assets::LoadCubemap(const std::string faceNames[6])
+{
+	struct CubeFace
+	{
+		std::vector<unsigned char> Pixels;
+		unsigned int Width;
+		unsigned int Height;
+		HRESULT Result;
+	};
+	CubeFace faces[6] = {};
+
+	JobSystem::GetInstance().ParallelFor(6, 1, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = first; i < last; i++)
+		{
+			LoadProfileScope scope("Decode", faceNames[i]);
+			faces[i].Result = DecodeImage(faceNames[i], faces[i].Pixels, faces[i].Width, faces[i].Height);
+		}
+	});
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (FAILED(faces[i].Result) || faces[i].Width != faces[0].Width || faces[i].Height != faces[0].Height)
+		{
+			printf("Couldn't assemble a cube map from %s\n", faceNames[i].c_str());
+			return 0;
+		}
+	}
+
+	LoadProfileScope scope("GPU Create", faceNames[0]);
+	D3D11_TEXTURE2D_DESC cubeDesc = {};
+	cubeDesc.ArraySize = 6;
+	cubeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET; // Render target for GenerateMips()
+	cubeDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Same as the WIC loader gives back for these
+	cubeDesc.Width = faces[0].Width;
+	cubeDesc.Height = faces[0].Height;
+	cubeDesc.MipLevels = 0; // All the way down
+	cubeDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE | D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	cubeDesc.SampleDesc.Count = 1;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> cube;
+	if (FAILED(GpuMemory::CreateTexture2D(device.Get(), &cubeDesc, 0, cube.GetAddressOf(), GpuMemoryCategory::Textures, faceNames[0])))
+		return 0;
+	cube->GetDesc(&cubeDesc);
+
+	// Initial data would need every mip, so just the top one's uploaded
+	for (unsigned int i = 0; i < 6; i++)
+	{
+		context->UpdateSubresource(cube.Get(), D3D11CalcSubresource(0, i, cubeDesc.MipLevels), 0, faces[i].Pixels.data(), faces[i].Width * 4, 0);
+		std::vector<unsigned char>().swap(faces[i].Pixels);
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = cubeDesc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	srvDesc.TextureCube.MipLevels = cubeDesc.MipLevels;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (FAILED(device->CreateShaderResourceView(cube.Get(), &srvDesc, srv.GetAddressOf())))
+		return 0;
+
+	context->GenerateMips(srv.Get());
+	return srv;
 }
 
+// Decodes any image WIC understands into RGBA8, from the pack if it's in there
+HRESULT Assets::DecodeImage(const std::string& name, std::vector<unsigned char>& pixels, unsigned int& width, unsigned int& height)
+{
+	std::vector<unsigned char> fileData;
+	const unsigned char* data = 0;
+	unsigned long long size = 0;
+	if (!pack.Find(name, data, size))
+	{
+		std::ifstream file(GetFullPathTo(rootAssetPath) + name, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+			return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+		fileData.resize((size_t)file.tellg());
+		file.seekg(0);
+		if (!file.read((char*)fileData.data(), fileData.size()))
+			return E_FAIL;
+		data = fileData.data();
+		size = fileData.size();
+	}
+
+	// WIC needs COM on whichever worker this ends up on
+	HRESULT com = CoInitializeEx(0, COINIT_MULTITHREADED);
+	HRESULT result;
+	{
+		// Released before COM is
+		Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+		Microsoft::WRL::ComPtr<IWICStream> stream;
+		Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
+		Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
+		Microsoft::WRL::ComPtr<IWICFormatConverter> converter;
+		result = CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()));
+		if (SUCCEEDED(result)) result = factory->CreateStream(stream.GetAddressOf());
+		if (SUCCEEDED(result)) result = stream->InitializeFromMemory((BYTE*)data, (DWORD)size);
+		if (SUCCEEDED(result)) result = factory->CreateDecoderFromStream(stream.Get(), 0, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf());
+		if (SUCCEEDED(result)) result = decoder->GetFrame(0, frame.GetAddressOf());
+		if (SUCCEEDED(result)) result = factory->CreateFormatConverter(converter.GetAddressOf());
+		if (SUCCEEDED(result)) result = converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0.0, WICBitmapPaletteTypeCustom);
+		if (SUCCEEDED(result))
+		{
+			converter->GetSize(&width, &height);
+			pixels.resize((size_t)width * height * 4);
+			result = converter->CopyPixels(0, width * 4, (UINT)pixels.size(), pixels.data());
+		}
+	}
+	if (SUCCEEDED(com))
+		CoUninitialize();
+	return result;
+}
 
 // --------------------------------------------------------------------------
 // Gets the actual path to this executable
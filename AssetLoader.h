@@ -1,15 +1,103 @@
 #pragma once
 
 #include <d3d11.h>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <WICTextureLoader.h>
 #include <wrl/client.h>
 #include <DirectXMath.h>
 
+#include "AssetHandle.h"
+#include "AssetPack.h"
+#include "AssetWatcher.h"
 #include "Mesh.h"
 #include "SimpleShader.h"
 
+// Roughly how many bytes of texels a frame spends swapping in streamed
+// textures, though at least one is always swapped in per frame
+#define ASSETS_STREAMING_UPLOAD_BUDGET	(16 * 1024 * 1024)
+
+// Stands in for streamed textures without a placeholder of their own
+#define ASSETS_STREAMING_PLACEHOLDER	"StreamingPlaceholder"
+
+// Mip streamed textures start out with (and always keep) their
+// mips up to this size, which streaming can't go below
+#define ASSETS_MIP_STREAMING_BASE_SIZE	64
+
+// Video memory mip streamed textures can take up, past which the
+// least recently drawn ones lose their finest mips
+#define ASSETS_MIP_STREAMING_BUDGET		(64 * 1024 * 1024)
+
+// Video memory every texture here can take up (zero for no limit), past
+// which streamed textures that haven't been drawn for a while are evicted
+// back to their placeholders, least recently drawn first
+#define ASSETS_TEXTURE_BUDGET			0
+#define ASSETS_TEXTURE_EVICT_FRAMES		120
+
+// How many frames a mesh or shader a reload replaced is kept for before
+// it's deleted: one more than the most the CPU can get ahead of the GPU
+// (the renderer's max frame latency, up to 4), so nothing in flight
+// still has it
+#define ASSETS_RETIRED_FRAMES			5
+
+// Every asset a run with on demand loading asked for, written next to
+// the exe as it closes so the next run can load them up front
+#define ASSETS_ACCESS_LOG				"AssetAccess.log"
+
+// Every shader's reflection, next to the exe, so shaders that haven't
+// changed since the last run aren't reflected again (see SimpleShader)
+#define ASSETS_SHADER_REFLECTION_CACHE	"ShaderReflection.cache"
+
+enum class TextureRequestState { Queued, Loading, Loaded, Failed, Cancelled };
+
+// A texture being streamed in, handed out by Assets::RequestTexture()
+//  - SRV is the placeholder until the real texture is swapped in
+//  - Owned by Assets, and stays valid (even once cancelled) until it's gone
+struct TextureRequest
+{
+	std::string Name;
+	float Priority;
+	std::atomic<TextureRequestState> State;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Placeholder;
+
+	// Called on the main thread whenever SRV changes: when the real texture
+	// is swapped in, when mip streaming replaces it with a new view and when
+	// it's evicted back to (a view of) the placeholder
+	std::vector<std::function<void(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>)>> OnLoaded;
+};
+
+// An asset that was reloaded after changing on disk, handed to each of
+// Assets' reload listeners once the new one's in its dictionary
+//  - Only the pointers for its kind of asset are set
+//  - The old mesh or shader isn't deleted until Assets is, since anything
+//    can be holding on to it, so it's safe to compare against
+struct AssetReload
+{
+	std::string Name;
+	Mesh* OldMesh;
+	Mesh* NewMesh;
+	ISimpleShader* OldShader;
+	ISimpleShader* NewShader;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> OldTexture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> NewTexture;
+};
+
+// Video memory one texture takes up, as of when it was last (re)created
+struct TextureMemory
+{
+	unsigned long long Bytes;
+	DXGI_FORMAT Format;
+	unsigned long long LastUsedFrame;
+};
 
 class Assets
 {
@@ -40,35 +128,424 @@ public:
 
 	void Initialize(std::string rootAssetPath, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
+	// Whether there was an asset pack (see AssetPack.h) next to the exe,
+	// which everything's found and read from instead of the loose files
+	bool IsUsingPack() { return pack.IsOpen(); }
+
 	void LoadAllAssets();
 	void LoadPixelShader(std::string path, bool useAssetPath = false);
 	void LoadVertexShader(std::string path, bool useAssetPath = false);
+	void LoadComputeShader(std::string path, bool useAssetPath = false);
 
 	void CreateSolidColorTexture(std::string textureName, int width, int height, DirectX::XMFLOAT4 color);
 	void CreateFloatTexture(std::string textureName, int width, int height, DirectX::XMFLOAT4* pixels);
 
+	// A cube map made straight from six images (named like GetTexture(), in
+	// the order +X, -X, +Y, -Y, +Z, -Z), decoded in parallel and uploaded
+	// into the one texture with a full mip chain, without a texture per face
+	//  - Returns null if a face can't be decoded or they don't match in size
+	//  - Cube maps that are already DDS files just load with GetTexture()
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> LoadCubemap(const std::string faceNames[6]);
+
 
 	Mesh* GetMesh(std::string name);
+
+	// Deletes the mesh and packs the geometry pool back
+	// together over the space it leaves behind
+	void UnloadMesh(std::string name);
 	SimplePixelShader* GetPixelShader(std::string name);
 	SimpleVertexShader* GetVertexShader(std::string name);
+	SimpleComputeShader* GetComputeShader(std::string name);
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetTexture(std::string name);
 
+	// Handles, made once from a name (or a key, without building a string)
+	// and then looked up by index, for anything that's used every frame
+	MeshHandle GetMeshHandle(AssetKey key) { return { MakeHandle(meshHandles, key) }; }
+	PixelShaderHandle GetPixelShaderHandle(AssetKey key) { return { MakeHandle(pixelShaderHandles, key) }; }
+	VertexShaderHandle GetVertexShaderHandle(AssetKey key) { return { MakeHandle(vertexShaderHandles, key) }; }
+	ComputeShaderHandle GetComputeShaderHandle(AssetKey key) { return { MakeHandle(computeShaderHandles, key) }; }
+	TextureHandle GetTextureHandle(AssetKey key) { return { MakeHandle(textureHandles, key) }; }
+	static AssetKey GetKey(const std::string& name) { return { HashAssetName(name.c_str(), name.size()), name.c_str(), name.size() }; }
+
+	Mesh* GetMesh(MeshHandle handle);
+	SimplePixelShader* GetPixelShader(PixelShaderHandle handle);
+	SimpleVertexShader* GetVertexShader(VertexShaderHandle handle);
+	SimpleComputeShader* GetComputeShader(ComputeShaderHandle handle);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetTexture(TextureHandle handle);
+
+	// Straight from a key, for when keeping the handle around isn't worth it
+	Mesh* GetMesh(AssetKey key) { return GetMesh(GetMeshHandle(key)); }
+	SimplePixelShader* GetPixelShader(AssetKey key) { return GetPixelShader(GetPixelShaderHandle(key)); }
+	SimpleVertexShader* GetVertexShader(AssetKey key) { return GetVertexShader(GetVertexShaderHandle(key)); }
+	SimpleComputeShader* GetComputeShader(AssetKey key) { return GetComputeShader(GetComputeShaderHandle(key)); }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetTexture(AssetKey key) { return GetTexture(GetTextureHandle(key)); }
+
+	// The name a shader (or mesh) was loaded under (empty if it wasn't loaded here)
+	std::string GetPixelShaderName(SimplePixelShader* shader);
+	std::string GetMeshName(Mesh* mesh);
+
+	// Whether LoadAllAssets() just finds everything, leaving each asset to load
+	// the first time it's asked for (apart from the ones the last run's access
+	// log lists, which still load up front), set before calling it
+	//  - Only the main thread loads this way, so anything other threads use
+	//    has to have been asked for on the main thread first
+	void SetLoadOnDemand(bool onDemand) { loadOnDemand = onDemand; }
+	bool GetLoadOnDemand() { return loadOnDemand; }
+	unsigned int GetUnloadedCount() { return (unsigned int)assetIndex.size(); }
+
+	// Whether meshes loaded from here get compact vertices (see
+	// CompactVertex), which has to be set before LoadAllAssets()
+	void SetCompactVertices(bool compact) { compactVertices = compact; }
+
+	// The permutation of a vertex shader that reads this mesh's vertices,
+	// which is the shader itself unless the mesh has compact vertices
+	SimpleVertexShader* GetVertexShaderFor(SimpleVertexShader* shader, Mesh* mesh);
+
+	// Whether LoadAllAssets() leaves textures to be streamed in the background
+	// by RequestTexture() rather than loading them, set before calling it
+	void SetStreamTextures(bool stream) { streamTextures = stream; }
+	bool GetStreamTextures() { return streamTextures; }
+
+	// Queues a texture (named like GetTexture()) to load in the background,
+	// highest priority first, and returns its request straight away with
+	// the named placeholder texture (or a grey one) standing in for it
+	//  - Requesting it again changes the priority (or re-queues it if it
+	//    was cancelled), and a texture that's already here is just loaded
+	//  - onLoaded is called once it's swapped in, or right away if it's
+	//    already loaded
+	TextureRequest* RequestTexture(std::string name, float priority, std::string placeholder = "", std::function<void(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>)> onLoaded = 0);
+
+	// Drops a request that hasn't been swapped in yet, keeping the placeholder
+	void CancelRequest(TextureRequest* request);
+
+	// Finishes the request right now (loading it on this thread if
+	// the background thread hasn't started on it yet)
+	void WaitForTexture(TextureRequest* request);
+
+	// Swaps in textures the background thread has finished, up to the upload
+	// budget, which has to be on the main thread (best once per frame)
+	void UpdateStreaming();
+
+	// Requests that are queued or loading, or waiting to be swapped in
+	unsigned int GetStreamingCount();
+	unsigned long long GetUploadBudget() { return uploadBudget; }
+	void SetUploadBudget(unsigned long long bytes) { uploadBudget = bytes; }
+
+	// Whether streamed DDS textures with mip chains load just their smallest
+	// mips at first and stream the rest in and out as they're needed, set
+	// before requesting any (anything else is still loaded whole)
+	void SetStreamMips(bool stream) { streamMips = stream; }
+	bool GetStreamMips() { return streamMips; }
+
+	// How finely a texture was drawn this frame, as the distance in uv space
+	// across one pixel, which picks the finest mip it needs streamed in
+	//  - Only the finest detail asked for each frame counts, and anything
+	//    that isn't a mip streamed texture is just marked as drawn
+	void RequestTextureDetail(ID3D11ShaderResourceView* srv, float uvPerPixel);
+
+	// Marks a texture as drawn this frame, which queues it to stream back
+	// in if this is the view it was evicted to
+	void MarkTextureUsed(ID3D11ShaderResourceView* srv);
+
+	// Video memory taken by every texture here, by name (mip streamed ones
+	// included), and the budget streamed textures are evicted to stay under
+	unsigned long long GetTextureBytes() { return textureBytes; }
+	const std::unordered_map<std::string, TextureMemory>& GetTextureMemory() { return textureMemory; }
+	unsigned long long GetTextureBudget() { return textureBudget; }
+	void SetTextureBudget(unsigned long long bytes) { textureBudget = bytes; }
+	unsigned int GetEvictedTextureCount() { return (unsigned int)evictedTextures.size(); }
+	unsigned long long GetFrame() { return streamingFrame; }
+
+	// Video memory taken by mip streamed textures, whose finer mips
+	// are evicted whenever it would go over the budget
+	unsigned long long GetMipResidentBytes() { return mipResidentBytes; }
+	unsigned long long GetMipBudget() { return mipBudget; }
+	void SetMipBudget(unsigned long long bytes) { mipBudget = bytes; }
+	unsigned int GetMipStreamedCount() { return (unsigned int)mipTextures.size(); }
+
+	// Whether meshes, textures and shaders that change on disk (in the asset
+	// root, and compiled shaders next to the exe) are reloaded while it runs,
+	// set after LoadAllAssets()
+	//  - Each one's loaded in the background as soon as it's written, then
+	//    swapped into its dictionary by UpdateHotReload(), so handles (and
+	//    streamed textures' requests) all see it at the same frame boundary
+	//  - Only what was already loaded is reloaded, and never from the pack
+	void SetHotReload(bool enabled);
+	bool GetHotReload() { return hotReload; }
+	unsigned int GetReloadCount() { return reloadCount; }
+
+	// Swaps in whatever's finished reloading, on the main thread (once per
+	// frame, before anything's drawn, since it's also what deletes what
+	// earlier reloads replaced, once no frame in flight can be using it)
+	void UpdateHotReload();
+
+	// Called on the main thread for each asset that's reloaded, to swap it
+	// into anything holding on to the old one directly
+	void AddReloadListener(std::function<void(const AssetReload&)> listener) { reloadListeners.push_back(listener); }
+
 private:
 
-	void LoadMesh(std::string path);
-	void LoadTexture(std::string path);
-	void LoadDDSTexture(std::string path);
-	void LoadUnknownShader(std::string path);
+	enum class PendingAssetType { Mesh, Texture, DDSTexture, StreamedMips, Shader };
+
+	// Where each mip of a DDS file is, for files that can be mip
+	// streamed (2D, a single slice and a format with a known size)
+	struct DDSLayout
+	{
+		DXGI_FORMAT Format;
+		unsigned int Width;
+		unsigned int Height;
+		unsigned int MipCount;
+		unsigned int BaseMip;	// The first mip at or under ASSETS_MIP_STREAMING_BASE_SIZE
+		std::vector<unsigned long long> MipOffsets;
+		std::vector<unsigned int> MipSizes;
+		std::vector<unsigned int> MipRowPitches;
+	};
+
+	// One file found by LoadAllAssets(), loaded on a worker and then
+	// finished on the main thread in the order it was found, so the
+	// maps (and the geometry pool) fill in the same order every time
+	struct PendingAsset
+	{
+		PendingAssetType Type;
+		std::string Path;
+		std::string Name;
+		bool Packed;							// Path is an entry in the pack
+		HRESULT Result;
+
+		Mesh* LoadedMesh;
+		Microsoft::WRL::ComPtr<ID3D11Resource> TextureResource;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+		std::vector<unsigned char> FileData;	// DDS files, read ahead
+		const unsigned char* PackedData;		// Or viewed straight from the pack
+		unsigned long long PackedSize;
+		DDSLayout Layout;						// And which of their mips that was
+		unsigned int ShaderType;
+		float ShaderMilliseconds;				// Reading, reflecting and creating it
+		SimpleVertexShader* VertexShader;
+		SimplePixelShader* PixelShader;
+		SimpleComputeShader* ComputeShader;
+	};
+
+	bool FindAssetType(PendingAsset& asset);
+	void LoadPending(PendingAsset& asset);
+	void FinishPending(PendingAsset& asset);
+
+	// On demand loading
+	bool loadOnDemand;
+	std::unordered_map<std::string, PendingAsset> assetIndex;	// Found, but not asked for yet
+	std::unordered_set<std::string> accessedAssets;
+	std::vector<std::string> accessLog;						// The same names, in the order they were first asked for
+
+	bool LoadOnDemand(std::string name);
+	void RecordAccess(const std::string& name);
+	void WriteAccessLog();
+
+	// Streaming
+	//  - Requests are only ever added or removed on the main thread, and
+	//    the lock covers the queue, what's finished and each request's state
+	struct QueuedTextureRequest
+	{
+		float Priority;
+		unsigned long long Sequence;
+		TextureRequest* Request;
+
+		// Highest priority at the top of the heap, then oldest first
+		bool operator<(const QueuedTextureRequest& other) const
+		{
+			return Priority < other.Priority || (Priority == other.Priority && Sequence > other.Sequence);
+		}
+	};
+	struct StreamedTexture
+	{
+		TextureRequest* Request;
+		PendingAsset Asset;
+	};
+	bool streamTextures;
+	unsigned long long uploadBudget;
+	std::unordered_map<std::string, std::string> texturePaths;	// Unloaded textures, found by LoadAllAssets()
+	std::unordered_map<std::string, TextureRequest*> textureRequests;
+	std::vector<QueuedTextureRequest> streamingQueue;
+	unsigned long long streamingSequence;
+	std::vector<StreamedTexture> streamedTextures;
+	std::thread streamingThread;
+	std::mutex streamingMutex;
+	std::condition_variable streamingCondition;	// Something's queued (or it's time to stop)
+	std::condition_variable streamedCondition;	// Something's finished loading
+	bool streamingRunning;
+
+	void StreamingLoop();
+	void StopStreaming();
+	PendingAsset LoadStreamed(TextureRequest* request);
+	void FinishStreamed(TextureRequest* request, PendingAsset& asset);
+
+	// Mip streaming
+	//  - Each texture's allocated from AllocatedMip down, and reallocated
+	//    (copying the mips it keeps) to grow or shrink a mip at a time
+	//  - Newly allocated mips are loaded one at a time by the background
+	//    thread, and until they are SetResourceMinLOD() keeps sampling
+	//    to the ones from ResidentMip down
+	//  - Everything but LoadingMip (under the lock) is main thread only
+	struct MipStreamedTexture
+	{
+		TextureRequest* Request;
+		DDSLayout Layout;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> Texture;
+		unsigned int AllocatedMip;
+		unsigned int ResidentMip;
+		unsigned int WantedMip;			// Finest asked for since the last update
+		unsigned long long LastUsedFrame;
+		unsigned int LoadingMip;		// Being read in the background (or UINT_MAX)
+	};
+	struct StreamedMipLevel
+	{
+		MipStreamedTexture* Texture;
+		unsigned int Mip;
+		std::vector<unsigned char> Data;
+	};
+	bool streamMips;
+	unsigned long long mipBudget;
+	unsigned long long mipResidentBytes;
+	std::unordered_map<std::string, MipStreamedTexture*> mipTextures;
+	std::unordered_map<ID3D11ShaderResourceView*, MipStreamedTexture*> mipTexturesBySRV;
+	std::vector<MipStreamedTexture*> mipQueue;
+	std::vector<StreamedMipLevel> streamedMipLevels;
+
+	// Texture memory
+	//  - Only textures someone can be told about (through OnLoaded) are
+	//    evicted, each to its own view of its placeholder, so drawing
+	//    one of those views is what asks for it back
+	unsigned long long textureBytes;
+	unsigned long long textureBudget;
+	unsigned long long streamingFrame;
+	std::unordered_map<std::string, TextureMemory> textureMemory;
+	std::unordered_map<ID3D11ShaderResourceView*, std::string> textureNamesBySRV;
+	std::unordered_map<ID3D11ShaderResourceView*, TextureRequest*> evictedTextures;
+
+	void AddTexture(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	void TrackTexture(std::string name, ID3D11ShaderResourceView* srv, unsigned long long bytes, DXGI_FORMAT format);
+	void UntrackTexture(std::string name, ID3D11ShaderResourceView* srv);
+	void EvictTextures();
+	static unsigned long long GetTextureSize(ID3D11ShaderResourceView* srv, DXGI_FORMAT& format);
+
+	void UpdateMipStreaming(unsigned long long uploaded);
+	bool EvictMip(MipStreamedTexture* except);
+	void ReallocateMips(MipStreamedTexture* texture, unsigned int allocatedMip);
+	void QueueNextMip(MipStreamedTexture* texture);
+	unsigned long long GetMipAllocationSize(const DDSLayout& layout, unsigned int allocatedMip);
+	HRESULT CreateMipTexture(const DDSLayout& layout, unsigned int allocatedMip, const unsigned char* initialData, const std::string& name, Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	bool ReadDDSLayout(const std::string& path, DDSLayout& layout);
+	bool ReadDDSMips(const std::string& path, const DDSLayout& layout, unsigned int firstMip, unsigned int lastMip, std::vector<unsigned char>& data);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GenerateMips(Microsoft::WRL::ComPtr<ID3D11Resource> resource, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	unsigned int GetShaderType(std::wstring path);
+	unsigned int GetShaderType(const void* bytecode, size_t size);
+
+	// Hot reload
+	//  - Changed files are loaded on the watcher's thread, and the lock
+	//    only covers the ones waiting to be swapped in
+	bool hotReload;
+	unsigned int reloadCount;
+	std::string watchedAssetPath;
+	AssetWatcher watcher;
+	std::mutex reloadMutex;
+	std::vector<PendingAsset> reloadedAssets;
+	std::vector<std::function<void(const AssetReload&)>> reloadListeners;
+
+	// What reloads replaced, and the frame each was, until it's deleted
+	struct RetiredAsset
+	{
+		Mesh* OldMesh;
+		ISimpleShader* OldShader;
+		unsigned long long Frame;
+	};
+	unsigned long long reloadFrame;
+	std::vector<RetiredAsset> retiredAssets;
+
+	void LoadChanged(unsigned int directory, const std::string& file);
+	bool SwapReloaded(PendingAsset& asset, AssetReload& reload);
+	void DeleteRetired(bool all);
+	static void DeletePending(PendingAsset& asset);
+
+	// Whether an asset's there, and reading part of it, from the pack
+	// when a path's one of its entries and the loose files otherwise
+	bool AssetExists(const std::string& path, bool packed);
+	bool ReadAssetBytes(const std::string& path, unsigned long long offset, unsigned long long size, unsigned char* data);
+	HRESULT DecodeImage(const std::string& name, std::vector<unsigned char>& pixels, unsigned int& width, unsigned int& height);
 
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
 	std::string rootAssetPath;
+	bool compactVertices;
+	AssetPack pack;
 
 	std::unordered_map<std::string, Mesh*> meshes;
 	std::unordered_map<std::string, SimplePixelShader*> pixelShaders;
 	std::unordered_map<std::string, SimpleVertexShader*> vertexShaders;
+	std::unordered_map<std::string, SimpleComputeShader*> computeShaders;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textures;
 
+	// One table per kind of asset, told apart by the names' hashes and
+	// pointing into its dictionary once each handle's first looked up
+	template<typename T>
+	struct HandleTable
+	{
+		std::unordered_map<unsigned long long, unsigned int> Indices;
+		std::vector<std::string> Names;
+		std::vector<T*> Values;	// Null until it's looked up, and again once it's unloaded
+	};
+	HandleTable<Mesh*> meshHandles;
+	HandleTable<SimplePixelShader*> pixelShaderHandles;
+	HandleTable<SimpleVertexShader*> vertexShaderHandles;
+	HandleTable<SimpleComputeShader*> computeShaderHandles;
+	HandleTable<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureHandles;
+
+	template<typename T>
+	unsigned int MakeHandle(HandleTable<T>& table, AssetKey key)
+	{
+		auto it = table.Indices.find(key.Hash);
+		if (it != table.Indices.end())
+			return it->second;
+
+		unsigned int index = (unsigned int)table.Names.size();
+		table.Indices.insert({ key.Hash, index });
+		table.Names.push_back(std::string(key.Name, key.Length));
+		table.Values.push_back(0);
+		return index;
+	}
+
+	// Map nodes don't move, so the value's address is good until it's erased
+	template<typename T>
+	T* ResolveHandle(HandleTable<T>& table, std::unordered_map<std::string, T>& dictionary, unsigned int index)
+	{
+		if (index >= table.Values.size())
+			return 0;
+		if (table.Values[index])
+			return table.Values[index];
+
+		std::string name = table.Names[index];
+		auto it = dictionary.find(name);
+		if (it == dictionary.end() && LoadOnDemand(name))
+			it = dictionary.find(name);
+		if (it == dictionary.end())
+			return 0;
+
+		RecordAccess(name);
+		table.Values[index] = &it->second;
+		return table.Values[index];
+	}
+
+	// Has to happen before erasing anything a handle might point to
+	template<typename T>
+	void ForgetHandle(HandleTable<T>& table, const std::string& name)
+	{
+		auto it = table.Indices.find(HashAssetName(name.c_str(), name.size()));
+		if (it != table.Indices.end())
+			table.Values[it->second] = 0;
+	}
+
+	// Each vertex shader's "_Compact" permutation, found once everything's
+	// loaded so looking them up while drawing never changes the map
+	std::unordered_map<SimpleVertexShader*, SimpleVertexShader*> compactVertexShaders;
+
 	// Helpers for determining the actual path to the executable
 	std::string GetExePath();
 	std::wstring GetExePath_Wide();
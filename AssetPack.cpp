@@ -0,0 +1,167 @@
+#include "AssetPack.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <cctype>
+
+AssetPack::AssetPack()
+	: file(INVALID_HANDLE_VALUE), mapping(0), data(0), size(0), header(0), slots(0), names(0)
+{
+}
+
+AssetPack::~AssetPack()
+{
+	Close();
+}
+
+// --------------------------------------------------------
+// Maps the whole pack read only and checks that its table
+// of contents, names and entries all fit inside it
+// --------------------------------------------------------
+bool AssetPack::Open(const std::string& path)
+{
+	Close();
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(file, &fileSize);
+	size = (unsigned long long)fileSize.QuadPart;
+	if (size >= sizeof(AssetPackHeader))
+		mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping)
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+
+	header = (const AssetPackHeader*)data;
+	unsigned long long slotsEnd = sizeof(AssetPackHeader) + (unsigned long long)header->SlotCount * sizeof(AssetPackEntry);
+	bool valid =
+		header->Magic == ASSET_PACK_MAGIC &&
+		header->Version == ASSET_PACK_VERSION &&
+		header->SlotCount > 0 && (header->SlotCount & (header->SlotCount - 1)) == 0 &&
+		header->EntryCount < header->SlotCount &&
+		slotsEnd <= size &&
+		header->NamesOffset >= slotsEnd &&
+		header->NamesOffset + header->NamesSize <= size;
+
+	slots = (const AssetPackEntry*)(header + 1);
+	names = (const char*)(data + header->NamesOffset);
+	for (unsigned int i = 0; valid && i < header->SlotCount; i++)
+	{
+		const AssetPackEntry& entry = slots[i];
+		valid = entry.Hash == 0 || (
+			entry.Offset + entry.Size <= size &&
+			(unsigned long long)entry.NameOffset + entry.NameLength <= header->NamesSize);
+	}
+
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void AssetPack::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	file = INVALID_HANDLE_VALUE;
+	mapping = 0;
+	data = 0;
+	size = 0;
+	header = 0;
+	slots = 0;
+	names = 0;
+}
+
+bool AssetPack::Find(const std::string& name, const unsigned char*& entryData, unsigned long long& entrySize) const
+{
+	const AssetPackEntry* entry = FindEntry(name);
+	if (!entry)
+		return false;
+
+	entryData = data + entry->Offset;
+	entrySize = entry->Size;
+	return true;
+}
+
+bool AssetPack::Contains(const std::string& name) const
+{
+	return FindEntry(name) != 0;
+}
+
+std::vector<std::string> AssetPack::GetNames() const
+{
+	std::vector<const AssetPackEntry*> entries;
+	for (unsigned int i = 0; data && i < header->SlotCount; i++)
+	{
+		if (slots[i].Hash != 0)
+			entries.push_back(&slots[i]);
+	}
+
+	// Data was written in packing order, so that's the order of offsets
+	std::sort(entries.begin(), entries.end(), [](const AssetPackEntry* a, const AssetPackEntry* b) { return a->Offset < b->Offset; });
+
+	std::vector<std::string> result;
+	for (auto e : entries)
+		result.push_back(std::string(names + e->NameOffset, e->NameLength));
+	return result;
+}
+
+unsigned int AssetPack::GetEntryCount() const
+{
+	return data ? header->EntryCount : 0;
+}
+
+unsigned long long AssetPack::Hash(const std::string& name)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (char c : name)
+	{
+		hash ^= (unsigned char)(c == '/' ? '\\' : tolower((unsigned char)c));
+		hash *= 1099511628211ull;
+	}
+	return hash == 0 ? 1 : hash;
+}
+
+// Linear probing from the hash's slot, until an empty one
+const AssetPackEntry* AssetPack::FindEntry(const std::string& name) const
+{
+	if (!data)
+		return 0;
+
+	unsigned long long hash = Hash(name);
+	unsigned int mask = header->SlotCount - 1;
+	for (unsigned int i = (unsigned int)hash & mask; slots[i].Hash != 0; i = (i + 1) & mask)
+	{
+		if (slots[i].Hash == hash && SameName(names + slots[i].NameOffset, slots[i].NameLength, name))
+			return &slots[i];
+	}
+	return 0;
+}
+
+bool AssetPack::SameName(const char* a, unsigned int aLength, const std::string& b)
+{
+	if (aLength != b.size())
+		return false;
+
+	for (unsigned int i = 0; i < aLength; i++)
+	{
+		char ca = a[i] == '/' ? '\\' : (char)tolower((unsigned char)a[i]);
+		char cb = b[i] == '/' ? '\\' : (char)tolower((unsigned char)b[i]);
+		if (ca != cb)
+			return false;
+	}
+	return true;
+}
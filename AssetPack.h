@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// One file holding every asset (and shader), made by Tools\AssetPacker
+// and found next to the exe, which Assets reads from instead of the
+// loose files whenever it's there
+#define ASSET_PACK_FILE			"Assets.pack"
+#define ASSET_PACK_MAGIC		0x4B505341	// "ASPK"
+#define ASSET_PACK_VERSION		1
+
+// Every entry's data starts on a page, so views into the mapped
+// pack are page aligned and no read straddles two entries
+#define ASSET_PACK_ALIGNMENT	4096
+
+// Start of the pack, followed by the table of contents (an open
+// addressed hash table of entries, by name), then the names
+struct AssetPackHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int EntryCount;
+	unsigned int SlotCount;		// A power of two, at least twice the entries
+	unsigned long long NamesOffset;
+	unsigned long long NamesSize;
+};
+
+// One slot of the table of contents
+struct AssetPackEntry
+{
+	unsigned long long Hash;	// Zero for an empty slot
+	unsigned long long Offset;	// From the start of the pack
+	unsigned long long Size;
+	unsigned int NameOffset;	// Into the names
+	unsigned int NameLength;
+};
+
+// --------------------------------------------------------
+// A memory mapped asset pack, with entries named by their
+// path under the asset folder (or just the file name, for
+// shaders), matched regardless of case or slash direction
+//  - Nothing changes once it's open, so any thread can
+//    look things up and read the mapped data at once
+// --------------------------------------------------------
+class AssetPack
+{
+public:
+	AssetPack();
+	~AssetPack();
+
+	// Maps the pack, which fails if it isn't there (or isn't a valid pack)
+	bool Open(const std::string& path);
+	void Close();
+	bool IsOpen() { return data != 0; }
+
+	// A view of an entry's data, straight from the mapped pack
+	bool Find(const std::string& name, const unsigned char*& entryData, unsigned long long& entrySize) const;
+	bool Contains(const std::string& name) const;
+
+	// Every entry's name, in the order they were packed
+	std::vector<std::string> GetNames() const;
+	unsigned int GetEntryCount() const;
+
+	// FNV-1a of the name in lower case with backslashes, never zero
+	static unsigned long long Hash(const std::string& name);
+
+private:
+	void* file;
+	void* mapping;
+	const unsigned char* data;
+	unsigned long long size;
+
+	const AssetPackHeader* header;
+	const AssetPackEntry* slots;
+	const char* names;
+
+	const AssetPackEntry* FindEntry(const std::string& name) const;
+	static bool SameName(const char* a, unsigned int aLength, const std::string& b);
+};
@@ -0,0 +1,182 @@
+#include "AssetWatcher.h"
+#include "CpuProfiler.h"
+#include "ThreadManager.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <unordered_map>
+
+// What counts as a change worth reporting
+#define ASSET_WATCHER_FILTER (FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE)
+
+// A file that's changed, and when it last did
+struct ChangedFile
+{
+	unsigned int Directory;
+	std::string File;
+	ULONGLONG Time;
+};
+
+static std::string ToNarrowString(const wchar_t* text, int length)
+{
+	int size = WideCharToMultiByte(CP_ACP, 0, text, length, 0, 0, 0, 0);
+	std::string narrow(size, '\0');
+	if (size > 0)
+		WideCharToMultiByte(CP_ACP, 0, text, length, &narrow[0], size, 0, 0);
+	return narrow;
+}
+
+AssetWatcher::AssetWatcher()
+{
+	stopEvent = CreateEvent(0, TRUE, FALSE, 0);
+}
+
+AssetWatcher::~AssetWatcher()
+{
+	Stop();
+	CloseHandle(stopEvent);
+}
+
+bool AssetWatcher::Start(const std::vector<AssetWatchDirectory>& watch, std::function<void(unsigned int directory, const std::string& file)> onChanged)
+{
+	Stop();
+	this->onChanged = onChanged;
+
+	for (auto& w : watch)
+	{
+		WatchedDirectory* d = new WatchedDirectory();
+		d->Directory = w;
+		d->Handle = CreateFileA(w.Path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			0, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+		d->Overlapped = {};
+		d->Overlapped.hEvent = CreateEvent(0, TRUE, FALSE, 0);
+		d->Buffer.resize(ASSET_WATCHER_BUFFER_SIZE / sizeof(DWORD));
+		directories.push_back(d);
+
+		if (d->Handle == INVALID_HANDLE_VALUE || !Read(d))
+		{
+			printf("Can't watch %s for changes (error %u)\n", w.Path.c_str(), (unsigned int)GetLastError());
+			Close();
+			return false;
+		}
+	}
+
+	ResetEvent(stopEvent);
+	thread = std::thread(&AssetWatcher::WatchLoop, this);
+	return true;
+}
+
+void AssetWatcher::Stop()
+{
+	if (thread.joinable())
+	{
+		SetEvent(stopEvent);
+		thread.join();
+	}
+	Close();
+}
+
+// Queues the next read, which signals the directory's event once there's something in it
+bool AssetWatcher::Read(WatchedDirectory* d)
+{
+	return ReadDirectoryChangesW(d->Handle, d->Buffer.data(), (DWORD)(d->Buffer.size() * sizeof(DWORD)),
+		d->Directory.Recursive ? TRUE : FALSE, ASSET_WATCHER_FILTER, 0, &d->Overlapped, 0) != 0;
+}
+
+// --------------------------------------------------------
+// Waits for any directory's read (or to stop), noting each
+// file it says changed, and reports the ones that haven't
+// changed again for ASSET_WATCHER_SETTLE_MS
+//  - Files are told apart regardless of case, like Windows
+//    does, so a save that renames over a file is one change
+// --------------------------------------------------------
+void AssetWatcher::WatchLoop()
+{
+	CpuProfiler::GetInstance().NameThread("Asset Watcher");
+	ThreadManager::GetInstance().Configure(ThreadRole::Background, "Asset Watcher");
+
+	std::vector<HANDLE> events;
+	for (auto d : directories)
+		events.push_back(d->Overlapped.hEvent);
+	events.push_back(stopEvent);
+	DWORD stopIndex = (DWORD)directories.size();
+
+	std::unordered_map<std::string, ChangedFile> changed;
+	while (true)
+	{
+		DWORD result = WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, changed.empty() ? INFINITE : ASSET_WATCHER_SETTLE_MS);
+		if (result == WAIT_OBJECT_0 + stopIndex || result == WAIT_FAILED)
+		{
+			ThreadManager::GetInstance().Unregister();
+			return;
+		}
+
+		if (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + stopIndex)
+		{
+			unsigned int index = result - WAIT_OBJECT_0;
+			WatchedDirectory* d = directories[index];
+			DWORD bytes = 0;
+			if (GetOverlappedResult(d->Handle, &d->Overlapped, &bytes, FALSE))
+			{
+				// Nothing at all means there was too much to fit
+				if (bytes == 0)
+					printf("Too many changes in %s at once, so some weren't reloaded\n", d->Directory.Path.c_str());
+
+				const BYTE* at = (const BYTE*)d->Buffer.data();
+				while (bytes > 0)
+				{
+					const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)at;
+					if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+					{
+						std::string file = ToNarrowString(info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)));
+						std::string key = std::to_string(index) + "|" + file;
+						std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+						changed[key] = { index, file, GetTickCount64() };
+					}
+
+					if (info->NextEntryOffset == 0)
+						break;
+					at += info->NextEntryOffset;
+				}
+			}
+
+			// Its event's left unsignaled if it can't carry on, so it's just never waited for again
+			if (!Read(d))
+			{
+				printf("Stopped watching %s for changes (error %u)\n", d->Directory.Path.c_str(), (unsigned int)GetLastError());
+				ResetEvent(d->Overlapped.hEvent);
+			}
+		}
+
+		ULONGLONG now = GetTickCount64();
+		for (auto it = changed.begin(); it != changed.end();)
+		{
+			if (now - it->second.Time < ASSET_WATCHER_SETTLE_MS)
+			{
+				it++;
+				continue;
+			}
+
+			onChanged(it->second.Directory, it->second.File);
+			it = changed.erase(it);
+		}
+	}
+}
+
+// Cancels each read and waits for it, since it writes into the buffer until it's done
+void AssetWatcher::Close()
+{
+	for (auto d : directories)
+	{
+		if (d->Handle != INVALID_HANDLE_VALUE)
+		{
+			DWORD bytes = 0;
+			if (CancelIoEx(d->Handle, &d->Overlapped))
+				GetOverlappedResult(d->Handle, &d->Overlapped, &bytes, TRUE);
+			CloseHandle(d->Handle);
+		}
+		CloseHandle(d->Overlapped.hEvent);
+		delete d;
+	}
+	directories.clear();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Windows.h>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How long a file has to go without changing before it's reported, since
+// most tools write a file in more than one go (and some write it twice)
+#define ASSET_WATCHER_SETTLE_MS		200
+
+// Bytes of change notifications each directory can queue up between
+// reads, past which that read's changes are lost (and say so)
+#define ASSET_WATCHER_BUFFER_SIZE	(64 * 1024)
+
+struct AssetWatchDirectory
+{
+	std::string Path;
+	bool Recursive;
+};
+
+// Watches directories with ReadDirectoryChangesW, on its own thread,
+// and reports each file that's written (or renamed into place) once
+// it's settled, with the index of its directory and its path in there
+//  - Reports happen on the watcher's thread, so they have to hand off
+//    anything that isn't thread safe
+class AssetWatcher
+{
+public:
+	AssetWatcher();
+	~AssetWatcher();
+
+	// Starts watching, stopping whatever it was watching before, and
+	// returns false (watching nothing) if a directory can't be opened
+	bool Start(const std::vector<AssetWatchDirectory>& directories, std::function<void(unsigned int directory, const std::string& file)> onChanged);
+	void Stop();
+	bool IsRunning() { return thread.joinable(); }
+
+private:
+	// Each has its own read in flight, which is why they're never moved
+	struct WatchedDirectory
+	{
+		AssetWatchDirectory Directory;
+		HANDLE Handle;
+		OVERLAPPED Overlapped;
+		std::vector<DWORD> Buffer;	// DWORDs, since the notifications have to be aligned to them
+	};
+
+	std::vector<WatchedDirectory*> directories;
+	std::function<void(unsigned int, const std::string&)> onChanged;
+	HANDLE stopEvent;
+	std::thread thread;
+
+	bool Read(WatchedDirectory* directory);
+	void WatchLoop();
+	void Close();
+};
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include "PortableMath.h"
+
+// Shared by the game and the server (see Server/GameServer)
+//
+// Writing and reading a bit at a time, so values only take the bits
+// they need.  Everything's serialized by templates that take either
+// stream, so one description of a message both writes and reads it:
+//
+//  template <typename Stream>
+//  void NetSerialize(Stream& stream, Thing& thing)
+//  {
+//      NetSerializeFloat(stream, thing.Height, NetRangeQuantizer{ 0, 100, 0.01f });
+//      NetSerializeBool(stream, thing.Alive);
+//  }
+
+// Writes bits into a buffer, lowest bits first
+class BitWriter
+{
+public:
+	static const bool IsWriting = true;
+
+	BitWriter(char* buffer, unsigned int capacity)
+		: buffer(buffer), capacity(capacity), scratch(0), scratchBits(0), bytes(0) {}
+
+	void SerializeBits(unsigned int& value, unsigned int bits) { WriteBits(value, bits); }
+
+	// Up to 32 bits at a time
+	void WriteBits(unsigned int value, unsigned int bits)
+	{
+		if (bits < 32)
+			value &= (1u << bits) - 1;
+
+		scratch |= (unsigned long long)value << scratchBits;
+		scratchBits += bits;
+		while (scratchBits >= 8)
+		{
+			PutByte((char)(scratch & 0xFF));
+			scratch >>= 8;
+			scratchBits -= 8;
+		}
+	}
+
+	// Writes out what's left, padded with zeros to a whole byte
+	void Flush()
+	{
+		if (scratchBits > 0)
+			PutByte((char)(scratch & 0xFF));
+		scratch = 0;
+		scratchBits = 0;
+	}
+
+	// In whole bytes, once it's been flushed
+	const char* GetData() { return buffer; }
+	int GetSize() { return (int)bytes; }
+
+private:
+	void PutByte(char value)
+	{
+		if (bytes >= capacity)
+			throw std::length_error("Bit stream too long");
+		buffer[bytes++] = value;
+	}
+
+	char* buffer;
+	unsigned int capacity;
+	unsigned long long scratch;
+	unsigned int scratchBits;
+	unsigned int bytes;
+};
+
+// Counts the bits a write would take, without writing them, so the
+// writer can find out what something costs before it commits to it
+class BitCounter
+{
+public:
+	static const bool IsWriting = true;
+
+	BitCounter() : bits(0) {}
+
+	void SerializeBits(unsigned int& /*value*/, unsigned int bits) { this->bits += bits; }
+
+	unsigned int GetBits() { return bits; }
+
+private:
+	unsigned int bits;
+};
+
+// Reads bits back in the order they were written
+//  - Reading past the end gives zeros, and marks the stream
+//    overflowed, so a short message is never read out of bounds
+class BitReader
+{
+public:
+	static const bool IsWriting = false;
+
+	BitReader(const char* data, unsigned int size)
+		: data(data), size(size), scratch(0), scratchBits(0), bytes(0), overflowed(false) {}
+
+	void SerializeBits(unsigned int& value, unsigned int bits) { value = ReadBits(bits); }
+
+	unsigned int ReadBits(unsigned int bits)
+	{
+		while (scratchBits < bits)
+		{
+			if (bytes >= size)
+			{
+				overflowed = true;
+				return 0;
+			}
+			scratch |= (unsigned long long)(unsigned char)data[bytes++] << scratchBits;
+			scratchBits += 8;
+		}
+
+		unsigned int value = (unsigned int)(scratch & ((1ull << bits) - 1));
+		scratch >>= bits;
+		scratchBits -= bits;
+		return value;
+	}
+
+	// Skips to the start of the next whole byte
+	void Align()
+	{
+		scratch = 0;
+		scratchBits = 0;
+	}
+
+	bool IsOverflowed() { return overflowed; }
+
+private:
+	const char* data;
+	unsigned int size;
+	unsigned long long scratch;
+	unsigned int scratchBits;
+	unsigned int bytes;
+	bool overflowed;
+};
+
+
+// --------------------------------------------------------
+// Quantization policies: how a float becomes some bits and
+// back, with Bits(), Quantize() and Dequantize()
+// --------------------------------------------------------
+
+// A float clamped between Min and Max, to within Precision
+struct NetRangeQuantizer
+{
+	float Min;
+	float Max;
+	float Precision;
+
+	// (Rounded up by hand, since std::ceil isn't constexpr)
+	constexpr unsigned int Steps() const
+	{
+		float steps = (Max - Min) / Precision;
+		return (unsigned int)steps + ((float)(unsigned int)steps < steps ? 1 : 0);
+	}
+
+	constexpr unsigned int Bits() const
+	{
+		unsigned int steps = Steps();
+		unsigned int bits = 1;
+		while (bits < 32 && (steps >> bits) != 0)
+			bits++;
+		return bits;
+	}
+
+	unsigned int Quantize(float value) const
+	{
+		double t = ((double)value - Min) / ((double)Max - Min);
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+		return (unsigned int)(t * Steps() + 0.5);
+	}
+
+	float Dequantize(unsigned int value) const
+	{
+		unsigned int steps = Steps();
+		if (value > steps)
+			value = steps;
+		return (float)(Min + ((double)Max - Min) * value / steps);
+	}
+};
+
+// An angle in radians, wrapped to one turn, in 2^AngleBits steps
+//  - Comes back between -pi and pi
+struct NetAngleQuantizer
+{
+	unsigned int AngleBits;
+
+	constexpr unsigned int Bits() const { return AngleBits; }
+
+	unsigned int Quantize(float value) const
+	{
+		double turns = value / DirectX::XM_2PI;
+		turns -= std::floor(turns);
+		unsigned long long steps = 1ull << AngleBits;
+		return (unsigned int)((unsigned long long)(turns * steps + 0.5) % steps);
+	}
+
+	float Dequantize(unsigned int value) const
+	{
+		double angle = (double)value / (1ull << AngleBits) * DirectX::XM_2PI;
+		if (angle >= DirectX::XM_PI)
+			angle -= DirectX::XM_2PI;
+		return (float)angle;
+	}
+};
+
+
+// --------------------------------------------------------
+// Serializing values with either stream
+// --------------------------------------------------------
+
+template <typename Stream>
+void NetSerializeBool(Stream& stream, bool& value)
+{
+	unsigned int bit = (Stream::IsWriting && value) ? 1 : 0;
+	stream.SerializeBits(bit, 1);
+	value = bit != 0;
+}
+
+template <typename Stream>
+void NetSerializeUInt(Stream& stream, unsigned int& value, unsigned int bits = 32)
+{
+	stream.SerializeBits(value, bits);
+}
+
+template <typename Stream, typename Quantizer>
+void NetSerializeFloat(Stream& stream, float& value, const Quantizer& quantizer)
+{
+	unsigned int bits = Stream::IsWriting ? quantizer.Quantize(value) : 0;
+	stream.SerializeBits(bits, quantizer.Bits());
+	if (!Stream::IsWriting)
+		value = quantizer.Dequantize(bits);
+}
+
+template <typename Stream, typename Quantizer>
+void NetSerializeFloat3(Stream& stream, DirectX::XMFLOAT3& value, const Quantizer& x, const Quantizer& y, const Quantizer& z)
+{
+	NetSerializeFloat(stream, value.x, x);
+	NetSerializeFloat(stream, value.y, y);
+	NetSerializeFloat(stream, value.z, z);
+}
+
+template <typename Stream, typename Quantizer>
+void NetSerializeFloat3(Stream& stream, DirectX::XMFLOAT3& value, const Quantizer& quantizer)
+{
+	NetSerializeFloat3(stream, value, quantizer, quantizer, quantizer);
+}
+
+// Just one bit when it's all zero, which most velocities are
+template <typename Stream, typename Quantizer>
+void NetSerializeOptionalFloat3(Stream& stream, DirectX::XMFLOAT3& value, const Quantizer& quantizer)
+{
+	bool nonZero = Stream::IsWriting && (value.x != 0 || value.y != 0 || value.z != 0);
+	NetSerializeBool(stream, nonZero);
+	if (nonZero)
+		NetSerializeFloat3(stream, value, quantizer);
+	else if (!Stream::IsWriting)
+		value = DirectX::XMFLOAT3(0, 0, 0);
+}
+
+// A unit quaternion as its three smallest components, and which one
+// was left out (which is rebuilt from the rest, since it's the largest)
+//  - Those three are all within +-1/sqrt(2)
+template <typename Stream>
+void NetSerializeQuaternion(Stream& stream, DirectX::XMFLOAT4& value, unsigned int componentBits)
+{
+	const float limit = 0.70710678f;
+	NetRangeQuantizer component = { -limit, limit, 2 * limit / ((1u << componentBits) - 1) };
+	float* q = &value.x;
+
+	unsigned int largest = 0;
+	if (Stream::IsWriting)
+	{
+		for (unsigned int i = 1; i < 4; i++)
+			if (std::fabs(q[i]) > std::fabs(q[largest]))
+				largest = i;
+	}
+	stream.SerializeBits(largest, 2);
+
+	// q and -q are the same rotation, so the left out one's always positive
+	float sign = (Stream::IsWriting && q[largest] < 0) ? -1.0f : 1.0f;
+	float sumOfSquares = 0;
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		float c = q[i] * sign;
+		NetSerializeFloat(stream, c, component);
+		if (!Stream::IsWriting)
+			q[i] = c;
+		sumOfSquares += c * c;
+	}
+	if (!Stream::IsWriting)
+		q[largest] = std::sqrt(sumOfSquares < 1 ? 1 - sumOfSquares : 0.0f);
+}
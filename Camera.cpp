@@ -1,17 +1,56 @@
 #include "Camera.h"
 #include "Input.h"
+#include "GpuMemory.h"
+
+#include <cstring>
 
 using namespace DirectX;
 
+// --------------------------------------------------------
+// Works out everything derived from the view and projection
+//  - The frustum planes come straight from the rows of the
+//    view projection's transpose (Gribb & Hartmann)
+// --------------------------------------------------------
+void ViewConstants::Compute()
+{
+	XMMATRIX view = XMLoadFloat4x4(&View);
+	XMMATRIX proj = XMLoadFloat4x4(&Projection);
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	XMStoreFloat4x4(&ViewProjection, viewProj);
+	XMStoreFloat4x4(&InvView, XMMatrixInverse(0, view));
+	XMStoreFloat4x4(&InvProjection, XMMatrixInverse(0, proj));
+	XMStoreFloat4x4(&InvViewProjection, XMMatrixInverse(0, viewProj));
+
+	XMMATRIX t = XMMatrixTranspose(viewProj);
+	XMVECTOR planes[6] =
+	{
+		XMVectorAdd(t.r[3], t.r[0]),		// Left
+		XMVectorSubtract(t.r[3], t.r[0]),	// Right
+		XMVectorAdd(t.r[3], t.r[1]),		// Bottom
+		XMVectorSubtract(t.r[3], t.r[1]),	// Top
+		t.r[2],								// Near (depth starts at 0 in D3D)
+		XMVectorSubtract(t.r[3], t.r[2]),	// Far
+	};
+	for (int i = 0; i < 6; i++)
+		XMStoreFloat4(&FrustumPlanes[i], XMPlaneNormalize(planes[i]));
+}
+
 // Creates a camera at the specified position
 Camera::Camera(float x, float y, float z, float moveSpeed, float mouseLookSpeed, float aspectRatio)
 {
 	this->movementSpeed = moveSpeed;
 	this->mouseLookSpeed = mouseLookSpeed;
+	this->nearClip = 0.01f;
+	this->farClip = 300.0f;
 	transform.SetPosition(x, y, z);
 
+	constants = {};
+	version = 1;
+	uploadedVersion = 0;
+
 	UpdateViewMatrix();
 	UpdateProjectionMatrix(aspectRatio);
+	constants.PrevViewProjection = constants.ViewProjection;
 }
 
 // Nothing to really do
@@ -49,7 +88,15 @@ void Camera::Update(float dt)
 		transform.Rotate(yDiff, xDiff, 0);
 	}*/
 
-	// Update the view every frame - could be optimized
+	// Last frame's view, for anything reprojecting
+	if (memcmp(&constants.PrevViewProjection, &constants.ViewProjection, sizeof(XMFLOAT4X4)) != 0)
+	{
+		constants.PrevViewProjection = constants.ViewProjection;
+		constants.PrevJitter = constants.Jitter;
+		version++;
+	}
+
+	// Update the view every frame - only recomputed if it moved
 	UpdateViewMatrix();
 
 }
@@ -68,18 +115,70 @@ void Camera::UpdateViewMatrix()
 		dir,
 		XMVectorSet(0, 1, 0, 0));
 
+	XMFLOAT4X4 viewMatrix;
 	XMStoreFloat4x4(&viewMatrix, view);
+	if (memcmp(&viewMatrix, &constants.View, sizeof(XMFLOAT4X4)) == 0)
+		return;
+
+	constants.View = viewMatrix;
+	ViewChanged();
 }
 
 // Updates the projection matrix
 void Camera::UpdateProjectionMatrix(float aspectRatio)
 {
+	this->aspectRatio = aspectRatio;
 	XMMATRIX P = XMMatrixPerspectiveFovLH(
 		0.25f * XM_PI,		// Field of View Angle
 		aspectRatio,		// Aspect ratio
-		0.01f,				// Near clip plane distance
-		300.0f);			// Far clip plane distance
-	XMStoreFloat4x4(&projMatrix, P);
+		nearClip,			// Near clip plane distance
+		farClip);			// Far clip plane distance
+
+	// Jitter shifts the whole projection, after the divide by w
+	P = XMMatrixMultiply(P, XMMatrixTranslation(constants.Jitter.x, constants.Jitter.y, 0));
+
+	XMStoreFloat4x4(&constants.Projection, P);
+	ViewChanged();
+}
+
+void Camera::SetJitter(float x, float y)
+{
+	if (constants.Jitter.x == x && constants.Jitter.y == y)
+		return;
+
+	constants.Jitter = XMFLOAT2(x, y);
+	UpdateProjectionMatrix(aspectRatio);
+}
+
+// Rebuilds the derived values after the view or projection changes
+void Camera::ViewChanged()
+{
+	constants.Compute();
+	version++;
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> Camera::GetViewBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	if (!viewBuffer)
+	{
+		D3D11_BUFFER_DESC cbDesc = {};
+		cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		cbDesc.Usage = D3D11_USAGE_DEFAULT;
+		cbDesc.ByteWidth = sizeof(ViewConstants);
+
+		D3D11_SUBRESOURCE_DATA initialData = {};
+		initialData.pSysMem = &constants;
+		if (FAILED(GpuMemory::CreateBuffer(device.Get(), &cbDesc, &initialData, viewBuffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Camera View")))
+			return 0;
+		uploadedVersion = version;
+	}
+
+	if (uploadedVersion != version)
+	{
+		context->UpdateSubresource(viewBuffer.Get(), 0, 0, &constants, 0, 0);
+		uploadedVersion = version;
+	}
+	return viewBuffer;
 }
 
 Transform* Camera::GetTransform()
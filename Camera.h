@@ -1,9 +1,32 @@
 #pragma once
+#include <d3d11.h>
 #include <DirectXMath.h>
 #include <Windows.h>
+#include <wrl/client.h>
 
 #include "Transform.h"
 
+// Everything derived from one view, worked out when its
+// matrices change rather than by each pass that needs it
+//  - Must match the perFrame cbuffer in ViewConstants.hlsli
+struct ViewConstants
+{
+	DirectX::XMFLOAT4X4 View;
+	DirectX::XMFLOAT4X4 Projection;
+	DirectX::XMFLOAT4X4 ViewProjection;
+	DirectX::XMFLOAT4X4 InvView;
+	DirectX::XMFLOAT4X4 InvProjection;
+	DirectX::XMFLOAT4X4 InvViewProjection;
+	DirectX::XMFLOAT4X4 PrevViewProjection;	// As of the last Update()
+	DirectX::XMFLOAT4 FrustumPlanes[6];		// World space, left right bottom top near far - inside is positive
+	DirectX::XMFLOAT2 Jitter;				// In NDC, already part of the projection
+	DirectX::XMFLOAT2 PrevJitter;			// Part of the previous view projection
+
+	// Fills the rest in from the view, projection and jitter, so
+	// shadow cascades and the like can share the same layout
+	void Compute();
+};
+
 class Camera
 {
 public:
@@ -15,20 +38,41 @@ public:
 	void UpdateViewMatrix();
 	void UpdateProjectionMatrix(float aspectRatio);
 
+	// Sub-pixel offset of the projection, in NDC
+	void SetJitter(float x, float y);
+
 	// Getters
-	DirectX::XMFLOAT4X4 GetView() { return viewMatrix; }
-	DirectX::XMFLOAT4X4 GetProjection() { return projMatrix; }
+	DirectX::XMFLOAT4X4 GetView() { return constants.View; }
+	DirectX::XMFLOAT4X4 GetProjection() { return constants.Projection; }
+	const ViewConstants& GetViewConstants() { return constants; }
+	float GetNearClip() { return nearClip; }
+	float GetFarClip() { return farClip; }
+
+	// This camera's constant buffer, uploaded only if the view's changed
+	// since the last call (and made the first time it's asked for)
+	//  - Call from one thread, before the passes that read it start
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetViewBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
 	Transform* GetTransform();
 
 private:
-	// Camera matrices
-	DirectX::XMFLOAT4X4 viewMatrix;
-	DirectX::XMFLOAT4X4 projMatrix;
+	// Camera matrices, and everything worked out from them
+	ViewConstants constants;
+	void ViewChanged();
+
+	// Bumped whenever the constants change, so the buffer's
+	// only uploaded when it's behind
+	unsigned int version;
+	unsigned int uploadedVersion;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> viewBuffer;
 
 	Transform transform;
 
 	float movementSpeed;
 	float mouseLookSpeed;
+
+	float aspectRatio;
+	float nearClip;
+	float farClip;
 };
 
@@ -0,0 +1,205 @@
+#include "CpuProfiler.h"
+
+#include <Windows.h>
+#include <cstdio>
+#include <fstream>
+
+// Singleton requirement
+CpuProfiler* CpuProfiler::instance;
+
+CpuProfiler::CpuProfiler()
+	: paused(false), threadCount(0), frameCount(0)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	frequency = freq.QuadPart;
+
+	for (unsigned int i = 0; i < CPU_PROFILER_MAX_THREADS; i++)
+		threads[i] = nullptr;
+}
+
+// (Only once nothing else could be recording)
+CpuProfiler::~CpuProfiler()
+{
+	for (unsigned int i = 0; i < threadCount; i++)
+		delete threads[i];
+}
+
+long long CpuProfiler::Now()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+void CpuProfiler::BeginFrame()
+{
+	if (paused) return;
+
+	unsigned long long frame = frameCount.load(std::memory_order_relaxed);
+	frameStarts[frame % (CPU_PROFILER_FRAMES + 1)] = Now();
+	frameCount.store(frame + 1, std::memory_order_release);
+}
+
+void CpuProfiler::NameThread(const char* name)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	if (!buffer) return;
+
+	std::lock_guard<std::mutex> lock(threadMutex);
+	buffer->Name = name;
+}
+
+unsigned int CpuProfiler::EnterScope()
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	return buffer ? buffer->Depth++ : 0;
+}
+
+// --------------------------------------------------------
+// Only its own thread ever writes to a ring, so this just
+// fills in the next event, then says it's there (with what
+// the thread's allocated since the scope started)
+// --------------------------------------------------------
+void CpuProfiler::ExitScope(const char* name, long long start, unsigned int depth, const AllocationCounts& allocations)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	if (!buffer) return;
+
+	buffer->Depth = depth;
+	if (paused) return;
+
+	long long end = Now();
+	AllocationCounts now = AllocationTracker::GetThreadCounts();
+	unsigned long long written = buffer->Written.load(std::memory_order_relaxed);
+	buffer->Events[written % CPU_PROFILER_EVENTS_PER_THREAD] = { name, start, end, depth,
+		(unsigned int)(now.Allocations - allocations.Allocations), now.Bytes - allocations.Bytes };
+	buffer->Written.store(written + 1, std::memory_order_release);
+}
+
+// --------------------------------------------------------
+// Each thread's ring, the first time it's seen (or nothing,
+// once there are as many as there can be)
+// --------------------------------------------------------
+CpuProfiler::ThreadBuffer* CpuProfiler::GetThreadBuffer()
+{
+	thread_local ThreadBuffer* buffer = nullptr;
+	thread_local bool full = false;
+	if (buffer || full)
+		return buffer;
+
+	std::lock_guard<std::mutex> lock(threadMutex);
+	unsigned int index = threadCount.load();
+	if (index >= CPU_PROFILER_MAX_THREADS)
+	{
+		full = true;
+		return nullptr;
+	}
+
+	buffer = new ThreadBuffer();
+	buffer->Name = "Thread " + std::to_string(index);
+	buffer->Written = 0;
+	buffer->Depth = 0;
+	threads[index] = buffer;
+	threadCount.store(index + 1, std::memory_order_release);
+	return buffer;
+}
+
+// --------------------------------------------------------
+// Copies each ring, then drops whatever its thread might
+// have written over while it was being copied, and keeps
+// only what overlaps the frames
+// --------------------------------------------------------
+unsigned int CpuProfiler::Capture(unsigned int frames, std::vector<CpuProfileThread>& captured, long long& start, long long& end)
+{
+	captured.clear();
+	start = end = 0;
+
+	// The newest frame's still going, so it's only up to its start
+	unsigned long long frame = frameCount.load(std::memory_order_acquire);
+	if (frame < 2) return 0;
+	frames = (unsigned int)min((unsigned long long)frames, min(frame - 1, (unsigned long long)CPU_PROFILER_FRAMES));
+	if (frames == 0) return 0;
+	start = frameStarts[(frame - 1 - frames) % (CPU_PROFILER_FRAMES + 1)];
+	end = frameStarts[(frame - 1) % (CPU_PROFILER_FRAMES + 1)];
+
+	unsigned int count = threadCount.load(std::memory_order_acquire);
+	std::vector<CpuProfileEvent> copied;
+	for (unsigned int t = 0; t < count; t++)
+	{
+		ThreadBuffer* buffer = threads[t];
+		unsigned long long written = buffer->Written.load(std::memory_order_acquire);
+		unsigned long long first = written > CPU_PROFILER_EVENTS_PER_THREAD ? written - CPU_PROFILER_EVENTS_PER_THREAD : 0;
+
+		copied.clear();
+		for (unsigned long long i = first; i < written; i++)
+			copied.push_back(buffer->Events[i % CPU_PROFILER_EVENTS_PER_THREAD]);
+
+		unsigned long long after = buffer->Written.load(std::memory_order_acquire);
+		unsigned long long overwritten = after > CPU_PROFILER_EVENTS_PER_THREAD ? after - CPU_PROFILER_EVENTS_PER_THREAD : 0;
+
+		CpuProfileThread thread;
+		{
+			std::lock_guard<std::mutex> lock(threadMutex);
+			thread.Name = buffer->Name;
+		}
+		for (unsigned long long i = first; i < written; i++)
+		{
+			const CpuProfileEvent& e = copied[(size_t)(i - first)];
+			if (i < overwritten || e.End <= start || e.Start >= end) continue;
+			thread.Events.push_back(e);
+		}
+		captured.push_back(std::move(thread));
+	}
+	return frames;
+}
+
+// --------------------------------------------------------
+// Every captured scope as a complete ("X") event in Chrome's
+// trace event format (with its allocations as args), with each
+// thread named, and each frame as an instant ("i") event on
+// the first
+// --------------------------------------------------------
+bool CpuProfiler::WriteTrace(unsigned int frames, std::string path)
+{
+	std::vector<CpuProfileThread> captured;
+	long long start, end;
+	if (Capture(frames, captured, start, end) == 0)
+		return false;
+
+	// Like the assets, relative to the exe rather than the working directory
+	char exePath[MAX_PATH] = {};
+	GetModuleFileNameA(0, exePath, MAX_PATH);
+	std::string exeDirectory = exePath;
+	path = exeDirectory.substr(0, exeDirectory.find_last_of("\\/") + 1) + path;
+
+	std::ofstream trace(path);
+	if (!trace.is_open())
+		return false;
+
+	// Microseconds since the first frame
+	auto micros = [&](long long ticks) { return (ticks - start) * 1000000.0 / frequency; };
+
+	trace << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	unsigned long long kept = min(frameCount.load(std::memory_order_acquire), (unsigned long long)CPU_PROFILER_FRAMES + 1);
+	for (unsigned long long f = 0; f < kept; f++)
+	{
+		if (frameStarts[f] < start || frameStarts[f] >= end) continue;
+		trace << "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"ts\":" << micros(frameStarts[f]) << ",\"pid\":1,\"tid\":0},\n";
+	}
+	for (size_t t = 0; t < captured.size(); t++)
+	{
+		trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\"" << captured[t].Name << "\"}}";
+		for (const CpuProfileEvent& e : captured[t].Events)
+		{
+			trace << ",\n{\"name\":\"" << e.Name << "\",\"ph\":\"X\",\"ts\":" << micros(e.Start)
+				<< ",\"dur\":" << micros(e.End) - micros(e.Start) << ",\"pid\":1,\"tid\":" << t
+				<< ",\"args\":{\"allocations\":" << e.Allocations << ",\"allocatedBytes\":" << e.AllocatedBytes << "}}";
+		}
+		trace << (t + 1 < captured.size() ? ",\n" : "\n");
+	}
+	trace << "]}\n";
+
+	printf("Wrote CPU trace to %s\n", path.c_str());
+	return true;
+}
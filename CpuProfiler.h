@@ -0,0 +1,160 @@
+#pragma once
+
+#include "AllocationTracker.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Set to 0 (in the project, or before this is included) to compile every
+// PROFILE_SCOPE out entirely
+#ifndef CPU_PROFILER_ENABLED
+#define CPU_PROFILER_ENABLED 1
+#endif
+
+// How many scopes each thread keeps (the oldest are written over), how
+// many frames back the view can go, and how many threads can be profiled
+#define CPU_PROFILER_EVENTS_PER_THREAD	16384
+#define CPU_PROFILER_FRAMES				120
+#define CPU_PROFILER_MAX_THREADS		32
+
+// Written next to the exe when asked for, and opened with chrome://tracing
+// (or ui.perfetto.dev)
+#define CPU_PROFILER_TRACE_FILE			"CpuTrace.json"
+
+// One finished scope, in QueryPerformanceCounter ticks
+struct CpuProfileEvent
+{
+	const char* Name;	// Always a literal, so it's never copied
+	long long Start;
+	long long End;
+	unsigned int Depth;	// How many scopes it's inside of, on its thread
+	unsigned int Allocations;			// Made inside it (including any nested scopes')
+	unsigned long long AllocatedBytes;
+};
+
+// Everything a thread finished in the frames that were asked for
+struct CpuProfileThread
+{
+	std::string Name;
+	std::vector<CpuProfileEvent> Events;
+};
+
+// --------------------------------------------------------
+// Times named scopes on any thread, for the last few frames
+//  - Each thread has its own ring of events, which only it
+//    writes to, so recording is just a copy and a store
+//    (there's a lock only the first time a thread's seen)
+//  - Reading them back copies each ring, and skips whatever
+//    was written over while it did, so it never waits on
+//    (or holds up) the threads being profiled
+// --------------------------------------------------------
+class CpuProfiler
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static CpuProfiler& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new CpuProfiler();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	CpuProfiler(CpuProfiler const&) = delete;
+	void operator=(CpuProfiler const&) = delete;
+
+private:
+	static CpuProfiler* instance;
+	CpuProfiler();
+#pragma endregion
+
+public:
+	~CpuProfiler();
+
+	static long long Now();
+	double TicksToMs(long long ticks) { return ticks * 1000.0 / frequency; }
+
+	// Marks the start of a frame (on the main thread, once a frame)
+	void BeginFrame();
+
+	// Shown instead of "Thread N" for whichever thread calls it
+	void NameThread(const char* name);
+
+	// Nothing's recorded while it's paused, so what's there can be looked at
+	bool GetPaused() { return paused.load(); }
+	void SetPaused(bool paused) { this->paused = paused; }
+
+	// Scopes call these, from whatever thread they're on
+	unsigned int EnterScope();
+	void ExitScope(const char* name, long long start, unsigned int depth, const AllocationCounts& allocations);
+
+	// Every thread's scopes that overlap the last frameCount whole frames
+	// (or as many as there have been), when those started and ended, and
+	// how many there were
+	unsigned int Capture(unsigned int frameCount, std::vector<CpuProfileThread>& threads, long long& start, long long& end);
+
+	// The last frameCount frames, as a trace (relative to the exe)
+	bool WriteTrace(unsigned int frameCount = CPU_PROFILER_FRAMES, std::string path = CPU_PROFILER_TRACE_FILE);
+
+private:
+	struct ThreadBuffer
+	{
+		std::string Name;
+		std::atomic<unsigned long long> Written;	// Total ever, so the ring's position too
+		unsigned int Depth;
+		CpuProfileEvent Events[CPU_PROFILER_EVENTS_PER_THREAD];
+	};
+
+	long long frequency;
+	std::atomic<bool> paused;
+
+	std::mutex threadMutex;
+	ThreadBuffer* threads[CPU_PROFILER_MAX_THREADS];
+	std::atomic<unsigned int> threadCount;
+
+	// When each of the last frames started
+	long long frameStarts[CPU_PROFILER_FRAMES + 1];
+	std::atomic<unsigned long long> frameCount;
+
+	ThreadBuffer* GetThreadBuffer();
+};
+
+// --------------------------------------------------------
+// Times from here to the end of the scope
+// --------------------------------------------------------
+class CpuProfileScope
+{
+public:
+	CpuProfileScope(const char* name)
+		: name(name)
+	{
+		depth = CpuProfiler::GetInstance().EnterScope();
+		allocations = AllocationTracker::GetThreadCounts();
+		start = CpuProfiler::Now();
+	}
+	~CpuProfileScope()
+	{
+		CpuProfiler::GetInstance().ExitScope(name, start, depth, allocations);
+	}
+
+private:
+	const char* name;
+	long long start;
+	unsigned int depth;
+	AllocationCounts allocations;	// This thread's, when it started
+};
+
+#define CPU_PROFILER_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_INNER(a, b)
+
+#if CPU_PROFILER_ENABLED
+#define PROFILE_SCOPE(name) CpuProfileScope CPU_PROFILER_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
@@ -1,6 +1,7 @@
 #include "DXCore.h"
 #include "Input.h"
 #include "Extensions/imgui/imgui.h"
+#include "GpuMemory.h"
 
 #include <WindowsX.h>
 #include <sstream>
@@ -56,8 +57,34 @@ DXCore::DXCore(
 	this->fpsTimeElapsed = 0.0f;
 	this->currentTime = 0;
 	this->deltaTime = 0;
+	this->frameSeconds = 0;
+	this->fixedTimestep = 0;
+	this->fixedTotalTime = 0;
+	this->exitCode = 0;
 	this->startTime = 0;
 	this->totalTime = 0;
+	this->frameLatencyWaitableObject = 0;
+	this->maxFrameLatency = DXCORE_DEFAULT_FRAME_LATENCY;
+	this->swapChainFlags = 0;
+	this->vsyncMode = VSyncMode::Off;
+	this->tearingSupported = false;
+	this->borderlessFullscreen = false;
+	this->inSizeMove = false;
+	this->pendingWidth = windowWidth;
+	this->pendingHeight = windowHeight;
+	SetRectEmpty(&this->windowedRect);
+	this->frameRateCap = 0.0f;
+	this->nextFrameTime = 0;
+	this->appActive = true;
+	this->minimized = false;
+	this->occluded = false;
+	this->backgroundFrameRate = DXCORE_BACKGROUND_FRAME_RATE;
+	this->nextBackgroundDraw = 0;
+
+	// Falls back to a regular timer before Windows 10 (1803)
+	this->frameTimer = CreateWaitableTimerExW(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!this->frameTimer)
+		this->frameTimer = CreateWaitableTimerExW(0, 0, 0, TIMER_ALL_ACCESS);
 
 	// Query performance counter for accurate timing information
 	__int64 perfFreq;
@@ -70,6 +97,11 @@ DXCore::DXCore(
 // --------------------------------------------------------
 DXCore::~DXCore()
 {
+	if (frameLatencyWaitableObject)
+		CloseHandle(frameLatencyWaitableObject);
+	if (frameTimer)
+		CloseHandle(frameTimer);
+
 	// Note: Since we're using smart pointers (ComPtr),
 	// we don't need to explicitly clean up those DirectX objects
 	// - If we weren't using smart pointers, we'd need
@@ -172,6 +204,18 @@ HRESULT DXCore::InitDirectX()
 	deviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif
 
+	// Presenting without VSync can only tear (rather than wait
+	// for the compositor) if the swap chain's made allowing it
+	Microsoft::WRL::ComPtr<IDXGIFactory5> factory;
+	if (SUCCEEDED(CreateDXGIFactory1(__uuidof(IDXGIFactory5), (void**)factory.GetAddressOf())))
+	{
+		BOOL allowTearing = FALSE;
+		tearingSupported = SUCCEEDED(factory->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing))) && allowTearing;
+	}
+	swapChainFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	if (tearingSupported)
+		swapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
 	// Create a description of how our swap
 	// chain should work
 	DXGI_SWAP_CHAIN_DESC swapDesc = {};
@@ -183,8 +227,8 @@ HRESULT DXCore::InitDirectX()
 	swapDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	swapDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
 	swapDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-	swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	swapDesc.Flags = 0;
+	swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT | DXGI_USAGE_UNORDERED_ACCESS; // For the fused SSAO combine
+	swapDesc.Flags = swapChainFlags;
 	swapDesc.OutputWindow = hWnd;
 	swapDesc.SampleDesc.Count = 1;
 	swapDesc.SampleDesc.Quality = 0;
@@ -210,6 +254,20 @@ HRESULT DXCore::InitDirectX()
 		context.GetAddressOf());	// Pointer to our Device Context pointer
 	if (FAILED(hr)) return hr;
 
+	// Frames are paced by waiting on the swap chain (see Run())
+	Microsoft::WRL::ComPtr<IDXGISwapChain2> swapChain2;
+	if (SUCCEEDED(swapChain.As(&swapChain2)))
+	{
+		swapChain2->SetMaximumFrameLatency(maxFrameLatency);
+		frameLatencyWaitableObject = swapChain2->GetFrameLatencyWaitableObject();
+	}
+
+	// Alt+Enter is borderless fullscreen (see ProcessMessage()) rather
+	// than DXGI's exclusive fullscreen, which can't present with tearing
+	Microsoft::WRL::ComPtr<IDXGIFactory1> swapChainFactory;
+	if (SUCCEEDED(swapChain->GetParent(__uuidof(IDXGIFactory1), (void**)swapChainFactory.GetAddressOf())))
+		swapChainFactory->MakeWindowAssociation(hWnd, DXGI_MWA_NO_ALT_ENTER);
+
 	// The above function created the back buffer render target
 	// for us, but we need a reference to it
 	ID3D11Texture2D* backBufferTexture = 0;
@@ -236,24 +294,38 @@ HRESULT DXCore::InitDirectX()
 	depthStencilDesc.Height				= height;
 	depthStencilDesc.MipLevels			= 1;
 	depthStencilDesc.ArraySize			= 1;
-	depthStencilDesc.Format				= DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilDesc.Format				= DXGI_FORMAT_R24G8_TYPELESS; // Typeless so it can also be read as a texture
 	depthStencilDesc.Usage				= D3D11_USAGE_DEFAULT;
-	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL;
+	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	depthStencilDesc.CPUAccessFlags		= 0;
 	depthStencilDesc.MiscFlags			= 0;
 	depthStencilDesc.SampleDesc.Count	= 1;
 	depthStencilDesc.SampleDesc.Quality = 0;
 
-	// Create the depth buffer and its view, then 
+	// Create the depth buffer and its views, then 
 	// release our reference to the texture
+	//  - The shader resource view just sees the depth bits
+	D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc = {};
+	depthStencilViewDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC depthSRVDesc = {};
+	depthSRVDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	depthSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	depthSRVDesc.Texture2D.MipLevels = 1;
+
 	ID3D11Texture2D* depthBufferTexture = 0;
-	device->CreateTexture2D(&depthStencilDesc, 0, &depthBufferTexture);
+	GpuMemory::CreateTexture2D(device.Get(), &depthStencilDesc, 0, &depthBufferTexture, GpuMemoryCategory::RenderTargets, "Depth Buffer");
 	if (depthBufferTexture != 0)
 	{
 		device->CreateDepthStencilView(
 			depthBufferTexture, 
-			0, 
+			&depthStencilViewDesc, 
 			depthStencilView.GetAddressOf());
+		device->CreateShaderResourceView(
+			depthBufferTexture,
+			&depthSRVDesc,
+			depthStencilSRV.GetAddressOf());
 		depthBufferTexture->Release();
 	}
 
@@ -299,7 +371,7 @@ void DXCore::OnResize()
 		width,
 		height,
 		DXGI_FORMAT_R8G8B8A8_UNORM,
-		0);
+		swapChainFlags); // Has to match the swap chain's flags
 
 	// Recreate the render target view for the back buffer
 	// texture, then release our local texture reference
@@ -320,24 +392,38 @@ void DXCore::OnResize()
 	depthStencilDesc.Height				= height;
 	depthStencilDesc.MipLevels			= 1;
 	depthStencilDesc.ArraySize			= 1;
-	depthStencilDesc.Format				= DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilDesc.Format				= DXGI_FORMAT_R24G8_TYPELESS; // Typeless so it can also be read as a texture
 	depthStencilDesc.Usage				= D3D11_USAGE_DEFAULT;
-	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL;
+	depthStencilDesc.BindFlags			= D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	depthStencilDesc.CPUAccessFlags		= 0;
 	depthStencilDesc.MiscFlags			= 0;
 	depthStencilDesc.SampleDesc.Count	= 1;
 	depthStencilDesc.SampleDesc.Quality = 0;
 
-	// Create the depth buffer and its view, then 
+	// Create the depth buffer and its views, then 
 	// release our reference to the texture
+	//  - The shader resource view just sees the depth bits
+	D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc = {};
+	depthStencilViewDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC depthSRVDesc = {};
+	depthSRVDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	depthSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	depthSRVDesc.Texture2D.MipLevels = 1;
+
 	ID3D11Texture2D* depthBufferTexture = 0;
-	device->CreateTexture2D(&depthStencilDesc, 0, &depthBufferTexture);
+	GpuMemory::CreateTexture2D(device.Get(), &depthStencilDesc, 0, &depthBufferTexture, GpuMemoryCategory::RenderTargets, "Depth Buffer");
 	if (depthBufferTexture != 0)
 	{
 		device->CreateDepthStencilView(
 			depthBufferTexture, 
-			0, 
+			&depthStencilViewDesc, 
 			depthStencilView.ReleaseAndGetAddressOf()); // ReleaseAndGetAddressOf() cleans up the old object before giving us the pointer
+		device->CreateShaderResourceView(
+			depthBufferTexture,
+			&depthSRVDesc,
+			depthStencilSRV.ReleaseAndGetAddressOf());
 		depthBufferTexture->Release();
 	}
 
@@ -361,6 +447,20 @@ void DXCore::OnResize()
 }
 
 
+// --------------------------------------------------------
+// Changes how many frames can be queued, which takes effect
+// from the next wait on
+// --------------------------------------------------------
+void DXCore::SetMaxFrameLatency(unsigned int frames)
+{
+	maxFrameLatency = frames;
+
+	Microsoft::WRL::ComPtr<IDXGISwapChain2> swapChain2;
+	if (SUCCEEDED(swapChain.As(&swapChain2)))
+		swapChain2->SetMaximumFrameLatency(frames);
+}
+
+
 // --------------------------------------------------------
 // This is the main game loop, handling the following:
 //  - OS-level messages coming in from Windows itself
@@ -381,6 +481,7 @@ HRESULT DXCore::Run()
 
 	// Our overall game and message loop
 	MSG msg = {};
+	bool drewLastFrame = true;
 	while (msg.message != WM_QUIT)
 	{
 		// Determine if there is a message waiting
@@ -393,6 +494,14 @@ HRESULT DXCore::Run()
 		}
 		else
 		{
+			// Wait until the GPU's few enough frames behind
+			//  - Before anything else, so the frame's input is
+			//    read as late as possible
+			//  - Nothing signals it without a present, so there's
+			//    no waiting after a frame that wasn't drawn
+			if (frameLatencyWaitableObject && drewLastFrame)
+				WaitForSingleObjectEx(frameLatencyWaitableObject, 1000, true);
+
 			// Update timer and title bar (if necessary)
 			UpdateTimer();
 			if (titleBarStats)
@@ -401,12 +510,24 @@ HRESULT DXCore::Run()
 			// Update the input manager
 			Input::GetInstance().Update();
 
-			// The game loop
+			// The game loop, which is only drawn now and then (if at
+			// all) in the background
 			Update(deltaTime, totalTime);
-			Draw(deltaTime, totalTime);
+			drewLastFrame = ShouldDraw();
+			if (drewLastFrame)
+				Draw(deltaTime, totalTime);
+			else
+				DrawSkipped();
 
 			// Frame is over, notify the input manager
 			Input::GetInstance().EndOfFrame();
+
+			// Sleep off whatever's left of the frame, which in the
+			// background is at least until the next tick
+			float cap = frameRateCap;
+			if (backgroundFrameRate >= 0.0f && IsInBackground() && (cap <= 0.0f || cap > DXCORE_BACKGROUND_TICK_RATE))
+				cap = DXCORE_BACKGROUND_TICK_RATE;
+			WaitForFrameCap(cap);
 		}
 	}
 
@@ -416,12 +537,178 @@ HRESULT DXCore::Run()
 }
 
 
+// --------------------------------------------------------
+// With adaptive VSync, a frame that took longer than a
+// refresh is presented right away, so one slow frame
+// doesn't have to wait for the blank after next
+// --------------------------------------------------------
+void DXCore::GetPresentOptions(unsigned int& syncInterval, unsigned int& flags)
+{
+	bool sync = vsyncMode == VSyncMode::On ||
+		vsyncMode == VSyncMode::Adaptive && deltaTime <= GetRefreshSeconds() * 1.05f;
+
+	// Tearing's only allowed windowed (including borderless), where it's
+	// what lets variable refresh displays show frames as they're ready
+	BOOL exclusiveFullscreen = FALSE;
+	swapChain->GetFullscreenState(&exclusiveFullscreen, 0);
+
+	syncInterval = sync ? 1 : 0;
+	flags = !sync && tearingSupported && !exclusiveFullscreen ? DXGI_PRESENT_ALLOW_TEARING : 0;
+}
+
+float DXCore::GetRefreshRate()
+{
+	return 1.0f / GetRefreshSeconds();
+}
+
+// --------------------------------------------------------
+// Swaps the window between its regular style and a popup
+// covering the whole monitor it's on, which presents just
+// like a window (so it can still tear), unlike exclusive
+// fullscreen
+// --------------------------------------------------------
+void DXCore::SetBorderlessFullscreen(bool enabled)
+{
+	if (enabled == borderlessFullscreen)
+		return;
+	borderlessFullscreen = enabled;
+
+	if (enabled)
+	{
+		GetWindowRect(hWnd, &windowedRect);
+		MONITORINFO monitor = {};
+		monitor.cbSize = sizeof(monitor);
+		GetMonitorInfo(MonitorFromWindow(hWnd, MONITOR_DEFAULTTONEAREST), &monitor);
+		SetWindowLongPtr(hWnd, GWL_STYLE, WS_POPUP | WS_VISIBLE);
+		SetWindowPos(hWnd, HWND_TOP,
+			monitor.rcMonitor.left, monitor.rcMonitor.top,
+			monitor.rcMonitor.right - monitor.rcMonitor.left,
+			monitor.rcMonitor.bottom - monitor.rcMonitor.top,
+			SWP_FRAMECHANGED | SWP_NOOWNERZORDER);
+	}
+	else
+	{
+		SetWindowLongPtr(hWnd, GWL_STYLE, WS_OVERLAPPEDWINDOW | WS_VISIBLE);
+		SetWindowPos(hWnd, HWND_NOTOPMOST,
+			windowedRect.left, windowedRect.top,
+			windowedRect.right - windowedRect.left,
+			windowedRect.bottom - windowedRect.top,
+			SWP_FRAMECHANGED | SWP_NOOWNERZORDER);
+	}
+}
+
+// --------------------------------------------------------
+// How long a refresh is on the monitor the window's on
+// --------------------------------------------------------
+float DXCore::GetRefreshSeconds()
+{
+	MONITORINFOEXA monitor = {};
+	monitor.cbSize = sizeof(monitor);
+	DEVMODEA mode = {};
+	mode.dmSize = sizeof(mode);
+	if (!GetMonitorInfoA(MonitorFromWindow(hWnd, MONITOR_DEFAULTTONEAREST), &monitor) ||
+		!EnumDisplaySettingsA(monitor.szDevice, ENUM_CURRENT_SETTINGS, &mode) ||
+		mode.dmDisplayFrequency <= 1) // 0 and 1 mean the hardware's default
+		return 1.0f / 60.0f;
+
+	return 1.0f / mode.dmDisplayFrequency;
+}
+
+// --------------------------------------------------------
+// Holds the frame rate at the cap: sleeps on the waitable
+// timer until just before the next frame's due, then spins
+// for the last moment, with each frame due one period
+// after the last (unless it's already late)
+// --------------------------------------------------------
+void DXCore::WaitForFrameCap(float framesPerSecond)
+{
+	__int64 now;
+	QueryPerformanceCounter((LARGE_INTEGER*)&now);
+	if (framesPerSecond <= 0.0f)
+	{
+		nextFrameTime = now;
+		return;
+	}
+
+	__int64 period = (__int64)(1.0 / (framesPerSecond * perfCounterSeconds));
+	nextFrameTime += period;
+	if (nextFrameTime < now)
+	{
+		nextFrameTime = now;
+		return;
+	}
+
+	double sleepSeconds = (nextFrameTime - now) * perfCounterSeconds - DXCORE_FRAME_CAP_SPIN_SECONDS;
+	if (frameTimer && sleepSeconds > 0.0)
+	{
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -(LONGLONG)(sleepSeconds * 10000000.0); // Negative is relative, in 100ns units
+		if (SetWaitableTimerEx(frameTimer, &dueTime, 0, 0, 0, 0, 0))
+			WaitForSingleObject(frameTimer, INFINITE);
+	}
+
+	do
+	{
+		YieldProcessor();
+		QueryPerformanceCounter((LARGE_INTEGER*)&now);
+	} while (now < nextFrameTime);
+}
+
+// --------------------------------------------------------
+// Whether this frame's drawn: always in the foreground,
+// never while minimized, and otherwise at the background
+// rate - a covered window just tests (at least that often,
+// even with the rate at 0) until a present would show, so
+// it doesn't draw frames nobody can see
+// --------------------------------------------------------
+bool DXCore::ShouldDraw()
+{
+	if (backgroundFrameRate < 0.0f || !IsInBackground())
+		return true;
+	if (minimized)
+		return false;
+
+	__int64 now;
+	QueryPerformanceCounter((LARGE_INTEGER*)&now);
+	if (now < nextBackgroundDraw)
+		return false;
+
+	float rate = backgroundFrameRate > 0.0f ? backgroundFrameRate : DXCORE_BACKGROUND_FRAME_RATE;
+	nextBackgroundDraw = now + (__int64)(1.0 / (rate * perfCounterSeconds));
+	if (occluded)
+	{
+		occluded = swapChain->Present(0, DXGI_PRESENT_TEST) == DXGI_STATUS_OCCLUDED;
+		if (occluded)
+			return false;
+		if (appActive)
+			return true;
+	}
+	return backgroundFrameRate > 0.0f;
+}
+
+// --------------------------------------------------------
+// Resizes everything to the last size the window was given,
+// if DX is initialized and it's actually changed
+// --------------------------------------------------------
+void DXCore::ApplyPendingSize()
+{
+	if (pendingWidth == 0 || pendingHeight == 0 ||
+		pendingWidth == width && pendingHeight == height)
+		return;
+
+	width = pendingWidth;
+	height = pendingHeight;
+	if (device)
+		OnResize();
+}
+
 // --------------------------------------------------------
 // Sends an OS-level window close message to our process, which
 // will be handled by our message processing function
 // --------------------------------------------------------
-void DXCore::Quit()
+void DXCore::Quit(int exitCode)
 {
+	this->exitCode = exitCode;
 	PostMessage(this->hWnd, WM_CLOSE, NULL, NULL);
 }
 
@@ -440,11 +727,20 @@ void DXCore::UpdateTimer()
 	// Calculate delta time and clamp to zero
 	//  - Could go negative if CPU goes into power save mode 
 	//    or the process itself gets moved to another core
-	deltaTime = max((float)((currentTime - previousTime) * perfCounterSeconds), 0.0f);
+	frameSeconds = max((float)((currentTime - previousTime) * perfCounterSeconds), 0.0f);
+	deltaTime = frameSeconds;
 
 	// Calculate the total time from start to now
 	totalTime = (float)((currentTime - startTime) * perfCounterSeconds);
 
+	// Or pretend every frame took exactly as long
+	if (fixedTimestep > 0.0f)
+	{
+		deltaTime = fixedTimestep;
+		fixedTotalTime += fixedTimestep;
+		totalTime = (float)fixedTotalTime;
+	}
+
 	// Save current time for next frame
 	previousTime = currentTime;
 }
@@ -637,13 +933,22 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 	{
 	// This is the message that signifies the window closing
 	case WM_DESTROY:
-		PostQuitMessage(0); // Send a quit message to our own program
+		PostQuitMessage(exitCode); // Send a quit message to our own program
 		return 0;
 
 	// Prevent beeping when we "alt-enter" into fullscreen
 	case WM_MENUCHAR: 
 		return MAKELRESULT(0, MNC_CLOSE);
 
+	// Alt+Enter toggles borderless fullscreen
+	case WM_SYSKEYDOWN:
+		if (wParam == VK_RETURN && (lParam & (1 << 29)))
+		{
+			SetBorderlessFullscreen(!borderlessFullscreen);
+			return 0;
+		}
+		break;
+
 	// Prevent the overall window from becoming too small
 	case WM_GETMINMAXINFO:
 		((MINMAXINFO*)lParam)->ptMinTrackSize.x = 200;
@@ -655,18 +960,30 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		// Don't adjust anything when minimizing,
 		// since we end up with a width/height of zero
 		// and that doesn't play well with the GPU
-		if (wParam == SIZE_MINIMIZED)
+		//  - Nothing's drawn until it's restored (see ShouldDraw())
+		minimized = wParam == SIZE_MINIMIZED;
+		if (minimized)
 			return 0;
 		
 		// Save the new client area dimensions.
-		width = LOWORD(lParam);
-		height = HIWORD(lParam);
+		pendingWidth = LOWORD(lParam);
+		pendingHeight = HIWORD(lParam);
+
+		// While the window's being dragged, the swap chain just
+		// stretches the old buffers to fit, and everything's
+		// only reallocated once the drag's over
+		if (!inSizeMove)
+			ApplyPendingSize();
 
-		// If DX is initialized, resize 
-		// our required buffers
-		if (device) 
-			OnResize();
+		return 0;
 
+	// The user's started or stopped dragging the window's edges (or moving it)
+	case WM_ENTERSIZEMOVE:
+		inSizeMove = true;
+		return 0;
+	case WM_EXITSIZEMOVE:
+		inSizeMove = false;
+		ApplyPendingSize();
 		return 0;
 
 	// Has the mouse wheel been scrolled?
@@ -674,10 +991,31 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		Input::GetInstance().SetWheelDelta(GET_WHEEL_DELTA_WPARAM(wParam) / (float)WHEEL_DELTA);
 		return 0;
 	
+	// Raw mouse motion since the last message, which Input adds up
+	// until the next frame (only absolute devices, like tablets and
+	// remote desktop, don't send relative motion, so they're skipped)
+	case WM_INPUT:
+	{
+		RAWINPUT raw = {};
+		UINT size = sizeof(RAWINPUT);
+		if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, &raw, &size, sizeof(RAWINPUTHEADER)) != (UINT)-1 &&
+			raw.header.dwType == RIM_TYPEMOUSE &&
+			(raw.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE) == 0)
+		{
+			Input::GetInstance().AddRawMouseDelta(raw.data.mouse.lLastX, raw.data.mouse.lLastY);
+		}
+		break; // DefWindowProc still has to clean up after it
+	}
+
 	// Is our focus state changing?
 	case WM_SETFOCUS:	hasFocus = true;	return 0;
 	case WM_KILLFOCUS:	hasFocus = false;	return 0;
 	case WM_ACTIVATE:	hasFocus = (LOWORD(wParam) != WA_INACTIVE); return 0;
+
+	// Another app (not just another of our windows) is active, or we are again
+	case WM_ACTIVATEAPP:
+		appActive = wParam != FALSE;
+		return 0;
 	case WM_CHAR:
 		ImGui::GetIO().AddInputCharacter((char)wParam);
 		return 0;
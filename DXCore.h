@@ -2,12 +2,38 @@
 
 #include <Windows.h>
 #include <d3d11.h>
+#include <dxgi1_5.h>
 #include <string>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 
 // We can include the correct library files here
 // instead of in Visual Studio settings if we want
 #pragma comment(lib, "d3d11.lib")
+#pragma comment(lib, "dxgi.lib")
+
+// How many frames the CPU can queue up ahead of the GPU before it
+// waits at the start of the next one (see SetMaxFrameLatency())
+#define DXCORE_DEFAULT_FRAME_LATENCY	1
+
+// The frame rate cap sleeps until this long before the frame's due,
+// then spins the rest of the way, since even the high resolution
+// timer can wake up a little late
+#define DXCORE_FRAME_CAP_SPIN_SECONDS	0.001
+
+// While another app's active, frames are only drawn this often (see
+// SetBackgroundFrameRate()), and updates are capped at the tick rate
+// whenever it's in the background, so they don't spin without a present
+#define DXCORE_BACKGROUND_FRAME_RATE	10.0f
+#define DXCORE_BACKGROUND_TICK_RATE		60.0f
+
+// When frames are presented
+enum class VSyncMode
+{
+	Off,		// Right away, tearing if the display allows
+	On,			// On the next vertical blank
+	Adaptive	// On the next vertical blank, unless the last frame missed
+				// one, in which case right away (instead of halving the rate)
+};
 
 class DXCore
 {
@@ -36,14 +62,55 @@ public:
 	HRESULT InitWindow();
 	HRESULT InitDirectX();
 	HRESULT Run();
-	void Quit();
+	void Quit(int exitCode = 0);	// What Run() returns
 	virtual void OnResize();
 
+	// The swap chain is waitable, so each frame starts by waiting until
+	// there are fewer than this many frames queued, which keeps input
+	// latency down (at the cost of the CPU and GPU overlapping less)
+	void SetMaxFrameLatency(unsigned int frames);
+	unsigned int GetMaxFrameLatency() { return maxFrameLatency; }
+
+	// How frames are presented, and a cap on the frame rate (0 for none)
+	// that sleeps, rather than spins, until the next frame's due
+	void SetVSyncMode(VSyncMode mode) { vsyncMode = mode; }
+	VSyncMode GetVSyncMode() { return vsyncMode; }
+	void SetFrameRateCap(float framesPerSecond) { frameRateCap = framesPerSecond; }
+	float GetFrameRateCap() { return frameRateCap; }
+	bool IsTearingSupported() { return tearingSupported; }
+	float GetRefreshRate();
+
+	// A popup window covering the monitor, which (unlike exclusive
+	// fullscreen) can still present with tearing, toggled by Alt+Enter
+	void SetBorderlessFullscreen(bool enabled);
+	bool IsBorderlessFullscreen() { return borderlessFullscreen; }
+
+	// What this frame should be presented with, for the VSync mode
+	void GetPresentOptions(unsigned int& syncInterval, unsigned int& flags);
+
+	// While another app's active the window's only drawn this many times
+	// a second (0 for not at all, negative to not throttle), and while
+	// it's minimized or covered it isn't drawn at all
+	//  - Update keeps running either way, so the simulation and the
+	//    network carry on
+	void SetBackgroundFrameRate(float framesPerSecond) { backgroundFrameRate = framesPerSecond; }
+	float GetBackgroundFrameRate() { return backgroundFrameRate; }
+	bool IsInBackground() { return !appActive || minimized || occluded; }
+
+	// Every frame's deltaTime is this many seconds (0 for the real time),
+	// so runs simulate the same no matter how fast they draw
+	//  - How long frames really take is still there either way
+	void SetFixedTimestep(float seconds) { fixedTimestep = seconds; }
+	float GetFrameSeconds() { return frameSeconds; }
+
 	// Pure virtual methods for setup and game functionality
 	virtual void Init() = 0;
 	virtual void Update(float deltaTime, float totalTime) = 0;
 	virtual void Draw(float deltaTime, float totalTime) = 0;
 
+	// Called instead of Draw() on a frame that's throttled away
+	virtual void DrawSkipped() {}
+
 protected:
 	HINSTANCE	hInstance;		// The handle to the application
 	HWND		hWnd;			// The handle to the window itself
@@ -64,8 +131,15 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D11Device>		device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext>	context;
 
+	// Null without IDXGISwapChain2 (before Windows 8.1), which
+	// leaves the frame latency up to the driver
+	HANDLE			frameLatencyWaitableObject;
+	unsigned int	maxFrameLatency;
+	unsigned int	swapChainFlags;	// Needed again whenever it's resized
+
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV;
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthStencilView;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthStencilSRV;
 
 	// Helper function for allocating a console window
 	void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
@@ -77,12 +151,20 @@ protected:
 	std::string GetFullPathTo(std::string relativeFilePath);
 	std::wstring GetFullPathTo_Wide(std::wstring relativeFilePath);
 
+	// Given whatever Present() last returned, so a covered window stops
+	// drawing until a test present says it would show again
+	void SetPresentOccluded(bool isOccluded) { occluded = isOccluded; }
+
 
 private:
 	// Timing related data
 	double perfCounterSeconds;
 	float totalTime;
 	float deltaTime;
+	float frameSeconds;
+	float fixedTimestep;
+	double fixedTotalTime;
+	int exitCode;
 	__int64 startTime;
 	__int64 currentTime;
 	__int64 previousTime;
@@ -93,5 +175,32 @@ private:
 
 	void UpdateTimer();			// Updates the timer for this frame
 	void UpdateTitleBarStats();	// Puts debug info in the title bar
+
+	// VSync and the frame rate cap
+	//  - The timer's high resolution when the OS has them
+	VSyncMode vsyncMode;
+	bool tearingSupported;
+	bool borderlessFullscreen;
+	RECT windowedRect;	// Where the window goes back to
+
+	// The size WM_SIZE last gave, held until any drag is done
+	bool inSizeMove;
+	unsigned int pendingWidth;
+	unsigned int pendingHeight;
+	void ApplyPendingSize();
+	float frameRateCap;
+	HANDLE frameTimer;
+	__int64 nextFrameTime;
+	float GetRefreshSeconds();
+	void WaitForFrameCap(float framesPerSecond);
+
+	// Background throttling, from WM_ACTIVATEAPP, WM_SIZE and
+	// DXGI_STATUS_OCCLUDED
+	bool appActive;
+	bool minimized;
+	bool occluded;
+	float backgroundFrameRate;
+	__int64 nextBackgroundDraw;
+	bool ShouldDraw();
 };
 
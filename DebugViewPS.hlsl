@@ -0,0 +1,79 @@
+#include "GBuffer.hlsli"
+
+// How the source is read - these should
+// match the definitions in DebugViews.h
+#define MODE_COLOR		0
+#define MODE_DEPTH		1
+#define MODE_NORMALS	2
+#define MODE_SHADOW		3
+#define MODE_ATLAS		4
+
+// Near clip over far clip of the shadow atlas tiles (see ShadowAtlas.h),
+// which is close enough for the smallest lights too
+#define ATLAS_NEAR_RATIO	0.01f
+
+// And which channel is shown (0 is all three)
+#define CHANNEL_RGB		0
+
+cbuffer externalData : register(b0)
+{
+	float2 uvScale;		// The part of the source in use
+	float2 footprint;	// One thumbnail pixel, in the source's uvs
+
+	float2 depthParams;	// Projection values for turning hardware depth into view depth
+	float2 depthRange;	// View depths shown as black and white
+
+	int mode;
+	int channel;
+	int slice;			// Of the shadow cascades
+};
+
+struct VertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+
+Texture2D Source : register(t0);
+Texture2DArray SourceArray : register(t1);
+SamplerState ClampSampler : register(s0);
+
+
+// Something a person can read, from whatever the source holds
+float4 Read(float2 uv)
+{
+	if (mode == MODE_SHADOW)
+		return SourceArray.SampleLevel(ClampSampler, float3(uv, slice), 0).rrrr;
+
+	float4 value = Source.SampleLevel(ClampSampler, uv, 0);
+	if (mode == MODE_DEPTH)
+	{
+		float depth = depthParams.y / (value.r - depthParams.x);
+		return saturate((depth - depthRange.x) / (depthRange.y - depthRange.x)).xxxx;
+	}
+	if (mode == MODE_ATLAS)
+		return (ATLAS_NEAR_RATIO / (1.0f - value.r * (1.0f - ATLAS_NEAR_RATIO))).xxxx;
+	if (mode == MODE_NORMALS)
+		return float4(DecodeNormal(value.rg) * 0.5f + 0.5f, 1);
+	return value;
+}
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	// Four taps spread across the pixel, so thin details
+	// don't just come and go as the thumbnail's redrawn
+	float2 uv = input.uv * uvScale;
+	float2 offset = footprint * 0.25f;
+	float4 value = 0.25f * (
+		Read(uv + float2(-offset.x, -offset.y)) +
+		Read(uv + float2(offset.x, -offset.y)) +
+		Read(uv + float2(-offset.x, offset.y)) +
+		Read(uv + float2(offset.x, offset.y)));
+
+	if (channel == CHANNEL_RGB)
+		return float4(value.rgb, 1);
+
+	float4 mask = float4(channel == 1, channel == 2, channel == 3, channel == 4);
+	return float4(dot(value, mask).xxx, 1);
+}
@@ -0,0 +1,209 @@
+#include "DebugViews.h"
+#include "AssetLoader.h"
+#include "DrawStats.h"
+#include "GpuMemory.h"
+#include "StateCache.h"
+
+using namespace DirectX;
+
+DebugViews::DebugViews(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+	for (View& view : views)
+	{
+		view.Enabled = false;
+		view.Valid = false;
+		view.Channel = DebugViewChannel::RGB;
+		view.Width = 0;
+		view.Height = 0;
+	}
+
+	// What's useful in each by default
+	views[(int)DebugViewSource::SSAO].Channel = DebugViewChannel::Red;
+	views[(int)DebugViewSource::SceneAmbient].Channel = DebugViewChannel::Alpha;
+
+	frame = 0;
+	updateInterval = DEBUG_VIEW_UPDATE_INTERVAL;
+	depthNear = 0.1f;
+	depthFar = 100.0f;
+
+	D3D11_SAMPLER_DESC sampDesc = {};
+	sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	sampler = StateCache::GetInstance().GetSamplerState(sampDesc);
+}
+
+void DebugViews::SetEnabled(DebugViewSource source, bool enabled)
+{
+	View& view = views[(int)source];
+	view.Enabled = enabled;
+
+	// Nothing's kept around for a view that's off
+	if (!enabled)
+	{
+		view.Valid = false;
+		view.SRV.Reset();
+		view.RTV.Reset();
+		view.Texture.Reset();
+		view.Width = 0;
+		view.Height = 0;
+	}
+}
+
+void DebugViews::SetChannel(DebugViewSource source, DebugViewChannel channel)
+{
+	views[(int)source].Channel = channel;
+	views[(int)source].Valid = false;
+}
+
+void DebugViews::SetDepthRange(float nearDepth, float farDepth)
+{
+	depthNear = max(nearDepth, 0.0f);
+	depthFar = max(farDepth, depthNear + 0.01f);
+	views[(int)DebugViewSource::SceneDepth].Valid = false;
+}
+
+void DebugViews::Invalidate()
+{
+	for (View& view : views)
+		view.Valid = false;
+}
+
+// --------------------------------------------------------
+// Each due view is a fullscreen triangle into its own
+// thumbnail, and the caller restores its targets after
+// --------------------------------------------------------
+bool DebugViews::Update(const DebugViewInputs& inputs)
+{
+	frame++;
+
+	Assets& assets = Assets::GetInstance();
+	SimplePixelShader* ps = 0;
+	for (int i = 0; i < (int)DebugViewSource::Count; i++)
+	{
+		View& view = views[i];
+		if (!view.Enabled || !inputs.Sources[i])
+			continue;
+
+		// Staggered, so they don't all land on the same frame
+		if (view.Valid && (frame + i) % updateInterval != 0)
+			continue;
+
+		ResizeThumbnail(view, inputs.SourceAspects[i]);
+
+		if (!ps)
+		{
+			ps = assets.GetPixelShader("DebugViewPS.cso"_asset);
+			assets.GetVertexShader("FullscreenVS.cso"_asset)->SetShader();
+			ps->SetShader();
+			ps->SetSamplerState("ClampSampler", sampler);
+			context->OMSetBlendState(0, 0, 0xFFFFFFFF);
+			context->OMSetDepthStencilState(0, 0);
+		}
+
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = (float)view.Width;
+		viewport.Height = (float)view.Height;
+		viewport.MaxDepth = 1.0f;
+		context->RSSetViewports(1, &viewport);
+		context->OMSetRenderTargets(1, view.RTV.GetAddressOf(), 0);
+
+		XMFLOAT2 uvScale = inputs.SourceUVScales[i];
+		bool shadow = i == (int)DebugViewSource::ShadowMap;
+		ps->SetInt("mode", GetMode((DebugViewSource)i));
+		ps->SetInt("channel", (int)view.Channel);
+		ps->SetInt("slice", inputs.ShadowCascade);
+		ps->SetFloat2("uvScale", uvScale);
+		ps->SetFloat2("footprint", XMFLOAT2(uvScale.x / view.Width, uvScale.y / view.Height));
+		ps->SetFloat2("depthParams", inputs.DepthParams);
+		ps->SetFloat2("depthRange", XMFLOAT2(depthNear, depthFar));
+		ps->CopyAllBufferData();
+		ps->SetShaderResourceView("Source", shadow ? 0 : inputs.Sources[i]);
+		ps->SetShaderResourceView("SourceArray", shadow ? inputs.Sources[i] : 0);
+		context->Draw(3, 0);
+		DrawStats::Count(DrawCounter::Draws);
+
+		view.Valid = true;
+	}
+
+	if (!ps)
+		return false;
+
+	// Nothing's left reading the targets
+	ID3D11ShaderResourceView* nullSRVs[2] = {};
+	context->PSSetShaderResources(0, 2, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+	return true;
+}
+
+void DebugViews::ResizeThumbnail(View& view, float aspect)
+{
+	unsigned int width = DEBUG_VIEW_THUMBNAIL_WIDTH;
+	unsigned int height = max(1u, (unsigned int)(width / max(aspect, 0.01f)));
+	if (view.Texture && view.Width == width && view.Height == height)
+		return;
+
+	view.Width = width;
+	view.Height = height;
+	view.Valid = false;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.ArraySize = 1;
+	desc.MipLevels = 1;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	view.Texture.Reset();
+	GpuMemory::CreateTexture2D(device.Get(), &desc, 0, view.Texture.GetAddressOf(), GpuMemoryCategory::RenderTargets, "Debug View");
+
+	device->CreateRenderTargetView(view.Texture.Get(), 0, view.RTV.ReleaseAndGetAddressOf());
+	device->CreateShaderResourceView(view.Texture.Get(), 0, view.SRV.ReleaseAndGetAddressOf());
+}
+
+int DebugViews::GetMode(DebugViewSource source)
+{
+	switch (source)
+	{
+	case DebugViewSource::ShadowMap: return DEBUG_VIEW_MODE_SHADOW;
+	case DebugViewSource::SceneNormals: return DEBUG_VIEW_MODE_NORMALS;
+	case DebugViewSource::SceneDepth: return DEBUG_VIEW_MODE_DEPTH;
+	case DebugViewSource::ShadowAtlas: return DEBUG_VIEW_MODE_ATLAS;
+	default: return DEBUG_VIEW_MODE_COLOR;
+	}
+}
+
+const char* DebugViews::GetName(DebugViewSource source)
+{
+	switch (source)
+	{
+	case DebugViewSource::ShadowMap: return "Shadow Map";
+	case DebugViewSource::SSAO: return "SSAO";
+	case DebugViewSource::SceneColors: return "Scene Color";
+	case DebugViewSource::SceneAmbient: return "Scene Ambient";
+	case DebugViewSource::SceneNormals: return "Scene Normals";
+	case DebugViewSource::SceneDepth: return "Scene Depth";
+	case DebugViewSource::ShadowAtlas: return "Shadow Atlas";
+	case DebugViewSource::SceneAlbedo: return "Scene Albedo";
+	case DebugViewSource::SceneSurface: return "Scene Surface";
+	default: return "Unknown";
+	}
+}
+
+const char* DebugViews::GetChannelName(DebugViewChannel channel)
+{
+	switch (channel)
+	{
+	case DebugViewChannel::RGB: return "RGB";
+	case DebugViewChannel::Red: return "Red";
+	case DebugViewChannel::Green: return "Green";
+	case DebugViewChannel::Blue: return "Blue";
+	case DebugViewChannel::Alpha: return "Alpha";
+	default: return "Unknown";
+	}
+}
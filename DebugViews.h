@@ -0,0 +1,125 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+
+// How wide each thumbnail is (its height follows its source's shape)
+#define DEBUG_VIEW_THUMBNAIL_WIDTH		320
+
+// How many frames apart each thumbnail is redrawn, by default
+#define DEBUG_VIEW_UPDATE_INTERVAL		8
+
+// How each source is read - these should match
+// the definitions in DebugViewPS.hlsl
+#define DEBUG_VIEW_MODE_COLOR			0
+#define DEBUG_VIEW_MODE_DEPTH			1	// Hardware depth, linearized
+#define DEBUG_VIEW_MODE_NORMALS			2	// Octahedral, decoded
+#define DEBUG_VIEW_MODE_SHADOW			3	// One slice of the cascades
+#define DEBUG_VIEW_MODE_ATLAS			4	// Each tile's depth, roughly linearized
+
+// Everything the renderer can show from its own targets
+enum class DebugViewSource
+{
+	ShadowMap,
+	SSAO,
+	SceneColors,
+	SceneAmbient,	// The ambient fraction in the scene colors' alpha
+	SceneNormals,
+	SceneDepth,
+	ShadowAtlas,	// Point and spot light shadows
+	SceneAlbedo,	// Deferred shading only, with roughness in alpha
+	SceneSurface,	// Deferred shading only - metalness and spec power
+
+	Count
+};
+
+// Which of the result's channels is shown (as gray, when it's one)
+enum class DebugViewChannel
+{
+	RGB,
+	Red,
+	Green,
+	Blue,
+	Alpha
+};
+
+// This frame's targets and what's needed to read them
+struct DebugViewInputs
+{
+	ID3D11ShaderResourceView* Sources[(int)DebugViewSource::Count];
+	DirectX::XMFLOAT2 SourceUVScales[(int)DebugViewSource::Count];	// The part of each in use
+	float SourceAspects[(int)DebugViewSource::Count];				// Width over height
+	DirectX::XMFLOAT2 DepthParams;	// Projection values for turning hardware depth into view depth
+	int ShadowCascade;
+};
+
+// --------------------------------------------------------
+// Small copies of the renderer's targets for the UI, so
+// it never shows (or keeps bound) the full size ones
+//  - Each view is off until it's asked for, and enabled
+//    views are redrawn a few frames apart, staggered so
+//    it's rarely more than one a frame
+//  - Depth is linearized (and stretched over a range of
+//    view depths), and normals decoded, so what's shown
+//    is something a person can read
+// --------------------------------------------------------
+class DebugViews
+{
+public:
+	DebugViews(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Redraws the enabled views that are due, returning
+	// whether it drew anything (so it's only a pass when it does)
+	bool Update(const DebugViewInputs& inputs);
+
+	// Redraws every enabled view next Update(), like after a resize
+	void Invalidate();
+
+	bool GetEnabled(DebugViewSource source) { return views[(int)source].Enabled; }
+	void SetEnabled(DebugViewSource source, bool enabled);
+	DebugViewChannel GetChannel(DebugViewSource source) { return views[(int)source].Channel; }
+	void SetChannel(DebugViewSource source, DebugViewChannel channel);
+
+	// View depths shown as black and white, for depth
+	float GetDepthNear() { return depthNear; }
+	float GetDepthFar() { return depthFar; }
+	void SetDepthRange(float nearDepth, float farDepth);
+
+	unsigned int GetUpdateInterval() { return updateInterval; }
+	void SetUpdateInterval(unsigned int frames) { updateInterval = frames > 0 ? frames : 1; }
+
+	// Null until the view's been drawn at least once
+	ID3D11ShaderResourceView* GetThumbnail(DebugViewSource source) { return views[(int)source].Valid ? views[(int)source].SRV.Get() : 0; }
+	unsigned int GetThumbnailWidth(DebugViewSource source) { return views[(int)source].Width; }
+	unsigned int GetThumbnailHeight(DebugViewSource source) { return views[(int)source].Height; }
+
+	static const char* GetName(DebugViewSource source);
+	static const char* GetChannelName(DebugViewChannel channel);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler;
+
+	struct View
+	{
+		bool Enabled;
+		bool Valid;
+		DebugViewChannel Channel;
+		unsigned int Width;
+		unsigned int Height;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> Texture;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> RTV;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+	};
+	View views[(int)DebugViewSource::Count];
+
+	unsigned int frame;
+	unsigned int updateInterval;
+	float depthNear;
+	float depthFar;
+
+	void ResizeThumbnail(View& view, float aspect);
+	static int GetMode(DebugViewSource source);
+};
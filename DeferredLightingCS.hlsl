@@ -0,0 +1,85 @@
+#include "SceneLighting.hlsli"
+
+// Lights the deferred G-buffer (see GBuffer.hlsli) into the scene
+// colors, with the same lighting as the forward pixel shaders
+//  - One thread per pixel, in 8x8 tiles, so each group mostly
+//    walks the same few light clusters
+//  - Pixels where the depth is 1 are left for the sky
+
+#define TILE_SIZE 8
+
+cbuffer externalData : register(b1)
+{
+	matrix invViewProjection;
+	matrix view;
+	float2 renderSize;		// Pixels actually in use, with dynamic resolution
+};
+
+
+Texture2D Albedo : register(t0);	// Linear color (sRGB target), roughness in alpha
+Texture2D Normals : register(t1);	// Octahedral encoded
+Texture2D Surface : register(t2);
+Texture2D Depths : register(t3);
+RWTexture2D<unorm float4> SceneColors : register(u0);
+
+SamplerState BasicSampler : register(s0);
+SamplerState ClampSampler : register(s1);
+
+
+// Rebuilds a pixel's world position from the depth buffer
+float3 WorldFromDepth(int2 pixel, float depth)
+{
+	float2 uv = (pixel + 0.5f) / renderSize;
+	uv.y = 1.0f - uv.y; // Invert Y due to UV <--> NDC diff
+	float4 worldPos = mul(invViewProjection, float4(uv * 2.0f - 1.0f, depth, 1.0f));
+	return worldPos.xyz / worldPos.w;
+}
+
+// How far the world position moves to the next pixel along one axis,
+// from whichever neighbor is closer in depth, so silhouettes don't
+// pick up the distance to whatever's behind them
+float3 WorldPosGradient(int2 pixel, int2 axis, float3 worldPos)
+{
+	int2 next = min(pixel + axis, (int2)renderSize - 1);
+	int2 previous = max(pixel - axis, 0);
+	float3 toNext = WorldFromDepth(next, Depths[next].r) - worldPos;
+	float3 fromPrevious = worldPos - WorldFromDepth(previous, Depths[previous].r);
+	return dot(toNext, toNext) < dot(fromPrevious, fromPrevious) ? toNext : fromPrevious;
+}
+
+[numthreads(TILE_SIZE, TILE_SIZE, 1)]
+void main(uint3 threadID : SV_DispatchThreadID)
+{
+	int2 pixel = threadID.xy;
+	if (any(pixel >= (int2)renderSize))
+		return;
+
+	float depth = Depths[pixel].r;
+	if (depth >= 1.0f)
+		return;
+
+	// Everything the forward shaders had from their inputs
+	float3 worldPos = WorldFromDepth(pixel, depth);
+	float viewDepth = mul(view, float4(worldPos, 1.0f)).z;
+	float4 screenPosition = float4(pixel + 0.5f, depth, viewDepth);
+
+	float4 albedo = Albedo[pixel];
+	float3 normal = DecodeNormal(Normals[pixel].rg);
+	float metal, specPower;
+	DecodeSurface(Surface[pixel].rg, metal, specPower);
+
+	// Only the directional light's cascades need the gradients
+#if FEATURE_SHADOWS
+	float shadowAmount = ShadowAmountGrad(worldPos, viewDepth,
+		WorldPosGradient(pixel, int2(1, 0), worldPos),
+		WorldPosGradient(pixel, int2(0, 1), worldPos));
+#else
+	float shadowAmount = 1.0f;
+#endif
+
+	// Not a ?: since that would shade both ways
+	if (specPower > 0.0f)
+		SceneColors[pixel] = ShadeBasic(screenPosition, ENTITY_LIGHT_LIST_NONE, normal, worldPos, specPower, albedo.rgb, shadowAmount);
+	else
+		SceneColors[pixel] = ShadePBR(screenPosition, ENTITY_LIGHT_LIST_NONE, normal, worldPos, albedo.a, metal, albedo.rgb, shadowAmount, BasicSampler, ClampSampler);
+}
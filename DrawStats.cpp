@@ -0,0 +1,128 @@
+#include "DrawStats.h"
+
+#include <cstring>
+
+// Singleton requirement
+DrawStats* DrawStats::instance;
+
+thread_local DrawStats::PassSlot* DrawStats::currentPass = 0;
+
+DrawStats::DrawStats()
+{
+	for (PassSlot& slot : slots)
+	{
+		slot.Name = 0;
+		for (auto& c : slot.Counts)
+			c = 0;
+	}
+	pending.Name = 0;
+	for (auto& c : pending.Counts)
+		c = 0;
+
+	// Anything that never ends up in a pass
+	slotCount = 1;
+	slots[0].Name = "Other";
+	totals = {};
+	totals.Name = "Total";
+}
+
+// The same name is always the same slot, and once they run out
+// everything else shares the first
+DrawStats::PassSlot* DrawStats::FindSlot(const char* name)
+{
+	std::lock_guard<std::mutex> lock(slotMutex);
+	for (unsigned int i = 0; i < slotCount; i++)
+	{
+		if (slots[i].Name == name || strcmp(slots[i].Name, name) == 0)
+			return &slots[i];
+	}
+
+	if (slotCount == DRAW_STATS_MAX_PASSES)
+		return &slots[0];
+	slots[slotCount].Name = name;
+	return &slots[slotCount++];
+}
+
+void DrawStats::MoveCounts(PassSlot& from, PassSlot& to)
+{
+	for (int i = 0; i < (int)DrawCounter::Count; i++)
+	{
+		unsigned long long count = from.Counts[i].exchange(0, std::memory_order_relaxed);
+		if (count)
+			to.Counts[i].fetch_add(count, std::memory_order_relaxed);
+	}
+}
+
+void DrawStats::EndPass(const char* name)
+{
+	MoveCounts(pending, *FindSlot(name));
+}
+
+// --------------------------------------------------------
+// Passes are kept in the order they were first seen, which
+// is the order they're drawn in, and only if they counted
+// anything this frame
+// --------------------------------------------------------
+void DrawStats::EndFrame()
+{
+	EndPass("Other");
+
+	passes.clear();
+	totals = {};
+	totals.Name = "Total";
+
+	unsigned int count;
+	{
+		std::lock_guard<std::mutex> lock(slotMutex);
+		count = slotCount;
+	}
+
+	// "Other" goes last
+	for (unsigned int s = 1; s <= count; s++)
+	{
+		PassSlot& slot = slots[s % count];
+		DrawPassCounters pass = {};
+		pass.Name = slot.Name;
+		bool any = false;
+		for (int i = 0; i < (int)DrawCounter::Count; i++)
+		{
+			pass.Counts[i] = slot.Counts[i].exchange(0, std::memory_order_relaxed);
+			totals.Counts[i] += pass.Counts[i];
+			any = any || pass.Counts[i] != 0;
+		}
+		if (any)
+			passes.push_back(pass);
+	}
+}
+
+const char* DrawStats::GetCounterName(DrawCounter counter)
+{
+	switch (counter)
+	{
+	case DrawCounter::Draws: return "Draws";
+	case DrawCounter::InstancedDraws: return "Instanced";
+	case DrawCounter::SetShaders: return "Shaders";
+	case DrawCounter::ConstantBufferUploads: return "CB Uploads";
+	case DrawCounter::ConstantBufferBytes: return "CB Bytes";
+	case DrawCounter::ShaderResourceBinds: return "SRV Binds";
+	case DrawCounter::SamplerBinds: return "Sampler Binds";
+	case DrawCounter::Maps: return "Maps";
+	default: return "Unknown";
+	}
+}
+
+const char* DrawStats::GetCounterKey(DrawCounter counter)
+{
+	switch (counter)
+	{
+	case DrawCounter::Draws: return "draws";
+	case DrawCounter::InstancedDraws: return "instancedDraws";
+	case DrawCounter::SetShaders: return "setShaders";
+	case DrawCounter::ConstantBufferUploads: return "cbUploads";
+	case DrawCounter::ConstantBufferBytes: return "cbBytes";
+	case DrawCounter::ShaderResourceBinds: return "srvBinds";
+	case DrawCounter::SamplerBinds: return "samplerBinds";
+	case DrawCounter::Maps: return "maps";
+	default: return "unknown";
+	}
+}
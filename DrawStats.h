@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Set to 0 (in the project, or before this is included) to compile every
+// counter out entirely
+#ifndef DRAW_STATS_ENABLED
+#define DRAW_STATS_ENABLED 1
+#endif
+
+// How many differently named passes are counted separately (any more
+// are counted as "Other")
+#define DRAW_STATS_MAX_PASSES	32
+
+// What's counted, each per pass
+enum class DrawCounter
+{
+	Draws,
+	InstancedDraws,			// Also counted in Draws
+	SetShaders,
+	ConstantBufferUploads,
+	ConstantBufferBytes,
+	ShaderResourceBinds,	// Calls, not views (a range is one)
+	SamplerBinds,
+	Maps,
+
+	Count
+};
+
+// One pass's counts for a whole frame
+struct DrawPassCounters
+{
+	std::string Name;
+	unsigned long long Counts[(int)DrawCounter::Count];
+
+	unsigned long long operator[](DrawCounter counter) const { return Counts[(int)counter]; }
+};
+
+// --------------------------------------------------------
+// Counts draws and the state changes around them, per pass
+//  - A pass is either a scope (DRAW_STATS_PASS), which is
+//    how the ones recorded on other threads are counted,
+//    or everything this thread did since the last EndPass()
+//  - Counting is a relaxed atomic add, so the counts cost
+//    about the same on any thread
+//  - After EndFrame() the counts are for the frame that
+//    just finished, so the UI always shows a whole frame
+// --------------------------------------------------------
+class DrawStats
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static DrawStats& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new DrawStats();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	DrawStats(DrawStats const&) = delete;
+	void operator=(DrawStats const&) = delete;
+
+private:
+	static DrawStats* instance;
+	DrawStats();
+#pragma endregion
+
+	struct PassSlot
+	{
+		const char* Name;	// Always a literal, so it's never copied
+		std::atomic<unsigned long long> Counts[(int)DrawCounter::Count];
+	};
+
+public:
+	// From anywhere that issues a call (on whatever thread)
+	static void Count(DrawCounter counter, unsigned long long amount = 1)
+	{
+#if DRAW_STATS_ENABLED
+		PassSlot* slot = currentPass ? currentPass : &GetInstance().pending;
+		slot->Counts[(int)counter].fetch_add(amount, std::memory_order_relaxed);
+#endif
+	}
+
+	// Everything this thread counted outside of a scope since the last
+	// call is the named pass's
+	void EndPass(const char* name);
+
+	// Keeps this frame's counts for Get...() and starts over (once every
+	// pass is done, including any recorded on other threads)
+	void EndFrame();
+
+	const std::vector<DrawPassCounters>& GetPasses() { return passes; }
+	const DrawPassCounters& GetTotals() { return totals; }
+
+	// For showing, and for naming its metric in reports
+	static const char* GetCounterName(DrawCounter counter);
+	static const char* GetCounterKey(DrawCounter counter);
+
+private:
+	friend class DrawStatsScope;
+
+	std::mutex slotMutex;
+	PassSlot slots[DRAW_STATS_MAX_PASSES];
+	unsigned int slotCount;
+	PassSlot pending;
+
+	std::vector<DrawPassCounters> passes;
+	DrawPassCounters totals;
+
+	static thread_local PassSlot* currentPass;
+
+	PassSlot* FindSlot(const char* name);
+	static void MoveCounts(PassSlot& from, PassSlot& to);
+};
+
+// --------------------------------------------------------
+// Counts everything from here to the end of the scope (on
+// this thread) as the named pass
+// --------------------------------------------------------
+class DrawStatsScope
+{
+public:
+	DrawStatsScope(const char* name)
+	{
+		previous = DrawStats::currentPass;
+		DrawStats::currentPass = DrawStats::GetInstance().FindSlot(name);
+	}
+	~DrawStatsScope()
+	{
+		DrawStats::currentPass = previous;
+	}
+
+private:
+	DrawStats::PassSlot* previous;
+};
+
+#define DRAW_STATS_CONCAT_INNER(a, b) a##b
+#define DRAW_STATS_CONCAT(a, b) DRAW_STATS_CONCAT_INNER(a, b)
+
+#if DRAW_STATS_ENABLED
+#define DRAW_STATS_PASS(name) DrawStatsScope DRAW_STATS_CONCAT(drawStatsPass, __LINE__)(name)
+#else
+#define DRAW_STATS_PASS(name)
+#endif
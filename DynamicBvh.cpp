@@ -0,0 +1,332 @@
+#include "DynamicBvh.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <stdio.h>
+
+using namespace DirectX;
+
+// Half the surface area of a box, which is what the
+// insertion cost is measured in
+static float Area(const BoundingBox& box)
+{
+	XMFLOAT3 e = box.Extents;
+	return 4.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+static BoundingBox Merge(const BoundingBox& a, const BoundingBox& b)
+{
+	BoundingBox merged;
+	BoundingBox::CreateMerged(merged, a, b);
+	return merged;
+}
+
+static int MaxHeight(int a, int b)
+{
+	return a > b ? a : b;
+}
+
+
+DynamicBvh::DynamicBvh(float margin)
+{
+	this->margin = margin;
+	root = BVH_NULL_NODE;
+	leafCount = 0;
+}
+
+void DynamicBvh::Clear()
+{
+	nodes.clear();
+	freeNodes.clear();
+	root = BVH_NULL_NODE;
+	leafCount = 0;
+}
+
+int DynamicBvh::AllocateNode()
+{
+	int node;
+	if (!freeNodes.empty())
+	{
+		node = freeNodes.back();
+		freeNodes.pop_back();
+	}
+	else
+	{
+		node = (int)nodes.size();
+		nodes.push_back({});
+	}
+
+	nodes[node].Parent = BVH_NULL_NODE;
+	nodes[node].Left = BVH_NULL_NODE;
+	nodes[node].Right = BVH_NULL_NODE;
+	nodes[node].Height = 0;
+	nodes[node].Value = 0;
+	return node;
+}
+
+void DynamicBvh::FreeNode(int node)
+{
+	nodes[node].Height = -1;
+	freeNodes.push_back(node);
+}
+
+int DynamicBvh::Insert(const BoundingBox& box, unsigned int value)
+{
+	int leaf = AllocateNode();
+	nodes[leaf].Box = box;
+	nodes[leaf].Box.Extents.x += margin;
+	nodes[leaf].Box.Extents.y += margin;
+	nodes[leaf].Box.Extents.z += margin;
+	nodes[leaf].Value = value;
+
+	InsertLeaf(leaf);
+	leafCount++;
+	return leaf;
+}
+
+void DynamicBvh::Remove(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	leafCount--;
+}
+
+// --------------------------------------------------------
+// Nothing changes while the box stays inside the leaf's
+// fat box, otherwise it's pulled out and put back in
+// --------------------------------------------------------
+bool DynamicBvh::Move(int proxy, const BoundingBox& box)
+{
+	if (nodes[proxy].Box.Contains(box) == CONTAINS)
+		return false;
+
+	RemoveLeaf(proxy);
+	nodes[proxy].Box = box;
+	nodes[proxy].Box.Extents.x += margin;
+	nodes[proxy].Box.Extents.y += margin;
+	nodes[proxy].Box.Extents.z += margin;
+	InsertLeaf(proxy);
+	return true;
+}
+
+// --------------------------------------------------------
+// Walks down to the sibling that grows the tree's total
+// area the least, then pairs the new leaf up with it
+// --------------------------------------------------------
+void DynamicBvh::InsertLeaf(int leaf)
+{
+	if (root == BVH_NULL_NODE)
+	{
+		root = leaf;
+		nodes[root].Parent = BVH_NULL_NODE;
+		return;
+	}
+
+	BoundingBox leafBox = nodes[leaf].Box;
+	int index = root;
+	while (!nodes[index].IsLeaf())
+	{
+		int left = nodes[index].Left;
+		int right = nodes[index].Right;
+
+		float area = Area(nodes[index].Box);
+		float combinedArea = Area(Merge(nodes[index].Box, leafBox));
+
+		// Cost of a new parent for this node and the leaf, and the
+		// minimum cost of pushing the leaf further down
+		float cost = 2.0f * combinedArea;
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float leftCost = Area(Merge(leafBox, nodes[left].Box)) + inheritanceCost;
+		if (!nodes[left].IsLeaf())
+			leftCost -= Area(nodes[left].Box);
+
+		float rightCost = Area(Merge(leafBox, nodes[right].Box)) + inheritanceCost;
+		if (!nodes[right].IsLeaf())
+			rightCost -= Area(nodes[right].Box);
+
+		if (cost < leftCost && cost < rightCost)
+			break;
+
+		index = leftCost < rightCost ? left : right;
+	}
+
+	// A new parent for the sibling and the leaf
+	int sibling = index;
+	int oldParent = nodes[sibling].Parent;
+	int newParent = AllocateNode();
+	nodes[newParent].Parent = oldParent;
+	nodes[newParent].Box = Merge(leafBox, nodes[sibling].Box);
+	nodes[newParent].Height = nodes[sibling].Height + 1;
+	nodes[newParent].Left = sibling;
+	nodes[newParent].Right = leaf;
+	nodes[sibling].Parent = newParent;
+	nodes[leaf].Parent = newParent;
+
+	if (oldParent == BVH_NULL_NODE)
+		root = newParent;
+	else if (nodes[oldParent].Left == sibling)
+		nodes[oldParent].Left = newParent;
+	else
+		nodes[oldParent].Right = newParent;
+
+	RefitUpwards(nodes[leaf].Parent);
+}
+
+// --------------------------------------------------------
+// Replaces the leaf's parent with its sibling
+// --------------------------------------------------------
+void DynamicBvh::RemoveLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = BVH_NULL_NODE;
+		return;
+	}
+
+	int parent = nodes[leaf].Parent;
+	int grandParent = nodes[parent].Parent;
+	int sibling = nodes[parent].Left == leaf ? nodes[parent].Right : nodes[parent].Left;
+
+	if (grandParent == BVH_NULL_NODE)
+	{
+		root = sibling;
+		nodes[sibling].Parent = BVH_NULL_NODE;
+		FreeNode(parent);
+		return;
+	}
+
+	if (nodes[grandParent].Left == parent)
+		nodes[grandParent].Left = sibling;
+	else
+		nodes[grandParent].Right = sibling;
+	nodes[sibling].Parent = grandParent;
+	FreeNode(parent);
+
+	RefitUpwards(grandParent);
+}
+
+// --------------------------------------------------------
+// Rebalances and refits every node from here to the root
+// --------------------------------------------------------
+void DynamicBvh::RefitUpwards(int node)
+{
+	while (node != BVH_NULL_NODE)
+	{
+		node = Balance(node);
+
+		int left = nodes[node].Left;
+		int right = nodes[node].Right;
+		nodes[node].Height = 1 + MaxHeight(nodes[left].Height, nodes[right].Height);
+		nodes[node].Box = Merge(nodes[left].Box, nodes[right].Box);
+
+		node = nodes[node].Parent;
+	}
+}
+
+// --------------------------------------------------------
+// Rotates the taller child up if the node is out of balance,
+// returning whichever node ends up in its place
+// --------------------------------------------------------
+int DynamicBvh::Balance(int a)
+{
+	if (nodes[a].IsLeaf() || nodes[a].Height < 2)
+		return a;
+
+	int b = nodes[a].Left;
+	int c = nodes[a].Right;
+	int balance = nodes[c].Height - nodes[b].Height;
+
+	// Right side is taller (or left, below), so its child
+	// takes a's place and a takes one of its children
+	if (balance > 1 || balance < -1)
+	{
+		bool rightTaller = balance > 1;
+		int up = rightTaller ? c : b;
+		int stay = rightTaller ? b : c;
+		int f = nodes[up].Left;
+		int g = nodes[up].Right;
+
+		nodes[up].Left = a;
+		nodes[up].Parent = nodes[a].Parent;
+		nodes[a].Parent = up;
+
+		int upParent = nodes[up].Parent;
+		if (upParent == BVH_NULL_NODE)
+			root = up;
+		else if (nodes[upParent].Left == a)
+			nodes[upParent].Left = up;
+		else
+			nodes[upParent].Right = up;
+
+		// The taller grandchild stays with "up", the
+		// other one moves over to a
+		int keep = nodes[f].Height > nodes[g].Height ? f : g;
+		int give = keep == f ? g : f;
+		nodes[up].Right = keep;
+		if (rightTaller)
+			nodes[a].Right = give;
+		else
+			nodes[a].Left = give;
+		nodes[give].Parent = a;
+
+		nodes[a].Box = Merge(nodes[stay].Box, nodes[give].Box);
+		nodes[a].Height = 1 + MaxHeight(nodes[stay].Height, nodes[give].Height);
+		nodes[up].Box = Merge(nodes[a].Box, nodes[keep].Box);
+		nodes[up].Height = 1 + MaxHeight(nodes[a].Height, nodes[keep].Height);
+		return up;
+	}
+
+	return a;
+}
+
+// --------------------------------------------------------
+// Random boxes in a big cube, hit by random spheres
+//  - Both versions count exact hits, so the totals should match
+// --------------------------------------------------------
+void DynamicBvh::Benchmark(unsigned int count, unsigned int queries, double& bruteForceMilliseconds, double& treeMilliseconds)
+{
+	const float worldSize = 1000.0f;
+	auto random = [](float low, float high) { return low + rand() / (float)RAND_MAX * (high - low); };
+
+	std::vector<BoundingBox> boxes(count);
+	DynamicBvh tree;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		boxes[i].Center = XMFLOAT3(random(0, worldSize), random(0, worldSize), random(0, worldSize));
+		boxes[i].Extents = XMFLOAT3(random(0.5f, 2.5f), random(0.5f, 2.5f), random(0.5f, 2.5f));
+		tree.Insert(boxes[i], i);
+	}
+
+	std::vector<BoundingSphere> spheres(queries);
+	for (auto& s : spheres)
+	{
+		s.Center = XMFLOAT3(random(0, worldSize), random(0, worldSize), random(0, worldSize));
+		s.Radius = 20.0f;
+	}
+
+	unsigned int bruteHits = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (auto& s : spheres)
+	{
+		for (auto& b : boxes)
+			bruteHits += s.Intersects(b) ? 1 : 0;
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	bruteForceMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	unsigned int treeHits = 0;
+	start = std::chrono::high_resolution_clock::now();
+	for (auto& s : spheres)
+	{
+		tree.Query(s, [&](unsigned int value, bool inside)
+		{
+			treeHits += inside || s.Intersects(boxes[value]) ? 1 : 0;
+		});
+	}
+	end = std::chrono::high_resolution_clock::now();
+	treeMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	printf("BVH (%u boxes, %u queries): %.3f ms brute force, %.3f ms tree, %u/%u hits, height %d\n",
+		count, queries, bruteForceMilliseconds, treeMilliseconds, bruteHits, treeHits, tree.GetHeight());
+}
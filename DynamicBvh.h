@@ -0,0 +1,156 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+#define BVH_NULL_NODE		-1
+#define BVH_MAX_STACK		256
+
+// How far (in world units) leaf boxes are grown past what they hold,
+// so small movements don't need the tree to change at all
+#define BVH_DEFAULT_MARGIN	0.25f
+
+struct BvhNode
+{
+	DirectX::BoundingBox Box;
+	int Parent;
+	int Left;
+	int Right;
+
+	// Leaves are zero, free nodes are -1
+	int Height;
+
+	// What a leaf holds (like an entity index)
+	unsigned int Value;
+
+	bool IsLeaf() const { return Left == BVH_NULL_NODE; }
+};
+
+// A dynamic AABB tree (bounding volume hierarchy)
+//  - Leaves hold a fattened copy of each box, and only move in the tree
+//    once what they hold leaves the fat box
+//  - Kept balanced with rotations as leaves come and go, so queries
+//    stay around log(n) no matter the insertion order
+class DynamicBvh
+{
+public:
+	DynamicBvh(float margin = BVH_DEFAULT_MARGIN);
+
+	// Returns a proxy (node index) for the new leaf
+	int Insert(const DirectX::BoundingBox& box, unsigned int value);
+	void Remove(int proxy);
+
+	// Updates a leaf's box, returning true if it had to move in the tree
+	bool Move(int proxy, const DirectX::BoundingBox& box);
+
+	void SetValue(int proxy, unsigned int value) { nodes[proxy].Value = value; }
+	unsigned int GetValue(int proxy) const { return nodes[proxy].Value; }
+	const DirectX::BoundingBox& GetFatBox(int proxy) const { return nodes[proxy].Box; }
+
+	int GetHeight() const { return root == BVH_NULL_NODE ? 0 : nodes[root].Height; }
+	unsigned int GetLeafCount() const { return leafCount; }
+	void Clear();
+
+	// Calls callback(value, inside) for every leaf whose fat box touches the
+	// volume (a BoundingFrustum, BoundingOrientedBox, BoundingBox or BoundingSphere)
+	//  - inside means the fat box (and so whatever the leaf holds) is
+	//    entirely within the volume, so there's no need to test it again
+	template<typename Volume, typename Callback>
+	void Query(const Volume& volume, Callback callback) const;
+
+	// Calls callback(value, distance) for every leaf whose fat box the ray
+	// hits within maxDistance, where distance is to that fat box
+	//  - direction must be normalized
+	template<typename Callback>
+	void QueryRay(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance, Callback callback) const;
+
+	// Times sphere queries against count random boxes, looping over
+	// every box versus using a tree
+	static void Benchmark(unsigned int count, unsigned int queries, double& bruteForceMilliseconds, double& treeMilliseconds);
+
+private:
+	std::vector<BvhNode> nodes;
+	std::vector<int> freeNodes;
+	int root;
+	unsigned int leafCount;
+	float margin;
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	void RefitUpwards(int node);
+	int Balance(int node);
+};
+
+template<typename Volume, typename Callback>
+void DynamicBvh::Query(const Volume& volume, Callback callback) const
+{
+	if (root == BVH_NULL_NODE)
+		return;
+
+	// Nodes to visit, and whether they're already known to be inside
+	int stack[BVH_MAX_STACK];
+	bool insideStack[BVH_MAX_STACK];
+	int count = 0;
+	stack[count] = root;
+	insideStack[count++] = false;
+
+	while (count > 0)
+	{
+		count--;
+		const BvhNode& node = nodes[stack[count]];
+		bool inside = insideStack[count];
+
+		if (!inside)
+		{
+			DirectX::ContainmentType containment = volume.Contains(node.Box);
+			if (containment == DirectX::DISJOINT)
+				continue;
+			inside = containment == DirectX::CONTAINS;
+		}
+
+		if (node.IsLeaf())
+		{
+			callback(node.Value, inside);
+		}
+		else if (count + 2 <= BVH_MAX_STACK)
+		{
+			stack[count] = node.Left;
+			insideStack[count++] = inside;
+			stack[count] = node.Right;
+			insideStack[count++] = inside;
+		}
+	}
+}
+
+template<typename Callback>
+void DynamicBvh::QueryRay(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance, Callback callback) const
+{
+	if (root == BVH_NULL_NODE)
+		return;
+
+	int stack[BVH_MAX_STACK];
+	int count = 0;
+	stack[count++] = root;
+
+	while (count > 0)
+	{
+		const BvhNode& node = nodes[stack[--count]];
+
+		float distance = 0.0f;
+		if (!node.Box.Contains(origin) && (!node.Box.Intersects(origin, direction, distance) || distance > maxDistance))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			callback(node.Value, distance);
+		}
+		else if (count + 2 <= BVH_MAX_STACK)
+		{
+			stack[count++] = node.Left;
+			stack[count++] = node.Right;
+		}
+	}
+}
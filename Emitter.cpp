@@ -1,6 +1,19 @@
 #include "Emitter.h"
+#include "Mesh.h"
+#include "AssetLoader.h"
+#include "CpuProfiler.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
 
-Emitter::Emitter(int maxParticles, int particlesPerSecond, float lifetime, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, SimpleVertexShader* vs, SimplePixelShader* ps, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture)
+#include <vector>
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> Emitter::quadIndexBuffer16;
+Microsoft::WRL::ComPtr<ID3D11Buffer> Emitter::quadIndexBuffer32;
+int Emitter::quadCapacity16 = 0;
+int Emitter::quadCapacity32 = 0;
+int Emitter::emitterCount = 0;
+
+Emitter::Emitter(int maxParticles, int particlesPerSecond, float lifetime, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, SimpleVertexShader* vs, SimplePixelShader* ps, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture, bool gpuSimulation)
 	: maxParticles(maxParticles), particlesPerSecond(particlesPerSecond), particleLifeSpan(lifetime), context(context), vs(vs), ps(ps), texture(texture)
 {
 
@@ -10,31 +23,57 @@ Emitter::Emitter(int maxParticles, int particlesPerSecond, float lifetime, Micro
 	livingCount = 0;
 	livingStart = 0;
 	deadStart = 0;
+	emittedSinceUpload = 0;
+	lastUploadBytes = 0;
+	canAppendUploads = false;
+	appendUploads = false;
+	emitterCount++;
+
+	position = DirectX::XMFLOAT3(0, 0, 0);
+	lowResolution = false;
+	visible = true;
+	updateInterval = 1;
+	framesSinceUpdate = 0;
+	pendingTime = 0.0f;
+	updatedThisFrame = false;
+
+	// Falls back to the CPU without all three shaders
+	Assets& assets = Assets::GetInstance();
+	this->gpuSimulation = gpuSimulation &&
+		assets.GetComputeShader("ParticleSimulateCS.cso") &&
+		assets.GetComputeShader("ParticleEmitCS.cso") &&
+		assets.GetVertexShader("ParticleGPUVS.cso");
+	currentAliveList = 0;
+	pendingEmitCount = 0;
+	pendingEmitTime = 0.0f;
+	pendingSimulateTime = 0.0f;
+	particles = 0;
+
+	// Sorting needs both of its compute shaders and its vertex shader
+	canSort =
+		assets.GetComputeShader("ParticleSortKeysCS.cso") &&
+		assets.GetComputeShader("ParticleBitonicSortCS.cso") &&
+		assets.GetVertexShader("ParticleSortedVS.cso");
+	depthSorted = false;
+
+	if (this->gpuSimulation)
+	{
+		CreateGpuBuffers(device);
+		CreateSortBuffers(device, maxParticles);
+		return;
+	}
 
 	particles = new Particle[maxParticles];
 	ZeroMemory(particles, sizeof(Particle) * maxParticles);
 
-	unsigned int* indices = new unsigned int[maxParticles * 6];
-	int indexCount = 0;
-	for (int i = 0; i < maxParticles * 4; i += 4)
-	{
-		indices[indexCount++] = i;
-		indices[indexCount++] = i + 1;
-		indices[indexCount++] = i + 2;
-		indices[indexCount++] = i;
-		indices[indexCount++] = i + 2;
-		indices[indexCount++] = i + 3;
-	}
-	D3D11_SUBRESOURCE_DATA indexData = {};
-	indexData.pSysMem = indices;
+	ReserveQuadIndices(device, maxParticles);
 
-	D3D11_BUFFER_DESC buffDesc = {};
-	buffDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	buffDesc.CPUAccessFlags = 0;
-	buffDesc.Usage = D3D11_USAGE_DEFAULT;
-	buffDesc.ByteWidth = sizeof(unsigned int) * maxParticles * 6;
-	device->CreateBuffer(&buffDesc, &indexData, indexBuffer.GetAddressOf());
-	delete[] indices;
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	canAppendUploads = options.MapNoOverwriteOnDynamicBufferSRV == TRUE;
+	appendUploads = canAppendUploads;
+	ringCapacity = canAppendUploads ? maxParticles * EMITTER_UPLOAD_RING_SCALE : maxParticles;
+	ringHead = ringCapacity; // So the first upload discards
 
 	D3D11_BUFFER_DESC particlesBufferDesc = {};
 	particlesBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
@@ -42,25 +81,71 @@ Emitter::Emitter(int maxParticles, int particlesPerSecond, float lifetime, Micro
 	particlesBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
 	particlesBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
 	particlesBufferDesc.StructureByteStride = sizeof(Particle);
-	particlesBufferDesc.ByteWidth = sizeof(Particle) * maxParticles;
-	device->CreateBuffer(&particlesBufferDesc, 0, particleDataBuffer.GetAddressOf());
+	particlesBufferDesc.ByteWidth = sizeof(Particle) * ringCapacity;
+	GpuMemory::CreateBuffer(device.Get(), &particlesBufferDesc, 0, particleDataBuffer.GetAddressOf(), GpuMemoryCategory::Particles, "Particle Data");
 
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
 	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
 	srvDesc.Buffer.FirstElement = 0;
-	srvDesc.Buffer.NumElements = maxParticles;
+	srvDesc.Buffer.NumElements = ringCapacity;
 	device->CreateShaderResourceView(particleDataBuffer.Get(), &srvDesc, particleDataSRV.GetAddressOf());
 
+	CreateSortBuffers(device, ringCapacity);
 }
 
 Emitter::~Emitter()
 {
 	delete[] particles;
+
+	if (--emitterCount == 0)
+	{
+		quadIndexBuffer16.Reset();
+		quadIndexBuffer32.Reset();
+		quadCapacity16 = 0;
+		quadCapacity32 = 0;
+	}
 }
 
 void Emitter::Update(float dt, float currentTime)
 {
+	PROFILE_SCOPE("Emitter::Update");
+	Simulate(dt, currentTime);
+	Upload();
+}
+
+void Emitter::Simulate(float dt, float currentTime)
+{
+	// Throttled (or culled), the time's saved up for the next update
+	updatedThisFrame = false;
+	pendingTime += dt;
+	if (updateInterval <= 0 || ++framesSinceUpdate < updateInterval)
+		return;
+	dt = pendingTime;
+	pendingTime = 0.0f;
+	framesSinceUpdate = 0;
+	updatedThisFrame = true;
+
+	// Skip anything that would have been emitted and died again
+	// since the last update
+	dtSinceLastEmit += dt;
+	if (dtSinceLastEmit - secondsPerParticle >= particleLifeSpan)
+	{
+		int expired = (int)((dtSinceLastEmit - secondsPerParticle - particleLifeSpan) / secondsPerParticle) + 1;
+		dtSinceLastEmit -= expired * secondsPerParticle;
+	}
+
+	// Only how many to emit, the same way as below, but all at once
+	//  - If there are too many, it's the newest that are kept
+	if (gpuSimulation)
+	{
+		int emitCount = (int)(dtSinceLastEmit / secondsPerParticle);
+		dtSinceLastEmit -= emitCount * secondsPerParticle;
+		pendingEmitCount = min(emitCount, maxParticles);
+		pendingEmitTime = currentTime - dtSinceLastEmit - (pendingEmitCount - 1) * secondsPerParticle;
+		pendingSimulateTime = currentTime;
+		return;
+	}
 
 	if (livingCount > 0)
 	{
@@ -91,53 +176,168 @@ void Emitter::Update(float dt, float currentTime)
 		}
 	}
 
-	dtSinceLastEmit += dt;
-
+	// Each one as long ago as it was due
 	while (dtSinceLastEmit > secondsPerParticle)
 	{
-		EmitParticle(currentTime);
 		dtSinceLastEmit -= secondsPerParticle;
+		EmitParticle(currentTime - dtSinceLastEmit);
 	}
+}
 
-	D3D11_MAPPED_SUBRESOURCE mapped = {};
-	context->Map(particleDataBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+void Emitter::Upload()
+{
+	// Nothing's changed since the last upload
+	lastUploadBytes = 0;
+	if (!updatedThisFrame || !visible && !gpuSimulation)
+		return;
 
-	if (livingStart < deadStart)
+	if (gpuSimulation)
 	{
-		memcpy(mapped.pData, particles + livingStart, sizeof(Particle) * livingCount);
+		SimulateOnGpu();
+		return;
 	}
-	else
+
+	// Only what was emitted since the last upload is new (and if
+	// nothing was uploaded for a while, that can be all of them)
+	int newCount = min(emittedSinceUpload, livingCount);
+	emittedSinceUpload = 0;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (!appendUploads || ringHead + newCount > ringCapacity)
 	{
-		memcpy(mapped.pData, particles, sizeof(Particle) * deadStart);
-		memcpy((void*)((Particle*)mapped.pData + deadStart), particles + livingStart, sizeof(Particle) * (maxParticles - livingStart));
+		// Start over with just the living ones, oldest first
+		context->Map(particleDataBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+		DrawStats::Count(DrawCounter::Maps);
+		CopyLivingParticles((Particle*)mapped.pData);
+		context->Unmap(particleDataBuffer.Get(), 0);
+		ringHead = livingCount;
+		lastUploadBytes = sizeof(Particle) * livingCount;
+		return;
 	}
 
+	if (newCount == 0)
+		return;
+
+	// The new ones end at deadStart, maybe wrapping around the CPU's ring
+	context->Map(particleDataBuffer.Get(), 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped);
+	DrawStats::Count(DrawCounter::Maps);
+	Particle* destination = (Particle*)mapped.pData + ringHead;
+	int first = (deadStart - newCount + maxParticles) % maxParticles;
+	int firstRun = min(newCount, maxParticles - first);
+	memcpy(destination, particles + first, sizeof(Particle) * firstRun);
+	memcpy(destination + firstRun, particles, sizeof(Particle) * (newCount - firstRun));
 	context->Unmap(particleDataBuffer.Get(), 0);
+	ringHead += newCount;
+	lastUploadBytes = sizeof(Particle) * newCount;
+}
+
+void Emitter::SetAppendUploads(bool enabled)
+{
+	appendUploads = enabled && canAppendUploads;
+	ringHead = ringCapacity; // So the next upload starts over
+}
 
+DirectX::BoundingBox Emitter::GetBounds()
+{
+	// Everything drifts the same way, so it's the line from where they
+	// start to where they die, as wide as a particle
+	DirectX::XMFLOAT3 end(position.x + EMITTER_PARTICLE_DRIFT * particleLifeSpan, position.y, position.z);
+	DirectX::XMFLOAT3 center((position.x + end.x) * 0.5f, position.y, position.z);
+	DirectX::XMFLOAT3 extents((end.x - position.x) * 0.5f + EMITTER_PARTICLE_RADIUS, EMITTER_PARTICLE_RADIUS, EMITTER_PARTICLE_RADIUS);
+	return DirectX::BoundingBox(center, extents);
 }
 
-void Emitter::Draw(Camera* camera, float currentTime)
+int Emitter::CopyLivingParticles(Particle* destination)
 {
+	if (gpuSimulation || livingCount == 0)
+		return 0;
+
+	// The living ones either run straight through, or wrap around the end
+	int firstRun = min(livingCount, maxParticles - livingStart);
+	memcpy(destination, particles + livingStart, sizeof(Particle) * firstRun);
+	memcpy(destination + firstRun, particles, sizeof(Particle) * (livingCount - firstRun));
+	return livingCount;
+}
+
+void Emitter::SetLivingParticles(const Particle* source, int count, float sinceLastEmit)
+{
+	if (gpuSimulation)
+		return;
+
+	count = max(0, min(count, maxParticles));
+	memcpy(particles, source, sizeof(Particle) * count);
+	livingStart = 0;
+	livingCount = count;
+	deadStart = count % maxParticles;
+	dtSinceLastEmit = sinceLastEmit;
+
+	// Uploaded whole, whether or not it's due to update
+	emittedSinceUpload = count;
+	ringHead = ringCapacity;
+	updatedThisFrame = true;
+}
+
+void Emitter::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera, float currentTime)
+{
+	if (!visible)
+		return;
 
 	UINT stride = 0;
 	UINT offset = 0;
 	ID3D11Buffer* nullBuffer = 0;
 	context->IASetVertexBuffers(0, 1, &nullBuffer, &stride, &offset);
-	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
-
-	vs->SetShader();
-	ps->SetShader();
+	SetQuadIndices(context, maxParticles);
 
-	vs->SetShaderResourceView("ParticleData", particleDataSRV);
-	ps->SetShaderResourceView("Texture", texture);
-
-	vs->SetMatrix4x4("view", camera->GetView());
-	vs->SetMatrix4x4("projection", camera->GetProjection());
-	vs->SetFloat("currentTime", currentTime);
-	vs->CopyAllBufferData();
+	// Everything that's alive is already listed on the GPU
+	SimpleVertexShader* drawVS = vs;
+	if (depthSorted)
+	{
+		drawVS = Assets::GetInstance().GetVertexShader("ParticleSortedVS.cso"_asset);
+		context->IASetIndexBuffer(0, DXGI_FORMAT_R16_UINT, 0);
+	}
+	else if (gpuSimulation)
+	{
+		drawVS = Assets::GetInstance().GetVertexShader("ParticleGPUVS.cso"_asset);
+		context->IASetIndexBuffer(0, DXGI_FORMAT_R16_UINT, 0);
+	}
 
-	context->DrawIndexed(livingCount * 6, 0, 0);
+	drawVS->SetShader();
+	ps->SetShader();
 
+	if (gpuSimulation)
+		drawVS->SetShaderResourceView("ParticleData"_sn, gpuParticleSRV);
+	else
+		drawVS->SetShaderResourceView("ParticleData"_sn, particleDataSRV);
+	if (depthSorted)
+		drawVS->SetShaderResourceView("SortKeys"_sn, sortKeySRV);
+	else if (gpuSimulation)
+		drawVS->SetShaderResourceView("AliveList"_sn, aliveListSRVs[currentAliveList]);
+	ps->SetShaderResourceView("Texture"_sn, texture);
+
+	drawVS->SetMatrix4x4("view"_sn, camera->GetView());
+	drawVS->SetMatrix4x4("projection"_sn, camera->GetProjection());
+	drawVS->SetFloat("currentTime"_sn, currentTime);
+	drawVS->SetFloat("lifetime"_sn, particleLifeSpan); // Throttled ones can be behind on killing them
+	if (!gpuSimulation && !depthSorted)
+	{
+		// The living ones are the newest livingCount uploaded
+		drawVS->SetInt("particleStart"_sn, ringHead - livingCount);
+		drawVS->SetInt("particleCount"_sn, livingCount);
+		drawVS->SetInt("particleCapacity"_sn, ringCapacity);
+	}
+	drawVS->CopyAllBufferData();
+
+	// Sorted, every slot's drawn (the dead ones as nothing), since a
+	// sort that isn't done yet can leave them anywhere
+	if (depthSorted)
+		context->DrawInstanced(6, sortSize, 0, 0);
+	else if (gpuSimulation)
+		context->DrawInstancedIndirect(drawArgsBuffer.Get(), 0);
+	else
+		context->DrawIndexed(livingCount * 6, 0, 0);
+	DrawStats::Count(DrawCounter::Draws);
+	if (depthSorted || gpuSimulation)
+		DrawStats::Count(DrawCounter::InstancedDraws);
 }
 
 void Emitter::UpdateParticle(float currentTime, int index)
@@ -153,15 +353,15 @@ void Emitter::UpdateParticle(float currentTime, int index)
 
 }
 
-void Emitter::EmitParticle(float currentTime)
+void Emitter::EmitParticle(float emitTime)
 {
 
 	if (livingCount == maxParticles)
 		return;
 
 	int newIndex = deadStart;
-	particles[newIndex].emitTime = currentTime;
-	particles[newIndex].initPos = DirectX::XMFLOAT3(0, 0, 0);
+	particles[newIndex].emitTime = emitTime;
+	particles[newIndex].initPos = position;
 
 	//fun stuff
 
@@ -169,5 +369,298 @@ void Emitter::EmitParticle(float currentTime)
 	deadStart %= maxParticles;
 
 	livingCount++;
+	emittedSinceUpload++;
+
+}
+
+// --------------------------------------------------------
+// The particle pool, its dead and alive lists, and what
+// the compute shaders and the indirect draw share, with
+// every slot starting out dead
+// --------------------------------------------------------
+void Emitter::CreateGpuBuffers(Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	auto createList = [&](const void* initialData, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* srv, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& uav, unsigned int stride, unsigned int uavFlags)
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | (srv ? D3D11_BIND_SHADER_RESOURCE : 0);
+		desc.ByteWidth = stride * maxParticles;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = stride;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		D3D11_SUBRESOURCE_DATA data = {};
+		data.pSysMem = initialData;
+		GpuMemory::CreateBuffer(device.Get(), &desc, initialData ? &data : 0, buffer.GetAddressOf(), GpuMemoryCategory::Particles, "Particle List");
+
+		if (srv)
+		{
+			D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+			srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+			srvDesc.Buffer.NumElements = maxParticles;
+			device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv->GetAddressOf());
+		}
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+		uavDesc.Buffer.NumElements = maxParticles;
+		uavDesc.Buffer.Flags = uavFlags;
+		device->CreateUnorderedAccessView(buffer.Get(), &uavDesc, uav.GetAddressOf());
+	};
+
+	std::vector<unsigned int> deadIndices(maxParticles);
+	for (int i = 0; i < maxParticles; i++)
+		deadIndices[i] = i;
+
+	// Long dead to begin with, for anything that checks a slot's age
+	std::vector<Particle> pool(maxParticles);
+	for (auto& p : pool)
+		p.emitTime = -1e30f;
+
+	createList(pool.data(), gpuParticleBuffer, &gpuParticleSRV, gpuParticleUAV, sizeof(Particle), 0);
+	createList(deadIndices.data(), deadListBuffer, 0, deadListUAV, sizeof(unsigned int), D3D11_BUFFER_UAV_FLAG_APPEND);
+	for (int i = 0; i < 2; i++)
+		createList(0, aliveListBuffers[i], &aliveListSRVs[i], aliveListUAVs[i], sizeof(unsigned int), D3D11_BUFFER_UAV_FLAG_APPEND);
+
+	D3D11_BUFFER_DESC countsDesc = {};
+	countsDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	countsDesc.ByteWidth = 16; // Constant buffers come in 16 byte chunks
+	countsDesc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateBuffer(device.Get(), &countsDesc, 0, listCountsBuffer.GetAddressOf(), GpuMemoryCategory::Particles, "Particle List Counts");
+
+	// Six vertices (a quad) for however many are alive
+	unsigned int drawArgs[4] = { 6, 0, 0, 0 };
+	D3D11_BUFFER_DESC argsDesc = {};
+	argsDesc.ByteWidth = sizeof(drawArgs);
+	argsDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+	argsDesc.Usage = D3D11_USAGE_DEFAULT;
+	D3D11_SUBRESOURCE_DATA argsData = {};
+	argsData.pSysMem = drawArgs;
+	GpuMemory::CreateBuffer(device.Get(), &argsDesc, &argsData, drawArgsBuffer.GetAddressOf(), GpuMemoryCategory::Particles, "Particle Draw Args");
+
+	// The lists' hidden counters are only set by binding them: every
+	// slot's in the dead list, and nothing's alive
+	ID3D11UnorderedAccessView* lists[3] = { deadListUAV.Get(), aliveListUAVs[0].Get(), aliveListUAVs[1].Get() };
+	unsigned int counts[3] = { (unsigned int)maxParticles, 0, 0 };
+	context->CSSetUnorderedAccessViews(0, 3, lists, counts);
+	ID3D11UnorderedAccessView* nullUAVs[3] = {};
+	context->CSSetUnorderedAccessViews(0, 3, nullUAVs, 0);
+	ISimpleShader::InvalidateStateCache(context);
+}
+
+// --------------------------------------------------------
+// Ages last frame's particles into this frame's alive list
+// (or back into the dead list), emits new ones into it too,
+// then has its count become the draw's instance count
+// --------------------------------------------------------
+void Emitter::SimulateOnGpu()
+{
+	Assets& assets = Assets::GetInstance();
+	SimpleComputeShader* simulateCS = assets.GetComputeShader("ParticleSimulateCS.cso"_asset);
+	SimpleComputeShader* emitCS = assets.GetComputeShader("ParticleEmitCS.cso"_asset);
+	int nextAliveList = 1 - currentAliveList;
+
+	// Aging only adds to the dead list, so its count from before
+	// is still safe to emit up to
+	context->CopyStructureCount(listCountsBuffer.Get(), 0, deadListUAV.Get());
+	context->CopyStructureCount(listCountsBuffer.Get(), 4, aliveListUAVs[currentAliveList].Get());
+
+	simulateCS->SetExternalConstantBuffer("listCounts", listCountsBuffer);
+	simulateCS->SetShader();
+	simulateCS->SetShaderResourceView("AliveIn", aliveListSRVs[currentAliveList]);
+	simulateCS->SetUnorderedAccessView("Particles", gpuParticleUAV);
+	simulateCS->SetUnorderedAccessView("DeadList", deadListUAV);
+	simulateCS->SetUnorderedAccessView("AliveOut", aliveListUAVs[nextAliveList], 0); // Starts empty
+	simulateCS->SetFloat("currentTime", pendingSimulateTime);
+	simulateCS->SetFloat("lifetime", particleLifeSpan);
+	simulateCS->CopyAllBufferData();
+	simulateCS->DispatchByThreads(maxParticles, 1, 1);
+
+	// The alive list keeps what aging left in it
+	if (pendingEmitCount > 0)
+	{
+		emitCS->SetExternalConstantBuffer("listCounts", listCountsBuffer);
+		emitCS->SetShader();
+		emitCS->SetUnorderedAccessView("Particles", gpuParticleUAV);
+		emitCS->SetUnorderedAccessView("DeadList", deadListUAV);
+		emitCS->SetUnorderedAccessView("AliveOut", aliveListUAVs[nextAliveList]);
+		emitCS->SetFloat("firstEmitTime", pendingEmitTime);
+		emitCS->SetFloat("secondsPerParticle", secondsPerParticle);
+		emitCS->SetInt("emitCount", pendingEmitCount);
+		emitCS->SetFloat3("position", position);
+		emitCS->CopyAllBufferData();
+		emitCS->DispatchByThreads(pendingEmitCount, 1, 1);
+	}
+
+	ID3D11UnorderedAccessView* nullUAVs[3] = {};
+	ID3D11ShaderResourceView* nullSRVs[1] = {};
+	context->CSSetUnorderedAccessViews(0, 3, nullUAVs, 0);
+	context->CSSetShaderResources(0, 1, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+
+	context->CopyStructureCount(drawArgsBuffer.Get(), 4, aliveListUAVs[nextAliveList].Get());
+	currentAliveList = nextAliveList;
+	pendingEmitCount = 0;
+}
+
+// Same as meshes, 16 bit indices while the quads' corners fit
+void Emitter::SetQuadIndices(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, int quads)
+{
+	if (quads * 4 <= MESH_MAX_SHORT_INDEX_VERTS)
+		context->IASetIndexBuffer(quadIndexBuffer16.Get(), DXGI_FORMAT_R16_UINT, 0);
+	else
+		context->IASetIndexBuffer(quadIndexBuffer32.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
+
+// --------------------------------------------------------
+// Makes sure the shared index buffer an emitter with this
+// many quads draws with has them all, replacing it with a
+// bigger one (at least double, to keep that rare) if not
+//  - Emitters look the buffer up each draw, so none are
+//    left holding the old one
+// --------------------------------------------------------
+void Emitter::ReserveQuadIndices(Microsoft::WRL::ComPtr<ID3D11Device> device, int quads)
+{
+	bool shortIndices = quads * 4 <= MESH_MAX_SHORT_INDEX_VERTS;
+	int& capacity = shortIndices ? quadCapacity16 : quadCapacity32;
+	if (quads <= capacity)
+		return;
+
+	int newCapacity = max(quads, capacity * 2);
+	if (shortIndices)
+		newCapacity = min(newCapacity, MESH_MAX_SHORT_INDEX_VERTS / 4);
+
+	std::vector<unsigned int> indices(newCapacity * 6);
+	int indexCount = 0;
+	for (int i = 0; i < newCapacity * 4; i += 4)
+	{
+		indices[indexCount++] = i;
+		indices[indexCount++] = i + 1;
+		indices[indexCount++] = i + 2;
+		indices[indexCount++] = i;
+		indices[indexCount++] = i + 2;
+		indices[indexCount++] = i + 3;
+	}
+	std::vector<unsigned short> shortData;
+	if (shortIndices)
+		shortData.assign(indices.begin(), indices.end());
+
+	D3D11_SUBRESOURCE_DATA indexData = {};
+	indexData.pSysMem = shortIndices ? (const void*)shortData.data() : indices.data();
+
+	D3D11_BUFFER_DESC buffDesc = {};
+	buffDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	buffDesc.CPUAccessFlags = 0;
+	buffDesc.Usage = D3D11_USAGE_DEFAULT;
+	buffDesc.ByteWidth = (shortIndices ? sizeof(unsigned short) : sizeof(unsigned int)) * newCapacity * 6;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer = shortIndices ? quadIndexBuffer16 : quadIndexBuffer32;
+	buffer.Reset();
+	if (SUCCEEDED(GpuMemory::CreateBuffer(device.Get(), &buffDesc, &indexData, buffer.GetAddressOf(), GpuMemoryCategory::Particles, "Particle Quad Indices")))
+		capacity = newCapacity;
+}
+
+// --------------------------------------------------------
+// The sort keys, one per slot of a pool this big (and
+// then dead padding up to a power of two), starting out
+// in slot order
+// --------------------------------------------------------
+void Emitter::CreateSortBuffers(Microsoft::WRL::ComPtr<ID3D11Device> device, int poolSize)
+{
+	sortSize = 0;
+	if (!canSort)
+		return;
+
+	sortSize = EMITTER_GPU_GROUP_SIZE;
+	while (sortSize < poolSize)
+		sortSize *= 2;
+	sortBlockSize = 2;
+	sortCompareOffset = 1;
+
+	std::vector<ParticleSortKey> keys(sortSize);
+	for (int i = 0; i < sortSize; i++)
+		keys[i] = { 0.0f, (unsigned int)i };
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+	desc.ByteWidth = sizeof(ParticleSortKey) * sortSize;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(ParticleSortKey);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = keys.data();
+	GpuMemory::CreateBuffer(device.Get(), &desc, &data, sortKeyBuffer.GetAddressOf(), GpuMemoryCategory::Particles, "Particle Sort Keys");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.Buffer.NumElements = sortSize;
+	device->CreateShaderResourceView(sortKeyBuffer.Get(), &srvDesc, sortKeySRV.GetAddressOf());
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+	uavDesc.Buffer.NumElements = sortSize;
+	device->CreateUnorderedAccessView(sortKeyBuffer.Get(), &uavDesc, sortKeyUAV.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Gives every key its particle's depth from this camera
+// (in the order they're already in), then runs as many
+// passes of the bitonic sort as fit in a frame
+//  - A small emitter's whole sort fits, so it's exact;
+//    a big one's carries on next frame, over keys that
+//    have barely moved since, so it stays nearly sorted
+// --------------------------------------------------------
+void Emitter::SortByDepth(Camera* camera, float currentTime)
+{
+	if (!depthSorted || !visible)
+		return;
+
+	Assets& assets = Assets::GetInstance();
+	SimpleComputeShader* keysCS = assets.GetComputeShader("ParticleSortKeysCS.cso"_asset);
+	SimpleComputeShader* sortCS = assets.GetComputeShader("ParticleBitonicSortCS.cso"_asset);
+
+	keysCS->SetShader();
+	keysCS->SetShaderResourceView("ParticleData", gpuSimulation ? gpuParticleSRV : particleDataSRV);
+	keysCS->SetUnorderedAccessView("SortKeys", sortKeyUAV);
+	keysCS->SetMatrix4x4("view", camera->GetView());
+	keysCS->SetFloat("currentTime", currentTime);
+	keysCS->SetFloat("lifetime", particleLifeSpan);
+	keysCS->SetInt("poolSize", gpuSimulation ? maxParticles : ringCapacity);
+	keysCS->SetInt("windowStart", gpuSimulation ? 0 : ringHead - livingCount);
+	keysCS->SetInt("windowCount", gpuSimulation ? maxParticles : livingCount);
+	keysCS->CopyAllBufferData();
+	keysCS->DispatchByThreads(sortSize, 1, 1);
+
+	// Same UAV, so it stays bound from one pass to the next
+	sortCS->SetShader();
+	sortCS->SetUnorderedAccessView("SortKeys", sortKeyUAV);
+	for (int pass = 0; pass < EMITTER_SORT_PASSES_PER_FRAME; pass++)
+	{
+		sortCS->SetInt("blockSize", sortBlockSize);
+		sortCS->SetInt("compareOffset", sortCompareOffset);
+		sortCS->CopyAllBufferData();
+		sortCS->DispatchByThreads(sortSize, 1, 1);
+
+		// Halve the distance until a block's merged, then double
+		// the block until the whole buffer's one
+		sortCompareOffset /= 2;
+		if (sortCompareOffset == 0)
+		{
+			sortBlockSize *= 2;
+			sortCompareOffset = sortBlockSize / 2;
+			if (sortBlockSize > sortSize)
+			{
+				sortBlockSize = 2;
+				sortCompareOffset = 1;
+				break;
+			}
+		}
+	}
 
+	ID3D11UnorderedAccessView* nullUAV = 0;
+	context->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+	ISimpleShader::InvalidateStateCache(context);
 }
@@ -3,16 +3,47 @@
 #include <wrl/client.h>
 #include <DirectXMath.h>
 #include <d3d11.h>
+#include <DirectXCollision.h>
 
 #include "SimpleShader.h"
 #include "Camera.h"
 
+// Should match PARTICLE_GROUP_SIZE in Particle.hlsli
+#define EMITTER_GPU_GROUP_SIZE	64
+
+// CPU simulated particles never change once they're emitted, so only
+// new ones are appended to the GPU's copy each frame, which has room
+// for this many emitters' worth before it's rewritten from the start
+#define EMITTER_UPLOAD_RING_SCALE	2
+
+// Depth sorting an emitter runs a pass per step of a bitonic sort, and
+// one too big for this many a frame has its sort spread over frames
+#define EMITTER_SORT_PASSES_PER_FRAME	78	// A whole sort of 4096
+
+// How far particles drift each second, and how far a quad's corners
+// reach from its center, which the vertex shaders have to match
+#define EMITTER_PARTICLE_DRIFT		0.1f
+#define EMITTER_PARTICLE_RADIUS		1.4142136f
+
+// Emitters farther than this from the camera only update every few
+// frames (see Emitter::SetUpdateInterval())
+#define EMITTER_THROTTLE_DISTANCE	50.0f
+#define EMITTER_THROTTLED_INTERVAL	4
+
+// Same layout as Particle in Particle.hlsli
 struct Particle
 {
 	float emitTime;
 	DirectX::XMFLOAT3 initPos; //16 Bytes
 };
 
+// Same layout as ParticleSortKey in Particle.hlsli
+struct ParticleSortKey
+{
+	float depth;
+	unsigned int index;
+};
+
 class Emitter
 {
 public:
@@ -26,12 +57,84 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
 		SimpleVertexShader* vs,
 		SimplePixelShader* ps,
-		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture,
+		bool gpuSimulation = false	// Simulated entirely in compute shaders, if they're loaded
 	);
 	~Emitter();
 
 	void Update(float dt, float currentTime);
-	void Draw(Camera* camera, float currentTime);
+
+	// The two halves of Update()
+	//  - Simulate only touches this emitter's own particles, so
+	//    different emitters can be simulated at the same time
+	//  - Upload maps the particle buffer, so it needs the immediate context
+	void Simulate(float dt, float currentTime);
+	void Upload();
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera, float currentTime);
+
+	bool IsGpuSimulated() { return gpuSimulation; }
+
+	// Where particles are emitted from, and a box around everywhere
+	// they can get to in their lifetime
+	void SetPosition(DirectX::XMFLOAT3 position) { this->position = position; }
+	DirectX::XMFLOAT3 GetPosition() { return position; }
+	DirectX::BoundingBox GetBounds();
+
+	// Culling and throttling, set each frame before it's simulated
+	//  - Invisible ones aren't drawn, uploaded or sorted
+	//  - Simulating only happens every updateInterval frames (or not at
+	//    all with 0), with the time in between saved up, and then any
+	//    particles that were due are emitted back when they would have
+	//    been, so it all catches up as if it never stopped
+	void SetVisible(bool visible) { this->visible = visible; }
+	bool IsVisible() { return visible; }
+	void SetUpdateInterval(int frames) { updateInterval = frames; }
+
+	// Alpha blended emitters are drawn back to front (by their
+	// particles' view depth, sorted on the GPU), which has to be
+	// redone every frame with SortByDepth() before they're drawn
+	//  - Only possible with the sorting compute shaders loaded
+	//  - Big ones are only sorted bit by bit, over a few frames, so
+	//    their order lags behind the camera (and each other) a little
+	void SetDepthSorted(bool sorted) { depthSorted = sorted && canSort; }
+	bool IsDepthSorted() { return depthSorted; }
+	void SortByDepth(Camera* camera, float currentTime);
+
+	// Drawn into the renderer's low resolution particle target, when
+	// it has one (see Renderer::SetParticleResolutionScale()), which
+	// is worth it for big, soft, screen filling effects
+	void SetLowResolution(bool lowResolution) { this->lowResolution = lowResolution; }
+	bool IsLowResolution() { return lowResolution; }
+
+	// Whether only new particles are uploaded each frame, rather than
+	// all of them (when the device allows it), and how many bytes the
+	// last Upload() wrote, for comparing the two
+	void SetAppendUploads(bool enabled);
+	bool GetAppendUploads() { return appendUploads; }
+	unsigned int GetLastUploadBytes() { return lastUploadBytes; }
+
+	// Whether ParticleBatcher can draw this one with others
+	bool IsBatchable() { return !gpuSimulation && !depthSorted; }
+
+	// For drawing emitters together (see ParticleBatcher)
+	//  - Copies the living particles, oldest first, returning how many
+	int CopyLivingParticles(Particle* destination);
+	int GetLivingCount() { return livingCount; }
+
+	// Puts back living particles (oldest first) and how long it's been
+	// since the last was emitted, as copied out by a frame capture (see
+	// FrameCapture), which are all uploaded again by the next Upload()
+	//  - The particles of GPU simulated emitters never leave the GPU,
+	//    so they can't be put back
+	void SetLivingParticles(const Particle* source, int count, float sinceLastEmit);
+	float GetTimeSinceLastEmit() { return dtSinceLastEmit; }
+	float GetLifetime() { return particleLifeSpan; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetTexture() { return texture; }
+	SimplePixelShader* GetPixelShader() { return ps; }
+
+	// Sets the shared index buffer with at least this many quads
+	static void ReserveQuadIndices(Microsoft::WRL::ComPtr<ID3D11Device> device, int quads);
+	static void SetQuadIndices(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, int quads);
 
 
 private:
@@ -48,12 +151,44 @@ private:
 
 	//System
 	float particleLifeSpan;
+	DirectX::XMFLOAT3 position;
+
+	bool lowResolution;
+
+	// Culling and throttling
+	bool visible;
+	int updateInterval;
+	int framesSinceUpdate;
+	float pendingTime;
+	bool updatedThisFrame;
 
 	//GPU
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> particleDataBuffer;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleDataSRV;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+
+	// New particles are written past the last frame's with NO_OVERWRITE
+	// (so nothing the GPU might still be reading is touched), and once
+	// the end's reached it's discarded and the living ones start it over
+	//  - Everything's rewritten each frame if the device can't map a
+	//    buffer with a shader resource view that way (or it's turned off)
+	bool canAppendUploads;
+	bool appendUploads;
+	unsigned int lastUploadBytes;
+	int ringCapacity;
+	int ringHead;			// Where the next new particle goes
+	int emittedSinceUpload;
+
+	// Every emitter draws its quads with the same indices, so they share
+	// one buffer, grown to fit the biggest of them
+	//  - 16 bit for every emitter whose corners fit, and a 32 bit one
+	//    only made if there's an emitter too big for that
+	//  - Released along with the last emitter
+	static Microsoft::WRL::ComPtr<ID3D11Buffer> quadIndexBuffer16;
+	static Microsoft::WRL::ComPtr<ID3D11Buffer> quadIndexBuffer32;
+	static int quadCapacity16;
+	static int quadCapacity32;
+	static int emitterCount;
 	
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture;
 	SimpleVertexShader* vs;
@@ -61,7 +196,42 @@ private:
 
 	//Methods
 	void UpdateParticle(float currentTime, int index);
-	void EmitParticle(float currentTime);
+	void EmitParticle(float emitTime);
+
+	// GPU simulation: particles stay in a pool on the GPU, with slots
+	// handed out from a dead list and the living ones listed (ping-
+	// ponging between two lists each frame) for an indirect draw
+	//  - The CPU only works out how many to emit each frame
+	bool gpuSimulation;
+	int currentAliveList;
+	int pendingEmitCount;
+	float pendingEmitTime;		// Of the first one, with the rest a particle's worth apart
+	float pendingSimulateTime;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> gpuParticleBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> gpuParticleSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> gpuParticleUAV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> deadListBuffer;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> deadListUAV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> aliveListBuffers[2];
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> aliveListSRVs[2];
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> aliveListUAVs[2];
+	Microsoft::WRL::ComPtr<ID3D11Buffer> listCountsBuffer;	// Dead and alive counts, for the compute shaders
+	Microsoft::WRL::ComPtr<ID3D11Buffer> drawArgsBuffer;	// DrawInstancedIndirect arguments
+	void CreateGpuBuffers(Microsoft::WRL::ComPtr<ID3D11Device> device);
+	void SimulateOnGpu();
+
+	// Depth sorting: a key for each slot of the pool (or upload ring),
+	// padded to a power of two, always in the order the last sort left
+	// them, so it can pick up where it left off the frame before
+	bool canSort;
+	bool depthSorted;
+	int sortSize;
+	int sortBlockSize;		// Where the bitonic sort is up to
+	int sortCompareOffset;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> sortKeyBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sortKeySRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> sortKeyUAV;
+	void CreateSortBuffers(Microsoft::WRL::ComPtr<ID3D11Device> device, int poolSize);
 
 
 };
@@ -0,0 +1,204 @@
+#include "EntityLightLists.h"
+#include "GpuMemory.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+// Entities per job, since each one is only a few vector ops per light
+#define ENTITY_LIGHTS_BATCH_SIZE	64
+
+EntityLightLists::EntityLightLists(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+	maxLights = ENTITY_LIGHTS_DEFAULT;
+	stats = {};
+	listCapacity = 0;
+	EnsureCapacity(1024);
+}
+
+// --------------------------------------------------------
+// Splits this frame's lights into directional ones (which
+// every list gets) and the rest, four to a vector
+// --------------------------------------------------------
+void EntityLightLists::GatherLights(const std::vector<Light>& lights, int lightCount)
+{
+	lightX.clear();
+	lightY.clear();
+	lightZ.clear();
+	lightRange.clear();
+	lightBrightness.clear();
+	lightIndices.clear();
+	directionalLights.clear();
+
+	for (int i = 0; i < lightCount && i < (int)lights.size(); i++)
+	{
+		const Light& light = lights[i];
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			directionalLights.push_back(i);
+			continue;
+		}
+
+		lightX.push_back(light.Position.x);
+		lightY.push_back(light.Position.y);
+		lightZ.push_back(light.Position.z);
+		lightRange.push_back(light.Range);
+		lightBrightness.push_back(light.Intensity * (light.Color.x * 0.2126f + light.Color.y * 0.7152f + light.Color.z * 0.0722f));
+		lightIndices.push_back(i);
+	}
+
+	// Padding lights are infinitely far away
+	while (lightX.size() % 4 != 0)
+	{
+		lightX.push_back(FLT_MAX);
+		lightY.push_back(FLT_MAX);
+		lightZ.push_back(FLT_MAX);
+		lightRange.push_back(0.0f);
+		lightBrightness.push_back(0.0f);
+		lightIndices.push_back(0);
+	}
+}
+
+// --------------------------------------------------------
+// Tests every entity against every local light, in parallel,
+// then packs the lists together and uploads them
+// --------------------------------------------------------
+void EntityLightLists::Build(Microsoft::WRL::ComPtr<ID3D11DeviceContext> uploadContext, const std::vector<BoundingSphere>& bounds,
+	const std::vector<Light>& lights, int lightCount)
+{
+	GatherLights(lights, lightCount);
+
+	stats = {};
+	stats.Entities = (unsigned int)bounds.size();
+
+	// Each entity gets a block big enough for a full list while building
+	//  - The lights that don't fit are counted in the block's last slot
+	unsigned int cap = maxLights;
+	unsigned int stride = cap + 2;
+	scratch.resize(bounds.size() * stride);
+	unsigned int groups = (unsigned int)lightX.size() / 4;
+
+	JobSystem::GetInstance().ParallelFor((unsigned int)bounds.size(), ENTITY_LIGHTS_BATCH_SIZE, [&](unsigned int start, unsigned int end)
+	{
+		// (importance, light) for whatever reaches the entity, from
+		// the frame arena of whichever worker runs this batch
+		FrameVector<std::pair<float, unsigned int>> reaching;
+		reaching.reserve(lightIndices.size());
+
+		for (unsigned int e = start; e < end; e++)
+		{
+			unsigned int* list = &scratch[e * stride];
+			unsigned int count = 0;
+			for (unsigned int d = 0; d < directionalLights.size() && count < cap; d++)
+				list[1 + count++] = directionalLights[d];
+
+			// Spheres overlap when the centers are closer than the radii
+			// added together, compared squared to skip the square root
+			XMVECTOR centerX = XMVectorReplicate(bounds[e].Center.x);
+			XMVECTOR centerY = XMVectorReplicate(bounds[e].Center.y);
+			XMVECTOR centerZ = XMVectorReplicate(bounds[e].Center.z);
+			XMVECTOR radius = XMVectorReplicate(bounds[e].Radius);
+
+			reaching.clear();
+			for (unsigned int g = 0; g < groups; g++)
+			{
+				XMVECTOR dx = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightX[g * 4]), centerX);
+				XMVECTOR dy = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightY[g * 4]), centerY);
+				XMVECTOR dz = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightZ[g * 4]), centerZ);
+				XMVECTOR distSq = XMVectorMultiplyAdd(dx, dx, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dz, dz)));
+				XMVECTOR reach = XMVectorAdd(XMLoadFloat4((const XMFLOAT4*)&lightRange[g * 4]), radius);
+				XMVECTOR overlap = XMVectorLessOrEqual(distSq, XMVectorMultiply(reach, reach));
+				if (XMVector4EqualInt(overlap, XMVectorFalseInt()))
+					continue;
+
+				XMUINT4 mask;
+				XMFLOAT4 distances;
+				XMStoreUInt4(&mask, overlap);
+				XMStoreFloat4(&distances, XMVectorSqrt(distSq));
+				const unsigned int* hits = &mask.x;
+				const float* dist = &distances.x;
+				for (unsigned int l = 0; l < 4; l++)
+				{
+					if (!hits[l])
+						continue;
+
+					// The same falloff as Attenuate() in the shaders, at
+					// the nearest point of the sphere to the light
+					unsigned int light = g * 4 + l;
+					float nearest = max(dist[l] - bounds[e].Radius, 0.0f) / max(lightRange[light], 0.0001f);
+					float att = max(1.0f - nearest * nearest, 0.0f);
+					reaching.push_back({ lightBrightness[light] * att * att, light });
+				}
+			}
+
+			// Only the brightest, when there are too many
+			unsigned int room = cap - count;
+			unsigned int kept = min(room, (unsigned int)reaching.size());
+			if (reaching.size() > room)
+			{
+				std::partial_sort(reaching.begin(), reaching.begin() + kept, reaching.end(),
+					[](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) { return a.first > b.first; });
+			}
+			for (unsigned int r = 0; r < kept; r++)
+				list[1 + count++] = lightIndices[reaching[r].second];
+
+			list[0] = count;
+			list[stride - 1] = (unsigned int)reaching.size() - kept;
+		}
+	});
+
+	// Pack them end to end
+	listStarts.resize(bounds.size());
+	packed.clear();
+	for (size_t e = 0; e < bounds.size(); e++)
+	{
+		const unsigned int* list = &scratch[e * stride];
+		listStarts[e] = (unsigned int)packed.size();
+		packed.insert(packed.end(), list, list + 1 + list[0]);
+		stats.LightsListed += list[0];
+		stats.LightsDropped += list[stride - 1];
+	}
+	stats.Indices = (unsigned int)packed.size();
+	if (packed.empty())
+		return;
+
+	EnsureCapacity((unsigned int)packed.size());
+	D3D11_BOX box = {};
+	box.right = (unsigned int)(sizeof(unsigned int) * packed.size());
+	box.bottom = 1;
+	box.back = 1;
+	uploadContext->UpdateSubresource(listBuffer.Get(), 0, &box, packed.data(), 0, 0);
+}
+
+// --------------------------------------------------------
+// Grows the buffer (to double what's needed) when the
+// lists don't fit
+// --------------------------------------------------------
+void EntityLightLists::EnsureCapacity(unsigned int indices)
+{
+	if (indices <= listCapacity)
+		return;
+
+	listCapacity = max(indices * 2, listCapacity);
+	listBuffer.Reset();
+	listSRV.Reset();
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.ByteWidth = sizeof(unsigned int) * listCapacity;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(unsigned int);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, listBuffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Entity Light Lists");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = listCapacity;
+	device->CreateShaderResourceView(listBuffer.Get(), &srvDesc, listSRV.GetAddressOf());
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+#include "Lights.h"
+
+// Most lights any one entity's list can hold, and how many it holds by default
+#define ENTITY_LIGHTS_MAX			32
+#define ENTITY_LIGHTS_DEFAULT		8
+
+// An entity with no list, which is lit by every light (or its clusters)
+//  - Must match ENTITY_LIGHT_LIST_NONE in PerFrameData.hlsli
+#define ENTITY_LIGHT_LIST_NONE		0xFFFFFFFF
+
+struct EntityLightListStats
+{
+	unsigned int Entities;
+	unsigned int LightsListed;		// Across every list
+	unsigned int LightsDropped;		// That reached an entity, but didn't make its cap
+	unsigned int Indices;			// Uploaded this frame, counts included
+};
+
+// --------------------------------------------------------
+// A short list of the lights that reach each entity, for
+// forward shading without the light clusters
+//  - Each entity's bounding sphere is tested against every
+//    point and spot light's range, four lights at a time,
+//    with the entities split across the job system
+//  - Directional lights reach everything, and go first
+//  - Past the cap, the lights that are brightest at the
+//    entity (by intensity and attenuation) are kept
+//  - Each list is its count followed by light indices, all
+//    packed into one buffer, which the pixel shaders find
+//    through their entity's per object data
+// --------------------------------------------------------
+class EntityLightLists
+{
+public:
+	EntityLightLists(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Makes a list for each sphere, then uploads them on the given
+	// context (which could be a deferred one)
+	void Build(Microsoft::WRL::ComPtr<ID3D11DeviceContext> uploadContext, const std::vector<DirectX::BoundingSphere>& bounds,
+		const std::vector<Light>& lights, int lightCount);
+
+	// Where the list for one of the spheres given to Build() starts
+	unsigned int GetList(unsigned int index) { return listStarts[index]; }
+
+	unsigned int GetMaxLights() { return maxLights; }
+	void SetMaxLights(unsigned int lights) { maxLights = max(1u, min(lights, (unsigned int)ENTITY_LIGHTS_MAX)); }
+	const EntityLightListStats& GetStats() { return stats; }
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV() { return listSRV; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	unsigned int maxLights;
+	EntityLightListStats stats;
+
+	// Local lights as structures of arrays, padded to a multiple
+	// of four with lights that can't reach anything
+	std::vector<float> lightX;
+	std::vector<float> lightY;
+	std::vector<float> lightZ;
+	std::vector<float> lightRange;
+	std::vector<float> lightBrightness;
+	std::vector<unsigned int> lightIndices;
+	std::vector<unsigned int> directionalLights;
+	void GatherLights(const std::vector<Light>& lights, int lightCount);
+
+	// Every list at its full size while building, then packed together
+	std::vector<unsigned int> scratch;
+	std::vector<unsigned int> listStarts;
+	std::vector<unsigned int> packed;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> listBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> listSRV;
+	unsigned int listCapacity;
+	void EnsureCapacity(unsigned int indices);
+};
@@ -0,0 +1,146 @@
+#include "EntityRegistry.h"
+#include "SpatialSort.h"
+
+
+// --------------------------------------------------------
+// Gives a freshly created entity its handle and adds it
+// to the end of the scene
+// --------------------------------------------------------
+template<typename T>
+T* EntityRegistry::Register(T* entity, EntityType type, unsigned int index, unsigned short generation)
+{
+	entity->handle.Type = type;
+	entity->handle.Generation = generation;
+	entity->handle.Index = index;
+	AddToScene(entity);
+	return entity;
+}
+
+GameEntity* EntityRegistry::CreateEntity(Mesh* mesh, Material* material)
+{
+	unsigned int index;
+	unsigned short generation;
+	GameEntity* entity = entityPool.Create(index, generation, mesh, material);
+	return Register(entity, EntityType::Entity, index, generation);
+}
+
+Player* EntityRegistry::CreatePlayer(Mesh* mesh, Material* material, Camera* camera, bool local)
+{
+	unsigned int index;
+	unsigned short generation;
+	Player* player = playerPool.Create(index, generation, mesh, material, camera, local);
+	return Register(player, EntityType::Player, index, generation);
+}
+
+void EntityRegistry::Reserve(unsigned int count)
+{
+	entityPool.Reserve(count);
+	entities.reserve(count);
+	meshes.reserve(count);
+	materials.reserve(count);
+	transforms.reserve(count);
+}
+
+void EntityRegistry::Destroy(GameEntity* entity)
+{
+	if (!entity)
+		return;
+
+	RemoveFromScene(entity);
+
+	EntityHandle handle = entity->handle;
+	switch (handle.Type)
+	{
+	case EntityType::Entity: entityPool.Destroy(handle.Index); break;
+	case EntityType::Player: playerPool.Destroy(handle.Index); break;
+	}
+}
+
+void EntityRegistry::SetMesh(GameEntity* entity, Mesh* mesh)
+{
+	entity->mesh = mesh;
+	if (entity->sceneIndex >= 0)
+		meshes[entity->sceneIndex] = mesh;
+}
+
+GameEntity* EntityRegistry::Get(EntityHandle handle)
+{
+	switch (handle.Type)
+	{
+	case EntityType::Entity: return entityPool.Get(handle.Index, handle.Generation);
+	case EntityType::Player: return playerPool.Get(handle.Index, handle.Generation);
+	}
+	return 0;
+}
+
+void EntityRegistry::AddToScene(GameEntity* entity)
+{
+	if (!entity || entity->sceneIndex >= 0)
+		return;
+
+	entity->sceneIndex = (int)entities.size();
+	entities.push_back(entity);
+	meshes.push_back(entity->GetMesh());
+	materials.push_back(entity->GetMaterial());
+	transforms.push_back(entity->GetTransform());
+}
+
+// --------------------------------------------------------
+// Erases an entity from every scene array, shifting the
+// rest down so nothing changes order
+// --------------------------------------------------------
+void EntityRegistry::RemoveFromScene(GameEntity* entity)
+{
+	if (!entity || entity->sceneIndex < 0)
+		return;
+
+	unsigned int index = (unsigned int)entity->sceneIndex;
+	entities.erase(entities.begin() + index);
+	meshes.erase(meshes.begin() + index);
+	materials.erase(materials.begin() + index);
+	transforms.erase(transforms.begin() + index);
+	entity->sceneIndex = -1;
+
+	for (size_t i = index; i < entities.size(); i++)
+		entities[i]->sceneIndex = (int)i;
+}
+
+// Moves each of a scene array's values to its new place
+template<typename T>
+static void Reorder(std::vector<T>& values, const std::vector<unsigned int>& order)
+{
+	std::vector<T> sorted(values.size());
+	for (size_t i = 0; i < order.size(); i++)
+		sorted[i] = values[order[i]];
+	values.swap(sorted);
+}
+
+bool EntityRegistry::SortSpatially(std::vector<unsigned int>& order)
+{
+	std::vector<DirectX::XMFLOAT3> positions(transforms.size());
+	for (size_t i = 0; i < transforms.size(); i++)
+	{
+		DirectX::XMFLOAT4X4 world = transforms[i]->GetWorldMatrix();
+		positions[i] = DirectX::XMFLOAT3(world._41, world._42, world._43);
+	}
+
+	SpatialSort::SortByMortonCode(positions, order);
+	bool moved = false;
+	for (size_t i = 0; i < order.size() && !moved; i++)
+		moved = order[i] != i;
+	if (!moved)
+	{
+		order.clear();
+		return false;
+	}
+
+	Reorder(entities, order);
+	Reorder(meshes, order);
+	Reorder(materials, order);
+	Reorder(transforms, order);
+	for (size_t i = 0; i < entities.size(); i++)
+		entities[i]->sceneIndex = (int)i;
+
+	sortCount++;
+	return true;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "GameEntity.h"
+#include "Player.h"
+
+// Objects per pool chunk - chunks never move, so neither do entities
+#define ENTITY_POOL_CHUNK_SIZE 256
+
+// Frames between the game putting the scene back in spatial order,
+// since entities move around and new ones go on the end
+#define ENTITY_SPATIAL_SORT_FRAMES 300
+
+// Fixed size chunks of objects constructed in place, with freed
+// slots reused before the pool grows
+template<typename T>
+class EntityPool
+{
+public:
+	EntityPool() {}
+	EntityPool(EntityPool const&) = delete;
+	void operator=(EntityPool const&) = delete;
+
+	~EntityPool()
+	{
+		for (unsigned int i = 0; i < slotCount; i++)
+		{
+			if (GetSlot(i).Alive)
+				Destroy(i);
+		}
+		for (auto& c : chunks)
+			delete[] c;
+	}
+
+	template<typename... Args>
+	T* Create(unsigned int& index, unsigned short& generation, Args&&... args)
+	{
+		if (!freeSlots.empty())
+		{
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			if (slotCount == chunks.size() * ENTITY_POOL_CHUNK_SIZE)
+				chunks.push_back(new Slot[ENTITY_POOL_CHUNK_SIZE]);
+			index = slotCount++;
+		}
+
+		Slot& slot = GetSlot(index);
+		slot.Alive = true;
+		generation = slot.Generation;
+		return new (slot.Storage) T(std::forward<Args>(args)...);
+	}
+
+	// Makes chunks for at least this many objects ahead of time
+	void Reserve(unsigned int count)
+	{
+		while (chunks.size() * ENTITY_POOL_CHUNK_SIZE < count)
+			chunks.push_back(new Slot[ENTITY_POOL_CHUNK_SIZE]);
+	}
+
+	void Destroy(unsigned int index)
+	{
+		Slot& slot = GetSlot(index);
+		if (!slot.Alive)
+			return;
+
+		reinterpret_cast<T*>(slot.Storage)->~T();
+		slot.Alive = false;
+		slot.Generation++;
+		freeSlots.push_back(index);
+	}
+
+	T* Get(unsigned int index, unsigned short generation)
+	{
+		if (index >= slotCount)
+			return 0;
+
+		Slot& slot = GetSlot(index);
+		return slot.Alive && slot.Generation == generation ? reinterpret_cast<T*>(slot.Storage) : 0;
+	}
+
+private:
+	struct Slot
+	{
+		alignas(T) unsigned char Storage[sizeof(T)];
+		unsigned short Generation = 0;
+		bool Alive = false;
+	};
+
+	std::vector<Slot*> chunks;
+	std::vector<unsigned int> freeSlots;
+	unsigned int slotCount = 0;
+
+	Slot& GetSlot(unsigned int index) { return chunks[index / ENTITY_POOL_CHUNK_SIZE][index % ENTITY_POOL_CHUNK_SIZE]; }
+};
+
+// Owns every entity, in pools per type, and keeps the ones in the
+// scene in dense arrays (entity, mesh, material, transform) so loops
+// over the scene can read just the parts they need
+//  - Scene order is creation order until it's sorted spatially, and
+//    removing keeps the order
+class EntityRegistry
+{
+public:
+	GameEntity* CreateEntity(Mesh* mesh, Material* material);
+	Player* CreatePlayer(Mesh* mesh, Material* material, Camera* camera, bool local = true);
+
+	// Room for this many plain entities in the pool and the scene,
+	// so making that many (like a whole level) never grows either
+	void Reserve(unsigned int count);
+
+	// Removes it from the scene and frees its slot
+	void Destroy(GameEntity* entity);
+
+	// Takes an entity out of the scene (or puts it back) without
+	// destroying it - new entities start in the scene
+	void AddToScene(GameEntity* entity);
+	void RemoveFromScene(GameEntity* entity);
+
+	EntityHandle GetHandle(GameEntity* entity) { return entity->handle; }
+
+	// Swaps an entity's mesh, in the scene arrays too
+	void SetMesh(GameEntity* entity, Mesh* mesh);
+
+	// Reorders the scene arrays along a Morton curve through each entity's
+	// world position, so loops over them visit nearby entities together
+	//  - The entities themselves stay where they are (so do their handles),
+	//    it's only their scene indices that change
+	//  - order gets each entity's old scene index, in its new place, for
+	//    anything keeping its own data per scene index to follow along
+	//  - Returns false (leaving the scene as it was) if it was already sorted
+	bool SortSpatially(std::vector<unsigned int>& order);
+	unsigned int GetSortCount() { return sortCount; }
+
+	// Where it is in the scene arrays, or -1 if it isn't in the scene
+	int GetSceneIndex(GameEntity* entity) { return entity->sceneIndex; }
+	GameEntity* Get(EntityHandle handle);
+
+	// The scene, as parallel arrays
+	unsigned int GetCount() { return (unsigned int)entities.size(); }
+	GameEntity* GetEntity(unsigned int index) { return entities[index]; }
+	const std::vector<GameEntity*>& GetEntities() { return entities; }
+	const std::vector<Mesh*>& GetMeshes() { return meshes; }
+	const std::vector<Material*>& GetMaterials() { return materials; }
+	const std::vector<Transform*>& GetTransforms() { return transforms; }
+
+private:
+	EntityPool<GameEntity> entityPool;
+	EntityPool<Player> playerPool;
+
+	std::vector<GameEntity*> entities;
+	std::vector<Mesh*> meshes;
+	std::vector<Material*> materials;
+	std::vector<Transform*> transforms;
+	unsigned int sortCount = 0;
+
+	template<typename T>
+	T* Register(T* entity, EntityType type, unsigned int index, unsigned short generation);
+};
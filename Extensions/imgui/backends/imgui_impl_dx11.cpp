@@ -59,6 +59,8 @@ struct ImGui_ImplDX11_Data
     ID3D11DepthStencilState*    pDepthStencilState;
     int                         VertexBufferSize;
     int                         IndexBufferSize;
+    ImVector<ImDrawVert>        UploadedVtx;    // What's in pVB and pIB, so they're only uploaded again when it changes
+    ImVector<ImDrawIdx>         UploadedIdx;
 
     ImGui_ImplDX11_Data()       { memset(this, 0, sizeof(*this)); VertexBufferSize = 5000; IndexBufferSize = 10000; }
 };
@@ -124,8 +126,10 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
     ID3D11DeviceContext* ctx = bd->pd3dDeviceContext;
 
     // Create and grow vertex/index buffers if needed
+    bool recreated = false;
     if (!bd->pVB || bd->VertexBufferSize < draw_data->TotalVtxCount)
     {
+        recreated = true;
         if (bd->pVB) { bd->pVB->Release(); bd->pVB = NULL; }
         bd->VertexBufferSize = draw_data->TotalVtxCount + 5000;
         D3D11_BUFFER_DESC desc;
@@ -140,6 +144,7 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
     }
     if (!bd->pIB || bd->IndexBufferSize < draw_data->TotalIdxCount)
     {
+        recreated = true;
         if (bd->pIB) { bd->pIB->Release(); bd->pIB = NULL; }
         bd->IndexBufferSize = draw_data->TotalIdxCount + 10000;
         D3D11_BUFFER_DESC desc;
@@ -152,24 +157,45 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
             return;
     }
 
-    // Upload vertex/index data into a single contiguous GPU buffer
-    D3D11_MAPPED_SUBRESOURCE vtx_resource, idx_resource;
-    if (ctx->Map(bd->pVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &vtx_resource) != S_OK)
-        return;
-    if (ctx->Map(bd->pIB, 0, D3D11_MAP_WRITE_DISCARD, 0, &idx_resource) != S_OK)
-        return;
-    ImDrawVert* vtx_dst = (ImDrawVert*)vtx_resource.pData;
-    ImDrawIdx* idx_dst = (ImDrawIdx*)idx_resource.pData;
-    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    // Upload vertex/index data into a single contiguous GPU buffer, if it's
+    // any different to what was uploaded last (which is kept to compare with)
+    bool changed = recreated || bd->UploadedVtx.Size != draw_data->TotalVtxCount || bd->UploadedIdx.Size != draw_data->TotalIdxCount;
+    for (int n = 0, vtx_offset = 0, idx_offset = 0; n < draw_data->CmdListsCount && !changed; n++)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        memcpy(vtx_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-        memcpy(idx_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-        vtx_dst += cmd_list->VtxBuffer.Size;
-        idx_dst += cmd_list->IdxBuffer.Size;
+        changed = memcmp(bd->UploadedVtx.Data + vtx_offset, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert)) != 0 ||
+            memcmp(bd->UploadedIdx.Data + idx_offset, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx)) != 0;
+        vtx_offset += cmd_list->VtxBuffer.Size;
+        idx_offset += cmd_list->IdxBuffer.Size;
+    }
+    if (changed)
+    {
+        bd->UploadedVtx.resize(draw_data->TotalVtxCount);
+        bd->UploadedIdx.resize(draw_data->TotalIdxCount);
+        ImDrawVert* vtx_dst = bd->UploadedVtx.Data;
+        ImDrawIdx* idx_dst = bd->UploadedIdx.Data;
+        for (int n = 0; n < draw_data->CmdListsCount; n++)
+        {
+            const ImDrawList* cmd_list = draw_data->CmdLists[n];
+            memcpy(vtx_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+            memcpy(idx_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+            vtx_dst += cmd_list->VtxBuffer.Size;
+            idx_dst += cmd_list->IdxBuffer.Size;
+        }
+
+        D3D11_MAPPED_SUBRESOURCE vtx_resource, idx_resource;
+        if (ctx->Map(bd->pVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &vtx_resource) != S_OK)
+            return;
+        if (ctx->Map(bd->pIB, 0, D3D11_MAP_WRITE_DISCARD, 0, &idx_resource) != S_OK)
+        {
+            ctx->Unmap(bd->pVB, 0);
+            return;
+        }
+        memcpy(vtx_resource.pData, bd->UploadedVtx.Data, bd->UploadedVtx.Size * sizeof(ImDrawVert));
+        memcpy(idx_resource.pData, bd->UploadedIdx.Data, bd->UploadedIdx.Size * sizeof(ImDrawIdx));
+        ctx->Unmap(bd->pVB, 0);
+        ctx->Unmap(bd->pIB, 0);
     }
-    ctx->Unmap(bd->pVB, 0);
-    ctx->Unmap(bd->pIB, 0);
 
     // Setup orthographic projection matrix into our constant buffer
     // Our visible imgui space lies from draw_data->DisplayPos (top left) to draw_data->DisplayPos+data_data->DisplaySize (bottom right). DisplayPos is (0,0) for single viewport apps.
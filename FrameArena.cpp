@@ -0,0 +1,138 @@
+#include "FrameArena.h"
+
+#include <atomic>
+#include <new>
+
+// Only EndFrame() moves it on, and each thread compares theirs to it
+static std::atomic<unsigned long long> currentFrame(0);
+
+// Every thread's, added as they go and kept by EndFrame()
+static std::atomic<unsigned long long> frameAllocations(0);
+static std::atomic<unsigned long long> frameBytes(0);
+static std::atomic<unsigned long long> reservedBytes(0);
+static std::atomic<unsigned int> arenaThreads(0);
+static FrameArenaStats lastFrame = {};
+
+struct FrameArenaBlock
+{
+	unsigned char* Memory;
+	size_t Size;
+};
+
+// One frame's worth, which keeps its blocks when it's reset
+struct FrameArenaBuffer
+{
+	std::vector<FrameArenaBlock> Blocks;
+	size_t Block = 0;	// The one being allocated from
+	size_t Used = 0;	// Of that block
+};
+
+struct ThreadArena
+{
+	FrameArenaBuffer Buffers[2];
+	FrameArenaBuffer* Current = &Buffers[0];
+	unsigned long long Frame = 0;
+	unsigned char* Last = nullptr;	// The last allocation, which Free() can take back
+
+	ThreadArena() { arenaThreads++; }
+	~ThreadArena()
+	{
+		for (FrameArenaBuffer& buffer : Buffers)
+		{
+			for (FrameArenaBlock& block : buffer.Blocks)
+			{
+				reservedBytes -= block.Size;
+				::operator delete(block.Memory);
+			}
+		}
+		arenaThreads--;
+	}
+};
+
+static thread_local ThreadArena arena;
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	// The first allocation this frame reuses the buffer from two
+	// frames ago (or longer, if this thread's been idle)
+	unsigned long long frame = currentFrame.load(std::memory_order_relaxed);
+	if (frame != arena.Frame)
+	{
+		arena.Frame = frame;
+		arena.Current = &arena.Buffers[frame & 1];
+		arena.Current->Block = 0;
+		arena.Current->Used = 0;
+		arena.Last = nullptr;
+	}
+
+	frameAllocations.fetch_add(1, std::memory_order_relaxed);
+	frameBytes.fetch_add(size, std::memory_order_relaxed);
+
+	// Move on through this buffer's blocks until one has room
+	FrameArenaBuffer& buffer = *arena.Current;
+	size = size > 0 ? size : 1;
+	while (true)
+	{
+		if (buffer.Block < buffer.Blocks.size())
+		{
+			FrameArenaBlock& block = buffer.Blocks[buffer.Block];
+			size_t address = (size_t)block.Memory + buffer.Used;
+			size_t start = ((address + alignment - 1) & ~(alignment - 1)) - (size_t)block.Memory;
+			if (start + size <= block.Size)
+			{
+				buffer.Used = start + size;
+				arena.Last = block.Memory + start;
+				return arena.Last;
+			}
+
+			// A block that's too small for this is swapped for one that's big enough
+			if (buffer.Used == 0)
+			{
+				reservedBytes -= block.Size;
+				::operator delete(block.Memory);
+				buffer.Blocks.erase(buffer.Blocks.begin() + buffer.Block);
+				continue;
+			}
+
+			buffer.Block++;
+			buffer.Used = 0;
+			continue;
+		}
+
+		// Room for the alignment too, for one that's only this allocation
+		size_t blockSize = size > FRAME_ARENA_BLOCK_SIZE ? size + alignment : FRAME_ARENA_BLOCK_SIZE;
+		buffer.Blocks.insert(buffer.Blocks.begin() + buffer.Block, { (unsigned char*)::operator new(blockSize), blockSize });
+		buffer.Used = 0;
+		reservedBytes += blockSize;
+	}
+}
+
+void FrameArena::Free(void* memory, size_t)
+{
+	// Only the top of this thread's current block can be reused
+	if (memory == nullptr || memory != arena.Last)
+		return;
+
+	FrameArenaBuffer& buffer = *arena.Current;
+	buffer.Used = arena.Last - buffer.Blocks[buffer.Block].Memory;
+	arena.Last = nullptr;
+}
+
+void FrameArena::EndFrame()
+{
+	lastFrame.Allocations = frameAllocations.exchange(0, std::memory_order_relaxed);
+	lastFrame.Bytes = frameBytes.exchange(0, std::memory_order_relaxed);
+	lastFrame.Reserved = reservedBytes.load();
+	lastFrame.Threads = arenaThreads.load();
+	currentFrame++;
+}
+
+unsigned long long FrameArena::GetFrame()
+{
+	return currentFrame.load(std::memory_order_relaxed);
+}
+
+FrameArenaStats FrameArena::GetLastFrame()
+{
+	return lastFrame;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Each thread's arena grows a block at a time (anything bigger gets a
+// block of its own), and keeps its blocks to reuse every other frame
+#define FRAME_ARENA_BLOCK_SIZE		(256 * 1024)
+
+// What the arenas handed out in the last full frame, across every thread
+struct FrameArenaStats
+{
+	unsigned long long Allocations;
+	unsigned long long Bytes;
+	unsigned long long Reserved;	// In every thread's blocks, used or not
+	unsigned int Threads;			// That have an arena
+};
+
+// --------------------------------------------------------
+// Memory for data that only lasts the frame it's made in
+// (culling results, light lists and the like), handed out
+// by moving a pointer along instead of from the heap
+//  - Every thread has its own, so nothing's synchronized,
+//    and EndFrame() just moves the frame number on - each
+//    thread resets its own once it next allocates
+//  - Double buffered, so what's made in one frame is still
+//    good through the next (like a frame in flight), and
+//    is only reused in the frame after that
+//  - Freeing only gives memory back if it's the last thing
+//    allocated (like a scratch vector that's done with
+//    before anything else is made), and a growing vector
+//    leaves its old copies behind, so reserve() first
+//    wherever the size is known
+// --------------------------------------------------------
+class FrameArena
+{
+public:
+	static void* Allocate(size_t size, size_t alignment);
+	static void Free(void* memory, size_t size);
+
+	// Marks the end of a frame (on the main thread, once a frame)
+	static void EndFrame();
+	static unsigned long long GetFrame();
+
+	static FrameArenaStats GetLastFrame();
+};
+
+// For any standard container's allocations to come from the frame arena
+//  - None of it may be kept past the next frame
+template<typename T>
+struct FrameAllocator
+{
+	typedef T value_type;
+
+	FrameAllocator() {}
+	template<typename U> FrameAllocator(const FrameAllocator<U>&) {}
+
+	T* allocate(size_t count) { return (T*)FrameArena::Allocate(sizeof(T) * count, alignof(T)); }
+	void deallocate(T* memory, size_t count) { FrameArena::Free(memory, sizeof(T) * count); }
+
+	template<typename U> bool operator==(const FrameAllocator<U>&) const { return true; }
+	template<typename U> bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
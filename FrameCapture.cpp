@@ -0,0 +1,325 @@
+#include "FrameCapture.h"
+#include "AssetLoader.h"
+#include "FrameTimeRecorder.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <unordered_map>
+
+using namespace DirectX;
+
+void FrameCapture::Capture(EntityRegistry& entities, const std::vector<Material*>& materials, const std::vector<Light>& lights, int lightCount,
+	const std::vector<Emitter*>& emitters, Camera* camera, float totalTime, int skyIndex, unsigned int width, unsigned int height)
+{
+	Header = {};
+	Header.Magic = FRAME_CAPTURE_MAGIC;
+	Header.Version = FRAME_CAPTURE_VERSION;
+	Header.Width = width;
+	Header.Height = height;
+	Header.TotalTime = totalTime;
+	Header.SkyIndex = skyIndex;
+	Header.CameraPosition = camera->GetTransform()->GetPosition();
+	Header.CameraPitchYawRoll = camera->GetTransform()->GetPitchYawRoll();
+	Header.ActiveLightCount = lightCount;
+
+	// Each mesh's name only once
+	Assets& assets = Assets::GetInstance();
+	std::unordered_map<Mesh*, unsigned int> meshIndices;
+	MeshNames.clear();
+	Entities.clear();
+	for (GameEntity* entity : entities.GetEntities())
+	{
+		Mesh* mesh = entity->GetMesh();
+		auto found = meshIndices.find(mesh);
+		if (found == meshIndices.end())
+		{
+			found = meshIndices.insert({ mesh, (unsigned int)MeshNames.size() }).first;
+			MeshNames.push_back(assets.GetMeshName(mesh));
+		}
+
+		FrameCaptureEntity captured = {};
+		captured.Mesh = found->second;
+		auto material = std::find(materials.begin(), materials.end(), entity->GetMaterial());
+		captured.Material = material != materials.end() ? (int)(material - materials.begin()) : -1;
+		captured.World = entity->GetTransform()->GetWorldMatrix();
+		Entities.push_back(captured);
+	}
+
+	Lights = lights;
+
+	Emitters.clear();
+	for (Emitter* emitter : emitters)
+	{
+		FrameCaptureEmitter captured;
+		captured.Position = emitter->GetPosition();
+		captured.SinceLastEmit = emitter->GetTimeSinceLastEmit();
+		captured.Particles.resize(emitter->GetLivingCount());
+		captured.Particles.resize(emitter->CopyLivingParticles(captured.Particles.data()));
+		Emitters.push_back(std::move(captured));
+	}
+
+	Header.MeshCount = (unsigned int)MeshNames.size();
+	Header.EntityCount = (unsigned int)Entities.size();
+	Header.LightCount = (unsigned int)Lights.size();
+	Header.EmitterCount = (unsigned int)Emitters.size();
+}
+
+bool FrameCapture::Save(const std::string& path)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		printf("Couldn't write frame capture %s\n", path.c_str());
+		return false;
+	}
+
+	file.write((const char*)&Header, sizeof(Header));
+	for (const std::string& name : MeshNames)
+	{
+		unsigned int length = (unsigned int)name.size();
+		file.write((const char*)&length, sizeof(length));
+		file.write(name.data(), length);
+	}
+	file.write((const char*)Entities.data(), sizeof(FrameCaptureEntity) * Entities.size());
+	file.write((const char*)Lights.data(), sizeof(Light) * Lights.size());
+	for (const FrameCaptureEmitter& emitter : Emitters)
+	{
+		unsigned int particleCount = (unsigned int)emitter.Particles.size();
+		file.write((const char*)&emitter.Position, sizeof(emitter.Position));
+		file.write((const char*)&emitter.SinceLastEmit, sizeof(emitter.SinceLastEmit));
+		file.write((const char*)&particleCount, sizeof(particleCount));
+		file.write((const char*)emitter.Particles.data(), sizeof(Particle) * particleCount);
+	}
+
+	printf("Captured %u entities, %u lights and %u emitters to %s\n", Header.EntityCount, Header.LightCount, Header.EmitterCount, path.c_str());
+	return file.good();
+}
+
+// --------------------------------------------------------
+// Reads it all back, failing on anything that runs off the
+// end of the file (or that isn't a capture this version)
+// --------------------------------------------------------
+bool FrameCapture::Load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open() || !file.read((char*)&Header, sizeof(Header)) ||
+		Header.Magic != FRAME_CAPTURE_MAGIC || Header.Version != FRAME_CAPTURE_VERSION)
+	{
+		printf("Couldn't read frame capture %s\n", path.c_str());
+		return false;
+	}
+
+	MeshNames.resize(Header.MeshCount);
+	for (std::string& name : MeshNames)
+	{
+		unsigned int length = 0;
+		file.read((char*)&length, sizeof(length));
+		name.resize(file ? length : 0);
+		file.read(&name[0], name.size());
+	}
+
+	Entities.resize(file ? Header.EntityCount : 0);
+	file.read((char*)Entities.data(), sizeof(FrameCaptureEntity) * Entities.size());
+	Lights.resize(file ? Header.LightCount : 0);
+	file.read((char*)Lights.data(), sizeof(Light) * Lights.size());
+
+	Emitters.resize(file ? Header.EmitterCount : 0);
+	for (FrameCaptureEmitter& emitter : Emitters)
+	{
+		unsigned int particleCount = 0;
+		file.read((char*)&emitter.Position, sizeof(emitter.Position));
+		file.read((char*)&emitter.SinceLastEmit, sizeof(emitter.SinceLastEmit));
+		file.read((char*)&particleCount, sizeof(particleCount));
+		emitter.Particles.resize(file ? particleCount : 0);
+		file.read((char*)emitter.Particles.data(), sizeof(Particle) * emitter.Particles.size());
+	}
+
+	if (!file)
+	{
+		printf("Frame capture %s is cut short\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+FrameReplay::FrameReplay()
+{
+	running = false;
+	capture = {};
+	savedLightCount = 0;
+	savedCameraPosition = XMFLOAT3(0, 0, 0);
+	savedCameraPitchYawRoll = XMFLOAT3(0, 0, 0);
+	measuring = false;
+	measureFrames = 0;
+	measureWarmup = 0;
+	measuredFrames = 0;
+}
+
+// --------------------------------------------------------
+// Swaps the capture in for the live scene, with entities
+// whose mesh or material isn't here any more left out
+// --------------------------------------------------------
+bool FrameReplay::Start(const FrameCapture& capture, EntityRegistry& entities, const std::vector<Material*>& materials,
+	LightManager& lights, int& lightCount, const std::vector<Emitter*>& emitters, Camera* camera)
+{
+	if (running)
+		Stop(entities, lights, lightCount, emitters, camera);
+
+	// Looked up once for every entity that uses each
+	Assets& assets = Assets::GetInstance();
+	std::vector<Mesh*> meshes;
+	for (const std::string& name : capture.MeshNames)
+		meshes.push_back(name.empty() ? 0 : assets.GetMesh(name));
+
+	unsigned int missing = 0;
+	for (const FrameCaptureEntity& e : capture.Entities)
+	{
+		bool found = e.Mesh < meshes.size() && meshes[e.Mesh] && e.Material >= 0 && e.Material < (int)materials.size();
+		missing += found ? 0 : 1;
+	}
+	if (missing == capture.Entities.size() && !capture.Entities.empty())
+	{
+		printf("None of the captured entities' meshes and materials are loaded\n");
+		return false;
+	}
+	if (missing > 0)
+		printf("Replaying without %u of the %u captured entities (their meshes or materials aren't loaded)\n", missing, (unsigned int)capture.Entities.size());
+
+	this->capture = capture;
+	running = true;
+
+	// Out of the scene, but not destroyed
+	hiddenEntities = entities.GetEntities();
+	for (GameEntity* entity : hiddenEntities)
+		entities.RemoveFromScene(entity);
+
+	replayEntities.clear();
+	for (const FrameCaptureEntity& e : capture.Entities)
+	{
+		if (e.Mesh >= meshes.size() || !meshes[e.Mesh] || e.Material < 0 || e.Material >= (int)materials.size())
+			continue;
+
+		GameEntity* entity = entities.CreateEntity(meshes[e.Mesh], materials[e.Material]);
+		entity->GetTransform()->SetTransformsFromMatrix(e.World);
+		replayEntities.push_back(entity);
+	}
+
+	savedLights.Swap(lights);
+	savedLightCount = lightCount;
+	lights.Assign(capture.Lights);
+	lightCount = min(capture.Header.ActiveLightCount, (int)lights.GetCount());
+
+	// Emitters are matched up in order, and any extra are left as they are
+	savedEmitterPositions.clear();
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		savedEmitterPositions.push_back(emitters[i]->GetPosition());
+		if (i >= capture.Emitters.size())
+			continue;
+
+		const FrameCaptureEmitter& e = capture.Emitters[i];
+		emitters[i]->SetPosition(e.Position);
+		emitters[i]->SetLivingParticles(e.Particles.data(), (int)e.Particles.size(), e.SinceLastEmit);
+	}
+
+	Transform* cameraTransform = camera->GetTransform();
+	savedCameraPosition = cameraTransform->GetPosition();
+	savedCameraPitchYawRoll = cameraTransform->GetPitchYawRoll();
+	cameraTransform->SetPosition(capture.Header.CameraPosition.x, capture.Header.CameraPosition.y, capture.Header.CameraPosition.z);
+	cameraTransform->SetRotation(capture.Header.CameraPitchYawRoll.x, capture.Header.CameraPitchYawRoll.y, capture.Header.CameraPitchYawRoll.z);
+	camera->UpdateViewMatrix();
+	return true;
+}
+
+void FrameReplay::Stop(EntityRegistry& entities, LightManager& lights, int& lightCount, const std::vector<Emitter*>& emitters, Camera* camera)
+{
+	if (!running)
+		return;
+
+	for (GameEntity* entity : replayEntities)
+		entities.Destroy(entity);
+	replayEntities.clear();
+	for (GameEntity* entity : hiddenEntities)
+		entities.AddToScene(entity);
+	hiddenEntities.clear();
+
+	lights.Swap(savedLights);
+	savedLights.Clear();
+	lightCount = savedLightCount;
+	for (size_t i = 0; i < emitters.size() && i < savedEmitterPositions.size(); i++)
+		emitters[i]->SetPosition(savedEmitterPositions[i]);
+
+	Transform* cameraTransform = camera->GetTransform();
+	cameraTransform->SetPosition(savedCameraPosition.x, savedCameraPosition.y, savedCameraPosition.z);
+	cameraTransform->SetRotation(savedCameraPitchYawRoll.x, savedCameraPitchYawRoll.y, savedCameraPitchYawRoll.z);
+	camera->UpdateViewMatrix();
+
+	running = false;
+	measuring = false;
+}
+
+void FrameReplay::Measure(const std::string& label, unsigned int frames, unsigned int warmupFrames)
+{
+	measuring = running;
+	measureLabel = label;
+	measureFrames = max(frames, 1u);
+	measureWarmup = warmupFrames;
+	measuredFrames = 0;
+	frameGpuMs.clear();
+	passTotals.clear();
+}
+
+float FrameReplay::GetMeasureProgress()
+{
+	return measuring ? (float)measuredFrames / (measureFrames + measureWarmup) : 0.0f;
+}
+
+bool FrameReplay::RecordFrame(GpuProfiler& profiler)
+{
+	if (!measuring || measuredFrames++ < measureWarmup)
+		return false;
+
+	frameGpuMs.push_back(profiler.GetFrameMs());
+	for (const GpuPassStats& pass : profiler.GetPassStats())
+		passTotals[pass.Name] += pass.LastMs;
+	if (frameGpuMs.size() < measureFrames)
+		return false;
+
+	FrameTimePercentiles gpu = FrameTimeRecorder::GetPercentiles(frameGpuMs);
+	FrameReplayResult result;
+	result.Label = measureLabel;
+	result.Frames = (unsigned int)frameGpuMs.size();
+	result.GpuMs = gpu.Average;
+	result.GpuP95Ms = gpu.P95;
+	for (auto& pass : passTotals)
+		result.PassMs[pass.first] = (float)(pass.second / result.Frames);
+	results.push_back(result);
+	AppendResult(result);
+
+	printf("Replay \"%s\": %.3f ms GPU (p95 %.3f ms) over %u frames\n", result.Label.c_str(), result.GpuMs, result.GpuP95Ms, result.Frames);
+	measuring = false;
+	return true;
+}
+
+// One row per pass, so results with different passes still line up
+void FrameReplay::AppendResult(const FrameReplayResult& result)
+{
+	std::ifstream existing(FRAME_REPLAY_RESULTS_FILE);
+	bool hasHeader = existing.good() && existing.peek() != std::ifstream::traits_type::eof();
+	existing.close();
+
+	std::ofstream csv(FRAME_REPLAY_RESULTS_FILE, std::ios::app);
+	if (!csv.is_open())
+	{
+		printf("Couldn't write %s\n", FRAME_REPLAY_RESULTS_FILE);
+		return;
+	}
+
+	if (!hasHeader)
+		csv << "label,frames,pass,ms\n";
+	csv << result.Label << "," << result.Frames << ",Frame," << result.GpuMs << "\n";
+	csv << result.Label << "," << result.Frames << ",Frame p95," << result.GpuP95Ms << "\n";
+	for (auto& pass : result.PassMs)
+		csv << result.Label << "," << result.Frames << "," << pass.first << "," << pass.second << "\n";
+}
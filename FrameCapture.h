@@ -0,0 +1,162 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+#include "EntityRegistry.h"
+#include "Emitter.h"
+#include "GpuProfiler.h"
+#include "Lights.h"
+#include "LightManager.h"
+#include "Material.h"
+
+// Where the UI saves (and loads) a capture, and -replay can take any
+#define FRAME_CAPTURE_FILE			"FrameCapture.bin"
+#define FRAME_CAPTURE_MAGIC			0x43465844	// "DXFC"
+#define FRAME_CAPTURE_VERSION		1
+
+// Where measured replays are appended to, and by default how many
+// frames each one is, after however many are skipped first (the GPU
+// profiler's a few frames behind, and caches need to settle)
+#define FRAME_REPLAY_RESULTS_FILE	"FrameReplay.csv"
+#define FRAME_REPLAY_FRAMES			300
+#define FRAME_REPLAY_WARMUP_FRAMES	30
+
+// Start of a capture, followed by the mesh names (each a length and
+// its characters), the entities, the lights, then each emitter with
+// its particles straight after it
+struct FrameCaptureHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int Width;				// Of the window it was captured in
+	unsigned int Height;
+	float TotalTime;
+	int SkyIndex;
+	DirectX::XMFLOAT3 CameraPosition;
+	DirectX::XMFLOAT3 CameraPitchYawRoll;
+	unsigned int MeshCount;
+	unsigned int EntityCount;
+	unsigned int LightCount;		// How many there are
+	int ActiveLightCount;			// How many are drawn
+	unsigned int EmitterCount;
+};
+
+// One entity, by its mesh's name (in Assets) and its material's index
+// (in the game's list), with its final world matrix, so any parents
+// it had are baked in
+struct FrameCaptureEntity
+{
+	unsigned int Mesh;	// Into the mesh names
+	int Material;		// -1 if it wasn't one of the game's
+	DirectX::XMFLOAT4X4 World;
+};
+
+struct FrameCaptureEmitter
+{
+	DirectX::XMFLOAT3 Position;
+	float SinceLastEmit;
+	std::vector<Particle> Particles;	// Living, oldest first
+};
+
+// --------------------------------------------------------
+// Everything the renderer's handed one frame (the scene's
+// entities, the lights, the emitters' particles, the camera
+// and the sky), which can be saved, loaded, and put back
+// in place of the live scene to draw again (see FrameReplay)
+//  - Entities only keep what's drawn, so players and
+//    projectiles come back as plain entities
+//  - GPU simulated emitters only keep where they are
+// --------------------------------------------------------
+struct FrameCapture
+{
+	FrameCaptureHeader Header;
+	std::vector<std::string> MeshNames;
+	std::vector<FrameCaptureEntity> Entities;
+	std::vector<Light> Lights;
+	std::vector<FrameCaptureEmitter> Emitters;
+
+	// Copies the scene as it's about to be drawn
+	void Capture(EntityRegistry& entities, const std::vector<Material*>& materials, const std::vector<Light>& lights, int lightCount,
+		const std::vector<Emitter*>& emitters, Camera* camera, float totalTime, int skyIndex, unsigned int width, unsigned int height);
+
+	bool Save(const std::string& path);
+	bool Load(const std::string& path);
+};
+
+// One measured replay, averaged over its frames
+struct FrameReplayResult
+{
+	std::string Label;
+	unsigned int Frames;
+	float GpuMs;
+	float GpuP95Ms;
+	std::map<std::string, float> PassMs;
+};
+
+// --------------------------------------------------------
+// Draws a capture in place of the live scene, every frame,
+// so what the renderer does can be timed away from the
+// simulation, and as many times as it takes
+//  - Start() takes the live entities out of the scene (so
+//    they're put back untouched), makes the captured ones,
+//    swaps in the lights and moves the camera and emitters
+//  - While it's running, nothing else should change the
+//    scene, so the game leaves its simulation alone
+//  - Measure() averages the GPU profiler's passes over the
+//    next few hundred frames, as a labeled result, which is
+//    how different renderer options are compared
+// --------------------------------------------------------
+class FrameReplay
+{
+public:
+	FrameReplay();
+
+	// False (with nothing changed) if none of it could be put in place
+	bool Start(const FrameCapture& capture, EntityRegistry& entities, const std::vector<Material*>& materials,
+		LightManager& lights, int& lightCount, const std::vector<Emitter*>& emitters, Camera* camera);
+	void Stop(EntityRegistry& entities, LightManager& lights, int& lightCount, const std::vector<Emitter*>& emitters, Camera* camera);
+	bool IsRunning() { return running; }
+
+	const FrameCapture& GetCapture() { return capture; }
+	float GetTotalTime() { return capture.Header.TotalTime; }
+
+	// Starts timing the next frames, after the warm up
+	void Measure(const std::string& label, unsigned int frames = FRAME_REPLAY_FRAMES, unsigned int warmupFrames = FRAME_REPLAY_WARMUP_FRAMES);
+	bool IsMeasuring() { return measuring; }
+	float GetMeasureProgress();
+
+	// After each frame's drawn, returning true once a measurement's
+	// finished (and been appended to the results file)
+	bool RecordFrame(GpuProfiler& profiler);
+
+	const std::vector<FrameReplayResult>& GetResults() { return results; }
+	void ClearResults() { results.clear(); }
+
+private:
+	bool running;
+	FrameCapture capture;
+
+	// What Start() swapped out, to swap back
+	std::vector<GameEntity*> hiddenEntities;
+	std::vector<GameEntity*> replayEntities;
+	LightManager savedLights;	// Swapped, so the scene's handles survive
+	int savedLightCount;
+	std::vector<DirectX::XMFLOAT3> savedEmitterPositions;
+	DirectX::XMFLOAT3 savedCameraPosition;
+	DirectX::XMFLOAT3 savedCameraPitchYawRoll;
+
+	bool measuring;
+	std::string measureLabel;
+	unsigned int measureFrames;
+	unsigned int measureWarmup;
+	unsigned int measuredFrames;
+	std::vector<float> frameGpuMs;
+	std::map<std::string, double> passTotals;
+	std::vector<FrameReplayResult> results;
+
+	void AppendResult(const FrameReplayResult& result);
+};
@@ -0,0 +1,110 @@
+#include "FrameTimeRecorder.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+
+FrameTimeRecorder::FrameTimeRecorder()
+{
+	frameMs.resize(FRAME_TIME_HISTORY);
+	cpuMs.resize(FRAME_TIME_HISTORY);
+	gpuMs.resize(FRAME_TIME_HISTORY);
+	sorted.reserve(FRAME_TIME_HISTORY);
+	Clear();
+}
+
+void FrameTimeRecorder::Clear()
+{
+	head = 0;
+	count = 0;
+	totalFrames = 0;
+	stats = {};
+	framesSinceStats = 0;
+}
+
+void FrameTimeRecorder::RecordFrame(float frameMs, float cpuMs, float gpuMs)
+{
+	this->frameMs[head] = frameMs;
+	this->cpuMs[head] = cpuMs;
+	this->gpuMs[head] = gpuMs;
+	head = (head + 1) % FRAME_TIME_HISTORY;
+	count = std::min(count + 1, (unsigned int)FRAME_TIME_HISTORY);
+	totalFrames++;
+
+	if (++framesSinceStats >= FRAME_TIME_REFRESH_FRAMES)
+	{
+		UpdateStats();
+		framesSinceStats = 0;
+	}
+}
+
+// --------------------------------------------------------
+// Percentiles are the nearest rank in the sorted times
+// --------------------------------------------------------
+FrameTimePercentiles FrameTimeRecorder::GetPercentiles(std::vector<float>& times)
+{
+	FrameTimePercentiles p = {};
+	if (times.empty())
+		return p;
+	std::sort(times.begin(), times.end());
+
+	size_t count = times.size();
+	double total = 0.0;
+	for (float t : times)
+		total += t;
+	p.Average = (float)(total / count);
+	p.P50 = times[(count - 1) * 50 / 100];
+	p.P95 = times[(count - 1) * 95 / 100];
+	p.P99 = times[(count - 1) * 99 / 100];
+	p.Max = times.back();
+	return p;
+}
+
+// The history's in ring order, but that doesn't matter once it's sorted
+FrameTimePercentiles FrameTimeRecorder::GetHistoryPercentiles(const std::vector<float>& times)
+{
+	sorted.assign(times.begin(), times.begin() + count);
+	return GetPercentiles(sorted);
+}
+
+void FrameTimeRecorder::UpdateStats()
+{
+	if (count == 0)
+		return;
+
+	stats.Frames = count;
+	stats.Cpu = GetHistoryPercentiles(cpuMs);
+	stats.Gpu = GetHistoryPercentiles(gpuMs);
+	stats.Frame = GetHistoryPercentiles(frameMs); // Last, so the sorted frame times are left behind
+
+	// The slowest 1% (at least one frame), as a frame rate
+	unsigned int slowest = std::max(count / 100, 1u);
+	double slowestMs = 0.0;
+	for (unsigned int i = count - slowest; i < count; i++)
+		slowestMs += sorted[i];
+	stats.OnePercentLowFps = slowestMs > 0.0 ? (float)(1000.0 * slowest / slowestMs) : 0.0f;
+
+	float hitchMs = stats.Frame.P50 * FRAME_TIME_HITCH_FACTOR;
+	stats.Hitches = (unsigned int)(sorted.end() - std::upper_bound(sorted.begin(), sorted.end(), hitchMs));
+}
+
+bool FrameTimeRecorder::Save(const char* path)
+{
+	std::ofstream csv(path);
+	if (!csv)
+	{
+		printf("Couldn't write %s\n", path);
+		return false;
+	}
+
+	csv << "Frame,Frame Ms,CPU Ms,GPU Ms\n";
+	unsigned int oldest = GetOffset();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int index = (oldest + i) % FRAME_TIME_HISTORY;
+		csv << totalFrames - count + i << "," << frameMs[index] << "," << cpuMs[index] << "," << gpuMs[index] << "\n";
+	}
+
+	printf("Wrote %u frame times to %s\n", count, path);
+	return true;
+}
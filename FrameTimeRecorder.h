@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+
+// How many of the most recent frames are kept
+#define FRAME_TIME_HISTORY			4096
+
+// The stats are only recomputed (sorting the whole history) this often
+#define FRAME_TIME_REFRESH_FRAMES	30
+
+// A frame this many times longer than the median is a hitch
+#define FRAME_TIME_HITCH_FACTOR		2.0f
+
+// Where the history's written, on the hotkey or on exit (next to the exe)
+#define FRAME_TIME_FILE				"FrameTimes.csv"
+
+// Percentiles of one of the times over the history, in milliseconds
+struct FrameTimePercentiles
+{
+	float P50;
+	float P95;
+	float P99;
+	float Average;
+	float Max;
+};
+
+struct FrameTimeStats
+{
+	unsigned int Frames;
+	FrameTimePercentiles Frame;	// Start of one frame to the start of the next
+	FrameTimePercentiles Cpu;	// Update and Draw
+	FrameTimePercentiles Gpu;	// From the GPU profiler, a few frames behind
+	float OnePercentLowFps;		// The frame rate the slowest 1% of frames averaged
+	unsigned int Hitches;
+};
+
+// --------------------------------------------------------
+// Keeps the frame, CPU and GPU time of each of the last
+// FRAME_TIME_HISTORY frames in a ring buffer, for the
+// percentiles and hitches an average would hide
+// --------------------------------------------------------
+class FrameTimeRecorder
+{
+public:
+	FrameTimeRecorder();
+
+	void RecordFrame(float frameMs, float cpuMs, float gpuMs);
+	void Clear();
+
+	const FrameTimeStats& GetStats() { return stats; }
+
+	// The frame times as a ring, oldest at the offset, for ImGui::PlotLines()
+	const float* GetFrameTimes() { return frameMs.data(); }
+	unsigned int GetCount() { return count; }
+	unsigned int GetOffset() { return count < FRAME_TIME_HISTORY ? 0 : head; }
+
+	// Writes every frame in the history, oldest first
+	bool Save(const char* path);
+
+	// Percentiles of any set of times (which are sorted in place)
+	static FrameTimePercentiles GetPercentiles(std::vector<float>& times);
+
+private:
+	std::vector<float> frameMs;
+	std::vector<float> cpuMs;
+	std::vector<float> gpuMs;
+	unsigned int head;
+	unsigned int count;
+	unsigned long long totalFrames;		// For numbering the saved frames
+
+	FrameTimeStats stats;
+	unsigned int framesSinceStats;
+	std::vector<float> sorted;
+	void UpdateStats();
+	FrameTimePercentiles GetHistoryPercentiles(const std::vector<float>& times);
+};
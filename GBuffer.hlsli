@@ -0,0 +1,86 @@
+// Include guard
+#ifndef _GBUFFER_HLSL
+#define _GBUFFER_HLSL
+
+// Packed G-buffer layout, written by the lit pixel shaders
+//  - Target 0 (R8G8B8A8): color with ambient included, and the
+//    fraction of that color that came from ambient in alpha
+//  - Target 1 (R16G16): octahedral encoded world space normal
+//  - Depth comes from the depth buffer itself
+//  - Target 2 (R16G16_FLOAT): motion since last frame in UVs, for
+//    temporal upsampling (only bound while it's on)
+//
+// With deferred shading, the _GBuffer pixel shaders write the surface
+// instead, and DeferredLightingCS.hlsl lights it into target 0
+//  - Albedo (R8G8B8A8 sRGB): linear surface color, roughness in alpha
+//  - Normals: as above
+//  - Surface (R8G8): metalness, and the Blinn-Phong spec power for
+//    non-PBR materials (0 means the surface is PBR)
+//  - Motion: as above, in target 3
+
+static const float3 LUMINANCE = float3(0.2126f, 0.7152f, 0.0722f);
+
+// Spec powers above this are clamped in the surface target
+#define GBUFFER_MAX_SPEC_POWER 256.0f
+
+float2 OctahedronWrap(float2 v)
+{
+	return (1.0f - abs(v.yx)) * (v.xy >= 0.0f ? 1.0f : -1.0f);
+}
+
+// Unit normal to [0,1] octahedral coords
+float2 EncodeNormal(float3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	n.xy = n.z >= 0.0f ? n.xy : OctahedronWrap(n.xy);
+	return n.xy * 0.5f + 0.5f;
+}
+
+float3 DecodeNormal(float2 encoded)
+{
+	encoded = encoded * 2.0f - 1.0f;
+	float3 n = float3(encoded.x, encoded.y, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+float2 EncodeSurface(float metal, float specPower)
+{
+	// Kept off zero for the tiniest spec powers, so they're still non-PBR
+	return float2(metal, specPower > 0.0f ? max(saturate(specPower / GBUFFER_MAX_SPEC_POWER), 1.0f / 255.0f) : 0.0f);
+}
+
+// Spec power is 0 for PBR surfaces
+void DecodeSurface(float2 encoded, out float metal, out float specPower)
+{
+	metal = encoded.x;
+	specPower = encoded.y * GBUFFER_MAX_SPEC_POWER;
+}
+
+// How far a pixel moved on screen since last frame (this frame's UV
+// minus last frame's), from clip positions without their jitter
+float2 EncodeMotion(float4 currentClip, float4 prevClip)
+{
+	return (currentClip.xy / currentClip.w - prevClip.xy / prevClip.w) * float2(0.5f, -0.5f);
+}
+
+// Folds the ambient term into the color, remembering how much of the
+// pixel's brightness it was so occlusion can be applied later
+float4 PackColorAndAmbient(float3 color, float3 ambient)
+{
+	float3 total = color + ambient;
+	float totalLuminance = dot(total, LUMINANCE);
+	float ambientFraction = totalLuminance > 0.0f ? saturate(dot(ambient, LUMINANCE) / totalLuminance) : 0.0f;
+	return float4(total, ambientFraction);
+}
+
+// Applies ambient occlusion to a packed color
+//  - Exact when the ambient has the same hue as the rest of
+//    the color, and close enough otherwise
+float3 UnpackColor(float4 packed, float ao)
+{
+	return packed.rgb * (1.0f - packed.a * (1.0f - ao));
+}
+
+#endif
@@ -1,6 +1,7 @@
 
 #include <stdlib.h>     // For seeding random and rand()
 #include <time.h>       // For grabbing time (to seed random)
+#include <chrono>
 
 #include "Game.h"
 #include "Vertex.h"
@@ -13,10 +14,15 @@
 #include "Extensions/imgui/backends/imgui_impl_win32.h"
 
 #include "AssetLoader.h"
+#include "GeometryPool.h"
+#include "StateCache.h"
+#include "UploadRing.h"
+#include "ThreadManager.h"
 
 // Needed for a helper function to read compiled shader files from the hard drive
 #pragma comment(lib, "d3dcompiler.lib")
 #include <d3dcompiler.h>
+#include <algorithm>
 
 // For the DirectX Math library
 using namespace DirectX;
@@ -28,6 +34,13 @@ using namespace DirectX;
 #define LoadTexture(file, srv) CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(file).c_str(), 0, srv.GetAddressOf())
 #define LoadShader(type, file) new type(device.Get(), context.Get(), GetFullPathTo_Wide(file).c_str())
 
+// Each a folder in Assets\Skies with six faces, the first of which is
+// the one the game starts with
+static const char* skyNames[] = { "Clouds Blue", "Night", "Planet" };
+static const char* skyFaceNames[6] = { "right", "left", "up", "down", "front", "back" }; // +X, -X, +Y, -Y, +Z, -Z
+static const char* stressMeshNames[] = { "cube", "cylinder", "cone", "sphere", "helix", "torus" };
+static const char* stressParticleTexture = "Textures\\Particles\\PNG (Black background)\\smoke_01.png";
+
 
 // --------------------------------------------------------
 // Constructor
@@ -37,15 +50,54 @@ using namespace DirectX;
 //
 // hInstance - the application's OS-level handle (unique ID)
 // --------------------------------------------------------
-Game::Game(HINSTANCE hInstance)
+Game::Game(HINSTANCE hInstance, const ScriptedBenchmarkOptions& benchmarkOptions)
 	: DXCore(
 		hInstance,		   // The application's handle
 		"DirectX Game",	   // Text for the window's title bar
-		1280,			   // Width of the window's client area
-		720,			   // Height of the window's client area
+		benchmarkOptions.Width,	// Width of the window's client area
+		benchmarkOptions.Height,	// Height of the window's client area
 		true)			   // Show extra stats (fps) in title bar?
 {
+	this->benchmarkOptions = benchmarkOptions;
+	stressOptions = benchmarkOptions.Stress;
+	SetBackgroundFrameRate(benchmarkOptions.BackgroundFrameRate);
 	camera = 0;
+	transformSystem = 0;
+	fixedTimestep = true;
+	tickRate = GAME_DEFAULT_TICK_RATE;
+	tickAccumulator = 0.0f;
+	tickBlend = 1.0f;
+	lastTickCount = 0;
+	pipelinedSimulation = true;
+	lateLatchCamera = true;
+	uiVisible = true;
+	lastPacketTick = 0;
+	materialAtlasesBuilt = false;
+	dataOrientedTransforms = false;
+	spatialSort = true;
+	framesSinceSpatialSort = 0;
+	skyIndex = 0;
+	pendingSkyIndex = -1;
+	memset(skyFaceRequests, 0, sizeof(skyFaceRequests));
+	skyRebuildBudgetMs = 1.0f;
+	emitterCulling = true;
+	visibleEmitterCount = 0;
+	particleBenchmarkSettings = {};
+	particleBenchmarkSettings.GridSize = 8;
+	particleBenchmarkSettings.Spacing = 4.0f;
+	particleBenchmarkSettings.MaxParticles = 1000;
+	particleBenchmarkSettings.ParticlesPerSecond = 250;
+	particleBenchmarkSettings.Lifetime = 4.0f;
+	particleBenchmarkSettings.WarmupFrames = 300;
+	particleBenchmarkSettings.Frames = 600;
+	particleBenchmarkSettings.Mode = ParticleBenchmarkMode::AppendUploads;
+	benchmarkSavedBatching = false;
+	benchmarkSavedCulling = false;
+	memset(transformBenchmarkMs, 0, sizeof(transformBenchmarkMs));
+	memset(bvhBenchmarkMs, 0, sizeof(bvhBenchmarkMs));
+	cpuProfileFrames = 4;
+	allocationSitesLastFrame = true;
+	captureNextFrame = false;
 
 	// Seed random
 	srand((unsigned int)time(0));
@@ -71,20 +123,25 @@ Game::~Game()
 	//   to call Release() on each DirectX object
 
 	// Clean up our other resources
+	simulation.Stop();
+	delete projectiles;
+	frameTimes.Save(FRAME_TIME_FILE);
+	for (auto& a : materialAtlases) delete a;
 	for (auto& m : materials) delete m;
-	for (auto& e : entities) delete e;
+	particleBenchmark.Stop(); // Puts the scene's emitters back
 	for (auto& e : emitters) delete e;
+	delete transformSystem;
 
 	// Delete any one-off objects
 	delete sky;
 	delete camera;
-	delete localPlayer; //COMMENT OUT IF RENDERING PLAYER'S BODY
 	delete arial;
 	delete spriteBatch;
 
 	// Delete singletons
 	delete& Input::GetInstance();
 	delete& Assets::GetInstance();
+	delete& GeometryPool::GetInstance();
 
 	// ImGui cleanup
 	ImGui_ImplDX11_Shutdown();
@@ -94,6 +151,17 @@ Game::~Game()
 	delete renderer;
 	delete netManager;
 
+	// Nothing should be queuing jobs by now
+	delete& JobSystem::GetInstance();
+	delete& ThreadManager::GetInstance();
+	delete& LoadProfiler::GetInstance();
+	delete& CpuProfiler::GetInstance();
+	delete& StateCache::GetInstance();
+	delete& UploadRing::GetInstance();
+
+	// Anything still alive after this just isn't counted
+	delete& GpuMemory::GetInstance();
+
 }
 
 // --------------------------------------------------------
@@ -102,8 +170,23 @@ Game::~Game()
 // --------------------------------------------------------
 void Game::Init()
 {
+	// Startup's timed from here, on this (the main) thread
+	LoadProfiler::GetInstance();
+	CpuProfiler::GetInstance().NameThread("Main");
+
+	// Every thread applies its settings as it starts, so they're read first
+	ThreadManager::GetInstance().Load(THREAD_MANAGER_CONFIG_PATH);
+	ThreadManager::GetInstance().Configure(ThreadRole::Render, "Main");
+	GpuMemory::GetInstance().Initialize(device);
+	StateCache::GetInstance().Initialize(device);
+	UploadRing::GetInstance().Initialize(device);
+
 	// Initialize the input manager with the window's handle
 	Input::GetInstance().Initialize(this->hWnd);
+	Input::GetInstance().SetRawMouseInput(true);
+
+	// Workers for anything that can be spread across cores
+	JobSystem::GetInstance().Initialize();
 
 	// Asset loading and entity creation
 	LoadAssetsAndCreateEntities();
@@ -113,8 +196,8 @@ void Game::Init()
 	// Essentially: "What kind of shape should the GPU draw with our data?"
 	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	// Set up lights initially
-	lightCount = 64;
+	// Set up lights initially, with at least the scene's own
+	lightCount = max(64, (int)sceneLights.size());
 	GenerateLights();
 
 	// Make our camera
@@ -124,11 +207,12 @@ void Game::Init()
 		1.0f,		// Mouse look
 		this->width / (float)this->height); // Aspect ratio
 
-	localPlayer = new Player(Assets::GetInstance().GetMesh("Models\\sphere.obj"), materials[0], camera);
+	localPlayer = entities.CreatePlayer(Assets::GetInstance().GetMesh("Models\\sphere.obj"), materials[0], camera);
 	localPlayer->GetTransform()->SetPosition(0, -1, 0);
 	localPlayer->GetTransform()->SetScale(2, 2, 2);
 	localPlayer->GetTransform()->SetParent(camera->GetTransform(), false);
-	//entities.push_back(localPlayer); //UNCOMMENT TO RENDER THE PLAYER'S BODY. DONT FORGET TO COMMENT OUT "delete localPlayer"
+	interpolator.Track(camera->GetTransform(), false); // Turned by the mouse every frame
+	entities.RemoveFromScene(localPlayer); //COMMENT OUT TO RENDER THE PLAYER'S BODY
 
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -138,22 +222,79 @@ void Game::Init()
 	ImGui_ImplWin32_Init(hWnd);
 	ImGui_ImplDX11_Init(device.Get(), context.Get());
 
-	renderer = new Renderer(device, context, swapChain, backBufferRTV, depthStencilView, width, height, sky, entities, lights, emitters);
+	renderer = new Renderer(device, context, swapChain, backBufferRTV, depthStencilView, depthStencilSRV, width, height, sky, entities, lights, emitters);
+	renderer->SetProjectiles(projectiles);
+	WarmUpRenderer();
 	netManager = new NetworkManager(&entities);
+	if (!benchmarkOptions.RegressionFile.empty())
+	{
+		if (regressionSuite.Start(benchmarkOptions))
+			StartRegressionScenario();
+		else
+			Quit(1);
+	}
+	else
+	{
+		if (stressOptions.Enabled)
+			GenerateStressScene();
+		if (benchmarkOptions.Enabled)
+			StartScriptedBenchmark();
+	}
+	if (pipelinedSimulation)
+		StartSimulationThread();
 
+	// Everything after this is loaded as it's needed, so isn't part of startup
+	LoadProfiler::GetInstance().Finish();
 }
 
 
+// --------------------------------------------------------
+// Draws everything the scene could need once, before the
+// first real frame, and says what was still slow after
+// --------------------------------------------------------
+void Game::WarmUpRenderer()
+{
+	if (benchmarkOptions.ShaderWarmUpMs <= 0)
+		return;
+
+	LoadProfileScope scope("Warm Up", "Renderer::WarmUp");
+	WarmUpReport report = renderer->WarmUp(camera, materials, lightMesh, lightCount, lightVS, lightPS, lightMesh, benchmarkOptions.ShaderWarmUpMs);
+	printf("Warm up: %u combinations in %.1f ms (%u skipped for time)\n", (unsigned int)report.Combinations.size(), report.TotalMs, report.Skipped);
+	for (const WarmUpCombination& combination : report.Combinations)
+	{
+		if (combination.SecondMs > RENDERER_WARM_UP_HITCH_MS)
+			printf("  Still hitched: %s (%.2f ms, then %.2f ms)\n", combination.Name.c_str(), combination.FirstMs, combination.SecondMs);
+	}
+}
+
 // --------------------------------------------------------
 // Load all assets and create materials, entities, etc.
 // --------------------------------------------------------
 void Game::LoadAssetsAndCreateEntities()
 {
 
+	// Loaded meshes all share the pool's buffers
+	GeometryPool::GetInstance().Initialize(device, context);
+
 	Assets& assets = Assets::GetInstance();
 	assets.Initialize("..\\..\\Assets\\", device, context);
+	assets.SetStreamTextures(true);
+	assets.SetStreamMips(true);
+	assets.SetLoadOnDemand(true);
 	assets.LoadAllAssets();
 
+	// Anything that changes on disk from here on is reloaded
+	assets.SetHotReload(true);
+	assets.AddReloadListener([this](const AssetReload& reload) { OnAssetReloaded(reload); });
+
+	// Anything needed to set up the scene can't wait for the streaming thread
+	auto loadTextureNow = [&](std::string name)
+	{
+		TextureRequest* request = assets.RequestTexture(name, 0);
+		assets.WaitForTexture(request);
+		return request->SRV;
+	};
+
 	// Create a random texture for SSAO
 	const int textureSize = 4;
 	const int totalPixels = textureSize * textureSize;
@@ -173,357 +314,194 @@ void Game::LoadAssetsAndCreateEntities()
 	sampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
 	sampDesc.MaxAnisotropy = 16;
 	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	device->CreateSamplerState(&sampDesc, samplerOptions.GetAddressOf());
+	samplerOptions = StateCache::GetInstance().GetSamplerState(sampDesc);
 
 	// Also create a clamp sampler
 	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
 	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
 	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-	device->CreateSamplerState(&sampDesc, clampSampler.GetAddressOf());
-
-
-	// Create the sky
-	sky = new Sky(
-		/*assets.GetTexture("Skies\\SunnyCubeMap.dds"),*/
-		assets.GetTexture("Skies\\Clouds Blue\\right.png"),
-		assets.GetTexture("Skies\\Clouds Blue\\left.png"),
-		assets.GetTexture("Skies\\Clouds Blue\\up.png"),
-		assets.GetTexture("Skies\\Clouds Blue\\down.png"),
-		assets.GetTexture("Skies\\Clouds Blue\\front.png"),
-		assets.GetTexture("Skies\\Clouds Blue\\back.png"),
-		samplerOptions,
-		device,
-		context);
+	clampSampler = StateCache::GetInstance().GetSamplerState(sampDesc);
+
+
+	// Create the sky, straight into a cube map if the faces can be decoded
+	// here (or from a DDS cube, like assets.GetTexture("Skies\\SunnyCubeMap.dds")),
+	// and from six textures that are then copied into one otherwise
+	std::string skyFaces[6];
+	for (int i = 0; i < 6; i++)
+		skyFaces[i] = std::string("Skies\\") + skyNames[0] + "\\" + skyFaceNames[i] + ".png";
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> skyCube = assets.LoadCubemap(skyFaces);
+	if (skyCube)
+	{
+		sky = new Sky(
+			skyCube,
+			samplerOptions,
+			device,
+			context,
+			true,	// Irradiance as spherical harmonics, rather than a cube map
+			SkyIBLQuality::High);
+	}
+	else
+	{
+		sky = new Sky(
+			loadTextureNow(skyFaces[0]),
+			loadTextureNow(skyFaces[1]),
+			loadTextureNow(skyFaces[2]),
+			loadTextureNow(skyFaces[3]),
+			loadTextureNow(skyFaces[4]),
+			loadTextureNow(skyFaces[5]),
+			samplerOptions,
+			device,
+			context,
+			true,
+			SkyIBLQuality::High);
+	}
 
 	// Grab basic shaders for all these materials
 	SimpleVertexShader* vs = assets.GetVertexShader("VertexShader.cso");
-	SimplePixelShader* ps = assets.GetPixelShader("PixelShader.cso");
-	SimplePixelShader* psPBR = assets.GetPixelShader("PixelShaderPBR.cso");
+
+	// Per-object data changes every draw, so append it to the constant
+	// rings rather than re-uploading the same small buffers over and over
+	vs->SetRingBacked("perObject");
+	assets.GetVertexShader("ShadowVS.cso")->SetRingBacked("perObject");
 
 	lightMesh = assets.GetMesh("Models\\sphere.obj");
 	lightVS = vs;
 	lightPS = assets.GetPixelShader("SolidColorPS.cso");
 
-	// Create basic materials
-	Material* cobbleMat2x = new Material(vs, ps, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	cobbleMat2x->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\cobblestone_albedo.png"));
-	cobbleMat2x->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\cobblestone_normals.png"));
-	cobbleMat2x->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\cobblestone_roughness.png"));
-	cobbleMat2x->AddPSSampler("BasicSampler", samplerOptions);
-
-	Material* floorMat = new Material(vs, ps, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	floorMat->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\floor_albedo.png"));
-	floorMat->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\floor_normals.png"));
-	floorMat->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\floor_roughness.png"));
-	floorMat->AddPSSampler("BasicSampler", samplerOptions);
-
-	Material* paintMat = new Material(vs, ps, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	paintMat->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\paint_albedo.png"));
-	paintMat->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\paint_normals.png"));
-	paintMat->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\paint_roughness.png"));
-	paintMat->AddPSSampler("BasicSampler", samplerOptions);
-
-	Material* scratchedMat = new Material(vs, ps, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	scratchedMat->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\scratched_albedo.png"));
-	scratchedMat->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\scratched_normals.png"));
-	scratchedMat->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\scratched_roughness.png"));
-	scratchedMat->AddPSSampler("BasicSampler", samplerOptions);
-
-	Material* bronzeMat = new Material(vs, ps, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	bronzeMat->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\bronze_albedo.png"));
-	bronzeMat->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\bronze_normals.png"));
-	bronzeMat->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\bronze_roughness.png"));
-	bronzeMat->AddPSSampler("BasicSampler", samplerOptions);
-
-	Material* roughMat = new Material(vs, ps, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	roughMat->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\rough_albedo.png"));
-	roughMat->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\rough_normals.png"));
-	roughMat->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\rough_roughness.png"));
-	roughMat->AddPSSampler("BasicSampler", samplerOptions);
-
-	Material* woodMat = new Material(vs, ps, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	woodMat->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\wood_albedo.png"));
-	woodMat->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\wood_normals.png"));
-	woodMat->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\wood_roughness.png"));
-	woodMat->AddPSSampler("BasicSampler", samplerOptions);
-
-
-	materials.push_back(cobbleMat2x);
-	materials.push_back(floorMat);
-	materials.push_back(paintMat);
-	materials.push_back(scratchedMat);
-	materials.push_back(bronzeMat);
-	materials.push_back(roughMat);
-	materials.push_back(woodMat);
-
-	// Create PBR materials
-	Material* cobbleMat2xPBR = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	cobbleMat2xPBR->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\cobblestone_albedo.png"));
-	cobbleMat2xPBR->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\cobblestone_normals.png"));
-	cobbleMat2xPBR->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\cobblestone_roughness.png"));
-	cobbleMat2xPBR->AddPSTextureSRV("MetalTexture", assets.GetTexture("Textures\\cobblestone_metal.png"));
-	cobbleMat2xPBR->AddPSSampler("BasicSampler", samplerOptions);
-	cobbleMat2xPBR->AddPSSampler("ClampSampler", clampSampler);
-
-	Material* floorMatPBR = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	floorMatPBR->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\floor_albedo.png"));
-	floorMatPBR->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\floor_normals.png"));
-	floorMatPBR->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\floor_roughness.png"));
-	floorMatPBR->AddPSTextureSRV("MetalTexture", assets.GetTexture("Textures\\floor_metal.png"));
-	floorMatPBR->AddPSSampler("BasicSampler", samplerOptions);
-	floorMatPBR->AddPSSampler("ClampSampler", clampSampler);
-
-	Material* paintMatPBR = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	paintMatPBR->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\paint_albedo.png"));
-	paintMatPBR->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\paint_normals.png"));
-	paintMatPBR->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\paint_roughness.png"));
-	paintMatPBR->AddPSTextureSRV("MetalTexture", assets.GetTexture("Textures\\paint_metal.png"));
-	paintMatPBR->AddPSSampler("BasicSampler", samplerOptions);
-	paintMatPBR->AddPSSampler("ClampSampler", clampSampler);
-
-	Material* scratchedMatPBR = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	scratchedMatPBR->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\scratched_albedo.png"));
-	scratchedMatPBR->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\scratched_normals.png"));
-	scratchedMatPBR->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\scratched_roughness.png"));
-	scratchedMatPBR->AddPSTextureSRV("MetalTexture", assets.GetTexture("Textures\\scratched_metal.png"));
-	scratchedMatPBR->AddPSSampler("BasicSampler", samplerOptions);
-	scratchedMatPBR->AddPSSampler("ClampSampler", clampSampler);
-
-	Material* bronzeMatPBR = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	bronzeMatPBR->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\bronze_albedo.png"));
-	bronzeMatPBR->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\bronze_normals.png"));
-	bronzeMatPBR->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\bronze_roughness.png"));
-	bronzeMatPBR->AddPSTextureSRV("MetalTexture", assets.GetTexture("Textures\\bronze_metal.png"));
-	bronzeMatPBR->AddPSSampler("BasicSampler", samplerOptions);
-	bronzeMatPBR->AddPSSampler("ClampSampler", clampSampler);
-
-	Material* roughMatPBR = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	roughMatPBR->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\rough_albedo.png"));
-	roughMatPBR->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\rough_normals.png"));
-	roughMatPBR->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\rough_roughness.png"));
-	roughMatPBR->AddPSTextureSRV("MetalTexture", assets.GetTexture("Textures\\rough_metal.png"));
-	roughMatPBR->AddPSSampler("BasicSampler", samplerOptions);
-	roughMatPBR->AddPSSampler("ClampSampler", clampSampler);
-
-	Material* woodMatPBR = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 256.0f, XMFLOAT2(2, 2));
-	woodMatPBR->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("Textures\\wood_albedo.png"));
-	woodMatPBR->AddPSTextureSRV("NormalTexture", assets.GetTexture("Textures\\wood_normals.png"));
-	woodMatPBR->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("Textures\\wood_roughness.png"));
-	woodMatPBR->AddPSTextureSRV("MetalTexture", assets.GetTexture("Textures\\wood_metal.png"));
-	woodMatPBR->AddPSSampler("BasicSampler", samplerOptions);
-	woodMatPBR->AddPSSampler("ClampSampler", clampSampler);
-
-	materials.push_back(cobbleMat2xPBR);
-	materials.push_back(floorMatPBR);
-	materials.push_back(paintMatPBR);
-	materials.push_back(scratchedMatPBR);
-	materials.push_back(bronzeMatPBR);
-	materials.push_back(roughMatPBR);
-	materials.push_back(woodMatPBR);
-
-
-	// === Create the PBR entities =====================================
-	Mesh* sphereMesh = assets.GetMesh("Models\\sphere.obj");
-	Mesh* cubeMesh = assets.GetMesh("Models\\cube.obj");
-
-	GameEntity* cobSpherePBR = new GameEntity(sphereMesh, cobbleMat2xPBR);
-	cobSpherePBR->GetTransform()->SetScale(2, 2, 2);
-	cobSpherePBR->GetTransform()->SetPosition(-6, 2, 0);
-
-	GameEntity* floorSpherePBR = new GameEntity(sphereMesh, floorMatPBR);
-	floorSpherePBR->GetTransform()->SetScale(2, 2, 2);
-	floorSpherePBR->GetTransform()->SetPosition(-4, 2, 0);
-
-	GameEntity* paintSpherePBR = new GameEntity(sphereMesh, paintMatPBR);
-	paintSpherePBR->GetTransform()->SetScale(2, 2, 2);
-	paintSpherePBR->GetTransform()->SetPosition(-2, 2, 0);
-
-	GameEntity* scratchSpherePBR = new GameEntity(sphereMesh, scratchedMatPBR);
-	scratchSpherePBR->GetTransform()->SetScale(2, 2, 2);
-	scratchSpherePBR->GetTransform()->SetPosition(0, 2, 0);
-
-	GameEntity* bronzeSpherePBR = new GameEntity(sphereMesh, bronzeMatPBR);
-	bronzeSpherePBR->GetTransform()->SetScale(2, 2, 2);
-	bronzeSpherePBR->GetTransform()->SetPosition(2, 2, 0);
-
-	GameEntity* roughSpherePBR = new GameEntity(sphereMesh, roughMatPBR);
-	roughSpherePBR->GetTransform()->SetScale(2, 2, 2);
-	roughSpherePBR->GetTransform()->SetPosition(4, 2, 0);
-
-	GameEntity* woodSpherePBR = new GameEntity(sphereMesh, woodMatPBR);
-	woodSpherePBR->GetTransform()->SetScale(2, 2, 2);
-	woodSpherePBR->GetTransform()->SetPosition(6, 2, 0);
-
-	GameEntity* floor = new GameEntity(cubeMesh, woodMatPBR);
-	floor->GetTransform()->SetScale(100, 0.1f, 100);
-	floor->GetTransform()->SetPosition(0, -5, 0);
-
-	entities.push_back(cobSpherePBR);
-	entities.push_back(floorSpherePBR);
-	entities.push_back(paintSpherePBR);
-	entities.push_back(scratchSpherePBR);
-	entities.push_back(bronzeSpherePBR);
-	entities.push_back(roughSpherePBR);
-	entities.push_back(woodSpherePBR);
-	entities.push_back(floor);
-
-	// Create the non-PBR entities ==============================
-	GameEntity* cobSphere = new GameEntity(sphereMesh, cobbleMat2x);
-	cobSphere->GetTransform()->SetScale(2, 2, 2);
-	cobSphere->GetTransform()->SetPosition(-6, -2, 0);
-
-	GameEntity* floorSphere = new GameEntity(sphereMesh, floorMat);
-	floorSphere->GetTransform()->SetScale(2, 2, 2);
-	floorSphere->GetTransform()->SetPosition(-4, -2, 0);
-
-	GameEntity* paintSphere = new GameEntity(sphereMesh, paintMat);
-	paintSphere->GetTransform()->SetScale(2, 2, 2);
-	paintSphere->GetTransform()->SetPosition(-2, -2, 0);
-
-	GameEntity* scratchSphere = new GameEntity(sphereMesh, scratchedMat);
-	scratchSphere->GetTransform()->SetScale(2, 2, 2);
-	scratchSphere->GetTransform()->SetPosition(0, -2, 0);
-
-	GameEntity* bronzeSphere = new GameEntity(sphereMesh, bronzeMat);
-	bronzeSphere->GetTransform()->SetScale(2, 2, 2);
-	bronzeSphere->GetTransform()->SetPosition(2, -2, 0);
-
-	GameEntity* roughSphere = new GameEntity(sphereMesh, roughMat);
-	roughSphere->GetTransform()->SetScale(2, 2, 2);
-	roughSphere->GetTransform()->SetPosition(4, -2, 0);
-
-	GameEntity* woodSphere = new GameEntity(sphereMesh, woodMat);
-	woodSphere->GetTransform()->SetScale(2, 2, 2);
-	woodSphere->GetTransform()->SetPosition(6, -2, 0);
-
-	entities.push_back(cobSphere);
-	entities.push_back(floorSphere);
-	entities.push_back(paintSphere);
-	entities.push_back(scratchSphere);
-	entities.push_back(bronzeSphere);
-	entities.push_back(roughSphere);
-	entities.push_back(woodSphere);
-
-
-	// Create simple PBR materials & entities (mostly for IBL testing)
+	// Solid colors for simple materials, and to stand in for textures still streaming
 	assets.CreateSolidColorTexture("white", 2, 2, XMFLOAT4(1, 1, 1, 1));
 	assets.CreateSolidColorTexture("black", 2, 2, XMFLOAT4(0, 0, 0, 0));
 	assets.CreateSolidColorTexture("grey", 2, 2, XMFLOAT4(0.5f, 0.5f, 0.5f, 1));
 	assets.CreateSolidColorTexture("darkGrey", 2, 2, XMFLOAT4(0.25f, 0.25f, 0.25f, 1));
 	assets.CreateSolidColorTexture("flatNormalMap", 2, 2, XMFLOAT4(0.5f, 0.5f, 1.0f, 1.0f));
 
-	Material* solidShinyMetal = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 0.0f, XMFLOAT2(1, 1));
-	solidShinyMetal->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("white"));
-	solidShinyMetal->AddPSTextureSRV("NormalTexture", assets.GetTexture("flatNormalMap"));
-	solidShinyMetal->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("black"));
-	solidShinyMetal->AddPSTextureSRV("MetalTexture", assets.GetTexture("white"));
-	solidShinyMetal->AddPSSampler("BasicSampler", samplerOptions);
-	solidShinyMetal->AddPSSampler("ClampSampler", clampSampler);
-	materials.push_back(solidShinyMetal);
-
-	Material* solidQuarterRoughMetal = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 0.0f, XMFLOAT2(1, 1));
-	solidQuarterRoughMetal->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("white"));
-	solidQuarterRoughMetal->AddPSTextureSRV("NormalTexture", assets.GetTexture("flatNormalMap"));
-	solidQuarterRoughMetal->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("darkGrey"));
-	solidQuarterRoughMetal->AddPSTextureSRV("MetalTexture", assets.GetTexture("white"));
-	solidQuarterRoughMetal->AddPSSampler("BasicSampler", samplerOptions);
-	solidQuarterRoughMetal->AddPSSampler("ClampSampler", clampSampler);
-	materials.push_back(solidQuarterRoughMetal);
-
-	Material* solidHalfRoughMetal = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 0.0f, XMFLOAT2(1, 1));
-	solidHalfRoughMetal->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("white"));
-	solidHalfRoughMetal->AddPSTextureSRV("NormalTexture", assets.GetTexture("flatNormalMap"));
-	solidHalfRoughMetal->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("grey"));
-	solidHalfRoughMetal->AddPSTextureSRV("MetalTexture", assets.GetTexture("white"));
-	solidHalfRoughMetal->AddPSSampler("BasicSampler", samplerOptions);
-	solidHalfRoughMetal->AddPSSampler("ClampSampler", clampSampler);
-	materials.push_back(solidHalfRoughMetal);
-
-	Material* solidShinyPlastic = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 0.0f, XMFLOAT2(1, 1));
-	solidShinyPlastic->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("white"));
-	solidShinyPlastic->AddPSTextureSRV("NormalTexture", assets.GetTexture("flatNormalMap"));
-	solidShinyPlastic->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("black"));
-	solidShinyPlastic->AddPSTextureSRV("MetalTexture", assets.GetTexture("black"));
-	solidShinyPlastic->AddPSSampler("BasicSampler", samplerOptions);
-	solidShinyPlastic->AddPSSampler("ClampSampler", clampSampler);
-	materials.push_back(solidShinyPlastic);
-
-	Material* solidQuarterRoughPlastic = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 0.0f, XMFLOAT2(1, 1));
-	solidQuarterRoughPlastic->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("white"));
-	solidQuarterRoughPlastic->AddPSTextureSRV("NormalTexture", assets.GetTexture("flatNormalMap"));
-	solidQuarterRoughPlastic->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("darkGrey"));
-	solidQuarterRoughPlastic->AddPSTextureSRV("MetalTexture", assets.GetTexture("black"));
-	solidQuarterRoughPlastic->AddPSSampler("BasicSampler", samplerOptions);
-	solidQuarterRoughPlastic->AddPSSampler("ClampSampler", clampSampler);
-	materials.push_back(solidQuarterRoughPlastic);
-
-	Material* solidHalfRoughPlastic = new Material(vs, psPBR, XMFLOAT4(1, 1, 1, 1), 0.0f, XMFLOAT2(1, 1));
-	solidHalfRoughPlastic->AddPSTextureSRV("AlbedoTexture", assets.GetTexture("white"));
-	solidHalfRoughPlastic->AddPSTextureSRV("NormalTexture", assets.GetTexture("flatNormalMap"));
-	solidHalfRoughPlastic->AddPSTextureSRV("RoughnessTexture", assets.GetTexture("grey"));
-	solidHalfRoughPlastic->AddPSTextureSRV("MetalTexture", assets.GetTexture("black"));
-	solidHalfRoughPlastic->AddPSSampler("BasicSampler", samplerOptions);
-	solidHalfRoughPlastic->AddPSSampler("ClampSampler", clampSampler);
-	materials.push_back(solidHalfRoughPlastic);
-
-
-
-	GameEntity* shinyMetal = new GameEntity(sphereMesh, solidShinyMetal);
-	shinyMetal->GetTransform()->SetPosition(-5, 0, 0);
-	entities.push_back(shinyMetal);
-
-	GameEntity* quarterRoughMetal = new GameEntity(sphereMesh, solidQuarterRoughMetal);
-	quarterRoughMetal->GetTransform()->SetPosition(-3.5f, 0, 0);
-	entities.push_back(quarterRoughMetal);
-
-	GameEntity* roughMetal = new GameEntity(sphereMesh, solidHalfRoughMetal);
-	roughMetal->GetTransform()->SetPosition(-2, 0, 0);
-	entities.push_back(roughMetal);
-
-	GameEntity* shinyPlastic = new GameEntity(sphereMesh, solidShinyPlastic);
-	shinyPlastic->GetTransform()->SetPosition(2, 0, 0);
-	entities.push_back(shinyPlastic);
+	// The level, from -scene when it's given (and can be read), or
+	// the built in one otherwise
+	//  - Binary scenes are used straight from their mapping
+	SceneData sceneData;
+	SceneFile sceneFile;
+	SceneView scene = {};
+	const std::string& scenePath = benchmarkOptions.ScenePath;
+	bool textScene = SceneData::IsTextPath(scenePath);
+	if (!scenePath.empty())
+	{
+		if (textScene ? sceneData.LoadText(scenePath) : sceneFile.Open(scenePath))
+			scene = textScene ? sceneData.GetView() : sceneFile.GetView();
+		if (scene.MaterialCount == 0)
+			printf("Couldn't load a scene (with materials) from %s, so using the built in one\n", scenePath.c_str());
+	}
+	if (scene.MaterialCount == 0)
+	{
+		sceneFile.Close();
+		BuildDefaultScene(sceneData);
+		scene = sceneData.GetView();
+	}
+	if (!benchmarkOptions.ExportScenePath.empty())
+	{
+		if (sceneFile.IsOpen())
+			sceneData.Load(scenePath);
+
+		// A copy, since the view might be of this one
+		SceneData exported = sceneData;
+		if (stressOptions.Enabled)
+			AddStressScene(exported);
+		exported.Save(benchmarkOptions.ExportScenePath);
+	}
+	CreateScene(scene);
 
-	GameEntity* quarterRoughPlastic = new GameEntity(sphereMesh, solidQuarterRoughPlastic);
-	quarterRoughPlastic->GetTransform()->SetPosition(3.5f, 0, 0);
-	entities.push_back(quarterRoughPlastic);
+	//Projectiles (made as they're first fired, and drawn as one batch)
+	projectiles = new ProjectilePool(Assets::GetInstance().GetMesh("Models\\sphere.obj"), materials[0]);
 
-	GameEntity* roughPlastic = new GameEntity(sphereMesh, solidHalfRoughPlastic);
-	roughPlastic->GetTransform()->SetPosition(5, 0, 0);
-	entities.push_back(roughPlastic);
+}
 
+// --------------------------------------------------------
+// The scene the game's always had, as scene data, which is
+// also what -export-scene writes when there's no -scene
+// --------------------------------------------------------
+void Game::BuildDefaultScene(SceneData& scene)
+{
+	scene.Clear();
+	unsigned int sphere = scene.AddName("Models\\sphere.obj");
+	unsigned int cube = scene.AddName("Models\\cube.obj");
 
-	// Transform test =====================================
-	entities[0]->GetTransform()->AddChild(entities[1]->GetTransform(), true);
+	auto addMaterial = [&](const char* ps, float shininess, float uvScale, unsigned int flags)
+	{
+		SceneFileMaterial m = {};
+		m.VertexShader = scene.AddName("VertexShader.cso");
+		m.PixelShader = scene.AddName(ps);
+		m.Color = XMFLOAT4(1, 1, 1, 1);
+		m.Shininess = shininess;
+		m.UVScale = XMFLOAT2(uvScale, uvScale);
+		m.Flags = flags;
+		scene.Materials.push_back(m);
+		return (unsigned int)scene.Materials.size() - 1;
+	};
+
+	auto addEntity = [&](unsigned int mesh, unsigned int material, XMFLOAT3 position, float scale, int parent = -1)
+	{
+		SceneFileEntity e = {};
+		e.Mesh = mesh;
+		e.Material = material;
+		e.Parent = parent;
+		e.Position = position;
+		e.Scale = XMFLOAT3(scale, scale, scale);
+		scene.Entities.push_back(e);
+	};
+
+	// Basic and PBR versions of each textured material, with textures
+	// that stream in after the first frame
+	const char* textures[] = { "cobblestone", "floor", "paint", "scratched", "bronze", "rough", "wood" };
+	const int textureCount = sizeof(textures) / sizeof(textures[0]);
+	for (int pbr = 0; pbr < 2; pbr++)
+	{
+		for (int i = 0; i < textureCount; i++)
+		{
+			std::string path = std::string("Textures\\") + textures[i];
+			addMaterial(pbr ? "PixelShaderPBR.cso" : "PixelShader.cso", 256.0f, 2.0f, pbr ? SCENE_MATERIAL_CLAMP_SAMPLER : 0);
+			scene.AddTexture("AlbedoTexture", path + "_albedo.png", SCENE_TEXTURE_STREAMED);
+			scene.AddTexture("NormalTexture", path + "_normals.png", SCENE_TEXTURE_STREAMED);
+			scene.AddTexture("RoughnessTexture", path + "_roughness.png", SCENE_TEXTURE_STREAMED);
+			if (pbr)
+				scene.AddTexture("MetalTexture", path + "_metal.png", SCENE_TEXTURE_STREAMED);
+		}
+	}
 
-	//Projectiles
-	for (int i = 0; i < MAX_PROJECTILES; i++)
+	// Solid PBR materials, mostly for IBL testing: metal then plastic,
+	// each shiny, a quarter rough and half rough
+	const char* roughness[] = { "black", "darkGrey", "grey" };
+	for (int metal = 1; metal >= 0; metal--)
 	{
-		Projectile* bullet = new Projectile(Assets::GetInstance().GetMesh("Models\\sphere.obj"), materials[0], 5);
-		entities.push_back(bullet);
-		projectiles[i] = bullet;
-		bullet->dead = true;
-		Transform* tf = bullet->GetTransform();
-		tf->SetScale(0.2f, 0.2f, 0.2f);
-		tf->SetPosition(0, -5000, 0);
+		for (int r = 0; r < 3; r++)
+		{
+			addMaterial("PixelShaderPBR.cso", 0.0f, 1.0f, SCENE_MATERIAL_CLAMP_SAMPLER);
+			scene.AddTexture("AlbedoTexture", "white", 0);
+			scene.AddTexture("NormalTexture", "flatNormalMap", 0);
+			scene.AddTexture("RoughnessTexture", roughness[r], 0);
+			scene.AddTexture("MetalTexture", metal ? "white" : "black", 0);
+		}
 	}
 
-	emitters.push_back(new Emitter(200, 50, 2, device, context, assets.GetVertexShader("ParticleVS.cso"), assets.GetPixelShader("ParticlePS.cso"),
-		assets.GetTexture("Textures\\Particles\\PNG (Black background)\\smoke_01.png")));
+	// A row of PBR spheres above a row of basic ones, on a floor, with the
+	// first's neighbour parented to it (as a transform test, staying where
+	// it would have been)
+	for (int i = 0; i < textureCount; i++)
+	{
+		if (i == 1)
+			addEntity(sphere, textureCount + i, XMFLOAT3(1, 0, 0), 1.0f, 0);
+		else
+			addEntity(sphere, textureCount + i, XMFLOAT3(-6.0f + i * 2, 2, 0), 2.0f);
+	}
+	addEntity(cube, textureCount * 2 - 1, XMFLOAT3(0, -5, 0), 1.0f);
+	scene.Entities.back().Scale = XMFLOAT3(100, 0.1f, 100);
+	for (int i = 0; i < textureCount; i++)
+		addEntity(sphere, i, XMFLOAT3(-6.0f + i * 2, -2, 0), 2.0f);
 
-}
-
-
-// --------------------------------------------------------
-// Generates the lights in the scene: 3 directional lights
-// and many random point lights.
-// --------------------------------------------------------
-void Game::GenerateLights()
-{
-	// Reset
-	lights.clear();
+	const float solidX[] = { -5, -3.5f, -2, 2, 3.5f, 5 };
+	for (int i = 0; i < 6; i++)
+		addEntity(sphere, textureCount * 2 + i, XMFLOAT3(solidX[i], 0, 0), 1.0f);
 
-	// Setup directional lights
+	// Three directional lights, with shadows from the first (the
+	// point lights are made to fill out the light count)
 	Light dir1 = {};
 	dir1.Type = LIGHT_TYPE_DIRECTIONAL;
 	dir1.Direction = XMFLOAT3(1, -1, 1);
@@ -543,13 +521,195 @@ void Game::GenerateLights()
 	dir3.Color = XMFLOAT3(0.2f, 0.2f, 0.2f);
 	dir3.Intensity = 1.0f;
 
-	// Add light to the list
-	lights.push_back(dir1);
-	lights.push_back(dir2);
-	lights.push_back(dir3);  //Only want one directional light for shadows
+	scene.Lights.push_back(dir1);
+	scene.Lights.push_back(dir2);
+	scene.Lights.push_back(dir3);
+
+	// Smoke, simulated on the GPU
+	SceneFileEmitter smoke = {};
+	smoke.VertexShader = scene.AddName("ParticleVS.cso");
+	smoke.PixelShader = scene.AddName("ParticlePS.cso");
+	smoke.Texture = scene.AddName("Textures\\Particles\\PNG (Black background)\\smoke_01.png");
+	smoke.Flags = SCENE_EMITTER_GPU_SIMULATED;
+	smoke.MaxParticles = 200;
+	smoke.ParticlesPerSecond = 50;
+	smoke.Lifetime = 2;
+	scene.Emitters.push_back(smoke);
+}
+
+// --------------------------------------------------------
+// Starts streaming one of a material's textures, with a
+// placeholder that looks close enough until it's in
+//  - Albedo (the most noticeable when it's missing) comes
+//    first, then normals, then everything else
+// --------------------------------------------------------
+void Game::StreamMaterialTexture(Material* material, const std::string& slot, const std::string& name)
+{
+	std::string placeholder = slot == "NormalTexture" ? "flatNormalMap" : (slot == "MetalTexture" ? "black" : "grey");
+	float priority = slot == "AlbedoTexture" ? 2.0f : (slot == "NormalTexture" ? 1.0f : 0.0f);
+	TextureRequest* request = Assets::GetInstance().RequestTexture(name, priority, placeholder,
+		[material, slot](Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) { material->SetPSTextureSRV(slot, srv); });
+	material->AddPSTextureSRV(slot, request->SRV);
+}
+
+// --------------------------------------------------------
+// Swaps a reloaded asset into everything here that kept a
+// pointer to the old one, rather than a handle
+//  - Streamed textures are already swapped by their requests
+// --------------------------------------------------------
+void Game::OnAssetReloaded(const AssetReload& reload)
+{
+	for (auto m : materials)
+	{
+		if (reload.OldShader)
+			m->ReplaceShader(reload.OldShader, reload.NewShader);
+
+		// Found first, since setting them rebinds the material's textures
+		if (reload.OldTexture)
+		{
+			std::vector<std::string> slots;
+			for (auto& t : m->GetPSTextureSRVs())
+				if (t.second == reload.OldTexture)
+					slots.push_back(t.first);
+			for (auto& slot : slots)
+				m->SetPSTextureSRV(slot, reload.NewTexture);
+		}
+	}
+
+	if (reload.OldMesh)
+	{
+		for (unsigned int i = 0; i < entities.GetCount(); i++)
+			if (entities.GetEntity(i)->GetMesh() == reload.OldMesh)
+				entities.SetMesh(entities.GetEntity(i), reload.NewMesh);
+		if (lightMesh == reload.OldMesh)
+			lightMesh = reload.NewMesh;
+	}
+
+	if (reload.OldShader && lightVS == reload.OldShader)
+		lightVS = (SimpleVertexShader*)reload.NewShader;
+	if (reload.OldShader && lightPS == reload.OldShader)
+		lightPS = (SimplePixelShader*)reload.NewShader;
+}
+
+// --------------------------------------------------------
+// Makes a scene's materials, entities and emitters, and
+// keeps its lights for GenerateLights()
+//  - Each asset's handle is made once, from the hash the
+//    scene already has for its name, then every record
+//    that uses it just indexes what it resolved to
+//  - The registry's grown for every entity up front, so
+//    making each one is only constructing it in its slot
+// --------------------------------------------------------
+void Game::CreateScene(const SceneView& scene)
+{
+	LoadProfileScope profile("Scene", "Create");
+	auto start = std::chrono::high_resolution_clock::now();
+	Assets& assets = Assets::GetInstance();
+
+	std::vector<Mesh*> meshes(scene.NameCount, 0);
+	std::vector<bool> resolved(scene.NameCount, false);
+	auto getMesh = [&](unsigned int name)
+	{
+		if (!resolved[name])
+		{
+			meshes[name] = assets.GetMesh(scene.GetKey(name));
+			resolved[name] = true;
+		}
+		return meshes[name];
+	};
+
+	unsigned int firstMaterial = (unsigned int)materials.size();
+	for (unsigned int i = 0; i < scene.MaterialCount; i++)
+	{
+		const SceneFileMaterial& m = scene.Materials[i];
+		SimpleVertexShader* vs = assets.GetVertexShader(scene.GetKey(m.VertexShader));
+		SimplePixelShader* ps = assets.GetPixelShader(scene.GetKey(m.PixelShader));
+		if (!vs || !ps)
+		{
+			printf("Scene material %u has shaders that aren't loaded, so it's drawn with the basic ones\n", i);
+			vs = assets.GetVertexShader("VertexShader.cso");
+			ps = assets.GetPixelShader("PixelShader.cso");
+		}
+
+		Material* material = new Material(vs, ps, m.Color, m.Shininess, m.UVScale);
+		for (unsigned int t = 0; t < m.TextureCount; t++)
+		{
+			const SceneFileTexture& texture = m.Textures[t];
+			if (texture.Flags & SCENE_TEXTURE_STREAMED)
+				StreamMaterialTexture(material, scene.GetName(texture.Slot), scene.GetName(texture.Texture));
+			else
+				material->AddPSTextureSRV(scene.GetName(texture.Slot), assets.GetTexture(scene.GetKey(texture.Texture)));
+		}
+		material->AddPSSampler("BasicSampler", samplerOptions);
+		if (m.Flags & SCENE_MATERIAL_CLAMP_SAMPLER)
+			material->AddPSSampler("ClampSampler", clampSampler);
+		materials.push_back(material);
+	}
+
+	entities.Reserve(entities.GetCount() + scene.EntityCount);
+	std::vector<GameEntity*> created(scene.EntityCount, 0);
+	unsigned int skipped = 0;
+	for (unsigned int i = 0; i < scene.EntityCount; i++)
+	{
+		const SceneFileEntity& e = scene.Entities[i];
+		Mesh* mesh = getMesh(e.Mesh);
+		if (!mesh)
+		{
+			skipped++;
+			continue;
+		}
+
+		GameEntity* entity = entities.CreateEntity(mesh, materials[firstMaterial + e.Material]);
+		Transform* transform = entity->GetTransform();
+		transform->SetPosition(e.Position.x, e.Position.y, e.Position.z);
+		transform->SetRotation(e.PitchYawRoll.x, e.PitchYawRoll.y, e.PitchYawRoll.z);
+		transform->SetScale(e.Scale.x, e.Scale.y, e.Scale.z);
+		if (e.Parent >= 0 && created[e.Parent])
+			created[e.Parent]->GetTransform()->AddChild(transform, false);
+		created[i] = entity;
+	}
+
+	sceneLights.assign(scene.Lights, scene.Lights + scene.LightCount);
+
+	for (unsigned int i = 0; i < scene.EmitterCount; i++)
+	{
+		const SceneFileEmitter& e = scene.Emitters[i];
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture;
+		if (e.Texture != SCENE_FILE_NO_NAME)
+		{
+			// Emitters can't wait for the streaming thread
+			TextureRequest* request = assets.RequestTexture(scene.GetName(e.Texture), 0);
+			assets.WaitForTexture(request);
+			texture = request->SRV;
+		}
+
+		Emitter* emitter = new Emitter(e.MaxParticles, e.ParticlesPerSecond, e.Lifetime, device, context,
+			assets.GetVertexShader(scene.GetKey(e.VertexShader)), assets.GetPixelShader(scene.GetKey(e.PixelShader)),
+			texture, (e.Flags & SCENE_EMITTER_GPU_SIMULATED) != 0);
+		emitter->SetPosition(e.Position);
+		emitters.push_back(emitter);
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("Made %u materials, %u entities and %u emitters from the scene in %.2fms", scene.MaterialCount, scene.EntityCount - skipped, scene.EmitterCount, ms);
+	if (skipped)
+		printf(" (skipping %u without a mesh)", skipped);
+	printf("\n");
+}
+
+
+// --------------------------------------------------------
+// Generates the lights in the scene: the scene's own (which
+// are 3 directional lights in the built in one), and many
+// random point lights.
+// --------------------------------------------------------
+void Game::GenerateLights()
+{
+	// The scene's lights (only one directional light should cast shadows)
+	std::vector<Light> generated = sceneLights;
 
 	// Create the rest of the lights
-	while (lights.size() < lightCount)
+	while (generated.size() < lightCount)
 	{
 		Light point = {};
 		point.Type = LIGHT_TYPE_POINT;
@@ -557,11 +717,15 @@ void Game::GenerateLights()
 		point.Color = XMFLOAT3(RandomRange(0, 1), RandomRange(0, 1), RandomRange(0, 1));
 		point.Range = RandomRange(5.0f, 10.0f);
 		point.Intensity = RandomRange(0.1f, 3.0f);
+		point.CastsShadows = generated.size() < sceneLights.size() + GAME_SHADOWED_POINT_LIGHTS;
 
 		// Add to the list
-		lights.push_back(point);
+		generated.push_back(point);
 	}
 
+	// Replaces them all, so every one's uploaded again
+	lights.Assign(generated);
+
 }
 
 
@@ -575,7 +739,7 @@ void Game::OnResize()
 	// Handle base-level DX resize stuff
 	DXCore::OnResize();
 
-	renderer->PostResize(this->width, this->height, backBufferRTV, depthStencilView);
+	renderer->PostResize(this->width, this->height, backBufferRTV, depthStencilView, depthStencilSRV);
 
 	// Update our projection matrix to match the new aspect ratio
 	if (camera)
@@ -583,188 +747,1900 @@ void Game::OnResize()
 }
 
 // --------------------------------------------------------
-// Update your game here - user input, move objects, AI, etc.
+// Decides which emitters are on screen, and how often each
+// of those should update for how far away it is
 // --------------------------------------------------------
-void Game::Update(float deltaTime, float totalTime)
+void Game::CullEmitters()
 {
+	const ViewConstants& view = camera->GetViewConstants();
+	BoundingFrustum frustum(XMLoadFloat4x4(&view.Projection));
+	frustum.Transform(frustum, XMLoadFloat4x4(&view.InvView));
+	XMFLOAT3 cameraPosition = camera->GetTransform()->GetPosition();
+	XMVECTOR cameraPos = XMLoadFloat3(&cameraPosition);
+
+	visibleEmitterCount = 0;
+	for (auto e : emitters)
+	{
+		if (!emitterCulling)
+		{
+			e->SetVisible(true);
+			e->SetUpdateInterval(1);
+			continue;
+		}
 
-	// Reset input manager's gui state so we dont
-	// taint our own input (youll uncomment later)
-	input.SetGuiKeyboardCapture(false);
-	input.SetGuiMouseCapture(false);
-	// Set io info
-	ImGuiIO& io = ImGui::GetIO();
-	io.DeltaTime = deltaTime;
-	io.DisplaySize.x = (float)this->width;
-	io.DisplaySize.y = (float)this->height;
-	io.KeyCtrl = input.KeyDown(VK_CONTROL);
-	io.KeyShift = input.KeyDown(VK_SHIFT);
-	io.KeyAlt = input.KeyDown(VK_MENU);
-	io.MousePos.x = (float)input.GetMouseX();
-	io.MousePos.y = (float)input.GetMouseY();
-	io.MouseDown[0] = input.MouseLeftDown();
-	io.MouseDown[1] = input.MouseRightDown();
-	io.MouseDown[2] = input.MouseMiddleDown();
-	io.MouseWheel = input.GetMouseWheel();
-	input.GetKeyArray(io.KeysDown, 256);
-
-	// Reset the frame
-	ImGui_ImplDX11_NewFrame();
-	ImGui_ImplWin32_NewFrame();
-	ImGui::NewFrame();
-	// Determine new input capture (youll uncomment later)
-	input.SetGuiKeyboardCapture(io.WantCaptureKeyboard);
-	input.SetGuiMouseCapture(io.WantCaptureMouse);
-
-	// Show the demo window
-	//ImGui:: ShowDemoWindow();
+		BoundingBox bounds = e->GetBounds();
+		bool visible = frustum.Intersects(bounds);
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - cameraPos));
+		e->SetVisible(visible);
+		e->SetUpdateInterval(!visible ? 0 : distance > EMITTER_THROTTLE_DISTANCE ? EMITTER_THROTTLED_INTERVAL : 1);
+		if (visible)
+			visibleEmitterCount++;
+	}
+}
 
-	ImGui::Begin("Render Targets");
+// --------------------------------------------------------
+// Hands the benchmark the scene's particle shaders and
+// texture, with the renderer's batching and the emitter
+// culling off until it's done
+// --------------------------------------------------------
+void Game::StartParticleBenchmark()
+{
+	if (particleBenchmark.IsRunning() || emitters.empty())
+		return;
 
-	ImGui::Text("Shadow Map");
-	ImGui::Image(renderer->GetShadowSRV().Get(), ImVec2(500, 500));
-	ImGui::Text("SSAO");
-	ImGui::Image(renderer->GetSSAO().Get(), ImVec2(500, 300));
-	ImGui::Text("Scene Color");
-	ImGui::Image(renderer->GetSceneColorsSRV().Get(), ImVec2(500, 300));
-	ImGui::Text("Scene Normals");
-	ImGui::Image(renderer->GetSceneNormalsSRV().Get(), ImVec2(500, 300));
-	ImGui::Text("Scene Ambient Color");
-	ImGui::Image(renderer->GetSceneAmbientSRV().Get(), ImVec2(500, 300));
-	ImGui::Text("Scene Depth");
-	ImGui::Image(renderer->GetSceneDepthSRV().Get(), ImVec2(500, 300));
+	benchmarkSavedBatching = renderer->GetBatchedParticles();
+	benchmarkSavedCulling = emitterCulling;
+	renderer->SetBatchedParticles(false);
+	emitterCulling = false;
 
-	ImGui::End();
+	Assets& assets = Assets::GetInstance();
+	particleBenchmark.Start(particleBenchmarkSettings, emitters, camera, device, context,
+		assets.GetVertexShader("ParticleVS.cso"), emitters[0]->GetPixelShader(), emitters[0]->GetTexture());
+}
 
-	ImGui::Begin("Object Manager");
-	if (ImGui::CollapsingHeader("Lights"))
+// --------------------------------------------------------
+// Starts rebuilding the sky once all six faces of the one
+// that was picked have streamed in, then keeps the rebuild
+// going within its budget
+// --------------------------------------------------------
+void Game::UpdateSky()
+{
+	if (pendingSkyIndex >= 0)
 	{
-		for (size_t i = 0; i < lights.size(); i++)
+		bool loaded = true;
+		for (int i = 0; i < 6; i++)
 		{
-			if (ImGui::TreeNode(("Light " + std::to_string(i + 1)).c_str()))
+			TextureRequestState state = skyFaceRequests[i]->State.load();
+			if (state == TextureRequestState::Failed)
 			{
-				if(lights[i].Type == LIGHT_TYPE_POINT)
-					ImGui::DragFloat3("Position", &lights[i].Position.x, 0.1f);
-				else
-					ImGui::DragFloat3("Direction", &lights[i].Direction.x, 0.1f);
-				ImGui::DragFloat("Intensity", &lights[i].Intensity);
-				ImGui::ColorEdit4("Color", &lights[i].Color.x);
-				ImGui::TreePop();
+				printf("Couldn't load the faces of sky %s\n", skyNames[pendingSkyIndex]);
+				pendingSkyIndex = -1;
+				return;
 			}
+			loaded = loaded && state == TextureRequestState::Loaded;
 		}
-	}
-	
-	if (ImGui::CollapsingHeader("Entities"))
-	{
-		for (size_t i = 0; i < entities.size(); i++)
+
+		if (loaded)
 		{
-			if (ImGui::TreeNode(("Object" + std::to_string(i + 1)).c_str()))
-			{
-				XMFLOAT3 pos = entities[i]->GetTransform()->GetPosition();
-				XMFLOAT3 rot = entities[i]->GetTransform()->GetPitchYawRoll();
-				XMFLOAT3 scl = entities[i]->GetTransform()->GetScale();
-				ImGui::DragFloat3("Position", &pos.x, 0.5f);
-				ImGui::DragFloat3("Rotation", &rot.x, 0.1f);
-				ImGui::DragFloat3("Scale", &scl.x, 0.5f);
-				entities[i]->GetTransform()->SetPosition(pos.x, pos.y, pos.z);
-				entities[i]->GetTransform()->SetRotation(rot.x, rot.y, rot.z);
-				entities[i]->GetTransform()->SetScale(scl.x, scl.y, scl.z);
-				ImGui::TreePop();
-			}
+			sky->RebuildIBL(
+				skyFaceRequests[0]->SRV,
+				skyFaceRequests[1]->SRV,
+				skyFaceRequests[2]->SRV,
+				skyFaceRequests[3]->SRV,
+				skyFaceRequests[4]->SRV,
+				skyFaceRequests[5]->SRV);
+			skyIndex = pendingSkyIndex;
+			pendingSkyIndex = -1;
 		}
 	}
-	ImGui::End();
 
-	ImGui::Begin("Network Manager");
+	sky->UpdateIBL(skyRebuildBudgetMs);
+}
 
-	NetworkState s = netManager->GetNetworkState();
-	if (s == NetworkState::Offline)
+// --------------------------------------------------------
+// Runs ticked on this thread, a fixed step at a time, so
+// every run simulates the same frames however fast it draws
+//  - Anything wrong with the options quits with an error
+// --------------------------------------------------------
+void Game::StartScriptedBenchmark()
+{
+	pipelinedSimulation = false;
+	fixedTimestep = true;
+	SetFixedTimestep(benchmarkOptions.Timestep);
+	SetVSyncMode(VSyncMode::Off);
+	SetFrameRateCap(0.0f);
+	SetBackgroundFrameRate(-1.0f);
+
+	if (!benchmarkOptions.Sky.empty())
 	{
-		ImGui::InputText("##text1", ip, 15);
-		ImGui::InputText("##text2", port, 6);
-
-		if (ImGui::Button("Connect"))
+		int index = -1;
+		for (int i = 0; i < (int)IM_ARRAYSIZE(skyNames); i++)
 		{
-			char* pEnd;
-			netManager->Connect(ip, strtol(port, &pEnd, 0), localPlayer, Assets::GetInstance().GetMesh("Models\\sphere.obj"), materials[0]);
+			if (benchmarkOptions.Sky == skyNames[i])
+				index = i;
+		}
+		if (index < 0)
+		{
+			printf("Unknown sky %s\n", benchmarkOptions.Sky.c_str());
+			Quit(1);
+			return;
 		}
+		if (index != skyIndex)
+			RequestSky(index);
 	}
-	else if (s == NetworkState::Connecting)
+
+	for (const std::string& setting : benchmarkOptions.Settings)
 	{
-		ImGui::Text("Connecting...");
+		size_t equals = setting.find('=');
+		if (equals == std::string::npos || !renderer->ApplySetting(setting.substr(0, equals), setting.substr(equals + 1)))
+		{
+			printf("Unknown renderer setting %s\n", setting.c_str());
+			Quit(1);
+			return;
+		}
 	}
-	else if (s == NetworkState::Connected)
-	{
-		ImGui::Text("Connected!");
 
-		if (ImGui::Button("Disconnect"))
+	// Drawn in place of the scene, which the path can't move
+	if (!benchmarkOptions.ReplayFile.empty())
+	{
+		if (!frameCapture.Load(benchmarkOptions.ReplayFile))
 		{
-			netManager->Disconnect();
+			Quit(1);
+			return;
+		}
+		StartFrameReplay();
+		if (!frameReplay.IsRunning())
+		{
+			Quit(1);
+			return;
 		}
 	}
-	ImGui::End();
+	else
+		StopFrameReplay();
 
-	Input& input = Input::GetInstance();
+	if (!scriptedBenchmark.Start(benchmarkOptions))
+		Quit(1);
+}
+
+// --------------------------------------------------------
+// Swaps the loaded capture in for the scene, with its sky
+// --------------------------------------------------------
+void Game::StartFrameReplay()
+{
+	if (!frameReplay.Start(frameCapture, entities, materials, lights, lightCount, emitters, camera))
+		return;
+
+	const FrameCaptureHeader& header = frameCapture.Header;
+	if (header.Width != width || header.Height != height)
+		printf("Frame capture was %ux%u, but the window's %ux%u\n", header.Width, header.Height, width, height);
+	if (header.SkyIndex >= 0 && header.SkyIndex < (int)IM_ARRAYSIZE(skyNames) && header.SkyIndex != skyIndex)
+		RequestSky(header.SkyIndex);
+	interpolator.Snap(camera->GetTransform());
+}
 
-	netManager->Update(deltaTime, localPlayer, projectiles);
+void Game::StopFrameReplay()
+{
+	if (!frameReplay.IsRunning())
+		return;
 
-	// Update the camera
-	camera->Update(deltaTime);
-	localPlayer->Update(deltaTime);
+	frameReplay.Stop(entities, lights, lightCount, emitters, camera);
+	interpolator.Snap(camera->GetTransform());
+}
 
-	if (input.MouseLeftPress())
+// --------------------------------------------------------
+// Sets the scene up how the suite's next scenario wants it
+// (with or without a stress scene), then benchmarks it
+// --------------------------------------------------------
+void Game::StartRegressionScenario()
+{
+	const RegressionScenario& scenario = regressionSuite.GetScenario();
+	printf("Regression scenario: %s\n", scenario.Name.c_str());
+	benchmarkOptions = scenario.Options;
+	stressOptions = scenario.Options.Stress;
+	if (stressOptions.Enabled)
+		GenerateStressScene();
+	else
+		ClearStressScene();
+	StartScriptedBenchmark();
+}
+
+// --------------------------------------------------------
+// Spreads the stress scene over every material, and the
+// basic shapes, with the demo's particle texture
+// --------------------------------------------------------
+void Game::GenerateStressScene()
+{
+	Assets& assets = Assets::GetInstance();
+	std::vector<Mesh*> meshes;
+	for (const char* name : stressMeshNames)
+	{
+		Mesh* mesh = assets.GetMesh(std::string("Models\\") + name + ".obj");
+		if (mesh) meshes.push_back(mesh);
+	}
+
+	TextureRequest* particleTexture = assets.RequestTexture(stressParticleTexture, 0);
+	assets.WaitForTexture(particleTexture);
+
+	stressScene.Generate(stressOptions, entities, meshes, materials, lights, emitters, device, context,
+		assets.GetVertexShader("ParticleVS.cso"), assets.GetPixelShader("ParticlePS.cso"), particleTexture->SRV);
+	lightCount = (int)lights.GetCount();
+}
+
+void Game::ClearStressScene()
+{
+	stressScene.Clear(entities, lights, emitters);
+	lightCount = (int)lights.GetCount();
+}
+
+// --------------------------------------------------------
+// The stress scene as scene data (for -stress with
+// -export-scene), laid out from the same meshes and the
+// scene's own materials, so -scene loads the same level
+// --------------------------------------------------------
+void Game::AddStressScene(SceneData& scene)
+{
+	Assets& assets = Assets::GetInstance();
+	std::vector<std::string> meshNames;
+	for (const char* name : stressMeshNames)
 	{
-		Projectile* bullet = nullptr;
-		int index;
+		std::string path = std::string("Models\\") + name + ".obj";
+		if (assets.GetMesh(path)) meshNames.push_back(path);
+	}
+
+	SceneFileEmitter emitter = {};
+	emitter.VertexShader = scene.AddName("ParticleVS.cso");
+	emitter.PixelShader = scene.AddName("ParticlePS.cso");
+	emitter.Texture = scene.AddName(stressParticleTexture);
+	emitter.Flags = SCENE_EMITTER_GPU_SIMULATED;
+	emitter.MaxParticles = STRESS_SCENE_EMITTER_PARTICLES;
+	emitter.ParticlesPerSecond = STRESS_SCENE_EMITTER_RATE;
+	emitter.Lifetime = STRESS_SCENE_EMITTER_LIFETIME;
+
+	StressLayout layout;
+	layout.Generate(stressOptions, (unsigned int)meshNames.size(), (unsigned int)scene.Materials.size(), MAX_LIGHTS - (int)scene.Lights.size());
+	layout.AddToScene(scene, meshNames, 0, emitter);
+}
+
+// --------------------------------------------------------
+// Starts streaming in the faces of a sky, which is swapped
+// in by UpdateSky() once they're all loaded
+// --------------------------------------------------------
+void Game::RequestSky(int index)
+{
+	pendingSkyIndex = index;
+	for (int i = 0; i < 6; i++)
+		skyFaceRequests[i] = Assets::GetInstance().RequestTexture(std::string("Skies\\") + skyNames[index] + "\\" + skyFaceNames[i] + ".png", 1.0f);
+}
+
+// --------------------------------------------------------
+// Every ImGui window
+// --------------------------------------------------------
+void Game::BuildUI()
+{
+	PROFILE_SCOPE("Game::BuildUI");
+	Assets& assets = Assets::GetInstance();
 
-		//Find the first dead projectile
-		for (int i = 0; i < MAX_PROJECTILES; i++)
+	// Show the demo window
+	//ImGui:: ShowDemoWindow();
+
+	ImGui::Begin("Render Targets");
+
+	// Small thumbnails, only drawn for the targets that are ticked
+	DebugViews& debugViews = renderer->GetDebugViews();
+	int debugViewInterval = (int)debugViews.GetUpdateInterval();
+	if (ImGui::SliderInt("Update Every (Frames)", &debugViewInterval, 1, 60))
+		debugViews.SetUpdateInterval((unsigned int)debugViewInterval);
+	for (int i = 0; i < (int)DebugViewSource::Count; i++)
+	{
+		DebugViewSource source = (DebugViewSource)i;
+		bool viewEnabled = debugViews.GetEnabled(source);
+		if (ImGui::Checkbox(DebugViews::GetName(source), &viewEnabled))
+			debugViews.SetEnabled(source, viewEnabled);
+		if (!viewEnabled)
+			continue;
+
+		ImGui::PushID(i);
+		if (source == DebugViewSource::ShadowMap)
 		{
-			if (projectiles[i]->dead) 
-			{
-				bullet = projectiles[i];
-				index = i;
-				break;
-			}
+			int debugCascade = renderer->GetShadowDebugCascade();
+			if (ImGui::SliderInt("Cascade", &debugCascade, 0, renderer->GetShadowCascadeCount() - 1))
+				renderer->SetShadowDebugCascade(debugCascade);
 		}
-		if (bullet != nullptr)
+		if (source == DebugViewSource::SceneDepth)
 		{
-			bullet->dead = false;
-			bullet->age = 0;
-			bullet->lifespan = 5;
-			Transform* tf = bullet->GetTransform();
-			Transform* camtf = localPlayer->GetCamera()->GetTransform();
-			tf->SetPosition(camtf->GetPosition().x + localPlayer->velocityX * deltaTime, camtf->GetPosition().y + localPlayer->velocityY * deltaTime, camtf->GetPosition().z + localPlayer->velocityZ * deltaTime);
-			tf->SetRotation(camtf->GetPitchYawRoll().x, camtf->GetPitchYawRoll().y, camtf->GetPitchYawRoll().z);
-			bullet->SetVelocity(0, 2, 35, -4.9f);
-			if (netManager->GetNetworkState() == NetworkState::Connected)
-				netManager->AddNetworkProjectile(bullet, index);
+			float depthNear = debugViews.GetDepthNear();
+			float depthFar = debugViews.GetDepthFar();
+			if (ImGui::DragFloatRange2("View Depths", &depthNear, &depthFar, 0.1f, 0.0f, 1000.0f))
+				debugViews.SetDepthRange(depthNear, depthFar);
 		}
+		int channel = (int)debugViews.GetChannel(source);
+		if (ImGui::Combo("Channel", &channel, "RGB\0Red\0Green\0Blue\0Alpha\0"))
+			debugViews.SetChannel(source, (DebugViewChannel)channel);
+		ID3D11ShaderResourceView* thumbnail = debugViews.GetThumbnail(source);
+		if (thumbnail)
+			ImGui::Image(thumbnail, ImVec2((float)debugViews.GetThumbnailWidth(source), (float)debugViews.GetThumbnailHeight(source)));
+		ImGui::PopID();
 	}
 
-	for (int i = 0; i < MAX_PROJECTILES; i++)
+	ImGui::End();
+
+	ImGui::Begin("Job System");
+
+	JobSystem& jobs = JobSystem::GetInstance();
+	bool jobsEnabled = jobs.GetEnabled();
+	if (ImGui::Checkbox("Enabled", &jobsEnabled))
+		jobs.SetEnabled(jobsEnabled);
+	ImGui::Columns(4);
+	ImGui::Text("Worker"); ImGui::NextColumn();
+	ImGui::Text("Busy"); ImGui::NextColumn();
+	ImGui::Text("Jobs"); ImGui::NextColumn();
+	ImGui::Text("Stolen"); ImGui::NextColumn();
+	for (unsigned int i = 0; i < jobs.GetWorkerCount(); i++)
 	{
-		Projectile* p = projectiles[i];
-		if (!p->dead)
-		{
-			p->Update(deltaTime);
-			if (p->dead)
-			{
-				p->GetTransform()->SetPosition(0, -5000, 0);
-			}
-		}
+		const JobWorkerStats& stats = jobs.GetWorkerStats(i);
+		if (i == 0) ImGui::Text("Main"); else ImGui::Text("%u", i);
+		ImGui::NextColumn();
+		ImGui::ProgressBar(stats.Utilization, ImVec2(-1, 0), (std::to_string((int)(stats.Utilization * 100)) + "%").c_str()); ImGui::NextColumn();
+		ImGui::Text("%u", stats.JobsRun); ImGui::NextColumn();
+		ImGui::Text("%u", stats.JobsStolen); ImGui::NextColumn();
 	}
+	ImGui::Columns(1);
 
-	for (int i = 0; i < emitters.size(); i++)
+	// Settings come from Threads.cfg, and only apply as each thread starts
+	if (ImGui::CollapsingHeader("Threads"))
 	{
-		emitters[i]->Update(deltaTime, totalTime);
+		ThreadManager& threads = ThreadManager::GetInstance();
+		ImGui::Text("%u physical cores, %u logical processors, workers %s", threads.GetPhysicalCoreCount(),
+			threads.GetLogicalProcessorCount(), threads.GetPinWorkers() ? "pinned" : "not pinned");
+		ImGui::Columns(4);
+		ImGui::Text("Thread"); ImGui::NextColumn();
+		ImGui::Text("Role"); ImGui::NextColumn();
+		ImGui::Text("Priority"); ImGui::NextColumn();
+		ImGui::Text("Core"); ImGui::NextColumn();
+		for (auto& thread : threads.GetThreads())
+		{
+			ImGui::Text("%s", thread.Name.c_str()); ImGui::NextColumn();
+			ImGui::Text("%s", ThreadManager::GetRoleName(thread.Role)); ImGui::NextColumn();
+			ImGui::Text("%s", ThreadManager::GetPriorityName(thread.Priority)); ImGui::NextColumn();
+			if (thread.Core >= 0) ImGui::Text("%d", thread.Core); else ImGui::Text("-");
+			ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
 	}
 
+	ImGui::End();
 
-	// Check individual input
-	if (input.KeyDown(VK_ESCAPE)) Quit();
-	if (input.KeyPress(VK_TAB)) GenerateLights();
+	ImGui::Begin("GPU Profiler");
 
+	GpuProfiler& profiler = renderer->GetGpuProfiler();
+	ImGui::Text("Frame: %.3f ms", profiler.GetFrameMs());
+	ImGui::Columns(4);
+	ImGui::Text("Pass"); ImGui::NextColumn();
+	ImGui::Text("ms"); ImGui::NextColumn();
+	ImGui::Text("Avg"); ImGui::NextColumn();
+	ImGui::Text("Max"); ImGui::NextColumn();
+	for (auto& pass : profiler.GetPassStats())
+	{
+		ImGui::Text("%s", pass.Name.c_str()); ImGui::NextColumn();
+		ImGui::Text("%.3f", pass.LastMs); ImGui::NextColumn();
+		ImGui::Text("%.3f", pass.AverageMs); ImGui::NextColumn();
+		ImGui::Text("%.3f", pass.MaxMs); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+
+	// Overdraw is how many times each pixel of the window was shaded
+	bool pipelineStatistics = profiler.GetPipelineStatistics();
+	if (ImGui::Checkbox("Pipeline Statistics", &pipelineStatistics))
+		profiler.SetPipelineStatistics(pipelineStatistics);
+	if (pipelineStatistics)
+	{
+		double pixels = (double)max(this->width * this->height, 1u);
+		ImGui::Columns(8);
+		ImGui::Text("Pass"); ImGui::NextColumn();
+		ImGui::Text("VS"); ImGui::NextColumn();
+		ImGui::Text("PS"); ImGui::NextColumn();
+		ImGui::Text("PS/Pixel"); ImGui::NextColumn();
+		ImGui::Text("Primitives"); ImGui::NextColumn();
+		ImGui::Text("Rendered"); ImGui::NextColumn();
+		ImGui::Text("Samples"); ImGui::NextColumn();
+		ImGui::Text("CS"); ImGui::NextColumn();
+		for (auto& pass : profiler.GetPassStats())
+		{
+			if (!pass.HasPipelineStats)
+				continue;
+			ImGui::Text("%s", pass.Name.c_str()); ImGui::NextColumn();
+			ImGui::Text("%llu", pass.Pipeline.VSInvocations); ImGui::NextColumn();
+			ImGui::Text("%llu", pass.Pipeline.PSInvocations); ImGui::NextColumn();
+			ImGui::Text("%.2f", pass.Pipeline.PSInvocations / pixels); ImGui::NextColumn();
+			ImGui::Text("%llu", pass.Pipeline.CInvocations); ImGui::NextColumn();
+			ImGui::Text("%llu", pass.Pipeline.CPrimitives); ImGui::NextColumn();
+			ImGui::Text("%llu", pass.SamplesPassed); ImGui::NextColumn();
+			ImGui::Text("%llu", pass.Pipeline.CSInvocations); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
+
+	ImGui::End();
+
+	// Last frame's, per pass, for seeing what batching and state filtering save
+	ImGui::Begin("Draw Stats");
+
+	DrawStats& drawStats = DrawStats::GetInstance();
+	ImGui::Columns((int)DrawCounter::Count + 1);
+	ImGui::Text("Pass"); ImGui::NextColumn();
+	for (int c = 0; c < (int)DrawCounter::Count; c++)
+	{
+		ImGui::Text("%s", DrawStats::GetCounterName((DrawCounter)c));
+		ImGui::NextColumn();
+	}
+	auto drawStatsRow = [](const DrawPassCounters& pass)
+	{
+		ImGui::Text("%s", pass.Name.c_str()); ImGui::NextColumn();
+		for (int c = 0; c < (int)DrawCounter::Count; c++)
+		{
+			ImGui::Text("%llu", pass.Counts[c]);
+			ImGui::NextColumn();
+		}
+	};
+	for (auto& pass : drawStats.GetPasses())
+		drawStatsRow(pass);
+	ImGui::Separator();
+	drawStatsRow(drawStats.GetTotals());
+	ImGui::Columns(1);
+
+	ImGui::End();
+
+	ImGui::Begin("Stress Scene");
+
+	ImGui::InputInt("Entities", &stressOptions.Entities, 100, 1000);
+	ImGui::InputInt("Lights", &stressOptions.Lights, 16, 256);
+	ImGui::InputInt("Emitters", &stressOptions.Emitters, 1, 10);
+	ImGui::InputScalar("Seed", ImGuiDataType_U32, &stressOptions.Seed);
+	ImGui::SliderFloat("Extent", &stressOptions.Extent, 5.0f, 500.0f);
+	ImGui::Checkbox("Motion", &stressOptions.Motion);
+	stressOptions.Entities = max(stressOptions.Entities, 0);
+	stressOptions.Lights = max(stressOptions.Lights, 0);
+	stressOptions.Emitters = max(stressOptions.Emitters, 0);
+	if (frameReplay.IsRunning())
+		ImGui::Text("Stop the frame replay to change the scene");
+	else
+	{
+		if (ImGui::Button("Generate"))
+			GenerateStressScene();
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			ClearStressScene();
+	}
+	if (stressScene.IsGenerated())
+	{
+		const StressSceneOptions& generated = stressScene.GetOptions();
+		ImGui::Text("Generated: %d entities, %d lights, %d emitters (seed %u)", generated.Entities, generated.Lights, generated.Emitters, generated.Seed);
+	}
+
+	ImGui::End();
+
+	BuildCpuProfilerUI();
+	BuildGpuMemoryUI();
+	BuildAllocationUI();
+	BuildFrameReplayUI();
+
+	ImGui::Begin("Frame Times");
+
+	const FrameTimeStats& frameStats = frameTimes.GetStats();
+	float plotMax = max(frameStats.Frame.P99 * 2.0f, 1.0f);
+	char overlay[64];
+	sprintf_s(overlay, "p99 %.2f ms", frameStats.Frame.P99);
+	ImGui::PlotLines("##FrameTimes", frameTimes.GetFrameTimes(), (int)frameTimes.GetCount(), (int)frameTimes.GetOffset(), overlay, 0.0f, plotMax, ImVec2(0, 80));
+	ImGui::Columns(4);
+	ImGui::Text("ms"); ImGui::NextColumn();
+	ImGui::Text("Frame"); ImGui::NextColumn();
+	ImGui::Text("CPU"); ImGui::NextColumn();
+	ImGui::Text("GPU"); ImGui::NextColumn();
+	const char* rowNames[] = { "Average", "p50", "p95", "p99", "Max" };
+	const FrameTimePercentiles* columns[] = { &frameStats.Frame, &frameStats.Cpu, &frameStats.Gpu };
+	for (int row = 0; row < 5; row++)
+	{
+		ImGui::Text("%s", rowNames[row]); ImGui::NextColumn();
+		for (auto p : columns)
+		{
+			float values[] = { p->Average, p->P50, p->P95, p->P99, p->Max };
+			ImGui::Text("%.2f", values[row]); ImGui::NextColumn();
+		}
+	}
+	ImGui::Columns(1);
+	ImGui::Text("1%% Low: %.1f fps", frameStats.OnePercentLowFps);
+	ImGui::Text("Hitches (over %.0fx p50): %u of %u frames", FRAME_TIME_HITCH_FACTOR, frameStats.Hitches, frameStats.Frames);
+	if (ImGui::Button("Save CSV (F9)"))
+		frameTimes.Save(FRAME_TIME_FILE);
+	ImGui::SameLine();
+	if (ImGui::Button("Clear"))
+		frameTimes.Clear();
+	ImGui::SameLine();
+	if (ImGui::Button("Hide UI (F1)"))
+		uiVisible = false;
+
+	ImGui::End();
+
+	ImGui::Begin("Sky");
+
+	int chosenSky = pendingSkyIndex >= 0 ? pendingSkyIndex : skyIndex;
+	if (ImGui::Combo("Sky", &chosenSky, skyNames, IM_ARRAYSIZE(skyNames)) && chosenSky != skyIndex)
+	{
+		RequestSky(chosenSky);
+	}
+	int skyDrawMode = (int)sky->GetDrawMode();
+	if (ImGui::Combo("Draw As", &skyDrawMode, "Cube\0Full Screen Triangle\0"))
+		sky->SetDrawMode((SkyDrawMode)skyDrawMode);
+	ImGui::SliderFloat("Rebuild Budget (ms)", &skyRebuildBudgetMs, 0.1f, 8.0f);
+	if (pendingSkyIndex >= 0)
+		ImGui::Text("Loading faces...");
+	else if (sky->IsRebuildingIBL())
+		ImGui::ProgressBar(sky->GetIBLRebuildProgress(), ImVec2(-1, 0), "Rebuilding IBL");
+
+	ImGui::End();
+
+	ImGui::Begin("Renderer");
+
+	// Frames the CPU can get ahead of the GPU
+	int frameLatency = (int)GetMaxFrameLatency();
+	if (ImGui::SliderInt("Max Frame Latency", &frameLatency, 1, 4))
+		SetMaxFrameLatency(frameLatency);
+
+	// Off tears (when the display allows), and adaptive only
+	// tears when a frame's missed its refresh
+	int vsync = (int)GetVSyncMode();
+	if (ImGui::Combo("VSync", &vsync, "Off\0On\0Adaptive\0"))
+		SetVSyncMode((VSyncMode)vsync);
+
+	float frameRateCap = GetFrameRateCap();
+	if (ImGui::SliderFloat("FPS Cap", &frameRateCap, 0.0f, 240.0f, frameRateCap > 0.0f ? "%.0f" : "Uncapped"))
+		SetFrameRateCap(frameRateCap);
+
+	// Drawn less (or not at all) while another app's active, and not at
+	// all while minimized or covered, but always updated
+	bool throttle = GetBackgroundFrameRate() >= 0.0f;
+	if (ImGui::Checkbox("Throttle In Background", &throttle))
+		SetBackgroundFrameRate(throttle ? DXCORE_BACKGROUND_FRAME_RATE : -1.0f);
+	if (throttle)
+	{
+		float backgroundRate = GetBackgroundFrameRate();
+		if (ImGui::SliderFloat("Background FPS", &backgroundRate, 0.0f, 60.0f, backgroundRate > 0.0f ? "%.0f" : "Not Drawn"))
+			SetBackgroundFrameRate(backgroundRate);
+	}
+
+	// With tearing and the cap just under the refresh rate, a variable
+	// refresh display shows every frame as it's done, without tearing
+	ImGui::Text("Tearing: %s", IsTearingSupported() ? "Supported" : "Not Supported");
+	if (ImGui::Button("Cap Below Refresh (VRR)"))
+	{
+		SetVSyncMode(VSyncMode::Off);
+		SetFrameRateCap(max(GetRefreshRate() - 3.0f, 30.0f));
+	}
+	bool borderless = IsBorderlessFullscreen();
+	if (ImGui::Checkbox("Borderless Fullscreen (Alt+Enter)", &borderless))
+		SetBorderlessFullscreen(borderless);
+
+	Input& input = Input::GetInstance();
+	bool rawMouse = input.GetRawMouseInput();
+	if (ImGui::Checkbox("Raw Mouse Input", &rawMouse))
+		input.SetRawMouseInput(rawMouse);
+	bool clipCursor = input.GetCursorClip();
+	if (ImGui::Checkbox("Clip Cursor To Window", &clipCursor))
+		input.SetCursorClip(clipCursor);
+	ImGui::Checkbox("Late Latch Camera", &lateLatchCamera);
+
+	if (netManager->GetNetworkState() == NetworkState::Offline &&
+		ImGui::Checkbox("Pipelined Simulation Thread", &pipelinedSimulation))
+	{
+		if (pipelinedSimulation)
+			StartSimulationThread();
+		else
+			simulation.Stop();
+	}
+	if (!pipelinedSimulation)
+		ImGui::Checkbox("Fixed Timestep", &fixedTimestep);
+	if (fixedTimestep || pipelinedSimulation)
+	{
+		if (ImGui::SliderInt("Tick Rate (Hz)", &tickRate, 10, 240))
+			simulation.SetTickRate(tickRate);
+		ImGui::Text("Ticks Last Frame: %d", lastTickCount);
+	}
+
+	bool multithreaded = renderer->GetMultithreadedRecording();
+	if (ImGui::Checkbox("Multithreaded Recording", &multithreaded))
+		renderer->SetMultithreadedRecording(multithreaded);
+
+	bool instancedGizmos = renderer->GetInstancedLightGizmos();
+	if (ImGui::Checkbox("Instanced Light Gizmos", &instancedGizmos))
+		renderer->SetInstancedLightGizmos(instancedGizmos);
+
+	bool batchedParticles = renderer->GetBatchedParticles();
+	if (ImGui::Checkbox("Batched Particles", &batchedParticles))
+		renderer->SetBatchedParticles(batchedParticles);
+	bool sortedParticles = !emitters.empty() && emitters[0]->IsDepthSorted();
+	if (ImGui::Checkbox("Depth Sorted Particles (Alpha Blended)", &sortedParticles))
+	{
+		for (auto& e : emitters)
+			e->SetDepthSorted(sortedParticles);
+	}
+
+	// Only for the emitters that opt in
+	int particleScaleIndex = renderer->GetParticleResolutionScale() / 2;
+	if (ImGui::Combo("Particle Resolution", &particleScaleIndex, "Full\0" "Half\0" "Quarter\0"))
+		renderer->SetParticleResolutionScale(1 << particleScaleIndex);
+
+	bool lowResolutionParticles = !emitters.empty() && emitters[0]->IsLowResolution();
+	if (ImGui::Checkbox("Low Resolution Emitters", &lowResolutionParticles))
+	{
+		for (auto& e : emitters)
+			e->SetLowResolution(lowResolutionParticles);
+	}
+
+	ImGui::Checkbox("Cull & Throttle Emitters", &emitterCulling);
+	ImGui::Text("Emitters on screen: %d of %d", visibleEmitterCount, (int)emitters.size());
+
+	const ParticleBatchStats& particleStats = renderer->GetParticleBatchStats();
+	ImGui::Text("Particles: %u from %u emitters in %u draws", particleStats.Particles, particleStats.Emitters, particleStats.Batches);
+
+	bool instancing = renderer->GetInstancing();
+	if (ImGui::Checkbox("Instancing", &instancing))
+		renderer->SetInstancing(instancing);
+
+	bool gpuCulling = renderer->GetGpuDrivenCulling();
+	if (ImGui::Checkbox("GPU Driven Culling", &gpuCulling))
+		renderer->SetGpuDrivenCulling(gpuCulling);
+
+	const GpuCullingStats& gpuCullingStats = renderer->GetGpuCullingStats();
+	if (gpuCulling)
+	{
+		ImGui::Text("GPU Buckets: %u (%u indirect draws)", gpuCullingStats.Buckets, gpuCullingStats.IndirectDraws);
+		ImGui::Text("GPU Entities: %u (%u uploaded)", gpuCullingStats.Entities, gpuCullingStats.EntitiesUploaded);
+	}
+
+	const RenderQueueStats& queueStats = renderer->GetRenderQueueStats();
+	ImGui::Text("Draws: %u", queueStats.Draws);
+	ImGui::Text("Instanced Draws: %u (%u entities)", queueStats.InstancedDraws, queueStats.InstancedEntities);
+	ImGui::Text("Shader Binds: %u (%u skipped)", queueStats.ShaderBinds, queueStats.ShaderBindsSkipped);
+	ImGui::Text("Material Binds: %u (%u skipped)", queueStats.MaterialBinds, queueStats.MaterialBindsSkipped);
+	ImGui::Text("Mesh Binds: %u (%u skipped)", queueStats.MeshBinds, queueStats.MeshBindsSkipped);
+	ImGui::Text("Constant Buffer Uploads: %u (%u skipped)", renderer->GetBufferUploadsIssued(), renderer->GetBufferUploadsSkipped());
+
+	bool stateCaching = renderer->GetStateCaching();
+	if (ImGui::Checkbox("Skip Redundant Binds", &stateCaching))
+		renderer->SetStateCaching(stateCaching);
+	ImGui::Text("Binds Skipped: %u", renderer->GetBindsSkipped());
+
+	StateCacheStats stateStats = StateCache::GetInstance().GetStats();
+	ImGui::Text("Pipeline States: %u (%u requests shared)", stateStats.StatesCreated, stateStats.StatesShared);
+	ImGui::Text("Pass States: %u (%u of %u changes skipped)", stateStats.Applies, stateStats.ChangesSkipped, stateStats.ChangesIssued + stateStats.ChangesSkipped);
+
+	UploadRingStats uploadStats = UploadRing::GetInstance().GetStats();
+	ImGui::Text("Ring Uploads: %u (%u discards), %.1f of %.1f KB", uploadStats.Uploads, uploadStats.Discards, uploadStats.Bytes / 1024.0f, uploadStats.Capacity / 1024.0f);
+
+	bool culling = renderer->GetFrustumCulling();
+	if (ImGui::Checkbox("Frustum Culling", &culling))
+		renderer->SetFrustumCulling(culling);
+
+	int prepassMode = (int)renderer->GetDepthPrepassMode();
+	if (ImGui::Combo("Depth Pre-pass", &prepassMode, "Off\0" "On\0" "Auto\0"))
+		renderer->SetDepthPrepassMode((DepthPrepassMode)prepassMode);
+
+	float prepassThreshold = renderer->GetDepthPrepassThreshold();
+	if (ImGui::SliderFloat("Pre-pass Threshold", &prepassThreshold, 0.5f, 4.0f))
+		renderer->SetDepthPrepassThreshold(prepassThreshold);
+
+	ImGui::Text("Estimated Depth Complexity: %.2f (pre-pass %s)",
+		renderer->GetEstimatedDepthComplexity(),
+		renderer->GetDepthPrepassActive() ? "on" : "off");
+	const RenderQueueStats& prepassStats = renderer->GetDepthPrepassStats();
+	ImGui::Text("Pre-pass Draws: %u (%u instanced)", prepassStats.Draws, prepassStats.InstancedDraws);
+
+	bool deferredShading = renderer->GetDeferredShading();
+	if (ImGui::Checkbox("Deferred Shading", &deferredShading))
+		renderer->SetDeferredShading(deferredShading);
+	if (deferredShading)
+	{
+		if (renderer->GetDeferredShadingActive())
+			ImGui::Text("Forward Draws: %u (%u instanced)", renderer->GetForwardQueueStats().Draws, renderer->GetForwardQueueStats().InstancedDraws);
+		else
+			ImGui::Text("Forward shading with GPU driven culling");
+	}
+
+	const CullingStats& cameraCulling = renderer->GetCameraCullingStats();
+	bool occlusion = renderer->GetOcclusionCulling();
+	if (ImGui::Checkbox("Occlusion Culling", &occlusion))
+		renderer->SetOcclusionCulling(occlusion);
+
+	bool occlusionShadows = renderer->GetOcclusionCullShadows();
+	if (ImGui::Checkbox("Occlusion Cull Shadow Casters", &occlusionShadows))
+		renderer->SetOcclusionCullShadows(occlusionShadows);
+
+	bool meshLods = renderer->GetMeshLods();
+	if (ImGui::Checkbox("Mesh LODs", &meshLods))
+		renderer->SetMeshLods(meshLods);
+
+	float lodScale = renderer->GetLodScale();
+	if (ImGui::SliderFloat("LOD Scale", &lodScale, 0.25f, 4.0f))
+		renderer->SetLodScale(lodScale);
+
+	int shadowLodBias = (int)renderer->GetShadowLodBias();
+	if (ImGui::SliderInt("Shadow LOD Bias", &shadowLodBias, 0, MESH_MAX_LODS - 1))
+		renderer->SetShadowLodBias((unsigned int)shadowLodBias);
+
+	ImGui::Text("Visible LODs: %u / %u / %u / %u",
+		renderer->GetVisibleLodCount(0), renderer->GetVisibleLodCount(1),
+		renderer->GetVisibleLodCount(2), renderer->GetVisibleLodCount(3));
+
+	bool impostors = renderer->GetImpostors();
+	if (ImGui::Checkbox("Impostors", &impostors))
+		renderer->SetImpostors(impostors);
+
+	float impostorDistance = renderer->GetImpostorDistance();
+	if (ImGui::SliderFloat("Impostor Distance", &impostorDistance, 10.0f, 300.0f))
+		renderer->SetImpostorDistance(impostorDistance);
+
+	const ImpostorStats& impostorStats = renderer->GetImpostorStats();
+	ImGui::Text("Impostors: %u (%u fading) in %u draws", impostorStats.Impostors, impostorStats.Fading, impostorStats.Draws);
+	ImGui::Text("Impostor Atlas: %u baked, %u waiting", impostorStats.Baked, impostorStats.Queued);
+
+	bool staticShadows = renderer->GetStaticShadowCaching();
+	if (ImGui::Checkbox("Cache Static Shadow Casters", &staticShadows))
+		renderer->SetStaticShadowCaching(staticShadows);
+
+	ImGui::Text("Static Casters: %u (%u cascades redrawn)", renderer->GetStaticCasterCount(), renderer->GetStaticShadowRebuilds());
+
+	ImGui::Text("Camera: %u visible, %u culled, %u occluded", cameraCulling.Visible, cameraCulling.Culled, cameraCulling.Occluded);
+	for (int i = 0; i < renderer->GetShadowCascadeCount(); i++)
+	{
+		const CullingStats& shadowCulling = renderer->GetShadowCullingStats(i);
+		ImGui::Text("Shadow Cascade %d: %u visible, %u culled, %u occluded", i, shadowCulling.Visible, shadowCulling.Culled, shadowCulling.Occluded);
+		if (renderer->GetStaticShadowCaching())
+			ImGui::Text("  (plus %u cached static casters)", renderer->GetStaticShadowCullingStats(i).Visible);
+	}
+
+	int cascadeCount = renderer->GetShadowCascadeCount();
+	if (ImGui::SliderInt("Shadow Cascades", &cascadeCount, 1, MAX_SHADOW_CASCADES))
+		renderer->SetShadowCascadeCount(cascadeCount);
+
+	// Power of two sizes from 512 to 4096
+	int shadowSizeIndex = 0;
+	while ((512 << shadowSizeIndex) < renderer->GetShadowMapSize())
+		shadowSizeIndex++;
+	if (ImGui::Combo("Shadow Map Size", &shadowSizeIndex, "512\0" "1024\0" "2048\0" "4096\0"))
+		renderer->SetShadowMapSize(512 << shadowSizeIndex);
+
+	// EVSM holds up at a quarter of the texels the comparison needs
+	int shadowFilter = (int)renderer->GetShadowFilter();
+	if (ImGui::Combo("Shadow Filter", &shadowFilter, "Comparison\0" "EVSM (2 moments, R32G32)\0" "EVSM (4 moments, R16G16B16A16)\0"))
+		renderer->SetShadowFilter((ShadowFilter)shadowFilter);
+	if (renderer->GetShadowFilter() != ShadowFilter::Comparison)
+	{
+		int blurRadius = renderer->GetEVSMBlurRadius();
+		if (ImGui::SliderInt("EVSM Blur Radius", &blurRadius, 0, EVSM_MAX_BLUR_RADIUS))
+			renderer->SetEVSMBlurRadius(blurRadius);
+
+		float bleedReduction = renderer->GetEVSMBleedReduction();
+		if (ImGui::SliderFloat("EVSM Bleed Reduction", &bleedReduction, 0.0f, 0.95f))
+			renderer->SetEVSMBleedReduction(bleedReduction);
+	}
+
+	const RenderQueueStats& shadowStats = renderer->GetShadowQueueStats();
+	ImGui::Text("Shadow Draws: %u", shadowStats.Draws);
+	ImGui::Text("Shadow Instanced Draws: %u (%u entities)", shadowStats.InstancedDraws, shadowStats.InstancedEntities);
+
+	// Point and spot light shadows, in tiles of one atlas
+	bool localShadows = renderer->GetLocalShadows();
+	if (ImGui::Checkbox("Local Light Shadows", &localShadows))
+		renderer->SetLocalShadows(localShadows);
+
+	// Power of two sizes from 2048 to 8192
+	int atlasSizeIndex = 0;
+	while ((2048u << atlasSizeIndex) < renderer->GetShadowAtlasSize())
+		atlasSizeIndex++;
+	if (ImGui::Combo("Shadow Atlas Size", &atlasSizeIndex, "2048\0" "4096\0" "8192\0"))
+		renderer->SetShadowAtlasSize(2048u << atlasSizeIndex);
+
+	int atlasBudget = (int)renderer->GetShadowAtlasBudget();
+	if (ImGui::SliderInt("Atlas Tiles Per Frame", &atlasBudget, 1, 48))
+		renderer->SetShadowAtlasBudget(atlasBudget);
+
+	const ShadowAtlasStats& atlasStats = renderer->GetShadowAtlasStats();
+	ImGui::Text("Atlas: %u lights, %u tiles, %.0f%% used", atlasStats.Lights, atlasStats.Tiles,
+		100.0f * atlasStats.TexelsUsed / ((float)renderer->GetShadowAtlasSize() * renderer->GetShadowAtlasSize()));
+	ImGui::Text("Atlas Tiles: %u drawn, %u waiting", atlasStats.TilesRendered, atlasStats.TilesWaiting);
+
+	// Full, half or quarter resolution
+	int ssaoScaleIndex = renderer->GetSSAOResolutionScale() / 2;
+	if (ImGui::Combo("SSAO Resolution", &ssaoScaleIndex, "Full\0" "Half\0" "Quarter\0"))
+		renderer->SetSSAOResolutionScale(1 << ssaoScaleIndex);
+
+	int ssaoSamples = renderer->GetSSAOSamples();
+	if (ImGui::SliderInt("SSAO Samples", &ssaoSamples, 1, 64))
+		renderer->SetSSAOSamples(ssaoSamples);
+
+	// Timings for both paths show up in the GPU profiler above
+	bool computeSSAO = renderer->GetComputeSSAO();
+	if (ImGui::Checkbox("Compute SSAO", &computeSSAO))
+		renderer->SetComputeSSAO(computeSSAO);
+
+	bool fusedCombine = renderer->GetFusedSSAOCombine();
+	if (ImGui::Checkbox("Fused Blur + Combine", &fusedCombine))
+		renderer->SetFusedSSAOCombine(fusedCombine);
+
+	bool temporalSSAO = renderer->GetTemporalSSAO();
+	if (ImGui::Checkbox("Temporal SSAO", &temporalSSAO))
+		renderer->SetTemporalSSAO(temporalSSAO);
+
+	int temporalSamples = renderer->GetSSAOTemporalSamples();
+	if (ImGui::SliderInt("SSAO Samples Per Frame", &temporalSamples, 4, 32))
+		renderer->SetSSAOTemporalSamples(temporalSamples);
+
+	float ssaoRadius = renderer->GetSSAORadius();
+	if (ImGui::SliderFloat("SSAO Radius", &ssaoRadius, 0.1f, 10.0f))
+		renderer->SetSSAORadius(ssaoRadius);
+
+	bool dynamicResolution = renderer->GetDynamicResolution();
+	if (ImGui::Checkbox("Dynamic Resolution", &dynamicResolution))
+		renderer->SetDynamicResolution(dynamicResolution);
+
+	float targetMs = renderer->GetDynamicResolutionTargetMs();
+	if (ImGui::SliderFloat("Target GPU ms", &targetMs, 4.0f, 33.3f))
+		renderer->SetDynamicResolutionTargetMs(targetMs);
+
+	float minScale = renderer->GetMinRenderScale();
+	if (ImGui::SliderFloat("Min Render Scale", &minScale, 0.25f, 1.0f))
+		renderer->SetMinRenderScale(minScale);
+
+	float maxScale = renderer->GetMaxRenderScale();
+	if (ImGui::SliderFloat("Max Render Scale", &maxScale, 0.25f, 1.0f))
+		renderer->SetMaxRenderScale(maxScale);
+
+	bool temporalUpsampling = renderer->GetTemporalUpsampling();
+	if (ImGui::Checkbox("Temporal Upsampling", &temporalUpsampling))
+		renderer->SetTemporalUpsampling(temporalUpsampling);
+
+	float upsamplingScale = renderer->GetTemporalUpsamplingScale();
+	if (ImGui::SliderFloat("Upsampling Render Scale", &upsamplingScale, 0.5f, 1.0f))
+		renderer->SetTemporalUpsamplingScale(upsamplingScale);
+
+	ImGui::Text("Render Scale: %.0f%%", renderer->GetRenderScale() * 100.0f);
+
+	bool aliasing = renderer->GetRenderTargetAliasing();
+	if (ImGui::Checkbox("Render Target Aliasing", &aliasing))
+		renderer->SetRenderTargetAliasing(aliasing);
+
+	RenderTargetPool& targetPool = renderer->GetRenderTargetPool();
+	ImGui::Text("Render Targets: %u (%.1f MB), %u without aliasing (%.1f MB)",
+		targetPool.GetTargetCount(),
+		targetPool.GetAllocatedBytes() / (1024.0f * 1024.0f),
+		targetPool.GetRequestCount(),
+		targetPool.GetRequestedBytes() / (1024.0f * 1024.0f));
+
+	// Shader permutations for every material at once
+	unsigned int features = materials[0]->GetFeatures();
+	bool featuresChanged = false;
+	featuresChanged |= ImGui::CheckboxFlags("Materials: No Shadows", &features, MATERIAL_FEATURE_NO_SHADOWS);
+	featuresChanged |= ImGui::CheckboxFlags("Materials: Directional Lights Only", &features, MATERIAL_FEATURE_DIRECTIONAL_ONLY);
+	featuresChanged |= ImGui::CheckboxFlags("Materials: Fixed Light Count", &features, MATERIAL_FEATURE_FIXED_LIGHTS);
+	if (featuresChanged)
+	{
+		for (auto& m : materials)
+			m->SetFeatures(features);
+	}
+
+	// Texture array atlases for the materials that fit in one
+	bool atlasesEnabled = !materialAtlases.empty() && materialAtlases[0]->GetEnabled();
+	if (ImGui::Checkbox("Materials: Texture Array Atlases", &atlasesEnabled))
+	{
+		for (auto& a : materialAtlases)
+			a->SetEnabled(atlasesEnabled);
+	}
+	unsigned int atlasedMaterials = 0;
+	for (auto& a : materialAtlases)
+		atlasedMaterials += (unsigned int)a->GetMaterials().size();
+	ImGui::Text("Atlases: %d (%d materials)", (int)materialAtlases.size(), atlasedMaterials);
+	ImGui::Text("Textures Streaming: %u", Assets::GetInstance().GetStreamingCount());
+	ImGui::Text("Assets Not Loaded: %u", Assets::GetInstance().GetUnloadedCount());
+	bool hotReload = Assets::GetInstance().GetHotReload();
+	if (ImGui::Checkbox("Hot Reload Assets", &hotReload))
+		Assets::GetInstance().SetHotReload(hotReload);
+	ImGui::SameLine();
+	ImGui::Text("(%u reloaded)", Assets::GetInstance().GetReloadCount());
+
+	// Finer mips of streamed textures, as the texel density asks for them
+	if (Assets::GetInstance().GetStreamMips())
+	{
+		Assets& assets = Assets::GetInstance();
+		int mipBudgetMB = (int)(assets.GetMipBudget() / (1024 * 1024));
+		if (ImGui::SliderInt("Mip Streaming Budget (MB)", &mipBudgetMB, 4, 512))
+			assets.SetMipBudget((unsigned long long)mipBudgetMB * 1024 * 1024);
+		ImGui::Text("Mip Streamed Textures: %u (%.2f MB resident)", assets.GetMipStreamedCount(), assets.GetMipResidentBytes() / (1024.0 * 1024.0));
+	}
+
+	// Every texture's video memory, and the budget that evicts streamed ones
+	{
+		Assets& assets = Assets::GetInstance();
+		ImGui::Text("Texture Memory: %.2f MB (%u textures, %u evicted)",
+			assets.GetTextureBytes() / (1024.0 * 1024.0), (unsigned int)assets.GetTextureMemory().size(), assets.GetEvictedTextureCount());
+		int textureBudgetMB = (int)(assets.GetTextureBudget() / (1024 * 1024));
+		if (ImGui::SliderInt("Texture Budget (MB, 0 for none)", &textureBudgetMB, 0, 1024))
+			assets.SetTextureBudget((unsigned long long)textureBudgetMB * 1024 * 1024);
+	}
+
+	// Entity transforms in one SoA system, updated in a batch
+	if (ImGui::Checkbox("Data-Oriented Transforms", &dataOrientedTransforms))
+	{
+		if (!transformSystem)
+			transformSystem = new TransformSystem();
+
+		for (auto& e : entities.GetEntities())
+		{
+			if (dataOrientedTransforms)
+				transformSystem->Add(e->GetTransform());
+			else
+				transformSystem->Remove(e->GetTransform());
+		}
+	}
+	if (transformSystem)
+		ImGui::Text("Transform Updates: %u of %u", transformSystem->GetLastUpdateCount(), transformSystem->GetCount());
+	ImGui::Checkbox("Spatially Sorted Scene", &spatialSort);
+	ImGui::SameLine();
+	ImGui::Text("(sorted %u times)", entities.GetSortCount());
+
+	if (ImGui::Button("Benchmark Transforms"))
+	{
+		unsigned int counts[2] = { 10000, 100000 };
+		for (int i = 0; i < 2; i++)
+		{
+			TransformSystem::Benchmark(counts[i], transformBenchmarkMs[i][0], transformBenchmarkMs[i][1]);
+			printf("Transforms (%u): %.3f ms regular, %.3f ms system\n", counts[i], transformBenchmarkMs[i][0], transformBenchmarkMs[i][1]);
+		}
+	}
+	ImGui::Text("10k: %.3f ms regular, %.3f ms system", transformBenchmarkMs[0][0], transformBenchmarkMs[0][1]);
+	ImGui::Text("100k: %.3f ms regular, %.3f ms system", transformBenchmarkMs[1][0], transformBenchmarkMs[1][1]);
+
+	if (ImGui::Button("Benchmark BVH"))
+	{
+		unsigned int counts[2] = { 10000, 100000 };
+		for (int i = 0; i < 2; i++)
+			DynamicBvh::Benchmark(counts[i], 1000, bvhBenchmarkMs[i][0], bvhBenchmarkMs[i][1]);
+	}
+	ImGui::Text("BVH Height: %d (%u leaves)", renderer->GetEntityTree().GetHeight(), renderer->GetEntityTree().GetLeafCount());
+	ImGui::Text("10k: %.3f ms brute force, %.3f ms tree", bvhBenchmarkMs[0][0], bvhBenchmarkMs[0][1]);
+	ImGui::Text("100k: %.3f ms brute force, %.3f ms tree", bvhBenchmarkMs[1][0], bvhBenchmarkMs[1][1]);
+
+	// Results are added to the CSV file, to compare modes
+	if (ImGui::CollapsingHeader("Particle Benchmark"))
+	{
+		ParticleBenchmarkSettings& s = particleBenchmarkSettings;
+		int mode = (int)s.Mode;
+		if (ImGui::Combo("Mode", &mode, "Full Uploads\0" "Append Uploads (No Overwrite)\0" "GPU Simulation\0"))
+			s.Mode = (ParticleBenchmarkMode)mode;
+		ImGui::SliderInt("Grid Size", &s.GridSize, 1, 32);
+		ImGui::SliderInt("Max Particles", &s.MaxParticles, 10, 10000);
+		ImGui::SliderInt("Particles Per Second", &s.ParticlesPerSecond, 1, 5000);
+		ImGui::SliderFloat("Lifetime", &s.Lifetime, 0.5f, 10.0f);
+		ImGui::SliderInt("Frames", &s.Frames, 10, 2000);
+
+		if (particleBenchmark.IsRunning())
+			ImGui::ProgressBar(particleBenchmark.GetProgress());
+		else if (ImGui::Button("Run Particle Benchmark"))
+			StartParticleBenchmark();
+
+		const ParticleBenchmarkFrame& averages = particleBenchmark.GetLastAverages();
+		ImGui::Text("Last: %.3f ms update, %llu bytes/frame, %.3f ms GPU", averages.UpdateMs, averages.UploadBytes, averages.GpuMs);
+	}
+
+	ImGui::End();
+
+	ImGui::Begin("Object Manager");
+	// Largest textures first, with how long it's been since each was drawn
+	if (ImGui::CollapsingHeader("Texture Memory"))
+	{
+		Assets& assets = Assets::GetInstance();
+		std::vector<std::pair<std::string, TextureMemory>> sorted(assets.GetTextureMemory().begin(), assets.GetTextureMemory().end());
+		std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, TextureMemory>& a, const std::pair<std::string, TextureMemory>& b) { return a.second.Bytes > b.second.Bytes; });
+
+		ImGui::Columns(4);
+		ImGui::Text("Texture"); ImGui::NextColumn();
+		ImGui::Text("MB"); ImGui::NextColumn();
+		ImGui::Text("Format"); ImGui::NextColumn();
+		ImGui::Text("Frames Unused"); ImGui::NextColumn();
+		for (auto& t : sorted)
+		{
+			ImGui::Text("%s", t.first.c_str()); ImGui::NextColumn();
+			ImGui::Text("%.2f", t.second.Bytes / (1024.0 * 1024.0)); ImGui::NextColumn();
+			ImGui::Text("%d", (int)t.second.Format); ImGui::NextColumn();
+			ImGui::Text("%llu", assets.GetFrame() - t.second.LastUsedFrame); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
+
+	if (ImGui::CollapsingHeader("Lights"))
+	{
+		bool clustered = renderer->GetClusteredLighting();
+		if (ImGui::Checkbox("Clustered Light Culling", &clustered))
+			renderer->SetClusteredLighting(clustered);
+
+		// Only used without the clusters
+		bool perEntityLights = renderer->GetPerEntityLights();
+		if (ImGui::Checkbox("Per Entity Light Lists", &perEntityLights))
+			renderer->SetPerEntityLights(perEntityLights);
+		int entityLightCap = (int)renderer->GetEntityLightCap();
+		if (ImGui::SliderInt("Lights Per Entity", &entityLightCap, 1, ENTITY_LIGHTS_MAX))
+			renderer->SetEntityLightCap(entityLightCap);
+		if (renderer->GetPerEntityLightsActive())
+		{
+			const EntityLightListStats& listStats = renderer->GetEntityLightListStats();
+			ImGui::Text("Listed: %u lights for %u entities (%u over the cap)", listStats.LightsListed, listStats.Entities, listStats.LightsDropped);
+		}
+
+		if (ImGui::SliderInt("Light Count", &lightCount, 3, MAX_LIGHTS))
+			GenerateLights();
+
+		// Names are only made for rows that are filtered or on screen
+		char name[64];
+		const char* lightTypes[] = { "Directional", "Point", "Spot" };
+		auto lightName = [&](unsigned int i)
+		{
+			sprintf_s(name, "Light %u (%s)", i + 1, lightTypes[lights.Get(i).Type % 3]);
+			return name;
+		};
+
+		lightFilter.Draw("Filter##Lights");
+		objectManagerRows.clear();
+		for (unsigned int i = 0; i < lights.GetCount(); i++)
+		{
+			if (!lightFilter.IsActive() || lightFilter.PassFilter(lightName(i)))
+				objectManagerRows.push_back(i);
+		}
+		ImGui::Text("%u of %u shown", (unsigned int)objectManagerRows.size(), lights.GetCount());
+
+		ImGui::BeginChild("Light List", ImVec2(0, 150), true);
+		ImGuiListClipper lightClipper;
+		lightClipper.Begin((int)objectManagerRows.size());
+		while (lightClipper.Step())
+		{
+			for (int row = lightClipper.DisplayStart; row < lightClipper.DisplayEnd; row++)
+			{
+				unsigned int i = objectManagerRows[row];
+				ImGui::PushID((int)i);
+				if (ImGui::Selectable(lightName(i), selectedLight == (int)i))
+					selectedLight = (int)i;
+				ImGui::PopID();
+			}
+		}
+		ImGui::EndChild();
+
+		// Edited as a copy, which only goes back to the manager (and so
+		// is only uploaded again) on the frames something was changed
+		if (selectedLight >= 0 && selectedLight < (int)lights.GetCount())
+		{
+			Light light = lights.Get(selectedLight);
+			ImGui::Text("%s", lightName(selectedLight));
+			if (light.Type != LIGHT_TYPE_DIRECTIONAL)
+				ImGui::DragFloat3("Position", &light.Position.x, 0.1f);
+			if (light.Type != LIGHT_TYPE_POINT)
+				ImGui::DragFloat3("Direction", &light.Direction.x, 0.1f);
+			ImGui::DragFloat("Intensity", &light.Intensity);
+			ImGui::ColorEdit4("Color", &light.Color.x);
+			if (light.Type != LIGHT_TYPE_DIRECTIONAL)
+				ImGui::DragFloat("Range", &light.Range, 0.1f, 0.1f, 100.0f);
+			if (light.Type == LIGHT_TYPE_SPOT)
+				ImGui::DragFloat("Spot Falloff", &light.SpotFalloff, 0.1f, 1.0f, 128.0f);
+
+			bool castsShadows = light.CastsShadows != 0;
+			if (ImGui::Checkbox("Casts Shadows", &castsShadows))
+				light.CastsShadows = castsShadows;
+
+			if (memcmp(&light, &lights.Get(selectedLight), sizeof(Light)) != 0)
+				lights.Set(selectedLight, light);
+		}
+	}
+	
+	if (ImGui::CollapsingHeader("Entities"))
+	{
+		char name[64];
+		const char* entityTypes[] = { "Entity", "Player" };
+		auto entityName = [&](GameEntity* e)
+		{
+			sprintf_s(name, "Object %d (%s)", entities.GetSceneIndex(e) + 1, entityTypes[(int)entities.GetHandle(e).Type % 2]);
+			return name;
+		};
+
+		entityFilter.Draw("Filter##Entities");
+		objectManagerRows.clear();
+		for (unsigned int i = 0; i < entities.GetCount(); i++)
+		{
+			if (!entityFilter.IsActive() || entityFilter.PassFilter(entityName(entities.GetEntity(i))))
+				objectManagerRows.push_back(i);
+		}
+		ImGui::Text("%u of %u shown", (unsigned int)objectManagerRows.size(), entities.GetCount());
+
+		ImGui::BeginChild("Entity List", ImVec2(0, 200), true);
+		ImGuiListClipper entityClipper;
+		entityClipper.Begin((int)objectManagerRows.size());
+		while (entityClipper.Step())
+		{
+			for (int row = entityClipper.DisplayStart; row < entityClipper.DisplayEnd; row++)
+			{
+				GameEntity* e = entities.GetEntity(objectManagerRows[row]);
+				EntityHandle handle = entities.GetHandle(e);
+				ImGui::PushID(row);
+				if (ImGui::Selectable(entityName(e), selectedEntity == handle))
+					selectedEntity = handle;
+				ImGui::PopID();
+			}
+		}
+		ImGui::EndChild();
+
+		// Transforms are only touched when a widget actually changes,
+		// since setting one dirties it (and its children)
+		GameEntity* selected = entities.Get(selectedEntity);
+		if (selected && entities.GetSceneIndex(selected) >= 0)
+		{
+			Transform* transform = selected->GetTransform();
+			XMFLOAT3 pos = transform->GetPosition();
+			XMFLOAT3 rot = transform->GetPitchYawRoll();
+			XMFLOAT3 scl = transform->GetScale();
+
+			ImGui::Text("%s", entityName(selected));
+			if (ImGui::DragFloat3("Position", &pos.x, 0.5f))
+				transform->SetPosition(pos.x, pos.y, pos.z);
+			if (ImGui::DragFloat3("Rotation", &rot.x, 0.1f))
+				transform->SetRotation(rot.x, rot.y, rot.z);
+			if (ImGui::DragFloat3("Scale", &scl.x, 0.5f))
+				transform->SetScale(scl.x, scl.y, scl.z);
+		}
+	}
+	ImGui::End();
+
+	ImGui::Begin("Network Manager");
+
+	NetworkState s = netManager->GetNetworkState();
+	if (s == NetworkState::Offline)
+	{
+		ImGui::InputText("##text1", ip, 15);
+		ImGui::InputText("##text2", port, 6);
+
+		if (ImGui::Button("Connect"))
+		{
+			// The local player's predicted by the network's ticks, so
+			// they have to run here with the rest of the simulation
+			if (pipelinedSimulation)
+			{
+				simulation.Stop();
+				pipelinedSimulation = false;
+			}
+
+			char* pEnd;
+			netManager->Connect(ip, strtol(port, &pEnd, 0), localPlayer, Assets::GetInstance().GetMesh("Models\\sphere.obj"), materials[0]);
+		}
+	}
+	else if (s == NetworkState::Connecting)
+	{
+		ImGui::Text("Connecting...");
+	}
+	else if (s == NetworkState::Connected)
+	{
+		ImGui::Text("Connected!");
+		ImGui::Text("Interpolation Delay: %.0f ms (Jitter: %.1f ms)",
+			netManager->GetInterpolationDelay() * 1000.0f, netManager->GetArrivalJitter() * 1000.0f);
+
+		// Each graph's last 30 seconds, with its current value over it
+		NetworkConnectionStats& stats = netManager->GetStats();
+		auto plot = [&](const char* label, NetworkStat stat, const char* format, float scale, float minMax)
+		{
+			const float* history = stats.GetHistory(stat);
+			float plotMax = minMax;
+			for (int i = 0; i < stats.GetHistoryCount(); i++)
+				plotMax = max(plotMax, history[i] * 1.25f);
+
+			char overlay[64];
+			sprintf_s(overlay, format, stats.Get(stat) * scale);
+			ImGui::PlotLines(label, history, stats.GetHistoryCount(), stats.GetHistoryOffset(), overlay, 0.0f, plotMax, ImVec2(0, 40));
+		};
+		plot("RTT", NETWORK_STAT_RTT, "%.0f ms", 1.0f, 50.0f);
+		plot("Jitter", NETWORK_STAT_JITTER, "%.1f ms", 1.0f, 10.0f);
+		plot("Loss In", NETWORK_STAT_LOSS_IN, "%.1f%%", 1.0f, 5.0f);
+		plot("Loss Out", NETWORK_STAT_LOSS_OUT, "%.1f%%", 1.0f, 5.0f);
+		plot("Bytes In", NETWORK_STAT_BYTES_IN, "%.2f kB/s", 1.0f / 1024.0f, 1024.0f);
+		plot("Bytes Out", NETWORK_STAT_BYTES_OUT, "%.2f kB/s", 1.0f / 1024.0f, 1024.0f);
+		ImGui::Text("Packets/s: %.0f in, %.0f out", stats.Get(NETWORK_STAT_PACKETS_IN), stats.Get(NETWORK_STAT_PACKETS_OUT));
+		ImGui::Text("Snapshot Age: %.0f ms", netManager->GetSnapshotAge() * 1000.0f);
+		ImGui::Text("Dropped Packets: %u in, %u out", netManager->GetDroppedPackets(), netManager->GetDroppedSends());
+		int sendRate = netManager->GetSendRate();
+		if (ImGui::SliderInt("Send Rate", &sendRate, NETWORK_MIN_SEND_RATE, NETWORK_MAX_SEND_RATE, "%d Hz"))
+			netManager->SetSendRate(sendRate);
+		ImGui::Text("Reliable Resends: %u", netManager->GetResends());
+		if (netManager->HasEntropyModel())
+		{
+			float decoded = netManager->GetAverageDecodedBytes();
+			ImGui::Text("Coded Snapshots: %u, %.0f bytes from %.0f (%.1f%%), %.1f us to decode",
+				netManager->GetCodedSnapshots(), netManager->GetAverageCodedBytes(), decoded,
+				decoded > 0 ? netManager->GetAverageCodedBytes() / decoded * 100.0f : 0.0f, netManager->GetAverageDecodeMicroseconds());
+		}
+		else
+			ImGui::Text("Coded Snapshots: no entropy model");
+
+		if (ImGui::Button("Disconnect"))
+		{
+			netManager->Disconnect();
+		}
+	}
+	ImGui::End();
+}
+
+// --------------------------------------------------------
+// Every thread's scopes over the last few frames, as rows
+// of bars (nested ones below what they're inside of), and
+// how long each kind took a frame, on average
+// --------------------------------------------------------
+void Game::BuildCpuProfilerUI()
+{
+	ImGui::Begin("CPU Profiler");
+
+	CpuProfiler& profiler = CpuProfiler::GetInstance();
+	bool paused = profiler.GetPaused();
+	if (ImGui::Checkbox("Paused", &paused))
+		profiler.SetPaused(paused);
+	ImGui::SameLine();
+	if (ImGui::Button("Save Chrome Trace"))
+		profiler.WriteTrace(cpuProfileFrames);
+	ImGui::SliderInt("Frames", &cpuProfileFrames, 1, CPU_PROFILER_FRAMES);
+
+	long long start, end;
+	unsigned int frames = profiler.Capture(cpuProfileFrames, cpuProfile, start, end);
+	if (frames == 0)
+	{
+#if CPU_PROFILER_ENABLED
+		ImGui::Text("Not enough frames yet");
+#else
+		ImGui::Text("Compiled out (CPU_PROFILER_ENABLED is 0)");
+#endif
+		ImGui::End();
+		return;
+	}
+	double spanMs = profiler.TicksToMs(end - start);
+	ImGui::Text("%.2f ms, %.2f ms a frame", spanMs, spanMs / frames);
+
+	ImDrawList* draw = ImGui::GetWindowDrawList();
+	float width = max(ImGui::GetContentRegionAvail().x, 100.0f);
+	float rowHeight = ImGui::GetTextLineHeight() + 2.0f;
+	ImVec2 mouse = ImGui::GetIO().MousePos;
+	for (size_t t = 0; t < cpuProfile.size(); t++)
+	{
+		CpuProfileThread& thread = cpuProfile[t];
+		if (thread.Events.empty()) continue;
+
+		unsigned int depth = 0;
+		for (auto& e : thread.Events)
+			depth = max(depth, e.Depth + 1);
+
+		ImGui::Text("%s", thread.Name.c_str());
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImGui::PushID((int)t);
+		ImGui::InvisibleButton("##Timeline", ImVec2(width, depth * rowHeight));
+		bool hovered = ImGui::IsItemHovered();
+		ImGui::PopID();
+
+		for (auto& e : thread.Events)
+		{
+			float x0 = origin.x + (float)((max(e.Start, start) - start) / (double)(end - start)) * width;
+			float x1 = origin.x + (float)((min(e.End, end) - start) / (double)(end - start)) * width;
+			x1 = max(x1, x0 + 1.0f);
+			float y0 = origin.y + e.Depth * rowHeight;
+			float y1 = y0 + rowHeight - 1.0f;
+
+			// The same color for the same scope, every frame
+			unsigned int hash = 2166136261u;
+			for (const char* c = e.Name; *c; c++)
+				hash = (hash ^ (unsigned char)*c) * 16777619u;
+			draw->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.7f));
+			if (ImGui::CalcTextSize(e.Name).x < x1 - x0 - 4.0f)
+				draw->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32_WHITE, e.Name);
+
+			if (hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1)
+				ImGui::SetTooltip("%s\n%.3f ms\n%u allocations (%llu bytes)", e.Name, profiler.TicksToMs(e.End - e.Start), e.Allocations, e.AllocatedBytes);
+		}
+	}
+
+	// Each scope's totals, across every thread
+	if (ImGui::CollapsingHeader("Totals"))
+	{
+		struct ScopeTotal
+		{
+			const char* Name;
+			long long Ticks;
+			unsigned int Calls;
+			unsigned long long Allocations;
+			unsigned long long AllocatedBytes;
+		};
+		std::vector<ScopeTotal> totals;
+		for (auto& thread : cpuProfile)
+		{
+			for (auto& e : thread.Events)
+			{
+				auto it = std::find_if(totals.begin(), totals.end(), [&](const ScopeTotal& s) { return strcmp(s.Name, e.Name) == 0; });
+				if (it == totals.end())
+				{
+					totals.push_back({ e.Name, 0, 0, 0, 0 });
+					it = totals.end() - 1;
+				}
+				it->Ticks += min(e.End, end) - max(e.Start, start);
+				it->Calls++;
+				it->Allocations += e.Allocations;
+				it->AllocatedBytes += e.AllocatedBytes;
+			}
+		}
+		std::sort(totals.begin(), totals.end(), [](const ScopeTotal& a, const ScopeTotal& b) { return a.Ticks > b.Ticks; });
+
+		ImGui::Columns(5);
+		ImGui::Text("Scope"); ImGui::NextColumn();
+		ImGui::Text("ms/frame"); ImGui::NextColumn();
+		ImGui::Text("Calls/frame"); ImGui::NextColumn();
+		ImGui::Text("Allocs/frame"); ImGui::NextColumn();
+		ImGui::Text("KB/frame"); ImGui::NextColumn();
+		for (auto& s : totals)
+		{
+			ImGui::Text("%s", s.Name); ImGui::NextColumn();
+			ImGui::Text("%.3f", profiler.TicksToMs(s.Ticks) / frames); ImGui::NextColumn();
+			ImGui::Text("%.1f", s.Calls / (float)frames); ImGui::NextColumn();
+			ImGui::Text("%.1f", s.Allocations / (float)frames); ImGui::NextColumn();
+			ImGui::Text("%.2f", s.AllocatedBytes / 1024.0f / frames); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
+
+	ImGui::End();
+}
+
+// --------------------------------------------------------
+// How much of its budget the process is using (by the OS's
+// count), what's tracked of that by category, and the
+// biggest resources
+// --------------------------------------------------------
+void Game::BuildGpuMemoryUI()
+{
+	ImGui::Begin("GPU Memory");
+
+	GpuMemory& memory = GpuMemory::GetInstance();
+	const float mb = 1024.0f * 1024.0f;
+	DXGI_QUERY_VIDEO_MEMORY_INFO budget;
+	if (memory.QueryBudget(budget) && budget.Budget > 0)
+	{
+		float used = (float)budget.CurrentUsage / budget.Budget;
+		char overlay[64];
+		sprintf_s(overlay, "%.1f / %.1f MB", budget.CurrentUsage / mb, budget.Budget / mb);
+		ImGui::Text("Budget");
+		ImGui::ProgressBar(used, ImVec2(-1, 0), overlay);
+	}
+	else
+		ImGui::Text("Budget: unavailable");
+	ImGui::Text("Tracked: %.1f MB", memory.GetTotalBytes() / mb);
+
+	ImGui::Columns(3);
+	ImGui::Text("Category"); ImGui::NextColumn();
+	ImGui::Text("Count"); ImGui::NextColumn();
+	ImGui::Text("MB"); ImGui::NextColumn();
+	for (int c = 0; c < (int)GpuMemoryCategory::Count; c++)
+	{
+		GpuMemoryCategory category = (GpuMemoryCategory)c;
+		ImGui::Text("%s", GpuMemory::GetCategoryName(category)); ImGui::NextColumn();
+		ImGui::Text("%u", memory.GetCount(category)); ImGui::NextColumn();
+		ImGui::Text("%.2f", memory.GetBytes(category) / mb); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+
+	if (ImGui::CollapsingHeader("Largest"))
+	{
+		memory.GetLargest(GPU_MEMORY_TOP_COUNT, gpuLargest);
+		ImGui::Columns(4);
+		ImGui::Text("Name"); ImGui::NextColumn();
+		ImGui::Text("Category"); ImGui::NextColumn();
+		ImGui::Text("MB"); ImGui::NextColumn();
+		ImGui::Text("Size"); ImGui::NextColumn();
+		for (const GpuAllocation& a : gpuLargest)
+		{
+			ImGui::Text("%s", a.Name.c_str()); ImGui::NextColumn();
+			ImGui::Text("%s", GpuMemory::GetCategoryName(a.Category)); ImGui::NextColumn();
+			ImGui::Text("%.2f", a.Bytes / mb); ImGui::NextColumn();
+			if (a.Format == DXGI_FORMAT_UNKNOWN)
+				ImGui::Text("Buffer");
+			else
+				ImGui::Text("%ux%u x%u, %u mips, format %d", a.Width, a.Height, a.ArraySize, a.MipLevels, (int)a.Format);
+			ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
+
+	ImGui::End();
+}
+
+// --------------------------------------------------------
+// How many heap allocations each frame makes (which should
+// be none, once everything's loaded), and where they come
+// from, when call sites are compiled in
+// --------------------------------------------------------
+void Game::BuildAllocationUI()
+{
+	ImGui::Begin("Allocations");
+
+#if ALLOCATION_TRACKER_ENABLED
+	AllocationCounts frame = AllocationTracker::GetLastFrame();
+	ImGui::Text("Last frame: %llu allocations (%.2f KB), %llu frees", frame.Allocations, frame.Bytes / 1024.0f, frame.Frees);
+	ImGui::Text("Live: %llu allocations, %.2f MB", AllocationTracker::GetLiveAllocations(), AllocationTracker::GetLiveBytes() / (1024.0f * 1024.0f));
+
+	FrameArenaStats arenaStats = FrameArena::GetLastFrame();
+	ImGui::Text("Frame arenas: %llu allocations (%.2f KB) on %u threads, %.2f MB reserved", arenaStats.Allocations, arenaStats.Bytes / 1024.0f,
+		arenaStats.Threads, arenaStats.Reserved / (1024.0f * 1024.0f));
+
+	AllocationTracker::GetHistory(allocationHistory);
+	if (!allocationHistory.empty())
+		ImGui::PlotHistogram("##Allocations", allocationHistory.data(), (int)allocationHistory.size(), 0, "Allocations per frame", 0.0f, FLT_MAX, ImVec2(-1, 60));
+
+	if (!AllocationTracker::CallSitesCompiled())
+	{
+		ImGui::Text("Call sites are only captured in debug builds (ALLOCATION_TRACKER_CALL_SITES)");
+		ImGui::End();
+		return;
+	}
+
+	bool capture = AllocationTracker::GetCaptureCallSites();
+	if (ImGui::Checkbox("Capture Call Sites (slow)", &capture))
+		AllocationTracker::SetCaptureCallSites(capture);
+	if (!capture)
+	{
+		ImGui::End();
+		return;
+	}
+	ImGui::SameLine();
+	ImGui::Checkbox("Last Frame Only", &allocationSitesLastFrame);
+	if (AllocationTracker::GetUntrackedCallSiteAllocations() > 0)
+		ImGui::Text("%llu allocations from call sites that didn't fit", AllocationTracker::GetUntrackedCallSiteAllocations());
+
+	AllocationTracker::GetCallSites(allocationSites, allocationSitesLastFrame);
+	ImGui::Columns(3);
+	ImGui::Text("Call Site"); ImGui::NextColumn();
+	ImGui::Text("Allocations"); ImGui::NextColumn();
+	ImGui::Text("KB"); ImGui::NextColumn();
+	for (const AllocationCallSite& site : allocationSites)
+	{
+		ImGui::Text("%s", site.Location.c_str());
+		if (ImGui::IsItemHovered())
+		{
+			ImGui::BeginTooltip();
+			for (const std::string& stackFrame : site.Stack)
+				ImGui::Text("%s", stackFrame.c_str());
+			ImGui::EndTooltip();
+		}
+		ImGui::NextColumn();
+		ImGui::Text("%llu", site.Allocations); ImGui::NextColumn();
+		ImGui::Text("%.2f", site.Bytes / 1024.0f); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+#else
+	ImGui::Text("Compiled out (ALLOCATION_TRACKER_ENABLED is 0)");
+#endif
+
+	ImGui::End();
+}
+
+// --------------------------------------------------------
+// Capturing a frame, replaying it, and timing the replay
+// under each label (set the renderer up, then measure)
+// --------------------------------------------------------
+void Game::BuildFrameReplayUI()
+{
+	ImGui::Begin("Frame Replay");
+
+	if (ImGui::Button("Capture Frame"))
+		captureNextFrame = true;
+	ImGui::SameLine();
+	if (!frameReplay.IsRunning())
+	{
+		if (ImGui::Button("Replay " FRAME_CAPTURE_FILE) && frameCapture.Load(FRAME_CAPTURE_FILE))
+			StartFrameReplay();
+		ImGui::End();
+		return;
+	}
+	if (ImGui::Button("Stop Replay"))
+	{
+		StopFrameReplay();
+		ImGui::End();
+		return;
+	}
+
+	const FrameCaptureHeader& header = frameReplay.GetCapture().Header;
+	ImGui::Text("%u entities, %d of %u lights, %u emitters (%ux%u)", header.EntityCount, header.ActiveLightCount, header.LightCount, header.EmitterCount, header.Width, header.Height);
+
+	ImGui::InputText("Label", replayLabel, sizeof(replayLabel));
+	if (frameReplay.IsMeasuring())
+		ImGui::ProgressBar(frameReplay.GetMeasureProgress(), ImVec2(-1, 0), "Measuring");
+	else if (ImGui::Button("Measure"))
+		frameReplay.Measure(replayLabel);
+
+	// Each result's passes, in whatever order they first showed up
+	const std::vector<FrameReplayResult>& results = frameReplay.GetResults();
+	if (!results.empty())
+	{
+		ImGui::Columns(4);
+		ImGui::Text("Label"); ImGui::NextColumn();
+		ImGui::Text("Pass"); ImGui::NextColumn();
+		ImGui::Text("ms"); ImGui::NextColumn();
+		ImGui::Text("p95 ms"); ImGui::NextColumn();
+		for (const FrameReplayResult& result : results)
+		{
+			ImGui::Text("%s", result.Label.c_str()); ImGui::NextColumn();
+			ImGui::Text("Frame"); ImGui::NextColumn();
+			ImGui::Text("%.3f", result.GpuMs); ImGui::NextColumn();
+			ImGui::Text("%.3f", result.GpuP95Ms); ImGui::NextColumn();
+			for (auto& pass : result.PassMs)
+			{
+				ImGui::NextColumn();
+				ImGui::Text("%s", pass.first.c_str()); ImGui::NextColumn();
+				ImGui::Text("%.3f", pass.second); ImGui::NextColumn();
+				ImGui::NextColumn();
+			}
+		}
+		ImGui::Columns(1);
+		if (ImGui::Button("Clear Results"))
+			frameReplay.ClearResults();
+		ImGui::SameLine();
+		ImGui::Text("Also appended to " FRAME_REPLAY_RESULTS_FILE);
+	}
+
+	ImGui::End();
+}
+
+// --------------------------------------------------------
+// Update your game here - user input, move objects, AI, etc.
+// --------------------------------------------------------
+void Game::Update(float deltaTime, float totalTime)
+{
+	AllocationTracker::EndFrame();
+	FrameArena::EndFrame();
+	CpuProfiler::GetInstance().BeginFrame();
+	PROFILE_SCOPE("Game::Update");
+	cpuFrameStart = std::chrono::high_resolution_clock::now();
+
+	// Reset input manager's gui state so we dont
+	// taint our own input (youll uncomment later)
+	input.SetGuiKeyboardCapture(false);
+	input.SetGuiMouseCapture(false);
+	// The renderer only draws ImGui's frame if there is one
+	if (input.KeyPress(VK_F1))
+		uiVisible = !uiVisible;
+	renderer->SetUIVisible(uiVisible);
+
+	if (uiVisible)
+	{
+		// Set io info
+		ImGuiIO& io = ImGui::GetIO();
+		io.DeltaTime = deltaTime;
+		io.DisplaySize.x = (float)this->width;
+		io.DisplaySize.y = (float)this->height;
+		io.KeyCtrl = input.KeyDown(VK_CONTROL);
+		io.KeyShift = input.KeyDown(VK_SHIFT);
+		io.KeyAlt = input.KeyDown(VK_MENU);
+		io.MousePos.x = (float)input.GetMouseX();
+		io.MousePos.y = (float)input.GetMouseY();
+		io.MouseDown[0] = input.MouseLeftDown();
+		io.MouseDown[1] = input.MouseRightDown();
+		io.MouseDown[2] = input.MouseMiddleDown();
+		io.MouseWheel = input.GetMouseWheel();
+		input.GetKeyArray(io.KeysDown, 256);
+
+		// Reset the frame
+		ImGui_ImplDX11_NewFrame();
+		ImGui_ImplWin32_NewFrame();
+		ImGui::NewFrame();
+		// Determine new input capture (youll uncomment later)
+		input.SetGuiKeyboardCapture(io.WantCaptureKeyboard);
+		input.SetGuiMouseCapture(io.WantCaptureMouse);
+	}
+
+	// Swap in whatever textures finished streaming, and pack the PBR materials
+	// with matching textures into texture arrays once they all have (their
+	// placeholders would group them wrong), so they can be switched between
+	// (and instanced) for free
+	//  - Only used once enabled
+	//  - Atlases are snapshots, which would leave mip streamed textures at
+	//    whatever mips they had, so they're only built without mip streaming
+	Assets& assets = Assets::GetInstance();
+	assets.UpdateHotReload();
+	assets.UpdateStreaming();
+	if (!materialAtlasesBuilt && assets.GetStreamingCount() == 0 && !assets.GetStreamMips())
+	{
+		materialAtlases = MaterialAtlas::Build(device, context, materials, assets.GetPixelShader("PixelShaderPBR_Atlas.cso"));
+		materialAtlasesBuilt = true;
+	}
+	UpdateSky();
+
+	// Counted every frame, whether or not the UI shows them
+	JobSystem::GetInstance().BeginFrame();
+
+	// Left out of benchmark runs, so it's not part of what's timed
+	if (uiVisible && !scriptedBenchmark.IsRunning())
+		BuildUI();
+
+	Input& input = Input::GetInstance();
+
+	// Nothing moves while a capture's replayed, but the emitters
+	// still need their particles uploaded (at the captured time)
+	if (frameReplay.IsRunning())
+	{
+		CullEmitters();
+		for (Emitter* emitter : emitters)
+		{
+			emitter->Simulate(0.0f, frameReplay.GetTotalTime());
+			if (!renderer->GetBatchedParticles() || !emitter->IsBatchable())
+				emitter->Upload();
+		}
+		if (input.KeyDown(VK_ESCAPE)) Quit();
+		return;
+	}
+
+	// Everything the simulation thread's moved since last frame
+	if (pipelinedSimulation)
+		ApplyRenderPacket();
+
+	// Update the camera (which the benchmark holds still)
+	if (!particleBenchmark.IsRunning())
+		camera->Update(deltaTime);
+	localPlayer->Look(deltaTime);
+
+	if (input.MouseLeftPress())
+	{
+		unsigned int index;
+		if (projectiles->Spawn(index))
+		{
+			Transform* camtf = localPlayer->GetCamera()->GetTransform();
+			SimulatedProjectile bullet = projectiles->GetState(index);
+			bullet.Lifespan = 5;
+			bullet.Position = XMFLOAT3(camtf->GetPosition().x + localPlayer->velocityX * deltaTime, camtf->GetPosition().y + localPlayer->velocityY * deltaTime, camtf->GetPosition().z + localPlayer->velocityZ * deltaTime);
+			bullet.PitchYawRoll = camtf->GetPitchYawRoll();
+			bullet.Velocity = XMFLOAT3(0, 2, 35);
+			bullet.Gravity = -4.9f;
+			projectiles->SetState(index, bullet);
+			projectiles->Snap(index);
+			if (netManager->GetNetworkState() == NetworkState::Connected)
+				netManager->AddNetworkProjectile(projectiles, index);
+		}
+	}
+
+	// On the thread, the ticks are already running, and only
+	// what needs the scene is done here
+	//  - Otherwise, as many ticks as the time since the last
+	//    covers, with what's left over saying how far to draw
+	//    into the next
+	if (pipelinedSimulation)
+	{
+		netManager->Update(deltaTime, localPlayer, projectiles);
+		CollideProjectiles();
+		SendSimulationChanges();
+	}
+	else if (fixedTimestep)
+	{
+		lastTickCount = 0;
+		float tickSeconds = 1.0f / tickRate;
+		tickAccumulator += deltaTime;
+		while (tickAccumulator >= tickSeconds && lastTickCount < GAME_MAX_TICKS_PER_FRAME)
+		{
+			interpolator.Save();
+			projectiles->SavePositions();
+			SimulateTick(tickSeconds);
+			tickAccumulator -= tickSeconds;
+			lastTickCount++;
+		}
+		tickAccumulator = min(tickAccumulator, tickSeconds);
+		tickBlend = tickAccumulator / tickSeconds;
+	}
+	else
+	{
+		tickAccumulator = 0.0f;
+		SimulateTick(deltaTime);
+		lastTickCount = 1;
+		tickBlend = 1.0f;
+	}
+
+	// Remote players move on the frame's time, not the ticks
+	netManager->InterpolateRemotePlayers();
+	stressScene.Update(totalTime, lights);
+
+	// Emitters simulate in parallel, but the uploads
+	// need the immediate context
+	//  - Batched emitters are uploaded by the renderer instead
+	//  - They stay on the frame's time, since their particles
+	//    are drawn by their age at the frame's time
+	auto emitterStart = std::chrono::high_resolution_clock::now();
+	CullEmitters();
+	JobSystem::GetInstance().ParallelFor((unsigned int)emitters.size(), 1, [&](unsigned int start, unsigned int end)
+	{
+		for (unsigned int i = start; i < end; i++)
+			emitters[i]->Simulate(deltaTime, totalTime);
+	});
+	bool batchedParticles = renderer->GetBatchedParticles();
+	for (int i = 0; i < emitters.size(); i++)
+	{
+		if (!batchedParticles || !emitters[i]->IsBatchable())
+			emitters[i]->Upload();
+	}
+	double emitterMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - emitterStart).count();
+	if (particleBenchmark.RecordFrame(emitterMs, renderer->GetGpuProfiler()))
+	{
+		renderer->SetBatchedParticles(benchmarkSavedBatching);
+		emitterCulling = benchmarkSavedCulling;
+	}
+
+
+	// Along the path, wherever the ticks left the camera
+	if (scriptedBenchmark.IsRunning())
+	{
+		scriptedBenchmark.MoveCamera(camera, totalTime);
+		interpolator.Snap(camera->GetTransform());
+	}
+
+	// Check individual input
+	if (input.KeyDown(VK_ESCAPE)) Quit();
+	if (input.KeyPress(VK_TAB)) GenerateLights();
+	if (input.KeyPress(VK_F9)) frameTimes.Save(FRAME_TIME_FILE);
+
+}
+
+// --------------------------------------------------------
+// One step of the simulation: the network, the player's
+// movement and the projectiles
+// --------------------------------------------------------
+void Game::SimulateTick(float dt)
+{
+	PROFILE_SCOPE("Game::SimulateTick");
+	netManager->Update(dt, localPlayer, projectiles);
+	if (!netManager->PredictsLocalPlayer())
+		localPlayer->Update(dt);
+
+	projectiles->Update(dt);
+	CollideProjectiles();
+}
+
+// --------------------------------------------------------
+// Offline there's no server deciding hits, so projectiles
+// stop at the first piece of the scene they touch
+// --------------------------------------------------------
+void Game::CollideProjectiles()
+{
+	if (netManager->GetNetworkState() == NetworkState::Connected)
+		return;
+
+	const DynamicBvh& entityTree = renderer->GetEntityTree();
+	unsigned int boundsCount = min(renderer->GetEntityBoundsCount(), entities.GetCount());
+	for (unsigned int i = 0; i < projectiles->GetCount(); i++)
+	{
+		if (!projectiles->IsLive(i))
+			continue;
+
+		bool hit = false;
+		BoundingSphere sphere(projectiles->GetPosition(i), PROJECTILE_RADIUS);
+		entityTree.Query(sphere, [&](unsigned int index, bool inside)
+		{
+			if (index >= boundsCount || entities.GetHandle(entities.GetEntity(index)).Type != EntityType::Entity)
+				return;
+			if (inside || sphere.Intersects(renderer->GetEntityBounds(index)))
+				hit = true;
+		});
+		if (hit)
+			projectiles->Release(i);
+	}
+}
+
+// --------------------------------------------------------
+// Starts the simulation thread from where everything is now
+// --------------------------------------------------------
+void Game::StartSimulationThread()
+{
+	simulation.Start(camera, localPlayer, projectiles, tickRate);
+
+	const RenderPacket* packet;
+	simulation.AcquirePacket(packet);
+	appliedState = packet->Current;
+	lastPacketTick = packet->Tick;
+	projectileChanges.assign(appliedState.Projectiles.size(), 0);
+}
+
+// --------------------------------------------------------
+// Sets everything the simulation moves from its newest
+// packet, with the packet's older state saved first so the
+// frame's drawn between the two
+//  - The camera's rotation is left alone, since looking
+//    around happens here every frame
+//  - So are projectiles changed here since the packet was
+//    built (one just fired would be put back as it was)
+// --------------------------------------------------------
+void Game::ApplyRenderPacket()
+{
+	const RenderPacket* packet;
+	if (!simulation.AcquirePacket(packet))
+	{
+		lastTickCount = 0;
+		tickBlend = simulation.GetBlend(*packet);
+		return;
+	}
+	lastTickCount = (int)(packet->Tick - lastPacketTick);
+	lastPacketTick = packet->Tick;
+
+	auto isStale = [&](unsigned int i) { return i < projectileChanges.size() && packet->ChangesApplied < projectileChanges[i]; };
+
+	const SimulationState* states[2] = { &packet->Previous, &packet->Current };
+	for (int s = 0; s < 2; s++)
+	{
+		XMFLOAT3 pos = states[s]->CameraPosition;
+		camera->GetTransform()->SetPosition(pos.x, pos.y, pos.z);
+		unsigned int count = min((unsigned int)states[s]->Projectiles.size(), projectiles->GetCount());
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (!isStale(i))
+				projectiles->SetState(i, states[s]->Projectiles[i]);
+		}
+		if (s == 0)
+		{
+			interpolator.Save();
+			projectiles->SavePositions();
+		}
+	}
+	localPlayer->SetVelocity(packet->Current.PlayerVelocity.x, packet->Current.PlayerVelocity.y, packet->Current.PlayerVelocity.z);
+
+	// Ones that just died leave the scene
+	unsigned int count = min((unsigned int)packet->Current.Projectiles.size(), projectiles->GetCount());
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (packet->Current.Projectiles[i].Dead && !isStale(i))
+			projectiles->Release(i);
+	}
+
+	// What's here now, stale ones included, is what later changes are against
+	appliedState.CameraPosition = packet->Current.CameraPosition;
+	appliedState.CameraPitchYawRoll = packet->Current.CameraPitchYawRoll;
+	appliedState.PlayerVelocity = packet->Current.PlayerVelocity;
+	appliedState.Projectiles.resize(projectiles->GetCount());
+	for (unsigned int i = 0; i < projectiles->GetCount(); i++)
+		appliedState.Projectiles[i] = projectiles->GetState(i);
+	tickBlend = simulation.GetBlend(*packet);
+}
+
+// --------------------------------------------------------
+// Hands the simulation whatever was changed here since the
+// packet was applied (the controls and camera rotation every
+// frame, anything else only when it's different)
+// --------------------------------------------------------
+void Game::SendSimulationChanges()
+{
+	simulation.SetControls(Player::ReadControls());
+
+	Transform* cameraTransform = camera->GetTransform();
+	simulation.SetCameraPitchYawRoll(cameraTransform->GetPitchYawRoll());
+	XMFLOAT3 pos = cameraTransform->GetPosition();
+	XMFLOAT3& applied = appliedState.CameraPosition;
+	if (pos.x != applied.x || pos.y != applied.y || pos.z != applied.z)
+	{
+		simulation.SetCameraPosition(pos);
+		applied = pos;
+	}
+
+	// (Ones made since the last packet are always new to it)
+	for (unsigned int i = 0; i < projectiles->GetCount(); i++)
+	{
+		SimulatedProjectile state = projectiles->GetState(i);
+		bool isNew = i >= appliedState.Projectiles.size();
+		if (isNew || !SimulationThread::Matches(state, appliedState.Projectiles[i]))
+		{
+			if (isNew)
+				appliedState.Projectiles.resize(i + 1);
+			if (projectileChanges.size() <= i)
+				projectileChanges.resize(i + 1, 0);
+			projectileChanges[i] = simulation.SetProjectile(i, state);
+			appliedState.Projectiles[i] = state;
+		}
+	}
 }
 
 // --------------------------------------------------------
@@ -772,7 +2648,98 @@ void Game::Update(float deltaTime, float totalTime)
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
+	PROFILE_SCOPE("Game::Draw");
+	// Drawn part way into the next tick, which is put back
+	// once it's drawn so the simulation carries on from it
+	interpolator.Apply(tickBlend);
+	projectiles->SetBlend(tickBlend);
+	camera->UpdateViewMatrix();
+
+	// Catch any entities created since last frame (like new players),
+	// then rebuild every dirty matrix at once
+	if (dataOrientedTransforms)
+	{
+		for (auto& e : entities.GetEntities())
+			transformSystem->Add(e->GetTransform());
+		transformSystem->Update();
+	}
+
+	// Every so often the scene arrays (and the transform system's slots)
+	// go back in spatial order, for everything that loops over them
+	if (spatialSort && ++framesSinceSpatialSort >= ENTITY_SPATIAL_SORT_FRAMES)
+	{
+		framesSinceSpatialSort = 0;
+		std::vector<unsigned int> order;
+		if (entities.SortSpatially(order))
+			renderer->RemapSceneOrder(order);
+		if (dataOrientedTransforms)
+			transformSystem->SortSpatially();
+	}
+
+	unsigned int syncInterval, presentFlags;
+	GetPresentOptions(syncInterval, presentFlags);
+	renderer->SetPresentOptions(syncInterval, presentFlags);
+	if (lateLatchCamera && !scriptedBenchmark.IsRunning() && !particleBenchmark.IsRunning() && !frameReplay.IsRunning())
+		renderer->SetCameraLateLatch([this, deltaTime]() { LateLatchCamera(deltaTime); });
+	else
+		renderer->SetCameraLateLatch(0);
+
+	// Exactly what's about to be drawn
+	if (captureNextFrame)
+	{
+		frameCapture.Capture(entities, materials, lights.GetLights(), lightCount, emitters, camera, totalTime, skyIndex, width, height);
+		frameCapture.Save(FRAME_CAPTURE_FILE);
+		captureNextFrame = false;
+	}
+	if (frameReplay.IsRunning())
+		totalTime = frameReplay.GetTotalTime();
+
 	renderer->Render(camera, totalTime, lightCount, lightVS, lightPS, lightMesh);
+	SetPresentOccluded(renderer->GetPresentResult() == DXGI_STATUS_OCCLUDED);
+	interpolator.Restore();
+	frameReplay.RecordFrame(renderer->GetGpuProfiler());
+
+	float cpuMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - cpuFrameStart).count();
+	float frameMs = GetFrameSeconds() * 1000.0f;
+	frameTimes.RecordFrame(frameMs, cpuMs, renderer->GetGpuProfiler().GetFrameMs());
+	if (scriptedBenchmark.RecordFrame(frameMs, cpuMs, renderer))
+	{
+		if (!regressionSuite.IsRunning())
+			Quit(scriptedBenchmark.Succeeded() ? 0 : 1);
+		else if (regressionSuite.FinishScenario(scriptedBenchmark.Succeeded(), scriptedBenchmark.GetMetrics()))
+			Quit(regressionSuite.Passed() ? 0 : 1);
+		else
+			StartRegressionScenario();
+	}
+}
+
+
+// --------------------------------------------------------
+// A frame that's throttled away in the background still
+// has to close ImGui's frame, if Update began one
+// --------------------------------------------------------
+void Game::DrawSkipped()
+{
+	if (uiVisible)
+		ImGui::EndFrame();
+}
+
+
+// --------------------------------------------------------
+// Turns the camera by however far the mouse has moved since
+// Update, right before the view is used for the frame, so
+// what's shown is up to date with the mouse as it can be
+//  - Only rotation, since moving is up to the simulation
+// --------------------------------------------------------
+void Game::LateLatchCamera(float deltaTime)
+{
+	int xDelta, yDelta;
+	Input::GetInstance().LateUpdateMouse(xDelta, yDelta);
+	if (xDelta == 0 && yDelta == 0)
+		return;
+
+	localPlayer->Look(deltaTime, xDelta, yDelta);
+	camera->UpdateViewMatrix();
 }
 
 
@@ -1,31 +1,63 @@
 #pragma once
 
 #include "DXCore.h"
+#include "AssetLoader.h"
 #include "Mesh.h"
-#include "GameEntity.h"
+#include "EntityRegistry.h"
 #include "Camera.h"
 #include "SimpleShader.h"
 #include "SpriteFont.h"
 #include "SpriteBatch.h"
 #include "Lights.h"
+#include "LightManager.h"
 #include "Sky.h"
 #include "Input.h"
 #include "Player.h"
 #include "Renderer.h"
 #include "Projectile.h"
+#include "ProjectilePool.h"
 #include "NetworkManager.h"
 #include "Emitter.h"
+#include "ParticleBenchmark.h"
+#include "MaterialAtlas.h"
+#include "TransformSystem.h"
+#include "TransformInterpolator.h"
+#include "SimulationThread.h"
+#include "FrameTimeRecorder.h"
+#include "ScriptedBenchmark.h"
+#include "FrameCapture.h"
+#include "RegressionSuite.h"
+#include "SceneFile.h"
+#include "JobSystem.h"
+#include "LoadProfiler.h"
+#include "AllocationTracker.h"
+#include "FrameArena.h"
+#include "CpuProfiler.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
+#include "Extensions/imgui/imgui.h"
 
 #include <DirectXMath.h>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <vector>
+#include <chrono>
+
+// The simulation's ticks per second, by default the same as the server's
+#define GAME_DEFAULT_TICK_RATE		60
+
+// Frames that fall further behind than this many ticks drop the rest,
+// rather than spending even longer catching up
+#define GAME_MAX_TICKS_PER_FRAME	5
+
+// Generated point lights that cast shadows (through the shadow atlas)
+#define GAME_SHADOWED_POINT_LIGHTS	4
 
 class Game 
 	: public DXCore
 {
 
 public:
-	Game(HINSTANCE hInstance);
+	Game(HINSTANCE hInstance, const ScriptedBenchmarkOptions& benchmarkOptions);
 	~Game();
 
 	// Overridden setup and game loop methods, which
@@ -34,6 +66,7 @@ public:
 	void OnResize();
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
+	void DrawSkipped();
 
 private:
 
@@ -43,19 +76,125 @@ private:
 
 	// Keep track of "stuff" to clean up
 	std::vector<Material*> materials;
+	std::vector<MaterialAtlas*> materialAtlases;
+	bool materialAtlasesBuilt;	// Once every texture has streamed in
 	std::vector<GameEntity*>* currentScene;
-	std::vector<GameEntity*> entities;
-	Projectile* projectiles[MAX_PROJECTILES];
+	EntityRegistry entities;
+
+	// Entity transforms, when they're data oriented
+	TransformSystem* transformSystem;
+	bool dataOrientedTransforms;
+	bool spatialSort;
+	unsigned int framesSinceSpatialSort;
+
+	// The player and projectiles move in fixed ticks, and are drawn
+	// part way between the last two (as far as the leftover time is
+	// through the next one)
+	//  - Turned off, there's one tick per frame of the frame's time
+	bool fixedTimestep;
+	int tickRate;
+	float tickAccumulator;
+	float tickBlend;
+	int lastTickCount;
+	TransformInterpolator interpolator;
+	void SimulateTick(float dt);
+	void CollideProjectiles();
+
+	// The same ticks on a thread of their own, with each frame drawn
+	// from the newest one finished while the next is simulated
+	//  - The network and hits stay here, since they need the scene,
+	//    and are handed to the thread as changes (as is looking around)
+	bool pipelinedSimulation;
+	SimulationThread simulation;
+	SimulationState appliedState;	// What the newest packet set everything to
+	unsigned long long lastPacketTick;
+	std::vector<unsigned long long> projectileChanges;	// The last change handed over for each projectile
+	void StartSimulationThread();
+	void ApplyRenderPacket();
+	void SendSimulationChanges();
+
+	// Turns the camera again from the input that's come in since Update,
+	// from part way into Render() (see Renderer::SetCameraLateLatch())
+	bool lateLatchCamera;
+	void LateLatchCamera(float deltaTime);
+
+	// The debug UI, hidden and shown again with F1 (or its button), which
+	// while hidden isn't built or drawn at all (no ImGui frame either)
+	bool uiVisible;
+
+	// Every frame's times, for percentiles and hitches, saved on F9
+	// (and on exit) as CSV
+	FrameTimeRecorder frameTimes;
+	std::chrono::high_resolution_clock::time_point cpuFrameStart;
+
+	// A run set up from the command line, which flies the camera along
+	// a path with the UI off, then quits with the report written
+	ScriptedBenchmarkOptions benchmarkOptions;
+	ScriptedBenchmark scriptedBenchmark;
+	void StartScriptedBenchmark();
+
+	// One frame's scene, saved to be drawn again in place of the live
+	// one, with the simulation stopped, so the renderer can be timed
+	// on its own (from the UI, or with -replay)
+	FrameCapture frameCapture;
+	FrameReplay frameReplay;
+	bool captureNextFrame;
+	char replayLabel[64] = "Baseline";
+	void StartFrameReplay();
+	void StopFrameReplay();
+	void BuildFrameReplayUI();
+
+	// Extra entities, lights and emitters, from the command line or the UI,
+	// for measuring how everything scales
+	StressSceneOptions stressOptions;
+	StressScene stressScene;
+	void GenerateStressScene();
+	void AddStressScene(SceneData& scene);
+	void ClearStressScene();
+
+	// Benchmark runs of each scenario in turn, from the command line,
+	// which quit once they're compared with the baseline
+	RegressionSuite regressionSuite;
+	void StartRegressionScenario();
+
+	// Last transform benchmark results (regular, system) for 10k and 100k
+	double transformBenchmarkMs[2][2];
+
+	// Last BVH benchmark results (brute force, tree) for 10k and 100k
+	double bvhBenchmarkMs[2][2];
+	ProjectilePool* projectiles;
 	Camera* camera;
 	Player* localPlayer;
 
 	// Lights
-	std::vector<Light> lights;
+	LightManager lights;
 	int lightCount;
 
+	// Object Manager, which only builds the rows that are on screen
+	// and only has editing widgets for what's selected
+	ImGuiTextFilter lightFilter;
+	ImGuiTextFilter entityFilter;
+	std::vector<unsigned int> objectManagerRows;
+	int selectedLight = -1;
+	EntityHandle selectedEntity = { EntityType::Entity, 0, UINT_MAX };
+
 	//Emitters
 	std::vector<Emitter*> emitters;
 
+	// Emitters off screen are neither simulated nor drawn, and
+	// ones far away are only simulated every few frames
+	bool emitterCulling;
+	int visibleEmitterCount;
+	void CullEmitters();
+
+	// Particle benchmark, which turns off batching and culling
+	// while it runs so every mode draws the same way
+	ParticleBenchmark particleBenchmark;
+	ParticleBenchmarkSettings particleBenchmarkSettings;
+	bool benchmarkSavedBatching;
+	bool benchmarkSavedCulling;
+	void StartParticleBenchmark();
+
 	// These will be loaded along with other assets and
 	// saved to these variables for ease of access
 	Mesh* lightMesh;
@@ -73,15 +212,48 @@ private:
 	// Skybox
 	Sky* sky;
 
+	// Switching skies at runtime: the new faces stream in, then the
+	// sky's IBL maps are remade over a few frames (see Sky::UpdateIBL())
+	int skyIndex;
+	int pendingSkyIndex;
+	TextureRequest* skyFaceRequests[6];
+	float skyRebuildBudgetMs;
+	void UpdateSky();
+	void RequestSky(int index);
+
 	// General helpers for setup and drawing
 	void GenerateLights();
 	void DrawUI();
+	void BuildUI();
+
+	// The CPU profiler's timeline, of this many of the last frames
+	int cpuProfileFrames;
+	std::vector<CpuProfileThread> cpuProfile;
+	void BuildCpuProfilerUI();
+
+	// What's using GPU memory, and the biggest resources
+	std::vector<GpuAllocation> gpuLargest;
+	void BuildGpuMemoryUI();
+
+	// Heap allocations per frame, and (in debug builds) where they're from
+	bool allocationSitesLastFrame;
+	std::vector<float> allocationHistory;
+	std::vector<AllocationCallSite> allocationSites;
+	void BuildAllocationUI();
 
 	//Renderer
 	Renderer* renderer;
 
-	// Initialization helper method
+	// Initialization helper methods
 	void LoadAssetsAndCreateEntities();
+	void WarmUpRenderer();
+
+	// Levels (see SceneFile), and the lights the scene came with
+	std::vector<Light> sceneLights;
+	void BuildDefaultScene(SceneData& scene);
+	void CreateScene(const SceneView& scene);
+	void StreamMaterialTexture(Material* material, const std::string& slot, const std::string& name);
+	void OnAssetReloaded(const AssetReload& reload);
 
 	Input& input = Input::GetInstance();
 
@@ -7,6 +7,10 @@ GameEntity::GameEntity(Mesh* mesh, Material* material)
 	// Save the data
 	this->mesh = mesh;
 	this->material = material;
+
+	// Not in a registry yet
+	handle = {};
+	sceneIndex = -1;
 }
 
 Mesh* GameEntity::GetMesh() { return mesh; }
@@ -7,6 +7,33 @@
 #include "Transform.h"
 #include "Camera.h"
 
+// Which pool of the EntityRegistry a handle points into
+enum class EntityType : unsigned short
+{
+	Entity,
+	Player
+};
+
+// Refers to an entity without keeping a pointer to it
+//  - The generation goes up every time a slot is reused, so a handle
+//    to something that's been destroyed just resolves to null
+struct EntityHandle
+{
+	EntityType Type;
+	unsigned short Generation;
+	unsigned int Index;
+};
+
+inline bool operator==(const EntityHandle& a, const EntityHandle& b)
+{
+	return a.Type == b.Type && a.Generation == b.Generation && a.Index == b.Index;
+}
+
+inline bool operator!=(const EntityHandle& a, const EntityHandle& b)
+{
+	return !(a == b);
+}
+
 class GameEntity
 {
 public:
@@ -23,5 +50,11 @@ protected:
 	Mesh* mesh;
 	Material* material;
 	Transform transform;
+
+private:
+	// Where the registry keeps this entity
+	friend class EntityRegistry;
+	EntityHandle handle;
+	int sceneIndex;
 };
 
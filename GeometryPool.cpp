@@ -0,0 +1,262 @@
+#include "GeometryPool.h"
+#include "GpuMemory.h"
+
+// Singleton requirement
+GeometryPool* GeometryPool::instance;
+
+
+GeometryRangeAllocator::GeometryRangeAllocator()
+{
+	capacity = 0;
+	freeCount = 0;
+}
+
+void GeometryRangeAllocator::Reset(unsigned int capacity)
+{
+	this->capacity = capacity;
+	freeCount = capacity;
+	freeRanges.clear();
+	if (capacity > 0)
+		freeRanges.push_back({ 0, capacity });
+}
+
+// Everything's packed at the front once the only free
+// space left is at the end
+bool GeometryRangeAllocator::IsPacked()
+{
+	return freeRanges.empty() || (freeRanges.size() == 1 && freeRanges[0].Start + freeRanges[0].Count == capacity);
+}
+
+bool GeometryRangeAllocator::Allocate(unsigned int count, unsigned int& start)
+{
+	for (size_t i = 0; i < freeRanges.size(); i++)
+	{
+		GeometryRange& r = freeRanges[i];
+		if (r.Count < count)
+			continue;
+
+		start = r.Start;
+		r.Start += count;
+		r.Count -= count;
+		if (r.Count == 0)
+			freeRanges.erase(freeRanges.begin() + i);
+
+		freeCount -= count;
+		return true;
+	}
+
+	return false;
+}
+
+// --------------------------------------------------------
+// Puts the range back in order, merging it with the free
+// ranges right before and after it
+// --------------------------------------------------------
+void GeometryRangeAllocator::Free(unsigned int start, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	size_t i = 0;
+	while (i < freeRanges.size() && freeRanges[i].Start < start)
+		i++;
+
+	freeRanges.insert(freeRanges.begin() + i, { start, count });
+	freeCount += count;
+
+	if (i + 1 < freeRanges.size() && freeRanges[i].Start + freeRanges[i].Count == freeRanges[i + 1].Start)
+	{
+		freeRanges[i].Count += freeRanges[i + 1].Count;
+		freeRanges.erase(freeRanges.begin() + i + 1);
+	}
+
+	if (i > 0 && freeRanges[i - 1].Start + freeRanges[i - 1].Count == freeRanges[i].Start)
+	{
+		freeRanges[i - 1].Count += freeRanges[i].Count;
+		freeRanges.erase(freeRanges.begin() + i);
+	}
+}
+
+
+GeometryPool::~GeometryPool()
+{
+	for (auto b : buffers)
+	{
+		for (auto a : b->Allocations) delete a;
+		delete b;
+	}
+}
+
+void GeometryPool::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->device = device;
+	this->context = context;
+}
+
+GeometryBuffers* GeometryPool::GetBuffers(unsigned int stride, DXGI_FORMAT indexFormat)
+{
+	for (auto b : buffers)
+	{
+		if (b->Stride == stride && b->IndexFormat == indexFormat)
+			return b;
+	}
+
+	GeometryBuffers* b = new GeometryBuffers();
+	b->Stride = stride;
+	b->IndexFormat = indexFormat;
+	b->IndexSize = indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(unsigned short) : sizeof(unsigned int);
+	buffers.push_back(b);
+	return b;
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> GeometryPool::CreateBuffer(unsigned int byteWidth, unsigned int bindFlags)
+{
+	// Default usage, since meshes are copied in (and moved
+	// around) with the context rather than being immutable
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.ByteWidth = byteWidth;
+	desc.BindFlags = bindFlags;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, buffer.GetAddressOf(), GpuMemoryCategory::Meshes, "Geometry Pool");
+	return buffer;
+}
+
+// --------------------------------------------------------
+// Makes new buffers at the given capacities and copies every
+// allocation over, packed one after another from the start
+//  - Copying between two buffers on the GPU, since copying
+//    overlapping ranges within one isn't allowed
+// --------------------------------------------------------
+void GeometryPool::Rebuild(GeometryBuffers* b, unsigned int vertexCapacity, unsigned int indexCapacity)
+{
+	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer = CreateBuffer(vertexCapacity * b->Stride, D3D11_BIND_VERTEX_BUFFER);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer = CreateBuffer(indexCapacity * b->IndexSize, D3D11_BIND_INDEX_BUFFER);
+	b->Vertices.Reset(vertexCapacity);
+	b->Indices.Reset(indexCapacity);
+
+	for (auto a : b->Allocations)
+	{
+		unsigned int baseVertex;
+		unsigned int startIndex;
+		b->Vertices.Allocate(a->VertexCount, baseVertex);
+		b->Indices.Allocate(a->IndexCount, startIndex);
+
+		// Nothing to copy the first time around
+		if (b->VertexBuffer)
+		{
+			D3D11_BOX box = { a->BaseVertex * b->Stride, 0, 0, (a->BaseVertex + a->VertexCount) * b->Stride, 1, 1 };
+			context->CopySubresourceRegion(vertexBuffer.Get(), 0, baseVertex * b->Stride, 0, 0, b->VertexBuffer.Get(), 0, &box);
+
+			box = { a->StartIndex * b->IndexSize, 0, 0, (a->StartIndex + a->IndexCount) * b->IndexSize, 1, 1 };
+			context->CopySubresourceRegion(indexBuffer.Get(), 0, startIndex * b->IndexSize, 0, 0, b->IndexBuffer.Get(), 0, &box);
+		}
+
+		a->BaseVertex = baseVertex;
+		a->StartIndex = startIndex;
+	}
+
+	b->VertexBuffer = vertexBuffer;
+	b->IndexBuffer = indexBuffer;
+}
+
+GeometryAllocation* GeometryPool::Allocate(const void* vertices, unsigned int vertexCount, unsigned int stride, const void* indices, unsigned int indexCount, DXGI_FORMAT indexFormat)
+{
+	GeometryBuffers* b = GetBuffers(stride, indexFormat);
+
+	GeometryAllocation* a = new GeometryAllocation();
+	a->Buffers = b;
+	a->VertexCount = vertexCount;
+	a->IndexCount = indexCount;
+
+	bool verticesFit = b->Vertices.Allocate(vertexCount, a->BaseVertex);
+	bool indicesFit = verticesFit && b->Indices.Allocate(indexCount, a->StartIndex);
+	if (!indicesFit)
+	{
+		if (verticesFit)
+			b->Vertices.Free(a->BaseVertex, vertexCount);
+
+		// Packing leaves all the free space in one piece, so each part
+		// only has to double until there's room past what's used
+		auto capacityFor = [](GeometryRangeAllocator& space, unsigned int count, unsigned int initialCapacity)
+		{
+			unsigned int used = space.GetCapacity() - space.GetFreeCount();
+			unsigned int capacity = max(space.GetCapacity(), initialCapacity);
+			while (capacity - used < count)
+				capacity *= 2;
+			return capacity;
+		};
+
+		Rebuild(b,
+			capacityFor(b->Vertices, vertexCount, GEOMETRY_POOL_INITIAL_VERTICES),
+			capacityFor(b->Indices, indexCount, GEOMETRY_POOL_INITIAL_INDICES));
+		b->Vertices.Allocate(vertexCount, a->BaseVertex);
+		b->Indices.Allocate(indexCount, a->StartIndex);
+	}
+	b->Allocations.push_back(a);
+
+	D3D11_BOX box = { a->BaseVertex * stride, 0, 0, (a->BaseVertex + vertexCount) * stride, 1, 1 };
+	context->UpdateSubresource(b->VertexBuffer.Get(), 0, &box, vertices, 0, 0);
+
+	box = { a->StartIndex * b->IndexSize, 0, 0, (a->StartIndex + indexCount) * b->IndexSize, 1, 1 };
+	context->UpdateSubresource(b->IndexBuffer.Get(), 0, &box, indices, 0, 0);
+
+	return a;
+}
+
+void GeometryPool::Free(GeometryAllocation* allocation)
+{
+	GeometryBuffers* b = allocation->Buffers;
+	b->Vertices.Free(allocation->BaseVertex, allocation->VertexCount);
+	b->Indices.Free(allocation->StartIndex, allocation->IndexCount);
+
+	for (size_t i = 0; i < b->Allocations.size(); i++)
+	{
+		if (b->Allocations[i] == allocation)
+		{
+			b->Allocations.erase(b->Allocations.begin() + i);
+			break;
+		}
+	}
+	delete allocation;
+}
+
+void GeometryPool::Defragment()
+{
+	for (auto b : buffers)
+	{
+		if (b->Vertices.IsPacked() && b->Indices.IsPacked())
+			continue;
+
+		Rebuild(b, b->Vertices.GetCapacity(), b->Indices.GetCapacity());
+	}
+}
+
+void GeometryPool::SetBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, GeometryAllocation* allocation)
+{
+	GeometryBuffers* b = allocation->Buffers;
+	UINT stride = b->Stride;
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, b->VertexBuffer.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(b->IndexBuffer.Get(), b->IndexFormat, 0);
+}
+
+unsigned long long GeometryPool::GetUsedBytes()
+{
+	unsigned long long bytes = 0;
+	for (auto b : buffers)
+	{
+		bytes += (unsigned long long)(b->Vertices.GetCapacity() - b->Vertices.GetFreeCount()) * b->Stride;
+		bytes += (unsigned long long)(b->Indices.GetCapacity() - b->Indices.GetFreeCount()) * b->IndexSize;
+	}
+	return bytes;
+}
+
+unsigned long long GeometryPool::GetCapacityBytes()
+{
+	unsigned long long bytes = 0;
+	for (auto b : buffers)
+		bytes += (unsigned long long)b->Vertices.GetCapacity() * b->Stride + (unsigned long long)b->Indices.GetCapacity() * b->IndexSize;
+	return bytes;
+}
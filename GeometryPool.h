@@ -0,0 +1,127 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+
+// Starting size of each format's shared buffers, in elements,
+// which at least double whenever they run out of room
+#define GEOMETRY_POOL_INITIAL_VERTICES	(1 << 16)
+#define GEOMETRY_POOL_INITIAL_INDICES	(1 << 18)
+
+// A run of elements in one of the shared buffers
+struct GeometryRange
+{
+	unsigned int Start;
+	unsigned int Count;
+};
+
+// Hands out ranges of a fixed size space (first fit), keeping the
+// free ranges sorted so freed ones merge with their neighbours
+class GeometryRangeAllocator
+{
+public:
+	GeometryRangeAllocator();
+
+	void Reset(unsigned int capacity);
+	bool Allocate(unsigned int count, unsigned int& start);
+	void Free(unsigned int start, unsigned int count);
+
+	unsigned int GetCapacity() { return capacity; }
+	unsigned int GetFreeCount() { return freeCount; }
+	unsigned int GetFreeRangeCount() { return (unsigned int)freeRanges.size(); }
+	bool IsPacked();
+
+private:
+	std::vector<GeometryRange> freeRanges;
+	unsigned int capacity;
+	unsigned int freeCount;
+};
+
+struct GeometryBuffers;
+
+// Where one mesh's vertices and indices are in the shared buffers
+//  - Owned by the pool, which moves it around when defragmenting,
+//    so meshes read it every time they draw
+struct GeometryAllocation
+{
+	GeometryBuffers* Buffers;
+	unsigned int BaseVertex;
+	unsigned int VertexCount;
+	unsigned int StartIndex;
+	unsigned int IndexCount;
+};
+
+// One shared vertex and index buffer, for every mesh with
+// the same vertex stride and index format
+struct GeometryBuffers
+{
+	unsigned int Stride;
+	DXGI_FORMAT IndexFormat;
+	unsigned int IndexSize;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> VertexBuffer;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> IndexBuffer;
+	GeometryRangeAllocator Vertices;
+	GeometryRangeAllocator Indices;
+	std::vector<GeometryAllocation*> Allocations;
+};
+
+// Suballocates every mesh's vertices and indices out of a few large
+// buffers, so draws sorted by mesh only rebind the input assembler
+// when the vertex format changes
+//  - Meshes draw their ranges with base vertex and start index offsets
+//  - Only used from the main thread (loading and unloading meshes),
+//    though drawing from the buffers is fine from anywhere
+class GeometryPool
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static GeometryPool& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new GeometryPool();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	GeometryPool(GeometryPool const&) = delete;
+	void operator=(GeometryPool const&) = delete;
+
+private:
+	static GeometryPool* instance;
+	GeometryPool() {};
+#pragma endregion
+
+public:
+	~GeometryPool();
+
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	bool IsInitialized() { return device != 0; }
+
+	// Copies the data into the matching format's buffers, growing them if they're full
+	GeometryAllocation* Allocate(const void* vertices, unsigned int vertexCount, unsigned int stride, const void* indices, unsigned int indexCount, DXGI_FORMAT indexFormat);
+	void Free(GeometryAllocation* allocation);
+
+	// Packs each format's allocations to the front of its buffers, so the
+	// holes left by unloaded meshes become one free range at the end
+	void Defragment();
+
+	void SetBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, GeometryAllocation* allocation);
+
+	unsigned int GetBufferCount() { return (unsigned int)buffers.size(); }
+	unsigned long long GetUsedBytes();
+	unsigned long long GetCapacityBytes();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::vector<GeometryBuffers*> buffers;
+
+	GeometryBuffers* GetBuffers(unsigned int stride, DXGI_FORMAT indexFormat);
+	void Rebuild(GeometryBuffers* b, unsigned int vertexCapacity, unsigned int indexCapacity);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> CreateBuffer(unsigned int byteWidth, unsigned int bindFlags);
+};
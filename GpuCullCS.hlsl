@@ -0,0 +1,146 @@
+#include "GpuCulling.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	float4 frustumPlanes[6];	// Pointing inwards
+	matrix hiZViewProjection;	// The view the Hi-Z pyramid was built from
+
+	float3 cameraPosition;
+	uint entityCount;
+
+	float4 lodCoverages;		// Screen coverage where each level starts
+	float lodScale;				// Projection y scale, times the LOD scale
+	float lodHysteresis;
+	uint useLods;
+	uint useOcclusion;
+
+	uint2 hiZSize;
+	uint hiZMipCount;
+};
+
+StructuredBuffer<CullEntity> Entities	: register(t0);
+StructuredBuffer<CullBucket> Buckets		: register(t1);
+Texture2D<float> HiZ						: register(t2);
+
+// Visible entities' instances, how many each bucket got per level
+// of detail, and each entity's level from last frame
+RWByteAddressBuffer Instances			: register(u0);
+RWByteAddressBuffer Counters			: register(u1);
+RWStructuredBuffer<uint> Lods			: register(u2);
+
+
+bool InFrustum(float3 center, float3 extents)
+{
+	[unroll]
+	for (int i = 0; i < 6; i++)
+	{
+		if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w + dot(extents, abs(frustumPlanes[i].xyz)) < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+// Same test as HiZBuffer::IsOccluded(), against the pyramid
+// itself rather than a read back copy
+bool IsOccluded(float3 center, float3 extents)
+{
+	float2 minNDC = 1e30f;
+	float2 maxNDC = -1e30f;
+	float minZ = 1e30f;
+	for (uint i = 0; i < 8; i++)
+	{
+		float3 corner = center + extents * float3(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1);
+		float4 clip = mul(hiZViewProjection, float4(corner, 1));
+
+		// Anything crossing the near plane is too close to call
+		if (clip.w <= 0.0001f)
+			return false;
+
+		minNDC = min(minNDC, clip.xy / clip.w);
+		maxNDC = max(maxNDC, clip.xy / clip.w);
+		minZ = min(minZ, clip.z / clip.w);
+	}
+
+	// Off (or partly off) the old screen, where there's no depth
+	if (any(minNDC < -1.0f) || any(maxNDC > 1.0f) || minZ < 0.0f)
+		return false;
+
+	// NDC to texels of the finest level (y flipped), then the first
+	// level where the rect is at most 2x2 texels
+	float2 topLeft = float2(minNDC.x * 0.5f + 0.5f, 0.5f - maxNDC.y * 0.5f) * hiZSize;
+	float2 bottomRight = float2(maxNDC.x * 0.5f + 0.5f, 0.5f - minNDC.y * 0.5f) * hiZSize;
+	float size = max(bottomRight.x - topLeft.x, bottomRight.y - topLeft.y);
+	uint level = min(hiZMipCount - 1, (uint)ceil(log2(max(size * 0.5f, 1.0f))));
+
+	int2 levelMax = int2(max(hiZSize >> level, 1)) - 1;
+	int2 start = clamp(int2(topLeft / (1 << level)), 0, levelMax);
+	int2 end = clamp(int2(bottomRight / (1 << level)), 0, levelMax);
+
+	float farthest = 0.0f;
+	for (int y = start.y; y <= end.y; y++)
+		for (int x = start.x; x <= end.x; x++)
+			farthest = max(farthest, HiZ.Load(int3(x, y, level)));
+
+	return minZ > farthest;
+}
+
+// Same selection as Renderer::UpdateEntityLods(), with each
+// entity's last level kept here instead
+uint SelectLod(uint entity, float3 center, float radius, uint lodCount)
+{
+	if (!useLods)
+		return 0;
+
+	float coverage = radius * lodScale / max(distance(center, cameraPosition), radius);
+	uint lod = min(Lods[entity], lodCount - 1);
+	while (lod + 1 < lodCount && coverage < lodCoverages[lod + 1])
+		lod++;
+	while (lod > 0 && coverage > lodCoverages[lod] * (1.0f + lodHysteresis))
+		lod--;
+
+	Lods[entity] = lod;
+	return lod;
+}
+
+// One thread per entity, appending each visible one to
+// its bucket's instances for the level it's drawn at
+[numthreads(GPU_CULLING_GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= entityCount)
+		return;
+
+	CullEntity e = Entities[id.x];
+	float4x4 world = float4x4(e.World[0], e.World[1], e.World[2], e.World[3]);
+
+	// World space box around the local bounds
+	float3 center = mul(float4(e.BoundsCenter, 1), world).xyz;
+	float3 extents =
+		abs(e.BoundsExtents.x * world[0].xyz) +
+		abs(e.BoundsExtents.y * world[1].xyz) +
+		abs(e.BoundsExtents.z * world[2].xyz);
+
+	if (!InFrustum(center, extents))
+		return;
+	if (useOcclusion && IsOccluded(center, extents))
+		return;
+
+	// The radius of the oriented box, like the CPU uses
+	float3 scale = float3(length(world[0].xyz), length(world[1].xyz), length(world[2].xyz));
+	CullBucket bucket = Buckets[e.Bucket];
+	uint lod = SelectLod(id.x, center, length(e.BoundsExtents * scale), bucket.LodCount);
+
+	uint slot;
+	Counters.InterlockedAdd((e.Bucket * GPU_CULLING_MAX_LODS + lod) * 4, 1, slot);
+
+	uint address = (bucket.InstanceStart + lod * bucket.Capacity + slot) * GPU_CULLING_INSTANCE_SIZE;
+	[unroll]
+	for (uint row = 0; row < 4; row++)
+	{
+		Instances.Store4(address + row * 16, asuint(e.World[row]));
+		Instances.Store4(address + 64 + row * 16, asuint(e.WorldInverseTranspose[row]));
+		Instances.Store4(address + 136 + row * 16, asuint(e.World[row])); // No object motion, just the camera's
+	}
+	Instances.Store(address + 128, e.MaterialIndex);
+	Instances.Store(address + 132, 0xFFFFFFFF); // No light list (ENTITY_LIGHT_LIST_NONE)
+}
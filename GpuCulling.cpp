@@ -0,0 +1,455 @@
+#include "GpuCulling.h"
+#include "AssetLoader.h"
+#include "GeometryPool.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+using namespace DirectX;
+
+// Bytes per set of DrawIndexedInstancedIndirect arguments
+#define GPU_CULLING_ARGS_SIZE	(5 * sizeof(unsigned int))
+
+
+GpuCulling::GpuCulling(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+	instanceCount = 0;
+	entityCapacity = 0;
+	bucketCapacity = 0;
+	drawCapacity = 0;
+	instanceCapacity = 0;
+}
+
+// --------------------------------------------------------
+// Rebuilds the buckets if any entity's mesh, material or
+// shaders changed (or entities came or went), then uploads
+// each run of entities whose transforms changed
+// --------------------------------------------------------
+void GpuCulling::Update(EntityRegistry& entities)
+{
+	stats = {};
+	unsigned int count = entities.GetCount();
+	const std::vector<Mesh*>& meshes = entities.GetMeshes();
+	const std::vector<Material*>& materials = entities.GetMaterials();
+	const std::vector<Transform*>& transforms = entities.GetTransforms();
+
+	bool rebuild = count != entityStates.size();
+	for (unsigned int i = 0; i < count && !rebuild; i++)
+	{
+		const EntityState& state = entityStates[i];
+		Material* material = materials[i];
+		rebuild =
+			state.EntityMesh != meshes[i] ||
+			state.EntityMaterial != material ||
+			state.VS != material->GetVS() ||
+			state.PS != material->GetPS() ||
+			state.BindingKey != material->GetBindingKey() ||
+			state.AtlasIndex != material->GetAtlasIndex();
+	}
+	if (rebuild)
+		RebuildBuckets(entities);
+
+	bool inRun = false;
+	unsigned int runStart = 0;
+	for (unsigned int i = 0; i <= count; i++)
+	{
+		bool changed = false;
+		if (i < count)
+		{
+			EntityState& state = entityStates[i];
+			EntityHandle handle = entities.GetHandle(entities.GetEntity(i));
+			unsigned int version = transforms[i]->GetVersion();
+			changed = rebuild || state.Handle != handle || state.Version != version;
+
+			if (changed)
+			{
+				GpuCullEntity& data = entityData[i];
+				data.World = transforms[i]->GetWorldMatrix();
+				data.WorldInverseTranspose = transforms[i]->GetWorldInverseTransposeMatrix();
+				data.BoundsCenter = meshes[i]->GetBounds().Center;
+				data.BoundsExtents = meshes[i]->GetBounds().Extents;
+				data.MaterialIndex = materials[i]->GetAtlasIndex();
+				state.Handle = handle;
+				state.Version = version;
+				stats.EntitiesUploaded++;
+			}
+		}
+
+		if (changed && !inRun)
+		{
+			runStart = i;
+			inRun = true;
+		}
+		else if (!changed && inRun)
+		{
+			UploadEntities(runStart, i);
+			inRun = false;
+		}
+	}
+
+	// Pooled meshes can move when the pool defragments,
+	// so the draws are checked every frame
+	BuildDraws();
+
+	stats.Entities = count;
+	stats.Buckets = (unsigned int)buckets.size();
+	stats.IndirectDraws = (unsigned int)draws.size();
+	stats.BucketsRebuilt = rebuild;
+}
+
+// --------------------------------------------------------
+// Groups the entities by shaders, material and mesh, and
+// gives each group a block of instances per level of detail
+// --------------------------------------------------------
+void GpuCulling::RebuildBuckets(EntityRegistry& entities)
+{
+	unsigned int count = entities.GetCount();
+	const std::vector<Mesh*>& meshes = entities.GetMeshes();
+	const std::vector<Material*>& materials = entities.GetMaterials();
+
+	auto key = [&](unsigned int i)
+	{
+		Material* m = materials[i];
+		return std::make_tuple((const void*)m->GetVS(), (const void*)m->GetPS(), m->GetBindingKey(), (const void*)meshes[i]);
+	};
+
+	std::vector<unsigned int> order(count);
+	for (unsigned int i = 0; i < count; i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return key(a) < key(b); });
+
+	buckets.clear();
+	bucketData.clear();
+	entityStates.resize(count);
+	entityData.resize(count);
+	for (unsigned int o = 0; o < count; o++)
+	{
+		unsigned int i = order[o];
+		if (o == 0 || key(i) != key(order[o - 1]))
+		{
+			buckets.push_back({ meshes[i], materials[i], 0, 0 });
+			bucketData.push_back({ 0, 0, meshes[i]->GetLodCount(), 0 });
+		}
+		bucketData.back().Capacity++;
+
+		Material* material = materials[i];
+		entityStates[i] = { meshes[i], material, material->GetVS(), material->GetPS(), material->GetBindingKey(), material->GetAtlasIndex(), {}, 0 };
+		entityData[i].Bucket = (unsigned int)buckets.size() - 1;
+	}
+
+	instanceCount = 0;
+	for (auto& b : bucketData)
+	{
+		b.InstanceStart = instanceCount;
+		instanceCount += b.Capacity * b.LodCount;
+	}
+
+	// Grow anything that's too small now
+	auto grow = [](unsigned int& capacity, unsigned int needed)
+	{
+		if (needed <= capacity && capacity > 0)
+			return false;
+		capacity = max(max(needed, 1u), capacity * 2);
+		return true;
+	};
+
+	if (grow(entityCapacity, count))
+	{
+		CreateStructuredBuffer(entityCapacity, sizeof(GpuCullEntity), false, entityBuffer, &entitySRV, 0);
+		CreateStructuredBuffer(entityCapacity, sizeof(unsigned int), true, lodBuffer, 0, &lodUAV);
+	}
+	if (grow(bucketCapacity, (unsigned int)bucketData.size()))
+	{
+		CreateStructuredBuffer(bucketCapacity, sizeof(GpuCullBucket), false, bucketBuffer, &bucketSRV, 0);
+		CreateRawBuffer(bucketCapacity * GPU_CULLING_MAX_LODS * sizeof(unsigned int), 0, 0, counterBuffer, counterUAV);
+	}
+	if (grow(instanceCapacity, instanceCount))
+		CreateRawBuffer(instanceCapacity * sizeof(InstanceData), D3D11_BIND_VERTEX_BUFFER, 0, instanceBuffer, instanceUAV);
+
+	if (!bucketData.empty())
+	{
+		D3D11_BOX box = { 0, 0, 0, (unsigned int)(sizeof(GpuCullBucket) * bucketData.size()), 1, 1 };
+		context->UpdateSubresource(bucketBuffer.Get(), 0, &box, bucketData.data(), 0, 0);
+	}
+
+	// Entities may be in different slots now, so every level of detail starts over
+	UINT zeros[4] = {};
+	context->ClearUnorderedAccessViewUint(lodUAV.Get(), zeros);
+}
+
+// One submesh draw per level of detail of each bucket
+void GpuCulling::BuildDraws()
+{
+	draws.clear();
+	for (unsigned int b = 0; b < buckets.size(); b++)
+	{
+		Bucket& bucket = buckets[b];
+		const GpuCullBucket& data = bucketData[b];
+		Mesh* mesh = bucket.BucketMesh;
+		GeometryAllocation* geometry = mesh->GetGeometry();
+		unsigned int startIndex = geometry ? geometry->StartIndex : 0;
+		unsigned int baseVertex = geometry ? geometry->BaseVertex : 0;
+
+		bucket.FirstDraw = (unsigned int)draws.size();
+		const std::vector<Submesh>& submeshes = mesh->GetSubmeshes();
+		unsigned int submeshCount = mesh->GetSubmeshCount();
+		for (unsigned int lod = 0; lod < data.LodCount; lod++)
+		{
+			for (unsigned int s = 0; s < submeshCount; s++)
+			{
+				const Submesh& submesh = submeshes[lod * submeshCount + s];
+				GpuCullDraw draw;
+				draw.Counter = b * GPU_CULLING_MAX_LODS + lod;
+				draw.IndexCount = submesh.IndexCount;
+				draw.StartIndex = startIndex + submesh.IndexStart;
+				draw.BaseVertex = (int)(baseVertex + submesh.VertexStart);
+				draw.StartInstance = data.InstanceStart + lod * data.Capacity;
+				draws.push_back(draw);
+			}
+		}
+		bucket.DrawCount = (unsigned int)draws.size() - bucket.FirstDraw;
+	}
+
+	if (draws.empty() || (draws.size() == uploadedDraws.size() && memcmp(draws.data(), uploadedDraws.data(), sizeof(GpuCullDraw) * draws.size()) == 0))
+		return;
+
+	if (draws.size() > drawCapacity)
+	{
+		drawCapacity = max((unsigned int)draws.size(), drawCapacity * 2);
+		CreateStructuredBuffer(drawCapacity, sizeof(GpuCullDraw), false, drawBuffer, &drawSRV, 0);
+		CreateRawBuffer(drawCapacity * GPU_CULLING_ARGS_SIZE, 0, D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS, argsBuffer, argsUAV);
+	}
+
+	D3D11_BOX box = { 0, 0, 0, (unsigned int)(sizeof(GpuCullDraw) * draws.size()), 1, 1 };
+	context->UpdateSubresource(drawBuffer.Get(), 0, &box, draws.data(), 0, 0);
+	uploadedDraws = draws;
+}
+
+void GpuCulling::UploadEntities(unsigned int first, unsigned int last)
+{
+	D3D11_BOX box = { (unsigned int)sizeof(GpuCullEntity) * first, 0, 0, (unsigned int)sizeof(GpuCullEntity) * last, 1, 1 };
+	context->UpdateSubresource(entityBuffer.Get(), 0, &box, &entityData[first], 0, 0);
+}
+
+// --------------------------------------------------------
+// Clears the counters, culls every entity into its bucket's
+// instances, then turns the counts into draw arguments
+// --------------------------------------------------------
+void GpuCulling::Cull(const XMFLOAT4X4& view, const XMFLOAT4X4& projection, const XMFLOAT3& cameraPosition, HiZBuffer* hiZ, float lodScale, const XMFLOAT4& lodCoverages, float lodHysteresis)
+{
+	if (draws.empty())
+		return;
+
+	// Frustum planes straight out of the view projection's columns,
+	// normalized so the box test can use their distances
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+	XMVECTOR columns[4];
+	for (int c = 0; c < 4; c++)
+		columns[c] = XMVectorSet(viewProj.m[0][c], viewProj.m[1][c], viewProj.m[2][c], viewProj.m[3][c]);
+
+	XMFLOAT4 planes[6];
+	XMVECTOR planeVectors[6] = {
+		columns[3] + columns[0],	// Left
+		columns[3] - columns[0],	// Right
+		columns[3] + columns[1],	// Bottom
+		columns[3] - columns[1],	// Top
+		columns[2],					// Near
+		columns[3] - columns[2] };	// Far
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planes[p], XMPlaneNormalize(planeVectors[p]));
+
+	bool useOcclusion = hiZ && hiZ->HasPyramid();
+	unsigned int hiZSize[2] = { useOcclusion ? hiZ->GetWidth() : 0, useOcclusion ? hiZ->GetHeight() : 0 };
+	XMFLOAT4X4 hiZViewProj = useOcclusion ? hiZ->GetPyramidViewProjection() : viewProj;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> hiZSRV;
+	if (useOcclusion)
+		hiZSRV = hiZ->GetPyramidSRV();
+
+	SimpleComputeShader* cs = Assets::GetInstance().GetComputeShader("GpuCullCS.cso"_asset);
+	cs->SetShader();
+	cs->SetData("frustumPlanes", planes, sizeof(planes));
+	cs->SetMatrix4x4("hiZViewProjection", hiZViewProj);
+	cs->SetFloat3("cameraPosition", cameraPosition);
+	cs->SetInt("entityCount", (int)entityStates.size());
+	cs->SetFloat4("lodCoverages", lodCoverages);
+	cs->SetFloat("lodScale", projection._22 * lodScale);
+	cs->SetFloat("lodHysteresis", lodHysteresis);
+	cs->SetInt("useLods", lodScale > 0.0f ? 1 : 0);
+	cs->SetInt("useOcclusion", useOcclusion ? 1 : 0);
+	cs->SetData("hiZSize", hiZSize, sizeof(hiZSize));
+	cs->SetInt("hiZMipCount", useOcclusion ? (int)hiZ->GetMipCount() : 0);
+	cs->CopyAllBufferData();
+
+	UINT zeros[4] = {};
+	context->ClearUnorderedAccessViewUint(counterUAV.Get(), zeros);
+
+	cs->SetShaderResourceView("Entities", entitySRV);
+	cs->SetShaderResourceView("Buckets", bucketSRV);
+	cs->SetShaderResourceView("HiZ", hiZSRV);
+	cs->SetUnorderedAccessView("Instances", instanceUAV);
+	cs->SetUnorderedAccessView("Counters", counterUAV);
+	cs->SetUnorderedAccessView("Lods", lodUAV);
+	cs->DispatchByThreads((unsigned int)entityStates.size(), 1, 1);
+
+	// Unbind so the counters can be read, and so the pyramid
+	// can be drawn into again at the end of the frame
+	ID3D11UnorderedAccessView* nullUAVs[3] = {};
+	ID3D11ShaderResourceView* nullSRVs[3] = {};
+	context->CSSetUnorderedAccessViews(0, 3, nullUAVs, 0);
+	context->CSSetShaderResources(0, 3, nullSRVs);
+
+	SimpleComputeShader* argsCS = Assets::GetInstance().GetComputeShader("GpuDrawArgsCS.cso"_asset);
+	argsCS->SetShader();
+	argsCS->SetInt("drawCount", (int)draws.size());
+	argsCS->CopyAllBufferData();
+	argsCS->SetShaderResourceView("Draws", drawSRV);
+	argsCS->SetUnorderedAccessView("Args", argsUAV);
+	argsCS->SetUnorderedAccessView("Counters", counterUAV);
+	argsCS->DispatchByThreads((unsigned int)draws.size(), 1, 1);
+
+	// Unbind so the instances and arguments can be drawn with
+	context->CSSetUnorderedAccessViews(0, 2, nullUAVs, 0);
+	context->CSSetShaderResources(0, 1, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+}
+
+void GpuCulling::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, SimpleVertexShader* instancedVS)
+{
+	DrawBuckets(passContext, instancedVS, false);
+}
+
+void GpuCulling::DrawDepthOnly(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, SimpleVertexShader* instancedVS)
+{
+	DrawBuckets(passContext, instancedVS, true);
+}
+
+// --------------------------------------------------------
+// Same state changes as RenderQueue::Submit(), but every
+// bucket is one instanced draw of each of its submeshes
+// (per level of detail), however many instances it got
+// --------------------------------------------------------
+void GpuCulling::DrawBuckets(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, SimpleVertexShader* instancedVS, bool depthOnly)
+{
+	if (draws.empty())
+		return;
+
+	if (depthOnly)
+	{
+		passContext->PSSetShader(0, 0, 0);
+		ISimpleShader::InvalidateStateCache(passContext);
+	}
+
+	// The culling shader's instances, in the second vertex buffer slot
+	UINT stride = sizeof(InstanceData);
+	UINT offset = 0;
+	passContext->IASetVertexBuffers(1, 1, instanceBuffer.GetAddressOf(), &stride, &offset);
+
+	Assets& assets = Assets::GetInstance();
+	SimpleVertexShader* currentVS = 0;
+	SimplePixelShader* currentPS = 0;
+	const void* currentMaterial = 0;
+	const void* currentBuffers = 0;
+
+	for (auto& bucket : buckets)
+	{
+		Material* material = bucket.BucketMaterial;
+		Mesh* mesh = bucket.BucketMesh;
+		SimpleVertexShader* vs = assets.GetVertexShaderFor(instancedVS, mesh);
+
+		if (vs != currentVS || (!depthOnly && material->GetPS() != currentPS))
+		{
+			vs->SetShader();
+			if (!depthOnly)
+				material->GetPS()->SetShader();
+			currentVS = vs;
+			currentPS = material->GetPS();
+		}
+
+		if (!depthOnly)
+		{
+			if (material->GetBindingKey() != currentMaterial)
+			{
+				material->SetPerMaterialDataAndResources();
+				currentMaterial = material->GetBindingKey();
+			}
+
+			vs->SetFloat2("uvScale"_sn, material->GetVertexUVScale());
+			vs->CopyBufferData("perMaterial"_sn);
+		}
+
+		if (mesh->GetBufferKey() != currentBuffers)
+		{
+			mesh->SetBuffers(passContext);
+			currentBuffers = mesh->GetBufferKey();
+		}
+
+		for (unsigned int d = bucket.FirstDraw; d < bucket.FirstDraw + bucket.DrawCount; d++)
+			passContext->DrawIndexedInstancedIndirect(argsBuffer.Get(), d * GPU_CULLING_ARGS_SIZE);
+		DrawStats::Count(DrawCounter::Draws, bucket.DrawCount);
+		DrawStats::Count(DrawCounter::InstancedDraws, bucket.DrawCount);
+	}
+
+	// Next frame's culling writes to the instances again
+	ID3D11Buffer* nullBuffer = 0;
+	passContext->IASetVertexBuffers(1, 1, &nullBuffer, &stride, &offset);
+}
+
+void GpuCulling::CreateStructuredBuffer(unsigned int count, unsigned int stride, bool unorderedAccess, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* srv, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>* uav)
+{
+	buffer.Reset();
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | (unorderedAccess ? D3D11_BIND_UNORDERED_ACCESS : 0);
+	desc.ByteWidth = count * stride;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = stride;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, buffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Culling Structured Buffer");
+
+	if (srv)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = count;
+		device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv->ReleaseAndGetAddressOf());
+	}
+
+	if (uav)
+	{
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		uavDesc.Buffer.FirstElement = 0;
+		uavDesc.Buffer.NumElements = count;
+		device->CreateUnorderedAccessView(buffer.Get(), &uavDesc, uav->ReleaseAndGetAddressOf());
+	}
+}
+
+// Raw (byte address) buffers are the only kind compute shaders can
+// write to that can also be vertex buffers or indirect arguments
+void GpuCulling::CreateRawBuffer(unsigned int byteWidth, unsigned int extraBindFlags, unsigned int extraMiscFlags, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& uav)
+{
+	buffer.Reset();
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | extraBindFlags;
+	desc.ByteWidth = byteWidth;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS | extraMiscFlags;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, buffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Culling Raw Buffer");
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = byteWidth / 4;
+	uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	device->CreateUnorderedAccessView(buffer.Get(), &uavDesc, uav.ReleaseAndGetAddressOf());
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "EntityRegistry.h"
+#include "HiZBuffer.h"
+#include "RenderQueue.h"
+
+// These should match the definitions in GpuCulling.hlsli
+#define GPU_CULLING_GROUP_SIZE		64
+#define GPU_CULLING_MAX_LODS		MESH_MAX_LODS
+
+// One scene entity, as the culling shader reads it
+//  - Must match CullEntity in GpuCulling.hlsli
+struct GpuCullEntity
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+	DirectX::XMFLOAT3 BoundsCenter;
+	unsigned int MaterialIndex;
+	DirectX::XMFLOAT3 BoundsExtents;
+	unsigned int Bucket;
+};
+
+// Must match CullBucket in GpuCulling.hlsli
+struct GpuCullBucket
+{
+	unsigned int InstanceStart;
+	unsigned int Capacity;
+	unsigned int LodCount;
+	unsigned int Padding;
+};
+
+// Must match CullDraw in GpuCulling.hlsli
+struct GpuCullDraw
+{
+	unsigned int Counter;
+	unsigned int IndexCount;
+	unsigned int StartIndex;
+	int BaseVertex;
+	unsigned int StartInstance;
+};
+
+// What the last frame cost on the CPU side (how many entities were
+// actually visible never leaves the GPU)
+struct GpuCullingStats
+{
+	unsigned int Entities;
+	unsigned int Buckets;
+	unsigned int IndirectDraws;
+	unsigned int EntitiesUploaded;
+	bool BucketsRebuilt;
+};
+
+// --------------------------------------------------------
+// Culls every scene entity on the GPU and draws the survivors
+// with an indirect draw per bucket (mesh and material), so the
+// CPU never touches a visible list or instance data
+//  - Entities stay in GPU buffers, and only the ones whose
+//    transforms changed are uploaded again each frame
+//  - A compute shader frustum and Hi-Z tests each entity, picks
+//    its level of detail and appends it to its bucket's instances,
+//    then a second one turns the counts into draw arguments
+// --------------------------------------------------------
+class GpuCulling
+{
+public:
+	GpuCulling(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Matches the GPU's copy of the scene to the registry
+	void Update(EntityRegistry& entities);
+
+	// Fills this frame's instances and draw arguments on the immediate context
+	//  - A null Hi-Z buffer (or one without a pyramid yet) skips occlusion
+	//  - Levels of detail are picked like Renderer::UpdateEntityLods(), from
+	//    the screen coverage where each one starts, and a lod scale of
+	//    zero draws everything at full detail
+	void Cull(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, const DirectX::XMFLOAT3& cameraPosition, HiZBuffer* hiZ, float lodScale, const DirectX::XMFLOAT4& lodCoverages, float lodHysteresis);
+
+	// Every bucket's indirect draws, with each material (or, for depth only
+	// draws, no pixel shader) and the "_Compact" version of instancedVS as needed
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, SimpleVertexShader* instancedVS);
+	void DrawDepthOnly(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, SimpleVertexShader* instancedVS);
+
+	const GpuCullingStats& GetStats() { return stats; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	GpuCullingStats stats = {};
+
+	// What each entity was last uploaded with, to tell what changed
+	struct EntityState
+	{
+		Mesh* EntityMesh;
+		Material* EntityMaterial;
+		SimpleVertexShader* VS;
+		SimplePixelShader* PS;
+		const void* BindingKey;
+		unsigned int AtlasIndex;
+		EntityHandle Handle;
+		unsigned int Version;	// Of the transform
+	};
+	std::vector<EntityState> entityStates;
+	std::vector<GpuCullEntity> entityData;
+
+	// Sorted by shaders, then material, then mesh, so drawing
+	// them in order changes as little state as possible
+	struct Bucket
+	{
+		Mesh* BucketMesh;
+		Material* BucketMaterial;
+		unsigned int FirstDraw;
+		unsigned int DrawCount;
+	};
+	std::vector<Bucket> buckets;
+	std::vector<GpuCullBucket> bucketData;
+	std::vector<GpuCullDraw> draws;
+	std::vector<GpuCullDraw> uploadedDraws;
+	unsigned int instanceCount;
+
+	// GPU copies, each grown (doubling) when it runs out of room
+	unsigned int entityCapacity;
+	unsigned int bucketCapacity;
+	unsigned int drawCapacity;
+	unsigned int instanceCapacity;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> entityBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> entitySRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lodBuffer;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> lodUAV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> bucketBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bucketSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> counterBuffer;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> counterUAV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> drawBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> drawSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> argsBuffer;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> argsUAV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> instanceUAV;
+
+	void RebuildBuckets(EntityRegistry& entities);
+	void BuildDraws();
+	void UploadEntities(unsigned int first, unsigned int last);
+	void DrawBuckets(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, SimpleVertexShader* instancedVS, bool depthOnly);
+
+	void CreateStructuredBuffer(unsigned int count, unsigned int stride, bool unorderedAccess, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* srv, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>* uav);
+	void CreateRawBuffer(unsigned int byteWidth, unsigned int extraBindFlags, unsigned int extraMiscFlags, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& uav);
+};
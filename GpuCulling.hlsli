@@ -0,0 +1,50 @@
+// Include guard
+#ifndef _GPU_CULLING_HLSL
+#define _GPU_CULLING_HLSL
+
+// These should match the definitions in GpuCulling.h
+#define GPU_CULLING_GROUP_SIZE		64
+#define GPU_CULLING_MAX_LODS		4
+
+// Bytes per instance in the instance buffer, which is read as the
+// instanced vertex shaders' "_PER_INSTANCE" inputs (InstanceData in RenderQueue.h)
+#define GPU_CULLING_INSTANCE_SIZE	200
+
+// Bytes per set of DrawIndexedInstancedIndirect arguments
+#define GPU_CULLING_ARGS_SIZE		20
+
+// One scene entity, kept on the GPU and only
+// uploaded again when it changes
+//  - Matrices are rows of the C++ (row major) matrices
+struct CullEntity
+{
+	float4 World[4];
+	float4 WorldInverseTranspose[4];
+	float3 BoundsCenter;	// Local space
+	uint MaterialIndex;
+	float3 BoundsExtents;
+	uint Bucket;
+};
+
+// Entities sharing a mesh and material, with a block of instances
+// per level of detail (each big enough for every entity)
+struct CullBucket
+{
+	uint InstanceStart;
+	uint Capacity;
+	uint LodCount;
+	uint Padding;
+};
+
+// One indirect draw of a submesh, for the instances one
+// bucket counted for one level of detail
+struct CullDraw
+{
+	uint Counter;
+	uint IndexCount;
+	uint StartIndex;
+	int BaseVertex;
+	uint StartInstance;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "GpuCulling.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	uint drawCount;
+};
+
+StructuredBuffer<CullDraw> Draws		: register(t0);
+
+// DrawIndexedInstancedIndirect arguments for each draw,
+// and the counts the culling shader left behind
+RWByteAddressBuffer Args			: register(u0);
+RWByteAddressBuffer Counters		: register(u1);
+
+// One thread per draw, filling in the instance
+// count its bucket ended up with
+[numthreads(GPU_CULLING_GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= drawCount)
+		return;
+
+	CullDraw draw = Draws[id.x];
+	uint address = id.x * GPU_CULLING_ARGS_SIZE;
+	Args.Store4(address, uint4(
+		draw.IndexCount,
+		Counters.Load(draw.Counter * 4),
+		draw.StartIndex,
+		asuint(draw.BaseVertex)));
+	Args.Store(address + 16, draw.StartInstance);
+}
@@ -0,0 +1,293 @@
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <cstring>
+
+// For WKPDID_D3DDebugObjectName
+#pragma comment(lib, "dxguid.lib")
+
+// Singleton requirement
+GpuMemory* GpuMemory::instance;
+
+// What each tracked resource's sentinel is kept under, in its private data
+static const GUID GpuMemorySentinelGuid = { 0x469c005c, 0x7933, 0x4702, { 0x92, 0xf8, 0x73, 0x8f, 0x53, 0x20, 0xb4, 0x36 } };
+
+// --------------------------------------------------------
+// Held (only) by the resource it's tracking, so it's let go
+// of when the resource is, and takes it out of the totals
+// --------------------------------------------------------
+class GpuMemory::Sentinel : public IUnknown
+{
+public:
+	Sentinel(unsigned long long id) : refs(1), id(id) {}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override
+	{
+		if (riid != __uuidof(IUnknown))
+		{
+			*object = 0;
+			return E_NOINTERFACE;
+		}
+		*object = this;
+		AddRef();
+		return S_OK;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() override { return InterlockedIncrement(&refs); }
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG remaining = InterlockedDecrement(&refs);
+		if (remaining == 0)
+		{
+			GpuMemory::Remove(id);
+			delete this;
+		}
+		return remaining;
+	}
+
+private:
+	ULONG refs;
+	unsigned long long id;
+};
+
+GpuMemory::GpuMemory()
+{
+	nextID = 1;
+	memset(categoryBytes, 0, sizeof(categoryBytes));
+	memset(categoryCounts, 0, sizeof(categoryCounts));
+}
+
+// Resources can outlive this (the device's own, for one), so
+// their sentinels check it's still here
+GpuMemory::~GpuMemory()
+{
+	instance = 0;
+}
+
+void GpuMemory::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	Microsoft::WRL::ComPtr<IDXGIDevice> dxgiDevice;
+	Microsoft::WRL::ComPtr<IDXGIAdapter> dxgiAdapter;
+	if (SUCCEEDED(device.As(&dxgiDevice)) && SUCCEEDED(dxgiDevice->GetAdapter(dxgiAdapter.GetAddressOf())))
+		dxgiAdapter.As(&adapter);
+}
+
+HRESULT GpuMemory::CreateTexture2D(ID3D11Device* device, const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+	ID3D11Texture2D** texture, GpuMemoryCategory category, const std::string& name)
+{
+	HRESULT hr = device->CreateTexture2D(desc, initialData, texture);
+	if (SUCCEEDED(hr))
+		Track(*texture, category, name);
+	return hr;
+}
+
+HRESULT GpuMemory::CreateBuffer(ID3D11Device* device, const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+	ID3D11Buffer** buffer, GpuMemoryCategory category, const std::string& name)
+{
+	HRESULT hr = device->CreateBuffer(desc, initialData, buffer);
+	if (SUCCEEDED(hr))
+		Track(*buffer, category, name);
+	return hr;
+}
+
+// --------------------------------------------------------
+// Sizes it up from its description, names it, and gives it
+// a sentinel (which replaces, and so untracks, any it had)
+// --------------------------------------------------------
+void GpuMemory::Track(ID3D11Resource* resource, GpuMemoryCategory category, const std::string& name)
+{
+	if (!resource) return;
+
+	GpuAllocation allocation = { name, category, 0, DXGI_FORMAT_UNKNOWN, 0, 1, 1, 1 };
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+	if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+		allocation.Bytes = GetTextureBytes(desc);
+		allocation.Format = desc.Format;
+		allocation.Width = desc.Width;
+		allocation.Height = desc.Height;
+		allocation.ArraySize = desc.ArraySize;
+		allocation.MipLevels = desc.MipLevels;
+	}
+	else if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+	{
+		D3D11_BUFFER_DESC desc;
+		static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+		allocation.Bytes = desc.ByteWidth;
+		allocation.Width = desc.ByteWidth;
+	}
+	else
+		return;
+
+	// Cleared first, since the debug layer warns about changing its size
+	resource->SetPrivateData(WKPDID_D3DDebugObjectName, 0, 0);
+	resource->SetPrivateData(WKPDID_D3DDebugObjectName, (UINT)name.size(), name.c_str());
+
+	// (Outside the lock, since it can let go of an old sentinel)
+	Sentinel* sentinel = new Sentinel(GetInstance().Add(allocation));
+	resource->SetPrivateDataInterface(GpuMemorySentinelGuid, sentinel);
+	sentinel->Release();
+}
+
+void GpuMemory::Track(ID3D11View* view, GpuMemoryCategory category, const std::string& name)
+{
+	if (!view) return;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	view->GetResource(resource.GetAddressOf());
+	Track(resource.Get(), category, name);
+}
+
+unsigned long long GpuMemory::GetBytes(GpuMemoryCategory category)
+{
+	std::lock_guard<std::mutex> lock(allocationMutex);
+	return categoryBytes[(int)category];
+}
+
+unsigned int GpuMemory::GetCount(GpuMemoryCategory category)
+{
+	std::lock_guard<std::mutex> lock(allocationMutex);
+	return categoryCounts[(int)category];
+}
+
+unsigned long long GpuMemory::GetTotalBytes()
+{
+	std::lock_guard<std::mutex> lock(allocationMutex);
+	unsigned long long total = 0;
+	for (unsigned long long bytes : categoryBytes)
+		total += bytes;
+	return total;
+}
+
+void GpuMemory::GetLargest(unsigned int count, std::vector<GpuAllocation>& largest)
+{
+	largest.clear();
+	{
+		std::lock_guard<std::mutex> lock(allocationMutex);
+		for (auto& a : allocations)
+			largest.push_back(a.second);
+	}
+
+	count = (unsigned int)min((size_t)count, largest.size());
+	std::partial_sort(largest.begin(), largest.begin() + count, largest.end(),
+		[](const GpuAllocation& a, const GpuAllocation& b) { return a.Bytes > b.Bytes; });
+	largest.resize(count);
+}
+
+bool GpuMemory::QueryBudget(DXGI_QUERY_VIDEO_MEMORY_INFO& info)
+{
+	info = {};
+	return adapter && SUCCEEDED(adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info));
+}
+
+const char* GpuMemory::GetCategoryName(GpuMemoryCategory category)
+{
+	switch (category)
+	{
+	case GpuMemoryCategory::RenderTargets: return "Render Targets";
+	case GpuMemoryCategory::Shadows: return "Shadows";
+	case GpuMemoryCategory::Textures: return "Textures";
+	case GpuMemoryCategory::Meshes: return "Meshes";
+	case GpuMemoryCategory::Sky: return "Sky";
+	case GpuMemoryCategory::Particles: return "Particles";
+	case GpuMemoryCategory::Buffers: return "Buffers";
+	case GpuMemoryCategory::Staging: return "Staging";
+	default: return "Unknown";
+	}
+}
+
+unsigned int GpuMemory::GetFormatBlockBytes(DXGI_FORMAT format, bool& compressed)
+{
+	compressed = true;
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_TYPELESS: case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS: case DXGI_FORMAT_BC4_UNORM: case DXGI_FORMAT_BC4_SNORM:
+		return 8;
+	case DXGI_FORMAT_BC2_TYPELESS: case DXGI_FORMAT_BC2_UNORM: case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS: case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS: case DXGI_FORMAT_BC5_UNORM: case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS: case DXGI_FORMAT_BC6H_UF16: case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS: case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 16;
+	}
+
+	compressed = false;
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return 16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT: case DXGI_FORMAT_R16G16B16A16_UNORM: case DXGI_FORMAT_R32G32_FLOAT:
+		return 8;
+	case DXGI_FORMAT_R8G8B8A8_UNORM: case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM: case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R10G10B10A2_UNORM: case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R16G16_FLOAT: case DXGI_FORMAT_R32_FLOAT:
+		return 4;
+	case DXGI_FORMAT_R8G8_UNORM: case DXGI_FORMAT_R16_FLOAT: case DXGI_FORMAT_R16_UNORM:
+		return 2;
+	case DXGI_FORMAT_R8_UNORM:
+		return 1;
+	}
+	return 0;
+}
+
+// Every mip of every slice (and sample), with anything not
+// listed counted at 4 bytes a texel
+unsigned long long GpuMemory::GetTextureBytes(const D3D11_TEXTURE2D_DESC& desc)
+{
+	bool compressed;
+	unsigned int blockBytes = GetFormatBlockBytes(desc.Format, compressed);
+	if (blockBytes == 0)
+	{
+		blockBytes = 4;
+		compressed = false;
+	}
+
+	// Zero mips means the whole chain
+	unsigned int mipLevels = desc.MipLevels;
+	if (mipLevels == 0)
+	{
+		mipLevels = 1;
+		while ((max(desc.Width, desc.Height) >> mipLevels) > 0)
+			mipLevels++;
+	}
+
+	unsigned long long bytes = 0;
+	for (unsigned int mip = 0; mip < mipLevels; mip++)
+	{
+		unsigned long long width = max(1u, desc.Width >> mip);
+		unsigned long long height = max(1u, desc.Height >> mip);
+		if (compressed)
+			bytes += ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+		else
+			bytes += width * height * blockBytes;
+	}
+	return bytes * desc.ArraySize * max(1u, desc.SampleDesc.Count);
+}
+
+unsigned long long GpuMemory::Add(const GpuAllocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(allocationMutex);
+	unsigned long long id = nextID++;
+	allocations.insert({ id, allocation });
+	categoryBytes[(int)allocation.Category] += allocation.Bytes;
+	categoryCounts[(int)allocation.Category]++;
+	return id;
+}
+
+void GpuMemory::Remove(unsigned long long id)
+{
+	GpuMemory* memory = instance;
+	if (!memory) return;
+
+	std::lock_guard<std::mutex> lock(memory->allocationMutex);
+	auto it = memory->allocations.find(id);
+	if (it == memory->allocations.end()) return;
+
+	memory->categoryBytes[(int)it->second.Category] -= it->second.Bytes;
+	memory->categoryCounts[(int)it->second.Category]--;
+	memory->allocations.erase(it);
+}
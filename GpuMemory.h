@@ -0,0 +1,128 @@
+#pragma once
+
+#include <d3d11.h>
+#include <dxgi1_4.h>
+#include <wrl/client.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// How many of the biggest resources the UI lists
+#define GPU_MEMORY_TOP_COUNT 20
+
+// What a resource is for, which its bytes are totalled under
+enum class GpuMemoryCategory
+{
+	RenderTargets,	// The renderer's MRTs, depth, SSAO and Hi-Z targets
+	Shadows,
+	Textures,		// Loaded (and made) by Assets, and material atlases
+	Meshes,			// Vertex and index buffers
+	Sky,			// Cube maps, IBL maps and the BRDF LUT
+	Particles,
+	Buffers,		// Constant, structured and instance buffers
+	Staging,		// CPU readable copies, for readbacks
+	Count
+};
+
+// One live resource, as it was when it was tracked
+struct GpuAllocation
+{
+	std::string Name;
+	GpuMemoryCategory Category;
+	unsigned long long Bytes;
+	DXGI_FORMAT Format;		// Unknown for buffers
+	unsigned int Width;		// Bytes, for buffers
+	unsigned int Height;
+	unsigned int ArraySize;
+	unsigned int MipLevels;
+};
+
+// --------------------------------------------------------
+// Keeps count of every GPU resource's size, by category
+//  - Resources are made through CreateTexture2D() and
+//    CreateBuffer() (or made elsewhere, like the texture
+//    loaders, then handed to Track()), which name them for
+//    the debug layer and graphics debuggers too
+//  - Each tracked resource holds a tiny object of this
+//    class's, as private data, which D3D releases when the
+//    resource is destroyed, so nothing has to remember to
+//    untrack anything
+//  - Sizes are worked out from the description, so they're
+//    what's asked for rather than what the driver actually
+//    allocated (which QueryBudget() has the total of)
+// --------------------------------------------------------
+class GpuMemory
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static GpuMemory& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new GpuMemory();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	GpuMemory(GpuMemory const&) = delete;
+	void operator=(GpuMemory const&) = delete;
+
+private:
+	static GpuMemory* instance;
+	GpuMemory();
+#pragma endregion
+
+public:
+	~GpuMemory();
+
+	// The adapter the device is on, for its budget
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Just like the device's own, but tracked under the category and name
+	static HRESULT CreateTexture2D(ID3D11Device* device, const D3D11_TEXTURE2D_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+		ID3D11Texture2D** texture, GpuMemoryCategory category, const std::string& name);
+	static HRESULT CreateBuffer(ID3D11Device* device, const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData,
+		ID3D11Buffer** buffer, GpuMemoryCategory category, const std::string& name);
+
+	// For resources made some other way (tracking one again replaces what
+	// it was tracked as), or by a view of one
+	static void Track(ID3D11Resource* resource, GpuMemoryCategory category, const std::string& name);
+	static void Track(ID3D11View* view, GpuMemoryCategory category, const std::string& name);
+
+	// Totals, by category
+	unsigned long long GetBytes(GpuMemoryCategory category);
+	unsigned int GetCount(GpuMemoryCategory category);
+	unsigned long long GetTotalBytes();
+
+	// The biggest live resources, biggest first
+	void GetLargest(unsigned int count, std::vector<GpuAllocation>& largest);
+
+	// What the OS says the process is using of the GPU's own memory, and
+	// how much it can, or false if the adapter can't say
+	bool QueryBudget(DXGI_QUERY_VIDEO_MEMORY_INFO& info);
+
+	static const char* GetCategoryName(GpuMemoryCategory category);
+
+	// Bytes per 4x4 block, or per texel for uncompressed formats (zero if
+	// it isn't known here)
+	static unsigned int GetFormatBlockBytes(DXGI_FORMAT format, bool& compressed);
+	static unsigned long long GetTextureBytes(const D3D11_TEXTURE2D_DESC& desc);
+
+private:
+	class Sentinel;
+
+	std::mutex allocationMutex;
+	std::unordered_map<unsigned long long, GpuAllocation> allocations;
+	unsigned long long nextID;
+	unsigned long long categoryBytes[(int)GpuMemoryCategory::Count];
+	unsigned int categoryCounts[(int)GpuMemoryCategory::Count];
+
+	Microsoft::WRL::ComPtr<IDXGIAdapter3> adapter;
+
+	unsigned long long Add(const GpuAllocation& allocation);
+	static void Remove(unsigned long long id);
+};
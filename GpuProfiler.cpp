@@ -0,0 +1,177 @@
+#include "GpuProfiler.h"
+
+GpuProfiler::GpuProfiler(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: context(context)
+{
+	frameIndex = 0;
+	frameMs = 0.0f;
+	pipelineStatistics = true;
+
+	D3D11_QUERY_DESC disjointDesc = {};
+	disjointDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+
+	D3D11_QUERY_DESC timestampDesc = {};
+	timestampDesc.Query = D3D11_QUERY_TIMESTAMP;
+
+	D3D11_QUERY_DESC pipelineDesc = {};
+	pipelineDesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+
+	D3D11_QUERY_DESC occlusionDesc = {};
+	occlusionDesc.Query = D3D11_QUERY_OCCLUSION;
+
+	for (int f = 0; f < GPU_PROFILER_FRAMES_IN_FLIGHT; f++)
+	{
+		device->CreateQuery(&disjointDesc, frames[f].Disjoint.GetAddressOf());
+		for (int t = 0; t < GPU_PROFILER_MAX_PASSES + 1; t++)
+		{
+			device->CreateQuery(&timestampDesc, frames[f].Timestamps[t].GetAddressOf());
+			device->CreateQuery(&pipelineDesc, frames[f].Pipeline[t].GetAddressOf());
+			device->CreateQuery(&occlusionDesc, frames[f].Occlusion[t].GetAddressOf());
+		}
+
+		frames[f].PassCount = 0;
+		frames[f].Pending = false;
+		frames[f].HasPipelineStats = false;
+	}
+}
+
+// --------------------------------------------------------
+// Starts a new frame of queries, first reading back the results
+// of the oldest frame, which reuses the same set of queries
+// --------------------------------------------------------
+void GpuProfiler::BeginFrame()
+{
+	FrameQueries& frame = frames[frameIndex];
+	if (frame.Pending)
+		ReadFrame(frame);
+
+	frame.PassCount = 0;
+	frame.HasPipelineStats = pipelineStatistics;
+	context->Begin(frame.Disjoint.Get());
+	context->End(frame.Timestamps[0].Get());
+	BeginPassQueries(frame, 0);
+}
+
+void GpuProfiler::Timestamp(std::string passName)
+{
+	FrameQueries& frame = frames[frameIndex];
+	if (frame.PassCount >= GPU_PROFILER_MAX_PASSES)
+		return;
+
+	frame.PassNames[frame.PassCount] = passName;
+	EndPassQueries(frame, frame.PassCount);
+	frame.PassCount++;
+	context->End(frame.Timestamps[frame.PassCount].Get());
+	BeginPassQueries(frame, frame.PassCount);
+}
+
+void GpuProfiler::EndFrame()
+{
+	FrameQueries& frame = frames[frameIndex];
+	EndPassQueries(frame, frame.PassCount);
+	context->End(frame.Disjoint.Get());
+	frame.Pending = true;
+
+	frameIndex = (frameIndex + 1) % GPU_PROFILER_FRAMES_IN_FLIGHT;
+}
+
+// --------------------------------------------------------
+// Reads a frame's results if the GPU is done with them.  If
+// it somehow isn't, the frame is dropped rather than waited on.
+// --------------------------------------------------------
+void GpuProfiler::ReadFrame(FrameQueries& frame)
+{
+	frame.Pending = false;
+
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+	if (context->GetData(frame.Disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return;
+
+	// Timestamps aren't reliable if the clock changed mid frame
+	if (disjoint.Disjoint)
+		return;
+
+	UINT64 timestamps[GPU_PROFILER_MAX_PASSES + 1] = {};
+	for (unsigned int i = 0; i <= frame.PassCount; i++)
+	{
+		if (context->GetData(frame.Timestamps[i].Get(), &timestamps[i], sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			return;
+	}
+
+	double msPerTick = 1000.0 / (double)disjoint.Frequency;
+	for (unsigned int i = 0; i < frame.PassCount; i++)
+	{
+		GpuPassStats* stats = AddSample(frame.PassNames[i], (float)((timestamps[i + 1] - timestamps[i]) * msPerTick));
+
+		// Left as they were if they're somehow not in yet
+		D3D11_QUERY_DATA_PIPELINE_STATISTICS pipeline;
+		UINT64 samples;
+		if (frame.HasPipelineStats &&
+			context->GetData(frame.Pipeline[i].Get(), &pipeline, sizeof(pipeline), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+			context->GetData(frame.Occlusion[i].Get(), &samples, sizeof(samples), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+		{
+			stats->HasPipelineStats = true;
+			stats->Pipeline = pipeline;
+			stats->SamplesPassed = samples;
+		}
+	}
+
+	frameMs = (float)((timestamps[frame.PassCount] - timestamps[0]) * msPerTick);
+}
+
+// Pipeline statistics and occlusion queries go around each pass,
+// one pass after another, so only one of each is ever running
+void GpuProfiler::BeginPassQueries(FrameQueries& frame, unsigned int pass)
+{
+	if (!frame.HasPipelineStats)
+		return;
+	context->Begin(frame.Pipeline[pass].Get());
+	context->Begin(frame.Occlusion[pass].Get());
+}
+
+void GpuProfiler::EndPassQueries(FrameQueries& frame, unsigned int pass)
+{
+	if (!frame.HasPipelineStats)
+		return;
+	context->End(frame.Pipeline[pass].Get());
+	context->End(frame.Occlusion[pass].Get());
+}
+
+GpuPassStats* GpuProfiler::AddSample(std::string passName, float ms)
+{
+	// Find (or add) this pass
+	GpuPassStats* stats = 0;
+	for (auto& s : passStats)
+	{
+		if (s.Name == passName)
+		{
+			stats = &s;
+			break;
+		}
+	}
+
+	if (!stats)
+	{
+		GpuPassStats newStats = {};
+		newStats.Name = passName;
+		passStats.push_back(newStats);
+		stats = &passStats.back();
+	}
+
+	// Record the sample and update the rolling average and max
+	stats->LastMs = ms;
+	stats->History[stats->HistoryIndex] = ms;
+	stats->HistoryIndex = (stats->HistoryIndex + 1) % GPU_PROFILER_HISTORY;
+	if (stats->HistoryCount < GPU_PROFILER_HISTORY)
+		stats->HistoryCount++;
+
+	float total = 0.0f;
+	stats->MaxMs = 0.0f;
+	for (unsigned int i = 0; i < stats->HistoryCount; i++)
+	{
+		total += stats->History[i];
+		stats->MaxMs = stats->History[i] > stats->MaxMs ? stats->History[i] : stats->MaxMs;
+	}
+	stats->AverageMs = total / stats->HistoryCount;
+	return stats;
+}
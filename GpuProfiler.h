@@ -0,0 +1,88 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <string>
+#include <vector>
+
+// How many frames of queries can be waiting on the GPU at once,
+// so results are always read long after they're ready
+#define GPU_PROFILER_FRAMES_IN_FLIGHT	4
+#define GPU_PROFILER_MAX_PASSES			16
+#define GPU_PROFILER_HISTORY			64
+
+// Timing for a single pass, over the last GPU_PROFILER_HISTORY frames
+struct GpuPassStats
+{
+	std::string Name;
+	float LastMs;
+	float AverageMs;
+	float MaxMs;
+
+	// What the pass did, from the last frame that had it (when the
+	// pipeline statistics are on), and how many samples passed the
+	// depth and stencil tests
+	bool HasPipelineStats;
+	D3D11_QUERY_DATA_PIPELINE_STATISTICS Pipeline;
+	UINT64 SamplesPassed;
+
+	float History[GPU_PROFILER_HISTORY];
+	unsigned int HistoryCount;
+	unsigned int HistoryIndex;
+};
+
+// --------------------------------------------------------
+// Measures GPU time between points in the frame with
+// timestamp queries, without ever waiting on the GPU
+//  - Each Timestamp() ends a pass that started at the
+//    previous one (or at BeginFrame())
+//  - Each pass can also have pipeline statistics and
+//    occlusion queries around it, read back just as late
+// --------------------------------------------------------
+class GpuProfiler
+{
+public:
+	GpuProfiler(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	void BeginFrame();
+	void Timestamp(std::string passName);
+	void EndFrame();
+
+	const std::vector<GpuPassStats>& GetPassStats() { return passStats; }
+	float GetFrameMs() { return frameMs; }
+
+	// Whether passes also count invocations, primitives and samples, which
+	// costs a little, so it can be left off when only timing matters
+	void SetPipelineStatistics(bool enabled) { pipelineStatistics = enabled; }
+	bool GetPipelineStatistics() { return pipelineStatistics; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	// All of the queries for one frame
+	struct FrameQueries
+	{
+		Microsoft::WRL::ComPtr<ID3D11Query> Disjoint;
+		Microsoft::WRL::ComPtr<ID3D11Query> Timestamps[GPU_PROFILER_MAX_PASSES + 1];
+		std::string PassNames[GPU_PROFILER_MAX_PASSES];
+		unsigned int PassCount;
+		bool Pending;
+
+		// One more than there are passes, for whatever's after the last
+		Microsoft::WRL::ComPtr<ID3D11Query> Pipeline[GPU_PROFILER_MAX_PASSES + 1];
+		Microsoft::WRL::ComPtr<ID3D11Query> Occlusion[GPU_PROFILER_MAX_PASSES + 1];
+		bool HasPipelineStats;
+	};
+	FrameQueries frames[GPU_PROFILER_FRAMES_IN_FLIGHT];
+	unsigned int frameIndex;
+	bool pipelineStatistics;
+
+	void BeginPassQueries(FrameQueries& frame, unsigned int pass);
+	void EndPassQueries(FrameQueries& frame, unsigned int pass);
+
+	std::vector<GpuPassStats> passStats;
+	float frameMs;
+
+	void ReadFrame(FrameQueries& frame);
+	GpuPassStats* AddSample(std::string passName, float ms);
+};
@@ -0,0 +1,306 @@
+#include "HiZBuffer.h"
+#include "AssetLoader.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
+
+#include <float.h>
+
+using namespace DirectX;
+
+HiZBuffer::HiZBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+	width = 0;
+	height = 0;
+	mipCount = 0;
+	readbackMip = 0;
+	readbackIndex = 0;
+	hasData = false;
+	built = false;
+	XMStoreFloat4x4(&levelsViewProjection, XMMatrixIdentity());
+	XMStoreFloat4x4(&builtViewProjection, XMMatrixIdentity());
+
+	for (int i = 0; i < HIZ_FRAMES_IN_FLIGHT; i++)
+		readbacks[i].Pending = false;
+}
+
+// --------------------------------------------------------
+// Recreates the pyramid for a new screen size
+//  - The first level is half the screen size, and any
+//    data already read back is thrown away
+// --------------------------------------------------------
+void HiZBuffer::Resize(unsigned int screenWidth, unsigned int screenHeight)
+{
+	width = max(1u, (screenWidth + 1) / 2);
+	height = max(1u, (screenHeight + 1) / 2);
+
+	mipCount = 1;
+	readbackMip = 0;
+	for (unsigned int w = width, h = height; w > 1 || h > 1; mipCount++)
+	{
+		if (w > HIZ_READBACK_WIDTH)
+			readbackMip = mipCount;
+		w = max(1u, w / 2);
+		h = max(1u, h / 2);
+	}
+
+	pyramid.Reset();
+	mipRTVs.clear();
+	mipSRVs.clear();
+	pyramidSRV.Reset();
+	levels.clear();
+	hasData = false;
+	built = false;
+
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = width;
+	texDesc.Height = height;
+	texDesc.ArraySize = 1;
+	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	texDesc.MipLevels = mipCount;
+	texDesc.SampleDesc.Count = 1;
+	GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, pyramid.GetAddressOf(), GpuMemoryCategory::RenderTargets, "Hi-Z Pyramid");
+
+	// Null description for a view of every mip
+	device->CreateShaderResourceView(pyramid.Get(), 0, pyramidSRV.GetAddressOf());
+
+	mipRTVs.resize(mipCount);
+	mipSRVs.resize(mipCount);
+	for (unsigned int m = 0; m < mipCount; m++)
+	{
+		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+		rtvDesc.Format = texDesc.Format;
+		rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+		rtvDesc.Texture2D.MipSlice = m;
+		device->CreateRenderTargetView(pyramid.Get(), &rtvDesc, mipRTVs[m].GetAddressOf());
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = texDesc.Format;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = m;
+		srvDesc.Texture2D.MipLevels = 1;
+		device->CreateShaderResourceView(pyramid.Get(), &srvDesc, mipSRVs[m].GetAddressOf());
+	}
+
+	// Staging copies of just the read back level
+	D3D11_TEXTURE2D_DESC stagingDesc = texDesc;
+	stagingDesc.Width = max(1u, width >> readbackMip);
+	stagingDesc.Height = max(1u, height >> readbackMip);
+	stagingDesc.MipLevels = 1;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	for (int i = 0; i < HIZ_FRAMES_IN_FLIGHT; i++)
+	{
+		readbacks[i].Staging.Reset();
+		readbacks[i].Pending = false;
+		GpuMemory::CreateTexture2D(device.Get(), &stagingDesc, 0, readbacks[i].Staging.GetAddressOf(), GpuMemoryCategory::Staging, "Hi-Z Readback");
+	}
+}
+
+// --------------------------------------------------------
+// Runs the downsample chain from the depth buffer to the
+// smallest mip, then copies the read back mip to staging
+//  - The depth buffer can't be bound for output here
+// --------------------------------------------------------
+void HiZBuffer::Build(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthSRV, const XMFLOAT4X4& viewProjection, float renderScale)
+{
+	if (!pyramid)
+		return;
+
+	Assets& assets = Assets::GetInstance();
+	assets.GetVertexShader("FullscreenVS.cso"_asset)->SetShader();
+	SimplePixelShader* ps = assets.GetPixelShader("HiZDownsamplePS.cso"_asset);
+	ps->SetShader();
+
+	ID3D11ShaderResourceView* nullSRV[1] = {};
+	// The first level squeezes the rendered part of the depth buffer into the whole pyramid
+	unsigned int sourceWidth = max(1u, (unsigned int)(width * 2 * renderScale));
+	unsigned int sourceHeight = max(1u, (unsigned int)(height * 2 * renderScale));
+	float sourceScale = 2.0f * renderScale;
+	for (unsigned int m = 0; m < mipCount; m++)
+	{
+		unsigned int mipWidth = max(1u, width >> m);
+		unsigned int mipHeight = max(1u, height >> m);
+
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = (float)mipWidth;
+		viewport.Height = (float)mipHeight;
+		viewport.MaxDepth = 1.0f;
+		context->RSSetViewports(1, &viewport);
+		context->OMSetRenderTargets(1, mipRTVs[m].GetAddressOf(), 0);
+
+		int sourceSize[2] = { (int)sourceWidth, (int)sourceHeight };
+		ps->SetData("sourceSize", sourceSize, sizeof(sourceSize));
+		ps->SetFloat("sourceScale", sourceScale);
+		ps->CopyAllBufferData();
+		ps->SetShaderResourceView("Source", m == 0 ? depthSRV : mipSRVs[m - 1]);
+		context->Draw(3, 0);
+		DrawStats::Count(DrawCounter::Draws);
+
+		// Unbind so this level can be written to next
+		context->PSSetShaderResources(0, 1, nullSRV);
+		ISimpleShader::InvalidateStateCache(context);
+		sourceWidth = mipWidth;
+		sourceHeight = mipHeight;
+		sourceScale = 2.0f;
+	}
+	context->OMSetRenderTargets(0, 0, 0);
+	builtViewProjection = viewProjection;
+	built = true;
+
+	Readback& readback = readbacks[readbackIndex];
+	context->CopySubresourceRegion(readback.Staging.Get(), 0, 0, 0, 0, pyramid.Get(), readbackMip, 0);
+	readback.ViewProjection = viewProjection;
+	readback.Pending = true;
+
+	readbackIndex = (readbackIndex + 1) % HIZ_FRAMES_IN_FLIGHT;
+}
+
+// --------------------------------------------------------
+// Reads the oldest readback (the next one Build() will reuse)
+// if it's ready.  If not, the last pyramid is kept instead.
+// --------------------------------------------------------
+void HiZBuffer::ReadBack()
+{
+	Readback& readback = readbacks[readbackIndex];
+	if (!readback.Pending)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	DrawStats::Count(DrawCounter::Maps);
+	if (context->Map(readback.Staging.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) != S_OK)
+		return;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	readback.Staging->GetDesc(&desc);
+
+	levels.resize(1);
+	levels[0].Width = desc.Width;
+	levels[0].Height = desc.Height;
+	levels[0].Depths.resize(desc.Width * desc.Height);
+	for (unsigned int y = 0; y < desc.Height; y++)
+	{
+		memcpy(
+			&levels[0].Depths[y * desc.Width],
+			(unsigned char*)mapped.pData + y * mapped.RowPitch,
+			sizeof(float) * desc.Width);
+	}
+
+	context->Unmap(readback.Staging.Get(), 0);
+	readback.Pending = false;
+
+	levelsViewProjection = readback.ViewProjection;
+	BuildCoarserLevels();
+	hasData = true;
+}
+
+// Same max downsample as the GPU, down to 1x1
+void HiZBuffer::BuildCoarserLevels()
+{
+	while (levels.back().Width > 1 || levels.back().Height > 1)
+	{
+		const Level& source = levels.back();
+
+		Level level;
+		level.Width = max(1u, source.Width / 2);
+		level.Height = max(1u, source.Height / 2);
+		level.Depths.resize(level.Width * level.Height);
+
+		for (unsigned int y = 0; y < level.Height; y++)
+		{
+			for (unsigned int x = 0; x < level.Width; x++)
+			{
+				int maxX = min((int)source.Width - 1, (int)x * 2 + 2);
+				int maxY = min((int)source.Height - 1, (int)y * 2 + 2);
+
+				float depth = 0.0f;
+				for (int sy = y * 2; sy <= maxY; sy++)
+					for (int sx = x * 2; sx <= maxX; sx++)
+						depth = max(depth, source.Depths[sy * source.Width + sx]);
+
+				level.Depths[y * level.Width + x] = depth;
+			}
+		}
+
+		levels.push_back(level);
+	}
+}
+
+// --------------------------------------------------------
+// Projects the box with the pyramid's view and compares its
+// closest depth against the farthest depth under its screen rect,
+// at the first level where that rect is at most 2x2 texels
+// --------------------------------------------------------
+bool HiZBuffer::IsOccluded(const BoundingOrientedBox& bounds)
+{
+	if (!hasData)
+		return false;
+
+	XMFLOAT3 corners[BoundingOrientedBox::CORNER_COUNT];
+	bounds.GetCorners(corners);
+	XMMATRIX viewProj = XMLoadFloat4x4(&levelsViewProjection);
+
+	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for (int i = 0; i < BoundingOrientedBox::CORNER_COUNT; i++)
+	{
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(corners[i].x, corners[i].y, corners[i].z, 1.0f), viewProj));
+
+		// Anything crossing the near plane is too close to call
+		if (clip.w <= 0.0001f)
+			return false;
+
+		float x = clip.x / clip.w;
+		float y = clip.y / clip.w;
+		minX = min(minX, x);
+		maxX = max(maxX, x);
+		minY = min(minY, y);
+		maxY = max(maxY, y);
+		minZ = min(minZ, clip.z / clip.w);
+	}
+
+	// Off (or partly off) the old screen, where there's no depth
+	if (minX < -1.0f || maxX > 1.0f || minY < -1.0f || maxY > 1.0f || minZ < 0.0f)
+		return false;
+
+	// NDC to texels of the finest level (y flipped)
+	const Level& top = levels[0];
+	float left = (minX * 0.5f + 0.5f) * top.Width;
+	float right = (maxX * 0.5f + 0.5f) * top.Width;
+	float topEdge = (0.5f - maxY * 0.5f) * top.Height;
+	float bottomEdge = (0.5f - minY * 0.5f) * top.Height;
+
+	unsigned int level = 0;
+	float size = max(right - left, bottomEdge - topEdge);
+	while (size > 2.0f && level + 1 < levels.size())
+	{
+		size *= 0.5f;
+		level++;
+	}
+
+	float scale = 1.0f / (float)(1 << level);
+	float farthest = MaxDepth(level,
+		(int)(left * scale), (int)(topEdge * scale),
+		(int)(right * scale), (int)(bottomEdge * scale));
+
+	return minZ > farthest;
+}
+
+float HiZBuffer::MaxDepth(unsigned int level, int minX, int minY, int maxX, int maxY)
+{
+	const Level& l = levels[level];
+	minX = max(0, minX);
+	minY = max(0, minY);
+	maxX = min((int)l.Width - 1, maxX);
+	maxY = min((int)l.Height - 1, maxY);
+
+	float depth = 0.0f;
+	for (int y = minY; y <= maxY; y++)
+		for (int x = minX; x <= maxX; x++)
+			depth = max(depth, l.Depths[y * l.Width + x]);
+
+	return depth;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+// How many frames of pyramids can be waiting to be read back,
+// so the CPU never waits on the GPU for one
+#define HIZ_FRAMES_IN_FLIGHT	3
+
+// The first pyramid level at most this wide is read back,
+// and the CPU builds the coarser levels from it
+#define HIZ_READBACK_WIDTH		256
+
+// --------------------------------------------------------
+// Hierarchical Z (max depth) pyramid built from the depth
+// buffer, and read back a few frames later for CPU occlusion
+// tests against the view it was rendered from
+// --------------------------------------------------------
+class HiZBuffer
+{
+public:
+	HiZBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	void Resize(unsigned int width, unsigned int height);
+
+	// Downsamples this frame's depth and queues the readback
+	//  - renderScale is the part of the depth buffer actually
+	//    rendered to, with dynamic resolution
+	void Build(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthSRV, const DirectX::XMFLOAT4X4& viewProjection, float renderScale = 1.0f);
+
+	// Picks up the oldest queued pyramid, if the GPU is done with it
+	void ReadBack();
+
+	// True if the box is entirely behind the depths in the last
+	// pyramid read back (always false until there is one)
+	bool IsOccluded(const DirectX::BoundingOrientedBox& bounds);
+	bool HasData() { return hasData; }
+
+	// The newest pyramid on the GPU (every mip), for culling there
+	// without waiting on a readback, and the view it was built from
+	bool HasPyramid() { return built; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetPyramidSRV() { return pyramidSRV; }
+	const DirectX::XMFLOAT4X4& GetPyramidViewProjection() { return builtViewProjection; }
+	unsigned int GetWidth() { return width; }
+	unsigned int GetHeight() { return height; }
+	unsigned int GetMipCount() { return mipCount; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	// GPU pyramid, with views of each mip
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipCount;
+	unsigned int readbackMip;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> pyramid;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11RenderTargetView>> mipRTVs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> mipSRVs;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> pyramidSRV;
+	DirectX::XMFLOAT4X4 builtViewProjection;
+	bool built;
+
+	// Readbacks, and the view each was rendered from
+	struct Readback
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> Staging;
+		DirectX::XMFLOAT4X4 ViewProjection;
+		bool Pending;
+	};
+	Readback readbacks[HIZ_FRAMES_IN_FLIGHT];
+	unsigned int readbackIndex;
+
+	// CPU copy of the pyramid, starting at the read back mip
+	struct Level
+	{
+		unsigned int Width;
+		unsigned int Height;
+		std::vector<float> Depths;
+	};
+	std::vector<Level> levels;
+	DirectX::XMFLOAT4X4 levelsViewProjection;
+	bool hasData;
+
+	void BuildCoarserLevels();
+	float MaxDepth(unsigned int level, int minX, int minY, int maxX, int maxY);
+};
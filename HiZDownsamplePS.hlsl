@@ -0,0 +1,36 @@
+cbuffer externalData : register(b0)
+{
+	int2 sourceSize;
+	float sourceScale;	// Source pixels per pixel of this level (2, except for a scaled first level)
+};
+
+struct VertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+
+Texture2D Source : register(t0);
+
+
+// One level of the Hi-Z pyramid: the farthest depth under each pixel
+//  - Reads a 3x3 block rather than 2x2, so odd sized levels still
+//    cover their last row and column (a little conservative elsewhere)
+float main(VertexToPixel input) : SV_TARGET
+{
+	int2 topLeft = int2(floor(input.position.xy) * sourceScale);
+	int2 maxPixel = sourceSize - 1;
+
+	float maxDepth = 0.0f;
+	for (int y = 0; y < 3; y++)
+	{
+		for (int x = 0; x < 3; x++)
+		{
+			int3 pixel = int3(min(topLeft + int2(x, y), maxPixel), 0);
+			maxDepth = max(maxDepth, Source.Load(pixel).r);
+		}
+	}
+
+	return maxDepth;
+}
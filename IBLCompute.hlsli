@@ -0,0 +1,47 @@
+#ifndef _IBL_COMPUTE_HLSL
+#define _IBL_COMPUTE_HLSL
+
+#include "Lighting.hlsli"
+
+// Threads per group along each side of a face, with
+// SV_DispatchThreadID.z picking the face
+#define IBL_GROUP_SIZE	8
+
+// The direction through a point on a cube face, with uv
+// going 0-1 across it (matching the IBL pixel shaders)
+float3 CubeFaceDirection(uint face, float2 uv)
+{
+	// Get a -1 to 1 range on x/y
+	float2 o = uv * 2 - 1;
+
+	float3 dir;
+	switch (face)
+	{
+	default:
+	case 0: dir = float3(+1, -o.y, -o.x); break;
+	case 1: dir = float3(-1, -o.y, +o.x); break;
+	case 2: dir = float3(+o.x, +1, +o.y); break;
+	case 3: dir = float3(+o.x, -1, -o.y); break;
+	case 4: dir = float3(+o.x, -o.y, +1); break;
+	case 5: dir = float3(-o.x, -o.y, -1); break;
+	}
+	return normalize(dir);
+}
+
+// Filtered importance sampling (GPU Gems 3, chapter 20)
+//
+// Picks the environment mip whose texels cover about as much of the
+// sphere as each sample stands in for, so a few hundred samples of a
+// mip chain look like thousands taken from the top mip
+//
+// pdf			- The sample's probability density (per steradian)
+// sampleCount	- How many samples are being taken in total
+// faceSize		- Width of the environment's top mip
+float EnvironmentMipLevel(float pdf, uint sampleCount, float faceSize)
+{
+	float sampleSolidAngle = 1.0f / (sampleCount * pdf + 0.0001f);
+	float texelSolidAngle = 4.0f * PI / (6.0f * faceSize * faceSize);
+	return max(0.5f * log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+}
+
+#endif
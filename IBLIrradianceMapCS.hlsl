@@ -0,0 +1,51 @@
+#include "IBLCompute.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	uint outputSize;
+	uint sampleCount;
+	uint firstFace;		// Of the faces the output array starts at
+	uint firstRow;		// Just some of the rows, when spread over several frames
+};
+
+// Textures and samplers
+TextureCube EnvironmentMap	: register(t0);	// With a full mip chain
+SamplerState BasicSampler	: register(s0);
+RWTexture2DArray<float4> IrradianceMap : register(u0);
+
+// Same result as IBLIrradianceMapPS, but with cosine weighted samples
+// (so the cosine term cancels out with the pdf) of a filtered
+// environment, rather than a brute force grid over the hemisphere
+[numthreads(IBL_GROUP_SIZE, IBL_GROUP_SIZE, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	uint3 texel = uint3(id.x, id.y + firstRow, id.z);
+	if (texel.x >= outputSize || texel.y >= outputSize)
+		return;
+
+	// Tangent basis around this texel's direction
+	float3 zDir = CubeFaceDirection(id.z + firstFace, (texel.xy + 0.5f) / outputSize);
+	float3 xDir = normalize(cross(abs(zDir.y) < 0.999f ? float3(0, 1, 0) : float3(1, 0, 0), zDir));
+	float3 yDir = cross(zDir, xDir);
+
+	uint faceSize, height, mipCount;
+	EnvironmentMap.GetDimensions(0, faceSize, height, mipCount);
+
+	float3 totalColor = float3(0, 0, 0);
+	for (uint i = 0; i < sampleCount; i++)
+	{
+		// Cosine weighted direction, with a pdf of cos(theta) / pi
+		float2 Xi = Hammersley2d(i, sampleCount);
+		float sinP, cosP;
+		sincos(TWO_PI * Xi.x, sinP, cosP);
+		float cosT = sqrt(1 - Xi.y);
+		float sinT = sqrt(Xi.y);
+		float3 dir = (sinT * cosP) * xDir + (sinT * sinP) * yDir + cosT * zDir;
+
+		float mip = EnvironmentMipLevel(cosT / PI, sampleCount, faceSize);
+		totalColor += pow(abs(EnvironmentMap.SampleLevel(BasicSampler, dir, mip).rgb), 2.2f);
+	}
+
+	float3 finalColor = totalColor / sampleCount;
+	IrradianceMap[texel] = float4(pow(abs(finalColor), 1.0f / 2.2f), 1);
+}
@@ -0,0 +1,65 @@
+#include "IBLCompute.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	uint projectSize;	// Texels across each face that are projected (a multiple of the group size)
+};
+
+// Textures and samplers
+TextureCube EnvironmentMap	: register(t0);	// Ideally with a mip chain, to read at projectSize
+SamplerState BasicSampler	: register(s0);
+
+// Each group's sums, nine in a row, with the solid angle they
+// cover in the first one's w (so they can be normalized after)
+RWStructuredBuffer<float4> PartialSH : register(u0);
+
+groupshared float4 groupSH[IBL_GROUP_SIZE * IBL_GROUP_SIZE][9];
+
+// Projects the sky into L2 spherical harmonics
+//  - Every thread weights its texel by the solid angle it covers,
+//    then each group sums its threads' coefficients, leaving just
+//    the groups to add up (see Sky::IBLComputeIrradianceSH())
+[numthreads(IBL_GROUP_SIZE, IBL_GROUP_SIZE, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint3 groupID : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	float2 uv = (id.xy + 0.5f) / projectSize;
+	float2 o = uv * 2 - 1;
+	float3 dir = CubeFaceDirection(id.z, uv);
+
+	// Solid angle of a texel at this point on the face
+	float solidAngle = 4.0f / (projectSize * projectSize * pow(1.0f + dot(o, o), 1.5f));
+
+	uint faceSize, height, mipCount;
+	EnvironmentMap.GetDimensions(0, faceSize, height, mipCount);
+	float mip = max(log2(faceSize / (float)projectSize), 0.0f);
+	float3 color = pow(abs(EnvironmentMap.SampleLevel(BasicSampler, dir, mip).rgb), 2.2f) * solidAngle;
+
+	float basis[9];
+	SHBasis(dir, basis);
+	[unroll]
+	for (int i = 0; i < 9; i++)
+		groupSH[groupIndex][i] = float4(color * basis[i], i == 0 ? solidAngle : 0);
+	GroupMemoryBarrierWithGroupSync();
+
+	// Halve the threads with sums each step
+	[unroll]
+	for (uint stride = IBL_GROUP_SIZE * IBL_GROUP_SIZE / 2; stride > 0; stride >>= 1)
+	{
+		if (groupIndex < stride)
+		{
+			[unroll]
+			for (int i = 0; i < 9; i++)
+				groupSH[groupIndex][i] += groupSH[groupIndex + stride][i];
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (groupIndex == 0)
+	{
+		uint groupsPerSide = projectSize / IBL_GROUP_SIZE;
+		uint group = (groupID.z * groupsPerSide + groupID.y) * groupsPerSide + groupID.x;
+		[unroll]
+		for (int i = 0; i < 9; i++)
+			PartialSH[group * 9 + i] = groupSH[0][i];
+	}
+}
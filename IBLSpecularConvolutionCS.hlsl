@@ -0,0 +1,62 @@
+#include "IBLCompute.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	float roughness;
+	uint outputSize;	// Of the mip being made
+	uint sampleCount;
+	uint firstFace;		// Of the faces the output array starts at
+	uint firstRow;		// Just some of the rows, when spread over several frames
+};
+
+// Textures and samplers
+TextureCube EnvironmentMap	: register(t0);	// With a full mip chain
+SamplerState BasicSampler	: register(s0);
+RWTexture2DArray<float4> ConvolvedMip : register(u0);
+
+// Same convolution as IBLSpecularConvolutionPS (GGX importance sampling,
+// assuming N == V == R), but each sample reads the environment mip that
+// matches its share of the lobe, so far fewer are needed
+[numthreads(IBL_GROUP_SIZE, IBL_GROUP_SIZE, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	uint3 texel = uint3(id.x, id.y + firstRow, id.z);
+	if (texel.x >= outputSize || texel.y >= outputSize)
+		return;
+
+	float3 N = CubeFaceDirection(id.z + firstFace, (texel.xy + 0.5f) / outputSize);
+	float3 V = N;
+
+	// A perfect mirror is just the environment
+	if (roughness <= 0.0f)
+	{
+		ConvolvedMip[texel] = float4(EnvironmentMap.SampleLevel(BasicSampler, N, 0).rgb, 1);
+		return;
+	}
+
+	uint faceSize, height, mipCount;
+	EnvironmentMap.GetDimensions(0, faceSize, height, mipCount);
+
+	float3 finalColor = float3(0, 0, 0);
+	float totalWeight = 0;
+	for (uint i = 0; i < sampleCount; i++)
+	{
+		float2 Xi = Hammersley2d(i, sampleCount);
+		float3 H = ImportanceSampleGGX(Xi, roughness, N);
+		float3 L = 2 * dot(V, H) * H - V;
+
+		float nDotL = saturate(dot(N, L));
+		if (nDotL > 0)
+		{
+			// With N == V, the pdf of L is D(h) / 4
+			float pdf = SpecDistribution(N, H, roughness) * 0.25f;
+			float mip = EnvironmentMipLevel(pdf, sampleCount, faceSize);
+
+			float3 thisColor = EnvironmentMap.SampleLevel(BasicSampler, L, mip).rgb;
+			finalColor += pow(abs(thisColor), 2.2f) * nDotL;
+			totalWeight += nDotL;
+		}
+	}
+
+	ConvolvedMip[texel] = float4(pow(abs(finalColor / totalWeight), 1.0f / 2.2f), 1);
+}
@@ -0,0 +1,38 @@
+// Include guard
+#ifndef _IMPOSTOR_HLSL
+#define _IMPOSTOR_HLSL
+
+// Each impostor's atlas slice is a grid of views of its mesh from
+// above the horizon, laid out by a hemi-octahedral mapping of the
+// direction they were looked from
+//  - Should match Impostors.h, which bakes them the same way
+
+#define IMPOSTOR_GRID 8
+
+// Unit direction (in the mesh's own space, y up) to [0,1] grid coords
+float2 ImpostorEncode(float3 direction)
+{
+	direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+	return float2(direction.x + direction.z, direction.x - direction.z) * 0.5f + 0.5f;
+}
+
+// The direction the middle of a grid cell was baked from
+float3 ImpostorCellDirection(uint2 cell)
+{
+	float2 encoded = (cell + 0.5f) / IMPOSTOR_GRID * 2.0f - 1.0f;
+	float3 direction = float3(encoded.x + encoded.y, 0.0f, encoded.x - encoded.y) * 0.5f;
+	direction.y = 1.0f - abs(direction.x) - abs(direction.z);
+	return normalize(direction);
+}
+
+// Right and up of the view a cell was baked with, looking back along
+// its direction (the same axes as XMMatrixLookToLH)
+void ImpostorViewAxes(float3 direction, out float3 right, out float3 up)
+{
+	float3 forward = -direction;
+	float3 upHint = abs(direction.y) > 0.999f ? float3(0, 0, 1) : float3(0, 1, 0);
+	right = normalize(cross(upHint, forward));
+	up = cross(forward, right);
+}
+
+#endif
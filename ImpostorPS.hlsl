@@ -0,0 +1,95 @@
+#include "SceneLighting.hlsli"
+#include "Impostor.hlsli"
+
+// Lights a baked impostor view like the G-buffer it is (see
+// DeferredLightingCS.hlsl), one atlas texel per pixel
+//  - Writes the forward targets (and motion, when that's bound),
+//    and its own depth from the baked one
+
+cbuffer externalData : register(b1)
+{
+	matrix viewProjection;
+	matrix view;
+	matrix prevViewProjection;
+	float2 jitter;
+	float2 prevJitter;
+	float2 atlasSize;	// Texels across one slice
+};
+
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;
+	float3 worldPos			: POSITION;
+	float3 depthAxis		: DEPTH_AXIS;
+	nointerpolation float3 worldIT0 : WORLDIT0;
+	nointerpolation float3 worldIT1 : WORLDIT1;
+	nointerpolation float3 worldIT2 : WORLDIT2;
+	nointerpolation uint slice : SLICE;
+	nointerpolation float fade : FADE;
+};
+
+struct PS_Output
+{
+	float4 color : SV_TARGET0;	// Packed with ambient - see GBuffer.hlsli
+	float2 normals : SV_TARGET1;
+	float2 motion : SV_TARGET2;
+	float depth : SV_DEPTH;
+};
+
+// The baked views - see Impostors.h
+Texture2DArray Albedo	: register(t0);
+Texture2DArray Normals	: register(t1);	// In the mesh's own space
+Texture2DArray Surface	: register(t2);
+Texture2DArray Depths	: register(t3);	// Across the bounds, front to back
+
+SamplerState BasicSampler	: register(s0);
+SamplerState ClampSampler	: register(s1);
+
+PS_Output main(VertexToPixel input)
+{
+	// Texels are loaded rather than filtered, so the edges
+	// don't blend into the empty parts of the view
+	int4 texel = int4(min(int2(input.uv * atlasSize), int2(atlasSize) - 1), input.slice, 0);
+	float depth = Depths.Load(texel).r;
+	clip(0.999f - depth);
+
+	float3 worldPos = input.worldPos + input.depthAxis * (depth * 2.0f - 1.0f);
+	float viewDepth = mul(view, float4(worldPos, 1.0f)).z;
+
+	// While fading in, it's drawn over its own entity from the
+	// front of the bounds, so the two can blend
+	float3 depthPos = input.fade < 1.0f ? input.worldPos - input.depthAxis : worldPos;
+	float4 clipPos = mul(viewProjection, float4(depthPos, 1.0f));
+
+	PS_Output output;
+	output.depth = clipPos.z / clipPos.w;
+
+	float4 albedo = Albedo.Load(texel);
+	float3x3 worldIT = float3x3(input.worldIT0, input.worldIT1, input.worldIT2);
+	float3 normal = normalize(mul(DecodeNormal(Normals.Load(texel).rg), worldIT));
+	float metal, specPower;
+	DecodeSurface(Surface.Load(texel).rg, metal, specPower);
+
+#if FEATURE_SHADOWS
+	float shadowAmount = ShadowAmount(worldPos, viewDepth);
+#else
+	float shadowAmount = 1.0f;
+#endif
+
+	float4 screenPosition = float4(input.screenPosition.xy, output.depth, viewDepth);
+	if (specPower > 0.0f)
+		output.color = ShadeBasic(screenPosition, ENTITY_LIGHT_LIST_NONE, normal, worldPos, specPower, albedo.rgb, shadowAmount);
+	else
+		output.color = ShadePBR(screenPosition, ENTITY_LIGHT_LIST_NONE, normal, worldPos, albedo.a, metal, albedo.rgb, shadowAmount, BasicSampler, ClampSampler);
+	output.normals = EncodeNormal(normal);
+
+	// Only the camera moves it (both without their jitter, like RemoveJitter()
+	// in ViewConstants.hlsli, whose cbuffer this can't include)
+	float4 currentClip = mul(viewProjection, float4(worldPos, 1.0f));
+	float4 prevClip = mul(prevViewProjection, float4(worldPos, 1.0f));
+	currentClip.xy -= jitter * currentClip.w;
+	prevClip.xy -= prevJitter * prevClip.w;
+	output.motion = EncodeMotion(currentClip, prevClip);
+	return output;
+}
@@ -0,0 +1,75 @@
+#include "ViewConstants.hlsli"
+#include "Impostor.hlsli"
+
+// One per distant entity - must match ImpostorInstance in Impostors.h
+struct ImpostorInstance
+{
+	row_major float4x4 World;
+	row_major float4x4 WorldInverseTranspose;
+	float3 Center;	// Of the baked mesh's bounds, in its own space
+	float Radius;
+	uint Slice;
+	float Fade;
+	float2 Padding;
+};
+
+StructuredBuffer<ImpostorInstance> Instances : register(t0);
+
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;		// Into the atlas slice
+	float3 worldPos			: POSITION;		// On the quad, through the middle of the bounds
+	float3 depthAxis		: DEPTH_AXIS;	// From the middle to the far side of the bounds
+	nointerpolation float3 worldIT0 : WORLDIT0;	// For the baked (mesh space) normals
+	nointerpolation float3 worldIT1 : WORLDIT1;
+	nointerpolation float3 worldIT2 : WORLDIT2;
+	nointerpolation uint slice : SLICE;
+	nointerpolation float fade : FADE;
+};
+
+// Corners of the quad, two clockwise triangles
+static const float2 Corners[6] =
+{
+	float2(-1, 1), float2(1, 1), float2(-1, -1),
+	float2(-1, -1), float2(1, 1), float2(1, -1)
+};
+
+// --------------------------------------------------------
+// Six vertices per instance, with no vertex buffer
+//  - Each impostor faces whichever baked view is closest to
+//    the camera's direction (rather than the camera itself),
+//    so the view lines up with the quad exactly
+// --------------------------------------------------------
+VertexToPixel main(uint id : SV_VertexID)
+{
+	ImpostorInstance instance = Instances[id / 6];
+	float2 corner = Corners[id % 6];
+
+	// The camera's direction in the mesh's own space, kept above the
+	// horizon since that's all that was baked
+	float3 center = mul(float4(instance.Center, 1.0f), instance.World).xyz;
+	float3 cameraPosition = mul(invView, float4(0, 0, 0, 1)).xyz;
+	float3 toCamera = mul((float3x3)instance.WorldInverseTranspose, cameraPosition - center);
+	toCamera = normalize(float3(toCamera.x, max(toCamera.y, 0.001f), toCamera.z));
+
+	uint2 cell = min(uint2(ImpostorEncode(toCamera) * IMPOSTOR_GRID), IMPOSTOR_GRID - 1);
+	float3 direction = ImpostorCellDirection(cell);
+	float3 right, up;
+	ImpostorViewAxes(direction, right, up);
+
+	float3 localPos = instance.Center + (right * corner.x + up * corner.y) * instance.Radius;
+	float4 worldPos = mul(float4(localPos, 1.0f), instance.World);
+
+	VertexToPixel output;
+	output.screenPosition = mul(viewProjection, worldPos);
+	output.uv = (cell + float2(corner.x, -corner.y) * 0.5f + 0.5f) / IMPOSTOR_GRID;
+	output.worldPos = worldPos.xyz;
+	output.depthAxis = mul(-direction * instance.Radius, (float3x3)instance.World);
+	output.worldIT0 = instance.WorldInverseTranspose[0].xyz;
+	output.worldIT1 = instance.WorldInverseTranspose[1].xyz;
+	output.worldIT2 = instance.WorldInverseTranspose[2].xyz;
+	output.slice = instance.Slice;
+	output.fade = instance.Fade;
+	return output;
+}
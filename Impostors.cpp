@@ -0,0 +1,191 @@
+#include "Impostors.h"
+#include "AssetLoader.h"
+#include "Camera.h"
+#include "GpuMemory.h"
+#include "StateCache.h"
+
+using namespace DirectX;
+
+ImpostorAtlas::ImpostorAtlas(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device)
+{
+	nextSlice = 0;
+}
+
+int ImpostorAtlas::Find(Mesh* mesh, Material* material)
+{
+	ImpostorKey key(mesh, material);
+	auto it = slices.find(key);
+	if (it != slices.end())
+		return it->second;
+
+	// Anything that can't be baked is remembered, so it isn't asked about again
+	slices.insert({ key, -1 });
+	if (material->GetGBufferPS() && nextSlice + queue.size() < IMPOSTOR_MAX_COUNT)
+		queue.push_back(key);
+	return -1;
+}
+
+unsigned int ImpostorAtlas::Bake(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int maxBakes)
+{
+	if (queue.empty() || (!albedoSRV && !CreateAtlas()))
+		return 0;
+
+	unsigned int baked = 0;
+	while (baked < maxBakes && !queue.empty())
+	{
+		ImpostorKey key = queue.front();
+		queue.erase(queue.begin());
+
+		BakeSlice(context, key.first, key.second, nextSlice);
+		slices[key] = (int)nextSlice;
+		nextSlice++;
+		baked++;
+	}
+
+	// Don't leave the atlas bound as a target, since it's read next
+	StateCache::GetInstance().Apply(context, PassState());
+	ISimpleShader::InvalidateStateCache(context);
+	return baked;
+}
+
+void ImpostorAtlas::Clear()
+{
+	slices.clear();
+	queue.clear();
+	nextSlice = 0;
+}
+
+// --------------------------------------------------------
+// The texture arrays with a view of each slice to bake into,
+// and the buffer each view's constants go in
+// --------------------------------------------------------
+bool ImpostorAtlas::CreateAtlas()
+{
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = IMPOSTOR_SLICE_SIZE;
+	texDesc.Height = IMPOSTOR_SLICE_SIZE;
+	texDesc.ArraySize = IMPOSTOR_MAX_COUNT;
+	texDesc.MipLevels = 1;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	// Same formats as the G-buffer, which the materials' shaders write
+	const DXGI_FORMAT formats[3] = { DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, DXGI_FORMAT_R16G16_UNORM, DXGI_FORMAT_R8G8_UNORM };
+	const char* names[3] = { "Impostor Albedo", "Impostor Normals", "Impostor Surface" };
+	ID3D11ShaderResourceView** srvs[3] = { albedoSRV.ReleaseAndGetAddressOf(), normalsSRV.ReleaseAndGetAddressOf(), surfaceSRV.ReleaseAndGetAddressOf() };
+	std::vector<Microsoft::WRL::ComPtr<ID3D11RenderTargetView>>* rtvs[3] = { &albedoRTVs, &normalsRTVs, &surfaceRTVs };
+	for (int t = 0; t < 3; t++)
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		texDesc.Format = formats[t];
+		if (FAILED(GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, texture.GetAddressOf(), GpuMemoryCategory::Textures, names[t])))
+			return false;
+		device->CreateShaderResourceView(texture.Get(), 0, srvs[t]);
+
+		rtvs[t]->assign(IMPOSTOR_MAX_COUNT, nullptr);
+		for (unsigned int s = 0; s < IMPOSTOR_MAX_COUNT; s++)
+		{
+			D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+			rtvDesc.Format = formats[t];
+			rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+			rtvDesc.Texture2DArray.FirstArraySlice = s;
+			rtvDesc.Texture2DArray.ArraySize = 1;
+			device->CreateRenderTargetView(texture.Get(), &rtvDesc, (*rtvs[t])[s].GetAddressOf());
+		}
+	}
+
+	// Depth is kept to rebuild where each texel was
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> depthTexture;
+	texDesc.Format = DXGI_FORMAT_R16_TYPELESS;
+	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	if (FAILED(GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, depthTexture.GetAddressOf(), GpuMemoryCategory::Textures, "Impostor Depth")))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R16_UNORM;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = IMPOSTOR_MAX_COUNT;
+	device->CreateShaderResourceView(depthTexture.Get(), &srvDesc, depthSRV.ReleaseAndGetAddressOf());
+
+	depthDSVs.assign(IMPOSTOR_MAX_COUNT, nullptr);
+	for (unsigned int s = 0; s < IMPOSTOR_MAX_COUNT; s++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = DXGI_FORMAT_D16_UNORM;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Texture2DArray.FirstArraySlice = s;
+		dsvDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(depthTexture.Get(), &dsvDesc, depthDSVs[s].GetAddressOf());
+	}
+
+	D3D11_BUFFER_DESC cbDesc = {};
+	cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	cbDesc.Usage = D3D11_USAGE_DEFAULT;
+	cbDesc.ByteWidth = sizeof(ViewConstants);
+	return SUCCEEDED(GpuMemory::CreateBuffer(device.Get(), &cbDesc, 0, viewBuffer.ReleaseAndGetAddressOf(), GpuMemoryCategory::Buffers, "Impostor View"));
+}
+
+// --------------------------------------------------------
+// Draws every view of a mesh into its slice, with the
+// material's vertex and G-buffer pixel shaders
+//  - The mesh is drawn where it is in its own space, so
+//    the normals come out in that space too
+// --------------------------------------------------------
+void ImpostorAtlas::BakeSlice(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Mesh* mesh, Material* material, unsigned int slice)
+{
+	float clearColor[4] = { 0, 0, 0, 0 };
+	context->ClearRenderTargetView(albedoRTVs[slice].Get(), clearColor);
+	context->ClearRenderTargetView(normalsRTVs[slice].Get(), clearColor);
+	context->ClearRenderTargetView(surfaceRTVs[slice].Get(), clearColor);
+	context->ClearDepthStencilView(depthDSVs[slice].Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+	ID3D11RenderTargetView* targets[3] = { albedoRTVs[slice].Get(), normalsRTVs[slice].Get(), surfaceRTVs[slice].Get() };
+	PassState bakePass;
+	bakePass.SetRenderTargets(3, targets, depthDSVs[slice].Get());
+	bakePass.SetViewport((float)IMPOSTOR_CELL_SIZE, (float)IMPOSTOR_CELL_SIZE);
+
+	SimpleVertexShader* vs = Assets::GetInstance().GetVertexShaderFor(material->GetVS(), mesh);
+	SimplePixelShader* ps = material->GetGBufferPS();
+	vs->SetExternalConstantBuffer("perFrame", viewBuffer);
+	vs->SetShader();
+	ps->SetShader();
+	material->SetPerMaterialDataAndResources(true, ps);
+
+	Transform identity;
+	material->SetPerObjectData(&identity, vs);
+	mesh->SetBuffers(context);
+
+	// The whole bounding sphere fits in each view, front to back
+	const BoundingBox& bounds = mesh->GetBounds();
+	XMVECTOR center = XMLoadFloat3(&bounds.Center);
+	float radius = max(XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents))), 0.001f);
+
+	ViewConstants view = {};
+	XMStoreFloat4x4(&view.Projection, XMMatrixOrthographicLH(radius * 2.0f, radius * 2.0f, 0.0f, radius * 2.0f));
+	for (unsigned int y = 0; y < IMPOSTOR_GRID; y++)
+	{
+		for (unsigned int x = 0; x < IMPOSTOR_GRID; x++)
+		{
+			// Same direction for each cell as ImpostorCellDirection()
+			float u = (x + 0.5f) / IMPOSTOR_GRID * 2.0f - 1.0f;
+			float v = (y + 0.5f) / IMPOSTOR_GRID * 2.0f - 1.0f;
+			XMFLOAT3 cellDirection((u + v) * 0.5f, 0.0f, (u - v) * 0.5f);
+			cellDirection.y = 1.0f - fabsf(cellDirection.x) - fabsf(cellDirection.z);
+			XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&cellDirection));
+
+			XMVECTOR up = fabsf(XMVectorGetY(direction)) > 0.999f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+			XMStoreFloat4x4(&view.View, XMMatrixLookToLH(center + direction * radius, -direction, up));
+			view.Compute();
+			view.PrevViewProjection = view.ViewProjection;
+			context->UpdateSubresource(viewBuffer.Get(), 0, 0, &view, 0, 0);
+
+			bakePass.Viewport.TopLeftX = (float)(x * IMPOSTOR_CELL_SIZE);
+			bakePass.Viewport.TopLeftY = (float)(y * IMPOSTOR_CELL_SIZE);
+			StateCache::GetInstance().Apply(context, bakePass);
+			mesh->Draw(context, 0);
+		}
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "Mesh.h"
+#include "Material.h"
+
+// Views baked for each mesh and material pair - a grid of them across
+// each atlas slice (see Impostor.hlsli), each this many texels square
+#define IMPOSTOR_GRID			8
+#define IMPOSTOR_CELL_SIZE		32
+#define IMPOSTOR_SLICE_SIZE		(IMPOSTOR_GRID * IMPOSTOR_CELL_SIZE)
+
+// Pairs that can have impostors at once (slices in the atlas)
+#define IMPOSTOR_MAX_COUNT		32
+
+// New pairs baked each frame, at most, so a lot of them showing up
+// at once doesn't hitch (the rest are drawn as meshes until then)
+#define IMPOSTOR_BAKES_PER_FRAME	2
+
+// One per distant entity, for the impostor shaders
+//  - Must match ImpostorInstance in ImpostorVS.hlsl
+struct ImpostorInstance
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+	DirectX::XMFLOAT3 Center;	// Of the baked mesh's bounds, in its own space
+	float Radius;
+	unsigned int Slice;
+	float Fade;					// How much of the entity it is, from 0 to 1
+	DirectX::XMFLOAT2 Padding;
+};
+
+// --------------------------------------------------------
+// Baked views of meshes, for drawing far away entities as
+// a single quad each
+//  - Each mesh and material pair gets a slice of the atlas
+//    the first time it's asked for, baked with the material's
+//    own G-buffer shader (so only materials that have one),
+//    and kept until the atlas is cleared
+//  - Views are orthographic, of the mesh's bounding sphere,
+//    from directions spread over the upper hemisphere, with
+//    G-buffer albedo, normals (in the mesh's own space),
+//    surface, and depth across the sphere
+// --------------------------------------------------------
+class ImpostorAtlas
+{
+public:
+	ImpostorAtlas(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// The slice with this pair's views, or -1 if it hasn't been baked
+	//  - The first time a pair's asked for, it's queued for baking,
+	//    if there's room and its material has a G-buffer shader
+	int Find(Mesh* mesh, Material* material);
+
+	// Bakes up to this many of the queued pairs, returning how many
+	//  - Points the materials' vertex shaders at its own view buffer,
+	//    so the caller has to bind the camera's again afterwards
+	unsigned int Bake(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int maxBakes);
+
+	// Forgets every pair (like when meshes or materials are replaced)
+	void Clear();
+
+	unsigned int GetBakedCount() { return nextSlice; }
+	unsigned int GetQueuedCount() { return (unsigned int)queue.size(); }
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetAlbedoSRV() { return albedoSRV; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetNormalsSRV() { return normalsSRV; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSurfaceSRV() { return surfaceSRV; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetDepthSRV() { return depthSRV; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	// Each pair's slice, or -1 while it's queued (or if it can't have one)
+	typedef std::pair<Mesh*, Material*> ImpostorKey;
+	std::map<ImpostorKey, int> slices;
+	std::vector<ImpostorKey> queue;
+	unsigned int nextSlice;
+
+	// Made the first time anything's baked
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedoSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normalsSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> surfaceSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthSRV;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11RenderTargetView>> albedoRTVs;	// One per slice
+	std::vector<Microsoft::WRL::ComPtr<ID3D11RenderTargetView>> normalsRTVs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11RenderTargetView>> surfaceRTVs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11DepthStencilView>> depthDSVs;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> viewBuffer;	// ViewConstants for each view
+	bool CreateAtlas();
+	void BakeSlice(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Mesh* mesh, Material* material, unsigned int slice);
+};
@@ -1,4 +1,5 @@
 #include "Input.h"
+#include <stdio.h>
 
 // Singleton requirement
 Input* Input::instance;
@@ -115,6 +116,18 @@ void Input::Update()
 	mouseY = mousePos.y;
 	mouseXDelta = mouseX - prevMouseX;
 	mouseYDelta = mouseY - prevMouseY;
+
+	// Raw input replaces the deltas with all of the motion since last
+	// frame, however many messages it came in
+	if (rawMouse)
+	{
+		mouseXDelta = (int)rawXAccumulated;
+		mouseYDelta = (int)rawYAccumulated;
+	}
+	rawXAccumulated = 0;
+	rawYAccumulated = 0;
+
+	UpdateCursorClip();
 }
 
 // ----------------------------------------------------------
@@ -164,6 +177,111 @@ void Input::SetWheelDelta(float delta)
 }
 
 
+// ---------------------------------------------------------------
+//  Turns raw mouse input on or off by (un)registering the mouse
+//  with Windows, which then sends this window WM_INPUT messages
+// ---------------------------------------------------------------
+void Input::SetRawMouseInput(bool enabled)
+{
+	RAWINPUTDEVICE mouse = {};
+	mouse.usUsagePage = 0x01;	// HID_USAGE_PAGE_GENERIC
+	mouse.usUsage = 0x02;		// HID_USAGE_GENERIC_MOUSE
+	mouse.dwFlags = enabled ? 0 : RIDEV_REMOVE;
+	mouse.hwndTarget = enabled ? windowHandle : 0;
+
+	if (!RegisterRawInputDevices(&mouse, 1, sizeof(RAWINPUTDEVICE)))
+	{
+		printf("Raw mouse input could not be %s\n", enabled ? "registered" : "removed");
+		rawMouse = false;
+		return;
+	}
+
+	rawMouse = enabled;
+	rawXAccumulated = 0;
+	rawYAccumulated = 0;
+}
+
+
+// ---------------------------------------------------------------
+//  Adds relative motion from a WM_INPUT message.  This is called
+//  by DXCore, so you'll never need to call this yourself.
+// ---------------------------------------------------------------
+void Input::AddRawMouseDelta(long x, long y)
+{
+	rawXAccumulated += x;
+	rawYAccumulated += y;
+}
+
+
+// ---------------------------------------------------------------
+//  Gets the mouse movement since Update(), part way into the frame
+//  - Raw input messages are pulled in here rather than waiting for
+//    the next time DXCore handles its messages
+// ---------------------------------------------------------------
+void Input::LateUpdateMouse(int& xDelta, int& yDelta)
+{
+	if (rawMouse)
+	{
+		MSG msg = {};
+		while (PeekMessage(&msg, windowHandle, WM_INPUT, WM_INPUT, PM_REMOVE))
+			DispatchMessage(&msg);
+
+		xDelta = (int)rawXAccumulated;
+		yDelta = (int)rawYAccumulated;
+		rawXAccumulated = 0;
+		rawYAccumulated = 0;
+	}
+	else
+	{
+		POINT mousePos = {};
+		GetCursorPos(&mousePos);
+		ScreenToClient(windowHandle, &mousePos);
+
+		xDelta = mousePos.x - mouseX;
+		yDelta = mousePos.y - mouseY;
+		mouseX = mousePos.x;
+		mouseY = mousePos.y;
+	}
+
+	mouseXDelta += xDelta;
+	mouseYDelta += yDelta;
+}
+
+
+// ---------------------------------------------------------------
+//  Turns clipping the cursor to the window on or off
+// ---------------------------------------------------------------
+void Input::SetCursorClip(bool enabled)
+{
+	clipCursor = enabled;
+	UpdateCursorClip();
+}
+
+
+// ---------------------------------------------------------------
+//  Clips the cursor to the window's client area while clipping's
+//  on and the window has focus, and lets it go otherwise
+//  - Redone each frame, since the window might have moved or
+//    been resized, and Windows drops the clip on focus changes
+// ---------------------------------------------------------------
+void Input::UpdateCursorClip()
+{
+	bool clip = clipCursor && windowHandle && GetForegroundWindow() == windowHandle;
+	if (clip)
+	{
+		RECT client = {};
+		GetClientRect(windowHandle, &client);
+		MapWindowPoints(windowHandle, 0, (POINT*)&client, 2);
+		ClipCursor(&client);
+	}
+	else if (cursorClipped)
+	{
+		ClipCursor(0);
+	}
+	cursorClipped = clip;
+}
+
+
 // ----------------------------------------------------------
 //  Is the given key down this frame?
 //  
@@ -40,6 +40,23 @@ public:
 	float GetMouseWheel();
 	void SetWheelDelta(float delta);
 
+	// Raw mouse input (WM_INPUT), which takes the mouse's motion straight
+	// from the device, before pointer acceleration, and isn't stopped by
+	// the edge of the screen
+	//  - While it's on, the deltas above are everything that came in
+	//    since the last Update() instead of the cursor's movement
+	//  - Clipping keeps the cursor inside the window while it has focus
+	void SetRawMouseInput(bool enabled);
+	bool GetRawMouseInput() { return rawMouse; }
+	void SetCursorClip(bool enabled);
+	bool GetCursorClip() { return clipCursor; }
+	void AddRawMouseDelta(long x, long y);
+
+	// Picks up any mouse movement since Update(), for turning the camera
+	// just before it's drawn with, and adds it to this frame's deltas so
+	// it isn't counted again next frame
+	void LateUpdateMouse(int& xDelta, int& yDelta);
+
 	bool KeyDown(int key);
 	bool KeyUp(int key);
 
@@ -82,6 +99,16 @@ private:
 	int mouseYDelta {0};
 	float wheelDelta {0};
 
+	// Raw motion since the last Update(), added to by DXCore
+	// as each WM_INPUT message comes in
+	bool rawMouse {false};
+	long rawXAccumulated {0};
+	long rawYAccumulated {0};
+
+	bool clipCursor {false};
+	bool cursorClipped {false};
+	void UpdateCursorClip();
+
 	bool guiWantsKeyboard;
 	bool guiWantsMouse;
 
@@ -0,0 +1,303 @@
+#include "JobSystem.h"
+#include "ThreadManager.h"
+
+#include <stdio.h>
+
+// Singleton requirement
+JobSystem* JobSystem::instance;
+thread_local int JobSystem::workerIndex = -1;
+
+
+JobSystem::JobSystem()
+{
+	enabled = true;
+	running = false;
+	queuedJobs = 0;
+	frameStart = std::chrono::high_resolution_clock::now();
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+// --------------------------------------------------------
+// Creates the workers, with the calling thread as worker 0
+//  - Not saying how many starts one per physical core when
+//    the workers are pinned (see ThreadManager)
+// --------------------------------------------------------
+void JobSystem::Initialize(unsigned int workerCount)
+{
+	if (!workers.empty())
+		return;
+
+	if (workerCount == 0)
+		workerCount = ThreadManager::GetInstance().GetDefaultWorkerCount();
+	workerCount = workerCount < 1 ? 1 : workerCount;
+	workerCount = workerCount > JOB_SYSTEM_MAX_WORKERS ? JOB_SYSTEM_MAX_WORKERS : workerCount;
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		Worker* worker = new Worker();
+		worker->BusyNanoseconds = 0;
+		worker->JobsRun = 0;
+		worker->JobsStolen = 0;
+		worker->Stats = {};
+		workers.push_back(worker);
+	}
+
+	workerIndex = 0;
+	running = true;
+	for (unsigned int i = 1; i < workerCount; i++)
+		workers[i]->Thread = std::thread(&JobSystem::WorkerLoop, this, i);
+
+	printf("Job system started with %u workers\n", workerCount);
+}
+
+// --------------------------------------------------------
+// Finishes anything still queued, then stops the workers
+// --------------------------------------------------------
+void JobSystem::Shutdown()
+{
+	if (workers.empty())
+		return;
+
+	Job job;
+	while (TakeJob(0, job))
+		Execute(job);
+
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		running = false;
+	}
+	wakeCondition.notify_all();
+
+	for (unsigned int i = 1; i < workers.size(); i++)
+		workers[i]->Thread.join();
+
+	for (auto& w : workers)
+		delete w;
+	workers.clear();
+}
+
+void JobSystem::WorkerLoop(unsigned int index)
+{
+	workerIndex = (int)index;
+
+	char name[32];
+	snprintf(name, sizeof(name), "Job Worker %u", index);
+	ThreadManager::GetInstance().Configure(ThreadRole::Worker, name, index);
+
+	while (running)
+	{
+		Job job;
+		if (TakeJob(index, job))
+		{
+			Execute(job);
+			continue;
+		}
+
+		// Nothing to do or steal, so sleep until something is queued
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wakeCondition.wait(lock, [&]() { return !running || queuedJobs > 0; });
+	}
+
+	ThreadManager::GetInstance().Unregister();
+}
+
+// --------------------------------------------------------
+// Queues a job, or holds it until its dependency is done
+//  - The counter goes up right away, so waiting on it
+//    also waits on jobs that are being held
+// --------------------------------------------------------
+void JobSystem::Run(std::function<void()> function, JobCounter* counter, JobCounter* dependency)
+{
+	Job job = { function, counter };
+	if (counter)
+		counter->count++;
+
+	// No workers means no one to hand it to
+	if (!enabled || workers.empty())
+	{
+		if (dependency)
+			Wait(dependency);
+		Execute(job);
+		return;
+	}
+
+	if (dependency)
+	{
+		// Checked under the lock, so it can't reach zero (and
+		// release its waiting jobs) in between
+		std::lock_guard<std::mutex> lock(dependency->waitingMutex);
+		if (dependency->count > 0)
+		{
+			dependency->waiting.push_back(job);
+			return;
+		}
+	}
+
+	Enqueue(job);
+}
+
+void JobSystem::Enqueue(Job job)
+{
+	// Threads that aren't workers share the main thread's deque
+	Worker* worker = workers[workerIndex < 0 ? 0 : workerIndex];
+	{
+		std::lock_guard<std::mutex> lock(worker->QueueMutex);
+		worker->Queue.push_back(job);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		queuedJobs++;
+	}
+	wakeCondition.notify_one();
+}
+
+// --------------------------------------------------------
+// Takes this worker's newest job (which is likely still in
+// cache), or the oldest job from someone else
+// --------------------------------------------------------
+bool JobSystem::TakeJob(unsigned int index, Job& job)
+{
+	if (queuedJobs <= 0)
+		return false;
+
+	{
+		Worker* worker = workers[index];
+		std::lock_guard<std::mutex> lock(worker->QueueMutex);
+		if (!worker->Queue.empty())
+		{
+			job = worker->Queue.back();
+			worker->Queue.pop_back();
+			queuedJobs--;
+			return true;
+		}
+	}
+
+	for (unsigned int i = 1; i < workers.size(); i++)
+	{
+		Worker* victim = workers[(index + i) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim->QueueMutex);
+		if (!victim->Queue.empty())
+		{
+			job = victim->Queue.front();
+			victim->Queue.pop_front();
+			queuedJobs--;
+			workers[index]->JobsStolen++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(Job& job)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	job.Function();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	// Only workers keep stats
+	if (workerIndex >= 0 && workerIndex < (int)workers.size())
+	{
+		Worker* worker = workers[workerIndex];
+		worker->BusyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		worker->JobsRun++;
+	}
+
+	Finish(job.Counter);
+}
+
+// --------------------------------------------------------
+// Counts a job as done, releasing anything that was
+// waiting on its counter once it reaches zero
+//  - Decremented under the lock, so Wait() can tell when
+//    this is completely done with the counter
+// --------------------------------------------------------
+void JobSystem::Finish(JobCounter* counter)
+{
+	if (!counter)
+		return;
+
+	std::vector<Job> released;
+	{
+		std::lock_guard<std::mutex> lock(counter->waitingMutex);
+		if (--counter->count > 0)
+			return;
+
+		released.swap(counter->waiting);
+	}
+
+	for (auto& job : released)
+	{
+		if (enabled && !workers.empty())
+			Enqueue(job);
+		else
+			Execute(job);
+	}
+}
+
+// --------------------------------------------------------
+// Helps out with queued jobs until the counter is done
+// --------------------------------------------------------
+void JobSystem::Wait(JobCounter* counter)
+{
+	if (!counter)
+		return;
+
+	while (!counter->IsDone())
+	{
+		Job job;
+		if (workerIndex >= 0 && workerIndex < (int)workers.size() && TakeJob(workerIndex, job))
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+
+	// The last job to finish might still hold the lock, and
+	// the counter can't go away until it's let go
+	std::lock_guard<std::mutex> lock(counter->waitingMutex);
+}
+
+void JobSystem::ParallelFor(unsigned int count, unsigned int batchSize, const std::function<void(unsigned int, unsigned int)>& function)
+{
+	batchSize = batchSize < 1 ? 1 : batchSize;
+	if (!enabled || workers.size() < 2 || count <= batchSize)
+	{
+		if (count > 0)
+			function(0, count);
+		return;
+	}
+
+	// The function outlives every batch, since this waits for them
+	JobCounter counter;
+	for (unsigned int start = 0; start < count; start += batchSize)
+	{
+		unsigned int end = start + batchSize < count ? start + batchSize : count;
+		Run([&function, start, end]() { function(start, end); }, &counter);
+	}
+	Wait(&counter);
+}
+
+// --------------------------------------------------------
+// Turns each worker's running totals into stats for the
+// frame that just ended
+// --------------------------------------------------------
+void JobSystem::BeginFrame()
+{
+	auto now = std::chrono::high_resolution_clock::now();
+	double frameNanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - frameStart).count();
+	frameStart = now;
+
+	for (auto& w : workers)
+	{
+		long long busy = w->BusyNanoseconds.exchange(0);
+		w->Stats.JobsRun = w->JobsRun.exchange(0);
+		w->Stats.JobsStolen = w->JobsStolen.exchange(0);
+		w->Stats.BusyMs = (float)(busy / 1000000.0);
+		w->Stats.Utilization = frameNanoseconds > 0 ? (float)(busy / frameNanoseconds) : 0.0f;
+	}
+}
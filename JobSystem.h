@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Upper limit on threads (including the main thread)
+#define JOB_SYSTEM_MAX_WORKERS 16
+
+class JobCounter;
+
+struct Job
+{
+	std::function<void()> Function;
+	JobCounter* Counter;
+};
+
+// Counts unfinished jobs
+//  - Goes up when a job is queued with it and down once that job is
+//    done, so a job that queues its own children with the same counter
+//    isn't finished until they are (parent/child dependencies)
+//  - Jobs can be held back until a counter reaches zero
+//  - Only safe to destroy once JobSystem::Wait() has returned for it
+class JobCounter
+{
+public:
+	JobCounter() : count(0) {}
+	bool IsDone() { return count.load() == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<int> count;
+
+	// Jobs waiting for this counter to reach zero
+	std::mutex waitingMutex;
+	std::vector<Job> waiting;
+};
+
+// Per worker numbers for the last full frame
+struct JobWorkerStats
+{
+	unsigned int JobsRun;
+	unsigned int JobsStolen;
+	float BusyMs;
+	float Utilization;
+};
+
+// Worker threads that each own a deque of jobs
+//  - A worker takes its own newest job first, and when it runs out
+//    steals the oldest job from another worker
+//  - The main thread is worker zero, and runs jobs while it waits
+//  - When disabled, everything just runs immediately on the calling thread
+class JobSystem
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static JobSystem& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new JobSystem();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	JobSystem(JobSystem const&) = delete;
+	void operator=(JobSystem const&) = delete;
+
+private:
+	static JobSystem* instance;
+	JobSystem();
+#pragma endregion
+
+public:
+	~JobSystem();
+
+	// Starts the workers from the calling (main) thread
+	//  - Zero workers means one per hardware thread
+	void Initialize(unsigned int workerCount = 0);
+	void Shutdown();
+
+	// Queues a job on the calling worker's deque
+	//  - counter (optional) is done once the job is
+	//  - dependency (optional) holds the job back until it's done
+	void Run(std::function<void()> function, JobCounter* counter = 0, JobCounter* dependency = 0);
+
+	// Runs queued jobs until the counter is done
+	void Wait(JobCounter* counter);
+
+	// Splits [0, count) into batches of batchSize, runs them across the
+	// workers as function(start, end) and waits for all of them
+	//  - Anything that fits in one batch just runs right here
+	void ParallelFor(unsigned int count, unsigned int batchSize, const std::function<void(unsigned int, unsigned int)>& function);
+
+	bool GetEnabled() { return enabled; }
+	void SetEnabled(bool enabled) { this->enabled = enabled; }
+
+	// Ends the stats for the frame so far and starts new ones
+	void BeginFrame();
+	unsigned int GetWorkerCount() { return (unsigned int)workers.size(); }
+	const JobWorkerStats& GetWorkerStats(unsigned int worker) { return workers[worker]->Stats; }
+
+private:
+	struct Worker
+	{
+		std::mutex QueueMutex;
+		std::deque<Job> Queue;
+		std::thread Thread;
+
+		// Written by the worker, read at the end of the frame
+		std::atomic<long long> BusyNanoseconds;
+		std::atomic<unsigned int> JobsRun;
+		std::atomic<unsigned int> JobsStolen;
+		JobWorkerStats Stats;
+	};
+
+	std::vector<Worker*> workers;
+	bool enabled;
+	std::atomic<bool> running;
+
+	// Sleeping workers wake up when anything is queued
+	std::atomic<int> queuedJobs;
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+
+	std::chrono::high_resolution_clock::time_point frameStart;
+
+	// Which worker the current thread is, or -1 if it isn't one
+	static thread_local int workerIndex;
+
+	void WorkerLoop(unsigned int index);
+	void Enqueue(Job job);
+	bool TakeJob(unsigned int index, Job& job);
+	void Execute(Job& job);
+	void Finish(JobCounter* counter);
+};
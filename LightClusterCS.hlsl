@@ -0,0 +1,109 @@
+#include "Lighting.hlsli"
+#include "LightClusters.hlsli"
+
+#define GROUP_SIZE (CLUSTER_COUNT_X * CLUSTER_COUNT_Y)
+
+cbuffer externalData : register(b0)
+{
+	matrix view;
+	matrix invProjection;
+
+	float2 screenSize;
+	float cameraNear;		// Start of the very first slice
+	float clusterNear;		// Start of the logarithmic slice distribution
+
+	float clusterFar;
+	int lightCount;
+};
+
+// All lights this frame
+StructuredBuffer<Light> Lights			: register(t0);
+
+// Per cluster light count, and a fixed size block
+// of light indices for each cluster
+RWStructuredBuffer<uint> LightGrid		: register(u0);
+RWStructuredBuffer<uint> LightIndices	: register(u1);
+
+// View space position and range of the current batch of lights
+// (range is negative for directional lights, which hit everything)
+groupshared float4 batchLights[GROUP_SIZE];
+
+
+// Converts a pixel position on the near plane to view space
+float3 ScreenToView(float2 pixel)
+{
+	float2 ndc = pixel / screenSize * 2.0f - 1.0f;
+	ndc.y = -ndc.y; // Invert Y due to pixel <--> NDC diff
+
+	float4 viewPos = mul(invProjection, float4(ndc, 0.0f, 1.0f));
+	return viewPos.xyz / viewPos.w;
+}
+
+// View space depth of the start of a depth slice
+float SliceDepth(uint slice)
+{
+	return clusterNear * pow(abs(clusterFar / clusterNear), slice / (float)CLUSTER_COUNT_Z);
+}
+
+bool SphereIntersectsAABB(float3 center, float radius, float3 aabbMin, float3 aabbMax)
+{
+	float3 closest = clamp(center, aabbMin, aabbMax);
+	float3 toClosest = closest - center;
+	return dot(toClosest, toClosest) <= radius * radius;
+}
+
+// One thread per cluster, one group per depth slice
+[numthreads(CLUSTER_COUNT_X, CLUSTER_COUNT_Y, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+	// Rays through the corners of this cluster's screen tile
+	float2 tileSize = screenSize / float2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y);
+	float3 minRay = ScreenToView(id.xy * tileSize);
+	float3 maxRay = ScreenToView((id.xy + 1) * tileSize);
+
+	// Depth range of this slice
+	float sliceNear = id.z == 0 ? cameraNear : SliceDepth(id.z);
+	float sliceFar = SliceDepth(id.z + 1);
+
+	// Bounding box of the slab of the tile frustum between those depths
+	float3 minNear = minRay * (sliceNear / minRay.z);
+	float3 minFar = minRay * (sliceFar / minRay.z);
+	float3 maxNear = maxRay * (sliceNear / maxRay.z);
+	float3 maxFar = maxRay * (sliceFar / maxRay.z);
+	float3 aabbMin = min(min(minNear, minFar), min(maxNear, maxFar));
+	float3 aabbMax = max(max(minNear, minFar), max(maxNear, maxFar));
+
+	uint cluster = ClusterIndex(id);
+	uint firstIndex = cluster * MAX_LIGHTS_PER_CLUSTER;
+	uint count = 0;
+
+	// Every thread in the group tests the same lights, so
+	// cooperatively load them into group shared memory in batches
+	for (int batch = 0; batch < lightCount; batch += GROUP_SIZE)
+	{
+		int lightIndex = batch + groupIndex;
+		if (lightIndex < lightCount)
+		{
+			Light light = Lights[lightIndex];
+			batchLights[groupIndex] = light.Type == LIGHT_TYPE_DIRECTIONAL ?
+				float4(0, 0, 0, -1) :
+				float4(mul(view, float4(light.Position, 1.0f)).xyz, light.Range);
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		int batchCount = min(GROUP_SIZE, lightCount - batch);
+		for (int i = 0; i < batchCount; i++)
+		{
+			float4 light = batchLights[i];
+			if (count < MAX_LIGHTS_PER_CLUSTER &&
+				(light.w < 0.0f || SphereIntersectsAABB(light.xyz, light.w, aabbMin, aabbMax)))
+			{
+				LightIndices[firstIndex + count] = batch + i;
+				count++;
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	LightGrid[cluster] = count;
+}
@@ -0,0 +1,31 @@
+// Include guard
+#ifndef _LIGHT_CLUSTERS_HLSL
+#define _LIGHT_CLUSTERS_HLSL
+
+// Cluster grid dimensions - these should match
+// the definitions in Lights.h
+#define CLUSTER_COUNT_X			16
+#define CLUSTER_COUNT_Y			9
+#define CLUSTER_COUNT_Z			24
+#define MAX_LIGHTS_PER_CLUSTER	128
+
+// Flattens a 3D cluster coordinate into an index
+// for the light grid
+uint ClusterIndex(uint3 cluster)
+{
+	return cluster.x + cluster.y * CLUSTER_COUNT_X + cluster.z * CLUSTER_COUNT_X * CLUSTER_COUNT_Y;
+}
+
+// Finds the cluster a pixel belongs to
+//  - screenPosition is SV_POSITION (xy in pixels, w is view space depth)
+//  - tileScale is the cluster count divided by the screen size
+//  - depthScaleBias turns log(view depth) into a depth slice
+uint ClusterIndexFromPixel(float4 screenPosition, float2 tileScale, float2 depthScaleBias)
+{
+	uint3 cluster;
+	cluster.xy = min(uint2(screenPosition.xy * tileScale), uint2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+	cluster.z = (uint)clamp(log(screenPosition.w) * depthScaleBias.x - depthScaleBias.y, 0.0f, CLUSTER_COUNT_Z - 1.0f);
+	return ClusterIndex(cluster);
+}
+
+#endif
@@ -0,0 +1,11 @@
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float3 color			: COLOR;
+};
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	// No ambient (alpha) for the G-buffer, so AO leaves it alone
+	return float4(input.color, 0);
+}
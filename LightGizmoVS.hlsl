@@ -0,0 +1,43 @@
+#include "VertexFormat.hlsli"
+#include "ViewConstants.hlsli"
+
+// One per point light - must match LightGizmo in Renderer.h
+struct LightGizmo
+{
+	float3 Position;
+	float Scale;
+	float3 Color;
+	float Padding;
+};
+
+StructuredBuffer<LightGizmo> Gizmos : register(t0);
+
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+	VertexUV uv			: TEXCOORD;
+	VertexDirection normal	: NORMAL;
+	VertexDirection tangent	: TANGENT;
+};
+
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float3 color			: COLOR;
+};
+
+// --------------------------------------------------------
+// Draws every point light's gizmo in a single instanced
+// draw, with each instance's data from the gizmo buffer
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input, uint instance : SV_InstanceID)
+{
+	LightGizmo gizmo = Gizmos[instance];
+
+	float3 worldPos = input.position * gizmo.Scale + gizmo.Position;
+
+	VertexToPixel output;
+	output.screenPosition = mul(projection, mul(view, float4(worldPos, 1.0f)));
+	output.color = gizmo.Color;
+	return output;
+}
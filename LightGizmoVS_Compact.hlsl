@@ -0,0 +1,5 @@
+// LightGizmoVS.hlsl for meshes with compact vertices
+//  - See VertexFormat.hlsli
+#define FEATURE_COMPACT_VERTICES 1
+
+#include "LightGizmoVS.hlsl"
@@ -0,0 +1,209 @@
+#include "LightManager.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+LightHandle LightManager::Add(const Light& light)
+{
+	unsigned int slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = (unsigned int)slots.size();
+		slots.push_back({ UINT_MAX, 0 });
+	}
+
+	unsigned int index = (unsigned int)lights.size();
+	slots[slot].LightIndex = index;
+	lights.push_back(light);
+	bounds.push_back({});
+	lightSlots.push_back(slot);
+	dirty.push_back(0);
+	UpdateBounds(index);
+	MarkDirty(index);
+	return { slot, slots[slot].Generation };
+}
+
+// --------------------------------------------------------
+// Moves the last light into the removed one's place, so
+// only that one place needs uploading again
+// --------------------------------------------------------
+void LightManager::Remove(LightHandle handle)
+{
+	int removed = GetIndex(handle);
+	if (removed < 0)
+		return;
+
+	unsigned int index = (unsigned int)removed;
+	unsigned int last = (unsigned int)lights.size() - 1;
+	if (index != last)
+	{
+		lights[index] = lights[last];
+		bounds[index] = bounds[last];
+		lightSlots[index] = lightSlots[last];
+		slots[lightSlots[index]].LightIndex = index;
+		MarkDirty(index);
+	}
+
+	// Anything past the end is never read, so the last place needn't upload
+	if (dirty[last])
+		dirtyList.erase(std::find(dirtyList.begin(), dirtyList.end(), last));
+	lights.pop_back();
+	bounds.pop_back();
+	lightSlots.pop_back();
+	dirty.pop_back();
+
+	slots[handle.Index].LightIndex = UINT_MAX;
+	slots[handle.Index].Generation++;
+	freeSlots.push_back(handle.Index);
+}
+
+void LightManager::Assign(const std::vector<Light>& newLights)
+{
+	for (unsigned int i = 0; i < (unsigned int)slots.size(); i++)
+	{
+		if (slots[i].LightIndex != UINT_MAX)
+		{
+			slots[i].LightIndex = UINT_MAX;
+			slots[i].Generation++;
+			freeSlots.push_back(i);
+		}
+	}
+
+	lights.clear();
+	bounds.clear();
+	lightSlots.clear();
+	dirty.clear();
+	dirtyList.clear();
+
+	lights.reserve(newLights.size());
+	for (const Light& light : newLights)
+		Add(light);
+}
+
+void LightManager::Swap(LightManager& other)
+{
+	std::swap(lights, other.lights);
+	std::swap(bounds, other.bounds);
+	std::swap(lightSlots, other.lightSlots);
+	std::swap(slots, other.slots);
+	std::swap(freeSlots, other.freeSlots);
+	std::swap(dirty, other.dirty);
+	std::swap(dirtyList, other.dirtyList);
+	MarkAllDirty();
+	other.MarkAllDirty();
+}
+
+bool LightManager::IsValid(LightHandle handle) const
+{
+	return GetIndex(handle) >= 0;
+}
+
+int LightManager::GetIndex(LightHandle handle) const
+{
+	if (handle.Index >= slots.size() || slots[handle.Index].Generation != handle.Generation)
+		return -1;
+
+	unsigned int index = slots[handle.Index].LightIndex;
+	return index == UINT_MAX ? -1 : (int)index;
+}
+
+LightHandle LightManager::GetHandle(unsigned int index) const
+{
+	if (index >= lights.size())
+		return {};
+
+	unsigned int slot = lightSlots[index];
+	return { slot, slots[slot].Generation };
+}
+
+void LightManager::Set(unsigned int index, const Light& light)
+{
+	lights[index] = light;
+	UpdateBounds(index);
+	MarkDirty(index);
+}
+
+void LightManager::SetPosition(unsigned int index, XMFLOAT3 position)
+{
+	lights[index].Position = position;
+	bounds[index].Center = position;
+	MarkDirty(index);
+}
+
+void LightManager::Set(LightHandle handle, const Light& light)
+{
+	int index = GetIndex(handle);
+	if (index >= 0)
+		Set((unsigned int)index, light);
+}
+
+void LightManager::SetPosition(LightHandle handle, XMFLOAT3 position)
+{
+	int index = GetIndex(handle);
+	if (index >= 0)
+		SetPosition((unsigned int)index, position);
+}
+
+Light& LightManager::Edit(unsigned int index)
+{
+	// The caller changes it after this, so its sphere's only
+	// worked out again once it's taken for uploading
+	MarkDirty(index);
+	return lights[index];
+}
+
+void LightManager::MarkAllDirty()
+{
+	for (unsigned int i = 0; i < (unsigned int)lights.size(); i++)
+		MarkDirty(i);
+}
+
+void LightManager::MarkDirty(unsigned int index)
+{
+	if (dirty[index])
+		return;
+
+	dirty[index] = 1;
+	dirtyList.push_back(index);
+}
+
+void LightManager::UpdateBounds(unsigned int index)
+{
+	const Light& light = lights[index];
+	bounds[index].Center = light.Position;
+	bounds[index].Radius = light.Type == LIGHT_TYPE_DIRECTIONAL ? FLT_MAX : light.Range;
+}
+
+// --------------------------------------------------------
+// Sorts the dirty lights below count and joins any that
+// are within the merge gap of each other
+// --------------------------------------------------------
+void LightManager::TakeDirtyRanges(unsigned int count, std::vector<LightRange>& ranges)
+{
+	ranges.clear();
+	if (dirtyList.empty())
+		return;
+
+	// The ones past the count stay listed, at the front, for later
+	auto taken = std::partition(dirtyList.begin(), dirtyList.end(), [count](unsigned int i) { return i >= count; });
+	std::sort(taken, dirtyList.end());
+	for (auto it = taken; it != dirtyList.end(); ++it)
+	{
+		unsigned int index = *it;
+		dirty[index] = 0;
+		UpdateBounds(index);
+
+		if (!ranges.empty() && index - (ranges.back().First + ranges.back().Count) <= LIGHT_UPLOAD_MERGE_GAP)
+			ranges.back().Count = index - ranges.back().First + 1;
+		else
+			ranges.push_back({ index, 1 });
+	}
+	dirtyList.erase(taken, dirtyList.end());
+}
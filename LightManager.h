@@ -0,0 +1,105 @@
+#pragma once
+
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <climits>
+#include <vector>
+
+#include "Lights.h"
+
+// Dirty lights closer together than this are uploaded as one range,
+// since copying a few clean ones costs less than another update call
+#define LIGHT_UPLOAD_MERGE_GAP	8
+
+// A light that stays the same light however others are added and
+// removed around it (which can move where it is in the array)
+struct LightHandle
+{
+	unsigned int Index = UINT_MAX;	// Of its slot, not its place in the array
+	unsigned int Generation = 0;
+	bool IsValid() const { return Index != UINT_MAX; }
+};
+
+// Lights [First, First + Count) of the array, which need uploading
+struct LightRange
+{
+	unsigned int First;
+	unsigned int Count;
+};
+
+// --------------------------------------------------------
+// Owns the scene's lights, as one packed array in the order
+// the GPU's light buffer has them, and remembers which ones
+// have changed since they were last uploaded
+//  - Anything that changes a light goes through here, which
+//    sets its dirty bit (and lists it, the first time), so
+//    finding them is never a pass over every light
+//  - Removing one moves the last into its place, so the
+//    array stays packed and only those two need uploading
+//  - Each light keeps a bounding sphere for culling, updated
+//    as it changes
+// --------------------------------------------------------
+class LightManager
+{
+public:
+	LightHandle Add(const Light& light);
+	void Remove(LightHandle handle);
+
+	// Replaces every light, which makes every existing handle stale
+	void Assign(const std::vector<Light>& newLights);
+	void Clear() { Assign(std::vector<Light>()); }
+
+	// Trades everything (handles included) with another manager, and
+	// marks both dirty, like swapping in a different scene's lights
+	void Swap(LightManager& other);
+
+	bool IsValid(LightHandle handle) const;
+	int GetIndex(LightHandle handle) const;	// -1 if it's stale
+	LightHandle GetHandle(unsigned int index) const;
+
+	unsigned int GetCount() const { return (unsigned int)lights.size(); }
+	const std::vector<Light>& GetLights() const { return lights; }
+	const Light& Get(unsigned int index) const { return lights[index]; }
+
+	// Changing a light, by where it is or by handle
+	void Set(unsigned int index, const Light& light);
+	void SetPosition(unsigned int index, DirectX::XMFLOAT3 position);
+	void Set(LightHandle handle, const Light& light);
+	void SetPosition(LightHandle handle, DirectX::XMFLOAT3 position);
+
+	// For editing a light in place (like in the UI) - it's marked
+	// dirty whether or not anything was actually changed
+	Light& Edit(unsigned int index);
+
+	// Everything must be uploaded again (like for a new light buffer)
+	void MarkAllDirty();
+
+	// Takes the dirty lights below count as merged ranges, in order,
+	// clearing their bits - the rest stay dirty until they're taken
+	void TakeDirtyRanges(unsigned int count, std::vector<LightRange>& ranges);
+	unsigned int GetDirtyCount() const { return (unsigned int)dirtyList.size(); }
+
+	// Spheres for each light (directional ones have an infinite radius)
+	//  - A light changed through Edit() has its sphere updated when
+	//    it's next taken, so these match what's uploaded
+	const std::vector<DirectX::BoundingSphere>& GetBounds() const { return bounds; }
+
+private:
+	std::vector<Light> lights;
+	std::vector<DirectX::BoundingSphere> bounds;
+	std::vector<unsigned int> lightSlots;	// The slot each light's handle points to
+
+	// Handles point at slots, which point into the array
+	struct Slot
+	{
+		unsigned int LightIndex;	// UINT_MAX when it's free
+		unsigned int Generation;
+	};
+	std::vector<Slot> slots;
+	std::vector<unsigned int> freeSlots;
+
+	std::vector<unsigned char> dirty;
+	std::vector<unsigned int> dirtyList;
+	void MarkDirty(unsigned int index);
+	void UpdateBounds(unsigned int index);
+};
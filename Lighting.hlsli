@@ -28,18 +28,23 @@ struct Light
 
 // === UTILITY FUNCTIONS ============================================
 
+// Rebuilds a tangent-space normal from just its x and y, since BC5
+// normal maps only keep two channels (z always faces out of the surface)
+float3 UnpackNormal(float2 packedNormal)
+{
+	float2 xy = packedNormal * 2.0f - 1.0f;
+	return float3(xy, sqrt(saturate(1.0f - dot(xy, xy))));
+}
+
 // Basic sample and unpack
 float3 SampleAndUnpackNormalMap(Texture2D map, SamplerState samp, float2 uv)
 {
-	return map.Sample(samp, uv).rgb * 2.0f - 1.0f;
+	return UnpackNormal(map.Sample(samp, uv).rg);
 }
 
-// Handle converting tangent-space normal map to world space normal
-float3 NormalMapping(Texture2D map, SamplerState samp, float2 uv, float3 normal, float3 tangent)
+// Handle converting an already unpacked tangent-space normal to world space
+float3 NormalMapping(float3 normalFromMap, float3 normal, float3 tangent)
 {
-	// Grab the normal from the map
-	float3 normalFromMap = SampleAndUnpackNormalMap(map, samp, uv);
-
 	// Gather the required vectors for converting the normal
 	float3 N = normal;
 	float3 T = normalize(tangent - N * dot(tangent, N));
@@ -52,6 +57,12 @@ float3 NormalMapping(Texture2D map, SamplerState samp, float2 uv, float3 normal,
 	return normalize(mul(normalFromMap, TBN));
 }
 
+// Handle converting tangent-space normal map to world space normal
+float3 NormalMapping(Texture2D map, SamplerState samp, float2 uv, float3 normal, float3 tangent)
+{
+	return NormalMapping(SampleAndUnpackNormalMap(map, samp, uv), normal, tangent);
+}
+
 // Range-based attenuation function
 float Attenuate(Light light, float3 worldPos)
 {
@@ -328,6 +339,45 @@ float3 IndirectDiffuse(TextureCube irrMap, SamplerState samp, float3 direction)
 
 }
 
+// The nine real L2 spherical harmonics basis functions
+//
+// n			- A normalized direction
+// basis		- Each function's value in that direction
+//
+void SHBasis(float3 n, out float basis[9])
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * n.y;
+	basis[2] = 0.488603f * n.z;
+	basis[3] = 0.488603f * n.x;
+	basis[4] = 1.092548f * n.x * n.y;
+	basis[5] = 1.092548f * n.y * n.z;
+	basis[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+	basis[7] = 1.092548f * n.x * n.z;
+	basis[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+}
+
+// Indirect diffuse irradiance from spherical harmonics
+//
+// Same result as IndirectDiffuse() (already linear), from the sky
+// projected into L2 spherical harmonics and convolved with the
+// cosine lobe, instead of a cube map fetch
+//
+// sh			- Convolved coefficients (rgb), see Sky::IBLComputeIrradianceSH()
+// direction	- Normalized direction to evaluate
+//
+float3 IndirectDiffuseSH(float4 sh[9], float3 direction)
+{
+	float basis[9];
+	SHBasis(direction, basis);
+
+	float3 irradiance = float3(0, 0, 0);
+	[unroll]
+	for (int i = 0; i < 9; i++)
+		irradiance += sh[i].rgb * basis[i];
+	return max(irradiance, 0);
+}
+
 
 // Indirect specular (environment reflections)
 //
@@ -349,7 +399,7 @@ float3 IndirectSpecular(TextureCube envMap, int mips, Texture2D brdfLookUp, Samp
 	roughness = max(roughness, MIN_ROUGHNESS);
 
 	// Calculate half of the split-sum approx (this texture is not gamma-corrected, as it just holds raw data)
-	float2 indirectBRDF = brdfLookUp.Sample(samp, float2(NdotV, roughness)).rg;
+	float2 indirectBRDF = brdfLookUp.SampleLevel(samp, float2(NdotV, roughness), 0).rg;
 	float3 indSpecFresnel = specColor * indirectBRDF.x + indirectBRDF.y; // Spec color is f0
 
 	// Sample the convolved environment map (other half of split-sum)
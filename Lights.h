@@ -1,10 +1,24 @@
 #pragma once
 
 #include <DirectXMath.h>
+#include <cstring>
+#include <vector>
 
-// This define should match your
-// MAX_LIGHTS definition in your shader(s)
-#define MAX_LIGHTS 128
+// The most lights a scene can have
+//  - Lights live in a structured buffer of this many, so it's
+//    only limited by memory (64 bytes per light)
+#define MAX_LIGHTS 32768
+
+// Clustered light culling - these should match
+// the definitions in LightClusters.hlsli
+#define CLUSTER_COUNT_X				16
+#define CLUSTER_COUNT_Y				9
+#define CLUSTER_COUNT_Z				24
+#define MAX_LIGHTS_PER_CLUSTER		128
+
+// Cascaded shadow map limit - should match
+// the definition in PerFrameData.hlsli
+#define MAX_SHADOW_CASCADES			4
 
 // Light types
 // Must match definitions in shader
@@ -25,5 +39,26 @@ struct Light
 
 	float				SpotFalloff;
 	int					CastsShadows;
-	DirectX::XMFLOAT3	Padding;	// 64 bytes
-};
\ No newline at end of file
+	DirectX::XMFLOAT2	Padding;	// 64 bytes
+};
+
+// Copies the range of lights that differ from the cache into it, giving
+// that range (inclusive), or false if none changed
+inline bool PackChangedLights(std::vector<Light>& cache, const Light* lights, int count, int& first, int& last)
+{
+	if ((int)cache.size() < count)
+		cache.resize(count, {});
+
+	first = 0;
+	while (first < count && memcmp(&cache[first], &lights[first], sizeof(Light)) == 0)
+		first++;
+	if (first == count)
+		return false;
+
+	last = count - 1;
+	while (last > first && memcmp(&cache[last], &lights[last], sizeof(Light)) == 0)
+		last--;
+
+	memcpy(&cache[first], &lights[first], sizeof(Light) * (last - first + 1));
+	return true;
+}
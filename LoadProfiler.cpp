@@ -0,0 +1,172 @@
+#include "LoadProfiler.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+// Singleton requirement
+LoadProfiler* LoadProfiler::instance;
+
+// Whichever thread makes it is the main thread
+LoadProfiler::LoadProfiler()
+	: start(std::chrono::high_resolution_clock::now()), recording(true)
+{
+	threads.insert({ std::this_thread::get_id(), 0 });
+}
+
+long long LoadProfiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void LoadProfiler::AddEvent(const char* category, const std::string& name, long long start, long long end)
+{
+	if (!recording.load())
+		return;
+
+	std::lock_guard<std::mutex> lock(eventMutex);
+	auto thread = threads.insert({ std::this_thread::get_id(), (unsigned int)threads.size() }).first;
+	events.push_back({ category, name, start, end - start, thread->second });
+}
+
+void LoadProfiler::Finish(std::string tracePath)
+{
+	if (!recording.exchange(false))
+		return;
+
+	// Nothing else can be added now, but a step could still be finishing
+	long long total = Now();
+	std::lock_guard<std::mutex> lock(eventMutex);
+
+	// Like the assets, relative to the exe rather than the working directory
+	char exePath[MAX_PATH] = {};
+	GetModuleFileNameA(0, exePath, MAX_PATH);
+	std::string exeDirectory = exePath;
+	tracePath = exeDirectory.substr(0, exeDirectory.find_last_of("\\/") + 1) + tracePath;
+
+	if (WriteTrace(tracePath))
+		printf("Wrote startup trace to %s\n", tracePath.c_str());
+	PrintSummary(total);
+}
+
+// --------------------------------------------------------
+// Writes every event as a complete ("X") event in Chrome's
+// trace event format, with each thread named
+// --------------------------------------------------------
+bool LoadProfiler::WriteTrace(const std::string& path)
+{
+	std::ofstream trace(path);
+	if (!trace.is_open())
+		return false;
+
+	// Paths are full of backslashes, which JSON has to escape
+	auto escape = [](const std::string& str)
+	{
+		std::string escaped;
+		for (char c : str)
+		{
+			if (c == '\\' || c == '"')
+				escaped += '\\';
+			escaped += (unsigned char)c < 0x20 ? ' ' : c;
+		}
+		return escaped;
+	};
+
+	trace << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	for (auto& t : threads)
+	{
+		std::string threadName = t.second == 0 ? "Main" : "Worker " + std::to_string(t.second);
+		trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t.second << ",\"args\":{\"name\":\"" << threadName << "\"}},\n";
+	}
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const LoadProfileEvent& e = events[i];
+		trace << "{\"name\":\"" << escape(e.Name) << "\",\"cat\":\"" << e.Category << "\",\"ph\":\"X\",\"ts\":" << e.Start
+			<< ",\"dur\":" << e.Duration << ",\"pid\":1,\"tid\":" << e.Thread << "}" << (i + 1 < events.size() ? ",\n" : "\n");
+	}
+	trace << "]}\n";
+	return true;
+}
+
+// --------------------------------------------------------
+// Time spent in each kind of step (across every thread, so
+// it can add up to more than the startup took), slowest
+// first, then the slowest steps on their own
+// --------------------------------------------------------
+void LoadProfiler::PrintSummary(long long totalMicroseconds)
+{
+	struct CategoryTotal
+	{
+		const char* Category;
+		long long Total;
+		long long Max;
+		unsigned int Count;
+	};
+	std::vector<CategoryTotal> totals;
+	for (auto& e : events)
+	{
+		auto it = std::find_if(totals.begin(), totals.end(), [&](const CategoryTotal& t) { return std::string(t.Category) == e.Category; });
+		if (it == totals.end())
+		{
+			totals.push_back({ e.Category, 0, 0, 0 });
+			it = totals.end() - 1;
+		}
+		it->Total += e.Duration;
+		it->Max = (std::max)(it->Max, e.Duration);
+		it->Count++;
+	}
+	std::sort(totals.begin(), totals.end(), [](const CategoryTotal& a, const CategoryTotal& b) { return a.Total > b.Total; });
+
+	printf("Startup took %.2f ms\n", totalMicroseconds / 1000.0);
+	printf(" %-16s %10s %6s %10s\n", "Step", "Total ms", "Count", "Max ms");
+	for (auto& t : totals)
+		printf(" %-16s %10.2f %6u %10.2f\n", t.Category, t.Total / 1000.0, t.Count, t.Max / 1000.0);
+
+	std::vector<const LoadProfileEvent*> slowest;
+	for (auto& e : events)
+		slowest.push_back(&e);
+	std::sort(slowest.begin(), slowest.end(), [](const LoadProfileEvent* a, const LoadProfileEvent* b) { return a->Duration > b->Duration; });
+	slowest.resize((std::min)(slowest.size(), (size_t)LOAD_PROFILER_SLOWEST));
+
+	printf(" Slowest:\n");
+	for (auto e : slowest)
+		printf("  %10.2f ms  %-12s %s\n", e->Duration / 1000.0, e->Category, e->Name.c_str());
+}
+
+
+
+LoadProfileScope::LoadProfileScope(const char* category, const std::string& name)
+	: category(category), start(0)
+{
+	LoadProfiler& profiler = LoadProfiler::GetInstance();
+	recording = profiler.IsRecording();
+	if (!recording)
+		return;
+
+	this->name = name;
+	start = profiler.Now();
+}
+
+// Shader names are wide, but only ever plain ASCII
+LoadProfileScope::LoadProfileScope(const char* category, const std::wstring& name)
+	: category(category), start(0)
+{
+	LoadProfiler& profiler = LoadProfiler::GetInstance();
+	recording = profiler.IsRecording();
+	if (!recording)
+		return;
+
+	for (wchar_t c : name)
+		this->name += c < 0x80 ? (char)c : '?';
+	start = profiler.Now();
+}
+
+LoadProfileScope::~LoadProfileScope()
+{
+	if (!recording)
+		return;
+
+	LoadProfiler& profiler = LoadProfiler::GetInstance();
+	profiler.AddEvent(category, name, start, profiler.Now());
+}
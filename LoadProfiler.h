@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Written next to the exe once startup's done, and opened with
+// chrome://tracing (or ui.perfetto.dev) to see every load on a timeline
+#define LOAD_PROFILER_TRACE_FILE	"StartupTrace.json"
+
+// How many of the slowest single steps the summary lists
+#define LOAD_PROFILER_SLOWEST		10
+
+// One timed step, in microseconds since the profiler started
+struct LoadProfileEvent
+{
+	const char* Category;	// What kind of step, e.g. "Read" or "GPU Create"
+	std::string Name;		// What it was done to, e.g. an asset's name
+	long long Start;
+	long long Duration;
+	unsigned int Thread;
+};
+
+// --------------------------------------------------------
+// Times each step of loading during startup, from any
+// thread, then writes them all out as a Chrome trace and
+// prints a summary of where the time went
+//  - Nothing's recorded once Finish() has been called, so
+//    loads after startup cost next to nothing
+// --------------------------------------------------------
+class LoadProfiler
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static LoadProfiler& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new LoadProfiler();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	LoadProfiler(LoadProfiler const&) = delete;
+	void operator=(LoadProfiler const&) = delete;
+
+private:
+	static LoadProfiler* instance;
+	LoadProfiler();
+#pragma endregion
+
+public:
+	bool IsRecording() { return recording.load(); }
+
+	// Microseconds since the profiler was first used
+	long long Now();
+	void AddEvent(const char* category, const std::string& name, long long start, long long end);
+
+	// Stops recording, then writes the trace (relative to the exe)
+	// and prints the summary
+	void Finish(std::string tracePath = LOAD_PROFILER_TRACE_FILE);
+
+private:
+	std::chrono::high_resolution_clock::time_point start;
+	std::atomic<bool> recording;
+
+	std::mutex eventMutex;
+	std::vector<LoadProfileEvent> events;
+	std::unordered_map<std::thread::id, unsigned int> threads;	// Numbered as they're seen, so the main thread's first
+
+	bool WriteTrace(const std::string& path);
+	void PrintSummary(long long totalMicroseconds);
+};
+
+// --------------------------------------------------------
+// Times from here to the end of the scope, if the profiler
+// is still recording
+// --------------------------------------------------------
+class LoadProfileScope
+{
+public:
+	LoadProfileScope(const char* category, const std::string& name);
+	LoadProfileScope(const char* category, const std::wstring& name);
+	~LoadProfileScope();
+
+private:
+	const char* category;
+	std::string name;
+	long long start;
+	bool recording;
+};
@@ -21,9 +21,9 @@ int WINAPI WinMain(
 	_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
-	// Create the Game object using
-	// the app handle we got from WinMain
-	Game dxGame(hInstance);
+	// Create the Game object using the app handle we got
+	// from WinMain, and any benchmark run asked for
+	Game dxGame(hInstance, ScriptedBenchmarkOptions::Parse(lpCmdLine));
 
 	// Result variable for function calls below
 	HRESULT hr = S_OK;
@@ -1,4 +1,8 @@
 #include "Material.h"
+#include "AssetLoader.h"
+#include "MaterialAtlas.h"
+
+#include <algorithm>
 
 
 
@@ -11,9 +15,15 @@ Material::Material(
 {
 	this->vs = vs;
 	this->ps = ps;
+	this->basePS = ps;
+	this->gbufferPS = 0;
+	this->features = 0;
+	this->atlas = 0;
+	this->atlasIndex = 0;
 	this->color = color;
 	this->shininess = shininess;
 	this->uvScale = uvScale;
+	this->gbufferPS = FindGBufferPermutation(ps);
 }
 
 
@@ -24,69 +34,273 @@ Material::~Material()
 void Material::PrepareMaterial(Transform* transform, Camera* cam)
 {
 	// Turn shaders on
-	vs->SetShader();
-	ps->SetShader();
+	SetShaders();
 
 	// Set vertex shader data
-	vs->SetMatrix4x4("world", transform->GetWorldMatrix());
-	vs->SetMatrix4x4("worldInverseTranspose", transform->GetWorldInverseTransposeMatrix());
-	vs->SetMatrix4x4("view", cam->GetView());
-	vs->SetMatrix4x4("projection", cam->GetProjection());
-	vs->SetFloat2("uvScale", uvScale);
-	vs->CopyAllBufferData();
+	//  - Camera data is shared per frame by the renderer
+	SetPerObjectData(transform);
 
-	// Set pixel shader data
-	ps->SetFloat4("Color", color);
-	ps->SetFloat("Shininess", shininess);
-	ps->CopyBufferData("perMaterial");
+	// Set pixel shader data and any other resources
+	SetPerMaterialDataAndResources();
+}
 
-	// Loop and set any other resources
-	for (auto t : psTextureSRVs) { ps->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto t : vsTextureSRVs) { vs->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto s : psSamplers) { ps->SetSamplerState(s.first.c_str(), s.second); }
-	for (auto s : vsSamplers) { vs->SetSamplerState(s.first.c_str(), s.second); }
+void Material::SetShaders()
+{
+	vs->SetShader();
+	ps->SetShader();
 }
 
-void Material::SetPerMaterialDataAndResources(bool copyToGPUNow)
+void Material::SetPerMaterialDataAndResources(bool copyToGPUNow, SimplePixelShader* targetPS)
 {
+	SimplePixelShader* target = targetPS ? targetPS : ps;
+
 	// Set vertex shader per-material vars
-	vs->SetFloat2("uvScale", uvScale);
+	vs->SetFloat2("uvScale"_sn, GetVertexUVScale());
 	if (copyToGPUNow)
 	{
-		vs->CopyBufferData("perMaterial");
+		vs->CopyBufferData("perMaterial"_sn);
 	}
 
-	// Set pixel shader per-material vars
-	ps->SetFloat4("Color", color);
-	ps->SetFloat("Shininess", shininess);
-	if (copyToGPUNow)
+	// Set pixel shader per-material vars (which an atlas
+	// keeps in its material buffer instead)
+	if (!atlas)
+	{
+		target->SetFloat4("Color"_sn, color);
+		target->SetFloat("Shininess"_sn, shininess);
+		if (copyToGPUNow)
+		{
+			target->CopyBufferData("perMaterial"_sn);
+		}
+	}
+
+	// Bind the baked resources, a run of registers at a time
+	//  - Permutations share the full shader's registers
+	for (auto& r : psBindings.SRVRanges) { ps->SetShaderResourceViews(r.StartSlot, r.Count, &psBindings.SRVs[r.First]); }
+	for (auto& r : vsBindings.SRVRanges) { vs->SetShaderResourceViews(r.StartSlot, r.Count, &vsBindings.SRVs[r.First]); }
+	for (auto& r : psBindings.SamplerRanges) { ps->SetSamplerStates(r.StartSlot, r.Count, &psBindings.Samplers[r.First]); }
+	for (auto& r : vsBindings.SamplerRanges) { vs->SetSamplerStates(r.StartSlot, r.Count, &vsBindings.Samplers[r.First]); }
+}
+
+void Material::SetPerObjectData(Transform* transform, SimpleVertexShader* targetVS, unsigned int lightList)
+{
+	SimpleVertexShader* target = targetVS ? targetVS : vs;
+
+	VSPerObjectData data = {};
+	data.World = transform->GetWorldMatrix();
+	data.WorldInverseTranspose = transform->GetWorldInverseTransposeMatrix();
+	data.PrevWorld = transform->GetPrevWorldMatrix();
+	data.UVScale = GetVertexUVScale();
+	data.MaterialIndex = atlasIndex;
+	data.LightList = lightList;
+	target->WriteBuffer("perObject"_sn, data, VSPerObjectDataLayout);
+	target->CopyBufferData("perObject"_sn);
+}
+
+void Material::SetPS(SimplePixelShader* ps)
+{
+	basePS = ps;
+	SelectPermutation();
+}
+
+// Permutations are picked again (by name) if it was any pixel shader,
+// since they'll have been reloaded too if they changed
+void Material::ReplaceShader(ISimpleShader* before, ISimpleShader* after)
+{
+	if (vs == before)
+		SetVS((SimpleVertexShader*)after);
+
+	bool pixelShader = basePS == before || ps == before || gbufferPS == before;
+	if (basePS == before)
+		basePS = (SimplePixelShader*)after;
+	if (pixelShader)
+		SelectPermutation();
+}
+
+void Material::SetFeatures(unsigned int features)
+{
+	this->features = features;
+	SelectPermutation();
+}
+
+void Material::SetAtlas(MaterialAtlas* atlas, unsigned int index)
+{
+	this->atlas = atlas;
+	this->atlasIndex = atlas ? index : 0;
+	SelectPermutation();
+}
+
+// --------------------------------------------------------
+// Swaps in the pixel shader permutation that matches this
+// material's features, by name from the assets
+// --------------------------------------------------------
+void Material::SelectPermutation()
+{
+	// The atlas has its own shader
+	if (atlas)
+	{
+		ps = atlas->GetPixelShader();
+		gbufferPS = FindGBufferPermutation(ps);
+		BakeBindings();
+		return;
+	}
+
+	ps = basePS;
+	gbufferPS = FindGBufferPermutation(basePS);
+
+	std::string name = Assets::GetInstance().GetPixelShaderName(basePS);
+	if (features != 0 && name.size() > 4)
 	{
-		ps->CopyBufferData("perMaterial");
+		// Swap "Shader.cso" for "Shader_Suffix.cso"
+		name = name.substr(0, name.size() - 4);
+		if (features & MATERIAL_FEATURE_NO_SHADOWS) name += "_NoShadows";
+		if (features & MATERIAL_FEATURE_DIRECTIONAL_ONLY) name += "_DirectionalOnly";
+		if (features & MATERIAL_FEATURE_FIXED_LIGHTS) name += "_FixedLights";
+		name += ".cso";
+
+		SimplePixelShader* permutation = Assets::GetInstance().GetPixelShader(name);
+		if (permutation)
+			ps = permutation;
+	}
+
+	BakeBindings();
+}
+
+// --------------------------------------------------------
+// The "Shader_GBuffer.cso" for a "Shader.cso", if it was built
+// --------------------------------------------------------
+SimplePixelShader* Material::FindGBufferPermutation(SimplePixelShader* shader)
+{
+	std::string name = Assets::GetInstance().GetPixelShaderName(shader);
+	if (name.size() <= 4)
+		return 0;
+
+	return Assets::GetInstance().GetPixelShader(name.substr(0, name.size() - 4) + MATERIAL_GBUFFER_SUFFIX + ".cso");
+}
+
+// --------------------------------------------------------
+// Sorts resources by register and splits them into runs
+// of consecutive registers
+//
+// bound - (register, resource) pairs, sorted in place
+// pointers - Filled with the resources in register order
+// ranges - Filled with the runs
+// --------------------------------------------------------
+template<typename T>
+static void BuildRanges(std::vector<std::pair<unsigned int, T*>>& bound, std::vector<T*>& pointers, std::vector<MaterialBindingRange>& ranges)
+{
+	std::sort(bound.begin(), bound.end(),
+		[](const std::pair<unsigned int, T*>& a, const std::pair<unsigned int, T*>& b) { return a.first < b.first; });
+
+	for (size_t i = 0; i < bound.size(); i++)
+	{
+		// Two resources for one register can only bind the last
+		if (i > 0 && bound[i].first == bound[i - 1].first)
+		{
+			pointers.back() = bound[i].second;
+			continue;
+		}
+
+		// Continue the current run, or start a new one
+		if (!ranges.empty() && bound[i].first == ranges.back().StartSlot + ranges.back().Count)
+			ranges.back().Count++;
+		else
+			ranges.push_back({ bound[i].first, 1, (unsigned int)pointers.size() });
+
+		pointers.push_back(bound[i].second);
+	}
+}
+
+// --------------------------------------------------------
+// Finds the register of every resource in the current
+// shaders and bakes them into binding tables, whenever
+// the resources or the shaders change
+//  - Resources the shaders don't use are left out
+// --------------------------------------------------------
+void Material::BakeBindings()
+{
+	psBindings.Clear();
+	vsBindings.Clear();
+
+	std::vector<std::pair<unsigned int, ID3D11ShaderResourceView*>> srvs;
+	std::vector<std::pair<unsigned int, ID3D11SamplerState*>> samplers;
+
+	// Pixel shader, which uses the atlas's resources in place of its own textures
+	if (atlas)
+	{
+		for (int s = 0; s < MATERIAL_ATLAS_TEXTURE_COUNT; s++)
+		{
+			const SimpleSRV* info = ps->GetShaderResourceViewInfo(MaterialAtlas::ArrayNames[s]);
+			if (info) srvs.push_back({ info->BindIndex, atlas->GetTextureArray(s).Get() });
+		}
+
+		const SimpleSRV* info = ps->GetShaderResourceViewInfo("AtlasMaterials");
+		if (info) srvs.push_back({ info->BindIndex, atlas->GetMaterialBuffer().Get() });
+	}
+	else
+	{
+		for (auto& t : psTextureSRVs)
+		{
+			const SimpleSRV* info = ps->GetShaderResourceViewInfo(t.first);
+			if (info) srvs.push_back({ info->BindIndex, t.second.Get() });
+		}
+	}
+	for (auto& s : psSamplers)
+	{
+		const SimpleSampler* info = ps->GetSamplerInfo(s.first);
+		if (info) samplers.push_back({ info->BindIndex, s.second.Get() });
+	}
+	BuildRanges(srvs, psBindings.SRVs, psBindings.SRVRanges);
+	BuildRanges(samplers, psBindings.Samplers, psBindings.SamplerRanges);
+
+	// Vertex shader
+	srvs.clear();
+	samplers.clear();
+	for (auto& t : vsTextureSRVs)
+	{
+		const SimpleSRV* info = vs->GetShaderResourceViewInfo(t.first);
+		if (info) srvs.push_back({ info->BindIndex, t.second.Get() });
 	}
+	for (auto& s : vsSamplers)
+	{
+		const SimpleSampler* info = vs->GetSamplerInfo(s.first);
+		if (info) samplers.push_back({ info->BindIndex, s.second.Get() });
+	}
+	BuildRanges(srvs, vsBindings.SRVs, vsBindings.SRVRanges);
+	BuildRanges(samplers, vsBindings.Samplers, vsBindings.SamplerRanges);
+}
 
-	// Loop and set any other resources
-	for (auto t : psTextureSRVs) { ps->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto t : vsTextureSRVs) { vs->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto s : psSamplers) { ps->SetSamplerState(s.first.c_str(), s.second); }
-	for (auto s : vsSamplers) { vs->SetSamplerState(s.first.c_str(), s.second); }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Material::GetPSTextureSRV(std::string shaderName)
+{
+	auto it = psTextureSRVs.find(shaderName);
+	return it == psTextureSRVs.end() ? nullptr : it->second;
 }
 
 void Material::AddPSTextureSRV(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	psTextureSRVs.insert({ shaderName, srv });
+	BakeBindings();
+}
+
+void Material::SetPSTextureSRV(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	psTextureSRVs[shaderName] = srv;
+	BakeBindings();
 }
 
 void Material::AddVSTextureSRV(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	vsTextureSRVs.insert({ shaderName, srv });
+	BakeBindings();
 }
 
 void Material::AddPSSampler(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
 {
 	psSamplers.insert({ shaderName, sampler });
+	BakeBindings();
 }
 
 void Material::AddVSSampler(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
 {
 	vsSamplers.insert({ shaderName, sampler });
+	BakeBindings();
 }
\ No newline at end of file
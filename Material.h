@@ -4,10 +4,77 @@
 #include <DirectXMath.h>
 #include <wrl/client.h>
 #include <unordered_map>
+#include <vector>
 
 #include "SimpleShader.h"
 #include "Camera.h"
 #include "Lights.h"
+#include "EntityLightLists.h"
+
+// Features a material can do without, each of which selects a
+// pixel shader permutation compiled with that path removed
+//  - Permutations are loaded like any other shader, and named
+//    "<shader>_<suffix>.cso" with suffixes in bit order
+//  - Should match ShaderFeatures.hlsli
+#define MATERIAL_FEATURE_NO_SHADOWS			0x1	// _NoShadows
+#define MATERIAL_FEATURE_DIRECTIONAL_ONLY	0x2	// _DirectionalOnly
+#define MATERIAL_FEATURE_FIXED_LIGHTS		0x4	// _FixedLights
+
+// Suffix of the permutation that writes the deferred G-buffer
+// instead of lighting, which ignores the features above
+#define MATERIAL_GBUFFER_SUFFIX				"_GBuffer"
+
+// Per object vertex shader data
+//  - Must match the perObject cbuffer in VertexShader.hlsl
+struct VSPerObjectData
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+	DirectX::XMFLOAT4X4 PrevWorld;	// Last frame's, for motion vectors
+	DirectX::XMFLOAT2 UVScale;
+	unsigned int MaterialIndex;
+	unsigned int LightList;
+};
+
+static const SimpleBufferField VSPerObjectDataLayout[] =
+{
+	SIMPLE_BUFFER_FIELD(VSPerObjectData, World, "world"),
+	SIMPLE_BUFFER_FIELD(VSPerObjectData, WorldInverseTranspose, "worldInverseTranspose"),
+	SIMPLE_BUFFER_FIELD(VSPerObjectData, PrevWorld, "prevWorld"),
+	SIMPLE_BUFFER_FIELD(VSPerObjectData, UVScale, "uvScale"),
+	SIMPLE_BUFFER_FIELD(VSPerObjectData, MaterialIndex, "materialIndex"),
+	SIMPLE_BUFFER_FIELD(VSPerObjectData, LightList, "lightList"),
+};
+
+class MaterialAtlas;
+
+// A run of consecutive registers in a material's binding
+// table, bound with a single call
+struct MaterialBindingRange
+{
+	unsigned int StartSlot;
+	unsigned int Count;
+	unsigned int First; // Index of the first pointer for this run
+};
+
+// Every resource a material binds to one shader stage, baked
+// into raw pointers ordered by register
+//  - The pointers are owned by the material's named maps
+struct MaterialStageBindings
+{
+	std::vector<ID3D11ShaderResourceView*> SRVs;
+	std::vector<MaterialBindingRange> SRVRanges;
+	std::vector<ID3D11SamplerState*> Samplers;
+	std::vector<MaterialBindingRange> SamplerRanges;
+
+	void Clear()
+	{
+		SRVs.clear();
+		SRVRanges.clear();
+		Samplers.clear();
+		SamplerRanges.clear();
+	}
+};
 
 class Material
 {
@@ -21,15 +88,57 @@ public:
 	~Material();
 
 	void PrepareMaterial(Transform* transform, Camera* cam);
-	void SetPerMaterialDataAndResources(bool copyToGPUNow = true);
+	void SetShaders();
+	// Writes to the given pixel shader instead of the material's own,
+	// like its G-buffer permutation
+	void SetPerMaterialDataAndResources(bool copyToGPUNow = true, SimplePixelShader* targetPS = 0);
+	// Writes to the given vertex shader instead of the material's own,
+	// like a permutation of it chosen for the mesh being drawn
+	//  - lightList is the entity's list in EntityLightLists, if it has one
+	void SetPerObjectData(Transform* transform, SimpleVertexShader* targetVS = 0, unsigned int lightList = ENTITY_LIGHT_LIST_NONE);
 
 	SimpleVertexShader* GetVS() { return vs; }
 	SimplePixelShader* GetPS() { return ps; }
+	// The G-buffer permutation of the base (or atlas) shader, or
+	// null if it wasn't built, so the material has to be forward shaded
+	SimplePixelShader* GetGBufferPS() { return gbufferPS; }
+	DirectX::XMFLOAT2 GetUVScale() { return uvScale; }
+	DirectX::XMFLOAT4 GetColor() { return color; }
+
+	// The uv scale for the vertex shader, which is left to
+	// the pixel shader while using an atlas
+	DirectX::XMFLOAT2 GetVertexUVScale() { return atlas ? DirectX::XMFLOAT2(1, 1) : uvScale; }
+
+	void SetVS(SimpleVertexShader* vs) { this->vs = vs; BakeBindings(); }
+	void SetPS(SimplePixelShader* ps);
+
+	// Swaps a shader that was reloaded (see Assets::AddReloadListener())
+	// for its new version, wherever this material uses it
+	void ReplaceShader(ISimpleShader* before, ISimpleShader* after);
 
-	void SetVS(SimpleVertexShader* vs) { this->vs = vs; }
-	void SetPS(SimplePixelShader* ps) { this->ps = ps; }
+	// Picks the permutation of the pixel shader given to the constructor
+	// or SetPS() with these MATERIAL_FEATURE_ bits, falling back to the
+	// full shader if that permutation wasn't built
+	void SetFeatures(unsigned int features);
+	unsigned int GetFeatures() { return features; }
 
+	// Draws with an atlas's pixel shader and texture arrays, as the given
+	// material in it, instead of this material's own (null to stop)
+	//  - Features are ignored while using an atlas
+	void SetAtlas(MaterialAtlas* atlas, unsigned int index);
+	MaterialAtlas* GetAtlas() { return atlas; }
+	unsigned int GetAtlasIndex() { return atlasIndex; }
+
+	// Materials with the same binding key bind exactly the same resources
+	// (which is true of every material using the same atlas)
+	const void* GetBindingKey() { return atlas ? (const void*)atlas : (const void*)this; }
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetPSTextureSRV(std::string shaderName);
+	const std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>& GetPSTextureSRVs() { return psTextureSRVs; }
 	void AddPSTextureSRV(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	// Replaces a texture that was already added (like a streamed
+	// one's placeholder), or adds it if it wasn't
+	void SetPSTextureSRV(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	void AddVSTextureSRV(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	void AddPSSampler(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
 	void AddVSSampler(std::string shaderName, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
@@ -37,6 +146,14 @@ public:
 private:
 	SimpleVertexShader* vs;
 	SimplePixelShader* ps;
+	SimplePixelShader* basePS;
+	SimplePixelShader* gbufferPS;
+	unsigned int features;
+	void SelectPermutation();
+	static SimplePixelShader* FindGBufferPermutation(SimplePixelShader* shader);
+
+	MaterialAtlas* atlas;
+	unsigned int atlasIndex;
 
 	DirectX::XMFLOAT2 uvScale;
 	DirectX::XMFLOAT4 color;
@@ -46,4 +163,11 @@ private:
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> vsTextureSRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> psSamplers;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> vsSamplers;
+
+	// The same resources resolved to registers in the current shaders,
+	// whenever the resources or the shaders change, so binding them
+	// is a call per run of registers with no lookups or ref counting
+	MaterialStageBindings psBindings;
+	MaterialStageBindings vsBindings;
+	void BakeBindings();
 };
\ No newline at end of file
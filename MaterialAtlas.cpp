@@ -0,0 +1,217 @@
+#include "MaterialAtlas.h"
+#include "Material.h"
+#include "GpuMemory.h"
+
+using namespace DirectX;
+
+const char* MaterialAtlas::TextureNames[MATERIAL_ATLAS_TEXTURE_COUNT] = { "AlbedoTexture", "NormalTexture", "RoughnessTexture", "MetalTexture" };
+const char* MaterialAtlas::ArrayNames[MATERIAL_ATLAS_TEXTURE_COUNT] = { "AlbedoArray", "NormalArray", "RoughnessArray", "MetalArray" };
+
+// The 2D texture behind an SRV, if that's what it is
+static Microsoft::WRL::ComPtr<ID3D11Texture2D> GetTexture2D(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	if (!srv)
+		return texture;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	srv->GetDesc(&viewDesc);
+	if (viewDesc.ViewDimension != D3D11_SRV_DIMENSION_TEXTURE2D)
+		return texture;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	srv->GetResource(resource.GetAddressOf());
+	resource.As(&texture);
+	return texture;
+}
+
+// Whether two textures can be slices of the same array
+static bool SameLayout(const D3D11_TEXTURE2D_DESC& a, const D3D11_TEXTURE2D_DESC& b)
+{
+	return
+		a.Width == b.Width &&
+		a.Height == b.Height &&
+		a.MipLevels == b.MipLevels &&
+		a.Format == b.Format &&
+		a.ArraySize == 1 && b.ArraySize == 1 &&
+		a.SampleDesc.Count == 1 && b.SampleDesc.Count == 1;
+}
+
+
+MaterialAtlas::MaterialAtlas(SimplePixelShader* ps, const std::vector<Material*>& materials)
+	: ps(ps), materials(materials), enabled(false)
+{
+}
+
+MaterialAtlas::~MaterialAtlas()
+{
+}
+
+// --------------------------------------------------------------------------
+// Finds the materials that have every atlas texture, groups the ones
+// whose textures match slot for slot, and builds an atlas per group
+// --------------------------------------------------------------------------
+std::vector<MaterialAtlas*> MaterialAtlas::Build(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	const std::vector<Material*>& materials,
+	SimplePixelShader* ps)
+{
+	std::vector<MaterialAtlas*> atlases;
+	if (!ps)
+		return atlases;
+
+	// Each usable material's texture layout
+	struct Candidate
+	{
+		Material* Source;
+		D3D11_TEXTURE2D_DESC Descs[MATERIAL_ATLAS_TEXTURE_COUNT];
+	};
+	std::vector<Candidate> candidates;
+
+	for (Material* material : materials)
+	{
+		Candidate candidate = {};
+		candidate.Source = material;
+
+		bool usable = true;
+		for (int s = 0; s < MATERIAL_ATLAS_TEXTURE_COUNT && usable; s++)
+		{
+			Microsoft::WRL::ComPtr<ID3D11Texture2D> texture = GetTexture2D(material->GetPSTextureSRV(TextureNames[s]));
+			if (texture)
+				texture->GetDesc(&candidate.Descs[s]);
+			else
+				usable = false;
+		}
+
+		if (usable)
+			candidates.push_back(candidate);
+	}
+
+	// Group them, keeping their original order
+	std::vector<bool> grouped(candidates.size(), false);
+	for (size_t i = 0; i < candidates.size(); i++)
+	{
+		if (grouped[i])
+			continue;
+
+		std::vector<Material*> group = { candidates[i].Source };
+		for (size_t j = i + 1; j < candidates.size(); j++)
+		{
+			if (grouped[j])
+				continue;
+
+			bool matches = true;
+			for (int s = 0; s < MATERIAL_ATLAS_TEXTURE_COUNT && matches; s++)
+				matches = SameLayout(candidates[i].Descs[s], candidates[j].Descs[s]);
+
+			if (matches)
+			{
+				group.push_back(candidates[j].Source);
+				grouped[j] = true;
+			}
+		}
+
+		// A single material gains nothing from an atlas
+		if (group.size() < 2)
+			continue;
+
+		MaterialAtlas* atlas = new MaterialAtlas(ps, group);
+		if (atlas->Create(device, context))
+			atlases.push_back(atlas);
+		else
+			delete atlas;
+	}
+
+	return atlases;
+}
+
+// --------------------------------------------------------------------------
+// Copies every material's textures into the arrays (all mips of each),
+// and their colors and uv scales into the material buffer
+//  - This is a snapshot, so changing a material afterwards doesn't
+//    change what it looks like while the atlas is enabled
+// --------------------------------------------------------------------------
+bool MaterialAtlas::Create(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	unsigned int count = (unsigned int)materials.size();
+
+	for (int s = 0; s < MATERIAL_ATLAS_TEXTURE_COUNT; s++)
+	{
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> firstSRV = materials[0]->GetPSTextureSRV(TextureNames[s]);
+
+		D3D11_TEXTURE2D_DESC desc = {};
+		GetTexture2D(firstSRV)->GetDesc(&desc);
+		desc.ArraySize = count;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = 0;
+		desc.MiscFlags = 0;
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> textureArray;
+		if (FAILED(GpuMemory::CreateTexture2D(device.Get(), &desc, 0, textureArray.GetAddressOf(), GpuMemoryCategory::Textures, "Material Atlas")))
+			return false;
+
+		for (unsigned int m = 0; m < count; m++)
+		{
+			Microsoft::WRL::ComPtr<ID3D11Texture2D> texture = GetTexture2D(materials[m]->GetPSTextureSRV(TextureNames[s]));
+			for (unsigned int mip = 0; mip < desc.MipLevels; mip++)
+			{
+				context->CopySubresourceRegion(
+					textureArray.Get(), D3D11CalcSubresource(mip, m, desc.MipLevels), 0, 0, 0,
+					texture.Get(), D3D11CalcSubresource(mip, 0, desc.MipLevels), 0);
+			}
+		}
+
+		// View it the same way the original textures were viewed
+		D3D11_SHADER_RESOURCE_VIEW_DESC firstViewDesc = {};
+		firstSRV->GetDesc(&firstViewDesc);
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = firstViewDesc.Format;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.MipLevels = desc.MipLevels;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = count;
+		if (FAILED(device->CreateShaderResourceView(textureArray.Get(), &srvDesc, textureArrays[s].GetAddressOf())))
+			return false;
+	}
+
+	// Everything else about each material
+	std::vector<AtlasMaterialData> data(count);
+	for (unsigned int m = 0; m < count; m++)
+	{
+		data[m].Color = materials[m]->GetColor();
+		data[m].UVScale = materials[m]->GetUVScale();
+		data[m].Padding = XMFLOAT2(0, 0);
+	}
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.ByteWidth = sizeof(AtlasMaterialData) * count;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = sizeof(AtlasMaterialData);
+	bufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = data.data();
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	if (FAILED(GpuMemory::CreateBuffer(device.Get(), &bufferDesc, &initialData, buffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Material Atlas Params")))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC bufferSRVDesc = {};
+	bufferSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	bufferSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	bufferSRVDesc.Buffer.FirstElement = 0;
+	bufferSRVDesc.Buffer.NumElements = count;
+	return SUCCEEDED(device->CreateShaderResourceView(buffer.Get(), &bufferSRVDesc, materialBuffer.GetAddressOf()));
+}
+
+void MaterialAtlas::SetEnabled(bool enabled)
+{
+	this->enabled = enabled;
+	for (unsigned int m = 0; m < materials.size(); m++)
+		materials[m]->SetAtlas(enabled ? this : 0, m);
+}
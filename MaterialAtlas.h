@@ -0,0 +1,68 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "SimpleShader.h"
+
+class Material;
+
+// Texture slots packed into arrays, in the order they're
+// declared in PixelShaderPBR.hlsl
+#define MATERIAL_ATLAS_TEXTURE_COUNT 4
+
+// Per material data in the atlas's structured buffer
+//  - Must match AtlasMaterial in PixelShaderPBR.hlsl
+struct AtlasMaterialData
+{
+	DirectX::XMFLOAT4 Color;
+	DirectX::XMFLOAT2 UVScale;
+	DirectX::XMFLOAT2 Padding;
+};
+
+// Materials whose textures are all the same size and format, packed
+// into one texture array per slot, with everything else about each
+// material in a structured buffer
+//  - Materials using an atlas only differ by their index into it, so
+//    they bind exactly the same things and can be instanced together
+class MaterialAtlas
+{
+public:
+	~MaterialAtlas();
+
+	// Groups the materials by the size and format of their textures,
+	// and builds an atlas for each group of at least two materials
+	//  - ps is the atlas version of the materials' pixel shader
+	//  - Materials are left as they are until an atlas is enabled
+	static std::vector<MaterialAtlas*> Build(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		const std::vector<Material*>& materials,
+		SimplePixelShader* ps);
+
+	// Switches all of this atlas's materials over to it (or back)
+	void SetEnabled(bool enabled);
+	bool GetEnabled() { return enabled; }
+
+	SimplePixelShader* GetPixelShader() { return ps; }
+	const std::vector<Material*>& GetMaterials() { return materials; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetTextureArray(unsigned int slot) { return textureArrays[slot]; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetMaterialBuffer() { return materialBuffer; }
+
+	// Each slot's name in the regular shader, and in the atlas shader
+	static const char* TextureNames[MATERIAL_ATLAS_TEXTURE_COUNT];
+	static const char* ArrayNames[MATERIAL_ATLAS_TEXTURE_COUNT];
+
+private:
+	MaterialAtlas(SimplePixelShader* ps, const std::vector<Material*>& materials);
+	bool Create(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	SimplePixelShader* ps;
+	std::vector<Material*> materials;
+	bool enabled;
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> textureArrays[MATERIAL_ATLAS_TEXTURE_COUNT];
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> materialBuffer;
+};
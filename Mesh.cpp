@@ -1,7 +1,18 @@
 #include "Mesh.h"
+#include "ObjParser.h"
+#include "MeshOptimizer.h"
+#include "GeometryPool.h"
+#include "JobSystem.h"
+#include "LoadProfiler.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
 #include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <cmath>
 #include <vector>
 #include <fstream>
+#include <chrono>
+#include <string>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -9,209 +20,255 @@
 
 using namespace DirectX;
 
-Mesh::Mesh(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device)
+// A read only view of an entire file
+struct MappedFile
 {
-	CreateBuffers(vertArray, numVerts, indexArray, numIndices, device, true);
+	HANDLE File;
+	HANDLE Mapping;
+	const char* Data;
+	unsigned long long Size;
+};
+
+static void UnmapFile(MappedFile& mapped)
+{
+	if (mapped.Data)
+		UnmapViewOfFile(mapped.Data);
+	if (mapped.Mapping)
+		CloseHandle(mapped.Mapping);
+	if (mapped.File != INVALID_HANDLE_VALUE)
+		CloseHandle(mapped.File);
+	mapped = { INVALID_HANDLE_VALUE, 0, 0, 0 };
 }
 
-Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, bool useAssImp)
+static bool MapFile(const char* path, MappedFile& mapped)
 {
-	if (useAssImp)
-	{
-		LoadAssImp(objFile, device);
-	}
-	else
+	mapped = { INVALID_HANDLE_VALUE, 0, 0, 0 };
+	mapped.File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (mapped.File == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Empty files can't be mapped
+	LARGE_INTEGER size = {};
+	GetFileSizeEx(mapped.File, &size);
+	mapped.Size = (unsigned long long)size.QuadPart;
+	if (mapped.Size > 0)
+		mapped.Mapping = CreateFileMappingA(mapped.File, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapped.Mapping)
+		mapped.Data = (const char*)MapViewOfFile(mapped.Mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (!mapped.Data)
 	{
-		LoadManually(objFile, device);
+		UnmapFile(mapped);
+		return false;
 	}
+	return true;
 }
 
+// Size and last write time of a file, or false if it can't be found
+static bool GetSourceInfo(const char* file, unsigned long long& size, unsigned long long& writeTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(file, GetFileExInfoStandard, &data))
+		return false;
 
-Mesh::~Mesh(void)
+	size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	writeTime = ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+// Folds a unit vector onto an octahedron and flattens that down
+// to two 16 bit snorms, which VertexFormat.hlsli unfolds again
+static unsigned int PackOctahedral(const XMFLOAT3& v)
 {
+	float length = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+	if (length <= 0.0f)
+		return 0;
+
+	float x = v.x / length;
+	float y = v.y / length;
+	if (v.z < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
 
+	short packedX = (short)roundf(max(-1.0f, min(1.0f, x)) * 32767.0f);
+	short packedY = (short)roundf(max(-1.0f, min(1.0f, y)) * 32767.0f);
+	return (unsigned short)packedX | ((unsigned int)(unsigned short)packedY << 16);
 }
 
+static CompactVertex PackVertex(const Vertex& v)
+{
+	CompactVertex packed;
+	packed.Position = v.Position;
+	packed.UV = PackedVector::XMConvertFloatToHalf(v.UV.x) | ((unsigned int)PackedVector::XMConvertFloatToHalf(v.UV.y) << 16);
+	packed.Normal = PackOctahedral(v.Normal);
+	packed.Tangent = PackOctahedral(v.Tangent);
+	return packed;
+}
 
-void Mesh::LoadManually(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+
+Mesh::Mesh(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, bool compactVertices)
 {
-	// File input object
-	std::ifstream obj(objFile);
+	this->compactVertices = compactVertices;
+	deferBuffers = false;
+	geometry = 0;
+	lodCount = 1;
+	fromCache = false;
+	loadMilliseconds = 0;
+	importMilliseconds = 0;
+	acmrBefore = 0;
+	acmrAfter = 0;
+	uvDensity = 0;
+	CreateBuffers(vertArray, numVerts, indexArray, numIndices, device, true);
+}
 
-	// Check for successful open
-	if (!obj.is_open())
+// --------------------------------------------------------
+// Loads from the model's cache if there's an up to date
+// one, otherwise imports the model and writes the cache
+//  - Deferring the buffers leaves nothing here that needs
+//    the immediate context, so this can run on any thread
+// --------------------------------------------------------
+Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, bool useAssImp, bool compactVertices, bool deferBuffers)
+{
+	this->compactVertices = compactVertices;
+	this->deferBuffers = deferBuffers;
+	geometry = 0;
+	numIndices = 0;
+	indexFormat = DXGI_FORMAT_R32_UINT;
+	lodCount = 1;
+	fromCache = false;
+	loadMilliseconds = 0;
+	importMilliseconds = 0;
+	acmrBefore = 0;
+	acmrAfter = 0;
+	uvDensity = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	bool cached;
+	{
+		LoadProfileScope scope("Mesh Cache", objFile);
+		cached = LoadCache(objFile, useAssImp, device);
+	}
+	if (cached)
+	{
+		fromCache = true;
+		loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 		return;
+	}
 
-	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;     // Positions from the file
-	std::vector<XMFLOAT3> normals;       // Normals from the file
-	std::vector<XMFLOAT2> uvs;           // UVs from the file
-	std::vector<Vertex> verts;           // Verts we're assembling
-	std::vector<UINT> indices;           // Indices of these verts
-	unsigned int vertCounter = 0;        // Count of vertices/indices
-	char chars[100];                     // String for line reading
-
-	// Still have data left?
-	while (obj.good())
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
+		LoadProfileScope scope("Mesh Import", objFile);
+		ImportFile(objFile, useAssImp, verts, indices, submeshes);
+	}
 
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't')
-		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f')
-		{
-			// Read the face indices into an array
-			// NOTE: This assumes the given obj file contains
-			//  vertex positions, uv coordinates AND normals.
-			//  If the model is missing any of these, this 
-			//  code will not handle the file correctly!
-			unsigned int i[12];
-			int facesRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// The model is most likely in a right-handed space,
-			// especially if it came from Maya.  We want to convert
-			// to a left-handed space for DirectX.  This means we 
-			// need to:
-			//  - Invert the Z position
-			//  - Invert the normal's Z
-			//  - Flip the winding order
-			// We also need to flip the UV coordinate since DirectX
-			// defines (0,0) as the top left of the texture, and many
-			// 3D modeling packages use the bottom left as (0,0)
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-
-			// Add three more indices
-			indices.push_back(vertCounter); vertCounter += 1;
-			indices.push_back(vertCounter); vertCounter += 1;
-			indices.push_back(vertCounter); vertCounter += 1;
-
-			// Was there a 4th face?
-			if (facesRead == 12)
-			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-
-				// Add three more indices
-				indices.push_back(vertCounter); vertCounter += 1;
-				indices.push_back(vertCounter); vertCounter += 1;
-				indices.push_back(vertCounter); vertCounter += 1;
-			}
-		}
+	if (verts.empty() || indices.empty())
+	{
+		printf("Error loading model!\n");
+		return;
+	}
+
+	{
+		LoadProfileScope scope("Mesh Optimize", objFile);
+		Optimize(verts, indices);
+		GenerateLods(verts, indices);
 	}
+	CreateBuffers(&verts[0], (int)verts.size(), &indices[0], (int)indices.size(), device, false);
+	importMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	loadMilliseconds = importMilliseconds;
 
-	// Close the file and create the actual buffers
-	obj.close();
+	WriteCache(objFile, useAssImp, verts, indices);
+}
 
 
-	// - At this point, "verts" is a vector of Vertex structs, and can be used
-	//    directly to create a vertex buffer:  &verts[0] is the address of the first vert
-	//
-	// - The vector "indices" is similar. It's a vector of unsigned ints and
-	//    can be used directly for the index buffer: &indices[0] is the address of the first int
-	//
-	// - "vertCounter" is BOTH the number of vertices and the number of indices
-	// - Yes, the indices are a bit redundant here (one per vertex).  Could you skip using
-	//    an index buffer in this case?  Sure!  Though, if your mesh class assumes you have
-	//    one, you'll need to write some extra code to handle cases when you don't.
+// --------------------------------------------------------
+// Loads straight from a cache's contents (like one in an
+// asset pack) without a source file to check it against,
+// leaving the mesh empty if it doesn't match this build
+// --------------------------------------------------------
+Mesh::Mesh(const void* cacheData, unsigned long long cacheSize, Microsoft::WRL::ComPtr<ID3D11Device> device, bool useAssImp, bool compactVertices, bool deferBuffers)
+{
+	this->compactVertices = compactVertices;
+	this->deferBuffers = deferBuffers;
+	geometry = 0;
+	numIndices = 0;
+	indexFormat = DXGI_FORMAT_R32_UINT;
+	lodCount = 1;
+	fromCache = false;
+	loadMilliseconds = 0;
+	importMilliseconds = 0;
+	acmrBefore = 0;
+	acmrAfter = 0;
+	uvDensity = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (!ReadCache((const char*)cacheData, cacheSize, useAssImp, false, 0, 0, device))
+	{
+		printf("Error loading cached model!\n");
+		return;
+	}
+
+	fromCache = true;
+	loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
 
-	CreateBuffers(&verts[0], vertCounter, &indices[0], vertCounter, device, true);
 
+Mesh::~Mesh(void)
+{
+	if (geometry)
+		GeometryPool::GetInstance().Free(geometry);
 }
 
-void Mesh::LoadAssImp(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+
+bool Mesh::Import(const char* objFile, bool useAssImp, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	std::vector<Submesh> submeshes;
+	ImportFile(objFile, useAssImp, verts, indices, submeshes);
+	return !verts.empty() && !indices.empty();
+}
+
+void Mesh::ImportFile(const char* objFile, bool useAssImp, std::vector<Vertex>& verts, std::vector<unsigned int>& indices, std::vector<Submesh>& submeshes)
+{
+	if (useAssImp)
+	{
+		LoadAssImp(objFile, verts, indices, submeshes);
+	}
+	else
+	{
+		// AssImp makes its own tangents
+		LoadManually(objFile, verts, indices);
+		if (!verts.empty() && !indices.empty())
+			CalculateTangents(&verts[0], (int)verts.size(), &indices[0], (int)indices.size());
+	}
+}
+
+// --------------------------------------------------------
+// Parses the OBJ straight out of a mapped view of the file
+// --------------------------------------------------------
+void Mesh::LoadManually(const char* objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	MappedFile obj;
+	if (!MapFile(objFile, obj))
+		return;
+
+	if (!ObjParser::Parse(obj.Data, (size_t)obj.Size, verts, indices))
+	{
+		verts.clear();
+		indices.clear();
+	}
+
+	UnmapFile(obj);
+}
+
+// --------------------------------------------------------
+// Imports every mesh in the file into one set of vertices
+// and indices, with a submesh for each
+// --------------------------------------------------------
+void Mesh::LoadAssImp(const char* objFile, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<Submesh>& submeshes)
 {
 	// Create the importer
 	Assimp::Importer importer;
@@ -226,93 +283,360 @@ void Mesh::LoadAssImp(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device>
 
 	// Did it work?
 	if (!scene)
+		return;
+
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++)
 	{
-		// Error!  Print something
-		printf("Error loading model!\n");
-	}
+		// Points and lines are sorted into their own meshes,
+		// and there's nothing here to draw those with
+		aiMesh* mesh = scene->mMeshes[m];
+		if (!(mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE))
+			continue;
 
-	// Grab the first mesh and build our vertices
-	aiMesh* mesh = scene->mMeshes[0];
-	std::vector<Vertex> vertices;
+		Submesh submesh = { (unsigned int)indices.size(), 0, (unsigned int)vertices.size(), mesh->mNumVertices, mesh->mMaterialIndex };
 
-	// Loop through the verts in assimp and build our vertex structs one by one
-	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-	{
-		Vertex v = {};
-		v.Position.x = mesh->mVertices[i].x;
-		v.Position.y = mesh->mVertices[i].y;
-		v.Position.z = mesh->mVertices[i].z;
+		// Loop through the verts in assimp and build our vertex structs one by one
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+		{
+			Vertex v = {};
+			v.Position.x = mesh->mVertices[i].x;
+			v.Position.y = mesh->mVertices[i].y;
+			v.Position.z = mesh->mVertices[i].z;
+
+			if (mesh->HasNormals())
+			{
+				v.Normal.x = mesh->mNormals[i].x;
+				v.Normal.y = mesh->mNormals[i].y;
+				v.Normal.z = mesh->mNormals[i].z;
+			}
 
-		if (mesh->HasNormals())
+			if (mesh->HasTextureCoords(0))
+			{
+				v.UV.x = mesh->mTextureCoords[0][i].x;
+				v.UV.y = mesh->mTextureCoords[0][i].y;
+			}
+
+			if (mesh->HasTangentsAndBitangents())
+			{
+				v.Tangent.x = mesh->mTangents[i].x;
+				v.Tangent.y = mesh->mTangents[i].y;
+				v.Tangent.z = mesh->mTangents[i].z;
+			}
+
+			vertices.push_back(v);
+		}
+
+		// Indices stay relative to this submesh's first vertex
+		for (unsigned int f = 0; f < mesh->mNumFaces; f++)
 		{
-			v.Normal.x = mesh->mNormals[i].x;
-			v.Normal.y = mesh->mNormals[i].y;
-			v.Normal.z = mesh->mNormals[i].z;
+			for (unsigned int i = 0; i < mesh->mFaces[f].mNumIndices; i++)
+				indices.push_back(mesh->mFaces[f].mIndices[i]);
 		}
 
-		if (mesh->HasTextureCoords(0))
+		submesh.IndexCount = (unsigned int)indices.size() - submesh.IndexStart;
+		submeshes.push_back(submesh);
+	}
+}
+
+// --------------------------------------------------------
+// Vertex cache order first, then overdraw order (which keeps
+// most of the cache order), then vertices in the order
+// the reordered triangles use them
+// --------------------------------------------------------
+void Mesh::Optimize(std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	// Manually loaded meshes are all one piece
+	if (submeshes.empty())
+		submeshes.push_back({ 0, (unsigned int)indices.size(), 0, (unsigned int)verts.size(), 0 });
+
+	// Every submesh's indices are local to it, so the whole
+	// mesh's ACMR is each one's, weighted by its triangles
+	auto acmr = [&]()
+	{
+		float misses = 0;
+		for (auto& s : submeshes)
+			misses += MeshOptimizer::CalculateAcmr(&indices[s.IndexStart], s.IndexCount, s.VertexCount) * (s.IndexCount / 3);
+		return misses / (float)(indices.size() / 3);
+	};
+
+	acmrBefore = acmr();
+	for (auto& s : submeshes)
+	{
+		if (s.IndexCount == 0)
+			continue;
+
+		unsigned int* range = &indices[s.IndexStart];
+		Vertex* submeshVerts = &verts[s.VertexStart];
+		MeshOptimizer::OptimizeVertexCache(range, s.IndexCount, s.VertexCount);
+		MeshOptimizer::OptimizeOverdraw(range, s.IndexCount, submeshVerts);
+		MeshOptimizer::OptimizeVertexFetch(submeshVerts, 0, s.VertexCount, range, s.IndexCount);
+	}
+	acmrAfter = acmr();
+}
+
+// --------------------------------------------------------
+// Simplifies each level's submeshes into the next one's,
+// allowing a little more error every time, until a level
+// wouldn't be much simpler than the one before it
+//  - Simplifying only removes vertices from triangles, so
+//    every level shares the vertex buffer
+// --------------------------------------------------------
+void Mesh::GenerateLods(const std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	BoundingBox box;
+	BoundingBox::CreateFromPoints(box, verts.size(), &verts[0].Position, sizeof(Vertex));
+	float maxError = 2.0f * XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents))) * MESH_LOD_MAX_ERROR;
+
+	unsigned int perLod = (unsigned int)submeshes.size();
+	std::vector<unsigned int> simplified;
+	for (unsigned int lod = 1; lod < MESH_MAX_LODS; lod++, maxError *= 2.0f)
+	{
+		size_t levelStart = indices.size();
+		unsigned int previousTriangles = 0;
+		unsigned int triangles = 0;
+		std::vector<Submesh> level;
+
+		for (unsigned int s = 0; s < perLod; s++)
 		{
-			v.UV.x = mesh->mTextureCoords[0][i].x;
-			v.UV.y = mesh->mTextureCoords[0][i].y;
+			Submesh next = submeshes[(lod - 1) * perLod + s];
+			unsigned int count = 0;
+			if (next.IndexCount > 0)
+			{
+				// Simplified into a copy first, since adding to the
+				// indices can move them
+				simplified.resize(next.IndexCount);
+				unsigned int target = (unsigned int)(next.IndexCount / 3 * MESH_LOD_REDUCTION) * 3;
+				count = MeshOptimizer::Simplify(simplified.data(), &indices[next.IndexStart], next.IndexCount, &verts[next.VertexStart], next.VertexCount, target, maxError * maxError);
+				if (count > 0)
+					MeshOptimizer::OptimizeVertexCache(simplified.data(), count, next.VertexCount);
+			}
+
+			previousTriangles += next.IndexCount / 3;
+			triangles += count / 3;
+			next.IndexStart = (unsigned int)indices.size();
+			next.IndexCount = count;
+			indices.insert(indices.end(), simplified.begin(), simplified.begin() + count);
+			level.push_back(next);
 		}
 
-		if (mesh->HasTangentsAndBitangents())
+		if (triangles > previousTriangles * MESH_LOD_MIN_REDUCTION || triangles < MESH_LOD_MIN_TRIANGLES)
 		{
-			v.Tangent.x = mesh->mTangents[i].x;
-			v.Tangent.y = mesh->mTangents[i].y;
-			v.Tangent.z = mesh->mTangents[i].z;
+			indices.resize(levelStart);
+			break;
 		}
 
-		vertices.push_back(v);
+		submeshes.insert(submeshes.end(), level.begin(), level.end());
+		lodCount++;
 	}
+}
 
-	std::vector<unsigned int> indices;
-	for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+// --------------------------------------------------------
+// Maps the cache file and hands its arrays straight to the
+// buffers, as long as it matches the source file and the
+// current vertex layout
+// --------------------------------------------------------
+bool Mesh::LoadCache(const char* objFile, bool useAssImp, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	unsigned long long sourceSize, sourceWriteTime;
+	if (!GetSourceInfo(objFile, sourceSize, sourceWriteTime))
+		return false;
+
+	MappedFile cache;
+	if (!MapFile((std::string(objFile) + MESH_CACHE_EXTENSION).c_str(), cache))
+		return false;
+
+	bool loaded = ReadCache(cache.Data, cache.Size, useAssImp, true, sourceSize, sourceWriteTime, device);
+	UnmapFile(cache);
+	return loaded;
+}
+
+// --------------------------------------------------------
+// Checks a cache's header against this build (and its
+// source file's size and time, if asked to) and creates
+// the buffers right from its arrays
+// --------------------------------------------------------
+bool Mesh::ReadCache(const char* data, unsigned long long size, bool useAssImp, bool checkSource, unsigned long long sourceSize, unsigned long long sourceWriteTime, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	bool loaded = false;
+	if (size >= sizeof(MeshCacheHeader))
 	{
-		for (unsigned int i = 0; i < mesh->mFaces[f].mNumIndices; i++)
+		const MeshCacheHeader* header = (const MeshCacheHeader*)data;
+		unsigned long long expectedSize = sizeof(MeshCacheHeader) +
+			(unsigned long long)header->SubmeshCount * sizeof(Submesh) +
+			(unsigned long long)header->VertexCount * sizeof(Vertex) +
+			(unsigned long long)header->IndexCount * sizeof(unsigned int);
+
+		if (header->Magic == MESH_CACHE_MAGIC &&
+			header->Version == MESH_CACHE_VERSION &&
+			header->VertexSize == sizeof(Vertex) &&
+			header->UsedAssImp == (useAssImp ? 1u : 0u) &&
+			(!checkSource || (header->SourceSize == sourceSize && header->SourceWriteTime == sourceWriteTime)) &&
+			header->VertexCount > 0 && header->IndexCount > 0 &&
+			header->LodCount > 0 && header->LodCount <= MESH_MAX_LODS &&
+			header->SubmeshCount % header->LodCount == 0 &&
+			size == expectedSize)
 		{
-			unsigned int index = mesh->mFaces[f].mIndices[i];
-			indices.push_back(index);
+			const Submesh* cachedSubmeshes = (const Submesh*)(header + 1);
+			const Vertex* verts = (const Vertex*)(cachedSubmeshes + header->SubmeshCount);
+			const unsigned int* indices = (const unsigned int*)(verts + header->VertexCount);
+
+			// Nothing writes to the arrays without tangents to calculate
+			submeshes.assign(cachedSubmeshes, cachedSubmeshes + header->SubmeshCount);
+			lodCount = header->LodCount;
+			CreateBuffers(const_cast<Vertex*>(verts), header->VertexCount, const_cast<unsigned int*>(indices), header->IndexCount, device, false, &header->Bounds);
+			importMilliseconds = header->ImportMilliseconds;
+			acmrBefore = header->AcmrBefore;
+			acmrAfter = header->AcmrAfter;
+			loaded = true;
 		}
 	}
+	return loaded;
+}
 
-	// Create the final buffers
-	CreateBuffers(&vertices[0], (int)vertices.size(), &indices[0], (int)indices.size(), device, false);
+void Mesh::WriteCache(const char* objFile, bool useAssImp, const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices)
+{
+	MeshCacheHeader header = {};
+	if (!GetSourceInfo(objFile, header.SourceSize, header.SourceWriteTime))
+		return;
+
+	header.Magic = MESH_CACHE_MAGIC;
+	header.Version = MESH_CACHE_VERSION;
+	header.VertexSize = sizeof(Vertex);
+	header.UsedAssImp = useAssImp ? 1 : 0;
+	header.SubmeshCount = (unsigned int)submeshes.size();
+	header.LodCount = lodCount;
+	header.VertexCount = (unsigned int)verts.size();
+	header.IndexCount = (unsigned int)indices.size();
+	header.ImportMilliseconds = (float)importMilliseconds;
+	header.AcmrBefore = acmrBefore;
+	header.AcmrAfter = acmrAfter;
+	header.Bounds = bounds;
+
+	// Not being able to write it (like a read only folder) just
+	// means importing again next time
+	std::ofstream cache(std::string(objFile) + MESH_CACHE_EXTENSION, std::ios::binary);
+	if (!cache.is_open())
+		return;
 
+	cache.write((const char*)&header, sizeof(header));
+	cache.write((const char*)submeshes.data(), sizeof(Submesh) * submeshes.size());
+	cache.write((const char*)verts.data(), sizeof(Vertex) * verts.size());
+	cache.write((const char*)indices.data(), sizeof(unsigned int) * indices.size());
 }
 
-void Mesh::CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, bool calcTangents)
+void Mesh::CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, bool calcTangents, const BoundingBox* knownBounds)
 {
 	// Calculate the tangents before copying to buffer?
 	if (calcTangents)
 		CalculateTangents(vertArray, numVerts, indexArray, numIndices);
 
+	// Calculate the bounds for culling, unless they're already known
+	if (knownBounds)
+		bounds = *knownBounds;
+	else
+		BoundingBox::CreateFromPoints(bounds, numVerts, &vertArray[0].Position, sizeof(Vertex));
+	BoundingSphere::CreateFromBoundingBox(boundingSphere, bounds);
+
+	// Anything not split up is one whole submesh
+	if (submeshes.empty())
+		submeshes.push_back({ 0, (unsigned int)numIndices, 0, (unsigned int)numVerts, 0 });
+	CalculateUVDensity(vertArray, indexArray);
+
+	// Pack the vertices down if this mesh wants that, as long
+	// as every uv fits in a half
+	//  - The cache keeps full vertices either way, so this can
+	//    change without re-importing anything
+	std::vector<CompactVertex> compactVerts;
+	for (int i = 0; compactVertices && i < numVerts; i++)
+	{
+		if (fabsf(vertArray[i].UV.x) > MESH_COMPACT_MAX_UV || fabsf(vertArray[i].UV.y) > MESH_COMPACT_MAX_UV)
+			compactVertices = false;
+	}
+	if (compactVertices)
+	{
+		compactVerts.resize(numVerts);
+		for (int i = 0; i < numVerts; i++)
+			compactVerts[i] = PackVertex(vertArray[i]);
+	}
+
+	// Small enough submeshes only need 16 bit indices, which
+	// halves the index buffer (and what it takes to read it)
+	std::vector<unsigned short> shortIndices;
+	unsigned int indexSize = sizeof(unsigned int);
+	indexFormat = DXGI_FORMAT_R32_UINT;
+	bool shortEnough = true;
+	for (auto& s : submeshes)
+		shortEnough = shortEnough && s.VertexCount <= MESH_MAX_SHORT_INDEX_VERTS;
+	if (shortEnough)
+	{
+		shortIndices.assign(indexArray, indexArray + numIndices);
+		indexSize = sizeof(unsigned short);
+		indexFormat = DXGI_FORMAT_R16_UINT;
+	}
+
+	// Save the indices
+	this->numIndices = numIndices;
+	const unsigned char* vertexData = compactVertices ? (const unsigned char*)compactVerts.data() : (const unsigned char*)vertArray;
+	const unsigned char* indexData = shortIndices.empty() ? (const unsigned char*)indexArray : (const unsigned char*)shortIndices.data();
+
+	// Hold on to exactly what goes in the buffers until CreatePendingBuffers()
+	if (deferBuffers)
+	{
+		pendingVertices.assign(vertexData, vertexData + (size_t)GetVertexStride() * numVerts);
+		pendingIndices.assign(indexData, indexData + (size_t)indexSize * numIndices);
+		return;
+	}
+
+	UploadBuffers(vertexData, numVerts, indexData, device);
+}
+
+void Mesh::CreatePendingBuffers(Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	if (pendingVertices.empty())
+		return;
+
+	UploadBuffers(pendingVertices.data(), (unsigned int)(pendingVertices.size() / GetVertexStride()), pendingIndices.data(), device);
+
+	// Swapped out, since clearing keeps the memory
+	std::vector<unsigned char>().swap(pendingVertices);
+	std::vector<unsigned char>().swap(pendingIndices);
+}
+
+void Mesh::UploadBuffers(const void* vertexData, unsigned int numVerts, const void* indexData, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	unsigned int indexSize = indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(unsigned short) : sizeof(unsigned int);
+
+	// Share the pool's buffers when there is one
+	GeometryPool& pool = GeometryPool::GetInstance();
+	if (pool.IsInitialized())
+	{
+		geometry = pool.Allocate(vertexData, numVerts, GetVertexStride(), indexData, numIndices, indexFormat);
+		return;
+	}
+
 	// Create the vertex buffer
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * numVerts; // Number of vertices
+	vbd.ByteWidth = GetVertexStride() * numVerts; // Number of vertices
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
 	vbd.StructureByteStride = 0;
 	D3D11_SUBRESOURCE_DATA initialVertexData;
-	initialVertexData.pSysMem = vertArray;
-	device->CreateBuffer(&vbd, &initialVertexData, vb.GetAddressOf());
+	initialVertexData.pSysMem = vertexData;
+	GpuMemory::CreateBuffer(device.Get(), &vbd, &initialVertexData, vb.GetAddressOf(), GpuMemoryCategory::Meshes, "Mesh Vertices");
 
 	// Create the index buffer
 	D3D11_BUFFER_DESC ibd;
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * numIndices; // Number of indices
+	ibd.ByteWidth = indexSize * numIndices; // Number of indices
 	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	ibd.CPUAccessFlags = 0;
 	ibd.MiscFlags = 0;
 	ibd.StructureByteStride = 0;
 	D3D11_SUBRESOURCE_DATA initialIndexData;
-	initialIndexData.pSysMem = indexArray;
-	device->CreateBuffer(&ibd, &initialIndexData, ib.GetAddressOf());
-
-	// Save the indices
-	this->numIndices = numIndices;
+	initialIndexData.pSysMem = indexData;
+	GpuMemory::CreateBuffer(device.Get(), &ibd, &initialIndexData, ib.GetAddressOf(), GpuMemoryCategory::Meshes, "Mesh Indices");
 }
 
 
@@ -320,89 +644,206 @@ void Mesh::CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArr
 // Code originally adapted from: http://www.terathon.com/code/tangent.html
 // Updated version now found here: http://foundationsofgameenginedev.com/FGED2-sample.pdf
 //  - See listing 7.4 in section 7.5 (page 9 of the PDF)
+//  - Big meshes split their triangles into a few chunks across the job
+//    system, each adding into its own tangents (triangles share vertices),
+//    which are then summed in chunk order so the result never changes
 void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
 {
-	// Reset tangents
-	for (int i = 0; i < numVerts; i++)
+	JobSystem& jobs = JobSystem::GetInstance();
+	unsigned int triangleCount = numIndices / 3;
+	unsigned int chunkCount = triangleCount / MESH_TANGENT_BATCH_TRIANGLES;
+	chunkCount = min(chunkCount, min(jobs.GetWorkerCount(), (unsigned int)MESH_TANGENT_MAX_CHUNKS));
+	chunkCount = jobs.GetEnabled() ? max(chunkCount, 1u) : 1;
+
+	// A single chunk adds straight into the vertices
+	std::vector<XMFLOAT3> chunkTangents(chunkCount > 1 ? (size_t)chunkCount * numVerts : 0, XMFLOAT3(0, 0, 0));
+	unsigned int trianglesPerChunk = (triangleCount + chunkCount - 1) / chunkCount;
+
+	jobs.ParallelFor(chunkCount, 1, [&](unsigned int firstChunk, unsigned int lastChunk)
 	{
-		verts[i].Tangent = XMFLOAT3(0, 0, 0);
-	}
+		for (unsigned int c = firstChunk; c < lastChunk; c++)
+		{
+			// Reset tangents
+			XMFLOAT3* tangents = chunkCount > 1 ? &chunkTangents[(size_t)c * numVerts] : 0;
+			if (!tangents)
+			{
+				for (int i = 0; i < numVerts; i++)
+					verts[i].Tangent = XMFLOAT3(0, 0, 0);
+			}
 
-	// Calculate tangents one whole triangle at a time
-	for (int i = 0; i < numIndices;)
+			// Calculate tangents one whole triangle at a time
+			unsigned int end = min((c + 1) * trianglesPerChunk, triangleCount) * 3;
+			for (unsigned int i = c * trianglesPerChunk * 3; i < end; i += 3)
+			{
+				// Grab indices and vertices of the triangle
+				unsigned int i1 = indices[i];
+				unsigned int i2 = indices[i + 1];
+				unsigned int i3 = indices[i + 2];
+				XMVECTOR p1 = XMLoadFloat3(&verts[i1].Position);
+				XMVECTOR uv1 = XMLoadFloat2(&verts[i1].UV);
+
+				// Vectors relative to the first vertex's position and uv
+				XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&verts[i2].Position), p1);
+				XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&verts[i3].Position), p1);
+				XMFLOAT2 d1, d2;
+				XMStoreFloat2(&d1, XMVectorSubtract(XMLoadFloat2(&verts[i2].UV), uv1));
+				XMStoreFloat2(&d2, XMVectorSubtract(XMLoadFloat2(&verts[i3].UV), uv1));
+
+				// Tangent is (t2 * e1 - t1 * e2) / (s1 * t2 - s2 * t1)
+				float r = 1.0f / (d1.x * d2.y - d2.x * d1.y);
+				XMVECTOR t = XMVectorScale(XMVectorSubtract(XMVectorScale(e1, d2.y), XMVectorScale(e2, d1.y)), r);
+
+				// Adjust tangents of each vert of the triangle
+				XMFLOAT3* t1 = tangents ? &tangents[i1] : &verts[i1].Tangent;
+				XMFLOAT3* t2 = tangents ? &tangents[i2] : &verts[i2].Tangent;
+				XMFLOAT3* t3 = tangents ? &tangents[i3] : &verts[i3].Tangent;
+				XMStoreFloat3(t1, XMVectorAdd(XMLoadFloat3(t1), t));
+				XMStoreFloat3(t2, XMVectorAdd(XMLoadFloat3(t2), t));
+				XMStoreFloat3(t3, XMVectorAdd(XMLoadFloat3(t3), t));
+			}
+		}
+	});
+
+	// Sum up the chunks and ensure all of the tangents are orthogonal to the normals
+	jobs.ParallelFor(numVerts, MESH_TANGENT_BATCH_VERTS, [&](unsigned int start, unsigned int end)
 	{
-		// Grab indices and vertices of first triangle
-		unsigned int i1 = indices[i++];
-		unsigned int i2 = indices[i++];
-		unsigned int i3 = indices[i++];
-		Vertex* v1 = &verts[i1];
-		Vertex* v2 = &verts[i2];
-		Vertex* v3 = &verts[i3];
-
-		// Calculate vectors relative to triangle positions
-		float x1 = v2->Position.x - v1->Position.x;
-		float y1 = v2->Position.y - v1->Position.y;
-		float z1 = v2->Position.z - v1->Position.z;
-
-		float x2 = v3->Position.x - v1->Position.x;
-		float y2 = v3->Position.y - v1->Position.y;
-		float z2 = v3->Position.z - v1->Position.z;
-
-		// Do the same for vectors relative to triangle uv's
-		float s1 = v2->UV.x - v1->UV.x;
-		float t1 = v2->UV.y - v1->UV.y;
-
-		float s2 = v3->UV.x - v1->UV.x;
-		float t2 = v3->UV.y - v1->UV.y;
-
-		// Create vectors for tangent calculation
-		float r = 1.0f / (s1 * t2 - s2 * t1);
-
-		float tx = (t2 * x1 - t1 * x2) * r;
-		float ty = (t2 * y1 - t1 * y2) * r;
-		float tz = (t2 * z1 - t1 * z2) * r;
-
-		// Adjust tangents of each vert of the triangle
-		v1->Tangent.x += tx;
-		v1->Tangent.y += ty;
-		v1->Tangent.z += tz;
-
-		v2->Tangent.x += tx;
-		v2->Tangent.y += ty;
-		v2->Tangent.z += tz;
-
-		v3->Tangent.x += tx;
-		v3->Tangent.y += ty;
-		v3->Tangent.z += tz;
-	}
+		for (unsigned int i = start; i < end; i++)
+		{
+			// Grab the two vectors
+			XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
+			XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
+			if (chunkCount > 1)
+			{
+				tangent = XMVectorZero();
+				for (unsigned int c = 0; c < chunkCount; c++)
+					tangent = XMVectorAdd(tangent, XMLoadFloat3(&chunkTangents[(size_t)c * numVerts + i]));
+			}
+
+			// Use Gram-Schmidt orthogonalize
+			tangent = XMVector3Normalize(
+				tangent - normal * XMVector3Dot(normal, tangent));
+
+			// Store the tangent
+			XMStoreFloat3(&verts[i].Tangent, tangent);
+		}
+	});
+}
+
 
-	// Ensure all of the tangents are orthogonal to the normals
-	for (int i = 0; i < numVerts; i++)
+
+
+// --------------------------------------------------------
+// Compares the total area of the full detail triangles in
+// uv space to their area in local space
+// --------------------------------------------------------
+void Mesh::CalculateUVDensity(const Vertex* verts, const unsigned int* indices)
+{
+	double area = 0, uvArea = 0;
+	for (unsigned int s = 0; s < GetSubmeshCount(); s++)
 	{
-		// Grab the two vectors
-		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
-		XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
+		const Submesh& submesh = submeshes[s];
+		const Vertex* base = verts + submesh.VertexStart;
+		for (unsigned int i = submesh.IndexStart; i + 2 < submesh.IndexStart + submesh.IndexCount; i += 3)
+		{
+			const Vertex& v0 = base[indices[i]];
+			const Vertex& v1 = base[indices[i + 1]];
+			const Vertex& v2 = base[indices[i + 2]];
 
-		// Use Gram-Schmidt orthogonalize
-		tangent = XMVector3Normalize(
-			tangent - normal * XMVector3Dot(normal, tangent));
+			XMVECTOR p0 = XMLoadFloat3(&v0.Position);
+			XMVECTOR cross = XMVector3Cross(XMLoadFloat3(&v1.Position) - p0, XMLoadFloat3(&v2.Position) - p0);
+			area += XMVectorGetX(XMVector3Length(cross)) / 2.0;
 
-		// Store the tangent
-		XMStoreFloat3(&verts[i].Tangent, tangent);
+			float u1 = v1.UV.x - v0.UV.x, w1 = v1.UV.y - v0.UV.y;
+			float u2 = v2.UV.x - v0.UV.x, w2 = v2.UV.y - v0.UV.y;
+			uvArea += fabs(u1 * w2 - u2 * w1) / 2.0;
+		}
 	}
+
+	uvDensity = area > 0 ? (float)sqrt(uvArea / area) : 0.0f;
 }
 
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer()
+{
+	return geometry ? geometry->Buffers->VertexBuffer : vb;
+}
 
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer()
+{
+	return geometry ? geometry->Buffers->IndexBuffer : ib;
+}
 
+const void* Mesh::GetBufferKey()
+{
+	return geometry ? (const void*)geometry->Buffers : (const void*)this;
+}
 
-void Mesh::SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+void Mesh::SetBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 {
+	if (geometry)
+	{
+		GeometryPool::GetInstance().SetBuffers(context, geometry);
+		return;
+	}
+
 	// Set buffers in the input assembler
-	UINT stride = sizeof(Vertex);
+	UINT stride = GetVertexStride();
 	UINT offset = 0;
 	context->IASetVertexBuffers(0, 1, vb.GetAddressOf(), &stride, &offset);
-	context->IASetIndexBuffer(ib.Get(), DXGI_FORMAT_R32_UINT, 0);
+	context->IASetIndexBuffer(ib.Get(), indexFormat, 0);
+}
+
+// Levels past the last one just draw the last one
+const Submesh& Mesh::GetLodSubmesh(unsigned int submesh, unsigned int lod)
+{
+	return submeshes[min(lod, lodCount - 1) * GetSubmeshCount() + submesh];
+}
+
+unsigned int Mesh::GetLodTriangleCount(unsigned int lod)
+{
+	unsigned int triangles = 0;
+	for (unsigned int s = 0; s < GetSubmeshCount(); s++)
+		triangles += GetLodSubmesh(s, lod).IndexCount / 3;
+	return triangles;
+}
+
+void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod)
+{
+	// Draw this mesh, assuming its buffers are already set
+	unsigned int startIndex = geometry ? geometry->StartIndex : 0;
+	unsigned int baseVertex = geometry ? geometry->BaseVertex : 0;
+	for (unsigned int i = 0; i < GetSubmeshCount(); i++)
+	{
+		const Submesh& s = GetLodSubmesh(i, lod);
+		context->DrawIndexed(s.IndexCount, startIndex + s.IndexStart, baseVertex + s.VertexStart);
+	}
+	DrawStats::Count(DrawCounter::Draws, GetSubmeshCount());
+}
 
-	// Draw this mesh
-	context->DrawIndexed(this->numIndices, 0, 0);
+void Mesh::DrawInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int instanceCount, unsigned int startInstance, unsigned int lod)
+{
+	// Same as above, assuming the instance data is bound too
+	unsigned int startIndex = geometry ? geometry->StartIndex : 0;
+	unsigned int baseVertex = geometry ? geometry->BaseVertex : 0;
+	for (unsigned int i = 0; i < GetSubmeshCount(); i++)
+	{
+		const Submesh& s = GetLodSubmesh(i, lod);
+		context->DrawIndexedInstanced(s.IndexCount, instanceCount, startIndex + s.IndexStart, baseVertex + s.VertexStart, startInstance);
+	}
+	DrawStats::Count(DrawCounter::Draws, GetSubmeshCount());
+	DrawStats::Count(DrawCounter::InstancedDraws, GetSubmeshCount());
+}
+
+void Mesh::DrawSubmesh(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int submesh, unsigned int lod)
+{
+	const Submesh& s = GetLodSubmesh(submesh, lod);
+	unsigned int startIndex = geometry ? geometry->StartIndex : 0;
+	unsigned int baseVertex = geometry ? geometry->BaseVertex : 0;
+	context->DrawIndexed(s.IndexCount, startIndex + s.IndexStart, baseVertex + s.VertexStart);
+	DrawStats::Count(DrawCounter::Draws);
+}
+
+void Mesh::SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	SetBuffers(context);
+	Draw(context);
 }
\ No newline at end of file
@@ -2,32 +2,195 @@
 
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <DirectXCollision.h>
+#include <vector>
 
 #include "Vertex.h"
 
+struct GeometryAllocation;
+
+// Binary copies of imported models, written next to each one
+// after it's first imported and mapped straight into buffers later
+//  - Bump the version whenever what's cached (or how) changes
+#define MESH_CACHE_MAGIC		0x4853454D
+#define MESH_CACHE_VERSION		5
+#define MESH_CACHE_EXTENSION	".meshcache"
+
+// Start of every cache file, followed by the submeshes,
+// vertices and indices
+struct MeshCacheHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int VertexSize;
+	unsigned int UsedAssImp;
+
+	// The source file this was made from, to tell when it's stale
+	unsigned long long SourceSize;
+	unsigned long long SourceWriteTime;
+
+	unsigned int SubmeshCount;	// Across every level of detail
+	unsigned int LodCount;
+	unsigned int VertexCount;
+	unsigned int IndexCount;
+	float ImportMilliseconds;
+	float AcmrBefore;
+	float AcmrAfter;
+	DirectX::BoundingBox Bounds;
+};
+
+// Meshes whose submeshes all have up to this many vertices
+// get 16 bit index buffers
+#define MESH_MAX_SHORT_INDEX_VERTS	65536
+
+// Compact vertices store uvs as halfs, which lose too much precision
+// past this (a mesh with larger uvs keeps its full vertices)
+#define MESH_COMPACT_MAX_UV			2.0f
+
+// Simpler levels of detail made at import, each aiming for this
+// fraction of the last one's triangles
+#define MESH_MAX_LODS				4
+#define MESH_LOD_REDUCTION			0.5f
+
+// No more levels once one keeps more than this fraction of the last
+// one's triangles (it isn't worth drawing), or ends up with fewer triangles than this
+#define MESH_LOD_MIN_REDUCTION		0.85f
+#define MESH_LOD_MIN_TRIANGLES		32
+
+// Furthest the first simplified level can move the surface, as a
+// fraction of the bounds' diagonal, which doubles for each level after
+#define MESH_LOD_MAX_ERROR			0.01f
+
+// Tangents are generated on the job system in chunks of at least this many
+// triangles, each with its own copy of every tangent to add into (so the
+// chunks are capped), then finished in batches of vertices
+#define MESH_TANGENT_BATCH_TRIANGLES	16384
+#define MESH_TANGENT_MAX_CHUNKS			8
+#define MESH_TANGENT_BATCH_VERTS		4096
+
+// A range of the index buffer, which came from one part of the model
+//  - Its indices count from VertexStart, which is drawn as the base
+//    vertex, so every submesh can use 16 bit indices on its own
+//  - Each level of detail has its own copy of every submesh, with
+//    new indices into the same vertices
+struct Submesh
+{
+	unsigned int IndexStart;
+	unsigned int IndexCount;
+	unsigned int VertexStart;
+	unsigned int VertexCount;
+	unsigned int MaterialSlot;	// The model's own material index for this part
+};
+
 
 class Mesh
 {
 public:
-	Mesh(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device);
-	Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, bool useAssImp = true);
+	Mesh(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, bool compactVertices = false);
+	Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, bool useAssImp = true, bool compactVertices = false, bool deferBuffers = false);
+	Mesh(const void* cacheData, unsigned long long cacheSize, Microsoft::WRL::ComPtr<ID3D11Device> device, bool useAssImp = true, bool compactVertices = false, bool deferBuffers = false);
 	~Mesh(void);
 
-	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer() { return vb; }
-	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer() { return ib; }
+	// A mesh loaded with deferred buffers keeps its finished vertices and
+	// indices until this creates them (or allocates them from the geometry
+	// pool), which has to happen on the thread that owns the context
+	bool HasPendingBuffers() { return !pendingVertices.empty(); }
+	void CreatePendingBuffers(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Either the geometry pool's shared buffers (starting at this mesh's
+	// range) or this mesh's own, if it was made without a pool
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
+	GeometryAllocation* GetGeometry() { return geometry; }
+
+	// Meshes with the same key draw from the same buffers, so switching
+	// between them doesn't need SetBuffers() again
+	const void* GetBufferKey();
 	int GetIndexCount() { return numIndices; }
+	DXGI_FORMAT GetIndexFormat() { return indexFormat; }
+
+	// Whether the vertex buffer holds CompactVertex rather than Vertex,
+	// which needs the "_Compact" permutation of any vertex shader
+	bool HasCompactVertices() { return compactVertices; }
+	unsigned int GetVertexStride() { return compactVertices ? sizeof(CompactVertex) : sizeof(Vertex); }
+
+	// Local space bounds, calculated from the vertices at load time
+	const DirectX::BoundingBox& GetBounds() { return bounds; }
+	const DirectX::BoundingSphere& GetBoundingSphere() { return boundingSphere; }
+
+	// Average distance in uv space per local unit across the surface
+	// (zero without uvs), which the renderer's texel density starts from
+	float GetUVDensity() { return uvDensity; }
 
+	// Every level of detail's submeshes, one level after another
+	const std::vector<Submesh>& GetSubmeshes() { return submeshes; }
+	unsigned int GetSubmeshCount() { return (unsigned int)submeshes.size() / lodCount; }
+	unsigned int GetLodCount() { return lodCount; }
+	unsigned int GetLodTriangleCount(unsigned int lod);
+
+	// How this mesh was loaded, and how long the original import
+	// took (which is what a cached load saves)
+	bool IsFromCache() { return fromCache; }
+	double GetLoadMilliseconds() { return loadMilliseconds; }
+	double GetImportMilliseconds() { return importMilliseconds; }
+
+	// Average vertex cache misses per triangle before and after the
+	// triangles were reordered at import (both zero if they weren't)
+	float GetAcmrBefore() { return acmrBefore; }
+	float GetAcmrAfter() { return acmrAfter; }
+
+	void SetBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	// Each of these draws every submesh of one level of detail (clamped
+	// to the ones this mesh has), with the buffers bound once
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod = 0);
+	void DrawInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int instanceCount, unsigned int startInstance, unsigned int lod = 0);
+	void DrawSubmesh(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int submesh, unsigned int lod = 0);
 	void SetBuffersAndDraw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
+	// Just the import (nothing's cached, optimized or uploaded), with
+	// tangents, for timing each way of loading on its own
+	static bool Import(const char* objFile, bool useAssImp, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+	static void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+
 private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vb;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ib;
+	GeometryAllocation* geometry;
 	int numIndices;
+	DXGI_FORMAT indexFormat;
+	bool compactVertices;
+	bool deferBuffers;
+	std::vector<unsigned char> pendingVertices;
+	std::vector<unsigned char> pendingIndices;
+	DirectX::BoundingBox bounds;
+	DirectX::BoundingSphere boundingSphere;
+	float uvDensity;
+	std::vector<Submesh> submeshes;
+	unsigned int lodCount;
+	bool fromCache;
+	double loadMilliseconds;
+	double importMilliseconds;
+	float acmrBefore;
+	float acmrAfter;
+
+	// Fill in the final vertices and indices, leaving the buffers for later
+	static void ImportFile(const char* objFile, bool useAssImp, std::vector<Vertex>& verts, std::vector<unsigned int>& indices, std::vector<Submesh>& submeshes);
+	static void LoadManually(const char* objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+	static void LoadAssImp(const char* objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices, std::vector<Submesh>& submeshes);
+
+	// Reorders each submesh's triangles and vertices for the GPU
+	void Optimize(std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
+	// Appends simplified copies of every submesh's indices, one level at a time
+	void GenerateLods(const std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+	const Submesh& GetLodSubmesh(unsigned int submesh, unsigned int lod);
 
-	void LoadManually(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
-	void LoadAssImp(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	bool LoadCache(const char* objFile, bool useAssImp, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	bool ReadCache(const char* data, unsigned long long size, bool useAssImp, bool checkSource, unsigned long long sourceSize, unsigned long long sourceWriteTime, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	void WriteCache(const char* objFile, bool useAssImp, const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices);
 
-	void CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, bool calcTangents);
-	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	void CreateBuffers(Vertex* vertArray, int numVerts, unsigned int* indexArray, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, bool calcTangents, const DirectX::BoundingBox* knownBounds = 0);
+	void UploadBuffers(const void* vertexData, unsigned int numVerts, const void* indexData, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	void CalculateUVDensity(const Vertex* verts, const unsigned int* indices);
 
 };
@@ -0,0 +1,569 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Simulates a FIFO cache, where a vertex only has to be
+// transformed again once enough others have come after it
+// --------------------------------------------------------
+float MeshOptimizer::CalculateAcmr(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount)
+{
+	if (indexCount < 3)
+		return 0.0f;
+
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	unsigned int time = MESH_OPTIMIZER_ACMR_CACHE_SIZE + 1;
+	unsigned int misses = 0;
+	for (unsigned int i = 0; i < indexCount; i++)
+	{
+		unsigned int v = indices[i];
+		if (time - timestamps[v] > MESH_OPTIMIZER_ACMR_CACHE_SIZE)
+		{
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+
+	return misses / (float)(indexCount / 3);
+}
+
+// How much a vertex wants its triangles drawn next - recently used
+// vertices score higher (but the last triangle's a bit lower, as it's
+// likely another triangle can use them soon), as do vertices with
+// few triangles left, so they get finished off
+static float VertexScore(int cachePosition, unsigned int trianglesLeft)
+{
+	if (trianglesLeft == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+			score = 0.75f;
+		else
+			score = powf(1.0f - (cachePosition - 3) / (float)(MESH_OPTIMIZER_CACHE_SIZE - 3), 1.5f);
+	}
+
+	return score + 2.0f * powf((float)trianglesLeft, -0.5f);
+}
+
+// --------------------------------------------------------
+// Greedily picks the best scoring triangle of whatever's in
+// the simulated cache, only searching every triangle when
+// nothing in the cache has any left
+// --------------------------------------------------------
+void MeshOptimizer::OptimizeVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount)
+{
+	unsigned int triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+		return;
+
+	// The triangles each vertex has left, with the ones still
+	// to be drawn kept at the front of each vertex's range
+	std::vector<unsigned int> trianglesLeft(vertexCount, 0);
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+		trianglesLeft[indices[i]]++;
+
+	std::vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + trianglesLeft[v];
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (unsigned int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = t;
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		vertexScores[v] = VertexScore(-1, trianglesLeft[v]);
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> drawn(triangleCount, false);
+	int best = 0;
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+		if (triangleScores[t] > triangleScores[best])
+			best = (int)t;
+	}
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	unsigned int cache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+	unsigned int cacheCount = 0;
+	unsigned int nextUndrawn = 0;
+
+	while (best >= 0)
+	{
+		unsigned int triangle[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+		drawn[best] = true;
+
+		// This triangle's vertices go to the front of the cache, and
+		// it's no longer one of their triangles left
+		unsigned int newCache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+		unsigned int newCount = 0;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int v = triangle[k];
+			output.push_back(v);
+			newCache[newCount++] = v;
+
+			unsigned int* first = &adjacency[offsets[v]];
+			unsigned int* last = first + trianglesLeft[v] - 1;
+			for (unsigned int* t = first; t <= last; t++)
+			{
+				if (*t == (unsigned int)best)
+				{
+					std::swap(*t, *last);
+					break;
+				}
+			}
+			trianglesLeft[v]--;
+		}
+
+		for (unsigned int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache[newCount++] = v;
+		}
+
+		// Rescore everything that moved (including whatever fell
+		// out), then look for the best triangle they still have
+		best = -1;
+		float bestScore = -1.0f;
+		for (unsigned int i = 0; i < newCount; i++)
+		{
+			unsigned int v = newCache[i];
+			cachePositions[v] = i < MESH_OPTIMIZER_CACHE_SIZE ? (int)i : -1;
+			vertexScores[v] = VertexScore(cachePositions[v], trianglesLeft[v]);
+		}
+
+		for (unsigned int i = 0; i < newCount; i++)
+		{
+			unsigned int v = newCache[i];
+			for (unsigned int a = offsets[v]; a < offsets[v] + trianglesLeft[v]; a++)
+			{
+				unsigned int t = adjacency[a];
+				triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				if (triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					best = (int)t;
+				}
+			}
+		}
+
+		cacheCount = newCount < MESH_OPTIMIZER_CACHE_SIZE ? newCount : MESH_OPTIMIZER_CACHE_SIZE;
+		for (unsigned int i = 0; i < cacheCount; i++)
+			cache[i] = newCache[i];
+
+		if (best < 0)
+		{
+			while (nextUndrawn < triangleCount && drawn[nextUndrawn])
+				nextUndrawn++;
+			best = nextUndrawn < triangleCount ? (int)nextUndrawn : -1;
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+// --------------------------------------------------------
+// Clusters that sit far out along the way they face are
+// most likely to be in front of the rest of the mesh, so
+// they're drawn first (Sander et al., "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw")
+// --------------------------------------------------------
+void MeshOptimizer::OptimizeOverdraw(unsigned int* indices, unsigned int indexCount, const Vertex* verts)
+{
+	unsigned int triangleCount = indexCount / 3;
+	unsigned int clusterCount = (triangleCount + MESH_OPTIMIZER_CLUSTER_SIZE - 1) / MESH_OPTIMIZER_CLUSTER_SIZE;
+	if (clusterCount < 2)
+		return;
+
+	// The middle of the mesh, as the average of its corners
+	XMVECTOR meshCenter = XMVectorZero();
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+		meshCenter = XMVectorAdd(meshCenter, XMLoadFloat3(&verts[indices[i]].Position));
+	meshCenter = XMVectorScale(meshCenter, 1.0f / (triangleCount * 3));
+
+	std::vector<std::pair<float, unsigned int>> clusters(clusterCount);
+	for (unsigned int c = 0; c < clusterCount; c++)
+	{
+		unsigned int start = c * MESH_OPTIMIZER_CLUSTER_SIZE * 3;
+		unsigned int end = std::min(start + MESH_OPTIMIZER_CLUSTER_SIZE * 3, triangleCount * 3);
+
+		XMVECTOR center = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		for (unsigned int i = start; i < end; i++)
+		{
+			center = XMVectorAdd(center, XMLoadFloat3(&verts[indices[i]].Position));
+			normal = XMVectorAdd(normal, XMLoadFloat3(&verts[indices[i]].Normal));
+		}
+		center = XMVectorScale(center, 1.0f / (end - start));
+		normal = XMVector3Normalize(normal);
+
+		clusters[c].first = XMVectorGetX(XMVector3Dot(XMVectorSubtract(center, meshCenter), normal));
+		clusters[c].second = c;
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) { return a.first > b.first; });
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	for (auto& c : clusters)
+	{
+		unsigned int start = c.second * MESH_OPTIMIZER_CLUSTER_SIZE * 3;
+		unsigned int end = std::min(start + MESH_OPTIMIZER_CLUSTER_SIZE * 3, triangleCount * 3);
+		output.insert(output.end(), indices + start, indices + end);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(Vertex* verts, unsigned int vertexStart, unsigned int vertexCount, unsigned int* indices, unsigned int indexCount)
+{
+	std::vector<unsigned int> remap(vertexCount, UINT_MAX);
+	unsigned int next = 0;
+	for (unsigned int i = 0; i < indexCount; i++)
+	{
+		unsigned int local = indices[i] - vertexStart;
+		if (remap[local] == UINT_MAX)
+			remap[local] = next++;
+		indices[i] = vertexStart + remap[local];
+	}
+
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] == UINT_MAX)
+			remap[v] = next++;
+	}
+
+	std::vector<Vertex> original(verts + vertexStart, verts + vertexStart + vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		verts[vertexStart + remap[v]] = original[v];
+}
+
+// The sum of squared distances to a set of planes, as the
+// symmetric 4x4 matrix of Garland and Heckbert's paper
+struct Quadric
+{
+	double XX, XY, XZ, XW, YY, YZ, YW, ZZ, ZW, WW;
+
+	void AddPlane(double a, double b, double c, double d, double weight)
+	{
+		XX += weight * a * a; XY += weight * a * b; XZ += weight * a * c; XW += weight * a * d;
+		YY += weight * b * b; YZ += weight * b * c; YW += weight * b * d;
+		ZZ += weight * c * c; ZW += weight * c * d;
+		WW += weight * d * d;
+	}
+
+	void Add(const Quadric& q)
+	{
+		XX += q.XX; XY += q.XY; XZ += q.XZ; XW += q.XW;
+		YY += q.YY; YZ += q.YZ; YW += q.YW;
+		ZZ += q.ZZ; ZW += q.ZW;
+		WW += q.WW;
+	}
+
+	double Error(const XMFLOAT3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return
+			XX * x * x + 2 * XY * x * y + 2 * XZ * x * z + 2 * XW * x +
+			YY * y * y + 2 * YZ * y * z + 2 * YW * y +
+			ZZ * z * z + 2 * ZW * z +
+			WW;
+	}
+};
+
+struct Collapse
+{
+	unsigned int From;
+	unsigned int To;
+	double Error;
+};
+
+static XMVECTOR TriangleNormal(const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+{
+	XMVECTOR pa = XMLoadFloat3(&a);
+	return XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&b), pa), XMVectorSubtract(XMLoadFloat3(&c), pa));
+}
+
+// --------------------------------------------------------
+// Edge collapses in passes - each pass sorts every edge by
+// error and collapses as many as it can that don't touch
+// one another, then the triangles are rebuilt for the next
+//  - Vertices on uv or normal seams share a position, so the
+//    collapses are between positions, and each vertex at the
+//    old position moves to the vertex it shared an edge with
+//    at the new one (or the one whose normal and uv are closest)
+//  - Open edges get extra planes, so borders stay put
+// --------------------------------------------------------
+unsigned int MeshOptimizer::Simplify(unsigned int* destination, const unsigned int* indices, unsigned int indexCount, const Vertex* verts, unsigned int vertexCount, unsigned int targetIndexCount, float maxError)
+{
+	std::vector<unsigned int> triangles(indices, indices + indexCount);
+	if (indexCount <= targetIndexCount)
+	{
+		std::copy(triangles.begin(), triangles.end(), destination);
+		return indexCount;
+	}
+
+	// One id per distinct position
+	std::vector<unsigned int> positionOf(vertexCount);
+	std::vector<XMFLOAT3> positions;
+	{
+		struct PositionHash
+		{
+			size_t operator()(const XMFLOAT3& p) const
+			{
+				unsigned int h[3];
+				memcpy(h, &p, sizeof(h));
+				return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+			}
+		};
+		struct PositionEqual
+		{
+			bool operator()(const XMFLOAT3& a, const XMFLOAT3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+		};
+
+		std::unordered_map<XMFLOAT3, unsigned int, PositionHash, PositionEqual> lookup;
+		lookup.reserve(vertexCount);
+		for (unsigned int v = 0; v < vertexCount; v++)
+		{
+			auto found = lookup.insert({ verts[v].Position, (unsigned int)positions.size() });
+			if (found.second)
+				positions.push_back(verts[v].Position);
+			positionOf[v] = found.first->second;
+		}
+	}
+	unsigned int positionCount = (unsigned int)positions.size();
+
+	// Every vertex at each position
+	std::vector<unsigned int> vertexOffsets(positionCount + 1, 0);
+	std::vector<unsigned int> positionVertices(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		vertexOffsets[positionOf[v] + 1]++;
+	for (unsigned int p = 0; p < positionCount; p++)
+		vertexOffsets[p + 1] += vertexOffsets[p];
+	{
+		std::vector<unsigned int> fill(vertexOffsets.begin(), vertexOffsets.end() - 1);
+		for (unsigned int v = 0; v < vertexCount; v++)
+			positionVertices[fill[positionOf[v]]++] = v;
+	}
+
+	// The vertex at a position whose normal and uv are closest to another's
+	auto closestVertex = [&](unsigned int position, unsigned int to)
+	{
+		unsigned int best = positionVertices[vertexOffsets[position]];
+		float bestDistance = FLT_MAX;
+		for (unsigned int i = vertexOffsets[position]; i < vertexOffsets[position + 1]; i++)
+		{
+			const Vertex& a = verts[positionVertices[i]];
+			const Vertex& b = verts[to];
+			float distance =
+				(a.Normal.x - b.Normal.x) * (a.Normal.x - b.Normal.x) + (a.Normal.y - b.Normal.y) * (a.Normal.y - b.Normal.y) + (a.Normal.z - b.Normal.z) * (a.Normal.z - b.Normal.z) +
+				(a.UV.x - b.UV.x) * (a.UV.x - b.UV.x) + (a.UV.y - b.UV.y) * (a.UV.y - b.UV.y);
+			if (distance < bestDistance)
+			{
+				bestDistance = distance;
+				best = positionVertices[i];
+			}
+		}
+		return best;
+	};
+
+	// Every triangle's plane, plus a plane standing up along each
+	// open edge (which only one triangle uses)
+	std::vector<Quadric> quadrics(positionCount, Quadric{});
+	std::unordered_map<unsigned long long, unsigned int> edgeUses;
+	for (unsigned int i = 0; i < indexCount; i += 3)
+	{
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int a = positionOf[triangles[i + k]], b = positionOf[triangles[i + (k + 1) % 3]];
+			edgeUses[((unsigned long long)std::min(a, b) << 32) | std::max(a, b)]++;
+		}
+	}
+
+	for (unsigned int i = 0; i < indexCount; i += 3)
+	{
+		unsigned int p[3] = { positionOf[triangles[i]], positionOf[triangles[i + 1]], positionOf[triangles[i + 2]] };
+		XMVECTOR normal = TriangleNormal(positions[p[0]], positions[p[1]], positions[p[2]]);
+		if (XMVectorGetX(XMVector3LengthSq(normal)) <= 0.0f)
+			continue;
+
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, XMVector3Normalize(normal));
+		double d = -(n.x * positions[p[0]].x + n.y * positions[p[0]].y + n.z * positions[p[0]].z);
+		for (unsigned int k = 0; k < 3; k++)
+			quadrics[p[k]].AddPlane(n.x, n.y, n.z, d, 1.0);
+
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			unsigned int a = p[k], b = p[(k + 1) % 3];
+			if (edgeUses[((unsigned long long)std::min(a, b) << 32) | std::max(a, b)] != 1)
+				continue;
+
+			XMVECTOR edge = XMVectorSubtract(XMLoadFloat3(&positions[b]), XMLoadFloat3(&positions[a]));
+			XMFLOAT3 side;
+			XMStoreFloat3(&side, XMVector3Normalize(XMVector3Cross(edge, XMLoadFloat3(&n))));
+			double sideD = -(side.x * positions[a].x + side.y * positions[a].y + side.z * positions[a].z);
+			quadrics[a].AddPlane(side.x, side.y, side.z, sideD, MESH_OPTIMIZER_BORDER_WEIGHT);
+			quadrics[b].AddPlane(side.x, side.y, side.z, sideD, MESH_OPTIMIZER_BORDER_WEIGHT);
+		}
+	}
+
+	std::vector<unsigned int> offsets(positionCount + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<unsigned char> locked(positionCount);
+	std::vector<unsigned int> vertexRemap(vertexCount);
+	std::vector<std::pair<unsigned int, unsigned int>> wedges;
+
+	while (triangles.size() > targetIndexCount)
+	{
+		// Which triangles use each position
+		unsigned int triangleCount = (unsigned int)triangles.size() / 3;
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (unsigned int i = 0; i < triangleCount * 3; i++)
+			offsets[positionOf[triangles[i]] + 1]++;
+		for (unsigned int p = 0; p < positionCount; p++)
+			offsets[p + 1] += offsets[p];
+
+		adjacency.resize(triangleCount * 3);
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (unsigned int i = 0; i < triangleCount * 3; i++)
+			adjacency[fill[positionOf[triangles[i]]]++] = i / 3;
+
+		// Each edge collapses whichever way costs less
+		//  - Edges inside the mesh come up twice, but only the
+		//    first one can go ahead this pass
+		collapses.clear();
+		for (unsigned int i = 0; i < triangleCount * 3; i++)
+		{
+			unsigned int a = positionOf[triangles[i]];
+			unsigned int b = positionOf[triangles[i - i % 3 + (i % 3 + 1) % 3]];
+
+			Quadric q = quadrics[a];
+			q.Add(quadrics[b]);
+			double toB = q.Error(positions[b]);
+			double toA = q.Error(positions[a]);
+			collapses.push_back(toB <= toA ? Collapse{ a, b, toB } : Collapse{ b, a, toA });
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.Error < y.Error; });
+
+		std::fill(locked.begin(), locked.end(), 0);
+		for (unsigned int v = 0; v < vertexCount; v++)
+			vertexRemap[v] = v;
+
+		unsigned int trianglesLeft = triangleCount;
+		unsigned int collapsed = 0;
+		for (auto& c : collapses)
+		{
+			if (c.Error > maxError || trianglesLeft * 3 <= targetIndexCount)
+				break;
+			if (locked[c.From] || locked[c.To])
+				continue;
+
+			// Every vertex at the old position needs one at the new
+			// position, and no triangle can flip over
+			bool valid = true;
+			unsigned int removed = 0;
+			wedges.clear();
+			for (unsigned int a = offsets[c.From]; a < offsets[c.From + 1] && valid; a++)
+			{
+				const unsigned int* t = &triangles[adjacency[a] * 3];
+				int to = -1;
+				for (int k = 0; k < 3; k++)
+					to = positionOf[t[k]] == c.To ? k : to;
+
+				if (to >= 0)
+				{
+					removed++;
+					for (int k = 0; k < 3; k++)
+					{
+						if (positionOf[t[k]] == c.From)
+							wedges.push_back({ t[k], t[to] });
+					}
+					continue;
+				}
+
+				XMFLOAT3 moved[3];
+				for (int k = 0; k < 3; k++)
+					moved[k] = positionOf[t[k]] == c.From ? positions[c.To] : positions[positionOf[t[k]]];
+				XMVECTOR before = TriangleNormal(positions[positionOf[t[0]]], positions[positionOf[t[1]]], positions[positionOf[t[2]]]);
+				XMVECTOR after = TriangleNormal(moved[0], moved[1], moved[2]);
+				valid = XMVectorGetX(XMVector3Dot(before, after)) > 0.0f;
+			}
+
+			for (unsigned int a = offsets[c.From]; a < offsets[c.From + 1] && valid; a++)
+			{
+				const unsigned int* t = &triangles[adjacency[a] * 3];
+				for (int k = 0; k < 3 && valid; k++)
+				{
+					if (positionOf[t[k]] != c.From)
+						continue;
+
+					bool found = false;
+					for (auto& w : wedges)
+						found = found || w.first == t[k];
+					if (!found)
+						wedges.push_back({ t[k], closestVertex(c.To, t[k]) });
+				}
+			}
+
+			if (!valid)
+				continue;
+
+			for (auto& w : wedges)
+				vertexRemap[w.first] = w.second;
+			quadrics[c.To].Add(quadrics[c.From]);
+
+			// Nothing around the old position can change again this pass
+			for (unsigned int a = offsets[c.From]; a < offsets[c.From + 1]; a++)
+			{
+				const unsigned int* t = &triangles[adjacency[a] * 3];
+				for (int k = 0; k < 3; k++)
+					locked[positionOf[t[k]]] = 1;
+			}
+
+			trianglesLeft -= removed;
+			collapsed++;
+		}
+
+		if (collapsed == 0)
+			break;
+
+		// Move the collapsed vertices and drop what's now degenerate
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < triangleCount * 3; i += 3)
+		{
+			unsigned int t[3] = { vertexRemap[triangles[i]], vertexRemap[triangles[i + 1]], vertexRemap[triangles[i + 2]] };
+			if (positionOf[t[0]] == positionOf[t[1]] || positionOf[t[1]] == positionOf[t[2]] || positionOf[t[0]] == positionOf[t[2]])
+				continue;
+
+			triangles[kept++] = t[0];
+			triangles[kept++] = t[1];
+			triangles[kept++] = t[2];
+		}
+		triangles.resize(kept);
+	}
+
+	std::copy(triangles.begin(), triangles.end(), destination);
+	return (unsigned int)triangles.size();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Vertex.h"
+
+// Vertices in the simulated cache while reordering triangles
+#define MESH_OPTIMIZER_CACHE_SIZE		32
+
+// FIFO cache size used to measure ACMR, which roughly matches
+// the post-transform cache of most GPUs
+#define MESH_OPTIMIZER_ACMR_CACHE_SIZE	16
+
+// Triangles per cluster when sorting for overdraw - big enough that
+// cluster boundaries barely hurt the vertex cache order
+#define MESH_OPTIMIZER_CLUSTER_SIZE		64
+
+// How much more moving an open edge costs than moving across
+// a surface when simplifying, so borders keep their shape
+#define MESH_OPTIMIZER_BORDER_WEIGHT	10.0
+
+// Reorders triangles and vertices for the GPU, once at import time
+//  - Every function works on a range of a larger index buffer, so
+//    each submesh can be done on its own
+class MeshOptimizer
+{
+public:
+	// Average cache misses per triangle (lower is better, 0.5 is ideal)
+	static float CalculateAcmr(const unsigned int* indices, unsigned int indexCount, unsigned int vertexCount);
+
+	// Orders triangles so each one reuses vertices the last few did,
+	// using Tom Forsyth's linear-speed vertex cache optimization
+	static void OptimizeVertexCache(unsigned int* indices, unsigned int indexCount, unsigned int vertexCount);
+
+	// Splits already cache-ordered triangles into clusters and draws
+	// outward facing clusters first, so they hide more of the rest
+	static void OptimizeOverdraw(unsigned int* indices, unsigned int indexCount, const Vertex* verts);
+
+	// Renumbers a range of vertices in the order they're first used,
+	// moving any unused ones to the end of the range
+	static void OptimizeVertexFetch(Vertex* verts, unsigned int vertexStart, unsigned int vertexCount, unsigned int* indices, unsigned int indexCount);
+
+	// Quadric error edge collapses onto existing vertices (so the simpler
+	// version shares the same vertices), until there are at most the target
+	// number of indices or every collapse left would cost more than
+	// maxError (a squared distance), returning the new index count
+	static unsigned int Simplify(unsigned int* destination, const unsigned int* indices, unsigned int indexCount, const Vertex* verts, unsigned int vertexCount, unsigned int targetIndexCount, float maxError);
+};
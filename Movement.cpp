@@ -0,0 +1,93 @@
+#include "Movement.h"
+
+// Each multiply and add rounds on its own, whichever compiler and
+// instruction set it's built for, so the game and the server agree
+#if defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Roll, then pitch, then yaw, as XMMatrixRotationRollPitchYaw()
+// has it, but from XMScalarSinCos() (which is the same code
+// everywhere, unlike the vector versions)
+// --------------------------------------------------------
+MovementAxes GetMovementAxes(XMFLOAT3 pitchYawRoll)
+{
+	float sp, cp, sy, cy, sr, cr;
+	XMScalarSinCos(&sp, &cp, pitchYawRoll.x);
+	XMScalarSinCos(&sy, &cy, pitchYawRoll.y);
+	XMScalarSinCos(&sr, &cr, pitchYawRoll.z);
+
+	MovementAxes axes;
+	axes.Right = XMFLOAT3(cr * cy + sr * sp * sy, sr * cp, sr * sp * cy - cr * sy);
+	axes.Up = XMFLOAT3(cr * sp * sy - sr * cy, cr * cp, sr * sy + cr * sp * cy);
+	axes.Forward = XMFLOAT3(cp * sy, -sp, cp * cy);
+	return axes;
+}
+
+void SimulatePlayerMovement(PlayerMovementState& state, const PlayerControls* controls, XMFLOAT3 pitchYawRoll, float dt)
+{
+	float speed = PLAYER_MOVE_SPEED;
+	float y = state.Position.y;
+
+	if (controls)
+	{
+		// Speed up or down as necessary
+		if (controls->Faster) { speed *= 1.6f; }
+		if (controls->Slower) { speed *= 0.5f; }
+
+		// Movement
+		if (controls->Forward) { state.Velocity.z = speed; }
+		else if (controls->Backward) { state.Velocity.z = -speed; }
+		else state.Velocity.z = 0;
+		if (controls->Left) { state.Velocity.x = -speed; }
+		else if (controls->Right) { state.Velocity.x = speed; }
+		else state.Velocity.x = 0;
+	}
+
+	// Falling, until the floor
+	if (y > PLAYER_FLOOR_HEIGHT)
+	{
+		state.Velocity.y += PLAYER_GRAVITY * dt;
+	}
+	else
+	{
+		state.Velocity.y = 0;
+		y = PLAYER_FLOOR_HEIGHT;
+	}
+
+	// Jump
+	if (controls && controls->Jump && y <= PLAYER_FLOOR_HEIGHT) { state.Velocity.y = PLAYER_JUMP_FORCE; }
+
+	// Across the ground the way the player's facing, with the vertical part
+	// of that left out (it's only ever the velocity's own)
+	MovementAxes axes = GetMovementAxes(pitchYawRoll);
+	float moveX = state.Velocity.x * dt;
+	float moveZ = state.Velocity.z * dt;
+	state.Position.x += moveX * axes.Right.x + moveZ * axes.Forward.x;
+	state.Position.z += moveX * axes.Right.z + moveZ * axes.Forward.z;
+	state.Position.y = y + state.Velocity.y * dt;
+}
+
+bool SimulateProjectileMovement(ProjectileMovementState& state, const MovementAxes& axes, float dt)
+{
+	state.Age += dt;
+	state.Velocity.y = state.Gravity * dt + state.Velocity.y;
+
+	// Local velocity onto the axes, in the order the batched version adds them
+	float moveX = state.Velocity.x * dt;
+	float moveY = state.Velocity.y * dt;
+	float moveZ = state.Velocity.z * dt;
+	state.Position.x = moveX * axes.Right.x + (moveY * axes.Up.x + (moveZ * axes.Forward.x + state.Position.x));
+	state.Position.y = moveX * axes.Right.y + (moveY * axes.Up.y + (moveZ * axes.Forward.y + state.Position.y));
+	state.Position.z = moveX * axes.Right.z + (moveY * axes.Up.z + (moveZ * axes.Forward.z + state.Position.z));
+
+	// Out of time, or out of the world
+	return state.Age < state.Lifespan && state.Position.y > PROJECTILE_KILL_HEIGHT;
+}
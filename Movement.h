@@ -0,0 +1,71 @@
+#pragma once
+
+#include "PortableMath.h"
+
+// Shared by the game and the server (see Server/GameServer), so the
+// server moves players and projectiles exactly as the game predicted
+//  - Plain float math one step at a time, with nothing allocated, and
+//    built without contracting multiplies and adds into FMAs (see
+//    Movement.cpp), so any build of either gives the same results
+//  - Both only ever step by their fixed tick (the game's fixed step
+//    loop and the server's TickScheduler), never a frame's dt
+
+#define PLAYER_MOVE_SPEED	15.0f
+#define PLAYER_GRAVITY		-19.6f
+#define PLAYER_JUMP_FORCE	8.0f
+#define PLAYER_FLOOR_HEIGHT	-3.0f	// TEMPORARY
+
+// Anything that falls below this is gone
+#define PROJECTILE_KILL_HEIGHT -6.0f
+
+// The keys that move a player, read once so the movement can be
+// run somewhere the keyboard can't be (like the simulation thread)
+struct PlayerControls
+{
+	bool Forward;
+	bool Backward;
+	bool Left;
+	bool Right;
+	bool Jump;
+	bool Faster;
+	bool Slower;
+};
+
+struct PlayerMovementState
+{
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 Velocity;
+};
+
+// The axes something facing pitchYawRoll moves along, the same rows
+// as XMMatrixRotationRollPitchYaw() but worked out one float at a time
+struct MovementAxes
+{
+	DirectX::XMFLOAT3 Right;
+	DirectX::XMFLOAT3 Up;
+	DirectX::XMFLOAT3 Forward;
+};
+
+// A projectile's part of a step, with its velocity along its axes
+//  - Gravity pulls along its up axis, like the rest of its velocity
+struct ProjectileMovementState
+{
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 Velocity;
+	float Gravity;
+	float Age;
+	float Lifespan;
+};
+
+MovementAxes GetMovementAxes(DirectX::XMFLOAT3 pitchYawRoll);
+
+// One step of a player's movement, facing pitchYawRoll
+//  - Without controls the player just falls (like the remote
+//    players, which only carry on with the velocity they had)
+void SimulatePlayerMovement(PlayerMovementState& state, const PlayerControls* controls, DirectX::XMFLOAT3 pitchYawRoll, float dt);
+
+// One step of a projectile's flight - age, then gravity, then the move
+// along its axes - returning false once it's out of time or has fallen
+// out of the world
+//  - ProjectileArrays::Update() does these same steps four at a time
+bool SimulateProjectileMovement(ProjectileMovementState& state, const MovementAxes& axes, float dt);
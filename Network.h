@@ -1,12 +1,41 @@
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
 #include <system_error>
 #include <string>
 #include <iostream>
-#include <winsock.h>
 
 #pragma once
+
+// Winsock on Windows, and BSD sockets everywhere else (the server's
+// built for Linux too), behind the same UDPSocket
+#ifdef _WIN32
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+#include <winsock.h>
 #pragma comment (lib, "ws2_32")
 
+typedef int SocketLength;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <algorithm>
+
+// What Windows.h's min and max macros are to the code that shares this
+using std::min;
+using std::max;
+
+typedef int SOCKET;
+typedef socklen_t SocketLength;
+#define INVALID_SOCKET -1
+#endif
+
+// How many datagrams SendBatch() hands the kernel at once, at most
+#define NETWORK_SEND_BATCH 64
+
+#ifdef _WIN32
 class WSASession
 {
 public:
@@ -24,61 +53,256 @@ public:
 private:
     WSAData data;
 };
+#else
+// Nothing to start up
+class WSASession
+{
+};
+#endif
 
+// What a socket call did, instead of throwing, since sends and receives
+// happen every tick and failing is a normal part of UDP
+//  - WouldBlock: nothing to receive yet (or no room to send)
+//  - Discarded: a datagram came in that's not usable, either too big
+//    for the buffer or an ICMP "port unreachable" from a peer that's gone,
+//    and there may be more behind it
+//  - Failed: see GetLastError()
+enum class SocketResult
+{
+    Success,
+    WouldBlock,
+    Discarded,
+    Failed
+};
+
+// A non-blocking UDP socket
+//  - Addresses are resolved once, with Resolve(), rather than on every send
+//  - A client talking to one server can Connect() to it and just Send()
+//  - The receiving thread sleeps in WaitForData(), then reads everything
+//    that's arrived until RecvFrom() says WouldBlock
 class UDPSocket
 {
 public:
     UDPSocket()
     {
+        lastError = 0;
         sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
         if (sock == INVALID_SOCKET)
-            throw std::system_error(WSAGetLastError(), std::system_category(), "Error opening socket");
+        {
+            lastError = LastSocketError();
+            return;
+        }
+
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        if (ioctlsocket(sock, FIONBIO, &nonBlocking) != 0)
+            lastError = LastSocketError();
+#else
+        if (fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) != 0)
+            lastError = LastSocketError();
+#endif
     }
     ~UDPSocket()
     {
-        closesocket(sock);
+        if (sock != INVALID_SOCKET)
+            Close(sock);
+    }
+
+    bool IsOpen() { return sock != INVALID_SOCKET; }
+    int GetLastError() { return lastError; }
+
+    // For overlapped I/O (or epoll) on it (see the server's ReceiveEngine)
+    SOCKET GetHandle() { return sock; }
+
+    // The port it's bound to (0 if it isn't)
+    unsigned short GetBoundPort()
+    {
+        sockaddr_in add = {};
+        SocketLength size = sizeof(add);
+        if (getsockname(sock, reinterpret_cast<sockaddr*>(&add), &size) != 0)
+            return 0;
+        return ntohs(add.sin_port);
+    }
+
+    // False when the address isn't a dotted IPv4 one
+    static bool Resolve(const std::string& address, unsigned short port, sockaddr_in& endpoint)
+    {
+        endpoint = {};
+        endpoint.sin_family = AF_INET;
+        endpoint.sin_addr.s_addr = inet_addr(address.c_str());
+        endpoint.sin_port = htons(port);
+        return endpoint.sin_addr.s_addr != INADDR_NONE;
     }
 
-    void SendTo(const std::string& address, unsigned short port, const char* buffer, int len, int flags = 0)
+    // Shared, every socket bound (shared) to the same port gets some of
+    // what comes in, picked by who it's from, so each can be read on its
+    // own core (SO_REUSEPORT, which Windows doesn't have, so it's ignored
+    // there)
+    SocketResult Bind(unsigned short port, bool shared = false)
     {
-        sockaddr_in add;
+#ifdef SO_REUSEPORT
+        int reuse = 1;
+        if (shared && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&reuse), sizeof(reuse)) != 0)
+            return Fail();
+#else
+        (void)shared;
+#endif
+
+        sockaddr_in add = {};
         add.sin_family = AF_INET;
-        add.sin_addr.s_addr = inet_addr(address.c_str());
+        add.sin_addr.s_addr = htonl(INADDR_ANY);
         add.sin_port = htons(port);
-        int ret = sendto(sock, buffer, len, flags, reinterpret_cast<SOCKADDR*>(&add), sizeof(add));
-        if (ret < 0)
-            throw std::system_error(WSAGetLastError(), std::system_category(), "sendto failed");
+
+        int ret = bind(sock, reinterpret_cast<sockaddr*>(&add), sizeof(add));
+        return ret < 0 ? Fail() : SocketResult::Success;
     }
-    void SendTo(sockaddr_in& address, const char* buffer, int len, int flags = 0)
+
+    // Sends from here go to, and only datagrams from there are received
+    // from, the one endpoint (which can be changed by connecting again)
+    SocketResult Connect(const sockaddr_in& endpoint)
     {
-        int ret = sendto(sock, buffer, len, flags, reinterpret_cast<SOCKADDR*>(&address), sizeof(address));
-        if (ret < 0)
-            throw std::system_error(WSAGetLastError(), std::system_category(), "sendto failed");
+        int ret = connect(sock, reinterpret_cast<const sockaddr*>(&endpoint), sizeof(endpoint));
+        return ret < 0 ? Fail() : SocketResult::Success;
+    }
+
+    SocketResult Send(const char* buffer, int len)
+    {
+        int ret = send(sock, buffer, len, 0);
+        return ret < 0 ? Fail() : SocketResult::Success;
+    }
+    SocketResult SendTo(const sockaddr_in& address, const char* buffer, int len)
+    {
+        int ret = (int)sendto(sock, buffer, len, 0, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+        return ret < 0 ? Fail() : SocketResult::Success;
+    }
+
+    // Each of count datagrams to its own address, as a few sendmmsg()
+    // calls on Linux (up to NETWORK_SEND_BATCH each) rather than one
+    // sendto() apiece, which is what it does everywhere else
+    //  - One that can't go is skipped, rather than holding up the rest,
+    //    and what happened to the last of those is what's returned
+    SocketResult SendBatch(const sockaddr_in* addresses, const char* const* buffers, const int* lengths, int count, int& sent)
+    {
+        SocketResult result = SocketResult::Success;
+        sent = 0;
+#ifdef __linux__
+        mmsghdr messages[NETWORK_SEND_BATCH];
+        iovec parts[NETWORK_SEND_BATCH];
+        int next = 0;
+        while (next < count)
+        {
+            int batch = count - next < NETWORK_SEND_BATCH ? count - next : NETWORK_SEND_BATCH;
+            for (int i = 0; i < batch; i++)
+            {
+                parts[i].iov_base = const_cast<char*>(buffers[next + i]);
+                parts[i].iov_len = lengths[next + i];
+                messages[i] = {};
+                messages[i].msg_hdr.msg_name = const_cast<sockaddr_in*>(&addresses[next + i]);
+                messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                messages[i].msg_hdr.msg_iov = &parts[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            // It stops at the first that fails, which is skipped
+            int ret = sendmmsg(sock, messages, batch, 0);
+            if (ret < 0)
+            {
+                result = Fail();
+                next++;
+                continue;
+            }
+            sent += ret;
+            next += ret;
+        }
+#else
+        for (int i = 0; i < count; i++)
+        {
+            SocketResult one = SendTo(addresses[i], buffers[i], lengths[i]);
+            if (one == SocketResult::Success)
+                sent++;
+            else
+                result = one;
+        }
+#endif
+        return result;
     }
-    sockaddr_in RecvFrom(char* buffer, int len, int flags = 0)
+
+    // The buffer needs room for one byte past len, which ends it with a zero
+    SocketResult RecvFrom(char* buffer, int len, int& received, sockaddr_in* from = 0)
     {
-        sockaddr_in from;
-        int size = sizeof(from);
-        int ret = recvfrom(sock, buffer, len, flags, reinterpret_cast<SOCKADDR*>(&from), &size);
+        sockaddr_in sender;
+        SocketLength size = sizeof(sender);
+        int ret = (int)recvfrom(sock, buffer, len, 0, reinterpret_cast<sockaddr*>(&sender), &size);
+        received = 0;
         if (ret < 0)
-            throw std::system_error(WSAGetLastError(), std::system_category(), "recvfrom failed");
+            return Fail();
 
         // make the buffer zero terminated
         buffer[ret] = 0;
-        return from;
+        received = ret;
+        if (from)
+            *from = sender;
+        return SocketResult::Success;
     }
-    void Bind(unsigned short port)
+
+    // Sleeps until there's something to receive (Success), or the time's
+    // up (WouldBlock)
+    //  - This is select(), since WSAPoll() needs winsock2.h, which can't
+    //    be included once Windows.h has pulled in winsock.h (as it has
+    //    everywhere this is)
+    SocketResult WaitForData(int timeoutMs)
     {
-        sockaddr_in add;
-        add.sin_family = AF_INET;
-        add.sin_addr.s_addr = htonl(INADDR_ANY);
-        add.sin_port = htons(port);
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+        timeval timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_usec = (timeoutMs % 1000) * 1000;
 
-        int ret = bind(sock, reinterpret_cast<SOCKADDR*>(&add), sizeof(add));
+        // (The first argument's ignored on Windows)
+        int ret = select((int)sock + 1, &readable, 0, 0, &timeout);
         if (ret < 0)
-            throw std::system_error(WSAGetLastError(), std::system_category(), "Bind failed");
+            return Fail();
+        return ret > 0 ? SocketResult::Success : SocketResult::WouldBlock;
     }
 
 private:
     SOCKET sock;
-};
\ No newline at end of file
+    int lastError;
+
+#ifdef _WIN32
+    static int LastSocketError() { return WSAGetLastError(); }
+    static void Close(SOCKET s) { closesocket(s); }
+#else
+    static int LastSocketError() { return errno; }
+    static void Close(SOCKET s) { close(s); }
+#endif
+
+    // (Linux says ECONNREFUSED where Windows says WSAECONNRESET, and
+    // never says a datagram was too big, since it's just cut short)
+    SocketResult Fail()
+    {
+        lastError = LastSocketError();
+        switch (lastError)
+        {
+#ifdef _WIN32
+        case WSAEWOULDBLOCK:
+            return SocketResult::WouldBlock;
+        case WSAEMSGSIZE:
+        case WSAECONNRESET:
+            return SocketResult::Discarded;
+#else
+        case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+        case EWOULDBLOCK:
+#endif
+            return SocketResult::WouldBlock;
+        case EMSGSIZE:
+        case ECONNREFUSED:
+            return SocketResult::Discarded;
+#endif
+        default:
+            return SocketResult::Failed;
+        }
+    }
+};
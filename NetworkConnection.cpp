@@ -0,0 +1,275 @@
+#include "NetworkConnection.h"
+
+#include <algorithm>
+
+NetworkConnection::NetworkConnection()
+{
+	Reset();
+}
+
+void NetworkConnection::Reset()
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	stats.Reset();
+	nextSequence = 0;
+	ackPending = false;
+	lastSendTime = 0;
+	resends = 0;
+	unreliableSize = 0;
+
+	for (SentPacket& packet : sentPackets)
+		packet.Valid = false;
+
+	for (ReliableChannel& channel : channels)
+	{
+		for (int i = 0; i < NETWORK_RELIABLE_WINDOW; i++)
+		{
+			channel.Sent[i].Pending = false;
+			channel.Received[i] = false;
+			channel.Held[i] = NetworkMessageView();
+		}
+		channel.NextSendId = 0;
+		channel.OldestUnacked = 0;
+		channel.NextReceiveId = 0;
+	}
+}
+
+bool NetworkConnection::Send(NetworkMessageWriter& message, unsigned char channel)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	int size = message.GetSize();
+	if (size > (int)NETWORK_MAX_MESSAGE_SIZE || channel >= NETWORK_CHANNEL_COUNT)
+		return false;
+
+	// Copied where it waits, with its channel and ID filled in
+	NetworkMessageHeader header;
+	std::memcpy(&header, message.GetData(), NETWORK_MESSAGE_HEADER_SIZE);
+	header.Channel = channel;
+
+	char* data;
+	if (channel == NETWORK_CHANNEL_UNRELIABLE)
+	{
+		if (unreliableSize + size > NETWORK_UNRELIABLE_QUEUE_SIZE)
+			return false;
+
+		data = unreliable + unreliableSize;
+		unreliableSize += size;
+	}
+	else
+	{
+		ReliableChannel& c = channels[channel];
+		if (size > NETWORK_MAX_RELIABLE_SIZE || (unsigned short)(c.NextSendId - c.OldestUnacked) >= NETWORK_RELIABLE_WINDOW)
+			return false;
+
+		header.Id = c.NextSendId++;
+		ReliableMessage& reliable = c.Sent[header.Id % NETWORK_RELIABLE_WINDOW];
+		reliable.Id = header.Id;
+		reliable.Pending = true;
+		reliable.LastSent = -1;
+		reliable.Size = size;
+		data = reliable.Data;
+	}
+
+	std::memcpy(data, message.GetData(), size);
+	std::memcpy(data, &header, NETWORK_MESSAGE_HEADER_SIZE);
+	return true;
+}
+
+unsigned int NetworkConnection::GetPendingReliable()
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	unsigned int pending = 0;
+	for (ReliableChannel& channel : channels)
+		pending += (unsigned short)(channel.NextSendId - channel.OldestUnacked);
+	return pending;
+}
+
+int NetworkConnection::GetQueuedBytes()
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+	return unreliableSize;
+}
+
+void NetworkConnection::Flush(double now, bool resendAll)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	char datagram[NETWORK_MAX_PACKET_SIZE];
+	int size = NETWORK_PACKET_HEADER_SIZE;
+	SentPacket record;
+	record.Count = 0;
+
+	// Finishes the datagram that's been filled, and starts the next
+	auto emit = [&]()
+	{
+		NetworkPacketHeader header = {};
+		header.Sequence = nextSequence++;
+		stats.OnSend(header, size, now);
+		std::memcpy(datagram, &header, NETWORK_PACKET_HEADER_SIZE);
+
+		record.Sequence = header.Sequence;
+		record.Valid = record.Count > 0;
+		sentPackets[header.Sequence % NETWORK_SENT_PACKET_WINDOW] = record;
+
+		if (sender)
+			sender(datagram, size);
+		ackPending = false;
+		lastSendTime = now;
+
+		size = NETWORK_PACKET_HEADER_SIZE;
+		record.Count = 0;
+	};
+
+	// Reliable messages first, so they're never crowded out
+	double timeout = std::min(std::max(2.0 * stats.GetRtt(), NETWORK_RESEND_MIN), NETWORK_RESEND_MAX);
+	for (unsigned char channel = NETWORK_CHANNEL_RELIABLE; channel < NETWORK_CHANNEL_COUNT; channel++)
+	{
+		ReliableChannel& c = channels[channel];
+		for (unsigned short id = c.OldestUnacked; id != c.NextSendId; id++)
+		{
+			ReliableMessage& reliable = c.Sent[id % NETWORK_RELIABLE_WINDOW];
+			if (!reliable.Pending) continue;
+			if (!resendAll && reliable.LastSent >= 0 && now - reliable.LastSent < timeout) continue;
+
+			if (size + reliable.Size > NETWORK_MAX_PACKET_SIZE || record.Count == NETWORK_RELIABLE_PER_PACKET)
+				emit();
+
+			std::memcpy(datagram + size, reliable.Data, reliable.Size);
+			size += reliable.Size;
+			record.Channel[record.Count] = channel;
+			record.Id[record.Count] = id;
+			record.Count++;
+
+			if (reliable.LastSent >= 0)
+				resends++;
+			reliable.LastSent = now;
+		}
+	}
+
+	// Then everything else, in the order it was queued
+	int offset = 0;
+	while (offset < unreliableSize)
+	{
+		NetworkMessageHeader header;
+		std::memcpy(&header, unreliable + offset, NETWORK_MESSAGE_HEADER_SIZE);
+		int messageSize = (int)(NETWORK_MESSAGE_HEADER_SIZE + header.Length);
+
+		if (size + messageSize > NETWORK_MAX_PACKET_SIZE)
+			emit();
+
+		std::memcpy(datagram + size, unreliable + offset, messageSize);
+		size += messageSize;
+		offset += messageSize;
+	}
+	unreliableSize = 0;
+
+	// And if there's nothing at all, the ack by itself once it's waited a bit
+	if (size > (int)NETWORK_PACKET_HEADER_SIZE || (ackPending && now - lastSendTime >= NETWORK_ACK_TIMEOUT))
+		emit();
+}
+
+void NetworkConnection::Receive(NetworkPacketRef packet, const MessageHandler& handler)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	if (!packet || packet->Size < (int)NETWORK_PACKET_HEADER_SIZE)
+		return;
+
+	NetworkPacketHeader header;
+	std::memcpy(&header, packet->Data, NETWORK_PACKET_HEADER_SIZE);
+	stats.OnReceive(header, packet->Size, packet->ReceivedTime);
+	ackPending = true;
+
+	// What it says the other side has of ours
+	if (header.Flags & NETWORK_HEADER_HAS_ACK)
+	{
+		AcknowledgePacket(header.Ack);
+		for (unsigned int n = 0; n < 32; n++)
+			if (header.AckBits & (1u << n))
+				AcknowledgePacket(header.Ack - 1 - n);
+	}
+
+	// Then each message in it, until one doesn't fit
+	int offset = NETWORK_PACKET_HEADER_SIZE;
+	int size = packet->Size;
+	while (offset < size)
+	{
+		NetworkMessageView message(packet, offset);
+		if (!message.IsValid())
+			break;
+		offset += message.GetSize();
+
+		unsigned char channel = message.GetHeader().Channel;
+		if (channel == NETWORK_CHANNEL_UNRELIABLE)
+			handler(message);
+		else if (channel < NETWORK_CHANNEL_COUNT)
+			ReceiveReliable(message, handler);
+	}
+}
+
+void NetworkConnection::AcknowledgePacket(unsigned int sequence)
+{
+	SentPacket& record = sentPackets[sequence % NETWORK_SENT_PACKET_WINDOW];
+	if (!record.Valid || record.Sequence != sequence)
+		return;
+	record.Valid = false;
+
+	for (int i = 0; i < record.Count; i++)
+	{
+		ReliableChannel& c = channels[record.Channel[i]];
+		ReliableMessage& reliable = c.Sent[record.Id[i] % NETWORK_RELIABLE_WINDOW];
+		if (reliable.Pending && reliable.Id == record.Id[i])
+			reliable.Pending = false;
+
+		// Which might free up the front of the window
+		while (c.OldestUnacked != c.NextSendId && !c.Sent[c.OldestUnacked % NETWORK_RELIABLE_WINDOW].Pending)
+			c.OldestUnacked++;
+	}
+}
+
+// --------------------------------------------------------
+// A reliable message that's arrived, which might be one
+// that's already been (if its ack was lost, and it was
+// resent), or on the ordered channel, one that's early
+//  - The sender never has more than a window of them out,
+//    so anything further back than that is a repeat
+// --------------------------------------------------------
+void NetworkConnection::ReceiveReliable(const NetworkMessageView& message, const MessageHandler& handler)
+{
+	unsigned char channel = message.GetHeader().Channel;
+	unsigned short id = message.GetHeader().Id;
+	ReliableChannel& c = channels[channel];
+	int slot = id % NETWORK_RELIABLE_WINDOW;
+
+	if (channel == NETWORK_CHANNEL_RELIABLE)
+	{
+		if (c.Received[slot] && c.ReceivedIds[slot] == id) return;
+		if ((short)(id - c.NextReceiveId) < -NETWORK_RELIABLE_WINDOW) return;
+
+		c.Received[slot] = true;
+		c.ReceivedIds[slot] = id;
+		if ((short)(id - c.NextReceiveId) >= 0)
+			c.NextReceiveId = id + 1;	// The newest, for telling what's too old
+		handler(message);
+		return;
+	}
+
+	// Ordered: held until everything before it has been handed over
+	if ((unsigned short)(id - c.NextReceiveId) >= NETWORK_RELIABLE_WINDOW) return;
+	if (c.Received[slot]) return;
+
+	c.Received[slot] = true;
+	c.Held[slot] = message;
+	while (c.Received[c.NextReceiveId % NETWORK_RELIABLE_WINDOW])
+	{
+		int next = c.NextReceiveId % NETWORK_RELIABLE_WINDOW;
+		NetworkMessageView ready = c.Held[next];
+		c.Held[next] = NetworkMessageView();
+		c.Received[next] = false;
+		c.NextReceiveId++;
+		handler(ready);
+	}
+}
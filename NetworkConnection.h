@@ -0,0 +1,130 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include "NetworkMessage.h"
+#include "NetworkPacketPool.h"
+#include "NetworkStats.h"
+
+// Shared by the game and the server (see Server/GameServer)
+
+// How many reliable messages each channel can have waiting to be
+// acknowledged (or held back, to be handed over in order), which is
+// a power of two well under the 65536 IDs there are
+#define NETWORK_RELIABLE_WINDOW		64
+
+// Reliable messages are kept until they're acknowledged, so they're
+// limited to this size, which is plenty for the events they're for
+#define NETWORK_MAX_RELIABLE_SIZE	256
+
+// The most reliable messages sent in one datagram, which are what's
+// remembered of it, to mark acknowledged when it is
+#define NETWORK_RELIABLE_PER_PACKET	16
+
+// How many sent datagrams are remembered for that (like NETWORK_STATS_SENT_WINDOW)
+#define NETWORK_SENT_PACKET_WINDOW	64
+
+// Unreliable messages wait for the next Flush() in this much room
+#define NETWORK_UNRELIABLE_QUEUE_SIZE	(4 * NETWORK_MAX_PACKET_SIZE)
+
+// A reliable message is sent again once it's gone unacknowledged for
+// twice the round trip, within these limits (in seconds)
+#define NETWORK_RESEND_MIN			0.1
+#define NETWORK_RESEND_MAX			1.0
+
+// With nothing else to send, an ack goes by itself after this long
+#define NETWORK_ACK_TIMEOUT			0.05
+
+// Messages both ways over UDP, on three channels (see NETWORK_CHANNEL_UNRELIABLE)
+//  - Everything queued is coalesced into as few datagrams as it fits in,
+//    with reliable messages that are due to be resent going first
+//  - Each datagram acknowledges the ones received (see NetworkPacketHeader),
+//    and a reliable message is done with once a datagram it was in is
+//  - Thread safe (and Receive()'s handler can send), since the server
+//    sends from one thread and receives on another
+class NetworkConnection
+{
+public:
+	// Sends one whole datagram to the other side
+	typedef std::function<void(const char* data, int size)> DatagramSender;
+	typedef std::function<void(const NetworkMessageView& message)> MessageHandler;
+
+	NetworkConnection();
+
+	void SetSender(DatagramSender send) { sender = send; }
+	void Reset();
+
+	// Queues a message for the next Flush(), returning false if there's no
+	// room for it (or, on a reliable channel, it's too big or the window's full)
+	bool Send(NetworkMessageWriter& message, unsigned char channel);
+
+	// Sends everything queued, and any reliable messages due to be resent
+	//  - resendAll: every unacknowledged one goes now, like when there
+	//    won't be another chance
+	void Flush(double now, bool resendAll = false);
+
+	// Reads a received datagram, handing over each of its messages that's
+	// new, and on the ordered channel, any held back until it came
+	void Receive(NetworkPacketRef packet, const MessageHandler& handler);
+
+	NetworkConnectionStats& GetStats() { return stats; }
+	unsigned int GetResends() { return resends; }
+
+	// How much is waiting: reliable messages not acknowledged yet, and
+	// bytes of unreliable ones queued for the next Flush()
+	unsigned int GetPendingReliable();
+	int GetQueuedBytes();
+
+private:
+	std::recursive_mutex lock;
+	DatagramSender sender;
+	NetworkConnectionStats stats;
+
+	unsigned int nextSequence;	// Of the next datagram
+	bool ackPending;			// Something's been received since the last datagram went
+	double lastSendTime;
+	unsigned int resends;
+
+	char unreliable[NETWORK_UNRELIABLE_QUEUE_SIZE];
+	int unreliableSize;
+
+	// Which reliable messages went in each datagram
+	struct SentPacket
+	{
+		unsigned int Sequence;
+		bool Valid;
+		int Count;
+		unsigned char Channel[NETWORK_RELIABLE_PER_PACKET];
+		unsigned short Id[NETWORK_RELIABLE_PER_PACKET];
+	};
+	SentPacket sentPackets[NETWORK_SENT_PACKET_WINDOW];
+
+	struct ReliableMessage
+	{
+		unsigned short Id;
+		bool Pending;		// Not acknowledged yet
+		double LastSent;	// Negative until it's first sent
+		int Size;
+		char Data[NETWORK_MAX_RELIABLE_SIZE];
+	};
+
+	// Each reliable channel's messages out, by ID, from the oldest that's
+	// not acknowledged, and what's come in
+	//  - Unordered: the IDs received, to ignore resends of
+	//  - Ordered: the messages that came early, until the ones before them do
+	struct ReliableChannel
+	{
+		ReliableMessage Sent[NETWORK_RELIABLE_WINDOW];
+		unsigned short NextSendId;
+		unsigned short OldestUnacked;
+
+		unsigned short ReceivedIds[NETWORK_RELIABLE_WINDOW];
+		bool Received[NETWORK_RELIABLE_WINDOW];
+		NetworkMessageView Held[NETWORK_RELIABLE_WINDOW];
+		unsigned short NextReceiveId;
+	};
+	ReliableChannel channels[NETWORK_CHANNEL_COUNT];	// The unreliable one's unused
+
+	void AcknowledgePacket(unsigned int sequence);
+	void ReceiveReliable(const NetworkMessageView& message, const MessageHandler& handler);
+};
@@ -0,0 +1,213 @@
+#include "NetworkEntropy.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// The coder keeps its range at least this big, shifting a byte out
+// (or in) whenever it drops under
+#define NET_ENTROPY_RANGE_MIN (1u << 24)
+
+// How the coded payload says how long the original was
+#define NET_ENTROPY_SIZE_BYTES 2
+
+NetEntropyModel::NetEntropyModel()
+{
+	loaded = false;
+	id = 0;
+}
+
+bool NetEntropyModel::Load(const std::string& path)
+{
+	loaded = false;
+	std::ifstream file(path);
+	if (!file) return false;
+
+	// Any line starting with # is a comment, and the rest is the frequencies
+	std::stringstream numbers;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (!line.empty() && line[0] != '#')
+			numbers << line << ' ';
+	}
+
+	unsigned int total = 0;
+	for (int i = 0; i < 256; i++)
+	{
+		unsigned int value = 0;
+		if (!(numbers >> value) || value == 0 || value > NET_ENTROPY_TOTAL)
+			return false;
+		frequency[i] = (unsigned short)value;
+		total += value;
+	}
+	if (total != NET_ENTROPY_TOTAL)
+		return false;
+
+	// Where each starts, and which each slot is, for decoding in one look up
+	cumulative[0] = 0;
+	for (int i = 0; i < 256; i++)
+	{
+		cumulative[i + 1] = cumulative[i] + frequency[i];
+		memset(symbols + cumulative[i], i, frequency[i]);
+	}
+
+	// FNV-1a, over the frequencies
+	id = 2166136261u;
+	for (int i = 0; i < 256; i++)
+	{
+		id = (id ^ (frequency[i] & 0xFF)) * 16777619u;
+		id = (id ^ (frequency[i] >> 8)) * 16777619u;
+	}
+	loaded = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// A range coder with carries (like LZMA's), a byte at a time
+//  - The first byte out is always zero, so it's left off,
+//    and so are any zeros at the end, since the decoder
+//    reads zeros past the end anyway
+// --------------------------------------------------------
+int NetEntropyModel::Encode(const char* data, int size, char* out, int capacity) const
+{
+	if (!loaded || size <= 0 || size > 0xFFFF || capacity <= NET_ENTROPY_SIZE_BYTES)
+		return 0;
+
+	out[0] = (char)(size & 0xFF);
+	out[1] = (char)(size >> 8);
+	int written = NET_ENTROPY_SIZE_BYTES;
+	bool first = true;
+	bool full = false;
+	auto put = [&](unsigned char value)
+	{
+		if (first)
+			first = false;
+		else if (written < capacity)
+			out[written++] = (char)value;
+		else
+			full = true;
+	};
+
+	unsigned long long low = 0;
+	unsigned int range = 0xFFFFFFFF;
+	unsigned char cache = 0;
+	unsigned long long cacheSize = 1;
+	auto shiftLow = [&]()
+	{
+		if ((unsigned int)low < 0xFF000000u || (low >> 32) != 0)
+		{
+			unsigned char carry = (unsigned char)(low >> 32);
+			unsigned char pending = cache;
+			do
+			{
+				put((unsigned char)(pending + carry));
+				pending = 0xFF;
+			} while (--cacheSize != 0);
+			cache = (unsigned char)(low >> 24);
+		}
+		cacheSize++;
+		low = (low & 0x00FFFFFF) << 8;
+	};
+
+	for (int i = 0; i < size && !full; i++)
+	{
+		unsigned char symbol = (unsigned char)data[i];
+		unsigned int r = range >> NET_ENTROPY_TOTAL_BITS;
+		low += (unsigned long long)r * cumulative[symbol];
+		range = r * frequency[symbol];
+		while (range < NET_ENTROPY_RANGE_MIN)
+		{
+			range <<= 8;
+			shiftLow();
+		}
+	}
+	for (int i = 0; i < 5; i++)
+		shiftLow();
+
+	while (written > NET_ENTROPY_SIZE_BYTES && out[written - 1] == 0)
+		written--;
+	return (full || written >= size) ? 0 : written;
+}
+
+int NetEntropyModel::Decode(const char* data, int size, char* out, int capacity) const
+{
+	if (!loaded || size < NET_ENTROPY_SIZE_BYTES)
+		return -1;
+
+	int length = (unsigned char)data[0] | ((unsigned char)data[1] << 8);
+	if (length > capacity)
+		return -1;
+
+	int read = NET_ENTROPY_SIZE_BYTES;
+	auto next = [&]() { return read < size ? (unsigned char)data[read++] : 0u; };
+
+	unsigned int code = 0;
+	unsigned int range = 0xFFFFFFFF;
+	for (int i = 0; i < 4; i++)
+		code = (code << 8) | next();
+
+	for (int i = 0; i < length; i++)
+	{
+		unsigned int r = range >> NET_ENTROPY_TOTAL_BITS;
+		unsigned int slot = code / r;
+		if (slot >= NET_ENTROPY_TOTAL)
+			return -1;
+
+		unsigned char symbol = symbols[slot];
+		out[i] = (char)symbol;
+		code -= r * cumulative[symbol];
+		range = r * frequency[symbol];
+		while (range < NET_ENTROPY_RANGE_MIN)
+		{
+			code = (code << 8) | next();
+			range <<= 8;
+		}
+	}
+	return length;
+}
+
+NetEntropyTrainer::NetEntropyTrainer()
+{
+	memset(counts, 0, sizeof(counts));
+	bytes = 0;
+}
+
+void NetEntropyTrainer::Add(const char* data, int size)
+{
+	for (int i = 0; i < size; i++)
+		counts[(unsigned char)data[i]]++;
+	bytes += size;
+}
+
+void NetEntropyTrainer::Add(const NetEntropyTrainer& other)
+{
+	for (int i = 0; i < 256; i++)
+		counts[i] += other.counts[i];
+	bytes += other.bytes;
+}
+
+bool NetEntropyTrainer::Save(const std::string& path)
+{
+	if (bytes == 0) return false;
+
+	// One each, the rest shared out by how often each came up, and
+	// whatever rounding leaves over to the most common
+	unsigned int frequency[256];
+	unsigned int total = 0;
+	int common = 0;
+	for (int i = 0; i < 256; i++)
+	{
+		frequency[i] = 1 + (unsigned int)(counts[i] * (NET_ENTROPY_TOTAL - 256) / bytes);
+		total += frequency[i];
+		if (counts[i] > counts[common])
+			common = i;
+	}
+	frequency[common] += NET_ENTROPY_TOTAL - total;
+
+	std::ofstream file(path, std::ios::trunc);
+	file << "# Snapshot byte frequencies, out of " << NET_ENTROPY_TOTAL << ", from " << bytes << " bytes\n";
+	for (int i = 0; i < 256; i++)
+		file << frequency[i] << ((i % 16 == 15) ? "\n" : " ");
+	return (bool)file;
+}
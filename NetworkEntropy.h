@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+
+// Shared by the game and the server (see Server/GameServer)
+
+// Frequencies of a model add up to this (a power of two, so the coder
+// can shift by it rather than divide)
+#define NET_ENTROPY_TOTAL_BITS	12
+#define NET_ENTROPY_TOTAL		(1u << NET_ENTROPY_TOTAL_BITS)
+
+// Where the client looks for a model, and the server writes one it's
+// trained (see -entropytrain)
+#define NET_ENTROPY_MODEL_PATH	"snapshot.entropy"
+
+// How each byte of a serialized snapshot's likely to be, trained
+// offline from what the server built for some recorded traffic, and
+// a static range coder that packs the bytes by it
+//  - Bit packed snapshots are still mostly zeros (unchanged fields,
+//    empty projectile slots, small deltas) whatever the byte lines up
+//    with, so even one frequency per byte value takes a lot off
+//  - Both sides have to have the same model, which is what its ID
+//    (a hash of its frequencies) is for - the client says which it
+//    has when it connects, and the server only codes snapshots for
+//    clients with its own
+//  - Coded payloads start with how long the original was (2 bytes),
+//    then the coder's bytes
+class NetEntropyModel
+{
+public:
+	NetEntropyModel();
+
+	// A model written by NetEntropyTrainer::Save()
+	bool Load(const std::string& path);
+
+	bool IsLoaded() const { return loaded; }
+	unsigned int GetID() const { return id; }
+
+	// Returns how many bytes it took, or 0 if it wouldn't fit (or
+	// wouldn't be any smaller), in which case the original is sent
+	int Encode(const char* data, int size, char* out, int capacity) const;
+
+	// Returns how long the original was, or -1 if it's not a coded
+	// payload (or is cut short, or wouldn't fit)
+	int Decode(const char* data, int size, char* out, int capacity) const;
+
+private:
+	bool loaded;
+	unsigned int id;
+	unsigned short frequency[256];
+	unsigned short cumulative[257];
+	unsigned char symbols[NET_ENTROPY_TOTAL];	// Which byte each of the total's slots is
+};
+
+// Counts the bytes of every snapshot (with the server's -entropytrain)
+// for a model to be made from
+class NetEntropyTrainer
+{
+public:
+	NetEntropyTrainer();
+
+	void Add(const char* data, int size);
+	void Add(const NetEntropyTrainer& other);
+
+	unsigned long long GetBytes() { return bytes; }
+
+	// Scaled to NET_ENTROPY_TOTAL, with every byte value at least one,
+	// so anything can still be coded
+	bool Save(const std::string& path);
+
+private:
+	unsigned long long counts[256];
+	unsigned long long bytes;
+};
@@ -1,25 +1,112 @@
 #include "NetworkManager.h"
+#include "CpuProfiler.h"
+#include "ThreadManager.h"
 #include <bitset>
+#include <chrono>
+
+using namespace DirectX;
 
 void NetworkManager::ReceiveFrom()
 {
+	CpuProfiler::GetInstance().NameThread("Network Receive");
+	ThreadManager::GetInstance().Configure(ThreadRole::Network, "Network Receive");
 	while (running)
 	{
-		while (!newData)
+		// Sleeps until something arrives, waking now and then to see if it should stop
+		SocketResult ready = socket.WaitForData(NETWORK_RECEIVE_WAIT_MS);
+		if (ready == SocketResult::WouldBlock)
+			continue;
+
+		// Then reads everything that's there
+		while (ready == SocketResult::Success)
 		{
-			try 
+			// Received right into a packet from the pool, or thrown away
+			// when the game thread's fallen so far behind there's none
+			NetworkPacketRef packet = packetPool.Acquire();
+			int dropped = 0;
+			ready = packet ?
+				socket.RecvFrom(packet->Data, NETWORK_MAX_PACKET_SIZE, packet->Size) :
+				socket.RecvFrom(droppedPacket, NETWORK_MAX_PACKET_SIZE, dropped);
+			if (ready == SocketResult::Discarded)
 			{
-				socket.RecvFrom(recvBuffer, 500);
+				ready = SocketResult::Success;
+				continue;
 			}
-			catch (std::exception& ex)
-			{
-				std::cout << "RecvFrom error." << std::endl;
-				running = false;
-				Disconnect();
-			}
-			newData = true;
+			if (ready != SocketResult::Success)
+				break;
+
+			if (packet)
+				packet->ReceivedTime = NetworkNow();
+			if (!packet || !receiveQueue.Push(std::move(packet)))
+				droppedPackets++;
+		}
+
+		if (ready == SocketResult::Failed)
+		{
+			// Update() disconnects once it sees the thread's stopped
+			std::cout << "RecvFrom error " << socket.GetLastError() << "." << std::endl;
+			running = false;
 		}
 	}
+
+	ThreadManager::GetInstance().Unregister();
+}
+
+// --------------------------------------------------------
+// Onto the send thread's queue, from a packet from the pool
+// --------------------------------------------------------
+void NetworkManager::QueueDatagram(const char* data, int size)
+{
+	NetworkPacketRef packet = packetPool.Acquire();
+	if (!packet)
+	{
+		droppedSends++;
+		return;
+	}
+
+	std::memcpy(packet->Data, data, size);
+	packet->Size = size;
+	if (!sendQueue.Push(std::move(packet)))
+	{
+		droppedSends++;
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sendMutex);
+		sendPending = true;
+	}
+	sendReady.notify_one();
+}
+
+// --------------------------------------------------------
+// The send thread: sleeps until there's something queued,
+// and sends it all, until it's told to stop (sending
+// whatever's left first, like the disconnects)
+//  - A failed send is just dropped, like a lost datagram
+// --------------------------------------------------------
+void NetworkManager::SendQueued()
+{
+	CpuProfiler::GetInstance().NameThread("Network Send");
+	ThreadManager::GetInstance().Configure(ThreadRole::Network, "Network Send");
+	bool stopping = false;
+	while (!stopping)
+	{
+		{
+			std::unique_lock<std::mutex> lock(sendMutex);
+			sendReady.wait_for(lock, std::chrono::milliseconds(NETWORK_RECEIVE_WAIT_MS), [&] { return sendPending || !running; });
+			sendPending = false;
+		}
+		stopping = !running;
+
+		while (NetworkPacketRef packet = sendQueue.Pop())
+		{
+			if (socket.Send(packet->Data, packet->Size) != SocketResult::Success)
+				droppedSends++;
+		}
+	}
+
+	ThreadManager::GetInstance().Unregister();
 }
 
 NetworkManager::~NetworkManager()
@@ -30,12 +117,10 @@ NetworkManager::~NetworkManager()
 		Player* p = remotePlayers[i];
 		if (p == nullptr) continue;
 
-		auto it = find(entities->begin(), entities->end(), p);
 		auto it2 = find(remotePlayers.begin(), remotePlayers.end(), p);
-		entities->erase(it);
 		remotePlayers.erase(it2);
 		delete p->GetCamera();
-		delete p;
+		entities->Destroy(p);
 	}
 
 	if (state != NetworkState::Offline)
@@ -47,6 +132,15 @@ NetworkManager::~NetworkManager()
 NetworkResult NetworkManager::Connect(std::string ip, int port, Player* local, Mesh* mesh, Material* mat)
 {
 	
+	// Resolved once, with everything after sent straight to it
+	sockaddr_in server;
+	if (!socket.IsOpen() || !UDPSocket::Resolve(ip, (unsigned short)port, server) ||
+		socket.Connect(server) != SocketResult::Success)
+	{
+		std::cout << "Couldn't connect to " << ip << ":" << port << " (" << socket.GetLastError() << ")." << std::endl;
+		return NetworkResult::FAILURE;
+	}
+
 	IP = ip;
 	PORT = port;
 
@@ -54,50 +148,69 @@ NetworkResult NetworkManager::Connect(std::string ip, int port, Player* local, M
 	playerMat = mat;
 
 	state = NetworkState::Connecting;
-	try
-	{
-		socket.Bind(0);
-	}
-	catch (std::exception& ex)
-	{
 
-	}
-
-	//Clear buffers
-	std::fill_n(sendBuffer, 500, 0);
-	std::fill_n(recvBuffer, 500, 0);
-
-	unsigned int msgType = 1;
-
-	std::memcpy(&sendBuffer, &msgType, 4);
-
-	//Send initial position and velocity
-	CopyPlayerMovementData(local, &sendBuffer[0] + 4);
-
-	socket.SendTo(IP, PORT, sendBuffer, 500);
+	receiveQueue.Clear();
+	sendQueue.Clear();
+	droppedPackets = 0;
+	droppedSends = 0;
+	nextSendTime = 0;
+	lastSentInput = 0;
+	connection.Reset();
+	receivedUpdate = false;
+	for (WorldSnapshot& snapshot : receivedSnapshots)
+		snapshot.Valid = false;
+	inputSequence = 0;
+	for (PlayerInputFrame& input : inputHistory)
+		input.Sequence = 0;
+	remoteSamples.clear();
+	serverProjectiles.clear();
+	for (BoundProjectile& shot : pendingShots)
+		shot.Bound = false;
+	shotSequence = 0;
+	serverClockKnown = false;
+	serverTickRate = NET_SERVER_TICK_RATE;
+
+	//Coded snapshots are only sent if the server has the same model
+	entropyModel.Load(NET_ENTROPY_MODEL_PATH);
+	codedSnapshots = 0;
+	averageCodedBytes = 0;
+	averageDecodedBytes = 0;
+	averageDecodeMicroseconds = 0;
+
+	//Send initial position and velocity (and which model we have)
+	NetConnectRequest request = { GetPlayerState(local), entropyModel.IsLoaded(), entropyModel.GetID() };
+	NetworkMessageWriter message = NetWriteMessage(sendBuffer, sizeof(sendBuffer), request);
+
+	connection.Send(message, NETWORK_CHANNEL_ORDERED);
+	connection.Flush(NetworkNow());
 
 	running = true;
 	recvFromThread = std::thread(&NetworkManager::ReceiveFrom, this);
+	sendThread = std::thread(&NetworkManager::SendQueued, this);
 
 	return NetworkResult::SUCCESS;
 }
 
 NetworkResult NetworkManager::Disconnect()
 {
-	std::fill_n(sendBuffer, 500, 0);
-
-	unsigned int msgType = 4;
-	std::memcpy(&sendBuffer, &msgType, 4);
-	msgType = playerID;
-	std::memcpy(&sendBuffer[0] + 4, &msgType, 4);
-	socket.SendTo(IP, PORT, sendBuffer, 500);
+	NetDisconnect disconnect = { playerID };
+	NetworkMessageWriter message = NetWriteMessage(sendBuffer, sizeof(sendBuffer), disconnect);
+	connection.Send(message, NETWORK_CHANNEL_ORDERED);
+	for (int i = 0; i < NETWORK_DISCONNECT_SENDS; i++)
+		connection.Flush(NetworkNow(), true);
 
 	IP = "";
 	PORT = 0;
-	running = false;
-	newData = true;
+	{
+		std::lock_guard<std::mutex> lock(sendMutex);
+		running = false;
+	}
+	sendReady.notify_one();
 	//session.~WSASession();
-	recvFromThread.join();
+	if (recvFromThread.joinable())
+		recvFromThread.join();
+	if (sendThread.joinable())
+		sendThread.join();
 	//socket.~UDPSocket();
 	//socket = UDPSocket();
 	//session = WSASession();
@@ -106,240 +219,491 @@ NetworkResult NetworkManager::Disconnect()
 	return NetworkResult::SUCCESS;
 }
 
-//Takes 36 Bytes
-void NetworkManager::CopyPlayerMovementData(Player* player, char* bff)
+PlayerNetState NetworkManager::GetPlayerState(Player* player)
 {
+	Transform* transform = player->GetCamera()->GetTransform();
 
-	float x = player->GetCamera()->GetTransform()->GetPosition().x;
-	float y = player->GetCamera()->GetTransform()->GetPosition().y;
-	float z = player->GetCamera()->GetTransform()->GetPosition().z;
-
-	//Position x/y/z
-	std::memcpy(bff, &x, 4);
-	std::memcpy(bff + 4, &y, 4);
-	std::memcpy(bff + 8, &z, 4);
-
-	//Velocity x/y/z
-	std::memcpy(bff + 12, &player->velocityX, 4);
-	std::memcpy(bff + 16, &player->velocityY, 4);
-	std::memcpy(bff + 20, &player->velocityZ, 4);
-
-	//Rotation pitch/yaw/roll
+	PlayerNetState state;
+	state.Position = transform->GetPosition();
+	state.Velocity = XMFLOAT3(player->velocityX, player->velocityY, player->velocityZ);
+	state.PitchYawRoll = transform->GetPitchYawRoll();
+	return state;
+}
 
-	float pitch = player->GetCamera()->GetTransform()->GetPitchYawRoll().x;
-	float yaw = player->GetCamera()->GetTransform()->GetPitchYawRoll().y;
-	float roll = player->GetCamera()->GetTransform()->GetPitchYawRoll().z;
+void NetworkManager::SetPlayerState(Player* player, const PlayerNetState& state)
+{
+	Transform* transform = player->GetCamera()->GetTransform();
+	transform->SetPosition(state.Position.x, state.Position.y, state.Position.z);
+	player->SetVelocity(state.Velocity.x, state.Velocity.y, state.Velocity.z);
+	transform->SetRotation(state.PitchYawRoll.x, state.PitchYawRoll.y, state.PitchYawRoll.z);
+}
 
-	std::memcpy(bff + 24, &pitch, 4);
-	std::memcpy(bff + 28, &yaw, 4);
-	std::memcpy(bff + 32, &roll, 4);
+ProjectileNetState NetworkManager::GetProjectileState(ProjectilePool* projectiles, unsigned int index)
+{
+	SimulatedProjectile projectile = projectiles->GetState(index);
+
+	ProjectileNetState state;
+	state.Position = projectile.Position;
+	state.Velocity = projectile.Velocity;
+	state.PitchYawRoll = projectile.PitchYawRoll;
+	state.Gravity = projectile.Gravity;
+	state.Lifespan = projectile.Lifespan;
+	state.Age = projectile.Age;
+	state.Owner = NetPlayerSlot(playerID);
+	state.Shot = 0;
+	return state;
 }
 
-void NetworkManager::ReadPlayerMovementData(Player* player, char* buffer)
+void NetworkManager::SetProjectileState(ProjectilePool* projectiles, unsigned int index, const ProjectileNetState& state)
 {
-	float* bff = (float*)buffer;
-
-	float posX, posY, posZ, velX, velY, velZ, pitch, yaw, roll;
-	posX = *bff;
-	posY = *(bff+1);
-	posZ = *(bff+2);
-	velX = *(bff+3);
-	velY = *(bff+4);
-	velZ = *(bff+5);
-	pitch = *(bff + 6);
-	yaw = *(bff + 7);
-	roll = *(bff + 8);
-
-	player->GetCamera()->GetTransform()->SetPosition(posX, posY, posZ);
-	player->SetVelocity(velX, velY, velZ);
-	player->GetCamera()->GetTransform()->SetRotation(pitch, yaw, roll);
+	// Whether it's live is up to this side
+	SimulatedProjectile projectile = projectiles->GetState(index);
+	projectile.Position = state.Position;
+	projectile.Velocity = state.Velocity;
+	projectile.PitchYawRoll = state.PitchYawRoll;
+	projectile.Gravity = state.Gravity;
+	projectile.Lifespan = state.Lifespan;
+	projectile.Age = state.Age;
+	projectiles->SetState(index, projectile);
 }
 
-//Takes 40 bytes
-void NetworkManager::CopyProjectileMovementData(Projectile* projectile, char* bff)
+void NetworkManager::AddNetworkProjectile(ProjectilePool* projectiles, unsigned int index)
 {
-	float x = projectile->GetTransform()->GetPosition().x;
-	float y = projectile->GetTransform()->GetPosition().y;
-	float z = projectile->GetTransform()->GetPosition().z;
+	// Kept until the server sends it back, in whichever slot it gives it
+	unsigned int shot = shotSequence++ & NET_SHOT_MASK;
+	pendingShots[shot] = { true, index, projectiles->GetGeneration(index), NetPlayerSlot(playerID), shot };
 
-	//Position x/y/z
-	std::memcpy(bff, &x, 4);
-	std::memcpy(bff + 4, &y, 4);
-	std::memcpy(bff + 8, &z, 4);
+	//Send initial position and velocity
+	NetNewProjectile newProjectile = { GetProjectileState(projectiles, index) };
+	newProjectile.State.Shot = shot;
+	NetworkMessageWriter message = NetWriteMessage(sendBuffer, sizeof(sendBuffer), newProjectile);
 
-	//Velocity x/y/z
-	std::memcpy(bff + 12, &projectile->velocityX, 4);
-	std::memcpy(bff + 16, &projectile->velocityY, 4);
-	std::memcpy(bff + 20, &projectile->velocityZ, 4);
+	// Sent with the next update
+	connection.Send(message, NETWORK_CHANNEL_RELIABLE);
+}
 
-	//Rotation pitch/yaw/roll
+void NetworkManager::HandleMessage(const NetworkMessageView& message, Player* local, ProjectilePool* projectiles)
+{
+	switch (message.GetType())
+	{
+	case NETWORK_MSG_CONNECT: //Connected request accepted
+	{
+		NetConnectAccepted accepted;
+		if (!NetReadMessage(message, accepted)) break;
+		if (accepted.TickRate > 0)
+			serverTickRate = accepted.TickRate;
+		if (state == NetworkState::Connecting) state = NetworkState::Connected;
+
+		std::cout << "\nJoined as player " << accepted.PlayerID << std::endl;
+		playerID = accepted.PlayerID;
+		//Room for the remote players, who are created as they're first sent
+		if (remotePlayers.size() < accepted.SlotCount)
+			remotePlayers.resize(min(accepted.SlotCount, (unsigned int)NET_MAX_PLAYERS), nullptr);
 
-	float pitch = projectile->GetTransform()->GetPitchYawRoll().x;
-	float yaw = projectile->GetTransform()->GetPitchYawRoll().y;
-	float roll = projectile->GetTransform()->GetPitchYawRoll().z;
-	float gravity = projectile->gravity;
+	}
+	break;
+	case NETWORK_MSG_PLAYER_JOINED:
+		if (state == NetworkState::Connected) //Player joined
+		{
+			remotePlayers.push_back(nullptr);
+			GetRemotePlayer((unsigned int)remotePlayers.size() - 1);
+		}
+		break;
+		//else if (*msgType == 3 && state == NetworkState::Connected) //New projectile
+		//{
+		//	return; // Ignore call for now
+		//	Projectile* newProjectile = entities->CreateProjectile(playerMesh, playerMat, 5);
+		//	newProjectile->GetTransform()->SetScale(0.2f, 0.2f, 0.2f);
+		//}
+	case NETWORK_MSG_CODED_UPDATE:
+	case NETWORK_MSG_UPDATE:
+		if (state == NetworkState::Connected) //Remote Player Update
+		{
+			// Only the newest snapshot counts
+			// (Which also says the newest of our inputs the server's moved us by)
+			BitReader stream = message.GetBitReader();
 
-	std::memcpy(bff + 24, &pitch, 4);
-	std::memcpy(bff + 28, &yaw, 4);
-	std::memcpy(bff + 32, &roll, 4);
-	std::memcpy(bff + 36, &gravity, 4);
+			// Read just the same once it's decoded
+			if (message.GetType() == NETWORK_MSG_CODED_UPDATE)
+			{
+				double decodeStart = NetworkNow();
+				int decoded = entropyModel.Decode(message.GetPayload(), message.GetLength(), decodedSnapshot, sizeof(decodedSnapshot));
+				if (decoded < 0) break;
+				float decodeMicroseconds = (float)((NetworkNow() - decodeStart) * 1000000.0);
+
+				codedSnapshots++;
+				averageCodedBytes += (message.GetLength() - averageCodedBytes) * 0.05f;
+				averageDecodedBytes += (decoded - averageDecodedBytes) * 0.05f;
+				averageDecodeMicroseconds += (decodeMicroseconds - averageDecodeMicroseconds) * 0.05f;
+				stream = BitReader(decodedSnapshot, decoded);
+			}
 
-	//Age
-	float lifespan = projectile->lifespan;
-	float age = projectile->age;
+			NetSnapshotHeader header;
+			NetMessage<NetSnapshotHeader>::Serialize(stream, header);
+			if (stream.IsOverflowed()) break;
+			unsigned int tick = header.Tick;
+			if (receivedUpdate && !NetworkSequenceNewer(tick, lastSnapshotTick)) break;
 
-	std::memcpy(bff + 40, &lifespan, 4);
-	std::memcpy(bff + 44, &age, 4);
+			// Its baseline is always one that was acknowledged, so it's still kept
+			const WorldSnapshot* baseline = nullptr;
+			if (header.HasBaseline)
+			{
+				unsigned int baselineTick = tick - header.BaselineAge;
+				baseline = &receivedSnapshots[baselineTick % NET_SNAPSHOT_HISTORY];
+				if (!baseline->Valid || baseline->Tick != baselineTick) break;
+			}
 
+			// All read before any of it's used, since a message
+			// that's cut short (or doesn't fit) is thrown away
+			WorldSnapshot snapshot;
+			snapshot.Tick = tick;
+			if (!NetSerializeSnapshot(stream, snapshot, baseline) || stream.IsOverflowed()) break;
+			if (snapshot.SlotCount > remotePlayers.size()) break;
+			if (snapshot.PlayerCount > 0 && snapshot.PlayerSlots[snapshot.PlayerCount - 1] >= remotePlayers.size()) break;
+
+			snapshot.Valid = true;
+			receivedSnapshots[tick % NET_SNAPSHOT_HISTORY] = snapshot;
+			AddRemoteSamples(snapshot, receivedUpdate ? lastSnapshotTick : tick, message.GetReceivedTime());
+			lastSnapshotTick = tick;
+			lastSnapshotTime = message.GetReceivedTime();
+			receivedUpdate = true;
+			ApplyProjectiles(snapshot, projectiles);
+
+			const PlayerNetState* own = NetFindSnapshotPlayer(snapshot, NetPlayerSlot(playerID));
+			if (header.HasInputAck && own != nullptr)
+				ReconcileLocalPlayer(local, *own, header.InputAck);
+		}
+		break;
+	}
 }
 
-void NetworkManager::ReadProjectileMovementData(Projectile* projectile, char* buffer)
+// --------------------------------------------------------
+// Lets go of every projectile the server says is gone, then
+// sets the ones it had room for (the rest carry on as they
+// were), matching up each new one with the shot it is, if
+// it's one of ours, or spawning it if it isn't
+// --------------------------------------------------------
+void NetworkManager::ApplyProjectiles(const WorldSnapshot& snapshot, ProjectilePool* projectiles)
 {
-	float* bff = (float*)buffer;
-
-	float posX, posY, posZ, velX, velY, velZ, pitch, yaw, roll, grav, lifespan, age;
-	posX = *bff;
-	posY = *(bff + 1);
-	posZ = *(bff + 2);
-	velX = *(bff + 3);
-	velY = *(bff + 4);
-	velZ = *(bff + 5);
-	pitch = *(bff + 6);
-	yaw = *(bff + 7);
-	roll = *(bff + 8);
-	grav = *(bff + 9);
-	lifespan = *(bff + 10);
-	age = *(bff + 11);
-
-	projectile->GetTransform()->SetPosition(posX, posY, posZ);
-	projectile->SetVelocity(velX, velY, velZ, grav);
-	projectile->GetTransform()->SetRotation(pitch, yaw, roll);
-	projectile->lifespan = lifespan;
-	projectile->age = age;
-}
+	auto isCurrent = [&](const BoundProjectile& bound)
+	{
+		return bound.Bound && projectiles->GetGeneration(bound.Index) == bound.Generation && projectiles->IsLive(bound.Index);
+	};
+	auto unbind = [&](BoundProjectile& bound)
+	{
+		if (isCurrent(bound))
+			projectiles->Release(bound.Index);
+		bound.Bound = false;
+	};
+
+	if (serverProjectiles.size() < snapshot.ProjectileSlotCount)
+		serverProjectiles.resize(snapshot.ProjectileSlotCount, BoundProjectile{});
+	for (unsigned int slot = 0; slot < serverProjectiles.size(); slot++)
+	{
+		if (slot >= snapshot.ProjectileSlotCount || !snapshot.ProjectilePresent[slot])
+			unbind(serverProjectiles[slot]);
+	}
 
-void NetworkManager::AddNetworkProjectile(Projectile* projectile, int index)
-{
-	//Clear buffers
-	std::fill_n(sendBuffer, 500, 0);
+	unsigned int ownSlot = NetPlayerSlot(playerID);
+	for (unsigned int i = 0; i < snapshot.ProjectileCount; i++)
+	{
+		const ProjectileNetState& state = snapshot.Projectiles[i];
+		BoundProjectile& bound = serverProjectiles[snapshot.ProjectileIndices[i]];
+		if (bound.Bound && (bound.Owner != state.Owner || bound.Shot != state.Shot))
+			unbind(bound);
 
-	unsigned int msgType = 3;
-	int ind = index;
+		if (!bound.Bound)
+		{
+			BoundProjectile& pending = pendingShots[state.Shot & NET_SHOT_MASK];
+			if (state.Owner == ownSlot && isCurrent(pending) && pending.Shot == state.Shot)
+			{
+				bound = pending;
+				pending.Bound = false;
+			}
+			else
+			{
+				unsigned int index;
+				if (state.Age >= state.Lifespan || !projectiles->Spawn(index))
+					continue;
+				bound = { true, index, projectiles->GetGeneration(index), state.Owner, state.Shot };
+				SetProjectileState(projectiles, index, state);
+				projectiles->Snap(index);
+				continue;
+			}
+		}
 
-	std::memcpy(&sendBuffer, &msgType, 4);
-	std::memcpy(&sendBuffer[0] + 4, &ind, 4);
+		// (Ones that have already run out here stay gone)
+		if (isCurrent(bound))
+			SetProjectileState(projectiles, bound.Index, state);
+	}
+}
 
-	//Send initial position and velocity
-	CopyProjectileMovementData(projectile, &sendBuffer[0] + 8);
+// --------------------------------------------------------
+// Moves the local player by this tick's input, rounded to
+// what the server will read, and keeps it to be replayed
+// --------------------------------------------------------
+void NetworkManager::PredictLocalPlayer(float dt, Player* local)
+{
+	inputSequence++;
+	PlayerInputFrame& input = inputHistory[inputSequence % NETWORK_INPUT_HISTORY];
+	input.Sequence = inputSequence;
+	input.Controls = Player::ReadControls();
+	input.PitchYawRoll = local->GetCamera()->GetTransform()->GetPitchYawRoll();
+	input.Dt = dt;
+	NetQuantize(input);
+
+	PlayerMovementState movement = local->GetMovementState();
+	SimulatePlayerMovement(movement, &input.Controls, input.PitchYawRoll, input.Dt);
+	local->SetMovementState(movement);
+}
 
-	socket.SendTo(IP, PORT, sendBuffer, 500);
+// --------------------------------------------------------
+// Starts over from where the server says the local player
+// was after the newest input it's had, and replays every
+// input since, which lands back where the prediction was
+// unless the server disagreed
+//  - Inputs too old to still be kept can't be replayed, so
+//    the server's state is as far as it gets then
+// --------------------------------------------------------
+void NetworkManager::ReconcileLocalPlayer(Player* local, const PlayerNetState& authoritative, unsigned int inputAck)
+{
+	PlayerMovementState movement;
+	movement.Position = authoritative.Position;
+	movement.Velocity = authoritative.Velocity;
 
+	for (unsigned int sequence = inputAck + 1; !NetworkSequenceNewer(sequence, inputSequence); sequence++)
+	{
+		const PlayerInputFrame& input = inputHistory[sequence % NETWORK_INPUT_HISTORY];
+		if (input.Sequence != sequence)
+			break;
+		SimulatePlayerMovement(movement, &input.Controls, input.PitchYawRoll, input.Dt);
+	}
+
+	local->SetMovementState(movement);
 }
 
-void NetworkManager::Update(float dt, Player* local, Projectile** projectiles)
+void NetworkManager::Update(float dt, Player* local, ProjectilePool* projectiles)
 {
+	PROFILE_SCOPE("NetworkManager::Update");
+	// The receive thread only stops by itself when the socket fails
+	if (state != NetworkState::Offline && !running)
+	{
+		Disconnect();
+		return;
+	}
 
-	while (newData)
+	// Everything that's come in since last frame, oldest first
+	//  - Anything cut short, or not framed at all, is ignored
+	while (NetworkPacketRef packet = receiveQueue.Pop())
 	{
+		connection.Receive(std::move(packet), [&](const NetworkMessageView& message)
+		{
+			HandleMessage(message, local, projectiles);
+		});
+	}
 
-		//Handle received data
-		unsigned int* msgType = (unsigned int*)&recvBuffer;
 
-		switch (*msgType)
-		{
-		case 1: //Connected request accepted
+	if (state == NetworkState::Connected)
+		PredictLocalPlayer(dt, local);
+
+	// Then, when a send's due, the newest inputs and everything that's
+	// queued go, and any reliable messages due again
+	//  - Kept to the rate, without bunching up after a long frame
+	if (state != NetworkState::Offline)
+	{
+		double now = NetworkNow();
+		if (now >= nextSendTime)
 		{
-			if (state == NetworkState::Connecting) state = NetworkState::Connected;
-
-			std::cout << "\nJoined as player " << *(msgType + 1) << std::endl;
-			playerID = *(msgType + 1);
-			//Create the remote players'
-			if(remotePlayers.size() != *(msgType + 2))
-				for (size_t i = 0; i < *(msgType + 2); i++)
-				{
-					if (i == playerID)
-					{
-						remotePlayers.push_back(nullptr); //Reserved spot for the local player
-						continue;
-					}
-					Player* newPlayer = new Player(playerMesh, playerMat, new Camera(0, 10, -5, 3.0f, 1.0f, 1280.0f / 720.0f), false);
-					newPlayer->GetTransform()->SetPosition(0, -1, 0);
-					newPlayer->GetTransform()->SetScale(2, 2, 2);
-					newPlayer->GetTransform()->SetParent(newPlayer->GetCamera()->GetTransform(), false);
-					remotePlayers.push_back(newPlayer);
-					entities->push_back(newPlayer);
-				}
+			if (state == NetworkState::Connected)
+				SendUpdate();
+			connection.Flush(now);
 
+			nextSendTime += 1.0 / sendRate;
+			if (nextSendTime <= now)
+				nextSendTime = now + 1.0 / sendRate;
 		}
-		break;
-		case 2:
-			if (state == NetworkState::Connected) //Player joined
-			{
-				Player* newPlayer = new Player(playerMesh, playerMat, new Camera(0, 10, -5, 3.0f, 1.0f, 1280.0f / 720.0f), false);
-				newPlayer->GetTransform()->SetPosition(0, -1, 0);
-				newPlayer->GetTransform()->SetScale(2, 2, 2);
-				newPlayer->GetTransform()->SetParent(newPlayer->GetCamera()->GetTransform(), false);
-				remotePlayers.push_back(newPlayer);
-				entities->push_back(newPlayer);
-			}
-			break;
-			//else if (*msgType == 3 && state == NetworkState::Connected) //New projectile
-			//{
-			//	return; // Ignore call for now
-			//	Projectile* newProjectile = new Projectile(playerMesh, playerMat, 5);
-			//	entities->push_back(newProjectile);
-			//	newProjectile->GetTransform()->SetScale(0.2f, 0.2f, 0.2f);
-			//}
-		case 10:
-			if (state == NetworkState::Connected) //Remote Player Update
-			{
-				for (size_t i = 0; i < remotePlayers.size(); i++)
-				{
-					if (remotePlayers[i] == nullptr) continue;
-
-					ReadPlayerMovementData(remotePlayers[i], &recvBuffer[0] + 4 + (36 * i));
-				}
-				for (size_t i = 0; i < MAX_PROJECTILES; i++)
-				{
-					ReadProjectileMovementData(*(projectiles + i), &recvBuffer[0] + 4 + (36 * remotePlayers.size()) + (48 * i));
-					Projectile* p = *(projectiles + i);
-					if (p->dead && p->age < p->lifespan) p->dead = false; //Fix for when the server resurrects a projectile and doesn't tell us
-				}
-			}
-			break;
-		}
-			//Clear buffer
-			std::fill_n(recvBuffer, 500, 0);
-			newData = false;
+		connection.GetStats().Update(now);
 	}
+}
 
+// --------------------------------------------------------
+// Our newest inputs (every one since the last update, and
+// a few before), with our player ID so the server can
+// identify us, and the newest snapshot we've got, to be
+// the baseline for the next
+// --------------------------------------------------------
+void NetworkManager::SendUpdate()
+{
+	NetPlayerUpdate update;
+	update.PlayerID = playerID;
+	update.HasSnapshotAck = receivedUpdate;
+	update.SnapshotAck = lastSnapshotTick;
+	unsigned int count = inputSequence - lastSentInput + NET_INPUT_REDUNDANCY - 1;
+	update.InputCount = min(inputSequence, min(count, (unsigned int)NET_UPDATE_MAX_INPUTS));
+	lastSentInput = inputSequence;
+	update.FirstInput = inputSequence - update.InputCount + 1;
+	for (unsigned int i = 0; i < update.InputCount; i++)
+		update.Inputs[i] = inputHistory[(update.FirstInput + i) % NETWORK_INPUT_HISTORY];
+	NetworkMessageWriter message = NetWriteMessage(sendBuffer, sizeof(sendBuffer), update);
+
+	connection.Send(message, NETWORK_CHANNEL_UNRELIABLE);
+}
 
-	if (state == NetworkState::Connected)
+float NetworkManager::GetInterpolationDelay()
+{
+	double delay = snapshotInterval + NETWORK_INTERPOLATION_JITTER_SCALE * arrivalJitter;
+	return (float)max(NETWORK_INTERPOLATION_MIN_DELAY, min(delay, NETWORK_INTERPOLATION_MAX_DELAY));
+}
+
+// --------------------------------------------------------
+// Stamps each remote player's state in a new snapshot with
+// the server's time, and learns how the server's clock and
+// the snapshots' arrival line up with ours
+// --------------------------------------------------------
+void NetworkManager::AddRemoteSamples(const WorldSnapshot& snapshot, unsigned int previousTick, double arrivalTime)
+{
+	double serverTime = snapshot.Tick / (double)serverTickRate;
+	double offset = arrivalTime - serverTime;
+	if (!serverClockKnown)
 	{
-		for (size_t i = 0; i < remotePlayers.size(); i++)
-		{
-			if (remotePlayers[i] == nullptr) continue;
+		serverClockOffset = offset;
+		arrivalJitter = 0;
+		snapshotInterval = 1.0 / NET_SNAPSHOT_RATE;
+		serverClockKnown = true;
+	}
+	else
+	{
+		double interval = (snapshot.Tick - previousTick) / (double)serverTickRate;
+		arrivalJitter += (fabs(offset - serverClockOffset) - arrivalJitter) * 0.1;
+		serverClockOffset += (offset - serverClockOffset) * 0.05;
+		snapshotInterval += (interval - snapshotInterval) * 0.1;
+	}
 
-			remotePlayers[i]->Update(dt);
+	if (remoteSamples.size() != remotePlayers.size())
+		remoteSamples.resize(remotePlayers.size());
+
+	// Those in it get a sample, and those who've left one saying so, while
+	// anyone else (who there wasn't room for) carries on from their last
+	unsigned int ownSlot = NetPlayerSlot(playerID);
+	for (unsigned int i = 0; i < remotePlayers.size(); i++)
+	{
+		if (i == ownSlot) continue;
+
+		std::deque<RemotePlayerSample>& samples = remoteSamples[i];
+		RemotePlayerSample sample;
+		sample.Time = serverTime;
+		const PlayerNetState* state = NetFindSnapshotPlayer(snapshot, i);
+		if (state != nullptr)
+		{
+			GetRemotePlayer(i);
+			sample.Present = true;
+			sample.State = *state;
 		}
+		else if (!snapshot.PlayerPresent[i] && !samples.empty() && samples.back().Present)
+			sample.Present = false;
+		else
+			continue;
+
+		// Only ever a second or so's worth is needed
+		samples.push_back(sample);
+		if (samples.size() > 64)
+			samples.pop_front();
+	}
+}
 
+// The remote player in a slot, created if there isn't one yet
+// (and never for our own slot, which is the local player)
+Player* NetworkManager::GetRemotePlayer(unsigned int slot)
+{
+	if (slot >= remotePlayers.size() || slot == NetPlayerSlot(playerID))
+		return nullptr;
+	if (remotePlayers[slot] == nullptr)
+	{
+		Player* newPlayer = entities->CreatePlayer(playerMesh, playerMat, new Camera(0, 10, -5, 3.0f, 1.0f, 1280.0f / 720.0f), false);
+		newPlayer->GetTransform()->SetPosition(0, -1, 0);
+		newPlayer->GetTransform()->SetScale(2, 2, 2);
+		newPlayer->GetTransform()->SetParent(newPlayer->GetCamera()->GetTransform(), false);
+		remotePlayers[slot] = newPlayer;
+	}
+	return remotePlayers[slot];
+}
 
-		//Send current player stats
+// --------------------------------------------------------
+// Between the two samples either side of the time drawn at,
+// along the Hermite curve their velocities give, or carried
+// on a little past the newest if the next is late
+// --------------------------------------------------------
+void NetworkManager::InterpolateRemotePlayers()
+{
+	if (state != NetworkState::Connected || !serverClockKnown)
+		return;
 
-		//Clear buffers
-		std::fill_n(sendBuffer, 500, 0);
+	double renderTime = NetworkNow() - serverClockOffset - GetInterpolationDelay();
 
-		unsigned int msgType = 10;
+	// The velocity that's sent is facing relative across the
+	// ground (see SimulatePlayerMovement()), so turn it
+	auto worldVelocity = [](const PlayerNetState& s)
+	{
+		XMVECTOR rotation = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&s.PitchYawRoll));
+		XMVECTOR ground = XMVector3Rotate(XMVectorSet(s.Velocity.x, 0, s.Velocity.z, 0), rotation);
+		return XMVectorSetY(ground, s.Velocity.y);
+	};
 
-		std::memcpy(&sendBuffer, &msgType, 4);
-		msgType = playerID;
-		std::memcpy(&sendBuffer[0] + 4, &msgType, 4); //send player ID so the server can identify us
+	for (size_t i = 0; i < remoteSamples.size() && i < remotePlayers.size(); i++)
+	{
+		Player* player = remotePlayers[i];
+		std::deque<RemotePlayerSample>& samples = remoteSamples[i];
+		if (player == nullptr || samples.empty()) continue;
 
-		//Send current position and velocity
-		CopyPlayerMovementData(local, &sendBuffer[0] + 8);
+		// Keep just the newest sample at or before the time drawn at
+		while (samples.size() > 2 && samples[1].Time <= renderTime)
+			samples.pop_front();
 
-		socket.SendTo(IP, PORT, sendBuffer, 500);
+		PlayerNetState s;
+		const RemotePlayerSample& a = samples[0];
+		if (samples.size() == 1 || renderTime <= a.Time || renderTime >= samples[1].Time)
+		{
+			// Before the first: held there / After the last: carried on
+			const RemotePlayerSample& last = (samples.size() == 1 || renderTime <= a.Time) ? a : samples[1];
+			s = last.State;
+			if (last.Present && renderTime > last.Time)
+			{
+				float ahead = (float)min(renderTime - last.Time, NETWORK_MAX_EXTRAPOLATION);
+				XMStoreFloat3(&s.Position, XMLoadFloat3(&s.Position) + worldVelocity(s) * ahead);
+			}
+			if (!last.Present) //Empty slots are parked out of sight
+				s = { XMFLOAT3(0, 0, -5000), XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0) };
+		}
+		else
+		{
+			const RemotePlayerSample& b = samples[1];
+			if (!a.Present || !b.Present)
+			{
+				// Joining or leaving, which there's nothing to blend from
+				s = b.Present ? b.State : PlayerNetState{ XMFLOAT3(0, 0, -5000), XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0) };
+			}
+			else
+			{
+				float span = (float)(b.Time - a.Time);
+				float t = (float)((renderTime - a.Time) / (b.Time - a.Time));
+				float t2 = t * t, t3 = t2 * t;
+
+				XMVECTOR p = XMLoadFloat3(&a.State.Position) * (2 * t3 - 3 * t2 + 1) +
+					worldVelocity(a.State) * span * (t3 - 2 * t2 + t) +
+					XMLoadFloat3(&b.State.Position) * (-2 * t3 + 3 * t2) +
+					worldVelocity(b.State) * span * (t3 - t2);
+				XMStoreFloat3(&s.Position, p);
+				XMStoreFloat3(&s.Velocity, XMVectorLerp(XMLoadFloat3(&a.State.Velocity), XMLoadFloat3(&b.State.Velocity), t));
+
+				// Angles the short way round
+				const float* from = &a.State.PitchYawRoll.x;
+				const float* to = &b.State.PitchYawRoll.x;
+				float* angles = &s.PitchYawRoll.x;
+				for (int c = 0; c < 3; c++)
+					angles[c] = from[c] + XMScalarModAngle(to[c] - from[c]) * t;
+			}
+		}
 
+		SetPlayerState(player, s);
 	}
-
 }
@@ -3,11 +3,47 @@
 #include <string>
 #include <thread>
 #include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "Player.h"
 #include "Projectile.h"
+#include "ProjectilePool.h"
+#include "EntityRegistry.h"
 #include "Network.h"
-
-#define MAX_PROJECTILES 6
+#include "NetworkPacketQueue.h"
+#include "NetworkProtocol.h"
+#include "NetworkConnection.h"
+#include "NetworkEntropy.h"
+
+// How long the receive thread blocks at a time before
+// checking whether it's been told to stop
+#define NETWORK_RECEIVE_WAIT_MS 100
+
+// Disconnecting goes this many times, since there's no waiting
+// around for it to be acknowledged
+#define NETWORK_DISCONNECT_SENDS 3
+
+// How many times a second everything queued is sent to the server
+// (whatever the frame or tick rate), by default, and within what
+#define NETWORK_SEND_RATE		60
+#define NETWORK_MIN_SEND_RATE	10
+#define NETWORK_MAX_SEND_RATE	240
+
+// How many inputs are kept for replaying (two seconds of 60 Hz ticks)
+#define NETWORK_INPUT_HISTORY 128
+
+// Remote players are drawn this far behind the newest snapshot, in
+// seconds: the time between snapshots, plus a few times the jitter
+// in when they arrive, within these limits
+#define NETWORK_INTERPOLATION_MIN_DELAY		0.05
+#define NETWORK_INTERPOLATION_MAX_DELAY		0.5
+#define NETWORK_INTERPOLATION_JITTER_SCALE	3.0
+
+// How far past the newest snapshot a remote player carries on,
+// in seconds, when the next is late
+#define NETWORK_MAX_EXTRAPOLATION			0.1
 
 enum class NetworkState
 {
@@ -32,44 +68,177 @@ private:
 	UDPSocket socket;
 
 	unsigned int playerID;
-	char sendBuffer[500];
-	char recvBuffer[500];
-	bool newData;
-	bool running;
-
+	char sendBuffer[NETWORK_MAX_MESSAGE_SIZE];
+
+	// Joining, leaving and shots are reliable, and everything else is
+	// sent once, all in as few datagrams as it fits (see NetworkConnection)
+	NetworkConnection connection;
+	double lastSnapshotTime {0};
+
+	// The last few snapshots from the server, which it sends the next
+	// ones as deltas against once they're acknowledged (with each update)
+	//  - Snapshots older than the newest already read are ignored
+	WorldSnapshot receivedSnapshots[NET_SNAPSHOT_HISTORY];
+	unsigned int lastSnapshotTick {0};
+	bool receivedUpdate {false};
+
+	// Snapshots can come entropy coded, when there's a model (read from
+	// NET_ENTROPY_MODEL_PATH on connecting), which the server's told the
+	// ID of, and has the same one
+	//  - How well it's done, per coded snapshot, smoothed
+	NetEntropyModel entropyModel;
+	char decodedSnapshot[NETWORK_MAX_MESSAGE_SIZE];
+	unsigned int codedSnapshots {0};
+	float averageCodedBytes {0};
+	float averageDecodedBytes {0};
+	float averageDecodeMicroseconds {0};
+
+	// Client side prediction: each tick's input moves the local player
+	// right away (with the movement the server has too), and is kept
+	// until the server's state for it comes back, which the inputs
+	// after it are then replayed on top of
+	PlayerInputFrame inputHistory[NETWORK_INPUT_HISTORY];
+	unsigned int inputSequence {0};	// Of the newest
+	void PredictLocalPlayer(float dt, Player* local);
+	void ReconcileLocalPlayer(Player* local, const PlayerNetState& authoritative, unsigned int inputAck);
+
+	// Remote players are drawn a little in the past, between the two
+	// snapshots either side of that time, so they move smoothly however
+	// unevenly the snapshots come in
+	//  - The server's clock is estimated from when they arrive, and how
+	//    much that varies is what the delay adapts to
+	struct RemotePlayerSample
+	{
+		double Time;	// Server time, in seconds
+		bool Present;
+		PlayerNetState State;
+	};
+	std::vector<std::deque<RemotePlayerSample>> remoteSamples;
+	bool serverClockKnown {false};
+	unsigned int serverTickRate {NET_SERVER_TICK_RATE};	// Sent when it accepts the connection
+	double serverClockOffset {0};	// Local time minus server time, smoothed
+	double arrivalJitter {0};		// How far arrivals stray from that, smoothed
+	double snapshotInterval {0};	// Server time between the snapshots received
+	void AddRemoteSamples(const WorldSnapshot& snapshot, unsigned int previousTick, double arrivalTime);
+
+	// Everything received since the last Update(), which handles it all
+	//  - The receive thread blocks until there's a datagram, which goes
+	//    straight into a pooled packet and onto the queue (or is dropped,
+	//    and counted, if there's no packet free or no room)
+	NetworkPacketPool packetPool;
+	NetworkPacketQueue receiveQueue;
+	char droppedPacket[NETWORK_MAX_PACKET_SIZE + 1];
+	std::atomic<unsigned int> droppedPackets {0};
+	std::atomic<bool> running {false};
+
+	// Everything's sent at the send rate, not every Update(), with just
+	// the newest inputs (each update has the last few anyway), and all
+	// of it in as few datagrams as it fits
+	//  - Those datagrams go into packets from the same pool, and onto a
+	//    queue for the send thread, so the socket's never waited on here
+	//    (and one that can't be queued is dropped, and counted)
+	int sendRate {NETWORK_SEND_RATE};
+	double nextSendTime {0};
+	unsigned int lastSentInput {0};
+	NetworkPacketQueue sendQueue;
+	std::mutex sendMutex;
+	std::condition_variable sendReady;
+	bool sendPending {false};	// (Guarded by sendMutex)
+	std::atomic<unsigned int> droppedSends {0};
+	std::thread sendThread;
+	void QueueDatagram(const char* data, int size);
+	void SendQueued();
+	void SendUpdate();
+
+	// One for each of the server's slots, created the first time it's in a snapshot
 	std::vector<Player*> remotePlayers;
+	Player* GetRemotePlayer(unsigned int slot);
+
+	// Which of the pool's projectiles each of the server's projectile slots
+	// is, and our own shots the server hasn't sent back yet (by shot number)
+	//  - A projectile's who fired it and which of their shots it was, so
+	//    our own are matched up with what we fired, and any other is new
+	//  - The pool's generation says whether it's still the same one (a
+	//    projectile can run out here before the server says it's gone)
+	struct BoundProjectile
+	{
+		bool Bound;
+		unsigned int Index;
+		unsigned int Generation;
+		unsigned int Owner;
+		unsigned int Shot;
+	};
+	std::vector<BoundProjectile> serverProjectiles;
+	BoundProjectile pendingShots[NET_SHOT_MASK + 1];
+	unsigned int shotSequence {0};
+	void ApplyProjectiles(const WorldSnapshot& snapshot, ProjectilePool* projectiles);
 
 	NetworkState state = NetworkState::Offline;
 
 	std::thread recvFromThread;
 
 	void ReceiveFrom();
+	void HandleMessage(const NetworkMessageView& message, Player* local, ProjectilePool* projectiles);
 
 	//Data required to make remote players
 	Mesh* playerMesh;
 	Material* playerMat;
-	std::vector<GameEntity*>* entities;
+	EntityRegistry* entities;
 
 public:
 	
-	NetworkManager(std::vector<GameEntity*>* entityList) { entities = entityList; }
+	NetworkManager(EntityRegistry* entityList)
+	{
+		entities = entityList;
+		connection.SetSender([this](const char* data, int size) { QueueDatagram(data, size); });
+	}
 
 	~NetworkManager();
 
 	NetworkState GetNetworkState() { return state; }
 
+	// While connected, the local player's moved by Update() (see
+	// PredictLocalPlayer()) instead of by Player::Update()
+	bool PredictsLocalPlayer() { return state == NetworkState::Connected; }
+	unsigned int GetDroppedPackets() { return droppedPackets; }
+	unsigned int GetDroppedSends() { return droppedSends; }
+
+	// (Between NETWORK_MIN_SEND_RATE and NETWORK_MAX_SEND_RATE)
+	int GetSendRate() { return sendRate; }
+	void SetSendRate(int rate) { sendRate = max(NETWORK_MIN_SEND_RATE, min(rate, NETWORK_MAX_SEND_RATE)); }
+	NetworkConnectionStats& GetStats() { return connection.GetStats(); }
+	unsigned int GetResends() { return connection.GetResends(); }
+
+	// Seconds since the newest snapshot came in
+	float GetSnapshotAge() { return receivedUpdate ? (float)(NetworkNow() - lastSnapshotTime) : 0.0f; }
+
 	NetworkResult Connect(std::string ip, int port, Player* local, Mesh* mesh, Material* mat);
 	NetworkResult Disconnect();
 
-	void CopyPlayerMovementData(Player* player, char* bff);
-	void ReadPlayerMovementData(Player* player, char* buffer);
+	// What's sent about each (see NetworkState.h, which the server shares)
+	PlayerNetState GetPlayerState(Player* player);
+	void SetPlayerState(Player* player, const PlayerNetState& state);
+
+	ProjectileNetState GetProjectileState(ProjectilePool* projectiles, unsigned int index);
+	void SetProjectileState(ProjectilePool* projectiles, unsigned int index, const ProjectileNetState& state);
+
+	// Tells the server about one we've just fired, as our next shot
+	void AddNetworkProjectile(ProjectilePool* projectiles, unsigned int index);
 
-	void CopyProjectileMovementData(Projectile* projectile, char* bff);
-	void ReadProjectileMovementData(Projectile* projectile, char* buffer);
+	void Update(float dt, Player* local, ProjectilePool* projectiles);
 
-	void AddNetworkProjectile(Projectile* projectile, int index);
+	// Once a frame, moves each remote player to where they were a
+	// moment ago (see NETWORK_INTERPOLATION_MIN_DELAY)
+	void InterpolateRemotePlayers();
+	float GetInterpolationDelay();
+	float GetArrivalJitter() { return (float)arrivalJitter; }
 
-	void Update(float dt, Player* local, Projectile** projectiles);
+	// Whether there's an entropy model, and how coded snapshots have done
+	bool HasEntropyModel() { return entropyModel.IsLoaded(); }
+	unsigned int GetCodedSnapshots() { return codedSnapshots; }
+	float GetAverageCodedBytes() { return averageCodedBytes; }
+	float GetAverageDecodedBytes() { return averageDecodedBytes; }
+	float GetAverageDecodeMicroseconds() { return averageDecodeMicroseconds; }
 
 };
 
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+
+// Shared by the game and the server (see Server/GameServer)
+
+// Every datagram either side sends fits in this, which is under
+// the smallest MTU there's likely to be on the way
+#define NETWORK_MAX_PACKET_SIZE		1200
+
+// What each message is (their payloads are laid out in NetworkProtocol.h)
+#define NETWORK_MSG_CONNECT			1	// To the server: NetConnectRequest / Back: NetConnectAccepted
+#define NETWORK_MSG_PLAYER_JOINED	2
+#define NETWORK_MSG_NEW_PROJECTILE	3	// NetNewProjectile
+#define NETWORK_MSG_DISCONNECT		4	// NetDisconnect
+#define NETWORK_MSG_UPDATE			10	// To the server: NetPlayerUpdate / Back: NetSnapshotHeader, then the snapshot
+#define NETWORK_MSG_CODED_UPDATE	11	// Back: an update's payload, entropy coded (see NetEntropyModel)
+
+// How a message is sent (see NetworkConnection)
+#define NETWORK_CHANNEL_UNRELIABLE	0	// Once, in the next datagram
+#define NETWORK_CHANNEL_RELIABLE	1	// Until it's acknowledged, handed over as soon as it arrives
+#define NETWORK_CHANNEL_ORDERED		2	// Until it's acknowledged, handed over in the order it was sent
+#define NETWORK_CHANNEL_COUNT		3
+
+// Starts every datagram, which is then as many messages as fit
+//  - The sequence counts up with every datagram its sender sends
+//    to that peer, and gaps are datagrams that were lost
+//  - The rest acknowledges the datagrams received from the other side,
+//    which is what reliable messages are resent by, and what the
+//    connection's measured by (see NetworkConnectionStats)
+struct NetworkPacketHeader
+{
+	unsigned int Sequence;
+	unsigned int Ack;			// The newest sequence received from the other side
+	unsigned int AckBits;		// Bit n: whether Ack - 1 - n was received too
+	unsigned short AckDelay;	// Milliseconds between Ack arriving and this being sent
+	unsigned short Flags;
+};
+
+#define NETWORK_PACKET_HEADER_SIZE	sizeof(NetworkPacketHeader)
+
+// Packet header flags
+#define NETWORK_HEADER_HAS_ACK		1	// Anything's been received to acknowledge
+
+// Starts every message in a datagram, which is only as long as it says
+//  - Reliable messages are numbered on their channel, so resends
+//    that both arrive are only handed over once
+struct NetworkMessageHeader
+{
+	unsigned char Type;
+	unsigned char Channel;
+	unsigned short Length;		// Of the payload after the header
+	unsigned short Id;			// Of reliable messages on their channel
+};
+
+#define NETWORK_MESSAGE_HEADER_SIZE	sizeof(NetworkMessageHeader)
+
+// The most a message can be (with its header), so it fits in a datagram by itself
+#define NETWORK_MAX_MESSAGE_SIZE	(NETWORK_MAX_PACKET_SIZE - NETWORK_PACKET_HEADER_SIZE)
+
+// Builds a message in a buffer, a field at a time, so only the bytes
+// actually written are sent (its channel and ID are filled in by
+// NetworkConnection::Send())
+class NetworkMessageWriter
+{
+public:
+	NetworkMessageWriter(char* buffer, unsigned int capacity, unsigned char type)
+		: buffer(buffer), capacity(capacity)
+	{
+		header.Type = type;
+		header.Channel = NETWORK_CHANNEL_UNRELIABLE;
+		header.Length = 0;
+		header.Id = 0;
+		std::memcpy(buffer, &header, NETWORK_MESSAGE_HEADER_SIZE);
+	}
+
+	// Room for the next size bytes of the payload, to be filled in
+	char* Reserve(unsigned int size)
+	{
+		unsigned int offset = NETWORK_MESSAGE_HEADER_SIZE + header.Length;
+		if (offset + size > capacity)
+			throw std::length_error("Network message too long");
+
+		header.Length += (unsigned short)size;
+		std::memcpy(buffer, &header, NETWORK_MESSAGE_HEADER_SIZE);
+		return buffer + offset;
+	}
+
+	void Write(const void* data, unsigned int size) { std::memcpy(Reserve(size), data, size); }
+	void WriteUInt(unsigned int value) { Write(&value, 4); }
+
+	unsigned char GetType() { return header.Type; }
+
+	const char* GetData() { return buffer; }
+	int GetSize() { return (int)(NETWORK_MESSAGE_HEADER_SIZE + header.Length); }
+
+private:
+	char* buffer;
+	unsigned int capacity;
+	NetworkMessageHeader header;
+};
+
+// Reads the header of the message at offset in a received datagram and
+// returns its payload, or null if the datagram's too short for it
+inline const char* NetworkReadMessage(const char* data, int size, int offset, NetworkMessageHeader& header)
+{
+	if (offset < 0 || size - offset < (int)NETWORK_MESSAGE_HEADER_SIZE)
+		return 0;
+
+	std::memcpy(&header, data + offset, NETWORK_MESSAGE_HEADER_SIZE);
+	if ((int)(NETWORK_MESSAGE_HEADER_SIZE + header.Length) > size - offset)
+		return 0;
+
+	return data + offset + NETWORK_MESSAGE_HEADER_SIZE;
+}
+
+// Whether sequence a came after b, allowing for the count wrapping around
+inline bool NetworkSequenceNewer(unsigned int a, unsigned int b)
+{
+	return (int)(a - b) > 0;
+}
@@ -0,0 +1,87 @@
+#include "NetworkPacketPool.h"
+
+// Marks the end of the free list
+#define NETWORK_PACKET_NONE	0xFFFFFFFFu
+
+NetworkPacketRef::NetworkPacketRef(const NetworkPacketRef& other) : packet(other.packet)
+{
+	if (packet)
+		packet->RefCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void NetworkPacketRef::Release()
+{
+	if (!packet)
+		return;
+
+	// Acquire/release, so whatever the other holders did with it
+	// is finished before it's handed out again
+	if (packet->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		packet->Pool->Return(packet);
+	packet = 0;
+}
+
+NetworkPacketPool::NetworkPacketPool(unsigned int size)
+{
+	this->size = size > 0 ? size : 1;
+	packets = new NetworkPacket[this->size];
+	for (unsigned int i = 0; i < this->size; i++)
+	{
+		packets[i].Size = 0;
+		packets[i].ReceivedTime = 0;
+		packets[i].RefCount = 0;
+		packets[i].NextFree = (i + 1 < this->size) ? (int)(i + 1) : (int)NETWORK_PACKET_NONE;
+		packets[i].Pool = this;
+	}
+	freeHead = 0;
+	freeCount = this->size;
+}
+
+// Anything still holding a packet has to be gone by now
+NetworkPacketPool::~NetworkPacketPool()
+{
+	delete[] packets;
+}
+
+NetworkPacketRef NetworkPacketPool::Acquire()
+{
+	unsigned long long head = freeHead.load(std::memory_order_acquire);
+	for (;;)
+	{
+		unsigned int index = (unsigned int)head;
+		if (index == NETWORK_PACKET_NONE)
+			return NetworkPacketRef();
+
+		unsigned long long next = (((head >> 32) + 1) << 32) | (unsigned int)packets[index].NextFree.load(std::memory_order_relaxed);
+		if (freeHead.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+		{
+			freeCount--;
+			packets[index].RefCount.store(1, std::memory_order_relaxed);
+			packets[index].Size = 0;
+			return NetworkPacketRef(&packets[index]);
+		}
+	}
+}
+
+void NetworkPacketPool::Return(NetworkPacket* packet)
+{
+	unsigned int index = (unsigned int)(packet - packets);
+	unsigned long long head = freeHead.load(std::memory_order_relaxed);
+	unsigned long long next;
+	do
+	{
+		packet->NextFree.store((int)(unsigned int)head, std::memory_order_relaxed);
+		next = (((head >> 32) + 1) << 32) | index;
+	} while (!freeHead.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+	freeCount++;
+}
+
+NetworkMessageView::NetworkMessageView(NetworkPacketRef packet, int offset)
+	: packet(std::move(packet)), header(), payload(0)
+{
+	NetworkPacket* p = this->packet.Get();
+	if (!p)
+		return;
+
+	payload = NetworkReadMessage(p->Data, p->Size, offset, header);
+}
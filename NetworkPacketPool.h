@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include "NetworkMessage.h"
+#include "BitStream.h"
+
+// Shared by the game and the server (see Server/GameServer)
+
+// How many packets can be in flight at once, whether being
+// received into, queued, or still being read (by default, since
+// the server, with many clients, wants more)
+#define NETWORK_PACKET_POOL_SIZE	128
+
+class NetworkPacketPool;
+
+// One received datagram
+//  - One byte more than the largest, since RecvFrom() ends it with a zero
+//  - Only ever read up to Size (and only as far as its header says, with
+//    NetworkMessageView), so it's never cleared between uses
+struct NetworkPacket
+{
+	char Data[NETWORK_MAX_PACKET_SIZE + 1];
+	int Size;
+	double ReceivedTime;	// When it came off the socket (see NetworkNow())
+
+	// How many NetworkPacketRefs there are to it, and the next
+	// free packet while it's back in the pool
+	std::atomic<int> RefCount;
+	std::atomic<int> NextFree;
+	NetworkPacketPool* Pool;
+};
+
+// A counted reference to a pooled packet, which goes back into the pool
+// when the last reference to it is gone, on whichever thread that is
+class NetworkPacketRef
+{
+public:
+	NetworkPacketRef() : packet(0) {}
+	NetworkPacketRef(const NetworkPacketRef& other);
+	NetworkPacketRef(NetworkPacketRef&& other) : packet(other.packet) { other.packet = 0; }
+	NetworkPacketRef& operator=(NetworkPacketRef other) { std::swap(packet, other.packet); return *this; }
+	~NetworkPacketRef() { Release(); }
+
+	NetworkPacket* Get() const { return packet; }
+	NetworkPacket* operator->() const { return packet; }
+	explicit operator bool() const { return packet != 0; }
+
+	void Release();
+
+private:
+	friend class NetworkPacketPool;
+	explicit NetworkPacketRef(NetworkPacket* packet) : packet(packet) {}
+
+	NetworkPacket* packet;
+};
+
+// A fixed set of packets, handed out and given back from any
+// thread without locking (a free list that's pushed and popped
+// with compare and swap)
+class NetworkPacketPool
+{
+public:
+	NetworkPacketPool(unsigned int size = NETWORK_PACKET_POOL_SIZE);
+	~NetworkPacketPool();
+	NetworkPacketPool(const NetworkPacketPool&) = delete;
+	NetworkPacketPool& operator=(const NetworkPacketPool&) = delete;
+
+	// A packet nothing else has (or an empty reference if they're all in use)
+	NetworkPacketRef Acquire();
+	unsigned int GetFreeCount() { return freeCount; }
+	unsigned int GetSize() { return size; }
+
+private:
+	friend class NetworkPacketRef;
+	void Return(NetworkPacket* packet);
+
+	NetworkPacket* packets;
+	unsigned int size;
+
+	// The first free packet's index in the low half, and in the high half
+	// a count of every change, so a pop that's raced by others taking and
+	// giving back the same packet fails rather than use a stale NextFree
+	std::atomic<unsigned long long> freeHead;
+	std::atomic<unsigned int> freeCount;
+};
+
+// A received message, read in place
+//  - The header's checked against the datagram once, up front, and
+//    every read after is checked against the payload
+//  - Holds on to its packet, so it stays valid however long it's kept
+//    (like when it's held back to be handed over in order)
+class NetworkMessageView
+{
+public:
+	NetworkMessageView() : header(), payload(0) {}
+
+	// The message at offset into the datagram (see NetworkPacketHeader), which
+	// isn't valid if the datagram's cut short, or isn't framed at all
+	NetworkMessageView(NetworkPacketRef packet, int offset);
+
+	bool IsValid() const { return payload != 0; }
+	const NetworkMessageHeader& GetHeader() const { return header; }
+	unsigned char GetType() const { return header.Type; }
+	int GetSize() const { return (int)(NETWORK_MESSAGE_HEADER_SIZE + header.Length); }
+	unsigned int GetLength() const { return header.Length; }
+	const char* GetPayload() const { return payload; }
+	double GetReceivedTime() const { return packet ? packet->ReceivedTime : 0; }
+
+	// Copies out the field at that offset into the payload
+	// (so it needn't be aligned), or returns false if it's past the end
+	template <typename T>
+	bool Read(unsigned int offset, T& value) const
+	{
+		if (!payload || offset > header.Length || sizeof(T) > header.Length - offset)
+			return false;
+
+		std::memcpy(&value, payload + offset, sizeof(T));
+		return true;
+	}
+	bool ReadUInt(unsigned int offset, unsigned int& value) const { return Read(offset, value); }
+
+	// For bit packed payloads (see NetworkState.h)
+	BitReader GetBitReader() const { return BitReader(payload, payload ? header.Length : 0); }
+
+private:
+	NetworkPacketRef packet;
+	NetworkMessageHeader header;
+	const char* payload;
+};
@@ -0,0 +1,41 @@
+#include "NetworkPacketQueue.h"
+
+NetworkPacketQueue::NetworkPacketQueue()
+{
+	head = 0;
+	tail = 0;
+}
+
+bool NetworkPacketQueue::Push(NetworkPacketRef packet)
+{
+	unsigned int h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) >= NETWORK_PACKET_QUEUE_SIZE)
+		return false;
+
+	packets[h % NETWORK_PACKET_QUEUE_SIZE] = std::move(packet);
+
+	// Release, so the packet's there before the consumer can see it
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+NetworkPacketRef NetworkPacketQueue::Pop()
+{
+	unsigned int t = tail.load(std::memory_order_relaxed);
+	if (t == head.load(std::memory_order_acquire))
+		return NetworkPacketRef();
+
+	NetworkPacketRef packet = std::move(packets[t % NETWORK_PACKET_QUEUE_SIZE]);
+
+	// Release, so the slot's been emptied before the producer can reuse it
+	tail.store(t + 1, std::memory_order_release);
+	return packet;
+}
+
+void NetworkPacketQueue::Clear()
+{
+	for (NetworkPacketRef& packet : packets)
+		packet.Release();
+	head = 0;
+	tail = 0;
+}
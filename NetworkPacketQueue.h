@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include "NetworkPacketPool.h"
+
+// How many received packets can wait for the game thread (a power of two)
+#define NETWORK_PACKET_QUEUE_SIZE	64
+
+// A bounded, lock free queue of packets from the receive thread (the
+// only producer) to the game thread (the only consumer)
+//  - It only holds references, with each packet received straight into
+//    one from the pool and read right where it is
+//  - Each side only ever writes its own index, and reads the other's
+//    to see how much of the ring belongs to it
+class NetworkPacketQueue
+{
+public:
+	NetworkPacketQueue();
+
+	// Producer: hands the packet over (false if the queue's full)
+	bool Push(NetworkPacketRef packet);
+
+	// Consumer: the oldest packet (an empty reference if there's none)
+	NetworkPacketRef Pop();
+
+	// Only while neither thread is using it
+	void Clear();
+
+private:
+	NetworkPacketRef packets[NETWORK_PACKET_QUEUE_SIZE];
+
+	// Kept on separate cache lines, since each is written by a different thread
+	alignas(64) std::atomic<unsigned int> head;	// Next slot to fill
+	alignas(64) std::atomic<unsigned int> tail;	// Next slot to read
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstddef>
+#include "NetworkMessage.h"
+#include "NetworkPacketPool.h"
+#include "NetworkState.h"
+
+// Shared by the game and the server (see Server/GameServer)
+//
+// Every message's payload as a table of its fields, in the order
+// they're sent, which both ends (and the load test bot) read and
+// write it from, so the layout's only written down once:
+//
+//  struct NetDisconnect { unsigned int PlayerID; };
+//  template <> struct NetMessage<NetDisconnect> : NetSchema<NETWORK_MSG_DISCONNECT,
+//      NetUIntField<NetDisconnect, &NetDisconnect::PlayerID>> {};
+//
+//  - Each field's code is picked when it's compiled, so serializing
+//    a message is just its fields one after the other
+//  - Each field knows the most bits it can take, so every message's
+//    biggest size is known when it's compiled, and checked to fit
+
+
+// --------------------------------------------------------
+// Fields, each with how many bits it takes at most
+// --------------------------------------------------------
+
+// Bits bits (all 32 by default)
+template <typename Message, unsigned int Message::*Member, unsigned int Bits = 32>
+struct NetUIntField
+{
+	static constexpr unsigned int MaxBits = Bits;
+
+	template <typename Stream>
+	static bool Serialize(Stream& stream, Message& message)
+	{
+		NetSerializeUInt(stream, message.*Member, Bits);
+		return true;
+	}
+};
+
+// A bit saying whether it's there, then the value if it is (and 0 if it isn't)
+template <typename Message, bool Message::*Has, unsigned int Message::*Member, unsigned int Bits = 32>
+struct NetOptionalUIntField
+{
+	static constexpr unsigned int MaxBits = 1 + Bits;
+
+	template <typename Stream>
+	static bool Serialize(Stream& stream, Message& message)
+	{
+		NetSerializeBool(stream, message.*Has);
+		if (message.*Has)
+			NetSerializeUInt(stream, message.*Member, Bits);
+		else if (!Stream::IsWriting)
+			message.*Member = 0;
+		return true;
+	}
+};
+
+// Anything with its own NetSerialize(), which is at most Bits (see NetworkState.h)
+template <typename Message, typename T, T Message::*Member, unsigned int Bits>
+struct NetStateField
+{
+	static constexpr unsigned int MaxBits = Bits;
+
+	template <typename Stream>
+	static bool Serialize(Stream& stream, Message& message)
+	{
+		NetSerialize(stream, message.*Member);
+		return true;
+	}
+};
+
+// How many there are (in CountBits), then that many of up to N, each at most
+// ItemBits, which isn't valid when it says there are more
+template <typename Message, typename T, size_t N, T (Message::*Items)[N], unsigned int Message::*Count,
+	unsigned int CountBits, unsigned int ItemBits>
+struct NetArrayField
+{
+	static_assert(N < (1ull << CountBits), "The count can't say how many there can be");
+	static constexpr unsigned int MaxBits = CountBits + (unsigned int)N * ItemBits;
+
+	template <typename Stream>
+	static bool Serialize(Stream& stream, Message& message)
+	{
+		NetSerializeUInt(stream, message.*Count, CountBits);
+		if (message.*Count > N)
+			return false;
+		for (unsigned int i = 0; i < message.*Count; i++)
+			NetSerialize(stream, (message.*Items)[i]);
+		return true;
+	}
+};
+
+
+// --------------------------------------------------------
+// Schemas: a message's type and its fields
+// --------------------------------------------------------
+
+template <typename... Fields>
+struct NetFieldBits
+{
+	static constexpr unsigned int Value = 0;
+};
+
+template <typename Field, typename... Rest>
+struct NetFieldBits<Field, Rest...>
+{
+	static constexpr unsigned int Value = Field::MaxBits + NetFieldBits<Rest...>::Value;
+};
+
+template <unsigned char MessageType, typename... Fields>
+struct NetSchema
+{
+	static constexpr unsigned char Type = MessageType;
+	static constexpr unsigned int MaxBits = NetFieldBits<Fields...>::Value;
+	static constexpr unsigned int MaxBytes = (MaxBits + 7) / 8;
+
+	static_assert(MaxBytes > 0, "A message needs at least one field");
+	static_assert(NETWORK_MESSAGE_HEADER_SIZE + MaxBytes <= NETWORK_MAX_MESSAGE_SIZE, "The message can be too long to send");
+
+	// Every field in turn (in the order they're listed, which a braced
+	// list is evaluated in), and whether all of them were valid
+	template <typename Stream, typename Message>
+	static bool Serialize(Stream& stream, Message& message)
+	{
+		bool valid[] = { Fields::Serialize(stream, message)... };
+		for (bool fieldValid : valid)
+		{
+			if (!fieldValid)
+				return false;
+		}
+		return true;
+	}
+};
+
+// Specialized for each message with its schema
+template <typename Message>
+struct NetMessage;
+
+// Builds it in buffer, ready to be sent
+template <typename Message>
+NetworkMessageWriter NetWriteMessage(char* buffer, unsigned int capacity, Message& message)
+{
+	typedef NetMessage<Message> Schema;
+	NetworkMessageWriter writer(buffer, capacity, Schema::Type);
+	char bits[Schema::MaxBytes];
+	BitWriter stream(bits, sizeof(bits));
+	Schema::Serialize(stream, message);
+	stream.Flush();
+	writer.Write(stream.GetData(), stream.GetSize());
+	return writer;
+}
+
+// Whether it's all there, and valid
+template <typename Message>
+bool NetReadMessage(const NetworkMessageView& view, Message& message)
+{
+	BitReader stream = view.GetBitReader();
+	return NetMessage<Message>::Serialize(stream, message) && !stream.IsOverflowed();
+}
+
+
+// --------------------------------------------------------
+// Messages
+// --------------------------------------------------------
+
+// To the server, to join, with where they are (and which snapshot
+// entropy model they have, if any)
+struct NetConnectRequest
+{
+	PlayerNetState State;
+	bool HasEntropyModel;
+	unsigned int EntropyModel;	// Its ID (see NetEntropyModel)
+};
+template <> struct NetMessage<NetConnectRequest> : NetSchema<NETWORK_MSG_CONNECT,
+	NetStateField<NetConnectRequest, PlayerNetState, &NetConnectRequest::State, NET_PLAYER_STATE_MAX_BITS>,
+	NetOptionalUIntField<NetConnectRequest, &NetConnectRequest::HasEntropyModel, &NetConnectRequest::EntropyModel>> {};
+
+// Back, with the ID they've been given, how many player slots there
+// are, and the rate the server ticks at
+struct NetConnectAccepted
+{
+	unsigned int PlayerID;
+	unsigned int SlotCount;
+	unsigned int TickRate;
+};
+template <> struct NetMessage<NetConnectAccepted> : NetSchema<NETWORK_MSG_CONNECT,
+	NetUIntField<NetConnectAccepted, &NetConnectAccepted::PlayerID>,
+	NetUIntField<NetConnectAccepted, &NetConnectAccepted::SlotCount, NET_PLAYER_SLOT_BITS + 1>,
+	NetUIntField<NetConnectAccepted, &NetConnectAccepted::TickRate, 16>> {};
+
+// To the server, when they leave
+struct NetDisconnect
+{
+	unsigned int PlayerID;
+};
+template <> struct NetMessage<NetDisconnect> : NetSchema<NETWORK_MSG_DISCONNECT,
+	NetUIntField<NetDisconnect, &NetDisconnect::PlayerID>> {};
+
+// To the server, for each shot (which it gives a slot)
+struct NetNewProjectile
+{
+	ProjectileNetState State;
+};
+template <> struct NetMessage<NetNewProjectile> : NetSchema<NETWORK_MSG_NEW_PROJECTILE,
+	NetStateField<NetNewProjectile, ProjectileNetState, &NetNewProjectile::State, NET_PROJECTILE_STATE_MAX_BITS>> {};
+
+// To the server, at the client's send rate: who they are, the newest
+// snapshot they've got (to be the baseline for the next), and their
+// newest few inputs, from the sequence of the first
+struct NetPlayerUpdate
+{
+	unsigned int PlayerID;
+	bool HasSnapshotAck;
+	unsigned int SnapshotAck;
+	unsigned int FirstInput;
+	unsigned int InputCount;
+	PlayerInputFrame Inputs[NET_UPDATE_MAX_INPUTS];
+};
+template <> struct NetMessage<NetPlayerUpdate> : NetSchema<NETWORK_MSG_UPDATE,
+	NetUIntField<NetPlayerUpdate, &NetPlayerUpdate::PlayerID>,
+	NetOptionalUIntField<NetPlayerUpdate, &NetPlayerUpdate::HasSnapshotAck, &NetPlayerUpdate::SnapshotAck>,
+	NetUIntField<NetPlayerUpdate, &NetPlayerUpdate::FirstInput>,
+	NetArrayField<NetPlayerUpdate, PlayerInputFrame, NET_UPDATE_MAX_INPUTS, &NetPlayerUpdate::Inputs,
+		&NetPlayerUpdate::InputCount, NET_INPUT_COUNT_BITS, NET_INPUT_FRAME_MAX_BITS>> {};
+
+// Back, starting each snapshot (which follows it in the same stream, see
+// NetSerializeSnapshot()): its tick, how many ticks older its baseline is
+// (if it has one), and the newest of their inputs they've been moved by
+struct NetSnapshotHeader
+{
+	unsigned int Tick;
+	bool HasBaseline;
+	unsigned int BaselineAge;
+	bool HasInputAck;
+	unsigned int InputAck;
+};
+template <> struct NetMessage<NetSnapshotHeader> : NetSchema<NETWORK_MSG_UPDATE,
+	NetUIntField<NetSnapshotHeader, &NetSnapshotHeader::Tick>,
+	NetOptionalUIntField<NetSnapshotHeader, &NetSnapshotHeader::HasBaseline, &NetSnapshotHeader::BaselineAge, NET_SNAPSHOT_HISTORY_BITS>,
+	NetOptionalUIntField<NetSnapshotHeader, &NetSnapshotHeader::HasInputAck, &NetSnapshotHeader::InputAck>> {};
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <bitset>
+#include <algorithm>
+#include "BitStream.h"
+#include "Movement.h"
+
+// Shared by the game and the server (see Server/GameServer)
+//
+// What's sent about each player and projectile, and to what precision,
+// so both ends read and write them with the same code
+
+// The box positions are kept to the millimeter in, deep enough
+// for everything parked out of the way at -5000
+static constexpr NetRangeQuantizer NetPositionX = { -1024.0f, 1024.0f, 0.001f };	// 21 bits
+static constexpr NetRangeQuantizer NetPositionY = { -5120.0f, 1024.0f, 0.001f };	// 23 bits
+static constexpr NetRangeQuantizer NetPositionZ = { -1024.0f, 1024.0f, 0.001f };	// 21 bits
+
+static constexpr NetRangeQuantizer NetVelocity = { -128.0f, 128.0f, 0.01f };	// 15 bits
+static constexpr NetRangeQuantizer NetGravity = { -128.0f, 0.0f, 0.01f };		// 14 bits
+static constexpr NetRangeQuantizer NetLifetime = { 0.0f, 64.0f, 0.01f };		// 13 bits
+static constexpr NetAngleQuantizer NetAngle = { 16 };
+
+static_assert(NetPositionX.Bits() == 21 && NetPositionY.Bits() == 23 && NetPositionZ.Bits() == 21, "Positions changed size");
+static_assert(NetVelocity.Bits() == 15 && NetGravity.Bits() == 14 && NetLifetime.Bits() == 13, "Projectile fields changed size");
+
+// Player slots
+#define NET_INDEX_BITS 8
+
+// Player IDs are a slot (which is where they are in snapshots) tagged with
+// how many times that slot's been given out, so a stale ID never matches
+// whoever has the slot now
+#define NET_PLAYER_SLOT_BITS		NET_INDEX_BITS
+#define NET_MAX_PLAYERS				(1u << NET_PLAYER_SLOT_BITS)
+#define NET_PLAYER_GENERATION_MASK	(0xFFFFFFFFu >> NET_PLAYER_SLOT_BITS)
+
+inline unsigned int NetPlayerID(unsigned int slot, unsigned int generation) { return (generation << NET_PLAYER_SLOT_BITS) | slot; }
+inline unsigned int NetPlayerSlot(unsigned int id) { return id & (NET_MAX_PLAYERS - 1); }
+
+// Projectiles are in slots the server gives out as they're fired (and
+// takes back when they die), and each says who fired it, and which of
+// their shots it was, which is how the shooter finds the one they fired
+//  - Shots are numbered by each player, and wrap around
+#define NET_PROJECTILE_SLOT_BITS	10
+#define NET_MAX_PROJECTILES			(1u << NET_PROJECTILE_SLOT_BITS)
+#define NET_SHOT_BITS				8
+#define NET_SHOT_MASK				((1u << NET_SHOT_BITS) - 1)
+
+// How long a single input can be simulated for
+static constexpr NetRangeQuantizer NetInputDt = { 0.0f, 0.25f, 0.0001f };	// 12 bits
+
+// Each update resends this many of the newest inputs, so
+// the odd lost packet doesn't lose any
+//  - Along with every one since the last, when updates are sent
+//    less often than inputs are made, up to NET_UPDATE_MAX_INPUTS
+#define NET_INPUT_REDUNDANCY	4
+#define NET_UPDATE_MAX_INPUTS	15
+#define NET_INPUT_COUNT_BITS	4
+
+struct PlayerNetState
+{
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 Velocity;
+	DirectX::XMFLOAT3 PitchYawRoll;
+};
+
+struct ProjectileNetState
+{
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 Velocity;
+	DirectX::XMFLOAT3 PitchYawRoll;
+	float Gravity;
+	float Lifespan;
+	float Age;
+	unsigned int Owner;	// The slot of the player who fired it
+	unsigned int Shot;
+};
+
+// One tick of a player's controls, which the server moves them by
+//  - The sequence isn't sent with each, since they're sent in a
+//    run that only needs the sequence of the first
+struct PlayerInputFrame
+{
+	unsigned int Sequence;
+	PlayerControls Controls;
+	DirectX::XMFLOAT3 PitchYawRoll;
+	float Dt;
+};
+
+// 51 bits
+#define NET_INPUT_FRAME_MAX_BITS (7 + 2 * NetAngle.Bits() + NetInputDt.Bits())
+static_assert(NET_INPUT_FRAME_MAX_BITS == 51, "Inputs changed size");
+
+template <typename Stream>
+void NetSerialize(Stream& stream, PlayerInputFrame& input)
+{
+	if (!Stream::IsWriting)
+		input.PitchYawRoll.z = 0;
+
+	NetSerializeBool(stream, input.Controls.Forward);
+	NetSerializeBool(stream, input.Controls.Backward);
+	NetSerializeBool(stream, input.Controls.Left);
+	NetSerializeBool(stream, input.Controls.Right);
+	NetSerializeBool(stream, input.Controls.Jump);
+	NetSerializeBool(stream, input.Controls.Faster);
+	NetSerializeBool(stream, input.Controls.Slower);
+	NetSerializeFloat(stream, input.PitchYawRoll.x, NetAngle);
+	NetSerializeFloat(stream, input.PitchYawRoll.y, NetAngle);
+	NetSerializeFloat(stream, input.Dt, NetInputDt);
+}
+
+// Rounds an input to exactly what the server will read, so the
+// prediction made from it is the same as the server's movement
+//  - Roll isn't sent, since players never roll
+inline void NetQuantize(PlayerInputFrame& input)
+{
+	input.PitchYawRoll.x = NetAngle.Dequantize(NetAngle.Quantize(input.PitchYawRoll.x));
+	input.PitchYawRoll.y = NetAngle.Dequantize(NetAngle.Quantize(input.PitchYawRoll.y));
+	input.PitchYawRoll.z = 0;
+	input.Dt = NetInputDt.Dequantize(NetInputDt.Quantize(input.Dt));
+}
+
+// 36 bytes of floats in 15-20
+//  - The most (at NET_PLAYER_STATE_MAX_BITS) is when it's moving
+#define NET_POSITION_BITS (NetPositionX.Bits() + NetPositionY.Bits() + NetPositionZ.Bits())
+#define NET_PLAYER_STATE_MAX_BITS (NET_POSITION_BITS + 1 + 3 * NetVelocity.Bits() + 3 * NetAngle.Bits())
+static_assert(NET_PLAYER_STATE_MAX_BITS == 159, "Player states changed size");
+
+template <typename Stream>
+void NetSerialize(Stream& stream, PlayerNetState& state)
+{
+	NetSerializeFloat3(stream, state.Position, NetPositionX, NetPositionY, NetPositionZ);
+	NetSerializeOptionalFloat3(stream, state.Velocity, NetVelocity);
+	NetSerializeFloat3(stream, state.PitchYawRoll, NetAngle);
+}
+
+// 48 bytes of floats in 20-25, and who fired it
+#define NET_PROJECTILE_STATE_MAX_BITS (NET_PLAYER_SLOT_BITS + NET_SHOT_BITS + NET_PLAYER_STATE_MAX_BITS + \
+	NetGravity.Bits() + 2 * NetLifetime.Bits())
+static_assert(NET_PROJECTILE_STATE_MAX_BITS == 215, "Projectile states changed size");
+
+template <typename Stream>
+void NetSerialize(Stream& stream, ProjectileNetState& state)
+{
+	NetSerializeUInt(stream, state.Owner, NET_PLAYER_SLOT_BITS);
+	NetSerializeUInt(stream, state.Shot, NET_SHOT_BITS);
+	NetSerializeFloat3(stream, state.Position, NetPositionX, NetPositionY, NetPositionZ);
+	NetSerializeOptionalFloat3(stream, state.Velocity, NetVelocity);
+	NetSerializeFloat3(stream, state.PitchYawRoll, NetAngle);
+	NetSerializeFloat(stream, state.Gravity, NetGravity);
+	NetSerializeFloat(stream, state.Lifespan, NetLifetime);
+	NetSerializeFloat(stream, state.Age, NetLifetime);
+}
+
+
+// --------------------------------------------------------
+// Delta compression against a baseline: one bit for an
+// entity that hasn't changed at all, then a bit per field
+// - Compared once quantized, so "unchanged" means the
+//   other end already has exactly what it'd be sent
+// --------------------------------------------------------
+template <typename Quantizer>
+bool NetQuantizedEqual(float a, float b, const Quantizer& quantizer)
+{
+	return quantizer.Quantize(a) == quantizer.Quantize(b);
+}
+
+template <typename Quantizer>
+bool NetQuantizedEqual(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const Quantizer& x, const Quantizer& y, const Quantizer& z)
+{
+	return NetQuantizedEqual(a.x, b.x, x) && NetQuantizedEqual(a.y, b.y, y) && NetQuantizedEqual(a.z, b.z, z);
+}
+
+// Whether a field changed (only known by the writer), which
+// the reader leaves as the baseline's when it didn't
+template <typename Stream, typename T>
+bool NetSerializeChanged(Stream& stream, bool changed, T& value, const T& baseline)
+{
+	NetSerializeBool(stream, changed);
+	if (!changed && !Stream::IsWriting)
+		value = baseline;
+	return changed;
+}
+
+template <typename Stream>
+void NetSerializeDelta(Stream& stream, PlayerNetState& state, const PlayerNetState& baseline)
+{
+	bool position = Stream::IsWriting && !NetQuantizedEqual(state.Position, baseline.Position, NetPositionX, NetPositionY, NetPositionZ);
+	bool velocity = Stream::IsWriting && !NetQuantizedEqual(state.Velocity, baseline.Velocity, NetVelocity, NetVelocity, NetVelocity);
+	bool rotation = Stream::IsWriting && !NetQuantizedEqual(state.PitchYawRoll, baseline.PitchYawRoll, NetAngle, NetAngle, NetAngle);
+	if (!NetSerializeChanged(stream, position || velocity || rotation, state, baseline))
+		return;
+
+	if (NetSerializeChanged(stream, position, state.Position, baseline.Position))
+		NetSerializeFloat3(stream, state.Position, NetPositionX, NetPositionY, NetPositionZ);
+	if (NetSerializeChanged(stream, velocity, state.Velocity, baseline.Velocity))
+		NetSerializeOptionalFloat3(stream, state.Velocity, NetVelocity);
+	if (NetSerializeChanged(stream, rotation, state.PitchYawRoll, baseline.PitchYawRoll))
+		NetSerializeFloat3(stream, state.PitchYawRoll, NetAngle);
+}
+
+template <typename Stream>
+void NetSerializeDelta(Stream& stream, ProjectileNetState& state, const ProjectileNetState& baseline)
+{
+	bool position = Stream::IsWriting && !NetQuantizedEqual(state.Position, baseline.Position, NetPositionX, NetPositionY, NetPositionZ);
+	bool velocity = Stream::IsWriting && !NetQuantizedEqual(state.Velocity, baseline.Velocity, NetVelocity, NetVelocity, NetVelocity);
+	bool rotation = Stream::IsWriting && !NetQuantizedEqual(state.PitchYawRoll, baseline.PitchYawRoll, NetAngle, NetAngle, NetAngle);
+	bool gravity = Stream::IsWriting && !NetQuantizedEqual(state.Gravity, baseline.Gravity, NetGravity);
+	bool lifetime = Stream::IsWriting && (!NetQuantizedEqual(state.Lifespan, baseline.Lifespan, NetLifetime) || !NetQuantizedEqual(state.Age, baseline.Age, NetLifetime));
+	bool shooter = Stream::IsWriting && (state.Owner != baseline.Owner || state.Shot != baseline.Shot);
+	if (!NetSerializeChanged(stream, position || velocity || rotation || gravity || lifetime || shooter, state, baseline))
+		return;
+
+	// (Only when its slot's been given to another one since)
+	if (NetSerializeChanged(stream, shooter, state.Owner, baseline.Owner))
+	{
+		NetSerializeUInt(stream, state.Owner, NET_PLAYER_SLOT_BITS);
+		NetSerializeUInt(stream, state.Shot, NET_SHOT_BITS);
+	}
+	else if (!Stream::IsWriting)
+	{
+		state.Shot = baseline.Shot;
+	}
+
+	if (NetSerializeChanged(stream, position, state.Position, baseline.Position))
+		NetSerializeFloat3(stream, state.Position, NetPositionX, NetPositionY, NetPositionZ);
+	if (NetSerializeChanged(stream, velocity, state.Velocity, baseline.Velocity))
+		NetSerializeOptionalFloat3(stream, state.Velocity, NetVelocity);
+	if (NetSerializeChanged(stream, rotation, state.PitchYawRoll, baseline.PitchYawRoll))
+		NetSerializeFloat3(stream, state.PitchYawRoll, NetAngle);
+	if (NetSerializeChanged(stream, gravity, state.Gravity, baseline.Gravity))
+		NetSerializeFloat(stream, state.Gravity, NetGravity);
+	if (NetSerializeChanged(stream, lifetime, state.Lifespan, baseline.Lifespan))
+	{
+		NetSerializeFloat(stream, state.Lifespan, NetLifetime);
+		NetSerializeFloat(stream, state.Age, NetLifetime);
+	}
+	else if (!Stream::IsWriting)
+	{
+		state.Age = baseline.Age;
+	}
+}
+
+
+// --------------------------------------------------------
+// Snapshots, once per server tick, of who's connected and
+// whichever players and projectiles were most worth sending
+// that client (see the server's InterestManager), each sent
+// as a delta against the newest one that client's
+// acknowledged (or whole, if there isn't one the server
+// still has)
+// --------------------------------------------------------
+
+// The server simulates at this rate by default (it can be started with
+// another, which it tells clients when they connect), and snapshots are
+// numbered by its ticks, but only about this many a second are sent,
+// since clients interpolate between them
+#define NET_SERVER_TICK_RATE			60
+#define NET_SNAPSHOT_RATE				20
+
+// How many snapshots each end keeps to be baselines (a power of two)
+#define NET_SNAPSHOT_HISTORY			32
+#define NET_SNAPSHOT_HISTORY_BITS		5
+
+// Room for at most this many of each in one snapshot
+#define NET_SNAPSHOT_MAX_PLAYERS		32
+#define NET_SNAPSHOT_MAX_PROJECTILES	32
+#define NET_SNAPSHOT_COUNT_BITS			6
+
+// A player (or projectile) that isn't in a snapshot is just one
+// there was no room for this time, so the client carries on with
+// what it has, while PlayerPresent is everyone who's connected,
+// and ProjectilePresent every projectile that's still alive
+//  - Entries are in ascending order of slot
+struct WorldSnapshot
+{
+	unsigned int Tick;
+	bool Valid;
+
+	unsigned int SlotCount;
+	std::bitset<NET_MAX_PLAYERS> PlayerPresent;
+
+	unsigned int ProjectileSlotCount;
+	std::bitset<NET_MAX_PROJECTILES> ProjectilePresent;
+
+	unsigned int PlayerCount;
+	unsigned int PlayerSlots[NET_SNAPSHOT_MAX_PLAYERS];
+	PlayerNetState Players[NET_SNAPSHOT_MAX_PLAYERS];
+
+	unsigned int ProjectileCount;
+	unsigned int ProjectileIndices[NET_SNAPSHOT_MAX_PROJECTILES];
+	ProjectileNetState Projectiles[NET_SNAPSHOT_MAX_PROJECTILES];
+};
+
+// Where a slot is among a snapshot's entries, or nullptr
+inline const PlayerNetState* NetFindSnapshotPlayer(const WorldSnapshot& snapshot, unsigned int slot)
+{
+	const unsigned int* end = snapshot.PlayerSlots + snapshot.PlayerCount;
+	const unsigned int* found = std::lower_bound(snapshot.PlayerSlots, end, slot);
+	return (found != end && *found == slot) ? &snapshot.Players[found - snapshot.PlayerSlots] : nullptr;
+}
+
+inline const ProjectileNetState* NetFindSnapshotProjectile(const WorldSnapshot& snapshot, unsigned int index)
+{
+	const unsigned int* end = snapshot.ProjectileIndices + snapshot.ProjectileCount;
+	const unsigned int* found = std::lower_bound(snapshot.ProjectileIndices, end, index);
+	return (found != end && *found == index) ? &snapshot.Projectiles[found - snapshot.ProjectileIndices] : nullptr;
+}
+
+// One entry, against the baseline's for the same slot, if it has one,
+// which is also what the server measures each entry with (BitCounter)
+template <typename Stream>
+void NetSerializeSnapshotEntry(Stream& stream, PlayerNetState& state, const PlayerNetState* baseline)
+{
+	if (baseline)
+		NetSerializeDelta(stream, state, *baseline);
+	else
+		NetSerialize(stream, state);
+}
+
+template <typename Stream>
+void NetSerializeSnapshotEntry(Stream& stream, ProjectileNetState& state, const ProjectileNetState* baseline)
+{
+	if (baseline)
+		NetSerializeDelta(stream, state, *baseline);
+	else
+		NetSerialize(stream, state);
+}
+
+// Which of the slots are in use, which is one bit when it's the same as the baseline's
+template <typename Stream, size_t Slots>
+bool NetSerializePresence(Stream& stream, unsigned int& slotCount, std::bitset<Slots>& present,
+	const unsigned int* baselineSlotCount, const std::bitset<Slots>* baselinePresent, unsigned int slotBits)
+{
+	bool unchanged = Stream::IsWriting && baselinePresent &&
+		*baselineSlotCount == slotCount && *baselinePresent == present;
+	NetSerializeBool(stream, unchanged);
+	if (unchanged)
+	{
+		if (!Stream::IsWriting)
+		{
+			if (!baselinePresent)
+				return false;
+			slotCount = *baselineSlotCount;
+			present = *baselinePresent;
+		}
+		return true;
+	}
+
+	NetSerializeUInt(stream, slotCount, slotBits + 1);
+	if (slotCount > Slots)
+		return false;
+	if (!Stream::IsWriting)
+		present.reset();
+	for (unsigned int i = 0; i < slotCount; i++)
+	{
+		bool inUse = Stream::IsWriting && present[i];
+		NetSerializeBool(stream, inUse);
+		if (!Stream::IsWriting)
+			present[i] = inUse;
+	}
+	return true;
+}
+
+// Who's connected, and which projectiles are alive
+template <typename Stream>
+bool NetSerializePresence(Stream& stream, WorldSnapshot& snapshot, const WorldSnapshot* baseline)
+{
+	return
+		NetSerializePresence(stream, snapshot.SlotCount, snapshot.PlayerPresent,
+			baseline ? &baseline->SlotCount : nullptr, baseline ? &baseline->PlayerPresent : nullptr, NET_PLAYER_SLOT_BITS) &&
+		NetSerializePresence(stream, snapshot.ProjectileSlotCount, snapshot.ProjectilePresent,
+			baseline ? &baseline->ProjectileSlotCount : nullptr, baseline ? &baseline->ProjectilePresent : nullptr, NET_PROJECTILE_SLOT_BITS);
+}
+
+// Everything in it, against the baseline when there is one
+//  - Returns false if what's read doesn't fit a snapshot
+template <typename Stream>
+bool NetSerializeSnapshot(Stream& stream, WorldSnapshot& snapshot, const WorldSnapshot* baseline)
+{
+	if (!NetSerializePresence(stream, snapshot, baseline))
+		return false;
+
+	NetSerializeUInt(stream, snapshot.PlayerCount, NET_SNAPSHOT_COUNT_BITS);
+	if (snapshot.PlayerCount > NET_SNAPSHOT_MAX_PLAYERS)
+		return false;
+	for (unsigned int i = 0; i < snapshot.PlayerCount; i++)
+	{
+		NetSerializeUInt(stream, snapshot.PlayerSlots[i], NET_PLAYER_SLOT_BITS);
+		if (i > 0 && snapshot.PlayerSlots[i] <= snapshot.PlayerSlots[i - 1])
+			return false;
+		NetSerializeSnapshotEntry(stream, snapshot.Players[i], baseline ? NetFindSnapshotPlayer(*baseline, snapshot.PlayerSlots[i]) : nullptr);
+	}
+
+	NetSerializeUInt(stream, snapshot.ProjectileCount, NET_SNAPSHOT_COUNT_BITS);
+	if (snapshot.ProjectileCount > NET_SNAPSHOT_MAX_PROJECTILES)
+		return false;
+	for (unsigned int i = 0; i < snapshot.ProjectileCount; i++)
+	{
+		NetSerializeUInt(stream, snapshot.ProjectileIndices[i], NET_PROJECTILE_SLOT_BITS);
+		if (i > 0 && snapshot.ProjectileIndices[i] <= snapshot.ProjectileIndices[i - 1])
+			return false;
+		if (snapshot.ProjectileIndices[i] >= snapshot.ProjectileSlotCount || !snapshot.ProjectilePresent[snapshot.ProjectileIndices[i]])
+			return false;
+		NetSerializeSnapshotEntry(stream, snapshot.Projectiles[i], baseline ? NetFindSnapshotProjectile(*baseline, snapshot.ProjectileIndices[i]) : nullptr);
+	}
+
+	return true;
+}
@@ -0,0 +1,217 @@
+#include "NetworkStats.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+double NetworkNow()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+NetworkConnectionStats::NetworkConnectionStats()
+{
+	Reset();
+}
+
+void NetworkConnectionStats::Reset()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	hasReceived = false;
+	newestReceived = 0;
+	receivedBits = 0;
+	newestReceivedTime = 0;
+	for (SentPacket& packet : sent)
+		packet.Valid = false;
+
+	hasRtt = false;
+	rtt = 0;
+	rttVariance = 0;
+
+	intervalStart = -1;
+	bytesIn = bytesOut = packetsIn = packetsOut = 0;
+	expectedIn = receivedIn = 0;
+	lostOut = resolvedOut = 0;
+
+	for (int i = 0; i < NETWORK_STAT_COUNT; i++)
+	{
+		current[i] = 0;
+		for (int j = 0; j < NETWORK_STATS_HISTORY; j++)
+			history[i][j] = 0;
+	}
+	historyCount = 0;
+	historyOffset = 0;
+}
+
+void NetworkConnectionStats::OnSend(NetworkPacketHeader& header, int bytes, double now)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (hasReceived)
+	{
+		double heldMs = (now - newestReceivedTime) * 1000.0;
+		header.Ack = newestReceived;
+		header.AckBits = receivedBits;
+		header.AckDelay = (unsigned short)fmin(fmax(heldMs, 0.0), 65535.0);
+		header.Flags |= NETWORK_HEADER_HAS_ACK;
+	}
+
+	// Whatever this pushes out of the window was either acknowledged by now or lost
+	unsigned int sequence = header.Sequence;
+	SentPacket& slot = sent[sequence % NETWORK_STATS_SENT_WINDOW];
+	if (slot.Valid)
+	{
+		resolvedOut++;
+		if (!slot.Acked)
+			lostOut++;
+	}
+	slot.Sequence = sequence;
+	slot.Time = now;
+	slot.Valid = true;
+	slot.Acked = false;
+
+	bytesOut += bytes;
+	packetsOut++;
+}
+
+void NetworkConnectionStats::OnReceive(const NetworkPacketHeader& header, int bytes, double now)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	bytesIn += bytes;
+	packetsIn++;
+
+	// Where it falls in what's been received, which is what we acknowledge
+	unsigned int sequence = header.Sequence;
+	bool duplicate = false;
+	if (!hasReceived)
+	{
+		hasReceived = true;
+		newestReceived = sequence;
+		newestReceivedTime = now;
+		receivedBits = 0;
+		expectedIn++;
+	}
+	else if (NetworkSequenceNewer(sequence, newestReceived))
+	{
+		unsigned int gap = sequence - newestReceived;
+		expectedIn += gap;
+		if (gap > 32)
+			receivedBits = 0;
+		else
+			receivedBits = (gap < 32 ? receivedBits << gap : 0) | (1u << (gap - 1));
+		newestReceived = sequence;
+		newestReceivedTime = now;
+	}
+	else
+	{
+		// Late, which only still counts if it's not a repeat
+		unsigned int age = newestReceived - sequence;
+		if (age == 0)
+			duplicate = true;
+		else if (age <= 32)
+		{
+			duplicate = (receivedBits & (1u << (age - 1))) != 0;
+			receivedBits |= 1u << (age - 1);
+		}
+	}
+	if (!duplicate)
+		receivedIn++;
+
+	// And what it says of ours
+	if (header.Flags & NETWORK_HEADER_HAS_ACK)
+	{
+		Acknowledge(header.Ack, now, header.AckDelay / 1000.0, true);
+		for (unsigned int n = 0; n < 32; n++)
+			if (header.AckBits & (1u << n))
+				Acknowledge(header.Ack - 1 - n, now, 0, false);
+	}
+}
+
+// --------------------------------------------------------
+// Marks a sent datagram as received, which times the round
+// trip if it's the newest the other side's seen (since it
+// says how long it held on to that one)
+//  - Smoothed the way TCP does, with the variance as the jitter
+// --------------------------------------------------------
+void NetworkConnectionStats::Acknowledge(unsigned int sequence, double now, double delay, bool timed)
+{
+	SentPacket& slot = sent[sequence % NETWORK_STATS_SENT_WINDOW];
+	if (!slot.Valid || slot.Sequence != sequence || slot.Acked)
+		return;
+
+	slot.Acked = true;
+	if (!timed)
+		return;
+
+	double sample = fmax(now - slot.Time - delay, 0.0);
+	if (!hasRtt)
+	{
+		rtt = sample;
+		rttVariance = sample / 2;
+		hasRtt = true;
+	}
+	else
+	{
+		rttVariance += (fabs(sample - rtt) - rttVariance) * 0.25;
+		rtt += (sample - rtt) * 0.125;
+	}
+}
+
+void NetworkConnectionStats::Update(double now)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (intervalStart < 0)
+		intervalStart = now;
+	double elapsed = now - intervalStart;
+	if (elapsed < NETWORK_STATS_INTERVAL)
+		return;
+
+	current[NETWORK_STAT_RTT] = (float)(rtt * 1000.0);
+	current[NETWORK_STAT_JITTER] = (float)(rttVariance * 1000.0);
+	current[NETWORK_STAT_BYTES_IN] = (float)(bytesIn / elapsed);
+	current[NETWORK_STAT_BYTES_OUT] = (float)(bytesOut / elapsed);
+	current[NETWORK_STAT_PACKETS_IN] = (float)(packetsIn / elapsed);
+	current[NETWORK_STAT_PACKETS_OUT] = (float)(packetsOut / elapsed);
+
+	// Loss stays as it was over an interval with nothing to say
+	if (expectedIn > 0)
+		current[NETWORK_STAT_LOSS_IN] = 100.0f * (1.0f - (float)fmin(receivedIn, expectedIn) / expectedIn);
+	if (resolvedOut > 0)
+		current[NETWORK_STAT_LOSS_OUT] = 100.0f * lostOut / resolvedOut;
+
+	for (int i = 0; i < NETWORK_STAT_COUNT; i++)
+		history[i][historyOffset] = current[i];
+	historyOffset = (historyOffset + 1) % NETWORK_STATS_HISTORY;
+	if (historyCount < NETWORK_STATS_HISTORY)
+		historyCount++;
+
+	intervalStart = now;
+	bytesIn = bytesOut = packetsIn = packetsOut = 0;
+	expectedIn = receivedIn = 0;
+	lostOut = resolvedOut = 0;
+}
+
+float NetworkConnectionStats::Get(NetworkStat stat)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return current[stat];
+}
+
+double NetworkConnectionStats::GetRtt()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return rtt;
+}
+
+void NetworkConnectionStats::Print(char* buffer, size_t size)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	snprintf(buffer, size, "rtt %.0f ms (jitter %.1f ms), loss %.1f%% in / %.1f%% out, %.2f / %.2f kB/s, %.0f / %.0f packets/s",
+		current[NETWORK_STAT_RTT], current[NETWORK_STAT_JITTER],
+		current[NETWORK_STAT_LOSS_IN], current[NETWORK_STAT_LOSS_OUT],
+		current[NETWORK_STAT_BYTES_IN] / 1024.0f, current[NETWORK_STAT_BYTES_OUT] / 1024.0f,
+		current[NETWORK_STAT_PACKETS_IN], current[NETWORK_STAT_PACKETS_OUT]);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <mutex>
+#include "NetworkMessage.h"
+
+// Shared by the game and the server (see Server/GameServer)
+
+// How many sent datagrams are remembered, to time them once they're
+// acknowledged (has to be more than the 32 each ack covers)
+#define NETWORK_STATS_SENT_WINDOW	64
+
+// The rates are measured over this many seconds at a time, and each
+// measurement kept for the graphs, up to this many
+#define NETWORK_STATS_INTERVAL		0.25
+#define NETWORK_STATS_HISTORY		120
+
+// What's measured, as of the last interval (see NetworkConnectionStats)
+enum NetworkStat
+{
+	NETWORK_STAT_RTT,			// Milliseconds, smoothed
+	NETWORK_STAT_JITTER,		// Milliseconds the round trip varies by, smoothed
+	NETWORK_STAT_LOSS_IN,		// Percent of the other side's datagrams that never came
+	NETWORK_STAT_LOSS_OUT,		// Percent of ours that it never acknowledged
+	NETWORK_STAT_BYTES_IN,		// Per second
+	NETWORK_STAT_BYTES_OUT,
+	NETWORK_STAT_PACKETS_IN,
+	NETWORK_STAT_PACKETS_OUT,
+	NETWORK_STAT_COUNT
+};
+
+// Seconds on a clock that only goes forward, for timing messages
+double NetworkNow();
+
+// Measures one connection from the sequences and acks in the
+// headers of the datagrams that go back and forth anyway
+//  - Every datagram sent acknowledges the newest one received,
+//    the 32 before it as bits, and how long it was held before
+//    sending, so the round trip is timed without the wait
+//  - Thread safe, since the server sends from one thread
+//    and receives on another
+class NetworkConnectionStats
+{
+public:
+	NetworkConnectionStats();
+
+	void Reset();
+
+	// Fills in the acknowledgment in the header of a datagram
+	// that's about to be sent, and counts it
+	void OnSend(NetworkPacketHeader& header, int bytes, double now);
+
+	// Counts a datagram that's arrived (at the time it came off the socket)
+	void OnReceive(const NetworkPacketHeader& header, int bytes, double now);
+
+	// Rolls the counts up into rates every NETWORK_STATS_INTERVAL
+	void Update(double now);
+
+	float Get(NetworkStat stat);
+
+	// Seconds, smoothed as of the last acknowledgment (0 until there's been one)
+	double GetRtt();
+
+	// Oldest first from the offset, as ImGui::PlotLines() takes them
+	const float* GetHistory(NetworkStat stat) { return history[stat]; }
+	int GetHistoryCount() { return historyCount; }
+	int GetHistoryOffset() { return historyOffset; }
+
+	// One line of the numbers, for the console
+	void Print(char* buffer, size_t size);
+
+private:
+	std::mutex lock;
+
+	// What's been received
+	bool hasReceived;
+	unsigned int newestReceived;
+	unsigned int receivedBits;		// Bit n: whether newestReceived - 1 - n was
+	double newestReceivedTime;
+
+	// What's been sent, until it's acknowledged (or pushed out of the window)
+	struct SentPacket
+	{
+		unsigned int Sequence;
+		double Time;
+		bool Valid;
+		bool Acked;
+	};
+	SentPacket sent[NETWORK_STATS_SENT_WINDOW];
+
+	bool hasRtt;
+	double rtt;
+	double rttVariance;
+
+	// Counts in the current interval
+	double intervalStart;
+	unsigned int bytesIn, bytesOut, packetsIn, packetsOut;
+	unsigned int expectedIn, receivedIn;
+	unsigned int lostOut, resolvedOut;
+
+	float current[NETWORK_STAT_COUNT];
+	float history[NETWORK_STAT_COUNT][NETWORK_STATS_HISTORY];
+	int historyCount;
+	int historyOffset;
+
+	void Acknowledge(unsigned int sequence, double now, double delay, bool timed);
+};
@@ -0,0 +1,338 @@
+#include "ObjParser.h"
+#include "JobSystem.h"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using namespace DirectX;
+
+// Corners keep negative OBJ indices relative to the start of their
+// chunk (which can reach back into earlier chunks) until chunks are
+// merged and the chunk's starting counts are known
+#define OBJ_MISSING INT_MIN
+#define OBJ_RELATIVE_POSITION	1
+#define OBJ_RELATIVE_UV			2
+#define OBJ_RELATIVE_NORMAL		4
+
+struct ObjCorner
+{
+	int Position;
+	int UV;
+	int Normal;
+	unsigned char Relative;
+};
+
+struct ObjChunk
+{
+	const char* Start;
+	const char* End;
+	std::vector<XMFLOAT3> Positions;
+	std::vector<XMFLOAT2> UVs;
+	std::vector<XMFLOAT3> Normals;
+
+	// Three per triangle, already in DirectX's winding order
+	std::vector<ObjCorner> Corners;
+};
+
+// A vertex is one unique (position, uv, normal) triple
+struct ObjVertexKey
+{
+	int Position;
+	int UV;
+	int Normal;
+
+	bool operator==(const ObjVertexKey& other) const
+	{
+		return Position == other.Position && UV == other.UV && Normal == other.Normal;
+	}
+};
+
+struct ObjVertexKeyHash
+{
+	size_t operator()(const ObjVertexKey& key) const
+	{
+		return ((size_t)key.Position * 73856093) ^ ((size_t)key.UV * 19349663) ^ ((size_t)key.Normal * 83492791);
+	}
+};
+
+static bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* SkipSpaces(const char* p, const char* end)
+{
+	while (p < end && IsSpace(*p))
+		p++;
+	return p;
+}
+
+// --------------------------------------------------------
+// Reads a float like 1, -0.5, .25 or 1.5e-3, without the
+// locale handling (and slowness) of the standard library
+// --------------------------------------------------------
+static const char* ParseFloat(const char* p, const char* end, float& value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	p = SkipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	double mantissa = 0;
+	int exponent = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		mantissa = mantissa * 10 + (*p++ - '0');
+
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			mantissa = mantissa * 10 + (*p++ - '0');
+			exponent--;
+		}
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negativeExponent = *p++ == '-';
+
+		int e = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+			e = e * 10 + (*p++ - '0');
+		exponent += negativeExponent ? -e : e;
+	}
+
+	if (exponent < 0)
+		mantissa /= -exponent <= 22 ? powers[-exponent] : pow(10.0, -exponent);
+	else if (exponent > 0)
+		mantissa *= exponent <= 22 ? powers[exponent] : pow(10.0, exponent);
+
+	value = (float)(negative ? -mantissa : mantissa);
+	return p;
+}
+
+static const char* ParseInt(const char* p, const char* end, int& value, bool& found)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	found = false;
+	value = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		value = value * 10 + (*p++ - '0');
+		found = true;
+	}
+
+	value = negative ? -value : value;
+	return p;
+}
+
+// OBJ indices start at one, and negative ones count back from
+// the latest of their kind so far
+static int ResolveIndex(int index, bool found, size_t countSoFar, unsigned char& relative, unsigned char relativeFlag)
+{
+	if (!found || index == 0)
+		return OBJ_MISSING;
+	if (index > 0)
+		return index - 1;
+
+	relative |= relativeFlag;
+	return (int)countSoFar + index;
+}
+
+// --------------------------------------------------------
+// Reads one face corner (v, v/vt, v//vn or v/vt/vn)
+// --------------------------------------------------------
+static const char* ParseCorner(const char* p, const char* end, const ObjChunk& chunk, ObjCorner& corner)
+{
+	int index;
+	bool found;
+	corner.Relative = 0;
+	p = ParseInt(p, end, index, found);
+	corner.Position = ResolveIndex(index, found, chunk.Positions.size(), corner.Relative, OBJ_RELATIVE_POSITION);
+	corner.UV = OBJ_MISSING;
+	corner.Normal = OBJ_MISSING;
+
+	if (p < end && *p == '/')
+	{
+		p = ParseInt(p + 1, end, index, found);
+		corner.UV = ResolveIndex(index, found, chunk.UVs.size(), corner.Relative, OBJ_RELATIVE_UV);
+
+		if (p < end && *p == '/')
+		{
+			p = ParseInt(p + 1, end, index, found);
+			corner.Normal = ResolveIndex(index, found, chunk.Normals.size(), corner.Relative, OBJ_RELATIVE_NORMAL);
+		}
+	}
+
+	// Skip anything unexpected, so one bad corner can't stall the line
+	while (p < end && !IsSpace(*p))
+		p++;
+	return p;
+}
+
+static void ParseChunk(ObjChunk& chunk)
+{
+	std::vector<ObjCorner> face;
+	const char* p = chunk.Start;
+	while (p < chunk.End)
+	{
+		const char* lineEnd = (const char*)memchr(p, '\n', chunk.End - p);
+		lineEnd = lineEnd ? lineEnd : chunk.End;
+		p = SkipSpaces(p, lineEnd);
+
+		if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 'n')
+		{
+			XMFLOAT3 normal;
+			const char* q = ParseFloat(p + 2, lineEnd, normal.x);
+			q = ParseFloat(q, lineEnd, normal.y);
+			ParseFloat(q, lineEnd, normal.z);
+			chunk.Normals.push_back(normal);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 't')
+		{
+			XMFLOAT2 uv;
+			const char* q = ParseFloat(p + 2, lineEnd, uv.x);
+			ParseFloat(q, lineEnd, uv.y);
+			chunk.UVs.push_back(uv);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'v' && IsSpace(p[1]))
+		{
+			XMFLOAT3 position;
+			const char* q = ParseFloat(p + 1, lineEnd, position.x);
+			q = ParseFloat(q, lineEnd, position.y);
+			ParseFloat(q, lineEnd, position.z);
+			chunk.Positions.push_back(position);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'f' && IsSpace(p[1]))
+		{
+			face.clear();
+			const char* q = SkipSpaces(p + 1, lineEnd);
+			while (q < lineEnd)
+			{
+				ObjCorner corner;
+				q = SkipSpaces(ParseCorner(q, lineEnd, chunk, corner), lineEnd);
+				if (corner.Position != OBJ_MISSING)
+					face.push_back(corner);
+			}
+
+			// Fan out into triangles, flipping the winding order
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				chunk.Corners.push_back(face[0]);
+				chunk.Corners.push_back(face[i]);
+				chunk.Corners.push_back(face[i - 1]);
+			}
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+// --------------------------------------------------------
+// Splits the text on line breaks, parses each chunk on its
+// own, then merges them (and shares vertices) in order
+// --------------------------------------------------------
+bool ObjParser::Parse(const char* text, size_t length, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	verts.clear();
+	indices.clear();
+
+	std::vector<ObjChunk> chunks;
+	const char* textEnd = text + length;
+	for (const char* p = text; p < textEnd;)
+	{
+		const char* chunkEnd = length - (p - text) > OBJ_PARSE_CHUNK_SIZE ? p + OBJ_PARSE_CHUNK_SIZE : textEnd;
+		const char* lineBreak = chunkEnd < textEnd ? (const char*)memchr(chunkEnd, '\n', textEnd - chunkEnd) : 0;
+		chunkEnd = lineBreak ? lineBreak + 1 : textEnd;
+
+		chunks.push_back({});
+		chunks.back().Start = p;
+		chunks.back().End = chunkEnd;
+		p = chunkEnd;
+	}
+
+	JobSystem::GetInstance().ParallelFor((unsigned int)chunks.size(), 1, [&](unsigned int start, unsigned int end)
+	{
+		for (unsigned int i = start; i < end; i++)
+			ParseChunk(chunks[i]);
+	});
+
+	// Everything from every chunk, in file order
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT2> uvs;
+	std::vector<XMFLOAT3> normals;
+	size_t cornerCount = 0;
+	for (auto& c : chunks)
+		cornerCount += c.Corners.size();
+
+	std::unordered_map<ObjVertexKey, unsigned int, ObjVertexKeyHash> vertexLookup;
+	vertexLookup.reserve(cornerCount);
+	indices.reserve(cornerCount);
+
+	for (auto& c : chunks)
+	{
+		int positionBase = (int)positions.size();
+		int uvBase = (int)uvs.size();
+		int normalBase = (int)normals.size();
+		positions.insert(positions.end(), c.Positions.begin(), c.Positions.end());
+		uvs.insert(uvs.end(), c.UVs.begin(), c.UVs.end());
+		normals.insert(normals.end(), c.Normals.begin(), c.Normals.end());
+
+		// Anything missing or out of range is -1
+		auto absolute = [](int index, bool relative, int base, size_t count)
+		{
+			if (index == OBJ_MISSING)
+				return -1;
+			index = relative ? base + index : index;
+			return index >= 0 && index < (int)count ? index : -1;
+		};
+
+		for (size_t i = 0; i < c.Corners.size(); i++)
+		{
+			const ObjCorner& corner = c.Corners[i];
+			ObjVertexKey key;
+			key.Position = absolute(corner.Position, (corner.Relative & OBJ_RELATIVE_POSITION) != 0, positionBase, positions.size());
+			key.UV = absolute(corner.UV, (corner.Relative & OBJ_RELATIVE_UV) != 0, uvBase, uvs.size());
+			key.Normal = absolute(corner.Normal, (corner.Relative & OBJ_RELATIVE_NORMAL) != 0, normalBase, normals.size());
+
+			// Faces can only use positions that already exist
+			if (key.Position < 0)
+				return false;
+
+			auto found = vertexLookup.find(key);
+			if (found != vertexLookup.end())
+			{
+				indices.push_back(found->second);
+				continue;
+			}
+
+			// Flip Z (and the normal's Z) for a left-handed space, and
+			// flip the UV since DirectX puts (0,0) at the top left
+			Vertex v = {};
+			v.Position = positions[key.Position];
+			v.Position.z *= -1.0f;
+			if (key.UV >= 0)
+				v.UV = XMFLOAT2(uvs[key.UV].x, 1.0f - uvs[key.UV].y);
+			if (key.Normal >= 0)
+				v.Normal = XMFLOAT3(normals[key.Normal].x, normals[key.Normal].y, -normals[key.Normal].z);
+
+			unsigned int index = (unsigned int)verts.size();
+			vertexLookup.insert({ key, index });
+			verts.push_back(v);
+			indices.push_back(index);
+		}
+	}
+
+	return !verts.empty() && !indices.empty();
+}
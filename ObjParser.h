@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+#include "Vertex.h"
+
+// Roughly how much of the file each parsing job gets,
+// after being moved up to the next line break
+#define OBJ_PARSE_CHUNK_SIZE (256 * 1024)
+
+// Parses OBJ text (positions, uvs, normals and faces) in parallel chunks
+//  - Faces can have any number of corners, with or without uvs
+//    and normals, and negative (relative) indices
+//  - Corners that share a position, uv and normal share a vertex
+//  - Everything is flipped into DirectX's left-handed space,
+//    and tangents are left to the caller
+class ObjParser
+{
+public:
+	static bool Parse(const char* text, size_t length, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+};
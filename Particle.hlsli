@@ -0,0 +1,33 @@
+// Include guard
+#ifndef _PARTICLE_HLSL
+#define _PARTICLE_HLSL
+
+// Should match EMITTER_GPU_GROUP_SIZE in Emitter.h
+#define PARTICLE_GROUP_SIZE		64
+
+// Same layout as Particle in Emitter.h
+struct Particle
+{
+	float EmitTime;
+	float3 StartPosition;
+};
+
+// One slot of an emitter's pool, as it's depth sorted (farthest
+// first) for alpha blending, with dead slots keyed to the very end
+//  - Same layout as ParticleSortKey in Emitter.h
+struct ParticleSortKey
+{
+	float Depth;
+	uint Index;
+};
+#define PARTICLE_DEAD_DEPTH		-1e30f
+
+// Copied in with CopyStructureCount() before each pass, since
+// consuming past the end of the dead list is undefined
+cbuffer listCounts : register(b1)
+{
+	uint deadCount;
+	uint aliveCount;
+};
+
+#endif
@@ -0,0 +1,79 @@
+cbuffer externalData : register(b0)
+{
+    matrix view;
+    matrix projection;
+    float currentTime;
+};
+
+// Must match BatchedParticle in ParticleBatcher.h
+struct BatchedParticle
+{
+    float EmitTime;
+    float3 StartPosition;
+    uint EmitterIndex;
+};
+
+// Must match BatchedEmitter in ParticleBatcher.h
+struct EmitterData
+{
+    float Lifetime;
+};
+
+StructuredBuffer<BatchedParticle> ParticleData : register(t0);
+StructuredBuffer<EmitterData> EmitterData : register(t1);
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+// Same as ParticleVS, for the particles of every emitter in a batch at
+// once, each with its own emitter's settings
+VertexToPixel main( uint id : SV_VertexID )
+{
+    VertexToPixel output;
+    
+    uint particleID = id / 4;
+    uint cornerID = id % 4;
+    BatchedParticle p = ParticleData.Load(particleID);
+    EmitterData emitter = EmitterData.Load(p.EmitterIndex);
+    float3 pos = p.StartPosition;
+    
+    float age = currentTime - p.EmitTime;
+    
+    // Anything that's outlived its emitter's lifetime (but is still
+    // waiting to be removed) collapses to nothing
+    if (age >= emitter.Lifetime)
+    {
+        output.position = float4(0, 0, 0, 0);
+        output.uv = float2(0, 0);
+        return output;
+    }
+    
+    //Cool effects
+    pos += float3(0.1f, 0, 0) * age;
+    //
+    
+    float2 offsets[4];
+    offsets[0] = float2(-1.0f, +1.0f);
+    offsets[1] = float2(+1.0f, +1.0f);
+    offsets[2] = float2(+1.0f, -1.0f);
+    offsets[3] = float2(-1.0f, -1.0f);
+    
+    pos += float3(view._11, view._12, view._13) * offsets[cornerID].x;
+    pos += float3(view._21, view._22, view._23) * offsets[cornerID].y;
+    
+    matrix viewProj = mul(projection, view);
+    output.position = mul(view, float4(pos, 1.0f));
+    
+    float2 uvs[4];
+    uvs[0] = float2(0, 0);
+    uvs[1] = float2(1, 0);
+    uvs[2] = float2(1, 1);
+    uvs[3] = float2(0, 1);
+    output.uv = uvs[cornerID];
+    
+    return output;
+    
+}
@@ -0,0 +1,143 @@
+#include "ParticleBatcher.h"
+#include "AssetLoader.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
+
+#include <algorithm>
+
+ParticleBatcher::ParticleBatcher(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+	stats = {};
+	particleCapacity = 0;
+	emitterCapacity = 0;
+}
+
+// --------------------------------------------------------
+// Sorts the emitters into batches, then lays each batch's
+// particles out one after another in the shared buffer,
+// tagged with the emitter they're from
+// --------------------------------------------------------
+void ParticleBatcher::Upload(const std::vector<Emitter*>& emitters)
+{
+	std::vector<Emitter*> batched;
+	for (auto e : emitters)
+	{
+		if (e->IsBatchable() && e->IsVisible())
+			batched.push_back(e);
+	}
+	std::stable_sort(batched.begin(), batched.end(), [](Emitter* a, Emitter* b)
+	{
+		if (a->IsLowResolution() != b->IsLowResolution())
+			return b->IsLowResolution();
+		if (a->GetTexture().Get() != b->GetTexture().Get())
+			return a->GetTexture().Get() < b->GetTexture().Get();
+		return a->GetPixelShader() < b->GetPixelShader();
+	});
+
+	batches.clear();
+	particleData.clear();
+	emitterData.clear();
+	for (auto e : batched)
+	{
+		if (batches.empty() || batches.back().Texture.Get() != e->GetTexture().Get() || batches.back().PS != e->GetPixelShader() || batches.back().LowResolution != e->IsLowResolution())
+			batches.push_back({ e->GetTexture(), e->GetPixelShader(), e->IsLowResolution(), (unsigned int)particleData.size(), 0 });
+
+		unsigned int emitterIndex = (unsigned int)emitterData.size();
+		emitterData.push_back({ e->GetLifetime() });
+
+		emitterParticles.resize(std::max((size_t)e->GetLivingCount(), emitterParticles.size()));
+		int count = e->CopyLivingParticles(emitterParticles.data());
+		for (int i = 0; i < count; i++)
+			particleData.push_back({ emitterParticles[i].emitTime, emitterParticles[i].initPos, emitterIndex });
+		batches.back().ParticleCount += count;
+	}
+
+	stats.Emitters = (unsigned int)batched.size();
+	stats.Batches = (unsigned int)batches.size();
+	stats.Particles = (unsigned int)particleData.size();
+	stats.UploadBytes = 0;
+	if (particleData.empty())
+		return;
+
+	// Doubling, so a growing effect doesn't reallocate every frame
+	if (particleData.size() > particleCapacity)
+	{
+		particleCapacity = std::max((unsigned int)particleData.size(), particleCapacity * 2);
+		CreateDynamicBuffer(particleCapacity, sizeof(BatchedParticle), particleBuffer, particleSRV);
+		Emitter::ReserveQuadIndices(device, particleCapacity);
+	}
+	if (emitterData.size() > emitterCapacity)
+	{
+		emitterCapacity = std::max((unsigned int)emitterData.size(), emitterCapacity * 2);
+		CreateDynamicBuffer(emitterCapacity, sizeof(BatchedEmitter), emitterBuffer, emitterSRV);
+	}
+
+	UploadBuffer(particleBuffer.Get(), particleData.data(), particleData.size() * sizeof(BatchedParticle));
+	UploadBuffer(emitterBuffer.Get(), emitterData.data(), emitterData.size() * sizeof(BatchedEmitter));
+	stats.UploadBytes = (unsigned int)(particleData.size() * sizeof(BatchedParticle) + emitterData.size() * sizeof(BatchedEmitter));
+}
+
+// --------------------------------------------------------
+// One indexed draw per batch, starting at its first quad
+// --------------------------------------------------------
+void ParticleBatcher::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, float currentTime, bool lowResolution)
+{
+	if (stats.Particles == 0)
+		return;
+
+	UINT stride = 0;
+	UINT offset = 0;
+	ID3D11Buffer* nullBuffer = 0;
+	passContext->IASetVertexBuffers(0, 1, &nullBuffer, &stride, &offset);
+	Emitter::SetQuadIndices(passContext, particleCapacity);
+
+	SimpleVertexShader* vs = Assets::GetInstance().GetVertexShader("ParticleBatchVS.cso"_asset);
+	vs->SetShader();
+	vs->SetShaderResourceView("ParticleData"_sn, particleSRV);
+	vs->SetShaderResourceView("EmitterData"_sn, emitterSRV);
+	vs->SetMatrix4x4("view"_sn, camera->GetView());
+	vs->SetMatrix4x4("projection"_sn, camera->GetProjection());
+	vs->SetFloat("currentTime"_sn, currentTime);
+	vs->CopyAllBufferData();
+
+	for (auto& batch : batches)
+	{
+		if (batch.ParticleCount == 0 || batch.LowResolution != lowResolution)
+			continue;
+
+		batch.PS->SetShader();
+		batch.PS->SetShaderResourceView("Texture"_sn, batch.Texture);
+		passContext->DrawIndexed(batch.ParticleCount * 6, batch.FirstParticle * 6, 0);
+		DrawStats::Count(DrawCounter::Draws);
+	}
+}
+
+void ParticleBatcher::CreateDynamicBuffer(unsigned int count, unsigned int stride, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = stride;
+	desc.ByteWidth = count * stride;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, buffer.ReleaseAndGetAddressOf(), GpuMemoryCategory::Particles, "Particle Batch");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.Buffer.NumElements = count;
+	device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv.ReleaseAndGetAddressOf());
+}
+
+void ParticleBatcher::UploadBuffer(ID3D11Buffer* buffer, const void* data, size_t size)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	DrawStats::Count(DrawCounter::Maps);
+	if (FAILED(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+
+	memcpy(mapped.pData, data, size);
+	context->Unmap(buffer, 0);
+}
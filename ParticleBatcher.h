@@ -0,0 +1,88 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Camera.h"
+#include "Emitter.h"
+
+// One particle of any emitter, as the batched vertex shader reads it
+//  - Must match BatchedParticle in ParticleBatchVS.hlsl
+struct BatchedParticle
+{
+	float EmitTime;
+	DirectX::XMFLOAT3 StartPosition;
+	unsigned int EmitterIndex;
+};
+
+// What the particles need to know about the emitter they came from
+//  - Must match EmitterData in ParticleBatchVS.hlsl
+struct BatchedEmitter
+{
+	float Lifetime;
+};
+
+// What the last frame's batches cost
+struct ParticleBatchStats
+{
+	unsigned int Emitters;
+	unsigned int Batches;
+	unsigned int Particles;
+	unsigned int UploadBytes;
+};
+
+// --------------------------------------------------------
+// Draws every CPU simulated emitter that shares a texture
+// and pixel shader with a single draw, from one buffer of
+// every emitter's particles uploaded once a frame
+//  - The blend mode's the same for every emitter (it's set
+//    by the particle pass), so it doesn't split batches
+//  - GPU simulated and depth sorted emitters are left to
+//    draw themselves
+// --------------------------------------------------------
+class ParticleBatcher
+{
+public:
+	ParticleBatcher(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Groups the emitters and uploads their particles, which has to be
+	// on the immediate context
+	void Upload(const std::vector<Emitter*>& emitters);
+	//  - Only the batches of emitters that do (or don't) want to be
+	//    drawn at low resolution (see Emitter::SetLowResolution())
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, float currentTime, bool lowResolution);
+
+	const ParticleBatchStats& GetStats() { return stats; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	// A run of the particle buffer drawn together
+	struct ParticleBatch
+	{
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Texture;
+		SimplePixelShader* PS;
+		bool LowResolution;
+		unsigned int FirstParticle;
+		unsigned int ParticleCount;
+	};
+	std::vector<ParticleBatch> batches;
+	ParticleBatchStats stats;
+
+	// Grown as needed, and rewritten whole each frame
+	std::vector<BatchedParticle> particleData;
+	std::vector<Particle> emitterParticles;
+	std::vector<BatchedEmitter> emitterData;
+	unsigned int particleCapacity;
+	unsigned int emitterCapacity;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> particleBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> emitterBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> emitterSRV;
+
+	void CreateDynamicBuffer(unsigned int count, unsigned int stride, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	void UploadBuffer(ID3D11Buffer* buffer, const void* data, size_t size);
+};
@@ -0,0 +1,178 @@
+#include "ParticleBenchmark.h"
+
+#include <fstream>
+#include <stdio.h>
+
+ParticleBenchmark::ParticleBenchmark()
+{
+	running = false;
+	frameIndex = 0;
+	settings = {};
+	lastAverages = {};
+	sceneEmitters = 0;
+	camera = 0;
+}
+
+ParticleBenchmark::~ParticleBenchmark()
+{
+	Stop();
+}
+
+void ParticleBenchmark::Stop()
+{
+	if (running)
+		Finish();
+}
+
+// --------------------------------------------------------
+// Builds the grid (centered on the origin, on the XY plane)
+// and backs the camera off far enough to see all of it
+// --------------------------------------------------------
+void ParticleBenchmark::Start(
+	const ParticleBenchmarkSettings& settings,
+	std::vector<Emitter*>& emitters,
+	Camera* camera,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	SimpleVertexShader* vs,
+	SimplePixelShader* ps,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture)
+{
+	if (running)
+		return;
+
+	this->settings = settings;
+	this->camera = camera;
+	sceneEmitters = &emitters;
+	savedEmitters = emitters;
+	running = true;
+	frameIndex = 0;
+	frames.clear();
+	frames.reserve(settings.Frames);
+
+	bool gpuSimulation = settings.Mode == ParticleBenchmarkMode::GpuSimulation;
+	float halfSize = (settings.GridSize - 1) * settings.Spacing * 0.5f;
+	gridEmitters.clear();
+	for (int y = 0; y < settings.GridSize; y++)
+	{
+		for (int x = 0; x < settings.GridSize; x++)
+		{
+			Emitter* e = new Emitter(settings.MaxParticles, settings.ParticlesPerSecond, settings.Lifetime, device, context, vs, ps, texture, gpuSimulation);
+			e->SetPosition(DirectX::XMFLOAT3(x * settings.Spacing - halfSize, y * settings.Spacing - halfSize, 0));
+			e->SetAppendUploads(settings.Mode == ParticleBenchmarkMode::AppendUploads);
+			gridEmitters.push_back(e);
+		}
+	}
+	emitters = gridEmitters;
+
+	Transform* t = camera->GetTransform();
+	savedCameraPosition = t->GetPosition();
+	savedCameraRotation = t->GetPitchYawRoll();
+	t->SetPosition(0, 0, -(halfSize * 2.0f + 10.0f));
+	t->SetRotation(0, 0, 0);
+	camera->UpdateViewMatrix();
+
+	printf("Particle benchmark: %s, %dx%d emitters of %d particles\n", GetModeName(settings.Mode), settings.GridSize, settings.GridSize, settings.MaxParticles);
+}
+
+bool ParticleBenchmark::RecordFrame(double updateMs, GpuProfiler& profiler)
+{
+	if (!running)
+		return false;
+
+	// Skipping the warm up
+	if (frameIndex++ < settings.WarmupFrames)
+		return false;
+
+	ParticleBenchmarkFrame frame = {};
+	frame.UpdateMs = updateMs;
+	for (auto e : gridEmitters)
+		frame.UploadBytes += e->GetLastUploadBytes();
+	for (auto& pass : profiler.GetPassStats())
+	{
+		if (pass.Name == "Particles" || pass.Name == "Particle Sort")
+			frame.GpuMs += pass.LastMs;
+	}
+	frames.push_back(frame);
+
+	if ((int)frames.size() < settings.Frames)
+		return false;
+
+	Finish();
+	return true;
+}
+
+float ParticleBenchmark::GetProgress()
+{
+	int total = settings.WarmupFrames + settings.Frames;
+	return total > 0 ? (float)frameIndex / total : 0.0f;
+}
+
+const char* ParticleBenchmark::GetModeName(ParticleBenchmarkMode mode)
+{
+	switch (mode)
+	{
+	case ParticleBenchmarkMode::FullUploads: return "Full Uploads";
+	case ParticleBenchmarkMode::AppendUploads: return "Append Uploads";
+	case ParticleBenchmarkMode::GpuSimulation: return "GPU Simulation";
+	}
+	return "";
+}
+
+// --------------------------------------------------------
+// Writes out the results, then puts the scene back the way
+// it was
+// --------------------------------------------------------
+void ParticleBenchmark::Finish()
+{
+	WriteResults();
+
+	for (auto e : gridEmitters)
+		delete e;
+	gridEmitters.clear();
+	*sceneEmitters = savedEmitters;
+
+	Transform* t = camera->GetTransform();
+	t->SetPosition(savedCameraPosition.x, savedCameraPosition.y, savedCameraPosition.z);
+	t->SetRotation(savedCameraRotation.x, savedCameraRotation.y, savedCameraRotation.z);
+	camera->UpdateViewMatrix();
+
+	running = false;
+}
+
+void ParticleBenchmark::WriteResults()
+{
+	lastAverages = {};
+	for (auto& f : frames)
+	{
+		lastAverages.UpdateMs += f.UpdateMs;
+		lastAverages.UploadBytes += f.UploadBytes;
+		lastAverages.GpuMs += f.GpuMs;
+	}
+	if (!frames.empty())
+	{
+		lastAverages.UpdateMs /= frames.size();
+		lastAverages.UploadBytes /= frames.size();
+		lastAverages.GpuMs /= frames.size();
+	}
+	printf("Particle benchmark: %.3f ms update, %llu bytes uploaded, %.3f ms GPU (averages of %u frames)\n",
+		lastAverages.UpdateMs, lastAverages.UploadBytes, lastAverages.GpuMs, (unsigned int)frames.size());
+
+	// Only a new file gets the header
+	bool newFile = !std::ifstream(PARTICLE_BENCHMARK_FILE).good();
+	std::ofstream csv(PARTICLE_BENCHMARK_FILE, std::ios::app);
+	if (!csv)
+	{
+		printf("Couldn't write %s\n", PARTICLE_BENCHMARK_FILE);
+		return;
+	}
+
+	if (newFile)
+		csv << "Mode,Emitters,Max Particles,Particles Per Second,Lifetime,Frame,Update Ms,Upload Bytes,GPU Ms\n";
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		csv << GetModeName(settings.Mode) << "," << settings.GridSize * settings.GridSize << "," << settings.MaxParticles << ","
+			<< settings.ParticlesPerSecond << "," << settings.Lifetime << "," << i << ","
+			<< frames[i].UpdateMs << "," << frames[i].UploadBytes << "," << frames[i].GpuMs << "\n";
+	}
+}
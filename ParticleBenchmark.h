@@ -0,0 +1,100 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+#include "Emitter.h"
+#include "GpuProfiler.h"
+
+// Every run adds its frames to the end of this (next to the exe), so
+// runs in different modes can be compared in one spreadsheet
+#define PARTICLE_BENCHMARK_FILE		"ParticleBenchmark.csv"
+
+// How the benchmark's emitters get their particles to the GPU
+enum class ParticleBenchmarkMode
+{
+	FullUploads,	// Every living particle, every frame
+	AppendUploads,	// Only the new ones, with NO_OVERWRITE
+	GpuSimulation	// Nothing, they're simulated by compute shaders
+};
+
+struct ParticleBenchmarkSettings
+{
+	int GridSize;			// Emitters along each side of the grid
+	float Spacing;
+	int MaxParticles;
+	int ParticlesPerSecond;
+	float Lifetime;
+	int WarmupFrames;		// Run, but not recorded, so the emitters fill up
+	int Frames;
+	ParticleBenchmarkMode Mode;
+};
+
+// What one recorded frame cost
+struct ParticleBenchmarkFrame
+{
+	double UpdateMs;				// CPU time simulating and uploading
+	unsigned long long UploadBytes;
+	float GpuMs;					// Sorting and drawing particles
+};
+
+// --------------------------------------------------------
+// Swaps the scene's emitters for a grid of identical ones
+// in front of a fixed camera for a set number of frames,
+// then writes what each frame cost out as CSV and puts
+// the scene's emitters back
+//  - GPU times come from the profiler, which is a few
+//    frames behind, so the warm up should cover that
+// --------------------------------------------------------
+class ParticleBenchmark
+{
+public:
+	ParticleBenchmark();
+	~ParticleBenchmark();
+
+	void Start(
+		const ParticleBenchmarkSettings& settings,
+		std::vector<Emitter*>& emitters,
+		Camera* camera,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		SimpleVertexShader* vs,
+		SimplePixelShader* ps,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture);
+
+	// After each frame's emitters are updated, returning true once
+	// the last frame's in and everything's been put back
+	bool RecordFrame(double updateMs, GpuProfiler& profiler);
+
+	// Ends a run early, keeping what it has so far
+	void Stop();
+
+	bool IsRunning() { return running; }
+	float GetProgress();
+
+	// Averages of the last run
+	const ParticleBenchmarkFrame& GetLastAverages() { return lastAverages; }
+
+	static const char* GetModeName(ParticleBenchmarkMode mode);
+
+private:
+	bool running;
+	int frameIndex;
+	ParticleBenchmarkSettings settings;
+	std::vector<ParticleBenchmarkFrame> frames;
+	ParticleBenchmarkFrame lastAverages;
+
+	// What the run replaced
+	std::vector<Emitter*>* sceneEmitters;
+	std::vector<Emitter*> savedEmitters;
+	std::vector<Emitter*> gridEmitters;
+	Camera* camera;
+	DirectX::XMFLOAT3 savedCameraPosition;
+	DirectX::XMFLOAT3 savedCameraRotation;
+
+	void Finish();
+	void WriteResults();
+};
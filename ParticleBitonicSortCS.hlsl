@@ -0,0 +1,33 @@
+#include "Particle.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	uint blockSize;		// Of the bitonic runs being merged (k)
+	uint compareOffset;	// Between the pairs compared in this pass (j)
+};
+
+RWStructuredBuffer<ParticleSortKey> SortKeys : register(u0);
+
+// One compare and swap pass of a bitonic sort, with a thread per key
+//  - Runs alternate direction by block, and the last block is the
+//    whole buffer, so it ends up farthest first
+[numthreads(PARTICLE_GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	uint count, stride;
+	SortKeys.GetDimensions(count, stride);
+
+	uint i = id.x;
+	uint partner = i ^ compareOffset;
+	if (i >= count || partner <= i)
+		return;
+
+	ParticleSortKey a = SortKeys[i];
+	ParticleSortKey b = SortKeys[partner];
+	bool farthestFirst = (i & blockSize) == 0;
+	if (farthestFirst ? a.Depth < b.Depth : a.Depth > b.Depth)
+	{
+		SortKeys[i] = b;
+		SortKeys[partner] = a;
+	}
+}
@@ -0,0 +1,63 @@
+cbuffer externalData : register(b0)
+{
+	float2 particleSize;	// Of the low resolution particles' viewport
+	int downscale;			// Full resolution pixels per low resolution pixel, on each axis
+
+	float2 depthParams;		// Projection values for turning hardware depth into view depth
+	float depthThreshold;	// Relative depth difference that counts as an edge
+};
+
+struct VertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+
+Texture2D ParticleColors : register(t0);	// Premultiplied, with coverage in alpha
+Texture2D ParticleDepths : register(t1);	// Same resolution as the particles
+Texture2D Depths : register(t2);			// Scene resolution
+
+
+float LinearDepth(float depth)
+{
+	return depthParams.y / (depth - depthParams.x);
+}
+
+// Depth aware upsample of the low resolution particles: bilinear
+// where the four texels around this pixel were all drawn against
+// about the same depth as it, but just the nearest in depth along
+// edges, so particles don't bleed onto (or off of) what's in front
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	float pixelDepth = LinearDepth(Depths.Load(int3(int2(input.position.xy), 0)).r);
+
+	float2 texel = input.position.xy / downscale - 0.5f;
+	int2 base = int2(floor(texel));
+	float2 f = texel - base;
+	int2 maxTexel = int2(particleSize) - 1;
+
+	float bilinear[4] = { (1 - f.x) * (1 - f.y), f.x * (1 - f.y), (1 - f.x) * f.y, f.x * f.y };
+	int2 offsets[4] = { int2(0, 0), int2(1, 0), int2(0, 1), int2(1, 1) };
+
+	float4 filtered = 0;
+	float4 nearest = 0;
+	float nearestDifference = 1e30f;
+	float maxDifference = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		int3 t = int3(clamp(base + offsets[i], int2(0, 0), maxTexel), 0);
+		float4 color = ParticleColors.Load(t);
+		float difference = abs(LinearDepth(ParticleDepths.Load(t).r) - pixelDepth) / pixelDepth;
+
+		filtered += color * bilinear[i];
+		maxDifference = max(maxDifference, difference);
+		if (difference < nearestDifference)
+		{
+			nearestDifference = difference;
+			nearest = color;
+		}
+	}
+
+	return maxDifference > depthThreshold ? nearest : filtered;
+}
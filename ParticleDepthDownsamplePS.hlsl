@@ -0,0 +1,34 @@
+cbuffer externalData : register(b0)
+{
+	int downscale;	// Full resolution pixels per low resolution pixel, on each axis
+};
+
+struct VertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+
+Texture2D Depths : register(t0);
+
+
+// Shrinks the depth buffer for low resolution particles
+//  - Keeps the closest depth of each block, like the SSAO's
+//    downsample, so particles never show through in front of
+//    a foreground edge (the composite sorts out the rest)
+float main(VertexToPixel input) : SV_DEPTH
+{
+	int2 topLeft = int2(input.position.xy) * downscale;
+
+	float closest = 1.0f;
+	for (int y = 0; y < downscale; y++)
+	{
+		for (int x = 0; x < downscale; x++)
+		{
+			closest = min(closest, Depths.Load(int3(topLeft + int2(x, y), 0)).r);
+		}
+	}
+
+	return closest;
+}
@@ -0,0 +1,32 @@
+#include "Particle.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	float firstEmitTime;		// Each one a particle's worth after the last,
+	float secondsPerParticle;	// so a big catch up isn't all at once
+	uint emitCount;
+	float3 position;
+};
+
+RWStructuredBuffer<Particle> Particles			: register(u0);
+ConsumeStructuredBuffer<uint> DeadList			: register(u1);
+AppendStructuredBuffer<uint> AliveOut			: register(u2);
+
+// One thread per new particle, as long as there are dead
+// slots for it (like the CPU version, nothing's emitted
+// once every particle is alive)
+[numthreads(PARTICLE_GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= emitCount || id.x >= deadCount)
+		return;
+
+	uint index = DeadList.Consume();
+
+	Particle p;
+	p.EmitTime = firstEmitTime + id.x * secondsPerParticle;
+	p.StartPosition = position;
+	Particles[index] = p;
+
+	AliveOut.Append(index);
+}
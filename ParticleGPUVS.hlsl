@@ -0,0 +1,67 @@
+#include "Particle.hlsli"
+
+cbuffer externalData : register(b0)
+{
+    matrix view;
+    matrix projection;
+    float currentTime;
+    float lifetime;
+};
+
+StructuredBuffer<Particle> ParticleData : register(t0);
+StructuredBuffer<uint> AliveList : register(t1);
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+// Same as ParticleVS, but drawn with DrawInstancedIndirect(): one
+// instance of six vertices (two triangles) per living particle,
+// which is looked up through the alive list
+VertexToPixel main( uint id : SV_VertexID, uint instance : SV_InstanceID )
+{
+    VertexToPixel output;
+    
+    static const uint corners[6] = { 0, 1, 2, 0, 2, 3 };
+    uint cornerID = corners[id];
+    Particle p = ParticleData.Load(AliveList.Load(instance));
+    float3 pos = p.StartPosition;
+    
+    float age = currentTime - p.EmitTime;
+    
+    // Throttled emitters can be a few frames late to kill them
+    if (age >= lifetime)
+    {
+        output.position = float4(0, 0, 0, 0);
+        output.uv = float2(0, 0);
+        return output;
+    }
+    
+    //Cool effects
+    pos += float3(0.1f, 0, 0) * age;
+    //
+    
+    float2 offsets[4];
+    offsets[0] = float2(-1.0f, +1.0f);
+    offsets[1] = float2(+1.0f, +1.0f);
+    offsets[2] = float2(+1.0f, -1.0f);
+    offsets[3] = float2(-1.0f, -1.0f);
+    
+    pos += float3(view._11, view._12, view._13) * offsets[cornerID].x;
+    pos += float3(view._21, view._22, view._23) * offsets[cornerID].y;
+    
+    matrix viewProj = mul(projection, view);
+    output.position = mul(view, float4(pos, 1.0f));
+    
+    float2 uvs[4];
+    uvs[0] = float2(0, 0);
+    uvs[1] = float2(1, 0);
+    uvs[2] = float2(1, 1);
+    uvs[3] = float2(0, 1);
+    output.uv = uvs[cornerID];
+    
+    return output;
+    
+}
@@ -7,8 +7,14 @@ struct VertexToPixel
 Texture2D Texture : register(t0);
 SamplerState BasicSampler : register(s0);
 
+// Premultiplied, with the black background textures' brightness as
+// their coverage, so the same output works for additive blending
+// (which ignores alpha) and alpha blending of depth sorted emitters
 float4 main(VertexToPixel input) : SV_TARGET
 {
-    return Texture.Sample(BasicSampler, input.uv);
+    float4 color = Texture.Sample(BasicSampler, input.uv);
+    color.rgb *= color.a;
+    color.a *= max(color.r, max(color.g, color.b));
+    return color;
 
 }
\ No newline at end of file
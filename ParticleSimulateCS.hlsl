@@ -0,0 +1,27 @@
+#include "Particle.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	float currentTime;
+	float lifetime;
+};
+
+StructuredBuffer<uint> AliveIn					: register(t0);
+RWStructuredBuffer<Particle> Particles			: register(u0);
+AppendStructuredBuffer<uint> DeadList			: register(u1);
+AppendStructuredBuffer<uint> AliveOut			: register(u2);
+
+// One thread per particle that was alive last frame, either
+// keeping it alive for this frame's draw or giving its slot back
+[numthreads(PARTICLE_GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	if (id.x >= aliveCount)
+		return;
+
+	uint index = AliveIn[id.x];
+	if (currentTime - Particles[index].EmitTime >= lifetime)
+		DeadList.Append(index);
+	else
+		AliveOut.Append(index);
+}
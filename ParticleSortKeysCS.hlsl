@@ -0,0 +1,41 @@
+#include "Particle.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	matrix view;
+	float currentTime;
+	float lifetime;
+	uint poolSize;
+	uint windowStart;	// The living slots of a CPU emitter's upload ring
+	uint windowCount;	// (the whole pool when it's simulated on the GPU)
+};
+
+StructuredBuffer<Particle> ParticleData			: register(t0);
+RWStructuredBuffer<ParticleSortKey> SortKeys	: register(u0);
+
+// Refreshes every key's depth in place, keeping the order the
+// last sort left them in, so a sort spread over several frames
+// only has to fix up how far the particles moved since
+[numthreads(PARTICLE_GROUP_SIZE, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	uint count, stride;
+	SortKeys.GetDimensions(count, stride);
+	if (id.x >= count)
+		return;
+
+	ParticleSortKey key = SortKeys[id.x];
+	key.Depth = PARTICLE_DEAD_DEPTH;
+	if (key.Index < poolSize && (key.Index + poolSize - windowStart) % poolSize < windowCount)
+	{
+		Particle p = ParticleData[key.Index];
+		float age = currentTime - p.EmitTime;
+		if (age < lifetime)
+		{
+			// Same movement as the particle vertex shaders
+			float3 pos = p.StartPosition + float3(0.1f, 0, 0) * age;
+			key.Depth = mul(view, float4(pos, 1.0f)).z;
+		}
+	}
+	SortKeys[id.x] = key;
+}
@@ -0,0 +1,66 @@
+#include "Particle.hlsli"
+
+cbuffer externalData : register(b0)
+{
+    matrix view;
+    matrix projection;
+    float currentTime;
+};
+
+StructuredBuffer<Particle> ParticleData : register(t0);
+StructuredBuffer<ParticleSortKey> SortKeys : register(t1);
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+// Same as ParticleGPUVS, but with an instance per pool slot in depth
+// sorted order, farthest first, so alpha blending comes out right
+//  - Dead slots are collapsed to nothing
+VertexToPixel main( uint id : SV_VertexID, uint instance : SV_InstanceID )
+{
+    VertexToPixel output;
+    
+    ParticleSortKey key = SortKeys.Load(instance);
+    if (key.Depth == PARTICLE_DEAD_DEPTH)
+    {
+        output.position = float4(0, 0, 0, 0);
+        output.uv = float2(0, 0);
+        return output;
+    }
+    
+    static const uint corners[6] = { 0, 1, 2, 0, 2, 3 };
+    uint cornerID = corners[id];
+    Particle p = ParticleData.Load(key.Index);
+    float3 pos = p.StartPosition;
+    
+    float age = currentTime - p.EmitTime;
+    
+    //Cool effects
+    pos += float3(0.1f, 0, 0) * age;
+    //
+    
+    float2 offsets[4];
+    offsets[0] = float2(-1.0f, +1.0f);
+    offsets[1] = float2(+1.0f, +1.0f);
+    offsets[2] = float2(+1.0f, -1.0f);
+    offsets[3] = float2(-1.0f, -1.0f);
+    
+    pos += float3(view._11, view._12, view._13) * offsets[cornerID].x;
+    pos += float3(view._21, view._22, view._23) * offsets[cornerID].y;
+    
+    matrix viewProj = mul(projection, view);
+    output.position = mul(view, float4(pos, 1.0f));
+    
+    float2 uvs[4];
+    uvs[0] = float2(0, 0);
+    uvs[1] = float2(1, 0);
+    uvs[2] = float2(1, 1);
+    uvs[3] = float2(0, 1);
+    output.uv = uvs[cornerID];
+    
+    return output;
+    
+}
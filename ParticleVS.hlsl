@@ -3,6 +3,12 @@ cbuffer externalData : register(b0)
     matrix view;
     matrix projection;
     float currentTime;
+    float lifetime;
+    
+    // Where the living particles are in the upload ring
+    uint particleStart;
+    uint particleCount;
+    uint particleCapacity;
 };
 
 struct Particle
@@ -25,11 +31,19 @@ VertexToPixel main( uint id : SV_VertexID )
     
     uint particleID = id / 4;
     uint cornerID = id % 4;
-    Particle p = ParticleData.Load(particleID);
+    Particle p = ParticleData.Load((particleStart + particleID) % particleCapacity);
     float3 pos = p.StartPosition;
     
     float age = currentTime - p.EmitTime;
     
+    // Throttled emitters can be a few frames late to kill them
+    if (age >= lifetime)
+    {
+        output.position = float4(0, 0, 0, 0);
+        output.uv = float2(0, 0);
+        return output;
+    }
+    
     //Cool effects
     pos += float3(0.1f, 0, 0) * age;
     //
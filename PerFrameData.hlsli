@@ -0,0 +1,193 @@
+// Include guard
+#ifndef _PER_FRAME_DATA_HLSL
+#define _PER_FRAME_DATA_HLSL
+
+#include "Lighting.hlsli"
+#include "ShadowMoments.hlsli"
+
+// Cascaded shadow map limit - should match Lights.h
+// (the cascade splits are packed into a single float4)
+#define MAX_SHADOW_CASCADES 4
+
+// How the cascades are filtered - should match ShadowFilter in Renderer.h
+#define SHADOW_FILTER_COMPARISON	0
+#define SHADOW_FILTER_EVSM2			1
+#define SHADOW_FILTER_EVSM4			2
+
+// Data that only changes once per frame
+//  - Shared by all lit pixel shaders, and filled and bound
+//    once per frame by the renderer, so this layout must
+//    match PSPerFrameData in Renderer.h
+cbuffer perFrame : register(b0)
+{
+	// The amount of lights THIS FRAME (in the Lights buffer below)
+	int LightCount;
+
+	// Needed for specular (reflection) calculation
+	float3 CameraPosition;
+
+	// The number of mip levels in the specular IBL map
+	int SpecIBLTotalMipLevels;
+
+	//Ambient Color for Environment
+	float3 AmbientNonPBR;
+
+	// Clustered light culling - when enabled, only the lights
+	// listed in each pixel's cluster are applied
+	float2 ClusterTileScale;
+	float2 ClusterDepthScaleBias;
+	int ClusteredLighting;
+
+	// Cascaded shadows for one directional light (the first that
+	// casts shadows, or -1 for none)
+	//  - Each split is the view space depth where that cascade ends
+	//  - Moment params are the exponents (xy), the minimum
+	//    variance (z) and the light bleeding reduction (w)
+	int ShadowCascadeCount;
+	int ShadowLightIndex;
+	int ShadowFilter;
+	float4 ShadowCascadeSplits;
+	float4 ShadowMomentParams;
+	matrix ShadowViewProjections[MAX_SHADOW_CASCADES];
+
+	// Indirect diffuse from the sky's spherical harmonics,
+	// instead of the irradiance map, when enabled
+	float4 IrradianceSH[9];
+	int UseIrradianceSH;
+};
+
+// Per frame resources, also bound once per frame by the renderer
+//  - Registers t0-t3 and s0-s1 are left for materials, as is
+//    t11 (for the material atlas buffer)
+
+// IBL (indirect PBR) textures
+Texture2D BrdfLookUpMap			: register(t4);
+TextureCube IrradianceIBLMap	: register(t5);	// Null when using IrradianceSH
+TextureCube SpecularIBLMap		: register(t6);
+
+//ShadowMap - one slice per cascade
+Texture2DArray ShadowMap		: register(t7);
+Texture2DArray ShadowMoments	: register(t15);	// Blurred and mipmapped, when filtering with EVSM
+
+// Every light this frame, and the lights in each cluster
+StructuredBuffer<Light> Lights				: register(t8);
+StructuredBuffer<uint> ClusterLightGrid		: register(t9);
+StructuredBuffer<uint> ClusterLightIndices	: register(t10);
+
+// Each entity's own list of the lights that reach it, when the renderer
+// made them - a count, then that many light indices
+//  - Must match EntityLightLists.h
+#define ENTITY_LIGHT_LIST_NONE 0xFFFFFFFF
+StructuredBuffer<uint> EntityLightLists		: register(t16);
+
+// Point and spot light shadows, in tiles of one atlas
+//  - Must match LocalShadowData in ShadowAtlas.h
+//  - Spot lights only use the first face, point lights one
+//    per cube face (+X, -X, +Y, -Y, +Z, -Z), and a face with
+//    no tile size hasn't been drawn yet
+struct LocalShadow
+{
+	matrix ViewProjections[6];
+	float4 Tiles[6];	// Atlas uv scale (xy) and offset (zw)
+};
+Texture2D ShadowAtlas						: register(t12);
+StructuredBuffer<LocalShadow> LocalShadows	: register(t13);
+StructuredBuffer<int> LightShadowIndices	: register(t14);	// Into LocalShadows, or -1
+
+SamplerComparisonState ShadowSampler : register(s2);
+SamplerState ShadowMomentSampler : register(s3);
+
+
+// Finds the cascade a pixel belongs to and compares its depth
+// from the light against that cascade's shadow map
+//  - viewDepth is the pixel's view space depth (SV_POSITION.w)
+//  - Returns 1 for lit, 0 for shadowed, and 1 for anything
+//    past the last cascade
+//  - With EVSM, the moments are filtered instead, at the mip
+//    matching the pixel's footprint on the shadow map
+//  - worldPosDX/DY are how far the world position moves to the next pixel
+//    across and down, which pixel shaders get from ShadowAmount below
+float ShadowAmountGrad(float3 worldPos, float viewDepth, float3 worldPosDX, float3 worldPosDY)
+{
+	// Count the cascades this pixel is beyond
+	int cascade = 0;
+	[unroll]
+	for (int i = 0; i < MAX_SHADOW_CASCADES; i++)
+		cascade += viewDepth > ShadowCascadeSplits[i] ? 1 : 0;
+
+	if (cascade >= ShadowCascadeCount)
+		return 1.0f;
+
+	// Where this pixel is from the light's point of view
+	float4 posForShadow = mul(ShadowViewProjections[cascade], float4(worldPos, 1.0f));
+	float2 shadowUV = posForShadow.xy / posForShadow.w * 0.5f + 0.5f;
+	shadowUV.y = 1.0f - shadowUV.y;
+
+	// Calculate this pixel's depth from the light
+	float depthFromLight = posForShadow.z / posForShadow.w;
+
+	if (ShadowFilter != SHADOW_FILTER_COMPARISON)
+	{
+		if (any(shadowUV != saturate(shadowUV)))
+			return 1.0f;
+
+		// Orthographic, so the footprint is just the derivatives projected
+		float2 uvDX = mul(ShadowViewProjections[cascade], float4(worldPosDX, 0.0f)).xy * float2(0.5f, -0.5f);
+		float2 uvDY = mul(ShadowViewProjections[cascade], float4(worldPosDY, 0.0f)).xy * float2(0.5f, -0.5f);
+		float4 moments = ShadowMoments.SampleGrad(ShadowMomentSampler, float3(shadowUV, cascade), uvDX, uvDY);
+		return MomentsShadow(moments, depthFromLight, ShadowMomentParams.xy,
+			ShadowFilter == SHADOW_FILTER_EVSM4, ShadowMomentParams.z, ShadowMomentParams.w);
+	}
+
+	// Sample the shadow map using a comparison sampler, which
+	// will compare the depth from the light and the value in the shadow map
+	return ShadowMap.SampleCmpLevelZero(ShadowSampler, float3(shadowUV, cascade), depthFromLight);
+}
+
+// Pixel shaders only
+float ShadowAmount(float3 worldPos, float viewDepth)
+{
+	// Before any branching, so they're valid for every pixel
+	return ShadowAmountGrad(worldPos, viewDepth, ddx(worldPos), ddy(worldPos));
+}
+
+// The same comparison against a point or spot light's tile of
+// the shadow atlas (the cube face the pixel's in, for point lights)
+//  - Returns 1 for lights without shadows, and outside the tile
+float LocalShadowAmount(uint lightIndex, Light light, float3 worldPos)
+{
+	int shadow = LightShadowIndices[lightIndex];
+	if (shadow < 0)
+		return 1.0f;
+
+	uint face = 0;
+	if (light.Type == LIGHT_TYPE_POINT)
+	{
+		float3 fromLight = worldPos - light.Position;
+		float3 axis = abs(fromLight);
+		if (axis.x >= axis.y && axis.x >= axis.z)
+			face = fromLight.x < 0 ? 1 : 0;
+		else if (axis.y >= axis.z)
+			face = fromLight.y < 0 ? 3 : 2;
+		else
+			face = fromLight.z < 0 ? 5 : 4;
+	}
+
+	float4 tile = LocalShadows[shadow].Tiles[face];
+	float4 posForShadow = mul(LocalShadows[shadow].ViewProjections[face], float4(worldPos, 1.0f));
+	if (tile.x <= 0.0f || posForShadow.w <= 0.0f)
+		return 1.0f;
+
+	float3 ndc = posForShadow.xyz / posForShadow.w;
+	if (any(abs(ndc.xy) > 1.0f) || ndc.z > 1.0f)
+		return 1.0f;
+
+	// Kept half a texel inside the tile, so filtering never reaches its neighbors
+	float2 atlasSize;
+	ShadowAtlas.GetDimensions(atlasSize.x, atlasSize.y);
+	float2 halfTexel = 0.5f / (tile.xy * atlasSize);
+	float2 shadowUV = clamp(ndc.xy * float2(0.5f, -0.5f) + 0.5f, halfTexel, 1.0f - halfTexel);
+	return ShadowAtlas.SampleCmpLevelZero(ShadowSampler, shadowUV * tile.xy + tile.zw, ndc.z);
+}
+
+#endif
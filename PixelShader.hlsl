@@ -1,11 +1,8 @@
 
-#include "Lighting.hlsli"
-
-// How many lights could we handle?
-#define MAX_LIGHTS 128
+#include "SceneLighting.hlsli"
 
 // Data that can change per material
-cbuffer perMaterial : register(b0)
+cbuffer perMaterial : register(b1)
 {
 	// Surface color
 	float4 Color;
@@ -14,24 +11,6 @@ cbuffer perMaterial : register(b0)
 	float Shininess;
 };
 
-// Data that only changes once per frame
-cbuffer perFrame : register(b1)
-{
-	// An array of light data
-	Light Lights[MAX_LIGHTS];
-
-	// The amount of lights THIS FRAME
-	int LightCount;
-
-	// Needed for specular (reflection) calculation
-	float3 CameraPosition;
-	
-	//Ambient Color for Environment
-	float3 AmbientNonPBR;
-	
-};
-
-
 // Defines the input to this pixel shader
 // - Should match the output of our corresponding vertex shader
 struct VertexToPixel
@@ -41,26 +20,35 @@ struct VertexToPixel
 	float3 normal			: NORMAL;
 	float3 tangent			: TANGENT;
 	float3 worldPos			: POSITION; // The world position of this PIXEL
-    float4 posForShadow		: SHADOWPOS;
+	nointerpolation uint materialIndex : MATERIAL_INDEX; // Unused, but before the light list
+	nointerpolation uint lightList : LIGHT_LIST;
+	float4 currentClip		: CURRENT_CLIP;	// Without the jitter, for motion vectors
+	float4 prevClip			: PREV_CLIP;
 };
 
 //Output
+#if FEATURE_GBUFFER
+struct PS_Output
+{
+	float4 albedo			: SV_TARGET0;	// See GBuffer.hlsli
+	float2 normals			: SV_TARGET1;
+	float2 surface			: SV_TARGET2;
+	float2 motion			: SV_TARGET3;
+};
+#else
 struct PS_Output
 {
-	float4 color			: SV_TARGET0;
-	float4 normals			: SV_TARGET1;
-	float4 ambient			: SV_TARGET2;
-	float4 depth			: SV_TARGET3;
+	float4 color			: SV_TARGET0;	// Packed with ambient - see GBuffer.hlsli
+	float2 normals			: SV_TARGET1;
+	float2 motion			: SV_TARGET2;
 };
+#endif
 
 // Texture-related variables
 Texture2D AlbedoTexture			: register(t0);
 Texture2D NormalTexture			: register(t1);
 Texture2D RoughnessTexture		: register(t2);
-Texture2D ShadowMap				: register(t3);
 SamplerState BasicSampler		: register(s0);
-SamplerComparisonState ShadowSampler : register(s2);
-
 
 // Entry point for this pixel shader
 PS_Output main(VertexToPixel input) : SV_TARGET
@@ -81,59 +69,29 @@ PS_Output main(VertexToPixel input) : SV_TARGET
 	float4 surfaceColor = AlbedoTexture.Sample(BasicSampler, input.uv);
 	surfaceColor.rgb = pow(surfaceColor.rgb, 2.2) * Color.rgb;
 
+#if FEATURE_GBUFFER
+	// Roughness is only for PBR surfaces, so it's left out
+	PS_Output output;
+	output.albedo = float4(surfaceColor.rgb, 1.0f);
+	output.normals = EncodeNormal(input.normal);
+	output.surface = EncodeSurface(0.0f, specPower);
+	output.motion = EncodeMotion(input.currentClip, input.prevClip);
+	return output;
+#else
 	// SHADOW MAPPING --------------------------------
-	// Note: This is only for a SINGLE light!  If you want multiple lights to cast shadows,
-	// you need to do all of this multiple times IN THIS SHADER.
-    float2 shadowUV = input.posForShadow.xy / input.posForShadow.w * 0.5f + 0.5f;
-    shadowUV.y = 1.0f - shadowUV.y;
-
-	// Calculate this pixel's depth from the light
-    float depthFromLight = input.posForShadow.z / input.posForShadow.w;
-
-	// Sample the shadow map using a comparison sampler, which
-	// will compare the depth from the light and the value in the shadow map
-	// Note: This is applied below, after we calc our DIRECTIONAL LIGHT
-    float shadowAmount = ShadowMap.SampleCmpLevelZero(ShadowSampler, shadowUV, depthFromLight);
-	
-	// Total color for this pixel
-	float3 totalColor = float3(0,0,0);
-
-	// Loop through all lights this frame
-	for(int i = 0; i < LightCount; i++)
-	{
-		// Which kind of light?
-		switch (Lights[i].Type)
-		{
-		case LIGHT_TYPE_DIRECTIONAL:
-			float3 dirLightResult = DirLight(Lights[i], input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
-			
-			// Apply the directional light result, scaled by the shadow mapping
-			//   Note: This demo really only has one shadow map, so this
-			//   will only be correct for THE FIRST DIRECTIONAL LIGHT
-            totalColor += dirLightResult * (Lights[i].CastsShadows ? shadowAmount : 1.0f);
-			break;
-
-		case LIGHT_TYPE_POINT:
-			totalColor += PointLight(Lights[i], input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
-			break;
-
-		case LIGHT_TYPE_SPOT:
-			totalColor += SpotLight(Lights[i], input.normal, input.worldPos, CameraPosition, specPower, surfaceColor.rgb);
-			break;
-		}
-	}
-	
-	
-	// Handle ambient
-	float3 ambient = surfaceColor.rgb * AmbientNonPBR;
+	// Note: This is only for the cascaded directional light - point and
+	// spot lights look up their own tiles of the shadow atlas as they go
+	// Note: This is applied in LightBasic, to the DIRECTIONAL LIGHT
+#if FEATURE_SHADOWS
+	float shadowAmount = ShadowAmount(input.worldPos, input.screenPosition.w);
+#else
+	float shadowAmount = 1.0f;
+#endif
 
 	PS_Output output;
-	// Gamma correction
-	//output.color = float4(pow(totalColor, 1.0f / 2.2f), 1);
-	output.color = float4(totalColor, 1);
-	output.ambient = float4(ambient, 1);
-	output.normals = float4(input.normal * 0.5f + 0.5f, 1);
-	output.depth = input.screenPosition.z;
+	output.color = ShadeBasic(input.screenPosition, input.lightList, input.normal, input.worldPos, specPower, surfaceColor.rgb, shadowAmount);
+	output.normals = EncodeNormal(input.normal);
+	output.motion = EncodeMotion(input.currentClip, input.prevClip);
 	return output;
-
-}
\ No newline at end of file
+#endif
+}
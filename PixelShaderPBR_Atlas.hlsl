@@ -0,0 +1,5 @@
+// PixelShaderPBR.hlsl reading its textures from a MaterialAtlas
+//  - See ShaderFeatures.hlsli and MaterialAtlas.h
+#define FEATURE_MATERIAL_ATLAS 1
+
+#include "PixelShaderPBR.hlsl"
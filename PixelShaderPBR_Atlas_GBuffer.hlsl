@@ -0,0 +1,6 @@
+// PixelShaderPBR_Atlas.hlsl writing the deferred G-buffer rather than lighting
+//  - See ShaderFeatures.hlsli and GBuffer.hlsli
+#define FEATURE_MATERIAL_ATLAS 1
+#define FEATURE_GBUFFER 1
+
+#include "PixelShaderPBR.hlsl"
@@ -0,0 +1,5 @@
+// PixelShaderPBR.hlsl with directional lights only
+//  - See ShaderFeatures.hlsli
+#define FEATURE_LOCAL_LIGHTS 0
+
+#include "PixelShaderPBR.hlsl"
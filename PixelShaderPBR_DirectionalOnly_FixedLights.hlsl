@@ -0,0 +1,6 @@
+// PixelShaderPBR.hlsl with directional lights only and an unrolled, fixed light count
+//  - See ShaderFeatures.hlsli
+#define FEATURE_LOCAL_LIGHTS 0
+#define FEATURE_FIXED_LIGHTS 1
+
+#include "PixelShaderPBR.hlsl"
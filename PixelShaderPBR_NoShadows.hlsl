@@ -0,0 +1,5 @@
+// PixelShaderPBR.hlsl with no shadows
+//  - See ShaderFeatures.hlsli
+#define FEATURE_SHADOWS 0
+
+#include "PixelShaderPBR.hlsl"
@@ -0,0 +1,7 @@
+// PixelShaderPBR.hlsl with no shadows, directional lights only and an unrolled, fixed light count
+//  - See ShaderFeatures.hlsli
+#define FEATURE_SHADOWS 0
+#define FEATURE_LOCAL_LIGHTS 0
+#define FEATURE_FIXED_LIGHTS 1
+
+#include "PixelShaderPBR.hlsl"
@@ -0,0 +1,5 @@
+// PixelShader.hlsl with directional lights only
+//  - See ShaderFeatures.hlsli
+#define FEATURE_LOCAL_LIGHTS 0
+
+#include "PixelShader.hlsl"
@@ -0,0 +1,5 @@
+// PixelShader.hlsl with an unrolled, fixed light count
+//  - See ShaderFeatures.hlsli
+#define FEATURE_FIXED_LIGHTS 1
+
+#include "PixelShader.hlsl"
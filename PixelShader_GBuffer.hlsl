@@ -0,0 +1,5 @@
+// PixelShader.hlsl writing the deferred G-buffer rather than lighting
+//  - See ShaderFeatures.hlsli and GBuffer.hlsli
+#define FEATURE_GBUFFER 1
+
+#include "PixelShader.hlsl"
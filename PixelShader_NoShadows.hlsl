@@ -0,0 +1,5 @@
+// PixelShader.hlsl with no shadows
+//  - See ShaderFeatures.hlsli
+#define FEATURE_SHADOWS 0
+
+#include "PixelShader.hlsl"
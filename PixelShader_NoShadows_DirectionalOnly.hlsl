@@ -0,0 +1,6 @@
+// PixelShader.hlsl with no shadows and directional lights only
+//  - See ShaderFeatures.hlsli
+#define FEATURE_SHADOWS 0
+#define FEATURE_LOCAL_LIGHTS 0
+
+#include "PixelShader.hlsl"
@@ -7,65 +7,69 @@ Player::Player(Mesh* mesh, Material* material, Camera* camera, bool local) : Gam
 	localPlayer = local;
 }
 
-void Player::Update(float dt)
+PlayerControls Player::ReadControls()
 {
-
-	float speed = moveSpeed;
-
-	float x = camera->GetTransform()->GetPosition().x;
-	float y = camera->GetTransform()->GetPosition().y;
-	float z = camera->GetTransform()->GetPosition().z;
-
 	// Get the input manager instance
 	Input& input = Input::GetInstance();
 
-	if (localPlayer)
-	{
+	PlayerControls controls;
+	controls.Forward = input.KeyDown('W');
+	controls.Backward = input.KeyDown('S');
+	controls.Left = input.KeyDown('A');
+	controls.Right = input.KeyDown('D');
+	controls.Jump = input.KeyDown(' ');
+	controls.Faster = input.KeyDown(VK_SHIFT);
+	controls.Slower = input.KeyDown(VK_CONTROL);
+	return controls;
+}
 
-		// Speed up or down as necessary
-		if (input.KeyDown(VK_SHIFT)) { speed *= 1.6f; }
-		if (input.KeyDown(VK_CONTROL)) { speed *= 0.5f; }
+void Player::Update(float dt)
+{
+	Update(dt, ReadControls());
+}
 
-		// Movement
-		if (input.KeyDown('W')) { velocityZ = speed; }
-		else if (input.KeyDown('S')) { velocityZ = -speed; }
-		else velocityZ = 0;
-		if (input.KeyDown('A')) { velocityX = -speed; }
-		else if (input.KeyDown('D')) { velocityX = speed; }
-		else velocityX = 0;
-		//if (input.KeyDown('X')) { camera->GetTransform()->MoveAbsolute(0, -speed, 0); }
+void Player::Update(float dt, const PlayerControls& controls)
+{
+	// Only the local player's moved by the controls
+	PlayerMovementState state = GetMovementState();
+	SimulatePlayerMovement(state, localPlayer ? &controls : 0, camera->GetTransform()->GetPitchYawRoll(), dt);
+	SetMovementState(state);
+}
 
-		// Handle mouse movement only when button is down
-		if (input.MouseRightDown())
-		{
-			// Calculate cursor change
-			float xDiff = dt * mouseLookSpeed * input.GetMouseXDelta();
-			float yDiff = dt * mouseLookSpeed * input.GetMouseYDelta();
-			camera->GetTransform()->Rotate(yDiff, xDiff, 0);
-		}
-	}
+PlayerMovementState Player::GetMovementState()
+{
+	PlayerMovementState state;
+	state.Position = camera->GetTransform()->GetPosition();
+	state.Velocity = DirectX::XMFLOAT3(velocityX, velocityY, velocityZ);
+	return state;
+}
 
+void Player::SetMovementState(const PlayerMovementState& state)
+{
+	camera->GetTransform()->SetPosition(state.Position.x, state.Position.y, state.Position.z);
+	SetVelocity(state.Velocity.x, state.Velocity.y, state.Velocity.z);
+}
 
-	//Movement
+void Player::Look(float dt)
+{
+	Input& input = Input::GetInstance();
+	Look(dt, input.GetMouseXDelta(), input.GetMouseYDelta());
+}
 
-	if (y > floorHeight)
-	{
-		velocityY += gravity * dt;
-	}
-	else if (y <= floorHeight)
+// Looks around by a given mouse movement, like the extra
+// that came in since the frame started (see Game::LateLatchCamera())
+void Player::Look(float dt, int mouseXDelta, int mouseYDelta)
+{
+	Input& input = Input::GetInstance();
+
+	// Handle mouse movement only when button is down
+	if (localPlayer && input.MouseRightDown())
 	{
-		velocityY = 0;
-		y = floorHeight;
+		// Calculate cursor change
+		float xDiff = dt * mouseLookSpeed * mouseXDelta;
+		float yDiff = dt * mouseLookSpeed * mouseYDelta;
+		camera->GetTransform()->Rotate(yDiff, xDiff, 0);
 	}
-
-	//Jump
-	if (localPlayer && input.KeyDown(' ') && y <= floorHeight) { velocityY = jumpForce; }
-
-	camera->GetTransform()->MoveRelative(velocityX * dt, 0, velocityZ * dt);
-	x = camera->GetTransform()->GetPosition().x;
-	z = camera->GetTransform()->GetPosition().z;
-	camera->GetTransform()->SetPosition(x, y + velocityY * dt, z);
-
 }
 
 void Player::SetVelocity(float x, float y, float z)
@@ -1,33 +1,42 @@
 #pragma once
 #include "GameEntity.h"
 #include "Camera.h"
+#include "Movement.h"
 
 class Player : public GameEntity
 {
 private:
 
-	float moveSpeed = 15.0f;
-	float gravity = -19.6f;
-	float jumpForce = 8;
 	float mouseLookSpeed = 1.0f;
 
 	Camera* camera;
 
 	bool localPlayer;
 
-	//TEMPORARY
-	float floorHeight = -3;
-
 public:
 
 	Player(Mesh* mesh, Material* material, Camera* camera, bool local = true);
 
 	Camera* GetCamera() { return camera; }
 
+	// Movement, once per simulation tick, from the keyboard
+	// or from controls read from it earlier
 	void Update(float dt);
+	void Update(float dt, const PlayerControls& controls);
+	static PlayerControls ReadControls();
+
+	// Mouse look, once per frame, since the mouse's movement
+	// is only known for the whole frame
+	void Look(float dt);
+	void Look(float dt, int mouseXDelta, int mouseYDelta);
 
 	void SetVelocity(float x, float y, float z);
 
+	// Where the camera is and how it's moving, for the
+	// movement code shared with the server
+	PlayerMovementState GetMovementState();
+	void SetMovementState(const PlayerMovementState& state);
+
 	float velocityX;
 	float velocityY;
 	float velocityZ;
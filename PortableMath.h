@@ -0,0 +1,464 @@
+#pragma once
+
+// Shared by the game and the server (see Server/GameServer)
+//
+// DirectXMath, wherever there is one, and otherwise (the Linux server)
+// a plain scalar version of just the part of it the server's code uses,
+// with the same names, layouts and conventions (row vectors, left to
+// right multiplication, and comparisons giving all-ones lanes)
+//  - Anything shared with the server includes this rather than
+//    DirectXMath.h, and game-only code can carry on including that
+
+#if defined(_WIN32) || defined(PORTABLE_MATH_USE_DIRECTXMATH)
+#include <DirectXMath.h>
+#else
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace DirectX
+{
+#define XM_CALLCONV
+
+	const float XM_PI = 3.141592654f;
+	const float XM_2PI = 6.283185307f;
+
+	// Floats or their bits, like DirectXMath's own no-intrinsics version
+	struct alignas(16) XMVECTOR
+	{
+		union
+		{
+			float vector4_f32[4];
+			uint32_t vector4_u32[4];
+		};
+	};
+	typedef const XMVECTOR FXMVECTOR;
+	typedef const XMVECTOR GXMVECTOR;
+	typedef const XMVECTOR HXMVECTOR;
+	typedef const XMVECTOR& CXMVECTOR;
+
+	struct alignas(16) XMMATRIX
+	{
+		XMVECTOR r[4];
+
+		XMMATRIX() = default;
+		XMMATRIX(FXMVECTOR r0, FXMVECTOR r1, FXMVECTOR r2, CXMVECTOR r3) { r[0] = r0; r[1] = r1; r[2] = r2; r[3] = r3; }
+	};
+	typedef const XMMATRIX FXMMATRIX;
+	typedef const XMMATRIX& CXMMATRIX;
+
+	struct XMFLOAT3
+	{
+		float x, y, z;
+
+		XMFLOAT3() = default;
+		XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+	};
+
+	struct XMFLOAT4
+	{
+		float x, y, z, w;
+
+		XMFLOAT4() = default;
+		XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	};
+
+	struct XMUINT4
+	{
+		uint32_t x, y, z, w;
+
+		XMUINT4() = default;
+		XMUINT4(uint32_t _x, uint32_t _y, uint32_t _z, uint32_t _w) : x(_x), y(_y), z(_z), w(_w) {}
+	};
+
+	struct XMFLOAT4X4
+	{
+		union
+		{
+			struct
+			{
+				float _11, _12, _13, _14;
+				float _21, _22, _23, _24;
+				float _31, _32, _33, _34;
+				float _41, _42, _43, _44;
+			};
+			float m[4][4];
+		};
+
+		XMFLOAT4X4() = default;
+	};
+
+	// Wrapped into -pi to pi, the way DirectXMath does it
+	inline float XMScalarModAngle(float angle)
+	{
+		angle = angle + XM_PI;
+		float wrapped = fabsf(angle);
+		wrapped = wrapped - XM_2PI * (float)(int32_t)(wrapped / XM_2PI);
+		wrapped = wrapped - XM_PI;
+		return angle < 0.0f ? -wrapped : wrapped;
+	}
+
+	// --------------------------------------------------------
+	// Vectors
+	// --------------------------------------------------------
+	inline XMVECTOR XM_CALLCONV XMVectorSet(float x, float y, float z, float w)
+	{
+		XMVECTOR v;
+		v.vector4_f32[0] = x; v.vector4_f32[1] = y; v.vector4_f32[2] = z; v.vector4_f32[3] = w;
+		return v;
+	}
+
+	inline XMVECTOR XM_CALLCONV XMVectorReplicate(float value) { return XMVectorSet(value, value, value, value); }
+	inline XMVECTOR XM_CALLCONV XMVectorZero() { return XMVectorReplicate(0.0f); }
+	inline XMVECTOR XM_CALLCONV XMVectorSplatOne() { return XMVectorReplicate(1.0f); }
+	inline float XM_CALLCONV XMVectorGetX(FXMVECTOR v) { return v.vector4_f32[0]; }
+
+	inline XMVECTOR XM_CALLCONV XMVectorSetW(FXMVECTOR v, float w)
+	{
+		XMVECTOR result = v;
+		result.vector4_f32[3] = w;
+		return result;
+	}
+
+	// Applies an operation to each lane
+#define PORTABLE_MATH_LANES(expression) \
+	XMVECTOR result; \
+	for (int i = 0; i < 4; i++) result.vector4_f32[i] = (expression); \
+	return result;
+
+	inline XMVECTOR XM_CALLCONV XMVectorAdd(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_LANES(a.vector4_f32[i] + b.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorSubtract(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_LANES(a.vector4_f32[i] - b.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorMultiply(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_LANES(a.vector4_f32[i] * b.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorDivide(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_LANES(a.vector4_f32[i] / b.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorNegate(FXMVECTOR v) { PORTABLE_MATH_LANES(-v.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorReciprocal(FXMVECTOR v) { PORTABLE_MATH_LANES(1.0f / v.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorScale(FXMVECTOR v, float scale) { PORTABLE_MATH_LANES(v.vector4_f32[i] * scale) }
+	inline XMVECTOR XM_CALLCONV XMVectorMin(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_LANES(a.vector4_f32[i] < b.vector4_f32[i] ? a.vector4_f32[i] : b.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorMax(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_LANES(a.vector4_f32[i] > b.vector4_f32[i] ? a.vector4_f32[i] : b.vector4_f32[i]) }
+
+	// a * b + c, and c - a * b
+	inline XMVECTOR XM_CALLCONV XMVectorMultiplyAdd(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c) { PORTABLE_MATH_LANES(a.vector4_f32[i] * b.vector4_f32[i] + c.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorNegativeMultiplySubtract(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c) { PORTABLE_MATH_LANES(c.vector4_f32[i] - a.vector4_f32[i] * b.vector4_f32[i]) }
+
+	inline XMVECTOR XM_CALLCONV XMVectorClamp(FXMVECTOR v, FXMVECTOR low, FXMVECTOR high) { return XMVectorMin(XMVectorMax(v, low), high); }
+	inline XMVECTOR XM_CALLCONV XMVectorSaturate(FXMVECTOR v) { return XMVectorClamp(v, XMVectorZero(), XMVectorSplatOne()); }
+
+	inline void XM_CALLCONV XMVectorSinCos(XMVECTOR* sin, XMVECTOR* cos, FXMVECTOR v)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			sin->vector4_f32[i] = sinf(v.vector4_f32[i]);
+			cos->vector4_f32[i] = cosf(v.vector4_f32[i]);
+		}
+	}
+
+	inline void XMScalarSinCos(float* sin, float* cos, float value)
+	{
+		*sin = sinf(value);
+		*cos = cosf(value);
+	}
+#undef PORTABLE_MATH_LANES
+
+	// Comparisons fill each lane with all ones or all zeros, for XMVectorSelect()
+#define PORTABLE_MATH_COMPARE(expression) \
+	XMVECTOR result; \
+	for (int i = 0; i < 4; i++) result.vector4_u32[i] = (expression) ? 0xFFFFFFFFu : 0u; \
+	return result;
+
+	inline XMVECTOR XM_CALLCONV XMVectorLess(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_COMPARE(a.vector4_f32[i] < b.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorLessOrEqual(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_COMPARE(a.vector4_f32[i] <= b.vector4_f32[i]) }
+	inline XMVECTOR XM_CALLCONV XMVectorGreater(FXMVECTOR a, FXMVECTOR b) { PORTABLE_MATH_COMPARE(a.vector4_f32[i] > b.vector4_f32[i]) }
+#undef PORTABLE_MATH_COMPARE
+
+	// Each bit from b where the control's set, and from a where it isn't
+	inline XMVECTOR XM_CALLCONV XMVectorSelect(FXMVECTOR a, FXMVECTOR b, FXMVECTOR control)
+	{
+		XMVECTOR result;
+		for (int i = 0; i < 4; i++)
+			result.vector4_u32[i] = (a.vector4_u32[i] & ~control.vector4_u32[i]) | (b.vector4_u32[i] & control.vector4_u32[i]);
+		return result;
+	}
+
+	// Three component ones, replicated into every lane
+	inline XMVECTOR XM_CALLCONV XMVector3Dot(FXMVECTOR a, FXMVECTOR b)
+	{
+		return XMVectorReplicate(a.vector4_f32[0] * b.vector4_f32[0] + a.vector4_f32[1] * b.vector4_f32[1] + a.vector4_f32[2] * b.vector4_f32[2]);
+	}
+
+	inline XMVECTOR XM_CALLCONV XMVector3LengthSq(FXMVECTOR v) { return XMVector3Dot(v, v); }
+	inline XMVECTOR XM_CALLCONV XMVector3Length(FXMVECTOR v) { return XMVectorReplicate(sqrtf(XMVectorGetX(XMVector3LengthSq(v)))); }
+
+	inline XMVECTOR XM_CALLCONV operator+(FXMVECTOR a, FXMVECTOR b) { return XMVectorAdd(a, b); }
+	inline XMVECTOR XM_CALLCONV operator-(FXMVECTOR a, FXMVECTOR b) { return XMVectorSubtract(a, b); }
+	inline XMVECTOR XM_CALLCONV operator*(FXMVECTOR a, FXMVECTOR b) { return XMVectorMultiply(a, b); }
+	inline XMVECTOR XM_CALLCONV operator/(FXMVECTOR a, FXMVECTOR b) { return XMVectorDivide(a, b); }
+	inline XMVECTOR XM_CALLCONV operator*(FXMVECTOR v, float scale) { return XMVectorScale(v, scale); }
+	inline XMVECTOR XM_CALLCONV operator*(float scale, FXMVECTOR v) { return XMVectorScale(v, scale); }
+	inline XMVECTOR XM_CALLCONV operator-(FXMVECTOR v) { return XMVectorNegate(v); }
+	inline XMVECTOR& XM_CALLCONV operator+=(XMVECTOR& a, FXMVECTOR b) { a = XMVectorAdd(a, b); return a; }
+	inline XMVECTOR& XM_CALLCONV operator-=(XMVECTOR& a, FXMVECTOR b) { a = XMVectorSubtract(a, b); return a; }
+	inline XMVECTOR& XM_CALLCONV operator*=(XMVECTOR& a, FXMVECTOR b) { a = XMVectorMultiply(a, b); return a; }
+	inline XMVECTOR& XM_CALLCONV operator/=(XMVECTOR& a, FXMVECTOR b) { a = XMVectorDivide(a, b); return a; }
+
+	// --------------------------------------------------------
+	// Loads and stores (the fourth lane of a three component
+	// load is zero)
+	// --------------------------------------------------------
+	inline XMVECTOR XM_CALLCONV XMLoadFloat3(const XMFLOAT3* source) { return XMVectorSet(source->x, source->y, source->z, 0.0f); }
+	inline XMVECTOR XM_CALLCONV XMLoadFloat4(const XMFLOAT4* source) { return XMVectorSet(source->x, source->y, source->z, source->w); }
+
+	inline void XM_CALLCONV XMStoreFloat3(XMFLOAT3* destination, FXMVECTOR v)
+	{
+		destination->x = v.vector4_f32[0];
+		destination->y = v.vector4_f32[1];
+		destination->z = v.vector4_f32[2];
+	}
+
+	inline void XM_CALLCONV XMStoreFloat4(XMFLOAT4* destination, FXMVECTOR v)
+	{
+		destination->x = v.vector4_f32[0];
+		destination->y = v.vector4_f32[1];
+		destination->z = v.vector4_f32[2];
+		destination->w = v.vector4_f32[3];
+	}
+
+	inline void XM_CALLCONV XMStoreUInt4(XMUINT4* destination, FXMVECTOR v)
+	{
+		destination->x = v.vector4_u32[0];
+		destination->y = v.vector4_u32[1];
+		destination->z = v.vector4_u32[2];
+		destination->w = v.vector4_u32[3];
+	}
+
+	inline XMMATRIX XM_CALLCONV XMLoadFloat4x4(const XMFLOAT4X4* source)
+	{
+		XMMATRIX m;
+		for (int row = 0; row < 4; row++)
+			m.r[row] = XMVectorSet(source->m[row][0], source->m[row][1], source->m[row][2], source->m[row][3]);
+		return m;
+	}
+
+	inline void XM_CALLCONV XMStoreFloat4x4(XMFLOAT4X4* destination, FXMMATRIX m)
+	{
+		for (int row = 0; row < 4; row++)
+			for (int column = 0; column < 4; column++)
+				destination->m[row][column] = m.r[row].vector4_f32[column];
+	}
+
+	// --------------------------------------------------------
+	// Matrices
+	// --------------------------------------------------------
+	inline XMMATRIX XM_CALLCONV XMMatrixIdentity()
+	{
+		return XMMATRIX(XMVectorSet(1, 0, 0, 0), XMVectorSet(0, 1, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 0, 0, 1));
+	}
+
+	inline XMMATRIX XM_CALLCONV XMMatrixTranspose(FXMMATRIX m)
+	{
+		XMMATRIX result;
+		for (int row = 0; row < 4; row++)
+			for (int column = 0; column < 4; column++)
+				result.r[row].vector4_f32[column] = m.r[column].vector4_f32[row];
+		return result;
+	}
+
+	inline XMMATRIX XM_CALLCONV XMMatrixMultiply(FXMMATRIX a, CXMMATRIX b)
+	{
+		XMMATRIX result;
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < 4; k++)
+					sum += a.r[row].vector4_f32[k] * b.r[k].vector4_f32[column];
+				result.r[row].vector4_f32[column] = sum;
+			}
+		}
+		return result;
+	}
+
+	inline XMMATRIX XM_CALLCONV operator*(FXMMATRIX a, CXMMATRIX b) { return XMMatrixMultiply(a, b); }
+	inline XMMATRIX& XM_CALLCONV operator*=(XMMATRIX& a, CXMMATRIX b) { a = XMMatrixMultiply(a, b); return a; }
+
+	inline XMMATRIX XM_CALLCONV XMMatrixScalingFromVector(FXMVECTOR scale)
+	{
+		return XMMATRIX(XMVectorSet(scale.vector4_f32[0], 0, 0, 0), XMVectorSet(0, scale.vector4_f32[1], 0, 0),
+			XMVectorSet(0, 0, scale.vector4_f32[2], 0), XMVectorSet(0, 0, 0, 1));
+	}
+
+	inline XMMATRIX XM_CALLCONV XMMatrixTranslationFromVector(FXMVECTOR offset)
+	{
+		return XMMATRIX(XMVectorSet(1, 0, 0, 0), XMVectorSet(0, 1, 0, 0), XMVectorSet(0, 0, 1, 0),
+			XMVectorSet(offset.vector4_f32[0], offset.vector4_f32[1], offset.vector4_f32[2], 1));
+	}
+
+	// Roll (z), then pitch (x), then yaw (y)
+	inline XMMATRIX XM_CALLCONV XMMatrixRotationRollPitchYaw(float pitch, float yaw, float roll)
+	{
+		float sp = sinf(pitch), cp = cosf(pitch);
+		float sy = sinf(yaw), cy = cosf(yaw);
+		float sr = sinf(roll), cr = cosf(roll);
+		return XMMATRIX(
+			XMVectorSet(cr * cy + sr * sp * sy, sr * cp, sr * sp * cy - cr * sy, 0),
+			XMVectorSet(cr * sp * sy - sr * cy, cr * cp, sr * sy + cr * sp * cy, 0),
+			XMVectorSet(cp * sy, -sp, cp * cy, 0),
+			XMVectorSet(0, 0, 0, 1));
+	}
+
+	inline XMMATRIX XM_CALLCONV XMMatrixRotationRollPitchYawFromVector(FXMVECTOR angles)
+	{
+		return XMMatrixRotationRollPitchYaw(angles.vector4_f32[0], angles.vector4_f32[1], angles.vector4_f32[2]);
+	}
+
+	inline XMMATRIX XM_CALLCONV XMMatrixRotationQuaternion(FXMVECTOR q)
+	{
+		float x = q.vector4_f32[0], y = q.vector4_f32[1], z = q.vector4_f32[2], w = q.vector4_f32[3];
+		return XMMATRIX(
+			XMVectorSet(1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w), 0),
+			XMVectorSet(2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w), 0),
+			XMVectorSet(2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y), 0),
+			XMVectorSet(0, 0, 0, 1));
+	}
+
+	// By cofactors, with the determinant replicated into each lane
+	inline XMMATRIX XM_CALLCONV XMMatrixInverse(XMVECTOR* determinant, FXMMATRIX m)
+	{
+		float a[16], inverse[16];
+		for (int i = 0; i < 16; i++)
+			a[i] = m.r[i / 4].vector4_f32[i % 4];
+
+		inverse[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+		inverse[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+		inverse[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+		inverse[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+		inverse[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+		inverse[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+		inverse[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+		inverse[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+		inverse[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+		inverse[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+		inverse[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+		inverse[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+		inverse[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+		inverse[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+		inverse[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+		inverse[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+		float det = a[0] * inverse[0] + a[1] * inverse[4] + a[2] * inverse[8] + a[3] * inverse[12];
+		if (determinant)
+			*determinant = XMVectorReplicate(det);
+
+		XMMATRIX result;
+		float scale = 1.0f / det;
+		for (int i = 0; i < 16; i++)
+			result.r[i / 4].vector4_f32[i % 4] = inverse[i] * scale;
+		return result;
+	}
+
+	// --------------------------------------------------------
+	// Quaternions (x, y, z, w)
+	// --------------------------------------------------------
+	inline XMVECTOR XM_CALLCONV XMQuaternionRotationRollPitchYaw(float pitch, float yaw, float roll)
+	{
+		float sp = sinf(pitch * 0.5f), cp = cosf(pitch * 0.5f);
+		float sy = sinf(yaw * 0.5f), cy = cosf(yaw * 0.5f);
+		float sr = sinf(roll * 0.5f), cr = cosf(roll * 0.5f);
+		return XMVectorSet(
+			cr * sp * cy + sr * cp * sy,
+			cr * cp * sy - sr * sp * cy,
+			sr * cp * cy - cr * sp * sy,
+			cr * cp * cy + sr * sp * sy);
+	}
+
+	inline XMVECTOR XM_CALLCONV XMQuaternionRotationRollPitchYawFromVector(FXMVECTOR angles)
+	{
+		return XMQuaternionRotationRollPitchYaw(angles.vector4_f32[0], angles.vector4_f32[1], angles.vector4_f32[2]);
+	}
+
+	// From a pure rotation matrix
+	inline XMVECTOR XM_CALLCONV XMQuaternionRotationMatrix(FXMMATRIX m)
+	{
+		float m00 = m.r[0].vector4_f32[0], m01 = m.r[0].vector4_f32[1], m02 = m.r[0].vector4_f32[2];
+		float m10 = m.r[1].vector4_f32[0], m11 = m.r[1].vector4_f32[1], m12 = m.r[1].vector4_f32[2];
+		float m20 = m.r[2].vector4_f32[0], m21 = m.r[2].vector4_f32[1], m22 = m.r[2].vector4_f32[2];
+
+		float trace = m00 + m11 + m22;
+		if (trace > 0.0f)
+		{
+			float s = sqrtf(trace + 1.0f) * 2.0f;
+			return XMVectorSet((m12 - m21) / s, (m20 - m02) / s, (m01 - m10) / s, 0.25f * s);
+		}
+		if (m00 > m11 && m00 > m22)
+		{
+			float s = sqrtf(1.0f + m00 - m11 - m22) * 2.0f;
+			return XMVectorSet(0.25f * s, (m01 + m10) / s, (m20 + m02) / s, (m12 - m21) / s);
+		}
+		if (m11 > m22)
+		{
+			float s = sqrtf(1.0f + m11 - m00 - m22) * 2.0f;
+			return XMVectorSet((m01 + m10) / s, 0.25f * s, (m12 + m21) / s, (m20 - m02) / s);
+		}
+		float s = sqrtf(1.0f + m22 - m00 - m11) * 2.0f;
+		return XMVectorSet((m20 + m02) / s, (m12 + m21) / s, 0.25f * s, (m01 - m10) / s);
+	}
+
+	// q v q*, with a zero fourth lane
+	inline XMVECTOR XM_CALLCONV XMVector3Rotate(FXMVECTOR v, FXMVECTOR q)
+	{
+		float qx = q.vector4_f32[0], qy = q.vector4_f32[1], qz = q.vector4_f32[2], qw = q.vector4_f32[3];
+		float vx = v.vector4_f32[0], vy = v.vector4_f32[1], vz = v.vector4_f32[2];
+
+		// t = 2 (q.xyz x v), then v + w t + q.xyz x t
+		float tx = 2 * (qy * vz - qz * vy);
+		float ty = 2 * (qz * vx - qx * vz);
+		float tz = 2 * (qx * vy - qy * vx);
+		return XMVectorSet(
+			vx + qw * tx + (qy * tz - qz * ty),
+			vy + qw * ty + (qz * tx - qx * tz),
+			vz + qw * tz + (qx * ty - qy * tx),
+			0.0f);
+	}
+
+	// --------------------------------------------------------
+	// Splits a scale, rotation and translation matrix (which
+	// is all the transforms ever build) back into its parts,
+	// returning false if a scale's too small to divide out
+	//  - A mirrored matrix gets its largest scale negated,
+	//    like DirectXMath does
+	// --------------------------------------------------------
+	inline bool XM_CALLCONV XMMatrixDecompose(XMVECTOR* outScale, XMVECTOR* outRotation, XMVECTOR* outTranslation, FXMMATRIX m)
+	{
+		*outTranslation = XMVectorSetW(m.r[3], 0.0f);
+
+		float scale[3];
+		XMVECTOR axes[3];
+		unsigned int largest = 0;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			scale[i] = XMVectorGetX(XMVector3Length(m.r[i]));
+			if (scale[i] < 1e-6f)
+				return false;
+			axes[i] = XMVectorScale(XMVectorSetW(m.r[i], 0.0f), 1.0f / scale[i]);
+			if (scale[i] > scale[largest])
+				largest = i;
+		}
+
+		float x0 = axes[0].vector4_f32[0], y0 = axes[0].vector4_f32[1], z0 = axes[0].vector4_f32[2];
+		float x1 = axes[1].vector4_f32[0], y1 = axes[1].vector4_f32[1], z1 = axes[1].vector4_f32[2];
+		float x2 = axes[2].vector4_f32[0], y2 = axes[2].vector4_f32[1], z2 = axes[2].vector4_f32[2];
+		float det = x0 * (y1 * z2 - z1 * y2) - y0 * (x1 * z2 - z1 * x2) + z0 * (x1 * y2 - y1 * x2);
+		if (det < 0.0f)
+		{
+			scale[largest] = -scale[largest];
+			axes[largest] = XMVectorNegate(axes[largest]);
+		}
+
+		*outScale = XMVectorSet(scale[0], scale[1], scale[2], 0.0f);
+		*outRotation = XMQuaternionRotationMatrix(XMMATRIX(axes[0], axes[1], axes[2], XMVectorSet(0, 0, 0, 1)));
+		return true;
+	}
+}
+
+#endif
@@ -1,34 +1,132 @@
 #include "Projectile.h"
 
-Projectile::Projectile(Mesh* mesh, Material* material, float lifespan) : GameEntity(mesh, material)
+using namespace DirectX;
+
+void ProjectileArrays::Resize(unsigned int count)
 {
+	// Room for the last group of four, with its padding dead
+	unsigned int padded = (count + 3) & ~3u;
+	for (int s = 0; s < StreamCount; s++)
+		streams[s].resize(padded, 0.0f);
+	live.resize(padded, 0);
+	pitchYawRoll.resize(padded, XMFLOAT3(0, 0, 0));
 
-	Projectile::lifespan = lifespan;
+	// Anything cut off is dead if it's ever grown back into
+	for (unsigned int i = count; i < padded; i++)
+		live[i] = 0;
+	this->count = count;
+}
 
-	velocityX = 0;
-	velocityY = 0;
-	velocityZ = 0;
-	age = 0;
+SimulatedProjectile ProjectileArrays::Get(unsigned int index)
+{
+	SimulatedProjectile state;
+	state.Position = GetPosition(index);
+	state.PitchYawRoll = pitchYawRoll[index];
+	state.Velocity = XMFLOAT3(streams[VelocityX][index], streams[VelocityY][index], streams[VelocityZ][index]);
+	state.Gravity = streams[Gravity][index];
+	state.Age = streams[Age][index];
+	state.Lifespan = streams[Lifespan][index];
+	state.Dead = !IsLive(index);
+	return state;
+}
 
+void ProjectileArrays::Set(unsigned int index, const SimulatedProjectile& state)
+{
+	streams[PositionX][index] = state.Position.x;
+	streams[PositionY][index] = state.Position.y;
+	streams[PositionZ][index] = state.Position.z;
+	streams[VelocityX][index] = state.Velocity.x;
+	streams[VelocityY][index] = state.Velocity.y;
+	streams[VelocityZ][index] = state.Velocity.z;
+	streams[Gravity][index] = state.Gravity;
+	streams[Age][index] = state.Age;
+	streams[Lifespan][index] = state.Lifespan;
+	SetLive(index, !state.Dead);
+
+	// The same axes the server moves its projectiles along
+	pitchYawRoll[index] = state.PitchYawRoll;
+	MovementAxes axes = GetMovementAxes(state.PitchYawRoll);
+	const XMFLOAT3& right = axes.Right;
+	const XMFLOAT3& up = axes.Up;
+	const XMFLOAT3& forward = axes.Forward;
+	streams[RightX][index] = right.x;
+	streams[RightY][index] = right.y;
+	streams[RightZ][index] = right.z;
+	streams[UpX][index] = up.x;
+	streams[UpY][index] = up.y;
+	streams[UpZ][index] = up.z;
+	streams[ForwardX][index] = forward.x;
+	streams[ForwardY][index] = forward.y;
+	streams[ForwardZ][index] = forward.z;
 }
 
-void Projectile::SetVelocity(float x, float y, float z, float g)
+XMFLOAT3 ProjectileArrays::GetPosition(unsigned int index)
 {
-	velocityX = x;
-	velocityY = y;
-	velocityZ = z;
-	gravity = g;
+	return XMFLOAT3(streams[PositionX][index], streams[PositionY][index], streams[PositionZ][index]);
 }
 
-void Projectile::Update(float dt)
+// --------------------------------------------------------
+// SimulateProjectileMovement()'s steps - age, then gravity,
+// then the move along its axes, then the checks - but for
+// four at once
+//  - XMVectorMultiplyAdd() is only fused when DirectXMath is
+//    built for FMA3, which the game isn't, so each lane rounds
+//    just as the scalar step does
+//  - Lanes that aren't live are selected back to what they
+//    were, so dead ones (and the padding) never move
+// --------------------------------------------------------
+void ProjectileArrays::Update(float dt, std::vector<unsigned int>* died)
 {
-	age += dt;
+	XMVECTOR step = XMVectorReplicate(dt);
+	XMVECTOR killHeight = XMVectorReplicate(PROJECTILE_KILL_HEIGHT);
+	float* s[StreamCount];
+	for (int i = 0; i < StreamCount; i++)
+		s[i] = streams[i].data();
+
+	auto load = [&](Stream stream, unsigned int i) { return XMLoadFloat4((const XMFLOAT4*)(s[stream] + i)); };
+	auto store = [&](Stream stream, unsigned int i, FXMVECTOR v) { XMStoreFloat4((XMFLOAT4*)(s[stream] + i), v); };
+
+	for (unsigned int i = 0; i < count; i += 4)
+	{
+		XMVECTOR mask = XMLoadUInt4((const XMUINT4*)(live.data() + i));
+		if (XMVector4EqualInt(mask, XMVectorZero()))
+			continue;
+
+		XMVECTOR age = XMVectorAdd(load(Age, i), step);
+		XMVECTOR velY = XMVectorMultiplyAdd(load(Gravity, i), step, load(VelocityY, i));
 
-	if (age >= lifespan) dead = true;
+		// Local velocity onto the axes, times dt
+		XMVECTOR moveX = XMVectorMultiply(load(VelocityX, i), step);
+		XMVECTOR moveY = XMVectorMultiply(velY, step);
+		XMVECTOR moveZ = XMVectorMultiply(load(VelocityZ, i), step);
+		XMVECTOR posX = XMVectorMultiplyAdd(moveX, load(RightX, i), XMVectorMultiplyAdd(moveY, load(UpX, i), XMVectorMultiplyAdd(moveZ, load(ForwardX, i), load(PositionX, i))));
+		XMVECTOR posY = XMVectorMultiplyAdd(moveX, load(RightY, i), XMVectorMultiplyAdd(moveY, load(UpY, i), XMVectorMultiplyAdd(moveZ, load(ForwardY, i), load(PositionY, i))));
+		XMVECTOR posZ = XMVectorMultiplyAdd(moveX, load(RightZ, i), XMVectorMultiplyAdd(moveY, load(UpZ, i), XMVectorMultiplyAdd(moveZ, load(ForwardZ, i), load(PositionZ, i))));
 
-	velocityY += gravity * dt;
-	transform.MoveRelative(velocityX * dt, velocityY * dt, velocityZ * dt);
+		store(Age, i, XMVectorSelect(load(Age, i), age, mask));
+		store(VelocityY, i, XMVectorSelect(load(VelocityY, i), velY, mask));
+		store(PositionX, i, XMVectorSelect(load(PositionX, i), posX, mask));
+		store(PositionY, i, XMVectorSelect(load(PositionY, i), posY, mask));
+		store(PositionZ, i, XMVectorSelect(load(PositionZ, i), posZ, mask));
 
-	if (transform.GetPosition().y <= -6) dead = true;
+		// Out of time, or out of the world
+		XMVECTOR dying = XMVectorAndInt(mask, XMVectorOrInt(
+			XMVectorGreaterOrEqual(age, load(Lifespan, i)),
+			XMVectorLessOrEqual(posY, killHeight)));
+		if (XMVector4EqualInt(dying, XMVectorZero()))
+			continue;
 
+		XMStoreUInt4((XMUINT4*)(live.data() + i), XMVectorAndCInt(mask, dying));
+		if (died)
+		{
+			XMUINT4 lanes;
+			XMStoreUInt4(&lanes, dying);
+			const unsigned int* lane = &lanes.x;
+			for (unsigned int l = 0; l < 4; l++)
+			{
+				if (lane[l])
+					died->push_back(i + l);
+			}
+		}
+	}
 }
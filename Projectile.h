@@ -1,28 +1,73 @@
 #pragma once
-#include "GameEntity.h"
-class Projectile :
-    public GameEntity
-{
-private:
 
+#include <DirectXMath.h>
+#include <vector>
 
-public:
+#include "Movement.h"
 
-    float gravity = 0;
+// Drawn as a 0.5 radius sphere, scaled down to 0.2
+#define PROJECTILE_RADIUS 0.1f
+#define PROJECTILE_SCALE 0.2f
 
-    float velocityX;
-    float velocityY;
-    float velocityZ;
+// A projectile, as one tick leaves it
+//  - Velocity is along the projectile's own axes (as it was fired),
+//    and so is gravity, which pulls along its up axis
+struct SimulatedProjectile
+{
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 PitchYawRoll;
+	DirectX::XMFLOAT3 Velocity;
+	float Gravity;
+	float Age;
+	float Lifespan;
+	bool Dead;
+};
 
-    float lifespan;
-    float age;
+// --------------------------------------------------------
+// Every projectile's state as parallel arrays, so a whole
+// tick's movement is a few passes over four at a time
+//  - The same steps as SimulateProjectileMovement(), in the
+//    same order, so the server's one at a time agrees
+//  - Each one's rotation is kept as its three axes, since
+//    its velocity is along them every tick
+//  - Padded to a multiple of four, and the padding (like any
+//    dead one) is never moved
+// --------------------------------------------------------
+class ProjectileArrays
+{
+public:
+	// New ones start out dead
+	void Resize(unsigned int count);
+	unsigned int GetCount() { return count; }
 
-    Projectile(Mesh* mesh, Material* material, float lifespan);
+	SimulatedProjectile Get(unsigned int index);
+	void Set(unsigned int index, const SimulatedProjectile& state);
 
-    void SetVelocity(float x, float y, float z, float g);
-    void Update(float dt);
+	bool IsLive(unsigned int index) { return live[index] != 0; }
+	void SetLive(unsigned int index, bool isLive) { live[index] = isLive ? 0xFFFFFFFF : 0; }
+	DirectX::XMFLOAT3 GetPosition(unsigned int index);
+	DirectX::XMFLOAT3 GetPitchYawRoll(unsigned int index) { return pitchYawRoll[index]; }
 
-    bool dead = false;
+	// Moves every live one along by dt, then kills any that ran out
+	// of time or fell too far (adding them to died, if it's given)
+	void Update(float dt, std::vector<unsigned int>* died);
 
-};
+private:
+	enum Stream
+	{
+		PositionX, PositionY, PositionZ,
+		VelocityX, VelocityY, VelocityZ,
+		RightX, RightY, RightZ,
+		UpX, UpY, UpZ,
+		ForwardX, ForwardY, ForwardZ,
+		Gravity, Age, Lifespan,
+		StreamCount
+	};
+	std::vector<float> streams[StreamCount];
+	std::vector<unsigned int> live; // All bits set, or none, for selecting four at a time
 
+	// Only to hand back, since the axes are what's moved along
+	std::vector<DirectX::XMFLOAT3> pitchYawRoll;
+
+	unsigned int count = 0;
+};
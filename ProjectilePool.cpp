@@ -0,0 +1,107 @@
+#include "ProjectilePool.h"
+#include "Transform.h"
+
+using namespace DirectX;
+
+ProjectilePool::ProjectilePool(Mesh* mesh, Material* material) :
+	mesh(mesh),
+	material(material)
+{
+}
+
+bool ProjectilePool::Spawn(unsigned int& index)
+{
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else if (arrays.GetCount() < PROJECTILE_POOL_MAX)
+	{
+		index = arrays.GetCount();
+		arrays.Resize(index + 1);
+		inUse.push_back(0);
+		generations.push_back(0);
+		previousPositions.push_back(XMFLOAT3(0, 0, 0));
+	}
+	else
+		return false;
+
+	generations[index]++;
+	inUse[index] = 1;
+
+	// Whoever spawned it sets the rest
+	SimulatedProjectile state = arrays.Get(index);
+	state.Age = 0;
+	state.Dead = false;
+	arrays.Set(index, state);
+	return true;
+}
+
+void ProjectilePool::Release(unsigned int index)
+{
+	if (!inUse[index])
+		return;
+
+	arrays.SetLive(index, false);
+	inUse[index] = 0;
+	freeIndices.push_back(index);
+}
+
+void ProjectilePool::Update(float dt)
+{
+	died.clear();
+	arrays.Update(dt, &died);
+	for (unsigned int index : died)
+		Release(index);
+}
+
+void ProjectilePool::SavePositions()
+{
+	for (unsigned int i = 0; i < arrays.GetCount(); i++)
+		previousPositions[i] = arrays.GetPosition(i);
+}
+
+void ProjectilePool::Snap(unsigned int index)
+{
+	previousPositions[index] = arrays.GetPosition(index);
+}
+
+// --------------------------------------------------------
+// Builds a world matrix for each live one, the same way
+// its transform would have (scale, rotation, position)
+// --------------------------------------------------------
+void ProjectilePool::BuildInstances(const XMFLOAT4* frustumPlanes, std::vector<InstanceData>& instances)
+{
+	XMMATRIX scale = XMMatrixScaling(PROJECTILE_SCALE, PROJECTILE_SCALE, PROJECTILE_SCALE);
+	XMVECTOR t = XMVectorReplicate(blend);
+	for (unsigned int i = 0; i < arrays.GetCount(); i++)
+	{
+		if (!inUse[i] || !arrays.IsLive(i))
+			continue;
+
+		XMFLOAT3 current = arrays.GetPosition(i);
+		XMVECTOR pos = XMVectorLerpV(XMLoadFloat3(&previousPositions[i]), XMLoadFloat3(&current), t);
+
+		// Culled as a sphere, against every plane
+		if (frustumPlanes)
+		{
+			bool outside = false;
+			for (int p = 0; p < 6 && !outside; p++)
+				outside = XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&frustumPlanes[p]), pos)) < -PROJECTILE_RADIUS;
+			if (outside)
+				continue;
+		}
+
+		XMFLOAT3 rot = arrays.GetPitchYawRoll(i);
+		XMMATRIX world = scale * XMMatrixRotationRollPitchYawFromVector(XMLoadFloat3(&rot)) * XMMatrixTranslationFromVector(pos);
+
+		InstanceData instance;
+		XMStoreFloat4x4(&instance.World, world);
+		XMStoreFloat4x4(&instance.WorldInverseTranspose, Transform::InverseTranspose(world, true));
+		instance.MaterialIndex = material->GetAtlasIndex();
+		instance.LightList = ENTITY_LIGHT_LIST_NONE;
+		instance.PrevWorld = instance.World;	// Their own motion isn't tracked, just the camera's
+		instances.push_back(instance);
+	}
+}
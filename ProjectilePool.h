@@ -0,0 +1,70 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Material.h"
+#include "Mesh.h"
+#include "Projectile.h"
+#include "RenderQueue.h"
+
+// Most projectiles there can be at once (each shot of the local player's,
+// and every one the server says is alive)
+#define PROJECTILE_POOL_MAX 1024
+
+// Every projectile the game's made, live or not, with the dead ones
+// reused before any more are made
+//  - They're not entities: their state is kept as parallel arrays and
+//    moved all at once by Update(), and the live ones are handed to the
+//    renderer as one batch of instances, so dead ones cost nothing
+//  - A projectile's index never changes, which is what the simulation
+//    thread and the network know it by, and its generation goes up with
+//    every Spawn(), so anything holding on to one can tell it's been reused
+class ProjectilePool
+{
+public:
+	ProjectilePool(Mesh* mesh, Material* material);
+
+	// A live one (a new one, when every one's in use), or false once
+	// there are PROJECTILE_POOL_MAX
+	bool Spawn(unsigned int& index);
+
+	// Dead, and free for the next Spawn()
+	void Release(unsigned int index);
+
+	// Moves every live one, releasing any that die
+	void Update(float dt);
+
+	// Every one, live or dead, by index
+	unsigned int GetCount() { return arrays.GetCount(); }
+	unsigned int GetGeneration(unsigned int index) { return generations[index]; }
+	bool IsLive(unsigned int index) { return arrays.IsLive(index); }
+	SimulatedProjectile GetState(unsigned int index) { return arrays.Get(index); }
+	void SetState(unsigned int index, const SimulatedProjectile& state) { arrays.Set(index, state); }
+	DirectX::XMFLOAT3 GetPosition(unsigned int index) { return arrays.GetPosition(index); }
+
+	// Drawn part way between the positions at the last SavePositions()
+	// and the current ones, like TransformInterpolator's transforms
+	void SavePositions();
+	void Snap(unsigned int index); // Jumps to where it's just been put, rather than sliding there
+	void SetBlend(float t) { blend = t; }
+
+	// The live ones as instances, leaving out any outside the
+	// frustum's planes (if they're given)
+	void BuildInstances(const DirectX::XMFLOAT4* frustumPlanes, std::vector<InstanceData>& instances);
+	Mesh* GetMesh() { return mesh; }
+	Material* GetMaterial() { return material; }
+
+private:
+	Mesh* mesh;
+	Material* material;
+
+	ProjectileArrays arrays;
+	std::vector<unsigned char> inUse; // Spawned and not yet released
+	std::vector<unsigned int> generations;
+	std::vector<unsigned int> freeIndices;
+	std::vector<unsigned int> died;
+
+	std::vector<DirectX::XMFLOAT3> previousPositions;
+	float blend = 1.0f;
+};
@@ -0,0 +1,387 @@
+#include "RegressionSuite.h"
+
+#include <ctype.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+RegressionSuite::RegressionSuite()
+{
+	running = false;
+	passed = false;
+	current = 0;
+	options = {};
+	hasBaseline = false;
+}
+
+bool RegressionSuite::Start(const ScriptedBenchmarkOptions& options)
+{
+	this->options = options;
+	scenarios.clear();
+	results.clear();
+	failedRuns.clear();
+	baseline.clear();
+	current = 0;
+	passed = false;
+	running = false;
+
+	if (!LoadScenarios(options.RegressionFile))
+		return false;
+
+	// Only needed for comparing
+	hasBaseline = !options.UpdateBaseline && ReadJson(options.BaselineFile, baseline);
+	if (!options.UpdateBaseline && !hasBaseline)
+		printf("No baseline at %s, so nothing will fail\n", options.BaselineFile.c_str());
+
+	printf("Regression suite: %u scenarios from %s\n", (unsigned int)scenarios.size(), options.RegressionFile.c_str());
+	running = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// Each scenario's options start from the defaults, apart
+// from the window size (it's the same window for them all),
+// and report to a file of their own unless they say where
+// --------------------------------------------------------
+bool RegressionSuite::LoadScenarios(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		printf("Couldn't open regression scenarios %s\n", path.c_str());
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+			continue;
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+		{
+			printf("Regression scenario \"%s\" needs a name, like \"name: options\"\n", line.c_str());
+			return false;
+		}
+
+		RegressionScenario scenario;
+		scenario.Name = line.substr(start, line.find_last_not_of(" \t", colon - 1) + 1 - start);
+		scenario.Options = ScriptedBenchmarkOptions::Parse(line.c_str() + colon + 1);
+		scenario.Options.Enabled = true;
+		scenario.Options.Width = options.Width;
+		scenario.Options.Height = options.Height;
+		scenario.Options.RegressionFile.clear();
+		if (scenario.Options.ReportFile == SCRIPTED_BENCHMARK_REPORT_FILE)
+			scenario.Options.ReportFile = "Regression_" + scenario.Name + ".json";
+		scenarios.push_back(scenario);
+	}
+
+	if (scenarios.empty())
+	{
+		printf("No scenarios in %s\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool RegressionSuite::FinishScenario(bool succeeded, const std::map<std::string, double>& metrics)
+{
+	if (!running)
+		return false;
+
+	const std::string& name = scenarios[current].Name;
+	if (succeeded)
+		results[name] = metrics;
+	else
+		failedRuns.push_back(name);
+
+	if (++current < scenarios.size())
+		return false;
+
+	running = false;
+	passed = options.UpdateBaseline ? WriteBaseline() && failedRuns.empty() : WriteReport();
+	return true;
+}
+
+double RegressionSuite::GetTolerance(const std::string& metric)
+{
+	if (options.Tolerance >= 0.0f)
+		return options.Tolerance;
+
+	auto it = baseline.find("tolerances/" + metric);
+	if (it == baseline.end())
+		it = baseline.find("tolerances/" + metric.substr(0, metric.find('.')));
+	if (it == baseline.end())
+		it = baseline.find("tolerances/default");
+	return it != baseline.end() ? it->second : REGRESSION_DEFAULT_TOLERANCE;
+}
+
+// --------------------------------------------------------
+// Every metric of every scenario, next to its baseline,
+// with whatever failed (or has no baseline) marked
+// --------------------------------------------------------
+bool RegressionSuite::WriteReport()
+{
+	std::vector<RegressionComparison> comparisons;
+	unsigned int failures = 0;
+	for (const RegressionScenario& scenario : scenarios)
+	{
+		auto result = results.find(scenario.Name);
+		if (result == results.end())
+			continue;
+
+		for (auto& m : result->second)
+		{
+			RegressionComparison c = {};
+			c.Scenario = scenario.Name;
+			c.Metric = m.first;
+			c.Current = m.second;
+			c.Tolerance = GetTolerance(m.first);
+			auto b = baseline.find("scenarios/" + scenario.Name + "/" + m.first);
+			c.HasBaseline = b != baseline.end();
+			if (c.HasBaseline)
+			{
+				c.Baseline = b->second;
+				c.Failed = c.Current - c.Baseline > REGRESSION_ABSOLUTE_SLACK && c.Current > c.Baseline * (1.0 + c.Tolerance);
+			}
+			if (c.Failed)
+				failures++;
+			comparisons.push_back(c);
+		}
+	}
+
+	// Anything the baseline has that wasn't measured this time is a failure too,
+	// or a renamed pass could hide a regression
+	for (auto& b : baseline)
+	{
+		if (b.first.compare(0, 10, "scenarios/") != 0)
+			continue;
+		size_t slash = b.first.find('/', 10);
+		if (slash == std::string::npos)
+			continue;
+		std::string scenario = b.first.substr(10, slash - 10);
+		std::string metric = b.first.substr(slash + 1);
+		auto result = results.find(scenario);
+		if (result == results.end() || result->second.count(metric))
+			continue;
+		RegressionComparison c = {};
+		c.Scenario = scenario;
+		c.Metric = metric;
+		c.Baseline = b.second;
+		c.HasBaseline = true;
+		c.Missing = true;
+		c.Failed = true;
+		failures++;
+		comparisons.push_back(c);
+	}
+
+	bool suitePassed = failures == 0 && failedRuns.empty();
+	std::ofstream report(REGRESSION_REPORT_FILE);
+	if (!report)
+		printf("Couldn't write %s\n", REGRESSION_REPORT_FILE);
+
+	char line[512];
+	auto write = [&](const char* text)
+	{
+		printf("%s", text);
+		if (report) report << text;
+	};
+
+	sprintf_s(line, "Regression suite %s: %u of %u metrics failed, %u scenarios didn't run\n",
+		suitePassed ? "PASSED" : "FAILED", failures, (unsigned int)comparisons.size(), (unsigned int)failedRuns.size());
+	write(line);
+	for (const std::string& name : failedRuns)
+	{
+		sprintf_s(line, "  %s: benchmark failed\n", name.c_str());
+		write(line);
+	}
+
+	for (const RegressionScenario& scenario : scenarios)
+	{
+		if (!results.count(scenario.Name))
+			continue;
+
+		sprintf_s(line, "\n%s\n  %-36s %12s %12s %9s %6s\n", scenario.Name.c_str(), "Metric", "Baseline", "Current", "Change", "Limit");
+		write(line);
+		for (const RegressionComparison& c : comparisons)
+		{
+			if (c.Scenario != scenario.Name)
+				continue;
+			if (c.Missing)
+				sprintf_s(line, "  %-36s %12.3f %12s %9s %6s  FAIL (missing)\n", c.Metric.c_str(), c.Baseline, "-", "-", "-");
+			else if (!c.HasBaseline)
+				sprintf_s(line, "  %-36s %12s %12.3f %9s %5.0f%%  new\n", c.Metric.c_str(), "-", c.Current, "-", c.Tolerance * 100.0);
+			else
+			{
+				double change = c.Baseline != 0.0 ? (c.Current - c.Baseline) / c.Baseline * 100.0 : 0.0;
+				sprintf_s(line, "  %-36s %12.3f %12.3f %+8.1f%% %5.0f%%%s\n", c.Metric.c_str(), c.Baseline, c.Current, change,
+					c.Tolerance * 100.0, c.Failed ? "  FAIL" : "");
+			}
+			write(line);
+		}
+	}
+	return suitePassed;
+}
+
+// --------------------------------------------------------
+// Every scenario's metrics as the new baseline, keeping the
+// tolerances the last one had
+// --------------------------------------------------------
+bool RegressionSuite::WriteBaseline()
+{
+	std::map<std::string, double> previous;
+	ReadJson(options.BaselineFile, previous);
+
+	std::ofstream json(options.BaselineFile);
+	if (!json)
+	{
+		printf("Couldn't write %s\n", options.BaselineFile.c_str());
+		return false;
+	}
+
+	json << "{\n\t\"tolerances\": {";
+	bool first = true;
+	bool hasDefault = false;
+	for (auto& p : previous)
+	{
+		if (p.first.compare(0, 11, "tolerances/") != 0)
+			continue;
+		json << (first ? "\n" : ",\n") << "\t\t\"" << p.first.substr(11) << "\": " << p.second;
+		hasDefault = hasDefault || p.first == "tolerances/default";
+		first = false;
+	}
+	if (!hasDefault)
+		json << (first ? "\n" : ",\n") << "\t\t\"default\": " << REGRESSION_DEFAULT_TOLERANCE;
+	json << "\n\t},\n\t\"scenarios\": {";
+
+	first = true;
+	for (const RegressionScenario& scenario : scenarios)
+	{
+		auto result = results.find(scenario.Name);
+		if (result == results.end())
+			continue;
+
+		json << (first ? "\n" : ",\n") << "\t\t\"" << scenario.Name << "\": {";
+		bool firstMetric = true;
+		for (auto& m : result->second)
+		{
+			json << (firstMetric ? "\n" : ",\n") << "\t\t\t\"" << m.first << "\": " << m.second;
+			firstMetric = false;
+		}
+		json << "\n\t\t}";
+		first = false;
+	}
+	json << "\n\t}\n}\n";
+
+	printf("Wrote the regression baseline to %s\n", options.BaselineFile.c_str());
+	return true;
+}
+
+// --------------------------------------------------------
+// Just enough JSON for the baseline: nested objects of
+// numbers, flattened into "parent/child" keys (anything
+// else, like strings and arrays, is skipped over)
+// --------------------------------------------------------
+bool RegressionSuite::ReadJson(const std::string& path, std::map<std::string, double>& values)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+	size_t i = 0;
+
+	auto skipSpace = [&]() { while (i < text.size() && isspace((unsigned char)text[i])) i++; };
+	auto readString = [&](std::string& out)
+	{
+		out.clear();
+		if (i >= text.size() || text[i] != '"') return false;
+		for (i++; i < text.size() && text[i] != '"'; i++)
+		{
+			if (text[i] == '\\' && i + 1 < text.size()) i++;
+			out += text[i];
+		}
+		i++;
+		return i <= text.size();
+	};
+
+	// Values are skipped (or read) from i, with prefix as their key
+	std::vector<std::string> prefixes;
+	std::vector<char> closers;
+	skipSpace();
+	if (i >= text.size() || text[i] != '{')
+		return false;
+	prefixes.push_back("");
+	closers.push_back('}');
+	i++;
+
+	while (!closers.empty())
+	{
+		skipSpace();
+		if (i >= text.size())
+			return false;
+
+		char c = text[i];
+		if (c == closers.back())
+		{
+			i++;
+			prefixes.pop_back();
+			closers.pop_back();
+			continue;
+		}
+		if (c == ',')
+		{
+			i++;
+			continue;
+		}
+
+		// Arrays have no keys
+		std::string key;
+		if (closers.back() == '}')
+		{
+			if (!readString(key)) return false;
+			skipSpace();
+			if (i >= text.size() || text[i] != ':') return false;
+			i++;
+			skipSpace();
+			if (i >= text.size()) return false;
+			c = text[i];
+		}
+		std::string name = prefixes.back().empty() ? key : prefixes.back() + "/" + key;
+
+		if (c == '{' || c == '[')
+		{
+			prefixes.push_back(name);
+			closers.push_back(c == '{' ? '}' : ']');
+			i++;
+		}
+		else if (c == '"')
+		{
+			std::string ignored;
+			if (!readString(ignored)) return false;
+		}
+		else
+		{
+			char* end;
+			double value = strtod(text.c_str() + i, &end);
+			if (end == text.c_str() + i)
+			{
+				// true, false or null
+				size_t word = i;
+				while (i < text.size() && isalpha((unsigned char)text[i])) i++;
+				if (i == word) return false;
+			}
+			else
+			{
+				i = end - text.c_str();
+				if (closers.back() == '}')
+					values[name] = value;
+			}
+		}
+	}
+	return true;
+}
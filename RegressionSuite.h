@@ -0,0 +1,93 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ScriptedBenchmark.h"
+
+// Written to after every suite, pass or fail
+#define REGRESSION_REPORT_FILE			"RegressionReport.txt"
+
+// How much worse than the baseline a metric can get, as a fraction of
+// it, when neither the command line nor the baseline says otherwise
+#define REGRESSION_DEFAULT_TOLERANCE	0.1
+
+// Differences smaller than this never fail, so metrics near zero
+// (like a pass that barely runs) aren't all noise
+#define REGRESSION_ABSOLUTE_SLACK		0.05
+
+struct RegressionScenario
+{
+	std::string Name;
+	ScriptedBenchmarkOptions Options;
+};
+
+// One metric of one scenario, against the baseline
+struct RegressionComparison
+{
+	std::string Scenario;
+	std::string Metric;
+	double Baseline;
+	double Current;
+	double Tolerance;
+	bool HasBaseline;
+	bool Missing;		// In the baseline, but not measured this time
+	bool Failed;
+};
+
+// --------------------------------------------------------
+// Runs a list of benchmark scenarios one after another,
+// then compares every metric of each (see ScriptedBenchmark
+// ::GetMetrics()) with a baseline, and writes what changed
+//  - Scenarios are one a line, as "name: options", with the
+//    options just like the command line's (and # comments)
+//  - Every metric is lower-is-better, so only getting worse
+//    by more than its tolerance fails
+//  - The baseline looks like this, where a metric's own
+//    tolerance comes first, then its group's (the part of
+//    its name before the dot), then the default:
+//    {
+//      "tolerances": { "default": 0.1, "draws": 0, "passMs": 0.2 },
+//      "scenarios": {
+//        "name": { "frameMs.p50": 4.1, "draws.average": 212 }
+//      }
+//    }
+// --------------------------------------------------------
+class RegressionSuite
+{
+public:
+	RegressionSuite();
+
+	// Reads the scenarios and the baseline the options name, and
+	// starts at the first scenario (false if there aren't any)
+	bool Start(const ScriptedBenchmarkOptions& options);
+	bool IsRunning() { return running; }
+
+	const RegressionScenario& GetScenario() { return scenarios[current]; }
+
+	// Once each scenario's benchmark is done, returning true after the
+	// last, once the report (or the new baseline) has been written
+	bool FinishScenario(bool succeeded, const std::map<std::string, double>& metrics);
+	bool Passed() { return passed; }
+
+private:
+	bool running;
+	bool passed;
+	unsigned int current;
+	ScriptedBenchmarkOptions options;
+	std::vector<RegressionScenario> scenarios;
+	std::map<std::string, std::map<std::string, double>> results;
+	std::vector<std::string> failedRuns;
+
+	// Flattened, with keys like "scenarios/name/frameMs.p50"
+	std::map<std::string, double> baseline;
+	bool hasBaseline;
+
+	bool LoadScenarios(const std::string& path);
+	double GetTolerance(const std::string& metric);
+	bool WriteReport();
+	bool WriteBaseline();
+
+	static bool ReadJson(const std::string& path, std::map<std::string, double>& values);
+};
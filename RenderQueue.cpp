@@ -0,0 +1,473 @@
+#include "RenderQueue.h"
+#include "AssetLoader.h"
+#include "DrawStats.h"
+
+using namespace DirectX;
+
+// Bit widths and positions of each part of the draw key
+#define KEY_PASS_SHIFT		60
+#define KEY_SHADER_SHIFT	48
+#define KEY_MATERIAL_SHIFT	32
+#define KEY_MESH_SHIFT		18
+#define KEY_LOD_SHIFT		16
+#define KEY_PASS_MASK		0xFull
+#define KEY_SHADER_MASK		0xFFFull
+#define KEY_ID_MASK			0xFFFFull
+#define KEY_MESH_MASK		0x3FFFull
+#define KEY_LOD_MASK		0x3ull
+
+
+RenderQueue::RenderQueue(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device)
+{
+	instancingThreshold = 2;
+	instanceSlice = {};
+}
+
+void RenderQueue::Clear()
+{
+	packets.clear();
+	batches.clear();
+	batchInstances.clear();
+}
+
+// --------------------------------------------------------------------------
+// Builds a draw packet for this entity.  Draws are grouped by state
+// first and then sorted front to back (relative to the given view)
+// within each group.
+// --------------------------------------------------------------------------
+void RenderQueue::Add(GameEntity* entity, const XMFLOAT4X4& view, float maxDepth, RenderPass pass, unsigned int lod, unsigned int lightList)
+{
+	Material* material = entity->GetMaterial();
+
+	// View space depth of the entity's origin, quantized into 16 bits
+	XMFLOAT4X4 world = entity->GetTransform()->GetWorldMatrix();
+	XMVECTOR viewPos = XMVector3TransformCoord(XMVectorSet(world._41, world._42, world._43, 1.0f), XMLoadFloat4x4(&view));
+	float depth = XMVectorGetZ(viewPos) / maxDepth;
+	depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+
+	// Depth only draws don't care about the material
+	unsigned long long stateBits = 0;
+	if (pass != RenderPass::DepthOnly)
+	{
+		stateBits =
+			((GetShaderID(material) & KEY_SHADER_MASK) << KEY_SHADER_SHIFT) |
+			((GetMaterialID(material) & KEY_ID_MASK) << KEY_MATERIAL_SHIFT);
+	}
+
+	DrawPacket packet;
+	packet.Entity = entity;
+	packet.Lod = min(lod, entity->GetMesh()->GetLodCount() - 1);
+	packet.LightList = lightList;
+	packet.Key =
+		(((unsigned long long)pass & KEY_PASS_MASK) << KEY_PASS_SHIFT) |
+		stateBits |
+		((GetMeshID(entity->GetMesh()) & KEY_MESH_MASK) << KEY_MESH_SHIFT) |
+		(((unsigned long long)packet.Lod & KEY_LOD_MASK) << KEY_LOD_SHIFT) |
+		((unsigned long long)(depth * 65535.0f) & KEY_ID_MASK);
+	packets.push_back(packet);
+}
+
+void RenderQueue::AddInstances(Mesh* mesh, Material* material, const InstanceData* data, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	batches.push_back({ mesh, material, (unsigned int)batchInstances.size(), count });
+	batchInstances.insert(batchInstances.end(), data, data + count);
+}
+
+// --------------------------------------------------------------------------
+// LSD radix sort of the packets by key, one byte per pass.  Passes where
+// every key has the same byte (common for the pass and shader bits) are
+// skipped, since they wouldn't change the order.
+// --------------------------------------------------------------------------
+void RenderQueue::Sort()
+{
+	size_t count = packets.size();
+	if (count < 2)
+		return;
+
+	sortScratch.resize(count);
+	DrawPacket* src = packets.data();
+	DrawPacket* dst = sortScratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		// Count how many keys have each value of this byte
+		size_t offsets[256] = {};
+		for (size_t i = 0; i < count; i++)
+			offsets[(src[i].Key >> shift) & 0xFF]++;
+
+		// Nothing to do if they all share the same byte
+		if (offsets[(src[0].Key >> shift) & 0xFF] == count)
+			continue;
+
+		// Turn the counts into starting offsets
+		size_t total = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			size_t c = offsets[b];
+			offsets[b] = total;
+			total += c;
+		}
+
+		// Scatter, which keeps equal keys in their previous order
+		for (size_t i = 0; i < count; i++)
+			dst[offsets[(src[i].Key >> shift) & 0xFF]++] = src[i];
+
+		DrawPacket* temp = src;
+		src = dst;
+		dst = temp;
+	}
+
+	// Make sure the final order ended up in the packet list
+	if (src != packets.data())
+		packets.swap(sortScratch);
+}
+
+// --------------------------------------------------------------------------
+// Draws every packet in order, only changing the shaders, material
+// resources and mesh buffers when they differ from the previous draw.
+// Runs of packets that share a material and mesh are drawn as a single
+// instanced draw when an instanced vertex shader is available.
+// --------------------------------------------------------------------------
+void RenderQueue::Submit(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, SimpleVertexShader* instancedVS, bool gbuffer)
+{
+	stats = {};
+	BuildInstances(context, instancedVS != 0, true);
+
+	Assets& assets = Assets::GetInstance();
+	SimpleVertexShader* currentVS = 0;
+	SimplePixelShader* currentPS = 0;
+	const void* currentMaterial = 0;
+	const void* currentBuffers = 0;
+	unsigned int instanceOffset = 0;
+
+	for (size_t i = 0; i < packets.size();)
+	{
+		Material* material = packets[i].Entity->GetMaterial();
+		Mesh* mesh = packets[i].Entity->GetMesh();
+
+		size_t run = RunLength(i);
+		bool instanced = instancedVS && IsInstancedRun(run);
+		SimpleVertexShader* vs = assets.GetVertexShaderFor(instanced ? instancedVS : material->GetVS(), mesh);
+		SimplePixelShader* ps = gbuffer && material->GetGBufferPS() ? material->GetGBufferPS() : material->GetPS();
+
+		// Shaders (which also binds their constant buffers)
+		if (vs != currentVS || ps != currentPS)
+		{
+			vs->SetShader();
+			ps->SetShader();
+			currentVS = vs;
+			currentPS = ps;
+			stats.ShaderBinds++;
+		}
+		else
+		{
+			stats.ShaderBindsSkipped++;
+		}
+
+		// Material data, textures and samplers
+		if (material->GetBindingKey() != currentMaterial)
+		{
+			material->SetPerMaterialDataAndResources(true, ps);
+			currentMaterial = material->GetBindingKey();
+			stats.MaterialBinds++;
+		}
+		else
+		{
+			stats.MaterialBindsSkipped++;
+		}
+
+		// Vertex and index buffers (shared by every pooled
+		// mesh with the same vertex format)
+		if (mesh->GetBufferKey() != currentBuffers)
+		{
+			mesh->SetBuffers(context);
+			currentBuffers = mesh->GetBufferKey();
+			stats.MeshBinds++;
+		}
+		else
+		{
+			stats.MeshBindsSkipped++;
+		}
+
+		if (instanced)
+		{
+			// The instanced shader gets the uv scale from the material,
+			// everything else comes from the instance buffer
+			vs->SetFloat2("uvScale"_sn, material->GetVertexUVScale());
+			vs->CopyBufferData("perMaterial"_sn);
+			DrawInstances(context, mesh, packets[i].Lod, (unsigned int)run, instanceOffset);
+			instanceOffset += (unsigned int)run;
+			i += run;
+		}
+		else
+		{
+			// Per object data always changes
+			material->SetPerObjectData(packets[i].Entity->GetTransform(), vs, packets[i].LightList);
+			mesh->Draw(context, packets[i].Lod);
+			stats.Draws++;
+			i++;
+		}
+	}
+
+	// Then the batches, which are always instanced
+	for (size_t b = 0; b < batches.size() && instancedVS; b++)
+	{
+		Material* material = batches[b].BatchMaterial;
+		Mesh* mesh = batches[b].BatchMesh;
+		SimpleVertexShader* vs = assets.GetVertexShaderFor(instancedVS, mesh);
+		SimplePixelShader* ps = gbuffer && material->GetGBufferPS() ? material->GetGBufferPS() : material->GetPS();
+
+		if (vs != currentVS || ps != currentPS)
+		{
+			vs->SetShader();
+			ps->SetShader();
+			currentVS = vs;
+			currentPS = ps;
+			stats.ShaderBinds++;
+		}
+		else
+		{
+			stats.ShaderBindsSkipped++;
+		}
+
+		if (material->GetBindingKey() != currentMaterial)
+		{
+			material->SetPerMaterialDataAndResources(true, ps);
+			currentMaterial = material->GetBindingKey();
+			stats.MaterialBinds++;
+		}
+		else
+		{
+			stats.MaterialBindsSkipped++;
+		}
+
+		if (mesh->GetBufferKey() != currentBuffers)
+		{
+			mesh->SetBuffers(context);
+			currentBuffers = mesh->GetBufferKey();
+			stats.MeshBinds++;
+		}
+		else
+		{
+			stats.MeshBindsSkipped++;
+		}
+
+		vs->SetFloat2("uvScale"_sn, material->GetVertexUVScale());
+		vs->CopyBufferData("perMaterial"_sn);
+		DrawInstances(context, mesh, 0, batches[b].Count, instanceOffset);
+		instanceOffset += batches[b].Count;
+	}
+}
+
+// --------------------------------------------------------------------------
+// Draws every packet with the given vertex shader and no pixel shader,
+// for depth only passes like the shadow map.  The shaders' per frame
+// data must already be set.
+// --------------------------------------------------------------------------
+void RenderQueue::SubmitDepthOnly(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, SimpleVertexShader* vs, SimpleVertexShader* instancedVS)
+{
+	stats = {};
+	BuildInstances(context, instancedVS != 0, false);
+
+	context->PSSetShader(0, 0, 0);
+	ISimpleShader::InvalidateStateCache(context);
+
+	Assets& assets = Assets::GetInstance();
+	SimpleVertexShader* currentVS = 0;
+	const void* currentBuffers = 0;
+	unsigned int instanceOffset = 0;
+
+	for (size_t i = 0; i < packets.size();)
+	{
+		Mesh* mesh = packets[i].Entity->GetMesh();
+
+		size_t run = RunLength(i);
+		bool instanced = instancedVS && IsInstancedRun(run);
+		SimpleVertexShader* entityVS = assets.GetVertexShaderFor(vs ? vs : packets[i].Entity->GetMaterial()->GetVS(), mesh);
+		SimpleVertexShader* currentPassVS = instanced ? assets.GetVertexShaderFor(instancedVS, mesh) : entityVS;
+
+		if (currentPassVS != currentVS)
+		{
+			currentPassVS->SetShader();
+			currentVS = currentPassVS;
+			stats.ShaderBinds++;
+		}
+		else
+		{
+			stats.ShaderBindsSkipped++;
+		}
+
+		if (mesh->GetBufferKey() != currentBuffers)
+		{
+			mesh->SetBuffers(context);
+			currentBuffers = mesh->GetBufferKey();
+			stats.MeshBinds++;
+		}
+		else
+		{
+			stats.MeshBindsSkipped++;
+		}
+
+		if (instanced)
+		{
+			DrawInstances(context, mesh, packets[i].Lod, (unsigned int)run, instanceOffset);
+			instanceOffset += (unsigned int)run;
+			i += run;
+		}
+		else
+		{
+			entityVS->SetMatrix4x4("world"_sn, packets[i].Entity->GetTransform()->GetWorldMatrix());
+			entityVS->CopyBufferData("perObject"_sn);
+			mesh->Draw(context, packets[i].Lod);
+			stats.Draws++;
+			i++;
+		}
+	}
+
+	for (size_t b = 0; b < batches.size() && instancedVS; b++)
+	{
+		Mesh* mesh = batches[b].BatchMesh;
+		SimpleVertexShader* batchVS = assets.GetVertexShaderFor(instancedVS, mesh);
+		if (batchVS != currentVS)
+		{
+			batchVS->SetShader();
+			currentVS = batchVS;
+			stats.ShaderBinds++;
+		}
+		else
+		{
+			stats.ShaderBindsSkipped++;
+		}
+
+		if (mesh->GetBufferKey() != currentBuffers)
+		{
+			mesh->SetBuffers(context);
+			currentBuffers = mesh->GetBufferKey();
+			stats.MeshBinds++;
+		}
+		else
+		{
+			stats.MeshBindsSkipped++;
+		}
+
+		DrawInstances(context, mesh, 0, batches[b].Count, instanceOffset);
+		instanceOffset += batches[b].Count;
+	}
+}
+
+// --------------------------------------------------------------------------
+// How many packets, starting at the given one, can share a draw.  Packets
+// are sorted by state, so they just need the same key above the depth bits.
+// --------------------------------------------------------------------------
+size_t RenderQueue::RunLength(size_t start)
+{
+	unsigned long long state = packets[start].Key >> KEY_LOD_SHIFT;
+
+	size_t end = start + 1;
+	while (end < packets.size() && (packets[end].Key >> KEY_LOD_SHIFT) == state)
+		end++;
+
+	return end - start;
+}
+
+bool RenderQueue::IsInstancedRun(size_t runLength)
+{
+	return instancingThreshold > 0 && runLength >= instancingThreshold;
+}
+
+// --------------------------------------------------------------------------
+// Gathers the matrices of every instanced run into one list, in draw
+// order, and appends them to the context's upload ring in one go
+//  - The batches go last, since they're drawn after the packets
+//  - Only the scene pass asks for last frame's matrices, since asking
+//    is what moves them on (and depth only passes can be recorded on
+//    other threads), so the rest just repeat this frame's
+// --------------------------------------------------------------------------
+void RenderQueue::BuildInstances(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, bool instancingAvailable, bool prevWorlds)
+{
+	instances.clear();
+	instanceSlice = {};
+	if (!instancingAvailable)
+		return;
+
+	for (size_t i = 0; i < packets.size() && instancingThreshold > 0;)
+	{
+		size_t run = RunLength(i);
+		if (!IsInstancedRun(run))
+		{
+			i += run;
+			continue;
+		}
+
+		for (size_t r = 0; r < run; r++, i++)
+		{
+			Transform* transform = packets[i].Entity->GetTransform();
+
+			InstanceData instance;
+			instance.World = transform->GetWorldMatrix();
+			instance.WorldInverseTranspose = transform->GetWorldInverseTransposeMatrix();
+			instance.MaterialIndex = packets[i].Entity->GetMaterial()->GetAtlasIndex();
+			instance.LightList = packets[i].LightList;
+			instance.PrevWorld = prevWorlds ? transform->GetPrevWorldMatrix() : instance.World;
+			instances.push_back(instance);
+		}
+	}
+	instances.insert(instances.end(), batchInstances.begin(), batchInstances.end());
+
+	if (instances.empty())
+		return;
+
+	UploadRing::GetInstance().Upload(context, instances.data(), (unsigned int)(sizeof(InstanceData) * instances.size()), 16, instanceSlice);
+}
+
+void RenderQueue::DrawInstances(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Mesh* mesh, unsigned int lod, unsigned int count, unsigned int firstInstance)
+{
+	// Instance data lives in the second vertex buffer slot, at
+	// wherever in the ring this frame's instances went
+	UINT stride = sizeof(InstanceData);
+	UINT offset = instanceSlice.Offset;
+	context->IASetVertexBuffers(1, 1, instanceSlice.Buffer.GetAddressOf(), &stride, &offset);
+
+	mesh->DrawInstanced(context, count, firstInstance, lod);
+	stats.InstancedDraws++;
+	stats.InstancedEntities += count;
+}
+
+unsigned int RenderQueue::GetShaderID(Material* material)
+{
+	std::pair<SimpleVertexShader*, SimplePixelShader*> pair(material->GetVS(), material->GetPS());
+	for (unsigned int i = 0; i < shaderPairs.size(); i++)
+	{
+		if (shaderPairs[i] == pair)
+			return i;
+	}
+
+	shaderPairs.push_back(pair);
+	return (unsigned int)shaderPairs.size() - 1;
+}
+
+unsigned int RenderQueue::GetMaterialID(Material* material)
+{
+	auto it = materialIDs.find(material->GetBindingKey());
+	if (it != materialIDs.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)materialIDs.size();
+	materialIDs.insert({ material->GetBindingKey(), id });
+	return id;
+}
+
+unsigned int RenderQueue::GetMeshID(Mesh* mesh)
+{
+	auto it = meshIDs.find(mesh);
+	if (it != meshIDs.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)meshIDs.size();
+	meshIDs.insert({ mesh, id });
+	return id;
+}
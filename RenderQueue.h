@@ -0,0 +1,147 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+#include <unordered_map>
+
+#include "GameEntity.h"
+#include "Camera.h"
+#include "EntityLightLists.h"
+#include "UploadRing.h"
+
+// Passes occupy the top bits of the draw key, so
+// everything in an earlier pass is drawn first
+enum class RenderPass : unsigned char
+{
+	Opaque = 0,
+	DepthOnly = 1
+};
+
+// A single draw, reduced to a sort key and the entity it came from
+//  - Key layout (most to least significant):
+//    pass (4) | shader (12) | material (16) | mesh (14) | lod (2) | depth (16)
+//  - Depth only draws leave the shader and material bits empty,
+//    so they're grouped purely by mesh
+//  - Materials sharing an atlas share a material id, so they end
+//    up in the same runs
+//  - Each level of detail of a mesh is its own run, since it
+//    draws different index ranges
+struct DrawPacket
+{
+	unsigned long long Key;
+	GameEntity* Entity;
+	unsigned int Lod;
+	unsigned int LightList;
+};
+
+// Per instance data for instanced draws
+//  - Must match the "_PER_INSTANCE" inputs of the instanced vertex shaders
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+	unsigned int MaterialIndex; // Within the material's atlas, if it has one
+	unsigned int LightList;		// Into EntityLightLists, or ENTITY_LIGHT_LIST_NONE
+	DirectX::XMFLOAT4X4 PrevWorld;	// Last frame's, for motion vectors
+};
+
+// Instances that aren't entities (like the projectiles), drawn with
+// a mesh and material of their own after the queue's packets
+struct InstanceBatch
+{
+	Mesh* BatchMesh;
+	Material* BatchMaterial;
+	unsigned int First;	// Into the queue's batch instances
+	unsigned int Count;
+};
+
+// How much work the last Submit() did, and how much it skipped
+struct RenderQueueStats
+{
+	unsigned int Draws;
+	unsigned int InstancedDraws;
+	unsigned int InstancedEntities;
+	unsigned int ShaderBinds;
+	unsigned int ShaderBindsSkipped;
+	unsigned int MaterialBinds;
+	unsigned int MaterialBindsSkipped;
+	unsigned int MeshBinds;
+	unsigned int MeshBindsSkipped;
+
+	// For totalling the stats of several submits
+	void Accumulate(const RenderQueueStats& other)
+	{
+		Draws += other.Draws;
+		InstancedDraws += other.InstancedDraws;
+		InstancedEntities += other.InstancedEntities;
+		ShaderBinds += other.ShaderBinds;
+		ShaderBindsSkipped += other.ShaderBindsSkipped;
+		MaterialBinds += other.MaterialBinds;
+		MaterialBindsSkipped += other.MaterialBindsSkipped;
+		MeshBinds += other.MeshBinds;
+		MeshBindsSkipped += other.MeshBindsSkipped;
+	}
+};
+
+class RenderQueue
+{
+public:
+	RenderQueue(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	void Clear();
+	void Add(GameEntity* entity, const DirectX::XMFLOAT4X4& view, float maxDepth, RenderPass pass = RenderPass::Opaque, unsigned int lod = 0, unsigned int lightList = ENTITY_LIGHT_LIST_NONE);
+	void Sort();
+
+	// Copies the instances into the queue, to be drawn as one instanced
+	// draw after the sorted packets (only when there's an instanced shader)
+	void AddInstances(Mesh* mesh, Material* material, const InstanceData* data, unsigned int count);
+
+	// Draws with each entity's material, using instancedVS in place of the
+	// material's vertex shader for instanced batches (if not null)
+	//  - With gbuffer set, draws with each material's G-buffer pixel
+	//    shader instead (every entity added should have one)
+	void Submit(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, SimpleVertexShader* instancedVS = 0, bool gbuffer = false);
+
+	// Draws with the given vertex shaders and no pixel shader
+	//  - A null vs uses each entity's material vertex shader
+	void SubmitDepthOnly(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, SimpleVertexShader* vs, SimpleVertexShader* instancedVS = 0);
+
+	// Runs of at least this many entities that share a mesh and material
+	// become a single instanced draw (0 turns instancing off)
+	void SetInstancingThreshold(unsigned int minInstances) { instancingThreshold = minInstances; }
+	unsigned int GetInstancingThreshold() { return instancingThreshold; }
+
+	const RenderQueueStats& GetStats() { return stats; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	std::vector<DrawPacket> packets;
+	std::vector<DrawPacket> sortScratch;
+	RenderQueueStats stats = {};
+
+	// Instance data for every batch this frame, uploaded all at once
+	unsigned int instancingThreshold;
+	std::vector<InstanceData> instances;
+	UploadSlice instanceSlice;
+	std::vector<InstanceBatch> batches;
+	std::vector<InstanceData> batchInstances;
+	size_t RunLength(size_t start);
+	bool IsInstancedRun(size_t runLength);
+	void BuildInstances(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, bool instancingAvailable, bool prevWorlds);
+	void DrawInstances(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Mesh* mesh, unsigned int lod, unsigned int count, unsigned int firstInstance);
+
+	// Small ids for the sort key, handed out the first time
+	// each shader pair, material or mesh is seen
+	//  - There are only ever a handful of shader pairs, so a
+	//    linear search is plenty
+	std::vector<std::pair<SimpleVertexShader*, SimplePixelShader*>> shaderPairs;
+	std::unordered_map<const void*, unsigned int> materialIDs; // By binding key
+	std::unordered_map<Mesh*, unsigned int> meshIDs;
+
+	unsigned int GetShaderID(Material* material);
+	unsigned int GetMaterialID(Material* material);
+	unsigned int GetMeshID(Mesh* mesh);
+};
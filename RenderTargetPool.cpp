@@ -0,0 +1,162 @@
+#include "RenderTargetPool.h"
+#include "GpuMemory.h"
+
+RenderTargetPool::RenderTargetPool(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: device(device)
+{
+}
+
+void RenderTargetPool::Reset()
+{
+	requests.clear();
+	targets.clear();
+}
+
+// --------------------------------------------------------
+// Adds a target to the pool, returning the handle used to get
+// its views once the pool is allocated
+//  - firstPass and lastPass are the first and last passes of the
+//    frame that write or read it
+// --------------------------------------------------------
+unsigned int RenderTargetPool::Request(unsigned int width, unsigned int height, DXGI_FORMAT format, unsigned int firstPass, unsigned int lastPass, bool unorderedAccess)
+{
+	TargetRequest request = {};
+	request.Width = width;
+	request.Height = height;
+	request.Format = format;
+	request.FirstPass = firstPass;
+	request.LastPass = lastPass;
+	request.UnorderedAccess = unorderedAccess;
+	requests.push_back(request);
+	return (unsigned int)requests.size() - 1;
+}
+
+// --------------------------------------------------------
+// Assigns every request to a texture and creates them.  With
+// aliasing, a request reuses the first texture of the same size
+// and format that isn't in use during any of its passes.
+// --------------------------------------------------------
+void RenderTargetPool::Allocate(bool aliasing)
+{
+	targets.clear();
+
+	for (unsigned int r = 0; r < requests.size(); r++)
+	{
+		TargetRequest& request = requests[r];
+
+		unsigned int t = 0;
+		while (t < targets.size() && !(aliasing && CanShare(targets[t], request)))
+			t++;
+
+		if (t == targets.size())
+		{
+			PooledTarget target = {};
+			target.Width = request.Width;
+			target.Height = request.Height;
+			target.Format = request.Format;
+			targets.push_back(target);
+		}
+
+		targets[t].Users.push_back(r);
+		targets[t].UnorderedAccess |= request.UnorderedAccess;
+		request.Target = t;
+	}
+
+	for (PooledTarget& target : targets)
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+
+		D3D11_TEXTURE2D_DESC texDesc = {};
+		texDesc.Width = target.Width;
+		texDesc.Height = target.Height;
+		texDesc.ArraySize = 1;
+		texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		if (target.UnorderedAccess)
+			texDesc.BindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+		texDesc.Format = target.Format;
+		texDesc.MipLevels = 1;
+		texDesc.MiscFlags = 0;
+		texDesc.SampleDesc.Count = 1;
+		GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, texture.GetAddressOf(), GpuMemoryCategory::RenderTargets, "Pooled Target");
+
+		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+		rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+		rtvDesc.Texture2D.MipSlice = 0;
+		rtvDesc.Format = texDesc.Format;
+		device->CreateRenderTargetView(texture.Get(), &rtvDesc, target.RTV.GetAddressOf());
+
+		device->CreateShaderResourceView(texture.Get(), 0, target.SRV.GetAddressOf());
+		if (target.UnorderedAccess)
+			device->CreateUnorderedAccessView(texture.Get(), 0, target.UAV.GetAddressOf());
+	}
+}
+
+Microsoft::WRL::ComPtr<ID3D11RenderTargetView> RenderTargetPool::GetRTV(unsigned int request)
+{
+	return targets[requests[request].Target].RTV;
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> RenderTargetPool::GetSRV(unsigned int request)
+{
+	return targets[requests[request].Target].SRV;
+}
+
+Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> RenderTargetPool::GetUAV(unsigned int request)
+{
+	return targets[requests[request].Target].UAV;
+}
+
+unsigned long long RenderTargetPool::GetRequestedBytes()
+{
+	unsigned long long bytes = 0;
+	for (TargetRequest& request : requests)
+		bytes += (unsigned long long)request.Width * request.Height * BytesPerPixel(request.Format);
+	return bytes;
+}
+
+unsigned long long RenderTargetPool::GetAllocatedBytes()
+{
+	unsigned long long bytes = 0;
+	for (PooledTarget& target : targets)
+		bytes += (unsigned long long)target.Width * target.Height * BytesPerPixel(target.Format);
+	return bytes;
+}
+
+// --------------------------------------------------------
+// A texture can take another request if it matches exactly and
+// none of its current users are alive during the same passes
+// --------------------------------------------------------
+bool RenderTargetPool::CanShare(const PooledTarget& target, const TargetRequest& request)
+{
+	if (target.Width != request.Width ||
+		target.Height != request.Height ||
+		target.Format != request.Format)
+		return false;
+
+	for (unsigned int user : target.Users)
+	{
+		const TargetRequest& other = requests[user];
+		if (request.FirstPass <= other.LastPass && other.FirstPass <= request.LastPass)
+			return false;
+	}
+
+	return true;
+}
+
+// Just the formats the renderer uses (anything else is
+// counted as 4 bytes, which only affects the reported sizes)
+unsigned int RenderTargetPool::BytesPerPixel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT: return 16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT: return 8;
+	case DXGI_FORMAT_R32G32_FLOAT: return 8;
+	case DXGI_FORMAT_R16G16_FLOAT: return 4;
+	case DXGI_FORMAT_R16G16_UNORM: return 4;
+	case DXGI_FORMAT_R8G8_UNORM: return 2;
+	case DXGI_FORMAT_R16_FLOAT: return 2;
+	case DXGI_FORMAT_R8_UNORM: return 1;
+	default: return 4;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Hands out render targets for the passes of a frame, keyed
+// by size and format
+//  - Each request says which passes it's used in (inclusive),
+//    and requests whose passes don't overlap can share a texture
+//  - Everything is requested up front, then Allocate() creates
+//    the textures; Reset() throws it all away (e.g. on resize)
+//  - Targets written by compute shaders ask for unordered access,
+//    and any texture with such a user gets a UAV
+// --------------------------------------------------------
+class RenderTargetPool
+{
+public:
+	RenderTargetPool(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	void Reset();
+	unsigned int Request(unsigned int width, unsigned int height, DXGI_FORMAT format, unsigned int firstPass, unsigned int lastPass, bool unorderedAccess = false);
+	void Allocate(bool aliasing);
+
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> GetRTV(unsigned int request);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV(unsigned int request);
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> GetUAV(unsigned int request);
+
+	// Memory with one texture per request, and what was actually allocated
+	unsigned long long GetRequestedBytes();
+	unsigned long long GetAllocatedBytes();
+	unsigned int GetRequestCount() { return (unsigned int)requests.size(); }
+	unsigned int GetTargetCount() { return (unsigned int)targets.size(); }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	struct TargetRequest
+	{
+		unsigned int Width;
+		unsigned int Height;
+		DXGI_FORMAT Format;
+		unsigned int FirstPass;
+		unsigned int LastPass;
+		bool UnorderedAccess;
+		unsigned int Target;
+	};
+
+	// A real texture, shared by one or more requests
+	struct PooledTarget
+	{
+		unsigned int Width;
+		unsigned int Height;
+		DXGI_FORMAT Format;
+		bool UnorderedAccess;
+		std::vector<unsigned int> Users;
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> RTV;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> UAV;
+	};
+
+	std::vector<TargetRequest> requests;
+	std::vector<PooledTarget> targets;
+
+	bool CanShare(const PooledTarget& target, const TargetRequest& request);
+	static unsigned int BytesPerPixel(DXGI_FORMAT format);
+};
@@ -4,21 +4,144 @@
 #include "Extensions/imgui/backends/imgui_impl_dx11.h"
 #include "Extensions/imgui/backends/imgui_impl_win32.h"
 #include "AssetLoader.h"
+#include "JobSystem.h"
+#include "CpuProfiler.h"
+#include "GpuMemory.h"
+#include "StateCache.h"
+#include "DrawStats.h"
+#include "FrameArena.h"
 
 #include <DirectXMath.h>
+#include <algorithm>
+#include <float.h>
+#include <thread>
+#include <chrono>
 
 using namespace DirectX;
 
-Renderer::Renderer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<IDXGISwapChain> swapChain, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV, unsigned int windowWidth, unsigned int windowHeight, Sky* sky, std::vector<GameEntity*>& entities, std::vector<Light>& lights, std::vector<Emitter*>& emitters)
-	: device(device), context(context), swapChain(swapChain), backBufferRTV(backBufferRTV), depthBufferDSV(depthBufferDSV),
+// Passes that use pooled render targets, in frame order,
+// for working out which targets can share memory
+enum RenderTargetPass
+{
+	PassScene,
+	PassSSAODownsample,
+	PassSSAO,
+	PassSSAOTemporal,
+	PassSSAOBlur,
+	PassCombine,
+	PassTemporalUpsample,
+	PassParticles
+};
+
+Renderer::Renderer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<IDXGISwapChain> swapChain, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthBufferSRV, unsigned int windowWidth, unsigned int windowHeight, Sky* sky, EntityRegistry& entities, LightManager& lights, std::vector<Emitter*>& emitters)
+	: device(device), context(context), swapChain(swapChain), backBufferRTV(backBufferRTV), depthBufferDSV(depthBufferDSV), depthBufferSRV(depthBufferSRV),
 	windowWidth(windowWidth), windowHeight(windowHeight), sky(sky),
-	entities(entities), lights(lights), emitters(emitters)
+	entities(entities), lightManager(lights), lights(lights.GetLights()), emitters(emitters),
+	renderQueue(device), shadowQueue(device), forwardQueue(device),
+	gpuProfiler(device, context),
+	renderTargetPool(device),
+	hiZBuffer(device, context),
+	gpuCulling(device, context),
+	particleBatcher(device, context),
+	entityLightLists(device, context),
+	debugViews(device, context),
+	shadowAtlas(device, context),
+	impostorAtlas(device)
 {
 
 	ambientNonPBR = XMFLOAT3(0.1f, 0.1f, 0.25f);
 
+	clusteredLighting = true;
+	clusterNearDepth = 1.0f;
+	perEntityLights = true;
+	perEntityLightsActive = false;
+
+	SetInstancing(true);
+	instancedLightGizmos = true;
+	presentSyncInterval = 0;
+	presentFlags = 0;
+	presentResult = S_OK;
+	batchedParticles = true;
+	warmingUp = false;
+	uiVisible = true;
+
+	// Deferred contexts for recording passes off the main thread
+	//  - Recording stays off if the device can't make them
+	device->CreateDeferredContext(0, shadowContext.GetAddressOf());
+	device->CreateDeferredContext(0, sceneContext.GetAddressOf());
+	device->CreateDeferredContext(0, particleContext.GetAddressOf());
+
+	// Only needed for discarding targets, so it's fine if it's missing
+	context.As(&context1);
+	multithreadedRecording = false;
+
+	frustumCulling = true;
+	occlusionCulling = true;
+	occlusionCullShadows = false;
+	gpuDrivenCulling = false;
+	deferredShading = false;
+	deferredShadingActive = false;
+	meshLods = true;
+	lodScale = 1.0f;
+	shadowLodBias = 1;
+	memset(visibleLodCounts, 0, sizeof(visibleLodCounts));
+	impostors = true;
+	impostorDistance = IMPOSTOR_DISTANCE;
+	impostorStats = {};
+	staticShadowCaching = true;
+	staticCastersChanged = false;
+	staticCasterCount = 0;
+	staticShadowRebuilds = 0;
+	cameraCullingStats = {};
+	localShadows = true;
+	shadowLightIndex = -1;
+	shadowFilter = ShadowFilter::Comparison;
+	evsmBlurRadius = 2;
+	evsmBleedReduction = 0.2f;
+	evsmMinVariance = 0.0001f;
+	lastEntityCount = 0;
+	atlasCulling = {};
+
+	depthPrepassMode = DepthPrepassMode::Auto;
+	depthPrepassThreshold = 1.5f;
+	estimatedDepthComplexity = 0.0f;
+	depthPrepassActive = false;
+	depthPrepassStats = {};
+	bufferUploadsIssued = 0;
+	bufferUploadsSkipped = 0;
+	bindsSkipped = 0;
+	shadowQueueStats = {};
+
 	ssaoSamples = 64;
 	ssaoRadius = 2.0f;
+	ssaoResolutionScale = 2;
+	ssaoDepthSharpness = 50.0f;
+	particleResolutionScale = 1;
+	particleCompositeDepthThreshold = 0.1f;
+	computeSSAO = false;
+	fusedSSAOCombine = false;
+	temporalSSAO = true;
+	ssaoTemporalSamples = 16;
+	ssaoFrameIndex = 0;
+	ssaoHistoryIndex = 0;
+	ssaoHistoryValid = false;
+	XMStoreFloat4x4(&prevViewProjection, XMMatrixIdentity());
+	ssaoHistoryUVScale = XMFLOAT2(1, 1);
+
+	dynamicResolution = false;
+	renderScale = 1.0f;
+	dynamicResolutionTargetMs = 16.0f;
+	minRenderScale = 0.5f;
+	maxRenderScale = 1.0f;
+	renderWidth = windowWidth;
+	renderHeight = windowHeight;
+	temporalUpsampling = false;
+	temporalUpsamplingScale = TEMPORAL_UPSAMPLING_SCALE;
+	jitterIndex = 0;
+	jitterPixels = XMFLOAT2(0, 0);
+	taaHistoryIndex = 0;
+	taaHistoryValid = false;
+	renderTargetAliasing = true;
 
 	// Set up the ssao offsets (count must match shader!)
 	for (int i = 0; i < ARRAYSIZE(ssaoOffsets); i++)
@@ -42,11 +165,34 @@ Renderer::Renderer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::
 
 	}
 
+	// Samplers for the post processing passes, so they
+	// don't depend on whatever the last material left bound
+	D3D11_SAMPLER_DESC ppSampDesc = {};
+	ppSampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	ppSampDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	ppSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	ppSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	ppSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	postProcessWrapSampler = StateCache::GetInstance().GetSamplerState(ppSampDesc);
+
+	ppSampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	ppSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	ppSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	postProcessClampSampler = StateCache::GetInstance().GetSamplerState(ppSampDesc);
+
+	// After a depth pre-pass, only the surface that
+	// laid down each pixel's depth gets shaded
+	D3D11_DEPTH_STENCIL_DESC equalDepthDesc = {};
+	equalDepthDesc.DepthEnable = true;
+	equalDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	equalDepthDesc.DepthFunc = D3D11_COMPARISON_EQUAL;
+	depthEqualState = StateCache::GetInstance().GetDepthStencilState(equalDepthDesc);
+
 	D3D11_DEPTH_STENCIL_DESC particleDepthDesc = {};
 	particleDepthDesc.DepthEnable = true;
 	particleDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
 	particleDepthDesc.DepthFunc = D3D11_COMPARISON_LESS;
-	device->CreateDepthStencilState(&particleDepthDesc, particleDepthState.GetAddressOf());
+	particleDepthState = StateCache::GetInstance().GetDepthStencilState(particleDepthDesc);
 
 	D3D11_BLEND_DESC additiveBlendDesc = {};
 	additiveBlendDesc.RenderTarget[0].BlendEnable = true;
@@ -57,61 +203,134 @@ Renderer::Renderer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::
 	additiveBlendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
 	additiveBlendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
 	additiveBlendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
-	device->CreateBlendState(&additiveBlendDesc, particleBlendAdditive.GetAddressOf());
-
-	CreateGenericRenderTarget(windowWidth, windowHeight, sceneColorsRTV, sceneColorsSRV);
-	CreateGenericRenderTarget(windowWidth, windowHeight, sceneNormalsRTV, sceneNormalsSRV);
-	CreateGenericRenderTarget(windowWidth, windowHeight, sceneAmbientRTV, sceneAmbientSRV);
-	CreateGenericRenderTarget(windowWidth, windowHeight, sceneDepthRTV, sceneDepthSRV, DXGI_FORMAT_R32_FLOAT);
-	CreateGenericRenderTarget(windowWidth, windowHeight, ssaoResultRTV, ssaoResultSRV);
-	CreateGenericRenderTarget(windowWidth, windowHeight, ssaoBlurRTV, ssaoBlurSRV);
+	particleBlendAdditive = StateCache::GetInstance().GetBlendState(additiveBlendDesc);
+
+	additiveBlendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED | D3D11_COLOR_WRITE_ENABLE_GREEN | D3D11_COLOR_WRITE_ENABLE_BLUE;
+	particleBlendSceneColors = StateCache::GetInstance().GetBlendState(additiveBlendDesc);
+
+	// Particles' colors come premultiplied, so alpha blending only
+	// has to scale down what's behind them
+	D3D11_BLEND_DESC premultipliedBlendDesc = additiveBlendDesc;
+	premultipliedBlendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	premultipliedBlendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+	particleBlendPremultipliedSceneColors = StateCache::GetInstance().GetBlendState(premultipliedBlendDesc);
+
+	premultipliedBlendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	particleBlendPremultiplied = StateCache::GetInstance().GetBlendState(premultipliedBlendDesc);
+
+	// Low resolution additive particles can't cover anything up
+	// when they're composited, so they leave the alpha at zero
+	D3D11_BLEND_DESC lowResBlendDesc = additiveBlendDesc;
+	lowResBlendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
+	lowResBlendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	particleBlendLowResAdditive = StateCache::GetInstance().GetBlendState(lowResBlendDesc);
+
+	// Impostors fading in are blended over their meshes by the blend
+	// factor, every target alike (the packed ambient included)
+	D3D11_BLEND_DESC impostorBlendDesc = {};
+	impostorBlendDesc.RenderTarget[0].BlendEnable = true;
+	impostorBlendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	impostorBlendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	impostorBlendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_BLEND_FACTOR;
+	impostorBlendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_BLEND_FACTOR;
+	impostorBlendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_BLEND_FACTOR;
+	impostorBlendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_BLEND_FACTOR;
+	impostorBlendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	impostorBlend = StateCache::GetInstance().GetBlendState(impostorBlendDesc);
+
+	D3D11_DEPTH_STENCIL_DESC depthWriteDesc = {};
+	depthWriteDesc.DepthEnable = true;
+	depthWriteDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthWriteDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	depthWriteAlwaysState = StateCache::GetInstance().GetDepthStencilState(depthWriteDesc);
+
+	CreateBackBufferUAV();
+	CreateRenderTargets();
+	hiZBuffer.Resize(windowWidth, windowHeight);
 	CreateShadowMapResources();
+	CreateLightBuffer();
+	CreateClusterResources();
+	CreateLightGizmoBuffer();
+	CreateImpostorBuffer();
+	CreatePerFrameBuffers();
 
 }
 
-void Renderer::PostResize(unsigned int windowWidth, unsigned int windowHeight, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV)
+void Renderer::PostResize(unsigned int windowWidth, unsigned int windowHeight, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthBufferSRV)
 {
 	Renderer::backBufferRTV = backBufferRTV;
+	CreateBackBufferUAV();
 	Renderer::depthBufferDSV = depthBufferDSV;
+	Renderer::depthBufferSRV = depthBufferSRV;
 	Renderer::windowWidth = windowWidth;
 	Renderer::windowHeight = windowHeight;
 
-	sceneColorsRTV.Reset();
-	sceneColorsSRV.Reset();
-	sceneNormalsRTV.Reset();
-	sceneNormalsSRV.Reset();
-	sceneAmbientRTV.Reset();
-	sceneAmbientSRV.Reset();
-	sceneDepthRTV.Reset();
-	sceneDepthSRV.Reset();
-
-	CreateGenericRenderTarget(windowWidth, windowHeight, sceneColorsRTV, sceneColorsSRV);
-	CreateGenericRenderTarget(windowWidth, windowHeight, sceneNormalsRTV, sceneNormalsSRV);
-	CreateGenericRenderTarget(windowWidth, windowHeight, sceneAmbientRTV, sceneAmbientSRV);
-	CreateGenericRenderTarget(windowWidth, windowHeight, sceneDepthRTV, sceneDepthSRV, DXGI_FORMAT_R32_FLOAT);
-	CreateGenericRenderTarget(windowWidth, windowHeight, ssaoResultRTV, ssaoResultSRV);
-	CreateGenericRenderTarget(windowWidth, windowHeight, ssaoBlurRTV, ssaoBlurSRV);
-	CreateShadowMap();
-
+	// Only what depends on the window's size (not the shadow maps)
+	CreateRenderTargets();
+	hiZBuffer.Resize(windowWidth, windowHeight);
+	debugViews.Invalidate();
 }
 
 void Renderer::Render(Camera* camera, float totalTime, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh)
 {
+	PROFILE_SCOPE("Renderer::Render");
+
+	gpuProfiler.BeginFrame();
+	UpdateDynamicResolution();
+	UpdateJitter(camera);
+
+	// Whatever was issued since last frame (uploads while updating) isn't any pass's
+	DrawStats& drawStats = DrawStats::GetInstance();
+	drawStats.EndPass("Other");
+
+	// Keep last frame's upload and bind counts for the UI, and start counting again
+	bufferUploadsIssued = ISimpleShader::GetBufferUploadsIssued();
+	bufferUploadsSkipped = ISimpleShader::GetBufferUploadsSkipped();
+	bindsSkipped = ISimpleShader::GetBindsSkipped();
+	ISimpleShader::ResetBufferUploadStats();
+	ISimpleShader::ResetBindsSkipped();
+
+	// Binding a resource as an output silently unbinds it as an input,
+	// which the state caches can't see, so start each frame fresh
+	//  - This also starts each context's constant ring over
+	ISimpleShader::BeginFrame();
+	StateCache::GetInstance().BeginFrame();
+	UploadRing::GetInstance().BeginFrame();
+
+	// Every color target is completely overwritten by its pass (the sky
+	// fills in behind the scene, and the combine covers the window), so
+	// their old contents are just discarded rather than cleared
+	//  - The scene normals behind the sky are left undefined, but nothing
+	//    reads them where the depth is 1
+	if (context1)
+	{
+		context1->DiscardView(backBufferRTV.Get());
+		context1->DiscardView(sceneColorsRTV.Get());
+		context1->DiscardView(sceneNormalsRTV.Get());
+		if (sceneAlbedoRTV)
+		{
+			context1->DiscardView(sceneAlbedoRTV.Get());
+			context1->DiscardView(sceneSurfaceRTV.Get());
+		}
+		context1->DiscardView(ssaoResultRTV.Get());
+		if (ssaoBlurRTV)
+			context1->DiscardView(ssaoBlurRTV.Get());
+		if (taaInputRTV)
+			context1->DiscardView(taaInputRTV.Get());
+	}
 
-	// Background color for clearing
-	const float color[4] = { 0, 0, 0, 1 };
-	const float depth[4] = { 1, 0, 0, 0 };
+	// Only the lit entities write motion (and the sky's is worked
+	// out from its depth), so this leaves the gizmos not moving
+	if (motionVectorsRTV)
+	{
+		float noMotion[4] = {};
+		context->ClearRenderTargetView(motionVectorsRTV.Get(), noMotion);
+	}
 
-	// Clear the render target and depth buffer (erases what's on the screen)
+	// The depth buffer does need its clear, since a depth of 1
+	// is what marks a pixel as empty for the sky and SSAO
 	//  - Do this ONCE PER FRAME
 	//  - At the beginning of Draw (before drawing *anything*)
-	context->ClearRenderTargetView(backBufferRTV.Get(), color);
-	context->ClearRenderTargetView(sceneColorsRTV.Get(), color);
-	context->ClearRenderTargetView(sceneNormalsRTV.Get(), color);
-	context->ClearRenderTargetView(sceneAmbientRTV.Get(), color);
-	context->ClearRenderTargetView(sceneDepthRTV.Get(), depth);
-	context->ClearRenderTargetView(ssaoResultRTV.Get(), color);
-	context->ClearRenderTargetView(ssaoBlurRTV.Get(), color);
 	context->ClearDepthStencilView(
 		depthBufferDSV.Get(),
 		D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
@@ -120,139 +339,389 @@ void Renderer::Render(Camera* camera, float totalTime, int lightCount, SimpleVer
 
 
 
-	RenderShadowMap();
-
-	ID3D11RenderTargetView* renderTargets[4] = {};
-	renderTargets[0] = sceneColorsRTV.Get();
-	renderTargets[1] = sceneNormalsRTV.Get();
-	renderTargets[2] = sceneAmbientRTV.Get();
-	renderTargets[3] = sceneDepthRTV.Get();
-
-	context->OMSetRenderTargets(4, renderTargets, depthBufferDSV.Get());
-
-	// Draw all of the entities
-	for (auto ge : entities)
+	// Bounds (and occlusion) are shared by the culling for each pass
+	UpdateEntityBounds();
+	hiZBuffer.ReadBack();
+	UpdateEntityOcclusion();
+	UpdateEntityLods(camera);
+	UpdateStaticCasters();
+	if (gpuDrivenCulling)
 	{
-		// Set the "per frame" data
-		// Note that this should literally be set once PER FRAME, before
-		// the draw loop, but we're currently setting it per entity since 
-		// we are just using whichever shader the current entity has.  
-		// Inefficient!!!
-		SimplePixelShader* ps = ge->GetMaterial()->GetPS();
-		ps->SetData("Lights", (void*)(&lights[0]), sizeof(Light) * lightCount);
-		ps->SetInt("LightCount", lightCount);
-		ps->SetFloat3("CameraPosition", camera->GetTransform()->GetPosition());
-		ps->SetInt("SpecIBLTotalMipLevels", sky->IBLGetMipLevels());
-		ps->SetFloat3("AmbientNonPBR", ambientNonPBR);
-		ps->CopyBufferData("perFrame");
+		// On the immediate context, so it's done before the scene is played back
+		XMFLOAT3 cameraPosition = camera->GetTransform()->GetPosition();
+		gpuCulling.Update(entities);
+		gpuCulling.Cull(camera->GetView(), camera->GetProjection(), cameraPosition,
+			occlusionCulling ? &hiZBuffer : 0,
+			meshLods ? lodScale : 0.0f,
+			XMFLOAT4(FLT_MAX, LOD_SCREEN_COVERAGE_1, LOD_SCREEN_COVERAGE_2, LOD_SCREEN_COVERAGE_3),
+			LOD_HYSTERESIS);
+	}
 
-		ps->SetShaderResourceView("IrradianceIBLMap", sky->IBLGetIrradianceMap());
-		ps->SetShaderResourceView("SpecularIBLMap", sky->IBLGetConvolvedSpecularMap());
-		ps->SetShaderResourceView("BrdfLookUpMap", sky->IBLGetBRDFLookupTexture());
-		ps->SetShaderResourceView("ShadowMap", shadowDepthSRV);
-		ps->SetSamplerState("ShadowSampler", shadowSampler);
+	// The camera's last turn before anything it's drawn with is made
+	if (cameraLateLatch)
+		cameraLateLatch();
 
-		SimpleVertexShader* vs = ge->GetMaterial()->GetVS();
-		vs->SetMatrix4x4("shadowView", shadowViewMatrix);
-		vs->SetMatrix4x4("shadowProjection", shadowProjectionMatrix);
+	// Cascades for the first shadow casting directional light,
+	// and atlas tiles for the point and spot lights
+	shadowLightIndex = -1;
+	for (int i = 0; i < lightCount && i < (int)lights.size() && shadowLightIndex < 0; i++)
+	{
+		if (lights[i].Type == LIGHT_TYPE_DIRECTIONAL && lights[i].CastsShadows)
+			shadowLightIndex = i;
+	}
+	if (shadowLightIndex >= 0)
+		UpdateShadowCascades(camera, &lights[shadowLightIndex]);
+	UpdateShadowAtlas(camera, lightCount);
+
+	// Views of whatever the last scene pass wanted impostors for, before
+	// the camera's view buffer is bound again (since baking binds its own)
+	if (impostors && impostorAtlas.Bake(context, IMPOSTOR_BAKES_PER_FRAME) > 0)
+		vsPerFrameCB.Reset();
+
+	// Upload anything that changed since last frame
+	UpdatePerFrameData(camera, lightCount);
+	if (batchedParticles)
+		particleBatcher.Upload(emitters);
+	EndPass("Clear & Light Culling");
+
+	// Sorts have to be on the immediate context, ahead of the
+	// particle pass (which might be recorded on another thread)
+	for (auto& e : emitters)
+		e->SortByDepth(camera, totalTime);
+	EndPass("Particle Sort");
 
-		// Draw the entity
-		ge->Draw(context, camera);
+	// Record (or just draw) the scene, which only needs this
+	// frame's per frame data and the finished shadow map
+	if (multithreadedRecording)
+	{
+		// Workers record the shadow and particle passes while this
+		// thread records the scene, then they're played back in order
+		std::thread shadowThread([&]() { RecordShadowPass(camera); });
+		std::thread particleThread([&]() { RecordParticlePass(camera, totalTime); });
+		RecordScenePass(camera, lightCount, lightVS, lightPS, lightMesh);
+		shadowThread.join();
+		particleThread.join();
+
+		context->ExecuteCommandList(shadowCommandList.Get(), TRUE);
+		EndPass("Shadow Map");
+		context->ExecuteCommandList(sceneCommandList.Get(), TRUE);
+		EndPass("Scene");
+		shadowCommandList.Reset();
+		sceneCommandList.Reset();
+	}
+	else
+	{
+		RenderShadowMap(context, camera);
+		EndPass("Shadow Map");
+		RenderScene(context, camera, lightCount, lightVS, lightPS, lightMesh);
+		EndPass("Scene");
 	}
 
-	// Draw the light sources
-	DrawPointLights(camera, lightCount, lightVS, lightPS, lightMesh);
 
-	// Draw the sky
-	sky->Draw(camera);
+	// Particles have to go in before the upscale with dynamic resolution
+	if (ReducedResolution())
+		DrawParticlePass(camera, totalTime);
 
 	// Lastly, get the final color results to the screen!
 	Assets& assets = Assets::GetInstance();
-	SimpleVertexShader* vs = assets.GetVertexShader("FullscreenVS.cso");
+	SimpleVertexShader* vs = assets.GetVertexShader("FullscreenVS.cso"_asset);
 	vs->SetShader();
 
 
-	// Set up ssao render pass
-	renderTargets[0] = ssaoResultRTV.Get();
-	renderTargets[1] = 0;
-	renderTargets[2] = 0;
-	renderTargets[3] = 0;
-	context->OMSetRenderTargets(4, renderTargets, 0);
-
-	SimplePixelShader* ssaoPS = assets.GetPixelShader("SsaoPS.cso");
-	ssaoPS->SetShader();
-
-	// Calculate the inverse of the camera matrices
-	XMFLOAT4X4 invView, invProj, view = camera->GetView(), proj = camera->GetProjection();
-	XMStoreFloat4x4(&invView, XMMatrixInverse(0, XMLoadFloat4x4(&view)));
-	XMStoreFloat4x4(&invProj, XMMatrixInverse(0, XMLoadFloat4x4(&proj)));
-	ssaoPS->SetMatrix4x4("invViewMatrix", invView);
-	ssaoPS->SetMatrix4x4("invProjMatrix", invProj);
-	ssaoPS->SetMatrix4x4("viewMatrix", view);
-	ssaoPS->SetMatrix4x4("projectionMatrix", proj);
-	ssaoPS->SetData("offsets", ssaoOffsets, sizeof(XMFLOAT4) * ARRAYSIZE(ssaoOffsets));
-	ssaoPS->SetFloat("ssaoRadius", ssaoRadius);
-	ssaoPS->SetInt("ssaoSamples", ssaoSamples);
-	ssaoPS->SetFloat2("randomTextureScreenScale", XMFLOAT2(windowWidth / 4.0f, windowHeight / 4.0f));
-	ssaoPS->CopyAllBufferData();
-
-	ssaoPS->SetShaderResourceView("Normals", sceneNormalsSRV);
-	ssaoPS->SetShaderResourceView("Depths", sceneDepthSRV);
-	ssaoPS->SetShaderResourceView("Random", assets.GetTexture("random"));
-
-	context->Draw(3, 0);
+	// Camera values shared by the SSAO passes
+	const ViewConstants& viewConstants = camera->GetViewConstants();
+	XMFLOAT4X4 invProj = viewConstants.InvProjection, view = viewConstants.View, proj = viewConstants.Projection;
+	XMFLOAT2 depthParams(proj._33, proj._43);
 
+	// SSAO passes run at the (possibly reduced) SSAO resolution, and
+	// only cover the part of their targets the scene was rendered to
+	unsigned int ssaoViewWidth = max(1u, renderWidth / ssaoResolutionScale);
+	unsigned int ssaoViewHeight = max(1u, renderHeight / ssaoResolutionScale);
+	XMFLOAT2 ssaoUVScale((float)ssaoViewWidth / ssaoWidth, (float)ssaoViewHeight / ssaoHeight);
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)ssaoViewWidth;
+	viewport.Height = (float)ssaoViewHeight;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
 
-	// Set up blur (assuming all other targets are null here)
-	renderTargets[0] = ssaoBlurRTV.Get();
-	context->OMSetRenderTargets(1, renderTargets, 0);
+	ID3D11RenderTargetView* renderTargets[4] = {};
 
-	SimplePixelShader* ps = assets.GetPixelShader("SsaoBlurPS.cso");
-	ps->SetShader();
-	ps->SetShaderResourceView("SSAO", ssaoResultSRV);
-	ps->SetFloat2("pixelSize", XMFLOAT2(1.0f / windowWidth, 1.0f / windowHeight));
-	ps->CopyAllBufferData();
-	context->Draw(3, 0);
+	// Shrink the depths and normals first, if necessary
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoInputNormals = sceneNormalsSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoInputDepths = depthBufferSRV;
+	if (ssaoResolutionScale > 1)
+	{
+		renderTargets[0] = ssaoNormalsRTV.Get();
+		renderTargets[1] = ssaoDepthRTV.Get();
+		context->OMSetRenderTargets(2, renderTargets, 0);
+
+		SimplePixelShader* downsamplePS = assets.GetPixelShader("SsaoDownsamplePS.cso"_asset);
+		downsamplePS->SetShader();
+		downsamplePS->SetInt("downscale", ssaoResolutionScale);
+		downsamplePS->CopyAllBufferData();
+		downsamplePS->SetShaderResourceView("Normals", sceneNormalsSRV);
+		downsamplePS->SetShaderResourceView("Depths", depthBufferSRV);
+		context->Draw(3, 0);
+		DrawStats::Count(DrawCounter::Draws);
+
+		// Unbind before they're used as inputs
+		renderTargets[0] = 0;
+		renderTargets[1] = 0;
+		ssaoInputNormals = ssaoNormalsSRV;
+		ssaoInputDepths = ssaoDepthSRV;
+	}
 
+	int ssaoFrameSamples = temporalSSAO ? ssaoTemporalSamples : ssaoSamples;
+	int ssaoSampleStart = temporalSSAO ? (int)((ssaoFrameIndex * ssaoTemporalSamples) % ARRAYSIZE(ssaoOffsets)) : 0;
+	ID3D11UnorderedAccessView* nullComputeUAVs[1] = {};
+	ID3D11ShaderResourceView* nullComputeSRVs[3] = {};
 
-	// Re-enable back buffer (assuming all other targets are null here)
-	renderTargets[0] = backBufferRTV.Get();
-	context->OMSetRenderTargets(1, renderTargets, 0);
+	if (computeSSAO)
+	{
+		// Nothing can still have the depth buffer bound for output
+		context->OMSetRenderTargets(0, 0, 0);
+
+		SimpleComputeShader* ssaoCS = assets.GetComputeShader("SsaoCS.cso"_asset);
+		ssaoCS->SetShader();
+		ssaoCS->SetMatrix4x4("invProjMatrix", invProj);
+		ssaoCS->SetMatrix4x4("viewMatrix", view);
+		ssaoCS->SetMatrix4x4("projectionMatrix", proj);
+		ssaoCS->SetData("offsets", ssaoOffsets, sizeof(XMFLOAT4) * ARRAYSIZE(ssaoOffsets));
+		ssaoCS->SetFloat("ssaoRadius", ssaoRadius);
+		ssaoCS->SetInt("ssaoSamples", ssaoFrameSamples);
+		ssaoCS->SetInt("sampleStart", ssaoSampleStart);
+		ssaoCS->SetFloat2("viewportSize", XMFLOAT2((float)ssaoViewWidth, (float)ssaoViewHeight));
+		ssaoCS->CopyAllBufferData();
+
+		ssaoCS->SetShaderResourceView("Normals", ssaoInputNormals);
+		ssaoCS->SetShaderResourceView("Depths", ssaoInputDepths);
+		ssaoCS->SetShaderResourceView("Random", assets.GetTexture("random"_asset));
+		ssaoCS->SetUnorderedAccessView("SSAOResult", ssaoResultUAV);
+		ssaoCS->DispatchByThreads(ssaoViewWidth, ssaoViewHeight, 1);
+
+		// Unbind so the result can be read
+		context->CSSetUnorderedAccessViews(0, 1, nullComputeUAVs, 0);
+		context->CSSetShaderResources(0, 3, nullComputeSRVs);
+		ISimpleShader::InvalidateStateCache(context);
+		EndPass("SSAO (Compute)");
+	}
+	else
+	{
+		// Set up ssao render pass
+		renderTargets[0] = ssaoResultRTV.Get();
+		context->OMSetRenderTargets(4, renderTargets, 0);
+
+		SimplePixelShader* ssaoPS = assets.GetPixelShader("SsaoPS.cso"_asset);
+		ssaoPS->SetShader();
+
+		SsaoPSData ssaoData = {};
+		ssaoData.ViewMatrix = view;
+		ssaoData.ProjectionMatrix = proj;
+		ssaoData.InvProjMatrix = invProj;
+		memcpy(ssaoData.Offsets, ssaoOffsets, sizeof(ssaoOffsets));
+		ssaoData.SsaoRadius = ssaoRadius;
+		ssaoData.SsaoSamples = ssaoFrameSamples;
+		ssaoData.RandomTextureScreenScale = XMFLOAT2(ssaoViewWidth / 4.0f, ssaoViewHeight / 4.0f);
+		ssaoData.SampleStart = ssaoSampleStart;
+		ssaoData.UVScale = ssaoUVScale;
+		ssaoPS->WriteBuffer("externalData"_sn, ssaoData, SsaoPSDataLayout);
+		ssaoPS->CopyAllBufferData();
+
+		ssaoPS->SetShaderResourceView("Normals", ssaoInputNormals);
+		ssaoPS->SetShaderResourceView("Depths", ssaoInputDepths);
+		ssaoPS->SetShaderResourceView("Random", assets.GetTexture("random"_asset));
+		ssaoPS->SetSamplerState("BasicSampler", postProcessWrapSampler);
+		ssaoPS->SetSamplerState("ClampSampler", postProcessClampSampler);
+
+		context->Draw(3, 0);
+		DrawStats::Count(DrawCounter::Draws);
+		EndPass("SSAO");
+	}
 
-	ps = assets.GetPixelShader("SsaoCombinePS.cso");
-	ps->SetShader();
-	ps->SetShaderResourceView("SceneColorsNoAmbient", sceneColorsSRV);
-	ps->SetShaderResourceView("Ambient", sceneAmbientSRV);
-	ps->SetShaderResourceView("SSAOBlur", ssaoBlurSRV);
-	ps->SetInt("ssaoEnabled", true);
-	ps->SetInt("ssaoOutputOnly", false);
-	ps->SetFloat2("pixelSize", XMFLOAT2(1.0f / windowWidth, 1.0f / windowHeight));
-	ps->CopyAllBufferData();
-	context->Draw(3, 0);
+	// Accumulate with the reprojected history, which is what gets blurred
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoBlurInput = ssaoResultSRV;
+	if (temporalSSAO)
+	{
+		renderTargets[0] = ssaoHistoryRTV[ssaoHistoryIndex].Get();
+		context->OMSetRenderTargets(1, renderTargets, 0);
+
+		// From this frame's NDCs back to world space, then into last frame's clip space
+		//  - Last frame's is the renderer's own, from when the history was written
+		XMMATRIX viewProj = XMLoadFloat4x4(&viewConstants.ViewProjection);
+		XMFLOAT4X4 reprojection;
+		XMStoreFloat4x4(&reprojection, XMLoadFloat4x4(&viewConstants.InvViewProjection) * XMLoadFloat4x4(&prevViewProjection));
+
+		// Keep roughly as many frames of history as it takes to cycle through every offset
+		float historyWeight = min(0.95f, 1.0f - (float)ssaoTemporalSamples / ARRAYSIZE(ssaoOffsets));
+
+		SimplePixelShader* temporalPS = assets.GetPixelShader("SsaoTemporalPS.cso"_asset);
+		temporalPS->SetShader();
+		temporalPS->SetMatrix4x4("reprojection", reprojection);
+		temporalPS->SetFloat2("depthParams", depthParams);
+		temporalPS->SetFloat("historyWeight", historyWeight);
+		temporalPS->SetInt("historyValid", ssaoHistoryValid);
+		temporalPS->SetFloat2("historyUVScale", ssaoHistoryUVScale);
+		temporalPS->CopyAllBufferData();
+		temporalPS->SetShaderResourceView("SSAO", ssaoResultSRV);
+		temporalPS->SetShaderResourceView("History", ssaoHistorySRV[1 - ssaoHistoryIndex]);
+		temporalPS->SetShaderResourceView("Normals", ssaoInputNormals);
+		temporalPS->SetShaderResourceView("Depths", ssaoInputDepths);
+		temporalPS->SetSamplerState("ClampSampler", postProcessClampSampler);
+		context->Draw(3, 0);
+		DrawStats::Count(DrawCounter::Draws);
+		EndPass("SSAO Temporal");
+
+		ssaoBlurInput = ssaoHistorySRV[ssaoHistoryIndex];
+
+		// This frame's output is next frame's history
+		XMStoreFloat4x4(&prevViewProjection, viewProj);
+		ssaoHistoryUVScale = ssaoUVScale;
+		ssaoHistoryIndex = 1 - ssaoHistoryIndex;
+		ssaoHistoryValid = true;
+		ssaoFrameIndex++;
+	}
 
-	//Particles!
-	renderTargets[0] = backBufferRTV.Get();
-	context->OMSetRenderTargets(1, renderTargets, depthBufferDSV.Get());
+	if (fusedSSAOCombine)
+	{
+		// Blurred as part of the combine
+	}
+	else if (computeSSAO)
+	{
+		// Separable - along the rows into a temporary, then down the columns
+		context->OMSetRenderTargets(0, 0, 0);
+
+		SimpleComputeShader* blurCS = assets.GetComputeShader("SsaoBlurCS.cso"_asset);
+		blurCS->SetShader();
+		blurCS->SetFloat2("depthParams", depthParams);
+		blurCS->SetFloat("depthSharpness", ssaoDepthSharpness);
+		blurCS->SetFloat2("viewportSize", XMFLOAT2((float)ssaoViewWidth, (float)ssaoViewHeight));
+		blurCS->SetShaderResourceView("Depths", ssaoInputDepths);
+
+		blurCS->SetInt("horizontal", true);
+		blurCS->CopyAllBufferData();
+		blurCS->SetShaderResourceView("SSAO", ssaoBlurInput);
+		blurCS->SetUnorderedAccessView("BlurResult", ssaoBlurTempUAV);
+		blurCS->DispatchByGroups((ssaoViewWidth + 63) / 64, ssaoViewHeight, 1);
+		context->CSSetUnorderedAccessViews(0, 1, nullComputeUAVs, 0);
+
+		blurCS->SetInt("horizontal", false);
+		blurCS->CopyAllBufferData();
+		blurCS->SetShaderResourceView("SSAO", ssaoBlurTempSRV);
+		blurCS->SetUnorderedAccessView("BlurResult", ssaoBlurUAV);
+		blurCS->DispatchByGroups((ssaoViewHeight + 63) / 64, ssaoViewWidth, 1);
+		context->CSSetUnorderedAccessViews(0, 1, nullComputeUAVs, 0);
+		context->CSSetShaderResources(0, 2, nullComputeSRVs);
+		ISimpleShader::InvalidateStateCache(context);
+		EndPass("SSAO Blur (Compute)");
+	}
+	else
+	{
+		// Set up blur (assuming all other targets are null here)
+		renderTargets[0] = ssaoBlurRTV.Get();
+		context->OMSetRenderTargets(1, renderTargets, 0);
+
+		SimplePixelShader* blurPS = assets.GetPixelShader("SsaoBlurPS.cso"_asset);
+		blurPS->SetShader();
+		blurPS->SetShaderResourceView("SSAO", ssaoBlurInput);
+		blurPS->SetShaderResourceView("Depths", ssaoInputDepths);
+		blurPS->SetFloat2("depthParams", depthParams);
+		blurPS->SetFloat("depthSharpness", ssaoDepthSharpness);
+		blurPS->SetFloat2("viewportSize", XMFLOAT2((float)ssaoViewWidth, (float)ssaoViewHeight));
+		blurPS->CopyAllBufferData();
+		context->Draw(3, 0);
+		DrawStats::Count(DrawCounter::Draws);
+		EndPass("SSAO Blur");
+	}
 
-	context->OMSetBlendState(particleBlendAdditive.Get(), 0, 0xFFFFFFFF);
-	context->OMSetDepthStencilState(particleDepthState.Get(), 0);
+	// Back to full resolution for the combine, unless it's
+	// staying at the render resolution for temporal upsampling
+	unsigned int combineWidth = temporalUpsampling ? renderWidth : windowWidth;
+	unsigned int combineHeight = temporalUpsampling ? renderHeight : windowHeight;
+	viewport.Width = (float)combineWidth;
+	viewport.Height = (float)combineHeight;
+	context->RSSetViewports(1, &viewport);
 
-	for (auto& e : emitters)
+	if (fusedSSAOCombine)
+	{
+		CombineSSAOFused(ssaoBlurInput, ssaoInputDepths, ssaoViewWidth, ssaoViewHeight, depthParams,
+			temporalUpsampling ? taaInputUAV : backBufferUAV, combineWidth, combineHeight);
+	}
+	else
 	{
-		e->Draw(camera, totalTime);
+		// Re-enable back buffer (assuming all other targets are null here)
+		renderTargets[0] = temporalUpsampling ? taaInputRTV.Get() : backBufferRTV.Get();
+		context->OMSetRenderTargets(1, renderTargets, 0);
+
+		// Combine, upsampling the SSAO along the way
+		SimplePixelShader* ps = assets.GetPixelShader("SsaoCombinePS.cso"_asset);
+		ps->SetShader();
+		ps->SetShaderResourceView("SceneColors", sceneColorsSRV);
+		ps->SetShaderResourceView("SSAOBlur", ssaoBlurSRV);
+		ps->SetShaderResourceView("Depths", depthBufferSRV);
+		ps->SetShaderResourceView("SSAODepths", ssaoInputDepths);
+		ps->SetSamplerState("BasicSampler", postProcessClampSampler);
+		ps->SetInt("ssaoEnabled", true);
+		ps->SetInt("ssaoOutputOnly", false);
+		ps->SetFloat2("ssaoSize", XMFLOAT2((float)ssaoViewWidth, (float)ssaoViewHeight));
+		ps->SetFloat2("renderSize", XMFLOAT2((float)renderWidth, (float)renderHeight));
+		ps->SetFloat2("uvScale", XMFLOAT2((float)renderWidth / windowWidth, (float)renderHeight / windowHeight));
+		ps->SetFloat2("depthParams", depthParams);
+		ps->SetFloat("depthSharpness", ssaoDepthSharpness);
+		ps->CopyAllBufferData();
+		context->Draw(3, 0);
+		DrawStats::Count(DrawCounter::Draws);
+		EndPass("Combine");
 	}
 
-	context->OMSetBlendState(0, 0, 0xFFFFFFFF);
-	context->OMSetDepthStencilState(0, 0);
+	// The depth buffer is about to be bound for the particles
+	// (and the UI may display it), so nothing can still be reading it
+	ID3D11ShaderResourceView* postProcessSRVs[4] = {};
+	context->PSSetShaderResources(0, 4, postProcessSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+
+	// Full resolution from this frame and the reprojected history
+	if (temporalUpsampling)
+		TemporalUpsample(camera, depthBufferSRV);
+
+	if (uiVisible)
+		UpdateDebugViews(camera, ssaoUVScale);
+
+	// Hi-Z pyramid of this frame's depth, for culling a few frames from now
+	if (occlusionCulling)
+	{
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj));
+		hiZBuffer.Build(depthBufferSRV, viewProj, renderScale);
+		EndPass("Hi-Z");
+	}
 
-	// Draw ImGui
-	ImGui::Render();
-	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	//Particles!
+	if (!ReducedResolution())
+		DrawParticlePass(camera, totalTime);
+
+	// Draw ImGui, without the depth buffer so it can show it
+	//  - Its vertices are only uploaded again when they've changed
+	//    (see ImGui_ImplDX11_RenderDrawData())
+	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+	if (!warmingUp && uiVisible)
+	{
+		PROFILE_SCOPE("ImGui");
+		ImGui::Render();
+		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	}
+	ISimpleShader::InvalidateStateCache(context);
+	EndPass("ImGui");
+	gpuProfiler.EndFrame();
+	drawStats.EndFrame();
 
 	// Present the back buffer to the user
 	//  - Puts the final frame we're drawing into the window so the user can see it
 	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
-	swapChain->Present(0, 0);
+	if (!warmingUp)
+	{
+		PROFILE_SCOPE("Present");
+		presentResult = swapChain->Present(presentSyncInterval, presentFlags);
+	}
 
 	// Due to the usage of a more sophisticated swap chain,
 	// the render target must be re-bound after every call to Present()
@@ -261,14 +730,691 @@ void Renderer::Render(Camera* camera, float totalTime, int lightCount, SimpleVer
 
 	// Unbind all SRVs at the end of the frame so they're not still bound for input
 	// when we begin the MRTs of the next frame
+	ID3D11ShaderResourceView* nullSRVs[17] = {};
+	context->PSSetShaderResources(0, 17, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+
+	// Whatever was drawn this frame has last frame's matrices from here on
+	Transform::NextFrame();
+}
+
+// --------------------------------------------------------------------------
+// Unordered access to the back buffer, for the fused SSAO combine
+//  - Left null if the swap chain wasn't made with unordered access,
+//    which keeps the fused combine off
+// --------------------------------------------------------------------------
+void Renderer::CreateBackBufferUAV()
+{
+	backBufferUAV.Reset();
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> backBuffer;
+	backBufferRTV->GetResource(backBuffer.GetAddressOf());
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+	if (FAILED(device->CreateUnorderedAccessView(backBuffer.Get(), &uavDesc, backBufferUAV.GetAddressOf())))
+	{
+		backBufferUAV.Reset();
+		fusedSSAOCombine = false;
+	}
+}
+
+// --------------------------------------------------------------------------
+// Blurs the unblurred (or temporally accumulated) SSAO and combines it with
+// the scene in one dispatch, straight into the back buffer
+//  - Replaces both the blur and the combine pass, and the blur's target
+// --------------------------------------------------------------------------
+void Renderer::CombineSSAOFused(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssao, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoDepths, unsigned int ssaoViewWidth, unsigned int ssaoViewHeight, XMFLOAT2 depthParams,
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> output, unsigned int outputWidth, unsigned int outputHeight)
+{
+	// The output can't be a render target while it's written
+	context->OMSetRenderTargets(0, 0, 0);
+
+	SimpleComputeShader* cs = Assets::GetInstance().GetComputeShader("SsaoCombineCS.cso"_asset);
+	cs->SetShader();
+	cs->SetFloat2("ssaoSize", XMFLOAT2((float)ssaoViewWidth, (float)ssaoViewHeight));
+	cs->SetFloat2("renderSize", XMFLOAT2((float)renderWidth, (float)renderHeight));
+	cs->SetFloat2("uvScale", XMFLOAT2((float)renderWidth / windowWidth, (float)renderHeight / windowHeight));
+	cs->SetFloat2("windowSize", XMFLOAT2((float)outputWidth, (float)outputHeight));
+	cs->SetFloat2("depthParams", depthParams);
+	cs->SetFloat("depthSharpness", ssaoDepthSharpness);
+	cs->CopyAllBufferData();
+	cs->SetShaderResourceView("SceneColors", sceneColorsSRV);
+	cs->SetShaderResourceView("SSAO", ssao);
+	cs->SetShaderResourceView("Depths", depthBufferSRV);
+	cs->SetShaderResourceView("SSAODepths", ssaoDepths);
+	cs->SetSamplerState("BasicSampler", postProcessClampSampler);
+	cs->SetUnorderedAccessView("Output", output);
+	cs->DispatchByGroups((outputWidth + 15) / 16, (outputHeight + 15) / 16, 1);
+
+	ID3D11UnorderedAccessView* nullUAVs[1] = {};
+	ID3D11ShaderResourceView* nullSRVs[4] = {};
+	context->CSSetUnorderedAccessViews(0, 1, nullUAVs, 0);
+	context->CSSetShaderResources(0, 4, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+	EndPass("SSAO Blur + Combine (Compute)");
+
+	// Everything after draws over it as usual
+	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+}
+
+// --------------------------------------------------------------------------
+// The main opaque scene pass into the MRTs: entities, light gizmos and sky.
+// Sets all of its own state so it can be recorded on a deferred context.
+// --------------------------------------------------------------------------
+void Renderer::RenderScene(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh)
+{
+	PROFILE_SCOPE("Renderer::RenderScene");
+	DRAW_STATS_PASS("Scene");
+	passContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// Anything could have been bound since the last pass
+	StateCache& states = StateCache::GetInstance();
+	states.Invalidate(passContext);
+	PassState scenePass;
+	scenePass.SetViewport((float)renderWidth, (float)renderHeight);
+
+	// Bind the per frame resources ONCE for all entities
+	//  - The per frame constant buffers are bound along with
+	//    each shader, since they're shared with SimpleShader
+	//  - Slots must match those in PerFrameData.hlsli
+	ID3D11ShaderResourceView* frameSRVs[12] = {
+		sky->IBLGetBRDFLookupTexture().Get(),
+		sky->IBLGetIrradianceMap().Get(),
+		sky->IBLGetConvolvedSpecularMap().Get(),
+		shadowDepthSRV.Get(),
+		lightSRV.Get(),
+		clusterLightGridSRV.Get(),
+		clusterLightIndicesSRV.Get(),
+		shadowAtlas.GetSRV().Get(),
+		shadowAtlas.GetShadowDataSRV().Get(),
+		shadowAtlas.GetLightIndicesSRV().Get(),
+		shadowMomentsSRV.Get() };
+	passContext->PSSetShaderResources(4, 12, frameSRVs);
+	ID3D11SamplerState* shadowSamplers[2] = { shadowSampler.Get(), shadowMomentSampler.Get() };
+	passContext->PSSetSamplers(2, 2, shadowSamplers);
+	ISimpleShader::InvalidateStateCache(passContext);
+
+	// Only entities that could be on screen (which the GPU
+	// already worked out, with GPU driven culling)
+	cameraVisibleEntities.clear();
+	cameraCullingStats = {};
+	if (!gpuDrivenCulling)
+	{
+		const ViewConstants& cameraView = camera->GetViewConstants();
+		BoundingFrustum cameraFrustum(XMLoadFloat4x4(&cameraView.Projection));
+		cameraFrustum.Transform(cameraFrustum, XMLoadFloat4x4(&cameraView.InvView));
+		CullEntities(cameraFrustum, cameraVisibleEntities, cameraCullingStats, true);
+	}
+	UpdateTextureDetail(camera);
+
+	// Lights for each visible entity, when the clusters aren't doing it
+	perEntityLightsActive = perEntityLights && !clusteredLighting && !gpuDrivenCulling;
+	if (perEntityLightsActive)
+	{
+		entityLightSpheres.clear();
+		for (auto ge : cameraVisibleEntities)
+		{
+			const BoundingOrientedBox& box = entityBounds[entities.GetSceneIndex(ge)];
+			entityLightSpheres.push_back(BoundingSphere(box.Center, XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)))));
+		}
+		entityLightLists.Build(passContext, entityLightSpheres, lights, lightCount);
+
+		ID3D11ShaderResourceView* lightListSRVs[1] = { entityLightLists.GetSRV().Get() };
+		passContext->PSSetShaderResources(16, 1, lightListSRVs);
+		ISimpleShader::InvalidateStateCache(passContext);
+	}
+
+	// Sort all of the entities to minimize state changes
+	//  - With deferred shading, anything that can't go in the
+	//    G-buffer is drawn forward afterwards
+	deferredShadingActive = deferredShading && !gpuDrivenCulling;
+	renderQueue.Clear();
+	forwardQueue.Clear();
+	memset(visibleLodCounts, 0, sizeof(visibleLodCounts));
+	impostorInstances.clear();
+	impostorStats = {};
+	XMFLOAT3 cameraPosition = camera->GetTransform()->GetPosition();
+	XMVECTOR cameraPos = XMLoadFloat3(&cameraPosition);
+	float impostorFadeRange = impostorDistance * IMPOSTOR_FADE_RANGE;
+	for (size_t v = 0; v < cameraVisibleEntities.size(); v++)
+	{
+		GameEntity* ge = cameraVisibleEntities[v];
+		unsigned int sceneIndex = entities.GetSceneIndex(ge);
+
+		// Far enough for an impostor, once its views are baked, and only
+		// a mesh as well while it's fading in
+		if (impostors && impostorInstances.size() < IMPOSTOR_MAX_INSTANCES)
+		{
+			float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&entityBounds[sceneIndex].Center) - cameraPos));
+			int slice = distance > impostorDistance ? impostorAtlas.Find(ge->GetMesh(), ge->GetMaterial()) : -1;
+			if (slice >= 0)
+			{
+				const BoundingBox& meshBounds = ge->GetMesh()->GetBounds();
+				ImpostorInstance instance = {};
+				instance.World = ge->GetTransform()->GetWorldMatrix();
+				instance.WorldInverseTranspose = ge->GetTransform()->GetWorldInverseTransposeMatrix();
+				instance.Center = meshBounds.Center;
+				instance.Radius = max(XMVectorGetX(XMVector3Length(XMLoadFloat3(&meshBounds.Extents))), 0.001f);
+				instance.Slice = (unsigned int)slice;
+				instance.Fade = min((distance - impostorDistance) / impostorFadeRange, 1.0f);
+				impostorInstances.push_back(instance);
+
+				if (instance.Fade >= 1.0f)
+					continue;
+				impostorStats.Fading++;
+			}
+		}
+
+		unsigned int lod = min((unsigned int)entityLods[sceneIndex], ge->GetMesh()->GetLodCount() - 1);
+		unsigned int lightList = perEntityLightsActive ? entityLightLists.GetList((unsigned int)v) : ENTITY_LIGHT_LIST_NONE;
+		RenderQueue& queue = deferredShadingActive && !ge->GetMaterial()->GetGBufferPS() ? forwardQueue : renderQueue;
+		queue.Add(ge, camera->GetView(), camera->GetFarClip(), RenderPass::Opaque, lod, lightList);
+		visibleLodCounts[lod]++;
+	}
+	renderQueue.Sort();
+	forwardQueue.Sort();
+
+	// The projectiles on screen, as one batch
+	if (projectiles)
+	{
+		projectileInstances.clear();
+		projectiles->BuildInstances(camera->GetViewConstants().FrustumPlanes, projectileInstances);
+		RenderQueue& queue = deferredShadingActive && !projectiles->GetMaterial()->GetGBufferPS() ? forwardQueue : renderQueue;
+		queue.AddInstances(projectiles->GetMesh(), projectiles->GetMaterial(), projectileInstances.data(), (unsigned int)projectileInstances.size());
+	}
+	SimpleVertexShader* instancedVS = Assets::GetInstance().GetVertexShader("VertexShaderInstanced.cso"_asset);
+
+	// Depth pre-pass, if it's worth it this frame
+	estimatedDepthComplexity = EstimateDepthComplexity(camera);
+	depthPrepassActive =
+		depthPrepassMode == DepthPrepassMode::On ||
+		(depthPrepassMode == DepthPrepassMode::Auto && estimatedDepthComplexity > depthPrepassThreshold);
+
+	if (depthPrepassActive)
+	{
+		// Same sorted queue and vertex shaders (and so the same instanced
+		// batches) as the scene pass, so the depths match exactly
+		scenePass.SetRenderTargets(0, 0, depthBufferDSV.Get());
+		states.Apply(passContext, scenePass);
+		depthPrepassStats = {};
+		if (gpuDrivenCulling)
+		{
+			// (The queue only has the projectiles)
+			gpuCulling.DrawDepthOnly(passContext, instancedVS);
+			renderQueue.SubmitDepthOnly(passContext, 0, instancedVS);
+		}
+		else
+		{
+			renderQueue.SubmitDepthOnly(passContext, 0, instancedVS);
+			depthPrepassStats = renderQueue.GetStats();
+			forwardQueue.SubmitDepthOnly(passContext, 0, instancedVS);
+			depthPrepassStats.Accumulate(forwardQueue.GetStats());
+		}
+		scenePass.DepthStencil = depthEqualState.Get();
+	}
+	else
+	{
+		depthPrepassStats = {};
+	}
+
+	// Depth isn't a render target - SSAO reads the depth buffer itself
+	//  - The motion vectors go after the rest, only with temporal upsampling
+	ID3D11RenderTargetView* renderTargets[3] = {};
+	renderTargets[0] = sceneColorsRTV.Get();
+	renderTargets[1] = sceneNormalsRTV.Get();
+	renderTargets[2] = motionVectorsRTV.Get();
+	unsigned int motionTargets = motionVectorsRTV ? 1 : 0;
+
+	if (deferredShadingActive)
+	{
+		// Surfaces into the G-buffer, lit all at once, then
+		// the forward entities over the result
+		ID3D11RenderTargetView* gbufferTargets[4] = { sceneAlbedoRTV.Get(), sceneNormalsRTV.Get(), sceneSurfaceRTV.Get(), motionVectorsRTV.Get() };
+		scenePass.SetRenderTargets(3 + motionTargets, gbufferTargets, depthBufferDSV.Get());
+		states.Apply(passContext, scenePass);
+		renderQueue.Submit(passContext, instancedVS, true);
+
+		LightGBuffer(passContext, camera, frameSRVs, shadowSamplers);
+
+		scenePass.SetRenderTargets(2 + motionTargets, renderTargets, depthBufferDSV.Get());
+		states.Apply(passContext, scenePass);
+		forwardQueue.Submit(passContext, instancedVS);
+	}
+	else
+	{
+		scenePass.SetRenderTargets(2 + motionTargets, renderTargets, depthBufferDSV.Get());
+		states.Apply(passContext, scenePass);
+
+		// Draw all of the entities (the queue is empty with GPU driven
+		// culling, which just leaves its stats zeroed)
+		renderQueue.Submit(passContext, instancedVS);
+		if (gpuDrivenCulling)
+			gpuCulling.Draw(passContext, instancedVS);
+	}
+	scenePass.DepthStencil = 0;
+	states.Apply(passContext, scenePass);
+
+	// Draw the light sources
+	DrawPointLights(passContext, camera, lightCount, lightVS, lightPS, lightMesh);
+
+	// Draw the sky
+	sky->Draw(passContext, camera);
+
+	// Then the impostors, which can blend over it
+	DrawImpostors(passContext, camera, scenePass);
+}
+
+// --------------------------------------------------------------------------
+// Lights the deferred G-buffer into the scene colors, with the same per
+// frame resources the lit pixel shaders get (at the same slots)
+//  - Renders nothing to the G-buffer's targets, which are unbound
+//    while it reads them
+// --------------------------------------------------------------------------
+void Renderer::LightGBuffer(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, ID3D11ShaderResourceView* frameSRVs[12], ID3D11SamplerState* shadowSamplers[2])
+{
+	PROFILE_SCOPE("Renderer::LightGBuffer");
+	StateCache::GetInstance().Apply(passContext, PassState());
+
+	const ViewConstants& viewConstants = camera->GetViewConstants();
+
+	SimpleComputeShader* cs = Assets::GetInstance().GetComputeShader("DeferredLightingCS.cso"_asset);
+	cs->SetShader();
+	cs->SetMatrix4x4("invViewProjection", viewConstants.InvViewProjection);
+	cs->SetMatrix4x4("view", viewConstants.View);
+	cs->SetFloat2("renderSize", XMFLOAT2((float)renderWidth, (float)renderHeight));
+	cs->CopyBufferData("externalData");
+	cs->SetShaderResourceView("Albedo", sceneAlbedoSRV);
+	cs->SetShaderResourceView("Normals", sceneNormalsSRV);
+	cs->SetShaderResourceView("Surface", sceneSurfaceSRV);
+	cs->SetShaderResourceView("Depths", depthBufferSRV);
+	cs->SetSamplerState("BasicSampler", postProcessClampSampler);
+	cs->SetSamplerState("ClampSampler", postProcessClampSampler);
+	cs->SetUnorderedAccessView("SceneColors", sceneColorsUAV);
+	passContext->CSSetShaderResources(4, 12, frameSRVs);
+	passContext->CSSetSamplers(2, 2, shadowSamplers);
+
+	cs->DispatchByGroups((renderWidth + 7) / 8, (renderHeight + 7) / 8, 1);
+
+	ID3D11UnorderedAccessView* nullUAVs[1] = {};
 	ID3D11ShaderResourceView* nullSRVs[16] = {};
-	context->PSSetShaderResources(0, 16, nullSRVs);
+	passContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, 0);
+	passContext->CSSetShaderResources(0, 16, nullSRVs);
+	ISimpleShader::InvalidateStateCache(passContext);
+}
+
+// --------------------------------------------------------------------------
+// Additive particles over the final image
+// --------------------------------------------------------------------------
+void Renderer::RenderParticles(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, float totalTime)
+{
+	PROFILE_SCOPE("Renderer::RenderParticles");
+	DRAW_STATS_PASS("Particles");
+	passContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// Anything could have been bound since the last pass
+	StateCache& states = StateCache::GetInstance();
+	states.Invalidate(passContext);
+
+	// Into the scaled scene colors with dynamic resolution, since
+	// that's the only place the depth buffer lines up with
+	ID3D11RenderTargetView* target = ReducedResolution() ? sceneColorsRTV.Get() : backBufferRTV.Get();
+	PassState particlePass;
+	if (ReducedResolution())
+		particlePass.SetViewport((float)renderWidth, (float)renderHeight);
+	else
+		particlePass.SetViewport((float)windowWidth, (float)windowHeight);
+	particlePass.SetRenderTargets(1, &target, depthBufferDSV.Get());
+	particlePass.DepthStencil = particleDepthState.Get();
+
+	ID3D11BlendState* additiveBlend = ReducedResolution() ? particleBlendSceneColors.Get() : particleBlendAdditive.Get();
+	ID3D11BlendState* premultipliedBlend = ReducedResolution() ? particleBlendPremultipliedSceneColors.Get() : particleBlendPremultiplied.Get();
+	DrawEmitters(passContext, particlePass, camera, totalTime, false, additiveBlend, premultipliedBlend);
+	if (particleResolutionScale > 1)
+		RenderLowResolutionParticles(passContext, particlePass, camera, totalTime, target);
+	else
+		DrawEmitters(passContext, particlePass, camera, totalTime, true, additiveBlend, premultipliedBlend);
+
+	particlePass.Blend = 0;
+	particlePass.DepthStencil = 0;
+	states.Apply(passContext, particlePass);
+}
+
+// --------------------------------------------------------------------------
+// Draws the emitters that do (or don't) want low resolution, with the
+// additive ones first, since their order doesn't matter, then the alpha
+// blended ones over them
+//  - Each sorted emitter is only sorted on its own, not against others
+// --------------------------------------------------------------------------
+void Renderer::DrawEmitters(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, PassState& particlePass, Camera* camera, float totalTime, bool lowResolution, ID3D11BlendState* additiveBlend, ID3D11BlendState* premultipliedBlend)
+{
+	StateCache& states = StateCache::GetInstance();
+	particlePass.Blend = additiveBlend;
+	states.Apply(passContext, particlePass);
+	if (batchedParticles)
+	{
+		// Anything that can't be batched draws itself
+		particleBatcher.Draw(passContext, camera, totalTime, lowResolution);
+		for (auto& e : emitters)
+		{
+			if (e->IsLowResolution() == lowResolution && !e->IsBatchable() && !e->IsDepthSorted())
+				e->Draw(passContext, camera, totalTime);
+		}
+	}
+	else
+	{
+		for (auto& e : emitters)
+		{
+			if (e->IsLowResolution() == lowResolution && !e->IsDepthSorted())
+				e->Draw(passContext, camera, totalTime);
+		}
+	}
+
+	particlePass.Blend = premultipliedBlend;
+	states.Apply(passContext, particlePass);
+	for (auto& e : emitters)
+	{
+		if (e->IsLowResolution() == lowResolution && e->IsDepthSorted())
+			e->Draw(passContext, camera, totalTime);
+	}
+}
+
+// --------------------------------------------------------------------------
+// Shrinks the depth buffer, draws the low resolution emitters against it,
+// and composites them over the target the rest of the particles went to
+// --------------------------------------------------------------------------
+void Renderer::RenderLowResolutionParticles(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, PassState& particlePass, Camera* camera, float totalTime, ID3D11RenderTargetView* target)
+{
+	Assets& assets = Assets::GetInstance();
+	StateCache& states = StateCache::GetInstance();
+	unsigned int fullWidth = ReducedResolution() ? renderWidth : windowWidth;
+	unsigned int fullHeight = ReducedResolution() ? renderHeight : windowHeight;
+	unsigned int lowWidth = max(1u, fullWidth / particleResolutionScale);
+	unsigned int lowHeight = max(1u, fullHeight / particleResolutionScale);
+
+	// Closest depth of each block
+	PassState lowResPass;
+	lowResPass.SetViewport((float)lowWidth, (float)lowHeight);
+	lowResPass.SetRenderTargets(0, 0, particleDepthDSV.Get());
+	lowResPass.DepthStencil = depthWriteAlwaysState.Get();
+	states.Apply(passContext, lowResPass);
+	assets.GetVertexShader("FullscreenVS.cso"_asset)->SetShader();
+	SimplePixelShader* downsamplePS = assets.GetPixelShader("ParticleDepthDownsamplePS.cso"_asset);
+	downsamplePS->SetShader();
+	downsamplePS->SetShaderResourceView("Depths", depthBufferSRV);
+	downsamplePS->SetInt("downscale", particleResolutionScale);
+	downsamplePS->CopyAllBufferData();
+	passContext->Draw(3, 0);
+	DrawStats::Count(DrawCounter::Draws);
+
+	// The particles, tested against it
+	const float clear[4] = { 0, 0, 0, 0 };
+	ID3D11ShaderResourceView* nullSRV = 0;
+	passContext->PSSetShaderResources(0, 1, &nullSRV);
+	passContext->ClearRenderTargetView(particleColorsRTV.Get(), clear);
+	lowResPass.SetRenderTargets(1, particleColorsRTV.GetAddressOf(), particleDepthDSV.Get());
+	lowResPass.DepthStencil = particleDepthState.Get();
+	ISimpleShader::InvalidateStateCache(passContext);
+	DrawEmitters(passContext, lowResPass, camera, totalTime, true, particleBlendLowResAdditive.Get(), particleBlendPremultiplied.Get());
+
+	// Back up to full resolution, over everything else
+	PassState compositePass = particlePass;
+	compositePass.SetRenderTargets(1, &target, 0);
+	compositePass.DepthStencil = 0;
+	compositePass.Blend = ReducedResolution() ? particleBlendPremultipliedSceneColors.Get() : particleBlendPremultiplied.Get();
+	states.Apply(passContext, compositePass);
+
+	XMFLOAT4X4 proj = camera->GetProjection();
+	assets.GetVertexShader("FullscreenVS.cso"_asset)->SetShader();
+	SimplePixelShader* compositePS = assets.GetPixelShader("ParticleCompositePS.cso"_asset);
+	compositePS->SetShader();
+	compositePS->SetShaderResourceView("ParticleColors", particleColorsSRV);
+	compositePS->SetShaderResourceView("ParticleDepths", particleDepthSRV);
+	compositePS->SetShaderResourceView("Depths", depthBufferSRV);
+	compositePS->SetFloat2("particleSize", XMFLOAT2((float)lowWidth, (float)lowHeight));
+	compositePS->SetInt("downscale", particleResolutionScale);
+	compositePS->SetFloat2("depthParams", XMFLOAT2(proj._33, proj._43));
+	compositePS->SetFloat("depthThreshold", particleCompositeDepthThreshold);
+	compositePS->CopyAllBufferData();
+	passContext->Draw(3, 0);
+	DrawStats::Count(DrawCounter::Draws);
+
+	// The depth buffer's bound again right after
+	ID3D11ShaderResourceView* nullSRVs[3] = {};
+	passContext->PSSetShaderResources(0, 3, nullSRVs);
+	ISimpleShader::InvalidateStateCache(passContext);
+}
+
+// --------------------------------------------------------------------------
+// Worker side of multithreaded recording: each pass is drawn into its own
+// deferred context, with SimpleShader redirected there for this thread
+// --------------------------------------------------------------------------
+void Renderer::RecordShadowPass(Camera* camera)
+{
+	ISimpleShader::SetThreadContext(shadowContext);
+	RenderShadowMap(shadowContext, camera);
+	ISimpleShader::SetThreadContext(0);
+	shadowContext->FinishCommandList(FALSE, shadowCommandList.ReleaseAndGetAddressOf());
+	ISimpleShader::InvalidateStateCache(shadowContext);
+}
+
+void Renderer::RecordScenePass(Camera* camera, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh)
+{
+	ISimpleShader::SetThreadContext(sceneContext);
+	RenderScene(sceneContext, camera, lightCount, lightVS, lightPS, lightMesh);
+	ISimpleShader::SetThreadContext(0);
+	sceneContext->FinishCommandList(FALSE, sceneCommandList.ReleaseAndGetAddressOf());
+	ISimpleShader::InvalidateStateCache(sceneContext);
+}
+
+void Renderer::RecordParticlePass(Camera* camera, float totalTime)
+{
+	ISimpleShader::SetThreadContext(particleContext);
+	RenderParticles(particleContext, camera, totalTime);
+	ISimpleShader::SetThreadContext(0);
+	particleContext->FinishCommandList(FALSE, particleCommandList.ReleaseAndGetAddressOf());
+	ISimpleShader::InvalidateStateCache(particleContext);
+}
+
+void Renderer::SetWindowViewport(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext)
+{
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)windowWidth;
+	viewport.Height = (float)windowHeight;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	passContext->RSSetViewports(1, &viewport);
+}
+
+void Renderer::DrawParticlePass(Camera* camera, float totalTime)
+{
+	if (multithreadedRecording)
+	{
+		context->ExecuteCommandList(particleCommandList.Get(), TRUE);
+		particleCommandList.Reset();
+	}
+	else
+	{
+		RenderParticles(context, camera, totalTime);
+	}
+	EndPass("Particles");
+}
+
+void Renderer::EndPass(const char* name)
+{
+	gpuProfiler.Timestamp(name);
+	DrawStats::GetInstance().EndPass(name);
+}
+
+// --------------------------------------------------------------------------
+// Redraws whichever debug thumbnails are due, straight from this frame's
+// targets (and the shadow cascades), then puts the back buffer back
+// --------------------------------------------------------------------------
+void Renderer::UpdateDebugViews(Camera* camera, XMFLOAT2 ssaoUVScale)
+{
+	XMFLOAT4X4 proj = camera->GetProjection();
+	XMFLOAT2 sceneUVScale((float)renderWidth / windowWidth, (float)renderHeight / windowHeight);
+	float windowAspect = (float)windowWidth / windowHeight;
+
+	DebugViewInputs inputs = {};
+	inputs.Sources[(int)DebugViewSource::ShadowMap] = shadowDepthSRV.Get();
+	inputs.Sources[(int)DebugViewSource::SSAO] = GetSSAO().Get();
+	inputs.Sources[(int)DebugViewSource::SceneColors] = sceneColorsSRV.Get();
+	inputs.Sources[(int)DebugViewSource::SceneAmbient] = sceneColorsSRV.Get();
+	inputs.Sources[(int)DebugViewSource::SceneNormals] = sceneNormalsSRV.Get();
+	inputs.Sources[(int)DebugViewSource::SceneDepth] = depthBufferSRV.Get();
+	inputs.Sources[(int)DebugViewSource::ShadowAtlas] = shadowAtlas.GetSRV().Get();
+	inputs.Sources[(int)DebugViewSource::SceneAlbedo] = sceneAlbedoSRV.Get();
+	inputs.Sources[(int)DebugViewSource::SceneSurface] = sceneSurfaceSRV.Get();
+	for (int i = 0; i < (int)DebugViewSource::Count; i++)
+	{
+		inputs.SourceUVScales[i] = sceneUVScale;
+		inputs.SourceAspects[i] = windowAspect;
+	}
+	inputs.SourceUVScales[(int)DebugViewSource::ShadowMap] = XMFLOAT2(1, 1);
+	inputs.SourceAspects[(int)DebugViewSource::ShadowMap] = 1.0f;
+	inputs.SourceUVScales[(int)DebugViewSource::ShadowAtlas] = XMFLOAT2(1, 1);
+	inputs.SourceAspects[(int)DebugViewSource::ShadowAtlas] = 1.0f;
+	inputs.SourceUVScales[(int)DebugViewSource::SSAO] = ssaoUVScale;
+	inputs.DepthParams = XMFLOAT2(proj._33, proj._43);
+	inputs.ShadowCascade = shadowDebugCascade;
+
+	if (!debugViews.Update(inputs))
+		return;
+
+	SetWindowViewport(context);
+	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+	EndPass("Debug Views");
+}
+
+// --------------------------------------------------------------------------
+// Nudges the render scale towards whatever should bring the GPU frame
+// time to the target.  Cost is roughly proportional to the pixel count,
+// so the scale moves with the square root of the time ratio.
+// --------------------------------------------------------------------------
+void Renderer::UpdateDynamicResolution()
+{
+	float frameMs = gpuProfiler.GetFrameMs();
+	if (!dynamicResolution)
+	{
+		renderScale = temporalUpsampling ? temporalUpsamplingScale : 1.0f;
+	}
+	else if (frameMs > 0.0f)
+	{
+		// A small dead band keeps it from hunting around the target
+		float ratio = dynamicResolutionTargetMs / frameMs;
+		if (ratio < 0.95f || ratio > 1.05f)
+		{
+			float step = renderScale * sqrtf(ratio) - renderScale;
+			renderScale += max(-0.05f, min(step, 0.02f));
+		}
+		renderScale = max(minRenderScale, min(renderScale, maxRenderScale));
+	}
+
+	renderWidth = max(1u, (unsigned int)(windowWidth * renderScale));
+	renderHeight = max(1u, (unsigned int)(windowHeight * renderScale));
+}
+
+// The index'th point of the Halton sequence in the given base, in [0, 1)
+static float Halton(unsigned int index, unsigned int base)
+{
+	float result = 0.0f;
+	float fraction = 1.0f;
+	while (index > 0)
+	{
+		fraction /= base;
+		result += fraction * (index % base);
+		index /= base;
+	}
+	return result;
+}
+
+// --------------------------------------------------------------------------
+// Moves the camera's projection on to the next sub-pixel offset for
+// temporal upsampling, or puts it back in the middle when it's off
+// --------------------------------------------------------------------------
+void Renderer::UpdateJitter(Camera* camera)
+{
+	if (!temporalUpsampling)
+	{
+		jitterPixels = XMFLOAT2(0, 0);
+		camera->SetJitter(0, 0);
+		return;
+	}
+
+	// From 1, since the sequence's first point is 0 (a pixel's corner)
+	jitterIndex = jitterIndex % TEMPORAL_UPSAMPLING_JITTER_SAMPLES + 1;
+	jitterPixels = XMFLOAT2(Halton(jitterIndex, 2) - 0.5f, Halton(jitterIndex, 3) - 0.5f);
+
+	// Render pixels to NDC, where y points up
+	camera->SetJitter(jitterPixels.x * 2.0f / renderWidth, -jitterPixels.y * 2.0f / renderHeight);
+}
+
+// --------------------------------------------------------------------------
+// Builds the full resolution frame from this frame's (smaller, jittered)
+// combine and last frame's result, into the back buffer and the history
+// --------------------------------------------------------------------------
+void Renderer::TemporalUpsample(Camera* camera, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depths)
+{
+	Assets& assets = Assets::GetInstance();
+
+	// For the sky, which doesn't write motion: from this frame's NDCs back
+	// to world space, then into last frame's clip space, both unjittered
+	const ViewConstants& viewConstants = camera->GetViewConstants();
+	XMFLOAT4X4 reprojection;
+	XMStoreFloat4x4(&reprojection,
+		XMMatrixTranslation(viewConstants.Jitter.x, viewConstants.Jitter.y, 0) *
+		XMLoadFloat4x4(&viewConstants.InvViewProjection) *
+		XMLoadFloat4x4(&viewConstants.PrevViewProjection) *
+		XMMatrixTranslation(-viewConstants.PrevJitter.x, -viewConstants.PrevJitter.y, 0));
+
+	ID3D11RenderTargetView* targets[2] = { backBufferRTV.Get(), taaHistoryRTV[taaHistoryIndex].Get() };
+	context->OMSetRenderTargets(2, targets, 0);
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)windowWidth;
+	viewport.Height = (float)windowHeight;
+	viewport.MaxDepth = 1.0f;
+	context->RSSetViewports(1, &viewport);
 
+	assets.GetVertexShader("FullscreenVS.cso"_asset)->SetShader();
+	SimplePixelShader* ps = assets.GetPixelShader("TemporalUpsamplePS.cso"_asset);
+	ps->SetShader();
+	ps->SetMatrix4x4("reprojection", reprojection);
+	ps->SetFloat2("renderSize", XMFLOAT2((float)renderWidth, (float)renderHeight));
+	ps->SetFloat2("jitterPixels", jitterPixels);
+	ps->SetInt("historyValid", taaHistoryValid);
+	ps->CopyAllBufferData();
+	ps->SetShaderResourceView("Current", taaInputSRV);
+	ps->SetShaderResourceView("Motion", motionVectorsSRV);
+	ps->SetShaderResourceView("Depths", depths);
+	ps->SetShaderResourceView("History", taaHistorySRV[1 - taaHistoryIndex]);
+	ps->SetSamplerState("ClampSampler", postProcessClampSampler);
+	context->Draw(3, 0);
+	DrawStats::Count(DrawCounter::Draws);
+
+	// The depth buffer is still to be bound for the particles
+	ID3D11ShaderResourceView* nullSRVs[4] = {};
+	context->PSSetShaderResources(0, 4, nullSRVs);
+	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+	ISimpleShader::InvalidateStateCache(context);
+	EndPass("Temporal Upsample");
+
+	// This frame's output is next frame's history
+	taaHistoryIndex = 1 - taaHistoryIndex;
+	taaHistoryValid = true;
 }
 
-void Renderer::DrawPointLights(Camera* camera, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh)
+void Renderer::DrawPointLights(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh)
 {
+	if (instancedLightGizmos)
+	{
+		DrawPointLightsInstanced(passContext, camera, lightCount, lightMesh);
+		return;
+	}
+
 	// Turn on these shaders
+	lightVS = Assets::GetInstance().GetVertexShaderFor(lightVS, lightMesh);
 	lightVS->SetShader();
 	lightPS->SetShader();
 
@@ -315,8 +1461,141 @@ void Renderer::DrawPointLights(Camera* camera, int lightCount, SimpleVertexShade
 		lightPS->CopyAllBufferData();
 
 		// Draw
-		lightMesh->SetBuffersAndDraw(context);
+		lightMesh->SetBuffersAndDraw(passContext);
+	}
+}
+
+// --------------------------------------------------------------------------
+// Same gizmos as above, but with every point light's transform and color
+// written to a structured buffer and drawn with a single instanced draw
+// --------------------------------------------------------------------------
+void Renderer::DrawPointLightsInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, int lightCount, Mesh* lightMesh)
+{
+	// Only the gizmos that could be on screen, tested with the light's
+	// range (which the gizmo is well inside of)
+	const ViewConstants& cameraView = camera->GetViewConstants();
+	BoundingFrustum cameraFrustum(XMLoadFloat4x4(&cameraView.Projection));
+	cameraFrustum.Transform(cameraFrustum, XMLoadFloat4x4(&cameraView.InvView));
+	const std::vector<BoundingSphere>& lightBounds = lightManager.GetBounds();
+
+	lightGizmos.clear();
+	for (int i = 0; i < lightCount && lightGizmos.size() < MAX_LIGHTS; i++)
+	{
+		const Light& light = lights[i];
+		if (light.Type != LIGHT_TYPE_POINT || !cameraFrustum.Intersects(lightBounds[i]))
+			continue;
+
+		// Same scale and color as the non-instanced version
+		LightGizmo gizmo = {};
+		gizmo.Position = light.Position;
+		gizmo.Scale = light.Range / 10.0f;
+		gizmo.Color = XMFLOAT3(
+			light.Color.x * light.Intensity,
+			light.Color.y * light.Intensity,
+			light.Color.z * light.Intensity);
+		lightGizmos.push_back(gizmo);
+	}
+
+	if (lightGizmos.empty())
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	passContext->Map(lightGizmoBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	DrawStats::Count(DrawCounter::Maps);
+	memcpy(mapped.pData, lightGizmos.data(), sizeof(LightGizmo) * lightGizmos.size());
+	passContext->Unmap(lightGizmoBuffer.Get(), 0);
+
+	Assets& assets = Assets::GetInstance();
+	SimpleVertexShader* vs = assets.GetVertexShaderFor(assets.GetVertexShader("LightGizmoVS.cso"_asset), lightMesh);
+	vs->SetShader();
+	vs->SetShaderResourceView("Gizmos", lightGizmoSRV);
+	assets.GetPixelShader("LightGizmoPS.cso"_asset)->SetShader();
+
+	lightMesh->SetBuffers(passContext);
+	lightMesh->DrawInstanced(passContext, (unsigned int)lightGizmos.size(), 0);
+
+	// Don't leave the buffer bound to the vertex shader
+	ID3D11ShaderResourceView* nullSRV[1] = {};
+	passContext->VSSetShaderResources(0, 1, nullSRV);
+	ISimpleShader::InvalidateStateCache(passContext);
+}
+
+// Which of the fade steps an impostor is drawn in (the last is opaque)
+static unsigned int ImpostorFadeStep(float fade)
+{
+	return min((unsigned int)(fade * IMPOSTOR_FADE_STEPS), (unsigned int)IMPOSTOR_FADE_STEPS);
+}
+
+// --------------------------------------------------------------------------
+// Draws the impostors the scene pass picked, with no vertex buffers (six
+// vertices each, from the instance buffer), into the scene's targets
+//  - The fully faded in ones go first, as one draw, then those still
+//    fading, a draw per step with its own blend factor
+// --------------------------------------------------------------------------
+void Renderer::DrawImpostors(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, PassState& scenePass)
+{
+	impostorStats.Impostors = (unsigned int)impostorInstances.size();
+	impostorStats.Baked = impostorAtlas.GetBakedCount();
+	impostorStats.Queued = impostorAtlas.GetQueuedCount();
+	if (impostorInstances.empty())
+		return;
+
+	std::sort(impostorInstances.begin(), impostorInstances.end(),
+		[](const ImpostorInstance& a, const ImpostorInstance& b) { return a.Fade > b.Fade; });
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	passContext->Map(impostorBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	DrawStats::Count(DrawCounter::Maps);
+	memcpy(mapped.pData, impostorInstances.data(), sizeof(ImpostorInstance) * impostorInstances.size());
+	passContext->Unmap(impostorBuffer.Get(), 0);
+
+	const ViewConstants& viewConstants = camera->GetViewConstants();
+	Assets& assets = Assets::GetInstance();
+	SimpleVertexShader* vs = assets.GetVertexShader("ImpostorVS.cso"_asset);
+	SimplePixelShader* ps = assets.GetPixelShader("ImpostorPS.cso"_asset);
+	vs->SetShader();
+	vs->SetShaderResourceView("Instances", impostorSRV);
+	ps->SetShader();
+	ps->SetMatrix4x4("viewProjection", viewConstants.ViewProjection);
+	ps->SetMatrix4x4("view", viewConstants.View);
+	ps->SetMatrix4x4("prevViewProjection", viewConstants.PrevViewProjection);
+	ps->SetFloat2("jitter", viewConstants.Jitter);
+	ps->SetFloat2("prevJitter", viewConstants.PrevJitter);
+	ps->SetFloat2("atlasSize", XMFLOAT2((float)IMPOSTOR_SLICE_SIZE, (float)IMPOSTOR_SLICE_SIZE));
+	ps->CopyBufferData("externalData");
+	ps->SetShaderResourceView("Albedo", impostorAtlas.GetAlbedoSRV());
+	ps->SetShaderResourceView("Normals", impostorAtlas.GetNormalsSRV());
+	ps->SetShaderResourceView("Surface", impostorAtlas.GetSurfaceSRV());
+	ps->SetShaderResourceView("Depths", impostorAtlas.GetDepthSRV());
+	ps->SetSamplerState("BasicSampler", postProcessClampSampler);
+	ps->SetSamplerState("ClampSampler", postProcessClampSampler);
+
+	StateCache& states = StateCache::GetInstance();
+	unsigned int count = (unsigned int)impostorInstances.size();
+	for (unsigned int i = 0; i < count;)
+	{
+		unsigned int step = ImpostorFadeStep(impostorInstances[i].Fade);
+		unsigned int end = i + 1;
+		while (end < count && ImpostorFadeStep(impostorInstances[end].Fade) == step)
+			end++;
+
+		float factor = step < IMPOSTOR_FADE_STEPS ? (step + 0.5f) / IMPOSTOR_FADE_STEPS : 1.0f;
+		scenePass.Blend = step < IMPOSTOR_FADE_STEPS ? impostorBlend.Get() : 0;
+		scenePass.BlendFactor[0] = scenePass.BlendFactor[1] = scenePass.BlendFactor[2] = scenePass.BlendFactor[3] = factor;
+		states.Apply(passContext, scenePass);
+		passContext->Draw((end - i) * 6, i * 6);
+		impostorStats.Draws++;
+		i = end;
 	}
+	scenePass.Blend = 0;
+	scenePass.BlendFactor[0] = scenePass.BlendFactor[1] = scenePass.BlendFactor[2] = scenePass.BlendFactor[3] = 1.0f;
+	states.Apply(passContext, scenePass);
+
+	// Don't leave the atlas bound, since it's a target while baking
+	ID3D11ShaderResourceView* nullSRVs[4] = {};
+	passContext->VSSetShaderResources(0, 1, nullSRVs);
+	passContext->PSSetShaderResources(0, 4, nullSRVs);
+	ISimpleShader::InvalidateStateCache(passContext);
 }
 
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Renderer::GetSceneColorsSRV()
@@ -329,89 +1608,1226 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Renderer::GetSceneNormalsSRV()
 	return sceneNormalsSRV;
 }
 
-Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Renderer::GetSceneAmbientSRV()
-{
-	return sceneAmbientSRV;
-}
-
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Renderer::GetSceneDepthSRV()
 {
-	return sceneDepthSRV;
+	return depthBufferSRV;
 }
 
+// The fused combine never writes the blurred SSAO out, so this
+// is the last thing it went into instead
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Renderer::GetSSAO()
 {
-	return ssaoBlurSRV;
+	if (!fusedSSAOCombine)
+		return ssaoBlurSRV;
+	return temporalSSAO ? ssaoHistorySRV[1 - ssaoHistoryIndex] : ssaoResultSRV;
 }
 
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Renderer::GetShadowSRV()
 {
+	// Every cascade, as an array (see GetDebugViews() for showing one)
 	return shadowDepthSRV;
 }
 
-void Renderer::CreateGenericRenderTarget(unsigned int width, unsigned int height, Microsoft::WRL::ComPtr<ID3D11RenderTargetView>& rtv, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv, DXGI_FORMAT colorFormat)
+const RenderQueueStats& Renderer::GetRenderQueueStats()
 {
+	return renderQueue.GetStats();
+}
 
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> rtTexture;
-
-	D3D11_TEXTURE2D_DESC textDesc = {};
+const RenderQueueStats& Renderer::GetShadowQueueStats()
+{
+	// Totalled over every cascade
+	return shadowQueueStats;
+}
 
-	textDesc.Width = width;
-	textDesc.Height = height;
-	textDesc.ArraySize = 1;
-	textDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	textDesc.Format = colorFormat;
-	textDesc.MipLevels = 1;
-	textDesc.MiscFlags = 0;
-	textDesc.SampleDesc.Count = 1;
-	device->CreateTexture2D(&textDesc, 0, rtTexture.GetAddressOf());
+const CullingStats& Renderer::GetCameraCullingStats()
+{
+	return cameraCullingStats;
+}
 
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+const CullingStats& Renderer::GetShadowCullingStats(int cascade)
+{
+	return shadowCascades[cascade].Culling;
+}
 
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-	rtvDesc.Texture2D.MipSlice = 0;
-	rtvDesc.Format = textDesc.Format;
-	device->CreateRenderTargetView(rtTexture.Get(), &rtvDesc, rtv.GetAddressOf());
+const CullingStats& Renderer::GetStaticShadowCullingStats(int cascade)
+{
+	return shadowCascades[cascade].StaticCulling;
+}
 
-	device->CreateShaderResourceView(rtTexture.Get(), 0, srv.GetAddressOf());
+int Renderer::GetShadowCascadeCount()
+{
+	return shadowCascadeCount;
+}
 
+void Renderer::SetShadowCascadeCount(int count)
+{
+	count = max(1, min(count, MAX_SHADOW_CASCADES));
+	if (count == shadowCascadeCount)
+		return;
 
+	shadowCascadeCount = count;
+	shadowDebugCascade = min(shadowDebugCascade, shadowCascadeCount - 1);
+	CreateShadowMap();
 }
 
-void Renderer::CreateShadowMap()
+int Renderer::GetShadowMapSize()
 {
-	
-	shadowDepthSRV.Reset();
-	shadowDepthDSV.Reset();
+	return shadowMapSize;
+}
 
-	D3D11_TEXTURE2D_DESC shadowDesc = {};
-	shadowDesc.Width = shadowMapSize;
-	shadowDesc.Height = shadowMapSize;
-	shadowDesc.ArraySize = 1;
-	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
-	shadowDesc.CPUAccessFlags = 0;
-	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-	shadowDesc.MipLevels = 1;
-	shadowDesc.MiscFlags = 0;
-	shadowDesc.SampleDesc.Count = 1;
-	shadowDesc.SampleDesc.Quality = 0;
-	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
-	device->CreateTexture2D(&shadowDesc, 0, shadowTexture.GetAddressOf());
+void Renderer::SetShadowMapSize(int size)
+{
+	if (size == shadowMapSize)
+		return;
 
-	D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
-	shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	shadowDSDesc.Texture2D.MipSlice = 0;
-	device->CreateDepthStencilView(shadowTexture.Get(), &shadowDSDesc, shadowDepthDSV.GetAddressOf());
+	shadowMapSize = size;
+	CreateShadowMap();
+}
+
+int Renderer::GetShadowDebugCascade()
+{
+	return shadowDebugCascade;
+}
+
+void Renderer::SetShadowDebugCascade(int cascade)
+{
+	shadowDebugCascade = max(0, min(cascade, shadowCascadeCount - 1));
+	debugViews.Invalidate();
+}
+
+ShadowFilter Renderer::GetShadowFilter()
+{
+	return shadowFilter;
+}
+
+void Renderer::SetShadowFilter(ShadowFilter filter)
+{
+	if (filter == shadowFilter)
+		return;
+
+	shadowFilter = filter;
+	CreateShadowMoments();
+}
+
+int Renderer::GetEVSMBlurRadius()
+{
+	return evsmBlurRadius;
+}
+
+void Renderer::SetEVSMBlurRadius(int radius)
+{
+	evsmBlurRadius = max(0, min(radius, EVSM_MAX_BLUR_RADIUS));
+}
+
+float Renderer::GetEVSMBleedReduction()
+{
+	return evsmBleedReduction;
+}
+
+void Renderer::SetEVSMBleedReduction(float reduction)
+{
+	evsmBleedReduction = max(0.0f, min(reduction, 0.95f));
+}
+
+bool Renderer::GetOcclusionCulling()
+{
+	return occlusionCulling;
+}
+
+void Renderer::SetOcclusionCulling(bool enabled)
+{
+	// Start over rather than use a pyramid from whenever it was last on
+	if (enabled && !occlusionCulling)
+		hiZBuffer.Resize(windowWidth, windowHeight);
+
+	occlusionCulling = enabled;
+}
+
+bool Renderer::GetOcclusionCullShadows()
+{
+	return occlusionCullShadows;
+}
+
+void Renderer::SetOcclusionCullShadows(bool enabled)
+{
+	occlusionCullShadows = enabled;
+}
+
+bool Renderer::GetMeshLods()
+{
+	return meshLods;
+}
+
+void Renderer::SetMeshLods(bool enabled)
+{
+	meshLods = enabled;
+}
+
+float Renderer::GetLodScale()
+{
+	return lodScale;
+}
+
+void Renderer::SetLodScale(float scale)
+{
+	lodScale = max(0.01f, scale);
+}
+
+unsigned int Renderer::GetShadowLodBias()
+{
+	return shadowLodBias;
+}
+
+void Renderer::SetShadowLodBias(unsigned int bias)
+{
+	shadowLodBias = min(bias, (unsigned int)MESH_MAX_LODS - 1);
+}
+
+unsigned int Renderer::GetVisibleLodCount(unsigned int lod)
+{
+	return lod < MESH_MAX_LODS ? visibleLodCounts[lod] : 0;
+}
+
+bool Renderer::GetImpostors()
+{
+	return impostors;
+}
+
+void Renderer::SetImpostors(bool enabled)
+{
+	impostors = enabled;
+}
+
+float Renderer::GetImpostorDistance()
+{
+	return impostorDistance;
+}
+
+void Renderer::SetImpostorDistance(float distance)
+{
+	impostorDistance = max(distance, 1.0f);
+}
+
+const ImpostorStats& Renderer::GetImpostorStats()
+{
+	return impostorStats;
+}
+
+bool Renderer::GetGpuDrivenCulling()
+{
+	return gpuDrivenCulling;
+}
+
+void Renderer::SetGpuDrivenCulling(bool enabled)
+{
+	gpuDrivenCulling = enabled;
+}
+
+const GpuCullingStats& Renderer::GetGpuCullingStats()
+{
+	return gpuCulling.GetStats();
+}
+
+bool Renderer::GetStaticShadowCaching()
+{
+	return staticShadowCaching;
+}
+
+void Renderer::SetStaticShadowCaching(bool enabled)
+{
+	// Every entity's static flag changes with this,
+	// which invalidates the cache on its own
+	staticShadowCaching = enabled;
+}
+
+unsigned int Renderer::GetStaticCasterCount()
+{
+	return staticCasterCount;
+}
+
+unsigned int Renderer::GetStaticShadowRebuilds()
+{
+	return staticShadowRebuilds;
+}
+
+bool Renderer::GetLocalShadows()
+{
+	return localShadows;
+}
+
+void Renderer::SetLocalShadows(bool enabled)
+{
+	localShadows = enabled;
+}
+
+unsigned int Renderer::GetShadowAtlasSize()
+{
+	return shadowAtlas.GetSize();
+}
+
+void Renderer::SetShadowAtlasSize(unsigned int size)
+{
+	if (size != shadowAtlas.GetSize())
+		shadowAtlas.Resize(size);
+}
+
+unsigned int Renderer::GetShadowAtlasBudget()
+{
+	return shadowAtlas.GetTileBudget();
+}
+
+void Renderer::SetShadowAtlasBudget(unsigned int tiles)
+{
+	shadowAtlas.SetTileBudget(tiles);
+}
+
+const ShadowAtlasStats& Renderer::GetShadowAtlasStats()
+{
+	return shadowAtlas.GetStats();
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Renderer::GetShadowAtlasSRV()
+{
+	return shadowAtlas.GetSRV();
+}
+
+DepthPrepassMode Renderer::GetDepthPrepassMode()
+{
+	return depthPrepassMode;
+}
+
+void Renderer::SetDepthPrepassMode(DepthPrepassMode mode)
+{
+	depthPrepassMode = mode;
+}
+
+float Renderer::GetDepthPrepassThreshold()
+{
+	return depthPrepassThreshold;
+}
+
+void Renderer::SetDepthPrepassThreshold(float threshold)
+{
+	depthPrepassThreshold = threshold;
+}
+
+float Renderer::GetEstimatedDepthComplexity()
+{
+	return estimatedDepthComplexity;
+}
+
+bool Renderer::GetDepthPrepassActive()
+{
+	return depthPrepassActive;
+}
+
+bool Renderer::GetDeferredShading()
+{
+	return deferredShading;
+}
+
+void Renderer::SetDeferredShading(bool enabled)
+{
+	if (enabled == deferredShading)
+		return;
+
+	// The G-buffer's extra targets, and unordered access to the colors
+	deferredShading = enabled;
+	CreateRenderTargets();
+}
+
+bool Renderer::GetDeferredShadingActive()
+{
+	return deferredShadingActive;
+}
+
+const RenderQueueStats& Renderer::GetForwardQueueStats()
+{
+	return forwardQueue.GetStats();
+}
+
+const RenderQueueStats& Renderer::GetDepthPrepassStats()
+{
+	return depthPrepassStats;
+}
+
+bool Renderer::GetFrustumCulling()
+{
+	return frustumCulling;
+}
+
+void Renderer::SetFrustumCulling(bool enabled)
+{
+	frustumCulling = enabled;
+}
+
+const DynamicBvh& Renderer::GetEntityTree()
+{
+	return entityTree;
+}
+
+const BoundingOrientedBox& Renderer::GetEntityBounds(unsigned int index)
+{
+	return entityBounds[index];
+}
+
+unsigned int Renderer::GetEntityBoundsCount()
+{
+	return (unsigned int)entityBounds.size();
+}
+
+// Only arrays that are caught up with the scene move, since anything
+// else is resized (and checked against each entity) next frame anyway
+template<typename T>
+static void RemapSceneArray(std::vector<T>& values, const std::vector<unsigned int>& order)
+{
+	if (values.size() != order.size())
+		return;
+
+	std::vector<T> remapped(values.size());
+	for (size_t i = 0; i < order.size(); i++)
+		remapped[i] = values[order[i]];
+	values.swap(remapped);
+}
+
+// --------------------------------------------------------------------------
+// Follows the scene being reordered, so bounds, tree leaves, LOD choices
+// and shadow caster history all stay with their entities
+//  - The tree's leaves hold scene indices, so they're renumbered in place
+//    and nothing in the tree moves
+//  - GPU driven culling still rebuilds its buckets once, since its
+//    instances are laid out in scene order
+// --------------------------------------------------------------------------
+void Renderer::RemapSceneOrder(const std::vector<unsigned int>& order)
+{
+	RemapSceneArray(entityBounds, order);
+	RemapSceneArray(entityProxies, order);
+	RemapSceneArray(entityOccluded, order);
+	RemapSceneArray(entityLods, order);
+	RemapSceneArray(casterHistory, order);
+	RemapSceneArray(entityStaticCaster, order);
+	RemapSceneArray(lastCasterBounds, order);
+
+	if (entityProxies.size() != order.size())
+		return;
+	for (size_t i = 0; i < entityProxies.size(); i++)
+	{
+		if (entityProxies[i].Node != BVH_NULL_NODE)
+			entityTree.SetValue(entityProxies[i].Node, (unsigned int)i);
+	}
+}
+
+RenderTargetPool& Renderer::GetRenderTargetPool()
+{
+	return renderTargetPool;
+}
+
+DebugViews& Renderer::GetDebugViews()
+{
+	return debugViews;
+}
+
+bool Renderer::GetRenderTargetAliasing()
+{
+	return renderTargetAliasing;
+}
+
+void Renderer::SetRenderTargetAliasing(bool enabled)
+{
+	if (enabled == renderTargetAliasing)
+		return;
+
+	renderTargetAliasing = enabled;
+	CreateRenderTargets();
+}
+
+GpuProfiler& Renderer::GetGpuProfiler()
+{
+	return gpuProfiler;
+}
+
+bool Renderer::GetMultithreadedRecording()
+{
+	return multithreadedRecording;
+}
+
+void Renderer::SetMultithreadedRecording(bool enabled)
+{
+	multithreadedRecording = enabled && shadowContext && sceneContext && particleContext;
+}
+
+int Renderer::GetSSAOSamples()
+{
+	return ssaoSamples;
+}
+
+void Renderer::SetSSAOSamples(int samples)
+{
+	ssaoSamples = max(1, min(samples, (int)ARRAYSIZE(ssaoOffsets)));
+}
+
+float Renderer::GetSSAORadius()
+{
+	return ssaoRadius;
+}
+
+void Renderer::SetSSAORadius(float radius)
+{
+	ssaoRadius = radius;
+}
+
+int Renderer::GetSSAOResolutionScale()
+{
+	return ssaoResolutionScale;
+}
+
+void Renderer::SetSSAOResolutionScale(int scale)
+{
+	if (scale == ssaoResolutionScale)
+		return;
+
+	ssaoResolutionScale = scale;
+	CreateRenderTargets();
+}
+
+int Renderer::GetParticleResolutionScale()
+{
+	return particleResolutionScale;
+}
+
+void Renderer::SetParticleResolutionScale(int scale)
+{
+	if (scale == particleResolutionScale)
+		return;
+
+	particleResolutionScale = scale;
+	CreateRenderTargets();
+}
+
+bool Renderer::GetComputeSSAO()
+{
+	return computeSSAO;
+}
+
+void Renderer::SetComputeSSAO(bool enabled)
+{
+	if (enabled == computeSSAO)
+		return;
+
+	// The compute path needs unordered access to its targets
+	computeSSAO = enabled;
+	CreateRenderTargets();
+}
+
+bool Renderer::GetFusedSSAOCombine()
+{
+	return fusedSSAOCombine;
+}
+
+void Renderer::SetFusedSSAOCombine(bool enabled)
+{
+	if (enabled == fusedSSAOCombine || (enabled && !backBufferUAV))
+		return;
+
+	// There's no blurred SSAO target when it's fused
+	fusedSSAOCombine = enabled;
+	CreateRenderTargets();
+}
+
+bool Renderer::GetTemporalSSAO()
+{
+	return temporalSSAO;
+}
+
+void Renderer::SetTemporalSSAO(bool enabled)
+{
+	if (enabled == temporalSSAO)
+		return;
+
+	temporalSSAO = enabled;
+	CreateRenderTargets();
+}
+
+bool Renderer::GetDynamicResolution()
+{
+	return dynamicResolution;
+}
+
+void Renderer::SetDynamicResolution(bool enabled)
+{
+	dynamicResolution = enabled;
+}
+
+float Renderer::GetDynamicResolutionTargetMs()
+{
+	return dynamicResolutionTargetMs;
+}
+
+void Renderer::SetDynamicResolutionTargetMs(float ms)
+{
+	dynamicResolutionTargetMs = max(1.0f, ms);
+}
+
+float Renderer::GetMinRenderScale()
+{
+	return minRenderScale;
+}
+
+void Renderer::SetMinRenderScale(float scale)
+{
+	minRenderScale = max(0.25f, min(scale, maxRenderScale));
+}
+
+float Renderer::GetMaxRenderScale()
+{
+	return maxRenderScale;
+}
+
+void Renderer::SetMaxRenderScale(float scale)
+{
+	maxRenderScale = max(minRenderScale, min(scale, 1.0f));
+}
+
+float Renderer::GetRenderScale()
+{
+	return renderScale;
+}
+
+bool Renderer::GetTemporalUpsampling()
+{
+	return temporalUpsampling;
+}
+
+void Renderer::SetTemporalUpsampling(bool enabled)
+{
+	if (enabled == temporalUpsampling)
+		return;
+
+	temporalUpsampling = enabled;
+	CreateRenderTargets();
+}
+
+float Renderer::GetTemporalUpsamplingScale()
+{
+	return temporalUpsamplingScale;
+}
+
+void Renderer::SetTemporalUpsamplingScale(float scale)
+{
+	temporalUpsamplingScale = max(0.5f, min(scale, 1.0f));
+}
+
+int Renderer::GetSSAOTemporalSamples()
+{
+	return ssaoTemporalSamples;
+}
+
+void Renderer::SetSSAOTemporalSamples(int samples)
+{
+	ssaoTemporalSamples = max(1, min(samples, (int)ARRAYSIZE(ssaoOffsets)));
+}
+
+bool Renderer::GetInstancing()
+{
+	return instancing;
+}
+
+void Renderer::SetInstancing(bool enabled)
+{
+	// Any run of two or more matching draws is worth instancing
+	instancing = enabled;
+	renderQueue.SetInstancingThreshold(enabled ? 2 : 0);
+	forwardQueue.SetInstancingThreshold(enabled ? 2 : 0);
+	shadowQueue.SetInstancingThreshold(enabled ? 2 : 0);
+}
+
+void Renderer::SetPresentOptions(unsigned int syncInterval, unsigned int flags)
+{
+	presentSyncInterval = syncInterval;
+	presentFlags = flags;
+}
+
+void Renderer::SetCameraLateLatch(std::function<void()> lateLatch)
+{
+	cameraLateLatch = lateLatch;
+}
+
+// --------------------------------------------------------
+// Every draw's timed on the CPU with a flush after it, since
+// that's where most drivers finish compiling what they put
+// off at creation - so a second draw that's still slow is
+// one the driver's remaking every time the state changes
+// --------------------------------------------------------
+WarmUpReport Renderer::WarmUp(Camera* camera, const std::vector<Material*>& materials, Mesh* mesh, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh, float budgetMs)
+{
+	PROFILE_SCOPE("Renderer::WarmUp");
+	WarmUpReport report = {};
+	auto start = std::chrono::high_resolution_clock::now();
+	auto elapsedMs = [start]() { return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count(); };
+
+	// The G-buffer targets only exist while deferred shading's on
+	bool deferred = deferredShading;
+	SetDeferredShading(true);
+
+	// Each vertex and pixel shader pair the scene queue could bind, in
+	// the targets it would bind them with (see RenderQueue::Submit())
+	struct MaterialDraw
+	{
+		Material* Example;	// Any one of the materials using the pair
+		SimpleVertexShader* VS;
+		SimplePixelShader* PS;
+		bool GBuffer;
+	};
+	std::vector<MaterialDraw> draws;
+	Assets& assets = Assets::GetInstance();
+	for (Material* material : materials)
+	{
+		SimpleVertexShader* vs = assets.GetVertexShaderFor(material->GetVS(), mesh);
+		for (int gbuffer = 0; gbuffer < 2; gbuffer++)
+		{
+			SimplePixelShader* ps = gbuffer && material->GetGBufferPS() ? material->GetGBufferPS() : material->GetPS();
+			if (!vs || !ps)
+				continue;
+
+			bool seen = false;
+			for (const MaterialDraw& draw : draws)
+				seen = seen || (draw.VS == vs && draw.PS == ps && draw.GBuffer == (gbuffer != 0));
+			if (!seen)
+				draws.push_back({ material, vs, ps, gbuffer != 0 });
+		}
+	}
+
+	// One pixel of the scene's own targets, and nothing to cover with it
+	ID3D11RenderTargetView* forwardTargets[2] = { sceneColorsRTV.Get(), sceneNormalsRTV.Get() };
+	ID3D11RenderTargetView* gbufferTargets[3] = { sceneAlbedoRTV.Get(), sceneNormalsRTV.Get(), sceneSurfaceRTV.Get() };
+	PassState forwardPass;
+	forwardPass.SetViewport(1, 1);
+	forwardPass.SetRenderTargets(2, forwardTargets, depthBufferDSV.Get());
+	PassState gbufferPass;
+	gbufferPass.SetViewport(1, 1);
+	gbufferPass.SetRenderTargets(3, gbufferTargets, depthBufferDSV.Get());
+
+	Transform zeroScale;
+	zeroScale.SetScale(0, 0, 0);
+	unsigned int lod = mesh->GetLodCount() > 0 ? mesh->GetLodCount() - 1 : 0;
+
+	StateCache& states = StateCache::GetInstance();
+	states.Invalidate(context);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	for (const MaterialDraw& draw : draws)
+	{
+		if (elapsedMs() > budgetMs)
+		{
+			report.Skipped++;
+			continue;
+		}
+
+		std::string name = assets.GetPixelShaderName(draw.PS);
+		WarmUpCombination combination = { (name.empty() ? "Pixel shader" : name) + (draw.GBuffer ? " (G-buffer)" : " (forward)"), 0, 0 };
+		states.Apply(context, draw.GBuffer ? gbufferPass : forwardPass);
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			float before = elapsedMs();
+			draw.VS->SetShader();
+			draw.PS->SetShader();
+			draw.Example->SetPerMaterialDataAndResources(true, draw.PS);
+			mesh->SetBuffers(context);
+			draw.Example->SetPerObjectData(&zeroScale, draw.VS);
+			mesh->Draw(context, lod);
+			context->Flush();
+			(attempt == 0 ? combination.FirstMs : combination.SecondMs) = elapsedMs() - before;
+		}
+		report.Combinations.push_back(combination);
+	}
+	states.Invalidate(context);
+	ISimpleShader::InvalidateStateCache(context);
+	SetDeferredShading(deferred);
+
+	// Then whole frames (for the passes' own shaders and targets), as
+	// they're set and with each option that changes them flipped
+	struct WarmUpOption
+	{
+		const char* Name;
+		bool (Renderer::*Get)();
+		void (Renderer::*Set)(bool);
+	};
+	WarmUpOption options[] = {
+		{ "Frame", 0, 0 },
+		{ "Frame (deferred shading flipped)", &Renderer::GetDeferredShading, &Renderer::SetDeferredShading },
+		{ "Frame (compute SSAO flipped)", &Renderer::GetComputeSSAO, &Renderer::SetComputeSSAO },
+		{ "Frame (fused SSAO combine flipped)", &Renderer::GetFusedSSAOCombine, &Renderer::SetFusedSSAOCombine },
+		{ "Frame (temporal SSAO flipped)", &Renderer::GetTemporalSSAO, &Renderer::SetTemporalSSAO },
+		{ "Frame (temporal upsampling flipped)", &Renderer::GetTemporalUpsampling, &Renderer::SetTemporalUpsampling },
+		{ "Frame (batched particles flipped)", &Renderer::GetBatchedParticles, &Renderer::SetBatchedParticles },
+		{ "Frame (instanced light gizmos flipped)", &Renderer::GetInstancedLightGizmos, &Renderer::SetInstancedLightGizmos } };
+
+	warmingUp = true;
+	for (const WarmUpOption& option : options)
+	{
+		if (elapsedMs() > budgetMs)
+		{
+			report.Skipped++;
+			continue;
+		}
+
+		bool was = option.Get ? (this->*option.Get)() : false;
+		if (option.Set)
+			(this->*option.Set)(!was);
+
+		// Some can't be flipped (like the fused combine, without a back buffer UAV)
+		if (!option.Get || (this->*option.Get)() != was)
+		{
+			WarmUpCombination combination = { option.Name, 0, 0 };
+			for (int attempt = 0; attempt < 2; attempt++)
+			{
+				float before = elapsedMs();
+				Render(camera, 0, lightCount, lightVS, lightPS, lightMesh);
+				context->Flush();
+				(attempt == 0 ? combination.FirstMs : combination.SecondMs) = elapsedMs() - before;
+			}
+			report.Combinations.push_back(combination);
+		}
+
+		if (option.Set)
+			(this->*option.Set)(was);
+	}
+	warmingUp = false;
+
+	report.TotalMs = elapsedMs();
+	return report;
+}
+
+bool Renderer::GetInstancedLightGizmos()
+{
+	return instancedLightGizmos;
+}
+
+void Renderer::SetInstancedLightGizmos(bool enabled)
+{
+	instancedLightGizmos = enabled;
+}
+
+bool Renderer::GetBatchedParticles()
+{
+	return batchedParticles;
+}
+
+void Renderer::SetBatchedParticles(bool enabled)
+{
+	batchedParticles = enabled;
+}
+
+const ParticleBatchStats& Renderer::GetParticleBatchStats()
+{
+	return particleBatcher.GetStats();
+}
+
+bool Renderer::GetClusteredLighting()
+{
+	return clusteredLighting;
+}
+
+void Renderer::SetClusteredLighting(bool enabled)
+{
+	clusteredLighting = enabled;
+}
+
+bool Renderer::GetPerEntityLights()
+{
+	return perEntityLights;
+}
+
+void Renderer::SetPerEntityLights(bool enabled)
+{
+	perEntityLights = enabled;
+}
+
+bool Renderer::GetPerEntityLightsActive()
+{
+	return perEntityLightsActive;
+}
+
+unsigned int Renderer::GetEntityLightCap()
+{
+	return entityLightLists.GetMaxLights();
+}
+
+void Renderer::SetEntityLightCap(unsigned int lights)
+{
+	entityLightLists.SetMaxLights(lights);
+}
+
+const EntityLightListStats& Renderer::GetEntityLightListStats()
+{
+	return entityLightLists.GetStats();
+}
+
+bool Renderer::ApplySetting(const std::string& name, const std::string& value)
+{
+	bool on = value == "1" || value == "true" || value == "on";
+	int number = atoi(value.c_str());
+	float fraction = (float)atof(value.c_str());
+
+	if (name == "stateCaching") SetStateCaching(on);
+	else if (name == "instancing") SetInstancing(on);
+	else if (name == "ssaoSamples") SetSSAOSamples(number);
+	else if (name == "ssaoRadius") SetSSAORadius(fraction);
+	else if (name == "ssaoScale") SetSSAOResolutionScale(number);
+	else if (name == "computeSSAO") SetComputeSSAO(on);
+	else if (name == "fusedSSAOCombine") SetFusedSSAOCombine(on);
+	else if (name == "deferredShading") SetDeferredShading(on);
+	else if (name == "temporalSSAO") SetTemporalSSAO(on);
+	else if (name == "particleScale") SetParticleResolutionScale(number);
+	else if (name == "dynamicResolution") SetDynamicResolution(on);
+	else if (name == "temporalUpsampling") SetTemporalUpsampling(on);
+	else if (name == "temporalUpsamplingScale") SetTemporalUpsamplingScale(fraction);
+	else if (name == "renderTargetAliasing") SetRenderTargetAliasing(on);
+	else if (name == "multithreadedRecording") SetMultithreadedRecording(on);
+	else if (name == "shadowCascades") SetShadowCascadeCount(number);
+	else if (name == "shadowMapSize") SetShadowMapSize(number);
+	else if (name == "shadowFilter")
+		SetShadowFilter(value == "evsm2" ? ShadowFilter::EVSM2 : value == "evsm4" ? ShadowFilter::EVSM4 : ShadowFilter::Comparison);
+	else if (name == "evsmBlurRadius") SetEVSMBlurRadius(number);
+	else if (name == "frustumCulling") SetFrustumCulling(on);
+	else if (name == "occlusionCulling") SetOcclusionCulling(on);
+	else if (name == "occlusionCullShadows") SetOcclusionCullShadows(on);
+	else if (name == "meshLods") SetMeshLods(on);
+	else if (name == "lodScale") SetLodScale(fraction);
+	else if (name == "impostors") SetImpostors(on);
+	else if (name == "impostorDistance") SetImpostorDistance(fraction);
+	else if (name == "gpuCulling") SetGpuDrivenCulling(on);
+	else if (name == "staticShadowCaching") SetStaticShadowCaching(on);
+	else if (name == "localShadows") SetLocalShadows(on);
+	else if (name == "shadowAtlasSize") SetShadowAtlasSize(number);
+	else if (name == "shadowAtlasBudget") SetShadowAtlasBudget(number);
+	else if (name == "instancedLightGizmos") SetInstancedLightGizmos(on);
+	else if (name == "batchedParticles") SetBatchedParticles(on);
+	else if (name == "clusteredLighting") SetClusteredLighting(on);
+	else if (name == "perEntityLights") SetPerEntityLights(on);
+	else if (name == "entityLightCap") SetEntityLightCap(number);
+	else if (name == "depthPrepass")
+		SetDepthPrepassMode(value == "auto" ? DepthPrepassMode::Auto : on ? DepthPrepassMode::On : DepthPrepassMode::Off);
+	else
+		return false;
+	return true;
+}
+
+// --------------------------------------------------------------------------
+// (Re)creates every full screen target through the pool, along with
+// the SSAO targets at the current SSAO resolution
+//  - Each target is requested for the passes it's alive in, so with
+//    aliasing on, targets that are never alive together share a texture
+//  - The debug views in the UI show whatever was written last, so
+//    aliased targets may show another pass's results
+// --------------------------------------------------------------------------
+void Renderer::CreateRenderTargets()
+{
+	sceneColorsRTV.Reset();
+	sceneColorsSRV.Reset();
+	sceneNormalsRTV.Reset();
+	sceneNormalsSRV.Reset();
+	sceneAlbedoRTV.Reset();
+	sceneAlbedoSRV.Reset();
+	sceneSurfaceRTV.Reset();
+	sceneSurfaceSRV.Reset();
+	sceneColorsUAV.Reset();
+	ssaoResultRTV.Reset();
+	ssaoResultSRV.Reset();
+	ssaoBlurRTV.Reset();
+	ssaoBlurSRV.Reset();
+	ssaoResultUAV.Reset();
+	ssaoBlurUAV.Reset();
+	ssaoBlurTempUAV.Reset();
+	ssaoBlurTempSRV.Reset();
+	ssaoNormalsRTV.Reset();
+	ssaoNormalsSRV.Reset();
+	ssaoDepthRTV.Reset();
+	ssaoDepthSRV.Reset();
+	particleColorsRTV.Reset();
+	particleColorsSRV.Reset();
+	particleDepthDSV.Reset();
+	particleDepthSRV.Reset();
+	motionVectorsRTV.Reset();
+	motionVectorsSRV.Reset();
+	taaInputRTV.Reset();
+	taaInputSRV.Reset();
+	taaInputUAV.Reset();
+	for (int i = 0; i < 2; i++)
+	{
+		ssaoHistoryRTV[i].Reset();
+		ssaoHistorySRV[i].Reset();
+		taaHistoryRTV[i].Reset();
+		taaHistorySRV[i].Reset();
+	}
+	renderTargetPool.Reset();
+	ssaoHistoryValid = false;
+	taaHistoryValid = false;
+
+	ssaoWidth = max(1u, windowWidth / ssaoResolutionScale);
+	ssaoHeight = max(1u, windowHeight / ssaoResolutionScale);
+
+	unsigned int colors = renderTargetPool.Request(windowWidth, windowHeight, DXGI_FORMAT_R8G8B8A8_UNORM, PassScene, PassCombine, deferredShading);
+	unsigned int normals = renderTargetPool.Request(windowWidth, windowHeight, DXGI_FORMAT_R16G16_UNORM, PassScene, PassSSAO);
+
+	// The rest of the deferred G-buffer, which is lit into the
+	// colors before the scene pass is over
+	unsigned int albedo = 0;
+	unsigned int surface = 0;
+	if (deferredShading)
+	{
+		albedo = renderTargetPool.Request(windowWidth, windowHeight, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, PassScene, PassScene);
+		surface = renderTargetPool.Request(windowWidth, windowHeight, DXGI_FORMAT_R8G8_UNORM, PassScene, PassScene);
+	}
+	// The fused combine blurs the raw results itself, so there's no blur target
+	unsigned int ssaoResult = renderTargetPool.Request(ssaoWidth, ssaoHeight, DXGI_FORMAT_R8G8B8A8_UNORM, PassSSAO, fusedSSAOCombine ? PassCombine : PassSSAOBlur, computeSSAO);
+	unsigned int ssaoBlur = 0;
+	if (!fusedSSAOCombine)
+		ssaoBlur = renderTargetPool.Request(ssaoWidth, ssaoHeight, DXGI_FORMAT_R8G8B8A8_UNORM, PassSSAOBlur, PassCombine, computeSSAO);
+
+	// The compute blur's first (horizontal) half goes here
+	unsigned int ssaoBlurTemp = 0;
+	if (computeSSAO && !fusedSSAOCombine)
+		ssaoBlurTemp = renderTargetPool.Request(ssaoWidth, ssaoHeight, DXGI_FORMAT_R8G8B8A8_UNORM, PassSSAOBlur, PassSSAOBlur, true);
+
+	// Full resolution SSAO just reads the scene's buffers
+	unsigned int ssaoNormals = 0;
+	unsigned int ssaoDepths = 0;
+	if (ssaoResolutionScale > 1)
+	{
+		ssaoNormals = renderTargetPool.Request(ssaoWidth, ssaoHeight, DXGI_FORMAT_R16G16_UNORM, PassSSAODownsample, PassSSAO);
+		ssaoDepths = renderTargetPool.Request(ssaoWidth, ssaoHeight, DXGI_FORMAT_R32_FLOAT, PassSSAODownsample, PassCombine);
+	}
+
+	// History carries over between frames, so it can't share with anything
+	unsigned int ssaoHistory[2] = {};
+	if (temporalSSAO)
+	{
+		for (int i = 0; i < 2; i++)
+			ssaoHistory[i] = renderTargetPool.Request(ssaoWidth, ssaoHeight, DXGI_FORMAT_R16G16B16A16_FLOAT, PassScene, PassCombine);
+	}
+
+	// Temporal upsampling's motion (written with the scene) and the
+	// combine at the render size, then full size history of its own
+	unsigned int motionVectors = 0;
+	unsigned int taaInput = 0;
+	unsigned int taaHistory[2] = {};
+	if (temporalUpsampling)
+	{
+		motionVectors = renderTargetPool.Request(windowWidth, windowHeight, DXGI_FORMAT_R16G16_FLOAT, PassScene, PassTemporalUpsample);
+		taaInput = renderTargetPool.Request(windowWidth, windowHeight, DXGI_FORMAT_R8G8B8A8_UNORM, PassCombine, PassTemporalUpsample, fusedSSAOCombine);
+		for (int i = 0; i < 2; i++)
+			taaHistory[i] = renderTargetPool.Request(windowWidth, windowHeight, DXGI_FORMAT_R16G16B16A16_FLOAT, PassScene, PassParticles);
+	}
+
+	// Low resolution particles are drawn before the combine with
+	// dynamic resolution, and after it without
+	unsigned int particleColors = 0;
+	if (particleResolutionScale > 1)
+		particleColors = renderTargetPool.Request(max(1u, windowWidth / particleResolutionScale), max(1u, windowHeight / particleResolutionScale), DXGI_FORMAT_R16G16B16A16_FLOAT, PassScene, PassParticles);
+
+	renderTargetPool.Allocate(renderTargetAliasing);
+
+	sceneColorsRTV = renderTargetPool.GetRTV(colors);
+	sceneColorsSRV = renderTargetPool.GetSRV(colors);
+	sceneNormalsRTV = renderTargetPool.GetRTV(normals);
+	sceneNormalsSRV = renderTargetPool.GetSRV(normals);
+	if (deferredShading)
+	{
+		sceneColorsUAV = renderTargetPool.GetUAV(colors);
+		sceneAlbedoRTV = renderTargetPool.GetRTV(albedo);
+		sceneAlbedoSRV = renderTargetPool.GetSRV(albedo);
+		sceneSurfaceRTV = renderTargetPool.GetRTV(surface);
+		sceneSurfaceSRV = renderTargetPool.GetSRV(surface);
+	}
+	ssaoResultRTV = renderTargetPool.GetRTV(ssaoResult);
+	ssaoResultSRV = renderTargetPool.GetSRV(ssaoResult);
+	if (!fusedSSAOCombine)
+	{
+		ssaoBlurRTV = renderTargetPool.GetRTV(ssaoBlur);
+		ssaoBlurSRV = renderTargetPool.GetSRV(ssaoBlur);
+	}
+	if (computeSSAO)
+	{
+		ssaoResultUAV = renderTargetPool.GetUAV(ssaoResult);
+		if (!fusedSSAOCombine)
+		{
+			ssaoBlurUAV = renderTargetPool.GetUAV(ssaoBlur);
+			ssaoBlurTempUAV = renderTargetPool.GetUAV(ssaoBlurTemp);
+			ssaoBlurTempSRV = renderTargetPool.GetSRV(ssaoBlurTemp);
+		}
+	}
+	if (ssaoResolutionScale > 1)
+	{
+		ssaoNormalsRTV = renderTargetPool.GetRTV(ssaoNormals);
+		ssaoNormalsSRV = renderTargetPool.GetSRV(ssaoNormals);
+		ssaoDepthRTV = renderTargetPool.GetRTV(ssaoDepths);
+		ssaoDepthSRV = renderTargetPool.GetSRV(ssaoDepths);
+	}
+	if (temporalSSAO)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			ssaoHistoryRTV[i] = renderTargetPool.GetRTV(ssaoHistory[i]);
+			ssaoHistorySRV[i] = renderTargetPool.GetSRV(ssaoHistory[i]);
+		}
+	}
+	if (temporalUpsampling)
+	{
+		motionVectorsRTV = renderTargetPool.GetRTV(motionVectors);
+		motionVectorsSRV = renderTargetPool.GetSRV(motionVectors);
+		taaInputRTV = renderTargetPool.GetRTV(taaInput);
+		taaInputSRV = renderTargetPool.GetSRV(taaInput);
+		if (fusedSSAOCombine)
+			taaInputUAV = renderTargetPool.GetUAV(taaInput);
+		for (int i = 0; i < 2; i++)
+		{
+			taaHistoryRTV[i] = renderTargetPool.GetRTV(taaHistory[i]);
+			taaHistorySRV[i] = renderTargetPool.GetSRV(taaHistory[i]);
+		}
+	}
+
+	// The pool only has color targets, so the particles' depth
+	// buffer is made here
+	if (particleResolutionScale > 1)
+	{
+		particleColorsRTV = renderTargetPool.GetRTV(particleColors);
+		particleColorsSRV = renderTargetPool.GetSRV(particleColors);
+
+		D3D11_TEXTURE2D_DESC depthDesc = {};
+		depthDesc.Width = max(1u, windowWidth / particleResolutionScale);
+		depthDesc.Height = max(1u, windowHeight / particleResolutionScale);
+		depthDesc.ArraySize = 1;
+		depthDesc.MipLevels = 1;
+		depthDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+		depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+		depthDesc.SampleDesc.Count = 1;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> depthTexture;
+		GpuMemory::CreateTexture2D(device.Get(), &depthDesc, 0, depthTexture.GetAddressOf(), GpuMemoryCategory::RenderTargets, "Scene Depth");
+
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+		device->CreateDepthStencilView(depthTexture.Get(), &dsvDesc, particleDepthDSV.GetAddressOf());
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = 1;
+		device->CreateShaderResourceView(depthTexture.Get(), &srvDesc, particleDepthSRV.GetAddressOf());
+	}
+
+	printf("Render targets: %u requested (%.1f MB), %u allocated (%.1f MB)\n",
+		renderTargetPool.GetRequestCount(),
+		renderTargetPool.GetRequestedBytes() / (1024.0f * 1024.0f),
+		renderTargetPool.GetTargetCount(),
+		renderTargetPool.GetAllocatedBytes() / (1024.0f * 1024.0f));
+}
+
+void Renderer::CreateShadowMap()
+{
+	
+	shadowDepthSRV.Reset();
+	shadowTexture.Reset();
+	staticShadowTexture.Reset();
+	for (int i = 0; i < MAX_SHADOW_CASCADES; i++)
+	{
+		shadowCascades[i].DSV.Reset();
+		shadowCascades[i].StaticDSV.Reset();
+		shadowCascades[i].StaticValid = false;
+	}
+
+	// One slice per cascade
+	D3D11_TEXTURE2D_DESC shadowDesc = {};
+	shadowDesc.Width = shadowMapSize;
+	shadowDesc.Height = shadowMapSize;
+	shadowDesc.ArraySize = shadowCascadeCount;
+	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	shadowDesc.CPUAccessFlags = 0;
+	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	shadowDesc.MipLevels = 1;
+	shadowDesc.MiscFlags = 0;
+	shadowDesc.SampleDesc.Count = 1;
+	shadowDesc.SampleDesc.Quality = 0;
+	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateTexture2D(device.Get(), &shadowDesc, 0, shadowTexture.GetAddressOf(), GpuMemoryCategory::Shadows, "Shadow Map");
+
+	// The static caster cache is only ever drawn to and copied from
+	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	GpuMemory::CreateTexture2D(device.Get(), &shadowDesc, 0, staticShadowTexture.GetAddressOf(), GpuMemoryCategory::Shadows, "Static Shadow Map");
+
+	// A depth view for rendering each cascade
+	for (int i = 0; i < shadowCascadeCount; i++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
+		shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		shadowDSDesc.Texture2DArray.MipSlice = 0;
+		shadowDSDesc.Texture2DArray.FirstArraySlice = i;
+		shadowDSDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(shadowTexture.Get(), &shadowDSDesc, shadowCascades[i].DSV.GetAddressOf());
+		device->CreateDepthStencilView(staticShadowTexture.Get(), &shadowDSDesc, shadowCascades[i].StaticDSV.GetAddressOf());
+	}
 
+	// And a single view of all of them for sampling
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = shadowCascadeCount;
 	device->CreateShaderResourceView(shadowTexture.Get(), &srvDesc, shadowDepthSRV.GetAddressOf());
 
+	CreateShadowMoments();
+}
+
+// --------------------------------------------------------------------------
+// The moments filtered from the shadow map, for EVSM, and the target
+// between the two halves of the blur - nothing at all with comparison
+// filtering
+//  - Full mip chains, so distant pixels read a prefiltered level
+//    rather than aliasing
+// --------------------------------------------------------------------------
+void Renderer::CreateShadowMoments()
+{
+	shadowMomentsTexture.Reset();
+	shadowMomentsSRV.Reset();
+	shadowMomentsUAV.Reset();
+	shadowMomentsTempSRV.Reset();
+	shadowMomentsTempUAV.Reset();
+	if (shadowFilter == ShadowFilter::Comparison)
+		return;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = shadowMapSize;
+	desc.Height = shadowMapSize;
+	desc.ArraySize = shadowCascadeCount;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_RENDER_TARGET;
+	desc.Format = shadowFilter == ShadowFilter::EVSM2 ? DXGI_FORMAT_R32G32_FLOAT : DXGI_FORMAT_R16G16B16A16_FLOAT;
+	desc.MipLevels = 0;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateTexture2D(device.Get(), &desc, 0, shadowMomentsTexture.GetAddressOf(), GpuMemoryCategory::Shadows, "Shadow Moments");
+	device->CreateShaderResourceView(shadowMomentsTexture.Get(), 0, shadowMomentsSRV.GetAddressOf());
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = desc.Format;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+	uavDesc.Texture2DArray.MipSlice = 0;
+	uavDesc.Texture2DArray.FirstArraySlice = 0;
+	uavDesc.Texture2DArray.ArraySize = shadowCascadeCount;
+	device->CreateUnorderedAccessView(shadowMomentsTexture.Get(), &uavDesc, shadowMomentsUAV.GetAddressOf());
+
+	// One cascade at a time goes through the temporary
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> tempTexture;
+	desc.ArraySize = 1;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	desc.MipLevels = 1;
+	desc.MiscFlags = 0;
+	GpuMemory::CreateTexture2D(device.Get(), &desc, 0, tempTexture.GetAddressOf(), GpuMemoryCategory::Shadows, "Shadow Moments Blur");
+	device->CreateShaderResourceView(tempTexture.Get(), 0, shadowMomentsTempSRV.GetAddressOf());
+	device->CreateUnorderedAccessView(tempTexture.Get(), 0, shadowMomentsTempUAV.GetAddressOf());
 }
 
 void Renderer::CreateShadowMapResources()
@@ -428,7 +2844,18 @@ void Renderer::CreateShadowMapResources()
 	shadowSampDesc.BorderColor[1] = 1.0f;
 	shadowSampDesc.BorderColor[2] = 1.0f;
 	shadowSampDesc.BorderColor[3] = 1.0f;
-	device->CreateSamplerState(&shadowSampDesc, &shadowSampler);
+	shadowSampler = StateCache::GetInstance().GetSamplerState(shadowSampDesc);
+
+	// Moments are filtered like any other texture, and anything
+	// outside the cascade is skipped by the shader instead
+	D3D11_SAMPLER_DESC momentSampDesc = {};
+	momentSampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+	momentSampDesc.MaxAnisotropy = 8;
+	momentSampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	momentSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	momentSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	momentSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	shadowMomentSampler = StateCache::GetInstance().GetSamplerState(momentSampDesc);
 
 	D3D11_RASTERIZER_DESC shadowRastDesc = {};
 	shadowRastDesc.FillMode = D3D11_FILL_SOLID;
@@ -437,61 +2864,889 @@ void Renderer::CreateShadowMapResources()
 	shadowRastDesc.DepthBias = 1000;
 	shadowRastDesc.DepthBiasClamp = 0.0f;
 	shadowRastDesc.SlopeScaledDepthBias = 1.0f;
-	device->CreateRasterizerState(&shadowRastDesc, &shadowRasterizer);
+	shadowRasterizer = StateCache::GetInstance().GetRasterizerState(shadowRastDesc);
+}
+
+// --------------------------------------------------------------------------
+// Splits the camera frustum (out to the shadow distance) into cascades
+// and fits an orthographic light projection around each one.  Each is
+// fitted to a bounding sphere, and snapped to whole shadow map texels,
+// so cascades don't shimmer as the camera moves and turns.
+// --------------------------------------------------------------------------
+void Renderer::UpdateShadowCascades(Camera* camera, const Light* light)
+{
+	float nearClip = camera->GetNearClip();
+	float farClip = min(shadowDistance, camera->GetFarClip());
+
+	const ViewConstants& viewConstants = camera->GetViewConstants();
+	XMFLOAT4X4 proj = viewConstants.Projection;
+	XMMATRIX invView = XMLoadFloat4x4(&viewConstants.InvView);
+
+	// Half the frustum's width and height at a view depth of 1
+	float tanHalfX = 1.0f / proj._11;
+	float tanHalfY = 1.0f / proj._22;
+
+	XMVECTOR lightDir = XMVector3Normalize(XMLoadFloat3(&light->Direction));
+
+	float splitStart = nearClip;
+	for (int i = 0; i < shadowCascadeCount; i++)
+	{
+		ShadowCascade& cascade = shadowCascades[i];
+
+		// Blend the logarithmic and uniform split depths
+		float t = (i + 1) / (float)shadowCascadeCount;
+		float logSplit = nearClip * powf(farClip / nearClip, t);
+		float uniformSplit = nearClip + (farClip - nearClip) * t;
+		float splitEnd = shadowCascadeLambda * logSplit + (1.0f - shadowCascadeLambda) * uniformSplit;
+		cascade.SplitDepth = splitEnd;
+
+		// Sphere around this slice of the frustum, which stays the same
+		// size no matter which way the camera faces
+		float centerDepth = (splitStart + splitEnd) * 0.5f;
+		XMVECTOR center = XMVectorSet(0, 0, centerDepth, 1);
+		XMVECTOR farCorner = XMVectorSet(tanHalfX * splitEnd, tanHalfY * splitEnd, splitEnd, 1);
+		XMVECTOR nearCorner = XMVectorSet(tanHalfX * splitStart, tanHalfY * splitStart, splitStart, 1);
+		float radius = max(
+			XMVectorGetX(XMVector3Length(farCorner - center)),
+			XMVectorGetX(XMVector3Length(nearCorner - center)));
+		radius = ceilf(radius * 16.0f) / 16.0f;
+		center = XMVector3TransformCoord(center, invView);
+
+		// Look at the sphere from far enough back to catch casters in front of it
+		float backDistance = radius + shadowCasterDistance;
+		cascade.FarClip = backDistance + radius;
+		XMMATRIX lightView = XMMatrixLookToLH(center - lightDir * backDistance, lightDir, XMVectorSet(0, 1, 0, 0));
+		XMMATRIX lightProj = XMMatrixOrthographicLH(radius * 2.0f, radius * 2.0f, 0.0f, cascade.FarClip);
+
+		// Snap the projection so the world origin lands on a texel
+		float halfSize = shadowMapSize * 0.5f;
+		XMVECTOR origin = XMVector3TransformCoord(XMVectorZero(), lightView * lightProj) * halfSize;
+		XMVECTOR offset = (XMVectorRound(origin) - origin) / halfSize;
+		lightProj.r[3] += XMVectorSelect(XMVectorZero(), offset, XMVectorSelectControl(1, 1, 0, 0));
+
+		XMStoreFloat4x4(&cascade.View, lightView);
+		XMStoreFloat4x4(&cascade.Projection, lightProj);
+
+		// The ortho volume as a box for culling, built in
+		// light view space and then moved into the world
+		cascade.Volume = BoundingOrientedBox(
+			XMFLOAT3(0, 0, cascade.FarClip * 0.5f),
+			XMFLOAT3(radius, radius, cascade.FarClip * 0.5f),
+			XMFLOAT4(0, 0, 0, 1));
+		cascade.Volume.Transform(cascade.Volume, XMMatrixInverse(0, lightView));
+
+		splitStart = splitEnd;
+	}
+}
+
+// --------------------------------------------------------------------------
+// Moves each mesh's local bounds into world space.  An oriented box keeps
+// rotated entities tight, and the DirectXMath tests against it are SIMD.
+//  - Only entities that moved (or that are new to their scene index) are
+//    redone, and the tree only changes when one leaves its fat box
+// --------------------------------------------------------------------------
+void Renderer::UpdateEntityBounds()
+{
+	// Straight from the registry's arrays, without touching the entities
+	const std::vector<GameEntity*>& sceneEntities = entities.GetEntities();
+	const std::vector<Mesh*>& meshes = entities.GetMeshes();
+	const std::vector<Transform*>& transforms = entities.GetTransforms();
+
+	for (size_t i = meshes.size(); i < entityProxies.size(); i++)
+	{
+		if (entityProxies[i].Node != BVH_NULL_NODE)
+			entityTree.Remove(entityProxies[i].Node);
+	}
+
+	entityBounds.resize(meshes.size());
+	entityProxies.resize(meshes.size(), { {}, 0, BVH_NULL_NODE });
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		EntityProxy& proxy = entityProxies[i];
+		EntityHandle handle = entities.GetHandle(sceneEntities[i]);
+		unsigned int version = transforms[i]->GetVersion();
+		if (proxy.Node != BVH_NULL_NODE && proxy.Handle == handle && proxy.Version == version)
+			continue;
+
+		BoundingOrientedBox localBounds;
+		BoundingOrientedBox::CreateFromBoundingBox(localBounds, meshes[i]->GetBounds());
+
+		XMFLOAT4X4 world = transforms[i]->GetWorldMatrix();
+		localBounds.Transform(entityBounds[i], XMLoadFloat4x4(&world));
+
+		XMFLOAT3 corners[BoundingOrientedBox::CORNER_COUNT];
+		entityBounds[i].GetCorners(corners);
+		BoundingBox box;
+		BoundingBox::CreateFromPoints(box, BoundingOrientedBox::CORNER_COUNT, corners, sizeof(XMFLOAT3));
+
+		if (proxy.Node == BVH_NULL_NODE)
+			proxy.Node = entityTree.Insert(box, (unsigned int)i);
+		else
+			entityTree.Move(proxy.Node, box);
+
+		proxy.Handle = handle;
+		proxy.Version = version;
+	}
+}
 
+// --------------------------------------------------------------------------
+// Fills the visible list with every entity whose bounds touch the
+// volume (a frustum or box), or every entity if culling is off
+// --------------------------------------------------------------------------
+template<typename Volume>
+void Renderer::CullEntities(const Volume& volume, std::vector<GameEntity*>& visible, CullingStats& stats, bool useOcclusion, CullFilter filter)
+{
+	visible.clear();
+	stats = {};
+
+	// Everything starts culled, and the tree finds what's left
+	//  - Local (from this thread's frame arena), since shadow
+	//    culling can happen on another thread
+	enum CullResult : unsigned char { Filtered, Culled, Occluded, Visible };
+	unsigned int count = entities.GetCount();
+	FrameVector<unsigned char> results(count, frustumCulling ? Culled : Visible);
+	if (frustumCulling)
+	{
+		entityTree.Query(volume, [&](unsigned int i, bool inside)
+		{
+			if (i < count && (inside || volume.Intersects(entityBounds[i])))
+				results[i] = Visible;
+		});
+	}
 
-	UpdateShadowProjection();
+	// Filter and occlusion test in parallel, then gather the results in order
+	JobSystem::GetInstance().ParallelFor(count, 256, [&](unsigned int start, unsigned int end)
+	{
+		for (unsigned int i = start; i < end; i++)
+		{
+			// Entities filtered out don't count towards the stats at all
+			if (filter != CullFilter::All && entityStaticCaster[i] != (filter == CullFilter::StaticCasters))
+				results[i] = Filtered;
+			else if (results[i] == Visible && useOcclusion && entityOccluded[i])
+				results[i] = Occluded;
+		}
+	});
+
+	for (unsigned int i = 0; i < entities.GetCount(); i++)
+	{
+		switch (results[i])
+		{
+		case Culled: stats.Culled++; break;
+		case Occluded: stats.Occluded++; break;
+		case Visible:
+			visible.push_back(entities.GetEntity(i));
+			stats.Visible++;
+			break;
+		default: break;
+		}
+	}
 }
 
-void Renderer::UpdateShadowProjection()
+// --------------------------------------------------------------------------
+// Tests every entity against the last Hi-Z pyramid read back, once per
+// frame, so each culling pass can just look up the result
+// --------------------------------------------------------------------------
+void Renderer::UpdateEntityOcclusion()
 {
-	XMMATRIX shProj = XMMatrixOrthographicLH(shadowProjectionSize, shadowProjectionSize, 0.1f, 100.0f);
-	XMStoreFloat4x4(&shadowProjectionMatrix, shProj);
+	entityOccluded.assign(entities.GetCount(), 0);
+	if (!occlusionCulling)
+		return;
+
+	JobSystem::GetInstance().ParallelFor((unsigned int)entities.GetCount(), 128, [&](unsigned int start, unsigned int end)
+	{
+		for (unsigned int i = start; i < end; i++)
+			entityOccluded[i] = hiZBuffer.IsOccluded(entityBounds[i]) ? 1 : 0;
+	});
 }
 
-void Renderer::UpdateShadowView(const Light* light)
+// --------------------------------------------------------------------------
+// Picks each entity's level of detail from how much of the screen's height
+// its bounds cover, only moving back to a finer level once it's covering
+// a bit more than it took to leave it, so entities near a threshold
+// don't flicker between two levels
+// --------------------------------------------------------------------------
+void Renderer::UpdateEntityLods(Camera* camera)
 {
-	XMMATRIX shView = XMMatrixLookToLH(
-		XMLoadFloat3(&light->Direction) * -25, XMLoadFloat3(&light->Direction), XMVectorSet(0, 1, 0, 0));
-	XMStoreFloat4x4(&shadowViewMatrix, shView);
+	static const float coverages[MESH_MAX_LODS] = { FLT_MAX, LOD_SCREEN_COVERAGE_1, LOD_SCREEN_COVERAGE_2, LOD_SCREEN_COVERAGE_3 };
+
+	if (!meshLods)
+	{
+		entityLods.assign(entities.GetCount(), 0);
+		return;
+	}
+	entityLods.resize(entities.GetCount(), 0);
+
+	// The projection's y scale turns radius over distance into a
+	// fraction of half the screen's height, and the diameter into
+	// the same fraction of all of it
+	XMFLOAT4X4 proj = camera->GetProjection();
+	XMFLOAT3 position = camera->GetTransform()->GetPosition();
+	XMVECTOR cameraPos = XMLoadFloat3(&position);
+	float scale = proj._22 * lodScale;
+
+	const std::vector<Mesh*>& meshes = entities.GetMeshes();
+	JobSystem::GetInstance().ParallelFor((unsigned int)entities.GetCount(), 256, [&](unsigned int start, unsigned int end)
+	{
+		for (unsigned int i = start; i < end; i++)
+		{
+			unsigned int lodCount = meshes[i]->GetLodCount();
+			const BoundingOrientedBox& bounds = entityBounds[i];
+			float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+			float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - cameraPos));
+			float coverage = radius * scale / max(distance, radius);
+
+			unsigned int lod = min((unsigned int)entityLods[i], lodCount - 1);
+			while (lod + 1 < lodCount && coverage < coverages[lod + 1])
+				lod++;
+			while (lod > 0 && coverage > coverages[lod] * (1.0f + LOD_HYSTERESIS))
+				lod--;
+			entityLods[i] = (unsigned char)lod;
+		}
+	});
 }
 
-void Renderer::RenderShadowMap()
+// --------------------------------------------------------------------------
+// Works out how many uvs each visible entity covers per pixel, from its
+// mesh's uv density at the closest its bounds get to the camera, and asks
+// for enough detail in its material's textures for the finest of them
+//  - This is also what marks textures as drawn, which the texture budget
+//    evicts by, so it runs whether or not mips are streamed
+//  - GPU driven culling doesn't leave a visible list, so every entity
+//    counts then, which only means streaming in more than is needed
+// --------------------------------------------------------------------------
+void Renderer::UpdateTextureDetail(Camera* camera)
 {
-	UpdateShadowView(&lights[0]);
+	Assets& assets = Assets::GetInstance();
+
+	// Same projection scale as the lods, turned into world units
+	// across one pixel for each unit away from the camera
+	XMFLOAT4X4 proj = camera->GetProjection();
+	XMFLOAT3 position = camera->GetTransform()->GetPosition();
+	XMVECTOR cameraPos = XMLoadFloat3(&position);
+	float unitsPerPixel = 2.0f / (proj._22 * renderHeight);
+
+	const std::vector<Mesh*>& meshes = entities.GetMeshes();
+	const std::vector<Material*>& materials = entities.GetMaterials();
+	materialTextureDetail.clear();
+	auto addEntity = [&](unsigned int i)
+	{
+		// Without uvs it's the same couple of texels everywhere
+		Mesh* mesh = meshes[i];
+		if (mesh->GetUVDensity() <= 0.0f)
+		{
+			materialTextureDetail.insert({ materials[i], 1.0f });
+			return;
+		}
+
+		// The bounds' size over the mesh's own is roughly the entity's scale
+		const BoundingOrientedBox& bounds = entityBounds[i];
+		float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+		float localRadius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&mesh->GetBounds().Extents)));
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - cameraPos)) - radius;
+
+		XMFLOAT2 uvScale = materials[i]->GetUVScale();
+		float uvsPerUnit = mesh->GetUVDensity() * max(uvScale.x, uvScale.y) * localRadius / max(radius, FLT_EPSILON);
+		float uvPerPixel = uvsPerUnit * max(distance, camera->GetNearClip()) * unitsPerPixel;
+
+		auto existing = materialTextureDetail.find(materials[i]);
+		if (existing == materialTextureDetail.end())
+			materialTextureDetail.insert({ materials[i], uvPerPixel });
+		else
+			existing->second = min(existing->second, uvPerPixel);
+	};
+
+	if (gpuDrivenCulling)
+	{
+		for (unsigned int i = 0; i < entities.GetCount(); i++)
+			addEntity(i);
+	}
+	else
+	{
+		for (auto ge : cameraVisibleEntities)
+			addEntity(entities.GetSceneIndex(ge));
+	}
+
+	for (auto& m : materialTextureDetail)
+	{
+		for (auto& t : m.first->GetPSTextureSRVs())
+			assets.RequestTextureDetail(t.second.Get(), m.second);
+	}
+}
 
-	context->OMSetRenderTargets(0, 0, shadowDepthDSV.Get());
-	context->ClearDepthStencilView(shadowDepthDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-	context->RSSetState(shadowRasterizer.Get());
+// Coarser than what the camera sees, since shadow maps don't hold much detail
+//  - Cached static shadows keep whatever levels they were drawn with until
+//    they're redrawn, which is fine at the resolution of a shadow map
+unsigned int Renderer::GetShadowLod(GameEntity* entity)
+{
+	return min(entityLods[entities.GetSceneIndex(entity)] + shadowLodBias, entity->GetMesh()->GetLodCount() - 1);
+}
 
-	D3D11_VIEWPORT viewport = {};
-	viewport.TopLeftX = 0.0f;
-	viewport.TopLeftY = 0.0f;
-	viewport.Width = (float)shadowMapSize;
-	viewport.Height = (float)shadowMapSize;
-	viewport.MinDepth = 0.0f;
-	viewport.MaxDepth = 1.0f;
-	context->RSSetViewports(1, &viewport);
+// --------------------------------------------------------------------------
+// Sorts entities into static and dynamic shadow casters, by how long
+// their transforms have gone unchanged.  Any entity changing sides (or
+// a static one being removed) means the cached static shadows are stale.
+//  - History is kept by index, so an entity in a different slot than
+//    last frame just starts over as dynamic
+// --------------------------------------------------------------------------
+void Renderer::UpdateStaticCasters()
+{
+	staticCastersChanged = false;
+	for (size_t i = entities.GetCount(); i < entityStaticCaster.size(); i++)
+		staticCastersChanged |= entityStaticCaster[i];
 
-	SimpleVertexShader* shadowVS = Assets::GetInstance().GetVertexShader("ShadowVS.cso");
-	shadowVS->SetShader();
-	shadowVS->SetMatrix4x4("view", shadowViewMatrix);
-	shadowVS->SetMatrix4x4("projection", shadowProjectionMatrix);
-	shadowVS->CopyBufferData("perFrame");
-	context->PSSetShader(0, 0, 0);
+	casterHistory.resize(entities.GetCount(), {});
+	entityStaticCaster.resize(entities.GetCount(), false);
+	staticCasterCount = 0;
 
-	for (auto& e : entities)
+	const std::vector<Transform*>& transforms = entities.GetTransforms();
+	for (unsigned int i = 0; i < entities.GetCount(); i++)
 	{
-		shadowVS->SetMatrix4x4("world", e->GetTransform()->GetWorldMatrix());
-		shadowVS->CopyBufferData("perObject");
+		CasterHistory& history = casterHistory[i];
+		unsigned int version = transforms[i]->GetVersion();
+		if (history.Entity != entities.GetEntity(i) || history.Version != version)
+		{
+			history.Entity = entities.GetEntity(i);
+			history.Version = version;
+			history.StableFrames = 0;
+		}
+		else if (history.StableFrames < STATIC_CASTER_FRAMES)
+		{
+			history.StableFrames++;
+		}
+
+		bool isStatic = staticShadowCaching && history.StableFrames >= STATIC_CASTER_FRAMES;
+		if (isStatic != entityStaticCaster[i])
+			staticCastersChanged = true;
+
+		entityStaticCaster[i] = isStatic;
+		if (isStatic)
+			staticCasterCount++;
+	}
+}
+
+// --------------------------------------------------------------------------
+// Rough number of surfaces covering each pixel, from the screen area of
+// the visible entities' bounding spheres
+//  - Each entity counts at most once, even if it covers the whole screen
+// --------------------------------------------------------------------------
+float Renderer::EstimateDepthComplexity(Camera* camera)
+{
+	XMFLOAT4X4 view = camera->GetView(), proj = camera->GetProjection();
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
 
-		e->GetMesh()->SetBuffersAndDraw(context);
+	float total = 0.0f;
+	for (auto ge : cameraVisibleEntities)
+	{
+		XMFLOAT4X4 world = ge->GetTransform()->GetWorldMatrix();
+		BoundingSphere sphere;
+		ge->GetMesh()->GetBoundingSphere().Transform(sphere, XMLoadFloat4x4(&world));
+
+		// Anything the camera is inside of covers the screen
+		float depth = XMVectorGetZ(XMVector3TransformCoord(XMLoadFloat3(&sphere.Center), viewMatrix));
+		if (depth <= sphere.Radius)
+		{
+			total += 1.0f;
+			continue;
+		}
+
+		// Projected radii in NDC, where the whole screen has an area of 4
+		float radiusX = sphere.Radius * proj._11 / depth;
+		float radiusY = sphere.Radius * proj._22 / depth;
+		total += min(1.0f, XM_PI * radiusX * radiusY / 4.0f);
 	}
 
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
-	viewport.Width = (float)this->windowWidth;
-	viewport.Height = (float)this->windowHeight;
-	context->RSSetViewports(1, &viewport);
-	context->RSSetState(0);
+	return total;
+}
+
+void Renderer::RenderShadowMap(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera)
+{
+	PROFILE_SCOPE("Renderer::RenderShadowMap");
+	DRAW_STATS_PASS("Shadow Map");
+	passContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// Anything could have been bound since the last pass
+	StateCache& states = StateCache::GetInstance();
+	states.Invalidate(passContext);
+	PassState shadowPass;
+	shadowPass.Rasterizer = shadowRasterizer.Get();
+	shadowPass.SetViewport((float)shadowMapSize, (float)shadowMapSize);
+
+	SimpleVertexShader* shadowVS = Assets::GetInstance().GetVertexShader("ShadowVS.cso"_asset);
+	SimpleVertexShader* shadowVSInstanced = Assets::GetInstance().GetVertexShader("ShadowVSInstanced.cso"_asset);
+
+	shadowQueueStats = {};
+	staticShadowRebuilds = 0;
+	int cascadeCount = shadowLightIndex >= 0 ? shadowCascadeCount : 0;
+
+	// Every live projectile, for every cascade
+	shadowProjectileInstances.clear();
+	if (projectiles && cascadeCount > 0)
+		projectiles->BuildInstances(0, shadowProjectileInstances);
+	for (int i = 0; i < cascadeCount; i++)
+	{
+		ShadowCascade& cascade = shadowCascades[i];
+
+		shadowVS->SetMatrix4x4("view", cascade.View);
+		shadowVS->SetMatrix4x4("projection", cascade.Projection);
+		shadowVS->CopyBufferData("perFrame");
+
+		shadowVSInstanced->SetMatrix4x4("view", cascade.View);
+		shadowVSInstanced->SetMatrix4x4("projection", cascade.Projection);
+		shadowVSInstanced->CopyBufferData("perFrame");
+
+		if (staticShadowCaching)
+		{
+			// Redraw the static casters only if the light, the cascade's
+			// fit or the set of static casters has changed since last time
+			if (!cascade.StaticValid || staticCastersChanged ||
+				memcmp(&cascade.StaticView, &cascade.View, sizeof(XMFLOAT4X4)) != 0 ||
+				memcmp(&cascade.StaticProjection, &cascade.Projection, sizeof(XMFLOAT4X4)) != 0)
+			{
+				shadowPass.SetRenderTargets(0, 0, cascade.StaticDSV.Get());
+				states.Apply(passContext, shadowPass);
+				passContext->ClearDepthStencilView(cascade.StaticDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+				// Never occlusion culled, since the cache outlives the camera position
+				CullEntities(cascade.Volume, cascade.StaticCasters, cascade.StaticCulling, false, CullFilter::StaticCasters);
+				DrawShadowCasters(passContext, cascade.View, cascade.FarClip, cascade.StaticCasters, shadowVS, shadowVSInstanced);
+
+				cascade.StaticView = cascade.View;
+				cascade.StaticProjection = cascade.Projection;
+				cascade.StaticValid = true;
+				staticShadowRebuilds++;
+			}
+
+			// Start from the cached depths, then add whatever's moving
+			unsigned int slice = D3D11CalcSubresource(0, i, 1);
+			shadowPass.SetRenderTargets(0, 0, 0);
+			states.Apply(passContext, shadowPass);
+			passContext->CopySubresourceRegion(shadowTexture.Get(), slice, 0, 0, 0, staticShadowTexture.Get(), slice, 0);
+			shadowPass.SetRenderTargets(0, 0, cascade.DSV.Get());
+			states.Apply(passContext, shadowPass);
+
+			CullEntities(cascade.Volume, cascade.Casters, cascade.Culling, occlusionCullShadows, CullFilter::DynamicCasters);
+		}
+		else
+		{
+			shadowPass.SetRenderTargets(0, 0, cascade.DSV.Get());
+			states.Apply(passContext, shadowPass);
+			passContext->ClearDepthStencilView(cascade.DSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+			// Only casters inside this cascade
+			CullEntities(cascade.Volume, cascade.Casters, cascade.Culling, occlusionCullShadows);
+		}
+
+		DrawShadowCasters(passContext, cascade.View, cascade.FarClip, cascade.Casters, shadowVS, shadowVSInstanced, true);
+	}
+
+	// The moments are made from the cascades, so those can't be bound
+	if (shadowFilter != ShadowFilter::Comparison && cascadeCount > 0)
+	{
+		shadowPass.SetRenderTargets(0, 0, 0);
+		states.Apply(passContext, shadowPass);
+		FilterShadowMoments(passContext, cascadeCount);
+	}
+
+	RenderShadowAtlas(passContext, shadowVS, shadowVSInstanced);
+
+	PassState windowPass;
+	windowPass.SetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+	windowPass.SetViewport((float)windowWidth, (float)windowHeight);
+	states.Apply(passContext, windowPass);
+
+}
+
+void Renderer::DrawShadowCasters(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, const XMFLOAT4X4& view, float farClip, std::vector<GameEntity*>& casters, SimpleVertexShader* vs, SimpleVertexShader* instancedVS, bool withProjectiles)
+{
+	// Sorted by mesh (front to back from the light), so
+	// entities sharing a mesh become one instanced draw
+	shadowQueue.Clear();
+	for (auto& e : casters)
+	{
+		shadowQueue.Add(e, view, farClip, RenderPass::DepthOnly, GetShadowLod(e));
+	}
+	shadowQueue.Sort();
+	if (withProjectiles && projectiles)
+		shadowQueue.AddInstances(projectiles->GetMesh(), projectiles->GetMaterial(), shadowProjectileInstances.data(), (unsigned int)shadowProjectileInstances.size());
+	shadowQueue.SubmitDepthOnly(passContext, vs, instancedVS);
+	shadowQueueStats.Accumulate(shadowQueue.GetStats());
+}
+
+// --------------------------------------------------------------------------
+// Turns each cascade's depths into moments, blurred along the rows as
+// they're made and then down the columns, then mipmaps the lot
+//  - Every frame, since the moving casters are drawn over the cached
+//    static ones each frame anyway
+//  - The cascades have to be unbound as depth targets first
+// --------------------------------------------------------------------------
+void Renderer::FilterShadowMoments(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, int cascadeCount)
+{
+	ID3D11UnorderedAccessView* nullUAVs[2] = {};
+	ID3D11ShaderResourceView* nullSRVs[2] = {};
+
+	float exponent = shadowFilter == ShadowFilter::EVSM2 ? EVSM2_EXPONENT : EVSM4_EXPONENT;
+	unsigned int groups = (shadowMapSize + 63) / 64;
+
+	SimpleComputeShader* momentsCS = Assets::GetInstance().GetComputeShader("ShadowMomentsCS.cso"_asset);
+	momentsCS->SetShader();
+	momentsCS->SetFloat2("exponents", XMFLOAT2(exponent, exponent));
+	momentsCS->SetInt("size", shadowMapSize);
+	momentsCS->SetInt("blurRadius", evsmBlurRadius);
+	for (int i = 0; i < cascadeCount; i++)
+	{
+		momentsCS->SetInt("slice", i);
+		momentsCS->SetInt("horizontal", true);
+		momentsCS->CopyAllBufferData();
+		momentsCS->SetShaderResourceView("Depths", shadowDepthSRV);
+		momentsCS->SetUnorderedAccessView("BlurTemp", shadowMomentsTempUAV);
+		momentsCS->DispatchByGroups(groups, shadowMapSize, 1);
+		passContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, 0);
+		ISimpleShader::InvalidateStateCache(passContext);
+
+		momentsCS->SetInt("horizontal", false);
+		momentsCS->CopyAllBufferData();
+		momentsCS->SetShaderResourceView("Moments", shadowMomentsTempSRV);
+		momentsCS->SetUnorderedAccessView("MomentsResult", shadowMomentsUAV);
+		momentsCS->DispatchByGroups(groups, shadowMapSize, 1);
+		passContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, 0);
+		passContext->CSSetShaderResources(0, 2, nullSRVs);
+		ISimpleShader::InvalidateStateCache(passContext);
+	}
+
+	passContext->GenerateMips(shadowMomentsSRV.Get());
+}
 
+// --------------------------------------------------------------------------
+// Hands the atlas this frame's lights, along with where anything that
+// moved this frame is now and was before, so it knows which tiles are
+// stale.  Entities going away could have been in any tile, so that
+// redraws them all.
+// --------------------------------------------------------------------------
+void Renderer::UpdateShadowAtlas(Camera* camera, int lightCount)
+{
+	unsigned int count = entities.GetCount();
+	bool castersRemoved = count < lastEntityCount;
+	lastEntityCount = count;
+
+	movedCasterBounds.clear();
+	size_t known = lastCasterBounds.size();
+	lastCasterBounds.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (casterHistory[i].StableFrames > 0)
+			continue;
+
+		if (i < known)
+			movedCasterBounds.push_back(lastCasterBounds[i]);
+		movedCasterBounds.push_back(entityBounds[i]);
+		lastCasterBounds[i] = entityBounds[i];
+	}
+
+	shadowAtlas.Update(camera, lights, lightCount, localShadows, movedCasterBounds, castersRemoved);
+}
+
+// --------------------------------------------------------------------------
+// Draws the atlas tiles picked this frame, each cleared on its own
+// (with a full screen triangle inside its viewport) since the rest of
+// the atlas is still in use
+// --------------------------------------------------------------------------
+void Renderer::RenderShadowAtlas(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, SimpleVertexShader* vs, SimpleVertexShader* instancedVS)
+{
+	const std::vector<ShadowAtlasRenderTile>& tiles = shadowAtlas.GetRenderTiles();
+	if (tiles.empty())
+		return;
+
+	Assets& assets = Assets::GetInstance();
+	SimpleVertexShader* fullscreenVS = assets.GetVertexShader("FullscreenVS.cso"_asset);
+	SimplePixelShader* clearPS = assets.GetPixelShader("ShadowAtlasClearPS.cso"_asset);
+
+	// Only the viewport and the clear's states change tile to tile
+	StateCache& states = StateCache::GetInstance();
+	PassState clearPass;
+	clearPass.SetRenderTargets(0, 0, shadowAtlas.GetDSV().Get());
+	clearPass.DepthStencil = depthWriteAlwaysState.Get();
+	PassState casterPass;
+	casterPass.SetRenderTargets(0, 0, shadowAtlas.GetDSV().Get());
+	casterPass.Rasterizer = shadowRasterizer.Get();
+
+	for (const ShadowAtlasRenderTile& tile : tiles)
+	{
+		clearPass.Viewport = tile.Viewport;
+		casterPass.Viewport = tile.Viewport;
+
+		states.Apply(passContext, clearPass);
+		fullscreenVS->SetShader();
+		clearPS->SetShader();
+		passContext->Draw(3, 0);
+		DrawStats::Count(DrawCounter::Draws);
+		states.Apply(passContext, casterPass);
+		ISimpleShader::InvalidateStateCache(passContext);
+
+		vs->SetMatrix4x4("view", tile.View);
+		vs->SetMatrix4x4("projection", tile.Projection);
+		vs->CopyBufferData("perFrame");
+
+		instancedVS->SetMatrix4x4("view", tile.View);
+		instancedVS->SetMatrix4x4("projection", tile.Projection);
+		instancedVS->CopyBufferData("perFrame");
+
+		// Anything still settling means this tile's redrawn next time too
+		CullEntities(tile.Frustum, atlasCasters, atlasCulling, false);
+		bool movingCasters = false;
+		for (GameEntity* e : atlasCasters)
+			movingCasters |= casterHistory[entities.GetSceneIndex(e)].StableFrames < STATIC_CASTER_FRAMES;
+		shadowAtlas.SetTileHasMovingCasters(tile, movingCasters);
+
+		DrawShadowCasters(passContext, tile.View, tile.FarClip, atlasCasters, vs, instancedVS);
+	}
+}
+
+
+// Room for a gizmo per light, up to the light limit
+void Renderer::CreateLightGizmoBuffer()
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.ByteWidth = sizeof(LightGizmo) * MAX_LIGHTS;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(LightGizmo);
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, lightGizmoBuffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Light Gizmos");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = MAX_LIGHTS;
+	device->CreateShaderResourceView(lightGizmoBuffer.Get(), &srvDesc, lightGizmoSRV.GetAddressOf());
+}
+
+// The impostors drawn each frame, rewritten by DrawImpostors()
+void Renderer::CreateImpostorBuffer()
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.ByteWidth = sizeof(ImpostorInstance) * IMPOSTOR_MAX_INSTANCES;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(ImpostorInstance);
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, impostorBuffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Impostor Instances");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = IMPOSTOR_MAX_INSTANCES;
+	device->CreateShaderResourceView(impostorBuffer.Get(), &srvDesc, impostorSRV.GetAddressOf());
+}
+
+// Every light, read by both the forward and clustered paths
+//  - Default usage, so that just the lights that changed can be
+//    copied in without rewriting (or renaming) the whole buffer
+void Renderer::CreateLightBuffer()
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.ByteWidth = sizeof(Light) * MAX_LIGHTS;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(Light);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, lightBuffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Lights");
+	lightManager.MarkAllDirty();
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = MAX_LIGHTS;
+	device->CreateShaderResourceView(lightBuffer.Get(), &srvDesc, lightSRV.GetAddressOf());
+}
+
+// Copies just the lights the manager has dirty, as one update
+// for each run of them (see LIGHT_UPLOAD_MERGE_GAP)
+//  - Lights past the count are never read, so they stay dirty
+//    until the count grows to cover them
+void Renderer::UpdateLightBuffer(int lightCount)
+{
+	lightManager.TakeDirtyRanges(lightCount, lightUploadRanges);
+	for (const LightRange& range : lightUploadRanges)
+	{
+		D3D11_BOX box = {};
+		box.left = sizeof(Light) * range.First;
+		box.right = sizeof(Light) * (range.First + range.Count);
+		box.bottom = 1;
+		box.back = 1;
+		context->UpdateSubresource(lightBuffer.Get(), 0, &box, &lights[range.First], 0, 0);
+	}
+}
+
+void Renderer::CreateClusterResources()
+{
+	// The light grid (a count per cluster) and the index list (a fixed
+	// block of indices per cluster) are written by the culling shader
+	// and read by the pixel shaders
+	const unsigned int clusterCount = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+	const unsigned int elementCounts[2] = { clusterCount, clusterCount * MAX_LIGHTS_PER_CLUSTER };
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* srvs[2] = { &clusterLightGridSRV, &clusterLightIndicesSRV };
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>* uavs[2] = { &clusterLightGridUAV, &clusterLightIndicesUAV };
+	for (int i = 0; i < 2; i++)
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+		desc.ByteWidth = sizeof(unsigned int) * elementCounts[i];
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = sizeof(unsigned int);
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		GpuMemory::CreateBuffer(device.Get(), &desc, 0, buffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Cluster Light Lists");
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = elementCounts[i];
+		device->CreateShaderResourceView(buffer.Get(), &srvDesc, srvs[i]->GetAddressOf());
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		uavDesc.Buffer.FirstElement = 0;
+		uavDesc.Buffer.NumElements = elementCounts[i];
+		device->CreateUnorderedAccessView(buffer.Get(), &uavDesc, uavs[i]->GetAddressOf());
+	}
+}
+
+void Renderer::CullLightsIntoClusters(Camera* camera, int lightCount)
+{
+	const ViewConstants& viewConstants = camera->GetViewConstants();
+	XMFLOAT4X4 invProj = viewConstants.InvProjection, view = viewConstants.View, proj = viewConstants.Projection;
+
+	SimpleComputeShader* cs = Assets::GetInstance().GetComputeShader("LightClusterCS.cso"_asset);
+	cs->SetShader();
+	cs->SetMatrix4x4("view", view);
+	cs->SetMatrix4x4("invProjection", invProj);
+	cs->SetFloat2("screenSize", XMFLOAT2((float)windowWidth, (float)windowHeight));
+	cs->SetFloat("cameraNear", camera->GetNearClip());
+	cs->SetFloat("clusterNear", clusterNearDepth);
+	cs->SetFloat("clusterFar", camera->GetFarClip());
+	cs->SetInt("lightCount", lightCount);
+	cs->CopyAllBufferData();
+
+	cs->SetShaderResourceView("Lights", lightSRV);
+	cs->SetUnorderedAccessView("LightGrid", clusterLightGridUAV);
+	cs->SetUnorderedAccessView("LightIndices", clusterLightIndicesUAV);
+	cs->DispatchByThreads(CLUSTER_COUNT_X, CLUSTER_COUNT_Y, CLUSTER_COUNT_Z);
+
+	// Unbind the UAVs so the pixel shaders can read the results
+	ID3D11UnorderedAccessView* nullUAVs[2] = {};
+	context->CSSetUnorderedAccessViews(0, 2, nullUAVs, 0);
+}
+
+void Renderer::CreatePerFrameBuffers()
+{
+	// Start with zeroed data, which matches the zeroed cached copy
+	psFrameData = {};
+
+	D3D11_BUFFER_DESC cbDesc = {};
+	cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	cbDesc.Usage = D3D11_USAGE_DEFAULT;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = &psFrameData;
+	cbDesc.ByteWidth = sizeof(PSPerFrameData);
+	GpuMemory::CreateBuffer(device.Get(), &cbDesc, &initialData, psPerFrameCB.GetAddressOf(), GpuMemoryCategory::Buffers, "PS Per Frame");
+
+	// Every lit shader shares these buffers instead of using its own copy
+	//  - The vertex shaders get the camera's once there is one
+	Assets& assets = Assets::GetInstance();
+	assets.GetPixelShader("PixelShader.cso"_asset)->SetExternalConstantBuffer("perFrame", psPerFrameCB);
+	assets.GetPixelShader("PixelShaderPBR.cso"_asset)->SetExternalConstantBuffer("perFrame", psPerFrameCB);
+	assets.GetComputeShader("DeferredLightingCS.cso"_asset)->SetExternalConstantBuffer("perFrame", psPerFrameCB);
+	assets.GetPixelShader("ImpostorPS.cso"_asset)->SetExternalConstantBuffer("perFrame", psPerFrameCB);
+}
+
+void Renderer::UpdatePerFrameData(Camera* camera, int lightCount)
+{
+	// Both the forward and clustered paths read the same light buffer
+	lightCount = min(lightCount, MAX_LIGHTS);
+	UpdateLightBuffer(lightCount);
+	if (clusteredLighting)
+		CullLightsIntoClusters(camera, lightCount);
+
+	// Build this frame's pixel shader data
+	//  - Zeroed first so any padding compares equal below
+	PSPerFrameData psData = {};
+	psData.LightCount = lightCount;
+	psData.CameraPosition = camera->GetTransform()->GetPosition();
+	psData.SpecIBLTotalMipLevels = sky->IBLGetMipLevels();
+	psData.AmbientNonPBR = ambientNonPBR;
+	psData.ClusteredLighting = clusteredLighting;
+
+	// The sky's irradiance, if it's kept as spherical harmonics
+	psData.UseIrradianceSH = sky->IBLHasIrradianceSH();
+	if (psData.UseIrradianceSH)
+		memcpy(psData.IrradianceSH, sky->IBLGetIrradianceSH(), sizeof(psData.IrradianceSH));
+
+	// Shadow cascades, with unused splits pushed out
+	// to infinity so the shader never picks them
+	//  - None at all without a light to cast them
+	int cascadeCount = shadowLightIndex >= 0 ? shadowCascadeCount : 0;
+	psData.ShadowCascadeCount = cascadeCount;
+	psData.ShadowLightIndex = shadowLightIndex;
+	psData.ShadowFilter = (int)shadowFilter;
+	float exponent = shadowFilter == ShadowFilter::EVSM2 ? EVSM2_EXPONENT : EVSM4_EXPONENT;
+	psData.ShadowMomentParams = XMFLOAT4(exponent, exponent, evsmMinVariance, evsmBleedReduction);
+	for (int i = 0; i < MAX_SHADOW_CASCADES; i++)
+	{
+		if (i < cascadeCount)
+		{
+			psData.ShadowCascadeSplits[i] = shadowCascades[i].SplitDepth;
+			XMStoreFloat4x4(&psData.ShadowViewProjections[i], XMMatrixMultiply(
+				XMLoadFloat4x4(&shadowCascades[i].View),
+				XMLoadFloat4x4(&shadowCascades[i].Projection)));
+		}
+		else
+		{
+			psData.ShadowCascadeSplits[i] = FLT_MAX;
+		}
+	}
+
+	// Values for finding the cluster of each pixel
+	float clusterLogRange = log(camera->GetFarClip() / clusterNearDepth);
+	psData.ClusterTileScale = XMFLOAT2(CLUSTER_COUNT_X / (float)windowWidth, CLUSTER_COUNT_Y / (float)windowHeight);
+	psData.ClusterDepthScaleBias = XMFLOAT2(
+		CLUSTER_COUNT_Z / clusterLogRange,
+		CLUSTER_COUNT_Z * log(clusterNearDepth) / clusterLogRange);
+
+	// And the vertex shaders read the camera's own buffer
+	BindViewBuffer(camera);
+
+	// Only upload when something actually changed
+	if (memcmp(&psData, &psFrameData, sizeof(PSPerFrameData)) != 0)
+	{
+		psFrameData = psData;
+		context->UpdateSubresource(psPerFrameCB.Get(), 0, 0, &psFrameData, 0, 0);
+	}
+}
+
+// --------------------------------------------------------
+// Points the lit vertex shaders at a camera's view buffer,
+// which the camera itself only re-uploads when it moves
+//  - Each camera has its own buffer, so switching between
+//    views is just binding the other one's
+// --------------------------------------------------------
+void Renderer::BindViewBuffer(Camera* camera)
+{
+	Microsoft::WRL::ComPtr<ID3D11Buffer> viewBuffer = camera->GetViewBuffer(device, context);
+	if (!viewBuffer || viewBuffer == vsPerFrameCB)
+		return;
+
+	vsPerFrameCB = viewBuffer;
+	Assets& assets = Assets::GetInstance();
+	assets.GetVertexShader("VertexShader.cso"_asset)->SetExternalConstantBuffer("perFrame", vsPerFrameCB);
+	assets.GetVertexShader("VertexShaderInstanced.cso"_asset)->SetExternalConstantBuffer("perFrame", vsPerFrameCB);
+	assets.GetVertexShader("LightGizmoVS.cso"_asset)->SetExternalConstantBuffer("perFrame", vsPerFrameCB);
+	assets.GetVertexShader("ImpostorVS.cso"_asset)->SetExternalConstantBuffer("perFrame", vsPerFrameCB);
 }
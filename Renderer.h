@@ -1,12 +1,244 @@
 #pragma once
 
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <wrl/client.h>
+#include <DirectXCollision.h>
+#include <unordered_map>
+#include <functional>
 #include <vector>
-#include "GameEntity.h"
+#include <string>
+#include "EntityRegistry.h"
+#include "ProjectilePool.h"
 #include "Sky.h"
 #include "Lights.h"
+#include "LightManager.h"
 #include "Emitter.h"
+#include "RenderQueue.h"
+#include "GpuProfiler.h"
+#include "RenderTargetPool.h"
+#include "HiZBuffer.h"
+#include "GpuCulling.h"
+#include "ParticleBatcher.h"
+#include "DynamicBvh.h"
+#include "DebugViews.h"
+#include "ShadowAtlas.h"
+#include "EntityLightLists.h"
+#include "StateCache.h"
+#include "Impostors.h"
+
+// How the cascades are filtered - should match
+// the definitions in PerFrameData.hlsli
+//  - EVSM keeps exponentially warped depth moments (positive only in
+//    R32G32, or positive and negative in R16G16B16A16), blurred and
+//    mipmapped, so soft edges don't need a bigger map or more taps
+enum class ShadowFilter
+{
+	Comparison,
+	EVSM2,
+	EVSM4
+};
+
+// Exponents each EVSM format can hold without overflowing
+//  - Squared in the second moment, so half the largest exponent
+//    the format itself can hold
+#define EVSM2_EXPONENT				40.0f
+#define EVSM4_EXPONENT				5.0f
+#define EVSM_MAX_BLUR_RADIUS		8	// Must match ShadowMomentsCS.hlsl
+
+// When the depth pre-pass runs
+enum class DepthPrepassMode
+{
+	Off,
+	On,
+	Auto	// Only when the estimated overdraw is high enough
+};
+
+// Frames an entity's transform has to stay the same before
+// it's treated as a static shadow caster
+#define STATIC_CASTER_FRAMES 30
+
+// How much of the screen's height an entity can cover before each
+// mesh level of detail is used (the first is always full detail), and
+// how much further back up an entity has to get before it goes finer
+#define LOD_SCREEN_COVERAGE_1	0.25f
+#define LOD_SCREEN_COVERAGE_2	0.1f
+#define LOD_SCREEN_COVERAGE_3	0.04f
+#define LOD_HYSTERESIS			0.15f
+
+// Entities further than this from the camera are drawn as impostors by
+// default, crossfading from their meshes over this much more of it
+//  - The fade is drawn in this many steps, one draw each
+#define IMPOSTOR_DISTANCE		80.0f
+#define IMPOSTOR_FADE_RANGE		0.15f
+#define IMPOSTOR_FADE_STEPS		8
+
+// Impostors drawn in one frame, at most (the rest stay meshes)
+#define IMPOSTOR_MAX_INSTANCES	8192
+
+// A warm-up draw that takes longer than this the second time round
+// (once the driver's had its chance to compile) still hitches
+#define RENDERER_WARM_UP_HITCH_MS	2.0f
+
+// Temporal upsampling cycles the jitter through this many points of
+// the Halton (2, 3) sequence, and renders at this share of the window
+// by default (when dynamic resolution isn't choosing it)
+#define TEMPORAL_UPSAMPLING_JITTER_SAMPLES	8
+#define TEMPORAL_UPSAMPLING_SCALE			0.67f
+
+// One shader and state combination drawn while warming up, and how
+// long (on the CPU, flush included) its first and second draws took
+struct WarmUpCombination
+{
+	std::string Name;
+	float FirstMs;
+	float SecondMs;
+};
+
+// What Renderer::WarmUp() drew, and what it ran out of time for
+struct WarmUpReport
+{
+	std::vector<WarmUpCombination> Combinations;
+	unsigned int Skipped;
+	float TotalMs;
+};
+
+// Which entities a culling pass considers
+enum class CullFilter
+{
+	All,
+	StaticCasters,
+	DynamicCasters
+};
+
+// How many entities a culling pass kept and rejected
+struct CullingStats
+{
+	unsigned int Visible;
+	unsigned int Culled;	// Outside the volume
+	unsigned int Occluded;	// Inside, but hidden behind the Hi-Z depths
+};
+
+// Which tree leaf holds an entity's bounds, and the transform
+// version those bounds were made from
+struct EntityProxy
+{
+	EntityHandle Handle;
+	unsigned int Version;
+	int Node;
+};
+
+// Pixel shader data that only changes once per frame
+//  - Must match the perFrame cbuffer in PerFrameData.hlsli
+struct PSPerFrameData
+{
+	int LightCount;
+	DirectX::XMFLOAT3 CameraPosition;
+
+	int SpecIBLTotalMipLevels;
+	DirectX::XMFLOAT3 AmbientNonPBR;
+
+	DirectX::XMFLOAT2 ClusterTileScale;
+	DirectX::XMFLOAT2 ClusterDepthScaleBias;
+
+	int ClusteredLighting;
+	int ShadowCascadeCount;
+	int ShadowLightIndex;
+	int ShadowFilter;
+
+	float ShadowCascadeSplits[MAX_SHADOW_CASCADES];
+	DirectX::XMFLOAT4 ShadowMomentParams;
+	DirectX::XMFLOAT4X4 ShadowViewProjections[MAX_SHADOW_CASCADES];
+
+	DirectX::XMFLOAT4 IrradianceSH[9];
+	int UseIrradianceSH;
+	DirectX::XMFLOAT3 Padding2;
+};
+
+// SSAO pixel shader data
+//  - Must match the externalData cbuffer in SsaoPS.hlsl
+struct SsaoPSData
+{
+	DirectX::XMFLOAT4X4 ViewMatrix;
+	DirectX::XMFLOAT4X4 ProjectionMatrix;
+	DirectX::XMFLOAT4X4 InvProjMatrix;
+	DirectX::XMFLOAT4 Offsets[64];
+
+	float SsaoRadius;
+	int SsaoSamples;
+	DirectX::XMFLOAT2 RandomTextureScreenScale;
+
+	int SampleStart;
+	DirectX::XMFLOAT2 UVScale;
+	float Padding;
+};
+
+static const SimpleBufferField SsaoPSDataLayout[] =
+{
+	SIMPLE_BUFFER_FIELD(SsaoPSData, ViewMatrix, "viewMatrix"),
+	SIMPLE_BUFFER_FIELD(SsaoPSData, ProjectionMatrix, "projectionMatrix"),
+	SIMPLE_BUFFER_FIELD(SsaoPSData, InvProjMatrix, "invProjMatrix"),
+	SIMPLE_BUFFER_FIELD(SsaoPSData, Offsets, "offsets"),
+	SIMPLE_BUFFER_FIELD(SsaoPSData, SsaoRadius, "ssaoRadius"),
+	SIMPLE_BUFFER_FIELD(SsaoPSData, SsaoSamples, "ssaoSamples"),
+	SIMPLE_BUFFER_FIELD(SsaoPSData, RandomTextureScreenScale, "randomTextureScreenScale"),
+	SIMPLE_BUFFER_FIELD(SsaoPSData, SampleStart, "sampleStart"),
+	SIMPLE_BUFFER_FIELD(SsaoPSData, UVScale, "uvScale"),
+};
+
+// What the last scene pass drew as impostors
+struct ImpostorStats
+{
+	unsigned int Impostors;		// Entities drawn as one
+	unsigned int Fading;		// Of those, also drawn as meshes
+	unsigned int Draws;
+	unsigned int Baked;			// Mesh and material pairs in the atlas
+	unsigned int Queued;		// Waiting to be baked
+};
+
+// Per light data for the instanced light gizmos
+//  - Must match LightGizmo in LightGizmoVS.hlsl
+struct LightGizmo
+{
+	DirectX::XMFLOAT3 Position;
+	float Scale;
+	DirectX::XMFLOAT3 Color;
+	float Padding;
+};
+
+// One slice of the cascaded shadow map, fitted
+// to part of the camera frustum each frame
+struct ShadowCascade
+{
+	DirectX::XMFLOAT4X4 View;
+	DirectX::XMFLOAT4X4 Projection;
+	float SplitDepth;	// View space depth where this cascade ends
+	float FarClip;
+	DirectX::BoundingOrientedBox Volume;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> DSV;
+
+	// Casters inside this cascade's volume
+	std::vector<GameEntity*> Casters;
+	CullingStats Culling;
+
+	// The static casters, drawn into a separate cached slice that's only
+	// redrawn when the matrices it was drawn with (or the casters) change
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> StaticDSV;
+	DirectX::XMFLOAT4X4 StaticView;
+	DirectX::XMFLOAT4X4 StaticProjection;
+	bool StaticValid;
+	std::vector<GameEntity*> StaticCasters;
+	CullingStats StaticCulling;
+};
+
+// What an entity's transform looked like last frame, for
+// telling static shadow casters from moving ones
+struct CasterHistory
+{
+	GameEntity* Entity;
+	unsigned int Version;
+	unsigned int StableFrames;
+};
 
 class Renderer
 {
@@ -14,58 +246,435 @@ class Renderer
 private:
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;	// For DiscardView(), if available
 	Microsoft::WRL::ComPtr<IDXGISwapChain> swapChain;
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> backBufferUAV;
+	void CreateBackBufferUAV();
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthBufferSRV;	// Hardware depth, read by SSAO
 
 	unsigned int windowWidth;
 	unsigned int windowHeight;
 
 	Sky* sky;
 
-	const std::vector<GameEntity*>& entities;
-	const std::vector<Light>& lights;
+	EntityRegistry& entities;
+	LightManager& lightManager;
+	const std::vector<Light>& lights;	// The manager's, in buffer order
 	const std::vector<Emitter*>& emitters;
 
+	// Drawn as one batch of instances in the scene pass and the
+	// cascades (the atlas tiles can keep their depths between
+	// frames, so nothing that moves every frame goes in them)
+	ProjectilePool* projectiles = 0;
+	std::vector<InstanceData> projectileInstances;
+	std::vector<InstanceData> shadowProjectileInstances;
+
+	// Sorted (and instanced, where possible) draws for
+	// the main scene pass and the shadow map
+	RenderQueue renderQueue;
+	RenderQueue shadowQueue;
+	bool instancing;
+
+	// Deferred shading - the scene pass writes each surface to the
+	// G-buffer (see GBuffer.hlsli), then DeferredLightingCS.hlsl lights
+	// every pixel once, however many surfaces were drawn over it
+	//  - Entities whose materials have no G-buffer shader are drawn
+	//    forward over the lit result, from forwardQueue
+	//  - GPU driven culling stays forward, since its buckets draw
+	//    with each material's forward shader
+	bool deferredShading;
+	bool deferredShadingActive;
+	RenderQueue forwardQueue;
+	void LightGBuffer(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, ID3D11ShaderResourceView* frameSRVs[12], ID3D11SamplerState* shadowSamplers[2]);
+
+	// GPU timing for each pass
+	GpuProfiler gpuProfiler;
+
+	// Multithreaded recording - the shadow, scene and particle
+	// passes are recorded into deferred contexts (two of them on
+	// worker threads) and then executed in order on the immediate context
+	bool multithreadedRecording;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> shadowContext;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> sceneContext;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> particleContext;
+	Microsoft::WRL::ComPtr<ID3D11CommandList> shadowCommandList;
+	Microsoft::WRL::ComPtr<ID3D11CommandList> sceneCommandList;
+	Microsoft::WRL::ComPtr<ID3D11CommandList> particleCommandList;
+	void RecordShadowPass(Camera* camera);
+	void RecordScenePass(Camera* camera, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh);
+	void RecordParticlePass(Camera* camera, float totalTime);
+
+	// Each pass sets all of its own state, so it can be
+	// drawn directly or recorded on a deferred context
+	void RenderScene(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh);
+	void RenderParticles(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, float totalTime);
+	void SetWindowViewport(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext);
+	void DrawParticlePass(Camera* camera, float totalTime);
+
+	// Marks the end of a pass on the immediate context, for the GPU
+	// profiler's timings and the draw stats alike
+	void EndPass(const char* name);
+
+	// Dynamic resolution - the scene and SSAO render into a viewport of
+	// renderScale times the window size, inside the full size targets,
+	// and the combine upscales it to the back buffer
+	//  - The scale follows the GPU frame time towards the target, in
+	//    small steps since the timings are a few frames old
+	//  - The depth buffer only matches the scaled viewport, so particles
+	//    are drawn into the scene colors (before the upscale) instead
+	bool dynamicResolution;
+	float renderScale;
+	float dynamicResolutionTargetMs;
+	float minRenderScale;
+	float maxRenderScale;
+	unsigned int renderWidth;
+	unsigned int renderHeight;
+	void UpdateDynamicResolution();
+
+	// Temporal upsampling - the scene renders at temporalUpsamplingScale
+	// (or the dynamic scale) with a different sub-pixel jitter each frame,
+	// and a pass after the combine builds the full resolution image up
+	// from the jittered frames, reprojected with per-pixel motion vectors
+	//  - History is clamped to the colors around each pixel this frame,
+	//    which keeps anything that's been uncovered from smearing
+	//  - The history is ping-ponged, and written along with the back buffer
+	bool temporalUpsampling;
+	float temporalUpsamplingScale;
+	unsigned int jitterIndex;
+	DirectX::XMFLOAT2 jitterPixels;	// This frame's, in render pixels
+	int taaHistoryIndex;
+	bool taaHistoryValid;
+	void UpdateJitter(Camera* camera);
+	void TemporalUpsample(Camera* camera, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depths);
+
+	// Anything rendered at renderWidth by renderHeight and upscaled later
+	bool ReducedResolution() { return dynamicResolution || temporalUpsampling; }
+
+	// Frustum culling, with the world space bounds of every
+	// entity calculated once per frame and shared by each pass
+	//  - Bounds only change when a transform does, and the tree
+	//    (holding scene indices) lets each pass skip straight to
+	//    what's inside rather than testing every entity
+	bool frustumCulling;
+	std::vector<DirectX::BoundingOrientedBox> entityBounds;
+	std::vector<EntityProxy> entityProxies;
+	DynamicBvh entityTree;
+	std::vector<GameEntity*> cameraVisibleEntities;
+	CullingStats cameraCullingStats;
+	void UpdateEntityBounds();
+	template<typename Volume>
+	void CullEntities(const Volume& volume, std::vector<GameEntity*>& visible, CullingStats& stats, bool useOcclusion, CullFilter filter = CullFilter::All);
+
+	// Occlusion culling against a Hi-Z pyramid of an earlier frame's
+	// depth, read back a few frames later so nothing waits on the GPU
+	//  - Occluded entities can also skip the shadow map, though an
+	//    entity hidden from the camera may still cast a visible shadow
+	HiZBuffer hiZBuffer;
+	bool occlusionCulling;
+	bool occlusionCullShadows;
+	std::vector<unsigned char> entityOccluded;
+	void UpdateEntityOcclusion();
+
+	// GPU driven culling - the camera pass culls the whole scene in a
+	// compute shader (against the newest Hi-Z pyramid, without waiting
+	// for a readback) and draws each bucket with indirect draws
+	//  - Shadows stay on the CPU, and auto pre-pass can't estimate the
+	//    depth complexity without a visible list, so it stays off
+	GpuCulling gpuCulling;
+	bool gpuDrivenCulling;
+
+	// Mesh level of detail for each entity, picked by how much of the
+	// screen its bounds cover and kept by index from frame to frame
+	//  - Shadow maps use levels shadowLodBias coarser than the camera,
+	//    since they're blurred by filtering anyway
+	bool meshLods;
+	float lodScale;
+	unsigned int shadowLodBias;
+	std::vector<unsigned char> entityLods;
+	unsigned int visibleLodCounts[MESH_MAX_LODS];
+	void UpdateEntityLods(Camera* camera);
+	unsigned int GetShadowLod(GameEntity* entity);
+
+	// Far away entities are drawn as a quad of their baked views instead
+	// of their meshes, past impostorDistance, after the sky (so the ones
+	// fading in blend over whatever's behind them)
+	//  - Only for camera culled entities whose material has a G-buffer
+	//    shader to bake with, and never in shadows or the depth pre-pass
+	//  - Crossfading ones are also drawn as meshes, and fade in by blend
+	//    factor a step at a time, from the front of their bounds
+	ImpostorAtlas impostorAtlas;
+	bool impostors;
+	float impostorDistance;
+	ImpostorStats impostorStats;
+	std::vector<ImpostorInstance> impostorInstances;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> impostorBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> impostorSRV;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> impostorBlend;
+	void CreateImpostorBuffer();
+	void DrawImpostors(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, PassState& scenePass);
+
+	// Texel density for mip streaming - the finest each material is drawn
+	// at, as the distance in uv space across a pixel, which Assets turns
+	// into the mips each of its textures needs
+	std::unordered_map<Material*, float> materialTextureDetail;
+	void UpdateTextureDetail(Camera* camera);
+
+	// Depth pre-pass - lays down depth for the visible entities first,
+	// so the scene pass only shades the closest surface of each pixel
+	//  - Auto only runs it when the visible entities' estimated depth
+	//    complexity is above depthPrepassThreshold
+	DepthPrepassMode depthPrepassMode;
+	float depthPrepassThreshold;
+	float estimatedDepthComplexity;
+	bool depthPrepassActive;
+	RenderQueueStats depthPrepassStats;
+	unsigned int bufferUploadsIssued;
+	unsigned int bufferUploadsSkipped;
+	unsigned int bindsSkipped;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthEqualState;
+	float EstimateDepthComplexity(Camera* camera);
+
 	// SSAO variables
+	//  - SSAO runs at 1/ssaoResolutionScale of the window size, on
+	//    downsampled depths and normals, and is upsampled in the combine
 	DirectX::XMFLOAT4 ssaoOffsets[64];
 	int ssaoSamples;
 	float ssaoRadius;
+	int ssaoResolutionScale;
+	float ssaoDepthSharpness;
+	unsigned int ssaoWidth;
+	unsigned int ssaoHeight;
+
+	// Compute SSAO - the same SSAO with the depths around each group of
+	// pixels in group shared memory, and a separable two pass blur
+	bool computeSSAO;
+
+	// Fused SSAO combine - the blur done in group shared memory as part
+	// of a compute combine, which writes the back buffer directly (or
+	// the temporal upsampling input)
+	bool fusedSSAOCombine;
+	void CombineSSAOFused(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssao, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoDepths, unsigned int ssaoViewWidth, unsigned int ssaoViewHeight, DirectX::XMFLOAT2 depthParams,
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> output, unsigned int outputWidth, unsigned int outputHeight);
+
+	// Temporal SSAO - a few samples a frame, cycling through the offsets,
+	// blended with last frame's result reprojected into this frame
+	//  - The history is ping-ponged between two targets, and keeps each
+	//    pixel's view depth and normal for rejecting mismatched history
+	bool temporalSSAO;
+	int ssaoTemporalSamples;
+	unsigned int ssaoFrameIndex;
+	int ssaoHistoryIndex;
+	bool ssaoHistoryValid;
+	DirectX::XMFLOAT4X4 prevViewProjection;
+	DirectX::XMFLOAT2 ssaoHistoryUVScale;	// Its viewport's share of the history target
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> postProcessWrapSampler;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> postProcessClampSampler;
 	
-	//Shadow Variable
-	int shadowMapSize = 4096;
-	float shadowProjectionSize = 40.0f;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDepthDSV;
+	//Shadow Variables
+	//  - Cascades cover the camera frustum out to shadowDistance,
+	//    split with a blend of logarithmic and uniform spacing
+	int shadowMapSize = 1024;
+	int shadowCascadeCount = 4;
+	float shadowDistance = 80.0f;
+	float shadowCascadeLambda = 0.75f;
+	float shadowCasterDistance = 50.0f;	// How far behind each cascade casters are still drawn
+	ShadowCascade shadowCascades[MAX_SHADOW_CASCADES];
+	RenderQueueStats shadowQueueStats;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowDepthSRV;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
-	DirectX::XMFLOAT4X4 shadowViewMatrix;
-	DirectX::XMFLOAT4X4 shadowProjectionMatrix;
+
+	// The cascade the shadow map debug view shows
+	int shadowDebugCascade = 0;
+
+	// Filtered shadows - with EVSM, each cascade's depth is turned
+	// into moments and blurred (in ShadowMomentsCS) after it's drawn,
+	// then the whole array's mipmapped
+	//  - The depth map is still drawn (and cached) the same way
+	ShadowFilter shadowFilter;
+	int evsmBlurRadius;
+	float evsmBleedReduction;
+	float evsmMinVariance;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowMomentsTexture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowMomentsSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> shadowMomentsUAV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowMomentsTempSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> shadowMomentsTempUAV;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowMomentSampler;
+	void CreateShadowMoments();
+	void FilterShadowMoments(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, int cascadeCount);
+
 	void CreateShadowMap();
 	void CreateShadowMapResources();
-	void UpdateShadowProjection();
-	void UpdateShadowView(const Light* light);
-	void RenderShadowMap();
+	void UpdateShadowCascades(Camera* camera, const Light* light);
+	void RenderShadowMap(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera);
+	void DrawShadowCasters(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, const DirectX::XMFLOAT4X4& view, float farClip, std::vector<GameEntity*>& casters, SimpleVertexShader* vs, SimpleVertexShader* instancedVS, bool withProjectiles = false);
+
+	// Static shadow caching - entities that haven't moved for a while are
+	// drawn into a cached copy of each cascade, which each frame is copied
+	// into the shadow map before the moving casters are drawn over it
+	//  - The cache is redrawn when the light or cascade fit changes, or
+	//    when an entity becomes static or stops being static
+	bool staticShadowCaching;
+	bool staticCastersChanged;
+	unsigned int staticCasterCount;
+	unsigned int staticShadowRebuilds;	// Cascades redrawn this frame
+	std::vector<CasterHistory> casterHistory;
+	std::vector<bool> entityStaticCaster;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staticShadowTexture;
+	void UpdateStaticCasters();
+
+	// Point and spot light shadows, drawn into tiles of one atlas
+	//  - The cascades are only for the first shadow casting directional
+	//    light (shadowLightIndex, or -1 with none)
+	//  - Entities that just moved (or appeared) and whether any were
+	//    removed tell the atlas which of its tiles are stale
+	bool localShadows;
+	int shadowLightIndex;
+	unsigned int lastEntityCount;
+	std::vector<DirectX::BoundingOrientedBox> movedCasterBounds;
+	std::vector<DirectX::BoundingOrientedBox> lastCasterBounds;	// Where each entity was, to catch it leaving a tile
+	std::vector<GameEntity*> atlasCasters;
+	CullingStats atlasCulling;
+	void UpdateShadowAtlas(Camera* camera, int lightCount);
+	void RenderShadowAtlas(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, SimpleVertexShader* vs, SimpleVertexShader* instancedVS);
 
 	DirectX::XMFLOAT3 ambientNonPBR;
 
+	// Every light, in a structured buffer that's only
+	// updated where the light manager has them dirty
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lightBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightSRV;
+	std::vector<LightRange> lightUploadRanges;
+	void CreateLightBuffer();
+	void UpdateLightBuffer(int lightCount);
+
+	// Clustered light culling
+	bool clusteredLighting;
+	float clusterNearDepth;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> clusterLightGridSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> clusterLightGridUAV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> clusterLightIndicesSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> clusterLightIndicesUAV;
+	void CreateClusterResources();
+	void CullLightsIntoClusters(Camera* camera, int lightCount);
+
+	// Per entity light lists - with clustering off (and culling on the
+	// CPU), each visible entity is lit by just the lights whose range
+	// reaches its bounds, rather than every light
+	bool perEntityLights;
+	bool perEntityLightsActive;
+	EntityLightLists entityLightLists;
+	std::vector<DirectX::BoundingSphere> entityLightSpheres;
+
+	// Point light gizmos, drawn with one instanced draw
+	// from a structured buffer of every point light
+	bool instancedLightGizmos;
+
+	// Set by the game each frame, for its VSync mode
+	unsigned int presentSyncInterval;
+	unsigned int presentFlags;
+	HRESULT presentResult;
+
+	// Set by the game each frame it wants to turn the camera as late as it can
+	std::function<void()> cameraLateLatch;
+
+	// Frames drawn by WarmUp() skip ImGui (which has no frame yet) and Present()
+	bool warmingUp;
+
+	// Whether the game started an ImGui frame this frame, which is drawn
+	// (with the debug views' thumbnails updated for it) only if it did
+	bool uiVisible;
+
+	// Every CPU simulated emitter batched into as few draws as there
+	// are texture and pixel shader pairs (see ParticleBatcher)
+	ParticleBatcher particleBatcher;
+	bool batchedParticles;
+	std::vector<LightGizmo> lightGizmos;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lightGizmoBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightGizmoSRV;
+	void CreateLightGizmoBuffer();
+	void DrawPointLightsInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, int lightCount, Mesh* lightMesh);
+
+	// Per frame data, shared by all lit shaders and only
+	// uploaded when it differs from the cached copy
+	//  - The vertex shaders' is the camera's own view buffer,
+	//    which is only re-pointed when the camera changes
+	PSPerFrameData psFrameData;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> psPerFrameCB;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> vsPerFrameCB;
+	void CreatePerFrameBuffers();
+	void BindViewBuffer(Camera* camera);
+	void UpdatePerFrameData(Camera* camera, int lightCount);
+
 	//Alt Render Targets
+	//  - The scene pass writes a packed G-buffer (see GBuffer.hlsli):
+	//    color with ambient folded in, and octahedral normals
+	//  - All of these come from the pool, so targets used by
+	//    passes that don't overlap may be the same texture
+	RenderTargetPool renderTargetPool;
+	bool renderTargetAliasing;
+	void CreateRenderTargets();
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneColorsRTV;
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneNormalsRTV;
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneAmbientRTV;
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneDepthRTV;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneAlbedoRTV;	// Only with deferred shading
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> sceneSurfaceRTV;
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ssaoResultRTV;
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ssaoBlurRTV;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ssaoNormalsRTV;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ssaoDepthRTV;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ssaoHistoryRTV[2];
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> motionVectorsRTV;	// Only with temporal upsampling
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> taaInputRTV;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> taaHistoryRTV[2];
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneColorsSRV;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneNormalsSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneAmbientSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneDepthSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneAlbedoSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sceneSurfaceSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> sceneColorsUAV;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoResultSRV;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoBlurSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoNormalsSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoDepthSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoHistorySRV[2];
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> motionVectorsSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> taaInputSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> taaHistorySRV[2];
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> taaInputUAV;	// For the fused combine
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ssaoBlurTempSRV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> ssaoResultUAV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> ssaoBlurUAV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> ssaoBlurTempUAV;
 	Microsoft::WRL::ComPtr<ID3D11BlendState> particleBlendAdditive;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> particleBlendSceneColors;	// Leaves the packed ambient alone
+	Microsoft::WRL::ComPtr<ID3D11BlendState> particleBlendPremultiplied;	// For depth sorted emitters
+	Microsoft::WRL::ComPtr<ID3D11BlendState> particleBlendPremultipliedSceneColors;
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> particleDepthState;
 
-	void CreateGenericRenderTarget(unsigned int width, unsigned int height, Microsoft::WRL::ComPtr<ID3D11RenderTargetView>& rtv, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv, DXGI_FORMAT colorFormat = DXGI_FORMAT_R8G8B8A8_UNORM);
+	// Thumbnails of the targets above (and the shadow map) for the UI,
+	// only drawn for the ones it's showing
+	DebugViews debugViews;
+	ShadowAtlas shadowAtlas;
+	void UpdateDebugViews(Camera* camera, DirectX::XMFLOAT2 ssaoUVScale);
+
+	// Low resolution particles: emitters that opt in (see
+	// Emitter::SetLowResolution()) are drawn at 1/particleResolutionScale
+	// of the size, depth tested against the closest depth of each block,
+	// then composited over everything else with a depth aware upsample
+	//  - A scale of 1 draws every emitter at full resolution
+	int particleResolutionScale;
+	float particleCompositeDepthThreshold;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> particleColorsRTV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleColorsSRV;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> particleDepthDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleDepthSRV;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> particleBlendLowResAdditive;	// Leaves the coverage alone
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depthWriteAlwaysState;
+	void DrawEmitters(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, PassState& particlePass, Camera* camera, float totalTime, bool lowResolution, ID3D11BlendState* additiveBlend, ID3D11BlendState* premultipliedBlend);
+	void RenderLowResolutionParticles(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, PassState& particlePass, Camera* camera, float totalTime, ID3D11RenderTargetView* target);
 
 public:
 
@@ -74,27 +683,212 @@ public:
 		Microsoft::WRL::ComPtr<IDXGISwapChain> swapChain,
 		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV,
 		Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthBufferSRV,
 		unsigned int windowWidth,
 		unsigned int windowHeight,
 		Sky* sky,
-		std::vector<GameEntity*>& entities,
-		std::vector<Light>& lights,
+		EntityRegistry& entities,
+		LightManager& lights,
 		std::vector<Emitter*>& emitters);
 
 
 
-	void PostResize(unsigned int windowWidth, unsigned int windowHeight, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV);
+	void PostResize(unsigned int windowWidth, unsigned int windowHeight, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthBufferSRV);
 
 	void Render(Camera* camera, float totalTime, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh);
 
-	void DrawPointLights(Camera* camera, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh);
+	// What the end of Render() presents with (see DXCore::GetPresentOptions()),
+	// and what the last present returned (like DXGI_STATUS_OCCLUDED)
+	void SetPresentOptions(unsigned int syncInterval, unsigned int flags);
+	HRESULT GetPresentResult() { return presentResult; }
+
+	// Called part way into Render(), once culling's done and just before
+	// the shadow cascades and per frame data are made from the camera, so
+	// the camera can be turned with the input that's come in since Update
+	//  - Culling has already used the earlier view, which is only a few
+	//    milliseconds old, so anything it drops at the edges is off screen
+	//    for a frame at most
+	void SetCameraLateLatch(std::function<void()> lateLatch);
+
+	// Set by the game each frame, before it'd start ImGui's frame
+	void SetUIVisible(bool visible) { uiVisible = visible; }
+	bool GetUIVisible() { return uiVisible; }
+
+	// Draws every shader and state combination the materials and passes
+	// can use once, off screen, so drivers compile them before the first
+	// frame that needs one instead of during it
+	//  - Each material's shaders in the forward and G-buffer targets, as
+	//    a zero scale draw into a 1x1 viewport, then whole frames (not
+	//    presented) with each pass option flipped, for the SSAO chain,
+	//    particles and the rest
+	//  - Anything left when the budget runs out is only counted
+	WarmUpReport WarmUp(Camera* camera, const std::vector<Material*>& materials, Mesh* mesh, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh, float budgetMs);
+
+	void DrawPointLights(Microsoft::WRL::ComPtr<ID3D11DeviceContext> passContext, Camera* camera, int lightCount, SimpleVertexShader* lightVS, SimplePixelShader* lightPS, Mesh* lightMesh);
 
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSceneColorsSRV();
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSceneNormalsSRV();
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSceneAmbientSRV();
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSceneDepthSRV();
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSSAO();
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetShadowSRV();
 
+	const RenderQueueStats& GetRenderQueueStats();
+	const RenderQueueStats& GetShadowQueueStats();
+
+	// Constant buffer uploads during the last frame
+	unsigned int GetBufferUploadsIssued() { return bufferUploadsIssued; }
+	unsigned int GetBufferUploadsSkipped() { return bufferUploadsSkipped; }
+
+	// Shader binds skipped because they were already bound, during the last frame
+	unsigned int GetBindsSkipped() { return bindsSkipped; }
+	bool GetStateCaching() { return ISimpleShader::GetStateCaching(); }
+	void SetStateCaching(bool enabled) { ISimpleShader::SetStateCaching(enabled); }
+
+	bool GetInstancing();
+	void SetInstancing(bool enabled);
+
+	int GetSSAOSamples();
+	void SetSSAOSamples(int samples);
+	float GetSSAORadius();
+	void SetSSAORadius(float radius);
+	int GetSSAOResolutionScale();
+	void SetSSAOResolutionScale(int scale);
+
+	int GetParticleResolutionScale();
+	void SetParticleResolutionScale(int scale);
+	bool GetComputeSSAO();
+	void SetComputeSSAO(bool enabled);
+	bool GetFusedSSAOCombine();
+	void SetFusedSSAOCombine(bool enabled);
+	bool GetTemporalSSAO();
+	void SetTemporalSSAO(bool enabled);
+	int GetSSAOTemporalSamples();
+	void SetSSAOTemporalSamples(int samples);
+	bool GetDynamicResolution();
+	void SetDynamicResolution(bool enabled);
+	float GetDynamicResolutionTargetMs();
+	void SetDynamicResolutionTargetMs(float ms);
+	float GetMinRenderScale();
+	void SetMinRenderScale(float scale);
+	float GetMaxRenderScale();
+	void SetMaxRenderScale(float scale);
+	float GetRenderScale();
+	bool GetTemporalUpsampling();
+	void SetTemporalUpsampling(bool enabled);
+	float GetTemporalUpsamplingScale();
+	void SetTemporalUpsamplingScale(float scale);
+
+	GpuProfiler& GetGpuProfiler();
+	RenderTargetPool& GetRenderTargetPool();
+	DebugViews& GetDebugViews();
+
+	bool GetRenderTargetAliasing();
+	void SetRenderTargetAliasing(bool enabled);
+
+	bool GetMultithreadedRecording();
+	void SetMultithreadedRecording(bool enabled);
+
+	const CullingStats& GetCameraCullingStats();
+	const CullingStats& GetShadowCullingStats(int cascade);
+	const CullingStats& GetStaticShadowCullingStats(int cascade);
+
+	int GetShadowCascadeCount();
+	void SetShadowCascadeCount(int count);
+	int GetShadowMapSize();
+	void SetShadowMapSize(int size);
+	int GetShadowDebugCascade();
+	void SetShadowDebugCascade(int cascade);
+	ShadowFilter GetShadowFilter();
+	void SetShadowFilter(ShadowFilter filter);
+	int GetEVSMBlurRadius();
+	void SetEVSMBlurRadius(int radius);
+	float GetEVSMBleedReduction();
+	void SetEVSMBleedReduction(float reduction);
+	bool GetFrustumCulling();
+	void SetFrustumCulling(bool enabled);
+
+	void SetProjectiles(ProjectilePool* pool) { projectiles = pool; }
+
+	// Scene entity bounds as of the last frame rendered
+	const DynamicBvh& GetEntityTree();
+	const DirectX::BoundingOrientedBox& GetEntityBounds(unsigned int index);
+	unsigned int GetEntityBoundsCount();
+
+	// Moves everything kept per scene index along with the registry's
+	// arrays when they're reordered (see EntityRegistry::SortSpatially()),
+	// rather than it being started over as if every entity had changed
+	void RemapSceneOrder(const std::vector<unsigned int>& order);
+
+	bool GetOcclusionCulling();
+	void SetOcclusionCulling(bool enabled);
+	bool GetOcclusionCullShadows();
+	void SetOcclusionCullShadows(bool enabled);
+	bool GetMeshLods();
+	void SetMeshLods(bool enabled);
+	float GetLodScale();
+	void SetLodScale(float scale);
+	unsigned int GetShadowLodBias();
+	void SetShadowLodBias(unsigned int bias);
+	unsigned int GetVisibleLodCount(unsigned int lod);
+
+	bool GetImpostors();
+	void SetImpostors(bool enabled);
+	float GetImpostorDistance();
+	void SetImpostorDistance(float distance);
+	const ImpostorStats& GetImpostorStats();
+
+	bool GetGpuDrivenCulling();
+	void SetGpuDrivenCulling(bool enabled);
+	const GpuCullingStats& GetGpuCullingStats();
+
+	bool GetStaticShadowCaching();
+	void SetStaticShadowCaching(bool enabled);
+	unsigned int GetStaticCasterCount();
+	unsigned int GetStaticShadowRebuilds();
+
+	bool GetLocalShadows();
+	void SetLocalShadows(bool enabled);
+	unsigned int GetShadowAtlasSize();
+	void SetShadowAtlasSize(unsigned int size);
+	unsigned int GetShadowAtlasBudget();
+	void SetShadowAtlasBudget(unsigned int tiles);
+	const ShadowAtlasStats& GetShadowAtlasStats();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetShadowAtlasSRV();
+
+	DepthPrepassMode GetDepthPrepassMode();
+	void SetDepthPrepassMode(DepthPrepassMode mode);
+	float GetDepthPrepassThreshold();
+	void SetDepthPrepassThreshold(float threshold);
+	float GetEstimatedDepthComplexity();
+	bool GetDepthPrepassActive();
+	const RenderQueueStats& GetDepthPrepassStats();
+
+	bool GetDeferredShading();
+	void SetDeferredShading(bool enabled);
+	bool GetDeferredShadingActive();
+	const RenderQueueStats& GetForwardQueueStats();
+
+	bool GetInstancedLightGizmos();
+	void SetInstancedLightGizmos(bool enabled);
+
+	bool GetBatchedParticles();
+	void SetBatchedParticles(bool enabled);
+	const ParticleBatchStats& GetParticleBatchStats();
+
+	bool GetClusteredLighting();
+	void SetClusteredLighting(bool enabled);
+
+	bool GetPerEntityLights();
+	void SetPerEntityLights(bool enabled);
+	bool GetPerEntityLightsActive();
+	unsigned int GetEntityLightCap();
+	void SetEntityLightCap(unsigned int lights);
+	const EntityLightListStats& GetEntityLightListStats();
+
+	// Sets one of the options above by name, from text like "1", "0.5" or
+	// (for the depth pre-pass) "auto", returning false for a name it doesn't
+	// know, so runs can be set up from the command line
+	bool ApplySetting(const std::string& name, const std::string& value);
+
 };
 
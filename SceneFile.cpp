@@ -0,0 +1,495 @@
+#include "SceneFile.h"
+
+#include <Windows.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+using namespace DirectX;
+
+// Sections start on this, so records are read aligned from the mapping
+#define SCENE_FILE_SECTION_ALIGNMENT	16
+
+AssetKey SceneView::GetKey(unsigned int name) const
+{
+	const SceneFileName& n = Names[name];
+	return { n.Hash, NameCharacters + n.Offset, n.Length };
+}
+
+std::string SceneView::GetName(unsigned int name) const
+{
+	if (name >= NameCount)
+		return std::string();
+
+	const SceneFileName& n = Names[name];
+	return std::string(NameCharacters + n.Offset, n.Length);
+}
+
+unsigned int SceneData::AddName(const std::string& name)
+{
+	unsigned long long hash = HashAssetName(name.c_str(), name.size());
+	for (unsigned int i = 0; i < (unsigned int)Names.size(); i++)
+	{
+		const SceneFileName& n = Names[i];
+		if (n.Hash == hash && n.Length == name.size() && memcmp(&NameCharacters[n.Offset], name.data(), name.size()) == 0)
+			return i;
+	}
+
+	SceneFileName n = { hash, (unsigned int)NameCharacters.size(), (unsigned int)name.size() };
+	NameCharacters.insert(NameCharacters.end(), name.begin(), name.end());
+	Names.push_back(n);
+	return (unsigned int)Names.size() - 1;
+}
+
+void SceneData::AddTexture(const std::string& slot, const std::string& texture, unsigned int flags)
+{
+	if (Materials.empty() || Materials.back().TextureCount >= SCENE_FILE_MAX_TEXTURES)
+		return;
+
+	SceneFileMaterial& material = Materials.back();
+	material.Textures[material.TextureCount++] = { AddName(slot), AddName(texture), flags };
+}
+
+SceneView SceneData::GetView() const
+{
+	SceneView view = {};
+	view.Names = Names.data();
+	view.NameCharacters = NameCharacters.data();
+	view.Materials = Materials.data();
+	view.Entities = Entities.data();
+	view.Lights = Lights.data();
+	view.Emitters = Emitters.data();
+	view.NameCount = (unsigned int)Names.size();
+	view.MaterialCount = (unsigned int)Materials.size();
+	view.EntityCount = (unsigned int)Entities.size();
+	view.LightCount = (unsigned int)Lights.size();
+	view.EmitterCount = (unsigned int)Emitters.size();
+	return view;
+}
+
+void SceneData::Clear()
+{
+	Names.clear();
+	NameCharacters.clear();
+	Materials.clear();
+	Entities.clear();
+	Lights.clear();
+	Emitters.clear();
+}
+
+bool SceneData::IsTextPath(const std::string& path)
+{
+	return path.size() >= 4 && _stricmp(path.c_str() + path.size() - 4, ".txt") == 0;
+}
+
+bool SceneData::Save(const std::string& path) const
+{
+	return IsTextPath(path) ? SaveText(path) : SaveBinary(path);
+}
+
+// --------------------------------------------------------
+// Reads either kind, copying a binary scene out of its
+// mapping so it can be changed
+// --------------------------------------------------------
+bool SceneData::Load(const std::string& path)
+{
+	if (IsTextPath(path))
+		return LoadText(path);
+
+	SceneFile file;
+	if (!file.Open(path))
+		return false;
+
+	const SceneView& view = file.GetView();
+	Clear();
+	Names.assign(view.Names, view.Names + view.NameCount);
+	unsigned int characters = 0;
+	for (const SceneFileName& n : Names)
+		characters = max(characters, n.Offset + n.Length);
+	NameCharacters.assign(view.NameCharacters, view.NameCharacters + characters);
+	Materials.assign(view.Materials, view.Materials + view.MaterialCount);
+	Entities.assign(view.Entities, view.Entities + view.EntityCount);
+	Lights.assign(view.Lights, view.Lights + view.LightCount);
+	Emitters.assign(view.Emitters, view.Emitters + view.EmitterCount);
+	return true;
+}
+
+// --------------------------------------------------------
+// The header, then each section padded out to the next
+// alignment, in the order the header lists them
+// --------------------------------------------------------
+bool SceneData::SaveBinary(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		printf("Couldn't write scene %s\n", path.c_str());
+		return false;
+	}
+
+	SceneFileHeader header = {};
+	header.Magic = SCENE_FILE_MAGIC;
+	header.Version = SCENE_FILE_VERSION;
+	header.NameCount = (unsigned int)Names.size();
+	header.NameCharacters = (unsigned int)NameCharacters.size();
+	header.MaterialCount = (unsigned int)Materials.size();
+	header.EntityCount = (unsigned int)Entities.size();
+	header.LightCount = (unsigned int)Lights.size();
+	header.EmitterCount = (unsigned int)Emitters.size();
+
+	const void* sections[] = { Names.data(), NameCharacters.data(), Materials.data(), Entities.data(), Lights.data(), Emitters.data() };
+	unsigned long long sizes[] = {
+		sizeof(SceneFileName) * Names.size(),
+		NameCharacters.size(),
+		sizeof(SceneFileMaterial) * Materials.size(),
+		sizeof(SceneFileEntity) * Entities.size(),
+		sizeof(Light) * Lights.size(),
+		sizeof(SceneFileEmitter) * Emitters.size() };
+	unsigned long long* offsets[] = {
+		&header.NamesOffset, &header.NameCharactersOffset, &header.MaterialsOffset,
+		&header.EntitiesOffset, &header.LightsOffset, &header.EmittersOffset };
+
+	unsigned long long offset = sizeof(SceneFileHeader);
+	for (int i = 0; i < 6; i++)
+	{
+		offset = (offset + SCENE_FILE_SECTION_ALIGNMENT - 1) & ~(unsigned long long)(SCENE_FILE_SECTION_ALIGNMENT - 1);
+		*offsets[i] = offset;
+		offset += sizes[i];
+	}
+
+	file.write((const char*)&header, sizeof(header));
+	unsigned long long written = sizeof(SceneFileHeader);
+	const char padding[SCENE_FILE_SECTION_ALIGNMENT] = {};
+	for (int i = 0; i < 6; i++)
+	{
+		file.write(padding, *offsets[i] - written);
+		file.write((const char*)sections[i], sizes[i]);
+		written = *offsets[i] + sizes[i];
+	}
+
+	printf("Saved %u materials, %u entities, %u lights and %u emitters to %s\n",
+		header.MaterialCount, header.EntityCount, header.LightCount, header.EmitterCount, path.c_str());
+	return file.good();
+}
+
+// --------------------------------------------------------
+// One record per line, starting with what it is, with names
+// in quotes (they can have spaces) and each texture on its
+// own line after its material
+// --------------------------------------------------------
+bool SceneData::SaveText(const std::string& path) const
+{
+	FILE* file = 0;
+	if (fopen_s(&file, path.c_str(), "w") != 0 || !file)
+	{
+		printf("Couldn't write scene %s\n", path.c_str());
+		return false;
+	}
+
+	SceneView view = GetView();
+	auto name = [&](unsigned int index) { return index == SCENE_FILE_NO_NAME ? std::string("\"\"") : "\"" + view.GetName(index) + "\""; };
+
+	fprintf(file, "# Scene, version %u\n", SCENE_FILE_VERSION);
+	fprintf(file, "# material <vs> <ps> <color rgba> <shininess> <uv scale> <flags>\n");
+	fprintf(file, "# texture <slot> <texture> <flags>\n");
+	fprintf(file, "# entity <mesh> <material> <parent> <position> <pitch yaw roll> <scale>\n");
+	fprintf(file, "# light <type> <direction> <range> <position> <intensity> <color> <spot falloff> <casts shadows>\n");
+	fprintf(file, "# emitter <vs> <ps> <texture> <flags> <position> <max particles> <per second> <lifetime>\n");
+
+	for (const SceneFileMaterial& m : Materials)
+	{
+		fprintf(file, "material %s %s %.9g %.9g %.9g %.9g %.9g %.9g %.9g %u\n",
+			name(m.VertexShader).c_str(), name(m.PixelShader).c_str(),
+			m.Color.x, m.Color.y, m.Color.z, m.Color.w, m.Shininess, m.UVScale.x, m.UVScale.y, m.Flags);
+		for (unsigned int t = 0; t < m.TextureCount && t < SCENE_FILE_MAX_TEXTURES; t++)
+			fprintf(file, "texture %s %s %u\n", name(m.Textures[t].Slot).c_str(), name(m.Textures[t].Texture).c_str(), m.Textures[t].Flags);
+	}
+
+	for (const SceneFileEntity& e : Entities)
+	{
+		fprintf(file, "entity %s %u %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+			name(e.Mesh).c_str(), e.Material, e.Parent,
+			e.Position.x, e.Position.y, e.Position.z,
+			e.PitchYawRoll.x, e.PitchYawRoll.y, e.PitchYawRoll.z,
+			e.Scale.x, e.Scale.y, e.Scale.z);
+	}
+
+	for (const Light& l : Lights)
+	{
+		fprintf(file, "light %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %d\n",
+			l.Type, l.Direction.x, l.Direction.y, l.Direction.z, l.Range,
+			l.Position.x, l.Position.y, l.Position.z, l.Intensity,
+			l.Color.x, l.Color.y, l.Color.z, l.SpotFalloff, l.CastsShadows);
+	}
+
+	for (const SceneFileEmitter& e : Emitters)
+	{
+		fprintf(file, "emitter %s %s %s %u %.9g %.9g %.9g %d %d %.9g\n",
+			name(e.VertexShader).c_str(), name(e.PixelShader).c_str(), name(e.Texture).c_str(), e.Flags,
+			e.Position.x, e.Position.y, e.Position.z, e.MaxParticles, e.ParticlesPerSecond, e.Lifetime);
+	}
+
+	bool written = ferror(file) == 0;
+	fclose(file);
+	if (written)
+		printf("Saved %u materials, %u entities, %u lights and %u emitters to %s\n",
+			(unsigned int)Materials.size(), (unsigned int)Entities.size(), (unsigned int)Lights.size(), (unsigned int)Emitters.size(), path.c_str());
+	return written;
+}
+
+// Splits a line into words, with anything in quotes as one (quotes removed)
+static std::vector<std::string> SplitSceneLine(const std::string& line)
+{
+	std::vector<std::string> words;
+	size_t i = 0;
+	while (i < line.size())
+	{
+		if (isspace((unsigned char)line[i])) { i++; continue; }
+
+		if (line[i] == '"')
+		{
+			size_t end = line.find('"', i + 1);
+			if (end == std::string::npos)
+				end = line.size();
+			words.push_back(line.substr(i + 1, end - i - 1));
+			i = end + 1;
+		}
+		else
+		{
+			size_t end = i;
+			while (end < line.size() && !isspace((unsigned char)line[end]))
+				end++;
+			words.push_back(line.substr(i, end - i));
+			i = end;
+		}
+	}
+	return words;
+}
+
+// --------------------------------------------------------
+// Reads what SaveText() writes, failing (and saying which
+// line) on anything it doesn't know or that's missing parts
+// --------------------------------------------------------
+bool SceneData::LoadText(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		printf("Couldn't read scene %s\n", path.c_str());
+		return false;
+	}
+
+	Clear();
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		std::vector<std::string> w = SplitSceneLine(line);
+		if (w.empty() || w[0][0] == '#')
+			continue;
+
+		auto f = [&](size_t i) { return (float)atof(w[i].c_str()); };
+		auto u = [&](size_t i) { return (unsigned int)strtoul(w[i].c_str(), 0, 10); };
+		auto n = [&](size_t i) { return w[i].empty() ? SCENE_FILE_NO_NAME : AddName(w[i]); };
+
+		bool valid = true;
+		if (w[0] == "material" && w.size() >= 11)
+		{
+			SceneFileMaterial m = {};
+			m.VertexShader = n(1);
+			m.PixelShader = n(2);
+			m.Color = XMFLOAT4(f(3), f(4), f(5), f(6));
+			m.Shininess = f(7);
+			m.UVScale = XMFLOAT2(f(8), f(9));
+			m.Flags = u(10);
+			Materials.push_back(m);
+		}
+		else if (w[0] == "texture" && w.size() >= 4 && !Materials.empty())
+		{
+			AddTexture(w[1], w[2], u(3));
+		}
+		else if (w[0] == "entity" && w.size() >= 13)
+		{
+			SceneFileEntity e = {};
+			e.Mesh = n(1);
+			e.Material = u(2);
+			e.Parent = atoi(w[3].c_str());
+			e.Position = XMFLOAT3(f(4), f(5), f(6));
+			e.PitchYawRoll = XMFLOAT3(f(7), f(8), f(9));
+			e.Scale = XMFLOAT3(f(10), f(11), f(12));
+			Entities.push_back(e);
+		}
+		else if (w[0] == "light" && w.size() >= 15)
+		{
+			Light l = {};
+			l.Type = atoi(w[1].c_str());
+			l.Direction = XMFLOAT3(f(2), f(3), f(4));
+			l.Range = f(5);
+			l.Position = XMFLOAT3(f(6), f(7), f(8));
+			l.Intensity = f(9);
+			l.Color = XMFLOAT3(f(10), f(11), f(12));
+			l.SpotFalloff = f(13);
+			l.CastsShadows = atoi(w[14].c_str());
+			Lights.push_back(l);
+		}
+		else if (w[0] == "emitter" && w.size() >= 11)
+		{
+			SceneFileEmitter e = {};
+			e.VertexShader = n(1);
+			e.PixelShader = n(2);
+			e.Texture = n(3);
+			e.Flags = u(4);
+			e.Position = XMFLOAT3(f(5), f(6), f(7));
+			e.MaxParticles = atoi(w[8].c_str());
+			e.ParticlesPerSecond = atoi(w[9].c_str());
+			e.Lifetime = f(10);
+			Emitters.push_back(e);
+		}
+		else valid = false;
+
+		if (!valid)
+		{
+			printf("Scene %s, line %u: couldn't read \"%s\"\n", path.c_str(), lineNumber, line.c_str());
+			Clear();
+			return false;
+		}
+	}
+
+	if (!SceneFile::Validate(GetView()))
+	{
+		printf("Scene %s refers to something it doesn't have\n", path.c_str());
+		Clear();
+		return false;
+	}
+	return true;
+}
+
+SceneFile::SceneFile()
+	: file(INVALID_HANDLE_VALUE), mapping(0), data(0), size(0), view()
+{
+}
+
+SceneFile::~SceneFile()
+{
+	Close();
+}
+
+// --------------------------------------------------------
+// Maps the whole file read only and checks each section
+// fits inside it, then that the records inside them only
+// refer to what's there
+// --------------------------------------------------------
+bool SceneFile::Open(const std::string& path)
+{
+	Close();
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(file, &fileSize);
+	size = (unsigned long long)fileSize.QuadPart;
+	if (size >= sizeof(SceneFileHeader))
+		mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping)
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+
+	const SceneFileHeader* header = (const SceneFileHeader*)data;
+	auto fits = [&](unsigned long long offset, unsigned long long count, unsigned long long stride)
+	{
+		return offset % SCENE_FILE_SECTION_ALIGNMENT == 0 && offset <= size && count <= (size - offset) / stride;
+	};
+	bool valid =
+		header->Magic == SCENE_FILE_MAGIC &&
+		header->Version == SCENE_FILE_VERSION &&
+		fits(header->NamesOffset, header->NameCount, sizeof(SceneFileName)) &&
+		fits(header->NameCharactersOffset, header->NameCharacters, 1) &&
+		fits(header->MaterialsOffset, header->MaterialCount, sizeof(SceneFileMaterial)) &&
+		fits(header->EntitiesOffset, header->EntityCount, sizeof(SceneFileEntity)) &&
+		fits(header->LightsOffset, header->LightCount, sizeof(Light)) &&
+		fits(header->EmittersOffset, header->EmitterCount, sizeof(SceneFileEmitter));
+
+	if (valid)
+	{
+		view.Names = (const SceneFileName*)(data + header->NamesOffset);
+		view.NameCharacters = (const char*)(data + header->NameCharactersOffset);
+		view.Materials = (const SceneFileMaterial*)(data + header->MaterialsOffset);
+		view.Entities = (const SceneFileEntity*)(data + header->EntitiesOffset);
+		view.Lights = (const Light*)(data + header->LightsOffset);
+		view.Emitters = (const SceneFileEmitter*)(data + header->EmittersOffset);
+		view.NameCount = header->NameCount;
+		view.MaterialCount = header->MaterialCount;
+		view.EntityCount = header->EntityCount;
+		view.LightCount = header->LightCount;
+		view.EmitterCount = header->EmitterCount;
+
+		for (unsigned int i = 0; valid && i < view.NameCount; i++)
+			valid = (unsigned long long)view.Names[i].Offset + view.Names[i].Length <= header->NameCharacters;
+		valid = valid && Validate(view);
+	}
+
+	if (!valid)
+	{
+		printf("%s isn't a valid scene (version %u)\n", path.c_str(), SCENE_FILE_VERSION);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void SceneFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	file = INVALID_HANDLE_VALUE;
+	mapping = 0;
+	data = 0;
+	size = 0;
+	view = {};
+}
+
+bool SceneFile::Validate(const SceneView& view)
+{
+	auto isName = [&](unsigned int name, bool optional) { return name < view.NameCount || (optional && name == SCENE_FILE_NO_NAME); };
+
+	for (unsigned int i = 0; i < view.MaterialCount; i++)
+	{
+		const SceneFileMaterial& m = view.Materials[i];
+		if (!isName(m.VertexShader, false) || !isName(m.PixelShader, false) || m.TextureCount > SCENE_FILE_MAX_TEXTURES)
+			return false;
+		for (unsigned int t = 0; t < m.TextureCount; t++)
+		{
+			if (!isName(m.Textures[t].Slot, false) || !isName(m.Textures[t].Texture, false))
+				return false;
+		}
+	}
+
+	for (unsigned int i = 0; i < view.EntityCount; i++)
+	{
+		const SceneFileEntity& e = view.Entities[i];
+		if (!isName(e.Mesh, false) || e.Material >= view.MaterialCount || e.Parent >= (int)i || e.Parent < -1)
+			return false;
+	}
+
+	for (unsigned int i = 0; i < view.EmitterCount; i++)
+	{
+		const SceneFileEmitter& e = view.Emitters[i];
+		if (!isName(e.VertexShader, false) || !isName(e.PixelShader, false) || !isName(e.Texture, true))
+			return false;
+	}
+
+	return view.LightCount <= MAX_LIGHTS;
+}
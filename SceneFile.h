@@ -0,0 +1,190 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+#include "AssetHandle.h"
+#include "Lights.h"
+
+// A level, as a compact binary file that's mapped and read in place
+// (-scene <file> on the command line), or as text for editing, which
+// is any file ending in .txt
+#define SCENE_FILE_MAGIC		0x43535844	// "DXSC"
+#define SCENE_FILE_VERSION		1
+
+// Textures per material, which is one of each PBR map
+#define SCENE_FILE_MAX_TEXTURES	4
+
+// No name, for a record that can leave one out
+#define SCENE_FILE_NO_NAME		0xFFFFFFFF
+
+// Material flags
+#define SCENE_MATERIAL_CLAMP_SAMPLER	0x1	// Also binds the clamped sampler, as ClampSampler
+
+// Texture flags
+#define SCENE_TEXTURE_STREAMED			0x1	// Streams in behind a placeholder, rather than loading first
+
+// Emitter flags
+#define SCENE_EMITTER_GPU_SIMULATED		0x1
+
+// Start of a scene, followed by each section at its offset (every
+// one 16 byte aligned, and in this order), all plain records that
+// are used straight from the mapped file
+struct SceneFileHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int NameCount;
+	unsigned int NameCharacters;
+	unsigned int MaterialCount;
+	unsigned int EntityCount;
+	unsigned int LightCount;
+	unsigned int EmitterCount;
+	unsigned long long NamesOffset;
+	unsigned long long NameCharactersOffset;
+	unsigned long long MaterialsOffset;
+	unsigned long long EntitiesOffset;
+	unsigned long long LightsOffset;
+	unsigned long long EmittersOffset;
+};
+
+// An asset's name, with the hash Assets looks it up by already worked
+// out, so handles are made without building (or hashing) a string
+struct SceneFileName
+{
+	unsigned long long Hash;	// HashAssetName()
+	unsigned int Offset;		// Into the name characters, which aren't null terminated
+	unsigned int Length;
+};
+
+struct SceneFileTexture
+{
+	unsigned int Slot;		// The shader's name for it, like AlbedoTexture
+	unsigned int Texture;
+	unsigned int Flags;
+};
+
+struct SceneFileMaterial
+{
+	unsigned int VertexShader;
+	unsigned int PixelShader;
+	DirectX::XMFLOAT4 Color;
+	float Shininess;
+	DirectX::XMFLOAT2 UVScale;
+	unsigned int Flags;
+	unsigned int TextureCount;
+	SceneFileTexture Textures[SCENE_FILE_MAX_TEXTURES];
+};
+
+// Relative to its parent, which is an earlier entity (or -1 for none)
+struct SceneFileEntity
+{
+	unsigned int Mesh;
+	unsigned int Material;	// Into the scene's materials
+	int Parent;
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 PitchYawRoll;
+	DirectX::XMFLOAT3 Scale;
+};
+
+struct SceneFileEmitter
+{
+	unsigned int VertexShader;
+	unsigned int PixelShader;
+	unsigned int Texture;
+	unsigned int Flags;
+	DirectX::XMFLOAT3 Position;
+	int MaxParticles;
+	int ParticlesPerSecond;
+	float Lifetime;
+};
+
+// --------------------------------------------------------
+// Every section of a scene, wherever it is - mapped from a
+// file or built up in a SceneData - which is all that's
+// needed to make it
+// --------------------------------------------------------
+struct SceneView
+{
+	const SceneFileName* Names;
+	const char* NameCharacters;
+	const SceneFileMaterial* Materials;
+	const SceneFileEntity* Entities;
+	const Light* Lights;
+	const SceneFileEmitter* Emitters;
+	unsigned int NameCount;
+	unsigned int MaterialCount;
+	unsigned int EntityCount;
+	unsigned int LightCount;
+	unsigned int EmitterCount;
+
+	// A name's key for Assets' handles, pointing into the view
+	AssetKey GetKey(unsigned int name) const;
+	std::string GetName(unsigned int name) const;
+};
+
+// --------------------------------------------------------
+// A scene that can be added to and changed, then saved as
+// binary or text, or read back from either
+//  - Names are only added once, so each asset's handle is
+//    made once however many records use it
+// --------------------------------------------------------
+struct SceneData
+{
+	std::vector<SceneFileName> Names;
+	std::vector<char> NameCharacters;
+	std::vector<SceneFileMaterial> Materials;
+	std::vector<SceneFileEntity> Entities;
+	std::vector<Light> Lights;
+	std::vector<SceneFileEmitter> Emitters;
+
+	// The name's index, added if it isn't there already
+	unsigned int AddName(const std::string& name);
+	// Adds a texture to the last material added
+	void AddTexture(const std::string& slot, const std::string& texture, unsigned int flags);
+
+	SceneView GetView() const;
+	void Clear();
+
+	// By extension: text for .txt, binary for anything else
+	bool Save(const std::string& path) const;
+	bool Load(const std::string& path);
+
+	bool SaveBinary(const std::string& path) const;
+	bool SaveText(const std::string& path) const;
+	bool LoadText(const std::string& path);
+
+	static bool IsTextPath(const std::string& path);
+};
+
+// --------------------------------------------------------
+// A binary scene, mapped read only and used in place, so
+// opening one only costs checking that its sections fit
+//  - Names and records are checked against each other too,
+//    so nothing made from the view can read past the file
+// --------------------------------------------------------
+class SceneFile
+{
+public:
+	SceneFile();
+	~SceneFile();
+	SceneFile(SceneFile const&) = delete;
+	void operator=(SceneFile const&) = delete;
+
+	bool Open(const std::string& path);
+	void Close();
+	bool IsOpen() { return data != 0; }
+
+	const SceneView& GetView() const { return view; }
+
+	// That every index in a view is in range, and parents come first
+	static bool Validate(const SceneView& view);
+
+private:
+	void* file;
+	void* mapping;
+	const unsigned char* data;
+	unsigned long long size;
+	SceneView view;
+};
@@ -0,0 +1,239 @@
+// Include guard
+#ifndef _SCENE_LIGHTING_HLSL
+#define _SCENE_LIGHTING_HLSL
+
+#include "PerFrameData.hlsli"
+#include "LightClusters.hlsli"
+#include "GBuffer.hlsli"
+#include "ShaderFeatures.hlsli"
+
+// Lighting of one surface, shared by the forward pixel shaders
+// (PixelShader.hlsl and PixelShaderPBR.hlsl) and the deferred
+// lighting pass (DeferredLightingCS.hlsl)
+//  - screenPosition is the pixel's SV_POSITION (or the same thing
+//    rebuilt from the depth buffer), for finding its light cluster
+//  - lightList is the entity's list in EntityLightLists, which is
+//    used in place of the clusters (or every light) when it has one
+//  - Returns the color packed with ambient - see GBuffer.hlsli
+
+// Direct lighting from a single light of any type
+float3 LightPBR(uint lightIndex, float3 normal, float3 worldPos, float roughness, float metal, float3 surfaceColor, float3 specColor, float shadowAmount)
+{
+	Light light = Lights[lightIndex];
+	float3 result = float3(0, 0, 0);
+
+	// Which kind of light?
+	switch (light.Type)
+	{
+	case LIGHT_TYPE_DIRECTIONAL:
+		float3 dirLightResult = DirLightPBR(light, normal, worldPos, CameraPosition, roughness, metal, surfaceColor, specColor);
+
+		// Apply the directional light result, scaled by the shadow mapping
+		//   Note: The cascades are only for one directional light
+		//   (see ShadowLightIndex), so any others are left unshadowed
+#if FEATURE_SHADOWS
+		result = dirLightResult * ((int)lightIndex == ShadowLightIndex ? shadowAmount : 1.0f);
+#else
+		result = dirLightResult;
+#endif
+		break;
+
+#if FEATURE_LOCAL_LIGHTS
+	case LIGHT_TYPE_POINT:
+		result = PointLightPBR(light, normal, worldPos, CameraPosition, roughness, metal, surfaceColor, specColor);
+		break;
+
+	case LIGHT_TYPE_SPOT:
+		result = SpotLightPBR(light, normal, worldPos, CameraPosition, roughness, metal, surfaceColor, specColor);
+		break;
+#endif
+	}
+
+	// Point and spot lights' shadows, from the atlas
+#if FEATURE_SHADOWS && FEATURE_LOCAL_LIGHTS
+	if (light.Type != LIGHT_TYPE_DIRECTIONAL)
+		result *= LocalShadowAmount(lightIndex, light, worldPos);
+#endif
+
+	return result;
+}
+
+// Direct lighting from a single light of any type
+float3 LightBasic(uint lightIndex, float3 normal, float3 worldPos, float specPower, float3 surfaceColor, float shadowAmount)
+{
+	Light light = Lights[lightIndex];
+	float3 result = float3(0, 0, 0);
+
+	// Which kind of light?
+	switch (light.Type)
+	{
+	case LIGHT_TYPE_DIRECTIONAL:
+		float3 dirLightResult = DirLight(light, normal, worldPos, CameraPosition, specPower, surfaceColor);
+
+		// Apply the directional light result, scaled by the shadow mapping
+		//   Note: The cascades are only for one directional light
+		//   (see ShadowLightIndex), so any others are left unshadowed
+#if FEATURE_SHADOWS
+		result = dirLightResult * ((int)lightIndex == ShadowLightIndex ? shadowAmount : 1.0f);
+#else
+		result = dirLightResult;
+#endif
+		break;
+
+#if FEATURE_LOCAL_LIGHTS
+	case LIGHT_TYPE_POINT:
+		result = PointLight(light, normal, worldPos, CameraPosition, specPower, surfaceColor);
+		break;
+
+	case LIGHT_TYPE_SPOT:
+		result = SpotLight(light, normal, worldPos, CameraPosition, specPower, surfaceColor);
+		break;
+#endif
+	}
+
+	// Point and spot lights' shadows, from the atlas
+#if FEATURE_SHADOWS && FEATURE_LOCAL_LIGHTS
+	if (light.Type != LIGHT_TYPE_DIRECTIONAL)
+		result *= LocalShadowAmount(lightIndex, light, worldPos);
+#endif
+
+	return result;
+}
+
+// PBR lighting, direct and indirect
+//  - The clamp sampler is for the BRDF look up table
+float4 ShadePBR(float4 screenPosition, uint lightList, float3 normal, float3 worldPos, float roughness, float metal, float3 surfaceColor, float shadowAmount,
+	SamplerState basicSampler, SamplerState clampSampler)
+{
+	// Specular color - Assuming albedo texture is actually holding specular color if metal == 1
+	// Note the use of lerp here - metal is generally 0 or 1, but might be in between
+	// because of linear texture sampling, so we want lerp the specular color to match
+	float3 specColor = lerp(F0_NON_METAL.rrr, surfaceColor, metal);
+
+	// Total color for this pixel
+	float3 totalColor = float3(0,0,0);
+
+#if FEATURE_FIXED_LIGHTS
+	// Just the first few lights
+	[unroll]
+	for (int i = 0; i < FIXED_LIGHT_COUNT; i++)
+	{
+		if (i < LightCount)
+		{
+			totalColor += LightPBR(i, normal, worldPos, roughness, metal, surfaceColor, specColor, shadowAmount);
+		}
+	}
+#else
+	if (lightList != ENTITY_LIGHT_LIST_NONE)
+	{
+		// Just the lights that reach this entity
+		uint listCount = EntityLightLists[lightList];
+		for (uint i = 0; i < listCount; i++)
+		{
+			uint lightIndex = EntityLightLists[lightList + 1 + i];
+			totalColor += LightPBR(lightIndex, normal, worldPos, roughness, metal, surfaceColor, specColor, shadowAmount);
+		}
+	}
+	else if (ClusteredLighting)
+	{
+		// Only loop through the lights that touch this pixel's cluster
+		uint cluster = ClusterIndexFromPixel(screenPosition, ClusterTileScale, ClusterDepthScaleBias);
+		uint clusterLightCount = ClusterLightGrid[cluster];
+		for (uint i = 0; i < clusterLightCount; i++)
+		{
+			uint lightIndex = ClusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+			totalColor += LightPBR(lightIndex, normal, worldPos, roughness, metal, surfaceColor, specColor, shadowAmount);
+		}
+	}
+	else
+	{
+		// Loop through all lights this frame
+		for (int i = 0; i < LightCount; i++)
+		{
+			totalColor += LightPBR(i, normal, worldPos, roughness, metal, surfaceColor, specColor, shadowAmount);
+		}
+	}
+#endif
+
+	// Calculate requisite reflection vectors
+	float3 viewToCam = normalize(CameraPosition - worldPos);
+	float3 viewRefl = normalize(reflect(-viewToCam, normal));
+	float NdotV = saturate(dot(normal, viewToCam));
+
+	// Indirect lighting
+	float3 indirectDiffuse = UseIrradianceSH ?
+		IndirectDiffuseSH(IrradianceSH, normal) :
+		IndirectDiffuse(IrradianceIBLMap, basicSampler, normal);
+	float3 indirectSpecular = IndirectSpecular(
+		SpecularIBLMap, SpecIBLTotalMipLevels,
+		BrdfLookUpMap, clampSampler, // MUST use the clamp sampler here!
+		viewRefl, NdotV,
+		roughness, specColor);
+
+	// Balance indirect diff/spec
+	float3 balancedDiff = DiffuseEnergyConserve(indirectDiffuse, indirectSpecular, metal);
+	float3 fullIndirect = indirectSpecular + balancedDiff * surfaceColor;
+
+	// Add the indirect to the direct
+	totalColor += fullIndirect;
+
+	// Balance indirect diff/spec
+	float3 balancedIndirectDiff = DiffuseEnergyConserve(indirectDiffuse, indirectSpecular, metal) * surfaceColor;
+
+	return PackColorAndAmbient(totalColor, balancedIndirectDiff);
+}
+
+// Blinn-Phong lighting, with the flat non-PBR ambient
+float4 ShadeBasic(float4 screenPosition, uint lightList, float3 normal, float3 worldPos, float specPower, float3 surfaceColor, float shadowAmount)
+{
+	// Total color for this pixel
+	float3 totalColor = float3(0,0,0);
+
+#if FEATURE_FIXED_LIGHTS
+	// Just the first few lights
+	[unroll]
+	for (int i = 0; i < FIXED_LIGHT_COUNT; i++)
+	{
+		if (i < LightCount)
+		{
+			totalColor += LightBasic(i, normal, worldPos, specPower, surfaceColor, shadowAmount);
+		}
+	}
+#else
+	if (lightList != ENTITY_LIGHT_LIST_NONE)
+	{
+		// Just the lights that reach this entity
+		uint listCount = EntityLightLists[lightList];
+		for (uint i = 0; i < listCount; i++)
+		{
+			uint lightIndex = EntityLightLists[lightList + 1 + i];
+			totalColor += LightBasic(lightIndex, normal, worldPos, specPower, surfaceColor, shadowAmount);
+		}
+	}
+	else if (ClusteredLighting)
+	{
+		// Only loop through the lights that touch this pixel's cluster
+		uint cluster = ClusterIndexFromPixel(screenPosition, ClusterTileScale, ClusterDepthScaleBias);
+		uint clusterLightCount = ClusterLightGrid[cluster];
+		for (uint i = 0; i < clusterLightCount; i++)
+		{
+			uint lightIndex = ClusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+			totalColor += LightBasic(lightIndex, normal, worldPos, specPower, surfaceColor, shadowAmount);
+		}
+	}
+	else
+	{
+		// Loop through all lights this frame
+		for (int i = 0; i < LightCount; i++)
+		{
+			totalColor += LightBasic(i, normal, worldPos, specPower, surfaceColor, shadowAmount);
+		}
+	}
+#endif
+
+	// Handle ambient
+	float3 ambient = surfaceColor * AmbientNonPBR;
+	return PackColorAndAmbient(totalColor, ambient);
+}
+
+#endif
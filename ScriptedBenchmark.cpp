@@ -0,0 +1,395 @@
+#include "ScriptedBenchmark.h"
+#include "AllocationTracker.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
+#include "DXCore.h"
+
+#include <Windows.h>
+#include <psapi.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Splits the command line on spaces, except inside quotes
+// (for sky names and paths with spaces in them)
+// --------------------------------------------------------
+ScriptedBenchmarkOptions ScriptedBenchmarkOptions::Parse(const char* commandLine)
+{
+	ScriptedBenchmarkOptions options = {};
+	options.Frames = SCRIPTED_BENCHMARK_FRAMES;
+	options.WarmupFrames = SCRIPTED_BENCHMARK_WARMUP_FRAMES;
+	options.Width = 1280;
+	options.Height = 720;
+	options.Timestep = 1.0f / 60.0f;
+	options.ReportFile = SCRIPTED_BENCHMARK_REPORT_FILE;
+	options.Stress = StressSceneOptions::Defaults();
+	options.BaselineFile = REGRESSION_BASELINE_FILE;
+	options.Tolerance = -1.0f;
+	options.ShaderWarmUpMs = STARTUP_WARM_UP_BUDGET_MS;
+	options.BackgroundFrameRate = DXCORE_BACKGROUND_FRAME_RATE;
+
+	std::vector<std::string> args;
+	std::string current;
+	bool quoted = false;
+	for (const char* c = commandLine; c && *c; c++)
+	{
+		if (*c == '"')
+			quoted = !quoted;
+		else if (*c == ' ' && !quoted)
+		{
+			if (!current.empty())
+				args.push_back(current);
+			current.clear();
+		}
+		else
+			current += *c;
+	}
+	if (!current.empty())
+		args.push_back(current);
+
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		const std::string& arg = args[i];
+		bool hasValue = i + 1 < args.size();
+		if (arg == "-benchmark") options.Enabled = true;
+		else if (arg == "-path" && hasValue) options.PathFile = args[++i];
+		else if (arg == "-sky" && hasValue) options.Sky = args[++i];
+		else if (arg == "-frames" && hasValue) options.Frames = max(atoi(args[++i].c_str()), 1);
+		else if (arg == "-warmup" && hasValue) options.WarmupFrames = max(atoi(args[++i].c_str()), 0);
+		else if (arg == "-timestep" && hasValue) options.Timestep = (float)atof(args[++i].c_str());
+		else if (arg == "-report" && hasValue) options.ReportFile = args[++i];
+		else if (arg == "-stress") options.Stress.Enabled = true;
+		else if (arg == "-entities" && hasValue) options.Stress.Entities = max(atoi(args[++i].c_str()), 0);
+		else if (arg == "-lights" && hasValue) options.Stress.Lights = max(atoi(args[++i].c_str()), 0);
+		else if (arg == "-emitters" && hasValue) options.Stress.Emitters = max(atoi(args[++i].c_str()), 0);
+		else if (arg == "-seed" && hasValue) options.Stress.Seed = (unsigned int)strtoul(args[++i].c_str(), 0, 10);
+		else if (arg == "-extent" && hasValue) options.Stress.Extent = (float)atof(args[++i].c_str());
+		else if (arg == "-motion") options.Stress.Motion = true;
+		else if (arg == "-replay" && hasValue) options.ReplayFile = args[++i];
+		else if (arg == "-set" && hasValue) options.Settings.push_back(args[++i]);
+		else if (arg == "-regression" && hasValue) options.RegressionFile = args[++i];
+		else if (arg == "-baseline" && hasValue) options.BaselineFile = args[++i];
+		else if (arg == "-tolerance" && hasValue) options.Tolerance = (float)atof(args[++i].c_str());
+		else if (arg == "-update-baseline") options.UpdateBaseline = true;
+		else if (arg == "-scene" && hasValue) options.ScenePath = args[++i];
+		else if (arg == "-export-scene" && hasValue) options.ExportScenePath = args[++i];
+		else if (arg == "-shader-warmup" && hasValue) options.ShaderWarmUpMs = max((float)atof(args[++i].c_str()), 0.0f);
+		else if (arg == "-background-fps" && hasValue) options.BackgroundFrameRate = (float)atof(args[++i].c_str());
+		else if (arg == "-resolution" && hasValue)
+		{
+			unsigned int w, h;
+			if (sscanf_s(args[++i].c_str(), "%ux%u", &w, &h) == 2 && w > 0 && h > 0)
+			{
+				options.Width = w;
+				options.Height = h;
+			}
+		}
+		else
+			printf("Unknown command line option: %s\n", arg.c_str());
+	}
+
+	if (options.Timestep <= 0.0f)
+		options.Timestep = 1.0f / 60.0f;
+	return options;
+}
+
+ScriptedBenchmark::ScriptedBenchmark()
+{
+	running = false;
+	succeeded = false;
+	frameIndex = 0;
+	options = {};
+	peakGpuMB = 0.0;
+	peakTrackedGpuMB = 0.0;
+	peakProcessMB = 0.0;
+}
+
+bool ScriptedBenchmark::Start(const ScriptedBenchmarkOptions& options)
+{
+	this->options = options;
+	keyframes.clear();
+	if (options.PathFile.empty())
+		CreateDefaultPath();
+	else if (!LoadPath(options.PathFile))
+		return false;
+
+	frameMs.clear();
+	cpuMs.clear();
+	gpuMs.clear();
+	draws.clear();
+	stateChanges.clear();
+	allocations.clear();
+	allocatedBytes.clear();
+	passTotals.clear();
+	drawStatTotals.clear();
+	metrics.clear();
+	peakGpuMB = 0.0;
+	peakTrackedGpuMB = 0.0;
+	peakProcessMB = 0.0;
+	frameIndex = 0;
+	succeeded = false;
+	running = true;
+
+	printf("Benchmark: %d frames at %ux%u along %s\n", options.Frames, options.Width, options.Height,
+		options.PathFile.empty() ? "the default path" : options.PathFile.c_str());
+	return true;
+}
+
+bool ScriptedBenchmark::LoadPath(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		printf("Couldn't open camera path %s\n", path.c_str());
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		CameraKeyframe k;
+		std::istringstream values(line);
+		if (values >> k.Time >> k.Position.x >> k.Position.y >> k.Position.z >> k.PitchYawRoll.x >> k.PitchYawRoll.y >> k.PitchYawRoll.z)
+			keyframes.push_back(k);
+	}
+
+	// Out of order keyframes would send the spline backwards
+	for (size_t i = 1; i < keyframes.size(); i++)
+	{
+		if (keyframes[i].Time <= keyframes[i - 1].Time)
+		{
+			printf("Camera path %s has keyframes out of order\n", path.c_str());
+			return false;
+		}
+	}
+
+	if (keyframes.size() < 2)
+	{
+		printf("Camera path %s needs at least two keyframes\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+// --------------------------------------------------------
+// A slow loop around the middle of the scene, looking in
+// --------------------------------------------------------
+void ScriptedBenchmark::CreateDefaultPath()
+{
+	const int count = 9;
+	const float radius = 15.0f;
+	const float seconds = 20.0f;
+	for (int i = 0; i < count; i++)
+	{
+		float angle = XM_2PI * i / (count - 1);
+		CameraKeyframe k;
+		k.Time = seconds * i / (count - 1);
+		k.Position = XMFLOAT3(sinf(angle) * radius, 4.0f, -cosf(angle) * radius);
+		k.PitchYawRoll = XMFLOAT3(0.2f, -angle, 0.0f);
+		keyframes.push_back(k);
+	}
+}
+
+void ScriptedBenchmark::MoveCamera(Camera* camera, float time)
+{
+	if (!running)
+		return;
+
+	// Looping from the first keyframe's time
+	float start = keyframes.front().Time;
+	float duration = keyframes.back().Time - start;
+	time = start + fmodf(max(time, 0.0f), duration);
+
+	size_t i = 0;
+	while (i + 2 < keyframes.size() && keyframes[i + 1].Time < time)
+		i++;
+	const CameraKeyframe& a = keyframes[i];
+	const CameraKeyframe& b = keyframes[i + 1];
+	const CameraKeyframe& before = keyframes[i > 0 ? i - 1 : i];
+	const CameraKeyframe& after = keyframes[min(i + 2, keyframes.size() - 1)];
+	float t = min(max((time - a.Time) / (b.Time - a.Time), 0.0f), 1.0f);
+
+	XMFLOAT3 pos, rot;
+	XMStoreFloat3(&pos, XMVectorCatmullRom(
+		XMLoadFloat3(&before.Position), XMLoadFloat3(&a.Position),
+		XMLoadFloat3(&b.Position), XMLoadFloat3(&after.Position), t));
+	XMVECTOR startRot = XMLoadFloat3(&a.PitchYawRoll);
+	XMVECTOR delta = XMVectorModAngles(XMVectorSubtract(XMLoadFloat3(&b.PitchYawRoll), startRot));
+	XMStoreFloat3(&rot, XMVectorMultiplyAdd(delta, XMVectorReplicate(t), startRot));
+
+	Transform* transform = camera->GetTransform();
+	transform->SetPosition(pos.x, pos.y, pos.z);
+	transform->SetRotation(rot.x, rot.y, rot.z);
+	camera->UpdateViewMatrix();
+}
+
+bool ScriptedBenchmark::RecordFrame(float frameMs, float cpuMs, Renderer* renderer)
+{
+	if (!running)
+		return false;
+
+	// Skipping the warm up
+	if (frameIndex++ < options.WarmupFrames)
+		return false;
+
+	GpuProfiler& profiler = renderer->GetGpuProfiler();
+	this->frameMs.push_back(frameMs);
+	this->cpuMs.push_back(cpuMs);
+	gpuMs.push_back(profiler.GetFrameMs());
+	for (auto& pass : profiler.GetPassStats())
+		passTotals[pass.Name] += pass.LastMs;
+	const RenderQueueStats* queues[3] = { &renderer->GetRenderQueueStats(), &renderer->GetDepthPrepassStats(), &renderer->GetShadowQueueStats() };
+	unsigned int frameDraws = 0, frameStateChanges = 0;
+	for (const RenderQueueStats* q : queues)
+	{
+		frameDraws += q->Draws;
+		frameStateChanges += q->ShaderBinds + q->MaterialBinds + q->MeshBinds;
+	}
+	draws.push_back((float)frameDraws);
+	stateChanges.push_back((float)frameStateChanges);
+
+	// The last whole frame's (this one's still going until the next update)
+	AllocationCounts frameAllocations = AllocationTracker::GetLastFrame();
+	allocations.push_back((float)frameAllocations.Allocations);
+	allocatedBytes.push_back((float)frameAllocations.Bytes);
+
+	// The renderer's just finished the frame, so these are all of it
+	DrawStats& drawStats = DrawStats::GetInstance();
+	auto addDrawStats = [&](const DrawPassCounters& pass, const std::string& prefix)
+	{
+		for (int c = 0; c < (int)DrawCounter::Count; c++)
+			drawStatTotals[prefix + DrawStats::GetCounterKey((DrawCounter)c)] += (double)pass.Counts[c];
+	};
+	for (auto& pass : drawStats.GetPasses())
+		addDrawStats(pass, pass.Name + ".");
+	addDrawStats(drawStats.GetTotals(), "");
+
+	// Peaks, sampled every frame
+	const double mb = 1024.0 * 1024.0;
+	GpuMemory& gpuMemory = GpuMemory::GetInstance();
+	DXGI_QUERY_VIDEO_MEMORY_INFO budget;
+	if (gpuMemory.QueryBudget(budget))
+		peakGpuMB = max(peakGpuMB, budget.CurrentUsage / mb);
+	peakTrackedGpuMB = max(peakTrackedGpuMB, gpuMemory.GetTotalBytes() / mb);
+	PROCESS_MEMORY_COUNTERS_EX process = {};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&process), sizeof(process)))
+		peakProcessMB = max(peakProcessMB, process.PrivateUsage / mb);
+
+	if ((int)this->frameMs.size() < options.Frames)
+		return false;
+
+	succeeded = WriteReport();
+	running = false;
+	return true;
+}
+
+bool ScriptedBenchmark::WriteReport()
+{
+	size_t frames = frameMs.size();
+	float drawTotal = 0.0f, stateChangeTotal = 0.0f;
+	for (float d : draws)
+		drawTotal += d;
+	for (float s : stateChanges)
+		stateChangeTotal += s;
+
+	// Sorted, for the 1% low
+	FrameTimePercentiles frame = FrameTimeRecorder::GetPercentiles(frameMs);
+	FrameTimePercentiles cpu = FrameTimeRecorder::GetPercentiles(cpuMs);
+	FrameTimePercentiles gpu = FrameTimeRecorder::GetPercentiles(gpuMs);
+	size_t slowest = max(frames / 100, (size_t)1);
+	double slowestMs = 0.0;
+	for (size_t i = frames - slowest; i < frames; i++)
+		slowestMs += frameMs[i];
+
+	// Everything that's compared between runs
+	metrics.clear();
+	auto addPercentiles = [&](const std::string& name, const FrameTimePercentiles& p)
+	{
+		metrics[name + ".average"] = p.Average;
+		metrics[name + ".p50"] = p.P50;
+		metrics[name + ".p95"] = p.P95;
+		metrics[name + ".p99"] = p.P99;
+		metrics[name + ".max"] = p.Max;
+	};
+	addPercentiles("frameMs", frame);
+	addPercentiles("cpuMs", cpu);
+	addPercentiles("gpuMs", gpu);
+	for (auto& pass : passTotals)
+		metrics["passMs." + pass.first] = pass.second / frames;
+
+	// Per frame averages, with the totals on their own and each pass's under its name
+	for (auto& stat : drawStatTotals)
+	{
+		bool perPass = stat.first.find('.') != std::string::npos;
+		metrics[(perPass ? "passDrawStats." : "drawStats.") + stat.first] = stat.second / frames;
+	}
+	metrics["draws.average"] = drawTotal / frames;
+	metrics["draws.max"] = FrameTimeRecorder::GetPercentiles(draws).Max;
+	metrics["stateChanges.average"] = stateChangeTotal / frames;
+	metrics["stateChanges.max"] = FrameTimeRecorder::GetPercentiles(stateChanges).Max;
+	FrameTimePercentiles allocationCounts = FrameTimeRecorder::GetPercentiles(allocations);
+	metrics["allocations.average"] = allocationCounts.Average;
+	metrics["allocations.max"] = allocationCounts.Max;
+	metrics["allocations.bytesAverage"] = FrameTimeRecorder::GetPercentiles(allocatedBytes).Average;
+	metrics["peakMemoryMB.gpu"] = peakGpuMB;
+	metrics["peakMemoryMB.trackedGpu"] = peakTrackedGpuMB;
+	metrics["peakMemoryMB.process"] = peakProcessMB;
+
+	std::ofstream json(options.ReportFile);
+	if (!json)
+	{
+		printf("Couldn't write %s\n", options.ReportFile.c_str());
+		return false;
+	}
+
+	// Each group of metrics (the part of the name before the dot) as an object
+	auto group = [&](const char* name, bool last)
+	{
+		json << "\t\"" << name << "\": {";
+		size_t prefix = strlen(name) + 1;
+		bool first = true;
+		for (auto& m : metrics)
+		{
+			if (m.first.compare(0, prefix, std::string(name) + ".") != 0)
+				continue;
+			json << (first ? " " : ", ") << "\"" << m.first.substr(prefix) << "\": " << m.second;
+			first = false;
+		}
+		json << " }" << (last ? "\n" : ",\n");
+	};
+
+	json << "{\n";
+	json << "\t\"frames\": " << frames << ",\n";
+	json << "\t\"width\": " << options.Width << ",\n";
+	json << "\t\"height\": " << options.Height << ",\n";
+	json << "\t\"timestep\": " << options.Timestep << ",\n";
+	if (options.Stress.Enabled)
+	{
+		json << "\t\"stress\": { \"seed\": " << options.Stress.Seed << ", \"entities\": " << options.Stress.Entities
+			<< ", \"lights\": " << options.Stress.Lights << ", \"emitters\": " << options.Stress.Emitters
+			<< ", \"extent\": " << options.Stress.Extent << ", \"motion\": " << (options.Stress.Motion ? "true" : "false") << " },\n";
+	}
+	group("frameMs", false);
+	group("cpuMs", false);
+	group("gpuMs", false);
+	json << "\t\"onePercentLowFps\": " << (slowestMs > 0.0 ? 1000.0 * slowest / slowestMs : 0.0) << ",\n";
+	group("passMs", false);
+	group("draws", false);
+	group("stateChanges", false);
+	group("allocations", false);
+	group("drawStats", false);
+	group("passDrawStats", false);
+	group("peakMemoryMB", true);
+	json << "}\n";
+
+	printf("Benchmark: %.3f ms p50, %.3f ms p99 over %u frames, written to %s\n", frame.P50, frame.P99, (unsigned int)frames, options.ReportFile.c_str());
+	return true;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+#include "Renderer.h"
+#include "FrameTimeRecorder.h"
+#include "StressScene.h"
+
+// Defaults for the command line options (see ScriptedBenchmarkOptions::Parse())
+#define SCRIPTED_BENCHMARK_FRAMES			1000
+#define SCRIPTED_BENCHMARK_WARMUP_FRAMES	60
+#define SCRIPTED_BENCHMARK_REPORT_FILE		"BenchmarkReport.json"
+#define REGRESSION_BASELINE_FILE			"RegressionBaseline.json"
+#define STARTUP_WARM_UP_BUDGET_MS			1000.0f
+
+// An automated run, set up from the command line:
+//   -benchmark               Run it (everything else is optional)
+//   -path <file>             Camera keyframes, one "time x y z pitch yaw roll"
+//                            per line (seconds and radians, # for comments),
+//                            or a loop around the scene without one
+//   -sky <name>              Which of the skies the scene's lit by
+//   -frames <count>          Frames recorded, after the warm up
+//   -warmup <count>          Frames run first, while things stream in
+//   -resolution <w>x<h>      Window size
+//   -timestep <seconds>      Simulated time per frame (1/60 by default)
+//   -report <file>           Where the JSON report goes
+//   -stress                  Adds a stress scene (see StressScene), which
+//                            these change from the defaults:
+//   -entities <count>
+//   -lights <count>
+//   -emitters <count>
+//   -seed <number>
+//   -extent <units>
+//   -motion
+//   -replay <file>           Draws a captured frame (see FrameCapture) over
+//                            and over instead, with nothing moving
+//   -set <name>=<value>      A renderer option (see Renderer::ApplySetting()),
+//                            as many as are needed, which stay set for any
+//                            later scenarios too
+//   -regression <file>       Runs each scenario in the file in turn (see
+//                            RegressionSuite) instead, comparing them with:
+//   -baseline <file>
+//   -tolerance <fraction>    How much worse than the baseline is a failure
+//   -update-baseline         Writes the results as the new baseline instead
+//   -scene <file>            The level (see SceneFile), in place of the built
+//                            in one, which is text if it ends in .txt
+//   -export-scene <file>     Writes the level out (binary, or text for .txt),
+//                            with the stress scene in it too, given -stress
+//   -shader-warmup <ms>      How long startup can spend drawing every shader
+//                            and state combination once (see
+//                            Renderer::WarmUp()), or 0 to skip it
+//   -background-fps <fps>    Frames drawn a second while another app's active
+//                            (see DXCore::SetBackgroundFrameRate()), 0 for
+//                            none or negative to draw at full speed - runs
+//                            started with -benchmark always draw every frame
+struct ScriptedBenchmarkOptions
+{
+	bool Enabled;
+	std::string PathFile;
+	std::string Sky;
+	int Frames;
+	int WarmupFrames;
+	unsigned int Width;
+	unsigned int Height;
+	float Timestep;
+	std::string ReportFile;
+	StressSceneOptions Stress;
+	std::string ReplayFile;
+	std::vector<std::string> Settings;	// Each "name=value"
+	std::string RegressionFile;
+	std::string BaselineFile;
+	float Tolerance;		// Negative leaves it to the baseline
+	bool UpdateBaseline;
+	std::string ScenePath;
+	std::string ExportScenePath;
+	float ShaderWarmUpMs;
+	float BackgroundFrameRate;
+
+	static ScriptedBenchmarkOptions Parse(const char* commandLine);
+};
+
+struct CameraKeyframe
+{
+	float Time;
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 PitchYawRoll;
+};
+
+// --------------------------------------------------------
+// Flies the camera along a spline through its keyframes for
+// a set number of frames, then writes a JSON report of the
+// frame times, per pass GPU times, draw and state change
+// counts (and DrawStats' counters, per pass) and peak memory
+//  - The path's positions are a Catmull-Rom spline, and its
+//    rotations are blended per angle the short way around
+//  - Paths shorter than the run loop
+// --------------------------------------------------------
+class ScriptedBenchmark
+{
+public:
+	ScriptedBenchmark();
+
+	// False if the path couldn't be loaded
+	bool Start(const ScriptedBenchmarkOptions& options);
+	bool IsRunning() { return running; }
+
+	// Puts the camera where the path is at this time
+	void MoveCamera(Camera* camera, float time);
+
+	// After each frame's drawn, returning true once the last frame's
+	// in and the report's been written (or failed to be)
+	bool RecordFrame(float frameMs, float cpuMs, Renderer* renderer);
+	bool Succeeded() { return succeeded; }
+
+	// Every number in the last report, by name (like "frameMs.p99" or
+	// "passMs.Shadows"), for comparing runs (see RegressionSuite)
+	const std::map<std::string, double>& GetMetrics() { return metrics; }
+
+private:
+	bool running;
+	bool succeeded;
+	int frameIndex;
+	ScriptedBenchmarkOptions options;
+	std::vector<CameraKeyframe> keyframes;
+
+	std::vector<float> frameMs;
+	std::vector<float> cpuMs;
+	std::vector<float> gpuMs;
+	std::vector<float> draws;
+	std::vector<float> stateChanges;	// Shader, material and mesh binds
+	std::vector<float> allocations;		// Heap allocations (and their bytes) per frame
+	std::vector<float> allocatedBytes;
+	std::map<std::string, double> passTotals;
+	std::map<std::string, double> drawStatTotals;	// By metric name, like "Scene.draws"
+	double peakGpuMB;					// What the OS says the process has of the GPU's memory
+	double peakTrackedGpuMB;			// What GpuMemory has tracked
+	double peakProcessMB;				// Private bytes
+	std::map<std::string, double> metrics;
+
+	bool LoadPath(const std::string& path);
+	void CreateDefaultPath();
+	bool WriteReport();
+};
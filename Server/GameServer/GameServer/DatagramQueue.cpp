@@ -0,0 +1,68 @@
+#include "DatagramQueue.h"
+
+DatagramQueue::DatagramQueue(unsigned int size)
+{
+	unsigned int rounded = 2;
+	while (rounded < size)
+		rounded *= 2;
+	mask = rounded - 1;
+
+	// Each slot starts out free for the push with its own number
+	slots = new Slot[rounded];
+	for (unsigned int i = 0; i < rounded; i++)
+		slots[i].Sequence.store(i, std::memory_order_relaxed);
+	head = 0;
+	tail = 0;
+}
+
+DatagramQueue::~DatagramQueue()
+{
+	delete[] slots;
+}
+
+// --------------------------------------------------------
+// Claims the head's slot if it's free (another producer may
+// take it first, in which case it's the next one), fills it,
+// and marks it filled
+// --------------------------------------------------------
+bool DatagramQueue::Push(ReceivedDatagram& datagram)
+{
+	unsigned int position = head.load(std::memory_order_relaxed);
+	Slot* slot;
+	for (;;)
+	{
+		slot = &slots[position & mask];
+		int lag = (int)(slot->Sequence.load(std::memory_order_acquire) - position);
+		if (lag == 0)
+		{
+			if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (lag < 0)
+			return false;	// Still waiting to be read, a whole lap ago
+		else
+			position = head.load(std::memory_order_relaxed);
+	}
+
+	slot->Datagram.Packet = std::move(datagram.Packet);
+	slot->Datagram.From = datagram.From;
+
+	// Release, so the datagram's there before the consumer can see it
+	slot->Sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+bool DatagramQueue::Pop(ReceivedDatagram& datagram)
+{
+	Slot* slot = &slots[tail & mask];
+	if ((int)(slot->Sequence.load(std::memory_order_acquire) - (tail + 1)) < 0)
+		return false;
+
+	datagram.Packet = std::move(slot->Datagram.Packet);
+	datagram.From = slot->Datagram.From;
+
+	// Release, so it's been emptied before it's free for the push a lap on
+	slot->Sequence.store(tail + mask + 1, std::memory_order_release);
+	tail++;
+	return true;
+}
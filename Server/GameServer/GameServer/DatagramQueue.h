@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include "../../../Network.h"
+#include "../../../NetworkPacketPool.h"
+
+// A datagram that's come in, and who from (the packet says when)
+struct ReceivedDatagram
+{
+	NetworkPacketRef Packet;
+	sockaddr_in From;
+};
+
+// A bounded, lock free queue of datagrams from any number of receive
+// workers (the producers) to the game loop (the only consumer)
+//  - Each slot has a sequence number, which says whether it's free for
+//    the push it's next up for, or filled for the pop, so producers only
+//    race each other for the head (with a compare and swap), and never
+//    the consumer
+//  - Nothing's ever locked, so a worker's never left waiting on the
+//    game loop (or another worker) part way through a tick
+class DatagramQueue
+{
+public:
+	// Rounded up to a power of two
+	DatagramQueue(unsigned int size);
+	~DatagramQueue();
+
+	DatagramQueue(const DatagramQueue&) = delete;
+	DatagramQueue& operator=(const DatagramQueue&) = delete;
+
+	// Producers: hands the datagram over (false, leaving it as it is, if the queue's full)
+	bool Push(ReceivedDatagram& datagram);
+
+	// Consumer: the oldest datagram (false if there's none)
+	bool Pop(ReceivedDatagram& datagram);
+
+private:
+	struct Slot
+	{
+		std::atomic<unsigned int> Sequence;
+		ReceivedDatagram Datagram;
+	};
+
+	Slot* slots;
+	unsigned int mask;
+
+	// Kept on separate cache lines, since the producers share one and the consumer has the other
+	alignas(64) std::atomic<unsigned int> head;	// Next slot to fill
+	alignas(64) unsigned int tail;				// Next slot to read
+};
@@ -0,0 +1,416 @@
+#include "GameRoom.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include "Helpers.h"
+
+// What's kept out of each snapshot's budget for its header and input ack
+#define SNAPSHOT_RESERVED_BITS 96
+
+GameRoom::GameRoom(unsigned int id, UDPSocket* socket, unsigned int capacity, double tickRate) :
+	socket(socket),
+	players(capacity),
+	projectileGrid(PROJECTILE_REACH)
+{
+	this->id = id;
+	this->tickRate = tickRate;
+	snapshotTick = 0;
+	SetOverload(OverloadGovernor::GetLevelSettings(0));
+	SetEntropy(nullptr, false);
+	averageUncodedBytes = 0;
+	averageCodedBytes = 0;
+	averageEncodeMicroseconds = 0;
+}
+
+void GameRoom::SetOverload(const OverloadSettings& settings)
+{
+	overload = settings;
+	interest.SetReach(INTEREST_RADIUS * settings.InterestRadiusScale, settings.FarPerSnapshot);
+}
+
+void GameRoom::SetEntropy(const NetEntropyModel* model, bool train)
+{
+	entropy = (model != nullptr && model->IsLoaded()) ? model : nullptr;
+	trainingEntropy = train;
+}
+
+void GameRoom::TakeLeft(std::vector<sockaddr_in>& left)
+{
+	left.insert(left.end(), this->left.begin(), this->left.end());
+	this->left.clear();
+}
+
+// --------------------------------------------------------
+// Everything for one tick of this room, timed a phase at
+// a time
+// --------------------------------------------------------
+void GameRoom::Tick(float deltaTime, unsigned int snapshotTicks)
+{
+	metrics.BeginTick();
+	double phaseStart = NetworkNow();
+	unsigned int tick = ++snapshotTick;
+
+	HandleReceived();
+	metrics.EndPhase(TICK_PHASE_RECEIVE, phaseStart);
+
+	//Update every player, and keep where they are now for lag compensation
+	for (unsigned int i = 0; i < players.GetCount(); i++)
+	{
+		Player* p = players.Get(i);
+		p->Update(deltaTime);
+		p->history.Record(tick, DirectX::XMFLOAT3(p->positionX, p->positionY, p->positionZ));
+	}
+
+	//Resend anything reliable that's due, and measure every connection
+	double now = NetworkNow();
+	for (unsigned int i = 0; i < players.GetCount(); i++)
+	{
+		Player* p = players.Get(i);
+		p->connection.Flush(now);
+		p->connection.GetStats().Update(now);
+	}
+	metrics.EndPhase(TICK_PHASE_PLAYERS, phaseStart);
+
+	UpdateProjectiles(deltaTime, tick);
+	metrics.EndPhase(TICK_PHASE_PROJECTILES, phaseStart);
+
+	Collide(tick);
+	metrics.EndPhase(TICK_PHASE_COLLISION, phaseStart);
+
+	//Send player position and velocity data to each client, every few ticks
+	//(which they interpolate between), or fewer while overloaded
+	snapshotTicks *= overload.SnapshotInterval;
+	if (tick % snapshotTicks == 0)
+		SendSnapshots(tick, snapshotTicks, phaseStart);
+
+	//Everything the tick's sent (replies and resends too), all at once
+	SendOutgoing();
+	metrics.EndPhase(TICK_PHASE_SNAPSHOT_SEND, phaseStart);
+}
+
+void GameRoom::PrintStats()
+{
+	char phases[512];
+	metrics.Print(phases, sizeof(phases));
+	printf("Room %u: %u/%u players | snapshots %.1f entries sent, %.1f left waiting, on average\n",
+		id, players.GetCount(), players.GetCapacity(), interest.GetAverageSent(), interest.GetAverageWaiting());
+	printf("Room %u: %s\n", id, phases);
+	if (entropy != nullptr)
+	{
+		printf("Room %u: coded snapshots %.0f bytes from %.0f (%.1f%%), %.1fus to encode, on average\n", id,
+			averageCodedBytes, averageUncodedBytes, averageUncodedBytes > 0 ? averageCodedBytes / averageUncodedBytes * 100.0f : 0.0f,
+			averageEncodeMicroseconds);
+	}
+
+	for (unsigned int i = 0; i < players.GetCount(); i++)
+	{
+		Player* p = players.Get(i);
+		char line[256];
+		p->connection.GetStats().Print(line, sizeof(line));
+		printf("Room %u: Player %u: %s\n", id, p->GetID(), line);
+	}
+}
+
+//Handles one message from a connected player, returning false once they've left
+bool GameRoom::HandleMessage(Player* p, const NetworkMessageView& message)
+{
+	//Payloads are laid out in NetworkProtocol.h
+
+	//Connection Request
+	if (message.GetType() == NETWORK_MSG_CONNECT)
+	{
+		//Read player initial position and velocity
+		NetConnectRequest request = { { DirectX::XMFLOAT3(0, 0, 0), DirectX::XMFLOAT3(0, 0, 0), DirectX::XMFLOAT3(0, 0, 0) } };
+		NetReadMessage(message, request);
+		Helpers::SetPlayerState(p, request.State);
+		p->hasEntropyModel = request.HasEntropyModel;
+		p->entropyModel = request.EntropyModel;
+
+		//Respond with their player ID and the tick rate (from its own buffer, since the tick's
+		//using sendbuffer), which goes right away, and again until it's acknowledged
+		char reply[NETWORK_MESSAGE_HEADER_SIZE + NetMessage<NetConnectAccepted>::MaxBytes];
+		NetConnectAccepted accepted = { p->GetID(), players.GetCapacity(), (unsigned int)tickRate };
+		NetworkMessageWriter response = NetWriteMessage(reply, sizeof(reply), accepted);
+		p->connection.Send(response, NETWORK_CHANNEL_ORDERED);
+		p->connection.Flush(NetworkNow());
+
+		printf("Room %u: Player %u joined.\n", id, p->GetID());
+	}
+	else if (message.GetType() == NETWORK_MSG_NEW_PROJECTILE) //New projectile
+	{
+		//Given the lowest free slot (its Owner is whoever sent it, whatever it says),
+		//and dropped if there isn't one
+		NetNewProjectile newProjectile;
+		if (!NetReadMessage(message, newProjectile)) return true;
+		ProjectileNetState& state = newProjectile.State;
+
+		Projectile* projectile = projectiles.Spawn(snapshotTick);
+		if (projectile == nullptr) return true;
+
+		Helpers::SetProjectileState(projectile, state);
+		projectile->ownerID = p->GetID();
+		projectile->shot = state.Shot;
+
+		//Fired at where they saw everyone, which is a round trip (there and
+		//back) plus how far behind they draw them
+		projectile->rewindSeconds = (float)min(p->connection.GetStats().GetRtt() + LAG_COMPENSATION_VIEW_DELAY, LAG_COMPENSATION_MAX);
+	}
+	else if (message.GetType() == NETWORK_MSG_DISCONNECT) //Intentional Disconnect
+	{
+		NetDisconnect disconnect;
+		if (!NetReadMessage(message, disconnect) || players.Find(disconnect.PlayerID) != p) return true;
+
+		printf("Room %u: Player %u disconnected.\n", id, disconnect.PlayerID);
+		return false;
+	}
+	else if (message.GetType() == NETWORK_MSG_UPDATE) //Player update
+	{
+		//With their newest few inputs, in order
+		NetPlayerUpdate update;
+		if (!NetReadMessage(message, update) || update.PlayerID != p->GetID()) return true;
+
+		//The newest snapshot they've got, to send the next ones against
+		if (update.HasSnapshotAck && (!p->hasAck || NetworkSequenceNewer(update.SnapshotAck, p->ackTick)))
+		{
+			p->ackTick = update.SnapshotAck;
+			p->hasAck = true;
+		}
+
+		//Moved by each input not already had, with the same code the client
+		//predicted with, so whatever we say they did is what they saw
+		//(inputs lost even from the resends are just skipped)
+		for (unsigned int i = 0; i < update.InputCount; i++)
+		{
+			unsigned int sequence = update.FirstInput + i;
+			if (p->hasInput && !NetworkSequenceNewer(sequence, p->lastInput)) continue;
+
+			Helpers::MovePlayer(p, update.Inputs[i]);
+			p->lastInput = sequence;
+			p->hasInput = true;
+		}
+	}
+	return true;
+}
+
+//Everything the front end's routed here since the last tick
+void GameRoom::HandleReceived()
+{
+	for (ReceivedDatagram& datagram : inbox)
+	{
+		metrics.CountReceived(datagram.Packet->Size);
+		try
+		{
+			//Someone new (who the front end's already checked is asking to join)
+			//gets the lowest open slot, if there still is one, and their
+			//connection's what reads everything they send from then on
+			Player* p = players.Find(datagram.From);
+			if (p == nullptr)
+			{
+				p = players.Add(datagram.From);
+				if (p == nullptr)
+				{
+					left.push_back(datagram.From);
+					continue;
+				}
+				p->connection.SetSender([this, p](const char* data, int size)
+				{
+					if (socket != nullptr)
+					{
+						outgoing.insert(outgoing.end(), data, data + size);
+						outgoingTo.push_back(p->client);
+						outgoingSizes.push_back(size);
+					}
+					metrics.CountSent(size);
+				});
+			}
+
+			//Anything cut short, or not framed at all, is ignored
+			bool stillConnected = true;
+			p->connection.Receive(std::move(datagram.Packet), [&](const NetworkMessageView& message)
+			{
+				if (stillConnected)
+					stillConnected = HandleMessage(p, message);
+			});
+
+			if (!stillConnected)
+			{
+				left.push_back(p->client);
+				players.Remove(p);
+			}
+		}
+		catch (std::exception& ex)
+		{
+			printf("Room %u: %s\n", id, ex.what());
+		}
+	}
+
+	//(Which gives the packets back)
+	inbox.clear();
+}
+
+//Moves every live projectile, and gives back the ones that die (backwards,
+//since that swaps the last into their place)
+void GameRoom::UpdateProjectiles(float deltaTime, unsigned int tick)
+{
+	for (unsigned int i = projectiles.GetCount(); i-- > 0;)
+	{
+		Projectile* p = projectiles.Get(i);
+		p->Update(deltaTime);
+		if (p->dead)
+			projectiles.Release(p, tick);
+	}
+}
+
+void GameRoom::Collide(unsigned int tick)
+{
+	//Where each live projectile went this tick, bucketed by the middle of
+	//that (ignoring a few frames' worth to avoid instant self collision)
+	projectileSweeps.Clear();
+	projectileGrid.Clear();
+	sweepRewinds.clear();
+	for (unsigned int j = 0; j < projectiles.GetCount(); j++)
+	{
+		Projectile* projectile = projectiles.Get(j);
+		if (projectile->age < 0.1f) continue;
+		projectileSweeps.Add(projectile->slot, projectile->previousPosition, projectile->GetTransform()->GetPosition());
+		sweepRewinds.push_back(projectile->rewindSeconds);
+		projectileGrid.Insert(projectileSweeps.GetCount() - 1, projectileSweeps.GetMidpoint(projectileSweeps.GetCount() - 1));
+	}
+	projectileGrid.Build();
+	sweepCandidates.resize(projectileSweeps.GetCount());
+	sweepHits.resize(projectileSweeps.GetCount());
+
+	//Each player's capsule against the sweeps around them, four at a time,
+	//with the capsule where each sweep's shooter saw them (the grid's reach
+	//leaves room for how far they can have moved since)
+	for (unsigned int i = 0; i < players.GetCount(); i++)
+	{
+		Player* p = players.Get(i);
+		unsigned int* candidates = sweepCandidates.data();
+		unsigned int candidateCount = 0;
+		projectileGrid.QueryNeighbours(DirectX::XMFLOAT3(p->positionX, p->positionY - 1, p->positionZ), [&](unsigned int sweep)
+		{
+			candidates[candidateCount++] = sweep;
+		});
+
+		//Those rewound just as far go together (which is all of one shooter's),
+		//or about as far, while overloaded
+		float step = overload.RewindStep;
+		auto rewind = [&](unsigned int sweep) { return step > 0 ? floorf(sweepRewinds[sweep] / step + 0.5f) * step : sweepRewinds[sweep]; };
+		std::sort(candidates, candidates + candidateCount, [&](unsigned int a, unsigned int b) { return rewind(a) < rewind(b); });
+
+		unsigned int* hits = sweepHits.data();
+		unsigned int hitCount = 0;
+		for (unsigned int first = 0, last; first < candidateCount; first = last)
+		{
+			for (last = first + 1; last < candidateCount && rewind(candidates[last]) == rewind(candidates[first]); last++);
+
+			DirectX::XMFLOAT3 seen(p->positionX, p->positionY, p->positionZ);
+			p->history.GetPosition(tick - rewind(candidates[first]) * tickRate, seen);
+			hitCount += projectileSweeps.TestCapsule(candidates + first, last - first,
+				DirectX::XMFLOAT3(seen.x, seen.y + PLAYER_HIT_BOTTOM, seen.z),
+				DirectX::XMFLOAT3(seen.x, seen.y + PLAYER_HIT_TOP, seen.z), hits + hitCount);
+		}
+		for (unsigned int h = 0; h < hitCount; h++)
+		{
+			//(Already used up on someone else this tick)
+			Projectile* hit = projectiles.GetInSlot(hits[h]);
+			if (hit == nullptr) continue;
+
+			//Gone from the next snapshot's projectiles, which tells the clients
+			printf("Room %u: Player %u is hit!\n", id, p->GetID());
+			projectiles.Release(hit, tick);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Each client's snapshot, with each kept to be a baseline
+// for later ones
+// --------------------------------------------------------
+void GameRoom::SendSnapshots(unsigned int tick, unsigned int snapshotTicks, double& phaseStart)
+{
+	interest.Build(players, projectiles);
+
+	//Each gets as much as their share of INTEREST_BYTES_PER_SECOND (or one
+	//message), less what the header and their input ack take
+	double snapshotsPerSecond = tickRate / snapshotTicks;
+	unsigned int budgetBytes = (unsigned int)min((double)INTEREST_BYTES_PER_SECOND / snapshotsPerSecond,
+		(double)(NETWORK_MAX_MESSAGE_SIZE - NETWORK_MESSAGE_HEADER_SIZE));
+	unsigned int budgetBits = budgetBytes * 8 - SNAPSHOT_RESERVED_BITS;
+
+	//Sent to each client against the newest snapshot they've acknowledged,
+	//or whole if that's too old to still be kept (or they haven't yet)
+	for (unsigned int i = 0; i < players.GetCount(); i++)
+	{
+		Player* p = players.Get(i);
+		WorldSnapshot* baseline = nullptr;
+		if (p->hasAck && tick - p->ackTick < NET_SNAPSHOT_HISTORY)
+		{
+			WorldSnapshot& acked = p->interest.Sent[p->ackTick % NET_SNAPSHOT_HISTORY];
+			if (acked.Valid && acked.Tick == p->ackTick)
+				baseline = &acked;
+		}
+
+		WorldSnapshot& snapshot = p->interest.Sent[tick % NET_SNAPSHOT_HISTORY];
+		snapshot.Tick = tick;
+		snapshot.Valid = true;
+		interest.BuildSnapshot(p, snapshot, baseline, budgetBits);
+
+		char bits[NETWORK_MAX_MESSAGE_SIZE - NETWORK_MESSAGE_HEADER_SIZE];
+		BitWriter stream(bits, sizeof(bits));
+		//And the newest of their inputs they've been moved by
+		NetSnapshotHeader header = { tick, baseline != nullptr, baseline ? tick - baseline->Tick : 0, p->hasInput, p->lastInput };
+		NetMessage<NetSnapshotHeader>::Serialize(stream, header);
+		NetSerializeSnapshot(stream, snapshot, baseline);
+		stream.Flush();
+
+		//Entropy coded, for whoever has the same model, whenever that's
+		//smaller (and counted for training one, with -entropytrain)
+		if (trainingEntropy)
+			entropyTrainer.Add(stream.GetData(), stream.GetSize());
+		int coded = 0;
+		if (entropy != nullptr && p->hasEntropyModel && p->entropyModel == entropy->GetID())
+		{
+			double encodeStart = NetworkNow();
+			coded = entropy->Encode(stream.GetData(), stream.GetSize(), codedbuffer, sizeof(codedbuffer));
+			float encodeMicroseconds = (float)((NetworkNow() - encodeStart) * 1000000.0);
+			averageUncodedBytes += (stream.GetSize() - averageUncodedBytes) * 0.05f;
+			averageCodedBytes += ((coded > 0 ? coded : stream.GetSize()) - averageCodedBytes) * 0.05f;
+			averageEncodeMicroseconds += (encodeMicroseconds - averageEncodeMicroseconds) * 0.05f;
+		}
+
+		metrics.EndPhase(TICK_PHASE_SNAPSHOT_BUILD, phaseStart);
+
+		NetworkMessageWriter message(sendbuffer, sizeof(sendbuffer), coded > 0 ? NETWORK_MSG_CODED_UPDATE : NETWORK_MSG_UPDATE);
+		if (coded > 0)
+			message.Write(codedbuffer, coded);
+		else
+			message.Write(stream.GetData(), stream.GetSize());
+		p->connection.Send(message, NETWORK_CHANNEL_UNRELIABLE);
+		p->connection.Flush(NetworkNow());
+		metrics.EndPhase(TICK_PHASE_SNAPSHOT_SEND, phaseStart);
+	}
+}
+
+//Everything the tick's sent, in as few calls as the socket can do it in
+void GameRoom::SendOutgoing()
+{
+	outgoingData.clear();
+	const char* data = outgoing.data();
+	for (int size : outgoingSizes)
+	{
+		outgoingData.push_back(data);
+		data += size;
+	}
+
+	int sent = 0;
+	if (!outgoingSizes.empty())
+		socket->SendBatch(outgoingTo.data(), outgoingData.data(), outgoingSizes.data(), (int)outgoingSizes.size(), sent);
+
+	outgoing.clear();
+	outgoingTo.clear();
+	outgoingSizes.clear();
+}
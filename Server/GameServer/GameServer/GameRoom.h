@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include "Player.h"
+#include "PlayerRegistry.h"
+#include "ProjectilePool.h"
+#include "SpatialHashGrid.h"
+#include "ProjectileSweeps.h"
+#include "InterestManager.h"
+#include "TickMetrics.h"
+#include "OverloadGovernor.h"
+#include "DatagramQueue.h"
+#include "../../../Network.h"
+#include "../../../NetworkMessage.h"
+#include "../../../NetworkProtocol.h"
+#include "../../../NetworkEntropy.h"
+
+// How far from a player a projectile's sweep can be centred and still hit
+// them, which the grid's cells are as big as (so, with the capsule, a
+// projectile can move up to about 16 units a tick)
+#define PROJECTILE_REACH 10.0f
+
+// One match, with everyone in it, their projectiles, and its own tick
+//  - Everything it owns is only touched by whichever thread is ticking
+//    it, so rooms can be ticked at the same time, on different threads
+//  - It's handed the datagrams from its players (and whoever's been sent
+//    to it to join) by the server's front end, which owns the socket
+//    and routes them by where they came from, and sends through the
+//    same socket (sendto from several threads at once is fine), all of
+//    a tick's at once at the end of it (see UDPSocket::SendBatch())
+//  - Whoever leaves is kept for the front end to take with TakeLeft(),
+//    once it's done ticking, so it can forget where they were routed
+//  - Without a socket (replaying a recording, see TrafficReplay) it
+//    builds everything it'd send, and counts it, but sends nothing
+class GameRoom
+{
+public:
+	GameRoom(unsigned int id, UDPSocket* socket, unsigned int capacity, double tickRate);
+
+	unsigned int GetID() { return id; }
+	PlayerRegistry& GetPlayers() { return players; }
+	InterestManager& GetInterest() { return interest; }
+	TickMetrics& GetMetrics() { return metrics; }
+
+	// How much less to do while the server's overloaded (from the
+	// OverloadGovernor), from the room's next tick on
+	void SetOverload(const OverloadSettings& settings);
+
+	// Snapshots are entropy coded with the model for whoever has it too
+	// (or none, with nullptr), and with train, every one's counted for
+	// a model to be made from (see GetEntropyTrainer())
+	void SetEntropy(const NetEntropyModel* model, bool train);
+	NetEntropyTrainer& GetEntropyTrainer() { return entropyTrainer; }
+
+	// Handled at the start of its next tick
+	void Route(ReceivedDatagram& datagram) { inbox.push_back(std::move(datagram)); }
+
+	// Everything this tick does, from handling what's come in to sending
+	// snapshots (every snapshotTicks ticks)
+	void Tick(float deltaTime, unsigned int snapshotTicks);
+
+	// Who's left (or couldn't join) since it was last asked
+	void TakeLeft(std::vector<sockaddr_in>& left);
+
+	// The room's numbers, and each of its connections', for the console
+	void PrintStats();
+
+private:
+	unsigned int id;
+	UDPSocket* socket;
+	double tickRate;
+	char sendbuffer[NETWORK_MAX_MESSAGE_SIZE];
+
+	std::vector<ReceivedDatagram> inbox;
+	std::vector<sockaddr_in> left;
+
+	// Everything sent this tick, one after the other, and who each is to
+	std::vector<char> outgoing;
+	std::vector<sockaddr_in> outgoingTo;
+	std::vector<int> outgoingSizes;
+	std::vector<const char*> outgoingData;
+
+	// How long each part of every tick takes, and what goes in and out
+	TickMetrics metrics;
+	OverloadSettings overload;
+
+	// Each client's snapshots are whatever's most worth sending them, kept
+	// (in their ClientInterest) so each can be sent a delta against the
+	// newest one they've acknowledged
+	InterestManager interest;
+	unsigned int snapshotTick;
+
+	// Shared by every room (so it's only read), and how well it's done,
+	// per coded snapshot, smoothed
+	const NetEntropyModel* entropy;
+	NetEntropyTrainer entropyTrainer;
+	bool trainingEntropy;
+	char codedbuffer[NETWORK_MAX_MESSAGE_SIZE - NETWORK_MESSAGE_HEADER_SIZE];
+	float averageUncodedBytes;
+	float averageCodedBytes;
+	float averageEncodeMicroseconds;
+
+	// Everyone in the room (as many as -maxplayers, up to NET_MAX_PLAYERS)
+	PlayerRegistry players;
+
+	// Every live projectile, in the slots the room gives them as they're fired
+	ProjectilePool projectiles;
+
+	// Live projectiles, bucketed every tick so each player only checks the
+	// ones in the cells around them (which are as big as their reach)
+	SpatialHashGrid projectileGrid;
+	ProjectileSweeps projectileSweeps;
+	std::vector<float> sweepRewinds;	// Each sweep's projectile's rewindSeconds
+	std::vector<unsigned int> sweepCandidates;
+	std::vector<unsigned int> sweepHits;
+
+	bool HandleMessage(Player* p, const NetworkMessageView& message);
+	void HandleReceived();
+	void UpdateProjectiles(float deltaTime, unsigned int tick);
+	void Collide(unsigned int tick);
+	void SendSnapshots(unsigned int tick, unsigned int snapshotTicks, double& phaseStart);
+	void SendOutgoing();
+};
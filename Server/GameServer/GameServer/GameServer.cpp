@@ -7,300 +7,398 @@
 #include <cstdint>
 #include <thread>
 #include <vector>
+#include <unordered_map>
 #include <bitset>
-#include "Player.h"
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+#include "GameRoom.h"
 #include "Helpers.h"
+#include "TickScheduler.h"
+#include "PlayerRegistry.h"
+#include "ReceiveEngine.h"
+#include "TickMetrics.h"
+#include "OverloadGovernor.h"
+#include "TrafficLog.h"
+#include "../../../JobSystem.h"
 #include "../../../Network.h"
+#include "../../../NetworkMessage.h"
+#include "../../../NetworkPacketPool.h"
+#include "../../../NetworkEntropy.h"
+#include "../../../ThreadManager.h"
 
 using namespace std::chrono;
 
-#define MAX_PLAYERS 4
-#define MAX_PROJECTILES 6
+// How many datagrams can be waiting to be handled (or being received into) at once
+#define PACKET_POOL_SIZE 4096
 
-using frame = duration<int32_t, std::ratio<1, 60>>;
-using ms = duration<float, std::milli>;
+// How many rooms there can be (-rooms), each its own match
+#define MAX_ROOMS 64
+
+// How often every room's (and connection's) numbers are printed (see NetworkConnectionStats)
+#define STATS_PRINT_SECONDS 10
+
+// Wakes the game loop for each tick (the rate can be set with -tickrate),
+// which ticks every room
+TickScheduler scheduler(NET_SERVER_TICK_RATE);
+
+// Has every room do less while the ticks are taking too long (see
+// OverloadGovernor), which (like the scheduler) only the game loop uses
+OverloadGovernor governor;
+
+// Where the rooms' tick metrics are exported to (-metrics FILE, as
+// Prometheus text) with the stats
+std::string metricsPath;
+
+// Snapshots can be entropy coded with a model (-entropy FILE) for the
+// clients that have it too, and a model trained on every snapshot that's
+// built (-entropytrain FILE, written once the server stops), which is
+// best done offline, replaying some recorded traffic
+NetEntropyModel entropyModel;
+std::string entropyTrainPath;
 
 bool gameLoopRunning = true;
-bool recvLoopRunning = true;
 
 WSASession Session;
 UDPSocket Socket;
-char buffer[500];
-char sendbuffer[500];
-bool newData;
-
-Player* players[MAX_PLAYERS];
-Projectile projectiles[MAX_PROJECTILES];
-
 
+// Received datagrams are read in place, from pooled packets, which the
+// receive engine's workers fill and the game loop takes every tick
+NetworkPacketPool packetPool(PACKET_POOL_SIZE);
+ReceiveEngine receiver(Socket, packetPool);
+std::vector<ReceivedDatagram> receivedBatch;
+
+// Every match (-rooms of them, with -maxplayers each), ticked at the same
+// time on the job system's workers (-workers, or one per core)
+std::vector<GameRoom*> rooms;
+unsigned int roomCount = 1;
+unsigned int roomCapacity = NET_MAX_PLAYERS;
+unsigned int jobWorkers = 0;
+
+// Which room everyone's datagrams go to, by where they come from, and
+// how many are routed to each (who's in it, and who's joining)
+std::unordered_map<unsigned long long, GameRoom*> routes;
+std::vector<unsigned int> routedCounts;
+
+// Everything received can be recorded (-record FILE), and a recording
+// played back through the rooms instead of a socket (-replay FILE), at
+// -replayspeed times the speed it was recorded at (or as fast as it
+// goes, with 0), so changes can be timed against the same traffic
+TrafficRecorder recorder;
+TrafficReplay replay;
+bool replaying = false;
+double replaySpeed = 1.0;
+
+
+
+//Whether a datagram from someone new is asking to join, which is
+//the only thing they can send before they have
+bool IsConnectRequest(const NetworkPacket* packet)
+{
+    NetworkMessageHeader header;
+    for (int offset = NETWORK_PACKET_HEADER_SIZE; NetworkReadMessage(packet->Data, packet->Size, offset, header); offset += NETWORK_MESSAGE_HEADER_SIZE + header.Length)
+    {
+        if (header.Type == NETWORK_MSG_CONNECT)
+            return true;
+    }
+    return false;
+}
 
-//Receives all client communications
-void RecvFromLoop()
+//Hands everything that's come in since the last tick (or was recorded
+//for it) to the room it's for, with someone new asking to join sent to
+//the first room with space, so matches fill up one at a time
+void RouteReceived(unsigned int tick)
 {
-    while (recvLoopRunning)
+    if (replaying)
+        replay.Take(tick, packetPool, receivedBatch);
+    else
+        receiver.TakeReceived(receivedBatch);
+
+    for (ReceivedDatagram& datagram : receivedBatch)
     {
-        while (!newData)
+        if (recorder.IsOpen())
+            recorder.Record(tick, datagram);
+
+        unsigned long long key = PlayerRegistry::EndpointKey(datagram.From);
+        auto route = routes.find(key);
+        if (route == routes.end())
         {
-            try
+            if (!IsConnectRequest(datagram.Packet.Get())) continue;
+
+            GameRoom* room = nullptr;
+            for (GameRoom* candidate : rooms)
             {
-                sockaddr_in sender = Socket.RecvFrom(&buffer[0], 500);
-                newData = true;
-                
-                //Can we handle this data ourselves?
-                unsigned int* msgType = (unsigned int*)&buffer;
-                
-                //Connection Request
-                if (*msgType == 1)
+                if (routedCounts[candidate->GetID()] < candidate->GetPlayers().GetCapacity())
                 {
-                    int firstOpen = -1;
-                    for (size_t i = 0; i < MAX_PLAYERS; i++)
-                    {
-                        if (players[i] == nullptr)
-                        {
-                            firstOpen = i;
-                            break;
-                        }
-                    }
-                    if (firstOpen != -1)
-                    {
-
-                        ////Tell every other played someone joined
-                        //for (size_t i = 0; i < MAX_PLAYERS; i++)
-                        //{
-                        //    if (players[i] == nullptr) continue;
-                        //    //Send a response
-                        //    std::fill_n(sendbuffer, 500, 0);
-
-                        //    unsigned int data = 2;
-                        //    std::memcpy(&sendbuffer, &data, 4);
-                        //    Socket.SendTo(players[i]->client, sendbuffer, 500);
-                        //}
-
-
-                        //Respond with 1 to accept, followed by a player ID
-
-                        int newID = firstOpen;
-                        Player* np = new Player(sender, newID);
-                        players[firstOpen] = np;
-
-                        //Read player initial position and velocity
-                        Helpers::ReadPlayerMovementData(np, &buffer[0] + 1);
-
-                        /*for (size_t i = 0; i < 8; i++)
-                        {
-                            std::bitset<8> x(sendbuffer[i]);
-                            std::cout << x << " ";
-                        }*/
-
-                        //Send a response
-                        std::fill_n(sendbuffer, 500, 0);
-
-                        unsigned int data = 1;
-                        std::memcpy(&sendbuffer, &data, 4);
-                        data = np->GetID();
-                        std::memcpy(&sendbuffer[4], &data, 4);
-                        data = MAX_PLAYERS;
-                        std::memcpy(&sendbuffer[8], &data, 4);
-
-                        Socket.SendTo(sender, sendbuffer, 500);
-
-                        std::cout << "Player " << np->GetID() << " joined.\n";
-
-                        //Clear buffer
-                        std::fill_n(buffer, 500, 0);
-                        newData = false;
-                    }
+                    room = candidate;
+                    break;
                 }
-                else if (*msgType == 3) //New projectile
-                {
-                    int* index = (int*)(&buffer[0] + 4);
-
-                    Projectile* p = &projectiles[*index];
-                    Helpers::ReadProjectileMovementData(p, &buffer[0] + 8);
-
-                    newData = false;
-
-                }
-                else if (*msgType == 4) //Intentional Disconnect
-                {
-                    unsigned int* pID = (unsigned int*)(&buffer[0] + 4);
-
-                    std::cout << "Player " << *pID << " disconnected." << std::endl;
-
-                    Socket.SendTo(players[*pID]->client, sendbuffer, 500); //Send garbage to free the recvfrom
+            }
+            if (room == nullptr) continue;
 
-                    Player* dc = players[*pID];
-                    players[*pID] = nullptr;
-                    delete dc;
+            route = routes.emplace(key, room).first;
+            routedCounts[room->GetID()]++;
+        }
+        route->second->Route(datagram);
+    }
 
-                    //Clear buffer
-                    std::fill_n(buffer, 500, 0);
-                    newData = false;
+    //(Which gives back the packets no room wanted)
+    receivedBatch.clear();
+}
 
-                }
-                else if(*msgType == 10) //Player update
-                { 
-                    unsigned int playerID = *(msgType + 1);
-                    //Find that player
-                    Player* p = nullptr;
-                    for (size_t i = 0; i < MAX_PLAYERS; i++)
-                    {
-                        if (players[i] == nullptr) continue;
-                        if (players[i]->ID == playerID)
-                        {
-                            p = players[i];
-                            break;
-                        }
-                    }
-                    if (p == nullptr)
-                    {
-                        //Clear buffer
-                        std::fill_n(buffer, 500, 0);
-                        newData = false;
-                        continue;
-                    }
-
-                    //Read player initial position and velocity
-                    float posX, posY, posZ, velX, velY, velZ;
-                    float* posData = (float*)&buffer;
-                    posX = *(posData + 2);
-                    posY = *(posData + 3);
-                    posZ = *(posData + 4);
-                    velX = *(posData + 5);
-                    velY = *(posData + 6);
-                    velZ = *(posData + 7);
-
-                    p->SetPosition(posX, posY, posZ);
-                    p->SetVelocity(velX, velY, velZ);
-
-                    //Clear buffer
-                    std::fill_n(buffer, 500, 0);
-                    newData = false;
-                }
-                //Socket.SendTo(sender, "awrfawfr", 8);
-            }
-            catch (std::exception& ex)
-            {
-                std::cout << ex.what() << std::endl;
-            }
+//Forgets where everyone who's left each room was routed
+void ForgetLeft()
+{
+    std::vector<sockaddr_in> left;
+    for (GameRoom* room : rooms)
+    {
+        left.clear();
+        room->TakeLeft(left);
+        for (const sockaddr_in& endpoint : left)
+        {
+            if (routes.erase(PlayerRegistry::EndpointKey(endpoint)) > 0)
+                routedCounts[room->GetID()]--;
         }
     }
 }
 
-//Updates at 60 frames
+//Prints every room's numbers, and exports them (with -metrics)
+void PrintStats(const ReceiveEngineStats& received)
+{
+    TickStats ticks = scheduler.GetStats();
+    printf("Ticks: %.0f/s, %llu run, %llu overran, %llu skipped | late %.2fms avg %.2fms max | work %.2fms | drift %.2fms | overload level %u (%llu changes)\n",
+        scheduler.GetTickRate(), ticks.Ticks, ticks.Overruns, ticks.Skipped,
+        ticks.AverageLateMs, ticks.MaxLateMs, ticks.AverageWorkMs, ticks.DriftMs,
+        governor.GetLevel(), governor.GetChanges());
+
+    std::vector<TickMetricsRoom> exported;
+    for (GameRoom* room : rooms)
+    {
+        room->PrintStats();
+        exported.push_back({ room->GetID(), &room->GetMetrics(), &room->GetPlayers() });
+    }
+    if (!metricsPath.empty() && !TickMetrics::Export(metricsPath, exported, ticks, received))
+        std::cout << "Couldn't write the metrics to " << metricsPath << std::endl;
+}
+
+//Updates at the scheduler's tick rate (60 by default), or a replay's
+//ticks until there are none left
 void GameLoop()
 {
-    time_point<steady_clock> fpsTimer(steady_clock::now());
-    frame FPS{};
+    ThreadManager::GetInstance().Configure(ThreadRole::Simulation, "Game Loop");
+
+    //This thread's worker zero, and helps tick the rooms
+    JobSystem::GetInstance().Initialize(jobWorkers);
+
+    double lastStatsPrint = NetworkNow();
+    double startTime = lastStatsPrint;
+    ReceiveEngineStats lastReceive = {};
 
+    //Every tick's as long as it was when it was recorded, however fast it's replayed
+    double tickRate = replaying ? replay.GetTickRate() : scheduler.GetTickRate();
+    float deltaTime = (float)(1.0 / tickRate);
+
+    //Snapshots go out at about the same rate, whatever the tick rate is
+    unsigned int snapshotTicks = (unsigned int)max(1.0, floor(tickRate / NET_SNAPSHOT_RATE + 0.5));
+
+    unsigned int tick = 0;
     while (gameLoopRunning)
     {
-        FPS = duration_cast<frame>(steady_clock::now() - fpsTimer);
-        if (FPS.count() >= 1)
+        //Sleeps until the tick's due, rather than spinning on the clock
+        if (!replaying || replaySpeed > 0)
         {
-            fpsTimer = steady_clock::now();
-            float deltaTime = duration_cast<ms>(FPS).count() / 1000;
-            //std::cout << "LastFrame: " << duration_cast<ms>(FPS).count() << "ms  |  FPS: " << FPS.count() * 60 << std::endl;
-        
-            //Update every player
-            for (size_t i = 0; i < MAX_PLAYERS; i++)
-            {
-                if (players[i] == nullptr) continue;
-                players[i]->Update(deltaTime);
-            }
+            scheduler.WaitForNextTick();
 
-            //Update every projectile
-            for (int i = 0; i < MAX_PROJECTILES; i++)
+            //Every room does less (or more again) from this tick on, if the
+            //last ones have been taking too long (or have stopped)
+            if (governor.Update(scheduler.GetStats().AverageWorkMs, scheduler.GetTickSeconds() * 1000.0))
             {
-                Projectile* p = &(projectiles[i]);
-                if (!p->dead)
-                {
-                    p->Update(deltaTime);
-                    if (p->dead)
-                    {
-                        //Do nothing I guess?? lmao
-                        p->GetTransform()->SetPosition(0, -5000, 0);
-                    }
-                }
+                for (GameRoom* room : rooms)
+                    room->SetOverload(governor.GetSettings());
             }
+        }
 
-            for (int i = 0; i < MAX_PLAYERS; i++)
-            {
-                if (players[i] == nullptr) continue;
-                for (int j = 0; j < MAX_PROJECTILES; j++)
-                {
-                    //ignore a few frames to avoid instant self collision
-                    if (projectiles[j].dead || projectiles[j].age < 0.1f) continue; 
-                    if (Helpers::CheckProjectileCollision(players[i], &projectiles[j], deltaTime, 3))
-                    {
-                        std::cout << "Player " << i << " is hit!" << std::endl;
-                        projectiles[j].dead = true;
-                        projectiles[j].age = projectiles[j].lifespan + 1; //tells the clients it's dead
-                        projectiles[j].GetTransform()->SetPosition(0, -5000, 0);
-                    }
-                }
-            }
-        
-            //Send player position and velocity data to each client
-            std::fill_n(sendbuffer, 500, 0);
+        RouteReceived(++tick);
 
-            int msgtyp = 10;
+        //Every room at once, a job each, which whichever worker's free takes
+        JobSystem::GetInstance().ParallelFor((unsigned int)rooms.size(), 1, [&](unsigned int start, unsigned int end)
+        {
+            for (unsigned int i = start; i < end; i++)
+                rooms[i]->Tick(deltaTime, snapshotTicks);
+        });
 
-            std::memcpy(&sendbuffer, &msgtyp, 4);
-            for (size_t i = 0; i < MAX_PLAYERS; i++)
-            {
-                if (players[i] == nullptr)
-                {
-                    float z = -5000;
-                    std::memcpy(&sendbuffer[0] + (i * 36) + 12, &z, 4);
-                    continue;
-                }
-                Helpers::CopyPlayerMovementData(players[i], &sendbuffer[0] + (i * 36) + 4);
-            }
-            for (size_t i = 0; i < MAX_PROJECTILES; i++)
-            {
-                Helpers::CopyProjectileMovementData(&projectiles[i], &sendbuffer[0] + (MAX_PLAYERS * 36) + (i * 48) + 4);
-            }
-            for (size_t i = 0; i < MAX_PLAYERS; i++)
-            {
-                if (players[i] == nullptr) continue;
-                Socket.SendTo(players[i]->client, sendbuffer, 500);
-            }
+        ForgetLeft();
+
+        if (replaying && replay.IsFinished())
+        {
+            double seconds = NetworkNow() - startTime;
+            printf("Replayed %llu datagrams (%llu dropped) over %u ticks in %.2fs, %.0f ticks/s (%.1fx)\n",
+                replay.GetCount(), replay.GetDropped(), tick, seconds, tick / seconds, tick / seconds / tickRate);
+            PrintStats(receiver.GetStats());
+            break;
+        }
+
+        //Print everything now and then
+        double now = NetworkNow();
+        if (now - lastStatsPrint >= STATS_PRINT_SECONDS)
+        {
+            //Packets per second, and per second of the workers' CPU time
+            ReceiveEngineStats received = receiver.GetStats();
+            double cpuSeconds = received.CpuSeconds - lastReceive.CpuSeconds;
+            printf("Receive: %.0f packets/s, %.0f per core second, %llu dropped, %llu discarded, %u workers\n",
+                (received.Packets - lastReceive.Packets) / (now - lastStatsPrint),
+                cpuSeconds > 0 ? (received.Packets - lastReceive.Packets) / cpuSeconds : 0.0,
+                received.Dropped, received.Discarded, received.Workers);
+            lastReceive = received;
+
+            lastStatsPrint = now;
+            PrintStats(received);
         }
     }
+
+    JobSystem::GetInstance().Shutdown();
+    ThreadManager::GetInstance().Unregister();
 }
 
-int main()
+int main(int argc, char* argv[])
 {
     std::string IP = "127.0.0.1";
     int PORT = 8888;
 
-    std::thread gameLoop;
-    std::thread recvLoop;
+    //-port N, -tickrate N, -maxplayers N (per room), -rooms N and -workers N
+    //override the defaults, -metrics FILE exports the tick metrics there
+    //with the stats, -record FILE, -replay FILE and -replayspeed N
+    //record and replay traffic, and -entropy FILE and -entropytrain FILE
+    //code snapshots with a model, and train one, and -threads FILE reads
+    //the thread settings from somewhere other than Threads.cfg
+    std::string recordPath, replayPath, entropyPath;
+    std::string threadsPath = THREAD_MANAGER_CONFIG_PATH;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i];
+        if (option == "-port")
+            PORT = atoi(argv[i + 1]);
+        else if (option == "-tickrate" && atof(argv[i + 1]) > 0)
+            scheduler.SetTickRate(atof(argv[i + 1]));
+        else if (option == "-maxplayers" && atoi(argv[i + 1]) > 0)
+            roomCapacity = min((unsigned int)atoi(argv[i + 1]), (unsigned int)NET_MAX_PLAYERS);
+        else if (option == "-rooms" && atoi(argv[i + 1]) > 0)
+            roomCount = min((unsigned int)atoi(argv[i + 1]), (unsigned int)MAX_ROOMS);
+        else if (option == "-workers")
+            jobWorkers = (unsigned int)atoi(argv[i + 1]);
+        else if (option == "-metrics")
+            metricsPath = argv[i + 1];
+        else if (option == "-record")
+            recordPath = argv[i + 1];
+        else if (option == "-replay")
+            replayPath = argv[i + 1];
+        else if (option == "-replayspeed" && atof(argv[i + 1]) >= 0)
+            replaySpeed = atof(argv[i + 1]);
+        else if (option == "-entropy")
+            entropyPath = argv[i + 1];
+        else if (option == "-entropytrain")
+            entropyTrainPath = argv[i + 1];
+        else if (option == "-threads")
+            threadsPath = argv[i + 1];
+    }
 
-    try
+    //Before any threads start, since each applies its settings as it does
+    if (!ThreadManager::GetInstance().Load(threadsPath) && threadsPath != THREAD_MANAGER_CONFIG_PATH)
+        std::cout << "Couldn't read the thread settings " << threadsPath << std::endl;
+
+    if (!entropyPath.empty())
     {
-        Socket.Bind(PORT);
+        if (entropyModel.Load(entropyPath))
+            printf("Coding snapshots with entropy model %08x\n", entropyModel.GetID());
+        else
+            std::cout << "Couldn't read the entropy model " << entropyPath << std::endl;
+    }
 
-        gameLoop = std::thread(&GameLoop);
-        recvLoop = std::thread(&RecvFromLoop);
+    std::thread gameLoop;
 
-        for (int i = 0; i < MAX_PROJECTILES; i++)
+    try
+    {
+        //Nothing's received (or sent), just ticked with what was recorded
+        if (!replayPath.empty())
         {
-            projectiles[i].GetTransform()->SetPosition(0, -5000, 0);
+            if (!replay.Open(replayPath))
+            {
+                std::cout << "Couldn't read the recording " << replayPath << std::endl;
+                return 1;
+            }
+            replaying = true;
+            if (replaySpeed > 0)
+                scheduler.SetTickRate(replay.GetTickRate() * replaySpeed);
+
+            for (unsigned int i = 0; i < roomCount; i++)
+                rooms.push_back(new GameRoom(i, nullptr, roomCapacity, replay.GetTickRate()));
+            routedCounts.assign(roomCount, 0);
+            for (GameRoom* room : rooms)
+                room->SetEntropy(&entropyModel, !entropyTrainPath.empty());
+
+            std::cout << "Replaying " << replay.GetCount() << " datagrams over " << replay.GetLastTick() << " ticks at "
+                << replay.GetTickRate() << " a second, " << roomCount << " rooms of " << roomCapacity << " players" << std::endl;
+            gameLoop = std::thread(&GameLoop);
         }
+        else
+        {
+            //Shared, so on Linux each receive worker can have a socket of its own on the port
+            if (Socket.Bind(PORT, true) != SocketResult::Success)
+            {
+                std::cout << "Couldn't bind port " << PORT << " (" << Socket.GetLastError() << ")" << std::endl;
+                return 1;
+            }
+
+            //A core each for receiving, up to a few
+            unsigned int workers = max(1u, min(std::thread::hardware_concurrency(), (unsigned int)RECEIVE_MAX_WORKERS));
+            if (!receiver.Start(workers))
+            {
+                std::cout << "Couldn't start receiving (" << receiver.GetLastError() << ")" << std::endl;
+                return 1;
+            }
+
+            if (!recordPath.empty() && !recorder.Open(recordPath, scheduler.GetTickRate()))
+                std::cout << "Couldn't record to " << recordPath << std::endl;
+
+            for (unsigned int i = 0; i < roomCount; i++)
+                rooms.push_back(new GameRoom(i, &Socket, roomCapacity, scheduler.GetTickRate()));
+            routedCounts.assign(roomCount, 0);
+            for (GameRoom* room : rooms)
+                room->SetEntropy(&entropyModel, !entropyTrainPath.empty());
 
-        std::cout << "Server online. Port number " << PORT << std::endl;
+            gameLoop = std::thread(&GameLoop);
 
+            std::cout << "Server online. Port number " << PORT << ", " << scheduler.GetTickRate() << " ticks a second, "
+                << roomCount << " rooms of " << roomCapacity << " players"
+                << (recorder.IsOpen() ? ", recording" : "")
+                << (scheduler.IsHighResolution() ? "" : " (low resolution timer)") << std::endl;
+        }
     }
     catch (std::exception& ex)
     {
         std::cout << ex.what() << std::endl;
     }
 
-    gameLoop.join();
+    if (gameLoop.joinable())
+        gameLoop.join();
+
+    receiver.Stop();
+    recorder.Close();
+
+    //Every room's snapshots, in one model
+    if (!entropyTrainPath.empty())
+    {
+        NetEntropyTrainer trainer;
+        for (GameRoom* room : rooms)
+            trainer.Add(room->GetEntropyTrainer());
+        if (trainer.Save(entropyTrainPath))
+            std::cout << "Trained an entropy model on " << trainer.GetBytes() << " bytes of snapshots, in " << entropyTrainPath << std::endl;
+        else
+            std::cout << "Couldn't write the entropy model " << entropyTrainPath << std::endl;
+    }
 
-    recvLoop.join();
+    for (GameRoom* room : rooms)
+        delete room;
 
 }
 
@@ -0,0 +1,229 @@
+#include "InterestManager.h"
+
+#include <algorithm>
+#include <cmath>
+#include "PlayerRegistry.h"
+#include "ProjectilePool.h"
+#include "Helpers.h"
+
+using namespace DirectX;
+
+InterestManager::InterestManager() : grid(INTEREST_RADIUS)
+{
+	players = nullptr;
+	projectiles = nullptr;
+	visitMark = 0;
+	radius = INTEREST_RADIUS;
+	farPerSnapshot = INTEREST_FAR_PER_SNAPSHOT;
+	averageSent = 0;
+	averageWaiting = 0;
+}
+
+void InterestManager::SetReach(float radius, unsigned int farPerSnapshot)
+{
+	this->radius = min(radius, INTEREST_RADIUS);
+	this->farPerSnapshot = max(farPerSnapshot, 1u);
+}
+
+// --------------------------------------------------------
+// Buckets everyone and every live projectile where they
+// are now, ready for each client's snapshot
+// --------------------------------------------------------
+void InterestManager::Build(PlayerRegistry& players, ProjectilePool& projectiles)
+{
+	this->players = &players;
+	this->projectiles = &projectiles;
+
+	grid.Clear();
+	for (unsigned int i = 0; i < players.GetCount(); i++)
+	{
+		Player* p = players.Get(i);
+		grid.Insert(NetPlayerSlot(p->GetID()), XMFLOAT3(p->positionX, p->positionY, p->positionZ));
+	}
+	for (unsigned int j = 0; j < projectiles.GetCount(); j++)
+	{
+		Projectile* p = projectiles.Get(j);
+		grid.Insert(NET_MAX_PLAYERS + p->slot, p->GetTransform()->GetPosition());
+	}
+	grid.Build();
+
+	if (visited.size() < NET_MAX_PLAYERS + projectiles.GetSlotCount())
+		visited.resize(NET_MAX_PLAYERS + projectiles.GetSlotCount(), 0);
+}
+
+// --------------------------------------------------------
+// Who's connected (and what's alive), themselves, and then
+// whatever's built up the most priority, for as long as it
+// fits
+// --------------------------------------------------------
+void InterestManager::BuildSnapshot(Player* viewer, WorldSnapshot& snapshot, const WorldSnapshot* baseline, unsigned int budgetBits)
+{
+	ClientInterest& interest = viewer->interest;
+	if (interest.ProjectilePriority.size() < projectiles->GetSlotCount())
+		interest.ProjectilePriority.resize(projectiles->GetSlotCount(), 0.0f);
+
+	// A new mark each time, rather than clearing what's been visited
+	if (++visitMark == 0)
+	{
+		std::fill(visited.begin(), visited.end(), 0);
+		visitMark = 1;
+	}
+	candidates.clear();
+
+	snapshot.SlotCount = players->GetSlotCount();
+	snapshot.PlayerPresent.reset();
+	for (unsigned int i = 0; i < players->GetCount(); i++)
+		snapshot.PlayerPresent[NetPlayerSlot(players->Get(i)->GetID())] = true;
+	snapshot.ProjectileSlotCount = projectiles->GetSlotCount();
+	snapshot.ProjectilePresent.reset();
+	for (unsigned int i = 0; i < projectiles->GetCount(); i++)
+		snapshot.ProjectilePresent[projectiles->Get(i)->slot] = true;
+
+	BitCounter presence;
+	NetSerializePresence(presence, snapshot, baseline);
+	int remaining = (int)budgetBits - (int)presence.GetBits() - 2 * NET_SNAPSHOT_COUNT_BITS;
+
+	// Where they are, and the way they're looking
+	XMVECTOR eye = XMVectorSet(viewer->positionX, viewer->positionY, viewer->positionZ, 0);
+	XMVECTOR forward = XMVectorSet(
+		sinf(viewer->yaw) * cosf(viewer->pitch),
+		-sinf(viewer->pitch),
+		cosf(viewer->yaw) * cosf(viewer->pitch), 0);
+	unsigned int viewerSlot = NetPlayerSlot(viewer->GetID());
+	visited[viewerSlot] = visitMark;
+
+	XMFLOAT3 eyePosition;
+	XMStoreFloat3(&eyePosition, eye);
+	grid.QueryNeighbours(eyePosition, [&](unsigned int id)
+	{
+		if (visited[id] == visitMark) return;
+
+		bool isPlayer = id < NET_MAX_PLAYERS;
+		unsigned int index = isPlayer ? id : id - NET_MAX_PLAYERS;
+		XMVECTOR position;
+		if (isPlayer)
+		{
+			Player* p = players->GetInSlot(index);
+			position = XMVectorSet(p->positionX, p->positionY, p->positionZ, 0);
+		}
+		else
+		{
+			XMFLOAT3 p = projectiles->GetInSlot(index)->GetTransform()->GetPosition();
+			position = XMLoadFloat3(&p);
+		}
+
+		XMVECTOR toward = XMVectorSubtract(position, eye);
+		float distance = XMVectorGetX(XMVector3Length(toward));
+		if (distance > radius) return;
+
+		float weight = 1.0f + INTEREST_NEAR_WEIGHT * (1.0f - distance / radius);
+		if (distance > 0 && XMVectorGetX(XMVector3Dot(toward, forward)) >= INTEREST_VIEW_COS * distance)
+			weight *= INTEREST_VIEW_WEIGHT;
+
+		visited[id] = visitMark;
+		Consider(interest, isPlayer, index, weight);
+	});
+
+	// And a few of everyone else, in turn
+	unsigned int slotCount = snapshot.SlotCount;
+	unsigned int farVisits = min(slotCount, farPerSnapshot);
+	float farWeight = INTEREST_FAR_WEIGHT * max(1.0f, slotCount / (float)farPerSnapshot);
+	for (unsigned int n = 0; n < farVisits; n++)
+	{
+		unsigned int slot = interest.FarCursor++ % slotCount;
+		if (!snapshot.PlayerPresent[slot] || visited[slot] == visitMark) continue;
+
+		visited[slot] = visitMark;
+		Consider(interest, true, slot, farWeight);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.Priority > b.Priority; });
+
+	// Each entry costs its slot and itself against the baseline's
+	snapshot.PlayerCount = 0;
+	snapshot.ProjectileCount = 0;
+	auto addPlayer = [&](unsigned int slot, bool always)
+	{
+		PlayerNetState state = Helpers::GetPlayerState(players->GetInSlot(slot));
+		BitCounter cost;
+		NetSerializeSnapshotEntry(cost, state, baseline ? NetFindSnapshotPlayer(*baseline, slot) : nullptr);
+		int bits = (int)cost.GetBits() + NET_PLAYER_SLOT_BITS;
+		if (snapshot.PlayerCount >= NET_SNAPSHOT_MAX_PLAYERS || (!always && bits > remaining))
+			return false;
+
+		remaining -= bits;
+		snapshot.PlayerSlots[snapshot.PlayerCount] = slot;
+		snapshot.Players[snapshot.PlayerCount++] = state;
+		return true;
+	};
+	auto addProjectile = [&](unsigned int index)
+	{
+		ProjectileNetState state = Helpers::GetProjectileState(projectiles->GetInSlot(index));
+		BitCounter cost;
+		NetSerializeSnapshotEntry(cost, state, baseline ? NetFindSnapshotProjectile(*baseline, index) : nullptr);
+		int bits = (int)cost.GetBits() + NET_PROJECTILE_SLOT_BITS;
+		if (snapshot.ProjectileCount >= NET_SNAPSHOT_MAX_PROJECTILES || bits > remaining)
+			return false;
+
+		remaining -= bits;
+		snapshot.ProjectileIndices[snapshot.ProjectileCount] = index;
+		snapshot.Projectiles[snapshot.ProjectileCount++] = state;
+		return true;
+	};
+
+	// They're always sent themselves, since that's what they're reconciled against
+	addPlayer(viewerSlot, true);
+
+	unsigned int waiting = 0;
+	for (const Candidate& candidate : candidates)
+	{
+		if (candidate.IsPlayer ? addPlayer(candidate.Index, false) : addProjectile(candidate.Index))
+		{
+			if (candidate.IsPlayer)
+				interest.PlayerPriority[candidate.Index] = 0;
+			else
+				interest.ProjectilePriority[candidate.Index] = 0;
+		}
+		else
+			waiting++;
+	}
+
+	// In order of slot, which is how they're sent
+	unsigned int order[max(NET_SNAPSHOT_MAX_PLAYERS, NET_SNAPSHOT_MAX_PROJECTILES)];
+	PlayerNetState playerStates[NET_SNAPSHOT_MAX_PLAYERS];
+	ProjectileNetState projectileStates[NET_SNAPSHOT_MAX_PROJECTILES];
+	unsigned int keys[max(NET_SNAPSHOT_MAX_PLAYERS, NET_SNAPSHOT_MAX_PROJECTILES)];
+
+	for (unsigned int i = 0; i < snapshot.PlayerCount; i++)
+		order[i] = i;
+	std::sort(order, order + snapshot.PlayerCount, [&](unsigned int a, unsigned int b) { return snapshot.PlayerSlots[a] < snapshot.PlayerSlots[b]; });
+	for (unsigned int i = 0; i < snapshot.PlayerCount; i++)
+	{
+		keys[i] = snapshot.PlayerSlots[order[i]];
+		playerStates[i] = snapshot.Players[order[i]];
+	}
+	std::copy(keys, keys + snapshot.PlayerCount, snapshot.PlayerSlots);
+	std::copy(playerStates, playerStates + snapshot.PlayerCount, snapshot.Players);
+
+	for (unsigned int i = 0; i < snapshot.ProjectileCount; i++)
+		order[i] = i;
+	std::sort(order, order + snapshot.ProjectileCount, [&](unsigned int a, unsigned int b) { return snapshot.ProjectileIndices[a] < snapshot.ProjectileIndices[b]; });
+	for (unsigned int i = 0; i < snapshot.ProjectileCount; i++)
+	{
+		keys[i] = snapshot.ProjectileIndices[order[i]];
+		projectileStates[i] = snapshot.Projectiles[order[i]];
+	}
+	std::copy(keys, keys + snapshot.ProjectileCount, snapshot.ProjectileIndices);
+	std::copy(projectileStates, projectileStates + snapshot.ProjectileCount, snapshot.Projectiles);
+
+	averageSent += (snapshot.PlayerCount + snapshot.ProjectileCount - averageSent) * 0.05f;
+	averageWaiting += (waiting - averageWaiting) * 0.05f;
+}
+
+// Builds up its priority, and makes it a candidate for this snapshot
+void InterestManager::Consider(ClientInterest& interest, bool isPlayer, unsigned int index, float weight)
+{
+	float& priority = isPlayer ? interest.PlayerPriority[index] : interest.ProjectilePriority[index];
+	priority += weight;
+	candidates.push_back({ isPlayer, index, priority });
+}
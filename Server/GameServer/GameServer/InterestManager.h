@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include "SpatialHashGrid.h"
+#include "../../../NetworkState.h"
+
+class Player;
+class PlayerRegistry;
+class ProjectilePool;
+
+// How far away players and projectiles are looked for (which the
+// grid's cells are as big as), and how wide the view cone is (the
+// cosine of the angle either side of where they're looking)
+#define INTEREST_RADIUS 60.0f
+#define INTEREST_VIEW_COS 0.5f
+
+// How quickly each kind of entity's priority builds up, per snapshot
+// it's not sent in
+//  - Near ones get up to INTEREST_NEAR_WEIGHT more the closer they are,
+//    doubled (INTEREST_VIEW_WEIGHT) when they're in view
+//  - Far players aren't looked for, but a few are visited in turn every
+//    snapshot (INTEREST_FAR_PER_SNAPSHOT), and build up as much as they
+//    would have since they were last visited
+#define INTEREST_NEAR_WEIGHT 4.0f
+#define INTEREST_VIEW_WEIGHT 2.0f
+#define INTEREST_FAR_WEIGHT 0.25f
+#define INTEREST_FAR_PER_SNAPSHOT 8
+
+// How much snapshot each client's sent a second, at most
+#define INTEREST_BYTES_PER_SECOND 16000
+
+// What one client's been sent, and how long everything's been waiting
+struct ClientInterest
+{
+	float PlayerPriority[NET_MAX_PLAYERS] = {};
+	std::vector<float> ProjectilePriority;
+	unsigned int FarCursor = 0;
+
+	// The snapshots they've been sent, which each is a baseline for later ones
+	WorldSnapshot Sent[NET_SNAPSHOT_HISTORY] = {};
+};
+
+// Picks what's most worth sending each client in their snapshots
+//  - Build() once a snapshot, then BuildSnapshot() for each client
+//  - Everyone's priority for everything near them builds up every
+//    snapshot it's left out of, and goes back to nothing when it's
+//    sent, so the nearest (and what's in view) are sent most often,
+//    but everything gets its turn
+//  - Entries are added highest priority first for as long as they fit
+//    the budget, which is measured against the baseline they'll go
+//    out against (with BitCounter), so it's exact
+class InterestManager
+{
+public:
+	InterestManager();
+
+	void Build(PlayerRegistry& players, ProjectilePool& projectiles);
+
+	// How far near entities are looked for (up to INTEREST_RADIUS), and how
+	// many far players are visited each snapshot, which the server lowers
+	// when it's overloaded (see OverloadGovernor)
+	void SetReach(float radius, unsigned int farPerSnapshot);
+
+	// Fills in everything about snapshot but its Tick and Valid
+	void BuildSnapshot(Player* viewer, WorldSnapshot& snapshot, const WorldSnapshot* baseline, unsigned int budgetBits);
+
+	// How many entries the last snapshots had, and how many were left waiting, on average
+	float GetAverageSent() { return averageSent; }
+	float GetAverageWaiting() { return averageWaiting; }
+
+private:
+	struct Candidate
+	{
+		bool IsPlayer;
+		unsigned int Index;
+		float Priority;
+	};
+
+	PlayerRegistry* players;
+	ProjectilePool* projectiles;
+
+	// Players by slot and projectiles by their slot (past the last player's)
+	SpatialHashGrid grid;
+	std::vector<Candidate> candidates;
+	std::vector<unsigned int> visited;
+	unsigned int visitMark;
+
+	float radius;
+	unsigned int farPerSnapshot;
+
+	float averageSent;
+	float averageWaiting;
+
+	void Consider(ClientInterest& interest, bool isPlayer, unsigned int index, float weight);
+};
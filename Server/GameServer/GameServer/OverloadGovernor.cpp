@@ -0,0 +1,68 @@
+#include "OverloadGovernor.h"
+
+#include <cstdio>
+#include "InterestManager.h"
+
+// What each level's for, in the log
+static const char* levelNames[OVERLOAD_MAX_LEVEL + 1] = { "normal", "fewer distant entities", "half snapshot rate", "coarse collision rewinds" };
+
+OverloadGovernor::OverloadGovernor()
+{
+	settings = GetLevelSettings(0);
+	overSeconds = 0;
+	underSeconds = 0;
+	changes = 0;
+}
+
+OverloadSettings OverloadGovernor::GetLevelSettings(unsigned int level)
+{
+	OverloadSettings levelSettings = { level, 1.0f, INTEREST_FAR_PER_SNAPSHOT, 1, 0.0f };
+	if (level >= 1)
+	{
+		levelSettings.InterestRadiusScale = 0.5f;
+		levelSettings.FarPerSnapshot = INTEREST_FAR_PER_SNAPSHOT / 2;
+	}
+	if (level >= 2)
+		levelSettings.SnapshotInterval = 2;
+	if (level >= 3)
+		levelSettings.RewindStep = 0.05f;
+	return levelSettings;
+}
+
+// --------------------------------------------------------
+// A step up once the load's been too high for long enough,
+// and a step back down once it's been low for longer, with
+// each count starting over after a change
+// --------------------------------------------------------
+bool OverloadGovernor::Update(double workMs, double tickMs)
+{
+	if (tickMs <= 0) return false;
+
+	double load = workMs / tickMs;
+	double tickSeconds = tickMs / 1000.0;
+	overSeconds = load > OVERLOAD_HIGH_LOAD ? overSeconds + tickSeconds : 0;
+	underSeconds = load < OVERLOAD_LOW_LOAD ? underSeconds + tickSeconds : 0;
+
+	if (overSeconds >= OVERLOAD_RAISE_SECONDS && settings.Level < OVERLOAD_MAX_LEVEL)
+	{
+		SetLevel(settings.Level + 1, load);
+		return true;
+	}
+	if (underSeconds >= OVERLOAD_RECOVER_SECONDS && settings.Level > 0)
+	{
+		SetLevel(settings.Level - 1, load);
+		return true;
+	}
+	return false;
+}
+
+void OverloadGovernor::SetLevel(unsigned int level, double load)
+{
+	printf("Overload: %s to level %u (%s), ticks taking %.0f%% of a tick\n",
+		level > settings.Level ? "up" : "down", level, levelNames[level], load * 100.0);
+
+	settings = GetLevelSettings(level);
+	overSeconds = 0;
+	underSeconds = 0;
+	changes++;
+}
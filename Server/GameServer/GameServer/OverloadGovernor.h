@@ -0,0 +1,63 @@
+#pragma once
+
+// How much of a tick the loop's (smoothed) work can take before the
+// server starts doing less, and how little before it goes back a step
+#define OVERLOAD_HIGH_LOAD 0.9
+#define OVERLOAD_LOW_LOAD 0.6
+
+// How long the load has to stay over (or under) before the level goes
+// up (or down) a step, in seconds, so each step's had time to show
+//  - Recovering is slower, so it doesn't bounce between two levels
+#define OVERLOAD_RAISE_SECONDS 0.5
+#define OVERLOAD_RECOVER_SECONDS 5.0
+
+// How far each level goes, from none (0) to everything (OVERLOAD_MAX_LEVEL)
+#define OVERLOAD_MAX_LEVEL 3
+
+// What the rooms do at each level, on top of the levels before it
+//  - 1: only the nearest are looked for, and fewer far players are
+//    visited, so distant entities go out less often
+//  - 2: snapshots go out half as often (each with twice the budget,
+//    so the bytes a second stay the same)
+//  - 3: projectiles rewound to about the same time are tested against
+//    each player together, so collision takes fewer capsule tests
+struct OverloadSettings
+{
+	unsigned int Level;
+	float InterestRadiusScale;		// Of INTEREST_RADIUS, for who's looked for near each client
+	unsigned int FarPerSnapshot;	// Instead of INTEREST_FAR_PER_SNAPSHOT
+	unsigned int SnapshotInterval;	// Snapshots go every this many times as many ticks
+	float RewindStep;				// Seconds each sweep's rewind is rounded to (0 for exactly)
+};
+
+// Watches how long the game loop's ticks take against how long they
+// can, and has the rooms do less (a level at a time) while they're
+// taking too long, and more again once they aren't
+//  - Only what's sent and how precisely it's checked changes; the
+//    simulation itself still ticks at the same rate
+//  - Every change of level is logged
+class OverloadGovernor
+{
+public:
+	OverloadGovernor();
+
+	// Once a tick, with the scheduler's smoothed work (see TickStats)
+	// and how long a tick is, in milliseconds, returning whether the
+	// level changed
+	bool Update(double workMs, double tickMs);
+
+	unsigned int GetLevel() { return settings.Level; }
+	const OverloadSettings& GetSettings() { return settings; }
+	unsigned long long GetChanges() { return changes; }
+
+	// What each level has the rooms do
+	static OverloadSettings GetLevelSettings(unsigned int level);
+
+private:
+	OverloadSettings settings;
+	double overSeconds;		// How long the load's been over OVERLOAD_HIGH_LOAD (or under OVERLOAD_LOW_LOAD)
+	double underSeconds;
+	unsigned long long changes;
+
+	void SetLevel(unsigned int level, double load);
+};
@@ -1,7 +1,7 @@
 #include "Player.h"
-#include <DirectXMath.h>
+#include "../../../PortableMath.h"
 
-Player::Player(sockaddr_in sender, int id)
+Player::Player(sockaddr_in sender, unsigned int id)
 {
 	client = sender;
 	ID = id;
@@ -1,21 +1,38 @@
 #pragma once
 
 #include "../../../Network.h"
+#include "../../../NetworkConnection.h"
+#include "InterestManager.h"
+#include "PositionHistory.h"
 
 class Player
 {
-private:
-	//Constants
-	float moveSpeed = 15.0f;
-	float gravity = -19.6f;
-	float jumpForce = 8;
-	float mouseLookSpeed = 1.0f;
-
 public:
 
-	int ID;
+	unsigned int ID;	// Their slot, tagged (see NetPlayerSlot())
 	sockaddr_in client;
 
+	// Everything to and from them (see NetworkConnection)
+	NetworkConnection connection;
+
+	// The newest input they've been moved by
+	unsigned int lastInput = 0;
+	bool hasInput = false;
+
+	// The newest snapshot they've said they have
+	unsigned int ackTick = 0;
+	bool hasAck = false;
+
+	// The entropy model they said they have when they joined, if any
+	unsigned int entropyModel = 0;
+	bool hasEntropyModel = false;
+
+	// What's most worth sending them, and what they've been sent
+	ClientInterest interest;
+
+	// Where they were each of the last few ticks, for lag compensation
+	PositionHistory history;
+
 	float positionX;
 	float positionY;
 	float positionZ;
@@ -28,9 +45,9 @@ public:
 	float yaw;
 	float roll;
 
-	Player(sockaddr_in sender, int id);
+	Player(sockaddr_in sender, unsigned int id);
 
-	int GetID() { return ID; }
+	unsigned int GetID() { return ID; }
 
 	void SetPosition(float x, float y, float z);
 	void SetVelocity(float x, float y, float z);
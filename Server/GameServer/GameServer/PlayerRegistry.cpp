@@ -0,0 +1,103 @@
+#include "PlayerRegistry.h"
+
+#include <algorithm>
+#include <functional>
+
+PlayerRegistry::PlayerRegistry(unsigned int capacity)
+{
+	this->capacity = 0;
+	SetCapacity(capacity);
+}
+
+PlayerRegistry::~PlayerRegistry()
+{
+	for (Player* player : dense)
+		delete player;
+}
+
+void PlayerRegistry::SetCapacity(unsigned int capacity)
+{
+	if (!dense.empty()) return;
+
+	this->capacity = max(1u, min(capacity, (unsigned int)NET_MAX_PLAYERS));
+	slots.clear();
+	freeSlots.clear();
+	slots.reserve(this->capacity);
+	dense.reserve(this->capacity);
+	endpoints.reserve(this->capacity);
+}
+
+// --------------------------------------------------------
+// Puts someone new in the lowest free slot (or a new one,
+// while there's room), with the next generation of its ID
+// --------------------------------------------------------
+Player* PlayerRegistry::Add(const sockaddr_in& endpoint)
+{
+	unsigned int slot;
+	if (!freeSlots.empty())
+	{
+		std::pop_heap(freeSlots.begin(), freeSlots.end(), std::greater<unsigned int>());
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else if (slots.size() < capacity)
+	{
+		slot = (unsigned int)slots.size();
+		slots.push_back({ nullptr, 0, 0 });
+	}
+	else
+		return nullptr;
+
+	// Generations start at 1, so no ID is ever 0
+	Slot& s = slots[slot];
+	s.Generation = (s.Generation + 1) & NET_PLAYER_GENERATION_MASK;
+	if (s.Generation == 0) s.Generation = 1;
+
+	Player* player = new Player(endpoint, NetPlayerID(slot, s.Generation));
+	s.Occupant = player;
+	s.DenseIndex = (unsigned int)dense.size();
+	dense.push_back(player);
+	endpoints[EndpointKey(endpoint)] = slot;
+	return player;
+}
+
+// --------------------------------------------------------
+// Deletes them, moving the last player into their place
+// --------------------------------------------------------
+void PlayerRegistry::Remove(Player* player)
+{
+	if (player == nullptr || Find(player->GetID()) != player) return;
+
+	unsigned int slot = NetPlayerSlot(player->GetID());
+	unsigned int index = slots[slot].DenseIndex;
+	Player* last = dense.back();
+	dense[index] = last;
+	slots[NetPlayerSlot(last->GetID())].DenseIndex = index;
+	dense.pop_back();
+
+	endpoints.erase(EndpointKey(player->client));
+	slots[slot].Occupant = nullptr;
+	freeSlots.push_back(slot);
+	std::push_heap(freeSlots.begin(), freeSlots.end(), std::greater<unsigned int>());
+
+	delete player;
+}
+
+Player* PlayerRegistry::Find(const sockaddr_in& endpoint)
+{
+	auto found = endpoints.find(EndpointKey(endpoint));
+	return found != endpoints.end() ? slots[found->second].Occupant : nullptr;
+}
+
+Player* PlayerRegistry::Find(unsigned int id)
+{
+	unsigned int slot = NetPlayerSlot(id);
+	if (slot >= slots.size() || slots[slot].Occupant == nullptr) return nullptr;
+	return slots[slot].Occupant->GetID() == id ? slots[slot].Occupant : nullptr;
+}
+
+// The address and port, which is all that tells one client from another
+unsigned long long PlayerRegistry::EndpointKey(const sockaddr_in& endpoint)
+{
+	return ((unsigned long long)endpoint.sin_addr.s_addr << 16) | endpoint.sin_port;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include "Player.h"
+#include "../../../NetworkState.h"
+
+// Everyone connected, found by where their datagrams come from or by
+// their ID, and kept packed together to be gone through each tick
+//  - IDs are a slot tagged with that slot's generation (see
+//    NetPlayerSlot()), so an old ID never finds whoever has it now
+//  - Leaving swaps the last player into the hole, so the dense order
+//    changes, but slots never do
+class PlayerRegistry
+{
+public:
+	PlayerRegistry(unsigned int capacity);
+	~PlayerRegistry();
+
+	// At most NET_MAX_PLAYERS, and only before anyone's joined
+	void SetCapacity(unsigned int capacity);
+	unsigned int GetCapacity() { return capacity; }
+
+	// A new player in the lowest free slot, or nullptr when it's full
+	Player* Add(const sockaddr_in& endpoint);
+	void Remove(Player* player);
+
+	Player* Find(const sockaddr_in& endpoint);
+	Player* Find(unsigned int id);
+
+	// For going through everyone, in no particular order
+	unsigned int GetCount() { return (unsigned int)dense.size(); }
+	Player* Get(unsigned int index) { return dense[index]; }
+
+	// One past the highest slot that's been used
+	unsigned int GetSlotCount() { return (unsigned int)slots.size(); }
+	Player* GetInSlot(unsigned int slot) { return slot < slots.size() ? slots[slot].Occupant : nullptr; }
+
+	// What an endpoint's found by (its address and port, together)
+	static unsigned long long EndpointKey(const sockaddr_in& endpoint);
+
+private:
+	struct Slot
+	{
+		Player* Occupant;
+		unsigned int Generation;
+		unsigned int DenseIndex;
+	};
+
+	unsigned int capacity;
+	std::vector<Slot> slots;
+	std::vector<Player*> dense;
+	std::vector<unsigned int> freeSlots;	// A min-heap, so the lowest is reused first
+	std::unordered_map<unsigned long long, unsigned int> endpoints;
+};
@@ -0,0 +1,45 @@
+#include "PositionHistory.h"
+
+#include <cmath>
+
+using namespace DirectX;
+
+PositionHistory::PositionHistory()
+{
+	for (Entry& entry : entries)
+		entry.Valid = false;
+}
+
+void PositionHistory::Record(unsigned int tick, const XMFLOAT3& position)
+{
+	Entry& entry = entries[tick % POSITION_HISTORY_TICKS];
+	entry.Tick = tick;
+	entry.Valid = true;
+	entry.Position = position;
+}
+
+bool PositionHistory::GetPosition(double tick, XMFLOAT3& position)
+{
+	double whole = floor(tick);
+	float fraction = (float)(tick - whole);
+	const Entry* before = Find((unsigned int)whole);
+	const Entry* after = Find((unsigned int)whole + 1);
+
+	if (before && after)
+	{
+		const XMFLOAT3& a = before->Position;
+		const XMFLOAT3& b = after->Position;
+		position = XMFLOAT3(a.x + (b.x - a.x) * fraction, a.y + (b.y - a.y) * fraction, a.z + (b.z - a.z) * fraction);
+	}
+	else if (before || after)
+		position = (before ? before : after)->Position;
+	else
+		return false;
+	return true;
+}
+
+const PositionHistory::Entry* PositionHistory::Find(unsigned int tick)
+{
+	const Entry& entry = entries[tick % POSITION_HISTORY_TICKS];
+	return (entry.Valid && entry.Tick == tick) ? &entry : nullptr;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../../../PortableMath.h"
+
+// How many ticks of each player's positions are kept (about a second at 60 a second)
+#define POSITION_HISTORY_TICKS 64
+
+// The most a shot's targets are rewound, in seconds, however far behind
+// its shooter is, so someone on a bad connection can't hit people where
+// they were long ago (and their own lag is theirs to lead)
+#define LAG_COMPENSATION_MAX 0.2
+
+// How far behind the newest snapshot a client draws everyone else, in
+// seconds, which is about one snapshot's time (see the game's
+// NETWORK_INTERPOLATION_MIN_DELAY), and is added to their round trip
+#define LAG_COMPENSATION_VIEW_DELAY 0.05
+
+// Where a player was at the end of each of the last few ticks, so hits
+// can be tested against where a shooter saw them rather than where they
+// are now (lag compensation)
+//  - A ring by tick, so a tick's found without searching, and any that
+//    weren't recorded (or have been written over) are just missing
+class PositionHistory
+{
+public:
+	PositionHistory();
+
+	void Record(unsigned int tick, const DirectX::XMFLOAT3& position);
+
+	// Where they were at a (fractional) tick, between the ticks either side,
+	// or at whichever of those there is, returning false if neither's kept
+	bool GetPosition(double tick, DirectX::XMFLOAT3& position);
+
+private:
+	struct Entry
+	{
+		unsigned int Tick;
+		bool Valid;
+		DirectX::XMFLOAT3 Position;
+	};
+	Entry entries[POSITION_HISTORY_TICKS];
+
+	const Entry* Find(unsigned int tick);
+};
@@ -1,18 +1,25 @@
 #include "Projectile.h"
 
-#include <DirectXMath.h>
+#include "../../../Movement.h"
 
 using namespace DirectX;
 
+// The game's own projectile step, so where the server has a
+// projectile is where the game predicted it
 void Projectile::Update(float dt)
 {
-	age += dt;
+	ProjectileMovementState state;
+	state.Position = transform.GetPosition();
+	state.Velocity = XMFLOAT3(velocityX, velocityY, velocityZ);
+	state.Gravity = gravity;
+	state.Age = age;
+	state.Lifespan = lifespan;
 
-	if (age >= lifespan) dead = true;
-
-	velocityY += gravity * dt;
-	transform.MoveRelative(velocityX * dt, velocityY * dt, velocityZ * dt);
-
-	if (transform.GetPosition().y <= -6) dead = true;
+	previousPosition = state.Position;
+	if (!SimulateProjectileMovement(state, GetMovementAxes(transform.GetPitchYawRoll()), dt))
+		dead = true;
 
+	age = state.Age;
+	velocityY = state.Velocity.y;
+	transform.SetPosition(state.Position.x, state.Position.y, state.Position.z);
 }
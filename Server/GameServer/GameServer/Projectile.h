@@ -22,6 +22,19 @@ public:
 
 	bool dead = true;
 
+	// Where it was before the last Update(), which moved it in a straight line from there
+	DirectX::XMFLOAT3 previousPosition;
+
+	// Where it is in the ProjectilePool (which snapshots send it by)
+	unsigned int slot = 0;
+
+	// Who fired it (and which of their shots it was), and how far back
+	// (in seconds) everyone it might hit is rewound to, which is where
+	// they were on the shooter's screen
+	unsigned int ownerID = 0;
+	unsigned int shot = 0;
+	float rewindSeconds = 0;
+
 	void Update(float dt);
 
 };
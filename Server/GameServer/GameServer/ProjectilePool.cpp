@@ -0,0 +1,69 @@
+#include "ProjectilePool.h"
+
+#include <algorithm>
+#include <functional>
+
+ProjectilePool::~ProjectilePool()
+{
+	for (Slot& slot : slots)
+		delete slot.Occupant;
+}
+
+// --------------------------------------------------------
+// Frees whichever slots have been empty long enough, then
+// gives out the lowest (or a new one, while there's room)
+// --------------------------------------------------------
+Projectile* ProjectilePool::Spawn(unsigned int tick)
+{
+	while (!released.empty() && tick - released.front().Tick >= PROJECTILE_SLOT_REUSE_TICKS)
+	{
+		freeSlots.push_back(released.front().Slot);
+		std::push_heap(freeSlots.begin(), freeSlots.end(), std::greater<unsigned int>());
+		released.pop_front();
+	}
+
+	unsigned int slot;
+	if (!freeSlots.empty())
+	{
+		std::pop_heap(freeSlots.begin(), freeSlots.end(), std::greater<unsigned int>());
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else if (slots.size() < NET_MAX_PROJECTILES)
+	{
+		slot = (unsigned int)slots.size();
+		slots.push_back({ new Projectile(), false, 0 });
+	}
+	else
+		return nullptr;
+
+	Slot& s = slots[slot];
+	s.Live = true;
+	s.DenseIndex = (unsigned int)dense.size();
+	dense.push_back(s.Occupant);
+
+	Projectile* projectile = s.Occupant;
+	projectile->slot = slot;
+	projectile->dead = false;
+	projectile->age = 0;
+	return projectile;
+}
+
+// --------------------------------------------------------
+// Takes it out of the live ones, moving the last into its
+// place, and starts its slot's wait to be reused
+// --------------------------------------------------------
+void ProjectilePool::Release(Projectile* projectile, unsigned int tick)
+{
+	if (projectile == nullptr || GetInSlot(projectile->slot) != projectile) return;
+
+	unsigned int index = slots[projectile->slot].DenseIndex;
+	Projectile* last = dense.back();
+	dense[index] = last;
+	slots[last->slot].DenseIndex = index;
+	dense.pop_back();
+
+	slots[projectile->slot].Live = false;
+	projectile->dead = true;
+	released.push_back({ projectile->slot, tick });
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include "Projectile.h"
+#include "../../../NetworkState.h"
+
+// How many ticks a projectile's slot is left empty once it's gone, which
+// is as long as any snapshot it was still in can be a baseline, so a
+// client never sees its slot go from one projectile straight to another
+#define PROJECTILE_SLOT_REUSE_TICKS NET_SNAPSHOT_HISTORY
+
+// Every live projectile, in the slots snapshots send them by
+//  - Slots (and the projectiles in them, which are kept for reuse) are
+//    only made when every one's in use, up to NET_MAX_PROJECTILES, and
+//    the lowest free one's always given out first, which keeps the
+//    slots (and each snapshot's presence) as few as they can be
+//  - Live ones are also kept packed together, to be gone through each
+//    tick, with Release() swapping the last into the hole
+class ProjectilePool
+{
+public:
+	ProjectilePool() {}
+	~ProjectilePool();
+
+	ProjectilePool(const ProjectilePool&) = delete;
+	ProjectilePool& operator=(const ProjectilePool&) = delete;
+
+	// A live one in the lowest free slot, or nullptr when there's none left
+	Projectile* Spawn(unsigned int tick);
+	void Release(Projectile* projectile, unsigned int tick);
+
+	// For going through every live one, in no particular order
+	unsigned int GetCount() { return (unsigned int)dense.size(); }
+	Projectile* Get(unsigned int index) { return dense[index]; }
+
+	// One past the highest slot that's been used, and who's in each (or nullptr)
+	unsigned int GetSlotCount() { return (unsigned int)slots.size(); }
+	Projectile* GetInSlot(unsigned int slot) { return slot < slots.size() && slots[slot].Live ? slots[slot].Occupant : nullptr; }
+
+private:
+	struct Slot
+	{
+		Projectile* Occupant;
+		bool Live;
+		unsigned int DenseIndex;
+	};
+
+	struct ReleasedSlot
+	{
+		unsigned int Slot;
+		unsigned int Tick;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<Projectile*> dense;
+	std::vector<unsigned int> freeSlots;	// A min-heap, so the lowest is reused first
+	std::deque<ReleasedSlot> released;		// Oldest first, waiting to be free
+};
@@ -0,0 +1,133 @@
+#include "ProjectileSweeps.h"
+
+using namespace DirectX;
+
+// Where the unused lanes of the last four are, which is nowhere near anyone
+#define SWEEP_FAR_AWAY 1e9f
+
+// Below this (squared length, or how parallel two segments are) the
+// division it'd go into isn't trusted
+#define SWEEP_EPSILON 1e-8f
+
+void ProjectileSweeps::Clear()
+{
+	startX.clear(); startY.clear(); startZ.clear();
+	deltaX.clear(); deltaY.clear(); deltaZ.clear();
+	ids.clear();
+}
+
+void ProjectileSweeps::Add(unsigned int id, const XMFLOAT3& start, const XMFLOAT3& end)
+{
+	startX.push_back(start.x);
+	startY.push_back(start.y);
+	startZ.push_back(start.z);
+	deltaX.push_back(end.x - start.x);
+	deltaY.push_back(end.y - start.y);
+	deltaZ.push_back(end.z - start.z);
+	ids.push_back(id);
+}
+
+XMFLOAT3 ProjectileSweeps::GetMidpoint(unsigned int sweep)
+{
+	return XMFLOAT3(
+		startX[sweep] + deltaX[sweep] * 0.5f,
+		startY[sweep] + deltaY[sweep] * 0.5f,
+		startZ[sweep] + deltaZ[sweep] * 0.5f);
+}
+
+// --------------------------------------------------------
+// The closest points between each sweep (start + delta * s)
+// and the capsule's segment (bottom + axis * t), for s and
+// t in [0, 1], four sweeps at a time
+//  - s is where the lines come closest, kept to the sweep,
+//    then t is the capsule's closest to that, and if that
+//    had to be kept to the capsule, s is found again from
+//    the end it was kept to (Ericson, Real-Time Collision
+//    Detection, 5.1.9), with every branch a select
+// --------------------------------------------------------
+unsigned int ProjectileSweeps::TestCapsule(const unsigned int* sweeps, unsigned int count,
+	const XMFLOAT3& bottom, const XMFLOAT3& top, unsigned int* hits)
+{
+	float radius = PLAYER_HIT_RADIUS + PROJECTILE_HIT_RADIUS;
+	float axisX = top.x - bottom.x;
+	float axisY = top.y - bottom.y;
+	float axisZ = top.z - bottom.z;
+	float axisLengthSq = axisX * axisX + axisY * axisY + axisZ * axisZ;
+	if (axisLengthSq < SWEEP_EPSILON) axisLengthSq = SWEEP_EPSILON;
+
+	XMVECTOR qX = XMVectorReplicate(bottom.x);
+	XMVECTOR qY = XMVectorReplicate(bottom.y);
+	XMVECTOR qZ = XMVectorReplicate(bottom.z);
+	XMVECTOR d2X = XMVectorReplicate(axisX);
+	XMVECTOR d2Y = XMVectorReplicate(axisY);
+	XMVECTOR d2Z = XMVectorReplicate(axisZ);
+	XMVECTOR e = XMVectorReplicate(axisLengthSq);
+	XMVECTOR radiusSq = XMVectorReplicate(radius * radius);
+	XMVECTOR epsilon = XMVectorReplicate(SWEEP_EPSILON);
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorSplatOne();
+
+	unsigned int hitCount = 0;
+	for (unsigned int first = 0; first < count; first += 4)
+	{
+		// Gathered four at a time (they're whichever the grid found)
+		XMFLOAT4 px(SWEEP_FAR_AWAY, SWEEP_FAR_AWAY, SWEEP_FAR_AWAY, SWEEP_FAR_AWAY), py = px, pz = px;
+		XMFLOAT4 dx(0, 0, 0, 0), dy = dx, dz = dx;
+		float* lanes[6] = { &px.x, &py.x, &pz.x, &dx.x, &dy.x, &dz.x };
+		for (unsigned int lane = 0; lane < 4 && first + lane < count; lane++)
+		{
+			unsigned int sweep = sweeps[first + lane];
+			lanes[0][lane] = startX[sweep];
+			lanes[1][lane] = startY[sweep];
+			lanes[2][lane] = startZ[sweep];
+			lanes[3][lane] = deltaX[sweep];
+			lanes[4][lane] = deltaY[sweep];
+			lanes[5][lane] = deltaZ[sweep];
+		}
+		XMVECTOR d1X = XMLoadFloat4(&dx);
+		XMVECTOR d1Y = XMLoadFloat4(&dy);
+		XMVECTOR d1Z = XMLoadFloat4(&dz);
+
+		// From the capsule's bottom to each sweep's start
+		XMVECTOR rX = XMVectorSubtract(XMLoadFloat4(&px), qX);
+		XMVECTOR rY = XMVectorSubtract(XMLoadFloat4(&py), qY);
+		XMVECTOR rZ = XMVectorSubtract(XMLoadFloat4(&pz), qZ);
+
+		XMVECTOR a = XMVectorMultiplyAdd(d1X, d1X, XMVectorMultiplyAdd(d1Y, d1Y, XMVectorMultiply(d1Z, d1Z)));
+		XMVECTOR b = XMVectorMultiplyAdd(d1X, d2X, XMVectorMultiplyAdd(d1Y, d2Y, XMVectorMultiply(d1Z, d2Z)));
+		XMVECTOR c = XMVectorMultiplyAdd(d1X, rX, XMVectorMultiplyAdd(d1Y, rY, XMVectorMultiply(d1Z, rZ)));
+		XMVECTOR f = XMVectorMultiplyAdd(d2X, rX, XMVectorMultiplyAdd(d2Y, rY, XMVectorMultiply(d2Z, rZ)));
+
+		// Where the lines come closest (or the start, if they're parallel)
+		XMVECTOR denominator = XMVectorNegativeMultiplySubtract(b, b, XMVectorMultiply(a, e));
+		XMVECTOR s = XMVectorDivide(XMVectorNegativeMultiplySubtract(c, e, XMVectorMultiply(b, f)), XMVectorMax(denominator, epsilon));
+		s = XMVectorSelect(XMVectorSaturate(s), zero, XMVectorLessOrEqual(denominator, epsilon));
+
+		// The capsule's closest to that, and the sweep's closest to whichever
+		// end that's kept to (for one that's not moving, its start)
+		XMVECTOR t = XMVectorDivide(XMVectorMultiplyAdd(b, s, f), e);
+		XMVECTOR moving = XMVectorGreater(a, epsilon);
+		XMVECTOR safeA = XMVectorMax(a, epsilon);
+		XMVECTOR sBottom = XMVectorSelect(zero, XMVectorSaturate(XMVectorDivide(XMVectorNegate(c), safeA)), moving);
+		XMVECTOR sTop = XMVectorSelect(zero, XMVectorSaturate(XMVectorDivide(XMVectorSubtract(b, c), safeA)), moving);
+		s = XMVectorSelect(s, sBottom, XMVectorLess(t, zero));
+		s = XMVectorSelect(s, sTop, XMVectorGreater(t, one));
+		t = XMVectorSaturate(t);
+
+		// And how far apart those are
+		XMVECTOR gapX = XMVectorSubtract(XMVectorMultiplyAdd(d1X, s, rX), XMVectorMultiply(d2X, t));
+		XMVECTOR gapY = XMVectorSubtract(XMVectorMultiplyAdd(d1Y, s, rY), XMVectorMultiply(d2Y, t));
+		XMVECTOR gapZ = XMVectorSubtract(XMVectorMultiplyAdd(d1Z, s, rZ), XMVectorMultiply(d2Z, t));
+		XMVECTOR gapSq = XMVectorMultiplyAdd(gapX, gapX, XMVectorMultiplyAdd(gapY, gapY, XMVectorMultiply(gapZ, gapZ)));
+
+		XMUINT4 hit;
+		XMStoreUInt4(&hit, XMVectorLessOrEqual(gapSq, radiusSq));
+		unsigned int lanesHit[4] = { hit.x, hit.y, hit.z, hit.w };
+		for (unsigned int lane = 0; lane < 4 && first + lane < count; lane++)
+		{
+			if (lanesHit[lane])
+				hits[hitCount++] = ids[sweeps[first + lane]];
+		}
+	}
+	return hitCount;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include "../../../PortableMath.h"
+
+// A projectile's radius, and the capsule a player's hit by, from below
+// their feet to above their head (relative to their position, which is
+// where their camera is)
+#define PROJECTILE_HIT_RADIUS 0.1f
+#define PLAYER_HIT_RADIUS 0.6f
+#define PLAYER_HIT_BOTTOM -1.4f
+#define PLAYER_HIT_TOP -0.6f
+
+// Where each projectile went over the last tick, stored as separate
+// arrays (SoA) so four can be hit tested at once with SIMD
+//  - Each is the straight line its Update() moved it along (gravity
+//    changes its velocity between ticks, not during them), so testing
+//    the line is exact, however fast it's going
+//  - Hits are the closest approach between that line and the segment
+//    down the middle of a player's capsule, worked out analytically
+class ProjectileSweeps
+{
+public:
+	void Clear();
+	void Add(unsigned int id, const DirectX::XMFLOAT3& start, const DirectX::XMFLOAT3& end);
+
+	unsigned int GetCount() { return (unsigned int)ids.size(); }
+	unsigned int GetID(unsigned int sweep) { return ids[sweep]; }
+	DirectX::XMFLOAT3 GetMidpoint(unsigned int sweep);
+
+	// Which of the given sweeps (indices, as Add() numbered them) pass
+	// within PLAYER_HIT_RADIUS + PROJECTILE_HIT_RADIUS of the segment from
+	// bottom to top, written to hits as IDs, returning how many did
+	unsigned int TestCapsule(const unsigned int* sweeps, unsigned int count,
+		const DirectX::XMFLOAT3& bottom, const DirectX::XMFLOAT3& top, unsigned int* hits);
+
+private:
+	std::vector<float> startX, startY, startZ;
+	std::vector<float> deltaX, deltaY, deltaZ;
+	std::vector<unsigned int> ids;
+};
@@ -0,0 +1,265 @@
+// Overlapped receives need winsock2.h, which has to come before anything
+// that pulls in Windows.h (and with it winsock.h, which it then replaces)
+#ifdef _WIN32
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+#include <winsock2.h>
+#include <mstcpip.h>
+#endif
+
+#include "ReceiveEngine.h"
+#include "../../../NetworkStats.h"
+#include "../../../ThreadManager.h"
+
+// The completion port's everything from here to TakeReceived() (Linux
+// has its own, in ReceiveEngineLinux.cpp)
+#ifdef _WIN32
+
+// Older SDKs don't have this (it's what stops ICMP "port unreachable"
+// from a client that's gone failing the next receive)
+#ifndef SIO_UDP_CONNRESET
+#define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
+#endif
+
+// One outstanding receive (the OVERLAPPED first, since that's what
+// comes back from the port)
+struct ReceiveEngine::Receive
+{
+	OVERLAPPED Overlapped;
+	WSABUF Buffer;
+	DWORD Flags;
+	sockaddr_in From;
+	int FromLength;
+	NetworkPacketRef Packet;
+	char Scratch[NETWORK_MAX_PACKET_SIZE + 1];	// For when there's no packet free
+};
+
+ReceiveEngine::ReceiveEngine(UDPSocket& socket, NetworkPacketPool& pool)
+	: socket(socket), pool(pool), received(RECEIVE_QUEUE_SIZE)
+{
+	port = NULL;
+	lastError = 0;
+	stopping = false;
+	pending = 0;
+	packets = 0;
+	dropped = 0;
+	discarded = 0;
+	batches = 0;
+}
+
+ReceiveEngine::~ReceiveEngine()
+{
+	Stop();
+}
+
+// --------------------------------------------------------
+// Ties the socket to a new completion port, posts every
+// receive, and starts the workers
+// --------------------------------------------------------
+bool ReceiveEngine::Start(unsigned int workerCount)
+{
+	if (port) return true;
+	if (workerCount < 1) workerCount = 1;
+
+	SOCKET sock = socket.GetHandle();
+	HANDLE newPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, workerCount);
+	if (newPort == NULL || CreateIoCompletionPort((HANDLE)sock, newPort, 0, 0) == NULL)
+	{
+		lastError = ::GetLastError();
+		if (newPort) CloseHandle(newPort);
+		return false;
+	}
+	port = newPort;
+
+	BOOL reportReset = FALSE;
+	DWORD returned = 0;
+	WSAIoctl(sock, SIO_UDP_CONNRESET, &reportReset, sizeof(reportReset), NULL, 0, &returned, NULL, NULL);
+
+	stopping = false;
+	for (unsigned int i = 0; i < workerCount * RECEIVE_OUTSTANDING; i++)
+	{
+		Receive* receive = new Receive();
+		receives.push_back(receive);
+		Post(receive);
+	}
+	if (pending == 0)
+	{
+		Stop();
+		return false;
+	}
+
+	for (unsigned int i = 0; i < workerCount; i++)
+		workers.push_back(std::thread(&ReceiveEngine::Work, this));
+	return true;
+}
+
+// --------------------------------------------------------
+// Cancels every receive, and waits for the workers to see
+// the last of them come back before they finish
+// --------------------------------------------------------
+void ReceiveEngine::Stop()
+{
+	if (!port) return;
+
+	stopping = true;
+	CancelIoEx((HANDLE)socket.GetHandle(), NULL);
+	for (size_t i = 0; i < workers.size(); i++)
+		PostQueuedCompletionStatus((HANDLE)port, 0, 0, NULL);
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+
+	for (Receive* receive : receives)
+		delete receive;
+	receives.clear();
+
+	CloseHandle((HANDLE)port);
+	port = NULL;
+}
+
+ReceiveEngineStats ReceiveEngine::GetStats()
+{
+	ReceiveEngineStats stats = {};
+	stats.Packets = packets;
+	stats.Dropped = dropped;
+	stats.Discarded = discarded;
+	stats.Batches = batches;
+	stats.Workers = (unsigned int)workers.size();
+
+	// User and kernel time, in 100 ns units
+	for (std::thread& worker : workers)
+	{
+		FILETIME created, exited, kernel, user;
+		if (!GetThreadTimes((HANDLE)worker.native_handle(), &created, &exited, &kernel, &user)) continue;
+		unsigned long long kernelTime = ((unsigned long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+		unsigned long long userTime = ((unsigned long long)user.dwHighDateTime << 32) | user.dwLowDateTime;
+		stats.CpuSeconds += (kernelTime + userTime) / 10000000.0;
+	}
+	return stats;
+}
+
+// --------------------------------------------------------
+// Takes whatever's finished off the port, queues each for
+// the game loop, and posts each receive again
+// --------------------------------------------------------
+void ReceiveEngine::Work()
+{
+	ThreadManager::GetInstance().Configure(ThreadRole::Network, "Receive Worker");
+	OVERLAPPED_ENTRY entries[RECEIVE_COMPLETION_BATCH];
+
+	for (;;)
+	{
+		ULONG count = 0;
+		if (!GetQueuedCompletionStatusEx((HANDLE)port, entries, RECEIVE_COMPLETION_BATCH, &count, INFINITE, FALSE))
+			count = 0;
+
+		for (ULONG i = 0; i < count; i++)
+		{
+			// Nothing in it is just a wake-up
+			if (entries[i].lpOverlapped == NULL) continue;
+
+			Receive* receive = reinterpret_cast<Receive*>(entries[i].lpOverlapped);
+			Complete(receive);
+			pending--;
+			if (!stopping)
+				Post(receive);
+		}
+
+		if (count > 0)
+			batches++;
+
+		// The last one out wakes the next
+		if (stopping && pending == 0)
+		{
+			PostQueuedCompletionStatus((HANDLE)port, 0, 0, NULL);
+			ThreadManager::GetInstance().Unregister();
+			return;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Receives into a free packet (or its own buffer, to drop
+// it, if there isn't one), returning false if it couldn't
+// --------------------------------------------------------
+bool ReceiveEngine::Post(Receive* receive)
+{
+	SOCKET sock = socket.GetHandle();
+	receive->Packet = pool.Acquire();
+	receive->Buffer.buf = receive->Packet ? receive->Packet->Data : receive->Scratch;
+	receive->Buffer.len = NETWORK_MAX_PACKET_SIZE;
+
+	// A receive that fails straight away, rather than going pending,
+	// is tried again, since that's usually just the one datagram
+	for (int attempt = 0; attempt < 3; attempt++)
+	{
+		ZeroMemory(&receive->Overlapped, sizeof(receive->Overlapped));
+		receive->Flags = 0;
+		receive->FromLength = sizeof(receive->From);
+
+		pending++;
+		int ret = WSARecvFrom(sock, &receive->Buffer, 1, NULL, &receive->Flags,
+			reinterpret_cast<sockaddr*>(&receive->From), &receive->FromLength, &receive->Overlapped, NULL);
+		if (ret == 0 || WSAGetLastError() == WSA_IO_PENDING)
+		{
+			// It might have just missed being cancelled
+			if (stopping)
+				CancelIoEx((HANDLE)sock, &receive->Overlapped);
+			return true;
+		}
+
+		pending--;
+		lastError = WSAGetLastError();
+		discarded++;
+	}
+
+	receive->Packet.Release();
+	return false;
+}
+
+// --------------------------------------------------------
+// Queues a finished receive's datagram, returning false if
+// there wasn't one (or it had to be dropped)
+// --------------------------------------------------------
+bool ReceiveEngine::Complete(Receive* receive)
+{
+	DWORD bytes = 0, flags = 0;
+	if (!WSAGetOverlappedResult(socket.GetHandle(), &receive->Overlapped, &bytes, FALSE, &flags))
+	{
+		if (WSAGetLastError() != WSA_OPERATION_ABORTED)
+			discarded++;
+		receive->Packet.Release();
+		return false;
+	}
+	if (!receive->Packet)
+	{
+		dropped++;
+		return false;
+	}
+
+	// Zero terminated, like RecvFrom()
+	NetworkPacket* packet = receive->Packet.Get();
+	packet->Size = (int)bytes;
+	packet->Data[bytes] = 0;
+	packet->ReceivedTime = NetworkNow();
+	ReceivedDatagram datagram = { std::move(receive->Packet), receive->From };
+	if (!received.Push(datagram))
+	{
+		datagram.Packet.Release();
+		dropped++;
+		return false;
+	}
+	packets++;
+	return true;
+}
+
+#endif
+
+void ReceiveEngine::TakeReceived(std::vector<ReceivedDatagram>& batch)
+{
+	// Only as many as are there now, so one tick's never held up by what
+	// keeps coming in while it takes them
+	batch.clear();
+	ReceivedDatagram datagram;
+	for (unsigned int i = 0; i < RECEIVE_QUEUE_SIZE && received.Pop(datagram); i++)
+		batch.push_back(std::move(datagram));
+}
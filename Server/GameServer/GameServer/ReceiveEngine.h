@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "../../../Network.h"
+#include "../../../NetworkPacketPool.h"
+#include "DatagramQueue.h"
+
+// How many worker threads wait on the completion port (or, on Linux,
+// each on a socket of its own), at most (one per core, up to this)
+#define RECEIVE_MAX_WORKERS 4
+
+// How many receives each worker keeps posted, so datagrams land
+// straight in packets while the workers are busy with others
+#define RECEIVE_OUTSTANDING 32
+
+// How many completions a worker takes off the port at once (or, on
+// Linux, datagrams it takes with each recvmmsg())
+#define RECEIVE_COMPLETION_BATCH 32
+
+// How many received datagrams can be waiting for the game loop
+#define RECEIVE_QUEUE_SIZE 4096
+
+// Totals since it started
+struct ReceiveEngineStats
+{
+	unsigned long long Packets;
+	unsigned long long Dropped;		// Came in while every packet (or the queue) was full
+	unsigned long long Discarded;	// Too big, or an error that only lost the one
+	unsigned long long Batches;		// Times a worker took completions off the port (or called recvmmsg())
+	double CpuSeconds;				// Spent on the workers, across every core
+	unsigned int Workers;
+};
+
+// Receives on several threads at once through an I/O completion port
+//  - Every outstanding receive goes straight into a pooled packet (or,
+//    if they're all in use, a buffer of its own, where it's dropped)
+//  - What's received is only queued (lock free, see DatagramQueue), for
+//    the game loop to take all of at the start of each tick with
+//    TakeReceived(), so player state is only ever touched on its thread
+//  - Registered I/O would save the buffer locking per receive too, but
+//    needs every buffer registered up front, which the pool's packets
+//    (shared with everything else that reads them) can't be
+//  - On Linux (see ReceiveEngineLinux.cpp) there's no completion port,
+//    so each worker has a socket of its own instead, all sharing the
+//    port (SO_REUSEPORT, which needs the socket it's given bound shared),
+//    and reads batches of them at once with recvmmsg() whenever epoll
+//    says there's something there
+class ReceiveEngine
+{
+public:
+	ReceiveEngine(UDPSocket& socket, NetworkPacketPool& pool);
+	~ReceiveEngine();
+
+	// False when the completion port (or the workers' sockets) couldn't be
+	// set up (see GetLastError())
+	bool Start(unsigned int workers);
+	void Stop();
+	int GetLastError() { return lastError; }
+
+	// Everything received since the last call, in the order it was queued
+	// (which is only arrival order per worker), replacing what's there
+	void TakeReceived(std::vector<ReceivedDatagram>& batch);
+
+	ReceiveEngineStats GetStats();
+
+private:
+	UDPSocket& socket;
+	NetworkPacketPool& pool;
+	std::atomic<int> lastError;	// Workers set it too
+
+	std::vector<std::thread> workers;
+	std::atomic<bool> stopping;
+
+	DatagramQueue received;
+
+	std::atomic<unsigned long long> packets;
+	std::atomic<unsigned long long> dropped;
+	std::atomic<unsigned long long> discarded;
+	std::atomic<unsigned long long> batches;
+
+#ifdef _WIN32
+	struct Receive;
+
+	void* port;
+	std::vector<Receive*> receives;
+	std::atomic<int> pending;
+
+	void Work();
+	bool Post(Receive* receive);
+	bool Complete(Receive* receive);
+#else
+	// Each worker's socket (the first's the one it was given) and epoll
+	// set, and what wakes them all when it's stopping
+	std::vector<SOCKET> workerSockets;
+	std::vector<int> workerPolls;
+	int wake;
+
+	void Work(unsigned int worker);
+#endif
+};
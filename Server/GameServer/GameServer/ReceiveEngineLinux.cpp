@@ -0,0 +1,248 @@
+// The Linux receive engine (Windows has the completion port one, in
+// ReceiveEngine.cpp)
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "ReceiveEngine.h"
+#include "../../../NetworkStats.h"
+#include "../../../ThreadManager.h"
+
+ReceiveEngine::ReceiveEngine(UDPSocket& socket, NetworkPacketPool& pool)
+	: socket(socket), pool(pool), received(RECEIVE_QUEUE_SIZE)
+{
+	lastError = 0;
+	stopping = false;
+	wake = -1;
+	packets = 0;
+	dropped = 0;
+	discarded = 0;
+	batches = 0;
+}
+
+ReceiveEngine::~ReceiveEngine()
+{
+	Stop();
+}
+
+// --------------------------------------------------------
+// Gives each worker a socket (the one it was given for the
+// first, and new ones sharing its port for the rest) and an
+// epoll set for it, and starts them
+// --------------------------------------------------------
+bool ReceiveEngine::Start(unsigned int workerCount)
+{
+	if (!workers.empty()) return true;
+	if (workerCount < 1) workerCount = 1;
+
+	unsigned short port = socket.GetBoundPort();
+	wake = eventfd(0, EFD_NONBLOCK);
+	if (port == 0 || wake < 0)
+	{
+		lastError = errno;
+		Stop();
+		return false;
+	}
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		SOCKET sock = socket.GetHandle();
+		if (i > 0)
+		{
+			// Only as many as can share the port (none can, if the first
+			// wasn't bound shared)
+			sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+			sockaddr_in add = {};
+			add.sin_family = AF_INET;
+			add.sin_addr.s_addr = htonl(INADDR_ANY);
+			add.sin_port = htons(port);
+			int reuse = 1;
+			if (sock == INVALID_SOCKET ||
+				setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) != 0 ||
+				fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) != 0 ||
+				bind(sock, reinterpret_cast<sockaddr*>(&add), sizeof(add)) != 0)
+			{
+				lastError = errno;
+				if (sock != INVALID_SOCKET) close(sock);
+				break;
+			}
+		}
+
+		int poll = epoll_create1(0);
+		epoll_event readable = {};
+		readable.events = EPOLLIN;
+		if (poll < 0 ||
+			epoll_ctl(poll, EPOLL_CTL_ADD, sock, &readable) != 0 ||
+			epoll_ctl(poll, EPOLL_CTL_ADD, wake, &readable) != 0)
+		{
+			lastError = errno;
+			if (poll >= 0) close(poll);
+			if (i > 0) close(sock);
+			break;
+		}
+		workerSockets.push_back(sock);
+		workerPolls.push_back(poll);
+	}
+	if (workerSockets.empty())
+	{
+		Stop();
+		return false;
+	}
+
+	stopping = false;
+	for (unsigned int i = 0; i < workerSockets.size(); i++)
+		workers.push_back(std::thread(&ReceiveEngine::Work, this, i));
+	return true;
+}
+
+// --------------------------------------------------------
+// Wakes every worker to see it's stopping, and closes all
+// but the socket it was given
+// --------------------------------------------------------
+void ReceiveEngine::Stop()
+{
+	stopping = true;
+	if (wake >= 0)
+	{
+		// Never read, so it wakes every worker, and keeps them awake
+		eventfd_write(wake, 1);
+	}
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+
+	for (size_t i = 0; i < workerSockets.size(); i++)
+	{
+		if (i > 0) close(workerSockets[i]);
+		close(workerPolls[i]);
+	}
+	workerSockets.clear();
+	workerPolls.clear();
+
+	if (wake >= 0) close(wake);
+	wake = -1;
+}
+
+ReceiveEngineStats ReceiveEngine::GetStats()
+{
+	ReceiveEngineStats stats = {};
+	stats.Packets = packets;
+	stats.Dropped = dropped;
+	stats.Discarded = discarded;
+	stats.Batches = batches;
+	stats.Workers = (unsigned int)workers.size();
+
+	// User and system time
+	for (std::thread& worker : workers)
+	{
+		clockid_t clock;
+		timespec spent;
+		if (pthread_getcpuclockid(worker.native_handle(), &clock) != 0 || clock_gettime(clock, &spent) != 0) continue;
+		stats.CpuSeconds += spent.tv_sec + spent.tv_nsec / 1000000000.0;
+	}
+	return stats;
+}
+
+// --------------------------------------------------------
+// Sleeps until its socket has something, then reads all of
+// it, RECEIVE_COMPLETION_BATCH at a time, straight into
+// pooled packets (or, if there aren't any free, a scratch
+// buffer, to drop it)
+// --------------------------------------------------------
+void ReceiveEngine::Work(unsigned int worker)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "Receive Worker %u", worker);
+	ThreadManager::GetInstance().Configure(ThreadRole::Network, name);
+
+	SOCKET sock = workerSockets[worker];
+	int poll = workerPolls[worker];
+
+	mmsghdr messages[RECEIVE_COMPLETION_BATCH];
+	iovec parts[RECEIVE_COMPLETION_BATCH];
+	sockaddr_in from[RECEIVE_COMPLETION_BATCH];
+	NetworkPacketRef batch[RECEIVE_COMPLETION_BATCH];
+	char scratch[NETWORK_MAX_PACKET_SIZE + 1];
+
+	while (!stopping)
+	{
+		epoll_event events[2];
+		if (epoll_wait(poll, events, 2, -1) < 0 && errno != EINTR)
+		{
+			lastError = errno;
+			break;
+		}
+
+		for (;;)
+		{
+			if (stopping) break;
+
+			// Whatever was used last time is replaced, and the rest kept
+			for (int i = 0; i < RECEIVE_COMPLETION_BATCH; i++)
+			{
+				if (!batch[i])
+					batch[i] = pool.Acquire();
+				parts[i].iov_base = batch[i] ? batch[i]->Data : scratch;
+				parts[i].iov_len = NETWORK_MAX_PACKET_SIZE;
+				messages[i] = {};
+				messages[i].msg_hdr.msg_name = &from[i];
+				messages[i].msg_hdr.msg_namelen = sizeof(from[i]);
+				messages[i].msg_hdr.msg_iov = &parts[i];
+				messages[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			int count = recvmmsg(sock, messages, RECEIVE_COMPLETION_BATCH, MSG_DONTWAIT, nullptr);
+			if (count < 0)
+			{
+				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+					break;
+
+				// Just the one, like an ICMP error, so there may be more behind it
+				lastError = errno;
+				discarded++;
+				continue;
+			}
+			batches++;
+
+			for (int i = 0; i < count; i++)
+			{
+				if (messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+				{
+					discarded++;
+					continue;
+				}
+				if (!batch[i])
+				{
+					dropped++;
+					continue;
+				}
+
+				// Zero terminated, like RecvFrom()
+				NetworkPacket* packet = batch[i].Get();
+				packet->Size = (int)messages[i].msg_len;
+				packet->Data[packet->Size] = 0;
+				packet->ReceivedTime = NetworkNow();
+				ReceivedDatagram datagram = { std::move(batch[i]), from[i] };
+				if (!received.Push(datagram))
+				{
+					datagram.Packet.Release();
+					dropped++;
+					continue;
+				}
+				packets++;
+			}
+
+			// Fewer than it asked for means it's taken everything there was
+			if (count < RECEIVE_COMPLETION_BATCH)
+				break;
+		}
+	}
+
+	ThreadManager::GetInstance().Unregister();
+}
+
+#endif
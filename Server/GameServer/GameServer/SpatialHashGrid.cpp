@@ -0,0 +1,65 @@
+#include "SpatialHashGrid.h"
+
+#include <cmath>
+
+SpatialHashGrid::SpatialHashGrid(float cellSize)
+{
+	this->cellSize = cellSize > 0 ? cellSize : 1.0f;
+	inverseCellSize = 1.0f / this->cellSize;
+	bucketMask = 0;
+}
+
+void SpatialHashGrid::Clear()
+{
+	inserted.clear();
+	sorted.clear();
+}
+
+void SpatialHashGrid::Insert(unsigned int id, const DirectX::XMFLOAT3& position)
+{
+	Entry entry;
+	GetCell(position, entry.X, entry.Y, entry.Z);
+	entry.Id = id;
+	inserted.push_back(entry);
+}
+
+// --------------------------------------------------------
+// Sorts everything inserted by bucket, with twice as many
+// buckets as entries (a power of two) to keep them short
+// --------------------------------------------------------
+void SpatialHashGrid::Build()
+{
+	unsigned int buckets = SPATIAL_HASH_MIN_BUCKETS;
+	while (buckets < inserted.size() * 2)
+		buckets *= 2;
+	bucketMask = buckets - 1;
+
+	// Count each bucket's entries, then turn the counts into where each starts
+	bucketStarts.assign(buckets + 1, 0);
+	for (const Entry& entry : inserted)
+		bucketStarts[GetBucket(entry.X, entry.Y, entry.Z) + 1]++;
+	for (unsigned int i = 1; i <= buckets; i++)
+		bucketStarts[i] += bucketStarts[i - 1];
+
+	// And put them there, with the starts as cursors, which leaves each
+	// at the next bucket's start, so they're shifted back after
+	sorted.resize(inserted.size());
+	for (const Entry& entry : inserted)
+		sorted[bucketStarts[GetBucket(entry.X, entry.Y, entry.Z)]++] = entry;
+	for (unsigned int i = buckets; i > 0; i--)
+		bucketStarts[i] = bucketStarts[i - 1];
+	bucketStarts[0] = 0;
+}
+
+void SpatialHashGrid::GetCell(const DirectX::XMFLOAT3& position, int& x, int& y, int& z) const
+{
+	x = (int)floorf(position.x * inverseCellSize);
+	y = (int)floorf(position.y * inverseCellSize);
+	z = (int)floorf(position.z * inverseCellSize);
+}
+
+// Large primes, multiplied as unsigned so negative cells wrap rather than overflow
+unsigned int SpatialHashGrid::GetBucket(int x, int y, int z) const
+{
+	return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u) ^ ((unsigned int)z * 83492791u)) & bucketMask;
+}
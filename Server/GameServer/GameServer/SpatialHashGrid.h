@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include "../../../PortableMath.h"
+
+// The fewest buckets the table has, however few things are in it
+#define SPATIAL_HASH_MIN_BUCKETS 64
+
+// A uniform grid over space, hashed so only occupied cells cost anything,
+// that's rebuilt from scratch every tick
+//  - Insert() everything, then Build(), then query, then Clear() next tick
+//  - A query visits the point's cell and the 26 around it, so everything
+//    within cellSize of the point is found (and some further away)
+//  - Building is a counting sort into buckets, so there's no allocating
+//    once the vectors have grown to fit
+class SpatialHashGrid
+{
+public:
+	SpatialHashGrid(float cellSize);
+
+	void Clear();
+	void Insert(unsigned int id, const DirectX::XMFLOAT3& position);
+	void Build();
+
+	// Calls visit(id) for everything in the 3x3x3 cells around position
+	template<typename Visitor>
+	void QueryNeighbours(const DirectX::XMFLOAT3& position, Visitor visit) const;
+
+	unsigned int GetCount() const { return (unsigned int)sorted.size(); }
+	float GetCellSize() const { return cellSize; }
+
+private:
+	struct Entry
+	{
+		int X, Y, Z;
+		unsigned int Id;
+	};
+
+	float cellSize;
+	float inverseCellSize;
+	std::vector<Entry> inserted;
+	std::vector<Entry> sorted;
+	std::vector<unsigned int> bucketStarts;	// One past the last bucket too
+	unsigned int bucketMask;
+
+	void GetCell(const DirectX::XMFLOAT3& position, int& x, int& y, int& z) const;
+	unsigned int GetBucket(int x, int y, int z) const;
+};
+
+template<typename Visitor>
+void SpatialHashGrid::QueryNeighbours(const DirectX::XMFLOAT3& position, Visitor visit) const
+{
+	if (sorted.empty())
+		return;
+
+	int cx, cy, cz;
+	GetCell(position, cx, cy, cz);
+	for (int z = cz - 1; z <= cz + 1; z++)
+		for (int y = cy - 1; y <= cy + 1; y++)
+			for (int x = cx - 1; x <= cx + 1; x++)
+			{
+				// Other cells can share the bucket, so each entry's own
+				// cell is checked (which also keeps anything from being
+				// visited twice)
+				unsigned int bucket = GetBucket(x, y, z);
+				for (unsigned int i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; i++)
+				{
+					const Entry& entry = sorted[i];
+					if (entry.X == x && entry.Y == y && entry.Z == z)
+						visit(entry.Id);
+				}
+			}
+}
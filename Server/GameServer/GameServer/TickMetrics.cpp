@@ -0,0 +1,208 @@
+#include "TickMetrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "TickScheduler.h"
+#include "ReceiveEngine.h"
+#include "PlayerRegistry.h"
+#include "../../../NetworkStats.h"
+
+// What each phase is called, in the log line and the exported labels
+static const char* phaseNames[TICK_PHASE_COUNT] = { "receive", "players", "projectiles", "collision", "snapshot_build", "snapshot_send" };
+
+TickMetrics::TickMetrics()
+{
+	inTick = false;
+	for (int i = 0; i < TICK_PHASE_COUNT; i++)
+	{
+		current[i] = 0;
+		phases[i].assign(TICK_METRICS_WINDOW, 0.0f);
+	}
+	work.assign(TICK_METRICS_WINDOW, 0.0f);
+	next = 0;
+	count = 0;
+	packetsIn = packetsOut = 0;
+	bytesIn = bytesOut = 0;
+}
+
+void TickMetrics::BeginTick()
+{
+	if (inTick)
+	{
+		double total = 0;
+		for (int i = 0; i < TICK_PHASE_COUNT; i++)
+		{
+			phases[i][next] = (float)(current[i] * 1000.0);
+			total += current[i];
+		}
+		work[next] = (float)(total * 1000.0);
+		next = (next + 1) % TICK_METRICS_WINDOW;
+		if (count < TICK_METRICS_WINDOW) count++;
+	}
+
+	inTick = true;
+	for (int i = 0; i < TICK_PHASE_COUNT; i++)
+		current[i] = 0;
+}
+
+void TickMetrics::EndPhase(TickPhase phase, double& start)
+{
+	double now = NetworkNow();
+	current[phase] += now - start;
+	start = now;
+}
+
+// Only over the ticks there have been, sorted just enough for each
+TickPercentiles TickMetrics::GetPercentiles(const std::vector<float>& samples)
+{
+	TickPercentiles percentiles = {};
+	if (count == 0) return percentiles;
+
+	std::vector<float> sorted(samples.begin(), samples.begin() + count);
+	auto at = [&](double fraction)
+	{
+		size_t index = (size_t)(fraction * sorted.size());
+		if (index >= sorted.size()) index = sorted.size() - 1;
+		std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+		return (double)sorted[index];
+	};
+	percentiles.P50 = at(0.50);
+	percentiles.P95 = at(0.95);
+	percentiles.P99 = at(0.99);
+	percentiles.Max = *std::max_element(sorted.begin(), sorted.end());
+	return percentiles;
+}
+
+void TickMetrics::Print(char* buffer, size_t size)
+{
+	int written = snprintf(buffer, size, "Phases (p95):");
+	for (int i = 0; i < TICK_PHASE_COUNT && written > 0 && (size_t)written < size; i++)
+		written += snprintf(buffer + written, size - written, " %s %.2fms", phaseNames[i], GetPhase((TickPhase)i).P95);
+
+	TickPercentiles total = GetWork();
+	if (written > 0 && (size_t)written < size)
+		snprintf(buffer + written, size - written, " | work %.2fms p50 %.2fms p99 %.2fms max", total.P50, total.P99, total.Max);
+}
+
+// --------------------------------------------------------
+// Summaries for the times (each phase's, and the tick's),
+// counters for everything that only goes up, and gauges
+// for what's waiting, per client, with every room's in
+// each family (as the format needs)
+// --------------------------------------------------------
+std::string TickMetrics::Format(const std::vector<TickMetricsRoom>& rooms, const TickStats& ticks, const ReceiveEngineStats& received)
+{
+	std::string text;
+	char line[256];
+	auto add = [&](const char* format, auto... values)
+	{
+		snprintf(line, sizeof(line), format, values...);
+		text += line;
+	};
+	auto addSummary = [&](const char* name, const char* labels, const TickPercentiles& p)
+	{
+		add("%s{%s,quantile=\"0.5\"} %.4f\n", name, labels, p.P50);
+		add("%s{%s,quantile=\"0.95\"} %.4f\n", name, labels, p.P95);
+		add("%s{%s,quantile=\"0.99\"} %.4f\n", name, labels, p.P99);
+		add("%s{%s,quantile=\"1\"} %.4f\n", name, labels, p.Max);
+	};
+
+	text += "# HELP gameserver_tick_phase_ms Milliseconds each phase of a room's tick took, over the last ticks\n";
+	text += "# TYPE gameserver_tick_phase_ms summary\n";
+	for (const TickMetricsRoom& room : rooms)
+	{
+		for (int i = 0; i < TICK_PHASE_COUNT; i++)
+		{
+			char labels[64];
+			snprintf(labels, sizeof(labels), "room=\"%u\",phase=\"%s\"", room.Room, phaseNames[i]);
+			addSummary("gameserver_tick_phase_ms", labels, room.Metrics->GetPhase((TickPhase)i));
+		}
+	}
+
+	text += "# HELP gameserver_tick_work_ms Milliseconds of work each of a room's ticks took, over the last ticks\n";
+	text += "# TYPE gameserver_tick_work_ms summary\n";
+	for (const TickMetricsRoom& room : rooms)
+	{
+		char labels[32];
+		snprintf(labels, sizeof(labels), "room=\"%u\"", room.Room);
+		addSummary("gameserver_tick_work_ms", labels, room.Metrics->GetWork());
+	}
+
+	text += "# TYPE gameserver_ticks_total counter\n";
+	add("gameserver_ticks_total %llu\n", ticks.Ticks);
+	text += "# HELP gameserver_tick_overruns_total Ticks whose work (every room's) took longer than a tick\n";
+	text += "# TYPE gameserver_tick_overruns_total counter\n";
+	add("gameserver_tick_overruns_total %llu\n", ticks.Overruns);
+	text += "# TYPE gameserver_ticks_skipped_total counter\n";
+	add("gameserver_ticks_skipped_total %llu\n", ticks.Skipped);
+	text += "# TYPE gameserver_tick_late_ms gauge\n";
+	add("gameserver_tick_late_ms %.4f\n", ticks.AverageLateMs);
+	text += "# TYPE gameserver_tick_drift_ms gauge\n";
+	add("gameserver_tick_drift_ms %.4f\n", ticks.DriftMs);
+
+	text += "# TYPE gameserver_packets_total counter\n";
+	for (const TickMetricsRoom& room : rooms)
+	{
+		add("gameserver_packets_total{room=\"%u\",direction=\"in\"} %llu\n", room.Room, room.Metrics->packetsIn);
+		add("gameserver_packets_total{room=\"%u\",direction=\"out\"} %llu\n", room.Room, room.Metrics->packetsOut);
+	}
+	text += "# TYPE gameserver_bytes_total counter\n";
+	for (const TickMetricsRoom& room : rooms)
+	{
+		add("gameserver_bytes_total{room=\"%u\",direction=\"in\"} %llu\n", room.Room, room.Metrics->bytesIn);
+		add("gameserver_bytes_total{room=\"%u\",direction=\"out\"} %llu\n", room.Room, room.Metrics->bytesOut);
+	}
+	text += "# HELP gameserver_receive_dropped_total Datagrams dropped with every packet (or the queue) full\n";
+	text += "# TYPE gameserver_receive_dropped_total counter\n";
+	add("gameserver_receive_dropped_total %llu\n", received.Dropped);
+	text += "# TYPE gameserver_receive_discarded_total counter\n";
+	add("gameserver_receive_discarded_total %llu\n", received.Discarded);
+
+	text += "# TYPE gameserver_players gauge\n";
+	for (const TickMetricsRoom& room : rooms)
+		add("gameserver_players{room=\"%u\"} %u\n", room.Room, room.Players->GetCount());
+
+	// Per client, in every room
+	auto addClients = [&](const char* name, const char* format, auto value)
+	{
+		for (const TickMetricsRoom& room : rooms)
+		{
+			for (unsigned int i = 0; i < room.Players->GetCount(); i++)
+			{
+				Player* p = room.Players->Get(i);
+				char labels[64];
+				snprintf(labels, sizeof(labels), "%s{room=\"%u\",player=\"%u\"} ", name, room.Room, p->GetID());
+				text += labels;
+				add(format, value(p));
+			}
+		}
+	};
+	text += "# HELP gameserver_client_reliable_pending Reliable messages not acknowledged yet, per client\n";
+	text += "# TYPE gameserver_client_reliable_pending gauge\n";
+	addClients("gameserver_client_reliable_pending", "%u\n", [](Player* p) { return p->connection.GetPendingReliable(); });
+	text += "# HELP gameserver_client_queued_bytes Unreliable bytes waiting for the next send, per client\n";
+	text += "# TYPE gameserver_client_queued_bytes gauge\n";
+	addClients("gameserver_client_queued_bytes", "%d\n", [](Player* p) { return p->connection.GetQueuedBytes(); });
+	text += "# TYPE gameserver_client_rtt_ms gauge\n";
+	addClients("gameserver_client_rtt_ms", "%.2f\n", [](Player* p) { return p->connection.GetStats().Get(NETWORK_STAT_RTT); });
+	return text;
+}
+
+bool TickMetrics::Export(const std::string& path, const std::vector<TickMetricsRoom>& rooms, const TickStats& ticks, const ReceiveEngineStats& received)
+{
+	std::string text = Format(rooms, ticks, received);
+	std::string temporary = path + ".tmp";
+
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file << text;
+		if (!file) return false;
+	}
+#ifdef _WIN32
+	return MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	// Which replaces whatever's there in one go already
+	return std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+}
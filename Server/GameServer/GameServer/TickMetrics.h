@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct TickStats;
+struct ReceiveEngineStats;
+class PlayerRegistry;
+
+// How many ticks the percentiles are over (ten seconds at 60 a second)
+#define TICK_METRICS_WINDOW 600
+
+// Each part of a tick, in the order the game loop runs them
+enum TickPhase
+{
+	TICK_PHASE_RECEIVE,			// Handling everything that's come in
+	TICK_PHASE_PLAYERS,			// Moving players, resending, measuring connections
+	TICK_PHASE_PROJECTILES,
+	TICK_PHASE_COLLISION,
+	TICK_PHASE_SNAPSHOT_BUILD,	// Picking each client's entries and writing them
+	TICK_PHASE_SNAPSHOT_SEND,
+	TICK_PHASE_COUNT
+};
+
+struct TickPercentiles
+{
+	double P50, P95, P99, Max;	// Milliseconds
+};
+
+class TickMetrics;
+
+// One room's metrics, and who's in it, to be exported with the rest
+struct TickMetricsRoom
+{
+	unsigned int Room;
+	TickMetrics* Metrics;
+	PlayerRegistry* Players;
+};
+
+// Times every phase of every tick, and counts what goes in and out
+//  - Each phase's time is added up over the tick (a phase can be timed
+//    in pieces, like the snapshots, a client at a time), and the last
+//    TICK_METRICS_WINDOW ticks of each kept for the percentiles
+//  - Exported as Prometheus text (for a textfile collector to pick up,
+//    or anything else that reads the format), and as a log line
+//  - Each room has its own, only ever used on whichever thread is
+//    ticking it, and they're all exported together (labelled by room)
+class TickMetrics
+{
+public:
+	TickMetrics();
+
+	// Ends the last tick (if there was one) and starts timing this one
+	void BeginTick();
+
+	// Adds the time since start to the phase, and moves start on to now
+	void EndPhase(TickPhase phase, double& start);
+
+	void CountReceived(int bytes) { packetsIn++; bytesIn += bytes; }
+	void CountSent(int bytes) { packetsOut++; bytesOut += bytes; }
+
+	TickPercentiles GetPhase(TickPhase phase) { return GetPercentiles(phases[phase]); }
+	TickPercentiles GetWork() { return GetPercentiles(work); }
+
+	// One line of every phase's 95th percentile, for the console
+	void Print(char* buffer, size_t size);
+
+	// Every room's, in the Prometheus text format, written to a file next to
+	// path and moved over it, so what's reading it never sees half of one
+	static std::string Format(const std::vector<TickMetricsRoom>& rooms, const TickStats& ticks, const ReceiveEngineStats& received);
+	static bool Export(const std::string& path, const std::vector<TickMetricsRoom>& rooms, const TickStats& ticks, const ReceiveEngineStats& received);
+
+private:
+	bool inTick;
+	double current[TICK_PHASE_COUNT];
+
+	// The last TICK_METRICS_WINDOW ticks' times, in milliseconds, as rings
+	std::vector<float> phases[TICK_PHASE_COUNT];
+	std::vector<float> work;
+	unsigned int next;
+	unsigned int count;
+
+	unsigned long long packetsIn, packetsOut;
+	unsigned long long bytesIn, bytesOut;
+
+	TickPercentiles GetPercentiles(const std::vector<float>& samples);
+};
@@ -0,0 +1,119 @@
+#include "TickScheduler.h"
+
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#pragma comment (lib, "winmm")
+
+// Windows 10 1803 and up, which older SDKs don't have
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+using namespace std::chrono;
+
+TickScheduler::TickScheduler(double ticksPerSecond)
+{
+#ifdef _WIN32
+	timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	highResolution = timer != NULL;
+	raisedTimerResolution = false;
+	if (!highResolution)
+	{
+		// The plain timer's only as good as the system timer, which is 15.6 ms unless asked for better
+		raisedTimerResolution = timeBeginPeriod(1) == TIMERR_NOERROR;
+		timer = CreateWaitableTimerW(NULL, FALSE, NULL);
+	}
+#else
+	// Sleeps elsewhere already wake within tens of microseconds
+	timer = nullptr;
+	highResolution = true;
+	raisedTimerResolution = false;
+#endif
+
+	SetTickRate(ticksPerSecond);
+}
+
+TickScheduler::~TickScheduler()
+{
+#ifdef _WIN32
+	if (timer)
+		CloseHandle(timer);
+	if (raisedTimerResolution)
+		timeEndPeriod(1);
+#endif
+}
+
+void TickScheduler::SetTickRate(double ticksPerSecond)
+{
+	tickRate = ticksPerSecond > 0 ? ticksPerSecond : 60.0;
+	period = duration_cast<clock::duration>(duration<double>(1.0 / tickRate));
+	start = clock::now();
+	nextDeadline = start;
+	lastWake = start;
+	stats = {};
+}
+
+void TickScheduler::WaitForNextTick()
+{
+	clock::time_point now = clock::now();
+	if (stats.Ticks > 0)
+	{
+		double workMs = duration<double, std::milli>(now - lastWake).count();
+		stats.AverageWorkMs += (workMs - stats.AverageWorkMs) * 0.05;
+		if (now - lastWake > period)
+			stats.Overruns++;
+	}
+
+	// Too far behind to catch up, so it's from now on instead
+	if (now - nextDeadline > period * TICK_MAX_CATCHUP)
+	{
+		stats.Skipped += (unsigned long long)((now - nextDeadline) / period);
+		nextDeadline = now;
+	}
+
+	if (now < nextDeadline)
+		SleepUntil(nextDeadline);
+
+	clock::time_point wake = clock::now();
+	double lateMs = duration<double, std::milli>(wake - nextDeadline).count();
+	if (lateMs < 0) lateMs = 0;
+	stats.AverageLateMs += (lateMs - stats.AverageLateMs) * 0.05;
+	if (lateMs > stats.MaxLateMs) stats.MaxLateMs = lateMs;
+
+	stats.Ticks++;
+	stats.DriftMs = duration<double, std::milli>(wake - start).count() - (stats.Ticks + stats.Skipped - 1) * duration<double, std::milli>(period).count();
+
+	lastWake = wake;
+	nextDeadline += period;
+}
+
+// --------------------------------------------------------
+// Sleeps on the timer, then for a coarse one, checks the
+// clock through whatever's left (yielding, not spinning)
+// --------------------------------------------------------
+void TickScheduler::SleepUntil(clock::time_point deadline)
+{
+	clock::duration margin = highResolution ? clock::duration(0) :
+		duration_cast<clock::duration>(duration<double, std::milli>(TICK_SPIN_MARGIN_MS));
+
+	clock::duration remaining = deadline - clock::now() - margin;
+#ifdef _WIN32
+	if (timer && remaining > clock::duration(0))
+	{
+		// Relative, in 100 ns units
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)(duration_cast<nanoseconds>(remaining).count() / 100);
+		if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+			WaitForSingleObject(timer, INFINITE);
+	}
+#else
+	if (remaining > clock::duration(0))
+		std::this_thread::sleep_for(remaining);
+#endif
+
+	while (clock::now() < deadline)
+		std::this_thread::yield();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+
+// How many ticks behind the loop can fall before it gives up on
+// catching up, and starts the schedule over from now (so one long
+// stall doesn't turn into a burst of ticks)
+#define TICK_MAX_CATCHUP 5
+
+// How much of the wait is spent on a wake-up check rather than asleep,
+// in milliseconds, for when the timer isn't a high resolution one
+#define TICK_SPIN_MARGIN_MS 1.0
+
+// How the loop's been keeping time, all in milliseconds
+struct TickStats
+{
+	unsigned long long Ticks;
+	unsigned long long Overruns;	// Ticks whose work took longer than a tick
+	unsigned long long Skipped;		// Ticks given up on after falling too far behind
+	double AverageLateMs;			// Waking after the deadline, smoothed
+	double MaxLateMs;
+	double AverageWorkMs;			// Between waking and the next wait, smoothed
+	double DriftMs;					// How far the schedule has slipped behind the time that's passed
+};
+
+// Runs a loop at a fixed rate by sleeping until each tick's deadline,
+// which are all a whole number of ticks from the start, so lateness
+// in one doesn't push the rest back
+//  - Sleeps on a high resolution waitable timer where Windows has one,
+//    or else with the system timer at 1 ms and a short check at the end
+//  - Anywhere but Windows, it's just sleep_for(), which is already as
+//    good as the high resolution timer
+class TickScheduler
+{
+public:
+	TickScheduler(double ticksPerSecond);
+	~TickScheduler();
+
+	// Starts the schedule over at the new rate
+	void SetTickRate(double ticksPerSecond);
+	double GetTickRate() { return tickRate; }
+	float GetTickSeconds() { return (float)(1.0 / tickRate); }
+
+	// Sleeps until the next tick's due (right away if it's already late)
+	void WaitForNextTick();
+
+	const TickStats& GetStats() { return stats; }
+	bool IsHighResolution() { return highResolution; }
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	double tickRate;
+	clock::duration period;
+	clock::time_point start;
+	clock::time_point nextDeadline;
+	clock::time_point lastWake;
+
+	void* timer;	// A waitable timer HANDLE (Windows only)
+	bool highResolution;
+	bool raisedTimerResolution;
+
+	TickStats stats;
+
+	void SleepUntil(clock::time_point deadline);
+};
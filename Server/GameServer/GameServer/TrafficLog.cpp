@@ -0,0 +1,112 @@
+#include "TrafficLog.h"
+
+#include <cstring>
+#include "../../../NetworkStats.h"
+
+bool TrafficRecorder::Open(const std::string& path, double tickRate)
+{
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	unsigned int magic = TRAFFIC_LOG_MAGIC, version = TRAFFIC_LOG_VERSION;
+	file.write((const char*)&magic, sizeof(magic));
+	file.write((const char*)&version, sizeof(version));
+	file.write((const char*)&tickRate, sizeof(tickRate));
+	count = 0;
+	return file.good();
+}
+
+void TrafficRecorder::Record(unsigned int tick, const ReceivedDatagram& datagram)
+{
+	unsigned int address = datagram.From.sin_addr.s_addr;
+	unsigned short port = datagram.From.sin_port;
+	unsigned short size = (unsigned short)datagram.Packet->Size;
+	file.write((const char*)&tick, sizeof(tick));
+	file.write((const char*)&address, sizeof(address));
+	file.write((const char*)&port, sizeof(port));
+	file.write((const char*)&size, sizeof(size));
+	file.write(datagram.Packet->Data, size);
+	count++;
+}
+
+bool TrafficReplay::Open(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+
+	data.resize((size_t)file.tellg());
+	file.seekg(0);
+	file.read(data.data(), data.size());
+
+	unsigned int magic = 0, version = 0;
+	size_t start = sizeof(magic) + sizeof(version) + sizeof(tickRate);
+	if (!file || data.size() < start)
+		return false;
+	std::memcpy(&magic, data.data(), sizeof(magic));
+	std::memcpy(&version, data.data() + sizeof(magic), sizeof(version));
+	std::memcpy(&tickRate, data.data() + sizeof(magic) + sizeof(version), sizeof(tickRate));
+	if (magic != TRAFFIC_LOG_MAGIC || version != TRAFFIC_LOG_VERSION || tickRate <= 0)
+		return false;
+
+	// Counted (and checked) once, so a log that's been cut short just ends there
+	RecordHeader header;
+	count = 0;
+	size_t end = start;
+	while (ReadHeader(end, header))
+	{
+		lastTick = header.Tick;
+		end += sizeof(RecordHeader) + header.Size;
+		count++;
+	}
+	data.resize(end);
+	offset = start;
+	dropped = 0;
+	return true;
+}
+
+bool TrafficReplay::ReadHeader(size_t at, RecordHeader& header)
+{
+	// (Which is how it's written, field by field)
+	static_assert(sizeof(RecordHeader) == 12, "Records have a 12 byte header");
+
+	if (data.size() - at < sizeof(RecordHeader))
+		return false;
+
+	std::memcpy(&header.Tick, &data[at], 4);
+	std::memcpy(&header.Address, &data[at + 4], 4);
+	std::memcpy(&header.Port, &data[at + 8], 2);
+	std::memcpy(&header.Size, &data[at + 10], 2);
+	return header.Size <= NETWORK_MAX_PACKET_SIZE && data.size() - at - sizeof(RecordHeader) >= header.Size;
+}
+
+void TrafficReplay::Take(unsigned int tick, NetworkPacketPool& pool, std::vector<ReceivedDatagram>& batch)
+{
+	batch.clear();
+
+	RecordHeader header;
+	while (ReadHeader(offset, header) && header.Tick <= tick)
+	{
+		const char* bytes = &data[offset + sizeof(RecordHeader)];
+		offset += sizeof(RecordHeader) + header.Size;
+
+		ReceivedDatagram datagram;
+		datagram.Packet = pool.Acquire();
+		if (!datagram.Packet)
+		{
+			dropped++;
+			continue;
+		}
+
+		std::memcpy(datagram.Packet->Data, bytes, header.Size);
+		datagram.Packet->Data[header.Size] = 0;
+		datagram.Packet->Size = header.Size;
+		datagram.Packet->ReceivedTime = NetworkNow();
+		datagram.From = {};
+		datagram.From.sin_family = AF_INET;
+		datagram.From.sin_addr.s_addr = header.Address;
+		datagram.From.sin_port = header.Port;
+		batch.push_back(std::move(datagram));
+	}
+}
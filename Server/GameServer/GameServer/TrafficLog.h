@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "DatagramQueue.h"
+
+// Starts every log ("GSTL"), then its version and the tick rate it was recorded at
+#define TRAFFIC_LOG_MAGIC	0x4C545347
+#define TRAFFIC_LOG_VERSION	1
+
+// Every datagram the server's had, by the tick it was handed to the rooms
+// at, so a match can be run again exactly as it went (see TrafficReplay)
+//  - Each is the tick, who it came from, and its bytes, written as they're
+//    routed (with the file's own buffering, so it's only now and then that
+//    a tick waits on the disk)
+class TrafficRecorder
+{
+public:
+	bool Open(const std::string& path, double tickRate);
+	bool IsOpen() { return file.is_open(); }
+	void Close() { file.close(); }
+
+	void Record(unsigned int tick, const ReceivedDatagram& datagram);
+	unsigned long long GetCount() { return count; }
+
+private:
+	std::ofstream file;
+	unsigned long long count = 0;
+};
+
+// A recorded log, read in whole up front, and handed back a tick at a time
+// from pooled packets, as if they'd just been received
+//  - Since they go in on the same ticks, not at the same times, the rooms
+//    do exactly what they did however fast it's run
+class TrafficReplay
+{
+public:
+	// False if it can't be read, or isn't a log
+	bool Open(const std::string& path);
+
+	double GetTickRate() { return tickRate; }
+	unsigned int GetLastTick() { return lastTick; }
+	unsigned long long GetCount() { return count; }
+	bool IsFinished() { return offset >= data.size(); }
+
+	// Everything recorded up to the tick, replacing what's in batch
+	// (with any there's no packet free for dropped, and counted)
+	void Take(unsigned int tick, NetworkPacketPool& pool, std::vector<ReceivedDatagram>& batch);
+	unsigned long long GetDropped() { return dropped; }
+
+private:
+	struct RecordHeader
+	{
+		unsigned int Tick;
+		unsigned int Address;
+		unsigned short Port;
+		unsigned short Size;
+	};
+
+	std::vector<char> data;
+	size_t offset = 0;
+	double tickRate = 0;
+	unsigned int lastTick = 0;
+	unsigned long long count = 0;
+	unsigned long long dropped = 0;
+
+	bool ReadHeader(size_t at, RecordHeader& header);
+};
@@ -0,0 +1,298 @@
+#include "Bot.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+// Where it starts, and how high up it's safe to spawn
+#define BOT_SPAWN_RANGE 40.0f
+#define BOT_SPAWN_HEIGHT 5.0f
+
+// What it fires (the same as the game's)
+#define BOT_PROJECTILE_SPEED 35.0f
+#define BOT_PROJECTILE_LIFT 2.0f
+#define BOT_PROJECTILE_GRAVITY -4.9f
+#define BOT_PROJECTILE_LIFESPAN 5.0f
+
+Bot::Bot(NetworkPacketPool& pool, const BotScript& script, unsigned int seed)
+	: pool(pool), script(script)
+{
+	connecting = false;
+	connected = false;
+	failed = false;
+	connectTime = 0;
+	playerID = 0;
+	snapshotTicks = 1;
+	shotSequence = 0;
+
+	random = seed * 2654435761u + 1;
+	movement.Position = XMFLOAT3((NextRandom() * 2 - 1) * BOT_SPAWN_RANGE, BOT_SPAWN_HEIGHT, (NextRandom() * 2 - 1) * BOT_SPAWN_RANGE);
+	movement.Velocity = XMFLOAT3(0, 0, 0);
+	pitch = 0;
+	yaw = NextRandom() * XM_2PI;
+	turnDirection = NextRandom() < 0.5f ? -1.0f : 1.0f;
+	nextTurnFlip = nextJump = nextFire = 0;
+
+	inputSequence = 0;
+	for (PlayerInputFrame& input : inputHistory)
+		input.Sequence = 0;
+	hasInputAck = false;
+	lastInputAck = 0;
+
+	for (WorldSnapshot& snapshot : receivedSnapshots)
+		snapshot.Valid = false;
+	receivedUpdate = false;
+	lastSnapshotTick = 0;
+
+	stats = {};
+
+	connection.SetSender([this](const char* data, int size) { socket.Send(data, size); });
+}
+
+Bot::~Bot()
+{
+	Disconnect();
+}
+
+// --------------------------------------------------------
+// Asks to be let in, from where it's starting, the same way
+// the game does
+// --------------------------------------------------------
+bool Bot::Connect(const sockaddr_in& server, double now)
+{
+	if (!socket.IsOpen() || socket.Connect(server) != SocketResult::Success)
+	{
+		failed = true;
+		return false;
+	}
+
+	connecting = true;
+	connectTime = now;
+	// Spread out, so they don't all turn, jump and fire together
+	nextTurnFlip = now + NextRandom() * script.TurnFlipSeconds;
+	nextJump = now + NextRandom() * script.JumpSeconds;
+	nextFire = now + NextRandom() * script.FireSeconds;
+
+	NetConnectRequest request = { { movement.Position, movement.Velocity, XMFLOAT3(pitch, yaw, 0) } };
+	NetworkMessageWriter message = NetWriteMessage(sendBuffer, sizeof(sendBuffer), request);
+
+	connection.Send(message, NETWORK_CHANNEL_ORDERED);
+	connection.Flush(now);
+	return true;
+}
+
+void Bot::Disconnect()
+{
+	if (!connected) return;
+
+	NetDisconnect disconnect = { playerID };
+	NetworkMessageWriter message = NetWriteMessage(sendBuffer, sizeof(sendBuffer), disconnect);
+	connection.Send(message, NETWORK_CHANNEL_ORDERED);
+	for (int i = 0; i < BOT_DISCONNECT_SENDS; i++)
+		connection.Flush(NetworkNow(), true);
+	connected = false;
+}
+
+void Bot::Update(double now, float dt)
+{
+	if (failed) return;
+
+	Receive();
+	if (connecting && now - connectTime > BOT_CONNECT_TIMEOUT)
+	{
+		connecting = false;
+		failed = true;
+		return;
+	}
+
+	if (connected)
+	{
+		SendInput(now, dt);
+		if (script.FireSeconds > 0 && now >= nextFire)
+		{
+			Fire(now);
+			nextFire = now + script.FireSeconds;
+		}
+	}
+
+	connection.Flush(now);
+	connection.GetStats().Update(now);
+}
+
+// Everything that's arrived, straight into pooled packets (or
+// thrown away, if every one's in use)
+void Bot::Receive()
+{
+	for (;;)
+	{
+		NetworkPacketRef packet = pool.Acquire();
+		int dropped = 0;
+		SocketResult result = packet ?
+			socket.RecvFrom(packet->Data, NETWORK_MAX_PACKET_SIZE, packet->Size) :
+			socket.RecvFrom(droppedPacket, NETWORK_MAX_PACKET_SIZE, dropped);
+		if (result == SocketResult::Discarded) continue;
+		if (result != SocketResult::Success) return;
+		if (!packet) continue;
+
+		packet->ReceivedTime = NetworkNow();
+		connection.Receive(std::move(packet), [this](const NetworkMessageView& message) { HandleMessage(message); });
+	}
+}
+
+void Bot::HandleMessage(const NetworkMessageView& message)
+{
+	switch (message.GetType())
+	{
+	case NETWORK_MSG_CONNECT:
+	{
+		NetConnectAccepted accepted;
+		if (!NetReadMessage(message, accepted)) break;
+		unsigned int tickRate = accepted.TickRate > 0 ? accepted.TickRate : NET_SERVER_TICK_RATE;
+
+		// The same as the server works out how often it sends them
+		snapshotTicks = (unsigned int)fmax(1.0, floor(tickRate / (double)NET_SNAPSHOT_RATE + 0.5));
+		if (connecting)
+			stats.ConnectSeconds = message.GetReceivedTime() - connectTime;
+		playerID = accepted.PlayerID;
+		connecting = false;
+		connected = true;
+	}
+	break;
+	case NETWORK_MSG_UPDATE:
+		if (connected)
+			HandleSnapshot(message);
+		break;
+	}
+}
+
+// --------------------------------------------------------
+// Reads a snapshot like the game does (so it can be the
+// baseline for the next), counting any skipped over, and
+// timing the newest input it says we've been moved by
+// --------------------------------------------------------
+void Bot::HandleSnapshot(const NetworkMessageView& message)
+{
+	BitReader stream = message.GetBitReader();
+	NetSnapshotHeader header;
+	NetMessage<NetSnapshotHeader>::Serialize(stream, header);
+	if (stream.IsOverflowed()) return;
+	unsigned int tick = header.Tick;
+	if (receivedUpdate && !NetworkSequenceNewer(tick, lastSnapshotTick))
+	{
+		stats.SnapshotsLate++;
+		return;
+	}
+
+	const WorldSnapshot* baseline = nullptr;
+	if (header.HasBaseline)
+	{
+		unsigned int baselineTick = tick - header.BaselineAge;
+		baseline = &receivedSnapshots[baselineTick % NET_SNAPSHOT_HISTORY];
+		if (!baseline->Valid || baseline->Tick != baselineTick) return;
+	}
+
+	WorldSnapshot& snapshot = receivedSnapshots[tick % NET_SNAPSHOT_HISTORY];
+	snapshot.Valid = false;
+	snapshot.Tick = tick;
+	if (!NetSerializeSnapshot(stream, snapshot, baseline) || stream.IsOverflowed()) return;
+	snapshot.Valid = true;
+
+	if (receivedUpdate)
+	{
+		unsigned int step = (tick - lastSnapshotTick + snapshotTicks / 2) / snapshotTicks;
+		if (step > 1)
+			stats.SnapshotsMissed += step - 1;
+	}
+	stats.Snapshots++;
+	receivedUpdate = true;
+	lastSnapshotTick = tick;
+
+	// Only while it's still kept, so it's that input's send time
+	unsigned int inputAck = header.InputAck;
+	if (header.HasInputAck && (!hasInputAck || NetworkSequenceNewer(inputAck, lastInputAck)))
+	{
+		const PlayerInputFrame& input = inputHistory[inputAck % BOT_INPUT_HISTORY];
+		if (input.Sequence == inputAck)
+		{
+			double response = message.GetReceivedTime() - inputSentTime[inputAck % BOT_INPUT_HISTORY];
+			stats.Responses++;
+			stats.ResponseSeconds += response;
+			if (response > stats.MaxResponseSeconds)
+				stats.MaxResponseSeconds = response;
+		}
+		hasInputAck = true;
+		lastInputAck = inputAck;
+	}
+}
+
+// --------------------------------------------------------
+// This tick's controls from the script, moved by, and sent
+// with the few before (like the game's update)
+// --------------------------------------------------------
+void Bot::SendInput(double now, float dt)
+{
+	if (now >= nextTurnFlip)
+	{
+		turnDirection = -turnDirection;
+		nextTurnFlip = now + script.TurnFlipSeconds * (0.5f + NextRandom());
+	}
+	yaw = XMScalarModAngle(yaw + turnDirection * script.TurnRate * dt);
+
+	PlayerInputFrame& input = inputHistory[++inputSequence % BOT_INPUT_HISTORY];
+	input.Sequence = inputSequence;
+	input.Controls = {};
+	input.Controls.Forward = true;
+	if (now >= nextJump)
+	{
+		input.Controls.Jump = true;
+		nextJump = now + script.JumpSeconds * (0.5f + NextRandom());
+	}
+	input.PitchYawRoll = XMFLOAT3(pitch, yaw, 0);
+	input.Dt = dt;
+	NetQuantize(input);
+	SimulatePlayerMovement(movement, &input.Controls, input.PitchYawRoll, input.Dt);
+	inputSentTime[inputSequence % BOT_INPUT_HISTORY] = now;
+
+	NetPlayerUpdate update;
+	update.PlayerID = playerID;
+	update.HasSnapshotAck = receivedUpdate;
+	update.SnapshotAck = lastSnapshotTick;
+	update.InputCount = inputSequence < NET_INPUT_REDUNDANCY ? inputSequence : NET_INPUT_REDUNDANCY;
+	update.FirstInput = inputSequence - update.InputCount + 1;
+	for (unsigned int i = 0; i < update.InputCount; i++)
+		update.Inputs[i] = inputHistory[(update.FirstInput + i) % BOT_INPUT_HISTORY];
+	NetworkMessageWriter message = NetWriteMessage(sendBuffer, sizeof(sendBuffer), update);
+
+	connection.Send(message, NETWORK_CHANNEL_UNRELIABLE);
+	stats.InputsSent++;
+}
+
+// A projectile from where it is, the way it's facing (the server gives it a slot)
+void Bot::Fire(double now)
+{
+	NetNewProjectile newProjectile;
+	ProjectileNetState& state = newProjectile.State;
+	state.Position = movement.Position;
+	state.Velocity = XMFLOAT3(0, BOT_PROJECTILE_LIFT, BOT_PROJECTILE_SPEED);
+	state.PitchYawRoll = XMFLOAT3(pitch, yaw, 0);
+	state.Gravity = BOT_PROJECTILE_GRAVITY;
+	state.Lifespan = BOT_PROJECTILE_LIFESPAN;
+	state.Age = 0;
+	state.Owner = NetPlayerSlot(playerID);
+	state.Shot = shotSequence++ & NET_SHOT_MASK;
+
+	NetworkMessageWriter message = NetWriteMessage(sendBuffer, sizeof(sendBuffer), newProjectile);
+
+	connection.Send(message, NETWORK_CHANNEL_RELIABLE);
+	stats.Fired++;
+}
+
+// Between 0 and 1 (xorshift, so every bot's the same each run)
+float Bot::NextRandom()
+{
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	return (random & 0xFFFFFF) / (float)0x1000000;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../../../Network.h"
+#include "../../../NetworkConnection.h"
+#include "../../../NetworkProtocol.h"
+#include "../../../Movement.h"
+
+// How many inputs are kept to time the server's response to (like the
+// game's NETWORK_INPUT_HISTORY)
+#define BOT_INPUT_HISTORY 128
+
+// How long a bot waits to be let in, and how many times it says it's leaving
+#define BOT_CONNECT_TIMEOUT 5.0
+#define BOT_DISCONNECT_SENDS 3
+
+// How it moves and fires
+//  - It runs forward, turning at its own rate, and now and then
+//    turns the other way, or jumps
+//  - Fires every so often (-fire per second), from where it is
+//    and the way it's facing
+struct BotScript
+{
+	float TurnRate;			// Radians a second
+	float TurnFlipSeconds;
+	float JumpSeconds;
+	float FireSeconds;		// 0 never fires
+};
+
+// What it's measured, since it connected
+struct BotStats
+{
+	unsigned long long Snapshots;		// Received and read
+	unsigned long long SnapshotsMissed;	// Skipped over, by their ticks
+	unsigned long long SnapshotsLate;	// Older than the newest, so thrown away
+	unsigned long long InputsSent;
+	unsigned long long Responses;		// Snapshots acknowledging a newer input
+	double ResponseSeconds;				// From the input going to that snapshot arriving, summed
+	double MaxResponseSeconds;
+	unsigned long long Fired;
+	double ConnectSeconds;				// From asking to being let in
+};
+
+// One simulated client, speaking the same protocol as the game's
+// NetworkManager with the same shared pieces (NetworkConnection,
+// NetworkState, PlayerMovement), but no rendering or entities
+//  - Everything it does happens in Update(), on whichever thread
+//    runs every bot (its socket is non-blocking, and just drained)
+class Bot
+{
+public:
+	Bot(NetworkPacketPool& pool, const BotScript& script, unsigned int seed);
+	~Bot();
+
+	bool Connect(const sockaddr_in& server, double now);
+	void Disconnect();
+
+	// Reads what's arrived, then sends this tick's input (and
+	// maybe a projectile)
+	void Update(double now, float dt);
+
+	bool IsConnected() { return connected; }
+	bool IsWaiting() { return connecting; }
+	bool HasFailed() { return failed; }
+
+	const BotStats& GetStats() { return stats; }
+	NetworkConnectionStats& GetConnectionStats() { return connection.GetStats(); }
+
+private:
+	NetworkPacketPool& pool;
+	UDPSocket socket;
+	NetworkConnection connection;
+	BotScript script;
+	char sendBuffer[NETWORK_MAX_MESSAGE_SIZE];
+	char droppedPacket[NETWORK_MAX_PACKET_SIZE + 1];
+
+	bool connecting;
+	bool connected;
+	bool failed;
+	double connectTime;
+	unsigned int playerID;
+	unsigned int snapshotTicks;	// Between snapshots, from the tick rate it says
+
+	// Where it thinks it is, moved by the same code the server uses
+	PlayerMovementState movement;
+	float pitch, yaw;
+	float turnDirection;
+	double nextTurnFlip, nextJump, nextFire;
+	unsigned int shotSequence;
+	unsigned int random;
+
+	unsigned int inputSequence;
+	PlayerInputFrame inputHistory[BOT_INPUT_HISTORY];
+	double inputSentTime[BOT_INPUT_HISTORY];
+	bool hasInputAck;
+	unsigned int lastInputAck;
+
+	// The snapshots it's read, which the server sends deltas against
+	WorldSnapshot receivedSnapshots[NET_SNAPSHOT_HISTORY];
+	bool receivedUpdate;
+	unsigned int lastSnapshotTick;
+
+	BotStats stats;
+
+	void Receive();
+	void HandleMessage(const NetworkMessageView& message);
+	void HandleSnapshot(const NetworkMessageView& message);
+	void SendInput(double now, float dt);
+	void Fire(double now);
+	float NextRandom();
+};
@@ -0,0 +1,215 @@
+// Headless load test for the GameServer: as many simulated clients as
+// it's told, each moving and firing from a script, all measured, and
+// printed every so often (and at the end) like the server's own stats
+//  - LoadTestBot [-ip A] [-port N] [-bots N] [-seconds S] [-rate HZ]
+//                [-fire PER_SECOND] [-ramp S] [-csv FILE]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include "Bot.h"
+#include "../../../NetworkPacketPool.h"
+#include "../../../NetworkStats.h"
+
+// How often everything's printed, which is how often the server prints its own
+#define BOT_REPORT_SECONDS 10
+
+// Enough for every bot's ordered messages that come early, and a few each
+#define BOT_PACKETS_PER_BOT 8
+
+struct LoadTestOptions
+{
+	std::string IP = "127.0.0.1";
+	int Port = 8888;
+	unsigned int Bots = 16;
+	double Seconds = 60;
+	double Rate = 60;		// Inputs a second, like the game's frame rate
+	double Fire = 0.5;		// Projectiles a second, each
+	double Ramp = 5;		// Seconds over which they all connect
+	std::string Csv;
+};
+
+// Everyone's numbers put together, over one report's time
+struct LoadTestTotals
+{
+	unsigned int Connected, Waiting, Failed;
+	BotStats Stats;
+	double Rtt, LossIn, LossOut;	// Means of each connected bot's
+};
+
+LoadTestTotals Total(std::vector<Bot*>& bots)
+{
+	LoadTestTotals totals = {};
+	for (Bot* bot : bots)
+	{
+		if (bot->HasFailed()) { totals.Failed++; continue; }
+		if (bot->IsWaiting()) { totals.Waiting++; continue; }
+		if (!bot->IsConnected()) continue;
+
+		totals.Connected++;
+		const BotStats& stats = bot->GetStats();
+		totals.Stats.Snapshots += stats.Snapshots;
+		totals.Stats.SnapshotsMissed += stats.SnapshotsMissed;
+		totals.Stats.SnapshotsLate += stats.SnapshotsLate;
+		totals.Stats.InputsSent += stats.InputsSent;
+		totals.Stats.Responses += stats.Responses;
+		totals.Stats.ResponseSeconds += stats.ResponseSeconds;
+		if (stats.MaxResponseSeconds > totals.Stats.MaxResponseSeconds)
+			totals.Stats.MaxResponseSeconds = stats.MaxResponseSeconds;
+		totals.Stats.Fired += stats.Fired;
+		totals.Stats.ConnectSeconds += stats.ConnectSeconds;
+
+		NetworkConnectionStats& connection = bot->GetConnectionStats();
+		totals.Rtt += connection.Get(NETWORK_STAT_RTT);
+		totals.LossIn += connection.Get(NETWORK_STAT_LOSS_IN);
+		totals.LossOut += connection.Get(NETWORK_STAT_LOSS_OUT);
+	}
+	if (totals.Connected > 0)
+	{
+		totals.Rtt /= totals.Connected;
+		totals.LossIn /= totals.Connected;
+		totals.LossOut /= totals.Connected;
+	}
+	return totals;
+}
+
+// --------------------------------------------------------
+// One line of what's changed since the last, and the same
+// as a row of the CSV (if there is one)
+//  - Response is from an input being sent to the snapshot
+//    that says it's been moved by arriving, so it's the
+//    round trip plus the wait for the server's tick and its
+//    next snapshot
+// --------------------------------------------------------
+void Report(double elapsed, double seconds, const LoadTestTotals& now, const LoadTestTotals& last, std::ofstream& csv)
+{
+	unsigned long long snapshots = now.Stats.Snapshots - last.Stats.Snapshots;
+	unsigned long long missed = now.Stats.SnapshotsMissed - last.Stats.SnapshotsMissed;
+	unsigned long long responses = now.Stats.Responses - last.Stats.Responses;
+	double responseMs = responses > 0 ? (now.Stats.ResponseSeconds - last.Stats.ResponseSeconds) * 1000.0 / responses : 0.0;
+	double snapshotRate = now.Connected > 0 && seconds > 0 ? snapshots / seconds / now.Connected : 0.0;
+	double missedPercent = snapshots + missed > 0 ? missed * 100.0 / (snapshots + missed) : 0.0;
+
+	printf("Bots: %u connected, %u waiting, %u failed | snapshots %.1f/s each, %.2f%% missed, %llu late | response %.1fms avg %.1fms max | rtt %.1fms | loss in %.1f%% out %.1f%%\n",
+		now.Connected, now.Waiting, now.Failed, snapshotRate, missedPercent, now.Stats.SnapshotsLate - last.Stats.SnapshotsLate,
+		responseMs, now.Stats.MaxResponseSeconds * 1000.0, now.Rtt, now.LossIn, now.LossOut);
+
+	if (csv.is_open())
+	{
+		char row[256];
+		snprintf(row, sizeof(row), "%.1f,%u,%u,%u,%.2f,%.3f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+			elapsed, now.Connected, now.Waiting, now.Failed, snapshotRate, missedPercent,
+			responseMs, now.Stats.MaxResponseSeconds * 1000.0, now.Rtt, now.LossIn, now.LossOut);
+		csv << row << std::flush;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	LoadTestOptions options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string option = argv[i];
+		if (option == "-ip")
+			options.IP = argv[i + 1];
+		else if (option == "-port")
+			options.Port = atoi(argv[i + 1]);
+		else if (option == "-bots" && atoi(argv[i + 1]) > 0)
+			options.Bots = (unsigned int)atoi(argv[i + 1]);
+		else if (option == "-seconds" && atof(argv[i + 1]) > 0)
+			options.Seconds = atof(argv[i + 1]);
+		else if (option == "-rate" && atof(argv[i + 1]) > 0)
+			options.Rate = atof(argv[i + 1]);
+		else if (option == "-fire" && atof(argv[i + 1]) >= 0)
+			options.Fire = atof(argv[i + 1]);
+		else if (option == "-ramp" && atof(argv[i + 1]) >= 0)
+			options.Ramp = atof(argv[i + 1]);
+		else if (option == "-csv")
+			options.Csv = argv[i + 1];
+	}
+
+	WSASession session;
+	sockaddr_in server;
+	if (!UDPSocket::Resolve(options.IP, (unsigned short)options.Port, server))
+	{
+		std::cout << "Couldn't resolve " << options.IP << ".\n";
+		return 1;
+	}
+
+	std::ofstream csv;
+	if (!options.Csv.empty())
+	{
+		csv.open(options.Csv);
+		if (csv.is_open())
+			csv << "seconds,connected,waiting,failed,snapshots_per_second,missed_percent,response_ms,response_max_ms,rtt_ms,loss_in_percent,loss_out_percent\n";
+	}
+
+	// Each with its own script, a little different from the rest
+	NetworkPacketPool pool(options.Bots * BOT_PACKETS_PER_BOT);
+	std::vector<Bot*> bots;
+	for (unsigned int i = 0; i < options.Bots; i++)
+	{
+		BotScript script;
+		script.TurnRate = 0.5f + (i % 7) * 0.25f;
+		script.TurnFlipSeconds = 3.0f + (i % 5);
+		script.JumpSeconds = 2.0f + (i % 3);
+		script.FireSeconds = options.Fire > 0 ? (float)(1.0 / options.Fire) : 0.0f;
+		bots.push_back(new Bot(pool, script, i + 1));
+	}
+
+	std::cout << "Load testing " << options.IP << ":" << options.Port << " with " << options.Bots
+		<< " bots at " << options.Rate << " Hz for " << options.Seconds << " seconds\n";
+
+	// Every bot's updated each tick, on this thread, with them connecting
+	// a few at a time over the ramp
+	double start = NetworkNow();
+	double lastReport = start;
+	LoadTestTotals lastTotals = {};
+	unsigned int nextToConnect = 0;
+	auto tickLength = std::chrono::duration<double>(1.0 / options.Rate);
+	auto nextTick = std::chrono::steady_clock::now();
+	float dt = (float)(1.0 / options.Rate);
+
+	for (;;)
+	{
+		double now = NetworkNow();
+		double elapsed = now - start;
+		if (elapsed >= options.Seconds) break;
+
+		while (nextToConnect < bots.size() &&
+			(options.Ramp <= 0 || elapsed >= options.Ramp * nextToConnect / bots.size()))
+			bots[nextToConnect++]->Connect(server, now);
+
+		for (Bot* bot : bots)
+			bot->Update(now, dt);
+
+		if (now - lastReport >= BOT_REPORT_SECONDS)
+		{
+			LoadTestTotals totals = Total(bots);
+			Report(elapsed, now - lastReport, totals, lastTotals, csv);
+			lastTotals = totals;
+			lastReport = now;
+		}
+
+		nextTick += std::chrono::duration_cast<std::chrono::steady_clock::duration>(tickLength);
+		std::this_thread::sleep_until(nextTick);
+	}
+
+	// And what's left since the last report, then everyone leaves
+	double now = NetworkNow();
+	LoadTestTotals totals = Total(bots);
+	Report(now - start, now - lastReport, totals, lastTotals, csv);
+	double connectMs = totals.Connected > 0 ? totals.Stats.ConnectSeconds * 1000.0 / totals.Connected : 0.0;
+	double responseMs = totals.Stats.Responses > 0 ? totals.Stats.ResponseSeconds * 1000.0 / totals.Stats.Responses : 0.0;
+	printf("Overall: %llu snapshots, %llu missed, %llu inputs, %llu fired | connect %.1fms avg | response %.1fms avg %.1fms max\n",
+		totals.Stats.Snapshots, totals.Stats.SnapshotsMissed, totals.Stats.InputsSent, totals.Stats.Fired,
+		connectMs, responseMs, totals.Stats.MaxResponseSeconds * 1000.0);
+
+	for (Bot* bot : bots)
+		delete bot;
+	return 0;
+}
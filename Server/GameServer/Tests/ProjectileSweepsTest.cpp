@@ -0,0 +1,167 @@
+// Brute force test for ProjectileSweeps::TestCapsule(): random sweeps
+// around a player's capsule, each hit or missed the same as the closest
+// of many points along it (to the capsule's segment) says it should be
+//  - ProjectileSweepsTest [-cases N] [-seed N]
+//  - Stationary sweeps (no movement over the tick), ones parallel to
+//    the capsule, tiny ones and fast ones are mixed in with the rest,
+//    and they're tested in groups of 1 to 9, so every lane of the last
+//    four (and the unused ones) gets used
+//  - Sampling can be off by a little, so a sweep that passes within
+//    SWEEP_LENIENCE of the radius isn't counted either way
+//  - Returns nonzero (having said which) if any hit or miss disagrees
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "../GameServer/ProjectileSweeps.h"
+
+using namespace DirectX;
+
+// Points checked along each sweep
+#define SWEEP_SAMPLES 4000
+
+// How close to the radius is too close to call
+#define SWEEP_LENIENCE 2e-3f
+
+// The most sweeps tested against the capsule at once
+#define SWEEP_GROUP 9
+
+static unsigned int seed = 1;
+static float NextRandom()
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) / 16777216.0f;
+}
+static float NextRandom(float low, float high)
+{
+	return low + (high - low) * NextRandom();
+}
+
+// Point to segment, exactly
+static float DistanceToSegment(const XMFLOAT3& p, const XMFLOAT3& a, const XMFLOAT3& b)
+{
+	float abX = b.x - a.x, abY = b.y - a.y, abZ = b.z - a.z;
+	float lengthSq = abX * abX + abY * abY + abZ * abZ;
+	float t = lengthSq > 0 ? ((p.x - a.x) * abX + (p.y - a.y) * abY + (p.z - a.z) * abZ) / lengthSq : 0;
+	t = t < 0 ? 0 : (t > 1 ? 1 : t);
+	float dX = p.x - (a.x + abX * t), dY = p.y - (a.y + abY * t), dZ = p.z - (a.z + abZ * t);
+	return sqrtf(dX * dX + dY * dY + dZ * dZ);
+}
+
+// The closest any sampled point of the sweep comes to the segment
+static float SampledDistance(const XMFLOAT3& start, const XMFLOAT3& end, const XMFLOAT3& bottom, const XMFLOAT3& top)
+{
+	float closest = 1e30f;
+	for (int i = 0; i <= SWEEP_SAMPLES; i++)
+	{
+		float s = (float)i / SWEEP_SAMPLES;
+		XMFLOAT3 p(start.x + (end.x - start.x) * s, start.y + (end.y - start.y) * s, start.z + (end.z - start.z) * s);
+		float distance = DistanceToSegment(p, bottom, top);
+		closest = distance < closest ? distance : closest;
+	}
+	return closest;
+}
+
+enum class SweepKind { Random, Stationary, Parallel, Tiny, Fast, Count };
+static const char* kindNames[(int)SweepKind::Count] = { "random", "stationary", "parallel", "tiny", "fast" };
+
+// Somewhere around the capsule (close enough that plenty hit), moving however the kind says
+static void MakeSweep(SweepKind kind, const XMFLOAT3& center, XMFLOAT3& start, XMFLOAT3& end)
+{
+	start = XMFLOAT3(center.x + NextRandom(-1.5f, 1.5f), center.y + NextRandom(-1.5f, 1.5f), center.z + NextRandom(-1.5f, 1.5f));
+	XMFLOAT3 delta;
+	switch (kind)
+	{
+	case SweepKind::Stationary: delta = XMFLOAT3(0, 0, 0); break;
+	case SweepKind::Parallel: delta = XMFLOAT3(0, NextRandom(-3, 3), 0); break;
+	case SweepKind::Tiny: delta = XMFLOAT3(NextRandom(-1e-4f, 1e-4f), NextRandom(-1e-4f, 1e-4f), NextRandom(-1e-4f, 1e-4f)); break;
+	case SweepKind::Fast:
+		// Right across, from well to one side to well past the other
+		delta = XMFLOAT3(NextRandom(-1, 1), NextRandom(-0.2f, 0.2f), NextRandom(-1, 1));
+		start = XMFLOAT3(start.x - delta.x * 20, start.y - delta.y * 20, start.z - delta.z * 20);
+		delta = XMFLOAT3(delta.x * 40, delta.y * 40, delta.z * 40);
+		break;
+	default: delta = XMFLOAT3(NextRandom(-3, 3), NextRandom(-3, 3), NextRandom(-3, 3)); break;
+	}
+	end = XMFLOAT3(start.x + delta.x, start.y + delta.y, start.z + delta.z);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int cases = 3000;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "-cases") cases = (unsigned int)atoi(argv[i + 1]);
+		else if (arg == "-seed") seed = (unsigned int)atoi(argv[i + 1]);
+	}
+
+	float radius = PLAYER_HIT_RADIUS + PROJECTILE_HIT_RADIUS;
+	unsigned int tested[(int)SweepKind::Count] = {};
+	unsigned int hit[(int)SweepKind::Count] = {};
+	unsigned int tooClose = 0, mismatches = 0;
+
+	ProjectileSweeps sweeps;
+	std::vector<XMFLOAT3> starts, ends;
+	std::vector<SweepKind> kinds;
+	unsigned int indices[SWEEP_GROUP];
+	unsigned int hits[SWEEP_GROUP];
+	for (unsigned int done = 0; done < cases;)
+	{
+		// A player somewhere, and a group of sweeps around them
+		XMFLOAT3 position(NextRandom(-50, 50), NextRandom(0, 10), NextRandom(-50, 50));
+		XMFLOAT3 bottom(position.x, position.y + PLAYER_HIT_BOTTOM, position.z);
+		XMFLOAT3 top(position.x, position.y + PLAYER_HIT_TOP, position.z);
+		XMFLOAT3 center(position.x, position.y + (PLAYER_HIT_BOTTOM + PLAYER_HIT_TOP) * 0.5f, position.z);
+
+		unsigned int count = 1 + (unsigned int)(NextRandom() * SWEEP_GROUP) % SWEEP_GROUP;
+		count = count < cases - done ? count : cases - done;
+		sweeps.Clear();
+		starts.resize(count);
+		ends.resize(count);
+		kinds.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			kinds[i] = (SweepKind)((done + i) % (int)SweepKind::Count);
+			MakeSweep(kinds[i], center, starts[i], ends[i]);
+			sweeps.Add(1000 + i, starts[i], ends[i]);
+
+			// Backwards, so the indices aren't just in order
+			indices[count - 1 - i] = i;
+		}
+
+		unsigned int hitCount = sweeps.TestCapsule(indices, count, bottom, top, hits);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			bool reported = false;
+			for (unsigned int h = 0; h < hitCount; h++)
+				reported |= hits[h] == 1000 + i;
+
+			float distance = SampledDistance(starts[i], ends[i], bottom, top);
+			tested[(int)kinds[i]]++;
+			if (fabsf(distance - radius) < SWEEP_LENIENCE)
+			{
+				tooClose++;
+				continue;
+			}
+
+			bool expected = distance < radius;
+			hit[(int)kinds[i]] += expected;
+			if (reported != expected)
+			{
+				printf("FAIL: a %s sweep from (%.4f, %.4f, %.4f) to (%.4f, %.4f, %.4f) passes %.4f from the capsule, but was %s\n",
+					kindNames[(int)kinds[i]], starts[i].x, starts[i].y, starts[i].z, ends[i].x, ends[i].y, ends[i].z,
+					distance, reported ? "hit" : "missed");
+				mismatches++;
+			}
+		}
+		done += count;
+	}
+
+	for (int k = 0; k < (int)SweepKind::Count; k++)
+		printf("%-10s %5u tested, %5u hit\n", kindNames[k], tested[k], hit[k]);
+	printf("%s: %u mismatches over %u sweeps (%u too close to call)\n", mismatches ? "FAIL" : "PASS", mismatches, cases, tooClose);
+	return mismatches ? 1 : 0;
+}
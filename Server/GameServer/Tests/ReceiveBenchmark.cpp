@@ -0,0 +1,180 @@
+// Receive benchmark for the ReceiveEngine: senders flood it over
+// 127.0.0.1 for a while, the main thread takes everything like the
+// game loop would (only without the tick in between), and what got
+// through, and what it cost the workers, is printed per worker count
+//  - ReceiveBenchmark [-workers N (or each of 1 to RECEIVE_MAX_WORKERS)]
+//                     [-senders N] [-seconds S] [-size BYTES]
+//  - The same on either side, so it's run on Windows (the completion
+//    port) and Linux (recvmmsg()) to compare the two
+//  - Lost is what the kernel threw away before the engine saw it (a
+//    full socket buffer), dropped is what the engine had nowhere for
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include "../GameServer/ReceiveEngine.h"
+#include "../../../NetworkStats.h"
+
+// Like the server's
+#define BENCHMARK_POOL_SIZE 4096
+
+struct BenchmarkOptions
+{
+	unsigned int Workers = 0;	// 0 for each of 1 to RECEIVE_MAX_WORKERS in turn
+	unsigned int Senders = 4;
+	double Seconds = 3;
+	int Size = 200;				// Around a snapshot's worth
+};
+
+struct BenchmarkResult
+{
+	unsigned long long Sent;
+	unsigned long long Taken;
+	double Seconds;
+	ReceiveEngineStats Stats;
+};
+
+// --------------------------------------------------------
+// Each sender has a socket of its own (so, on Linux, they're
+// spread across the workers' sockets by who they're from) and
+// sends in batches, as fast as it can, until it's told not to
+// --------------------------------------------------------
+static void Send(const sockaddr_in& server, int size, std::atomic<bool>& running, std::atomic<unsigned long long>& sent)
+{
+	UDPSocket socket;
+	if (socket.Connect(server) != SocketResult::Success)
+	{
+		printf("A sender couldn't connect (error %d)\n", socket.GetLastError());
+		return;
+	}
+
+	std::vector<char> data(size, 'x');
+	unsigned long long count = 0;
+	while (running)
+	{
+		for (int i = 0; i < NETWORK_SEND_BATCH; i++)
+		{
+			// Mostly a full send buffer, which is worth a moment's wait
+			if (socket.Send(data.data(), size) == SocketResult::Success)
+				count++;
+			else
+				std::this_thread::yield();
+		}
+	}
+	sent += count;
+}
+
+static bool Run(const BenchmarkOptions& options, unsigned int workerCount, BenchmarkResult& result)
+{
+	NetworkPacketPool pool(BENCHMARK_POOL_SIZE);
+	UDPSocket server;
+	if (server.Bind(0, true) != SocketResult::Success)
+	{
+		printf("Couldn't bind the server's socket (error %d)\n", server.GetLastError());
+		return false;
+	}
+
+	ReceiveEngine engine(server, pool);
+	if (!engine.Start(workerCount))
+	{
+		printf("The receive engine didn't start (error %d)\n", engine.GetLastError());
+		return false;
+	}
+
+	sockaddr_in serverAddress;
+	UDPSocket::Resolve("127.0.0.1", server.GetBoundPort(), serverAddress);
+
+	std::atomic<bool> running(true);
+	std::atomic<unsigned long long> sent(0);
+	std::vector<std::thread> senders;
+	for (unsigned int s = 0; s < options.Senders; s++)
+		senders.emplace_back(Send, std::cref(serverAddress), options.Size, std::ref(running), std::ref(sent));
+
+	// Taken as fast as it comes, and the packets given straight back
+	std::vector<ReceivedDatagram> batch;
+	unsigned long long taken = 0;
+	double start = NetworkNow();
+	while (NetworkNow() - start < options.Seconds)
+	{
+		engine.TakeReceived(batch);
+		if (batch.empty())
+			std::this_thread::yield();
+		taken += batch.size();
+		batch.clear();
+	}
+
+	running = false;
+	for (std::thread& sender : senders)
+		sender.join();
+
+	// Whatever's still on its way in
+	double drainStart = NetworkNow();
+	while (NetworkNow() - drainStart < 0.1)
+	{
+		engine.TakeReceived(batch);
+		taken += batch.size();
+		batch.clear();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	result.Sent = sent;
+	result.Taken = taken;
+	result.Seconds = NetworkNow() - start;
+	result.Stats = engine.GetStats();
+	engine.Stop();
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "-workers") options.Workers = (unsigned int)atoi(argv[i + 1]);
+		else if (arg == "-senders") options.Senders = (unsigned int)atoi(argv[i + 1]);
+		else if (arg == "-seconds") options.Seconds = atof(argv[i + 1]);
+		else if (arg == "-size") options.Size = atoi(argv[i + 1]);
+	}
+	if (options.Size < 1 || options.Size > NETWORK_MAX_PACKET_SIZE)
+	{
+		printf("-size is 1 to %d bytes\n", NETWORK_MAX_PACKET_SIZE);
+		return 1;
+	}
+
+	WSASession session;
+
+#ifdef _WIN32
+	const char* path = "completion port";
+#else
+	const char* path = "recvmmsg";
+#endif
+	printf("Receiving %d byte datagrams from %u senders for %.1fs each (%s)\n",
+		options.Size, options.Senders, options.Seconds, path);
+	printf("%8s %12s %12s %8s %8s %10s %12s %10s\n",
+		"Workers", "Sent", "Taken/s", "Lost", "Dropped", "Per batch", "CPU us/each", "CPU cores");
+
+	unsigned int first = options.Workers ? options.Workers : 1;
+	unsigned int last = options.Workers ? options.Workers : RECEIVE_MAX_WORKERS;
+	for (unsigned int workers = first; workers <= last; workers++)
+	{
+		BenchmarkResult result;
+		if (!Run(options, workers, result))
+			return 1;
+
+		const ReceiveEngineStats& stats = result.Stats;
+		unsigned long long seen = stats.Packets + stats.Dropped + stats.Discarded;
+		printf("%8u %12llu %12.0f %7.2f%% %7.2f%% %10.1f %12.3f %10.2f\n",
+			stats.Workers, result.Sent, result.Taken / result.Seconds,
+			result.Sent ? 100.0 * (result.Sent > seen ? result.Sent - seen : 0) / result.Sent : 0.0,
+			seen ? 100.0 * stats.Dropped / seen : 0.0,
+			stats.Batches ? (double)seen / stats.Batches : 0.0,
+			seen ? stats.CpuSeconds * 1000000.0 / seen : 0.0,
+			stats.CpuSeconds / result.Seconds);
+	}
+	return 0;
+}
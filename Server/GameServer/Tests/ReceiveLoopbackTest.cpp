@@ -0,0 +1,211 @@
+// Loopback test for the ReceiveEngine: a few clients each send numbered
+// datagrams to it over 127.0.0.1, and everything has to come out of
+// TakeReceived() exactly once, intact, and from who sent it
+//  - ReceiveLoopbackTest [-workers N] [-clients N] [-datagrams N (each)]
+//  - Sent a round at a time (across every client), and each round's all
+//    taken before the next, so nothing's lost to a full socket buffer
+//    (which is the kernel's doing, not the engine's, and the default's
+//    only a hundred or so of the biggest datagrams on Linux)
+//  - Returns nonzero (having said why) if anything's missing, doubled,
+//    damaged, dropped or from the wrong place
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "../GameServer/ReceiveEngine.h"
+#include "../../../NetworkStats.h"
+
+// How many are sent (between every client) before they're all taken
+#define LOOPBACK_ROUND 32
+
+// How long a round can take to come in before it's given up on
+#define LOOPBACK_TIMEOUT 2.0
+
+// What each datagram starts with, and the rest's filled with a
+// pattern from both, up to a size that varies with the sequence
+struct LoopbackHeader
+{
+	unsigned int Client;
+	unsigned int Sequence;
+};
+
+static int LoopbackSize(unsigned int sequence)
+{
+	return (int)(sizeof(LoopbackHeader) + (sequence * 37) % (NETWORK_MAX_PACKET_SIZE - sizeof(LoopbackHeader) + 1));
+}
+
+static char LoopbackByte(unsigned int client, unsigned int sequence, int offset)
+{
+	return (char)(client * 131 + sequence * 7 + offset);
+}
+
+static void FillDatagram(char* data, unsigned int client, unsigned int sequence)
+{
+	LoopbackHeader header = { client, sequence };
+	memcpy(data, &header, sizeof(header));
+	for (int i = sizeof(header); i < LoopbackSize(sequence); i++)
+		data[i] = LoopbackByte(client, sequence, i);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int workerCount = RECEIVE_MAX_WORKERS;
+	unsigned int clientCount = 8;
+	unsigned int datagramCount = 1000;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "-workers") workerCount = (unsigned int)atoi(argv[i + 1]);
+		else if (arg == "-clients") clientCount = (unsigned int)atoi(argv[i + 1]);
+		else if (arg == "-datagrams") datagramCount = (unsigned int)atoi(argv[i + 1]);
+	}
+
+	WSASession session;
+	NetworkPacketPool pool(4096);
+
+	// Bound shared, on whatever port's free, like the server binds its own
+	UDPSocket server;
+	if (server.Bind(0, true) != SocketResult::Success)
+	{
+		printf("FAIL: couldn't bind the server's socket (error %d)\n", server.GetLastError());
+		return 1;
+	}
+	unsigned short port = server.GetBoundPort();
+
+	ReceiveEngine engine(server, pool);
+	if (!engine.Start(workerCount))
+	{
+		printf("FAIL: the receive engine didn't start (error %d)\n", engine.GetLastError());
+		return 1;
+	}
+
+	sockaddr_in serverAddress;
+	UDPSocket::Resolve("127.0.0.1", port, serverAddress);
+
+	std::vector<UDPSocket> clients(clientCount);
+	std::vector<unsigned short> clientPorts(clientCount);
+	for (unsigned int c = 0; c < clientCount; c++)
+	{
+		if (clients[c].Bind(0) != SocketResult::Success)
+		{
+			printf("FAIL: couldn't bind client %u (error %d)\n", c, clients[c].GetLastError());
+			return 1;
+		}
+		clientPorts[c] = clients[c].GetBoundPort();
+	}
+
+	// How many times each client's datagrams have been seen
+	std::vector<std::vector<unsigned char>> seen(clientCount, std::vector<unsigned char>(datagramCount, 0));
+	unsigned long long sent = 0, received = 0;
+	unsigned int failures = 0;
+
+	std::vector<ReceivedDatagram> batch;
+	char data[NETWORK_MAX_PACKET_SIZE];
+
+	// Each client's next, in turn
+	unsigned int total = clientCount * datagramCount;
+	for (unsigned int first = 0; first < total && failures == 0; first += LOOPBACK_ROUND)
+	{
+		unsigned int last = first + LOOPBACK_ROUND < total ? first + LOOPBACK_ROUND : total;
+		for (unsigned int next = first; next < last; next++)
+		{
+			unsigned int c = next % clientCount, sequence = next / clientCount;
+			FillDatagram(data, c, sequence);
+			if (clients[c].SendTo(serverAddress, data, LoopbackSize(sequence)) == SocketResult::Success)
+				sent++;
+			else
+				printf("Client %u couldn't send %u (error %d)\n", c, sequence, clients[c].GetLastError());
+		}
+
+		double start = NetworkNow();
+		while (received < sent && NetworkNow() - start < LOOPBACK_TIMEOUT)
+		{
+			engine.TakeReceived(batch);
+			if (batch.empty())
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+
+			for (ReceivedDatagram& datagram : batch)
+			{
+				received++;
+				const NetworkPacket* packet = datagram.Packet.Get();
+				LoopbackHeader header;
+				if (packet->Size < (int)sizeof(header))
+				{
+					printf("FAIL: a datagram came in %d bytes long\n", packet->Size);
+					failures++;
+					continue;
+				}
+				memcpy(&header, packet->Data, sizeof(header));
+				if (header.Client >= clientCount || header.Sequence >= datagramCount)
+				{
+					printf("FAIL: a datagram came in from client %u, numbered %u\n", header.Client, header.Sequence);
+					failures++;
+					continue;
+				}
+
+				bool intact = packet->Size == LoopbackSize(header.Sequence);
+				for (int i = sizeof(header); i < packet->Size && intact; i++)
+					intact = packet->Data[i] == LoopbackByte(header.Client, header.Sequence, i);
+				if (!intact)
+				{
+					printf("FAIL: client %u's datagram %u came in damaged (%d bytes)\n", header.Client, header.Sequence, packet->Size);
+					failures++;
+				}
+				if (ntohs(datagram.From.sin_port) != clientPorts[header.Client])
+				{
+					printf("FAIL: client %u's datagram %u came in from port %u, not %u\n",
+						header.Client, header.Sequence, ntohs(datagram.From.sin_port), clientPorts[header.Client]);
+					failures++;
+				}
+				if (seen[header.Client][header.Sequence]++ == 1)
+				{
+					printf("FAIL: client %u's datagram %u came in twice\n", header.Client, header.Sequence);
+					failures++;
+				}
+			}
+		}
+		batch.clear();
+	}
+
+	ReceiveEngineStats stats = engine.GetStats();
+	engine.Stop();
+
+	for (unsigned int c = 0; c < clientCount; c++)
+	{
+		unsigned int missing = 0;
+		for (unsigned int sequence = 0; sequence < datagramCount; sequence++)
+			missing += seen[c][sequence] == 0;
+		if (missing > 0)
+		{
+			printf("FAIL: %u of client %u's datagrams never came in\n", missing, c);
+			failures++;
+		}
+	}
+	if (stats.Dropped > 0 || stats.Discarded > 0)
+	{
+		printf("FAIL: the engine dropped %llu and discarded %llu\n", stats.Dropped, stats.Discarded);
+		failures++;
+	}
+	if (stats.Packets != received)
+	{
+		printf("FAIL: the engine counted %llu, but %llu were taken\n", stats.Packets, received);
+		failures++;
+	}
+
+	// Stopping hands back whatever the posted receives were holding
+	if (pool.GetFreeCount() != pool.GetSize())
+	{
+		printf("FAIL: %u packets weren't given back to the pool\n", pool.GetSize() - pool.GetFreeCount());
+		failures++;
+	}
+
+	printf("%s: %llu of %llu datagrams from %u clients, across %u workers in %llu batches\n",
+		failures ? "FAIL" : "PASS", received, sent, clientCount, stats.Workers, stats.Batches);
+	return failures ? 1 : 0;
+}
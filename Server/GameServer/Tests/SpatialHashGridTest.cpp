@@ -0,0 +1,135 @@
+// Brute force test for SpatialHashGrid: random points, and queries around
+// random places, each checked against every point there is
+//  - SpatialHashGridTest [-rounds N] [-seed N]
+//  - Everything within a cell's size of the query has to be visited,
+//    nothing can be visited twice, and nothing outside the 3x3x3 cells
+//    around it can be visited at all
+//  - Each round rebuilds the same grid (like each tick does), with a
+//    number of points over a different sized area, from none to
+//    thousands, crowded into a few cells or spread over many (which
+//    end up sharing buckets), on either side of zero
+//  - Returns nonzero (having said what) if any query gets it wrong
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "../GameServer/SpatialHashGrid.h"
+
+using namespace DirectX;
+
+// The size of the server's cells (PROJECTILE_REACH)
+#define GRID_CELL_SIZE 10.0f
+
+// Queries each round
+#define GRID_QUERIES 200
+
+static unsigned int seed = 1;
+static float NextRandom()
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) / 16777216.0f;
+}
+static float NextRandom(float low, float high)
+{
+	return low + (high - low) * NextRandom();
+}
+
+static int Cell(float position)
+{
+	return (int)floorf(position / GRID_CELL_SIZE);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int rounds = 50;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "-rounds") rounds = (unsigned int)atoi(argv[i + 1]);
+		else if (arg == "-seed") seed = (unsigned int)atoi(argv[i + 1]);
+	}
+
+	SpatialHashGrid grid(GRID_CELL_SIZE);
+	std::vector<XMFLOAT3> points;
+	std::vector<unsigned int> visits;
+	unsigned long long queries = 0, visited = 0, inReach = 0;
+	unsigned int failures = 0;
+	for (unsigned int round = 0; round < rounds && failures == 0; round++)
+	{
+		// From nothing at all to thousands crowded into a few cells, and
+		// some sitting right on a cell's edge
+		unsigned int count = round == 0 ? 0 : 1 + (unsigned int)(NextRandom() * 4000);
+		float extent = NextRandom(GRID_CELL_SIZE, 40 * GRID_CELL_SIZE);
+		XMFLOAT3 center(NextRandom(-100, 100), NextRandom(-100, 100), NextRandom(-100, 100));
+		points.resize(count);
+		grid.Clear();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			points[i] = XMFLOAT3(center.x + NextRandom(-extent, extent), center.y + NextRandom(-extent, extent), center.z + NextRandom(-extent, extent));
+			if (i % 16 == 0)
+				points[i].x = Cell(points[i].x) * GRID_CELL_SIZE;
+			grid.Insert(i, points[i]);
+		}
+		grid.Build();
+		if (grid.GetCount() != count)
+		{
+			printf("FAIL: %u inserted, but the grid has %u\n", count, grid.GetCount());
+			failures++;
+		}
+
+		visits.assign(count, 0);
+		for (unsigned int q = 0; q < GRID_QUERIES; q++)
+		{
+			XMFLOAT3 position(center.x + NextRandom(-extent, extent), center.y + NextRandom(-extent, extent), center.z + NextRandom(-extent, extent));
+			std::vector<unsigned int> found;
+			grid.QueryNeighbours(position, [&](unsigned int id) { found.push_back(id); });
+			queries++;
+			visited += found.size();
+
+			for (unsigned int id : found)
+			{
+				if (id >= count)
+				{
+					printf("FAIL: a query visited %u, which was never inserted\n", id);
+					failures++;
+					continue;
+				}
+				if (visits[id]++ == 1)
+				{
+					printf("FAIL: a query visited %u twice\n", id);
+					failures++;
+				}
+
+				const XMFLOAT3& p = points[id];
+				if (abs(Cell(p.x) - Cell(position.x)) > 1 || abs(Cell(p.y) - Cell(position.y)) > 1 || abs(Cell(p.z) - Cell(position.z)) > 1)
+				{
+					printf("FAIL: a query at (%.3f, %.3f, %.3f) visited %u at (%.3f, %.3f, %.3f), outside the cells around it\n",
+						position.x, position.y, position.z, id, p.x, p.y, p.z);
+					failures++;
+				}
+			}
+
+			for (unsigned int i = 0; i < count; i++)
+			{
+				float dX = points[i].x - position.x, dY = points[i].y - position.y, dZ = points[i].z - position.z;
+				bool near = dX * dX + dY * dY + dZ * dZ <= GRID_CELL_SIZE * GRID_CELL_SIZE;
+				inReach += near;
+				if (near && visits[i] == 0)
+				{
+					printf("FAIL: a query at (%.3f, %.3f, %.3f) missed %u at (%.3f, %.3f, %.3f), which is within reach\n",
+						position.x, position.y, position.z, i, points[i].x, points[i].y, points[i].z);
+					failures++;
+				}
+			}
+
+			for (unsigned int id : found)
+				if (id < count) visits[id] = 0;
+		}
+	}
+
+	printf("%s: %llu queries visited %llu points, %llu of them within reach\n",
+		failures ? "FAIL" : "PASS", queries, visited, inReach);
+	return failures ? 1 : 0;
+}
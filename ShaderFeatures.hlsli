@@ -0,0 +1,44 @@
+// Include guard
+#ifndef _SHADER_FEATURES_HLSL
+#define _SHADER_FEATURES_HLSL
+
+// Compile time features of the lit pixel shaders
+//  - The full shaders use these defaults, and each permutation
+//    wrapper (like PixelShaderPBR_NoShadows.hlsl) defines some of
+//    them before including the full shader
+//  - Wrapper names must match the MATERIAL_FEATURE_ suffixes
+//    in Material.h
+
+// Sample the shadow map for shadow casting directional lights
+#ifndef FEATURE_SHADOWS
+#define FEATURE_SHADOWS 1
+#endif
+
+// Point and spot lights (without them, only directional lights are applied)
+#ifndef FEATURE_LOCAL_LIGHTS
+#define FEATURE_LOCAL_LIGHTS 1
+#endif
+
+// Apply only the first FIXED_LIGHT_COUNT lights with a fully unrolled
+// loop, rather than looping over every light (or cluster) this frame
+#ifndef FEATURE_FIXED_LIGHTS
+#define FEATURE_FIXED_LIGHTS 0
+#endif
+
+#define FIXED_LIGHT_COUNT 8
+
+// Read textures from a MaterialAtlas's texture arrays, and the
+// material's color and uv scale from its material buffer
+//  - Only the PBR shader has this, as PixelShaderPBR_Atlas.hlsl
+#ifndef FEATURE_MATERIAL_ATLAS
+#define FEATURE_MATERIAL_ATLAS 0
+#endif
+
+// Write the surface to the deferred G-buffer (see GBuffer.hlsli) rather
+// than lighting it, for DeferredLightingCS.hlsl to light later
+//  - Wrappers are named with _GBuffer after the rest of the permutation
+#ifndef FEATURE_GBUFFER
+#define FEATURE_GBUFFER 0
+#endif
+
+#endif
@@ -0,0 +1,505 @@
+#include "ShadowAtlas.h"
+#include "GpuMemory.h"
+#include "FrameArena.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+
+ShadowAtlas::ShadowAtlas(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+	size = 0;
+	levelCount = 0;
+	tileBudget = SHADOW_ATLAS_TILE_BUDGET;
+	stats = {};
+
+	// Room for every light that can have tiles, and an index for every light
+	D3D11_BUFFER_DESC desc = {};
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.ByteWidth = sizeof(LocalShadowData) * SHADOW_ATLAS_MAX_LIGHTS;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(LocalShadowData);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateBuffer(device.Get(), &desc, 0, shadowDataBuffer.GetAddressOf(), GpuMemoryCategory::Shadows, "Local Shadows");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = SHADOW_ATLAS_MAX_LIGHTS;
+	device->CreateShaderResourceView(shadowDataBuffer.Get(), &srvDesc, shadowDataSRV.GetAddressOf());
+
+	std::vector<int> noShadows(MAX_LIGHTS, -1);
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = noShadows.data();
+	desc.ByteWidth = sizeof(int) * MAX_LIGHTS;
+	desc.StructureByteStride = sizeof(int);
+	GpuMemory::CreateBuffer(device.Get(), &desc, &initialData, lightIndicesBuffer.GetAddressOf(), GpuMemoryCategory::Shadows, "Light Shadow Indices");
+	srvDesc.Buffer.NumElements = MAX_LIGHTS;
+	device->CreateShaderResourceView(lightIndicesBuffer.Get(), &srvDesc, lightIndicesSRV.GetAddressOf());
+	uploadedLightIndices.assign(MAX_LIGHTS, -1);
+
+	Resize(SHADOW_ATLAS_SIZE);
+}
+
+void ShadowAtlas::Resize(unsigned int newSize)
+{
+	size = max(newSize, (unsigned int)SHADOW_ATLAS_MIN_TILE << SHADOW_ATLAS_MAX_TILE_LEVEL);
+	atlasTexture.Reset();
+	atlasDSV.Reset();
+	atlasSRV.Reset();
+
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = size;
+	texDesc.Height = size;
+	texDesc.ArraySize = 1;
+	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	texDesc.MipLevels = 1;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, atlasTexture.GetAddressOf(), GpuMemoryCategory::Shadows, "Shadow Atlas");
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(atlasTexture.Get(), &dsvDesc, atlasDSV.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(atlasTexture.Get(), &srvDesc, atlasSRV.GetAddressOf());
+
+	// Untouched parts of the atlas are never sampled, but start them out lit anyway
+	context->ClearDepthStencilView(atlasDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+	// Levels down to the smallest tile, with just the whole atlas free
+	levelCount = 1;
+	while (TileSize(levelCount - 1) > SHADOW_ATLAS_MIN_TILE)
+		levelCount++;
+	freeTiles.assign(levelCount, {});
+	freeTiles[0].push_back(XMUINT2(0, 0));
+
+	shadowedLights.clear();
+	renderTiles.clear();
+}
+
+// --------------------------------------------------------
+// Takes a free tile of the level, splitting up the smallest
+// bigger one if there isn't one that size
+// --------------------------------------------------------
+bool ShadowAtlas::AllocateTile(unsigned int level, XMUINT2& corner)
+{
+	int from = (int)level;
+	while (from >= 0 && freeTiles[from].empty())
+		from--;
+	if (from < 0)
+		return false;
+
+	corner = freeTiles[from].back();
+	freeTiles[from].pop_back();
+	for (unsigned int l = from + 1; l <= level; l++)
+	{
+		// Keep the first quarter, and free the other three
+		unsigned int half = TileSize(l);
+		freeTiles[l].push_back(XMUINT2(corner.x + half, corner.y));
+		freeTiles[l].push_back(XMUINT2(corner.x, corner.y + half));
+		freeTiles[l].push_back(XMUINT2(corner.x + half, corner.y + half));
+	}
+	return true;
+}
+
+// Gives a tile back, merged with the rest of its
+// quarters whenever they're all free
+void ShadowAtlas::FreeTile(unsigned int level, XMUINT2 corner)
+{
+	while (level > 0)
+	{
+		unsigned int parentSize = TileSize(level - 1);
+		XMUINT2 parent(corner.x / parentSize * parentSize, corner.y / parentSize * parentSize);
+
+		// Any of the other quarters that are free
+		std::vector<XMUINT2>& free = freeTiles[level];
+		std::vector<size_t> siblings;
+		for (size_t i = 0; i < free.size(); i++)
+		{
+			bool inParent = free[i].x / parentSize * parentSize == parent.x && free[i].y / parentSize * parentSize == parent.y;
+			if (inParent)
+				siblings.push_back(i);
+		}
+		if (siblings.size() < 3)
+			break;
+
+		// Backwards, so the earlier indices stay put
+		for (size_t i = siblings.size(); i-- > 0;)
+		{
+			free[siblings[i]] = free.back();
+			free.pop_back();
+		}
+		corner = parent;
+		level--;
+	}
+	freeTiles[level].push_back(corner);
+}
+
+void ShadowAtlas::FreeTiles(ShadowedLight& light)
+{
+	if (!light.Allocated)
+		return;
+
+	for (unsigned int i = 0; i < light.FaceCount; i++)
+		FreeTile(light.Level, light.Faces[i].Corner);
+	light.Allocated = false;
+}
+
+// --------------------------------------------------------
+// New tiles for every face, all at the level or none at all
+//  - The old tiles (if any) are left for the caller to free
+// --------------------------------------------------------
+bool ShadowAtlas::AllocateFaces(ShadowedLight& light, unsigned int level, const Light& source)
+{
+	XMUINT2 corners[6];
+	unsigned int allocated = 0;
+	while (allocated < light.FaceCount && AllocateTile(level, corners[allocated]))
+		allocated++;
+	if (allocated < light.FaceCount)
+	{
+		for (unsigned int i = 0; i < allocated; i++)
+			FreeTile(level, corners[i]);
+		return false;
+	}
+
+	light.Allocated = true;
+	light.Level = level;
+	light.Source = source;
+	for (unsigned int i = 0; i < light.FaceCount; i++)
+	{
+		light.Faces[i].Corner = corners[i];
+		light.Faces[i].Drawn = false;
+		light.Faces[i].Dirty = true;
+		light.Faces[i].MovingCasters = false;
+		light.Faces[i].FramesWaiting = 0;
+	}
+	UpdateFaces(light, source);
+	return true;
+}
+
+// --------------------------------------------------------
+// Where each face looks from, for the light as it is now
+//  - Spot lights get one perspective view wide enough for
+//    where their falloff is all but zero, and point lights
+//    one square 90 degree view down each axis
+// --------------------------------------------------------
+void ShadowAtlas::UpdateFaces(ShadowedLight& light, const Light& source)
+{
+	static const XMFLOAT3 cubeDirections[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	static const XMFLOAT3 cubeUps[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+
+	float farClip = max(source.Range, 0.1f);
+	float nearClip = max(farClip * SHADOW_ATLAS_NEAR_RATIO, 0.05f);
+	XMVECTOR position = XMLoadFloat3(&source.Position);
+
+	for (unsigned int i = 0; i < light.FaceCount; i++)
+	{
+		XMVECTOR direction, up;
+		float fov;
+		if (source.Type == LIGHT_TYPE_SPOT)
+		{
+			direction = XMVector3Normalize(XMLoadFloat3(&source.Direction));
+			up = fabsf(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+
+			// pow(cos(angle), falloff) drops to 1% at this angle
+			float edge = source.SpotFalloff > 0.0f ? acosf(powf(0.01f, 1.0f / source.SpotFalloff)) : XM_PIDIV2;
+			fov = min(max(edge * 2.0f, XMConvertToRadians(5.0f)), XMConvertToRadians(170.0f));
+		}
+		else
+		{
+			direction = XMLoadFloat3(&cubeDirections[i]);
+			up = XMLoadFloat3(&cubeUps[i]);
+			fov = XM_PIDIV2;
+		}
+
+		Tile& tile = light.Faces[i];
+		XMMATRIX view = XMMatrixLookToLH(position, direction, up);
+		XMMATRIX proj = XMMatrixPerspectiveFovLH(fov, 1.0f, nearClip, farClip);
+		XMStoreFloat4x4(&tile.View, view);
+		XMStoreFloat4x4(&tile.Projection, proj);
+		BoundingFrustum frustum(proj);
+		frustum.Transform(tile.Frustum, XMMatrixInverse(0, view));
+	}
+}
+
+void ShadowAtlas::Update(Camera* camera, const std::vector<Light>& lights, int lightCount, bool enabled,
+	const std::vector<BoundingOrientedBox>& movedBounds, bool castersRemoved)
+{
+	renderTiles.clear();
+	stats = {};
+
+	// Lights worth a tile, by how much of the screen they could cover
+	//  - This and the lists below only last the update, so they're
+	//    from the frame arena
+	struct Candidate { int LightIndex; float Coverage; };
+	FrameVector<Candidate> candidates;
+	if (enabled)
+	{
+		XMFLOAT4X4 view = camera->GetView(), proj = camera->GetProjection();
+		XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
+		BoundingFrustum cameraFrustum(XMLoadFloat4x4(&proj));
+		cameraFrustum.Transform(cameraFrustum, XMMatrixInverse(0, viewMatrix));
+
+		for (int i = 0; i < lightCount && i < (int)lights.size(); i++)
+		{
+			const Light& light = lights[i];
+			if (!light.CastsShadows || light.Type == LIGHT_TYPE_DIRECTIONAL || light.Range <= 0.0f)
+				continue;
+
+			BoundingSphere sphere(light.Position, light.Range);
+			if (!cameraFrustum.Intersects(sphere))
+				continue;
+
+			// The camera's inside it, or it's the projected radius over half the screen's height
+			float depth = XMVectorGetZ(XMVector3TransformCoord(XMLoadFloat3(&light.Position), viewMatrix));
+			float coverage = depth <= light.Range ? 1.0f : min(1.0f, light.Range * proj._22 / depth);
+			candidates.push_back({ i, coverage });
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.Coverage > b.Coverage; });
+		if (candidates.size() > SHADOW_ATLAS_MAX_LIGHTS)
+			candidates.resize(SHADOW_ATLAS_MAX_LIGHTS);
+	}
+
+	// Let go of lights that aren't wanted any more (or changed type)
+	for (size_t i = 0; i < shadowedLights.size();)
+	{
+		ShadowedLight& light = shadowedLights[i];
+		bool wanted = false;
+		for (const Candidate& c : candidates)
+			wanted |= c.LightIndex == light.LightIndex && lights[c.LightIndex].Type == light.Source.Type;
+		if (wanted)
+		{
+			i++;
+			continue;
+		}
+		FreeTiles(light);
+		shadowedLights[i] = shadowedLights.back();
+		shadowedLights.pop_back();
+	}
+
+	// Each light's tile size from its coverage (point lights' faces a
+	// level smaller, since there are six), kept unless it's moved well
+	// past the sizes either side
+	unsigned int minLevel = levelCount - 1;
+	auto levelFor = [&](float coverage, bool point)
+	{
+		float steps = floorf(-log2f(max(coverage, 1e-4f)));
+		unsigned int level = SHADOW_ATLAS_MAX_TILE_LEVEL + (unsigned int)max(steps, 0.0f) + (point ? 1 : 0);
+		return min(level, minLevel);
+	};
+
+	FrameVector<ShadowedLight*> ordered;
+	ordered.reserve(candidates.size());
+	for (const Candidate& c : candidates)
+	{
+		const Light& source = lights[c.LightIndex];
+		bool point = source.Type == LIGHT_TYPE_POINT;
+
+		ShadowedLight* light = 0;
+		for (ShadowedLight& existing : shadowedLights)
+		{
+			if (existing.LightIndex == c.LightIndex)
+				light = &existing;
+		}
+		if (!light)
+		{
+			ShadowedLight added = {};
+			added.LightIndex = c.LightIndex;
+			added.Source = source;
+			added.FaceCount = point ? 6 : 1;
+			shadowedLights.push_back(added);
+			light = &shadowedLights.back();
+		}
+		light->Coverage = c.Coverage;
+
+		// Shrinking always fits, but growing only happens once there's
+		// room, and the old tiles are kept until then
+		unsigned int finest = levelFor(c.Coverage * (1.0f + SHADOW_ATLAS_HYSTERESIS), point);
+		unsigned int coarsest = levelFor(c.Coverage / (1.0f + SHADOW_ATLAS_HYSTERESIS), point);
+		unsigned int wanted = levelFor(c.Coverage, point);
+		if (light->Allocated && light->Level < finest)
+			FreeTiles(*light);
+		else if (light->Allocated && light->Level > coarsest)
+		{
+			unsigned int oldLevel = light->Level;
+			Tile oldFaces[6];
+			memcpy(oldFaces, light->Faces, sizeof(oldFaces));
+			if (AllocateFaces(*light, wanted, source))
+			{
+				for (unsigned int i = 0; i < light->FaceCount; i++)
+					FreeTile(oldLevel, oldFaces[i].Corner);
+			}
+		}
+		if (!light->Allocated)
+			light->Level = wanted;
+	}
+
+	// Pointers only once nothing else is added
+	for (const Candidate& c : candidates)
+	{
+		for (ShadowedLight& light : shadowedLights)
+		{
+			if (light.LightIndex == c.LightIndex)
+				ordered.push_back(&light);
+		}
+	}
+
+	// New tiles, biggest lights first, going smaller when there's no room
+	for (ShadowedLight* light : ordered)
+	{
+		if (light->Allocated)
+			continue;
+
+		for (unsigned int level = light->Level; level < levelCount && !light->Allocated; level++)
+			AllocateFaces(*light, level, lights[light->LightIndex]);
+	}
+
+	// Which tiles are out of date
+	struct Waiting { ShadowedLight* Light; unsigned int Face; float Priority; };
+	FrameVector<Waiting> waiting;
+	waiting.reserve(ordered.size() * 6);
+	for (ShadowedLight* light : ordered)
+	{
+		if (!light->Allocated)
+			continue;
+
+		const Light& source = lights[light->LightIndex];
+		bool lightChanged =
+			memcmp(&source.Position, &light->Source.Position, sizeof(XMFLOAT3)) != 0 ||
+			memcmp(&source.Direction, &light->Source.Direction, sizeof(XMFLOAT3)) != 0 ||
+			source.Range != light->Source.Range ||
+			source.SpotFalloff != light->Source.SpotFalloff;
+		if (lightChanged)
+			UpdateFaces(*light, source);
+		light->Source = source;
+
+		for (unsigned int i = 0; i < light->FaceCount; i++)
+		{
+			Tile& tile = light->Faces[i];
+			tile.Dirty |= lightChanged || castersRemoved || tile.MovingCasters;
+			for (size_t b = 0; b < movedBounds.size() && !tile.Dirty; b++)
+				tile.Dirty = tile.Frustum.Intersects(movedBounds[b]);
+
+			if (tile.Dirty)
+			{
+				// Never drawn comes first, since those have no shadows at all
+				float priority = light->Coverage * (1.0f + tile.FramesWaiting) + (tile.Drawn ? 0.0f : 1000.0f);
+				waiting.push_back({ light, i, priority });
+			}
+		}
+	}
+
+	std::sort(waiting.begin(), waiting.end(), [](const Waiting& a, const Waiting& b) { return a.Priority > b.Priority; });
+	for (size_t w = 0; w < waiting.size(); w++)
+	{
+		Tile& tile = waiting[w].Light->Faces[waiting[w].Face];
+		if (w >= tileBudget)
+		{
+			tile.FramesWaiting++;
+			stats.TilesWaiting++;
+			continue;
+		}
+
+		unsigned int tileSize = TileSize(waiting[w].Light->Level);
+		ShadowAtlasRenderTile render = {};
+		render.View = tile.View;
+		render.Projection = tile.Projection;
+		render.FarClip = waiting[w].Light->Source.Range;
+		render.Frustum = tile.Frustum;
+		render.Viewport.TopLeftX = (float)tile.Corner.x;
+		render.Viewport.TopLeftY = (float)tile.Corner.y;
+		render.Viewport.Width = (float)tileSize;
+		render.Viewport.Height = (float)tileSize;
+		render.Viewport.MaxDepth = 1.0f;
+		render.Light = (unsigned int)(waiting[w].Light - shadowedLights.data());
+		render.Face = waiting[w].Face;
+		renderTiles.push_back(render);
+
+		XMStoreFloat4x4(&tile.DrawnViewProjection, XMLoadFloat4x4(&tile.View) * XMLoadFloat4x4(&tile.Projection));
+		tile.Drawn = true;
+		tile.Dirty = false;
+		tile.FramesWaiting = 0;
+	}
+	stats.TilesRendered = (unsigned int)renderTiles.size();
+
+	// What the shaders sample - only faces that have been drawn
+	shadowData.clear();
+	lightIndices.assign(max(lightCount, 0), -1);
+	for (ShadowedLight* light : ordered)
+	{
+		if (!light->Allocated)
+			continue;
+
+		LocalShadowData data = {};
+		float tileScale = (float)TileSize(light->Level) / size;
+		for (unsigned int i = 0; i < light->FaceCount; i++)
+		{
+			const Tile& tile = light->Faces[i];
+			if (!tile.Drawn)
+				continue;
+			data.ViewProjections[i] = tile.DrawnViewProjection;
+			data.Tiles[i] = XMFLOAT4(tileScale, tileScale, (float)tile.Corner.x / size, (float)tile.Corner.y / size);
+		}
+
+		lightIndices[light->LightIndex] = (int)shadowData.size();
+		shadowData.push_back(data);
+		stats.Lights++;
+		stats.Tiles += light->FaceCount;
+		stats.TexelsUsed += light->FaceCount * TileSize(light->Level) * TileSize(light->Level);
+	}
+	UploadShadowData(lightCount);
+}
+
+void ShadowAtlas::SetTileHasMovingCasters(const ShadowAtlasRenderTile& tile, bool moving)
+{
+	if (tile.Light < shadowedLights.size() && tile.Face < shadowedLights[tile.Light].FaceCount)
+		shadowedLights[tile.Light].Faces[tile.Face].MovingCasters = moving;
+}
+
+// Only the parts that differ from the last upload
+//  - Indices past the light count are never read, so they're left alone
+void ShadowAtlas::UploadShadowData(int lightCount)
+{
+	if (shadowData.size() != uploadedShadowData.size() ||
+		(!shadowData.empty() && memcmp(shadowData.data(), uploadedShadowData.data(), sizeof(LocalShadowData) * shadowData.size()) != 0))
+	{
+		uploadedShadowData = shadowData;
+		if (!shadowData.empty())
+		{
+			D3D11_BOX box = {};
+			box.right = (unsigned int)(sizeof(LocalShadowData) * shadowData.size());
+			box.bottom = 1;
+			box.back = 1;
+			context->UpdateSubresource(shadowDataBuffer.Get(), 0, &box, shadowData.data(), 0, 0);
+		}
+	}
+
+	int count = min(lightCount, MAX_LIGHTS);
+	int first = 0;
+	while (first < count && lightIndices[first] == uploadedLightIndices[first])
+		first++;
+	if (first == count)
+		return;
+
+	int last = count - 1;
+	while (last > first && lightIndices[last] == uploadedLightIndices[last])
+		last--;
+
+	memcpy(&uploadedLightIndices[first], &lightIndices[first], sizeof(int) * (last - first + 1));
+	D3D11_BOX box = {};
+	box.left = sizeof(int) * first;
+	box.right = sizeof(int) * (last + 1);
+	box.bottom = 1;
+	box.back = 1;
+	context->UpdateSubresource(lightIndicesBuffer.Get(), 0, &box, &lightIndices[first], 0, 0);
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+#include "Camera.h"
+#include "Lights.h"
+
+// Default size of the atlas (square), and the biggest and smallest
+// tiles in it - it's split in quarters down to whatever size is needed
+#define SHADOW_ATLAS_SIZE			4096
+#define SHADOW_ATLAS_MAX_TILE_LEVEL	2		// A quarter of the width, for the biggest spot lights
+#define SHADOW_ATLAS_MIN_TILE		64
+
+// How many lights can have tiles at once
+#define SHADOW_ATLAS_MAX_LIGHTS		64
+
+// Tiles redrawn each frame by default, at most
+#define SHADOW_ATLAS_TILE_BUDGET	8
+
+// How much further past a size's screen coverage a light has to
+// get before its tiles change size, so they don't flip back and forth
+#define SHADOW_ATLAS_HYSTERESIS		0.2f
+
+// Each tile's near clip, as a fraction of its light's range
+#define SHADOW_ATLAS_NEAR_RATIO		0.01f
+
+// Per light shadow data for the pixel shaders
+//  - Must match LocalShadow in PerFrameData.hlsli
+//  - Spot lights only use the first face, point lights
+//    one per cube face (+X, -X, +Y, -Y, +Z, -Z)
+//  - A tile with no size means that face isn't drawn yet
+struct LocalShadowData
+{
+	DirectX::XMFLOAT4X4 ViewProjections[6];
+	DirectX::XMFLOAT4 Tiles[6];	// Atlas uv scale (xy) and offset (zw)
+};
+
+// One tile the renderer should draw this frame
+struct ShadowAtlasRenderTile
+{
+	DirectX::XMFLOAT4X4 View;
+	DirectX::XMFLOAT4X4 Projection;
+	float FarClip;
+	DirectX::BoundingFrustum Frustum;
+	D3D11_VIEWPORT Viewport;
+	unsigned int Light;	// Which of the atlas's lights, and which of its faces
+	unsigned int Face;
+};
+
+struct ShadowAtlasStats
+{
+	unsigned int Lights;			// With tiles
+	unsigned int Tiles;
+	unsigned int TilesRendered;		// This frame
+	unsigned int TilesWaiting;		// Out of date, but over the budget
+	unsigned int TexelsUsed;		// Of the whole atlas
+};
+
+// --------------------------------------------------------
+// One depth atlas shared by every shadow casting point and
+// spot light, which the renderer draws tiles of
+//  - Lights get tiles sized by how much of the screen their
+//    range covers, biggest first, and lights off screen
+//    (or past the limit) get none
+//  - Tiles are split from the atlas in quarters, and kept
+//    from frame to frame, so each one is a cache: it's only
+//    redrawn when its light changes, when something moves
+//    inside it, or when it held moving casters last time
+//  - At most the budget's worth of tiles are redrawn each
+//    frame, the lights covering the most screen (and the
+//    ones waiting longest) first, and a tile that's waiting
+//    is still sampled with the matrices it was drawn with
+// --------------------------------------------------------
+class ShadowAtlas
+{
+public:
+	ShadowAtlas(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Remakes the atlas, which throws every tile away
+	void Resize(unsigned int size);
+	unsigned int GetSize() { return size; }
+
+	// Picks this frame's lights, tiles, and tiles to draw, then uploads
+	// the shadow data the pixel shaders read
+	//  - movedBounds are the entities that moved (or appeared) this frame,
+	//    and castersRemoved says whether any went away
+	//  - With enabled false, every tile's let go
+	void Update(Camera* camera, const std::vector<Light>& lights, int lightCount, bool enabled,
+		const std::vector<DirectX::BoundingOrientedBox>& movedBounds, bool castersRemoved);
+
+	// What to draw, and whether each drawn tile had anything moving in it
+	const std::vector<ShadowAtlasRenderTile>& GetRenderTiles() { return renderTiles; }
+	void SetTileHasMovingCasters(const ShadowAtlasRenderTile& tile, bool moving);
+
+	unsigned int GetTileBudget() { return tileBudget; }
+	void SetTileBudget(unsigned int budget) { tileBudget = budget; }
+	const ShadowAtlasStats& GetStats() { return stats; }
+
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> GetDSV() { return atlasDSV; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV() { return atlasSRV; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetShadowDataSRV() { return shadowDataSRV; }
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetLightIndicesSRV() { return lightIndicesSRV; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	unsigned int size;
+	unsigned int tileBudget;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> atlasTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> atlasDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> atlasSRV;
+
+	// Free tiles at each level (level 0 is the whole atlas, and
+	// each level down is a quarter of the one above), by corner
+	std::vector<std::vector<DirectX::XMUINT2>> freeTiles;
+	unsigned int levelCount;
+	unsigned int TileSize(unsigned int level) { return size >> level; }
+	bool AllocateTile(unsigned int level, DirectX::XMUINT2& corner);
+	void FreeTile(unsigned int level, DirectX::XMUINT2 corner);
+
+	struct Tile
+	{
+		DirectX::XMUINT2 Corner;
+		DirectX::XMFLOAT4X4 View;
+		DirectX::XMFLOAT4X4 Projection;
+		DirectX::BoundingFrustum Frustum;
+		DirectX::XMFLOAT4X4 DrawnViewProjection;	// What's in the atlas now
+		bool Drawn;
+		bool Dirty;
+		bool MovingCasters;
+		unsigned int FramesWaiting;
+	};
+
+	struct ShadowedLight
+	{
+		int LightIndex;
+		Light Source;		// As of the last update, to see what changes
+		float Coverage;		// Of the screen's height, from 0 to 1
+		bool Allocated;
+		unsigned int Level;
+		unsigned int FaceCount;
+		Tile Faces[6];
+	};
+	std::vector<ShadowedLight> shadowedLights;
+	void FreeTiles(ShadowedLight& light);
+	bool AllocateFaces(ShadowedLight& light, unsigned int level, const Light& source);
+	void UpdateFaces(ShadowedLight& light, const Light& source);
+
+	std::vector<ShadowAtlasRenderTile> renderTiles;
+	ShadowAtlasStats stats;
+
+	// What the pixel shaders read, only uploaded where it's changed
+	//  - Each light's index into the shadow data, or -1
+	Microsoft::WRL::ComPtr<ID3D11Buffer> shadowDataBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowDataSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> lightIndicesBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightIndicesSRV;
+	std::vector<LocalShadowData> shadowData;
+	std::vector<LocalShadowData> uploadedShadowData;
+	std::vector<int> lightIndices;
+	std::vector<int> uploadedLightIndices;
+	void UploadShadowData(int lightCount);
+};
@@ -0,0 +1,7 @@
+// Clears one tile of the shadow atlas (drawn with the
+// viewport over just that tile), since clearing the
+// depth view would clear every tile at once
+float main(float4 position : SV_POSITION) : SV_DEPTH
+{
+	return 1.0f;
+}
@@ -0,0 +1,54 @@
+// Include guard
+#ifndef _SHADOW_MOMENTS_HLSL
+#define _SHADOW_MOMENTS_HLSL
+
+// Exponential variance shadow maps - each texel keeps the first two
+// moments of exp(c * depth) (and of -exp(-c * depth), with four)
+// rather than the depth itself, so the map can be blurred and
+// mipmapped like any other texture
+//  - Depth is warped from 0-1 to -1-1 first, so both
+//    exponents get the whole range
+//  - Used by ShadowMomentsCS.hlsl and PerFrameData.hlsli
+
+float2 WarpDepth(float depth, float2 exponents)
+{
+	depth = depth * 2.0f - 1.0f;
+	return float2(exp(exponents.x * depth), -exp(-exponents.y * depth));
+}
+
+// Moments of one depth - positive (xy) and negative (zw)
+float4 DepthMoments(float depth, float2 exponents)
+{
+	float2 warped = WarpDepth(depth, exponents);
+	return float4(warped.x, warped.x * warped.x, warped.y, warped.y * warped.y);
+}
+
+// Chebyshev's upper bound on how much of the filtered area is
+// further from the light than the given (warped) depth
+float ChebyshevUpperBound(float2 moments, float depth, float minVariance, float bleedReduction)
+{
+	float variance = max(moments.y - moments.x * moments.x, minVariance);
+	float difference = depth - moments.x;
+	float lit = variance / (variance + difference * difference);
+
+	// Cuts off the tail that leaks light where shadows overlap
+	lit = saturate((lit - bleedReduction) / (1.0f - bleedReduction));
+	return depth <= moments.x ? 1.0f : lit;
+}
+
+// How lit a depth is against filtered moments, with the
+// negative moments only when there are four
+float MomentsShadow(float4 moments, float depth, float2 exponents, bool fourMoments, float minVariance, float bleedReduction)
+{
+	float2 warped = WarpDepth(depth, exponents);
+
+	// The variance needs scaling with how steep the warp is
+	float positive = ChebyshevUpperBound(moments.xy, warped.x, minVariance * exponents.x * warped.x * exponents.x * warped.x, bleedReduction);
+	if (!fourMoments)
+		return positive;
+
+	float negative = ChebyshevUpperBound(moments.zw, warped.y, minVariance * exponents.y * warped.y * exponents.y * warped.y, bleedReduction);
+	return min(positive, negative);
+}
+
+#endif
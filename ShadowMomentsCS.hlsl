@@ -0,0 +1,77 @@
+#include "ShadowMoments.hlsli"
+
+// One row (or column) segment of texels per group, plus
+// as many either side as the widest blur reaches
+#define GROUP_SIZE		64
+#define MAX_BLUR_RADIUS	8
+#define TILE_SIZE		(GROUP_SIZE + MAX_BLUR_RADIUS * 2)
+
+cbuffer externalData : register(b0)
+{
+	float2 exponents;	// Positive and negative depth warps
+	int horizontal;		// Depths into moments along rows, otherwise moments down columns
+	int slice;			// The cascade being filtered
+	int size;			// Of the (square) shadow map
+	int blurRadius;		// Texels either side, up to MAX_BLUR_RADIUS
+};
+
+
+Texture2DArray Depths : register(t0);
+Texture2D Moments : register(t1);
+RWTexture2D<float4> BlurTemp : register(u0);
+RWTexture2DArray<float4> MomentsResult : register(u1);
+
+groupshared float4 tileMoments[TILE_SIZE];
+
+
+// Converts a position along the row/column into a texel
+int2 TexelAt(int along, int across)
+{
+	return horizontal ? int2(along, across) : int2(across, along);
+}
+
+// Half of a separable gaussian blur of the shadow moments
+//  - The horizontal half turns the cascade's depths into moments
+//    as it reads them, so there's no separate pass for that
+//  - Groups are laid out along x for both directions, so
+//    SV_GroupID.y picks the row or column
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 groupThreadID : SV_GroupThreadID, uint3 groupID : SV_GroupID)
+{
+	int across = groupID.y;
+	int start = groupID.x * GROUP_SIZE - MAX_BLUR_RADIUS;
+
+	for (int t = groupThreadID.x; t < TILE_SIZE; t += GROUP_SIZE)
+	{
+		int2 texel = TexelAt(clamp(start + t, 0, size - 1), across);
+		tileMoments[t] = horizontal ?
+			DepthMoments(Depths.Load(int4(texel, slice, 0)).r, exponents) :
+			Moments.Load(int3(texel, 0));
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	int along = groupID.x * GROUP_SIZE + groupThreadID.x;
+	if (along >= size)
+		return;
+
+	// Standard deviation of half the radius, so the
+	// weights are all but zero at the edges
+	int radius = clamp(blurRadius, 0, MAX_BLUR_RADIUS);
+	float sigma = max(radius * 0.5f, 0.5f);
+	int center = groupThreadID.x + MAX_BLUR_RADIUS;
+
+	float4 moments = 0;
+	float totalWeight = 0;
+	for (int i = -radius; i <= radius; i++)
+	{
+		float weight = exp(-(i * i) / (2.0f * sigma * sigma));
+		moments += tileMoments[center + i] * weight;
+		totalWeight += weight;
+	}
+	moments /= totalWeight;
+
+	if (horizontal)
+		BlurTemp[TexelAt(along, across)] = moments;
+	else
+		MomentsResult[int3(TexelAt(along, across), slice)] = moments;
+}
@@ -1,3 +1,5 @@
+#include "VertexFormat.hlsli"
+
 cbuffer perFrame : register(b0)
 {
     matrix view;
@@ -12,9 +14,9 @@ cbuffer perObject : register(b1)
 struct VertexShaderInput
 {
     float3 localPosition : POSITION;
-    float2 uv : TEXCOORD;
-    float3 normal : NORMAL;
-    float3 tangent : TANGENT;
+    VertexUV uv : TEXCOORD;
+    VertexDirection normal : NORMAL;
+    VertexDirection tangent : TANGENT;
 };
 
 struct VertexToPixelShadow
@@ -0,0 +1,41 @@
+#include "VertexFormat.hlsli"
+
+cbuffer perFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+}
+
+//  - "_PER_INSTANCE" semantics come from the instance buffer
+//    (input slot 1), which holds InstanceData from RenderQueue.h
+struct VertexShaderInput
+{
+    float3 localPosition : POSITION;
+    VertexUV uv : TEXCOORD;
+    VertexDirection normal : NORMAL;
+    VertexDirection tangent : TANGENT;
+
+    float4 world0 : WORLD_PER_INSTANCE0;
+    float4 world1 : WORLD_PER_INSTANCE1;
+    float4 world2 : WORLD_PER_INSTANCE2;
+    float4 world3 : WORLD_PER_INSTANCE3;
+};
+
+struct VertexToPixelShadow
+{
+    float4 screenPosition : SV_POSITION;
+};
+
+
+VertexToPixelShadow main(VertexShaderInput input)
+{
+    VertexToPixelShadow output;
+
+    // Instance rows come straight from the C++ (row major)
+    // matrix, so this one multiplies from the right
+    matrix world = matrix(input.world0, input.world1, input.world2, input.world3);
+    float4 worldPos = mul(float4(input.localPosition, 1.0f), world);
+    output.screenPosition = mul(projection, mul(view, worldPos));
+
+    return output;
+}
@@ -0,0 +1,5 @@
+// ShadowVSInstanced.hlsl for meshes with compact vertices
+//  - See VertexFormat.hlsli
+#define FEATURE_COMPACT_VERTICES 1
+
+#include "ShadowVSInstanced.hlsl"
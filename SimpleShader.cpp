@@ -1,4 +1,10 @@
 #include "SimpleShader.h"
+#include "LoadProfiler.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
+
+#include <chrono>
+#include <fstream>
 
 // Default error reporting state
 bool ISimpleShader::ReportErrors = false;
@@ -11,11 +17,127 @@ bool ISimpleShader::ReportWarnings = false;
 // ISimpleShader::ReportErrors = true;
 // ISimpleShader::ReportWarnings = true;
 
+// No redirection until a thread asks for it
+thread_local ID3D11DeviceContext* ISimpleShader::threadContext = 0;
+
+std::atomic<unsigned int> ISimpleShader::bufferUploadsIssued = 0;
+std::atomic<unsigned int> ISimpleShader::bufferUploadsSkipped = 0;
+
+// Redundant bind filtering is on by default
+std::mutex ISimpleShader::stateCacheMutex;
+std::unordered_map<ID3D11DeviceContext*, std::unique_ptr<SimpleShaderStateCache>> ISimpleShader::stateCaches;
+thread_local ID3D11DeviceContext* ISimpleShader::lastCacheContext = 0;
+thread_local SimpleShaderStateCache* ISimpleShader::lastCache = 0;
+bool ISimpleShader::stateCaching = true;
+std::atomic<unsigned int> ISimpleShader::bindsSkipped = 0;
+unsigned int ISimpleShader::frameIndex = 0;
+int ISimpleShader::ringSupport = -1;
+
+// Reflection shared between shaders, by bytecode hash
+std::mutex ISimpleShader::reflectionMutex;
+std::unordered_map<unsigned long long, std::weak_ptr<const SimpleShaderReflection>> ISimpleShader::reflections;
+std::unordered_map<unsigned long long, std::shared_ptr<const SimpleShaderReflection>> ISimpleShader::cachedReflections;
+std::unordered_map<unsigned long long, bool> ISimpleShader::usedCachedReflections;
+SimpleShaderReflectionCacheStats ISimpleShader::reflectionCacheStats = {};
+
+// Anything in the reflection cache file with more than this many of
+// something is taken to be corrupt, rather than allocated
+#define SIMPLE_SHADER_REFLECTION_CACHE_MAX_COUNT	65536
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // ------ BASE SIMPLE SHADER --------------------------------------------------
 ///////////////////////////////////////////////////////////////////////////////
 
+// --------------------------------------------------------
+// Sends every shader's work on the calling thread to the given
+// context (such as a deferred context being recorded on this
+// thread) instead of its own.  Pass null to stop redirecting.
+//  - The caller must keep the context alive while it's set
+// --------------------------------------------------------
+void ISimpleShader::SetThreadContext(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	threadContext = context.Get();
+}
+
+// --------------------------------------------------------
+// Forgets everything SimpleShader thinks is bound to the given
+// context, so the next binds all go through to D3D.  Needed
+// after anything else binds state on that context directly.
+// --------------------------------------------------------
+void ISimpleShader::InvalidateStateCache(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	std::lock_guard<std::mutex> lock(stateCacheMutex);
+	auto it = stateCaches.find(context.Get());
+	if (it != stateCaches.end())
+		it->second->Invalidate();
+}
+
+void ISimpleShader::InvalidateAllStateCaches()
+{
+	std::lock_guard<std::mutex> lock(stateCacheMutex);
+	for (auto& c : stateCaches)
+		c.second->Invalidate();
+}
+
+// --------------------------------------------------------
+// Starts a new frame for every shader on every context
+// --------------------------------------------------------
+void ISimpleShader::BeginFrame()
+{
+	frameIndex++;
+	InvalidateAllStateCaches();
+}
+
+// --------------------------------------------------------
+// Turns redundant bind filtering on or off.  The caches
+// aren't updated while it's off, so they start over.
+// --------------------------------------------------------
+void ISimpleShader::SetStateCaching(bool enabled)
+{
+	stateCaching = enabled;
+	InvalidateAllStateCaches();
+}
+
+// --------------------------------------------------------
+// Gets the state cache of the context this thread is using,
+// creating it the first time that context is seen
+// --------------------------------------------------------
+SimpleShaderStateCache* ISimpleShader::GetStateCache()
+{
+	ID3D11DeviceContext* context = GetContext();
+	if (context == lastCacheContext)
+		return lastCache;
+
+	std::lock_guard<std::mutex> lock(stateCacheMutex);
+	std::unique_ptr<SimpleShaderStateCache>& cache = stateCaches[context];
+	if (!cache)
+	{
+		cache = std::make_unique<SimpleShaderStateCache>();
+		cache->Invalidate();
+		context->QueryInterface(IID_PPV_ARGS(cache->Context1.GetAddressOf()));
+	}
+
+	lastCacheContext = context;
+	lastCache = cache.get();
+	return lastCache;
+}
+
+bool ISimpleShader::CacheBind(ID3D11DeviceChild*& cached, ID3D11DeviceChild* value)
+{
+	if (!stateCaching)
+		return true;
+
+	if (value && cached == value)
+	{
+		bindsSkipped++;
+		return false;
+	}
+
+	cached = value;
+	return true;
+}
+
 // --------------------------------------------------------
 // Constructor accepts Direct3D device & context
 // --------------------------------------------------------
@@ -54,20 +176,12 @@ void ISimpleShader::CleanUp()
 	if (constantBuffers)
 	{
 		delete[] constantBuffers;
+		constantBuffers = 0;
 		constantBufferCount = 0;
 	}
 
-	for (unsigned int i = 0; i < shaderResourceViews.size(); i++)
-		delete shaderResourceViews[i];
-
-	for (unsigned int i = 0; i < samplerStates.size(); i++)
-		delete samplerStates[i];
-
-	// Clean up tables
-	varTable.clear();
-	cbTable.clear();
-	samplerTable.clear();
-	textureTable.clear();
+	// The shared reflection is kept, since it's found before the
+	// shader's created (and let go of along with the shader)
 }
 
 // --------------------------------------------------------
@@ -81,7 +195,11 @@ void ISimpleShader::CleanUp()
 bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 {
 	// Load the shader to a blob and ensure it worked
-	HRESULT hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
+	HRESULT hr;
+	{
+		LoadProfileScope scope("Read", shaderFile);
+		hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
+	}
 	if (hr != S_OK)
 	{
 		if (ReportErrors)
@@ -94,37 +212,206 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	return LoadShaderBlob(shaderFile);
+}
+
+// --------------------------------------------------------
+// Loads a shader from compiled bytecode already in memory
+// (like an asset pack's), copying it into the shader's blob
+//
+// bytecode - The compiled shader
+// size - Bytes of bytecode
+// shaderName - What to call it in any errors
+//
+// Returns true if shader is loaded properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderBytecode(const void* bytecode, size_t size, LPCWSTR shaderName)
+{
+	HRESULT hr = D3DCreateBlob(size, shaderBlob.GetAddressOf());
+	if (hr != S_OK)
+	{
+		if (ReportErrors)
+		{
+			LogError("SimpleShader::LoadShaderBytecode() - Error allocating bytecode for '");
+			LogW(shaderName);
+			LogError("'.\n");
+		}
+
+		return false;
+	}
+
+	memcpy(shaderBlob->GetBufferPointer(), bytecode, size);
+	return LoadShaderBlob(shaderName);
+}
+
+// --------------------------------------------------------
+// Creates the shader and its constant buffers from the
+// bytecode that's been loaded into the blob
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderBlob(LPCWSTR shaderName)
+{
+	// Get the reflected layout of this shader first, since vertex and
+	// compute shaders are created from it - it's only built the first
+	// time this bytecode is loaded (or never, if it's in the cache)
+	{
+		LoadProfileScope scope("Reflection", shaderName);
+		reflection = InternReflection(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize());
+	}
+
 	// Create the shader - Calls an overloaded version of this abstract
 	// method in the appropriate child class
-	shaderValid = CreateShader(shaderBlob);
+	if (reflection)
+	{
+		LoadProfileScope scope("GPU Create", shaderName);
+		shaderValid = CreateShader(shaderBlob);
+	}
+	else
+	{
+		shaderValid = false;
+	}
+
 	if (!shaderValid)
 	{
+		reflection.reset();
 		if (ReportErrors)
 		{
 			LogError("SimpleShader::LoadShaderFile() - Error creating shader from file '");
-			LogW(shaderFile);
+			LogW(shaderName);
 			LogError("'. Ensure the type of shader (vertex, pixel, etc.) matches the SimpleShader type (SimpleVertexShader, SimplePixelShader, etc.) you're using.\n");
 		}
 
 		return false;
 	}
 
+	// Create this instance's buffers to match
+	constantBufferCount = (unsigned int)reflection->Buffers.size();
+	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
+	for (unsigned int b = 0; b < constantBufferCount; b++)
+	{
+		const SimpleBufferLayout& layout = reflection->Buffers[b];
+		constantBuffers[b].Type = layout.Type;
+		constantBuffers[b].BindIndex = layout.BindIndex;
+
+		// Create this constant buffer
+		D3D11_BUFFER_DESC newBuffDesc = {};
+		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
+		newBuffDesc.ByteWidth = layout.Size;
+		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		newBuffDesc.CPUAccessFlags = 0;
+		newBuffDesc.MiscFlags = 0;
+		newBuffDesc.StructureByteStride = 0;
+		GpuMemory::CreateBuffer(device.Get(), &newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf(), GpuMemoryCategory::Buffers, layout.Name);
+
+		// Set up the data buffer for this constant buffer
+		constantBuffers[b].Size = layout.Size;
+		constantBuffers[b].LocalDataBuffer = new unsigned char[layout.Size];
+		ZeroMemory(constantBuffers[b].LocalDataBuffer, layout.Size);
+	}
+
+	// All set
+	return true;
+}
+
+// --------------------------------------------------------
+// Finds the shared reflection for a shader's bytecode,
+// building it if no other shader has this bytecode (and
+// it isn't in the reflection cache)
+//
+// bytecode - The compiled shader
+// size - Bytes of bytecode
+//
+// Returns the reflection, or null if reflection failed
+// --------------------------------------------------------
+std::shared_ptr<const SimpleShaderReflection> ISimpleShader::InternReflection(const void* bytecode, size_t size)
+{
+	// 64 bit FNV-1a of the whole bytecode
+	const unsigned char* bytes = (const unsigned char*)bytecode;
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+	std::lock_guard<std::mutex> lock(reflectionMutex);
+
+	// Already reflected and still in use?
+	auto it = reflections.find(hash);
+	if (it != reflections.end())
+	{
+		std::shared_ptr<const SimpleShaderReflection> existing = it->second.lock();
+		if (existing && existing->BytecodeSize == size)
+			return existing;
+	}
+
+	// Or cached, from the file or from earlier in this run
+	std::shared_ptr<const SimpleShaderReflection> result;
+	auto cached = cachedReflections.find(hash);
+	if (cached != cachedReflections.end() && cached->second->BytecodeSize == size)
+	{
+		result = cached->second;
+
+		// The first time one from the file is used is what it saves
+		if (usedCachedReflections.insert({ hash, true }).second)
+		{
+			reflectionCacheStats.Hits++;
+			reflectionCacheStats.SavedMilliseconds += result->ReflectMilliseconds;
+		}
+	}
+	else
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		std::shared_ptr<SimpleShaderReflection> built = BuildReflection(bytecode, size);
+		if (!built)
+			return nullptr;
+
+		built->BytecodeHash = hash;
+		built->BytecodeSize = size;
+		built->ReflectMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		reflectionCacheStats.Reflected++;
+		reflectionCacheStats.ReflectMilliseconds += built->ReflectMilliseconds;
+
+		cachedReflections[hash] = built;
+		usedCachedReflections[hash] = false;
+		result = built;
+	}
+
+	// Drop any reflections nobody uses anymore while we're here
+	for (auto e = reflections.begin(); e != reflections.end();)
+		e = e->second.expired() ? reflections.erase(e) : std::next(e);
+
+	reflections[hash] = result;
+	return result;
+}
+
+unsigned int ISimpleShader::GetShaderType(const void* bytecode, size_t size)
+{
+	std::shared_ptr<const SimpleShaderReflection> found = InternReflection(bytecode, size);
+	return found ? found->ShaderType : (unsigned int)-1;
+}
+
+// --------------------------------------------------------
+// Reflects a shader's buffers, variables and resources
+// into flat arrays for a SimpleShaderReflection, along
+// with its inputs (vertex shaders) or thread group size
+// and UAVs (compute shaders)
+// --------------------------------------------------------
+std::shared_ptr<SimpleShaderReflection> ISimpleShader::BuildReflection(const void* bytecode, size_t size)
+{
 	// Set up shader reflection to get information about
 	// this shader and its variables,  buffers, etc.
 	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
+	HRESULT hr = D3DReflect(
+		bytecode,
+		size,
 		IID_ID3D11ShaderReflection,
 		(void**)refl.GetAddressOf());
+	if (FAILED(hr))
+		return nullptr;
+
+	std::shared_ptr<SimpleShaderReflection> result = std::make_shared<SimpleShaderReflection>();
 
 	// Get the description of the shader
 	D3D11_SHADER_DESC shaderDesc;
 	refl->GetDesc(&shaderDesc);
-
-	// Create resource arrays
-	constantBufferCount = shaderDesc.ConstantBuffers;
-	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
+	result->ShaderType = D3D11_SHVER_GET_TYPE(shaderDesc.Version);
 
 	// Handle bound resources (like shaders and samplers)
 	unsigned int resourceCount = shaderDesc.BoundResources;
@@ -140,32 +427,39 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		case D3D_SIT_STRUCTURED: // Treat structured buffers as texture resources
 		case D3D_SIT_TEXTURE: // A texture resource
 		{
-			// Create the SRV wrapper
-			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;				// Shader bind point
-			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
-
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
-			shaderResourceViews.push_back(srv);
+			SimpleSRV srv;
+			srv.BindIndex = resourceDesc.BindPoint;							// Shader bind point
+			srv.Index = (unsigned int)result->ShaderResourceViews.size();	// Raw index
+			result->ShaderResourceViews.push_back(srv);
+			result->ShaderResourceViewNames.push_back(resourceDesc.Name);
 		}
 		break;
 
 		case D3D_SIT_SAMPLER: // A sampler resource
 		{
-			// Create the sampler wrapper
-			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;			// Shader bind point
-			samp->Index = (unsigned int)samplerStates.size();	// Raw index
-
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
-			samplerStates.push_back(samp);
+			SimpleSampler samp;
+			samp.BindIndex = resourceDesc.BindPoint;				// Shader bind point
+			samp.Index = (unsigned int)result->Samplers.size();	// Raw index
+			result->Samplers.push_back(samp);
+			result->SamplerNames.push_back(resourceDesc.Name);
 		}
 		break;
+
+		// Any kind of UAV (which only compute shaders look up by name)
+		case D3D_SIT_UAV_APPEND_STRUCTURED:
+		case D3D_SIT_UAV_CONSUME_STRUCTURED:
+		case D3D_SIT_UAV_RWBYTEADDRESS:
+		case D3D_SIT_UAV_RWSTRUCTURED:
+		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
+		case D3D_SIT_UAV_RWTYPED:
+			result->UAVs.push_back({ resourceDesc.Name, resourceDesc.BindPoint });
+			break;
 		}
 	}
 
 	// Loop through all constant buffers
-	for (unsigned int b = 0; b < constantBufferCount; b++)
+	std::vector<std::string> bufferNames;
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
 	{
 		// Get this buffer
 		ID3D11ShaderReflectionConstantBuffer* cb =
@@ -175,62 +469,153 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		D3D11_SHADER_BUFFER_DESC bufferDesc;
 		cb->GetDesc(&bufferDesc);
 
-		// Save the type, which we reference when setting these buffers
-		constantBuffers[b].Type = bufferDesc.Type;
-
 		// Get the description of the resource binding, so
 		// we know exactly how it's bound in the shader
 		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
 		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
 
-		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
-		constantBuffers[b].Name = bufferDesc.Name;
-		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
-
-		// Create this constant buffer
-		D3D11_BUFFER_DESC newBuffDesc = {};
-		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
-		newBuffDesc.ByteWidth = bufferDesc.Size;
-		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		newBuffDesc.CPUAccessFlags = 0;
-		newBuffDesc.MiscFlags = 0;
-		newBuffDesc.StructureByteStride = 0;
-		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
-
-		// Set up the data buffer for this constant buffer
-		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		SimpleBufferLayout layout;
+		layout.Name = bufferDesc.Name;
+		layout.Type = bufferDesc.Type;
+		layout.Size = bufferDesc.Size;
+		layout.BindIndex = bindDesc.BindPoint;
+		layout.FirstVariable = (unsigned int)result->Variables.size();
+		layout.VariableCount = bufferDesc.Variables;
+		result->Buffers.push_back(layout);
+		bufferNames.push_back(layout.Name);
 
 		// Loop through all variables in this buffer
 		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
 		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-
-			// Get the description of the variable and its type
+			// Get the description of this variable
 			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
+			cb->GetVariableByIndex(v)->GetDesc(&varDesc);
 
-			// Create the variable struct
 			SimpleShaderVariable varStruct = {};
 			varStruct.ConstantBufferIndex = b;
 			varStruct.ByteOffset = varDesc.StartOffset;
 			varStruct.Size = varDesc.Size;
+			result->Variables.push_back(varStruct);
+			result->VariableNames.push_back(varDesc.Name);
+		}
+	}
 
-			// Get a string version
-			std::string varName(varDesc.Name);
+	// Vertex shader inputs, for an input layout that matches what it expects
+	//  - Code adapted from: https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
+	if (result->ShaderType == D3D11_SHVER_VERTEX_SHADER)
+	{
+		for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+		{
+			D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+			refl->GetInputParameterDesc(i, &paramDesc);
+
+			// Check the semantic name for "_PER_INSTANCE"
+			std::string perInstanceStr = "_PER_INSTANCE";
+			std::string sem = paramDesc.SemanticName;
+			int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
+
+			SimpleInputElement input = {};
+			input.SemanticName = sem;
+			input.SemanticIndex = paramDesc.SemanticIndex;
+			input.PerInstance = lenDiff >= 0 && sem.compare(lenDiff, perInstanceStr.size(), perInstanceStr) == 0;
+
+			// Determine DXGI format
+			input.Format = DXGI_FORMAT_UNKNOWN;
+			if (paramDesc.Mask == 1)
+			{
+				if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) input.Format = DXGI_FORMAT_R32_UINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) input.Format = DXGI_FORMAT_R32_SINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) input.Format = DXGI_FORMAT_R32_FLOAT;
+			}
+			else if (paramDesc.Mask <= 3)
+			{
+				if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) input.Format = DXGI_FORMAT_R32G32_UINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) input.Format = DXGI_FORMAT_R32G32_SINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) input.Format = DXGI_FORMAT_R32G32_FLOAT;
+			}
+			else if (paramDesc.Mask <= 7)
+			{
+				if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) input.Format = DXGI_FORMAT_R32G32B32_UINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) input.Format = DXGI_FORMAT_R32G32B32_SINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) input.Format = DXGI_FORMAT_R32G32B32_FLOAT;
+			}
+			else if (paramDesc.Mask <= 15)
+			{
+				if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) input.Format = DXGI_FORMAT_R32G32B32A32_UINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) input.Format = DXGI_FORMAT_R32G32B32A32_SINT;
+				else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) input.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			}
+			result->InputElements.push_back(input);
+		}
+	}
 
-			// Add this variable to the table and the constant buffer
-			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
-			constantBuffers[b].Variables.push_back(varStruct);
+	// Compute shader thread group size
+	if (result->ShaderType == D3D11_SHVER_COMPUTE_SHADER)
+		refl->GetThreadGroupSize(&result->ThreadGroupSize[0], &result->ThreadGroupSize[1], &result->ThreadGroupSize[2]);
+
+	// Sort the names for lookups
+	SortHashes(result->BufferHashes, bufferNames);
+	SortHashes(result->VariableHashes, result->VariableNames);
+	SortHashes(result->SRVHashes, result->ShaderResourceViewNames);
+	SortHashes(result->SamplerHashes, result->SamplerNames);
+	return result;
+}
+
+// --------------------------------------------------------
+// Builds a sorted (hash, handle) table for a list of names
+//  - A name used twice (like a variable in two buffers)
+//    keeps its first handle, as it always has
+//  - Two different names with the same hash can't both be
+//    set by hashed name, which gets a warning
+// --------------------------------------------------------
+void ISimpleShader::SortHashes(SimpleShaderReflection::HashTable& table, const std::vector<std::string>& names)
+{
+	table.clear();
+	table.reserve(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+		table.push_back({ SimpleShaderName::HashName(names[i].c_str(), names[i].size()), (SimpleShaderHandle)i });
+
+	// Stable, so equal hashes stay in handle order
+	std::stable_sort(table.begin(), table.end(),
+		[](const std::pair<unsigned int, SimpleShaderHandle>& a, const std::pair<unsigned int, SimpleShaderHandle>& b) { return a.first < b.first; });
+
+	// Keep only the first handle for each hash
+	size_t kept = 0;
+	for (size_t i = 0; i < table.size(); i++)
+	{
+		if (kept > 0 && table[kept - 1].first == table[i].first)
+		{
+			if (names[table[kept - 1].second] != names[table[i].second] && ReportWarnings)
+			{
+				LogWarning("SimpleShader::LoadShaderFile() - The name '");
+				Log(names[table[i].second]);
+				LogWarning("' has the same hash as another name in this shader, so it can't be set by hashed name.\n");
+			}
+			continue;
 		}
+		table[kept++] = table[i];
 	}
+	table.resize(kept);
+}
 
-	// All set
-	return true;
+SimpleShaderHandle ISimpleShader::FindHash(const SimpleShaderReflection::HashTable& table, const SimpleShaderName& name)
+{
+	auto result = std::lower_bound(table.begin(), table.end(), name.Hash,
+		[](const std::pair<unsigned int, SimpleShaderHandle>& entry, unsigned int hash) { return entry.first < hash; });
+	return (result == table.end() || result->first != name.Hash) ? SIMPLE_SHADER_INVALID_HANDLE : result->second;
+}
+
+SimpleShaderHandle ISimpleShader::FindName(const SimpleShaderReflection::HashTable& table, const std::vector<std::string>& names, const std::string& name)
+{
+	SimpleShaderHandle handle = FindHash(table, SimpleShaderName(name.c_str(), name.size()));
+	if (handle == SIMPLE_SHADER_INVALID_HANDLE || names[handle] == name)
+		return handle;
+
+	// Its hash is shared with another name
+	for (size_t i = 0; i < names.size(); i++)
+		if (names[i] == name)
+			return (SimpleShaderHandle)i;
+	return SIMPLE_SHADER_INVALID_HANDLE;
 }
 
 // --------------------------------------------------------
@@ -240,18 +625,17 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 // name - the name of the variable to look for
 // size - the size of the variable (for verification), or -1 to bypass
 // --------------------------------------------------------
-SimpleShaderVariable* ISimpleShader::FindVariable(std::string name, int size)
+const SimpleShaderVariable* ISimpleShader::FindVariable(std::string name, int size)
 {
-	// Look for the key
-	std::unordered_map<std::string, SimpleShaderVariable>::iterator result =
-		varTable.find(name);
+	if (!reflection)
+		return 0;
 
-	// Did we find the key?
-	if (result == varTable.end())
+	// Look for the name
+	SimpleShaderHandle handle = FindName(reflection->VariableHashes, reflection->VariableNames, name);
+	if (handle == SIMPLE_SHADER_INVALID_HANDLE)
 		return 0;
 
-	// Grab the result from the iterator
-	SimpleShaderVariable* var = &(result->second);
+	const SimpleShaderVariable* var = &reflection->Variables[handle];
 
 	// Is the data size correct ?
 	if (size > 0 && var->Size != size)
@@ -266,16 +650,16 @@ SimpleShaderVariable* ISimpleShader::FindVariable(std::string name, int size)
 // --------------------------------------------------------
 SimpleConstantBuffer* ISimpleShader::FindConstantBuffer(std::string name)
 {
-	// Look for the key
-	std::unordered_map<std::string, SimpleConstantBuffer*>::iterator result =
-		cbTable.find(name);
-
-	// Did we find the key?
-	if (result == cbTable.end())
+	if (!reflection)
 		return 0;
 
-	// Success
-	return result->second;
+	// There are only ever a few buffers
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+		if (reflection->Buffers[i].Name == name)
+			return &constantBuffers[i];
+
+	// Not found
+	return 0;
 }
 
 // --------------------------------------------------------
@@ -348,10 +732,11 @@ void ISimpleShader::CopyAllBufferData()
 	// Loop through the constant buffers and copy all data
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
+		// Skip buffers that are filled elsewhere
+		if (constantBuffers[i].External)
+			continue;
+
+		UploadBuffer(&constantBuffers[i]);
 	}
 }
 
@@ -377,12 +762,9 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
-	if (!cb) return;
+	if (!cb || cb->External) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0,
-		cb->LocalDataBuffer, 0, 0);
+	UploadBuffer(cb);
 }
 
 // --------------------------------------------------------
@@ -392,6 +774,13 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 //              Useful for updating more frequently-changing
 //              variables without having to re-copy all buffers.
 // --------------------------------------------------------
+void ISimpleShader::CopyBufferData(const SimpleShaderName& bufferName)
+{
+	SimpleShaderHandle handle = GetBufferHandle(bufferName);
+	if (handle != SIMPLE_SHADER_INVALID_HANDLE)
+		CopyBufferData((unsigned int)handle);
+}
+
 void ISimpleShader::CopyBufferData(std::string bufferName)
 {
 	// Ensure the shader is valid
@@ -399,12 +788,209 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
-	if (!cb) return;
+	if (!cb || cb->External) return;
+
+	UploadBuffer(cb);
+}
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
+// --------------------------------------------------------
+// Copies a buffer's local data to the GPU, unless it hasn't
+// changed since it was last copied on this same context
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer* cb)
+{
+	ID3D11DeviceContext* context = GetContext();
+
+	// Ring-backed buffers get a new slice whenever they change, and
+	// are rebound either way since another shader may have bound its
+	// own slice to the same slot
+	if (cb->RingBacked)
+	{
+		SimpleShaderStateCache* cache = GetStateCache();
+		bool sliceCurrent = cb->UploadedContext == context && cb->RingGeneration == cache->RingGeneration;
+		if (!cb->Dirty && sliceCurrent)
+			bufferUploadsSkipped++;
+		else if (WriteToRing(cb, cache))
+		{
+			bufferUploadsIssued++;
+			DrawStats::Count(DrawCounter::ConstantBufferUploads);
+			DrawStats::Count(DrawCounter::ConstantBufferBytes, cb->Size);
+		}
+		else
+		{
+			// Couldn't map, so go back to its own buffer for good
+			cb->RingBacked = false;
+			cb->Dirty = true;
+		}
+
+		if (cb->RingBacked && BindRingSlice(cb))
+			return;
+	}
+	if (!cb->Dirty && cb->UploadedContext == context)
+	{
+		bufferUploadsSkipped++;
+		return;
+	}
+
+	context->UpdateSubresource(
 		cb->ConstantBuffer.Get(), 0, 0,
 		cb->LocalDataBuffer, 0, 0);
+
+	cb->Dirty = false;
+	cb->UploadedContext = context;
+	bufferUploadsIssued++;
+	DrawStats::Count(DrawCounter::ConstantBufferUploads);
+	DrawStats::Count(DrawCounter::ConstantBufferBytes, cb->Size);
+}
+
+// --------------------------------------------------------
+// Appends a buffer's local data to the calling context's ring
+//  - The first write of each frame, and any write that would run
+//    off the end, discards the whole ring and starts over
+// --------------------------------------------------------
+bool ISimpleShader::WriteToRing(SimpleConstantBuffer* cb, SimpleShaderStateCache* cache)
+{
+	ID3D11DeviceContext* context = GetContext();
+	if (!cache->Context1)
+		return false;
+
+	if (!cache->Ring)
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = SIMPLE_SHADER_RING_SIZE;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		if (FAILED(GpuMemory::CreateBuffer(device.Get(), &desc, 0, cache->Ring.GetAddressOf(), GpuMemoryCategory::Buffers, "Constant Buffer Ring")))
+			return false;
+		cache->RingFrame = frameIndex - 1;
+	}
+
+	// Offsets are in whole 16-constant (256 byte) blocks
+	unsigned int size = (cb->Size + 255) & ~255u;
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (cache->RingFrame != frameIndex || cache->RingOffset + size > SIMPLE_SHADER_RING_SIZE)
+	{
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		cache->RingOffset = 0;
+		cache->RingFrame = frameIndex;
+		cache->RingGeneration++;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	DrawStats::Count(DrawCounter::Maps);
+	if (FAILED(context->Map(cache->Ring.Get(), 0, mapType, 0, &mapped)))
+		return false;
+	memcpy((unsigned char*)mapped.pData + cache->RingOffset, cb->LocalDataBuffer, cb->Size);
+	context->Unmap(cache->Ring.Get(), 0);
+
+	cb->Dirty = false;
+	cb->UploadedContext = context;
+	cb->RingGeneration = cache->RingGeneration;
+	cb->RingFirstConstant = cache->RingOffset / 16;
+	cb->RingConstantCount = size / 16;
+	cache->RingOffset += size;
+	return true;
+}
+
+// --------------------------------------------------------
+// Binds a ring-backed buffer's latest slice, if it's still
+// valid on the calling context
+// --------------------------------------------------------
+bool ISimpleShader::BindRingSlice(SimpleConstantBuffer* cb)
+{
+	SimpleShaderStateCache* cache = GetStateCache();
+	if (!cache->Context1 || !cache->Ring ||
+		cb->UploadedContext != GetContext() ||
+		cb->RingGeneration != cache->RingGeneration)
+		return false;
+
+	BindConstantBufferRange(cache->Context1.Get(), cb->BindIndex, cache->Ring.Get(), cb->RingFirstConstant, cb->RingConstantCount);
+	return true;
+}
+
+// --------------------------------------------------------
+// Copies data into a variable's spot in its local buffer,
+// and marks the buffer dirty only if any bytes changed
+// --------------------------------------------------------
+void ISimpleShader::WriteLocalData(const SimpleShaderVariable* var, const void* data, unsigned int size)
+{
+	SimpleConstantBuffer* cb = &constantBuffers[var->ConstantBufferIndex];
+	unsigned char* dest = cb->LocalDataBuffer + var->ByteOffset;
+	if (memcmp(dest, data, size) == 0)
+		return;
+
+	memcpy(dest, data, size);
+	cb->Dirty = true;
+}
+
+// --------------------------------------------------------
+// Backs one of this shader's constant buffers with the per
+// context constant rings, if the device supports binding
+// constant buffer ranges and no-overwrite maps of them
+//
+// bufferName - The name of the buffer to back with the ring
+//
+// Returns true if the buffer is now ring-backed
+// --------------------------------------------------------
+bool ISimpleShader::SetRingBacked(std::string bufferName)
+{
+	if (ringSupport == -1)
+	{
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+		ringSupport =
+			SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+			options.ConstantBufferOffsetting &&
+			options.MapNoOverwriteOnDynamicConstantBuffer;
+	}
+
+	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
+	if (!cb || cb->External || cb->Type != D3D11_CT_CBUFFER || !ringSupport)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetRingBacked() - Constant buffer '");
+			Log(bufferName);
+			LogWarning("' not found, or the device can't bind constant buffer ranges.\n");
+		}
+		return false;
+	}
+
+	cb->RingBacked = true;
+	cb->Dirty = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// Replaces this shader's own constant buffer with one that
+// is created and filled elsewhere, so the same data can be
+// shared by many shaders and uploaded just once.  The buffer
+// is still bound by SetShader(), but local data is never
+// copied into it.
+//
+// bufferName - The name of the buffer to replace
+// buffer - The buffer to bind instead (must be at least as large)
+//
+// Returns true if the buffer was replaced
+// --------------------------------------------------------
+bool ISimpleShader::SetExternalConstantBuffer(std::string bufferName, Microsoft::WRL::ComPtr<ID3D11Buffer> buffer)
+{
+	// Check for the buffer
+	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
+	if (!cb)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetExternalConstantBuffer() - Constant buffer '");
+			Log(bufferName);
+			LogWarning("' not found. Ensure the name is spelled correctly and that it exists in the shader.\n");
+		}
+		return false;
+	}
+
+	cb->ConstantBuffer = buffer;
+	cb->External = true;
+	return true;
 }
 
 
@@ -420,7 +1006,7 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 bool ISimpleShader::SetData(std::string name, const void* data, unsigned int size)
 {
 	// Look for the variable and verify
-	SimpleShaderVariable* var = FindVariable(name, -1);
+	const SimpleShaderVariable* var = FindVariable(name, -1);
 	if (var == 0)
 	{
 		if (ReportWarnings)
@@ -446,15 +1032,88 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 	}
 
 	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
-		data,
-		size);
+	WriteLocalData(var, data, size);
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Copies a struct into a buffer's local data in one go,
+// for the WriteBuffer() templates
+//
+// buffer - Handle of the buffer to fill
+// data - The struct
+// size - Size of the struct, which must match the buffer exactly
+// fields - Optional members to check against the reflection
+//
+// Returns true if the struct matched and was copied
+// --------------------------------------------------------
+bool ISimpleShader::WriteBufferData(SimpleShaderHandle buffer, const void* data, unsigned int size, const SimpleBufferField* fields, unsigned int fieldCount)
+{
+	if (buffer < 0 || buffer >= (SimpleShaderHandle)constantBufferCount)
+		return false;
+
+	// Only check the layout once per struct size
+	SimpleConstantBuffer* cb = &constantBuffers[buffer];
+	if (cb->CheckedStructSize != size)
+	{
+		cb->CheckedStructSize = size;
+		cb->StructMatches = CheckBufferLayout(buffer, size, fields, fieldCount);
+	}
+
+	if (!cb->StructMatches)
+		return false;
+
+	if (memcmp(cb->LocalDataBuffer, data, size) != 0)
+	{
+		memcpy(cb->LocalDataBuffer, data, size);
+		cb->Dirty = true;
+	}
+	return true;
+}
+
+// --------------------------------------------------------
+// Compares a struct's size and fields with the reflected
+// layout of one of this shader's buffers
+// --------------------------------------------------------
+bool ISimpleShader::CheckBufferLayout(unsigned int index, unsigned int size, const SimpleBufferField* fields, unsigned int fieldCount)
+{
+	const SimpleBufferLayout& layout = reflection->Buffers[index];
+	if (size != layout.Size)
+	{
+		if (ReportErrors)
+		{
+			LogError("SimpleShader::WriteBuffer() - Struct size doesn't match constant buffer '");
+			Log(layout.Name);
+			LogError("'.\n");
+		}
+		return false;
+	}
+
+	for (unsigned int i = 0; i < fieldCount; i++)
+	{
+		const SimpleShaderVariable* var = FindVariable(fields[i].Name, -1);
+		if (var == 0 ||
+			var->ConstantBufferIndex != index ||
+			var->ByteOffset != fields[i].Offset ||
+			var->Size != fields[i].Size)
+		{
+			if (ReportErrors)
+			{
+				LogError("SimpleShader::WriteBuffer() - Field '");
+				Log(fields[i].Name);
+				LogError("' doesn't match its variable in constant buffer '");
+				Log(layout.Name);
+				LogError("'.\n");
+			}
+			return false;
+		}
+	}
+
+	return true;
+}
+
 // --------------------------------------------------------
 // Sets INTEGER data
 // --------------------------------------------------------
@@ -484,61 +1143,244 @@ bool ISimpleShader::SetFloat2(std::string name, const float data[2])
 // --------------------------------------------------------
 bool ISimpleShader::SetFloat2(std::string name, const DirectX::XMFLOAT2 data)
 {
-	return this->SetData(name, &data, sizeof(float) * 2);
+	return this->SetData(name, &data, sizeof(float) * 2);
+}
+
+// --------------------------------------------------------
+// Sets a FLOAT3 variable by name in the local data buffer
+// --------------------------------------------------------
+bool ISimpleShader::SetFloat3(std::string name, const float data[3])
+{
+	return this->SetData(name, (void*)data, sizeof(float) * 3);
+}
+
+// --------------------------------------------------------
+// Sets a FLOAT3 variable by name in the local data buffer
+// --------------------------------------------------------
+bool ISimpleShader::SetFloat3(std::string name, const DirectX::XMFLOAT3 data)
+{
+	return this->SetData(name, &data, sizeof(float) * 3);
+}
+
+// --------------------------------------------------------
+// Sets a FLOAT4 variable by name in the local data buffer
+// --------------------------------------------------------
+bool ISimpleShader::SetFloat4(std::string name, const float data[4])
+{
+	return this->SetData(name, (void*)data, sizeof(float) * 4);
+}
+
+// --------------------------------------------------------
+// Sets a FLOAT4 variable by name in the local data buffer
+// --------------------------------------------------------
+bool ISimpleShader::SetFloat4(std::string name, const DirectX::XMFLOAT4 data)
+{
+	return this->SetData(name, &data, sizeof(float) * 4);
+}
+
+// --------------------------------------------------------
+// Sets a MATRIX (4x4) variable by name in the local data buffer
+// --------------------------------------------------------
+bool ISimpleShader::SetMatrix4x4(std::string name, const float data[16])
+{
+	return this->SetData(name, (void*)data, sizeof(float) * 16);
+}
+
+// --------------------------------------------------------
+// Sets a MATRIX (4x4) variable by name in the local data buffer
+// --------------------------------------------------------
+bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data)
+{
+	return this->SetData(name, &data, sizeof(float) * 16);
+}
+
+// --------------------------------------------------------
+// Determines if the shader contains the specified
+// variable within one of its constant buffers
+// --------------------------------------------------------
+// --------------------------------------------------------
+// Sets a shader resource view, by name
+//
+// name - The name of the texture resource in the shader
+// srv - The shader resource view of the texture in GPU memory
+//
+// Returns true if a texture of the given name was found, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	// Look for the variable and verify
+	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
+	if (srvInfo == 0)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetShaderResourceView() - SRV named '");
+			Log(name);
+			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
+		}
+		return false;
+	}
+
+	BindShaderResourceView(srvInfo->BindIndex, srv.Get());
+	return true;
+}
+
+// --------------------------------------------------------
+// Sets a sampler state, by name
+//
+// name - The name of the sampler state in the shader
+// samplerState - The sampler state in GPU memory
+//
+// Returns true if a sampler of the given name was found, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+{
+	// Look for the variable and verify
+	const SimpleSampler* sampInfo = GetSamplerInfo(name);
+	if (sampInfo == 0)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetSamplerState() - Sampler named '");
+			Log(name);
+			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
+		}
+		return false;
+	}
+
+	BindSamplerState(sampInfo->BindIndex, samplerState.Get());
+	return true;
+}
+
+
+// --------------------------------------------------------
+// Handle lookups - each one is only worth doing once
+// --------------------------------------------------------
+SimpleShaderHandle ISimpleShader::GetVariableHandle(std::string name)
+{
+	return GetVariableHandle(SimpleShaderName(name.c_str(), name.size()));
+}
+
+SimpleShaderHandle ISimpleShader::GetVariableHandle(const SimpleShaderName& name)
+{
+	return reflection ? FindHash(reflection->VariableHashes, name) : SIMPLE_SHADER_INVALID_HANDLE;
+}
+
+SimpleShaderHandle ISimpleShader::GetBufferHandle(std::string name)
+{
+	return GetBufferHandle(SimpleShaderName(name.c_str(), name.size()));
+}
+
+SimpleShaderHandle ISimpleShader::GetBufferHandle(const SimpleShaderName& name)
+{
+	return reflection ? FindHash(reflection->BufferHashes, name) : SIMPLE_SHADER_INVALID_HANDLE;
+}
+
+SimpleShaderHandle ISimpleShader::GetShaderResourceViewHandle(std::string name)
+{
+	return GetShaderResourceViewHandle(SimpleShaderName(name.c_str(), name.size()));
+}
+
+SimpleShaderHandle ISimpleShader::GetShaderResourceViewHandle(const SimpleShaderName& name)
+{
+	return reflection ? FindHash(reflection->SRVHashes, name) : SIMPLE_SHADER_INVALID_HANDLE;
+}
+
+SimpleShaderHandle ISimpleShader::GetSamplerHandle(std::string name)
+{
+	return GetSamplerHandle(SimpleShaderName(name.c_str(), name.size()));
+}
+
+SimpleShaderHandle ISimpleShader::GetSamplerHandle(const SimpleShaderName& name)
+{
+	return reflection ? FindHash(reflection->SamplerHashes, name) : SIMPLE_SHADER_INVALID_HANDLE;
 }
 
+
 // --------------------------------------------------------
-// Sets a FLOAT3 variable by name in the local data buffer
+// Sets data by handle - no strings, no lookups
+//
+// variable - The handle from GetVariableHandle()
+// data - Pointer to the data
+// size - The size of the data, which can't be more than
+//        the size of the variable
+//
+// Returns true if the handle was valid and the data fit
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat3(std::string name, const float data[3])
+bool ISimpleShader::SetData(SimpleShaderHandle variable, const void* data, unsigned int size)
 {
-	return this->SetData(name, (void*)data, sizeof(float) * 3);
+	if (!reflection || variable < 0 || variable >= (SimpleShaderHandle)reflection->Variables.size())
+		return false;
+
+	const SimpleShaderVariable* var = &reflection->Variables[variable];
+	if (size > var->Size)
+		return false;
+
+	WriteLocalData(var, data, size);
+	return true;
 }
 
-// --------------------------------------------------------
-// Sets a FLOAT3 variable by name in the local data buffer
-// --------------------------------------------------------
-bool ISimpleShader::SetFloat3(std::string name, const DirectX::XMFLOAT3 data)
+bool ISimpleShader::SetInt(SimpleShaderHandle variable, int data) { return SetData(variable, &data, sizeof(int)); }
+bool ISimpleShader::SetFloat(SimpleShaderHandle variable, float data) { return SetData(variable, &data, sizeof(float)); }
+bool ISimpleShader::SetFloat2(SimpleShaderHandle variable, const DirectX::XMFLOAT2 data) { return SetData(variable, &data, sizeof(float) * 2); }
+bool ISimpleShader::SetFloat3(SimpleShaderHandle variable, const DirectX::XMFLOAT3 data) { return SetData(variable, &data, sizeof(float) * 3); }
+bool ISimpleShader::SetFloat4(SimpleShaderHandle variable, const DirectX::XMFLOAT4 data) { return SetData(variable, &data, sizeof(float) * 4); }
+bool ISimpleShader::SetMatrix4x4(SimpleShaderHandle variable, const DirectX::XMFLOAT4X4 data) { return SetData(variable, &data, sizeof(float) * 16); }
+
+bool ISimpleShader::SetShaderResourceView(SimpleShaderHandle srv, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> view)
 {
-	return this->SetData(name, &data, sizeof(float) * 3);
+	if (!reflection || srv < 0 || srv >= (SimpleShaderHandle)reflection->ShaderResourceViews.size())
+		return false;
+
+	BindShaderResourceView(reflection->ShaderResourceViews[srv].BindIndex, view.Get());
+	return true;
 }
 
-// --------------------------------------------------------
-// Sets a FLOAT4 variable by name in the local data buffer
-// --------------------------------------------------------
-bool ISimpleShader::SetFloat4(std::string name, const float data[4])
+bool ISimpleShader::SetSamplerState(SimpleShaderHandle sampler, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
 {
-	return this->SetData(name, (void*)data, sizeof(float) * 4);
+	if (!reflection || sampler < 0 || sampler >= (SimpleShaderHandle)reflection->Samplers.size())
+		return false;
+
+	BindSamplerState(reflection->Samplers[sampler].BindIndex, samplerState.Get());
+	return true;
 }
 
+
 // --------------------------------------------------------
-// Sets a FLOAT4 variable by name in the local data buffer
+// Sets data by compile time hashed name, which is one
+// integer lookup rather than building and hashing a string
 // --------------------------------------------------------
-bool ISimpleShader::SetFloat4(std::string name, const DirectX::XMFLOAT4 data)
+bool ISimpleShader::SetData(const SimpleShaderName& name, const void* data, unsigned int size)
 {
-	return this->SetData(name, &data, sizeof(float) * 4);
+	if (SetData(GetVariableHandle(name), data, size))
+		return true;
+
+	if (ReportWarnings)
+	{
+		LogWarning("SimpleShader::SetData() - Shader variable '");
+		Log(name.Text);
+		LogWarning("' not found, or is smaller than the data being set.\n");
+	}
+	return false;
 }
 
-// --------------------------------------------------------
-// Sets a MATRIX (4x4) variable by name in the local data buffer
-// --------------------------------------------------------
-bool ISimpleShader::SetMatrix4x4(std::string name, const float data[16])
+bool ISimpleShader::SetInt(const SimpleShaderName& name, int data) { return SetData(name, &data, sizeof(int)); }
+bool ISimpleShader::SetFloat(const SimpleShaderName& name, float data) { return SetData(name, &data, sizeof(float)); }
+bool ISimpleShader::SetFloat2(const SimpleShaderName& name, const DirectX::XMFLOAT2 data) { return SetData(name, &data, sizeof(float) * 2); }
+bool ISimpleShader::SetFloat3(const SimpleShaderName& name, const DirectX::XMFLOAT3 data) { return SetData(name, &data, sizeof(float) * 3); }
+bool ISimpleShader::SetFloat4(const SimpleShaderName& name, const DirectX::XMFLOAT4 data) { return SetData(name, &data, sizeof(float) * 4); }
+bool ISimpleShader::SetMatrix4x4(const SimpleShaderName& name, const DirectX::XMFLOAT4X4 data) { return SetData(name, &data, sizeof(float) * 16); }
+
+bool ISimpleShader::SetShaderResourceView(const SimpleShaderName& name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
-	return this->SetData(name, (void*)data, sizeof(float) * 16);
+	return SetShaderResourceView(GetShaderResourceViewHandle(name), srv);
 }
 
-// --------------------------------------------------------
-// Sets a MATRIX (4x4) variable by name in the local data buffer
-// --------------------------------------------------------
-bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data)
+bool ISimpleShader::SetSamplerState(const SimpleShaderName& name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
 {
-	return this->SetData(name, &data, sizeof(float) * 16);
+	return SetSamplerState(GetSamplerHandle(name), samplerState);
 }
 
-// --------------------------------------------------------
-// Determines if the shader contains the specified
-// variable within one of its constant buffers
-// --------------------------------------------------------
 bool ISimpleShader::HasVariable(std::string name)
 {
 	return FindVariable(name, -1) != 0;
@@ -575,16 +1417,16 @@ const SimpleShaderVariable* ISimpleShader::GetVariableInfo(std::string name)
 // --------------------------------------------------------
 const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(std::string name)
 {
-	// Look for the key
-	std::unordered_map<std::string, SimpleSRV*>::iterator result =
-		textureTable.find(name);
+	if (!reflection)
+		return 0;
 
-	// Did we find the key?
-	if (result == textureTable.end())
+	// Look for the name
+	SimpleShaderHandle handle = FindName(reflection->SRVHashes, reflection->ShaderResourceViewNames, name);
+	if (handle == SIMPLE_SHADER_INVALID_HANDLE)
 		return 0;
 
 	// Success
-	return result->second;
+	return &reflection->ShaderResourceViews[handle];
 }
 
 
@@ -596,10 +1438,10 @@ const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(std::string name)
 const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(unsigned int index)
 {
 	// Valid index?
-	if (index >= shaderResourceViews.size()) return 0;
+	if (!reflection || index >= reflection->ShaderResourceViews.size()) return 0;
 
 	// Grab the bind index
-	return shaderResourceViews[index];
+	return &reflection->ShaderResourceViews[index];
 }
 
 
@@ -610,16 +1452,16 @@ const SimpleSRV* ISimpleShader::GetShaderResourceViewInfo(unsigned int index)
 // --------------------------------------------------------
 const SimpleSampler* ISimpleShader::GetSamplerInfo(std::string name)
 {
-	// Look for the key
-	std::unordered_map<std::string, SimpleSampler*>::iterator result =
-		samplerTable.find(name);
+	if (!reflection)
+		return 0;
 
-	// Did we find the key?
-	if (result == samplerTable.end())
+	// Look for the name
+	SimpleShaderHandle handle = FindName(reflection->SamplerHashes, reflection->SamplerNames, name);
+	if (handle == SIMPLE_SHADER_INVALID_HANDLE)
 		return 0;
 
 	// Success
-	return result->second;
+	return &reflection->Samplers[handle];
 }
 
 // --------------------------------------------------------
@@ -630,10 +1472,10 @@ const SimpleSampler* ISimpleShader::GetSamplerInfo(std::string name)
 const SimpleSampler* ISimpleShader::GetSamplerInfo(unsigned int index)
 {
 	// Valid index?
-	if (index >= samplerStates.size()) return 0;
+	if (!reflection || index >= reflection->Samplers.size()) return 0;
 
 	// Grab the bind index
-	return samplerStates[index];
+	return &reflection->Samplers[index];
 }
 
 
@@ -642,6 +1484,256 @@ const SimpleSampler* ISimpleShader::GetSamplerInfo(unsigned int index)
 // --------------------------------------------------------
 unsigned int ISimpleShader::GetBufferCount() { return constantBufferCount; }
 
+// --------------------------------------------------------
+// Gets the number of unique bytecodes reflected so far
+// that are still used by at least one shader
+// --------------------------------------------------------
+size_t ISimpleShader::GetReflectionCount()
+{
+	std::lock_guard<std::mutex> lock(reflectionMutex);
+
+	size_t count = 0;
+	for (auto& r : reflections)
+		count += r.second.expired() ? 0 : 1;
+	return count;
+}
+
+// --------------------------------------------------------
+// Strings and arrays in the reflection cache are a count
+// and then their contents, and everything else is written
+// as it is, since only this build reads it back (the
+// version goes up whenever the reflection changes)
+// --------------------------------------------------------
+static void WriteCacheString(std::ofstream& file, const std::string& text)
+{
+	unsigned int length = (unsigned int)text.size();
+	file.write((const char*)&length, sizeof(length));
+	file.write(text.data(), length);
+}
+
+static void WriteCacheStrings(std::ofstream& file, const std::vector<std::string>& texts)
+{
+	unsigned int count = (unsigned int)texts.size();
+	file.write((const char*)&count, sizeof(count));
+	for (const std::string& text : texts)
+		WriteCacheString(file, text);
+}
+
+template<typename T>
+static void WriteCacheArray(std::ofstream& file, const std::vector<T>& items)
+{
+	unsigned int count = (unsigned int)items.size();
+	file.write((const char*)&count, sizeof(count));
+	file.write((const char*)items.data(), sizeof(T) * count);
+}
+
+static unsigned int ReadCacheCount(std::ifstream& file)
+{
+	unsigned int count = 0;
+	file.read((char*)&count, sizeof(count));
+	if (!file || count > SIMPLE_SHADER_REFLECTION_CACHE_MAX_COUNT)
+	{
+		file.setstate(std::ios::failbit);
+		return 0;
+	}
+	return count;
+}
+
+static void ReadCacheString(std::ifstream& file, std::string& text)
+{
+	text.resize(ReadCacheCount(file));
+	file.read(&text[0], text.size());
+}
+
+static void ReadCacheStrings(std::ifstream& file, std::vector<std::string>& texts)
+{
+	texts.resize(ReadCacheCount(file));
+	for (std::string& text : texts)
+		ReadCacheString(file, text);
+}
+
+template<typename T>
+static void ReadCacheArray(std::ifstream& file, std::vector<T>& items)
+{
+	items.resize(ReadCacheCount(file));
+	file.read((char*)items.data(), sizeof(T) * items.size());
+}
+
+// --------------------------------------------------------
+// Reads every reflection in the file into the cache, or
+// none of them if it's from another version or cut short
+// --------------------------------------------------------
+bool ISimpleShader::LoadReflectionCache(const std::wstring& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	unsigned int header[3] = {};
+	if (!file.is_open() || !file.read((char*)header, sizeof(header)) ||
+		header[0] != SIMPLE_SHADER_REFLECTION_CACHE_MAGIC || header[1] != SIMPLE_SHADER_REFLECTION_CACHE_VERSION ||
+		header[2] > SIMPLE_SHADER_REFLECTION_CACHE_MAX_COUNT)
+		return false;
+
+	std::vector<std::shared_ptr<SimpleShaderReflection>> loaded;
+	for (unsigned int i = 0; i < header[2] && file; i++)
+	{
+		std::shared_ptr<SimpleShaderReflection> entry = std::make_shared<SimpleShaderReflection>();
+		unsigned long long bytecodeSize = 0;
+		file.read((char*)&entry->BytecodeHash, sizeof(entry->BytecodeHash));
+		file.read((char*)&bytecodeSize, sizeof(bytecodeSize));
+		file.read((char*)&entry->ShaderType, sizeof(entry->ShaderType));
+		file.read((char*)&entry->ReflectMilliseconds, sizeof(entry->ReflectMilliseconds));
+		entry->BytecodeSize = (size_t)bytecodeSize;
+
+		entry->Buffers.resize(ReadCacheCount(file));
+		for (SimpleBufferLayout& layout : entry->Buffers)
+		{
+			ReadCacheString(file, layout.Name);
+			file.read((char*)&layout.Type, sizeof(layout.Type));
+			file.read((char*)&layout.Size, sizeof(layout.Size));
+			file.read((char*)&layout.BindIndex, sizeof(layout.BindIndex));
+			file.read((char*)&layout.FirstVariable, sizeof(layout.FirstVariable));
+			file.read((char*)&layout.VariableCount, sizeof(layout.VariableCount));
+		}
+		ReadCacheArray(file, entry->Variables);
+		ReadCacheStrings(file, entry->VariableNames);
+		ReadCacheArray(file, entry->ShaderResourceViews);
+		ReadCacheStrings(file, entry->ShaderResourceViewNames);
+		ReadCacheArray(file, entry->Samplers);
+		ReadCacheStrings(file, entry->SamplerNames);
+		ReadCacheArray(file, entry->BufferHashes);
+		ReadCacheArray(file, entry->VariableHashes);
+		ReadCacheArray(file, entry->SRVHashes);
+		ReadCacheArray(file, entry->SamplerHashes);
+
+		entry->InputElements.resize(ReadCacheCount(file));
+		for (SimpleInputElement& input : entry->InputElements)
+		{
+			unsigned int perInstance = 0;
+			ReadCacheString(file, input.SemanticName);
+			file.read((char*)&input.SemanticIndex, sizeof(input.SemanticIndex));
+			file.read((char*)&input.Format, sizeof(input.Format));
+			file.read((char*)&perInstance, sizeof(perInstance));
+			input.PerInstance = perInstance != 0;
+		}
+		file.read((char*)entry->ThreadGroupSize, sizeof(entry->ThreadGroupSize));
+
+		entry->UAVs.resize(ReadCacheCount(file));
+		for (std::pair<std::string, unsigned int>& uav : entry->UAVs)
+		{
+			ReadCacheString(file, uav.first);
+			file.read((char*)&uav.second, sizeof(uav.second));
+		}
+
+		// Handles index straight into the arrays, so they must all be in range
+		bool valid = entry->VariableNames.size() == entry->Variables.size() &&
+			entry->ShaderResourceViewNames.size() == entry->ShaderResourceViews.size() &&
+			entry->SamplerNames.size() == entry->Samplers.size();
+		for (const SimpleBufferLayout& layout : entry->Buffers)
+			valid = valid && (unsigned long long)layout.FirstVariable + layout.VariableCount <= entry->Variables.size();
+		for (const SimpleShaderVariable& variable : entry->Variables)
+			valid = valid && variable.ConstantBufferIndex < entry->Buffers.size();
+		auto inRange = [&valid](const SimpleShaderReflection::HashTable& table, size_t count)
+		{
+			for (const std::pair<unsigned int, SimpleShaderHandle>& h : table)
+				valid = valid && h.second >= 0 && (size_t)h.second < count;
+		};
+		inRange(entry->BufferHashes, entry->Buffers.size());
+		inRange(entry->VariableHashes, entry->Variables.size());
+		inRange(entry->SRVHashes, entry->ShaderResourceViews.size());
+		inRange(entry->SamplerHashes, entry->Samplers.size());
+		if (!valid)
+			file.setstate(std::ios::failbit);
+
+		loaded.push_back(entry);
+	}
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(reflectionMutex);
+	for (std::shared_ptr<SimpleShaderReflection>& entry : loaded)
+		cachedReflections[entry->BytecodeHash] = entry;
+	reflectionCacheStats.Loaded += (unsigned int)loaded.size();
+	return true;
+}
+
+// --------------------------------------------------------
+// Writes every reflection used since the cache was loaded,
+// so shaders that have been changed or removed drop out,
+// unless it would be exactly what was loaded
+// --------------------------------------------------------
+bool ISimpleShader::SaveReflectionCache(const std::wstring& path)
+{
+	std::lock_guard<std::mutex> lock(reflectionMutex);
+	if (reflectionCacheStats.Reflected == 0 && usedCachedReflections.size() == reflectionCacheStats.Loaded)
+		return true;
+
+	// Not being able to write it (like a read only folder) just
+	// means reflecting again next time
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	unsigned int header[3] = { SIMPLE_SHADER_REFLECTION_CACHE_MAGIC, SIMPLE_SHADER_REFLECTION_CACHE_VERSION, (unsigned int)usedCachedReflections.size() };
+	file.write((const char*)header, sizeof(header));
+	for (auto& used : usedCachedReflections)
+	{
+		const SimpleShaderReflection& entry = *cachedReflections[used.first];
+		unsigned long long bytecodeSize = entry.BytecodeSize;
+		file.write((const char*)&entry.BytecodeHash, sizeof(entry.BytecodeHash));
+		file.write((const char*)&bytecodeSize, sizeof(bytecodeSize));
+		file.write((const char*)&entry.ShaderType, sizeof(entry.ShaderType));
+		file.write((const char*)&entry.ReflectMilliseconds, sizeof(entry.ReflectMilliseconds));
+
+		unsigned int bufferCount = (unsigned int)entry.Buffers.size();
+		file.write((const char*)&bufferCount, sizeof(bufferCount));
+		for (const SimpleBufferLayout& layout : entry.Buffers)
+		{
+			WriteCacheString(file, layout.Name);
+			file.write((const char*)&layout.Type, sizeof(layout.Type));
+			file.write((const char*)&layout.Size, sizeof(layout.Size));
+			file.write((const char*)&layout.BindIndex, sizeof(layout.BindIndex));
+			file.write((const char*)&layout.FirstVariable, sizeof(layout.FirstVariable));
+			file.write((const char*)&layout.VariableCount, sizeof(layout.VariableCount));
+		}
+		WriteCacheArray(file, entry.Variables);
+		WriteCacheStrings(file, entry.VariableNames);
+		WriteCacheArray(file, entry.ShaderResourceViews);
+		WriteCacheStrings(file, entry.ShaderResourceViewNames);
+		WriteCacheArray(file, entry.Samplers);
+		WriteCacheStrings(file, entry.SamplerNames);
+		WriteCacheArray(file, entry.BufferHashes);
+		WriteCacheArray(file, entry.VariableHashes);
+		WriteCacheArray(file, entry.SRVHashes);
+		WriteCacheArray(file, entry.SamplerHashes);
+
+		unsigned int inputCount = (unsigned int)entry.InputElements.size();
+		file.write((const char*)&inputCount, sizeof(inputCount));
+		for (const SimpleInputElement& input : entry.InputElements)
+		{
+			unsigned int perInstance = input.PerInstance ? 1 : 0;
+			WriteCacheString(file, input.SemanticName);
+			file.write((const char*)&input.SemanticIndex, sizeof(input.SemanticIndex));
+			file.write((const char*)&input.Format, sizeof(input.Format));
+			file.write((const char*)&perInstance, sizeof(perInstance));
+		}
+		file.write((const char*)entry.ThreadGroupSize, sizeof(entry.ThreadGroupSize));
+
+		unsigned int uavCount = (unsigned int)entry.UAVs.size();
+		file.write((const char*)&uavCount, sizeof(uavCount));
+		for (const std::pair<std::string, unsigned int>& uav : entry.UAVs)
+		{
+			WriteCacheString(file, uav.first);
+			file.write((const char*)&uav.second, sizeof(uav.second));
+		}
+	}
+	return file.good();
+}
+
+SimpleShaderReflectionCacheStats ISimpleShader::GetReflectionCacheStats()
+{
+	std::lock_guard<std::mutex> lock(reflectionMutex);
+	return reflectionCacheStats;
+}
+
 
 
 // --------------------------------------------------------
@@ -721,6 +1813,16 @@ SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> devi
 	this->LoadShaderFile(shaderFile);
 }
 
+// --------------------------------------------------------
+// Constructor overload which takes bytecode already in memory
+// --------------------------------------------------------
+SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const void* bytecode, size_t bytecodeSize, LPCWSTR shaderName)
+	: ISimpleShader(device, context)
+{
+	this->perInstanceCompatible = false;
+	this->LoadShaderBytecode(bytecode, bytecodeSize, shaderName);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -767,48 +1869,23 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		return true;
 
 	// Vertex shader was created successfully, so we now use the
-	// shader code to re-reflect and create an input layout that 
-	// matches what the vertex shader expects.  Code adapted from:
-	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
-
-	// Reflect shader info
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
-	// Read input layout description from shader info
+	// inputs its reflection found to create an input layout that
+	// matches what the vertex shader expects
 	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
-	for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+	for (const SimpleInputElement& input : reflection->InputElements)
 	{
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetInputParameterDesc(i, &paramDesc);
-
-		// Check the semantic name for "_PER_INSTANCE"
-		std::string perInstanceStr = "_PER_INSTANCE";
-		std::string sem = paramDesc.SemanticName;
-		int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
-		bool isPerInstance =
-			lenDiff >= 0 &&
-			sem.compare(lenDiff, perInstanceStr.size(), perInstanceStr) == 0;
-
 		// Fill out input element desc
 		D3D11_INPUT_ELEMENT_DESC elementDesc = {};
-		elementDesc.SemanticName = paramDesc.SemanticName;
-		elementDesc.SemanticIndex = paramDesc.SemanticIndex;
+		elementDesc.SemanticName = input.SemanticName.c_str();
+		elementDesc.SemanticIndex = input.SemanticIndex;
+		elementDesc.Format = input.Format;
 		elementDesc.InputSlot = 0;
 		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
 		elementDesc.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 		elementDesc.InstanceDataStepRate = 0;
 
 		// Replace anything affected by "per instance" data
-		if (isPerInstance)
+		if (input.PerInstance)
 		{
 			elementDesc.InputSlot = 1; // Assume per instance data comes from another input slot!
 			elementDesc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
@@ -817,39 +1894,13 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 			perInstanceCompatible = true;
 		}
 
-		// Determine DXGI format
-		if (paramDesc.Mask == 1)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 3)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 7)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 15)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-		}
-
 		// Save element desc
 		inputLayoutDesc.push_back(elementDesc);
 	}
 
 	// Try to create Input Layout
 	HRESULT hr = device->CreateInputLayout(
-		&inputLayoutDesc[0],
+		inputLayoutDesc.data(),
 		(unsigned int)inputLayoutDesc.size(),
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
@@ -869,8 +1920,15 @@ void SimpleVertexShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	SimpleShaderStateCache* cache = GetStateCache();
+	if (CacheBind(cache->InputLayout, inputLayout.Get()))
+		GetContext()->IASetInputLayout(inputLayout.Get());
+	SimpleShaderStageState& state = cache->Stages[(int)SimpleShaderStage::Vertex];
+	if (CacheBind(state.Shader, shader.Get()))
+	{
+		GetContext()->VSSetShader(shader.Get(), 0, 0);
+		DrawStats::Count(DrawCounter::SetShaders);
+	}
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -879,8 +1937,15 @@ void SimpleVertexShader::SetShaderAndCBs()
 		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
-		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
+		// Ring-backed buffers bind their latest slice
+		if (constantBuffers[i].RingBacked && BindRingSlice(&constantBuffers[i]))
+			continue;
+
+		// This is a real constant buffer, so set it (unless it already is)
+		if (!CacheBind(state.ConstantBuffers[constantBuffers[i].BindIndex], constantBuffers[i].ConstantBuffer.Get()))
+			continue;
+
+		GetContext()->VSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -888,63 +1953,37 @@ void SimpleVertexShader::SetShaderAndCBs()
 }
 
 // --------------------------------------------------------
-// Sets a shader resource view in the vertex shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
+// Binds SRVs to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+void SimpleVertexShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Vertex).ShaderResourceViews + startSlot, srvs, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleVertexShader::SetShaderResourceView() - SRV named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->VSSetShaderResources(startSlot, count, srvs);
+		DrawStats::Count(DrawCounter::ShaderResourceBinds);
 	}
-
-	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
-
-	// Success
-	return true;
 }
 
 // --------------------------------------------------------
-// Sets a sampler state in the vertex shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
+// Binds samplers to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+void SimpleVertexShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Vertex).Samplers + startSlot, samplers, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleVertexShader::SetSamplerState() - Sampler named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->VSSetSamplers(startSlot, count, samplers);
+		DrawStats::Count(DrawCounter::SamplerBinds);
 	}
+}
 
-	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
-
-	// Success
-	return true;
+// --------------------------------------------------------
+// Binds part of a buffer to one of this stage's constant
+// buffer slots, which the state cache then knows nothing about
+// --------------------------------------------------------
+void SimpleVertexShader::BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	context->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	GetStageState(SimpleShaderStage::Vertex).ConstantBuffers[slot] = 0;
 }
 
 
@@ -962,6 +2001,15 @@ SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device
 	this->LoadShaderFile(shaderFile);
 }
 
+// --------------------------------------------------------
+// Constructor overload which takes bytecode already in memory
+// --------------------------------------------------------
+SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const void* bytecode, size_t bytecodeSize, LPCWSTR shaderName)
+	: ISimpleShader(device, context)
+{
+	this->LoadShaderBytecode(bytecode, bytecodeSize, shaderName);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -1012,7 +2060,12 @@ void SimplePixelShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	SimpleShaderStageState& state = GetStageState(SimpleShaderStage::Pixel);
+	if (CacheBind(state.Shader, shader.Get()))
+	{
+		GetContext()->PSSetShader(shader.Get(), 0, 0);
+		DrawStats::Count(DrawCounter::SetShaders);
+	}
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1021,72 +2074,53 @@ void SimplePixelShader::SetShaderAndCBs()
 		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
-		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
-	}
-}
-
-// --------------------------------------------------------
-// Sets a shader resource view in the pixel shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
-// --------------------------------------------------------
-bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
-{
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
-	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimplePixelShader::SetShaderResourceView() - SRV named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
-	}
+		// Ring-backed buffers bind their latest slice
+		if (constantBuffers[i].RingBacked && BindRingSlice(&constantBuffers[i]))
+			continue;
 
-	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+		// This is a real constant buffer, so set it (unless it already is)
+		if (!CacheBind(state.ConstantBuffers[constantBuffers[i].BindIndex], constantBuffers[i].ConstantBuffer.Get()))
+			continue;
 
-	// Success
-	return true;
+		GetContext()->PSSetConstantBuffers(
+			constantBuffers[i].BindIndex,
+			1,
+			constantBuffers[i].ConstantBuffer.GetAddressOf());
+	}
 }
 
 // --------------------------------------------------------
-// Sets a sampler state in the pixel shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
+// Binds SRVs to a run of this stage's slots
 // --------------------------------------------------------
-bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+void SimplePixelShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Pixel).ShaderResourceViews + startSlot, srvs, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimplePixelShader::SetSamplerState() - Sampler named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->PSSetShaderResources(startSlot, count, srvs);
+		DrawStats::Count(DrawCounter::ShaderResourceBinds);
 	}
+}
 
-	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+// --------------------------------------------------------
+// Binds samplers to a run of this stage's slots
+// --------------------------------------------------------
+void SimplePixelShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Pixel).Samplers + startSlot, samplers, count))
+	{
+		GetContext()->PSSetSamplers(startSlot, count, samplers);
+		DrawStats::Count(DrawCounter::SamplerBinds);
+	}
+}
 
-	// Success
-	return true;
+// --------------------------------------------------------
+// Binds part of a buffer to one of this stage's constant
+// buffer slots, which the state cache then knows nothing about
+// --------------------------------------------------------
+void SimplePixelShader::BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	context->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	GetStageState(SimpleShaderStage::Pixel).ConstantBuffers[slot] = 0;
 }
 
 
@@ -1156,7 +2190,12 @@ void SimpleDomainShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->DSSetShader(shader.Get(), 0, 0);
+	SimpleShaderStageState& state = GetStageState(SimpleShaderStage::Domain);
+	if (CacheBind(state.Shader, shader.Get()))
+	{
+		GetContext()->DSSetShader(shader.Get(), 0, 0);
+		DrawStats::Count(DrawCounter::SetShaders);
+	}
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1165,8 +2204,15 @@ void SimpleDomainShader::SetShaderAndCBs()
 		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
-		// This is a real constant buffer, so set it
-		deviceContext->DSSetConstantBuffers(
+		// Ring-backed buffers bind their latest slice
+		if (constantBuffers[i].RingBacked && BindRingSlice(&constantBuffers[i]))
+			continue;
+
+		// This is a real constant buffer, so set it (unless it already is)
+		if (!CacheBind(state.ConstantBuffers[constantBuffers[i].BindIndex], constantBuffers[i].ConstantBuffer.Get()))
+			continue;
+
+		GetContext()->DSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1174,63 +2220,37 @@ void SimpleDomainShader::SetShaderAndCBs()
 }
 
 // --------------------------------------------------------
-// Sets a shader resource view in the domain shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
+// Binds SRVs to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleDomainShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+void SimpleDomainShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Domain).ShaderResourceViews + startSlot, srvs, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleDomainShader::SetShaderResourceView() - SRV named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->DSSetShaderResources(startSlot, count, srvs);
+		DrawStats::Count(DrawCounter::ShaderResourceBinds);
 	}
-
-	// Set the shader resource view
-	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
-
-	// Success
-	return true;
 }
 
 // --------------------------------------------------------
-// Sets a sampler state in the domain shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
+// Binds samplers to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleDomainShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+void SimpleDomainShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Domain).Samplers + startSlot, samplers, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleDomainShader::SetSamplerState() - Sampler named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->DSSetSamplers(startSlot, count, samplers);
+		DrawStats::Count(DrawCounter::SamplerBinds);
 	}
+}
 
-	// Set the shader resource view
-	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
-
-	// Success
-	return true;
+// --------------------------------------------------------
+// Binds part of a buffer to one of this stage's constant
+// buffer slots, which the state cache then knows nothing about
+// --------------------------------------------------------
+void SimpleDomainShader::BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	context->DSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	GetStageState(SimpleShaderStage::Domain).ConstantBuffers[slot] = 0;
 }
 
 
@@ -1299,7 +2319,12 @@ void SimpleHullShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->HSSetShader(shader.Get(), 0, 0);
+	SimpleShaderStageState& state = GetStageState(SimpleShaderStage::Hull);
+	if (CacheBind(state.Shader, shader.Get()))
+	{
+		GetContext()->HSSetShader(shader.Get(), 0, 0);
+		DrawStats::Count(DrawCounter::SetShaders);
+	}
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1308,8 +2333,15 @@ void SimpleHullShader::SetShaderAndCBs()
 		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
-		// This is a real constant buffer, so set it
-		deviceContext->HSSetConstantBuffers(
+		// Ring-backed buffers bind their latest slice
+		if (constantBuffers[i].RingBacked && BindRingSlice(&constantBuffers[i]))
+			continue;
+
+		// This is a real constant buffer, so set it (unless it already is)
+		if (!CacheBind(state.ConstantBuffers[constantBuffers[i].BindIndex], constantBuffers[i].ConstantBuffer.Get()))
+			continue;
+
+		GetContext()->HSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1317,63 +2349,37 @@ void SimpleHullShader::SetShaderAndCBs()
 }
 
 // --------------------------------------------------------
-// Sets a shader resource view in the hull shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
+// Binds SRVs to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleHullShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+void SimpleHullShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Hull).ShaderResourceViews + startSlot, srvs, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleHullShader::SetShaderResourceView() - SRV named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->HSSetShaderResources(startSlot, count, srvs);
+		DrawStats::Count(DrawCounter::ShaderResourceBinds);
 	}
-
-	// Set the shader resource view
-	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
-
-	// Success
-	return true;
 }
 
 // --------------------------------------------------------
-// Sets a sampler state in the hull shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
+// Binds samplers to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleHullShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+void SimpleHullShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Hull).Samplers + startSlot, samplers, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleHullShader::SetSamplerState() - Sampler named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->HSSetSamplers(startSlot, count, samplers);
+		DrawStats::Count(DrawCounter::SamplerBinds);
 	}
+}
 
-	// Set the shader resource view
-	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
-
-	// Success
-	return true;
+// --------------------------------------------------------
+// Binds part of a buffer to one of this stage's constant
+// buffer slots, which the state cache then knows nothing about
+// --------------------------------------------------------
+void SimpleHullShader::BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	context->HSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	GetStageState(SimpleShaderStage::Hull).ConstantBuffers[slot] = 0;
 }
 
 
@@ -1549,7 +2555,7 @@ bool SimpleGeometryShader::CreateCompatibleStreamOutBuffer(Microsoft::WRL::ComPt
 	desc.Usage = D3D11_USAGE_DEFAULT;
 
 	// Attempt to create the buffer and return the result
-	HRESULT result = device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+	HRESULT result = GpuMemory::CreateBuffer(device.Get(), &desc, 0, buffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Stream Out");
 	return (result == S_OK);
 }
 
@@ -1573,7 +2579,12 @@ void SimpleGeometryShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->GSSetShader(shader.Get(), 0, 0);
+	SimpleShaderStageState& state = GetStageState(SimpleShaderStage::Geometry);
+	if (CacheBind(state.Shader, shader.Get()))
+	{
+		GetContext()->GSSetShader(shader.Get(), 0, 0);
+		DrawStats::Count(DrawCounter::SetShaders);
+	}
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1582,8 +2593,15 @@ void SimpleGeometryShader::SetShaderAndCBs()
 		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
-		// This is a real constant buffer, so set it
-		deviceContext->GSSetConstantBuffers(
+		// Ring-backed buffers bind their latest slice
+		if (constantBuffers[i].RingBacked && BindRingSlice(&constantBuffers[i]))
+			continue;
+
+		// This is a real constant buffer, so set it (unless it already is)
+		if (!CacheBind(state.ConstantBuffers[constantBuffers[i].BindIndex], constantBuffers[i].ConstantBuffer.Get()))
+			continue;
+
+		GetContext()->GSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1591,63 +2609,37 @@ void SimpleGeometryShader::SetShaderAndCBs()
 }
 
 // --------------------------------------------------------
-// Sets a shader resource view in the Geometry shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
+// Binds SRVs to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleGeometryShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+void SimpleGeometryShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Geometry).ShaderResourceViews + startSlot, srvs, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleGeometryShader::SetShaderResourceView() - SRV named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->GSSetShaderResources(startSlot, count, srvs);
+		DrawStats::Count(DrawCounter::ShaderResourceBinds);
 	}
-
-	// Set the shader resource view
-	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
-
-	// Success
-	return true;
 }
 
 // --------------------------------------------------------
-// Sets a sampler state in the Geometry shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
+// Binds samplers to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleGeometryShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+void SimpleGeometryShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Geometry).Samplers + startSlot, samplers, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleGeometryShader::SetSamplerState() - Sampler named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->GSSetSamplers(startSlot, count, samplers);
+		DrawStats::Count(DrawCounter::SamplerBinds);
 	}
+}
 
-	// Set the shader resource view
-	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
-
-	// Success
-	return true;
+// --------------------------------------------------------
+// Binds part of a buffer to one of this stage's constant
+// buffer slots, which the state cache then knows nothing about
+// --------------------------------------------------------
+void SimpleGeometryShader::BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	context->GSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	GetStageState(SimpleShaderStage::Geometry).ConstantBuffers[slot] = 0;
 }
 
 // --------------------------------------------------------
@@ -1688,6 +2680,19 @@ SimpleComputeShader::SimpleComputeShader(Microsoft::WRL::ComPtr<ID3D11Device> de
 	this->LoadShaderFile(shaderFile);
 }
 
+// --------------------------------------------------------
+// Constructor overload which takes bytecode already in memory
+// --------------------------------------------------------
+SimpleComputeShader::SimpleComputeShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const void* bytecode, size_t bytecodeSize, LPCWSTR shaderName)
+	: ISimpleShader(device, context)
+{
+	this->threadsTotal = 0;
+	this->threadsX = 0;
+	this->threadsY = 0;
+	this->threadsZ = 0;
+	this->LoadShaderBytecode(bytecode, bytecodeSize, shaderName);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -1730,44 +2735,13 @@ bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBl
 	if (result != S_OK)
 		return false;
 
-	// Set up shader reflection to get information about UAV's
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
-	// Grab the thread info
-	threadsTotal = refl->GetThreadGroupSize(
-		&threadsX,
-		&threadsY,
-		&threadsZ);
-
-	// Loop and get all UAV resources
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
-	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
-
-		// Check the type, looking for any kind of UAV
-		switch (resourceDesc.Type)
-		{
-		case D3D_SIT_UAV_APPEND_STRUCTURED:
-		case D3D_SIT_UAV_CONSUME_STRUCTURED:
-		case D3D_SIT_UAV_RWBYTEADDRESS:
-		case D3D_SIT_UAV_RWSTRUCTURED:
-		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
-		case D3D_SIT_UAV_RWTYPED:
-			uavTable.insert(std::pair<std::string, unsigned int>(resourceDesc.Name, resourceDesc.BindPoint));
-		}
-	}
+	// Grab the thread info and UAVs from the reflection
+	threadsX = reflection->ThreadGroupSize[0];
+	threadsY = reflection->ThreadGroupSize[1];
+	threadsZ = reflection->ThreadGroupSize[2];
+	threadsTotal = threadsX * threadsY * threadsZ;
+	for (const std::pair<std::string, unsigned int>& uav : reflection->UAVs)
+		uavTable.insert(uav);
 
 	// All set
 	return true;
@@ -1783,7 +2757,12 @@ void SimpleComputeShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->CSSetShader(shader.Get(), 0, 0);
+	SimpleShaderStageState& state = GetStageState(SimpleShaderStage::Compute);
+	if (CacheBind(state.Shader, shader.Get()))
+	{
+		GetContext()->CSSetShader(shader.Get(), 0, 0);
+		DrawStats::Count(DrawCounter::SetShaders);
+	}
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1792,8 +2771,15 @@ void SimpleComputeShader::SetShaderAndCBs()
 		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
 			continue;
 
-		// This is a real constant buffer, so set it
-		deviceContext->CSSetConstantBuffers(
+		// Ring-backed buffers bind their latest slice
+		if (constantBuffers[i].RingBacked && BindRingSlice(&constantBuffers[i]))
+			continue;
+
+		// This is a real constant buffer, so set it (unless it already is)
+		if (!CacheBind(state.ConstantBuffers[constantBuffers[i].BindIndex], constantBuffers[i].ConstantBuffer.Get()))
+			continue;
+
+		GetContext()->CSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1822,7 +2808,7 @@ void SimpleComputeShader::SetShaderAndCBs()
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
 {
-	deviceContext->Dispatch(groupsX, groupsY, groupsZ);
+	GetContext()->Dispatch(groupsX, groupsY, groupsZ);
 }
 
 // --------------------------------------------------------
@@ -1847,7 +2833,7 @@ void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int gr
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ)
 {
-	deviceContext->Dispatch(
+	GetContext()->Dispatch(
 		max((unsigned int)ceil((float)threadsX / this->threadsX), 1),
 		max((unsigned int)ceil((float)threadsY / this->threadsY), 1),
 		max((unsigned int)ceil((float)threadsZ / this->threadsZ), 1));
@@ -1862,63 +2848,37 @@ bool SimpleComputeShader::HasUnorderedAccessView(std::string name)
 }
 
 // --------------------------------------------------------
-// Sets a shader resource view in the Compute shader stage
-//
-// name - The name of the texture resource in the shader
-// srv - The shader resource view of the texture in GPU memory
-//
-// Returns true if a texture of the given name was found, false otherwise
+// Binds SRVs to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleComputeShader::SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+void SimpleComputeShader::BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
 {
-	// Look for the variable and verify
-	const SimpleSRV* srvInfo = GetShaderResourceViewInfo(name);
-	if (srvInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Compute).ShaderResourceViews + startSlot, srvs, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleComputeShader::SetShaderResourceView() - SRV named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->CSSetShaderResources(startSlot, count, srvs);
+		DrawStats::Count(DrawCounter::ShaderResourceBinds);
 	}
-
-	// Set the shader resource view
-	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
-
-	// Success
-	return true;
 }
 
 // --------------------------------------------------------
-// Sets a sampler state in the Compute shader stage
-//
-// name - The name of the sampler state in the shader
-// samplerState - The sampler state in GPU memory
-//
-// Returns true if a sampler of the given name was found, false otherwise
+// Binds samplers to a run of this stage's slots
 // --------------------------------------------------------
-bool SimpleComputeShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+void SimpleComputeShader::BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
 {
-	// Look for the variable and verify
-	const SimpleSampler* sampInfo = GetSamplerInfo(name);
-	if (sampInfo == 0)
+	if (CacheBindRange(GetStageState(SimpleShaderStage::Compute).Samplers + startSlot, samplers, count))
 	{
-		if (ReportWarnings)
-		{
-			LogWarning("SimpleComputeShader::SetSamplerState() - Sampler named '");
-			Log(name);
-			LogWarning("' was not found in the shader. Ensure the name is spelled correctly and that it exists in the shader.\n");
-		}
-		return false;
+		GetContext()->CSSetSamplers(startSlot, count, samplers);
+		DrawStats::Count(DrawCounter::SamplerBinds);
 	}
+}
 
-	// Set the shader resource view
-	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
-
-	// Success
-	return true;
+// --------------------------------------------------------
+// Binds part of a buffer to one of this stage's constant
+// buffer slots, which the state cache then knows nothing about
+// --------------------------------------------------------
+void SimpleComputeShader::BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	context->CSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	GetStageState(SimpleShaderStage::Compute).ConstantBuffers[slot] = 0;
 }
 
 // --------------------------------------------------------
@@ -1946,7 +2906,7 @@ bool SimpleComputeShader::SetUnorderedAccessView(std::string name, Microsoft::WR
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetUnorderedAccessViews(bindIndex, 1, uav.GetAddressOf(), &appendConsumeOffset);
+	GetContext()->CSSetUnorderedAccessViews(bindIndex, 1, uav.GetAddressOf(), &appendConsumeOffset);
 
 	// Success
 	return true;
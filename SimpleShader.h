@@ -3,6 +3,7 @@
 #pragma comment(lib, "d3dcompiler.lib")
 
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
 #include <wrl/client.h>
@@ -10,6 +11,12 @@
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <mutex>
+#include <memory>
+#include <algorithm>
 
 
 // --------------------------------------------------------
@@ -24,21 +31,58 @@ struct SimpleShaderVariable
 };
 
 // --------------------------------------------------------
-// Contains information about a specific
-// constant buffer in a shader, as well as
-// the local data buffer for it
+// One shader instance's copy of a constant buffer: the
+// GPU buffer and the local data buffer for it
+//  - The names and variables are in the shared reflection,
+//    and only the scalars needed to bind it are repeated here
 // --------------------------------------------------------
 struct SimpleConstantBuffer
 {
-	std::string Name;
 	D3D_CBUFFER_TYPE Type = D3D_CBUFFER_TYPE::D3D11_CT_CBUFFER;
 	unsigned int Size = 0;
 	unsigned int BindIndex = 0;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
 	unsigned char* LocalDataBuffer = 0;
-	std::vector<SimpleShaderVariable> Variables;
+	bool External = false; // Buffer is owned and filled elsewhere, so never copy local data to it
+
+	// Local data has changed since it was last copied to the GPU
+	//  - Also tracks the context it was copied on, as each deferred
+	//    context's command list may execute in any order
+	bool Dirty = true;
+	ID3D11DeviceContext* UploadedContext = 0;
+
+	// Written into a slice of each context's constant ring rather than
+	// updating its own buffer (see ISimpleShader::SetRingBacked())
+	bool RingBacked = false;
+	unsigned int RingGeneration = 0;
+	unsigned int RingFirstConstant = 0;
+	unsigned int RingConstantCount = 0;
+
+	// Result of checking a struct of this size against the
+	// reflection, the first time WriteBuffer() is used with it
+	unsigned int CheckedStructSize = 0;
+	bool StructMatches = false;
+};
+
+// --------------------------------------------------------
+// One member of a C++ struct that mirrors a cbuffer, which
+// WriteBuffer() can check against the shader's reflection
+//  - shaderName is the variable's name in the shader
+// --------------------------------------------------------
+struct SimpleBufferField
+{
+	const char* Name;
+	unsigned int Offset;
+	unsigned int Size;
 };
 
+#define SIMPLE_BUFFER_FIELD(type, member, shaderName) { shaderName, (unsigned int)offsetof(type, member), (unsigned int)sizeof(type::member) }
+
+// Size of each context's constant ring
+//  - Every ring-backed copy takes at least 256 bytes, so this is
+//    enough for 16K per-object copies before the ring wraps
+#define SIMPLE_SHADER_RING_SIZE (4 * 1024 * 1024)
+
 // --------------------------------------------------------
 // Contains info about a single SRV in a shader
 // --------------------------------------------------------
@@ -57,6 +101,173 @@ struct SimpleSampler
 	unsigned int BindIndex; // The register of the Sampler
 };
 
+// --------------------------------------------------------
+// A variable, buffer or resource name hashed at compile time
+//  - Write "world"_sn rather than "world" to skip building
+//    a std::string and hashing it on every call
+//  - FNV-1a, which is also used to hash the reflected names
+// --------------------------------------------------------
+struct SimpleShaderName
+{
+	unsigned int Hash;
+	const char* Text; // Only kept for warnings
+
+	constexpr SimpleShaderName(const char* text, size_t length) : Hash(HashName(text, length)), Text(text) {}
+
+	static constexpr unsigned int HashName(const char* text, size_t length)
+	{
+		unsigned int hash = 2166136261u;
+		for (size_t i = 0; i < length; i++)
+			hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+		return hash;
+	}
+};
+
+constexpr SimpleShaderName operator"" _sn(const char* text, size_t length)
+{
+	return SimpleShaderName(text, length);
+}
+
+// --------------------------------------------------------
+// A variable, buffer, SRV or sampler resolved once from its
+// name and then used without any lookup at all
+//  - Indexes into the shader's reflection, so a handle is only
+//    valid for shaders loaded from the same bytecode
+//  - Invalid handles are ignored, just like unknown names
+// --------------------------------------------------------
+typedef int SimpleShaderHandle;
+#define SIMPLE_SHADER_INVALID_HANDLE -1
+
+// --------------------------------------------------------
+// The reflected layout of a constant buffer
+//  - Its variables are Variables[FirstVariable] onwards
+// --------------------------------------------------------
+struct SimpleBufferLayout
+{
+	std::string Name;
+	D3D_CBUFFER_TYPE Type;
+	unsigned int Size;
+	unsigned int BindIndex;
+	unsigned int FirstVariable;
+	unsigned int VariableCount;
+};
+
+// --------------------------------------------------------
+// One vertex shader input, for building its input layout
+//  - Semantics ending in _PER_INSTANCE come from the
+//    second slot, one element per instance
+// --------------------------------------------------------
+struct SimpleInputElement
+{
+	std::string SemanticName;
+	unsigned int SemanticIndex;
+	DXGI_FORMAT Format;
+	bool PerInstance;
+};
+
+// --------------------------------------------------------
+// Everything reflection says about one compiled shader
+//  - Built once per unique bytecode and shared, read only, by
+//    every shader loaded from it (see ISimpleShader::InternReflection())
+//  - Handles index straight into the flat arrays, and names are
+//    found by binary searching the sorted (hash, handle) tables
+// --------------------------------------------------------
+struct SimpleShaderReflection
+{
+	typedef std::vector<std::pair<unsigned int, SimpleShaderHandle>> HashTable;
+
+	std::vector<SimpleBufferLayout> Buffers;
+	std::vector<SimpleShaderVariable> Variables;
+	std::vector<std::string> VariableNames;
+	std::vector<SimpleSRV> ShaderResourceViews;
+	std::vector<std::string> ShaderResourceViewNames;
+	std::vector<SimpleSampler> Samplers;
+	std::vector<std::string> SamplerNames;
+
+	HashTable BufferHashes;
+	HashTable VariableHashes;
+	HashTable SRVHashes;
+	HashTable SamplerHashes;
+
+	// What kind of shader it is (a D3D11_SHVER type), and
+	// what only some kinds need
+	unsigned int ShaderType;
+	std::vector<SimpleInputElement> InputElements;				// Vertex shaders
+	unsigned int ThreadGroupSize[3];							// Compute shaders
+	std::vector<std::pair<std::string, unsigned int>> UAVs;	// Compute shaders, by name and register
+
+	// The bytecode this came from, to rule out hash collisions
+	unsigned long long BytecodeHash;
+	size_t BytecodeSize;
+
+	// How long D3DReflect() and building the tables took, which
+	// is what every later run that finds it in the cache saves
+	float ReflectMilliseconds;
+};
+
+// The reflection cache file (see ISimpleShader::LoadReflectionCache())
+#define SIMPLE_SHADER_REFLECTION_CACHE_MAGIC	0x43524853
+#define SIMPLE_SHADER_REFLECTION_CACHE_VERSION	1
+
+// What the reflection cache did since it was loaded
+struct SimpleShaderReflectionCacheStats
+{
+	unsigned int Loaded;		// Reflections read from the file
+	unsigned int Hits;			// Bytecodes found there, so never reflected
+	unsigned int Reflected;		// Bytecodes that weren't, and had to be
+	double ReflectMilliseconds;	// Spent reflecting those
+	double SavedMilliseconds;	// What the hits took to reflect when they were cached
+};
+
+// --------------------------------------------------------
+// What SimpleShader last bound to each stage of one context,
+// so binding the same thing again can be skipped
+//  - Null means "unknown", so after binding anything directly
+//    through the context, call ISimpleShader::InvalidateStateCache()
+//  - Entries are raw pointers, which is safe because the context
+//    keeps a reference to everything that's still bound
+// --------------------------------------------------------
+enum class SimpleShaderStage
+{
+	Vertex,
+	Hull,
+	Domain,
+	Geometry,
+	Pixel,
+	Compute,
+	Count
+};
+
+struct SimpleShaderStageState
+{
+	ID3D11DeviceChild* Shader;
+	ID3D11DeviceChild* ConstantBuffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+	ID3D11DeviceChild* ShaderResourceViews[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+	ID3D11DeviceChild* Samplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+};
+
+struct SimpleShaderStateCache
+{
+	ID3D11DeviceChild* InputLayout;
+	SimpleShaderStageState Stages[(int)SimpleShaderStage::Count];
+
+	void Invalidate()
+	{
+		InputLayout = 0;
+		memset(Stages, 0, sizeof(Stages));
+	}
+
+	// This context's constant ring, which outlives invalidation
+	//  - Context1 is null if the device can't bind buffer ranges
+	//  - The generation changes every time the ring is discarded,
+	//    which orphans every slice written before then
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> Context1;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> Ring;
+	unsigned int RingOffset = 0;
+	unsigned int RingGeneration = 0;
+	unsigned int RingFrame = 0;
+};
+
 // --------------------------------------------------------
 // Base abstract class for simplifying shader handling
 // --------------------------------------------------------
@@ -74,6 +285,39 @@ public:
 	void CopyAllBufferData();
 	void CopyBufferData(unsigned int index);
 	void CopyBufferData(std::string bufferName);
+	void CopyBufferData(const SimpleShaderName& bufferName);
+
+	// Constant buffer uploads across all shaders, and how many
+	// were skipped because nothing had changed since the last one
+	static unsigned int GetBufferUploadsIssued() { return bufferUploadsIssued; }
+	static unsigned int GetBufferUploadsSkipped() { return bufferUploadsSkipped; }
+	static void ResetBufferUploadStats() { bufferUploadsIssued = 0; bufferUploadsSkipped = 0; }
+
+	// Redundant bind filtering, per context
+	//  - Invalidate after anything binds shaders, constant buffers, SRVs
+	//    or samplers directly through that context, or resets its state
+	static void InvalidateStateCache(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	static void InvalidateAllStateCaches();
+	static bool GetStateCaching() { return stateCaching; }
+	static void SetStateCaching(bool enabled);
+	static unsigned int GetBindsSkipped() { return bindsSkipped; }
+	static void ResetBindsSkipped() { bindsSkipped = 0; }
+
+	// Redirects all shaders used on the calling thread to another context
+	static void SetThreadContext(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Backs a buffer with slices of a large ring instead of its own buffer,
+	// so copies are appended with no-overwrite maps and never wait for
+	// the GPU to finish with the previous data (for per-object data)
+	bool SetRingBacked(std::string bufferName);
+
+	// Starts a new frame for every shader, which must happen before
+	// anything is drawn: each context's ring starts over, and the
+	// state caches are invalidated
+	static void BeginFrame();
+
+	// Shares a buffer filled outside of this shader (like per-frame data)
+	bool SetExternalConstantBuffer(std::string bufferName, Microsoft::WRL::ComPtr<ID3D11Buffer> buffer);
 
 	// Sets arbitrary shader data
 	bool SetData(std::string name, const void* data, unsigned int size);
@@ -89,9 +333,67 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	// Copies a whole C++ struct into a constant buffer at once
+	//  - The struct must be exactly as large as the cbuffer, which is
+	//    checked (along with any fields given) the first time it's used
+	template<typename T, typename NameType>
+	bool WriteBuffer(const NameType& bufferName, const T& data)
+	{
+		static_assert(sizeof(T) % 16 == 0, "Constant buffer structs must be padded to a multiple of 16 bytes");
+		static_assert(std::is_trivially_copyable<T>::value, "Constant buffer structs must be trivially copyable");
+		return WriteBufferData(GetBufferHandle(bufferName), &data, sizeof(T), 0, 0);
+	}
+
+	template<typename T, typename NameType, size_t FieldCount>
+	bool WriteBuffer(const NameType& bufferName, const T& data, const SimpleBufferField(&fields)[FieldCount])
+	{
+		static_assert(sizeof(T) % 16 == 0, "Constant buffer structs must be padded to a multiple of 16 bytes");
+		static_assert(std::is_trivially_copyable<T>::value, "Constant buffer structs must be trivially copyable");
+		return WriteBufferData(GetBufferHandle(bufferName), &data, sizeof(T), fields, (unsigned int)FieldCount);
+	}
+
+	bool WriteBufferData(SimpleShaderHandle buffer, const void* data, unsigned int size, const SimpleBufferField* fields, unsigned int fieldCount);
+
 	// Setting shader resources
-	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
-	virtual bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
+	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+
+	// Binds resources straight to a run of registers, for callers
+	// that resolved the slots themselves (like material binding tables)
+	void SetShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs) { BindShaderResourceViews(startSlot, count, srvs); }
+	void SetSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers) { BindSamplerStates(startSlot, count, samplers); }
+
+	// Resolving handles (buffer handles are the same as buffer indices)
+	SimpleShaderHandle GetVariableHandle(std::string name);
+	SimpleShaderHandle GetVariableHandle(const SimpleShaderName& name);
+	SimpleShaderHandle GetBufferHandle(std::string name);
+	SimpleShaderHandle GetBufferHandle(const SimpleShaderName& name);
+	SimpleShaderHandle GetShaderResourceViewHandle(std::string name);
+	SimpleShaderHandle GetShaderResourceViewHandle(const SimpleShaderName& name);
+	SimpleShaderHandle GetSamplerHandle(std::string name);
+	SimpleShaderHandle GetSamplerHandle(const SimpleShaderName& name);
+
+	// Setting data and resources by handle
+	bool SetData(SimpleShaderHandle variable, const void* data, unsigned int size);
+	bool SetInt(SimpleShaderHandle variable, int data);
+	bool SetFloat(SimpleShaderHandle variable, float data);
+	bool SetFloat2(SimpleShaderHandle variable, const DirectX::XMFLOAT2 data);
+	bool SetFloat3(SimpleShaderHandle variable, const DirectX::XMFLOAT3 data);
+	bool SetFloat4(SimpleShaderHandle variable, const DirectX::XMFLOAT4 data);
+	bool SetMatrix4x4(SimpleShaderHandle variable, const DirectX::XMFLOAT4X4 data);
+	bool SetShaderResourceView(SimpleShaderHandle srv, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> view);
+	bool SetSamplerState(SimpleShaderHandle sampler, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
+
+	// Setting data and resources by compile time hashed name
+	bool SetData(const SimpleShaderName& name, const void* data, unsigned int size);
+	bool SetInt(const SimpleShaderName& name, int data);
+	bool SetFloat(const SimpleShaderName& name, float data);
+	bool SetFloat2(const SimpleShaderName& name, const DirectX::XMFLOAT2 data);
+	bool SetFloat3(const SimpleShaderName& name, const DirectX::XMFLOAT3 data);
+	bool SetFloat4(const SimpleShaderName& name, const DirectX::XMFLOAT4 data);
+	bool SetMatrix4x4(const SimpleShaderName& name, const DirectX::XMFLOAT4X4 data);
+	bool SetShaderResourceView(const SimpleShaderName& name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	bool SetSamplerState(const SimpleShaderName& name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
 	// Simple resource checking
 	bool HasVariable(std::string name);
@@ -103,11 +405,11 @@ public:
 
 	const SimpleSRV* GetShaderResourceViewInfo(std::string name);
 	const SimpleSRV* GetShaderResourceViewInfo(unsigned int index);
-	size_t GetShaderResourceViewCount() { return textureTable.size(); }
+	size_t GetShaderResourceViewCount() { return reflection ? reflection->ShaderResourceViews.size() : 0; }
 
 	const SimpleSampler* GetSamplerInfo(std::string name);
 	const SimpleSampler* GetSamplerInfo(unsigned int index);
-	size_t GetSamplerCount() { return samplerTable.size(); }
+	size_t GetSamplerCount() { return reflection ? reflection->Samplers.size() : 0; }
 
 	// Get data about constant buffers
 	unsigned int GetBufferCount();
@@ -117,6 +419,24 @@ public:
 
 	// Misc getters
 	Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob() { return shaderBlob; }
+	std::shared_ptr<const SimpleShaderReflection> GetReflection() { return reflection; }
+
+	// Unique shader bytecodes currently reflected, however many
+	// shaders have been loaded from them
+	static size_t GetReflectionCount();
+
+	// A file of reflections by bytecode hash, so shaders whose bytecode
+	// hasn't changed since it was saved skip D3DReflect() (and building
+	// the tables) altogether
+	//  - Load it before any shaders are, and save it once they all have
+	//    been, which writes only the reflections used in this run
+	static bool LoadReflectionCache(const std::wstring& path);
+	static bool SaveReflectionCache(const std::wstring& path);
+	static SimpleShaderReflectionCacheStats GetReflectionCacheStats();
+
+	// The D3D11_SHVER type of some bytecode (or -1), which reflects it
+	// (unless it's cached) and keeps that for when it's created
+	static unsigned int GetShaderType(const void* bytecode, size_t size);
 
 	// Error reporting
 	static bool ReportErrors;
@@ -129,40 +449,114 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
 
+	// The context to actually use on this thread
+	static thread_local ID3D11DeviceContext* threadContext;
+	ID3D11DeviceContext* GetContext() { return threadContext ? threadContext : deviceContext.Get(); }
+
+	// Upload tracking (shaders are used from several threads)
+	static std::atomic<unsigned int> bufferUploadsIssued;
+	static std::atomic<unsigned int> bufferUploadsSkipped;
+	void UploadBuffer(SimpleConstantBuffer* cb);
+
+	// State caches for every context, plus the calling
+	// thread's most recent one so it's rarely looked up
+	static std::mutex stateCacheMutex;
+	static std::unordered_map<ID3D11DeviceContext*, std::unique_ptr<SimpleShaderStateCache>> stateCaches;
+	static thread_local ID3D11DeviceContext* lastCacheContext;
+	static thread_local SimpleShaderStateCache* lastCache;
+	static bool stateCaching;
+	static std::atomic<unsigned int> bindsSkipped;
+	static unsigned int frameIndex;
+	static int ringSupport; // -1 until the device is checked
+	bool WriteToRing(SimpleConstantBuffer* cb, SimpleShaderStateCache* cache);
+	bool BindRingSlice(SimpleConstantBuffer* cb);
+	bool CheckBufferLayout(unsigned int index, unsigned int size, const SimpleBufferField* fields, unsigned int fieldCount);
+	SimpleShaderStateCache* GetStateCache();
+	SimpleShaderStageState& GetStageState(SimpleShaderStage stage) { return GetStateCache()->Stages[(int)stage]; }
+
+	// Records a bind in the cache, and returns false if
+	// it's already bound and can be skipped
+	static bool CacheBind(ID3D11DeviceChild*& cached, ID3D11DeviceChild* value);
+
+	// The same for a run of slots, which are only skipped if
+	// every one of them is already bound
+	template<typename T>
+	static bool CacheBindRange(ID3D11DeviceChild** cached, T* const* values, unsigned int count)
+	{
+		if (!stateCaching)
+			return true;
+
+		bool same = true;
+		for (unsigned int i = 0; i < count && same; i++)
+			same = values[i] && cached[i] == values[i];
+
+		if (same)
+		{
+			bindsSkipped++;
+			return false;
+		}
+
+		for (unsigned int i = 0; i < count; i++)
+			cached[i] = values[i];
+		return true;
+	}
+	void WriteLocalData(const SimpleShaderVariable* var, const void* data, unsigned int size);
+
 	// Resource counts
 	unsigned int constantBufferCount;
 
-	// Maps for variables and buffers
-	SimpleConstantBuffer* constantBuffers; // For index-based lookup
-	std::vector<SimpleSRV*>		shaderResourceViews;
-	std::vector<SimpleSampler*>	samplerStates;
-	std::unordered_map<std::string, SimpleConstantBuffer*> cbTable;
-	std::unordered_map<std::string, SimpleShaderVariable> varTable;
-	std::unordered_map<std::string, SimpleSRV*> textureTable;
-	std::unordered_map<std::string, SimpleSampler*> samplerTable;
+	// This instance's buffers, indexed like the reflection's
+	SimpleConstantBuffer* constantBuffers;
+
+	// Reflection shared by every shader with the same bytecode
+	//  - The cache only holds weak references, so a reflection
+	//    goes away along with the last shader using it
+	std::shared_ptr<const SimpleShaderReflection> reflection;
+	//  - The reflection cache holds strong ones to everything loaded
+	//    from its file or reflected since
+	static std::mutex reflectionMutex;
+	static std::unordered_map<unsigned long long, std::weak_ptr<const SimpleShaderReflection>> reflections;
+	static std::unordered_map<unsigned long long, std::shared_ptr<const SimpleShaderReflection>> cachedReflections;
+	static std::unordered_map<unsigned long long, bool> usedCachedReflections;	// Whether each was loaded (rather than reflected)
+	static SimpleShaderReflectionCacheStats reflectionCacheStats;
+	static std::shared_ptr<const SimpleShaderReflection> InternReflection(const void* bytecode, size_t size);
+	static std::shared_ptr<SimpleShaderReflection> BuildReflection(const void* bytecode, size_t size);
+	static void SortHashes(SimpleShaderReflection::HashTable& table, const std::vector<std::string>& names);
+
+	// Hashed name lookups, with the string versions also checking
+	// the name itself (and falling back to a search on a collision)
+	static SimpleShaderHandle FindHash(const SimpleShaderReflection::HashTable& table, const SimpleShaderName& name);
+	static SimpleShaderHandle FindName(const SimpleShaderReflection::HashTable& table, const std::vector<std::string>& names, const std::string& name);
 
 	// Initialization method
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	bool LoadShaderBytecode(const void* bytecode, size_t size, LPCWSTR shaderName);
+	bool LoadShaderBlob(LPCWSTR shaderName);
 
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
 	virtual void SetShaderAndCBs() = 0;
+	virtual void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs) = 0;
+	virtual void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers) = 0;
+	void BindShaderResourceView(unsigned int slot, ID3D11ShaderResourceView* srv) { BindShaderResourceViews(slot, 1, &srv); }
+	void BindSamplerState(unsigned int slot, ID3D11SamplerState* samplerState) { BindSamplerStates(slot, 1, &samplerState); }
+	virtual void BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount) = 0;
 
 	virtual void CleanUp();
 
 	// Helpers for finding data by name
-	SimpleShaderVariable* FindVariable(std::string name, int size);
+	const SimpleShaderVariable* FindVariable(std::string name, int size);
 	SimpleConstantBuffer* FindConstantBuffer(std::string name);
 
 	// Error logging
-	void Log(std::string message, WORD color);
-	void LogW(std::wstring message, WORD color);
-	void Log(std::string message);
-	void LogW(std::wstring message);
-	void LogError(std::string message);
-	void LogErrorW(std::wstring message);
-	void LogWarning(std::string message);
-	void LogWarningW(std::wstring message);
+	static void Log(std::string message, WORD color);
+	static void LogW(std::wstring message, WORD color);
+	static void Log(std::string message);
+	static void LogW(std::wstring message);
+	static void LogError(std::string message);
+	static void LogErrorW(std::wstring message);
+	static void LogWarning(std::string message);
+	static void LogWarningW(std::wstring message);
 };
 
 // --------------------------------------------------------
@@ -173,13 +567,12 @@ class SimpleVertexShader : public ISimpleShader
 public:
 	SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile);
 	SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile, Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout, bool perInstanceCompatible);
+	SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const void* bytecode, size_t bytecodeSize, LPCWSTR shaderName);
 	~SimpleVertexShader();
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> GetDirectXShader() { return shader; }
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> GetInputLayout() { return inputLayout; }
 	bool GetPerInstanceCompatible() { return perInstanceCompatible; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
 protected:
 	bool perInstanceCompatible;
@@ -187,6 +580,9 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
 	void CleanUp();
 };
 
@@ -198,16 +594,18 @@ class SimplePixelShader : public ISimpleShader
 {
 public:
 	SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile);
+	SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const void* bytecode, size_t bytecodeSize, LPCWSTR shaderName);
 	~SimplePixelShader();
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
 	void CleanUp();
 };
 
@@ -221,13 +619,14 @@ public:
 	~SimpleDomainShader();
 	Microsoft::WRL::ComPtr<ID3D11DomainShader> GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11DomainShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
 	void CleanUp();
 };
 
@@ -241,13 +640,14 @@ public:
 	~SimpleHullShader();
 	Microsoft::WRL::ComPtr<ID3D11HullShader> GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
 protected:
 	Microsoft::WRL::ComPtr<ID3D11HullShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
 	void CleanUp();
 };
 
@@ -261,8 +661,6 @@ public:
 	~SimpleGeometryShader();
 	Microsoft::WRL::ComPtr<ID3D11GeometryShader> GetDirectXShader() { return shader; }
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
 	bool CreateCompatibleStreamOutBuffer(Microsoft::WRL::ComPtr<ID3D11Buffer> buffer, int vertexCount);
 
@@ -280,6 +678,9 @@ protected:
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	bool CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
 	void CleanUp();
 
 	// Helpers
@@ -294,6 +695,7 @@ class SimpleComputeShader : public ISimpleShader
 {
 public:
 	SimpleComputeShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile);
+	SimpleComputeShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const void* bytecode, size_t bytecodeSize, LPCWSTR shaderName);
 	~SimpleComputeShader();
 	Microsoft::WRL::ComPtr<ID3D11ComputeShader> GetDirectXShader() { return shader; }
 
@@ -302,8 +704,6 @@ public:
 
 	bool HasUnorderedAccessView(std::string name);
 
-	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 	bool SetUnorderedAccessView(std::string name, Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav, unsigned int appendConsumeOffset = -1);
 
 	int GetUnorderedAccessViewIndex(std::string name);
@@ -319,5 +719,8 @@ protected:
 
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void BindSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void BindConstantBufferRange(ID3D11DeviceContext1* context, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
 	void CleanUp();
 };
\ No newline at end of file
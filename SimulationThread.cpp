@@ -0,0 +1,259 @@
+#include "SimulationThread.h"
+#include "CpuProfiler.h"
+#include "ThreadManager.h"
+
+using namespace DirectX;
+
+
+SimulationThread::SimulationThread()
+{
+	running = false;
+	tickRate = 60;
+	tick = 0;
+	camera = 0;
+	player = 0;
+	changesApplied = 0;
+	changesQueued = 0;
+	writeIndex = 0;
+	readyIndex = 1;
+	readIndex = 2;
+	controls = {};
+	hasCameraPitchYawRoll = false;
+	cameraPitchYawRoll = XMFLOAT3(0, 0, 0);
+	hasCameraPosition = false;
+	cameraPosition = XMFLOAT3(0, 0, 0);
+
+	// The regular timer would only wake the thread every 15ms or so
+	tickTimer = CreateWaitableTimerExW(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!tickTimer)
+		tickTimer = CreateWaitableTimerExW(0, 0, 0, TIMER_ALL_ACCESS);
+}
+
+SimulationThread::~SimulationThread()
+{
+	Stop();
+	if (tickTimer)
+		CloseHandle(tickTimer);
+}
+
+// --------------------------------------------------------
+// Makes the simulation's own copies of everything it moves,
+// fills every packet with their current state (so the first
+// one picked up is sensible) and starts the thread
+// --------------------------------------------------------
+void SimulationThread::Start(Camera* camera, Player* player, ProjectilePool* projectiles, int tickRate)
+{
+	Stop();
+
+	XMFLOAT3 pos = camera->GetTransform()->GetPosition();
+	XMFLOAT3 rot = camera->GetTransform()->GetPitchYawRoll();
+	this->camera = new Camera(pos.x, pos.y, pos.z, 3.0f, 1.0f, 1.0f);
+	this->camera->GetTransform()->SetRotation(rot.x, rot.y, rot.z);
+	this->player = new Player(0, 0, this->camera);
+	this->player->SetVelocity(player->velocityX, player->velocityY, player->velocityZ);
+	this->projectiles.Resize(projectiles->GetCount());
+	for (unsigned int i = 0; i < projectiles->GetCount(); i++)
+		this->projectiles.Set(i, projectiles->GetState(i));
+
+	tick = 0;
+	changesApplied = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		packets[i].Tick = 0;
+		packets[i].ChangesApplied = 0;
+		packets[i].Time = std::chrono::high_resolution_clock::now();
+		CaptureState(packets[i].Previous);
+		packets[i].Current = packets[i].Previous;
+	}
+	writeIndex = 0;
+	readyIndex = 1;
+	readIndex = 2;
+
+	{
+		std::lock_guard<std::mutex> lock(changesMutex);
+		controls = {};
+		hasCameraPitchYawRoll = false;
+		hasCameraPosition = false;
+		hasProjectile.clear();
+		projectileChanges.clear();
+		changesQueued = 0;
+	}
+
+	this->tickRate = tickRate;
+	running = true;
+	thread = std::thread(&SimulationThread::Run, this);
+}
+
+void SimulationThread::Stop()
+{
+	if (!running)
+		return;
+
+	running = false;
+	thread.join();
+
+	delete player;
+	delete camera;
+	player = 0;
+	camera = 0;
+	projectiles.Resize(0);
+}
+
+bool SimulationThread::AcquirePacket(const RenderPacket*& packet)
+{
+	bool fresh = (readyIndex.load() & SIMULATION_PACKET_NEW) != 0;
+	if (fresh)
+		readIndex = readyIndex.exchange(readIndex) & ~SIMULATION_PACKET_NEW;
+
+	packet = &packets[readIndex];
+	return fresh;
+}
+
+float SimulationThread::GetBlend(const RenderPacket& packet)
+{
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - packet.Time).count();
+	return (float)min(seconds * tickRate, 1.0);
+}
+
+void SimulationThread::SetControls(const PlayerControls& controls)
+{
+	std::lock_guard<std::mutex> lock(changesMutex);
+	this->controls = controls;
+}
+
+void SimulationThread::SetCameraPitchYawRoll(XMFLOAT3 pitchYawRoll)
+{
+	std::lock_guard<std::mutex> lock(changesMutex);
+	hasCameraPitchYawRoll = true;
+	cameraPitchYawRoll = pitchYawRoll;
+}
+
+void SimulationThread::SetCameraPosition(XMFLOAT3 position)
+{
+	std::lock_guard<std::mutex> lock(changesMutex);
+	hasCameraPosition = true;
+	cameraPosition = position;
+}
+
+unsigned long long SimulationThread::SetProjectile(unsigned int index, const SimulatedProjectile& state)
+{
+	std::lock_guard<std::mutex> lock(changesMutex);
+	if (index >= hasProjectile.size())
+	{
+		hasProjectile.resize(index + 1, false);
+		projectileChanges.resize(index + 1);
+	}
+	hasProjectile[index] = true;
+	projectileChanges[index] = state;
+	return ++changesQueued;
+}
+
+bool SimulationThread::Matches(const SimulatedProjectile& a, const SimulatedProjectile& b)
+{
+	return
+		a.Position.x == b.Position.x && a.Position.y == b.Position.y && a.Position.z == b.Position.z &&
+		a.PitchYawRoll.x == b.PitchYawRoll.x && a.PitchYawRoll.y == b.PitchYawRoll.y && a.PitchYawRoll.z == b.PitchYawRoll.z &&
+		a.Velocity.x == b.Velocity.x && a.Velocity.y == b.Velocity.y && a.Velocity.z == b.Velocity.z &&
+		a.Gravity == b.Gravity && a.Age == b.Age && a.Lifespan == b.Lifespan && a.Dead == b.Dead;
+}
+
+void SimulationThread::CaptureState(SimulationState& state)
+{
+	state.CameraPosition = camera->GetTransform()->GetPosition();
+	state.CameraPitchYawRoll = camera->GetTransform()->GetPitchYawRoll();
+	state.PlayerVelocity = XMFLOAT3(player->velocityX, player->velocityY, player->velocityZ);
+	state.Projectiles.resize(projectiles.GetCount());
+	for (unsigned int i = 0; i < projectiles.GetCount(); i++)
+		state.Projectiles[i] = projectiles.Get(i);
+}
+
+// --------------------------------------------------------
+// The thread itself: one tick per period, each handing
+// over its packet as soon as it's done, then sleeping on
+// the waitable timer until the next is due
+//  - Falling behind restarts the schedule from now, rather
+//    than running a burst of ticks to catch up
+// --------------------------------------------------------
+void SimulationThread::Run()
+{
+	CpuProfiler::GetInstance().NameThread("Simulation");
+	ThreadManager::GetInstance().Configure(ThreadRole::Simulation, "Simulation");
+	auto nextTick = std::chrono::high_resolution_clock::now();
+	SimulationState previous;
+	while (running)
+	{
+		float dt = 1.0f / tickRate;
+		ApplyChanges();
+		CaptureState(previous);
+		Tick(dt);
+
+		RenderPacket& packet = packets[writeIndex];
+		packet.Tick = ++tick;
+		packet.ChangesApplied = changesApplied;
+		packet.Time = std::chrono::high_resolution_clock::now();
+		packet.Previous = previous;
+		CaptureState(packet.Current);
+		writeIndex = readyIndex.exchange(writeIndex | SIMULATION_PACKET_NEW) & ~SIMULATION_PACKET_NEW;
+
+		nextTick += std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(dt));
+		auto now = std::chrono::high_resolution_clock::now();
+		if (nextTick < now)
+		{
+			nextTick = now;
+			continue;
+		}
+
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -(LONGLONG)(std::chrono::duration<double>(nextTick - now).count() * 10000000.0); // Relative, in 100ns units
+		if (tickTimer && SetWaitableTimerEx(tickTimer, &dueTime, 0, 0, 0, 0, 0))
+			WaitForSingleObject(tickTimer, INFINITE);
+		else
+			std::this_thread::sleep_until(nextTick);
+	}
+
+	ThreadManager::GetInstance().Unregister();
+}
+
+// --------------------------------------------------------
+// Gives the simulation's copies whatever the main thread
+// changed since the last tick
+// --------------------------------------------------------
+void SimulationThread::ApplyChanges()
+{
+	std::lock_guard<std::mutex> lock(changesMutex);
+
+	Transform* transform = camera->GetTransform();
+	if (hasCameraPitchYawRoll)
+		transform->SetRotation(cameraPitchYawRoll.x, cameraPitchYawRoll.y, cameraPitchYawRoll.z);
+	if (hasCameraPosition)
+		transform->SetPosition(cameraPosition.x, cameraPosition.y, cameraPosition.z);
+	hasCameraPitchYawRoll = false;
+	hasCameraPosition = false;
+
+	// (Copies of any new ones first, which start out dead)
+	if (projectiles.GetCount() < hasProjectile.size())
+		projectiles.Resize((unsigned int)hasProjectile.size());
+	for (size_t i = 0; i < hasProjectile.size(); i++)
+	{
+		if (hasProjectile[i])
+			projectiles.Set((unsigned int)i, projectileChanges[i]);
+		hasProjectile[i] = false;
+	}
+	changesApplied = changesQueued;
+}
+
+// --------------------------------------------------------
+// The same movement as Game::SimulateTick(), minus the
+// network and the hits, which need the render side's data
+// --------------------------------------------------------
+void SimulationThread::Tick(float dt)
+{
+	PlayerControls tickControls;
+	{
+		std::lock_guard<std::mutex> lock(changesMutex);
+		tickControls = controls;
+	}
+	player->Update(dt, tickControls);
+
+	projectiles.Update(dt, 0);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <Windows.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Player.h"
+#include "Projectile.h"
+#include "ProjectilePool.h"
+
+// Flags a render packet that hasn't been picked up yet
+#define SIMULATION_PACKET_NEW	0x4
+
+// Everything the simulation thread moves, as one tick leaves it
+struct SimulationState
+{
+	DirectX::XMFLOAT3 CameraPosition;
+	DirectX::XMFLOAT3 CameraPitchYawRoll;
+	DirectX::XMFLOAT3 PlayerVelocity;
+	std::vector<SimulatedProjectile> Projectiles;	// By their index in the pool
+};
+
+// What the render side gets from each tick: the last two states,
+// to draw part way between, and when the newer one was finished
+//  - Never changed once it's handed over
+//  - ChangesApplied is how many changes had been handed over when
+//    its tick started, so anything changed since can be told apart
+//    from what the packet still has from before
+struct RenderPacket
+{
+	unsigned long long Tick;
+	unsigned long long ChangesApplied;
+	std::chrono::high_resolution_clock::time_point Time;
+	SimulationState Previous;
+	SimulationState Current;
+};
+
+// --------------------------------------------------------
+// Runs the player's movement and the projectiles on a thread
+// of their own, at a fixed tick rate, while the main thread
+// handles input, the UI and drawing
+//  - Each tick's result goes into a triple buffered render
+//    packet, so the simulation always has one to write, the
+//    render side always has the newest finished one, and
+//    neither ever waits on the other
+//  - The simulation owns copies of the player's camera and the
+//    projectiles, and the render side's objects are only set
+//    from the packets, so nothing's shared between the threads
+//  - Anything the main thread changes itself (looking around,
+//    firing, hits, the server's corrections) is handed to the
+//    simulation before its next tick, and the projectiles it
+//    hasn't heard of yet (the pool grows as they're fired) are
+//    copied when they're first handed over
+// --------------------------------------------------------
+class SimulationThread
+{
+public:
+	SimulationThread();
+	~SimulationThread();
+
+	// Copies the current state of the objects, then starts ticking
+	void Start(Camera* camera, Player* player, ProjectilePool* projectiles, int tickRate);
+	void Stop();
+	bool IsRunning() { return running; }
+
+	void SetTickRate(int ticksPerSecond) { tickRate = ticksPerSecond; }
+
+	// The newest finished packet, returning whether it's new since the last call
+	bool AcquirePacket(const RenderPacket*& packet);
+
+	// How far the render side is from the packet's older state to its
+	// newer one, one tick after the newer one was finished
+	float GetBlend(const RenderPacket& packet);
+
+	// Changes made outside the simulation, for its next tick
+	void SetControls(const PlayerControls& controls);
+	void SetCameraPitchYawRoll(DirectX::XMFLOAT3 pitchYawRoll);
+	void SetCameraPosition(DirectX::XMFLOAT3 position);
+	// Returns which change it is, to compare with a packet's ChangesApplied
+	unsigned long long SetProjectile(unsigned int index, const SimulatedProjectile& state);
+
+	static bool Matches(const SimulatedProjectile& a, const SimulatedProjectile& b);
+
+private:
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<int> tickRate;
+	HANDLE tickTimer;
+	void Run();
+	void Tick(float dt);
+	void CaptureState(SimulationState& state);
+
+	// The simulation's own copies
+	Camera* camera;
+	Player* player;
+	ProjectileArrays projectiles;
+	unsigned long long tick;
+	unsigned long long changesApplied;
+
+	// The three packets: one being written, one finished and
+	// waiting (with SIMULATION_PACKET_NEW until it's picked up),
+	// and one being read
+	RenderPacket packets[3];
+	unsigned int writeIndex;
+	std::atomic<unsigned int> readyIndex;
+	unsigned int readIndex;
+
+	// Changes waiting for the next tick
+	std::mutex changesMutex;
+	PlayerControls controls;
+	bool hasCameraPitchYawRoll;
+	DirectX::XMFLOAT3 cameraPitchYawRoll;
+	bool hasCameraPosition;
+	DirectX::XMFLOAT3 cameraPosition;
+	std::vector<bool> hasProjectile;
+	std::vector<SimulatedProjectile> projectileChanges;
+	unsigned long long changesQueued;
+	void ApplyChanges();
+};
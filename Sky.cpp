@@ -2,9 +2,110 @@
 #include "WICTextureLoader.h"
 #include "DDSTextureLoader.h"
 #include "AssetLoader.h"
+#include "LoadProfiler.h"
+#include "GpuMemory.h"
+#include "StateCache.h"
+#include "DrawStats.h"
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
 
 using namespace DirectX;
 
+// The parts of the DDS format needed to write out an uncompressed
+// texture (see DDSTextureLoader's DDS_HEADER and DDS_HEADER_DXT10)
+#define DDS_MAGIC				0x20534444	// "DDS "
+#define DDS_FOURCC_DX10			0x30315844	// "DX10"
+#define DDSD_CAPS				0x1
+#define DDSD_HEIGHT				0x2
+#define DDSD_WIDTH				0x4
+#define DDSD_PITCH				0x8
+#define DDSD_PIXELFORMAT		0x1000
+#define DDSD_MIPMAPCOUNT		0x20000
+#define DDPF_FOURCC				0x4
+#define DDSCAPS_COMPLEX			0x8
+#define DDSCAPS_TEXTURE			0x1000
+#define DDSCAPS_MIPMAP			0x400000
+#define DDSCAPS2_CUBEMAP_ALL	0xFE00		// Cube map, with all six faces
+#define DDS_DIMENSION_TEXTURE2D	3
+
+struct DDSPixelFormat
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int FourCC;
+	unsigned int RGBBitCount;
+	unsigned int RBitMask;
+	unsigned int GBitMask;
+	unsigned int BBitMask;
+	unsigned int ABitMask;
+};
+
+struct DDSHeader
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int Height;
+	unsigned int Width;
+	unsigned int PitchOrLinearSize;
+	unsigned int Depth;
+	unsigned int MipMapCount;
+	unsigned int Reserved1[11];
+	DDSPixelFormat PixelFormat;
+	unsigned int Caps;
+	unsigned int Caps2;
+	unsigned int Caps3;
+	unsigned int Caps4;
+	unsigned int Reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	DXGI_FORMAT Format;
+	unsigned int ResourceDimension;
+	unsigned int MiscFlag;
+	unsigned int ArraySize;
+	unsigned int MiscFlags2;
+};
+
+// FNV-1a, carried on from a previous hash
+static unsigned long long HashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Bytes per texel of the formats skies and IBL maps come in,
+// or zero for anything (like block compression) that isn't cached
+static unsigned int GetTexelBytes(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R16G16_UNORM:
+	case DXGI_FORMAT_R16G16_FLOAT:
+		return 4;
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return 8;
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
 Sky::Sky(
 	const wchar_t* cubemapDDSFile, 
 	Mesh* mesh, 
@@ -21,12 +122,20 @@ Sky::Sky(
 	this->samplerOptions = samplerOptions;
 	this->skyVS = skyVS;
 	this->skyPS = skyPS;
+	this->drawMode = SkyDrawMode::FullscreenTriangle;
+	this->computeIBL = false;
+	this->shIrradiance = false;
+	this->rebuilding = false;
+	this->rebuildTimingIndex = 0;
+	this->rebuildMsPerMegaSample = SKY_IBL_REBUILD_MS_PER_MSAMPLE;
 
 	// Init render states
 	InitRenderStates();
+	SetIBLQuality(SkyIBLQuality::High);
 
 	// Load texture
 	CreateDDSTextureFromFile(device.Get(), cubemapDDSFile, 0, skySRV.GetAddressOf());
+	GpuMemory::Track(skySRV.Get(), GpuMemoryCategory::Sky, "Sky Cube");
 }
 
 Sky::Sky(
@@ -38,28 +147,115 @@ Sky::Sky(
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> back,
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
 	Microsoft::WRL::ComPtr<ID3D11Device> device,
-	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context) :
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	bool useIrradianceSH,
+	SkyIBLQuality quality) :
 	samplerOptions(samplerOptions),
 	device(device),
 	context(context),
-	mipLevels(0) // Will be calculated later
+	mipLevels(0), // Will be calculated later
+	drawMode(SkyDrawMode::FullscreenTriangle),
+	shIrradiance(useIrradianceSH),
+	rebuilding(false),
+	rebuildTimingIndex(0),
+	rebuildMsPerMegaSample(SKY_IBL_REBUILD_MS_PER_MSAMPLE)
 {
 	// Init render states
 	InitRenderStates();
+	SetIBLQuality(quality);
 
 	// Create texture from 6 images
 	skySRV = CreateCubemap(right, left, up, down, front, back);
+	CreateIBL();
+}
 
-	// Build IBL Maps
-	IBLCreateIrradianceMap();
-	IBLCreateConvolvedSpecularMap();
-	IBLCreateBRDFLookUpTexture();
+Sky::Sky(
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap,
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	bool useIrradianceSH,
+	SkyIBLQuality quality) :
+	samplerOptions(samplerOptions),
+	device(device),
+	context(context),
+	skySRV(cubemap),
+	mipLevels(0),
+	drawMode(SkyDrawMode::FullscreenTriangle),
+	shIrradiance(useIrradianceSH),
+	rebuilding(false),
+	rebuildTimingIndex(0),
+	rebuildMsPerMegaSample(SKY_IBL_REBUILD_MS_PER_MSAMPLE)
+{
+	InitRenderStates();
+	SetIBLQuality(quality);
+	CreateIBL();
 }
 
 Sky::~Sky()
 {
 }
 
+// --------------------------------------------------------
+// Makes (or loads the cached) IBL maps for the sky
+// --------------------------------------------------------
+void Sky::CreateIBL()
+{
+	Assets& assets = Assets::GetInstance();
+	computeIBL =
+		assets.GetComputeShader("IBLIrradianceMapCS.cso") &&
+		assets.GetComputeShader("IBLSpecularConvolutionCS.cso");
+	shIrradiance = shIrradiance && assets.GetComputeShader("IBLIrradianceSHCS.cso");
+
+	// Build IBL Maps, other than any that were cached for this sky already
+	//  - The compute versions come out slightly differently, so they're cached apart
+	unsigned int computeSettings[] = { computeIBL, computeSampleCount };
+	unsigned long long settingsHash = HashIBLSettings();
+	unsigned long long skyHash = HashSky(HashBytes(settingsHash, computeSettings, sizeof(computeSettings)));
+	{
+		LoadProfileScope scope("IBL", "Load Cache");
+		LoadIBLCache(settingsHash, skyHash);
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment;
+	if (shIrradiance || (computeIBL && (!irradianceCM || !convolvedSpecularCM)))
+		environment = CreateMippedSky(skySRV);
+
+	// Quick enough that it's not worth caching
+	if (shIrradiance)
+	{
+		LoadProfileScope scope("IBL", "Irradiance SH");
+		shIrradiance = IBLComputeIrradianceSH(environment);
+	}
+
+	if (!irradianceCM && !shIrradiance)
+	{
+		LoadProfileScope scope("IBL", "Irradiance Map");
+		if (computeIBL)
+			IBLComputeIrradianceMap(environment);
+		else
+			IBLCreateIrradianceMap();
+		WaitForGpu();
+	}
+	if (!convolvedSpecularCM)
+	{
+		LoadProfileScope scope("IBL", "Convolved Specular Map");
+		if (computeIBL)
+			IBLComputeConvolvedSpecularMap(environment);
+		else
+			IBLCreateConvolvedSpecularMap();
+		WaitForGpu();
+	}
+	if (!lookupTexture)
+	{
+		LoadProfileScope scope("IBL", "BRDF Look Up Texture");
+		IBLCreateBRDFLookUpTexture();
+		WaitForGpu();
+	}
+
+	SaveIBLCache(settingsHash, skyHash);
+}
+
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::IBLGetIrradianceMap()
 {
 	return irradianceCM;
@@ -80,12 +276,19 @@ int Sky::IBLGetMipLevels()
 	return mipLevels;
 }
 
-void Sky::Draw(Camera* camera)
+void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera)
 {
 	Assets& assets = Assets::GetInstance();
-	SimpleVertexShader* skyVS = assets.GetVertexShader("SkyVS.cso");
-	SimplePixelShader* skyPS = assets.GetPixelShader("SkyPS.cso");
-	Mesh* skyMesh = assets.GetMesh("Models\\cube.obj");
+	SimpleVertexShader* fullscreenVS = assets.GetVertexShader("SkyFullscreenVS.cso"_asset);
+	if (drawMode == SkyDrawMode::FullscreenTriangle && fullscreenVS)
+	{
+		DrawFullscreen(context, camera, fullscreenVS);
+		return;
+	}
+
+	Mesh* skyMesh = assets.GetMesh("Models\\cube.obj"_asset);
+	SimpleVertexShader* skyVS = assets.GetVertexShaderFor(assets.GetVertexShader("SkyVS.cso"_asset), skyMesh);
+	SimplePixelShader* skyPS = assets.GetPixelShader("SkyPS.cso"_asset);
 
 	// Change to the sky-specific rasterizer state
 	context->RSSetState(skyRasterState.Get());
@@ -112,6 +315,37 @@ void Sky::Draw(Camera* camera)
 	context->OMSetDepthStencilState(0, 0);
 }
 
+// --------------------------------------------------------
+// Draws the sky as one triangle at the far plane, with the
+// sample direction unprojected from each of its corners
+//  - Nothing needs culling, so it's the default rasterizer state
+// --------------------------------------------------------
+void Sky::DrawFullscreen(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera, SimpleVertexShader* fullscreenVS)
+{
+	XMFLOAT4X4 viewFloats = camera->GetView();
+	XMMATRIX view = XMLoadFloat4x4(&viewFloats);
+	view.r[3] = XMVectorSet(0, 0, 0, 1);
+	XMFLOAT4X4 projFloats = camera->GetProjection();
+	XMFLOAT4X4 inverseViewProjection;
+	XMStoreFloat4x4(&inverseViewProjection, XMMatrixInverse(0, view * XMLoadFloat4x4(&projFloats)));
+
+	context->RSSetState(0);
+	context->OMSetDepthStencilState(skyDepthState.Get(), 0);
+	SimplePixelShader* skyPS = Assets::GetInstance().GetPixelShader("SkyPS.cso"_asset);
+	fullscreenVS->SetShader();
+	skyPS->SetShader();
+
+	fullscreenVS->SetMatrix4x4("inverseViewProjection", inverseViewProjection);
+	fullscreenVS->CopyAllBufferData();
+	skyPS->SetShaderResourceView("skyTexture", skySRV);
+	skyPS->SetSamplerState("samplerOptions", samplerOptions);
+
+	context->Draw(3, 0);
+	DrawStats::Count(DrawCounter::Draws);
+
+	context->OMSetDepthStencilState(0, 0);
+}
+
 void Sky::InitRenderStates()
 {
 	// Rasterizer to reverse the cull mode
@@ -119,14 +353,14 @@ void Sky::InitRenderStates()
 	rastDesc.CullMode = D3D11_CULL_FRONT; // Draw the inside instead of the outside!
 	rastDesc.FillMode = D3D11_FILL_SOLID;
 	rastDesc.DepthClipEnable = true;
-	device->CreateRasterizerState(&rastDesc, skyRasterState.GetAddressOf());
+	skyRasterState = StateCache::GetInstance().GetRasterizerState(rastDesc);
 
 	// Depth state so that we ACCEPT pixels with a depth == 1
 	D3D11_DEPTH_STENCIL_DESC depthDesc = {};
 	depthDesc.DepthEnable = true;
 	depthDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
 	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-	device->CreateDepthStencilState(&depthDesc, skyDepthState.GetAddressOf());
+	skyDepthState = StateCache::GetInstance().GetDepthStencilState(depthDesc);
 }
 
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(
@@ -172,7 +406,7 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(
 
 	// Create the actual texture resource
 	ID3D11Texture2D* cubeMapTexture = 0;
-	device->CreateTexture2D(&cubeDesc, 0, &cubeMapTexture);
+	GpuMemory::CreateTexture2D(device.Get(), &cubeDesc, 0, &cubeMapTexture, GpuMemoryCategory::Sky, "Sky Cube");
 
 	// Loop through the individual face textures and copy them,
 	// one at a time, to the cube map texure
@@ -215,6 +449,259 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(
 	return cubeSRV;
 }
 
+void Sky::SetIBLQuality(SkyIBLQuality quality)
+{
+	switch (quality)
+	{
+	case SkyIBLQuality::Low: mipFaceSize = 128; lookupSize = 32; break;
+	case SkyIBLQuality::Medium: mipFaceSize = 256; lookupSize = 64; break;
+	default:
+	case SkyIBLQuality::High: mipFaceSize = 512; lookupSize = 64; break;
+	}
+
+	// Half the size of 16 bit floats, and the same as the old 8 bit maps
+	cubeFormat = DXGI_FORMAT_R11G11B10_FLOAT;
+	lookupFormat = DXGI_FORMAT_R16G16_FLOAT;
+}
+
+// Everything that changes what the IBL maps come out as, other than the sky
+unsigned long long Sky::HashIBLSettings()
+{
+	int settings[] = { SKY_IBL_CACHE_VERSION, mipFaceSize, mipSkip, lookupSize, (int)cubeFormat, (int)lookupFormat };
+	float sampleSteps[] = { irradianceSampleStepPhi, irradianceSampleStepTheta };
+	unsigned long long hash = HashBytes(14695981039346656037ull, settings, sizeof(settings));
+	return HashBytes(hash, sampleSteps, sizeof(sampleSteps));
+}
+
+// --------------------------------------------------------
+// Hashes the sky's texels along with the settings, by way
+// of a staging copy, returning zero if it can't be cached
+//  - Reading it back waits on the GPU, but that's nothing
+//    next to convolving it
+// --------------------------------------------------------
+unsigned long long Sky::HashSky(unsigned long long settingsHash)
+{
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	skySRV->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&texture)))
+		return 0;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->GetDesc(&desc);
+	unsigned int texelBytes = GetTexelBytes(desc.Format);
+	if (texelBytes == 0)
+		return 0;
+
+	desc.BindFlags = 0;
+	desc.MiscFlags = 0;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(GpuMemory::CreateTexture2D(device.Get(), &desc, 0, staging.GetAddressOf(), GpuMemoryCategory::Staging, "Sky Staging")))
+		return 0;
+	context->CopyResource(staging.Get(), texture.Get());
+
+	unsigned int layout[] = { desc.Width, desc.Height, desc.MipLevels, desc.ArraySize, (unsigned int)desc.Format };
+	unsigned long long hash = HashBytes(settingsHash, layout, sizeof(layout));
+	for (unsigned int slice = 0; slice < desc.ArraySize; slice++)
+	{
+		for (unsigned int mip = 0; mip < desc.MipLevels; mip++)
+		{
+			D3D11_MAPPED_SUBRESOURCE mapped = {};
+			unsigned int subresource = D3D11CalcSubresource(mip, slice, desc.MipLevels);
+			if (FAILED(context->Map(staging.Get(), subresource, D3D11_MAP_READ, 0, &mapped)))
+				return 0;
+
+			// Just the texels, not whatever pads out each row
+			unsigned int width = max(desc.Width >> mip, 1u);
+			unsigned int height = max(desc.Height >> mip, 1u);
+			for (unsigned int y = 0; y < height; y++)
+				hash = HashBytes(hash, (const unsigned char*)mapped.pData + y * mapped.RowPitch, width * texelBytes);
+			context->Unmap(staging.Get(), subresource);
+		}
+	}
+	return hash == 0 ? 1 : hash;
+}
+
+std::string Sky::GetIBLCachePath(unsigned long long hash, const char* map)
+{
+	char exePath[MAX_PATH] = {};
+	GetModuleFileNameA(0, exePath, MAX_PATH);
+	std::string path = exePath;
+	path = path.substr(0, path.find_last_of("\\/") + 1) + SKY_IBL_CACHE_FOLDER;
+
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx_%s.dds", hash, map);
+	return path + name;
+}
+
+// Whatever's missing (or can't be loaded) is left null, to be made
+void Sky::LoadIBLCache(unsigned long long settingsHash, unsigned long long skyHash)
+{
+	auto load = [&](unsigned long long hash, const char* map, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+	{
+		std::string path = GetIBLCachePath(hash, map);
+		if (GetFileAttributesA(path.c_str()) == INVALID_FILE_ATTRIBUTES)
+			return;
+
+		std::wstring widePath(path.begin(), path.end());
+		if (FAILED(CreateDDSTextureFromFile(device.Get(), widePath.c_str(), 0, srv.GetAddressOf())))
+			srv.Reset();
+		else
+		{
+			GpuMemory::Track(srv.Get(), GpuMemoryCategory::Sky, map);
+			printf("Loaded cached %s map\n", map);
+		}
+	};
+
+	if (skyHash != 0)
+	{
+		if (!shIrradiance)
+			load(skyHash, "irradiance", irradianceCM);
+		load(skyHash, "specular", convolvedSpecularCM);
+	}
+	load(settingsHash, "brdf", lookupTexture);
+
+	// The mip count's normally worked out while convolving
+	if (convolvedSpecularCM)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		convolvedSpecularCM->GetDesc(&srvDesc);
+		mipLevels = srvDesc.TextureCube.MipLevels;
+	}
+}
+
+// Saves each map that isn't already cached
+void Sky::SaveIBLCache(unsigned long long settingsHash, unsigned long long skyHash)
+{
+	std::string folder = GetIBLCachePath(0, "");
+	CreateDirectoryA(folder.substr(0, folder.find_last_of("\\/")).c_str(), 0);
+
+	auto save = [&](unsigned long long hash, const char* map, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+	{
+		std::string path = GetIBLCachePath(hash, map);
+		if (!srv || GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES)
+			return;
+
+		Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+		srv->GetResource(resource.GetAddressOf());
+		if (!SaveDDS(resource.Get(), path))
+			printf("Couldn't cache %s map to %s\n", map, path.c_str());
+	};
+
+	if (skyHash != 0)
+	{
+		save(skyHash, "irradiance", irradianceCM);
+		save(skyHash, "specular", convolvedSpecularCM);
+	}
+	save(settingsHash, "brdf", lookupTexture);
+}
+
+// --------------------------------------------------------
+// Writes every mip of every slice of an uncompressed 2D
+// texture (or cube map) to a DDS file, with the DX10 header
+// so the format's kept exactly
+// --------------------------------------------------------
+bool Sky::SaveDDS(ID3D11Resource* resource, std::string path)
+{
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	if (FAILED(resource->QueryInterface(IID_PPV_ARGS(texture.GetAddressOf()))))
+		return false;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->GetDesc(&desc);
+	unsigned int texelBytes = GetTexelBytes(desc.Format);
+	bool cube = (desc.MiscFlags & D3D11_RESOURCE_MISC_TEXTURECUBE) != 0;
+	if (texelBytes == 0)
+		return false;
+
+	D3D11_TEXTURE2D_DESC stagingDesc = desc;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.MiscFlags = 0;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(GpuMemory::CreateTexture2D(device.Get(), &stagingDesc, 0, staging.GetAddressOf(), GpuMemoryCategory::Staging, "Sky Staging")))
+		return false;
+	context->CopyResource(staging.Get(), texture.Get());
+
+	DDSHeader header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_PITCH | (desc.MipLevels > 1 ? DDSD_MIPMAPCOUNT : 0);
+	header.Width = desc.Width;
+	header.Height = desc.Height;
+	header.PitchOrLinearSize = desc.Width * texelBytes;
+	header.MipMapCount = desc.MipLevels;
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = DDPF_FOURCC;
+	header.PixelFormat.FourCC = DDS_FOURCC_DX10;
+	header.Caps = DDSCAPS_TEXTURE | (desc.MipLevels > 1 || cube ? DDSCAPS_COMPLEX : 0) | (desc.MipLevels > 1 ? DDSCAPS_MIPMAP : 0);
+	header.Caps2 = cube ? DDSCAPS2_CUBEMAP_ALL : 0;
+
+	// Cube maps count whole cubes, rather than faces
+	DDSHeaderDX10 dx10 = {};
+	dx10.Format = desc.Format;
+	dx10.ResourceDimension = DDS_DIMENSION_TEXTURE2D;
+	dx10.MiscFlag = cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+	dx10.ArraySize = cube ? desc.ArraySize / 6 : desc.ArraySize;
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	unsigned int magic = DDS_MAGIC;
+	file.write((const char*)&magic, sizeof(magic));
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&dx10, sizeof(dx10));
+
+	// Slice by slice, each with its whole mip chain
+	bool written = true;
+	for (unsigned int slice = 0; written && slice < desc.ArraySize; slice++)
+	{
+		for (unsigned int mip = 0; written && mip < desc.MipLevels; mip++)
+		{
+			D3D11_MAPPED_SUBRESOURCE mapped = {};
+			unsigned int subresource = D3D11CalcSubresource(mip, slice, desc.MipLevels);
+			if (FAILED(context->Map(staging.Get(), subresource, D3D11_MAP_READ, 0, &mapped)))
+			{
+				written = false;
+				break;
+			}
+
+			unsigned int width = max(desc.Width >> mip, 1u);
+			unsigned int height = max(desc.Height >> mip, 1u);
+			for (unsigned int y = 0; y < height; y++)
+				file.write((const char*)mapped.pData + y * mapped.RowPitch, width * texelBytes);
+			context->Unmap(staging.Get(), subresource);
+		}
+	}
+
+	written = written && file.good();
+	file.close();
+	if (!written)
+		DeleteFileA(path.c_str());
+	return written;
+}
+
+// Only while the profiler's recording, since otherwise there's nothing to wait for
+void Sky::WaitForGpu()
+{
+	if (!LoadProfiler::GetInstance().IsRecording())
+		return;
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	Microsoft::WRL::ComPtr<ID3D11Query> query;
+	if (FAILED(device->CreateQuery(&queryDesc, query.GetAddressOf())))
+		return;
+
+	context->End(query.Get());
+	BOOL done = FALSE;
+	while (context->GetData(query.Get(), &done, sizeof(done), 0) == S_FALSE)
+		std::this_thread::yield();
+}
+
 void Sky::IBLCreateIrradianceMap()
 {
 
@@ -228,11 +715,11 @@ void Sky::IBLCreateIrradianceMap()
 	texDesc.Height = mipFaceSize;
 	texDesc.ArraySize = 6; // Cube map means 6 textures
 	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;  // Basic texture format
+	texDesc.Format = cubeFormat;  // Floats, so bright skies don't clip
 	texDesc.MipLevels = 1; // No mip chain needed
 	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE; // It's a cube map
 	texDesc.SampleDesc.Count = 1; // Can't be zero
-	device->CreateTexture2D(&texDesc, 0, irrMapFinalTexture.GetAddressOf());
+	GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, irrMapFinalTexture.GetAddressOf(), GpuMemoryCategory::Sky, "Irradiance Map");
 
 
 	// Create an SRV for the irradiance texture
@@ -298,8 +785,8 @@ void Sky::IBLCreateIrradianceMap()
 
 		// Per-face shader data and copy
 		irradiancePS->SetInt("faceIndex", face);
-		irradiancePS->SetFloat("sampleStepPhi", 0.025f);
-		irradiancePS->SetFloat("sampleStepTheta", 0.025f);
+		irradiancePS->SetFloat("sampleStepPhi", irradianceSampleStepPhi);
+		irradiancePS->SetFloat("sampleStepTheta", irradianceSampleStepTheta);
 		irradiancePS->CopyAllBufferData();
 
 		// Render exactly 3 vertices
@@ -340,11 +827,11 @@ void Sky::IBLCreateConvolvedSpecularMap()
 	texDesc.Height = mipFaceSize;
 	texDesc.ArraySize = 6; // Cube map means 6 textures
 	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;  // Basic texture format
+	texDesc.Format = cubeFormat;  // Floats, so bright skies don't clip
 	texDesc.MipLevels = mipLevels; // Depends on face size
 	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE; // It's a cube map
 	texDesc.SampleDesc.Count = 1; // Can't be zero
-	device->CreateTexture2D(&texDesc, 0, specConvFinalTexture.GetAddressOf());
+	GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, specConvFinalTexture.GetAddressOf(), GpuMemoryCategory::Sky, "Specular Map");
 
 	// Create an SRV for the texture
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
@@ -390,7 +877,7 @@ void Sky::IBLCreateConvolvedSpecularMap()
 			rtvDesc.Texture2DArray.ArraySize = 1;			// How much of the array do we have access to?
 			rtvDesc.Texture2DArray.FirstArraySlice = face;	// Which texture are we rendering into?
 			rtvDesc.Texture2DArray.MipSlice = mip;			// Which mip of that texture are we rendering into?
-			rtvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;	// Same format as accum texture
+			rtvDesc.Format = texDesc.Format;				// Same format as accum texture
 
 			Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtv;
 			device->CreateRenderTargetView(specConvFinalTexture.Get(), &rtvDesc, rtv.GetAddressOf());
@@ -436,6 +923,548 @@ void Sky::IBLCreateConvolvedSpecularMap()
 
 }
 
+// --------------------------------------------------------
+// A copy of the sky with a full mip chain, for the compute
+// shaders' filtered lookups, or just the sky itself if its
+// format can't have mips generated
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateMippedSky(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> source)
+{
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	source->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&texture)))
+		return source;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->GetDesc(&desc);
+	unsigned int sourceMips = desc.MipLevels;
+
+	// Already has them all (like one from Assets::LoadCubemap())
+	if (sourceMips == (unsigned int)log2(max(desc.Width, desc.Height)) + 1)
+		return source;
+
+	desc.MipLevels = 0; // All the way down
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE | D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> mipped;
+	if (FAILED(GpuMemory::CreateTexture2D(device.Get(), &desc, 0, mipped.GetAddressOf(), GpuMemoryCategory::Sky, "Sky Cube")))
+		return source;
+	mipped->GetDesc(&desc);
+
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		context->CopySubresourceRegion(
+			mipped.Get(), D3D11CalcSubresource(0, face, desc.MipLevels), 0, 0, 0,
+			texture.Get(), D3D11CalcSubresource(0, face, sourceMips), 0);
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = desc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	srvDesc.TextureCube.MipLevels = desc.MipLevels;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (FAILED(device->CreateShaderResourceView(mipped.Get(), &srvDesc, srv.GetAddressOf())))
+		return source;
+
+	context->GenerateMips(srv.Get());
+	return srv;
+}
+
+void Sky::IBLComputeIrradianceMap(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment)
+{
+	printf("Computing irradiance map...");
+
+	// Same as the pixel shader version, but written through a UAV instead
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> irrMapFinalTexture;
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = mipFaceSize;
+	texDesc.Height = mipFaceSize;
+	texDesc.ArraySize = 6;
+	texDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.Format = cubeFormat;
+	texDesc.MipLevels = 1;
+	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	texDesc.SampleDesc.Count = 1;
+	GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, irrMapFinalTexture.GetAddressOf(), GpuMemoryCategory::Sky, "Irradiance Map");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	srvDesc.TextureCube.MipLevels = 1;
+	srvDesc.Format = texDesc.Format;
+	device->CreateShaderResourceView(irrMapFinalTexture.Get(), &srvDesc, irradianceCM.GetAddressOf());
+
+	// All six faces at once, as an array
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+	uavDesc.Texture2DArray.ArraySize = 6;
+	uavDesc.Format = texDesc.Format;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav;
+	device->CreateUnorderedAccessView(irrMapFinalTexture.Get(), &uavDesc, uav.GetAddressOf());
+
+	SimpleComputeShader* irradianceCS = Assets::GetInstance().GetComputeShader("IBLIrradianceMapCS.cso");
+	irradianceCS->SetShader();
+	irradianceCS->SetShaderResourceView("EnvironmentMap", environment);
+	irradianceCS->SetSamplerState("BasicSampler", samplerOptions);
+	irradianceCS->SetUnorderedAccessView("IrradianceMap", uav);
+	irradianceCS->SetInt("outputSize", mipFaceSize);
+	irradianceCS->SetInt("sampleCount", computeSampleCount);
+	irradianceCS->SetInt("firstFace", 0);
+	irradianceCS->SetInt("firstRow", 0);
+	irradianceCS->CopyAllBufferData();
+	irradianceCS->DispatchByThreads(mipFaceSize, mipFaceSize, 6);
+	context->Flush();
+
+	// Unbind, so the map can be read from
+	ID3D11UnorderedAccessView* nullUAVs[1] = {};
+	ID3D11ShaderResourceView* nullSRVs[1] = {};
+	context->CSSetUnorderedAccessViews(0, 1, nullUAVs, 0);
+	context->CSSetShaderResources(0, 1, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+
+	printf("Complete.\n");
+}
+
+void Sky::IBLComputeConvolvedSpecularMap(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment)
+{
+	printf("Computing convolved environment map for indirect specular lighting...");
+
+	// Same mip chain as the pixel shader version
+	mipLevels = max((int)(log2(mipFaceSize)) + 1 - mipSkip, 1);
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> specConvFinalTexture;
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = mipFaceSize;
+	texDesc.Height = mipFaceSize;
+	texDesc.ArraySize = 6;
+	texDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.Format = cubeFormat;
+	texDesc.MipLevels = mipLevels;
+	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	texDesc.SampleDesc.Count = 1;
+	GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, specConvFinalTexture.GetAddressOf(), GpuMemoryCategory::Sky, "Specular Map");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	srvDesc.TextureCube.MipLevels = mipLevels;
+	srvDesc.Format = texDesc.Format;
+	device->CreateShaderResourceView(specConvFinalTexture.Get(), &srvDesc, convolvedSpecularCM.GetAddressOf());
+
+	SimpleComputeShader* specConvCS = Assets::GetInstance().GetComputeShader("IBLSpecularConvolutionCS.cso");
+	specConvCS->SetShader();
+	specConvCS->SetShaderResourceView("EnvironmentMap", environment);
+	specConvCS->SetSamplerState("BasicSampler", samplerOptions);
+
+	// One dispatch per mip, covering all six faces
+	ID3D11UnorderedAccessView* nullUAVs[1] = {};
+	for (int mip = 0; mip < mipLevels; mip++)
+	{
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+		uavDesc.Texture2DArray.MipSlice = mip;
+		uavDesc.Texture2DArray.ArraySize = 6;
+		uavDesc.Format = texDesc.Format;
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav;
+		device->CreateUnorderedAccessView(specConvFinalTexture.Get(), &uavDesc, uav.GetAddressOf());
+
+		unsigned int size = max(mipFaceSize >> mip, 1);
+		specConvCS->SetUnorderedAccessView("ConvolvedMip", uav);
+		specConvCS->SetFloat("roughness", mip / (float)(mipLevels - 1));
+		specConvCS->SetInt("outputSize", size);
+		specConvCS->SetInt("sampleCount", computeSampleCount);
+		specConvCS->SetInt("firstFace", 0);
+		specConvCS->SetInt("firstRow", 0);
+		specConvCS->CopyAllBufferData();
+		specConvCS->DispatchByThreads(size, size, 6);
+		context->CSSetUnorderedAccessViews(0, 1, nullUAVs, 0);
+
+		// Still worth flushing between mips, to stay clear of a timeout
+		context->Flush();
+	}
+
+	ID3D11ShaderResourceView* nullSRVs[1] = {};
+	context->CSSetShaderResources(0, 1, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+
+	printf("done!\n");
+}
+
+// --------------------------------------------------------
+// Projects the sky into L2 spherical harmonics on the GPU,
+// then adds up each group's sums here and convolves them
+// with the cosine lobe, returning false if it couldn't
+//  - Matches the irradiance map, which is divided by pi
+// --------------------------------------------------------
+bool Sky::IBLComputeIrradianceSH(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment)
+{
+	Microsoft::WRL::ComPtr<ID3D11Buffer> readback = IBLDispatchIrradianceSH(environment);
+	return readback && IBLReadIrradianceSH(readback.Get(), irradianceSH);
+}
+
+// Queues up the projection and a copy of each group's sums
+// to read back, returning null if it couldn't
+Microsoft::WRL::ComPtr<ID3D11Buffer> Sky::IBLDispatchIrradianceSH(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment)
+{
+	unsigned int groupsPerSide = shProjectSize / 8;
+	unsigned int groupCount = groupsPerSide * groupsPerSide * 6;
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = groupCount * 9 * sizeof(XMFLOAT4);
+	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = sizeof(XMFLOAT4);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> partials;
+	if (FAILED(GpuMemory::CreateBuffer(device.Get(), &bufferDesc, 0, partials.GetAddressOf(), GpuMemoryCategory::Buffers, "Sky Partials")))
+		return 0;
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.NumElements = groupCount * 9;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav;
+	if (FAILED(device->CreateUnorderedAccessView(partials.Get(), &uavDesc, uav.GetAddressOf())))
+		return 0;
+
+	bufferDesc.BindFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.Usage = D3D11_USAGE_STAGING;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> readback;
+	if (FAILED(GpuMemory::CreateBuffer(device.Get(), &bufferDesc, 0, readback.GetAddressOf(), GpuMemoryCategory::Staging, "Sky Readback")))
+		return 0;
+
+	SimpleComputeShader* shCS = Assets::GetInstance().GetComputeShader("IBLIrradianceSHCS.cso");
+	shCS->SetShader();
+	shCS->SetShaderResourceView("EnvironmentMap", environment);
+	shCS->SetSamplerState("BasicSampler", samplerOptions);
+	shCS->SetUnorderedAccessView("PartialSH", uav);
+	shCS->SetInt("projectSize", shProjectSize);
+	shCS->CopyAllBufferData();
+	shCS->DispatchByGroups(groupsPerSide, groupsPerSide, 6);
+
+	ID3D11UnorderedAccessView* nullUAVs[1] = {};
+	ID3D11ShaderResourceView* nullSRVs[1] = {};
+	context->CSSetUnorderedAccessViews(0, 1, nullUAVs, 0);
+	context->CSSetShaderResources(0, 1, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+
+	context->CopyResource(readback.Get(), partials.Get());
+	return readback;
+}
+
+// Waits for the GPU if it's not done yet, but there's only a few KB to read
+bool Sky::IBLReadIrradianceSH(ID3D11Buffer* readback, XMFLOAT4* sh)
+{
+	D3D11_BUFFER_DESC bufferDesc = {};
+	readback->GetDesc(&bufferDesc);
+	unsigned int groupCount = bufferDesc.ByteWidth / (9 * sizeof(XMFLOAT4));
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(readback, 0, D3D11_MAP_READ, 0, &mapped)))
+		return false;
+
+	double sums[9][3] = {};
+	double solidAngle = 0;
+	const XMFLOAT4* groups = (const XMFLOAT4*)mapped.pData;
+	for (unsigned int g = 0; g < groupCount; g++)
+	{
+		for (unsigned int i = 0; i < 9; i++)
+		{
+			const XMFLOAT4& c = groups[g * 9 + i];
+			sums[i][0] += c.x;
+			sums[i][1] += c.y;
+			sums[i][2] += c.z;
+		}
+		solidAngle += groups[g * 9].w;
+	}
+	context->Unmap(readback, 0);
+	if (solidAngle <= 0)
+		return false;
+
+	// The texels' solid angles should add up to the whole sphere, so any
+	// error's scaled out, then each band gets its cosine lobe factor
+	// (pi, 2pi/3, pi/4) divided by pi
+	const double bandScale[3] = { 1.0, 2.0 / 3.0, 1.0 / 4.0 };
+	const unsigned int band[9] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+	double normalize = 4.0 * XM_PI / solidAngle;
+	for (unsigned int i = 0; i < 9; i++)
+	{
+		double scale = normalize * bandScale[band[i]];
+		sh[i] = XMFLOAT4((float)(sums[i][0] * scale), (float)(sums[i][1] * scale), (float)(sums[i][2] * scale), 0);
+	}
+
+	printf("Projected sky irradiance into spherical harmonics\n");
+	return true;
+}
+
+// --------------------------------------------------------
+// Starts a rebuild from 6 new faces, with the maps and the
+// list of steps to fill them in made up front
+// --------------------------------------------------------
+void Sky::RebuildIBL(
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> right,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> left,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> up,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> down,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> front,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> back)
+{
+	RebuildIBL(CreateCubemap(right, left, up, down, front, back));
+}
+
+void Sky::RebuildIBL(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap)
+{
+	rebuild = IBLRebuild();
+	rebuild.Sky = cubemap;
+	rebuilding = false;
+
+	// The pixel shaders can only do whole faces, so there's no
+	// spreading them out, and the new sky is just used right away
+	if (!computeIBL)
+	{
+		skySRV = rebuild.Sky;
+		rebuild = IBLRebuild();
+		shIrradiance = false;
+		IBLCreateIrradianceMap();
+		IBLCreateConvolvedSpecularMap();
+		if (!lookupTexture)
+			IBLCreateBRDFLookUpTexture();
+		return;
+	}
+
+	// The lookup texture doesn't depend on the sky, but the DDS
+	// constructor never made one
+	if (!lookupTexture)
+		IBLCreateBRDFLookUpTexture();
+
+	for (auto& timing : rebuildTimings)
+	{
+		if (timing.Disjoint)
+			continue;
+
+		D3D11_QUERY_DESC queryDesc = {};
+		queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+		device->CreateQuery(&queryDesc, timing.Disjoint.GetAddressOf());
+		queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+		device->CreateQuery(&queryDesc, timing.Start.GetAddressOf());
+		device->CreateQuery(&queryDesc, timing.End.GetAddressOf());
+		timing.Pending = false;
+	}
+
+	rebuild.Environment = CreateMippedSky(rebuild.Sky);
+	rebuild.MipLevels = max((int)(log2(mipFaceSize)) + 1 - mipSkip, 1);
+	CreateIBLCube(rebuild.MipLevels, rebuild.SpecularTexture, rebuild.Specular);
+
+	// Spherical harmonics first, so they're long done by the time they're read
+	if (shIrradiance)
+		rebuild.Steps.push_back({ -1, 0, 0, 0 });
+	else
+	{
+		CreateIBLCube(1, rebuild.IrradianceTexture, rebuild.Irradiance);
+		AddRebuildSteps(-1);
+	}
+	for (int mip = 0; mip < rebuild.MipLevels; mip++)
+		AddRebuildSteps(mip);
+
+	rebuild.NextStep = 0;
+	rebuilding = true;
+}
+
+// --------------------------------------------------------
+// Runs steps until the next one would go over the budget,
+// going by how long the last few frames' steps took, and
+// swaps the new sky in once they're all done
+// --------------------------------------------------------
+bool Sky::UpdateIBL(float gpuBudgetMs)
+{
+	if (!rebuilding)
+		return false;
+
+	for (auto& timing : rebuildTimings)
+	{
+		if (timing.Pending)
+			ReadRebuildTiming(timing);
+	}
+
+	IBLRebuildTiming& timing = rebuildTimings[rebuildTimingIndex];
+	if (timing.Pending)
+		return false; // Nothing to time this frame with, which shouldn't last
+	context->Begin(timing.Disjoint.Get());
+	context->End(timing.Start.Get());
+
+	double megaSamples = 0;
+	while (rebuild.NextStep < rebuild.Steps.size())
+	{
+		const IBLRebuildStep& step = rebuild.Steps[rebuild.NextStep];
+		double cost = GetRebuildStepCost(step);
+		if (megaSamples > 0 && (megaSamples + cost) * rebuildMsPerMegaSample > gpuBudgetMs)
+			break;
+
+		RunRebuildStep(step);
+		megaSamples += cost;
+		rebuild.NextStep++;
+	}
+
+	context->End(timing.End.Get());
+	context->End(timing.Disjoint.Get());
+	timing.MegaSamples = megaSamples;
+	timing.Pending = true;
+	rebuildTimingIndex = (rebuildTimingIndex + 1) % SKY_IBL_REBUILD_FRAMES_IN_FLIGHT;
+
+	if (rebuild.NextStep < rebuild.Steps.size())
+		return false;
+
+	FinishRebuild();
+	return !rebuilding;
+}
+
+float Sky::GetIBLRebuildProgress()
+{
+	if (!rebuilding || rebuild.Steps.empty())
+		return 1.0f;
+	return rebuild.NextStep / (float)rebuild.Steps.size();
+}
+
+// An empty cube map in the IBL format, written to by the compute shaders
+void Sky::CreateIBLCube(int mips, Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = mipFaceSize;
+	texDesc.Height = mipFaceSize;
+	texDesc.ArraySize = 6;
+	texDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.Format = cubeFormat;
+	texDesc.MipLevels = mips;
+	texDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	texDesc.SampleDesc.Count = 1;
+	GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, texture.GetAddressOf(), GpuMemoryCategory::Sky, "IBL Cube");
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	srvDesc.TextureCube.MipLevels = mips;
+	srvDesc.Format = texDesc.Format;
+	device->CreateShaderResourceView(texture.Get(), &srvDesc, srv.GetAddressOf());
+}
+
+// Every face of a mip (or the irradiance map, for -1), in bands of
+// whole groups of rows
+void Sky::AddRebuildSteps(int mip)
+{
+	int size = max(mipFaceSize >> max(mip, 0), 1);
+	int rows = max(SKY_IBL_REBUILD_STEP_TEXELS / size / SKY_IBL_GROUP_SIZE, 1) * SKY_IBL_GROUP_SIZE;
+	for (int face = 0; face < 6; face++)
+	{
+		for (int row = 0; row < size; row += rows)
+			rebuild.Steps.push_back({ mip, face, row, min(rows, size - row) });
+	}
+}
+
+// In millions of environment samples
+double Sky::GetRebuildStepCost(const IBLRebuildStep& step)
+{
+	if (step.Rows == 0)
+		return 6.0 * shProjectSize * shProjectSize / 1000000.0;
+
+	int size = max(mipFaceSize >> max(step.Mip, 0), 1);
+	return (double)size * step.Rows * computeSampleCount / 1000000.0;
+}
+
+void Sky::RunRebuildStep(const IBLRebuildStep& step)
+{
+	if (step.Rows == 0)
+	{
+		rebuild.SHReadback = IBLDispatchIrradianceSH(rebuild.Environment);
+		return;
+	}
+
+	// Just the one face the step's in
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+	uavDesc.Texture2DArray.MipSlice = max(step.Mip, 0);
+	uavDesc.Texture2DArray.FirstArraySlice = step.Face;
+	uavDesc.Texture2DArray.ArraySize = 1;
+	uavDesc.Format = cubeFormat;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> uav;
+	device->CreateUnorderedAccessView(
+		step.Mip < 0 ? rebuild.IrradianceTexture.Get() : rebuild.SpecularTexture.Get(),
+		&uavDesc,
+		uav.GetAddressOf());
+
+	Assets& assets = Assets::GetInstance();
+	SimpleComputeShader* cs;
+	int size = max(mipFaceSize >> max(step.Mip, 0), 1);
+	if (step.Mip < 0)
+	{
+		cs = assets.GetComputeShader("IBLIrradianceMapCS.cso");
+		cs->SetUnorderedAccessView("IrradianceMap", uav);
+	}
+	else
+	{
+		cs = assets.GetComputeShader("IBLSpecularConvolutionCS.cso");
+		cs->SetUnorderedAccessView("ConvolvedMip", uav);
+		cs->SetFloat("roughness", step.Mip / (float)(rebuild.MipLevels - 1));
+	}
+
+	cs->SetShader();
+	cs->SetShaderResourceView("EnvironmentMap", rebuild.Environment);
+	cs->SetSamplerState("BasicSampler", samplerOptions);
+	cs->SetInt("outputSize", size);
+	cs->SetInt("sampleCount", computeSampleCount);
+	cs->SetInt("firstFace", step.Face);
+	cs->SetInt("firstRow", step.FirstRow);
+	cs->CopyAllBufferData();
+	cs->DispatchByThreads(size, step.Rows, 1);
+
+	ID3D11UnorderedAccessView* nullUAVs[1] = {};
+	ID3D11ShaderResourceView* nullSRVs[1] = {};
+	context->CSSetUnorderedAccessViews(0, 1, nullUAVs, 0);
+	context->CSSetShaderResources(0, 1, nullSRVs);
+	ISimpleShader::InvalidateStateCache(context);
+}
+
+// Folds a finished frame's timing into the running estimate, or
+// leaves it for next frame if the GPU's not there yet
+void Sky::ReadRebuildTiming(IBLRebuildTiming& timing)
+{
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+	if (context->GetData(timing.Disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return;
+	timing.Pending = false;
+
+	UINT64 start = 0, end = 0;
+	if (disjoint.Disjoint || timing.MegaSamples <= 0 ||
+		context->GetData(timing.Start.Get(), &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+		context->GetData(timing.End.Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return;
+
+	double ms = (end - start) * 1000.0 / disjoint.Frequency;
+	rebuildMsPerMegaSample = rebuildMsPerMegaSample * 0.75 + (ms / timing.MegaSamples) * 0.25;
+}
+
+// Swaps everything in at once, so no frame's lit with half of each
+void Sky::FinishRebuild()
+{
+	if (rebuild.SHReadback && !IBLReadIrradianceSH(rebuild.SHReadback.Get(), irradianceSH))
+	{
+		// Fall back to an irradiance map, which takes a few more frames
+		printf("Couldn't project the new sky into spherical harmonics\n");
+		rebuild.SHReadback.Reset();
+		rebuild.Steps.clear();
+		rebuild.NextStep = 0;
+		CreateIBLCube(1, rebuild.IrradianceTexture, rebuild.Irradiance);
+		AddRebuildSteps(-1);
+		return;
+	}
+
+	skySRV = rebuild.Sky;
+	irradianceCM = rebuild.Irradiance;
+	convolvedSpecularCM = rebuild.Specular;
+	mipLevels = rebuild.MipLevels;
+	shIrradiance = rebuild.SHReadback != 0;
+
+	rebuild = IBLRebuild();
+	rebuilding = false;
+}
+
 void Sky::IBLCreateBRDFLookUpTexture()
 {
 	printf("Creating pre-calculated environment BRDF lookup texture...");
@@ -448,11 +1477,11 @@ void Sky::IBLCreateBRDFLookUpTexture()
 	texDesc.Height = lookupSize;
 	texDesc.ArraySize = 1; // Single texture
 	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	texDesc.Format = DXGI_FORMAT_R16G16_UNORM;  // Only two channels, each of which is double the precision
+	texDesc.Format = lookupFormat;  // Only two channels, each of which is double the precision
 	texDesc.MipLevels = 1; // Just one mip level
 	texDesc.MiscFlags = 0; // NOT a cube map!
 	texDesc.SampleDesc.Count = 1; // Can't be zero
-	device->CreateTexture2D(&texDesc, 0, envBrdfFinalTexture.GetAddressOf());
+	GpuMemory::CreateTexture2D(device.Get(), &texDesc, 0, envBrdfFinalTexture.GetAddressOf(), GpuMemoryCategory::Sky, "BRDF LUT");
 
 	// Create an SRV for the BRDF look-up texture
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
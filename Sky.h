@@ -5,6 +5,49 @@
 #include "Camera.h"
 
 #include <wrl/client.h> // Used for ComPtr
+#include <string>
+#include <vector>
+
+// Where IBL maps are saved (as DDS files, next to the exe) once they're
+// made, named by a hash of the sky and everything that goes into them
+#define SKY_IBL_CACHE_FOLDER	"IBLCache\\"
+
+// Bumped whenever the IBL shaders change what they make, since
+// their bytecode isn't part of the hash
+#define SKY_IBL_CACHE_VERSION	1
+
+// Rebuilding the IBL maps at runtime is split into steps of at most
+// this many texels (whole rows of one face of one mip), as many of
+// which are run each frame as fit in the GPU time it's given
+#define SKY_IBL_REBUILD_STEP_TEXELS		16384
+#define SKY_IBL_REBUILD_FRAMES_IN_FLIGHT	4
+#define SKY_IBL_GROUP_SIZE				8	// Has to match IBL_GROUP_SIZE in IBLCompute.hlsli
+
+// A guess at GPU milliseconds per million samples, until the first
+// steps have been timed
+#define SKY_IBL_REBUILD_MS_PER_MSAMPLE	0.1
+
+// How big, and in what formats, a sky's IBL maps are made
+//  - The cube maps are floats at every level, so skies brighter than
+//    one don't clip, and the lookup texture is smooth enough that a
+//    tiny one looks the same as a big one
+enum class SkyIBLQuality
+{
+	Low,	// 128 faces, 32x32 lookup
+	Medium,	// 256 faces, 64x64 lookup
+	High	// 512 faces, 64x64 lookup
+};
+
+// What the sky's drawn with
+//  - A cube mesh around the camera, culled to its inside
+//  - One triangle over the whole screen at the far plane, which needs no
+//    vertices, world matrix or rasterizer state, and leaves every pixel
+//    something's already been drawn on to early depth testing
+enum class SkyDrawMode
+{
+	Cube,
+	FullscreenTriangle
+};
 
 class Sky
 {
@@ -31,7 +74,20 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> back,
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
 		Microsoft::WRL::ComPtr<ID3D11Device> device,
-		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		bool useIrradianceSH = false,	// Spherical harmonics instead of an irradiance map (see IBLGetIrradianceSH())
+		SkyIBLQuality quality = SkyIBLQuality::High
+	);
+
+	// Constructor that takes an existing cube map, like one from
+	// Assets::LoadCubemap() or a DDS file, and makes its IBL maps
+	Sky(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap,
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		bool useIrradianceSH = false,
+		SkyIBLQuality quality = SkyIBLQuality::High
 	);
 
 	~Sky();
@@ -41,11 +97,45 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> IBLGetBRDFLookupTexture();
 	int IBLGetMipLevels();
 
-	void Draw(Camera* camera);
+	// The sky's irradiance as nine L2 spherical harmonics coefficients
+	// (linear rgb, already convolved with the cosine lobe), which is
+	// all there is of it when the irradiance map wasn't made
+	bool IBLHasIrradianceSH() { return shIrradiance; }
+	const DirectX::XMFLOAT4* IBLGetIrradianceSH() { return irradianceSH; }
+
+	// Starts remaking the sky from 6 new faces, with its IBL maps made a
+	// few slices at a time by UpdateIBL(), while the current sky is still
+	// drawn and lit with, then swapped for the new one all at once
+	//  - Starting another rebuild drops the one in progress
+	//  - Without the compute shaders it's all done right away instead
+	void RebuildIBL(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> right,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> left,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> up,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> down,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> front,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> back);
+	void RebuildIBL(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubemap);
+
+	// Once a frame: runs as many rebuild steps as should fit in the GPU
+	// time given (at least one), returning true on the frame the new sky
+	// is swapped in
+	bool UpdateIBL(float gpuBudgetMs);
+	bool IsRebuildingIBL() { return rebuilding; }
+	float GetIBLRebuildProgress();
+
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera);
+
+	// Each sky starts out as the full screen triangle, which falls back
+	// to the cube if its shader wasn't loaded
+	void SetDrawMode(SkyDrawMode mode) { drawMode = mode; }
+	SkyDrawMode GetDrawMode() { return drawMode; }
 
 private:
 
 	void InitRenderStates();
+	void DrawFullscreen(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Camera* camera, SimpleVertexShader* fullscreenVS);
+	void CreateIBL();
 
 	// Helper for creating a cubemap from 6 individual textures
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
@@ -62,6 +152,8 @@ private:
 	
 	Mesh* skyMesh;
 
+	SkyDrawMode drawMode;
+
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> skyRasterState;
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> skyDepthState;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> skySRV;
@@ -71,13 +163,99 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lookupTexture;
 	int mipLevels;
 	const int mipSkip = 3;
-	const int mipFaceSize = 512;
-	const int lookupSize = 512;
+	int mipFaceSize;
+	int lookupSize;
+	DXGI_FORMAT cubeFormat;		// Of the irradiance and specular maps
+	DXGI_FORMAT lookupFormat;
+	void SetIBLQuality(SkyIBLQuality quality);
+	const float irradianceSampleStepPhi = 0.025f;
+	const float irradianceSampleStepTheta = 0.025f;
 
 	void IBLCreateIrradianceMap();
 	void IBLCreateConvolvedSpecularMap();
 	void IBLCreateBRDFLookUpTexture();
 
+	// The same maps from compute shaders, which write all six faces at
+	// once and sample a mip chain of the sky (see IBLCompute.hlsli), so
+	// they need a fraction of the samples for the same result
+	//  - Used whenever both shaders were loaded
+	bool computeIBL;
+	const unsigned int computeSampleCount = 256;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateMippedSky(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> source);
+	void IBLComputeIrradianceMap(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment);
+	void IBLComputeConvolvedSpecularMap(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment);
+
+	// Projecting the sky at this size is plenty for the few
+	// coefficients there are (has to be a multiple of 8)
+	bool shIrradiance;
+	DirectX::XMFLOAT4 irradianceSH[9];
+	const unsigned int shProjectSize = 64;
+	bool IBLComputeIrradianceSH(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> IBLDispatchIrradianceSH(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> environment);
+	bool IBLReadIrradianceSH(ID3D11Buffer* readback, DirectX::XMFLOAT4* sh);
+
+	// A rebuild's maps, not used until they're all done
+	//  - A step with a Mip of -1 is part of the irradiance map, and one
+	//    with no Rows projects the spherical harmonics
+	struct IBLRebuildStep
+	{
+		int Mip;
+		int Face;
+		int FirstRow;
+		int Rows;
+	};
+	struct IBLRebuild
+	{
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Environment;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> IrradianceTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Irradiance;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> SpecularTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Specular;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> SHReadback;
+		int MipLevels;
+		std::vector<IBLRebuildStep> Steps;
+		size_t NextStep;
+	};
+	IBLRebuild rebuild;
+	bool rebuilding;
+
+	// Each frame's steps are timed, and read back a few frames later, to
+	// learn how many fit in the budget
+	struct IBLRebuildTiming
+	{
+		Microsoft::WRL::ComPtr<ID3D11Query> Disjoint;
+		Microsoft::WRL::ComPtr<ID3D11Query> Start;
+		Microsoft::WRL::ComPtr<ID3D11Query> End;
+		double MegaSamples;
+		bool Pending;
+	};
+	IBLRebuildTiming rebuildTimings[SKY_IBL_REBUILD_FRAMES_IN_FLIGHT];
+	unsigned int rebuildTimingIndex;
+	double rebuildMsPerMegaSample;
+
+	void CreateIBLCube(int mips, Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	void AddRebuildSteps(int mip);
+	double GetRebuildStepCost(const IBLRebuildStep& step);
+	void RunRebuildStep(const IBLRebuildStep& step);
+	void ReadRebuildTiming(IBLRebuildTiming& timing);
+	void FinishRebuild();
+
+	// Loads IBL maps made for the same sky and settings before, or
+	// saves the ones that were just made for next time
+	//  - The lookup texture doesn't depend on the sky, so one's
+	//    shared by every sky with the same settings
+	unsigned long long HashIBLSettings();
+	unsigned long long HashSky(unsigned long long settingsHash);
+	std::string GetIBLCachePath(unsigned long long hash, const char* map);
+	void LoadIBLCache(unsigned long long settingsHash, unsigned long long skyHash);
+	void SaveIBLCache(unsigned long long settingsHash, unsigned long long skyHash);
+	bool SaveDDS(ID3D11Resource* resource, std::string path);
+
+	// Blocks until the GPU's caught up, so profiling the passes
+	// above times the rendering instead of just issuing it
+	void WaitForGpu();
+
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerOptions;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
@@ -0,0 +1,32 @@
+// The camera's inverse view-projection, without the view's translation,
+// so what's under a pixel on the far plane is just the direction to it
+cbuffer ExternalData : register(b0)
+{
+	matrix inverseViewProjection;
+}
+
+// Same as SkyVS, so they share SkyPS
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;	// XYZW position (System Value Position)
+	float3 sampleDir	: DIRECTION;
+};
+
+// --------------------------------------------------------
+// One triangle that covers the screen (like FullscreenVS),
+// right on the far plane, so it only draws where nothing
+// else has, and early depth testing skips everything else
+//  - Every point on the far plane unprojects to the same w,
+//    so dividing by it here is as good as doing it per pixel
+// --------------------------------------------------------
+VertexToPixel main(uint id : SV_VertexID)
+{
+	VertexToPixel output;
+
+	float2 uv = float2((id << 1) & 2, id & 2);
+	output.position = float4(uv.x * 2 - 1, uv.y * -2 + 1, 1, 1);
+
+	float4 farPoint = mul(inverseViewProjection, output.position);
+	output.sampleDir = farPoint.xyz / farPoint.w;
+	return output;
+}
@@ -1,4 +1,6 @@
 
+#include "VertexFormat.hlsli"
+
 // The variables defined in this cbuffer will pull their data from the 
 // constant buffer (ID3D11Buffer) bound to "vertex shader constant buffer slot 0"
 // It was bound using context->VSSetConstantBuffers() over in C++.
@@ -12,9 +14,9 @@ cbuffer ExternalData : register(b0)
 struct VertexShaderInput
 {
 	float3 position		: POSITION;     // XYZ position
-	float2 uv			: TEXCOORD;
-	float3 normal		: NORMAL;
-	float3 tangent		: TANGENT;
+	VertexUV uv			: TEXCOORD;
+	VertexDirection normal	: NORMAL;
+	VertexDirection tangent	: TANGENT;
 };
 
 // Struct representing the data we're sending down the pipeline
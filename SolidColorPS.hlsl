@@ -7,5 +7,6 @@ cbuffer externalData : register(b0)
 
 float4 main() : SV_TARGET
 {
-	return float4(Color, 1);
+	// No ambient (alpha) for the G-buffer, so AO leaves it alone
+	return float4(Color, 0);
 }
\ No newline at end of file
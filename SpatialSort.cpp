@@ -0,0 +1,56 @@
+#include "SpatialSort.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace DirectX;
+
+// Spreads the low 21 bits of a value out to every third bit
+static unsigned long long SpreadBits(unsigned int value)
+{
+	unsigned long long x = value & 0x1FFFFF;
+	x = (x | (x << 32)) & 0x1F00000000FFFFull;
+	x = (x | (x << 16)) & 0x1F0000FF0000FFull;
+	x = (x | (x << 8)) & 0x100F00F00F00F00Full;
+	x = (x | (x << 4)) & 0x10C30C30C30C30C3ull;
+	x = (x | (x << 2)) & 0x1249249249249249ull;
+	return x;
+}
+
+unsigned long long SpatialSort::GetMortonCode(unsigned int x, unsigned int y, unsigned int z)
+{
+	return SpreadBits(x) | (SpreadBits(y) << 1) | (SpreadBits(z) << 2);
+}
+
+void SpatialSort::SortByMortonCode(const std::vector<XMFLOAT3>& positions, std::vector<unsigned int>& order)
+{
+	unsigned int count = (unsigned int)positions.size();
+	order.resize(count);
+	if (count == 0)
+		return;
+
+	XMVECTOR lowest = XMVectorReplicate(FLT_MAX);
+	XMVECTOR highest = XMVectorReplicate(-FLT_MAX);
+	for (auto& p : positions)
+	{
+		XMVECTOR position = XMLoadFloat3(&p);
+		lowest = XMVectorMin(lowest, position);
+		highest = XMVectorMax(highest, position);
+	}
+
+	// Every axis gets the full range of cells (and a flat one just gets the first)
+	const float cells = (float)((1u << SPATIAL_SORT_AXIS_BITS) - 1);
+	XMVECTOR size = XMVectorSubtract(highest, lowest);
+	XMVECTOR scale = XMVectorSelect(XMVectorDivide(XMVectorReplicate(cells), size), XMVectorZero(), XMVectorLessOrEqual(size, XMVectorZero()));
+
+	std::vector<unsigned long long> codes(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT3 cell;
+		XMStoreFloat3(&cell, XMVectorClamp(XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&positions[i]), lowest), scale), XMVectorZero(), XMVectorReplicate(cells)));
+		codes[i] = GetMortonCode((unsigned int)cell.x, (unsigned int)cell.y, (unsigned int)cell.z);
+		order[i] = i;
+	}
+
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return codes[a] < codes[b]; });
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "PortableMath.h"
+#include <vector>
+
+// Bits of each axis in a Morton code, so all three fit in 64 bits
+#define SPATIAL_SORT_AXIS_BITS	21
+
+// Orders things along a Morton (Z order) curve through where they are,
+// so things next to each other in the order are near each other in space,
+// and loops over them touch nearby things together
+class SpatialSort
+{
+public:
+	// Fills order with the index of each position in its sorted place,
+	// along the curve through the box around all of them
+	//  - Positions in the same cell keep the order they were in
+	static void SortByMortonCode(const std::vector<DirectX::XMFLOAT3>& positions, std::vector<unsigned int>& order);
+
+	// Interleaves the low SPATIAL_SORT_AXIS_BITS of each coordinate
+	static unsigned long long GetMortonCode(unsigned int x, unsigned int y, unsigned int z);
+};
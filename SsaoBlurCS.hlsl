@@ -0,0 +1,74 @@
+// One row (or column) segment of pixels per group, plus the
+// few pixels either side that the blur reaches
+#define GROUP_SIZE	64
+#define BLUR_BEFORE	2
+#define BLUR_AFTER	1
+#define TILE_SIZE	(GROUP_SIZE + BLUR_BEFORE + BLUR_AFTER)
+
+cbuffer externalData : register(b0)
+{
+	float2 depthParams;		// Projection values for turning hardware depth into view depth
+	float depthSharpness;
+	int horizontal;			// Blur along rows, otherwise along columns
+	float2 viewportSize;	// Pixels actually in use, with dynamic resolution
+};
+
+
+Texture2D SSAO : register(t0);
+Texture2D Depths : register(t1);
+RWTexture2D<unorm float4> BlurResult : register(u0);
+
+groupshared float tileAO[TILE_SIZE];
+groupshared float tileDepths[TILE_SIZE];
+
+
+float LinearDepth(float depth)
+{
+	return depthParams.y / (depth - depthParams.x);
+}
+
+// Converts a position along the row/column into a pixel
+int2 PixelAt(int along, int across)
+{
+	return horizontal ? int2(along, across) : int2(across, along);
+}
+
+// Half of the separable version of SsaoBlurPS's 4x4 depth aware blur
+//  - Groups are laid out along x for both directions, so
+//    SV_GroupID.y picks the row or column
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 groupThreadID : SV_GroupThreadID, uint3 groupID : SV_GroupID)
+{
+	int2 size = int2(viewportSize);
+	int length = horizontal ? size.x : size.y;
+	int across = groupID.y;
+	int start = groupID.x * GROUP_SIZE - BLUR_BEFORE;
+
+	for (int t = groupThreadID.x; t < TILE_SIZE; t += GROUP_SIZE)
+	{
+		int3 pixel = int3(PixelAt(clamp(start + t, 0, length - 1), across), 0);
+		tileAO[t] = SSAO.Load(pixel).r;
+		tileDepths[t] = LinearDepth(Depths.Load(pixel).r);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	int along = groupID.x * GROUP_SIZE + groupThreadID.x;
+	if (along >= length)
+		return;
+
+	int center = groupThreadID.x + BLUR_BEFORE;
+	float centerDepth = tileDepths[center];
+
+	float ao = 0;
+	float totalWeight = 0;
+	for (int i = -BLUR_BEFORE; i <= BLUR_AFTER; i++)
+	{
+		// Falls off with depth difference relative to this pixel's depth
+		float weight = 1.0f / (1.0f + abs(tileDepths[center + i] - centerDepth) / centerDepth * depthSharpness);
+		ao += tileAO[center + i] * weight;
+		totalWeight += weight;
+	}
+
+	ao /= totalWeight;
+	BlurResult[PixelAt(along, across)] = float4(ao.rrr, 1);
+}
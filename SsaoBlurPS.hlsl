@@ -1,6 +1,8 @@
 cbuffer externalData : register(b0)
 {
-	float2 pixelSize;
+	float2 depthParams;	// Projection values for turning hardware depth into view depth
+	float depthSharpness;
+	float2 viewportSize;	// Only part of the targets may be in use, with dynamic resolution
 };
 
 struct VertexToPixel
@@ -11,22 +13,40 @@ struct VertexToPixel
 
 
 Texture2D SSAO : register(t0);
-SamplerState BasicSampler : register(s0);
-SamplerState ClampSampler : register(s1);
+Texture2D Depths : register(t1);
 
 
+float LinearDepth(float depth)
+{
+	return depthParams.y / (depth - depthParams.x);
+}
+
+// 4x4 blur that skips across depth discontinuities, so
+// occlusion doesn't bleed between foreground and background
 float4 main(VertexToPixel input) : SV_TARGET
 {
+	int2 maxPixel = int2(viewportSize) - 1;
+
+	int2 center = int2(input.position.xy);
+	float centerDepth = LinearDepth(Depths.Load(int3(center, 0)).r);
+
 	float ao = 0;
-	for (float x = -1.5f; x <= 1.5f; x++)  // -1.5, -0.5, 0.5, 1.5
+	float totalWeight = 0;
+	for (int x = -2; x <= 1; x++)
 	{
-		for (float y = -1.5f; y <= 1.5f; y++)
+		for (int y = -2; y <= 1; y++)
 		{
-			ao += SSAO.Sample(ClampSampler, float2(x, y) * pixelSize + input.uv).r;
+			int3 pixel = int3(clamp(center + int2(x, y), int2(0, 0), maxPixel), 0);
+			float sampleDepth = LinearDepth(Depths.Load(pixel).r);
+
+			// Falls off with depth difference relative to this pixel's depth
+			float weight = 1.0f / (1.0f + abs(sampleDepth - centerDepth) / centerDepth * depthSharpness);
+			ao += SSAO.Load(pixel).r * weight;
+			totalWeight += weight;
 		}
 	}
 
 	// Average results and return
-	ao /= 16.0f; // 4x4 blur is 16 samples
+	ao /= totalWeight;
 	return float4(ao.rrr, 1);
 }
\ No newline at end of file
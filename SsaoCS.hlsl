@@ -0,0 +1,121 @@
+#include "GBuffer.hlsli"
+
+// Each group covers a block of pixels, plus an apron of depths around
+// it, so most samples never leave group shared memory
+#define GROUP_SIZE	8
+#define TILE_APRON	8
+#define TILE_SIZE	(GROUP_SIZE + TILE_APRON * 2)
+
+cbuffer externalData : register(b0)
+{
+	matrix viewMatrix;
+	matrix projectionMatrix;
+	matrix invProjMatrix;
+
+	float4 offsets[64];
+	float ssaoRadius;
+	int ssaoSamples;
+	int sampleStart;		// First offset to use, rotated each frame for temporal SSAO
+	float2 viewportSize;	// Pixels actually in use, with dynamic resolution
+};
+
+
+Texture2D Normals : register(t0);	// Octahedral encoded
+Texture2D Depths : register(t1);	// Hardware depth (or its downsampled copy)
+Texture2D Random : register(t2);	// 4x4, tiled across the screen
+RWTexture2D<unorm float4> SSAOResult : register(u0);
+
+groupshared float tileDepths[TILE_SIZE * TILE_SIZE];
+
+
+// Rebuilds a view space position from a depth buffer value, which
+// is already the post-projection z, so it can be unprojected directly
+float3 ViewSpaceFromDepth(float depth, float2 uv)
+{
+	// Back to NDCs
+	uv.y = 1.0f - uv.y; // Invert Y due to UV <--> NDC diff
+	uv = uv * 2.0f - 1.0f;
+	float4 screenPos = float4(uv, depth, 1.0f);
+
+	// Back to view space
+	float4 viewPos = mul(invProjMatrix, screenPos);
+	return viewPos.xyz / viewPos.w;
+}
+
+float2 UVFromViewSpacePosition(float3 viewSpacePosition)
+{
+	// Apply the projection matrix to the view space position then perspective divide
+	float4 samplePosScreen = mul(projectionMatrix, float4(viewSpacePosition, 1));
+	samplePosScreen.xyz /= samplePosScreen.w;
+
+	// Adjust from NDCs to UV coords (flip the Y!)
+	samplePosScreen.xy = samplePosScreen.xy * 0.5f + 0.5f;
+	samplePosScreen.y = 1.0f - samplePosScreen.y;
+
+	return samplePosScreen.xy;
+}
+
+// Same as SsaoPS, with the depths around each group loaded once
+// into group shared memory instead of fetched for every sample
+[numthreads(GROUP_SIZE, GROUP_SIZE, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint3 groupID : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	int2 maxPixel = int2(viewportSize) - 1;
+	int2 tileOrigin = int2(groupID.xy) * GROUP_SIZE - TILE_APRON;
+
+	// Every thread loads several of the tile's depths
+	for (uint t = groupIndex; t < TILE_SIZE * TILE_SIZE; t += GROUP_SIZE * GROUP_SIZE)
+	{
+		int2 pixel = clamp(tileOrigin + int2(t % TILE_SIZE, t / TILE_SIZE), int2(0, 0), maxPixel);
+		tileDepths[t] = Depths.Load(int3(pixel, 0)).r;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	int2 pixel = int2(id.xy);
+	if (any(pixel > maxPixel))
+		return;
+
+	// Early out for sky box
+	int2 local = pixel - tileOrigin;
+	float pixelDepth = tileDepths[local.y * TILE_SIZE + local.x];
+	if (pixelDepth == 1.0f)
+	{
+		SSAOResult[pixel] = float4(1, 1, 1, 1);
+		return;
+	}
+
+	float2 uv = (pixel + 0.5f) / viewportSize;
+	float3 pixelPositionViewSpace = ViewSpaceFromDepth(pixelDepth, uv);
+	float3 randomDir = Random.Load(int3(pixel % 4, 0)).xyz;
+
+	// Normal is only needed for this pixel, so it's read directly
+	float3 normal = DecodeNormal(Normals.Load(int3(pixel, 0)).xy);
+	normal = normalize(mul((float3x3) viewMatrix, normal));
+
+	// Calculate TBN matrix
+	float3 tangent = normalize(randomDir - normal * dot(randomDir, normal));
+	float3 bitangent = cross(tangent, normal);
+	float3x3 TBN = float3x3(tangent, bitangent, normal);
+
+	float ao = 0.0f;
+	for (int i = 0; i < ssaoSamples; i++)
+	{
+		float3 samplePosView = pixelPositionViewSpace + mul(offsets[(sampleStart + i) % 64].xyz, TBN) * ssaoRadius;
+		float2 sampleUV = UVFromViewSpacePosition(samplePosView);
+
+		// From the tile when it's close enough, otherwise from the texture
+		int2 samplePixel = clamp(int2(sampleUV * viewportSize), int2(0, 0), maxPixel);
+		int2 sampleLocal = samplePixel - tileOrigin;
+		float sampleDepth = all(sampleLocal >= 0) && all(sampleLocal < TILE_SIZE) ?
+			tileDepths[sampleLocal.y * TILE_SIZE + sampleLocal.x] :
+			Depths.Load(int3(samplePixel, 0)).r;
+		float sampleZ = ViewSpaceFromDepth(sampleDepth, sampleUV).z;
+
+		// Compare the depths and fade result based on range (so far away objects arent occluded)
+		float rangeCheck = smoothstep(0.0f, 1.0f, ssaoRadius / abs(pixelPositionViewSpace.z - sampleZ));
+		ao += (sampleZ < samplePosView.z ? rangeCheck : 0.0f);
+	}
+
+	ao = 1.0f - ao / ssaoSamples;
+	SSAOResult[pixel] = float4(ao.rrr, 1);
+}
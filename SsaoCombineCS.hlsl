@@ -0,0 +1,139 @@
+#include "GBuffer.hlsli"
+
+// Blurs the SSAO and combines it with the scene in one pass, straight
+// into the back buffer, so the blurred AO never goes out to memory
+//  - Each group covers a block of window pixels, and first loads every
+//    SSAO texel their upsample reaches (plus the blur's apron) into
+//    group shared memory, then blurs those in place
+//  - The same 4x4 depth aware blur as SsaoBlurPS, and the same
+//    bilateral upsample and combine as SsaoCombinePS
+#define GROUP_SIZE	16
+#define BLUR_BEFORE	2
+#define BLUR_AFTER	1
+
+// The SSAO is never bigger than the window, so a group's pixels reach
+// at most one texel each, plus one more for the upsample's neighbours
+#define BLURRED_SIZE	(GROUP_SIZE + 2)
+#define RAW_SIZE		(BLURRED_SIZE + BLUR_BEFORE + BLUR_AFTER)
+
+cbuffer externalData : register(b0)
+{
+	float2 ssaoSize;		// Resolution of the (possibly smaller) SSAO viewport
+	float2 renderSize;		// The scene's viewport, smaller than the window with dynamic resolution
+	float2 uvScale;			// And its share of the scene's targets
+	float2 windowSize;		// Of the output, which is the render size with temporal upsampling
+
+	float2 depthParams;		// Projection values for turning hardware depth into view depth
+	float depthSharpness;
+};
+
+
+Texture2D SceneColors : register(t0);	// Packed with ambient - see GBuffer.hlsli
+Texture2D SSAO : register(t1);			// Unblurred
+Texture2D Depths : register(t2);		// Scene resolution
+Texture2D SSAODepths : register(t3);	// Same resolution as the SSAO
+SamplerState BasicSampler : register(s0);
+RWTexture2D<unorm float4> Output : register(u0);
+
+groupshared float rawAO[RAW_SIZE * RAW_SIZE];
+groupshared float rawDepths[RAW_SIZE * RAW_SIZE];
+groupshared float blurredAO[BLURRED_SIZE * BLURRED_SIZE];
+groupshared float blurredDepths[BLURRED_SIZE * BLURRED_SIZE];
+
+
+float LinearDepth(float depth)
+{
+	return depthParams.y / (depth - depthParams.x);
+}
+
+// Where a window pixel lands among the SSAO texels
+float2 SSAOTexel(float2 pixel)
+{
+	return (pixel + 0.5f) / windowSize * ssaoSize - 0.5f;
+}
+
+[numthreads(GROUP_SIZE, GROUP_SIZE, 1)]
+void main(uint3 threadID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID, uint3 groupID : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	int2 maxTexel = int2(ssaoSize) - 1;
+	int2 blurStart = int2(floor(SSAOTexel(groupID.xy * GROUP_SIZE)));
+	int2 rawStart = blurStart - BLUR_BEFORE;
+
+	// Every texel the blur reads, clamped to the viewport like the pixel shader's
+	for (uint r = groupIndex; r < RAW_SIZE * RAW_SIZE; r += GROUP_SIZE * GROUP_SIZE)
+	{
+		int3 texel = int3(clamp(rawStart + int2(r % RAW_SIZE, r / RAW_SIZE), int2(0, 0), maxTexel), 0);
+		rawAO[r] = SSAO.Load(texel).r;
+		rawDepths[r] = LinearDepth(SSAODepths.Load(texel).r);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	// Blur each texel the upsample needs (where one's outside the
+	// viewport, it's the clamped texel's blur, as it would be loaded)
+	for (uint b = groupIndex; b < BLURRED_SIZE * BLURRED_SIZE; b += GROUP_SIZE * GROUP_SIZE)
+	{
+		int2 texel = clamp(blurStart + int2(b % BLURRED_SIZE, b / BLURRED_SIZE), int2(0, 0), maxTexel);
+		int2 center = texel - rawStart;
+		float centerDepth = rawDepths[center.y * RAW_SIZE + center.x];
+
+		float ao = 0;
+		float totalWeight = 0;
+		for (int x = -BLUR_BEFORE; x <= BLUR_AFTER; x++)
+		{
+			for (int y = -BLUR_BEFORE; y <= BLUR_AFTER; y++)
+			{
+				// Already clamped when loaded, which is the same texel the
+				// pixel shader's clamped tap would read
+				int2 tap = clamp(center + int2(x, y), int2(0, 0), int2(RAW_SIZE - 1, RAW_SIZE - 1));
+				int t = tap.y * RAW_SIZE + tap.x;
+
+				// Falls off with depth difference relative to this texel's depth
+				float weight = 1.0f / (1.0f + abs(rawDepths[t] - centerDepth) / centerDepth * depthSharpness);
+				ao += rawAO[t] * weight;
+				totalWeight += weight;
+			}
+		}
+
+		blurredAO[b] = ao / totalWeight;
+		blurredDepths[b] = centerDepth;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	int2 pixel = threadID.xy;
+	if (any(pixel >= int2(windowSize)))
+		return;
+
+	// Sample the scene and its occlusion (the sky isn't occluded)
+	//  - This pass covers the window, so it upscales the scene if necessary
+	float2 uv = (pixel + 0.5f) / windowSize;
+	float4 sceneColors = SceneColors.SampleLevel(BasicSampler, uv * uvScale, 0);
+	float depth = Depths.Load(int3(min(uv * renderSize, renderSize - 1), 0)).r;
+
+	float ao = 1.0f;
+	if (depth < 1.0f)
+	{
+		// Bilateral upsample, from the blurred texels in shared memory
+		float pixelDepth = LinearDepth(depth);
+		float2 texel = SSAOTexel(pixel);
+		int2 base = int2(floor(texel));
+		float2 f = texel - base;
+
+		float bilinear[4] = { (1 - f.x) * (1 - f.y), f.x * (1 - f.y), (1 - f.x) * f.y, f.x * f.y };
+		int2 offsets[4] = { int2(0, 0), int2(1, 0), int2(0, 1), int2(1, 1) };
+
+		ao = 0;
+		float totalWeight = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			int2 t = clamp(base + offsets[i] - blurStart, int2(0, 0), int2(BLURRED_SIZE - 1, BLURRED_SIZE - 1));
+			int index = t.y * BLURRED_SIZE + t.x;
+			float weight = bilinear[i] / (1.0f + abs(blurredDepths[index] - pixelDepth) / pixelDepth * depthSharpness) + 0.0001f;
+			ao += blurredAO[index] * weight;
+			totalWeight += weight;
+		}
+		ao /= totalWeight;
+	}
+
+	// Final combine
+	Output[pixel] = float4(pow(UnpackColor(sceneColors, ao), 1.0f / 2.2f), 1);
+}
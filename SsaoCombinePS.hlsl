@@ -1,7 +1,16 @@
+#include "GBuffer.hlsli"
+
 cbuffer externalData : register(b0)
 {
 	int ssaoEnabled;
 	int ssaoOutputOnly;
+	float2 ssaoSize;	// Resolution of the (possibly smaller) SSAO viewport
+
+	float2 renderSize;	// The scene's viewport, smaller than the window with dynamic resolution
+	float2 uvScale;		// And its share of the scene's targets
+
+	float2 depthParams;	// Projection values for turning hardware depth into view depth
+	float depthSharpness;
 };
 
 struct VertexToPixel
@@ -11,18 +20,55 @@ struct VertexToPixel
 };
 
 
-Texture2D SceneColorsNoAmbient : register(t0);
-Texture2D Ambient : register(t1);
-Texture2D SSAOBlur : register(t2);
+Texture2D SceneColors : register(t0);	// Packed with ambient - see GBuffer.hlsli
+Texture2D SSAOBlur : register(t1);
+Texture2D Depths : register(t2);		// Scene resolution
+Texture2D SSAODepths : register(t3);	// Same resolution as the SSAO
 SamplerState BasicSampler : register(s0);
 
 
+float LinearDepth(float depth)
+{
+	return depthParams.y / (depth - depthParams.x);
+}
+
+// Bilateral upsample of the SSAO results: the usual bilinear
+// weights, scaled down for texels at a different depth than
+// this pixel, so AO stays on the surface it was computed for
+float UpsampleSSAO(float2 uv, float pixelDepth)
+{
+	float2 texel = uv * ssaoSize - 0.5f;
+	int2 base = int2(floor(texel));
+	float2 f = texel - base;
+	int2 maxTexel = int2(ssaoSize) - 1;
+
+	float bilinear[4] = { (1 - f.x) * (1 - f.y), f.x * (1 - f.y), (1 - f.x) * f.y, f.x * f.y };
+	int2 offsets[4] = { int2(0, 0), int2(1, 0), int2(0, 1), int2(1, 1) };
+
+	float ao = 0;
+	float totalWeight = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		int3 t = int3(clamp(base + offsets[i], int2(0, 0), maxTexel), 0);
+		float sampleDepth = LinearDepth(SSAODepths.Load(t).r);
+		float weight = bilinear[i] / (1.0f + abs(sampleDepth - pixelDepth) / pixelDepth * depthSharpness) + 0.0001f;
+		ao += SSAOBlur.Load(t).r * weight;
+		totalWeight += weight;
+	}
+
+	return ao / totalWeight;
+}
+
+
 float4 main(VertexToPixel input) : SV_TARGET
 {
-	// Sample all three
-	float3 sceneColors = SceneColorsNoAmbient.Sample(BasicSampler, input.uv).rgb;
-	float3 ambient = Ambient.Sample(BasicSampler, input.uv).rgb;
-	float ao = SSAOBlur.Sample(BasicSampler, input.uv).r;
+	// Sample the scene and its occlusion (the sky isn't occluded)
+	//  - This pass covers the window, so it upscales the scene if necessary
+	float4 sceneColors = SceneColors.Sample(BasicSampler, input.uv * uvScale);
+	float depth = Depths.Load(int3(min(input.uv * renderSize, renderSize - 1), 0)).r;
+	float ao = ssaoEnabled && depth < 1.0f ?
+		UpsampleSSAO(input.uv, LinearDepth(depth)) :
+		1.0f;
 
 
 
@@ -31,5 +77,5 @@ float4 main(VertexToPixel input) : SV_TARGET
 		return float4(ao.rrr, 1);
 
 	// Final combine
-	return float4(pow(ambient * ao + sceneColors, 1.0f / 2.2f), 1);
+	return float4(pow(UnpackColor(sceneColors, ao), 1.0f / 2.2f), 1);
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+cbuffer externalData : register(b0)
+{
+	int downscale;	// Full resolution pixels per low resolution pixel, on each axis
+};
+
+struct VertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+struct PS_Output
+{
+	float2 normals : SV_TARGET0;	// Still encoded, just copied
+	float depth : SV_TARGET1;
+};
+
+
+Texture2D Normals : register(t0);
+Texture2D Depths : register(t1);
+
+
+// Shrinks the depth and normal buffers for lower resolution SSAO
+//  - Keeps the closest depth of each block (and its normal) rather
+//    than averaging, so edges don't end up floating between surfaces
+PS_Output main(VertexToPixel input)
+{
+	int2 topLeft = int2(input.position.xy) * downscale;
+
+	PS_Output output;
+	output.depth = 1.0f;
+	output.normals = float2(0, 0);
+
+	for (int y = 0; y < downscale; y++)
+	{
+		for (int x = 0; x < downscale; x++)
+		{
+			int3 pixel = int3(topLeft + int2(x, y), 0);
+			float depth = Depths.Load(pixel).r;
+			if (depth <= output.depth)
+			{
+				output.depth = depth;
+				output.normals = Normals.Load(pixel).xy;
+			}
+		}
+	}
+
+	return output;
+}
@@ -1,3 +1,5 @@
+#include "GBuffer.hlsli"
+
 cbuffer externalData : register(b0)
 {
 	matrix viewMatrix;
@@ -8,6 +10,8 @@ cbuffer externalData : register(b0)
 	float ssaoRadius;
 	int ssaoSamples;
 	float2 randomTextureScreenScale;
+	int sampleStart;	// First offset to use, rotated each frame for temporal SSAO
+	float2 uvScale;		// The viewport's share of the textures, with dynamic resolution
 };
 
 struct VertexToPixel
@@ -17,13 +21,15 @@ struct VertexToPixel
 };
 
 
-Texture2D Normals : register(t0);
-Texture2D Depths : register(t1);
+Texture2D Normals : register(t0);	// Octahedral encoded
+Texture2D Depths : register(t1);	// Hardware depth (or its downsampled copy)
 Texture2D Random : register(t2);
 SamplerState BasicSampler : register(s0);
 SamplerState ClampSampler : register(s1);
 
 
+// Rebuilds a view space position from a depth buffer value, which
+// is already the post-projection z, so it can be unprojected directly
 float3 ViewSpaceFromDepth(float depth, float2 uv)
 {
 	// Back to NDCs
@@ -53,7 +59,7 @@ float2 UVFromViewSpacePosition(float3 viewSpacePosition)
 float4 main(VertexToPixel input) : SV_TARGET
 {
 	// Sample depth first and early out for sky box
-	float pixelDepth = Depths.Sample(ClampSampler, input.uv).r;
+	float pixelDepth = Depths.Sample(ClampSampler, input.uv * uvScale).r;
 	if (pixelDepth == 1.0f)
 		return float4(1, 1, 1, 1);
 
@@ -64,7 +70,7 @@ float4 main(VertexToPixel input) : SV_TARGET
 	float3 randomDir = Random.Sample(BasicSampler, input.uv * randomTextureScreenScale).xyz;
 
 	// Sample normal and convert to view space
-	float3 normal = Normals.Sample(BasicSampler, input.uv).xyz * 2 - 1;
+	float3 normal = DecodeNormal(Normals.Sample(BasicSampler, input.uv * uvScale).xy);
 	normal = normalize(mul((float3x3) viewMatrix, normal));
 	
 	// Calculate TBN matrix
@@ -77,13 +83,13 @@ float4 main(VertexToPixel input) : SV_TARGET
 	for (int i = 0; i < ssaoSamples; i++)
 	{
 		// Rotate the offset, scale and apply to position
-		float3 samplePosView = pixelPositionViewSpace + mul(offsets[i].xyz, TBN) * ssaoRadius;
+		float3 samplePosView = pixelPositionViewSpace + mul(offsets[(sampleStart + i) % 64].xyz, TBN) * ssaoRadius;
 
 		// Get the UV coord of this position
 		float2 samplePosScreen = UVFromViewSpacePosition(samplePosView);
 
 		// Sample the this nearby depth
-		float sampleDepth = Depths.SampleLevel(ClampSampler, samplePosScreen.xy, 0).r;
+		float sampleDepth = Depths.SampleLevel(ClampSampler, samplePosScreen.xy * uvScale, 0).r;
 		float sampleZ = ViewSpaceFromDepth(sampleDepth, samplePosScreen.xy).z;
 
 		// Compare the depths and fade result based on range (so far away objects arent occluded)
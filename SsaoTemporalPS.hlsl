@@ -0,0 +1,64 @@
+#include "GBuffer.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	matrix reprojection;	// This frame's NDCs to last frame's clip space
+	float2 depthParams;		// Projection values for turning hardware depth into view depth
+	float historyWeight;	// How much of the history to keep when it's valid
+	int historyValid;
+	float2 historyUVScale;	// Last frame's viewport's share of the history, with dynamic resolution
+};
+
+struct VertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+
+Texture2D SSAO : register(t0);		// This frame's (noisy, few sample) result
+Texture2D History : register(t1);	// Last frame's output - ao, view depth, encoded normal
+Texture2D Normals : register(t2);
+Texture2D Depths : register(t3);
+SamplerState ClampSampler : register(s0);
+
+
+float LinearDepth(float depth)
+{
+	return depthParams.y / (depth - depthParams.x);
+}
+
+// Blends this frame's SSAO into last frame's, found by reprojecting
+// each pixel with the previous view-projection
+//  - History that's off screen, or whose depth or normal doesn't
+//    match this pixel's, belongs to another surface and is dropped
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	int3 pixel = int3(input.position.xy, 0);
+	float ao = SSAO.Load(pixel).r;
+	float depth = Depths.Load(pixel).r;
+	float2 encodedNormal = Normals.Load(pixel).xy;
+
+	// Sky never has occlusion, or history worth keeping
+	if (depth >= 1.0f)
+		return float4(1, 0, encodedNormal);
+
+	float viewDepth = LinearDepth(depth);
+
+	// Where this pixel was last frame
+	float2 ndc = float2(input.uv.x, 1.0f - input.uv.y) * 2.0f - 1.0f;
+	float4 prevClip = mul(reprojection, float4(ndc, depth, 1.0f));
+	float2 prevUV = prevClip.xy / prevClip.w * float2(0.5f, -0.5f) + 0.5f;
+
+	if (historyValid && all(prevUV >= 0.0f) && all(prevUV <= 1.0f))
+	{
+		float4 history = History.SampleLevel(ClampSampler, prevUV * historyUVScale, 0);
+
+		// The clip space w is the depth this pixel had from last frame's camera
+		float depthMatch = abs(history.g - prevClip.w) / prevClip.w < 0.05f;
+		float normalMatch = dot(DecodeNormal(history.ba), DecodeNormal(encodedNormal)) > 0.9f;
+		ao = lerp(ao, history.r, historyWeight * depthMatch * normalMatch);
+	}
+
+	return float4(ao, viewDepth, encodedNormal);
+}
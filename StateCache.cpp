@@ -0,0 +1,222 @@
+#include "StateCache.h"
+
+#include <cstring>
+
+// Singleton requirement
+StateCache* StateCache::instance;
+
+// FNV-1a over a whole description
+static unsigned long long HashDesc(const void* data, size_t size)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+PassState::PassState()
+{
+	memset(this, 0, sizeof(PassState));
+	BlendFactor[0] = BlendFactor[1] = BlendFactor[2] = BlendFactor[3] = 1.0f;
+	SampleMask = 0xFFFFFFFF;
+}
+
+void PassState::SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	RenderTargetCount = min(count, (unsigned int)D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
+	for (unsigned int i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+		RenderTargets[i] = i < RenderTargetCount ? rtvs[i] : 0;
+	DepthStencilView = dsv;
+}
+
+void PassState::SetViewport(float width, float height)
+{
+	Viewport = {};
+	Viewport.Width = width;
+	Viewport.Height = height;
+	Viewport.MinDepth = 0.0f;
+	Viewport.MaxDepth = 1.0f;
+}
+
+void StateCache::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	this->device = device;
+}
+
+// --------------------------------------------------------
+// Finds the state made from an identical description, or
+// makes it the first time that description is asked for
+// --------------------------------------------------------
+template<typename Desc, typename State, typename Create>
+Microsoft::WRL::ComPtr<State> StateCache::GetState(StateTable<Desc, State>& table, const Desc& desc, Create create)
+{
+	std::lock_guard<std::mutex> lock(tableMutex);
+	std::vector<typename StateTable<Desc, State>::Entry>& bucket = table.buckets[HashDesc(&desc, sizeof(Desc))];
+	for (auto& entry : bucket)
+	{
+		if (memcmp(&entry.Description, &desc, sizeof(Desc)) == 0)
+		{
+			statesShared++;
+			return entry.Object;
+		}
+	}
+
+	Microsoft::WRL::ComPtr<State> state;
+	if (FAILED(create(&desc, state.GetAddressOf())))
+		return state;
+
+	bucket.push_back({ desc, state });
+	statesCreated++;
+	return state;
+}
+
+Microsoft::WRL::ComPtr<ID3D11SamplerState> StateCache::GetSamplerState(const D3D11_SAMPLER_DESC& desc)
+{
+	return GetState(samplers, desc, [&](const D3D11_SAMPLER_DESC* d, ID3D11SamplerState** s) { return device->CreateSamplerState(d, s); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11BlendState> StateCache::GetBlendState(const D3D11_BLEND_DESC& desc)
+{
+	return GetState(blendStates, desc, [&](const D3D11_BLEND_DESC* d, ID3D11BlendState** s) { return device->CreateBlendState(d, s); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11DepthStencilState> StateCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	return GetState(depthStencilStates, desc, [&](const D3D11_DEPTH_STENCIL_DESC* d, ID3D11DepthStencilState** s) { return device->CreateDepthStencilState(d, s); });
+}
+
+Microsoft::WRL::ComPtr<ID3D11RasterizerState> StateCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+	return GetState(rasterizerStates, desc, [&](const D3D11_RASTERIZER_DESC* d, ID3D11RasterizerState** s) { return device->CreateRasterizerState(d, s); });
+}
+
+// --------------------------------------------------------
+// Gets what a context has bound, tracking it from
+// the first time it's seen
+// --------------------------------------------------------
+StateCache::BoundState* StateCache::GetBoundState(ID3D11DeviceContext* context)
+{
+	std::lock_guard<std::mutex> lock(boundMutex);
+	std::unique_ptr<BoundState>& state = bound[context];
+	if (!state)
+	{
+		state = std::make_unique<BoundState>();
+		state->Valid = false;
+	}
+	return state.get();
+}
+
+// --------------------------------------------------------
+// Binds each part of the pass state that's different from
+// what the context has bound (or all of it, when that's
+// not known)
+// --------------------------------------------------------
+void StateCache::Apply(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const PassState& state)
+{
+	BoundState* b = GetBoundState(context.Get());
+	PassState& current = b->State;
+	bool all = !b->Valid;
+	unsigned int issued = 0;
+	unsigned int skipped = 0;
+
+	if (all || current.Rasterizer != state.Rasterizer)
+	{
+		context->RSSetState(state.Rasterizer);
+		current.Rasterizer = state.Rasterizer;
+		issued++;
+	}
+	else skipped++;
+
+	if (all || current.DepthStencil != state.DepthStencil || current.StencilRef != state.StencilRef)
+	{
+		context->OMSetDepthStencilState(state.DepthStencil, state.StencilRef);
+		current.DepthStencil = state.DepthStencil;
+		current.StencilRef = state.StencilRef;
+		issued++;
+	}
+	else skipped++;
+
+	if (all || current.Blend != state.Blend || current.SampleMask != state.SampleMask ||
+		memcmp(current.BlendFactor, state.BlendFactor, sizeof(state.BlendFactor)) != 0)
+	{
+		context->OMSetBlendState(state.Blend, state.BlendFactor, state.SampleMask);
+		current.Blend = state.Blend;
+		memcpy(current.BlendFactor, state.BlendFactor, sizeof(state.BlendFactor));
+		current.SampleMask = state.SampleMask;
+		issued++;
+	}
+	else skipped++;
+
+	// Without a viewport, whatever's bound is left alone - and
+	// might not be what was last applied, so it's forgotten
+	if (state.Viewport.Width <= 0.0f)
+	{
+		current.Viewport = {};
+	}
+	else if (all || current.Viewport.Width <= 0.0f || memcmp(&current.Viewport, &state.Viewport, sizeof(D3D11_VIEWPORT)) != 0)
+	{
+		context->RSSetViewports(1, &state.Viewport);
+		current.Viewport = state.Viewport;
+		issued++;
+	}
+	else skipped++;
+
+	if (all || current.RenderTargetCount != state.RenderTargetCount || current.DepthStencilView != state.DepthStencilView ||
+		memcmp(current.RenderTargets, state.RenderTargets, sizeof(ID3D11RenderTargetView*) * state.RenderTargetCount) != 0)
+	{
+		context->OMSetRenderTargets(state.RenderTargetCount, state.RenderTargetCount ? state.RenderTargets : 0, state.DepthStencilView);
+		current.RenderTargetCount = state.RenderTargetCount;
+		memcpy(current.RenderTargets, state.RenderTargets, sizeof(state.RenderTargets));
+		current.DepthStencilView = state.DepthStencilView;
+		issued++;
+	}
+	else skipped++;
+
+	b->Valid = true;
+	applies++;
+	changesIssued += issued;
+	changesSkipped += skipped;
+}
+
+void StateCache::Invalidate(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	std::lock_guard<std::mutex> lock(boundMutex);
+	auto it = bound.find(context.Get());
+	if (it != bound.end())
+		it->second->Valid = false;
+}
+
+void StateCache::InvalidateAll()
+{
+	std::lock_guard<std::mutex> lock(boundMutex);
+	for (auto& b : bound)
+		b.second->Valid = false;
+}
+
+// --------------------------------------------------------
+// Starts a new frame, where nothing bound is assumed
+// to have survived since the last
+// --------------------------------------------------------
+void StateCache::BeginFrame()
+{
+	InvalidateAll();
+	applies = 0;
+	changesIssued = 0;
+	changesSkipped = 0;
+}
+
+StateCacheStats StateCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(tableMutex);
+	StateCacheStats stats = {};
+	stats.StatesCreated = statesCreated;
+	stats.StatesShared = statesShared;
+	stats.Applies = applies;
+	stats.ChangesIssued = changesIssued;
+	stats.ChangesSkipped = changesSkipped;
+	return stats;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// --------------------------------------------------------
+// The fixed function state a pass draws with, applied all
+// at once by StateCache::Apply()
+//  - Null states are D3D's defaults, like passing null
+//    to the context directly
+//  - A viewport with no width leaves the bound one alone,
+//    for passes that draw wherever they're pointed
+// --------------------------------------------------------
+struct PassState
+{
+	ID3D11RasterizerState* Rasterizer;
+	ID3D11DepthStencilState* DepthStencil;
+	unsigned int StencilRef;
+	ID3D11BlendState* Blend;
+	float BlendFactor[4];
+	unsigned int SampleMask;
+	D3D11_VIEWPORT Viewport;
+	unsigned int RenderTargetCount;
+	ID3D11RenderTargetView* RenderTargets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	ID3D11DepthStencilView* DepthStencilView;
+
+	PassState();
+	void SetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv);
+	void SetViewport(float width, float height);
+};
+
+struct StateCacheStats
+{
+	unsigned int StatesCreated;		// Unique descriptions, across every kind of state
+	unsigned int StatesShared;		// Requests answered by an existing state
+	unsigned int Applies;			// Pass states applied since the last reset
+	unsigned int ChangesIssued;		// Raster, depth, blend, viewport and target changes sent to D3D
+	unsigned int ChangesSkipped;	// The same, but already bound
+};
+
+// --------------------------------------------------------
+// Hands out one shared D3D state object per description,
+// and applies pass states with only the parts that differ
+// from what's bound
+//  - Descriptions are matched by their bytes, so zero them
+//    (= {}) before filling them in
+//  - What's bound is tracked per context, like SimpleShader's
+//    state caches, so after setting raster, depth, blend,
+//    viewport or render target state directly through a
+//    context (or finishing a command list on it), call
+//    Invalidate() for that context
+//  - The renderer's passes invalidate their context as they
+//    start, so only changes within a pass are filtered
+// --------------------------------------------------------
+class StateCache
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static StateCache& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new StateCache();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	StateCache(StateCache const&) = delete;
+	void operator=(StateCache const&) = delete;
+
+private:
+	static StateCache* instance;
+	StateCache() {};
+#pragma endregion
+
+public:
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> GetSamplerState(const D3D11_SAMPLER_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11BlendState> GetBlendState(const D3D11_BLEND_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> GetRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+
+	// Binds the pass state, skipping whatever already matches
+	void Apply(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const PassState& state);
+
+	// Forgets what a context (or every context) has bound
+	void Invalidate(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void InvalidateAll();
+
+	// The apply counts start over each frame
+	void BeginFrame();
+	StateCacheStats GetStats();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	// One bucket per description hash, compared in full on the off
+	// chance two different descriptions hash the same
+	template<typename Desc, typename State>
+	struct StateTable
+	{
+		struct Entry
+		{
+			Desc Description;
+			Microsoft::WRL::ComPtr<State> Object;
+		};
+		std::unordered_map<unsigned long long, std::vector<Entry>> buckets;
+	};
+	StateTable<D3D11_SAMPLER_DESC, ID3D11SamplerState> samplers;
+	StateTable<D3D11_BLEND_DESC, ID3D11BlendState> blendStates;
+	StateTable<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> depthStencilStates;
+	StateTable<D3D11_RASTERIZER_DESC, ID3D11RasterizerState> rasterizerStates;
+	std::mutex tableMutex;
+
+	template<typename Desc, typename State, typename Create>
+	Microsoft::WRL::ComPtr<State> GetState(StateTable<Desc, State>& table, const Desc& desc, Create create);
+
+	// What each context has bound, as of the last Apply()
+	struct BoundState
+	{
+		PassState State;
+		bool Valid;
+	};
+	std::unordered_map<ID3D11DeviceContext*, std::unique_ptr<BoundState>> bound;
+	std::mutex boundMutex;
+	BoundState* GetBoundState(ID3D11DeviceContext* context);
+
+	unsigned int statesCreated = 0;
+	unsigned int statesShared = 0;
+	std::atomic<unsigned int> applies{ 0 };
+	std::atomic<unsigned int> changesIssued{ 0 };
+	std::atomic<unsigned int> changesSkipped{ 0 };
+};
@@ -0,0 +1,138 @@
+#include "StressLayout.h"
+
+#include <algorithm>
+
+#include "SceneFile.h"
+
+using namespace DirectX;
+
+StressSceneOptions StressSceneOptions::Defaults()
+{
+	StressSceneOptions options = {};
+	options.Seed = STRESS_SCENE_SEED;
+	options.Entities = STRESS_SCENE_ENTITIES;
+	options.Lights = STRESS_SCENE_LIGHTS;
+	options.Emitters = STRESS_SCENE_EMITTERS;
+	options.Extent = STRESS_SCENE_EXTENT;
+	return options;
+}
+
+XMFLOAT3 StressOrbit::GetPosition(float totalTime) const
+{
+	float angle = Phase + Speed * totalTime;
+	return XMFLOAT3(
+		Center.x + cosf(angle) * Radius,
+		Center.y + sinf(angle * 2.0f) * 0.25f * Radius,
+		Center.z + sinf(angle) * Radius);
+}
+
+StressLayout::StressLayout()
+{
+	randomState = 1;
+}
+
+// --------------------------------------------------------
+// Entities are dropped anywhere on the square, and the
+// lights and emitters just above it, with everything drawn
+// from the one sequence in the same order each time
+// --------------------------------------------------------
+void StressLayout::Generate(const StressSceneOptions& options, unsigned int meshCount, unsigned int materialCount, int lightLimit)
+{
+	Clear();
+	if (meshCount == 0 || materialCount == 0)
+		return;
+
+	randomState = options.Seed ? options.Seed : 1;
+	float extent = std::max(options.Extent, 1.0f);
+
+	Entities.reserve(std::max(options.Entities, 0));
+	for (int i = 0; i < options.Entities; i++)
+	{
+		StressEntity e;
+		e.Mesh = RandomIndex(meshCount);
+		e.Material = RandomIndex(materialCount);
+		e.Position = XMFLOAT3(Random(-extent, extent), Random(-4.0f, 8.0f), Random(-extent, extent));
+		e.Scale = Random(0.25f, 2.0f);
+		e.PitchYawRoll = XMFLOAT3(Random(0, XM_2PI), Random(0, XM_2PI), 0);
+		e.Orbit = RandomOrbit(e.Position);
+		Entities.push_back(e);
+	}
+
+	int lightCount = std::min(options.Lights, lightLimit);
+	for (int i = 0; i < lightCount; i++)
+	{
+		Light point = {};
+		point.Type = LIGHT_TYPE_POINT;
+		point.Position = XMFLOAT3(Random(-extent, extent), Random(-3.0f, 6.0f), Random(-extent, extent));
+		point.Color = XMFLOAT3(Random(0, 1), Random(0, 1), Random(0, 1));
+		point.Range = Random(3.0f, 8.0f);
+		point.Intensity = Random(0.5f, 3.0f);
+		Lights.push_back(point);
+		LightOrbits.push_back(RandomOrbit(point.Position));
+	}
+
+	for (int i = 0; i < options.Emitters; i++)
+		Emitters.push_back(XMFLOAT3(Random(-extent, extent), Random(-2.0f, 4.0f), Random(-extent, extent)));
+}
+
+void StressLayout::Clear()
+{
+	Entities.clear();
+	Lights.clear();
+	LightOrbits.clear();
+	Emitters.clear();
+}
+
+// Orbits aren't part of a scene, so it's just where everything starts
+void StressLayout::AddToScene(SceneData& scene, const std::vector<std::string>& meshNames, unsigned int firstMaterial, const SceneFileEmitter& emitter) const
+{
+	std::vector<unsigned int> meshes;
+	for (const std::string& name : meshNames)
+		meshes.push_back(scene.AddName(name));
+
+	scene.Entities.reserve(scene.Entities.size() + Entities.size());
+	for (const StressEntity& e : Entities)
+	{
+		SceneFileEntity entity = {};
+		entity.Mesh = meshes[e.Mesh];
+		entity.Material = firstMaterial + e.Material;
+		entity.Parent = -1;
+		entity.Position = e.Position;
+		entity.PitchYawRoll = e.PitchYawRoll;
+		entity.Scale = XMFLOAT3(e.Scale, e.Scale, e.Scale);
+		scene.Entities.push_back(entity);
+	}
+
+	scene.Lights.insert(scene.Lights.end(), Lights.begin(), Lights.end());
+
+	for (const XMFLOAT3& position : Emitters)
+	{
+		SceneFileEmitter e = emitter;
+		e.Position = position;
+		scene.Emitters.push_back(e);
+	}
+}
+
+// A plain xorshift, which is all a layout needs
+float StressLayout::Random(float low, float high)
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return low + (randomState / 4294967295.0f) * (high - low);
+}
+
+unsigned int StressLayout::RandomIndex(unsigned int count)
+{
+	return std::min((unsigned int)Random(0.0f, (float)count), count - 1);
+}
+
+StressOrbit StressLayout::RandomOrbit(XMFLOAT3 center)
+{
+	StressOrbit orbit;
+	orbit.Center = center;
+	orbit.Radius = Random(0.5f, 3.0f);
+	orbit.Speed = Random(-2.0f, 2.0f);
+	orbit.Phase = Random(0, XM_2PI);
+	return orbit;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Lights.h"
+#include "PortableMath.h"
+
+struct SceneData;
+struct SceneFileEmitter;
+
+// Defaults for a stress scene (or the command line's -stress)
+#define STRESS_SCENE_ENTITIES	5000
+#define STRESS_SCENE_LIGHTS		512
+#define STRESS_SCENE_EMITTERS	16
+#define STRESS_SCENE_SEED		1
+#define STRESS_SCENE_EXTENT		60.0f
+
+// Every emitter in a stress scene
+#define STRESS_SCENE_EMITTER_PARTICLES	200
+#define STRESS_SCENE_EMITTER_RATE		50
+#define STRESS_SCENE_EMITTER_LIFETIME	2.0f
+
+struct StressSceneOptions
+{
+	bool Enabled;
+	unsigned int Seed;
+	int Entities;
+	int Lights;			// Point lights, on top of the scene's directional ones
+	int Emitters;
+	float Extent;		// Half the width of the square they're spread over
+	bool Motion;		// Entities and lights orbit where they started
+
+	static StressSceneOptions Defaults();
+};
+
+// Around the center on the horizontal, bobbing a little
+struct StressOrbit
+{
+	DirectX::XMFLOAT3 Center;
+	float Radius;
+	float Speed;	// Radians per second
+	float Phase;
+
+	DirectX::XMFLOAT3 GetPosition(float totalTime) const;
+};
+
+struct StressEntity
+{
+	unsigned int Mesh;		// Into the meshes it was laid out for
+	unsigned int Material;	// And the materials
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 PitchYawRoll;
+	float Scale;
+	StressOrbit Orbit;
+};
+
+// --------------------------------------------------------
+// Where everything in a stress scene goes, drawn from its
+// seed, without making any of it
+//  - Its own random numbers, so nothing else calling
+//    rand() changes the layout
+//  - StressScene makes it live, and it can be added to
+//    scene data too (-stress with -export-scene), so the
+//    same level loads with -scene
+// --------------------------------------------------------
+class StressLayout
+{
+public:
+	StressLayout();
+
+	// Replaces whatever was laid out last, picking from as many meshes
+	// and materials as there are, with no more lights than the limit
+	void Generate(const StressSceneOptions& options, unsigned int meshCount, unsigned int materialCount, int lightLimit);
+	void Clear();
+
+	// Entities use the scene's materials from the first one on, and
+	// emitters are copies of the one given, each moved into place
+	void AddToScene(SceneData& scene, const std::vector<std::string>& meshNames, unsigned int firstMaterial, const SceneFileEmitter& emitter) const;
+
+	std::vector<StressEntity> Entities;
+	std::vector<Light> Lights;
+	std::vector<StressOrbit> LightOrbits;
+	std::vector<DirectX::XMFLOAT3> Emitters;
+
+private:
+	unsigned int randomState;
+
+	float Random(float low, float high);
+	unsigned int RandomIndex(unsigned int count);
+	StressOrbit RandomOrbit(DirectX::XMFLOAT3 center);
+};
@@ -0,0 +1,103 @@
+#include "StressScene.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+using namespace DirectX;
+
+StressScene::StressScene()
+{
+	generated = false;
+	options = StressSceneOptions::Defaults();
+}
+
+void StressScene::Generate(
+	const StressSceneOptions& options,
+	EntityRegistry& entities,
+	const std::vector<Mesh*>& meshes,
+	const std::vector<Material*>& materials,
+	LightManager& lights,
+	std::vector<Emitter*>& emitters,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	SimpleVertexShader* particleVS,
+	SimplePixelShader* particlePS,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleTexture)
+{
+	Clear(entities, lights, emitters);
+	if (meshes.empty() || materials.empty())
+		return;
+
+	// Never more lights than the light buffer holds
+	this->options = options;
+	layout.Generate(options, (unsigned int)meshes.size(), (unsigned int)materials.size(), MAX_LIGHTS - (int)lights.GetCount());
+
+	createdEntities.reserve(layout.Entities.size());
+	for (const StressEntity& e : layout.Entities)
+	{
+		GameEntity* entity = entities.CreateEntity(meshes[e.Mesh], materials[e.Material]);
+		Transform* transform = entity->GetTransform();
+		transform->SetPosition(e.Position.x, e.Position.y, e.Position.z);
+		transform->SetRotation(e.PitchYawRoll.x, e.PitchYawRoll.y, e.PitchYawRoll.z);
+		transform->SetScale(e.Scale, e.Scale, e.Scale);
+		createdEntities.push_back(entity);
+	}
+
+	for (const Light& point : layout.Lights)
+		createdLights.push_back(lights.Add(point));
+
+	for (const XMFLOAT3& position : layout.Emitters)
+	{
+		Emitter* emitter = new Emitter(STRESS_SCENE_EMITTER_PARTICLES, STRESS_SCENE_EMITTER_RATE, STRESS_SCENE_EMITTER_LIFETIME,
+			device, context, particleVS, particlePS, particleTexture, true);
+		emitter->SetPosition(position);
+		emitters.push_back(emitter);
+		createdEmitters.push_back(emitter);
+	}
+
+	generated = true;
+	printf("Stress scene: %d entities, %d lights and %d emitters from seed %u\n", options.Entities, (int)layout.Lights.size(), options.Emitters, options.Seed);
+}
+
+void StressScene::Clear(EntityRegistry& entities, LightManager& lights, std::vector<Emitter*>& emitters)
+{
+	if (!generated)
+		return;
+
+	for (GameEntity* entity : createdEntities)
+		entities.Destroy(entity);
+	createdEntities.clear();
+
+	for (Emitter* emitter : createdEmitters)
+	{
+		emitters.erase(std::remove(emitters.begin(), emitters.end(), emitter), emitters.end());
+		delete emitter;
+	}
+	createdEmitters.clear();
+
+	// Newest first, so each is the last light and nothing has to move
+	//  - Any that have already been replaced are stale, and skipped
+	for (auto it = createdLights.rbegin(); it != createdLights.rend(); ++it)
+		lights.Remove(*it);
+	createdLights.clear();
+	layout.Clear();
+
+	generated = false;
+}
+
+void StressScene::Update(float totalTime, LightManager& lights)
+{
+	if (!generated || !options.Motion)
+		return;
+
+	for (size_t i = 0; i < createdEntities.size(); i++)
+	{
+		XMFLOAT3 position = layout.Entities[i].Orbit.GetPosition(totalTime);
+		createdEntities[i]->GetTransform()->SetPosition(position.x, position.y, position.z);
+	}
+
+	// Only moves them (which doesn't touch their range), and any
+	// that have since been replaced are stale handles, and skipped
+	for (size_t i = 0; i < layout.LightOrbits.size(); i++)
+		lights.SetPosition(createdLights[i], layout.LightOrbits[i].GetPosition(totalTime));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "EntityRegistry.h"
+#include "Emitter.h"
+#include "LightManager.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "StressLayout.h"
+
+// --------------------------------------------------------
+// Adds a scene's worth of entities, point lights and
+// emitters to the existing one, laid out from a seed so
+// the same options always make the same scene (see
+// StressLayout)
+//  - Motion is a function of the total time, so fixed
+//    timestep runs move everything the same way each time
+// --------------------------------------------------------
+class StressScene
+{
+public:
+	StressScene();
+
+	// Replaces whatever Generate() made last (meshes and materials are
+	// picked from those given, and the scene's own lights stay)
+	void Generate(
+		const StressSceneOptions& options,
+		EntityRegistry& entities,
+		const std::vector<Mesh*>& meshes,
+		const std::vector<Material*>& materials,
+		LightManager& lights,
+		std::vector<Emitter*>& emitters,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		SimpleVertexShader* particleVS,
+		SimplePixelShader* particlePS,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleTexture);
+
+	// Destroys everything it made
+	void Clear(EntityRegistry& entities, LightManager& lights, std::vector<Emitter*>& emitters);
+
+	// Moves everything, if the options asked for motion
+	void Update(float totalTime, LightManager& lights);
+
+	bool IsGenerated() { return generated; }
+	const StressSceneOptions& GetOptions() { return options; }
+
+private:
+	bool generated;
+	StressSceneOptions options;
+	StressLayout layout;
+
+	std::vector<GameEntity*> createdEntities;
+	std::vector<Emitter*> createdEmitters;
+	std::vector<LightHandle> createdLights;
+};
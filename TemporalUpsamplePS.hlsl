@@ -0,0 +1,102 @@
+#include "GBuffer.hlsli"
+
+cbuffer externalData : register(b0)
+{
+	matrix reprojection;	// Unjittered NDCs to last frame's unjittered clip space (for the sky)
+	float2 renderSize;		// This frame's viewport in the inputs, smaller than the window
+	float2 jitterPixels;	// How far this frame's image was shifted, in render pixels
+	int historyValid;
+};
+
+struct VertexToPixel
+{
+	float4 position : SV_POSITION;
+	float2 uv : TEXCOORD0;
+};
+
+struct PS_Output
+{
+	float4 color : SV_TARGET0;		// The back buffer
+	float4 history : SV_TARGET1;	// Next frame's history
+};
+
+
+Texture2D Current : register(t0);	// This frame's combine (gamma corrected), at the render size
+Texture2D Motion : register(t1);	// See GBuffer.hlsli
+Texture2D Depths : register(t2);
+Texture2D History : register(t3);	// Last frame's output, at the window size
+SamplerState ClampSampler : register(s0);
+
+// How much of this frame goes into the history - more when its
+// sample landed right on the pixel, and always a little
+#define CURRENT_WEIGHT_MIN	0.04f
+#define CURRENT_WEIGHT_MAX	0.2f
+
+
+// Blends this frame's nearest jittered sample into the history, found
+// by following the motion vectors back to where the pixel was
+//  - The history is clamped to the range of colors around the sample,
+//    so anything that wasn't there last frame can't smear over it
+PS_Output main(VertexToPixel input)
+{
+	// The render pixel whose sample landed closest to this pixel (its
+	// sample sits at its center minus the jitter), and how far off it was
+	float2 renderPixel = input.uv * renderSize;
+	int2 maxPixel = int2(renderSize) - 1;
+	int2 nearest = clamp(int2(floor(renderPixel + jitterPixels)), int2(0, 0), maxPixel);
+	float2 offset = renderPixel - (nearest + 0.5f - jitterPixels);
+
+	// The colors around it, and the closest depth among them (whose
+	// motion is used, so edges move with whatever's in front)
+	float3 current = Current.Load(int3(nearest, 0)).rgb;
+	float3 minColor = current;
+	float3 maxColor = current;
+	int2 closest = nearest;
+	float closestDepth = Depths.Load(int3(nearest, 0)).r;
+
+	[unroll]
+	for (int y = -1; y <= 1; y++)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; x++)
+		{
+			int3 pixel = int3(clamp(nearest + int2(x, y), int2(0, 0), maxPixel), 0);
+			float3 color = Current.Load(pixel).rgb;
+			minColor = min(minColor, color);
+			maxColor = max(maxColor, color);
+
+			float depth = Depths.Load(pixel).r;
+			if (depth < closestDepth)
+			{
+				closestDepth = depth;
+				closest = pixel.xy;
+			}
+		}
+	}
+
+	// Where this pixel was last frame - only the camera moves the sky
+	float2 prevUV;
+	if (closestDepth >= 1.0f)
+	{
+		float2 ndc = float2(input.uv.x, 1.0f - input.uv.y) * 2.0f - 1.0f;
+		float4 prevClip = mul(reprojection, float4(ndc, 1.0f, 1.0f));
+		prevUV = prevClip.xy / prevClip.w * float2(0.5f, -0.5f) + 0.5f;
+	}
+	else
+	{
+		prevUV = input.uv - Motion.Load(int3(closest, 0)).xy;
+	}
+
+	float3 result = current;
+	if (historyValid && all(prevUV >= 0.0f) && all(prevUV <= 1.0f))
+	{
+		float3 history = clamp(History.SampleLevel(ClampSampler, prevUV, 0).rgb, minColor, maxColor);
+		float currentWeight = lerp(CURRENT_WEIGHT_MIN, CURRENT_WEIGHT_MAX, exp(-2.0f * dot(offset, offset)));
+		result = lerp(history, current, currentWeight);
+	}
+
+	PS_Output output;
+	output.color = float4(result, 1);
+	output.history = float4(result, 1);
+	return output;
+}
@@ -0,0 +1,295 @@
+#include "ThreadManager.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <thread>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Singleton requirement
+ThreadManager* ThreadManager::instance;
+
+// What each role's called in the config file (lower case) and the UI
+static const char* roleNames[(int)ThreadRole::Count] = { "Render", "Network", "Simulation", "Worker", "Background" };
+
+// Each priority the config file can ask for, by name, and the nice
+// value it is on Linux (which only goes from 19 down to -20)
+struct PriorityName
+{
+	const char* Name;
+	int Priority;
+	int Nice;
+};
+static const PriorityName priorityNames[] =
+{
+	{ "idle", THREAD_PRIORITY_LEVEL_IDLE, 19 },
+	{ "lowest", -2, 10 },
+	{ "below_normal", -1, 5 },
+	{ "normal", THREAD_PRIORITY_LEVEL_NORMAL, 0 },
+	{ "above_normal", 1, -5 },
+	{ "highest", 2, -10 },
+	{ "time_critical", THREAD_PRIORITY_LEVEL_TIME_CRITICAL, -20 },
+};
+
+ThreadManager::ThreadManager()
+{
+	// Render and network threads are mostly waiting, and want to go the moment they can
+	pinWorkers = true;
+	settings[(int)ThreadRole::Render] = { 2 };
+	settings[(int)ThreadRole::Network] = { 2 };
+	settings[(int)ThreadRole::Simulation] = { 1 };
+	settings[(int)ThreadRole::Worker] = { THREAD_PRIORITY_LEVEL_NORMAL };
+	settings[(int)ThreadRole::Background] = { -1 };
+
+	logicalProcessors = std::thread::hardware_concurrency();
+	FindCores();
+}
+
+// --------------------------------------------------------
+// Lines are a setting's name then its value, with anything
+// after a # ignored
+//  - pin_workers 0 or 1
+//  - <role>_priority, one of the priority names
+// --------------------------------------------------------
+bool ThreadManager::Load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file) return false;
+
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream words(line);
+		std::string key;
+		if (!(words >> key))
+			continue;
+
+		std::string value;
+		std::getline(words >> std::ws, value);
+		while (!value.empty() && (value.back() == ' ' || value.back() == '\t' || value.back() == '\r'))
+			value.pop_back();
+
+		bool known = false;
+		if (key == "pin_workers" && (value == "0" || value == "1"))
+		{
+			pinWorkers = value == "1";
+			known = true;
+		}
+
+		for (int r = 0; r < (int)ThreadRole::Count && !known; r++)
+		{
+			std::string role = roleNames[r];
+			for (auto& c : role) c = (char)tolower(c);
+
+			if (key == role + "_priority")
+			{
+				for (auto& p : priorityNames)
+				{
+					if (value == p.Name)
+					{
+						settings[r].Priority = p.Priority;
+						known = true;
+					}
+				}
+			}
+		}
+
+		if (!known)
+			printf("Ignoring line %u of %s (%s)\n", lineNumber, path.c_str(), line.c_str());
+	}
+
+	printf("Thread settings from %s: %u physical cores of %u logical processors, workers %s\n",
+		path.c_str(), GetPhysicalCoreCount(), logicalProcessors, pinWorkers ? "pinned" : "not pinned");
+	return true;
+}
+
+void ThreadManager::Configure(ThreadRole role, const char* name, unsigned int index)
+{
+	const ThreadRoleSettings& roleSettings = settings[(int)role];
+	ThreadInfo info = { std::this_thread::get_id(), name, role, THREAD_PRIORITY_LEVEL_NORMAL, -1 };
+
+	SetName(name);
+
+	// Both read back, so it's what the thread really ended up with
+	SetPriority(roleSettings.Priority);
+	if (role == ThreadRole::Worker && pinWorkers && !cores.empty())
+	{
+		unsigned int core = index % (unsigned int)cores.size();
+		if (Pin(cores[core]))
+			info.Core = (int)core;
+		else
+			printf("Couldn't pin %s to core %u\n", name, core);
+	}
+	info.Priority = GetPriority();
+
+	std::lock_guard<std::mutex> lock(threadMutex);
+	for (auto& thread : threads)
+	{
+		if (thread.Id == info.Id)
+		{
+			thread = info;
+			return;
+		}
+	}
+	threads.push_back(info);
+}
+
+void ThreadManager::Unregister()
+{
+	std::thread::id id = std::this_thread::get_id();
+	std::lock_guard<std::mutex> lock(threadMutex);
+	for (auto it = threads.begin(); it != threads.end(); it++)
+	{
+		if (it->Id == id)
+		{
+			threads.erase(it);
+			return;
+		}
+	}
+}
+
+unsigned int ThreadManager::GetDefaultWorkerCount()
+{
+	unsigned int count = pinWorkers && !cores.empty() ? (unsigned int)cores.size() : logicalProcessors;
+	return count < 1 ? 1 : count;
+}
+
+std::vector<ThreadInfo> ThreadManager::GetThreads()
+{
+	std::lock_guard<std::mutex> lock(threadMutex);
+	return threads;
+}
+
+const char* ThreadManager::GetRoleName(ThreadRole role)
+{
+	return roleNames[(int)role];
+}
+
+const char* ThreadManager::GetPriorityName(int priority)
+{
+	for (auto& p : priorityNames)
+	{
+		if (p.Priority == priority)
+			return p.Name;
+	}
+	return "other";
+}
+
+// --------------------------------------------------------
+// Keeps the first logical processor of each physical core,
+// which is the one to pin to, so the rest (its SMT siblings)
+// are never given a worker of their own
+//  - None on Windows, so nothing's pinned there
+// --------------------------------------------------------
+void ThreadManager::FindCores()
+{
+	cores.clear();
+
+#ifndef _WIN32
+	// Each processor's siblings (itself included) are listed lowest first, like "0,8" or "0-1"
+	for (unsigned int cpu = 0; cpu < logicalProcessors; cpu++)
+	{
+		char path[128];
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu);
+		std::ifstream file(path);
+		unsigned int first = cpu;
+		if (file && !(file >> first))
+			first = cpu;
+		if (first == cpu)
+			cores.push_back({ 0, cpu });
+	}
+#endif
+}
+
+void ThreadManager::SetName(const char* name)
+{
+#ifdef _WIN32
+	(void)name;
+#else
+	// Linux only takes 15 characters
+	char shortName[16];
+	snprintf(shortName, sizeof(shortName), "%s", name);
+	pthread_setname_np(pthread_self(), shortName);
+#endif
+}
+
+// --------------------------------------------------------
+// On Linux, the calling thread's own nice value (which is
+// what PRIO_PROCESS with a thread's id sets), where raising
+// one past where it is takes CAP_SYS_NICE, or an RLIMIT_NICE
+// that allows it, and it's left as it is without
+// --------------------------------------------------------
+void ThreadManager::SetPriority(int priority)
+{
+#ifdef _WIN32
+	(void)priority;
+#else
+	for (auto& p : priorityNames)
+	{
+		if (p.Priority == priority && setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), p.Nice) != 0)
+			printf("Couldn't set a thread's priority to %s (%s)\n", p.Name, strerror(errno));
+	}
+#endif
+}
+
+// The nearest of the priorities to what the thread has, since
+// its nice value could've been set by something else
+int ThreadManager::GetPriority()
+{
+#ifdef _WIN32
+	return THREAD_PRIORITY_LEVEL_NORMAL;
+#else
+	errno = 0;
+	int nice = getpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid));
+	if (nice == -1 && errno != 0)
+		return THREAD_PRIORITY_LEVEL_NORMAL;
+
+	const PriorityName* nearest = &priorityNames[0];
+	for (auto& p : priorityNames)
+	{
+		if (abs(p.Nice - nice) < abs(nearest->Nice - nice))
+			nearest = &p;
+	}
+	return nearest->Priority;
+#endif
+}
+
+// --------------------------------------------------------
+// Pins the calling thread to just the one logical processor,
+// and reads it back, since the process's own affinity (or a
+// cgroup's) can quietly leave it somewhere else
+// --------------------------------------------------------
+bool ThreadManager::Pin(const PhysicalCore& core)
+{
+#ifdef _WIN32
+	(void)core;
+	return false;
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core.Processor, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		return false;
+
+	cpu_set_t pinned;
+	CPU_ZERO(&pinned);
+	return pthread_getaffinity_np(pthread_self(), sizeof(pinned), &pinned) == 0 && CPU_EQUAL(&pinned, &set);
+#endif
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Shared by the game and the server (see Server/GameServer)
+
+// Where each looks for its settings, in the working directory like the
+// entropy model (and the server's -threads can point somewhere else)
+#define THREAD_MANAGER_CONFIG_PATH	"Threads.cfg"
+
+// Windows' thread priorities, which are what the settings are in
+// (and on Linux each stands for a nice value, see ThreadManager.cpp)
+#define THREAD_PRIORITY_LEVEL_IDLE			-15
+#define THREAD_PRIORITY_LEVEL_NORMAL		0
+#define THREAD_PRIORITY_LEVEL_TIME_CRITICAL	15
+
+// What a thread's for, which is what its settings are looked up by
+enum class ThreadRole
+{
+	Render,		// The game's main thread, which records and presents each frame
+	Network,	// Sending and receiving, on either side
+	Simulation,	// Fixed rate ticks: the game's simulation thread, and the server's game loop
+	Worker,		// Job system workers (other than worker zero, which is whoever started it)
+	Background,	// Asset streaming and watching, which can wait
+	Count
+};
+
+struct ThreadRoleSettings
+{
+	int Priority;
+};
+
+// What each thread's ended up with, which isn't always what was asked
+struct ThreadInfo
+{
+	std::thread::id Id;
+	std::string Name;
+	ThreadRole Role;
+	int Priority;
+	int Core;		// The physical core it's pinned to (read back, not just asked for), or -1
+};
+
+// Names threads and applies their role's settings, from a config file
+// so they can be tuned per machine
+//  - Job workers can be pinned to a physical core each, on the first of
+//    its logical processors, so SMT siblings never share a core's work
+//    (and the other logical processor of each is left to everything else)
+//  - Latency sensitive threads are raised, and background ones lowered
+//  - Each thread configures itself once it's running, and unregisters
+//    on its way out, since most can be stopped and started again
+//  - On Windows threads are only listed for now (nothing's named,
+//    raised or pinned there, and workers go one per logical processor)
+class ThreadManager
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static ThreadManager& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new ThreadManager();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	ThreadManager(ThreadManager const&) = delete;
+	void operator=(ThreadManager const&) = delete;
+
+private:
+	static ThreadManager* instance;
+	ThreadManager();
+#pragma endregion
+
+public:
+	// Reads settings over the defaults, returning false (with the defaults
+	// left as they were) if there's no file
+	//  - Threads that are already running keep what they had
+	bool Load(const std::string& path);
+
+	// Names the calling thread and applies its role's settings, with a
+	// worker's index deciding which core it's pinned to
+	//  - Configuring a thread again replaces what it had
+	void Configure(ThreadRole role, const char* name, unsigned int index = 0);
+
+	// Takes the calling thread out of the list, for just before it exits
+	void Unregister();
+
+	// How many workers the job system starts when it's not told: one for
+	// each physical core when they're pinned, or each logical one if not
+	unsigned int GetDefaultWorkerCount();
+	unsigned int GetPhysicalCoreCount() { return (unsigned int)cores.size(); }
+	unsigned int GetLogicalProcessorCount() { return logicalProcessors; }
+
+	bool GetPinWorkers() { return pinWorkers; }
+	const ThreadRoleSettings& GetSettings(ThreadRole role) { return settings[(int)role]; }
+	std::vector<ThreadInfo> GetThreads();
+
+	static const char* GetRoleName(ThreadRole role);
+	static const char* GetPriorityName(int priority);
+
+private:
+	// The first logical processor of each physical core
+	struct PhysicalCore
+	{
+		unsigned short Group;
+		unsigned int Processor;
+	};
+
+	bool pinWorkers;
+	ThreadRoleSettings settings[(int)ThreadRole::Count];
+	std::vector<PhysicalCore> cores;
+	unsigned int logicalProcessors;
+
+	std::mutex threadMutex;
+	std::vector<ThreadInfo> threads;
+
+	void FindCores();
+	void SetName(const char* name);
+	void SetPriority(int priority);
+	int GetPriority();
+	bool Pin(const PhysicalCore& core);
+};
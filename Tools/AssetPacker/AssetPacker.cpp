@@ -0,0 +1,238 @@
+// AssetPacker.cpp : Packs the assets and compiled shaders into one file the game maps
+//
+
+#include <Windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <experimental/filesystem>
+// If using C++17, remove the "experimental" portion above and anywhere filesystem is used!
+
+#include "../../AssetPack.h"
+#include "../../Mesh.h"
+
+// Where the assets are from the exe, same as the game looks for them
+#define DEFAULT_ASSET_PATH	"..\\..\\Assets\\"
+
+// One file going into the pack
+struct PackedFile
+{
+	std::string Name;
+	std::string Path;
+	std::string AliasOf;	// Shares another entry's data, instead of its own
+	unsigned long long Size;
+	unsigned long long Offset;
+};
+
+static bool EndsWith(const std::string& str, const std::string& ending)
+{
+	return str.size() >= ending.size() && std::equal(ending.rbegin(), ending.rend(), str.rbegin());
+}
+
+static unsigned long long Align(unsigned long long offset)
+{
+	return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+}
+
+// --------------------------------------------------------
+// Whether a model's cache was written from the model as it
+// is now, by the same build of the cache format
+//  - Mesh checks the vertex layout once it's loaded, since
+//    that's down to how the game was built
+// --------------------------------------------------------
+static bool IsCacheUpToDate(const std::string& modelPath, const std::string& cachePath)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(modelPath.c_str(), GetFileExInfoStandard, &data))
+		return false;
+
+	unsigned long long size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	unsigned long long writeTime = ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+
+	MeshCacheHeader header;
+	std::ifstream cache(cachePath, std::ios::binary);
+	if (!cache.is_open() || !cache.read((char*)&header, sizeof(header)))
+		return false;
+
+	return header.Magic == MESH_CACHE_MAGIC &&
+		header.Version == MESH_CACHE_VERSION &&
+		header.SourceSize == size &&
+		header.SourceWriteTime == writeTime;
+}
+
+// Lower case with backslashes, which is how the pack tells names apart
+static std::string NormalizeName(const std::string& name)
+{
+	std::string normalized = name;
+	for (auto& c : normalized)
+		c = c == '/' ? '\\' : (char)tolower((unsigned char)c);
+	return normalized;
+}
+
+int main(int argc, char* argv[])
+{
+	char exePath[MAX_PATH] = {};
+	GetModuleFileNameA(0, exePath, MAX_PATH);
+	std::string exeDirectory = exePath;
+	exeDirectory = exeDirectory.substr(0, exeDirectory.find_last_of("\\/") + 1);
+
+	// The shaders and the pack both live next to the game's exe, which is where this ends up too
+	std::string rootPath = argc > 1 ? argv[1] : exeDirectory + DEFAULT_ASSET_PATH;
+	std::string shaderPath = argc > 2 ? argv[2] : exeDirectory;
+	std::string outputPath = argc > 3 ? argv[3] : exeDirectory + ASSET_PACK_FILE;
+	if (!rootPath.empty() && rootPath.back() != '\\' && rootPath.back() != '/')
+		rootPath += "\\";
+	if (!std::experimental::filesystem::exists(rootPath) || !std::experimental::filesystem::exists(shaderPath))
+	{
+		printf("Usage: AssetPacker [asset folder] [shader folder] [output pack] (can't find \"%s\" or \"%s\")\n", rootPath.c_str(), shaderPath.c_str());
+		return 1;
+	}
+
+	// Named by their path under the asset folder, like the game finds them
+	std::vector<PackedFile> files;
+	unsigned int skipped = 0;
+	for (auto& item : std::experimental::filesystem::recursive_directory_iterator(rootPath))
+	{
+		if (item.status().type() != std::experimental::filesystem::file_type::regular)
+			continue;
+
+		std::string path = item.path().string();
+		PackedFile file = { path.substr(rootPath.size()), path };
+		if (EndsWith(path, MESH_CACHE_EXTENSION) || EndsWith(path, ".pack"))
+			continue;
+
+		// Models go in as their caches, which are all the game reads from a pack
+		if (EndsWith(path, ".obj") || EndsWith(path, ".fbx"))
+		{
+			std::string cachePath = path + MESH_CACHE_EXTENSION;
+			if (!IsCacheUpToDate(path, cachePath))
+			{
+				printf("Skipping %s: no up to date cache (run the game once to make one)\n", file.Name.c_str());
+				skipped++;
+				continue;
+			}
+
+			file.Name += MESH_CACHE_EXTENSION;
+			file.Path = cachePath;
+		}
+
+		// Textures that were block compressed are only ever loaded as their
+		// DDS files, but still need to be found under their own names
+		else if (EndsWith(path, ".png") || EndsWith(path, ".jpg"))
+		{
+			std::string compressedPath = path.substr(0, path.size() - 4) + ".dds";
+			if (std::experimental::filesystem::exists(compressedPath))
+				file.AliasOf = compressedPath.substr(rootPath.size());
+		}
+
+		files.push_back(file);
+	}
+
+	for (auto& item : std::experimental::filesystem::directory_iterator(shaderPath))
+	{
+		std::string name = item.path().filename().string();
+		if (EndsWith(name, ".cso"))
+			files.push_back({ name, item.path().string() });
+	}
+
+	// Names have to be unique regardless of case
+	std::set<std::string> names;
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (!names.insert(NormalizeName(files[i].Name)).second)
+		{
+			printf("Skipping %s: already packed under that name\n", files[i].Path.c_str());
+			files.erase(files.begin() + i--);
+		}
+	}
+
+	// Table of contents, then the names, then each entry's data on its own pages
+	AssetPackHeader header = {};
+	header.Magic = ASSET_PACK_MAGIC;
+	header.Version = ASSET_PACK_VERSION;
+	header.EntryCount = (unsigned int)files.size();
+	header.SlotCount = 2;
+	while (header.SlotCount < files.size() * 2)
+		header.SlotCount *= 2;
+	header.NamesOffset = sizeof(AssetPackHeader) + (unsigned long long)header.SlotCount * sizeof(AssetPackEntry);
+
+	std::string allNames;
+	std::vector<unsigned int> nameOffsets;
+	for (auto& file : files)
+	{
+		nameOffsets.push_back((unsigned int)allNames.size());
+		allNames += file.Name;
+	}
+	header.NamesSize = allNames.size();
+
+	unsigned long long offset = Align(header.NamesOffset + header.NamesSize);
+	for (auto& file : files)
+	{
+		if (!file.AliasOf.empty())
+			continue;
+
+		file.Size = std::experimental::filesystem::file_size(file.Path);
+		file.Offset = offset;
+		offset = Align(offset + file.Size);
+	}
+
+	std::vector<AssetPackEntry> slots(header.SlotCount);
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		const PackedFile* data = &files[i];
+		if (!data->AliasOf.empty())
+		{
+			std::string alias = NormalizeName(data->AliasOf);
+			for (auto& other : files)
+			{
+				if (NormalizeName(other.Name) == alias)
+					data = &other;
+			}
+		}
+
+		// Opens up a slot by linear probing, like AssetPack searches them
+		AssetPackEntry entry = { AssetPack::Hash(files[i].Name), data->Offset, data->Size, nameOffsets[i], (unsigned int)files[i].Name.size() };
+		unsigned int slot = (unsigned int)entry.Hash & (header.SlotCount - 1);
+		while (slots[slot].Hash != 0)
+			slot = (slot + 1) & (header.SlotCount - 1);
+		slots[slot] = entry;
+	}
+
+	std::ofstream pack(outputPath, std::ios::binary);
+	if (!pack.is_open())
+	{
+		printf("Couldn't write %s\n", outputPath.c_str());
+		return 1;
+	}
+
+	pack.write((const char*)&header, sizeof(header));
+	pack.write((const char*)slots.data(), sizeof(AssetPackEntry) * slots.size());
+	pack.write(allNames.data(), allNames.size());
+
+	std::vector<char> data;
+	for (auto& file : files)
+	{
+		if (!file.AliasOf.empty())
+			continue;
+
+		data.resize((size_t)file.Size);
+		std::ifstream source(file.Path, std::ios::binary);
+		if (!source.is_open() || (file.Size > 0 && !source.read(data.data(), data.size())))
+		{
+			printf("Couldn't read %s\n", file.Path.c_str());
+			return 1;
+		}
+
+		// Padding up to this entry's page
+		std::vector<char> padding((size_t)(file.Offset - (unsigned long long)pack.tellp()));
+		pack.write(padding.data(), padding.size());
+		pack.write(data.data(), data.size());
+	}
+
+	printf("Packed %u files (%.2f MB) into %s, skipped %u\n", header.EntryCount, (unsigned long long)pack.tellp() / (1024.0 * 1024.0), outputPath.c_str(), skipped);
+	return 0;
+}
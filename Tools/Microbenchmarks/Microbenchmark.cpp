@@ -0,0 +1,131 @@
+#include "Microbenchmark.h"
+#include "../../AllocationTracker.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+MicrobenchmarkOptions MicrobenchmarkOptions::Parse(int argc, char* argv[])
+{
+	MicrobenchmarkOptions options;
+	options.ReportFile = MICROBENCHMARK_REPORT_FILE;
+	options.Samples = MICROBENCHMARK_SAMPLES;
+	options.SampleMilliseconds = MICROBENCHMARK_SAMPLE_MS;
+	options.List = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "-filter") == 0 && hasValue)
+			options.Filter = argv[++i];
+		else if (strcmp(argv[i], "-out") == 0 && hasValue)
+			options.ReportFile = argv[++i];
+		else if (strcmp(argv[i], "-samples") == 0 && hasValue)
+			options.Samples = (unsigned int)max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "-sampleMs") == 0 && hasValue)
+			options.SampleMilliseconds = max(atof(argv[++i]), 0.1);
+		else if (strcmp(argv[i], "-list") == 0)
+			options.List = true;
+		else
+			printf("Unknown option %s (options are -filter text, -out file, -samples n, -sampleMs ms, -list)\n", argv[i]);
+	}
+	return options;
+}
+
+Microbenchmarks::Microbenchmarks(const MicrobenchmarkOptions& options)
+{
+	this->options = options;
+}
+
+bool Microbenchmarks::Matches(const std::string& name)
+{
+	return options.Filter.empty() || name.find(options.Filter) != std::string::npos;
+}
+
+double Microbenchmarks::Milliseconds(std::function<void(unsigned int iterations)>& benchmark, unsigned int iterations)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	benchmark(iterations);
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void Microbenchmarks::Run(const std::string& name, double itemsPerIteration, std::function<void(unsigned int iterations)> benchmark)
+{
+	if (!Matches(name))
+		return;
+	if (options.List)
+	{
+		printf("%s\n", name.c_str());
+		return;
+	}
+
+	// Which also warms it up (caches, lazy setup and the like)
+	unsigned int iterations = 1;
+	while (Milliseconds(benchmark, iterations) < options.SampleMilliseconds && iterations < (1u << 30))
+		iterations *= 2;
+
+	std::vector<double> samples(options.Samples);
+	AllocationCounts allocationsBefore = AllocationTracker::GetTotals();
+	for (double& sample : samples)
+		sample = Milliseconds(benchmark, iterations) * 1000000.0 / iterations;
+	AllocationCounts allocationsAfter = AllocationTracker::GetTotals();
+	std::sort(samples.begin(), samples.end());
+
+	MicrobenchmarkResult result = {};
+	result.Name = name;
+	result.Iterations = iterations;
+	result.ItemsPerIteration = itemsPerIteration;
+	result.MinNs = samples.front();
+	result.MaxNs = samples.back();
+	result.MedianNs = samples[samples.size() / 2];
+	for (double sample : samples)
+		result.MeanNs += sample;
+	result.MeanNs /= samples.size();
+	result.ItemsPerSecond = result.MedianNs > 0.0 ? itemsPerIteration * 1000000000.0 / result.MedianNs : 0.0;
+	result.AllocationsPerIteration = (double)(allocationsAfter.Allocations - allocationsBefore.Allocations) / ((double)iterations * samples.size());
+	results.push_back(result);
+
+	printf("%-44s %12.1f ns %12.1f min %12.1f max %14.0f items/s %8.2f allocs\n",
+		name.c_str(), result.MedianNs, result.MinNs, result.MaxNs, result.ItemsPerSecond, result.AllocationsPerIteration);
+}
+
+void Microbenchmarks::Skip(const std::string& name, const char* reason)
+{
+	if (Matches(name) && !options.List)
+		printf("%-44s skipped: %s\n", name.c_str(), reason);
+}
+
+bool Microbenchmarks::WriteReport()
+{
+	if (options.List)
+		return true;
+
+	std::ofstream json(options.ReportFile);
+	if (!json)
+	{
+		printf("Couldn't write %s\n", options.ReportFile.c_str());
+		return false;
+	}
+
+	json.precision(10);
+	json << "{\n\t\"samples\": " << options.Samples << ",\n\t\"sampleMs\": " << options.SampleMilliseconds << ",\n\t\"benchmarks\": [";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const MicrobenchmarkResult& r = results[i];
+		json << (i ? ",\n" : "\n") << "\t\t{ \"name\": \"" << r.Name << "\", \"iterations\": " << r.Iterations
+			<< ", \"itemsPerIteration\": " << r.ItemsPerIteration
+			<< ", \"minNs\": " << r.MinNs << ", \"medianNs\": " << r.MedianNs
+			<< ", \"meanNs\": " << r.MeanNs << ", \"maxNs\": " << r.MaxNs
+			<< ", \"itemsPerSecond\": " << r.ItemsPerSecond
+			<< ", \"allocationsPerIteration\": " << r.AllocationsPerIteration << " }";
+	}
+	json << "\n\t]\n}\n";
+
+	printf("Wrote %u results to %s\n", (unsigned int)results.size(), options.ReportFile.c_str());
+	return true;
+}
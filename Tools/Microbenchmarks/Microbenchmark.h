@@ -0,0 +1,81 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Where the results go, unless the command line says otherwise
+#define MICROBENCHMARK_REPORT_FILE	"Microbenchmarks.json"
+
+// How many timed samples each benchmark takes, and roughly how
+// long each runs for (the iterations are doubled until it's this)
+#define MICROBENCHMARK_SAMPLES		15
+#define MICROBENCHMARK_SAMPLE_MS	10.0
+
+struct MicrobenchmarkOptions
+{
+	std::string Filter;		// Only benchmarks with this in their name
+	std::string ReportFile;
+	unsigned int Samples;
+	double SampleMilliseconds;
+	bool List;				// Just print the names
+
+	static MicrobenchmarkOptions Parse(int argc, char* argv[]);
+};
+
+// One benchmark's samples, per operation
+struct MicrobenchmarkResult
+{
+	std::string Name;
+	unsigned long long Iterations;	// In each sample
+	double ItemsPerIteration;
+	double MinNs;
+	double MedianNs;
+	double MeanNs;
+	double MaxNs;
+	double ItemsPerSecond;			// At the median
+	double AllocationsPerIteration;	// Heap allocations, on any thread
+};
+
+// Keeps the compiler from throwing away work whose result is never used
+template <typename T>
+inline void DoNotOptimize(const T& value)
+{
+	const volatile char* sink = (const volatile char*)&value;
+	(void)*sink;
+}
+
+// --------------------------------------------------------
+// Times small pieces of code on their own
+//  - Each benchmark is a function that does the work a given
+//    number of times, so the loop is its own and only the
+//    setup it does outside of that loop isn't timed
+//  - Iterations double until a sample takes long enough to
+//    time, then every sample runs that many
+//  - Results are the time of one iteration, and (when each
+//    iteration does several items) items per second
+// --------------------------------------------------------
+class Microbenchmarks
+{
+public:
+	Microbenchmarks(const MicrobenchmarkOptions& options);
+
+	// Runs it (unless it's filtered out) and prints its result
+	void Run(const std::string& name, double itemsPerIteration, std::function<void(unsigned int iterations)> benchmark);
+
+	// Prints why a benchmark (or a group of them) didn't run
+	void Skip(const std::string& name, const char* reason);
+
+	// Everything run so far, as JSON:
+	// { "samples": 15, "benchmarks": [ { "name": ..., "medianNs": ... }, ... ] }
+	bool WriteReport();
+
+	const std::vector<MicrobenchmarkResult>& GetResults() { return results; }
+
+private:
+	MicrobenchmarkOptions options;
+	std::vector<MicrobenchmarkResult> results;
+
+	bool Matches(const std::string& name);
+	static double Milliseconds(std::function<void(unsigned int iterations)>& benchmark, unsigned int iterations);
+};
@@ -0,0 +1,646 @@
+// Microbenchmarks.cpp : Times the engine's hot paths one at a time, away from the game
+//
+
+#include <Windows.h>
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Microbenchmark.h"
+#include "../../JobSystem.h"
+#include "../../Lights.h"
+#include "../../LightManager.h"
+#include "../../Mesh.h"
+#include "../../Movement.h"
+#include "../../NetworkProtocol.h"
+#include "../../ObjParser.h"
+#include "../../Projectile.h"
+#include "../../SimpleShader.h"
+#include "../../Transform.h"
+#include "../../TransformSystem.h"
+
+#pragma comment(lib, "d3d11.lib")
+
+using namespace DirectX;
+
+// Where the assets are from the exe, same as the game looks for them
+#define DEFAULT_ASSET_PATH	"..\\..\\Assets\\"
+
+// Sizes of the generated data
+#define TRANSFORM_COUNT		1024
+#define HIERARCHY_FANOUT	8		// Three levels below the root, so 585 in all
+#define GRID_SIZE			256		// Quads a side
+#define LIGHT_COUNT			4096
+#define MOVEMENT_PLAYERS	64
+#define MOVEMENT_PROJECTILES 1024
+#define MOVEMENT_DT			(1.0f / 60.0f)
+#define SNAPSHOT_PLAYERS	NET_SNAPSHOT_MAX_PLAYERS
+#define SNAPSHOT_PROJECTILES NET_SNAPSHOT_MAX_PROJECTILES
+
+static std::string exeDirectory;
+static std::wstring exeDirectoryWide;
+
+// --------------------------------------------------------
+// Transforms: changing one and getting its matrix back,
+// alone, in a hierarchy and in a system
+// --------------------------------------------------------
+static void BenchmarkTransforms(Microbenchmarks& bench)
+{
+	std::vector<Transform> transforms(TRANSFORM_COUNT);
+	for (int i = 0; i < TRANSFORM_COUNT; i++)
+		transforms[i].SetPosition((float)i, 0, 0);
+
+	bench.Run("Transform/UpdateMatrices", TRANSFORM_COUNT, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			for (Transform& t : transforms)
+			{
+				t.Rotate(0, 0.001f, 0);
+				XMFLOAT4X4 world = t.GetWorldMatrix();
+				DoNotOptimize(world);
+			}
+		}
+	});
+
+	bench.Run("Transform/UpdateMatricesInverseTranspose", TRANSFORM_COUNT, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			for (Transform& t : transforms)
+			{
+				t.Rotate(0, 0.001f, 0);
+				XMFLOAT4X4 world = t.GetWorldMatrix();
+				XMFLOAT4X4 inverseTranspose = t.GetWorldInverseTransposeMatrix();
+				DoNotOptimize(world);
+				DoNotOptimize(inverseTranspose);
+			}
+		}
+	});
+
+	// The system's declared first, so the nodes leave it before it goes
+	TransformSystem system;
+	const int nodeCount = 1 + HIERARCHY_FANOUT + HIERARCHY_FANOUT * HIERARCHY_FANOUT + HIERARCHY_FANOUT * HIERARCHY_FANOUT * HIERARCHY_FANOUT;
+	std::vector<Transform> nodes(nodeCount);
+	for (int i = 1; i < nodeCount; i++)
+	{
+		nodes[i].SetPosition(1, 0, 0);
+		nodes[(i - 1) / HIERARCHY_FANOUT].AddChild(&nodes[i], false);
+	}
+
+	// Moving the root dirties everything below it
+	bench.Run("Transform/Hierarchy", nodeCount, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			nodes[0].Rotate(0, 0.001f, 0);
+			for (Transform& t : nodes)
+			{
+				XMFLOAT4X4 world = t.GetWorldMatrix();
+				DoNotOptimize(world);
+			}
+		}
+	});
+
+	for (Transform& t : nodes)
+		system.Add(&t);
+	bench.Run("TransformSystem/Hierarchy", nodeCount, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			nodes[0].Rotate(0, 0.001f, 0);
+			system.Update();
+			XMFLOAT4X4 world = nodes[nodeCount - 1].GetWorldMatrix();
+			DoNotOptimize(world);
+		}
+	});
+}
+
+// A flat grid of quads, as vertices and indices or as OBJ text
+static void MakeGrid(std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	verts.clear();
+	indices.clear();
+	for (int z = 0; z <= GRID_SIZE; z++)
+	{
+		for (int x = 0; x <= GRID_SIZE; x++)
+		{
+			Vertex v = {};
+			v.Position = XMFLOAT3((float)x, sinf(x * 0.1f) * cosf(z * 0.1f), (float)z);
+			v.UV = XMFLOAT2((float)x / GRID_SIZE, (float)z / GRID_SIZE);
+			v.Normal = XMFLOAT3(0, 1, 0);
+			verts.push_back(v);
+		}
+	}
+	for (int z = 0; z < GRID_SIZE; z++)
+	{
+		for (int x = 0; x < GRID_SIZE; x++)
+		{
+			unsigned int i = z * (GRID_SIZE + 1) + x;
+			unsigned int quad[6] = { i, i + GRID_SIZE + 1, i + 1, i + 1, i + GRID_SIZE + 1, i + GRID_SIZE + 2 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+static std::string MakeGridObj(const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices)
+{
+	std::string text;
+	char line[128];
+	for (const Vertex& v : verts)
+	{
+		sprintf_s(line, "v %f %f %f\nvt %f %f\nvn %f %f %f\n", v.Position.x, v.Position.y, v.Position.z,
+			v.UV.x, v.UV.y, v.Normal.x, v.Normal.y, v.Normal.z);
+		text += line;
+	}
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		sprintf_s(line, "f %u/%u/%u %u/%u/%u %u/%u/%u\n",
+			indices[i] + 1, indices[i] + 1, indices[i] + 1,
+			indices[i + 1] + 1, indices[i + 1] + 1, indices[i + 1] + 1,
+			indices[i + 2] + 1, indices[i + 2] + 1, indices[i + 2] + 1);
+		text += line;
+	}
+	return text;
+}
+
+// --------------------------------------------------------
+// Meshes: tangents, parsing, and each way of importing
+// a whole model (without the caches or the upload)
+// --------------------------------------------------------
+static void BenchmarkMeshes(Microbenchmarks& bench)
+{
+	std::vector<Vertex> grid;
+	std::vector<unsigned int> gridIndices;
+	MakeGrid(grid, gridIndices);
+
+	bench.Run("Mesh/CalculateTangents", (double)grid.size(), [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+			Mesh::CalculateTangents(&grid[0], (int)grid.size(), &gridIndices[0], (int)gridIndices.size());
+	});
+
+	std::string obj = MakeGridObj(grid, gridIndices);
+	bench.Run("ObjParser/Parse", (double)obj.size(), [&](unsigned int iterations)
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			ObjParser::Parse(obj.c_str(), obj.size(), verts, indices);
+			DoNotOptimize(verts.size());
+		}
+	});
+
+	const char* models[] = { "sphere", "helix", "LEGO_Man" };
+	for (const char* model : models)
+	{
+		std::string path = exeDirectory + DEFAULT_ASSET_PATH + "Models\\" + model + ".obj";
+		for (int useAssImp = 0; useAssImp < 2; useAssImp++)
+		{
+			std::string name = std::string("Mesh/Import") + (useAssImp ? "AssImp/" : "Obj/") + model;
+			std::vector<Vertex> verts;
+			std::vector<unsigned int> indices;
+			if (!Mesh::Import(path.c_str(), useAssImp != 0, verts, indices))
+			{
+				bench.Skip(name, "couldn't load the model");
+				continue;
+			}
+
+			bench.Run(name, (double)verts.size(), [&](unsigned int iterations)
+			{
+				for (unsigned int n = 0; n < iterations; n++)
+				{
+					verts.clear();
+					indices.clear();
+					Mesh::Import(path.c_str(), useAssImp != 0, verts, indices);
+					DoNotOptimize(verts.size());
+				}
+			});
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Shaders: setting a variable each way, copying the
+// buffers, and binding with and without the state cache
+// --------------------------------------------------------
+static void BenchmarkShaders(Microbenchmarks& bench)
+{
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	D3D_DRIVER_TYPE driverTypes[] = { D3D_DRIVER_TYPE_HARDWARE, D3D_DRIVER_TYPE_WARP };
+	for (D3D_DRIVER_TYPE type : driverTypes)
+	{
+		if (SUCCEEDED(D3D11CreateDevice(0, type, 0, 0, 0, 0, D3D11_SDK_VERSION, device.GetAddressOf(), 0, context.GetAddressOf())))
+			break;
+	}
+	if (!device)
+	{
+		bench.Skip("SimpleShader", "no D3D11 device");
+		return;
+	}
+
+	std::wstring shaderPath = exeDirectoryWide + L"VertexShader.cso";
+	SimpleVertexShader vs(device, context, shaderPath.c_str());
+	if (!vs.IsShaderValid())
+	{
+		bench.Skip("SimpleShader", "couldn't load VertexShader.cso (build the game first)");
+		return;
+	}
+
+	XMFLOAT4X4 matrix;
+	XMStoreFloat4x4(&matrix, XMMatrixIdentity());
+	XMFLOAT2 uvScale(1, 1);
+
+	bench.Run("SimpleShader/SetByString", 4, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			vs.SetMatrix4x4("world", matrix);
+			vs.SetMatrix4x4("view", matrix);
+			vs.SetMatrix4x4("projection", matrix);
+			vs.SetFloat2("uvScale", uvScale);
+		}
+	});
+
+	bench.Run("SimpleShader/SetByHashedName", 4, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			vs.SetMatrix4x4("world"_sn, matrix);
+			vs.SetMatrix4x4("view"_sn, matrix);
+			vs.SetMatrix4x4("projection"_sn, matrix);
+			vs.SetFloat2("uvScale"_sn, uvScale);
+		}
+	});
+
+	SimpleShaderHandle world = vs.GetVariableHandle("world");
+	SimpleShaderHandle view = vs.GetVariableHandle("view");
+	SimpleShaderHandle projection = vs.GetVariableHandle("projection");
+	SimpleShaderHandle uv = vs.GetVariableHandle("uvScale");
+	bench.Run("SimpleShader/SetByHandle", 4, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			vs.SetMatrix4x4(world, matrix);
+			vs.SetMatrix4x4(view, matrix);
+			vs.SetMatrix4x4(projection, matrix);
+			vs.SetFloat2(uv, uvScale);
+		}
+	});
+
+	// Nothing's changed, so there's nothing to upload
+	vs.CopyAllBufferData();
+	bench.Run("SimpleShader/CopyAllBufferDataClean", 1, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+			vs.CopyAllBufferData();
+	});
+
+	bench.Run("SimpleShader/CopyAllBufferDataDirty", 1, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			matrix._41 = (float)n;
+			vs.SetMatrix4x4(world, matrix);
+			vs.CopyAllBufferData();
+		}
+	});
+
+	bench.Run("SimpleShader/SetShaderCached", 1, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+			vs.SetShader();
+	});
+
+	bench.Run("SimpleShader/SetShaderUncached", 1, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			ISimpleShader::InvalidateStateCache(context);
+			vs.SetShader();
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Lights: finding what changed since the last upload, by
+// comparing every light (Pack) or from the light manager's
+// dirty list (see Renderer::UpdateLightBuffer())
+// --------------------------------------------------------
+static void BenchmarkLights(Microbenchmarks& bench)
+{
+	std::vector<Light> lights(LIGHT_COUNT);
+	for (int i = 0; i < LIGHT_COUNT; i++)
+	{
+		lights[i].Type = LIGHT_TYPE_POINT;
+		lights[i].Position = XMFLOAT3((float)i, 1, 0);
+		lights[i].Color = XMFLOAT3(1, 1, 1);
+		lights[i].Range = 5;
+		lights[i].Intensity = 1;
+	}
+	std::vector<Light> cache;
+	int first, last;
+
+	bench.Run("Lights/PackUnchanged", LIGHT_COUNT, [&](unsigned int iterations)
+	{
+		PackChangedLights(cache, lights.data(), LIGHT_COUNT, first, last);
+		for (unsigned int n = 0; n < iterations; n++)
+			DoNotOptimize(PackChangedLights(cache, lights.data(), LIGHT_COUNT, first, last));
+	});
+
+	bench.Run("Lights/PackOneChanged", LIGHT_COUNT, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			lights[LIGHT_COUNT / 2].Intensity += 0.001f;
+			DoNotOptimize(PackChangedLights(cache, lights.data(), LIGHT_COUNT, first, last));
+		}
+	});
+
+	bench.Run("Lights/PackAllChanged", LIGHT_COUNT, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			lights[0].Intensity += 0.001f;
+			lights[LIGHT_COUNT - 1].Intensity += 0.001f;
+			DoNotOptimize(PackChangedLights(cache, lights.data(), LIGHT_COUNT, first, last));
+		}
+	});
+
+	LightManager manager;
+	manager.Assign(lights);
+	std::vector<LightRange> ranges;
+
+	bench.Run("Lights/ManagerUnchanged", LIGHT_COUNT, [&](unsigned int iterations)
+	{
+		manager.TakeDirtyRanges(LIGHT_COUNT, ranges);
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			manager.TakeDirtyRanges(LIGHT_COUNT, ranges);
+			DoNotOptimize(ranges.size());
+		}
+	});
+
+	bench.Run("Lights/ManagerOneChanged", LIGHT_COUNT, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			manager.Edit(LIGHT_COUNT / 2).Intensity += 0.001f;
+			manager.TakeDirtyRanges(LIGHT_COUNT, ranges);
+			DoNotOptimize(ranges.size());
+		}
+	});
+
+	// Every light moving, like the stress scene's orbits
+	bench.Run("Lights/ManagerAllMoved", LIGHT_COUNT, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			for (unsigned int i = 0; i < LIGHT_COUNT; i++)
+				manager.SetPosition(i, XMFLOAT3((float)i, 1.0f + (float)(n & 1), 0));
+			manager.TakeDirtyRanges(LIGHT_COUNT, ranges);
+			DoNotOptimize(ranges.size());
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Movement: one fixed step of the shared player and
+// projectile simulation, scalar and batched
+//  - The scalar ones start from the same state each
+//    iteration, so nothing runs off or dies
+// --------------------------------------------------------
+static void BenchmarkMovement(Microbenchmarks& bench)
+{
+	PlayerControls controls = {};
+	controls.Forward = true;
+	controls.Left = true;
+	std::vector<PlayerMovementState> players(MOVEMENT_PLAYERS);
+	std::vector<XMFLOAT3> facing(MOVEMENT_PLAYERS);
+	for (int i = 0; i < MOVEMENT_PLAYERS; i++)
+	{
+		players[i] = { XMFLOAT3((float)i, 0, 0), XMFLOAT3(0, 0, 0) };
+		facing[i] = XMFLOAT3(0, i * 0.1f, 0);
+	}
+
+	bench.Run("Movement/PlayerStep", MOVEMENT_PLAYERS, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			for (int i = 0; i < MOVEMENT_PLAYERS; i++)
+			{
+				PlayerMovementState state = players[i];
+				SimulatePlayerMovement(state, &controls, facing[i], MOVEMENT_DT);
+				DoNotOptimize(state);
+			}
+		}
+	});
+
+	std::vector<ProjectileMovementState> projectiles(MOVEMENT_PROJECTILES);
+	std::vector<MovementAxes> axes(MOVEMENT_PROJECTILES);
+	ProjectileArrays arrays;
+	arrays.Resize(MOVEMENT_PROJECTILES);
+	for (int i = 0; i < MOVEMENT_PROJECTILES; i++)
+	{
+		projectiles[i] = { XMFLOAT3((float)i, 1, 0), XMFLOAT3(0, 0, 10), -9.8f, 0, 1000000.0f };
+		axes[i] = GetMovementAxes(XMFLOAT3(0, i * 0.2f, 0));
+
+		SimulatedProjectile p = {};
+		p.Position = projectiles[i].Position;
+		p.PitchYawRoll = XMFLOAT3(0, i * 0.2f, 0);
+		p.Velocity = projectiles[i].Velocity;
+		p.Gravity = 0; // Or they'd soon fall out of the world (see below)
+		p.Lifespan = projectiles[i].Lifespan;
+		arrays.Set(i, p);
+	}
+
+	bench.Run("Movement/ProjectileStep", MOVEMENT_PROJECTILES, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			for (int i = 0; i < MOVEMENT_PROJECTILES; i++)
+			{
+				ProjectileMovementState state = projectiles[i];
+				DoNotOptimize(SimulateProjectileMovement(state, axes[i], MOVEMENT_DT));
+				DoNotOptimize(state);
+			}
+		}
+	});
+
+	// Steps the same ones for real, which is why they have no
+	// gravity there - a dead one is skipped, and isn't timed
+	bench.Run("Movement/ProjectileArraysStep", MOVEMENT_PROJECTILES, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			arrays.Update(MOVEMENT_DT, 0);
+			DoNotOptimize(arrays.GetPosition(0));
+		}
+	});
+}
+
+// A full room's worth, with everyone moving
+static void MakeSnapshot(WorldSnapshot& snapshot, unsigned int tick, float time)
+{
+	snapshot = {};
+	snapshot.Tick = tick;
+	snapshot.Valid = true;
+	snapshot.SlotCount = SNAPSHOT_PLAYERS;
+	snapshot.ProjectileSlotCount = SNAPSHOT_PROJECTILES;
+	snapshot.PlayerCount = SNAPSHOT_PLAYERS;
+	snapshot.ProjectileCount = SNAPSHOT_PROJECTILES;
+	for (unsigned int i = 0; i < SNAPSHOT_PLAYERS; i++)
+	{
+		snapshot.PlayerPresent[i] = true;
+		snapshot.PlayerSlots[i] = i;
+		PlayerNetState& p = snapshot.Players[i];
+		// Only every other one moves, like a real room
+		float t = (i % 2) ? time : 0.0f;
+		p.Position = XMFLOAT3(i * 3.0f + t, 0, t * 0.5f);
+		p.Velocity = XMFLOAT3((i % 2) ? 1.0f : 0.0f, 0, 0);
+		p.PitchYawRoll = XMFLOAT3(0, i * 0.1f + t, 0);
+	}
+	for (unsigned int i = 0; i < SNAPSHOT_PROJECTILES; i++)
+	{
+		snapshot.ProjectilePresent[i] = true;
+		snapshot.ProjectileIndices[i] = i;
+		ProjectileNetState& p = snapshot.Projectiles[i];
+		p.Position = XMFLOAT3(i * 2.0f, 1 + time, time * 10.0f);
+		p.Velocity = XMFLOAT3(0, 0, 10);
+		p.PitchYawRoll = XMFLOAT3(0, i * 0.2f, 0);
+		p.Gravity = -9.8f;
+		p.Lifespan = 5;
+		p.Age = time;
+		p.Owner = i % SNAPSHOT_PLAYERS;
+		p.Shot = i;
+	}
+}
+
+// --------------------------------------------------------
+// Networking: the client's update out and the server's
+// read of it, and the server's snapshots out and the
+// client's read of them, whole and as deltas
+// --------------------------------------------------------
+static void BenchmarkNetwork(Microbenchmarks& bench)
+{
+	NetPlayerUpdate update = {};
+	update.PlayerID = NetPlayerID(3, 1);
+	update.HasSnapshotAck = true;
+	update.SnapshotAck = 1000;
+	update.FirstInput = 5000;
+	update.InputCount = NET_INPUT_REDUNDANCY;
+	for (unsigned int i = 0; i < update.InputCount; i++)
+	{
+		update.Inputs[i].Controls.Forward = true;
+		update.Inputs[i].PitchYawRoll = XMFLOAT3(0.1f, i * 0.01f, 0);
+		update.Inputs[i].Dt = 1.0f / 60.0f;
+	}
+
+	char buffer[NETWORK_MAX_MESSAGE_SIZE];
+	bench.Run("Network/ClientWriteUpdate", 1, [&](unsigned int iterations)
+	{
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			NetworkMessageWriter message = NetWriteMessage(buffer, sizeof(buffer), update);
+			DoNotOptimize(message.GetSize());
+		}
+	});
+
+	// What NetReadMessage() reads, without needing a packet around it
+	char payload[NetMessage<NetPlayerUpdate>::MaxBytes];
+	BitWriter updateWriter(payload, sizeof(payload));
+	NetMessage<NetPlayerUpdate>::Serialize(updateWriter, update);
+	updateWriter.Flush();
+	unsigned int payloadSize = (unsigned int)updateWriter.GetSize();
+	bench.Run("Network/ServerReadUpdate", 1, [&](unsigned int iterations)
+	{
+		NetPlayerUpdate readUpdate;
+		for (unsigned int n = 0; n < iterations; n++)
+		{
+			BitReader stream(payload, payloadSize);
+			DoNotOptimize(NetMessage<NetPlayerUpdate>::Serialize(stream, readUpdate) && !stream.IsOverflowed());
+		}
+	});
+
+	// Everything in a full room is more than one message holds (the
+	// server's interest management cuts it down to fit), so there's
+	// room for all of it here
+	static WorldSnapshot baseline, snapshot, read;
+	MakeSnapshot(baseline, 100, 0.0f);
+	MakeSnapshot(snapshot, 101, 0.1f);
+	static char bits[4 * NETWORK_MAX_MESSAGE_SIZE];
+	unsigned int sizes[2] = {};
+
+	for (int delta = 0; delta < 2; delta++)
+	{
+		const WorldSnapshot* against = delta ? &baseline : nullptr;
+		std::string suffix = delta ? "Delta" : "Full";
+		NetSnapshotHeader header = { snapshot.Tick, delta != 0, delta ? snapshot.Tick - baseline.Tick : 0, true, 5000 };
+
+		bench.Run("Network/ServerWriteSnapshot" + suffix, SNAPSHOT_PLAYERS + SNAPSHOT_PROJECTILES, [&](unsigned int iterations)
+		{
+			for (unsigned int n = 0; n < iterations; n++)
+			{
+				BitWriter stream(bits, sizeof(bits));
+				NetMessage<NetSnapshotHeader>::Serialize(stream, header);
+				NetSerializeSnapshot(stream, snapshot, against);
+				stream.Flush();
+				sizes[delta] = (unsigned int)stream.GetSize();
+			}
+		});
+
+		// What was just written, to read back
+		BitWriter stream(bits, sizeof(bits));
+		NetMessage<NetSnapshotHeader>::Serialize(stream, header);
+		NetSerializeSnapshot(stream, snapshot, against);
+		stream.Flush();
+		sizes[delta] = (unsigned int)stream.GetSize();
+
+		bench.Run("Network/ClientReadSnapshot" + suffix, SNAPSHOT_PLAYERS + SNAPSHOT_PROJECTILES, [&](unsigned int iterations)
+		{
+			for (unsigned int n = 0; n < iterations; n++)
+			{
+				BitReader reader(bits, sizes[delta]);
+				NetSnapshotHeader readHeader;
+				bool valid = NetMessage<NetSnapshotHeader>::Serialize(reader, readHeader) &&
+					NetSerializeSnapshot(reader, read, against) && !reader.IsOverflowed();
+				DoNotOptimize(valid);
+			}
+		});
+	}
+	printf("Snapshots are %u bytes whole and %u as a delta\n", sizes[0], sizes[1]);
+}
+
+int main(int argc, char* argv[])
+{
+	MicrobenchmarkOptions options = MicrobenchmarkOptions::Parse(argc, argv);
+
+	// Everything's found from the exe, wherever it's run from
+	char exePath[MAX_PATH];
+	GetModuleFileNameA(0, exePath, MAX_PATH);
+	exeDirectory = exePath;
+	exeDirectory = exeDirectory.substr(0, exeDirectory.find_last_of("\\/") + 1);
+	wchar_t exePathWide[MAX_PATH];
+	GetModuleFileNameW(0, exePathWide, MAX_PATH);
+	exeDirectoryWide = exePathWide;
+	exeDirectoryWide = exeDirectoryWide.substr(0, exeDirectoryWide.find_last_of(L"\\/") + 1);
+
+	// The parser and the transform system spread their work across it
+	JobSystem::GetInstance().Initialize();
+
+	Microbenchmarks bench(options);
+	BenchmarkTransforms(bench);
+	BenchmarkMeshes(bench);
+	BenchmarkShaders(bench);
+	BenchmarkLights(bench);
+	BenchmarkMovement(bench);
+	BenchmarkNetwork(bench);
+
+	JobSystem::GetInstance().Shutdown();
+	return bench.WriteReport() ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+#include "BlockCompression.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// How far along the endpoints each of BC7's 4 bit indices lands (out of 64)
+static const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Writes the lowest bits of a value into a block, least significant first
+static void WriteBits(unsigned char* block, unsigned int& bit, unsigned int value, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++, bit++)
+	{
+		if (value & (1 << i))
+			block[bit >> 3] |= 1 << (bit & 7);
+	}
+}
+
+// --------------------------------------------------------
+// Red only, as a single BC4 block
+// --------------------------------------------------------
+void BlockCompression::CompressBC4(const unsigned char* rgba, unsigned char* block)
+{
+	unsigned char values[16];
+	for (int i = 0; i < 16; i++)
+		values[i] = rgba[i * 4];
+
+	CompressBC4Channel(values, block);
+}
+
+// --------------------------------------------------------
+// Red then green, as two BC4 blocks back to back
+// --------------------------------------------------------
+void BlockCompression::CompressBC5(const unsigned char* rgba, unsigned char* block)
+{
+	unsigned char values[16];
+	for (int channel = 0; channel < 2; channel++)
+	{
+		for (int i = 0; i < 16; i++)
+			values[i] = rgba[i * 4 + channel];
+
+		CompressBC4Channel(values, block + channel * BC4_BLOCK_SIZE);
+	}
+}
+
+// --------------------------------------------------------
+// Tries both of BC4's palettes and keeps whichever fits better
+//  - Eight values spread between the darkest and brightest texel
+//  - Six spread between whatever isn't 0 or 255, plus exact 0
+//    and 255 (better for blocks with a few black or white texels)
+// --------------------------------------------------------
+void BlockCompression::CompressBC4Channel(const unsigned char* values, unsigned char* block)
+{
+	int minAll = 255, maxAll = 0;
+	int minInner = 255, maxInner = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int v = values[i];
+		if (v < minAll) minAll = v;
+		if (v > maxAll) maxAll = v;
+		if (v != 0 && v != 255)
+		{
+			if (v < minInner) minInner = v;
+			if (v > maxInner) maxInner = v;
+		}
+	}
+	if (minInner > maxInner)
+		minInner = maxInner = 0;
+
+	float bestError = FLT_MAX;
+	for (int mode = 0; mode < 2; mode++)
+	{
+		// The order of the endpoints is what tells the decoder which palette this is
+		int e0 = mode == 0 ? maxAll : minInner;
+		int e1 = mode == 0 ? minAll : maxInner;
+
+		float palette[8];
+		palette[0] = (float)e0;
+		palette[1] = (float)e1;
+		if (e0 > e1)
+		{
+			for (int k = 1; k <= 6; k++)
+				palette[k + 1] = ((7 - k) * e0 + k * e1) / 7.0f;
+		}
+		else
+		{
+			for (int k = 1; k <= 4; k++)
+				palette[k + 1] = ((5 - k) * e0 + k * e1) / 5.0f;
+			palette[6] = 0.0f;
+			palette[7] = 255.0f;
+		}
+
+		unsigned int indices[16];
+		float error = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float best = FLT_MAX;
+			for (unsigned int p = 0; p < 8; p++)
+			{
+				float diff = palette[p] - values[i];
+				if (diff * diff < best)
+				{
+					best = diff * diff;
+					indices[i] = p;
+				}
+			}
+			error += best;
+		}
+
+		if (error >= bestError)
+			continue;
+
+		bestError = error;
+		memset(block, 0, BC4_BLOCK_SIZE);
+		block[0] = (unsigned char)e0;
+		block[1] = (unsigned char)e1;
+		unsigned int bit = 16;
+		for (int i = 0; i < 16; i++)
+			WriteBits(block, bit, indices[i], 3);
+	}
+}
+
+// One try at mode 6 - quantized endpoints, their shared low
+// bits and the palette index each texel ended up with
+struct BC7Mode6
+{
+	int Endpoints[2][4];
+	int PBits[2];
+	unsigned int Indices[16];
+	float Error;
+};
+
+// Quantizes a pair of endpoints with each combination of low bits,
+// keeping whichever gives the least error with the nearest indices
+static void FitBC7Mode6(const float texels[16][4], const float endpoints[2][4], BC7Mode6& result)
+{
+	result.Error = FLT_MAX;
+	for (int pbits = 0; pbits < 4; pbits++)
+	{
+		BC7Mode6 attempt;
+		attempt.PBits[0] = pbits & 1;
+		attempt.PBits[1] = pbits >> 1;
+
+		int decoded[2][4];
+		for (int e = 0; e < 2; e++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				int q = (int)floorf((endpoints[e][c] - attempt.PBits[e]) / 2.0f + 0.5f);
+				q = q < 0 ? 0 : (q > 127 ? 127 : q);
+				attempt.Endpoints[e][c] = q;
+				decoded[e][c] = (q << 1) | attempt.PBits[e];
+			}
+		}
+
+		float palette[16][4];
+		for (int p = 0; p < 16; p++)
+		{
+			for (int c = 0; c < 4; c++)
+				palette[p][c] = (float)(((64 - bc7Weights[p]) * decoded[0][c] + bc7Weights[p] * decoded[1][c] + 32) >> 6);
+		}
+
+		attempt.Error = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float best = FLT_MAX;
+			for (unsigned int p = 0; p < 16; p++)
+			{
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++)
+				{
+					float diff = palette[p][c] - texels[i][c];
+					error += diff * diff;
+				}
+
+				if (error < best)
+				{
+					best = error;
+					attempt.Indices[i] = p;
+				}
+			}
+			attempt.Error += best;
+		}
+
+		if (attempt.Error < result.Error)
+			result = attempt;
+	}
+}
+
+// --------------------------------------------------------
+// Starts with endpoints at either end of the texels along their
+// principal axis, then refits them by least squares to the
+// indices they were given, keeping any refit that helps
+// --------------------------------------------------------
+void BlockCompression::CompressBC7(const unsigned char* rgba, unsigned char* block)
+{
+	float texels[16][4];
+	float mean[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			texels[i][c] = rgba[i * 4 + c];
+			mean[c] += texels[i][c] / 16.0f;
+		}
+	}
+
+	// Covariance, then its largest eigenvector by power iteration
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < 4; a++)
+		{
+			for (int b = 0; b < 4; b++)
+				covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+		}
+	}
+
+	float axis[4] = { 1, 1, 1, 1 };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = { 0, 0, 0, 0 };
+		for (int a = 0; a < 4; a++)
+		{
+			for (int b = 0; b < 4; b++)
+				next[a] += covariance[a][b] * axis[b];
+		}
+
+		float length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f)
+			break;
+
+		for (int c = 0; c < 4; c++)
+			axis[c] = next[c] / length;
+	}
+
+	float minT = FLT_MAX, maxT = -FLT_MAX;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < 4; c++)
+			t += (texels[i][c] - mean[c]) * axis[c];
+
+		if (t < minT) minT = t;
+		if (t > maxT) maxT = t;
+	}
+
+	float endpoints[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = mean[c] + axis[c] * minT;
+		endpoints[1][c] = mean[c] + axis[c] * maxT;
+	}
+
+	BC7Mode6 best;
+	FitBC7Mode6(texels, endpoints, best);
+
+	for (int pass = 0; pass < BC7_REFINE_PASSES && best.Error > 0.0f; pass++)
+	{
+		// Solves for the two endpoints that best reproduce each
+		// texel at the weight its current index gives it
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = { 0, 0, 0, 0 };
+		float bx[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			float w = bc7Weights[best.Indices[i]] / 64.0f;
+			aa += (1.0f - w) * (1.0f - w);
+			ab += (1.0f - w) * w;
+			bb += w * w;
+			for (int c = 0; c < 4; c++)
+			{
+				ax[c] += (1.0f - w) * texels[i][c];
+				bx[c] += w * texels[i][c];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (fabsf(determinant) < 1e-6f)
+			break;
+
+		for (int c = 0; c < 4; c++)
+		{
+			float e0 = (bb * ax[c] - ab * bx[c]) / determinant;
+			float e1 = (aa * bx[c] - ab * ax[c]) / determinant;
+			endpoints[0][c] = e0 < 0.0f ? 0.0f : (e0 > 255.0f ? 255.0f : e0);
+			endpoints[1][c] = e1 < 0.0f ? 0.0f : (e1 > 255.0f ? 255.0f : e1);
+		}
+
+		BC7Mode6 refit;
+		FitBC7Mode6(texels, endpoints, refit);
+		if (refit.Error >= best.Error)
+			break;
+
+		best = refit;
+	}
+
+	// The first texel's index drops its top bit, so swap
+	// the endpoints (the weights are symmetric) if it's set
+	if (best.Indices[0] >= 8)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			int swap = best.Endpoints[0][c];
+			best.Endpoints[0][c] = best.Endpoints[1][c];
+			best.Endpoints[1][c] = swap;
+		}
+
+		int swap = best.PBits[0];
+		best.PBits[0] = best.PBits[1];
+		best.PBits[1] = swap;
+
+		for (int i = 0; i < 16; i++)
+			best.Indices[i] = 15 - best.Indices[i];
+	}
+
+	memset(block, 0, BC7_BLOCK_SIZE);
+	unsigned int bit = 0;
+	WriteBits(block, bit, 1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		WriteBits(block, bit, best.Endpoints[0][c], 7);
+		WriteBits(block, bit, best.Endpoints[1][c], 7);
+	}
+	WriteBits(block, bit, best.PBits[0], 1);
+	WriteBits(block, bit, best.PBits[1], 1);
+	for (int i = 0; i < 16; i++)
+		WriteBits(block, bit, best.Indices[i], i == 0 ? 3 : 4);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Bytes in one compressed 4x4 block
+#define BC4_BLOCK_SIZE	8
+#define BC5_BLOCK_SIZE	16
+#define BC7_BLOCK_SIZE	16
+
+// How many times BC7 refits its endpoints to the indices it picked
+#define BC7_REFINE_PASSES	2
+
+// Encoders for one 4x4 block at a time, read from 16 RGBA8 texels in
+// row order (blocks hanging off the edge of a texture should repeat
+// their last row and column)
+class BlockCompression
+{
+public:
+	// One channel (roughness, metal) from the texels' red
+	static void CompressBC4(const unsigned char* rgba, unsigned char* block);
+
+	// Two channels (normal x and y) from the texels' red and green
+	static void CompressBC5(const unsigned char* rgba, unsigned char* block);
+
+	// Color and alpha, using BC7's single subset mode 6 with endpoints
+	// fit along the texels' principal axis
+	static void CompressBC7(const unsigned char* rgba, unsigned char* block);
+
+private:
+	static void CompressBC4Channel(const unsigned char* values, unsigned char* block);
+};
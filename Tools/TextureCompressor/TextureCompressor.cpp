@@ -0,0 +1,330 @@
+// TextureCompressor.cpp : Converts material textures into block compressed DDS files
+//
+
+#include <Windows.h>
+#include <wincodec.h>
+#include <dxgiformat.h>
+#include <wrl/client.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <experimental/filesystem>
+// If using C++17, remove the "experimental" portion above and anywhere filesystem is used!
+
+#include "BlockCompression.h"
+
+#pragma comment(lib, "windowscodecs.lib")
+
+// Where the assets are from the exe, same as the game looks for them
+#define DEFAULT_ASSET_PATH	"..\\..\\Assets\\"
+
+// The few parts of the DDS format the runtime's loader needs
+//  - See DDSTextureLoader's DDS_HEADER and DDS_HEADER_DXT10
+#define DDS_MAGIC				0x20534444	// "DDS "
+#define DDS_FOURCC_DX10			0x30315844	// "DX10"
+#define DDSD_CAPS				0x1
+#define DDSD_HEIGHT				0x2
+#define DDSD_WIDTH				0x4
+#define DDSD_PIXELFORMAT		0x1000
+#define DDSD_MIPMAPCOUNT		0x20000
+#define DDSD_LINEARSIZE			0x80000
+#define DDPF_FOURCC				0x4
+#define DDSCAPS_COMPLEX			0x8
+#define DDSCAPS_TEXTURE			0x1000
+#define DDSCAPS_MIPMAP			0x400000
+#define DDS_DIMENSION_TEXTURE2D	3
+
+struct DDSPixelFormat
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int FourCC;
+	unsigned int RGBBitCount;
+	unsigned int RBitMask;
+	unsigned int GBitMask;
+	unsigned int BBitMask;
+	unsigned int ABitMask;
+};
+
+struct DDSHeader
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int Height;
+	unsigned int Width;
+	unsigned int PitchOrLinearSize;
+	unsigned int Depth;
+	unsigned int MipMapCount;
+	unsigned int Reserved1[11];
+	DDSPixelFormat PixelFormat;
+	unsigned int Caps;
+	unsigned int Caps2;
+	unsigned int Caps3;
+	unsigned int Caps4;
+	unsigned int Reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	DXGI_FORMAT Format;
+	unsigned int ResourceDimension;
+	unsigned int MiscFlag;
+	unsigned int ArraySize;
+	unsigned int MiscFlags2;
+};
+
+// Which compression (if any) a texture gets, from its name
+//  - Formats are UNORM rather than SRGB, as the shaders
+//    gamma correct albedo textures themselves
+enum class TextureKind { None, Albedo, Normals, Single };
+
+// One level of an uncompressed RGBA8 mip chain
+struct MipLevel
+{
+	unsigned int Width;
+	unsigned int Height;
+	std::vector<unsigned char> Pixels;
+};
+
+using Microsoft::WRL::ComPtr;
+
+bool EndsWith(const std::string& str, const std::string& ending)
+{
+	return str.size() >= ending.size() && str.compare(str.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+TextureKind GetTextureKind(const std::string& stem)
+{
+	if (EndsWith(stem, "_albedo"))
+		return TextureKind::Albedo;
+	if (EndsWith(stem, "_normals"))
+		return TextureKind::Normals;
+	if (EndsWith(stem, "_roughness") || EndsWith(stem, "_metal"))
+		return TextureKind::Single;
+	return TextureKind::None;
+}
+
+// --------------------------------------------------------
+// Decodes any image WIC understands into RGBA8
+// --------------------------------------------------------
+bool ReadImage(IWICImagingFactory* factory, const std::wstring& path, MipLevel& image)
+{
+	ComPtr<IWICBitmapDecoder> decoder;
+	ComPtr<IWICBitmapFrameDecode> frame;
+	ComPtr<IWICFormatConverter> converter;
+	if (FAILED(factory->CreateDecoderFromFilename(path.c_str(), 0, GENERIC_READ, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf())) ||
+		FAILED(decoder->GetFrame(0, frame.GetAddressOf())) ||
+		FAILED(factory->CreateFormatConverter(converter.GetAddressOf())) ||
+		FAILED(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0.0, WICBitmapPaletteTypeCustom)))
+		return false;
+
+	converter->GetSize(&image.Width, &image.Height);
+	image.Pixels.resize(image.Width * image.Height * 4);
+	return SUCCEEDED(converter->CopyPixels(0, image.Width * 4, (UINT)image.Pixels.size(), image.Pixels.data()));
+}
+
+// --------------------------------------------------------
+// Box filters one level down from the last (repeating the last row
+// or column of odd sizes), renormalizing normals so lower mips
+// don't get flatter and darker
+// --------------------------------------------------------
+void AddMipLevel(std::vector<MipLevel>& mips, TextureKind kind)
+{
+	const MipLevel& source = mips.back();
+	MipLevel level;
+	level.Width = max(source.Width / 2, 1u);
+	level.Height = max(source.Height / 2, 1u);
+	level.Pixels.resize(level.Width * level.Height * 4);
+
+	for (unsigned int y = 0; y < level.Height; y++)
+	{
+		for (unsigned int x = 0; x < level.Width; x++)
+		{
+			unsigned int x0 = min(x * 2, source.Width - 1), x1 = min(x * 2 + 1, source.Width - 1);
+			unsigned int y0 = min(y * 2, source.Height - 1), y1 = min(y * 2 + 1, source.Height - 1);
+
+			float sum[4];
+			for (int c = 0; c < 4; c++)
+			{
+				sum[c] = (source.Pixels[(y0 * source.Width + x0) * 4 + c] + source.Pixels[(y0 * source.Width + x1) * 4 + c] +
+					source.Pixels[(y1 * source.Width + x0) * 4 + c] + source.Pixels[(y1 * source.Width + x1) * 4 + c]) / 4.0f;
+			}
+
+			if (kind == TextureKind::Normals)
+			{
+				float n[3];
+				for (int c = 0; c < 3; c++)
+					n[c] = sum[c] / 255.0f * 2.0f - 1.0f;
+
+				float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length > 1e-6f)
+				{
+					for (int c = 0; c < 3; c++)
+						sum[c] = (n[c] / length * 0.5f + 0.5f) * 255.0f;
+				}
+			}
+
+			unsigned char* pixel = &level.Pixels[(y * level.Width + x) * 4];
+			for (int c = 0; c < 4; c++)
+				pixel[c] = (unsigned char)min(max(sum[c] + 0.5f, 0.0f), 255.0f);
+		}
+	}
+
+	mips.push_back(level);
+}
+
+// --------------------------------------------------------
+// Compresses a level one 4x4 block at a time, appending the
+// blocks (in row order) to the output
+// --------------------------------------------------------
+void CompressLevel(const MipLevel& level, TextureKind kind, std::vector<unsigned char>& output)
+{
+	unsigned int blockSize = kind == TextureKind::Single ? BC4_BLOCK_SIZE : BC7_BLOCK_SIZE;
+	unsigned int blocksWide = (level.Width + 3) / 4;
+	unsigned int blocksHigh = (level.Height + 3) / 4;
+
+	size_t offset = output.size();
+	output.resize(offset + (size_t)blocksWide * blocksHigh * blockSize);
+
+	unsigned char texels[16 * 4];
+	for (unsigned int by = 0; by < blocksHigh; by++)
+	{
+		for (unsigned int bx = 0; bx < blocksWide; bx++)
+		{
+			for (unsigned int y = 0; y < 4; y++)
+			{
+				for (unsigned int x = 0; x < 4; x++)
+				{
+					unsigned int sx = min(bx * 4 + x, level.Width - 1);
+					unsigned int sy = min(by * 4 + y, level.Height - 1);
+					memcpy(&texels[(y * 4 + x) * 4], &level.Pixels[(sy * level.Width + sx) * 4], 4);
+				}
+			}
+
+			unsigned char* block = &output[offset];
+			switch (kind)
+			{
+			case TextureKind::Albedo: BlockCompression::CompressBC7(texels, block); break;
+			case TextureKind::Normals: BlockCompression::CompressBC5(texels, block); break;
+			default: BlockCompression::CompressBC4(texels, block); break;
+			}
+			offset += blockSize;
+		}
+	}
+}
+
+bool WriteDDS(const std::string& path, const std::vector<MipLevel>& mips, TextureKind kind, const std::vector<unsigned char>& blocks)
+{
+	DDSHeader header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.Width = mips[0].Width;
+	header.Height = mips[0].Height;
+	header.PitchOrLinearSize = ((mips[0].Width + 3) / 4) * ((mips[0].Height + 3) / 4) * (kind == TextureKind::Single ? BC4_BLOCK_SIZE : BC7_BLOCK_SIZE);
+	header.MipMapCount = (unsigned int)mips.size();
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = DDPF_FOURCC;
+	header.PixelFormat.FourCC = DDS_FOURCC_DX10;
+	header.Caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+	DDSHeaderDX10 extended = {};
+	extended.Format = kind == TextureKind::Albedo ? DXGI_FORMAT_BC7_UNORM : (kind == TextureKind::Normals ? DXGI_FORMAT_BC5_UNORM : DXGI_FORMAT_BC4_UNORM);
+	extended.ResourceDimension = DDS_DIMENSION_TEXTURE2D;
+	extended.ArraySize = 1;
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	unsigned int magic = DDS_MAGIC;
+	file.write((const char*)&magic, sizeof(magic));
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&extended, sizeof(extended));
+	file.write((const char*)blocks.data(), blocks.size());
+	return file.good();
+}
+
+int main(int argc, char* argv[])
+{
+	std::string rootPath = argc > 1 ? argv[1] : DEFAULT_ASSET_PATH;
+	if (argc <= 1)
+	{
+		char exePath[MAX_PATH] = {};
+		GetModuleFileNameA(0, exePath, MAX_PATH);
+		std::string exeDirectory = exePath;
+		rootPath = exeDirectory.substr(0, exeDirectory.find_last_of("\\/") + 1) + rootPath;
+	}
+	if (!std::experimental::filesystem::exists(rootPath))
+	{
+		printf("Usage: TextureCompressor [asset folder] (can't find \"%s\")\n", rootPath.c_str());
+		return 1;
+	}
+
+	CoInitializeEx(0, COINIT_MULTITHREADED);
+	ComPtr<IWICImagingFactory> factory;
+	if (FAILED(CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()))))
+	{
+		printf("Couldn't create the WIC factory\n");
+		return 1;
+	}
+
+	unsigned int compressed = 0, upToDate = 0, failed = 0;
+	for (auto& item : std::experimental::filesystem::recursive_directory_iterator(rootPath))
+	{
+		if (item.status().type() != std::experimental::filesystem::file_type::regular)
+			continue;
+
+		std::experimental::filesystem::path sourcePath = item.path();
+		std::string extension = sourcePath.extension().string();
+		if (extension != ".png" && extension != ".jpg")
+			continue;
+
+		TextureKind kind = GetTextureKind(sourcePath.stem().string());
+		if (kind == TextureKind::None)
+			continue;
+
+		// Only redo textures that changed since they were last compressed
+		std::experimental::filesystem::path ddsPath = sourcePath;
+		ddsPath.replace_extension(".dds");
+		if (std::experimental::filesystem::exists(ddsPath) &&
+			std::experimental::filesystem::last_write_time(ddsPath) >= std::experimental::filesystem::last_write_time(sourcePath))
+		{
+			upToDate++;
+			continue;
+		}
+
+		std::vector<MipLevel> mips(1);
+		if (!ReadImage(factory.Get(), sourcePath.wstring(), mips[0]))
+		{
+			printf("Couldn't read %s\n", sourcePath.string().c_str());
+			failed++;
+			continue;
+		}
+
+		while (mips.back().Width > 1 || mips.back().Height > 1)
+			AddMipLevel(mips, kind);
+
+		std::vector<unsigned char> blocks;
+		for (auto& level : mips)
+			CompressLevel(level, kind, blocks);
+
+		if (!WriteDDS(ddsPath.string(), mips, kind, blocks))
+		{
+			printf("Couldn't write %s\n", ddsPath.string().c_str());
+			failed++;
+			continue;
+		}
+
+		printf("Compressed %s (%ux%u, %u mips) to %.2f MB\n", ddsPath.string().c_str(),
+			mips[0].Width, mips[0].Height, (unsigned int)mips.size(), blocks.size() / (1024.0 * 1024.0));
+		compressed++;
+	}
+
+	printf("Compressed %u textures (%u up to date, %u failed)\n", compressed, upToDate, failed);
+	CoUninitialize();
+	return failed > 0 ? 1 : 0;
+}
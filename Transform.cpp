@@ -1,7 +1,13 @@
 #include "Transform.h"
+#include "TransformSystem.h"
+
+#include <algorithm>
 
 using namespace DirectX;
 
+// Starts past 0, which is what an undrawn transform has
+unsigned int Transform::currentFrame = 1;
+
 
 Transform::Transform()
 {
@@ -15,17 +21,28 @@ Transform::Transform()
 
 	// No need to recalc yet
 	matricesDirty = false;
+	inverseTransposeDirty = false;
+	uniformScale = true;
+	version = 0;
+	prevWorldMatrix = worldMatrix;
+	drawnWorldMatrix = worldMatrix;
+	drawnFrame = 0;
 
 	parent = NULL;
+	system = 0;
+	slot = 0;
+}
+
+Transform::~Transform()
+{
+	if (system)
+		system->Remove(this);
 }
 
 void Transform::MoveAbsolute(float x, float y, float z)
 {
-	position.x += x;
-	position.y += y;
-	position.z += z;
-	matricesDirty = true;
-	MarkChildTransformsDirty();
+	XMFLOAT3 p = GetPosition();
+	SetPosition(p.x + x, p.y + y, p.z + z);
 }
 
 void Transform::MoveRelative(float x, float y, float z)
@@ -33,67 +50,104 @@ void Transform::MoveRelative(float x, float y, float z)
 	// Create a direction vector from the params
 	// and a rotation quaternion
 	XMVECTOR movement = XMVectorSet(x, y, z, 0);
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
+	XMFLOAT3 rotation = GetPitchYawRoll();
+	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&rotation));
 
 	// Rotate the movement by the quaternion
 	XMVECTOR dir = XMVector3Rotate(movement, rotQuat);
 
-	// Add and store, and invalidate the matrices
-	XMStoreFloat3(&position, XMLoadFloat3(&position) + dir);
-	matricesDirty = true;
-	MarkChildTransformsDirty();
+	// Add and store, which invalidates the matrices
+	XMFLOAT3 p = GetPosition();
+	XMStoreFloat3(&p, XMLoadFloat3(&p) + dir);
+	SetPosition(p.x, p.y, p.z);
 }
 
 void Transform::Rotate(float p, float y, float r)
 {
-	pitchYawRoll.x += p;
-	pitchYawRoll.y += y;
-	pitchYawRoll.z += r;
-	matricesDirty = true;
-	MarkChildTransformsDirty();
+	XMFLOAT3 rotation = GetPitchYawRoll();
+	SetRotation(rotation.x + p, rotation.y + y, rotation.z + r);
 }
 
 void Transform::Scale(float x, float y, float z)
 {
-	scale.x *= x;
-	scale.y *= y;
-	scale.z *= z;
-	matricesDirty = true;
-	MarkChildTransformsDirty();
+	XMFLOAT3 s = GetScale();
+	SetScale(s.x * x, s.y * y, s.z * z);
 }
 
 void Transform::SetPosition(float x, float y, float z)
 {
+	if (system)
+	{
+		system->positionX[slot] = x;
+		system->positionY[slot] = y;
+		system->positionZ[slot] = z;
+		MarkDirty();
+		MarkChildTransformsDirty();
+		return;
+	}
+
 	position.x = x;
 	position.y = y;
 	position.z = z;
-	matricesDirty = true;
+	MarkDirty();
 	MarkChildTransformsDirty();
 }
 
 void Transform::SetRotation(float p, float y, float r)
 {
+	if (system)
+	{
+		system->pitch[slot] = p;
+		system->yaw[slot] = y;
+		system->roll[slot] = r;
+		MarkDirty();
+		MarkChildTransformsDirty();
+		return;
+	}
+
 	pitchYawRoll.x = p;
 	pitchYawRoll.y = y;
 	pitchYawRoll.z = r;
-	matricesDirty = true;
+	MarkDirty();
 	MarkChildTransformsDirty();
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
+	if (system)
+	{
+		system->scaleX[slot] = x;
+		system->scaleY[slot] = y;
+		system->scaleZ[slot] = z;
+		MarkDirty();
+		MarkChildTransformsDirty();
+		return;
+	}
+
 	scale.x = x;
 	scale.y = y;
 	scale.z = z;
-	matricesDirty = true;
+	MarkDirty();
 	MarkChildTransformsDirty();
 }
 
-DirectX::XMFLOAT3 Transform::GetPosition() { return position; }
+DirectX::XMFLOAT3 Transform::GetPosition()
+{
+	if (system) return XMFLOAT3(system->positionX[slot], system->positionY[slot], system->positionZ[slot]);
+	return position;
+}
 
-DirectX::XMFLOAT3 Transform::GetPitchYawRoll() { return pitchYawRoll; }
+DirectX::XMFLOAT3 Transform::GetPitchYawRoll()
+{
+	if (system) return XMFLOAT3(system->pitch[slot], system->yaw[slot], system->roll[slot]);
+	return pitchYawRoll;
+}
 
-DirectX::XMFLOAT3 Transform::GetScale() { return scale; }
+DirectX::XMFLOAT3 Transform::GetScale()
+{
+	if (system) return XMFLOAT3(system->scaleX[slot], system->scaleY[slot], system->scaleZ[slot]);
+	return scale;
+}
 
 void Transform::SetTransformsFromMatrix(DirectX::XMFLOAT4X4 worldMatrix)
 {
@@ -106,26 +160,106 @@ void Transform::SetTransformsFromMatrix(DirectX::XMFLOAT4X4 worldMatrix)
 	// Get the euler angles from the quaternion and store as our 
 	XMFLOAT4 quat;
 	XMStoreFloat4(&quat, localRotQuat);
-	pitchYawRoll = QuaternionToEuler(quat);
+	XMFLOAT3 rotation = QuaternionToEuler(quat);
 
 	// Overwrite the child's other transform data
-	XMStoreFloat3(&position, localPos);
-	XMStoreFloat3(&scale, localScale);
-
-	// Things have changed
-	matricesDirty = true;
+	XMFLOAT3 p, s;
+	XMStoreFloat3(&p, localPos);
+	XMStoreFloat3(&s, localScale);
+
+	// Things have changed (children are marked by the setters)
+	SetRotation(rotation.x, rotation.y, rotation.z);
+	SetPosition(p.x, p.y, p.z);
+	SetScale(s.x, s.y, s.z);
 }
 
 DirectX::XMFLOAT4X4 Transform::GetWorldMatrix()
 {
 	UpdateMatrices();
+	if (system) return system->worldMatrices[slot];
 	return worldMatrix;
 }
 
 DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
 {
 	UpdateMatrices();
-	return worldMatrix;
+	if (system)
+	{
+		system->UpdateInverseTranspose(slot);
+		return system->worldInverseTransposeMatrices[slot];
+	}
+
+	if (inverseTransposeDirty)
+	{
+		XMStoreFloat4x4(&worldInverseTransposeMatrix, InverseTranspose(XMLoadFloat4x4(&worldMatrix), uniformScale));
+		inverseTransposeDirty = false;
+	}
+	return worldInverseTransposeMatrix;
+}
+
+bool Transform::HasUniformScale()
+{
+	UpdateMatrices();
+	if (system) return system->uniformScales[slot] != 0;
+	return uniformScale;
+}
+
+// --------------------------------------------------------
+// For a uniformly scaled world matrix, the upper 3x3 is just
+// a rotation times s, so its inverse transpose is that same
+// 3x3 divided by s squared (no general inverse needed)
+//  - The 4th column then follows from the translation, to
+//    match what the full inverse would've produced
+// --------------------------------------------------------
+DirectX::XMMATRIX Transform::InverseTranspose(DirectX::FXMMATRIX world, bool uniformScale)
+{
+	if (!uniformScale)
+		return XMMatrixInverse(0, XMMatrixTranspose(world));
+
+	XMVECTOR inverseScaleSq = XMVectorReciprocal(XMVector3LengthSq(world.r[0]));
+	XMVECTOR translation = world.r[3];
+
+	XMMATRIX result;
+	for (int i = 0; i < 3; i++)
+	{
+		XMVECTOR row = XMVectorMultiply(world.r[i], inverseScaleSq);
+		result.r[i] = XMVectorSetW(row, -XMVectorGetX(XMVector3Dot(row, translation)));
+	}
+	result.r[3] = XMVectorSet(0, 0, 0, 1);
+	return result;
+}
+
+bool Transform::IsUniformScale(float x, float y, float z)
+{
+	float tolerance = 0.0001f * fabsf(x);
+	return fabsf(x - y) <= tolerance && fabsf(x - z) <= tolerance;
+}
+
+unsigned int Transform::GetVersion()
+{
+	return version;
+}
+
+// --------------------------------------------------------
+// The first ask each frame moves this frame's matrix into
+// the drawn slot, and only keeps the one that was there if
+// it's from the frame just before
+// --------------------------------------------------------
+DirectX::XMFLOAT4X4 Transform::GetPrevWorldMatrix()
+{
+	if (drawnFrame != currentFrame)
+	{
+		XMFLOAT4X4 world = GetWorldMatrix();
+		prevWorldMatrix = drawnFrame != 0 && drawnFrame + 1 == currentFrame ? drawnWorldMatrix : world;
+		drawnWorldMatrix = world;
+		drawnFrame = currentFrame;
+	}
+	return prevWorldMatrix;
+}
+
+void Transform::NextFrame()
+{
+	currentFrame++;
 }
 
 void Transform::AddChild(Transform* child, bool makeChildRelative)
@@ -163,9 +297,11 @@ void Transform::AddChild(Transform* child, bool makeChildRelative)
 	// Reciprocal set!
 	children.push_back(child);
 	child->parent = this;
+	if (child->system)
+		child->system->hierarchyChanged = true;
 
 	// This child transform is now out of date
-	child->matricesDirty = true;
+	child->MarkDirty();
 	child->MarkChildTransformsDirty();
 }
 
@@ -193,9 +329,11 @@ void Transform::RemoveChild(Transform* child, bool applyParentTransform)
 	// Reciprocal removal
 	children.erase(it);
 	child->parent = 0;
+	if (child->system)
+		child->system->hierarchyChanged = true;
 
 	// This child transform is now out of date
-	child->matricesDirty = true;
+	child->MarkDirty();
 	child->MarkChildTransformsDirty();
 }
 
@@ -245,6 +383,14 @@ unsigned int Transform::GetChildCount()
 
 void Transform::UpdateMatrices()
 {
+	// The system builds its own matrices
+	if (system)
+	{
+		if (system->dirty[slot] & (DIRTY_LOCAL | DIRTY_WORLD))
+			system->UpdateTransform(this);
+		return;
+	}
+
 	// Are the matrices out of date (dirty)?
 	if (matricesDirty)
 	{
@@ -255,27 +401,46 @@ void Transform::UpdateMatrices()
 
 		// Combine and store the world
 		XMMATRIX wm = sc * rot * trans;
+		uniformScale = IsUniformScale(scale.x, scale.y, scale.z);
 		if (parent)
 		{
 			XMFLOAT4X4 pW4X4 = parent->GetWorldMatrix();
 			XMMATRIX pW = XMLoadFloat4x4(&pW4X4);
 			wm *= pW;
+			uniformScale = uniformScale && parent->HasUniformScale();
 		}
 		XMStoreFloat4x4(&worldMatrix, wm);
 
-		// Invert and transpose, too
-		XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixInverse(0, XMMatrixTranspose(wm)));
+		// The inverse transpose waits until it's needed
+		inverseTransposeDirty = true;
 
 		// All set
 		matricesDirty = false;
 	}
 }
 
+void Transform::MarkDirty()
+{
+	if (system)
+		system->dirty[slot] = DIRTY_LOCAL | DIRTY_WORLD;
+	else
+		matricesDirty = true;
+
+	version++;
+}
+
 void Transform::MarkChildTransformsDirty()
 {
+	// The system keeps its hierarchy flattened, so no need to recurse
+	if (system)
+	{
+		system->MarkDescendantsDirty(this);
+		return;
+	}
+
 	for (size_t i = 0; i < children.size(); i++)
 	{
-		children[i]->matricesDirty = true;
+		children[i]->MarkDirty();
 		children[i]->MarkChildTransformsDirty();
 	}
 }
@@ -1,12 +1,15 @@
 #pragma once
 
-#include <DirectXMath.h>
+#include "PortableMath.h"
 #include <vector>
 
+class TransformSystem;
+
 class Transform
 {
 public:
 	Transform();
+	~Transform();
 
 	void MoveAbsolute(float x, float y, float z);
 	void MoveRelative(float x, float y, float z);
@@ -25,6 +28,26 @@ public:
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
 	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
 
+	// Whether the world matrix is just a rotation, a single scale and a
+	// translation, which makes the inverse transpose much cheaper
+	bool HasUniformScale();
+
+	// Inverse transpose of a world matrix, using the cheap version
+	// when the world matrix is known to have a uniform scale
+	static DirectX::XMMATRIX InverseTranspose(DirectX::FXMMATRIX world, bool uniformScale);
+	static bool IsUniformScale(float x, float y, float z);
+
+	// Goes up every time this transform (or a parent) changes, so
+	// anything caching its results can tell when they're stale
+	unsigned int GetVersion();
+
+	// The world matrix this was drawn with last frame (or this frame's,
+	// if it wasn't drawn then), for motion vectors
+	//  - Asking is what counts as being drawn, so only the scene pass
+	//    should ask, and NextFrame() moves every transform on at once
+	DirectX::XMFLOAT4X4 GetPrevWorldMatrix();
+	static void NextFrame();
+
 	void AddChild(Transform* child, bool makeChildRelative = true);
 	void RemoveChild(Transform* child, bool applyParentTransform = true);
 	void SetParent(Transform* newParent, bool makeChildRelative = true);
@@ -33,20 +56,43 @@ public:
 	int IndexOfChild(Transform* child);
 	unsigned int GetChildCount();
 
+	// The system holding this transform's data, if any
+	TransformSystem* GetSystem() { return system; }
+
 private:
+	friend class TransformSystem;
+
 	// Raw transformation data
 	DirectX::XMFLOAT3 position;
 	DirectX::XMFLOAT3 pitchYawRoll;
 	DirectX::XMFLOAT3 scale;
 
 	// World matrix and inverse transpose of the world matrix
+	//  - The inverse transpose is only built when someone asks for it
 	bool matricesDirty;
+	bool inverseTransposeDirty;
+	bool uniformScale;
 	DirectX::XMFLOAT4X4 worldMatrix;
 	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
+	unsigned int version;
+
+	// What was drawn, and when, for the previous world matrix
+	DirectX::XMFLOAT4X4 prevWorldMatrix;
+	DirectX::XMFLOAT4X4 drawnWorldMatrix;
+	unsigned int drawnFrame;	// 0 until it's first drawn
+	static unsigned int currentFrame;
 
 	Transform* parent;
 	std::vector<Transform*> children;
 
+	// When in a system, the data above (except the hierarchy)
+	// lives in its arrays at this slot instead
+	TransformSystem* system;
+	unsigned int slot;
+
+	// Flags the matrices as out of date, wherever they live
+	void MarkDirty();
+
 	// Helper to update both matrices if necessary
 	void UpdateMatrices();
 	
@@ -0,0 +1,112 @@
+#include "TransformInterpolator.h"
+
+using namespace DirectX;
+
+
+TransformInterpolator::TransformInterpolator()
+{
+	applied = false;
+}
+
+void TransformInterpolator::Track(Transform* transform, bool interpolateRotation)
+{
+	TrackedTransform t = {};
+	t.Target = transform;
+	t.InterpolateRotation = interpolateRotation;
+	t.PreviousPosition = transform->GetPosition();
+	t.PreviousPitchYawRoll = transform->GetPitchYawRoll();
+	tracked.push_back(t);
+}
+
+void TransformInterpolator::Untrack(Transform* transform)
+{
+	for (size_t i = 0; i < tracked.size(); i++)
+	{
+		if (tracked[i].Target == transform)
+		{
+			tracked.erase(tracked.begin() + i);
+			return;
+		}
+	}
+}
+
+void TransformInterpolator::Snap(Transform* transform)
+{
+	for (auto& t : tracked)
+	{
+		if (t.Target == transform)
+		{
+			t.PreviousPosition = transform->GetPosition();
+			t.PreviousPitchYawRoll = transform->GetPitchYawRoll();
+			return;
+		}
+	}
+}
+
+void TransformInterpolator::Save()
+{
+	for (auto& t : tracked)
+	{
+		t.PreviousPosition = t.Target->GetPosition();
+		t.PreviousPitchYawRoll = t.Target->GetPitchYawRoll();
+	}
+}
+
+// --------------------------------------------------------
+// Blends each moved transform from its saved state to its
+// current one, remembering the current one for Restore()
+// --------------------------------------------------------
+void TransformInterpolator::Apply(float t)
+{
+	if (applied)
+		Restore();
+	if (t >= 1.0f)
+		return; // Already where it'd be put
+	XMVECTOR blend = XMVectorReplicate(t);
+	for (auto& tt : tracked)
+	{
+		tt.CurrentPosition = tt.Target->GetPosition();
+		tt.CurrentPitchYawRoll = tt.Target->GetPitchYawRoll();
+
+		XMVECTOR previousPos = XMLoadFloat3(&tt.PreviousPosition);
+		XMVECTOR currentPos = XMLoadFloat3(&tt.CurrentPosition);
+		XMVECTOR previousRot = XMLoadFloat3(&tt.PreviousPitchYawRoll);
+		XMVECTOR currentRot = XMLoadFloat3(&tt.CurrentPitchYawRoll);
+		bool moved = !XMVector3Equal(previousPos, currentPos);
+		bool turned = tt.InterpolateRotation && !XMVector3Equal(previousRot, currentRot);
+		tt.Applied = moved || turned;
+		if (!tt.Applied)
+			continue;
+
+		XMFLOAT3 pos = tt.CurrentPosition;
+		if (moved)
+			XMStoreFloat3(&pos, XMVectorLerpV(previousPos, currentPos, blend));
+		XMFLOAT3 rot = tt.CurrentPitchYawRoll;
+		if (turned)
+		{
+			// Wrapped to [-pi, pi], so it never turns the long way
+			XMVECTOR delta = XMVectorModAngles(XMVectorSubtract(currentRot, previousRot));
+			XMStoreFloat3(&rot, XMVectorMultiplyAdd(delta, blend, previousRot));
+		}
+
+		tt.Target->SetPosition(pos.x, pos.y, pos.z);
+		tt.Target->SetRotation(rot.x, rot.y, rot.z);
+	}
+	applied = true;
+}
+
+void TransformInterpolator::Restore()
+{
+	if (!applied)
+		return;
+
+	for (auto& t : tracked)
+	{
+		if (!t.Applied)
+			continue;
+		t.Target->SetPosition(t.CurrentPosition.x, t.CurrentPosition.y, t.CurrentPosition.z);
+		t.Target->SetRotation(t.CurrentPitchYawRoll.x, t.CurrentPitchYawRoll.y, t.CurrentPitchYawRoll.z);
+		t.Applied = false;
+	}
+	applied = false;
+}
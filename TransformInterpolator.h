@@ -0,0 +1,50 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+#include "Transform.h"
+
+// Smooths transforms moved by a fixed timestep simulation, by drawing
+// them part way between the states of the last two ticks
+//  - Save() before each tick, then Apply() before drawing and Restore()
+//    after, so the simulation never sees the blended state
+//  - Rotations are blended per angle, the short way around, which is
+//    plenty for the small steps one tick makes
+//  - Transforms that didn't move aren't touched, so they stay clean
+class TransformInterpolator
+{
+public:
+	TransformInterpolator();
+
+	// Rotation can be left out for transforms that are also turned
+	// outside the ticks (like the camera, by the mouse every frame)
+	void Track(Transform* transform, bool interpolateRotation = true);
+	void Untrack(Transform* transform);
+
+	// Makes a transform's last state its current one, so moving it
+	// somewhere new (like respawning) jumps there instead of sliding
+	void Snap(Transform* transform);
+
+	// The state every tracked transform is in before the next tick
+	void Save();
+
+	// Puts every transform that moved in the last tick between its
+	// saved and current states, t of the way along, then back again
+	void Apply(float t);
+	void Restore();
+
+private:
+	struct TrackedTransform
+	{
+		Transform* Target;
+		bool InterpolateRotation;
+		DirectX::XMFLOAT3 PreviousPosition;
+		DirectX::XMFLOAT3 PreviousPitchYawRoll;
+		DirectX::XMFLOAT3 CurrentPosition;	// Only while applied
+		DirectX::XMFLOAT3 CurrentPitchYawRoll;
+		bool Applied;
+	};
+	std::vector<TrackedTransform> tracked;
+	bool applied;
+};
@@ -0,0 +1,507 @@
+#include "TransformSystem.h"
+#include "Transform.h"
+#include "JobSystem.h"
+#include "SpatialSort.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+
+using namespace DirectX;
+
+
+TransformSystem::TransformSystem()
+{
+	hierarchyChanged = false;
+	lastUpdateCount = 0;
+}
+
+TransformSystem::~TransformSystem()
+{
+	// Hand every transform its data back
+	while (!owners.empty())
+		Remove(owners.back());
+}
+
+// --------------------------------------------------------
+// Resizes every per slot array, keeping the float
+// arrays padded out to a multiple of four
+// --------------------------------------------------------
+void TransformSystem::ResizeArrays(unsigned int count)
+{
+	unsigned int padded = (count + 3) & ~3u;
+	std::vector<float>* floats[] = { &positionX, &positionY, &positionZ, &pitch, &yaw, &roll, &scaleX, &scaleY, &scaleZ };
+	for (auto f : floats)
+		f->resize(padded, 0.0f);
+
+	dirty.resize(count);
+	uniformScales.resize(count);
+	localMatrices.resize(count);
+	worldMatrices.resize(count);
+	worldInverseTransposeMatrices.resize(count);
+	owners.resize(count);
+	parents.resize(count);
+	subtreeEnds.resize(count);
+	externalChildren.resize(count);
+}
+
+// --------------------------------------------------------
+// Moves a transform's data into a new slot at the end
+// --------------------------------------------------------
+void TransformSystem::Add(Transform* transform)
+{
+	if (!transform || transform->system == this)
+		return;
+
+	// Only one system at a time
+	if (transform->system)
+		transform->system->Remove(transform);
+
+	XMFLOAT3 position = transform->GetPosition();
+	XMFLOAT3 pitchYawRoll = transform->GetPitchYawRoll();
+	XMFLOAT3 scale = transform->GetScale();
+
+	unsigned int slot = (unsigned int)owners.size();
+	ResizeArrays(slot + 1);
+	positionX[slot] = position.x;
+	positionY[slot] = position.y;
+	positionZ[slot] = position.z;
+	pitch[slot] = pitchYawRoll.x;
+	yaw[slot] = pitchYawRoll.y;
+	roll[slot] = pitchYawRoll.z;
+	scaleX[slot] = scale.x;
+	scaleY[slot] = scale.y;
+	scaleZ[slot] = scale.z;
+	dirty[slot] = DIRTY_LOCAL | DIRTY_WORLD;
+	owners[slot] = transform;
+
+	transform->system = this;
+	transform->slot = slot;
+	hierarchyChanged = true;
+}
+
+// --------------------------------------------------------
+// Copies a transform's data back into it, and fills its
+// slot with the last one
+// --------------------------------------------------------
+void TransformSystem::Remove(Transform* transform)
+{
+	if (!transform || transform->system != this)
+		return;
+
+	unsigned int slot = transform->slot;
+	transform->position = XMFLOAT3(positionX[slot], positionY[slot], positionZ[slot]);
+	transform->pitchYawRoll = XMFLOAT3(pitch[slot], yaw[slot], roll[slot]);
+	transform->scale = XMFLOAT3(scaleX[slot], scaleY[slot], scaleZ[slot]);
+	transform->matricesDirty = true;
+	transform->system = 0;
+
+	unsigned int last = (unsigned int)owners.size() - 1;
+	if (slot != last)
+	{
+		positionX[slot] = positionX[last];
+		positionY[slot] = positionY[last];
+		positionZ[slot] = positionZ[last];
+		pitch[slot] = pitch[last];
+		yaw[slot] = yaw[last];
+		roll[slot] = roll[last];
+		scaleX[slot] = scaleX[last];
+		scaleY[slot] = scaleY[last];
+		scaleZ[slot] = scaleZ[last];
+		dirty[slot] = dirty[last];
+		uniformScales[slot] = uniformScales[last];
+		localMatrices[slot] = localMatrices[last];
+		worldMatrices[slot] = worldMatrices[last];
+		worldInverseTransposeMatrices[slot] = worldInverseTransposeMatrices[last];
+		owners[slot] = owners[last];
+		owners[slot]->slot = slot;
+	}
+
+	ResizeArrays(last);
+	hierarchyChanged = true;
+}
+
+// Moves one slot's worth of every array into a new order
+template<typename T>
+static void Reorder(std::vector<T>& values, const std::vector<unsigned int>& order)
+{
+	std::vector<T> sorted(values.size());
+	for (size_t i = 0; i < order.size(); i++)
+		sorted[i] = values[order[i]];
+
+	// Keep any padding as it was
+	for (size_t i = order.size(); i < values.size(); i++)
+		sorted[i] = values[i];
+
+	values.swap(sorted);
+}
+
+// --------------------------------------------------------
+// Reorders every slot depth first, so each slot is directly
+// followed by all of its descendants in this system
+//  - Only needed after transforms are added, removed
+//    or reparented, so it's fine for this to chase pointers
+// --------------------------------------------------------
+void TransformSystem::SortHierarchy()
+{
+	unsigned int count = (unsigned int)owners.size();
+	std::vector<unsigned int> order;
+	order.reserve(count);
+
+	std::vector<Transform*> stack;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		// Start from every transform without a parent in this system
+		Transform* parent = owners[i]->parent;
+		if (parent && parent->system == this)
+			continue;
+
+		stack.push_back(owners[i]);
+		while (!stack.empty())
+		{
+			Transform* transform = stack.back();
+			stack.pop_back();
+			order.push_back(transform->slot);
+
+			// Reversed, so children come out in their original order
+			for (size_t c = transform->children.size(); c > 0; c--)
+			{
+				if (transform->children[c - 1]->system == this)
+					stack.push_back(transform->children[c - 1]);
+			}
+		}
+	}
+
+	ApplyOrder(order);
+}
+
+// --------------------------------------------------------
+// Puts the roots' subtrees in Morton order of where each
+// root is (as of its last world matrix), keeping every
+// subtree in one piece and in hierarchy order
+// --------------------------------------------------------
+void TransformSystem::SortSpatially()
+{
+	if (hierarchyChanged)
+		SortHierarchy();
+
+	std::vector<XMFLOAT3> positions(roots.size());
+	for (size_t i = 0; i < roots.size(); i++)
+	{
+		const XMFLOAT4X4& world = worldMatrices[roots[i]];
+		positions[i] = XMFLOAT3(world._41, world._42, world._43);
+	}
+
+	std::vector<unsigned int> rootOrder;
+	SpatialSort::SortByMortonCode(positions, rootOrder);
+
+	std::vector<unsigned int> order;
+	order.reserve(owners.size());
+	for (unsigned int r : rootOrder)
+	{
+		for (unsigned int slot = roots[r]; slot < subtreeEnds[roots[r]]; slot++)
+			order.push_back(slot);
+	}
+	ApplyOrder(order);
+}
+
+// --------------------------------------------------------
+// Moves every slot to its place in the order, where each
+// one has to already be followed by all its descendants,
+// then redoes the hierarchy to match
+// --------------------------------------------------------
+void TransformSystem::ApplyOrder(const std::vector<unsigned int>& order)
+{
+	unsigned int count = (unsigned int)owners.size();
+	Reorder(positionX, order);
+	Reorder(positionY, order);
+	Reorder(positionZ, order);
+	Reorder(pitch, order);
+	Reorder(yaw, order);
+	Reorder(roll, order);
+	Reorder(scaleX, order);
+	Reorder(scaleY, order);
+	Reorder(scaleZ, order);
+	Reorder(dirty, order);
+	Reorder(uniformScales, order);
+	Reorder(localMatrices, order);
+	Reorder(worldMatrices, order);
+	Reorder(worldInverseTransposeMatrices, order);
+	Reorder(owners, order);
+
+	for (unsigned int i = 0; i < count; i++)
+		owners[i]->slot = i;
+
+	// Now the hierarchy itself, in the new order
+	//  - Walking backwards means every child's range is
+	//    finished before its parent extends over it
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Transform* parent = owners[i]->parent;
+		parents[i] = parent && parent->system == this ? (int)parent->slot : -1;
+		subtreeEnds[i] = i + 1;
+
+		externalChildren[i] = 0;
+		for (Transform* child : owners[i]->children)
+			externalChildren[i] |= child->system != this ? 1 : 0;
+	}
+	for (unsigned int i = count; i > 0; i--)
+	{
+		int parent = parents[i - 1];
+		if (parent >= 0 && subtreeEnds[i - 1] > subtreeEnds[parent])
+			subtreeEnds[parent] = subtreeEnds[i - 1];
+	}
+
+	roots.clear();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (parents[i] < 0)
+			roots.push_back(i);
+	}
+
+	hierarchyChanged = false;
+}
+
+// --------------------------------------------------------
+// Flags everything below a transform as needing a new world
+// matrix, which is a single range of slots
+// --------------------------------------------------------
+void TransformSystem::MarkDescendantsDirty(Transform* transform)
+{
+	if (hierarchyChanged)
+		SortHierarchy();
+
+	unsigned int first = transform->slot;
+	for (unsigned int i = first; i < subtreeEnds[first]; i++)
+	{
+		if (i > first)
+		{
+			dirty[i] |= DIRTY_WORLD;
+			owners[i]->version++;
+		}
+
+		// Anything hanging off the range outside of this system
+		// gets marked the usual way
+		if (externalChildren[i])
+		{
+			for (Transform* child : owners[i]->children)
+			{
+				if (child->system == this)
+					continue;
+
+				child->MarkDirty();
+				child->MarkChildTransformsDirty();
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Rebuilds the local (scale, rotation, translation) matrices
+// of four slots at once, starting at the given slot
+//  - Each vector holds the same value for four transforms,
+//    so all twelve sines and cosines take three calls
+//  - Matches XMMatrixRotationRollPitchYaw: roll, then pitch,
+//    then yaw
+// --------------------------------------------------------
+void TransformSystem::UpdateLocalMatrices(unsigned int first)
+{
+	XMVECTOR sp, cp, sy, cy, sr, cr;
+	XMVectorSinCos(&sp, &cp, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&pitch[first])));
+	XMVectorSinCos(&sy, &cy, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&yaw[first])));
+	XMVectorSinCos(&sr, &cr, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&roll[first])));
+
+	XMVECTOR srsp = XMVectorMultiply(sr, sp);
+	XMVECTOR crsp = XMVectorMultiply(cr, sp);
+
+	// Rotation, one element at a time
+	XMVECTOR r00 = XMVectorMultiplyAdd(srsp, sy, XMVectorMultiply(cr, cy));
+	XMVECTOR r01 = XMVectorMultiply(sr, cp);
+	XMVECTOR r02 = XMVectorNegativeMultiplySubtract(cr, sy, XMVectorMultiply(srsp, cy));
+	XMVECTOR r10 = XMVectorNegativeMultiplySubtract(sr, cy, XMVectorMultiply(crsp, sy));
+	XMVECTOR r11 = XMVectorMultiply(cr, cp);
+	XMVECTOR r12 = XMVectorMultiplyAdd(crsp, cy, XMVectorMultiply(sr, sy));
+	XMVECTOR r20 = XMVectorMultiply(cp, sy);
+	XMVECTOR r21 = XMVectorNegate(sp);
+	XMVECTOR r22 = XMVectorMultiply(cp, cy);
+
+	// Scale each row
+	XMVECTOR sx = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&scaleX[first]));
+	XMVECTOR sy_ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&scaleY[first]));
+	XMVECTOR sz = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&scaleZ[first]));
+
+	// Transposing turns "one element of four matrices" into
+	// "one row of each matrix"
+	XMVECTOR zero = XMVectorZero();
+	XMMATRIX row0 = XMMatrixTranspose(XMMATRIX(r00 * sx, r01 * sx, r02 * sx, zero));
+	XMMATRIX row1 = XMMatrixTranspose(XMMATRIX(r10 * sy_, r11 * sy_, r12 * sy_, zero));
+	XMMATRIX row2 = XMMatrixTranspose(XMMATRIX(r20 * sz, r21 * sz, r22 * sz, zero));
+	XMMATRIX row3 = XMMatrixTranspose(XMMATRIX(
+		XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&positionX[first])),
+		XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&positionY[first])),
+		XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&positionZ[first])),
+		XMVectorSplatOne()));
+
+	unsigned int count = (unsigned int)owners.size();
+	for (unsigned int i = 0; i < 4 && first + i < count; i++)
+		XMStoreFloat4x4(&localMatrices[first + i], XMMATRIX(row0.r[i], row1.r[i], row2.r[i], row3.r[i]));
+}
+
+// --------------------------------------------------------
+// Combines a slot's local matrix with its parent's world
+// matrix, which must already be up to date
+// --------------------------------------------------------
+void TransformSystem::UpdateWorldMatrices(unsigned int slot)
+{
+	XMMATRIX world = XMLoadFloat4x4(&localMatrices[slot]);
+	bool uniform = Transform::IsUniformScale(scaleX[slot], scaleY[slot], scaleZ[slot]);
+
+	if (parents[slot] >= 0)
+	{
+		world *= XMLoadFloat4x4(&worldMatrices[parents[slot]]);
+		uniform = uniform && uniformScales[parents[slot]];
+	}
+	else if (owners[slot]->parent)
+	{
+		// Parent outside of this system
+		XMFLOAT4X4 parentWorld = owners[slot]->parent->GetWorldMatrix();
+		world *= XMLoadFloat4x4(&parentWorld);
+		uniform = uniform && owners[slot]->parent->HasUniformScale();
+	}
+
+	XMStoreFloat4x4(&worldMatrices[slot], world);
+	uniformScales[slot] = uniform ? 1 : 0;
+	dirty[slot] = DIRTY_INVERSE_TRANSPOSE;
+}
+
+// --------------------------------------------------------
+// Builds a slot's inverse transpose, if its world matrix
+// has changed since the last time
+// --------------------------------------------------------
+void TransformSystem::UpdateInverseTranspose(unsigned int slot)
+{
+	if (!(dirty[slot] & DIRTY_INVERSE_TRANSPOSE))
+		return;
+
+	XMStoreFloat4x4(&worldInverseTransposeMatrices[slot],
+		Transform::InverseTranspose(XMLoadFloat4x4(&worldMatrices[slot]), uniformScales[slot] != 0));
+	dirty[slot] &= ~DIRTY_INVERSE_TRANSPOSE;
+}
+
+// --------------------------------------------------------
+// Brings a single transform up to date outside of Update(),
+// for transforms read before the system is updated
+// --------------------------------------------------------
+void TransformSystem::UpdateTransform(Transform* transform)
+{
+	if (hierarchyChanged)
+		SortHierarchy();
+
+	// Find the highest dirty ancestor, as a descendant is
+	// always dirty when its parent is
+	unsigned int top = transform->slot;
+	while (parents[top] >= 0 && (dirty[parents[top]] & (DIRTY_LOCAL | DIRTY_WORLD)))
+		top = parents[top];
+
+	// Then work back down through the slots in between, skipping
+	// any that aren't an ancestor (their range doesn't reach it)
+	for (unsigned int i = top; i <= transform->slot; i++)
+	{
+		if (!(dirty[i] & (DIRTY_LOCAL | DIRTY_WORLD)) || subtreeEnds[i] <= transform->slot)
+			continue;
+
+		// The rest of its group of four comes along for free
+		if (dirty[i] & DIRTY_LOCAL)
+			UpdateLocalMatrices(i & ~3u);
+		UpdateWorldMatrices(i);
+	}
+}
+
+// --------------------------------------------------------
+// Rebuilds every dirty matrix: local matrices in groups of
+// four, then world matrices one hierarchy (range) at a time
+// --------------------------------------------------------
+void TransformSystem::Update()
+{
+	if (hierarchyChanged)
+		SortHierarchy();
+
+	JobSystem& jobs = JobSystem::GetInstance();
+	unsigned int count = (unsigned int)owners.size();
+	jobs.ParallelFor((count + 3) / 4, 256, [&](unsigned int start, unsigned int end)
+	{
+		for (unsigned int group = start; group < end; group++)
+		{
+			unsigned int first = group * 4;
+			bool anyDirty = false;
+			for (unsigned int i = first; i < first + 4 && i < count; i++)
+				anyDirty |= (dirty[i] & DIRTY_LOCAL) != 0;
+
+			if (anyDirty)
+				UpdateLocalMatrices(first);
+		}
+	});
+
+	// Parents outside of this system update themselves when read,
+	// so get that out of the way before going wide
+	for (unsigned int root : roots)
+	{
+		if (owners[root]->parent)
+			owners[root]->parent->GetWorldMatrix();
+	}
+
+	// Within each range, parents always come first, so they're
+	// done by the time their children need them
+	std::atomic<unsigned int> updated(0);
+	jobs.ParallelFor((unsigned int)roots.size(), 256, [&](unsigned int start, unsigned int end)
+	{
+		unsigned int rangeUpdated = 0;
+		for (unsigned int r = start; r < end; r++)
+		{
+			for (unsigned int i = roots[r]; i < subtreeEnds[roots[r]]; i++)
+			{
+				if (!(dirty[i] & (DIRTY_LOCAL | DIRTY_WORLD)))
+					continue;
+
+				UpdateWorldMatrices(i);
+				rangeUpdated++;
+			}
+		}
+		updated += rangeUpdated;
+	});
+	lastUpdateCount = updated;
+}
+
+// --------------------------------------------------------
+// Times rebuilding the matrices of "count" transforms with
+// random data, both as regular transforms and in a system
+// --------------------------------------------------------
+void TransformSystem::Benchmark(unsigned int count, double& transformMilliseconds, double& systemMilliseconds)
+{
+	std::unique_ptr<Transform[]> transforms(new Transform[count]);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		transforms[i].SetPosition(rand() / (float)RAND_MAX * 100.0f, rand() / (float)RAND_MAX * 100.0f, rand() / (float)RAND_MAX * 100.0f);
+		transforms[i].SetRotation(rand() / (float)RAND_MAX * XM_2PI, rand() / (float)RAND_MAX * XM_2PI, rand() / (float)RAND_MAX * XM_2PI);
+		transforms[i].SetScale(1.0f + rand() / (float)RAND_MAX, 1.0f + rand() / (float)RAND_MAX, 1.0f + rand() / (float)RAND_MAX);
+	}
+
+	// One at a time, then marked dirty again for the system
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < count; i++)
+		transforms[i].GetWorldMatrix();
+	auto end = std::chrono::high_resolution_clock::now();
+	transformMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	TransformSystem system;
+	for (unsigned int i = 0; i < count; i++)
+		system.Add(&transforms[i]);
+
+	start = std::chrono::high_resolution_clock::now();
+	system.Update();
+	end = std::chrono::high_resolution_clock::now();
+	systemMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+	// The system hands the data back before the transforms go away
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "PortableMath.h"
+#include <vector>
+
+class Transform;
+
+#define DIRTY_LOCAL 1
+#define DIRTY_WORLD 2
+#define DIRTY_INVERSE_TRANSPOSE 4
+
+// Transform data for many transforms at once, stored as separate
+// arrays (SoA) so dirty matrices can be rebuilt four at a time with SIMD
+//  - Transforms added here keep their whole API, but just become
+//    handles into these arrays
+//  - Update() rebuilds every dirty matrix once per frame, and any
+//    transform read before then is brought up to date on its own
+//  - Slots are kept in hierarchy order (each transform directly followed
+//    by everything below it), so world matrices take one linear pass and
+//    marking a subtree dirty is just marking a range of slots
+//  - Transforms in a system must not be copied
+class TransformSystem
+{
+public:
+	TransformSystem();
+	~TransformSystem();
+
+	// Moves a transform's data into the system, or back out of it
+	void Add(Transform* transform);
+	void Remove(Transform* transform);
+	unsigned int GetCount() { return (unsigned int)owners.size(); }
+
+	// Rebuilds every dirty world matrix
+	//  - Inverse transposes are left until they're asked for
+	//  - Spread across the job system, as groups of four local
+	//    matrices and separate hierarchies don't depend on each other
+	void Update();
+
+	// Reorders the slots so separate hierarchies are in Morton order of
+	// where their roots are, for Update() to walk nearby transforms
+	// together (best right after it, while the world matrices are current)
+	void SortSpatially();
+
+	// How many matrices the last Update() rebuilt
+	unsigned int GetLastUpdateCount() { return lastUpdateCount; }
+
+	// Times rebuilding the matrices of this many (all dirty) transforms,
+	// one at a time as regular transforms and all at once in a system
+	static void Benchmark(unsigned int count, double& transformMilliseconds, double& systemMilliseconds);
+
+private:
+	friend class Transform;
+
+	// Raw transformation data, one entry per slot
+	//  - dirty holds DIRTY_LOCAL, DIRTY_WORLD and/or DIRTY_INVERSE_TRANSPOSE,
+	//    the last of which only gets cleared when the matrix is asked for
+	//  - uniformScales flags world matrices with a uniform scale
+	//  - The float arrays are padded to a multiple of four, so
+	//    they can always be loaded four at a time
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> pitch, yaw, roll;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	std::vector<unsigned char> dirty;
+	std::vector<unsigned char> uniformScales;
+	std::vector<DirectX::XMFLOAT4X4> localMatrices;
+	std::vector<DirectX::XMFLOAT4X4> worldMatrices;
+	std::vector<DirectX::XMFLOAT4X4> worldInverseTransposeMatrices;
+	std::vector<Transform*> owners;
+
+	// The hierarchy, flattened
+	//  - parents is the parent's slot, or -1 when it has none in this system
+	//  - subtreeEnds is one past the last slot below each slot
+	//  - externalChildren flags slots with children outside this system
+	std::vector<int> parents;
+	std::vector<unsigned int> subtreeEnds;
+	std::vector<unsigned char> externalChildren;
+	std::vector<unsigned int> roots;
+	bool hierarchyChanged;
+	void SortHierarchy();
+	void ApplyOrder(const std::vector<unsigned int>& order);
+
+	unsigned int lastUpdateCount;
+
+	void ResizeArrays(unsigned int count);
+	void UpdateLocalMatrices(unsigned int first);
+	void UpdateWorldMatrices(unsigned int slot);
+	void UpdateInverseTranspose(unsigned int slot);
+	void UpdateTransform(Transform* transform);
+	void MarkDescendantsDirty(Transform* transform);
+};
@@ -0,0 +1,119 @@
+#include "UploadRing.h"
+#include "GpuMemory.h"
+#include "DrawStats.h"
+
+#include <cstring>
+
+// Singleton requirement
+UploadRing* UploadRing::instance;
+
+void UploadRing::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	this->device = device;
+}
+
+// --------------------------------------------------------
+// Gets a context's ring, which isn't given a buffer until
+// the first upload on that context
+// --------------------------------------------------------
+UploadRing::ContextRing* UploadRing::GetRing(ID3D11DeviceContext* context)
+{
+	std::lock_guard<std::mutex> lock(ringMutex);
+	std::unique_ptr<ContextRing>& ring = rings[context];
+	if (!ring)
+		ring = std::make_unique<ContextRing>();
+	return ring.get();
+}
+
+// --------------------------------------------------------
+// Replaces a ring's buffer with one that fits at least
+// the given size (whatever was in the old one is still
+// around for anything already bound to it)
+// --------------------------------------------------------
+bool UploadRing::Grow(ContextRing* ring, unsigned int size)
+{
+	unsigned int capacity = ring->Capacity ? ring->Capacity : UPLOAD_RING_SIZE;
+	while (capacity < size)
+		capacity *= 2;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = capacity;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_INDEX_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	if (FAILED(GpuMemory::CreateBuffer(device.Get(), &desc, 0, buffer.GetAddressOf(), GpuMemoryCategory::Buffers, "Upload Ring")))
+		return false;
+
+	ring->Buffer = buffer;
+	ring->Capacity = capacity;
+	ring->Offset = capacity; // So the next map discards
+	return true;
+}
+
+// --------------------------------------------------------
+// Appends the data to the calling context's ring
+//  - The first upload of each frame, and any upload that
+//    would run off the end, discards the ring and starts over
+// --------------------------------------------------------
+bool UploadRing::Upload(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const void* data, unsigned int size, unsigned int alignment, UploadSlice& slice)
+{
+	if (size == 0)
+		return false;
+
+	ContextRing* ring = GetRing(context.Get());
+	if (ring->Capacity < size && !Grow(ring, size))
+		return false;
+
+	unsigned int offset = (ring->Offset + alignment - 1) & ~(alignment - 1);
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (ring->Frame != frameIndex || offset + size > ring->Capacity || offset < ring->Offset)
+	{
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		offset = 0;
+		ring->Frame = frameIndex;
+		discards++;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	DrawStats::Count(DrawCounter::Maps);
+	if (FAILED(context->Map(ring->Buffer.Get(), 0, mapType, 0, &mapped)))
+		return false;
+	memcpy((unsigned char*)mapped.pData + offset, data, size);
+	context->Unmap(ring->Buffer.Get(), 0);
+
+	ring->Offset = offset + size;
+	slice.Buffer = ring->Buffer;
+	slice.Offset = offset;
+	slice.Size = size;
+
+	uploads++;
+	bytes += size;
+	return true;
+}
+
+// --------------------------------------------------------
+// Starts a new frame, so each ring's next upload discards
+//  - Only called between frames, with nothing recording
+// --------------------------------------------------------
+void UploadRing::BeginFrame()
+{
+	frameIndex++;
+	uploads = 0;
+	discards = 0;
+	bytes = 0;
+}
+
+UploadRingStats UploadRing::GetStats()
+{
+	UploadRingStats stats = {};
+	stats.Uploads = uploads;
+	stats.Discards = discards;
+	stats.Bytes = bytes;
+
+	std::lock_guard<std::mutex> lock(ringMutex);
+	for (auto& r : rings)
+		stats.Capacity += r.second->Capacity;
+	return stats;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Starting size of each context's ring, which grows (to double
+// whatever didn't fit) if a single upload is ever bigger
+#define UPLOAD_RING_SIZE	(4 * 1024 * 1024)
+
+// Where an upload landed, for binding with an offset
+//  - Holds a reference, since the ring can be replaced when it grows
+struct UploadSlice
+{
+	Microsoft::WRL::ComPtr<ID3D11Buffer> Buffer;
+	unsigned int Offset;
+	unsigned int Size;
+};
+
+struct UploadRingStats
+{
+	unsigned int Uploads;		// Since the start of the frame, across every context
+	unsigned int Discards;		// Maps that started a ring over
+	unsigned long long Bytes;
+	unsigned long long Capacity; // Of every context's ring together
+};
+
+// --------------------------------------------------------
+// Large dynamic vertex and index buffers, one per context,
+// that this frame's transient geometry data is appended to
+// with no-overwrite maps
+//  - The first upload on a context each frame discards, as
+//    does one that runs off the end, so nothing the GPU
+//    could still be reading is ever written over
+//  - Discarding first each frame is also what lets deferred
+//    contexts map it, since each frame's command list starts
+//    with nothing mapped
+//  - Structured buffers have one stride for the whole buffer,
+//    so data read through SRVs keeps its own buffers
+// --------------------------------------------------------
+class UploadRing
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static UploadRing& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new UploadRing();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	UploadRing(UploadRing const&) = delete;
+	void operator=(UploadRing const&) = delete;
+
+private:
+	static UploadRing* instance;
+	UploadRing() {};
+#pragma endregion
+
+public:
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Copies the data into the context's ring, at a multiple
+	// of the alignment (which must be a power of two)
+	bool Upload(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const void* data, unsigned int size, unsigned int alignment, UploadSlice& slice);
+
+	// Every ring starts over with its next upload
+	void BeginFrame();
+	UploadRingStats GetStats();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	struct ContextRing
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> Buffer;
+		unsigned int Capacity = 0;
+		unsigned int Offset = 0;
+		unsigned int Frame = 0;
+	};
+	std::unordered_map<ID3D11DeviceContext*, std::unique_ptr<ContextRing>> rings;
+	std::mutex ringMutex;
+	ContextRing* GetRing(ID3D11DeviceContext* context);
+	bool Grow(ContextRing* ring, unsigned int size);
+
+	unsigned int frameIndex = 1;
+	std::atomic<unsigned int> uploads{ 0 };
+	std::atomic<unsigned int> discards{ 0 };
+	std::atomic<unsigned long long> bytes{ 0 };
+};
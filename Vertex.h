@@ -13,4 +13,18 @@ struct Vertex
 	DirectX::XMFLOAT2 UV;			// Texture mapping
 	DirectX::XMFLOAT3 Normal;		// Lighting
 	DirectX::XMFLOAT3 Tangent;		// Normal mapping
+};
+
+// --------------------------------------------------------
+// A packed copy of a Vertex (24 bytes instead of 44), for
+// meshes created with compact vertices
+//  - Only the vertex buffer uses this, and the "_Compact"
+//    vertex shaders unpack it (see VertexFormat.hlsli)
+// --------------------------------------------------------
+struct CompactVertex
+{
+	DirectX::XMFLOAT3 Position;
+	unsigned int UV;			// Two halfs (x in the low bits)
+	unsigned int Normal;		// Octahedral, as two 16 bit snorms
+	unsigned int Tangent;		// Same as the normal
 };
\ No newline at end of file
@@ -0,0 +1,44 @@
+// Include guard
+#ifndef _VERTEX_FORMAT_HLSL
+#define _VERTEX_FORMAT_HLSL
+
+// Which vertex layout the mesh vertex shaders read
+//  - The full shaders read Vertex (from Vertex.h), and each "_Compact"
+//    wrapper (like VertexShader_Compact.hlsl) defines this before
+//    including the full shader, to read CompactVertex instead
+//  - Compact attributes come in as plain uints and are unpacked here,
+//    so the input layouts built from each shader still match
+#ifndef FEATURE_COMPACT_VERTICES
+#define FEATURE_COMPACT_VERTICES 0
+#endif
+
+#if FEATURE_COMPACT_VERTICES
+typedef uint VertexUV;
+typedef uint VertexDirection;
+#else
+typedef float2 VertexUV;
+typedef float3 VertexDirection;
+#endif
+
+// Full vertices are already unpacked
+float2 DecodeUV(float2 uv) { return uv; }
+float3 DecodeDirection(float3 direction) { return direction; }
+
+// Two halfs, with x in the low bits
+float2 DecodeUV(uint uv)
+{
+	return f16tof32(uint2(uv, uv >> 16));
+}
+
+// Two 16 bit snorms on an octahedron, where the lower half
+// of the sphere was folded out over the upper half's corners
+float3 DecodeDirection(uint packed)
+{
+	float2 f = max(float2(int2(packed << 16, packed) >> 16) / 32767.0f, -1.0f);
+	float3 direction = float3(f, 1.0f - abs(f.x) - abs(f.y));
+	float fold = saturate(-direction.z);
+	direction.xy += direction.xy >= 0.0f ? -fold : fold;
+	return normalize(direction);
+}
+
+#endif
@@ -1,23 +1,25 @@
 
-// Constant Buffer for external (C++) data
-cbuffer externalData : register(b0)
+#include "VertexFormat.hlsli"
+#include "ViewConstants.hlsli"
+
+// Data that changes for each object
+cbuffer perObject : register(b1)
 {
 	matrix world;
 	matrix worldInverseTranspose;
-	matrix view;
-	matrix projection;
-    matrix shadowView;
-    matrix shadowProjection;
+	matrix prevWorld;	// Last frame's, for motion vectors
 	float2 uvScale;
+	uint materialIndex; // Within the material's atlas, if it has one
+	uint lightList;		// Into EntityLightLists, or ENTITY_LIGHT_LIST_NONE
 };
 
 // Struct representing a single vertex worth of data
 struct VertexShaderInput
 {
 	float3 position		: POSITION;
-	float2 uv			: TEXCOORD;
-	float3 normal		: NORMAL;
-	float3 tangent		: TANGENT;
+	VertexUV uv			: TEXCOORD;
+	VertexDirection normal	: NORMAL;
+	VertexDirection tangent	: TANGENT;
 };
 
 // Out of the vertex shader (and eventually input to the PS)
@@ -28,7 +30,10 @@ struct VertexToPixel
 	float3 normal			: NORMAL;
 	float3 tangent			: TANGENT;
 	float3 worldPos			: POSITION; // The world position of this vertex
-    float4 posForShadow		: SHADOWPOS;
+	nointerpolation uint materialIndex : MATERIAL_INDEX; // Only read by atlas shaders
+	nointerpolation uint lightList : LIGHT_LIST;
+	float4 currentClip		: CURRENT_CLIP;	// Both without their jitter, for motion vectors
+	float4 prevClip			: PREV_CLIP;
 };
 
 // --------------------------------------------------------
@@ -43,20 +48,22 @@ VertexToPixel main(VertexShaderInput input)
 	matrix worldViewProj = mul(projection, mul(view, world));
 	output.screenPosition = mul(worldViewProj, float4(input.position, 1.0f));
 
-	// Calculate where this vertex is from the light's point of view
-    matrix shadowWVP = mul(shadowProjection, mul(shadowView, world));
-    output.posForShadow = mul(shadowWVP, float4(input.position, 1.0f));
-	
 	// Calculate the world position of this vertex (to be used
 	// in the pixel shader when we do point/spot lights)
 	output.worldPos = mul(world, float4(input.position, 1.0f)).xyz;
 
 	// Make sure the normal is in WORLD space, not "local" space
-	output.normal = normalize(mul((float3x3)worldInverseTranspose, input.normal));
-	output.tangent = normalize(mul((float3x3)worldInverseTranspose, input.tangent));
+	output.normal = normalize(mul((float3x3)worldInverseTranspose, DecodeDirection(input.normal)));
+	output.tangent = normalize(mul((float3x3)worldInverseTranspose, DecodeDirection(input.tangent)));
 
 	// Pass through the uv
-	output.uv = input.uv * uvScale;
+	output.uv = DecodeUV(input.uv) * uvScale;
+	output.materialIndex = materialIndex;
+	output.lightList = lightList;
+
+	// Where it is and was, for how far it's moved on screen
+	output.currentClip = RemoveJitter(output.screenPosition, jitter);
+	output.prevClip = RemoveJitter(mul(prevViewProjection, mul(prevWorld, float4(input.position, 1.0f))), prevJitter);
 
 	return output;
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "VertexFormat.hlsli"
+#include "ViewConstants.hlsli"
+
+// Data that changes per material
+cbuffer perMaterial : register(b1)
+{
+	float2 uvScale;
+};
+
+// Struct representing a single vertex worth of data, along
+// with the data for the instance it belongs to
+//  - "_PER_INSTANCE" semantics come from the instance buffer
+//    (input slot 1), which holds InstanceData from RenderQueue.h
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+	VertexUV uv			: TEXCOORD;
+	VertexDirection normal	: NORMAL;
+	VertexDirection tangent	: TANGENT;
+
+	float4 world0		: WORLD_PER_INSTANCE0;
+	float4 world1		: WORLD_PER_INSTANCE1;
+	float4 world2		: WORLD_PER_INSTANCE2;
+	float4 world3		: WORLD_PER_INSTANCE3;
+	float4 worldIT0		: WORLDIT_PER_INSTANCE0;
+	float4 worldIT1		: WORLDIT_PER_INSTANCE1;
+	float4 worldIT2		: WORLDIT_PER_INSTANCE2;
+	float4 worldIT3		: WORLDIT_PER_INSTANCE3;
+	uint materialIndex	: MATERIAL_PER_INSTANCE;
+	uint lightList		: LIGHTS_PER_INSTANCE;
+	float4 prevWorld0	: PREVWORLD_PER_INSTANCE0;
+	float4 prevWorld1	: PREVWORLD_PER_INSTANCE1;
+	float4 prevWorld2	: PREVWORLD_PER_INSTANCE2;
+	float4 prevWorld3	: PREVWORLD_PER_INSTANCE3;
+};
+
+// Out of the vertex shader (and eventually input to the PS)
+struct VertexToPixel
+{
+	float4 screenPosition	: SV_POSITION;
+	float2 uv				: TEXCOORD;
+	float3 normal			: NORMAL;
+	float3 tangent			: TANGENT;
+	float3 worldPos			: POSITION; // The world position of this vertex
+	nointerpolation uint materialIndex : MATERIAL_INDEX; // Only read by atlas shaders
+	nointerpolation uint lightList : LIGHT_LIST;
+	float4 currentClip		: CURRENT_CLIP;	// Both without their jitter, for motion vectors
+	float4 prevClip			: PREV_CLIP;
+};
+
+// --------------------------------------------------------
+// The entry point (main method) for our vertex shader
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input)
+{
+	// Set up output
+	VertexToPixel output;
+
+	// Instance matrices arrive as rows of the C++ (row major) matrices,
+	// so they multiply from the right, unlike the cbuffer matrices
+	matrix world = matrix(input.world0, input.world1, input.world2, input.world3);
+	matrix worldInverseTranspose = matrix(input.worldIT0, input.worldIT1, input.worldIT2, input.worldIT3);
+
+	// Calculate the world position of this vertex (to be used
+	// in the pixel shader when we do point/spot lights)
+	float4 worldPos = mul(float4(input.position, 1.0f), world);
+	output.worldPos = worldPos.xyz;
+
+	// Calculate output position
+	output.screenPosition = mul(projection, mul(view, worldPos));
+
+	// Make sure the normal is in WORLD space, not "local" space
+	output.normal = normalize(mul(DecodeDirection(input.normal), (float3x3)worldInverseTranspose));
+	output.tangent = normalize(mul(DecodeDirection(input.tangent), (float3x3)worldInverseTranspose));
+
+	// Pass through the uv
+	output.uv = DecodeUV(input.uv) * uvScale;
+	output.materialIndex = input.materialIndex;
+	output.lightList = input.lightList;
+
+	// Where it is and was, for how far it's moved on screen
+	matrix prevWorld = matrix(input.prevWorld0, input.prevWorld1, input.prevWorld2, input.prevWorld3);
+	output.currentClip = RemoveJitter(output.screenPosition, jitter);
+	output.prevClip = RemoveJitter(mul(prevViewProjection, mul(float4(input.position, 1.0f), prevWorld)), prevJitter);
+
+	return output;
+}
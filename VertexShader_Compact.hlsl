@@ -0,0 +1,5 @@
+// VertexShader.hlsl for meshes with compact vertices
+//  - See VertexFormat.hlsli
+#define FEATURE_COMPACT_VERTICES 1
+
+#include "VertexShader.hlsl"
@@ -0,0 +1,30 @@
+// Include guard
+#ifndef _VIEW_CONSTANTS_HLSL
+#define _VIEW_CONSTANTS_HLSL
+
+// One camera's view, and everything worked out from it
+//  - Owned by the camera, which only re-uploads it when the view
+//    changes, and bound by the renderer to every shader including
+//    this, so this layout must match ViewConstants in Camera.h
+cbuffer perFrame : register(b0)
+{
+	matrix view;
+	matrix projection;
+	matrix viewProjection;
+	matrix invView;
+	matrix invProjection;
+	matrix invViewProjection;
+	matrix prevViewProjection;
+	float4 frustumPlanes[6];	// World space, left right bottom top near far
+	float2 jitter;				// In NDC, already part of the projection
+	float2 prevJitter;			// Part of the previous view projection
+};
+
+// Takes a clip space position's share of the jitter back out, for
+// motion vectors (which shouldn't include the jitter's wobble)
+float4 RemoveJitter(float4 clipPosition, float2 offset)
+{
+	return float4(clipPosition.xy - offset * clipPosition.w, clipPosition.zw);
+}
+
+#endif